@@ -8,6 +8,8 @@
 #pragma once
 
 #include <memory>
+#include <new>
+#include <stddef.h>
 #include <tuple>
 #include <type_traits>
 #include <utility>
@@ -23,6 +25,60 @@ enum ConnectionType {
 	ConnectionTypeBlocking,
 };
 
+namespace details {
+
+class BoundMethodPool
+{
+public:
+	static void *allocate(size_t size);
+	static void deallocate(void *ptr, size_t size) noexcept;
+};
+
+template<typename T>
+class BoundMethodPackAllocator
+{
+public:
+	using value_type = T;
+
+	BoundMethodPackAllocator() = default;
+
+	template<typename U>
+	BoundMethodPackAllocator([[maybe_unused]] const BoundMethodPackAllocator<U> &other)
+	{
+	}
+
+	T *allocate(size_t n)
+	{
+		if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			return static_cast<T *>(::operator new(n * sizeof(T),
+							       std::align_val_t(alignof(T))));
+		else
+			return static_cast<T *>(BoundMethodPool::allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T *ptr, size_t n) noexcept
+	{
+		if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			::operator delete(ptr, std::align_val_t(alignof(T)));
+		else
+			BoundMethodPool::deallocate(ptr, n * sizeof(T));
+	}
+
+	template<typename U>
+	bool operator==([[maybe_unused]] const BoundMethodPackAllocator<U> &other) const
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=([[maybe_unused]] const BoundMethodPackAllocator<U> &other) const
+	{
+		return false;
+	}
+};
+
+} /* namespace details */
+
 class BoundMethodPackBase
 {
 public:
@@ -72,6 +128,16 @@ public:
 	}
 	virtual ~BoundMethodBase() = default;
 
+	static void *operator new(size_t size)
+	{
+		return details::BoundMethodPool::allocate(size);
+	}
+
+	static void operator delete(void *ptr, size_t size) noexcept
+	{
+		details::BoundMethodPool::deallocate(ptr, size);
+	}
+
 	template<typename T, std::enable_if_t<!std::is_same<Object, T>::value> * = nullptr>
 	bool match(T *obj) { return obj == obj_; }
 	bool match(Object *object) { return object == object_; }
@@ -81,7 +147,16 @@ public:
 	virtual void invokePack(BoundMethodPackBase *pack) = 0;
 
 protected:
-	bool activatePack(std::shared_ptr<BoundMethodPackBase> pack,
+	template<typename PackType, typename... Args>
+	static std::shared_ptr<PackType> createPack(Args... args)
+	{
+		return std::allocate_shared<PackType>(details::BoundMethodPackAllocator<PackType>(),
+						      args...);
+	}
+
+	ConnectionType resolveConnectionType() const;
+	bool activatePack(ConnectionType type,
+			  std::shared_ptr<BoundMethodPackBase> pack,
 			  bool deleteMethod);
 
 	void *obj_;
@@ -145,8 +220,14 @@ public:
 		if (!this->object_)
 			return func_(args...);
 
-		auto pack = std::make_shared<PackType>(args...);
-		bool sync = BoundMethodBase::activatePack(pack, deleteMethod);
+		ConnectionType type = this->resolveConnectionType();
+		if (type == ConnectionTypeDirect) {
+			std::unique_ptr<BoundMethodBase> self(deleteMethod ? this : nullptr);
+			return func_(args...);
+		}
+
+		auto pack = this->template createPack<PackType>(args...);
+		bool sync = BoundMethodBase::activatePack(type, pack, deleteMethod);
 		return sync ? pack->returnValue() : R();
 	}
 
@@ -175,13 +256,19 @@ public:
 
 	R activate(Args... args, bool deleteMethod = false) override
 	{
-		if (!this->object_) {
-			T *obj = static_cast<T *>(this->obj_);
+		T *obj = static_cast<T *>(this->obj_);
+
+		if (!this->object_)
+			return (obj->*func_)(args...);
+
+		ConnectionType type = this->resolveConnectionType();
+		if (type == ConnectionTypeDirect) {
+			std::unique_ptr<BoundMethodBase> self(deleteMethod ? this : nullptr);
 			return (obj->*func_)(args...);
 		}
 
-		auto pack = std::make_shared<PackType>(args...);
-		bool sync = BoundMethodBase::activatePack(pack, deleteMethod);
+		auto pack = this->template createPack<PackType>(args...);
+		bool sync = BoundMethodBase::activatePack(type, pack, deleteMethod);
 		return sync ? pack->returnValue() : R();
 	}
 
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Epoll-based event dispatcher
+ */
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <libcamera/base/private.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/timer_queue.h>
+#include <libcamera/base/unique_fd.h>
+#include <libcamera/base/utils.h>
+
+struct epoll_event;
+
+namespace libcamera {
+
+class EventNotifier;
+class Timer;
+
+class EventDispatcherEpoll final : public EventDispatcher
+{
+public:
+	EventDispatcherEpoll();
+	~EventDispatcherEpoll();
+
+	bool isValid() const { return epollfd_.isValid(); }
+
+	void registerEventNotifier(EventNotifier *notifier);
+	void unregisterEventNotifier(EventNotifier *notifier);
+
+	void registerTimer(Timer *timer);
+	void unregisterTimer(Timer *timer);
+
+	void processEvents();
+	void interrupt();
+
+private:
+	struct EventNotifierSetEpoll {
+		uint32_t events() const;
+		EventNotifier *notifiers[3] = {};
+	};
+
+	int updateNotifiers(int op, int fd, const EventNotifierSetEpoll &set);
+	void armTimerfd();
+	void processInterrupt();
+	void processTimerfd();
+	void processNotifiers(const struct epoll_event &event);
+	void processTimers();
+
+	std::map<int, EventNotifierSetEpoll> notifiers_;
+	std::vector<int> unregisteredFds_;
+	TimerQueue timers_;
+	UniqueFD epollfd_;
+	UniqueFD eventfd_;
+	UniqueFD timerfd_;
+	utils::time_point timerfdDeadline_;
+
+	bool processingEvents_;
+};
+
+} /* namespace libcamera */
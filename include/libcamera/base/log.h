@@ -33,6 +33,7 @@ public:
 	const std::string &name() const { return name_; }
 	LogSeverity severity() const { return severity_; }
 	void setSeverity(LogSeverity severity);
+	bool enabled(LogSeverity severity) const { return severity >= severity_; }
 
 	static const LogCategory &defaultCategory();
 
@@ -70,7 +71,9 @@ public:
 	const utils::time_point &timestamp() const { return timestamp_; }
 	LogSeverity severity() const { return severity_; }
 	const LogCategory &category() const { return category_; }
-	const std::string &fileInfo() const { return fileInfo_; }
+	const char *fileName() const { return fileName_; }
+	unsigned int line() const { return line_; }
+	std::string fileInfo() const;
 	const std::string &prefix() const { return prefix_; }
 	const std::string msg() const { return msgStream_.str(); }
 
@@ -83,7 +86,8 @@ private:
 	const LogCategory &category_;
 	LogSeverity severity_;
 	utils::time_point timestamp_;
-	std::string fileInfo_;
+	const char *fileName_;
+	unsigned int line_;
 	std::string prefix_;
 };
 
@@ -107,19 +111,38 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
 #ifndef __DOXYGEN__
 #define _LOG_CATEGORY(name) logCategory##name
 
+/*
+ * Skip the construction and formatting of the message when the category
+ * doesn't print it. The macros expand to a single expression, which keeps
+ * them safe to use in if/else statements without braces.
+ */
+struct LogMessageVoidify {
+	void operator&(std::ostream &) {}
+};
+
 #define _LOG1(severity) \
-	_log(nullptr, Log##severity).stream()
+	!LogCategory::defaultCategory().enabled(Log##severity) ? (void)0 : \
+	LogMessageVoidify() & _log(nullptr, Log##severity).stream()
 #define _LOG2(category, severity) \
-	_log(&_LOG_CATEGORY(category)(), Log##severity).stream()
+	!_LOG_CATEGORY(category)().enabled(Log##severity) ? (void)0 : \
+	LogMessageVoidify() & _log(&_LOG_CATEGORY(category)(), Log##severity).stream()
+
+#define _LOG_ENABLED1(severity) \
+	LogCategory::defaultCategory().enabled(Log##severity)
+#define _LOG_ENABLED2(category, severity) \
+	_LOG_CATEGORY(category)().enabled(Log##severity)
 
 /*
- * Expand the LOG() macro to _LOG1() or _LOG2() based on the number of
- * arguments.
+ * Expand the LOG() and LOG_ENABLED() macros to their 1 or 2 argument variants
+ * based on the number of arguments.
  */
 #define _LOG_MACRO(_1, _2, NAME, ...) NAME
 #define LOG(...) _LOG_MACRO(__VA_ARGS__, _LOG2, _LOG1)(__VA_ARGS__)
+#define LOG_ENABLED(...) \
+	_LOG_MACRO(__VA_ARGS__, _LOG_ENABLED2, _LOG_ENABLED1)(__VA_ARGS__)
 #else /* __DOXYGEN___ */
 #define LOG(category, severity)
+#define LOG_ENABLED(category, severity)
 #endif /* __DOXYGEN__ */
 
 #ifndef NDEBUG
@@ -23,10 +23,19 @@ public:
 
 	using Seals = Flags<Seal>;
 
+	enum class Option {
+		None = 0,
+		HugePages = (1 << 0),
+	};
+
+	using Options = Flags<Option>;
+
 	static UniqueFD create(const char *name, std::size_t size,
-			       Seals seals = Seal::None);
+			       Seals seals = Seal::None,
+			       Options options = Option::None);
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(MemFd::Seal)
+LIBCAMERA_FLAGS_ENABLE_OPERATORS(MemFd::Option)
 
 } /* namespace libcamera */
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Lightweight metrics registry
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/private.h>
+
+#include <libcamera/base/class.h>
+
+namespace libcamera {
+
+class Metric
+{
+public:
+	enum class Type {
+		Counter,
+		Gauge,
+		Histogram,
+	};
+
+	struct Sample {
+		std::string name;
+		std::string camera;
+		Type type;
+		double value;
+		std::vector<double> bounds;
+		std::vector<uint64_t> buckets;
+		uint64_t count;
+	};
+
+	~Metric();
+
+	const std::string &name() const { return name_; }
+	const std::string &camera() const { return camera_; }
+	Type type() const { return type_; }
+
+	static std::vector<Sample> snapshot();
+	static std::string toPrometheus(const std::vector<Sample> &samples);
+
+protected:
+	Metric(Type type, const std::string &name, const std::string &camera,
+	       const std::vector<double> &bounds = {});
+
+	std::atomic<int64_t> value_;
+
+	std::vector<double> bounds_;
+	std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+	std::atomic<uint64_t> count_;
+	std::atomic<double> sum_;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(Metric)
+
+	Sample sample() const;
+
+	Type type_;
+	std::string name_;
+	std::string camera_;
+};
+
+class CounterMetric : public Metric
+{
+public:
+	CounterMetric(const std::string &name, const std::string &camera = {});
+
+	void increment(uint64_t value = 1)
+	{
+		value_.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+};
+
+class GaugeMetric : public Metric
+{
+public:
+	GaugeMetric(const std::string &name, const std::string &camera = {});
+
+	void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+	void add(int64_t value)
+	{
+		value_.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	int64_t value() const { return value_.load(std::memory_order_relaxed); }
+};
+
+class HistogramMetric : public Metric
+{
+public:
+	HistogramMetric(const std::string &name, const std::string &camera,
+			const std::vector<double> &bounds);
+
+	void observe(double value);
+
+	const std::vector<double> &bounds() const { return bounds_; }
+	uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+};
+
+} /* namespace libcamera */
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <vector>
@@ -65,7 +66,7 @@ private:
 
 	Thread *thread_;
 	std::list<SignalBase *> signals_;
-	unsigned int pendingMessages_;
+	std::atomic<unsigned int> pendingMessages_;
 };
 
 } /* namespace libcamera */
@@ -8,8 +8,9 @@
 #pragma once
 
 #include <functional>
-#include <list>
+#include <stddef.h>
 #include <type_traits>
+#include <vector>
 
 #include <libcamera/base/bound_method.h>
 
@@ -23,15 +24,27 @@ public:
 	void disconnect(Object *object);
 
 protected:
-	using SlotList = std::list<BoundMethodBase *>;
+	using SlotList = std::vector<BoundMethodBase *>;
+
+	struct Emission {
+		bool destroyed = false;
+		SlotList disconnected;
+	};
+
+	~SignalBase();
 
 	void connect(BoundMethodBase *slot);
 	void disconnect(std::function<bool(SlotList::iterator &)> match);
 
-	SlotList slots();
+	size_t beginEmission(Emission *emission);
+	BoundMethodBase *slot(size_t index);
+	void endEmission(Emission *emission);
+	static void abortEmission(Emission *emission);
 
 private:
 	SlotList slots_;
+	SlotList disconnected_;
+	std::vector<Emission *> emissions_;
 };
 
 template<typename... Args>
@@ -146,11 +159,32 @@ public:
 	void emit(Args... args)
 	{
 		/*
-		 * Make a copy of the slots list as the slot could call the
-		 * disconnect operation, invalidating the iterator.
+		 * Iterate over the slots by index, as a slot could connect
+		 * or disconnect slots. Slots connected during the emission
+		 * are not invoked, and disconnected slots are cleared until
+		 * the emission ends.
+		 *
+		 * A slot may also destroy the signal. The emission state lives
+		 * on the stack to detect that case, and the signal must not be
+		 * accessed anymore once it is flagged as destroyed.
 		 */
-		for (BoundMethodBase *slot : slots())
+		Emission emission;
+		size_t count = beginEmission(&emission);
+
+		for (size_t i = 0; i < count; ++i) {
+			BoundMethodBase *slot = this->slot(i);
+			if (!slot)
+				continue;
+
 			static_cast<BoundMethodArgs<void, Args...> *>(slot)->activate(args...);
+
+			if (emission.destroyed) {
+				abortEmission(&emission);
+				return;
+			}
+		}
+
+		endEmission(&emission);
 	}
 };
 
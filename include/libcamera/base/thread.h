@@ -8,8 +8,10 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <sys/types.h>
 #include <thread>
+#include <vector>
 
 #include <libcamera/base/private.h>
 
@@ -28,9 +30,29 @@ class ThreadMain;
 class Thread
 {
 public:
-	Thread();
+	enum class SchedulingPolicy {
+		Other,
+		Batch,
+		Idle,
+		Fifo,
+		RoundRobin,
+	};
+
+	enum class Role {
+		Default,
+		LatencyCritical,
+		Housekeeping,
+	};
+
+	Thread(std::string name = {});
 	virtual ~Thread();
 
+	const std::string &name() const;
+
+	int setAffinity(const std::vector<unsigned int> &cpus);
+	int setSchedulingPolicy(SchedulingPolicy policy, int priority = 0);
+	void setRole(Role role);
+
 	void start();
 	void exit(int code = 0);
 	bool wait(utils::duration duration = utils::duration::max());
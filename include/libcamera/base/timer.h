@@ -17,6 +17,7 @@
 namespace libcamera {
 
 class Message;
+class TimerQueue;
 
 class Timer : public Object
 {
@@ -37,11 +38,18 @@ protected:
 	void message(Message *msg) override;
 
 private:
+	friend class TimerQueue;
+
 	void registerTimer();
 	void unregisterTimer();
 
 	bool running_;
 	std::chrono::steady_clock::time_point deadline_;
+
+	/* Links in the TimerQueue of the event dispatcher */
+	TimerQueue *queue_;
+	Timer *prev_;
+	Timer *next_;
 };
 
 } /* namespace libcamera */
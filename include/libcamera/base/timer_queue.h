@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Queue of timers ordered by deadline
+ */
+
+#pragma once
+
+#include <libcamera/base/private.h>
+
+#include <libcamera/base/class.h>
+
+namespace libcamera {
+
+class Timer;
+
+class TimerQueue
+{
+public:
+	TimerQueue();
+	~TimerQueue();
+
+	bool empty() const { return !head_; }
+	Timer *front() const { return head_; }
+
+	void insert(Timer *timer);
+	void remove(Timer *timer);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(TimerQueue)
+
+	Timer *head_;
+	Timer *tail_;
+};
+
+} /* namespace libcamera */
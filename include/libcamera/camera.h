@@ -65,6 +65,11 @@ public:
 		Invalid,
 	};
 
+	enum class MetadataMode {
+		Full,
+		Delta,
+	};
+
 	using iterator = std::vector<StreamConfiguration>::iterator;
 	using const_iterator = std::vector<StreamConfiguration>::const_iterator;
 
@@ -94,6 +99,7 @@ public:
 
 	std::optional<SensorConfiguration> sensorConfig;
 	Orientation orientation;
+	MetadataMode metadataMode;
 
 protected:
 	CameraConfiguration();
@@ -144,9 +150,15 @@ public:
 	}
 
 	int configure(CameraConfiguration *config);
+	int reconfigure(CameraConfiguration *config);
 
 	std::unique_ptr<Request> createRequest(uint64_t cookie = 0);
 	int queueRequest(Request *request);
+	int queueRequests(Span<Request *const> requests);
+
+	int enableCompletionQueue(unsigned int capacity);
+	int completionFd() const;
+	std::size_t popCompletedRequests(Span<Request *> requests);
 
 	int start(const ControlList *controls = nullptr);
 	int stop();
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Synchronized capture from multiple cameras
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+
+namespace libcamera {
+
+class Camera;
+class Request;
+
+class CameraGroup : public Extensible
+{
+	LIBCAMERA_DECLARE_PRIVATE()
+
+public:
+	CameraGroup(const std::vector<std::shared_ptr<Camera>> &cameras);
+	~CameraGroup();
+
+	const std::vector<std::shared_ptr<Camera>> &cameras() const;
+
+	void setTolerance(std::chrono::nanoseconds tolerance);
+
+	int start();
+	int stop();
+
+	int queueRequests(const std::vector<Request *> &requests);
+
+	Signal<const std::vector<Request *> &> requestsCompleted;
+	Signal<Request *> requestDropped;
+
+private:
+	LIBCAMERA_DISABLE_COPY(CameraGroup)
+};
+
+} /* namespace libcamera */
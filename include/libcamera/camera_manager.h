@@ -8,6 +8,7 @@
 #pragma once
 
 #include <memory>
+#include <stdint.h>
 #include <string>
 #include <sys/types.h>
 #include <vector>
@@ -24,6 +25,29 @@ class CameraManager : public Object, public Extensible
 {
 	LIBCAMERA_DECLARE_PRIVATE()
 public:
+	struct MemoryUsage {
+		std::string category;
+		std::string heap;
+		std::size_t size;
+		unsigned int count;
+	};
+
+	struct MetricSample {
+		enum class Type {
+			Counter,
+			Gauge,
+			Histogram,
+		};
+
+		std::string name;
+		std::string camera;
+		Type type;
+		double value;
+		std::vector<double> bounds;
+		std::vector<uint64_t> buckets;
+		uint64_t count;
+	};
+
 	CameraManager();
 	~CameraManager();
 
@@ -33,6 +57,11 @@ public:
 	std::vector<std::shared_ptr<Camera>> cameras() const;
 	std::shared_ptr<Camera> get(const std::string &id);
 
+	std::vector<MemoryUsage> memoryUsage() const;
+
+	std::vector<MetricSample> metrics() const;
+	std::string prometheusMetrics() const;
+
 	static const std::string &version() { return version_; }
 
 	Signal<std::shared_ptr<Camera>> cameraAdded;
@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/class.h>
@@ -148,7 +149,9 @@ public:
 	~ControlValue();
 
 	ControlValue(const ControlValue &other);
+	ControlValue(ControlValue &&other) noexcept;
 	ControlValue &operator=(const ControlValue &other);
+	ControlValue &operator=(ControlValue &&other) noexcept;
 
 	ControlType type() const { return type_; }
 	bool isNone() const { return type_ == ControlTypeNone; }
@@ -219,12 +222,15 @@ public:
 		     std::size_t numElements = 1);
 
 private:
+	static constexpr std::size_t kInlineStorageSize = 40;
+
 	ControlType type_ : 8;
 	bool isArray_;
 	std::size_t numElements_ : 32;
 	union {
 		uint64_t value_;
 		void *storage_;
+		uint8_t inlineStorage_[kInlineStorageSize];
 	};
 
 	void release();
@@ -339,12 +345,12 @@ public:
 	using Map = std::unordered_map<const ControlId *, ControlInfo>;
 
 	ControlInfoMap() = default;
-	ControlInfoMap(const ControlInfoMap &other) = default;
+	ControlInfoMap(const ControlInfoMap &other);
 	ControlInfoMap(std::initializer_list<Map::value_type> init,
 		       const ControlIdMap &idmap);
 	ControlInfoMap(Map &&info, const ControlIdMap &idmap);
 
-	ControlInfoMap &operator=(const ControlInfoMap &other) = default;
+	ControlInfoMap &operator=(const ControlInfoMap &other);
 
 	using Map::key_type;
 	using Map::mapped_type;
@@ -372,15 +378,23 @@ public:
 	const ControlIdMap &idmap() const { return *idmap_; }
 
 private:
+	struct IndexRange {
+		unsigned int first;
+		std::vector<iterator> entries;
+	};
+
 	bool validate();
+	void buildIndex();
+	iterator lookup(unsigned int id) const;
 
 	const ControlIdMap *idmap_ = nullptr;
+	std::vector<IndexRange> index_;
 };
 
 class ControlList
 {
 private:
-	using ControlListMap = std::unordered_map<unsigned int, ControlValue>;
+	using ControlListMap = std::vector<std::pair<unsigned int, ControlValue>>;
 
 public:
 	enum class MergePolicy {
@@ -411,12 +425,11 @@ public:
 	template<typename T>
 	std::optional<T> get(const Control<T> &ctrl) const
 	{
-		const auto entry = controls_.find(ctrl.id());
-		if (entry == controls_.end())
+		const ControlValue *val = lookup(ctrl.id());
+		if (!val)
 			return std::nullopt;
 
-		const ControlValue &val = entry->second;
-		return val.get<T>();
+		return val->get<T>();
 	}
 
 	template<typename T, typename V>
@@ -446,6 +459,7 @@ public:
 	const ControlIdMap *idMap() const { return idmap_; }
 
 private:
+	const ControlValue *lookup(unsigned int id) const;
 	const ControlValue *find(unsigned int id) const;
 	ControlValue *find(unsigned int id);
 
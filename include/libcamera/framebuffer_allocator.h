@@ -9,6 +9,7 @@
 
 #include <map>
 #include <memory>
+#include <stddef.h>
 #include <vector>
 
 #include <libcamera/base/class.h>
@@ -16,6 +17,7 @@
 namespace libcamera {
 
 class Camera;
+class CameraConfiguration;
 class FrameBuffer;
 class Stream;
 
@@ -31,11 +33,20 @@ public:
 	bool allocated() const { return !buffers_.empty(); }
 	const std::vector<std::unique_ptr<FrameBuffer>> &buffers(Stream *stream) const;
 
+	void setMemoryLimit(size_t limit) { memoryLimit_ = limit; }
+	size_t memoryLimit() const { return memoryLimit_; }
+	size_t memoryUsage() const { return memoryUsage_; }
+
+	static size_t memoryRequirement(const CameraConfiguration &config);
+
 private:
 	LIBCAMERA_DISABLE_COPY(FrameBufferAllocator)
 
 	std::shared_ptr<Camera> camera_;
 	std::map<Stream *, std::vector<std::unique_ptr<FrameBuffer>>> buffers_;
+
+	size_t memoryLimit_;
+	size_t memoryUsage_;
 };
 
 } /* namespace libcamera */
@@ -14,12 +14,16 @@
 #include <string>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/metrics.h>
 
 #include <libcamera/camera.h>
 
+#include "libcamera/internal/completion_queue.h"
+
 namespace libcamera {
 
 class CameraControlValidator;
+class FrameTimingMonitor;
 class PipelineHandler;
 class Stream;
 
@@ -39,8 +43,16 @@ public:
 
 	uint32_t requestSequence_;
 
+	std::unique_ptr<GaugeMetric> queuedRequestsMetric_;
+	std::unique_ptr<CounterMetric> completedRequestsMetric_;
+	std::unique_ptr<CounterMetric> cancelledRequestsMetric_;
+	std::unique_ptr<FrameTimingMonitor> frameTimingMonitor_;
+
 	const CameraControlValidator *validator() const { return validator_.get(); }
 
+	void reportMetadata(Request *request);
+	void monitorFrameTiming(const Request *request);
+
 private:
 	enum State {
 		CameraAvailable,
@@ -57,6 +69,8 @@ private:
 	int isAccessAllowed(State low, State high,
 			    bool allowDisconnected = false,
 			    const char *from = __builtin_FUNCTION()) const;
+	int validateRequest(const Request *request) const;
+	int applyConfiguration(CameraConfiguration *config, bool reconfigure);
 
 	void disconnect();
 	void setState(State state);
@@ -70,6 +84,11 @@ private:
 	std::atomic<State> state_;
 
 	std::unique_ptr<CameraControlValidator> validator_;
+
+	std::unique_ptr<CompletionQueue> completionQueue_;
+
+	CameraConfiguration::MetadataMode metadataMode_;
+	ControlList reportedMetadata_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Camera group private data
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/camera_group.h>
+
+namespace libcamera {
+
+class CameraGroup::Private : public Extensible::Private
+{
+	LIBCAMERA_DECLARE_PUBLIC(CameraGroup)
+
+public:
+	Private(const std::vector<std::shared_ptr<Camera>> &cameras);
+	~Private();
+
+	void reset();
+	void applyTiming(unsigned int index, Request *request);
+	void requestComplete(unsigned int index, Request *request);
+
+	std::vector<std::shared_ptr<Camera>> cameras_;
+	std::chrono::nanoseconds tolerance_;
+
+private:
+	struct Member {
+		bool frameDurationControl;
+		std::deque<Request *> pending;
+		std::optional<int64_t> timestamp;
+		std::optional<int64_t> frameDuration;
+	};
+
+	void updateTiming(unsigned int index, Request *request)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+	void match(std::vector<std::vector<Request *>> *sets,
+		   std::vector<Request *> *dropped)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	Mutex mutex_;
+	std::vector<Member> members_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::optional<int64_t> referenceDuration_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
@@ -64,6 +64,9 @@ private:
 
 	std::unique_ptr<DeviceEnumerator> enumerator_;
 
+	bool usePipelineThreads_;
+	std::vector<std::unique_ptr<Thread>> pipelineThreads_;
+
 	std::unique_ptr<IPAManager> ipaManager_;
 	ProcessManager processManager_;
 };
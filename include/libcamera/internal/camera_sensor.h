@@ -86,6 +86,16 @@ protected:
 private:
 	LIBCAMERA_DISABLE_COPY(CameraSensor)
 
+	struct Mode {
+		unsigned int code;
+		Size size;
+	};
+
+	int initModes();
+	std::string modeCachePath() const;
+	bool loadModes(const std::string &path);
+	void storeModes(const std::string &path) const;
+
 	int generateId();
 	int validateSensorDriver();
 	void initVimcDefaultProperties();
@@ -104,7 +114,8 @@ private:
 	std::string model_;
 	std::string id_;
 
-	V4L2Subdevice::Formats formats_;
+	/* Supported modes, sorted by increasing area */
+	std::vector<Mode> modes_;
 	std::vector<unsigned int> mbusCodes_;
 	std::vector<Size> sizes_;
 	std::vector<controls::draft::TestPatternModeEnum> testPatternModes_;
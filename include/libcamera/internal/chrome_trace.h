@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Chrome JSON trace event output
+ */
+
+#pragma once
+
+#include <fstream>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <type_traits>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/request.h>
+
+#include "libcamera/internal/trace_ring.h"
+
+namespace libcamera {
+
+class FrameBuffer;
+
+class ChromeTrace
+{
+public:
+	enum class Flow {
+		None,
+		Begin,
+		Step,
+		End,
+	};
+
+	~ChromeTrace();
+
+	static ChromeTrace *instance();
+
+	template<typename... Args>
+	static void trace(const char *name, Args... args)
+	{
+		ChromeTrace *trace = instance();
+		if (trace)
+			trace->tracepoint(name, args...);
+	}
+
+	static void traceFrame(const char *pipe, FrameStage stage, uint32_t frame)
+	{
+		ChromeTrace *trace = instance();
+		if (trace)
+			trace->recordFrame(pipe, stage, frame);
+	}
+
+	static void begin(const char *pipe, const char *func)
+	{
+		ChromeTrace *trace = instance();
+		if (trace)
+			trace->recordDuration('B', pipe, func);
+	}
+
+	static void end(const char *pipe, const char *func)
+	{
+		ChromeTrace *trace = instance();
+		if (trace)
+			trace->recordDuration('E', pipe, func);
+	}
+
+	void recordFrame(const char *pipe, FrameStage stage, uint32_t frame);
+	void recordDuration(char phase, const char *category, const char *name);
+	void record(const char *name, const char *category, uint64_t flowId,
+		    Flow flow, const std::string &args = {});
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(ChromeTrace)
+
+	ChromeTrace(const std::string &path);
+
+	void tracepoint(const char *name, Request *request);
+	void tracepoint(const char *name, Request::Private *request);
+	void tracepoint(const char *name, Request::Private *request,
+			FrameBuffer *buffer);
+
+	template<typename... Args>
+	void tracepoint(const char *name, Args... args)
+	{
+		std::string values;
+		unsigned int index = 0;
+
+		auto append = [&](auto value) {
+			if constexpr (std::is_arithmetic_v<decltype(value)>) {
+				if (!values.empty())
+					values += ", ";
+				values += "\"arg" + std::to_string(index) +
+					  "\": " + std::to_string(value);
+			}
+			index++;
+		};
+
+		(append(args), ...);
+
+		record(name, "libcamera", 0, Flow::None, values);
+	}
+
+	void writeEvent(const std::string &event)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+	void writeThreadName(pid_t tid)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	pid_t pid_;
+
+	Mutex mutex_;
+	std::ofstream file_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool empty_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::set<pid_t> threads_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
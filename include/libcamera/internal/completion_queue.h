@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Queue of completed requests
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/span.h>
+#include <libcamera/base/unique_fd.h>
+
+namespace libcamera {
+
+class Request;
+
+class CompletionQueue
+{
+public:
+	CompletionQueue();
+
+	int init(unsigned int capacity);
+
+	int fd() const { return eventfd_.get(); }
+	bool empty() const;
+
+	bool reserve(unsigned int count);
+	void push(Request *request);
+	size_t pop(Span<Request *> requests);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(CompletionQueue)
+
+	void notify();
+
+	UniqueFD eventfd_;
+
+	std::vector<Request *> slots_;
+	size_t mask_;
+	unsigned int capacity_;
+
+	std::atomic<size_t> head_;
+	std::atomic<size_t> tail_;
+	std::atomic<unsigned int> reserved_;
+};
+
+} /* namespace libcamera */
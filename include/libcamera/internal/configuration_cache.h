@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Camera configuration validation cache
+ */
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/color_space.h>
+#include <libcamera/geometry.h>
+#include <libcamera/orientation.h>
+#include <libcamera/pixel_format.h>
+#include <libcamera/stream.h>
+
+namespace libcamera {
+
+class ConfigurationCache
+{
+public:
+	class Key
+	{
+	public:
+		Key(const CameraConfiguration &config);
+
+		bool operator==(const Key &other) const;
+
+	private:
+		struct StreamKey {
+			PixelFormat pixelFormat;
+			Size size;
+			unsigned int stride;
+			unsigned int bufferCount;
+			std::optional<ColorSpace> colorSpace;
+		};
+
+		std::vector<StreamKey> streams_;
+		Orientation orientation_;
+		std::optional<SensorConfiguration> sensorConfig_;
+	};
+
+	ConfigurationCache(unsigned int size = 8);
+
+	std::shared_ptr<const CameraConfiguration>
+	lookup(const Key &key, CameraConfiguration::Status *status) const;
+	void insert(Key &&key, std::unique_ptr<CameraConfiguration> config,
+		    CameraConfiguration::Status status);
+	void clear();
+
+	static void restore(const CameraConfiguration &config,
+			    CameraConfiguration *target,
+			    std::vector<StreamConfiguration> *streams);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(ConfigurationCache)
+
+	struct Entry {
+		Key key;
+		std::shared_ptr<const CameraConfiguration> config;
+		CameraConfiguration::Status status;
+	};
+
+	unsigned int size_;
+
+	mutable Mutex mutex_;
+	std::list<Entry> entries_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
@@ -9,6 +9,7 @@
 
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <vector>
 
 #include <libcamera/controls.h>
@@ -37,10 +38,18 @@ public:
 
 	template<typename T>
 	T deserialize(ByteStreamBuffer &buffer);
+	int deserialize(ByteStreamBuffer &buffer, ControlList *list);
 
 	bool isCached(const ControlInfoMap &infoMap);
 
+	void setIncremental(bool enable) { incremental_ = enable; }
+
 private:
+	static uint64_t baselineKey(unsigned int handle, unsigned int idMapType)
+	{
+		return (static_cast<uint64_t>(idMapType) << 32) | handle;
+	}
+
 	static size_t binarySize(const ControlValue &value);
 	static size_t binarySize(const ControlInfo &info);
 
@@ -53,10 +62,14 @@ private:
 
 	unsigned int serial_;
 	unsigned int serialSeed_;
+	bool incremental_;
 	std::vector<std::unique_ptr<ControlId>> controlIds_;
 	std::vector<std::unique_ptr<ControlIdMap>> controlIdMaps_;
 	std::map<unsigned int, ControlInfoMap> infoMaps_;
 	std::map<const ControlInfoMap *, unsigned int> infoMapHandles_;
+
+	std::map<uint64_t, ControlList> txBaselines_;
+	std::map<uint64_t, ControlList> rxBaselines_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Accounting of the frame data accessed by the CPU
+ */
+
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <string>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/metrics.h>
+
+namespace libcamera {
+
+class CopyAccount
+{
+public:
+	CopyAccount(const std::string &stage);
+
+	static bool enabled();
+
+	bool active() const { return copied_ != nullptr; }
+	void record(size_t copied, size_t touched);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(CopyAccount)
+
+	std::unique_ptr<HistogramMetric> copied_;
+	std::unique_ptr<HistogramMetric> touched_;
+};
+
+} /* namespace libcamera */
@@ -7,13 +7,16 @@
 
 #pragma once
 
+#include <optional>
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
 #include <libcamera/controls.h>
 
 namespace libcamera {
 
+class MediaRequest;
 class V4L2Device;
 
 class DelayedControls
@@ -24,15 +27,21 @@ public:
 		bool priorityWrite;
 	};
 
+	static constexpr unsigned int kDefaultHistorySize = 16;
+
 	DelayedControls(V4L2Device *device,
-			const std::unordered_map<uint32_t, ControlParams> &controlParams);
+			const std::unordered_map<uint32_t, ControlParams> &controlParams,
+			unsigned int historySize = kDefaultHistorySize);
 
-	void reset();
+	void reset(unsigned int cookie = 0);
 
-	bool push(const ControlList &controls);
-	ControlList get(uint32_t sequence);
+	bool push(const ControlList &controls, unsigned int cookie = 0);
+	std::optional<uint32_t> pushAt(uint32_t sequence, const ControlList &controls,
+				       unsigned int cookie = 0);
+	ControlList get(uint32_t sequence, unsigned int *cookie = nullptr);
 
 	void applyControls(uint32_t sequence);
+	void queueControls(uint32_t sequence, const MediaRequest *request);
 
 private:
 	class Info : public ControlValue
@@ -51,31 +60,29 @@ private:
 		bool updated;
 	};
 
-	/* \todo Make the listSize configurable at instance creation time. */
-	static constexpr int listSize = 16;
-	class ControlRingBuffer : public std::array<Info, listSize>
-	{
-	public:
-		Info &operator[](unsigned int index)
-		{
-			return std::array<Info, listSize>::operator[](index % listSize);
-		}
-
-		const Info &operator[](unsigned int index) const
-		{
-			return std::array<Info, listSize>::operator[](index % listSize);
-		}
+	struct Control {
+		const ControlId *id;
+		ControlParams params;
 	};
 
+	int findControl(unsigned int id) const;
+	void writeControls(uint32_t sequence, const MediaRequest *request);
+
+	Info &value(unsigned int index, unsigned int control)
+	{
+		return values_[(index & historyMask_) * controls_.size() + control];
+	}
+
 	V4L2Device *device_;
-	/* \todo Evaluate if we should index on ControlId * or unsigned int */
-	std::unordered_map<const ControlId *, ControlParams> controlParams_;
+	std::vector<Control> controls_;
 	unsigned int maxDelay_;
 
 	uint32_t queueCount_;
 	uint32_t writeCount_;
-	/* \todo Evaluate if we should index on ControlId * or unsigned int */
-	std::unordered_map<const ControlId *, ControlRingBuffer> values_;
+
+	unsigned int historyMask_;
+	std::vector<Info> values_;
+	std::vector<unsigned int> cookies_;
 };
 
 } /* namespace libcamera */
@@ -47,11 +47,19 @@ public:
 
 protected:
 	std::unique_ptr<MediaDevice> createDevice(const std::string &deviceNode);
+	std::vector<std::unique_ptr<MediaDevice>>
+	createDevices(const std::vector<std::string> &deviceNodes);
 	void addDevice(std::unique_ptr<MediaDevice> media);
 	void removeDevice(const std::string &deviceNode);
 
+	void holdNotifications();
+	void releaseNotifications();
+
 private:
 	std::vector<std::shared_ptr<MediaDevice>> devices_;
+
+	unsigned int notificationsHeld_ = 0;
+	bool devicesPending_ = false;
 };
 
 } /* namespace libcamera */
@@ -13,6 +13,13 @@
 #include <set>
 #include <string>
 #include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
 
 #include "libcamera/internal/device_enumerator.h"
 
@@ -26,7 +33,7 @@ class EventNotifier;
 class MediaDevice;
 class MediaEntity;
 
-class DeviceEnumeratorUdev final : public DeviceEnumerator
+class DeviceEnumeratorUdev final : public DeviceEnumerator, public Object
 {
 public:
 	DeviceEnumeratorUdev();
@@ -54,17 +61,45 @@ private:
 		DependencyMap deps_;
 	};
 
+	class Prober : public Object
+	{
+	public:
+		Prober(DeviceEnumeratorUdev *enumerator)
+			: enumerator_(enumerator)
+		{
+		}
+
+		void probe(const std::vector<std::string> &deviceNodes);
+
+	private:
+		DeviceEnumeratorUdev *enumerator_;
+	};
+
 	int addUdevDevice(struct udev_device *dev);
+	int addMediaDevice(std::unique_ptr<MediaDevice> media);
 	int populateMediaDevice(MediaDevice *media, DependencyMap *deps);
 	std::string lookupDeviceNode(dev_t devnum);
 
 	int addV4L2Device(dev_t devnum);
 	void udevNotify();
+	void processEvents();
+	void devicesProbed();
 
 	struct udev *udev_;
 	struct udev_monitor *monitor_;
 	EventNotifier *notifier_;
 
+	std::vector<struct udev_device *> events_;
+	Timer debounceTimer_;
+
+	Thread probeThread_;
+	Prober prober_;
+	std::set<std::string> probing_;
+
+	Mutex mutex_;
+	std::vector<std::pair<std::string, std::unique_ptr<MediaDevice>>> probed_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
 	std::set<dev_t> orphans_;
 	std::list<MediaDeviceDeps> pending_;
 	std::map<dev_t, MediaDeviceDeps *> devMap_;
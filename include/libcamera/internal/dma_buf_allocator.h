@@ -7,11 +7,19 @@
 
 #pragma once
 
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/class.h>
 #include <libcamera/base/flags.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/unique_fd.h>
 
 namespace libcamera {
 
+class FrameBuffer;
+
 class DmaBufAllocator
 {
 public:
@@ -23,18 +31,58 @@ public:
 
 	using DmaBufAllocatorFlags = Flags<DmaBufAllocatorFlag>;
 
-	DmaBufAllocator(DmaBufAllocatorFlags flags = DmaBufAllocatorFlag::CmaHeap);
+	DmaBufAllocator(DmaBufAllocatorFlags flags = DmaBufAllocatorFlag::SystemHeap);
 	~DmaBufAllocator();
 	bool isValid() const { return providerHandle_.isValid(); }
 	UniqueFD alloc(const char *name, std::size_t size);
 
+	int exportBuffers(unsigned int count,
+			  const std::vector<unsigned int> &planeSizes,
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+
+	void setPoolLimit(std::size_t limit);
+	std::size_t poolSize() const;
+	void trimPool(std::size_t size = 0);
+
+	void setHugePages(bool enable);
+
 private:
+	class Pool;
+	class PooledFrameBuffer;
+
 	UniqueFD allocFromHeap(const char *name, std::size_t size);
 	UniqueFD allocFromUDmaBuf(const char *name, std::size_t size);
 	UniqueFD providerHandle_;
 	DmaBufAllocatorFlag type_;
+	bool hugePages_;
+
+	std::shared_ptr<Pool> pool_;
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(DmaBufAllocator::DmaBufAllocatorFlag)
 
+class DmaSyncer final
+{
+public:
+	enum class SyncType {
+		Read = 0,
+		Write,
+		ReadWrite,
+	};
+
+	explicit DmaSyncer(SharedFD fd, SyncType type = SyncType::ReadWrite);
+
+	DmaSyncer(DmaSyncer &&other) = default;
+
+	~DmaSyncer();
+
+private:
+	LIBCAMERA_DISABLE_COPY(DmaSyncer)
+
+	void sync(uint64_t step);
+
+	SharedFD fd_;
+	uint64_t flags_ = 0;
+};
+
 } /* namespace libcamera */
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Start of frame notification with a synthesized fallback
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/signal.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class FrameBuffer;
+class V4L2Device;
+class V4L2VideoDevice;
+
+class FrameStartMonitor
+{
+public:
+	FrameStartMonitor(const std::vector<V4L2Device *> &devices,
+			  V4L2VideoDevice *video);
+	~FrameStartMonitor();
+
+	int start();
+	void stop();
+
+	bool synthesized() const { return running_ && !source_; }
+
+	Signal<uint32_t> frameStart;
+
+private:
+	void frameStarted(uint32_t sequence);
+	void bufferReady(FrameBuffer *buffer);
+	void timeout();
+
+	std::vector<V4L2Device *> devices_;
+	V4L2VideoDevice *video_;
+
+	V4L2Device *source_;
+	bool running_;
+
+	Timer timer_;
+	uint32_t lastSequence_;
+	uint64_t lastTimestamp_;
+	utils::Duration frameDuration_;
+	uint32_t nextSequence_;
+};
+
+} /* namespace libcamera */
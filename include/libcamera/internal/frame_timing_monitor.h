@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Frame timing jitter and deadline miss detection
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/metrics.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class FrameTimingMonitor
+{
+public:
+	static constexpr unsigned int kWindowSize = 128;
+
+	FrameTimingMonitor(const std::string &camera);
+
+	void reset();
+	void frameCompleted(uint32_t sequence, uint64_t timestamp,
+			    utils::Duration frameDuration);
+
+	uint64_t lateFrames() const { return lateFramesMetric_.value(); }
+	uint64_t droppedFrames() const { return droppedFramesMetric_.value(); }
+	bool degraded() const { return degraded_; }
+
+	Signal<bool> degradedChanged;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(FrameTimingMonitor)
+
+	double jitterPercentile(double p) const;
+
+	std::string camera_;
+
+	CounterMetric lateFramesMetric_;
+	CounterMetric droppedFramesMetric_;
+	HistogramMetric jitterMetric_;
+	GaugeMetric degradedMetric_;
+
+	bool started_;
+	uint32_t lastSequence_;
+	uint64_t lastTimestamp_;
+	utils::Duration estimatedDuration_;
+
+	std::array<uint8_t, kWindowSize> misses_;
+	std::array<float, kWindowSize> jitter_;
+	unsigned int index_;
+	unsigned int frames_;
+	unsigned int windowMisses_;
+	bool degraded_;
+};
+
+} /* namespace libcamera */
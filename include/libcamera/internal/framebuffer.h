@@ -22,9 +22,14 @@ class FrameBuffer::Private : public Extensible::Private
 	LIBCAMERA_DECLARE_PUBLIC(FrameBuffer)
 
 public:
+	/* Number of planes stored without reallocation by setPlanes() */
+	static constexpr unsigned int kInlinePlanes = 4;
+
 	Private(const std::vector<Plane> &planes, uint64_t cookie = 0);
 	virtual ~Private();
 
+	void setPlanes(const std::vector<Plane> &planes);
+
 	void setRequest(Request *request) { request_ = request; }
 	bool isContiguous() const { return isContiguous_; }
 
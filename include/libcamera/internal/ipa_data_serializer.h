@@ -90,7 +90,12 @@ public:
  *
  * 4 bytes - uint32_t Length of vector, in number of elements
  *
- * For every element in the vector:
+ * If V is an arithmetic type other than bool, the elements are stored
+ * contiguously:
+ *
+ * X bytes - Elements, in host byte order
+ *
+ * Otherwise, for every element in the vector:
  *
  * 4 bytes - uint32_t Size of element, in bytes
  * 4 bytes - uint32_t Number of fds for the element
@@ -101,6 +106,9 @@ public:
 template<typename V>
 class IPADataSerializer<std::vector<V>>
 {
+	static constexpr bool kPacked = std::is_arithmetic_v<V> &&
+					!std::is_same_v<V, bool>;
+
 public:
 	static std::tuple<std::vector<uint8_t>, std::vector<SharedFD>>
 	serialize(const std::vector<V> &data, ControlSerializer *cs = nullptr)
@@ -110,6 +118,17 @@ public:
 
 		/* Serialize the length. */
 		uint32_t vecLen = data.size();
+
+		if constexpr (kPacked) {
+			dataVec.resize(sizeof(vecLen) + vecLen * sizeof(V));
+			memcpy(dataVec.data(), &vecLen, sizeof(vecLen));
+			if (vecLen)
+				memcpy(dataVec.data() + sizeof(vecLen), data.data(),
+				       vecLen * sizeof(V));
+
+			return { dataVec, fdsVec };
+		}
+
 		appendPOD<uint32_t>(dataVec, vecLen);
 
 		/* Serialize the members. */
@@ -156,6 +175,25 @@ public:
 					  ControlSerializer *cs = nullptr)
 	{
 		uint32_t vecLen = readPOD<uint32_t>(dataBegin, 0, dataEnd);
+
+		if constexpr (kPacked) {
+			size_t dataSize = std::distance(dataBegin, dataEnd);
+			if (dataSize - sizeof(vecLen) < vecLen * sizeof(V)) {
+				LOG(IPADataSerializer, Error)
+					<< "Failed to deserialize vector: not enough data, expected "
+					<< vecLen * sizeof(V) << ", got "
+					<< dataSize - sizeof(vecLen);
+				return {};
+			}
+
+			std::vector<V> ret(vecLen);
+			if (vecLen)
+				memcpy(ret.data(), &*(dataBegin + sizeof(vecLen)),
+				       vecLen * sizeof(V));
+
+			return ret;
+		}
+
 		std::vector<V> ret(vecLen);
 
 		std::vector<uint8_t>::const_iterator dataIter = dataBegin + 4;
@@ -7,7 +7,11 @@
 
 #pragma once
 
+#include <map>
 #include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <time.h>
 #include <vector>
 
 #include <libcamera/base/log.h>
@@ -19,6 +23,7 @@
 #include "libcamera/internal/ipa_module.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/pub_key.h"
+#include "libcamera/internal/startup_profile.h"
 
 namespace libcamera {
 
@@ -35,6 +40,8 @@ public:
 					    uint32_t minVersion,
 					    uint32_t maxVersion)
 	{
+		StartupProfile::Scope scope("ipa_create", pipe->name());
+
 		CameraManager *cm = pipe->cameraManager();
 		IPAManager *self = cm->_d()->ipaManager();
 		IPAModule *m = self->module(pipe, minVersion, maxVersion);
@@ -58,6 +65,15 @@ public:
 #endif
 
 private:
+	struct SignatureCacheEntry {
+		dev_t device;
+		ino_t inode;
+		off_t size;
+		struct timespec mtime;
+		bool valid;
+	};
+
+	void loadModules();
 	void parseDir(const char *libDir, unsigned int maxDepth,
 		      std::vector<std::string> &files);
 	unsigned int addDir(const char *libDir, unsigned int maxDepth = 0);
@@ -67,8 +83,11 @@ private:
 
 	bool isSignatureValid(IPAModule *ipa) const;
 
+	bool modulesLoaded_;
 	std::vector<IPAModule *> modules_;
 
+	mutable std::map<std::string, SignatureCacheEntry> signatureCache_;
+
 #if HAVE_IPA_PUBKEY
 	static const uint8_t publicKeyData_[];
 	static const PubKey pubKey_;
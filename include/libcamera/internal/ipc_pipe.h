@@ -56,6 +56,8 @@ public:
 
 	virtual int sendSync(const IPCMessage &in,
 			     IPCMessage *out) = 0;
+	virtual int sendSyncBegin(const IPCMessage &in) = 0;
+	virtual int sendSyncEnd(uint32_t cookie, IPCMessage *out) = 0;
 
 	virtual int sendAsync(const IPCMessage &data) = 0;
 
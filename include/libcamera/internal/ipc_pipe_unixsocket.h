@@ -25,20 +25,23 @@ public:
 
 	int sendSync(const IPCMessage &in,
 		     IPCMessage *out = nullptr) override;
+	int sendSyncBegin(const IPCMessage &in) override;
+	int sendSyncEnd(uint32_t cookie, IPCMessage *out = nullptr) override;
 
 	int sendAsync(const IPCMessage &data) override;
 
 private:
+	class SharedWorker;
+
 	struct CallData {
-		IPCUnixSocket::Payload *response;
+		IPCUnixSocket::Payload response;
 		bool done;
 	};
 
 	void readyRead();
-	int call(const IPCUnixSocket::Payload &message,
-		 IPCUnixSocket::Payload *response, uint32_t seq);
 
 	std::unique_ptr<Process> proc_;
+	std::shared_ptr<SharedWorker> worker_;
 	std::unique_ptr<IPCUnixSocket> socket_;
 	std::map<uint32_t, CallData> callData_;
 };
@@ -45,15 +45,39 @@ private:
 		uint8_t fds;
 	};
 
+	struct RingControl;
+
+	struct Ring {
+		RingControl *control;
+		uint8_t *data;
+		uint32_t pos;
+		UniqueFD doorbell;
+	};
+
+	int sendSocket(const Payload &payload);
+	int receiveSocket(Payload *payload);
 	int sendData(const void *buffer, size_t length, const int32_t *fds, unsigned int num);
 	int recvData(void *buffer, size_t length, int32_t *fds, unsigned int num);
 
+	int createRings();
+	int bindRings();
+	int mapRings(const UniqueFD &memfd, bool creator);
+	void unmapRings();
+	int sendRing(const Payload &payload);
+	int receiveRing(Payload *payload);
+
 	void dataNotifier();
+	void ringNotifier();
 
 	UniqueFD fd_;
 	bool headerReceived_;
 	struct Header header_;
 	EventNotifier *notifier_;
+
+	void *ringMem_;
+	Ring tx_;
+	Ring rx_;
+	EventNotifier *ringNotifier_;
 };
 
 } /* namespace libcamera */
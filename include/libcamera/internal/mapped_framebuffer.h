@@ -7,15 +7,20 @@
 
 #pragma once
 
+#include <list>
 #include <stdint.h>
+#include <sys/types.h>
 #include <vector>
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/flags.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/span.h>
 
 #include <libcamera/framebuffer.h>
 
+#include "libcamera/internal/dma_buf_allocator.h"
+
 namespace libcamera {
 
 class MappedBuffer
@@ -53,10 +58,57 @@ public:
 	};
 
 	using MapFlags = Flags<MapFlag>;
+	using SyncScope = std::vector<DmaSyncer>;
 
 	MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags);
+
+	[[nodiscard]] SyncScope syncScope() const { return syncScope(flags_); }
+	[[nodiscard]] SyncScope syncScope(MapFlags access) const;
+
+private:
+	MapFlags flags_;
+	std::vector<SharedFD> fds_;
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(MappedFrameBuffer::MapFlag)
 
+class MappedFrameBufferCache
+{
+public:
+	static constexpr unsigned int kDefaultMaxEntries = 16;
+
+	MappedFrameBufferCache(MappedFrameBuffer::MapFlags flags,
+			       unsigned int maxEntries = kDefaultMaxEntries);
+
+	const MappedFrameBuffer *map(const FrameBuffer *buffer);
+	void clear();
+
+private:
+	LIBCAMERA_DISABLE_COPY(MappedFrameBufferCache)
+
+	struct PlaneKey {
+		dev_t dev;
+		ino_t ino;
+		unsigned int offset;
+		unsigned int length;
+
+		bool operator==(const PlaneKey &other) const
+		{
+			return dev == other.dev && ino == other.ino &&
+			       offset == other.offset && length == other.length;
+		}
+	};
+
+	struct Entry {
+		std::vector<PlaneKey> key;
+		MappedFrameBuffer mapping;
+	};
+
+	MappedFrameBuffer::MapFlags flags_;
+	unsigned int maxEntries_;
+	/* Entries from the most to the least recently used */
+	std::list<Entry> entries_;
+	std::vector<PlaneKey> key_;
+};
+
 } /* namespace libcamera */
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <cstddef>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,6 +20,7 @@
 #include <libcamera/base/unique_fd.h>
 
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/media_request.h"
 
 namespace libcamera {
 
@@ -33,6 +36,7 @@ public:
 
 	bool lock();
 	void unlock();
+	unsigned int lockCount() const { return lockCount_; }
 
 	int populate();
 	bool isValid() const { return valid_; }
@@ -52,6 +56,9 @@ public:
 			const MediaEntity *sink, unsigned int sinkIdx);
 	MediaLink *link(const MediaPad *source, const MediaPad *sink);
 	int disableLinks();
+	int configureLinks(const std::vector<MediaLink *> &links);
+
+	std::unique_ptr<MediaRequest> allocateRequest();
 
 	Signal<> disconnected;
 
@@ -66,6 +73,10 @@ private:
 	bool addObject(MediaObject *object);
 	void clear();
 
+	void allocateObjects(const struct media_v2_topology &topology);
+	template<typename T, typename... Args>
+	T *createObject(Args &&...args);
+
 	struct media_v2_interface *findInterface(const struct media_v2_topology &topology,
 						 unsigned int entityId);
 	bool populateEntities(const struct media_v2_topology &topology);
@@ -85,6 +96,11 @@ private:
 	UniqueFD fd_;
 	bool valid_;
 	bool acquired_;
+	unsigned int lockCount_;
+
+	std::unique_ptr<std::max_align_t[]> arena_;
+	size_t arenaSize_;
+	size_t arenaUsed_;
 
 	std::map<unsigned int, MediaObject *> objects_;
 	std::vector<MediaEntity *> entities_;
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Media Controller request
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/unique_fd.h>
+
+namespace libcamera {
+
+class EventNotifier;
+
+class MediaRequest
+{
+public:
+	explicit MediaRequest(UniqueFD fd);
+	~MediaRequest();
+
+	int fd() const { return fd_.get(); }
+	bool isQueued() const { return queued_; }
+
+	int queue();
+	int reinit();
+
+	Signal<MediaRequest *> completed;
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(MediaRequest)
+
+	void requestComplete();
+
+	UniqueFD fd_;
+	std::unique_ptr<EventNotifier> notifier_;
+	bool queued_;
+};
+
+} /* namespace libcamera */
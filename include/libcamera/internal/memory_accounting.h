@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Accounting of the memory allocated by libcamera
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/class.h>
+
+namespace libcamera {
+
+class MemoryAccount
+{
+public:
+	enum class Heap {
+		Cma,
+		System,
+		UDmaBuf,
+		MemFd,
+		Driver,
+	};
+
+	struct Usage {
+		std::string category;
+		Heap heap;
+		std::size_t size;
+		unsigned int count;
+	};
+
+	MemoryAccount();
+	MemoryAccount(const std::string &category, Heap heap, std::size_t size);
+	MemoryAccount(MemoryAccount &&other);
+	~MemoryAccount();
+
+	MemoryAccount &operator=(MemoryAccount &&other);
+
+	void reset();
+
+	const std::string &category() const { return category_; }
+	Heap heap() const { return heap_; }
+	std::size_t size() const { return size_; }
+
+	static std::vector<Usage> usage();
+	static const char *heapName(Heap heap);
+
+private:
+	LIBCAMERA_DISABLE_COPY(MemoryAccount)
+
+	std::string category_;
+	Heap heap_;
+	std::size_t size_;
+	bool active_;
+};
+
+} /* namespace libcamera */
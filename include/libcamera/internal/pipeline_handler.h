@@ -7,8 +7,8 @@
 
 #pragma once
 
+#include <deque>
 #include <memory>
-#include <queue>
 #include <string>
 #include <sys/types.h>
 #include <vector>
@@ -47,6 +47,7 @@ public:
 	virtual std::unique_ptr<CameraConfiguration> generateConfiguration(Camera *camera,
 									   Span<const StreamRole> roles) = 0;
 	virtual int configure(Camera *camera, CameraConfiguration *config) = 0;
+	virtual int reconfigure(Camera *camera, CameraConfiguration *config);
 
 	virtual int exportFrameBuffers(Camera *camera, Stream *stream,
 				       std::vector<std::unique_ptr<FrameBuffer>> *buffers) = 0;
@@ -57,6 +58,7 @@ public:
 
 	void registerRequest(Request *request);
 	void queueRequest(Request *request);
+	void queueRequests(const std::vector<Request *> &requests);
 
 	bool completeBuffer(Request *request, FrameBuffer *buffer);
 	void completeRequest(Request *request);
@@ -92,7 +94,8 @@ private:
 	std::vector<std::shared_ptr<MediaDevice>> mediaDevices_;
 	std::vector<std::weak_ptr<Camera>> cameras_;
 
-	std::queue<Request *> waitingRequests_;
+	std::deque<Request *> waitingRequests_;
+	bool batching_;
 
 	const char *name_;
 	unsigned int useCount_;
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Vectorized pixel conversion kernels
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace libcamera {
+
+namespace kernels {
+
+const char *implementation();
+
+void deinterleave(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+		  unsigned int count);
+
+void unpackCSI2P10(uint16_t *dst, const uint8_t *src, unsigned int width);
+void unpackCSI2P12(uint16_t *dst, const uint8_t *src, unsigned int width);
+
+} /* namespace kernels */
+
+} /* namespace libcamera */
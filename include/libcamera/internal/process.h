@@ -7,10 +7,12 @@
 
 #pragma once
 
+#include <list>
 #include <signal.h>
 #include <string>
 #include <vector>
 
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/signal.h>
 #include <libcamera/base/unique_fd.h>
 
@@ -73,7 +75,8 @@ private:
 
 	void sighandler();
 
-	std::list<Process *> processes_;
+	Mutex mutex_;
+	std::list<Process *> processes_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 
 	struct sigaction oldsa_;
 
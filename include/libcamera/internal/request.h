@@ -7,13 +7,16 @@
 
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <map>
 #include <memory>
-#include <unordered_set>
+#include <stdint.h>
+#include <vector>
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/timer.h>
+#include <libcamera/base/unique_fd.h>
 
 #include <libcamera/request.h>
 
@@ -29,6 +32,12 @@ class Request::Private : public Extensible::Private
 	LIBCAMERA_DECLARE_PUBLIC(Request)
 
 public:
+	enum class Stage {
+		BufferDequeue = 1,
+		IpaDone = 2,
+		IspDone = 3,
+	};
+
 	Private(Camera *camera);
 	~Private();
 
@@ -40,6 +49,8 @@ public:
 	void cancel();
 	void reset();
 
+	void recordStage(Stage stage);
+
 	void prepare(std::chrono::milliseconds timeout = 0ms);
 	Signal<> prepared;
 
@@ -50,16 +61,29 @@ private:
 	void doCancelRequest();
 	void emitPrepareCompleted();
 	void notifierActivated(FrameBuffer *buffer);
+	void mergedFenceActivated();
 	void timeout();
+	void clearFences();
 
 	Camera *camera_;
 	bool cancelled_;
 	uint32_t sequence_ = 0;
+	unsigned int priority_ = 0;
 	bool prepared_ = false;
 
-	std::unordered_set<FrameBuffer *> pending_;
+	bool reportLatency_ = false;
+	std::array<int64_t, 5> stageTimestamps_ = {};
+
+	std::vector<FrameBuffer *> pending_;
 	std::map<FrameBuffer *, std::unique_ptr<EventNotifier>> notifiers_;
 	std::unique_ptr<Timer> timer_;
+
+	/* The fences of mergedBuffers_ waited on as a single sync_file. */
+	UniqueFD mergedFence_;
+	std::unique_ptr<EventNotifier> mergedNotifier_;
+	std::vector<FrameBuffer *> mergedBuffers_;
+
+	std::vector<BufferMap::node_type> spareBufferNodes_;
 };
 
 } /* namespace libcamera */
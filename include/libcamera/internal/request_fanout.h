@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Request fan-out private data
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/request_fanout.h>
+
+namespace libcamera {
+
+class RequestFanout::Private : public Extensible::Private
+{
+	LIBCAMERA_DECLARE_PUBLIC(RequestFanout)
+
+public:
+	Private(std::shared_ptr<Camera> camera);
+	~Private();
+
+	void requestComplete(Request *request);
+	void recycle(const std::vector<Request *> &requests);
+
+	std::shared_ptr<Camera> camera_;
+
+	Mutex mutex_;
+
+	struct Consumer {
+		unsigned int queueDepth;
+		DropPolicy policy;
+		std::deque<Request *> ready;
+	};
+
+	std::vector<Consumer> consumers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::vector<std::unique_ptr<Request>> requests_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::unordered_map<const Request *, unsigned int> refs_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool running_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace libcamera */
@@ -18,6 +18,8 @@
 #include <libcamera/base/shared_fd.h>
 #include <libcamera/base/span.h>
 
+#include "libcamera/internal/memory_accounting.h"
+
 namespace libcamera {
 
 class SharedMem
@@ -53,6 +55,8 @@ private:
 	SharedFD fd_;
 
 	Span<uint8_t> mem_;
+
+	MemoryAccount account_;
 };
 
 template<class T, typename = std::enable_if_t<std::is_standard_layout<T>::value>>
@@ -17,12 +17,21 @@ namespace libcamera {
 
 struct DebayerParams {
 	static constexpr unsigned int kRGBLookupSize = 256;
+	static constexpr unsigned int kGammaLookupSize = 1024;
+	static constexpr unsigned int kCcmShift = 8;
 
 	using ColorLookupTable = std::array<uint8_t, kRGBLookupSize>;
+	using GammaLookupTable = std::array<uint8_t, kGammaLookupSize>;
 
 	ColorLookupTable red;
 	ColorLookupTable green;
 	ColorLookupTable blue;
+	GammaLookupTable gamma;
+
+	uint32_t lutVersion;
+
+	bool ccmEnabled;
+	std::array<int16_t, 9> ccm;
 };
 
 } /* namespace libcamera */
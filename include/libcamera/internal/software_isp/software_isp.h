@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <functional>
 #include <initializer_list>
 #include <map>
@@ -18,11 +20,14 @@
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/metrics.h>
 #include <libcamera/base/signal.h>
 #include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/geometry.h>
 #include <libcamera/pixel_format.h>
+#include <libcamera/transform.h>
 
 #include <libcamera/ipa/soft_ipa_interface.h>
 #include <libcamera/ipa/soft_ipa_proxy.h>
@@ -35,8 +40,10 @@
 
 namespace libcamera {
 
-class DebayerCpu;
+class Debayer;
+struct DebayerFrameTiming;
 class FrameBuffer;
+class SwIspGovernor;
 class PixelFormat;
 class Stream;
 struct StreamConfiguration;
@@ -46,6 +53,8 @@ LOG_DECLARE_CATEGORY(SoftwareIsp)
 class SoftwareIsp
 {
 public:
+	static constexpr unsigned int kMaxOutputs = 3;
+
 	SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor);
 	~SoftwareIsp();
 
@@ -57,12 +66,19 @@ public:
 
 	SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
 
+	unsigned int maxOutputs() const;
+	Size secondarySize(const PixelFormat &outputFormat, const Size &primarySize,
+			   const Size &size);
+
 	std::tuple<unsigned int, unsigned int>
 	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size);
 
+	bool supportsTransform(const PixelFormat &outputFormat, Transform transform);
+
 	int configure(const StreamConfiguration &inputCfg,
 		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
-		      const ipa::soft::IPAConfigInfo &configInfo);
+		      const ipa::soft::IPAConfigInfo &configInfo,
+		      Transform transform = Transform::Identity);
 
 	int exportBuffers(const Stream *stream, unsigned int count,
 			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
@@ -77,7 +93,10 @@ public:
 	int queueBuffers(uint32_t frame, FrameBuffer *input,
 			 const std::map<const Stream *, FrameBuffer *> &outputs);
 
-	void process(uint32_t frame, FrameBuffer *input, FrameBuffer *output);
+	void process(uint32_t frame, FrameBuffer *input,
+		     const std::vector<FrameBuffer *> &outputs);
+
+	unsigned int throttleLevel() const;
 
 	Signal<FrameBuffer *> inputBufferReady;
 	Signal<FrameBuffer *> outputBufferReady;
@@ -85,18 +104,50 @@ public:
 	Signal<const ControlList &> setSensorControls;
 
 private:
-	void saveIspParams();
+	/*
+	 * Parameters buffers are indexed by frame number. The number of
+	 * buffers must be larger than the number of frames that can be queued
+	 * to the ISP at a time, which is bounded by the number of input buffers
+	 * of the pipeline handler.
+	 */
+	static constexpr unsigned int kParamsBufferCount = 8;
+
+	/*
+	 * Frames waiting for their parameters. The slots are only accessed
+	 * from the pipeline handler thread, the outputs are copied to the ISP
+	 * thread with the process() call and the timing is passed back with
+	 * the Debayer::inputBufferReady signal.
+	 */
+	struct QueuedFrame {
+		FrameBuffer *input;
+		std::vector<FrameBuffer *> outputs;
+		utils::time_point queued;
+		utils::Duration interval;
+	};
+
+	std::unique_ptr<Debayer> createDebayer();
+	void paramsReady(uint32_t frame);
 	void setSensorCtrls(const ControlList &sensorControls);
+	void releaseStatsBuffer(uint32_t bufferId);
 	void statsReady(uint32_t frame, uint32_t bufferId);
-	void inputReady(FrameBuffer *input);
+	void inputReady(FrameBuffer *input, const DebayerFrameTiming &timing);
 	void outputReady(FrameBuffer *output);
 
-	std::unique_ptr<DebayerCpu> debayer_;
+	std::unique_ptr<Debayer> debayer_;
 	Thread ispWorkerThread_;
-	SharedMemObject<DebayerParams> sharedParams_;
-	DebayerParams debayerParams_;
+	std::array<SharedMemObject<DebayerParams>, kParamsBufferCount> sharedParams_;
+	std::array<QueuedFrame, kParamsBufferCount> queuedFrames_;
+	std::vector<const Stream *> outputStreams_;
 	DmaBufAllocator dmaHeap_;
 
+	std::unique_ptr<SwIspGovernor> governor_;
+	uint64_t lastInputTimestamp_;
+	std::atomic<unsigned int> framesInFlight_;
+	bool running_;
+
+	HistogramMetric latencyMetric_;
+	GaugeMetric throttleLevelMetric_;
+
 	std::unique_ptr<ipa::soft::IPAProxySoft> ipa_;
 };
 
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Startup phase timing
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class StartupProfile
+{
+public:
+	struct Phase {
+		std::string name;
+		std::string owner;
+		utils::Duration duration;
+		unsigned int count;
+	};
+
+	class Scope
+	{
+	public:
+		Scope(const char *name, const std::string &owner = {});
+		~Scope();
+
+	private:
+		LIBCAMERA_DISABLE_COPY_AND_MOVE(Scope)
+
+		const char *name_;
+		std::string owner_;
+		utils::time_point start_;
+	};
+
+	static void record(const char *name, const std::string &owner,
+			   utils::Duration duration);
+	static std::vector<Phase> phases();
+	static std::string toString();
+};
+
+} /* namespace libcamera */
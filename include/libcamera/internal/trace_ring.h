@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * In-process frame trace ring
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+
+#include <libcamera/base/class.h>
+
+namespace libcamera {
+
+enum class FrameStage : uint8_t {
+	StartOfFrame,
+	SensorDequeue,
+	IpaPrepareBegin,
+	IpaPrepareEnd,
+	IpaProcessBegin,
+	IpaProcessEnd,
+	IspQueue,
+	IspDequeue,
+	RequestComplete,
+};
+
+class TraceRing
+{
+public:
+	static TraceRing *instance();
+
+	static void trace(const char *pipe, FrameStage stage, uint32_t frame)
+	{
+		TraceRing *ring = instance();
+		if (ring)
+			ring->record(pipe, stage, frame);
+	}
+
+	void record(const char *pipe, FrameStage stage, uint32_t frame);
+	void dump(std::ostream &stream);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(TraceRing)
+
+	struct Entry {
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> timestamp;
+		std::atomic<const char *> pipe;
+		std::atomic<uint32_t> tid;
+		std::atomic<uint32_t> frame;
+		std::atomic<FrameStage> stage;
+	};
+
+	TraceRing(unsigned int size);
+
+	std::unique_ptr<Entry[]> entries_;
+	uint64_t mask_;
+	std::atomic<uint64_t> head_;
+};
+
+} /* namespace libcamera */
@@ -27,6 +27,7 @@
 namespace libcamera {
 
 class EventNotifier;
+class MediaRequest;
 
 class V4L2Device : protected Loggable
 {
@@ -37,7 +38,7 @@ public:
 	const ControlInfoMap &controls() const { return controls_; }
 
 	ControlList getControls(const std::vector<uint32_t> &ids);
-	int setControls(ControlList *ctrls);
+	int setControls(ControlList *ctrls, const MediaRequest *request = nullptr);
 
 	const struct v4l2_query_ext_ctrl *controlInfo(uint32_t id) const;
 
@@ -60,6 +61,8 @@ protected:
 
 	int fd() const { return fd_.get(); }
 
+	virtual void layoutChanged() {}
+
 	template<typename T>
 	static std::optional<ColorSpace> toColorSpace(const T &v4l2Format,
 						      PixelFormatInfo::ColourEncoding colourEncoding);
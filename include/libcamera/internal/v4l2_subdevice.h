@@ -7,10 +7,12 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include <linux/v4l2-subdev.h>
@@ -165,10 +167,25 @@ public:
 
 protected:
 	std::string logPrefix() const override;
+	void layoutChanged() override;
 
 private:
 	LIBCAMERA_DISABLE_COPY(V4L2Subdevice)
 
+	struct CachedFormat {
+		V4L2SubdeviceFormat request;
+		V4L2SubdeviceFormat format;
+	};
+
+	struct CachedSelection {
+		Rectangle request;
+		Rectangle rect;
+	};
+
+	void validateCache();
+	void invalidateCache(Whence whence, const Stream &stream);
+	void clearCache();
+
 	std::optional<ColorSpace>
 	toColorSpace(const v4l2_mbus_framefmt &format) const;
 
@@ -183,6 +200,10 @@ private:
 
 	std::string model_;
 	struct V4L2SubdeviceCapability caps_;
+
+	std::map<std::tuple<Whence, unsigned int, unsigned int>, CachedFormat> formatCache_;
+	std::map<std::tuple<unsigned int, unsigned int, unsigned int>, CachedSelection> selectionCache_;
+	unsigned int cacheLockCount_;
 };
 
 bool operator==(const V4L2Subdevice::Stream &lhs, const V4L2Subdevice::Stream &rhs);
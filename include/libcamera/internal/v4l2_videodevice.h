@@ -13,8 +13,10 @@
 #include <optional>
 #include <ostream>
 #include <queue>
+#include <set>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -33,6 +35,7 @@
 #include <libcamera/pixel_format.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/memory_accounting.h"
 #include "libcamera/internal/v4l2_device.h"
 #include "libcamera/internal/v4l2_pixelformat.h"
 
@@ -41,6 +44,7 @@ namespace libcamera {
 class EventNotifier;
 class MediaDevice;
 class MediaEntity;
+class MediaRequest;
 
 struct V4L2Capability final : v4l2_capability {
 	const char *driver() const
@@ -125,14 +129,28 @@ struct V4L2Capability final : v4l2_capability {
 class V4L2BufferCache
 {
 public:
+	struct Counters {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+
+		Counters &operator+=(const Counters &other);
+	};
+
 	V4L2BufferCache(unsigned int numEntries);
 	V4L2BufferCache(const std::vector<std::unique_ptr<FrameBuffer>> &buffers);
 	~V4L2BufferCache();
 
+	void addEntries(unsigned int numEntries);
+	void addEntries(const std::vector<std::unique_ptr<FrameBuffer>> &buffers);
+
+	unsigned int size() const { return cache_.size(); }
 	bool isEmpty() const;
 	int get(const FrameBuffer &buffer);
 	void put(unsigned int index);
 
+	const Counters &counters() const { return counters_; }
+
 private:
 	class Entry
 	{
@@ -141,9 +159,13 @@ private:
 		Entry(bool free, uint64_t lastUsed, const FrameBuffer &buffer);
 
 		bool operator==(const FrameBuffer &buffer) const;
+		bool isEmpty() const { return planes_.empty(); }
+
+		static size_t hash(const FrameBuffer &buffer);
 
 		bool free_;
 		uint64_t lastUsed_;
+		size_t hash_;
 
 	private:
 		struct Plane {
@@ -159,10 +181,15 @@ private:
 		std::vector<Plane> planes_;
 	};
 
+	void use(unsigned int index, const FrameBuffer &buffer);
+
 	std::atomic<uint64_t> lastUsedCounter_;
 	std::vector<Entry> cache_;
-	/* \todo Expose the miss counter through an instrumentation API. */
-	unsigned int missCounter_;
+	/* Indexes of the populated entries, by hash of their planes */
+	std::unordered_multimap<size_t, unsigned int> index_;
+	/* Free entries, from the least to the most recently used */
+	std::set<std::pair<uint64_t, unsigned int>> freeEntries_;
+	Counters counters_;
 };
 
 class V4L2DeviceFormat
@@ -190,6 +217,22 @@ class V4L2VideoDevice : public V4L2Device
 public:
 	using Formats = std::map<V4L2PixelFormat, std::vector<SizeRange>>;
 
+	struct Stats {
+		static constexpr unsigned int kLatencyBins = 12;
+
+		uint64_t queued = 0;
+		uint64_t dequeued = 0;
+		uint64_t errors = 0;
+		uint64_t sequenceGaps = 0;
+		unsigned int queueDepth = 0;
+		unsigned int maxQueueDepth = 0;
+		utils::Duration totalLatency;
+		utils::Duration maxLatency;
+		std::array<uint64_t, kLatencyBins> latencyHistogram = {};
+
+		std::string toString() const;
+	};
+
 	explicit V4L2VideoDevice(const std::string &deviceNode);
 	explicit V4L2VideoDevice(const MediaEntity *entity);
 	~V4L2VideoDevice();
@@ -217,11 +260,22 @@ public:
 	int exportBuffers(unsigned int count,
 			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 	int importBuffers(unsigned int count);
+	int addBuffers(unsigned int count,
+		       std::vector<std::unique_ptr<FrameBuffer>> *buffers = nullptr);
 	int releaseBuffers();
 
-	int queueBuffer(FrameBuffer *buffer);
+	int queueBuffer(FrameBuffer *buffer, const MediaRequest *request = nullptr);
 	Signal<FrameBuffer *> bufferReady;
 
+	bool supportsRequests() const
+	{
+		return bufferCaps_ & V4L2_BUF_CAP_SUPPORTS_REQUESTS;
+	}
+
+	V4L2BufferCache::Counters bufferCacheCounters() const;
+	Stats stats() const;
+	void resetStats();
+
 	int streamOn();
 	int streamOff();
 
@@ -266,9 +320,12 @@ private:
 	UniqueFD exportDmabufFd(unsigned int index, unsigned int plane);
 
 	void bufferAvailable();
+	void flushReadyBuffers();
 	FrameBuffer *dequeueBuffer();
 
-	int queueToDevice(FrameBuffer *buffer);
+	int queueToDevice(FrameBuffer *buffer, const MediaRequest *request = nullptr);
+
+	void updateStats(unsigned int index, const struct v4l2_buffer &buf);
 
 	void watchdogExpired();
 
@@ -282,16 +339,26 @@ private:
 
 	enum v4l2_buf_type bufferType_;
 	enum v4l2_memory memoryType_;
+	uint32_t bufferCaps_;
 
 	V4L2BufferCache *cache_;
+	V4L2BufferCache::Counters releasedCacheCounters_;
+	std::vector<MemoryAccount> bufferAccounts_;
 	std::map<unsigned int, FrameBuffer *> queuedBuffers_;
 	std::queue<FrameBuffer *> pendingBuffersToQueue_;
+	std::queue<FrameBuffer *> readyBuffers_;
 
 	EventNotifier *fdBufferNotifier_;
 
 	State state_;
 	std::optional<unsigned int> firstFrame_;
 
+	Stats stats_;
+	/* Time at which each V4L2 buffer was queued, indexed by buffer index */
+	std::vector<utils::time_point> queueTimes_;
+	std::optional<uint32_t> lastSequence_;
+	utils::time_point lastStatsLog_;
+
 	Timer watchdog_;
 	utils::Duration watchdogDuration_;
 };
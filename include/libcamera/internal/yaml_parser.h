@@ -9,6 +9,7 @@
 
 #include <iterator>
 #include <map>
+#include <memory>
 #include <optional>
 #include <stdint.h>
 #include <string>
@@ -22,18 +23,19 @@
 namespace libcamera {
 
 class File;
+class YamlCache;
 class YamlParserContext;
 
 class YamlObject
 {
 private:
 	struct Value {
-		Value(std::string &&k, std::unique_ptr<YamlObject> &&v)
-			: key(std::move(k)), value(std::move(v))
+		Value(std::string &&k, YamlObject *v)
+			: key(std::move(k)), value(v)
 		{
 		}
 		std::string key;
-		std::unique_ptr<YamlObject> value;
+		YamlObject *value;
 	};
 
 	using Container = std::vector<Value>;
@@ -112,12 +114,12 @@ public:
 
 		value_type operator*() const
 		{
-			return *it_->value.get();
+			return *it_->value;
 		}
 
 		pointer operator->() const
 		{
-			return it_->value.get();
+			return it_->value;
 		}
 	};
 
@@ -130,7 +132,7 @@ public:
 
 		value_type operator*() const
 		{
-			return { it_->key, *it_->value.get() };
+			return { it_->key, *it_->value };
 		}
 	};
 
@@ -215,6 +217,7 @@ private:
 
 	template<typename T>
 	friend struct Getter;
+	friend class YamlCache;
 	friend class YamlParserContext;
 
 	enum class Type {
@@ -229,11 +232,19 @@ private:
 		std::optional<T> get(const YamlObject &obj) const;
 	};
 
+	class Arena;
+
+	static Arena *arena(YamlObject &root);
+	void buildIndex();
+	const YamlObject *find(std::string_view key) const;
+
 	Type type_;
 
 	std::string value_;
 	Container list_;
-	std::map<std::string, YamlObject *, std::less<>> dictionary_;
+	std::vector<uint32_t> index_;
+
+	std::unique_ptr<Arena> arena_;
 };
 
 class YamlParser final
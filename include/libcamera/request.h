@@ -51,6 +51,7 @@ public:
 
 	ControlList &controls() { return *controls_; }
 	ControlList &metadata() { return *metadata_; }
+	const ControlList &metadata() const { return *metadata_; }
 	const BufferMap &buffers() const { return bufferMap_; }
 	int addBuffer(const Stream *stream, FrameBuffer *buffer,
 		      std::unique_ptr<Fence> fence = nullptr);
@@ -58,6 +59,8 @@ public:
 
 	uint32_t sequence() const;
 	uint64_t cookie() const { return cookie_; }
+	unsigned int priority() const;
+	void setPriority(unsigned int priority);
 	Status status() const { return status_; }
 
 	bool hasPendingBuffers() const;
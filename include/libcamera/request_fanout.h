@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Distribution of completed requests to multiple consumers
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/signal.h>
+
+namespace libcamera {
+
+class Camera;
+class ControlList;
+class Request;
+
+class RequestFanout : public Extensible
+{
+	LIBCAMERA_DECLARE_PRIVATE()
+
+public:
+	enum class DropPolicy {
+		DropOldest,
+		DropNewest,
+	};
+
+	RequestFanout(std::shared_ptr<Camera> camera);
+	~RequestFanout();
+
+	int addConsumer(unsigned int queueDepth = 1,
+			DropPolicy policy = DropPolicy::DropOldest);
+	int addRequest(std::unique_ptr<Request> request);
+
+	int start(const ControlList *controls = nullptr);
+	int stop();
+
+	const Request *acquire(unsigned int consumer);
+	void release(const Request *request);
+
+	Signal<unsigned int> requestAvailable;
+
+private:
+	LIBCAMERA_DISABLE_COPY(RequestFanout)
+};
+
+} /* namespace libcamera */
@@ -14,6 +14,10 @@
 #include <libcamera/geometry.h>
 #include <libcamera/pixel_format.h>
 
+namespace libcamera {
+class MappedFrameBufferCache;
+} /* namespace libcamera */
+
 class CameraBuffer final : public libcamera::Extensible
 {
 	LIBCAMERA_DECLARE_PRIVATE()
@@ -21,7 +25,8 @@ class CameraBuffer final : public libcamera::Extensible
 public:
 	CameraBuffer(buffer_handle_t camera3Buffer,
 		     libcamera::PixelFormat pixelFormat,
-		     const libcamera::Size &size, int flags);
+		     const libcamera::Size &size, int flags,
+		     libcamera::MappedFrameBufferCache *cache = nullptr);
 	~CameraBuffer();
 
 	bool isValid() const;
@@ -41,10 +46,11 @@ public:
 #define PUBLIC_CAMERA_BUFFER_IMPLEMENTATION				\
 CameraBuffer::CameraBuffer(buffer_handle_t camera3Buffer,		\
 			   libcamera::PixelFormat pixelFormat,		\
-			   const libcamera::Size &size, int flags)	\
+			   const libcamera::Size &size, int flags,	\
+			   libcamera::MappedFrameBufferCache *cache)	\
 	: Extensible(std::make_unique<Private>(this, camera3Buffer,	\
 					       pixelFormat, size,	\
-					       flags))			\
+					       flags, cache))		\
 {									\
 }									\
 CameraBuffer::~CameraBuffer()						\
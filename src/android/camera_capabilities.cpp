@@ -362,6 +362,9 @@ CameraCapabilities::computeCapabilities()
 	if (rawStreamAvailable_)
 		capabilities.insert(ANDROID_REQUEST_AVAILABLE_CAPABILITIES_RAW);
 
+	if (!reprocessInputSize_.isNull())
+		capabilities.insert(ANDROID_REQUEST_AVAILABLE_CAPABILITIES_YUV_REPROCESSING);
+
 	return capabilities;
 }
 
@@ -1379,6 +1382,23 @@ int CameraCapabilities::initializeStaticMetadata()
 			<< entry.minFrameDurationNsec << "]"
 			<< "@" << fps;
 	}
+	/*
+	 * YUV reprocessing is implemented in software by the post-processors,
+	 * from NV12 input buffers of the maximum YUV output size, which is
+	 * also a JPEG size.
+	 */
+	reprocessInputSize_ = maxYUVSize;
+	if (!reprocessInputSize_.isNull()) {
+		availableStreamConfigurations.push_back(HAL_PIXEL_FORMAT_YCbCr_420_888);
+		availableStreamConfigurations.push_back(maxYUVSize.width);
+		availableStreamConfigurations.push_back(maxYUVSize.height);
+		availableStreamConfigurations.push_back(
+			ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_INPUT);
+
+		LOG(HAL, Debug) << "Input Stream: YCbCr_420_888 ("
+				<< maxYUVSize << ")";
+	}
+
 	staticMetadata_->addEntry(ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
 				  availableStreamConfigurations);
 
@@ -1430,11 +1450,29 @@ int CameraCapabilities::initializeStaticMetadata()
 					  maxPipelineDepth);
 	}
 
-	/* LIMITED does not support reprocessing. */
-	uint32_t maxNumInputStreams = 0;
+	/* Reprocessing static metadata. */
+	int32_t maxNumInputStreams = reprocessInputSize_.isNull() ? 0 : 1;
 	staticMetadata_->addEntry(ANDROID_REQUEST_MAX_NUM_INPUT_STREAMS,
 				  maxNumInputStreams);
 
+	if (maxNumInputStreams) {
+		int32_t inputOutputFormatsMap[] = {
+			HAL_PIXEL_FORMAT_YCbCr_420_888, 2,
+			HAL_PIXEL_FORMAT_YCbCr_420_888, HAL_PIXEL_FORMAT_BLOB,
+		};
+		staticMetadata_->addEntry(ANDROID_SCALER_AVAILABLE_INPUT_OUTPUT_FORMATS_MAP,
+					  inputOutputFormatsMap);
+
+		/* The input buffer is processed as soon as it is queued. */
+		int32_t maxCaptureStall = 1;
+		staticMetadata_->addEntry(ANDROID_REPROCESS_MAX_CAPTURE_STALL,
+					  maxCaptureStall);
+
+		availableCharacteristicsKeys_.insert(ANDROID_REPROCESS_MAX_CAPTURE_STALL);
+		availableRequestKeys_.insert(ANDROID_REPROCESS_EFFECTIVE_EXPOSURE_FACTOR);
+		availableResultKeys_.insert(ANDROID_REPROCESS_EFFECTIVE_EXPOSURE_FACTOR);
+	}
+
 	/* Number of { RAW, YUV, JPEG } supported output streams */
 	int32_t numOutStreams[] = { rawStreamAvailable_, 2, 1 };
 	staticMetadata_->addEntry(ANDROID_REQUEST_MAX_NUM_OUTPUT_STREAMS,
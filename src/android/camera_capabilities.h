@@ -31,6 +31,7 @@ public:
 	CameraMetadata *staticMetadata() const { return staticMetadata_.get(); }
 	libcamera::PixelFormat toPixelFormat(int format) const;
 	unsigned int maxJpegBufferSize() const { return maxJpegBufferSize_; }
+	bool reprocessingAvailable() const { return !reprocessInputSize_.isNull(); }
 
 	std::unique_ptr<CameraMetadata> requestTemplateManual() const;
 	std::unique_ptr<CameraMetadata> requestTemplatePreview() const;
@@ -71,6 +72,7 @@ private:
 	int facing_;
 	int orientation_;
 	bool rawStreamAvailable_;
+	libcamera::Size reprocessInputSize_;
 	int64_t maxFrameDuration_;
 	camera_metadata_enum_android_info_supported_hardware_level hwLevel_;
 	std::set<camera_metadata_enum_android_request_available_capabilities> capabilities_;
@@ -11,6 +11,7 @@
 #include <fstream>
 #include <set>
 #include <sys/mman.h>
+#include <sys/poll.h>
 #include <unistd.h>
 #include <vector>
 
@@ -39,6 +40,18 @@ LOG_DECLARE_CATEGORY(HAL)
 
 namespace {
 
+/*
+ * Number of frame buffers of completed requests kept for reuse, enough to
+ * cover the buffers of all the streams of a configuration.
+ */
+constexpr unsigned int kMaxFreeFrameBuffers = 32;
+
+/* Number of input buffers the framework can queue for reprocessing. */
+constexpr unsigned int kMaxInputBuffers = 2;
+
+/* Timeout waiting on the acquire fence of a reprocessing input buffer. */
+constexpr int kInputFenceTimeoutMs = 300;
+
 /*
  * \struct Camera3StreamConfig
  * \brief Data to store StreamConfiguration associated with camera3_stream(s)
@@ -249,6 +262,7 @@ bool validateCropRotate(const camera3_stream_configuration_t &streamList)
 
 CameraDevice::CameraDevice(unsigned int id, std::shared_ptr<Camera> camera)
 	: id_(id), state_(State::Stopped), camera_(std::move(camera)),
+	  inputStream_(nullptr), sendingResults_(false),
 	  facing_(CAMERA_FACING_FRONT), orientation_(0)
 {
 	camera_->requestCompleted.connect(this, &CameraDevice::requestComplete);
@@ -427,6 +441,21 @@ void CameraDevice::flush()
 
 	camera_->stop();
 
+	/*
+	 * Complete the buffers waiting on their acquire fence or queued for
+	 * post-processing.
+	 */
+	for (CameraStream &stream : streams_)
+		stream.flush();
+
+	/* All the results shall be returned before flush() returns. */
+	{
+		MutexLocker descriptorsLock(descriptorsMutex_);
+		waitCaptureResults(descriptorsLock);
+	}
+
+	clearFrameBuffers();
+
 	MutexLocker stateLock(stateMutex_);
 	state_ = State::Stopped;
 }
@@ -437,11 +466,19 @@ void CameraDevice::stop()
 
 	camera_->stop();
 
+	/* Make sure no fence wait or post-processor still uses the buffers. */
+	for (CameraStream &stream : streams_)
+		stream.flush();
+
 	{
 		MutexLocker descriptorsLock(descriptorsMutex_);
 		descriptors_ = {};
+		/* The results being sent reference the streams. */
+		waitCaptureResults(descriptorsLock);
 	}
 
+	clearFrameBuffers();
+
 	streams_.clear();
 
 	state_ = State::Stopped;
@@ -499,8 +536,20 @@ const camera_metadata_t *CameraDevice::constructDefaultRequestSettings(int type)
 		captureIntent = ANDROID_CONTROL_CAPTURE_INTENT_MANUAL;
 		requestTemplate = capabilities_.requestTemplateManual();
 		break;
-	/* \todo Implement templates generation for the remaining use cases. */
 	case CAMERA3_TEMPLATE_ZERO_SHUTTER_LAG:
+		/*
+		 * Zero shutter lag is implemented by the framework through
+		 * reprocessing, the captures use the still capture settings.
+		 */
+		if (!capabilities_.reprocessingAvailable()) {
+			LOG(HAL, Error) << "Zero shutter lag requires reprocessing";
+			return nullptr;
+		}
+
+		captureIntent = ANDROID_CONTROL_CAPTURE_INTENT_ZERO_SHUTTER_LAG;
+		requestTemplate = capabilities_.requestTemplateStill();
+		break;
+	/* \todo Implement templates generation for the remaining use cases. */
 	default:
 		LOG(HAL, Error) << "Unsupported template request type: " << type;
 		return nullptr;
@@ -554,6 +603,8 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	 */
 	streams_.clear();
 	streams_.reserve(stream_list->num_streams);
+	clearFrameBuffers();
+	inputStream_ = nullptr;
 
 	std::vector<Camera3StreamConfig> streamConfigs;
 	streamConfigs.reserve(stream_list->num_streams);
@@ -593,6 +644,37 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		}
 #endif
 
+		/*
+		 * Input streams carry the buffers of reprocessing requests.
+		 * They are not produced by the camera and map to no libcamera
+		 * stream.
+		 */
+		if (stream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL) {
+			LOG(HAL, Error) << "Bidirectional streams are not supported";
+			return -EINVAL;
+		}
+
+		if (stream->stream_type == CAMERA3_STREAM_INPUT) {
+			if (inputStream_) {
+				LOG(HAL, Error)
+					<< "Multiple input streams are not supported";
+				return -EINVAL;
+			}
+
+			if (stream->format != HAL_PIXEL_FORMAT_YCbCr_420_888) {
+				LOG(HAL, Error)
+					<< "Unsupported input stream format "
+					<< utils::hex(stream->format);
+				return -EINVAL;
+			}
+
+			stream->usage |= GRALLOC_USAGE_SW_READ_OFTEN;
+			stream->max_buffers = kMaxInputBuffers;
+			stream->priv = nullptr;
+			inputStream_ = stream;
+			continue;
+		}
+
 		/* Defer handling of MJPEG streams until all others are known. */
 		if (stream->format == HAL_PIXEL_FORMAT_BLOB) {
 			if (jpegStream) {
@@ -765,8 +847,22 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 			LOG(HAL, Error) << "Failed to configure camera stream";
 			return ret;
 		}
+
+		if (!inputStream_)
+			continue;
+
+		ret = cameraStream.configureReprocessing({ inputStream_->width,
+							  inputStream_->height });
+		if (ret) {
+			LOG(HAL, Error) << "Failed to configure stream reprocessing";
+			return ret;
+		}
 	}
 
+	resultMetadataTemplate_ = createResultMetadataTemplate();
+	if (!resultMetadataTemplate_)
+		return -ENOMEM;
+
 	config_ = std::move(config);
 	return 0;
 }
@@ -775,6 +871,36 @@ std::unique_ptr<HALFrameBuffer>
 CameraDevice::createFrameBuffer(const buffer_handle_t camera3buffer,
 				PixelFormat pixelFormat, const Size &size)
 {
+	std::unique_ptr<HALFrameBuffer> frameBuffer;
+
+	/*
+	 * The framework cycles through a small set of buffers for each stream.
+	 * Reuse the frame buffer that wrapped the same buffer for a previous
+	 * request if there's one, which skips the plane layout computation
+	 * and lets the V4L2 buffer cache of the pipeline handler hit.
+	 * Otherwise recycle the least recently used frame buffer to avoid
+	 * allocating memory for every request.
+	 */
+	{
+		MutexLocker locker(frameBuffersMutex_);
+
+		auto it = std::find_if(freeFrameBuffers_.begin(),
+				       freeFrameBuffers_.end(),
+				       [&](const auto &buffer) {
+					       return buffer->wraps(camera3buffer);
+				       });
+		if (it != freeFrameBuffers_.end()) {
+			frameBuffer = std::move(*it);
+			freeFrameBuffers_.erase(it);
+			return frameBuffer;
+		}
+
+		if (freeFrameBuffers_.size() >= kMaxFreeFrameBuffers) {
+			frameBuffer = std::move(freeFrameBuffers_.front());
+			freeFrameBuffers_.erase(freeFrameBuffers_.begin());
+		}
+	}
+
 	CameraBuffer buf(camera3buffer, pixelFormat, size, PROT_READ);
 	if (!buf.isValid()) {
 		LOG(HAL, Fatal) << "Failed to create CameraBuffer";
@@ -794,9 +920,31 @@ CameraDevice::createFrameBuffer(const buffer_handle_t camera3buffer,
 		planes[i].length = buf.size(i);
 	}
 
+	if (frameBuffer) {
+		frameBuffer->retarget(planes, camera3buffer);
+		return frameBuffer;
+	}
+
 	return std::make_unique<HALFrameBuffer>(planes, camera3buffer);
 }
 
+void CameraDevice::recycleFrameBuffer(std::unique_ptr<HALFrameBuffer> frameBuffer)
+{
+	MutexLocker locker(frameBuffersMutex_);
+	freeFrameBuffers_.push_back(std::move(frameBuffer));
+}
+
+/*
+ * Drop the frame buffers of completed requests, which releases their dmabufs.
+ * The buffers that the framework will queue after a flush or a stream
+ * configuration may be new ones.
+ */
+void CameraDevice::clearFrameBuffers()
+{
+	MutexLocker locker(frameBuffersMutex_);
+	freeFrameBuffers_.clear();
+}
+
 int CameraDevice::processControls(Camera3RequestDescriptor *descriptor)
 {
 	const CameraMetadata &settings = descriptor->settings_;
@@ -932,6 +1080,27 @@ bool CameraDevice::isValidRequest(camera3_capture_request_t *camera3Request) con
 		}
 	}
 
+	if (camera3Request->input_buffer) {
+		const camera3_stream_buffer_t &inputBuffer =
+			*camera3Request->input_buffer;
+
+		if (!inputStream_ || inputBuffer.stream != inputStream_) {
+			LOG(HAL, Error) << "Input buffer for an unconfigured stream";
+			return false;
+		}
+
+		if (!inputBuffer.buffer || !(*inputBuffer.buffer)) {
+			LOG(HAL, Error) << "Invalid input native handle";
+			return false;
+		}
+
+		/* The settings of the input frame are required to reprocess it. */
+		if (!camera3Request->settings) {
+			LOG(HAL, Error) << "No settings provided for reprocessing";
+			return false;
+		}
+	}
+
 	return true;
 }
 
@@ -948,6 +1117,13 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 	auto descriptor = std::make_unique<Camera3RequestDescriptor>(camera_.get(),
 								     camera3Request);
 
+	/*
+	 * Reprocessing requests don't involve the camera, and their settings
+	 * describe the input frame rather than new capture settings.
+	 */
+	if (descriptor->isReprocess())
+		return reprocessRequest(std::move(descriptor));
+
 	/*
 	 * \todo The Android request model is incremental, settings passed in
 	 * previous requests are to be effective until overridden explicitly in
@@ -1135,6 +1311,102 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 	return 0;
 }
 
+/*
+ * Produce the output buffers of a reprocessing request from its input buffer,
+ * by running the reprocessor of each output stream. The request is completed
+ * when all the buffers have been processed, in order with the capture requests
+ * queued before it.
+ */
+int CameraDevice::reprocessRequest(std::unique_ptr<Camera3RequestDescriptor> descriptor)
+{
+	Camera3RequestDescriptor::InputBuffer *input = descriptor->input_.get();
+
+	LOG(HAL, Debug) << "Reprocessing request " << descriptor->frameNumber_
+			<< " with " << descriptor->buffers_.size() << " streams";
+
+	/*
+	 * The input buffer is read on the post-processing threads, wait for
+	 * its producer to release it first.
+	 */
+	if (input->fence.isValid()) {
+		struct pollfd fds = { input->fence.get(), POLLIN, 0 };
+		int ret = poll(&fds, 1, kInputFenceTimeoutMs);
+		if (ret <= 0 || (fds.revents & (POLLERR | POLLNVAL))) {
+			LOG(HAL, Error) << "Failed waiting for input fence";
+			return -EINVAL;
+		}
+
+		input->fence.reset();
+	}
+
+	input->frameBuffer = createFrameBuffer(*input->camera3Buffer, formats::NV12,
+					       { input->stream->width,
+						 input->stream->height });
+	if (!input->frameBuffer) {
+		LOG(HAL, Error) << "Failed to create input frame buffer";
+		return -ENOMEM;
+	}
+
+	Camera3RequestDescriptor *rawDescriptor = descriptor.get();
+
+	{
+		MutexLocker stateLock(stateMutex_);
+
+		{
+			MutexLocker descriptorsLock(descriptorsMutex_);
+			descriptors_.push(std::move(descriptor));
+		}
+
+		if (state_ == State::Flushing) {
+			abortRequest(rawDescriptor);
+			completeDescriptor(rawDescriptor);
+			return 0;
+		}
+	}
+
+	/* The shutter timestamp is the one of the input frame. */
+	camera_metadata_ro_entry_t entry;
+	uint64_t sensorTimestamp = 0;
+	if (rawDescriptor->settings_.getEntry(ANDROID_SENSOR_TIMESTAMP, &entry))
+		sensorTimestamp = *entry.data.i64;
+	notifyShutter(rawDescriptor->frameNumber_, sensorTimestamp);
+
+	rawDescriptor->resultMetadata_ = getResultMetadata(*rawDescriptor);
+	if (!rawDescriptor->resultMetadata_) {
+		notifyError(rawDescriptor->frameNumber_, nullptr,
+			    CAMERA3_MSG_ERROR_RESULT);
+		rawDescriptor->resultMetadata_ = std::make_unique<CameraMetadata>(0, 0);
+	}
+
+	MutexLocker locker(rawDescriptor->streamsProcessMutex_);
+
+	for (auto &buffer : rawDescriptor->buffers_) {
+		buffer.srcBuffer = input->frameBuffer.get();
+		rawDescriptor->pendingStreamsToProcess_.insert({ buffer.stream, &buffer });
+	}
+
+	/* As in requestComplete(), completions can't run until unlocked. */
+	auto iter = rawDescriptor->pendingStreamsToProcess_.begin();
+	while (iter != rawDescriptor->pendingStreamsToProcess_.end()) {
+		CameraStream *stream = iter->first;
+		Camera3RequestDescriptor::StreamBuffer *buffer = iter->second;
+
+		++iter;
+		int ret = stream->process(buffer);
+		if (ret) {
+			setBufferStatus(*buffer, Camera3RequestDescriptor::Status::Error);
+			rawDescriptor->pendingStreamsToProcess_.erase(stream);
+		}
+	}
+
+	if (rawDescriptor->pendingStreamsToProcess_.empty()) {
+		locker.unlock();
+		completeDescriptor(rawDescriptor);
+	}
+
+	return 0;
+}
+
 void CameraDevice::requestComplete(Request *request)
 {
 	Camera3RequestDescriptor *descriptor =
@@ -1275,64 +1547,129 @@ void CameraDevice::completeDescriptor(Camera3RequestDescriptor *descriptor)
 	MutexLocker lock(descriptorsMutex_);
 	descriptor->complete_ = true;
 
-	sendCaptureResults();
+	sendCaptureResults(lock);
 }
 
 /**
  * \brief Sequentially send capture results to the framework
+ * \param[in] locker The locker holding the descriptors mutex
  *
  * Iterate over the descriptors queue to send completed descriptors back to the
- * framework, in the same order as they have been queued. For each complete
- * descriptor, populate a locally-scoped camera3_capture_result_t from the
- * descriptor, send the capture result back by calling the
- * process_capture_result() callback, and remove the descriptor from the queue.
- * Stop iterating if the descriptor at the front of the queue is not complete.
+ * framework, in the same order as they have been queued. All the descriptors
+ * completed at the front of the queue are removed from the queue at once, and
+ * their capture results are then sent with the descriptors mutex released, to
+ * avoid blocking the threads completing other descriptors while the framework
+ * processes the results. The iteration stops when the descriptor at the front
+ * of the queue is not complete.
+ *
+ * Only one thread sends results at a time, to preserve their order. If another
+ * thread is already sending results, this function returns immediately, and
+ * the results of the descriptors completed in the meantime are sent by that
+ * thread.
  *
  * This function should never be called directly in the codebase. Use
  * completeDescriptor() instead.
  */
-void CameraDevice::sendCaptureResults()
+void CameraDevice::sendCaptureResults(MutexLocker &locker)
 {
-	while (!descriptors_.empty() && !descriptors_.front()->isPending()) {
-		auto descriptor = std::move(descriptors_.front());
-		descriptors_.pop();
+	if (sendingResults_)
+		return;
 
-		camera3_capture_result_t captureResult = {};
+	sendingResults_ = true;
 
-		captureResult.frame_number = descriptor->frameNumber_;
+	std::vector<std::unique_ptr<Camera3RequestDescriptor>> completed;
 
-		if (descriptor->resultMetadata_)
-			captureResult.result =
-				descriptor->resultMetadata_->getMetadata();
+	while (true) {
+		while (!descriptors_.empty() && !descriptors_.front()->isPending()) {
+			completed.push_back(std::move(descriptors_.front()));
+			descriptors_.pop();
+		}
 
-		std::vector<camera3_stream_buffer_t> resultBuffers;
-		resultBuffers.reserve(descriptor->buffers_.size());
+		if (completed.empty())
+			break;
 
-		for (auto &buffer : descriptor->buffers_) {
-			camera3_buffer_status status = CAMERA3_BUFFER_STATUS_ERROR;
+		locker.unlock();
 
-			if (buffer.status == Camera3RequestDescriptor::Status::Success)
-				status = CAMERA3_BUFFER_STATUS_OK;
+		for (auto &descriptor : completed)
+			sendCaptureResult(descriptor.get());
 
-			/*
-			 * Pass the buffer fence back to the camera framework as
-			 * a release fence. This instructs the framework to wait
-			 * on the acquire fence in case we haven't done so
-			 * ourselves for any reason.
-			 */
-			resultBuffers.push_back({ buffer.stream->camera3Stream(),
-						  buffer.camera3Buffer, status,
-						  -1, buffer.fence.release() });
-		}
+		completed.clear();
+
+		locker.lock();
+	}
+
+	sendingResults_ = false;
+	resultsSentCv_.notify_all();
+}
+
+/*
+ * Wait until the thread sending capture results, if any, has sent all the
+ * results of the completed descriptors.
+ */
+void CameraDevice::waitCaptureResults(MutexLocker &locker)
+{
+	resultsSentCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(descriptorsMutex_) {
+		return !sendingResults_;
+	});
+}
+
+void CameraDevice::sendCaptureResult(Camera3RequestDescriptor *descriptor)
+{
+	camera3_capture_result_t captureResult = {};
 
-		captureResult.num_output_buffers = resultBuffers.size();
-		captureResult.output_buffers = resultBuffers.data();
+	captureResult.frame_number = descriptor->frameNumber_;
 
-		if (descriptor->status_ == Camera3RequestDescriptor::Status::Success)
-			captureResult.partial_result = 1;
+	if (descriptor->resultMetadata_)
+		captureResult.result =
+			descriptor->resultMetadata_->getMetadata();
 
-		callbacks_->process_capture_result(callbacks_, &captureResult);
+	std::vector<camera3_stream_buffer_t> resultBuffers;
+	resultBuffers.reserve(descriptor->buffers_.size());
+
+	for (auto &buffer : descriptor->buffers_) {
+		camera3_buffer_status status = CAMERA3_BUFFER_STATUS_ERROR;
+
+		if (buffer.status == Camera3RequestDescriptor::Status::Success)
+			status = CAMERA3_BUFFER_STATUS_OK;
+
+		/*
+		 * Pass the buffer fence back to the camera framework as
+		 * a release fence. This instructs the framework to wait
+		 * on the acquire fence in case we haven't done so
+		 * ourselves for any reason.
+		 */
+		resultBuffers.push_back({ buffer.stream->camera3Stream(),
+					  buffer.camera3Buffer, status,
+					  -1, buffer.fence.release() });
 	}
+
+	captureResult.num_output_buffers = resultBuffers.size();
+	captureResult.output_buffers = resultBuffers.data();
+
+	/* Return the input buffer of reprocessing requests. */
+	camera3_stream_buffer_t inputBuffer = {};
+	if (descriptor->input_) {
+		Camera3RequestDescriptor::InputBuffer *input =
+			descriptor->input_.get();
+
+		inputBuffer = { input->stream, input->camera3Buffer,
+				CAMERA3_BUFFER_STATUS_OK, -1,
+				input->fence.release() };
+		captureResult.input_buffer = &inputBuffer;
+	}
+
+	if (descriptor->status_ == Camera3RequestDescriptor::Status::Success)
+		captureResult.partial_result = 1;
+
+	callbacks_->process_capture_result(callbacks_, &captureResult);
+
+	for (auto &buffer : descriptor->buffers_) {
+		if (buffer.frameBuffer)
+			recycleFrameBuffer(std::move(buffer.frameBuffer));
+	}
+
+	if (descriptor->input_ && descriptor->input_->frameBuffer)
+		recycleFrameBuffer(std::move(descriptor->input_->frameBuffer));
 }
 
 void CameraDevice::setBufferStatus(Camera3RequestDescriptor::StreamBuffer &streamBuffer,
@@ -1418,36 +1755,20 @@ void CameraDevice::notifyError(uint32_t frameNumber, camera3_stream_t *stream,
 }
 
 /*
- * Produce a set of fixed result metadata.
+ * Build the part of the result metadata that doesn't depend on the request,
+ * along with placeholders for the per-frame entries that are always reported,
+ * which getResultMetadata() then updates in place.
  */
-std::unique_ptr<CameraMetadata>
-CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) const
+std::unique_ptr<CameraMetadata> CameraDevice::createResultMetadataTemplate() const
 {
-	const ControlList &metadata = descriptor.request_->metadata();
-	const CameraMetadata &settings = descriptor.settings_;
-	camera_metadata_ro_entry_t entry;
-	bool found;
-
 	/*
 	 * \todo Keep this in sync with the actual number of entries.
-	 * Currently: 40 entries, 156 bytes
-	 *
-	 * Reserve more space for the JPEG metadata set by the post-processor.
-	 * Currently:
-	 * ANDROID_JPEG_GPS_COORDINATES (double x 3) = 24 bytes
-	 * ANDROID_JPEG_GPS_PROCESSING_METHOD (byte x 32) = 32 bytes
-	 * ANDROID_JPEG_GPS_TIMESTAMP (int64) = 8 bytes
-	 * ANDROID_JPEG_SIZE (int32_t) = 4 bytes
-	 * ANDROID_JPEG_QUALITY (byte) = 1 byte
-	 * ANDROID_JPEG_ORIENTATION (int32_t) = 4 bytes
-	 * ANDROID_JPEG_THUMBNAIL_QUALITY (byte) = 1 byte
-	 * ANDROID_JPEG_THUMBNAIL_SIZE (int32 x 2) = 8 bytes
-	 * Total bytes for JPEG metadata: 82
+	 * Currently: 30 entries, 16 bytes
 	 */
 	std::unique_ptr<CameraMetadata> resultMetadata =
-		std::make_unique<CameraMetadata>(88, 166);
+		std::make_unique<CameraMetadata>(30, 16);
 	if (!resultMetadata->isValid()) {
-		LOG(HAL, Error) << "Failed to allocate result metadata";
+		LOG(HAL, Error) << "Failed to allocate result metadata template";
 		return nullptr;
 	}
 
@@ -1474,18 +1795,8 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 	value = ANDROID_CONTROL_AE_MODE_ON;
 	resultMetadata->addEntry(ANDROID_CONTROL_AE_MODE, value);
 
-	if (settings.getEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, &entry))
-		/*
-		 * \todo Retrieve the AE FPS range from the libcamera metadata.
-		 * As libcamera does not support that control, as a temporary
-		 * workaround return what the framework asked.
-		 */
-		resultMetadata->addEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE,
-					 entry.data.i32, 2);
-
-	found = settings.getEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, &entry);
-	value = found ? *entry.data.u8 :
-			(uint8_t)ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE;
+	/* Updated from the request settings. */
+	value = ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE;
 	resultMetadata->addEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, value);
 
 	value = ANDROID_CONTROL_AE_STATE_CONVERGED;
@@ -1530,9 +1841,6 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 	value = ANDROID_FLASH_STATE_UNAVAILABLE;
 	resultMetadata->addEntry(ANDROID_FLASH_STATE, value);
 
-	if (settings.getEntry(ANDROID_LENS_APERTURE, &entry))
-		resultMetadata->addEntry(ANDROID_LENS_APERTURE, entry.data.f, 1);
-
 	float focal_length = 1.0;
 	resultMetadata->addEntry(ANDROID_LENS_FOCAL_LENGTH, focal_length);
 
@@ -1543,13 +1851,10 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 	resultMetadata->addEntry(ANDROID_LENS_OPTICAL_STABILIZATION_MODE,
 				 value);
 
+	/* Updated from the libcamera metadata. */
 	value32 = ANDROID_SENSOR_TEST_PATTERN_MODE_OFF;
 	resultMetadata->addEntry(ANDROID_SENSOR_TEST_PATTERN_MODE, value32);
 
-	if (settings.getEntry(ANDROID_STATISTICS_FACE_DETECT_MODE, &entry))
-		resultMetadata->addEntry(ANDROID_STATISTICS_FACE_DETECT_MODE,
-					 entry.data.u8, 1);
-
 	value = ANDROID_STATISTICS_LENS_SHADING_MAP_MODE_OFF;
 	resultMetadata->addEntry(ANDROID_STATISTICS_LENS_SHADING_MAP_MODE,
 				 value);
@@ -1568,10 +1873,109 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 	resultMetadata->addEntry(ANDROID_SENSOR_ROLLING_SHUTTER_SKEW,
 				 rolling_shutter_skew);
 
-	/* Add metadata tags reported by libcamera. */
-	const int64_t timestamp = metadata.get(controls::SensorTimestamp).value_or(0);
+	/* Updated from the libcamera metadata. */
+	const int64_t timestamp = 0;
 	resultMetadata->addEntry(ANDROID_SENSOR_TIMESTAMP, timestamp);
 
+	if (!resultMetadata->isValid()) {
+		LOG(HAL, Error) << "Failed to construct result metadata template";
+		return nullptr;
+	}
+
+	/* Sort the entries to speed up the lookups of the per-frame updates. */
+	resultMetadata->sort();
+
+	return resultMetadata;
+}
+
+/*
+ * Produce the result metadata of a request.
+ */
+std::unique_ptr<CameraMetadata>
+CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) const
+{
+	const ControlList &metadata = descriptor.request_->metadata();
+	const CameraMetadata &settings = descriptor.settings_;
+	camera_metadata_ro_entry_t entry;
+
+	/*
+	 * \todo Keep this in sync with the actual number of entries.
+	 * Currently: 40 entries, 156 bytes
+	 *
+	 * Reserve more space for the JPEG metadata set by the post-processor.
+	 * Currently:
+	 * ANDROID_JPEG_GPS_COORDINATES (double x 3) = 24 bytes
+	 * ANDROID_JPEG_GPS_PROCESSING_METHOD (byte x 32) = 32 bytes
+	 * ANDROID_JPEG_GPS_TIMESTAMP (int64) = 8 bytes
+	 * ANDROID_JPEG_SIZE (int32_t) = 4 bytes
+	 * ANDROID_JPEG_QUALITY (byte) = 1 byte
+	 * ANDROID_JPEG_ORIENTATION (int32_t) = 4 bytes
+	 * ANDROID_JPEG_THUMBNAIL_QUALITY (byte) = 1 byte
+	 * ANDROID_JPEG_THUMBNAIL_SIZE (int32 x 2) = 8 bytes
+	 * Total bytes for JPEG metadata: 82
+	 */
+	std::unique_ptr<CameraMetadata> resultMetadata =
+		std::make_unique<CameraMetadata>(88, 166);
+	if (!resultMetadata->isValid()) {
+		LOG(HAL, Error) << "Failed to allocate result metadata";
+		return nullptr;
+	}
+
+	/*
+	 * Start from the entries that don't change between frames, and update
+	 * the per-frame ones while the entries are still sorted.
+	 */
+	if (!resultMetadataTemplate_ ||
+	    !resultMetadata->append(*resultMetadataTemplate_)) {
+		LOG(HAL, Error) << "Failed to copy result metadata template";
+		return nullptr;
+	}
+
+	if (settings.getEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, &entry))
+		resultMetadata->updateEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER,
+					    *entry.data.u8);
+
+	/*
+	 * Add metadata tags reported by libcamera. Reprocessing requests carry
+	 * the result metadata of the input frame in their settings instead.
+	 */
+	int64_t timestamp = metadata.get(controls::SensorTimestamp).value_or(0);
+	if (descriptor.isReprocess() &&
+	    settings.getEntry(ANDROID_SENSOR_TIMESTAMP, &entry))
+		timestamp = *entry.data.i64;
+	resultMetadata->updateEntry(ANDROID_SENSOR_TIMESTAMP, timestamp);
+
+	if (descriptor.isReprocess()) {
+		if (settings.getEntry(ANDROID_SENSOR_EXPOSURE_TIME, &entry))
+			resultMetadata->addEntry(ANDROID_SENSOR_EXPOSURE_TIME,
+						 entry.data.i64, 1);
+
+		if (settings.getEntry(ANDROID_REPROCESS_EFFECTIVE_EXPOSURE_FACTOR, &entry))
+			resultMetadata->addEntry(ANDROID_REPROCESS_EFFECTIVE_EXPOSURE_FACTOR,
+						 entry.data.f, 1);
+	}
+
+	const auto &testPatternMode = metadata.get(controls::draft::TestPatternMode);
+	if (testPatternMode)
+		resultMetadata->updateEntry(ANDROID_SENSOR_TEST_PATTERN_MODE,
+					    *testPatternMode);
+
+	if (settings.getEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, &entry))
+		/*
+		 * \todo Retrieve the AE FPS range from the libcamera metadata.
+		 * As libcamera does not support that control, as a temporary
+		 * workaround return what the framework asked.
+		 */
+		resultMetadata->addEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE,
+					 entry.data.i32, 2);
+
+	if (settings.getEntry(ANDROID_LENS_APERTURE, &entry))
+		resultMetadata->addEntry(ANDROID_LENS_APERTURE, entry.data.f, 1);
+
+	if (settings.getEntry(ANDROID_STATISTICS_FACE_DETECT_MODE, &entry))
+		resultMetadata->addEntry(ANDROID_STATISTICS_FACE_DETECT_MODE,
+					 entry.data.u8, 1);
+
 	const auto &pipelineDepth = metadata.get(controls::draft::PipelineDepth);
 	if (pipelineDepth)
 		resultMetadata->addEntry(ANDROID_REQUEST_PIPELINE_DEPTH,
@@ -1652,11 +2056,6 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 		resultMetadata->addEntry(ANDROID_SCALER_CROP_REGION, cropRect);
 	}
 
-	const auto &testPatternMode = metadata.get(controls::draft::TestPatternMode);
-	if (testPatternMode)
-		resultMetadata->addEntry(ANDROID_SENSOR_TEST_PATTERN_MODE,
-					 *testPatternMode);
-
 	/*
 	 * Return the result metadata pack even is not valid: get() will return
 	 * nullptr.
@@ -31,6 +31,7 @@
 #include "camera_stream.h"
 #include "hal_framebuffer.h"
 #include "jpeg/encoder.h"
+#include "post_processor_pool.h"
 
 class Camera3RequestDescriptor;
 struct CameraConfigData;
@@ -52,6 +53,7 @@ public:
 	camera3_device_t *camera3Device() { return &camera3Device_; }
 	const CameraCapabilities *capabilities() const { return &capabilities_; }
 	const std::shared_ptr<libcamera::Camera> &camera() const { return camera_; }
+	PostProcessorPool *postProcessorPool() { return &postProcessorPool_; }
 
 	const std::string &maker() const { return maker_; }
 	const std::string &model() const { return model_; }
@@ -87,7 +89,12 @@ private:
 	std::unique_ptr<HALFrameBuffer>
 	createFrameBuffer(const buffer_handle_t camera3buffer,
 			  libcamera::PixelFormat pixelFormat,
-			  const libcamera::Size &size);
+			  const libcamera::Size &size)
+		LIBCAMERA_TSA_EXCLUDES(frameBuffersMutex_);
+	void recycleFrameBuffer(std::unique_ptr<HALFrameBuffer> frameBuffer)
+		LIBCAMERA_TSA_EXCLUDES(frameBuffersMutex_);
+	void clearFrameBuffers() LIBCAMERA_TSA_EXCLUDES(frameBuffersMutex_);
+	int reprocessRequest(std::unique_ptr<Camera3RequestDescriptor> descriptor);
 	void abortRequest(Camera3RequestDescriptor *descriptor) const;
 	bool isValidRequest(camera3_capture_request_t *request) const;
 	void notifyShutter(uint32_t frameNumber, uint64_t timestamp);
@@ -96,9 +103,14 @@ private:
 	int processControls(Camera3RequestDescriptor *descriptor);
 	void completeDescriptor(Camera3RequestDescriptor *descriptor)
 		LIBCAMERA_TSA_EXCLUDES(descriptorsMutex_);
-	void sendCaptureResults() LIBCAMERA_TSA_REQUIRES(descriptorsMutex_);
+	void sendCaptureResults(libcamera::MutexLocker &locker)
+		LIBCAMERA_TSA_REQUIRES(descriptorsMutex_);
+	void sendCaptureResult(Camera3RequestDescriptor *descriptor);
+	void waitCaptureResults(libcamera::MutexLocker &locker)
+		LIBCAMERA_TSA_REQUIRES(descriptorsMutex_);
 	void setBufferStatus(Camera3RequestDescriptor::StreamBuffer &buffer,
 			     Camera3RequestDescriptor::Status status);
+	std::unique_ptr<CameraMetadata> createResultMetadataTemplate() const;
 	std::unique_ptr<CameraMetadata> getResultMetadata(
 		const Camera3RequestDescriptor &descriptor) const;
 
@@ -113,13 +125,31 @@ private:
 	CameraCapabilities capabilities_;
 
 	std::map<unsigned int, std::unique_ptr<CameraMetadata>> requestTemplates_;
+	/* Result metadata entries that don't change between frames */
+	std::unique_ptr<CameraMetadata> resultMetadataTemplate_;
 	const camera3_callback_ops_t *callbacks_;
 
+	/* Shared by the streams, which must be destroyed first. */
+	PostProcessorPool postProcessorPool_;
 	std::vector<CameraStream> streams_;
+	/* Input stream for reprocessing requests, if configured */
+	camera3_stream_t *inputStream_;
 
 	libcamera::Mutex descriptorsMutex_ LIBCAMERA_TSA_ACQUIRED_AFTER(stateMutex_);
 	std::queue<std::unique_ptr<Camera3RequestDescriptor>> descriptors_
 		LIBCAMERA_TSA_GUARDED_BY(descriptorsMutex_);
+	/* Set while a thread sends capture results without the lock held */
+	bool sendingResults_ LIBCAMERA_TSA_GUARDED_BY(descriptorsMutex_);
+	libcamera::ConditionVariable resultsSentCv_;
+
+	/*
+	 * Frame buffers of completed requests, from the least to the most
+	 * recently completed. They still wrap their gralloc buffer, to be reused
+	 * as-is when the framework queues the same buffer again.
+	 */
+	libcamera::Mutex frameBuffersMutex_;
+	std::vector<std::unique_ptr<HALFrameBuffer>> freeFrameBuffers_
+		LIBCAMERA_TSA_GUARDED_BY(frameBuffersMutex_);
 
 	std::string maker_;
 	std::string model_;
@@ -169,6 +169,45 @@ bool CameraMetadata::addEntry(uint32_t tag, const void *data, size_t count,
 	return false;
 }
 
+/*
+ * \brief Append all the entries of \a other to the container
+ * \param[in] other The metadata to copy the entries from
+ *
+ * The entries of \a other must not be present in the container already. The
+ * entries stay sorted if the container was empty and \a other was sorted.
+ *
+ * \return True on success, false otherwise
+ */
+bool CameraMetadata::append(const CameraMetadata &other)
+{
+	if (!valid_ || !other.isValid())
+		return false;
+
+	auto [entryCount, dataCount] = other.usage();
+	if (!resize(entryCount, dataCount)) {
+		LOG(CameraMetadata, Error) << "Failed to resize";
+		valid_ = false;
+		return false;
+	}
+
+	if (append_camera_metadata(metadata_, other.metadata_)) {
+		LOG(CameraMetadata, Error) << "Failed to append metadata";
+		valid_ = false;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * \brief Sort the entries by tag to speed up their lookup
+ */
+void CameraMetadata::sort()
+{
+	if (valid_)
+		sort_camera_metadata(metadata_);
+}
+
 bool CameraMetadata::updateEntry(uint32_t tag, const void *data, size_t count,
 				 size_t elementSize)
 {
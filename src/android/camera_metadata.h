@@ -33,6 +33,9 @@ public:
 
 	bool hasEntry(uint32_t tag) const;
 
+	bool append(const CameraMetadata &other);
+	void sort();
+
 	template<typename T,
 		 std::enable_if_t<std::is_arithmetic_v<T> ||
 				  std::is_enum_v<T>> * = nullptr>
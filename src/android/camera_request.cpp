@@ -69,7 +69,7 @@ using namespace libcamera;
  * │     ├┬───┬───┬──────────────┤     ├┬───┬───┬────────────┤                          │
  * │     ││   │   │              │     ││   │   │            │                          │
  * │     │▼───▼───▼──────────────┤     │▼───▼───▼────────────┤                          │
- * │     │PostProcessorWorker    │     │PostProcessorWorker  │                          │
+ * │     │PostProcessorPool      │     │PostProcessorPool    │                          │
  * │     │                       │     │                     │                          │
  * │     │ +------------------+  │     │ +------------------+│                          │
  * │     │ | PostProcessor    |  │     │ | PostProcessor    |│                          │
@@ -103,7 +103,7 @@ using namespace libcamera;
  * └────────────────────────────────────────────────────────────────────────────────────┘
  *
  *   +-------------+
- *   |             | - PostProcessorWorker's thread
+ *   |             | - PostProcessorPool worker thread
  *   |             |
  *   +-------------+
  */
@@ -128,6 +128,19 @@ Camera3RequestDescriptor::Camera3RequestDescriptor(
 		buffers_.emplace_back(stream, buffer, this);
 	}
 
+	/*
+	 * Reprocessing requests produce their output buffers from an input
+	 * buffer provided by the framework instead of a camera frame.
+	 */
+	if (camera3Request->input_buffer) {
+		const camera3_stream_buffer_t &buffer = *camera3Request->input_buffer;
+
+		input_ = std::make_unique<InputBuffer>();
+		input_->stream = buffer.stream;
+		input_->camera3Buffer = buffer.buffer;
+		input_->fence = UniqueFD(buffer.acquire_fence);
+	}
+
 	/* Clone the controls associated with the camera3 request. */
 	settings_ = CameraMetadata(camera3Request->settings);
 
@@ -57,6 +57,14 @@ public:
 		LIBCAMERA_DISABLE_COPY(StreamBuffer)
 	};
 
+	/* Input buffer of a reprocessing request. */
+	struct InputBuffer {
+		camera3_stream_t *stream;
+		buffer_handle_t *camera3Buffer;
+		libcamera::UniqueFD fence;
+		std::unique_ptr<HALFrameBuffer> frameBuffer;
+	};
+
 	/* Keeps track of streams requiring post-processing. */
 	std::map<CameraStream *, StreamBuffer *> pendingStreamsToProcess_
 		LIBCAMERA_TSA_GUARDED_BY(streamsProcessMutex_);
@@ -67,10 +75,12 @@ public:
 	~Camera3RequestDescriptor();
 
 	bool isPending() const { return !complete_; }
+	bool isReprocess() const { return input_ != nullptr; }
 
 	uint32_t frameNumber_ = 0;
 
 	std::vector<StreamBuffer> buffers_;
+	std::unique_ptr<InputBuffer> input_;
 
 	CameraMetadata settings_;
 	std::unique_ptr<libcamera::Request> request_;
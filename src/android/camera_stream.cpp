@@ -7,14 +7,22 @@
 
 #include "camera_stream.h"
 
+#include <chrono>
 #include <errno.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
 #include <unistd.h>
 
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
 #include <libcamera/formats.h>
 
+#include "libcamera/internal/mapped_framebuffer.h"
+
 #include "jpeg/post_processor_jpeg.h"
 #include "yuv/post_processor_yuv.h"
 
@@ -24,6 +32,7 @@
 #include "camera_metadata.h"
 #include "frame_buffer_allocator.h"
 #include "post_processor.h"
+#include "post_processor_pool.h"
 
 using namespace libcamera;
 
@@ -50,6 +59,120 @@ LOG_DECLARE_CATEGORY(HAL)
  * and buffer allocation.
  */
 
+/*
+ * Wait on the acquire fences of the destination buffers. The event notifiers
+ * and timers are created, signalled and destroyed in the camera thread, which
+ * the waiter is bound to.
+ */
+class CameraStream::FenceWaiter : public Object
+{
+public:
+	FenceWaiter(CameraStream *stream)
+		: stream_(stream)
+	{
+	}
+
+	void wait(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	void flush();
+	void clear();
+
+private:
+	struct Wait {
+		std::unique_ptr<EventNotifier> notifier;
+		std::unique_ptr<Timer> timer;
+	};
+
+	void release(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	void signalled(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	void timeout(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+
+	CameraStream *stream_;
+	std::map<Camera3RequestDescriptor::StreamBuffer *, Wait> waits_;
+};
+
+void CameraStream::FenceWaiter::wait(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
+	/*
+	 * \todo Better characterize the timeout. Currently equal to the one
+	 * used by the Rockchip Camera HAL on ChromeOS.
+	 */
+	constexpr std::chrono::milliseconds kTimeout{ 300 };
+
+	Wait &wait = waits_[streamBuffer];
+
+	wait.notifier = std::make_unique<EventNotifier>(streamBuffer->fence.get(),
+							EventNotifier::Read);
+	wait.notifier->activated.connect(this, [this, streamBuffer] {
+		signalled(streamBuffer);
+	});
+
+	wait.timer = std::make_unique<Timer>();
+	wait.timer->timeout.connect(this, [this, streamBuffer] {
+		timeout(streamBuffer);
+	});
+	wait.timer->start(kTimeout);
+}
+
+/* Complete the buffers still waiting on their fence with errors. */
+void CameraStream::FenceWaiter::flush()
+{
+	std::vector<Camera3RequestDescriptor::StreamBuffer *> streamBuffers;
+	for (const auto &[streamBuffer, wait] : waits_)
+		streamBuffers.push_back(streamBuffer);
+
+	waits_.clear();
+
+	for (Camera3RequestDescriptor::StreamBuffer *streamBuffer : streamBuffers)
+		stream_->cameraDevice_->streamProcessingComplete(streamBuffer,
+								 Camera3RequestDescriptor::Status::Error);
+}
+
+/* Drop the waits without completing the buffers. */
+void CameraStream::FenceWaiter::clear()
+{
+	waits_.clear();
+}
+
+/*
+ * Stop waiting on the fence of a buffer from the handlers of its notifier or
+ * timer. They are being emitted, delete them when control returns to the event
+ * loop.
+ */
+void CameraStream::FenceWaiter::release(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
+	auto it = waits_.find(streamBuffer);
+	Wait wait = std::move(it->second);
+	waits_.erase(it);
+
+	wait.notifier->setEnabled(false);
+	wait.timer->stop();
+
+	wait.notifier.release()->deleteLater();
+	wait.timer.release()->deleteLater();
+}
+
+void CameraStream::FenceWaiter::signalled(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
+	release(streamBuffer);
+	streamBuffer->fence.reset();
+
+	int ret = stream_->queueToWorker(streamBuffer);
+	if (ret)
+		stream_->cameraDevice_->streamProcessingComplete(streamBuffer,
+								 Camera3RequestDescriptor::Status::Error);
+}
+
+void CameraStream::FenceWaiter::timeout(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
+	LOG(HAL, Error) << "Timeout waiting for fence: "
+			<< streamBuffer->fence.get();
+
+	release(streamBuffer);
+
+	stream_->cameraDevice_->streamProcessingComplete(streamBuffer,
+							 Camera3RequestDescriptor::Status::Error);
+}
+
 CameraStream::CameraStream(CameraDevice *const cameraDevice,
 			   CameraConfiguration *config, Type type,
 			   camera3_stream_t *camera3Stream,
@@ -68,6 +191,19 @@ CameraStream::~CameraStream()
 	 * Manually delete buffers and then the allocator to make sure buffers
 	 * are released while the allocator is still valid.
 	 */
+	/* Tear the fence waits down in the camera thread. */
+	if (fenceWaiter_) {
+		fenceWaiter_->invokeMethod(&FenceWaiter::clear,
+					   ConnectionTypeBlocking);
+		fenceWaiter_.release()->deleteLater();
+	}
+
+	/* Make sure no pool worker still uses the post-processors. */
+	if (postProcessor_)
+		cameraDevice_->postProcessorPool()->unregister(postProcessor_.get());
+	if (reprocessor_)
+		cameraDevice_->postProcessorPool()->unregister(reprocessor_.get());
+
 	allocatedBuffers_.clear();
 	allocator_.reset();
 }
@@ -82,6 +218,34 @@ Stream *CameraStream::stream() const
 	return configuration().stream();
 }
 
+std::unique_ptr<PostProcessor>
+CameraStream::createPostProcessor(const PixelFormat &format)
+{
+	switch (format) {
+	case formats::NV12:
+		return std::make_unique<PostProcessorYuv>();
+
+	case formats::MJPEG:
+		return std::make_unique<PostProcessorJpeg>(cameraDevice_);
+
+	default:
+		return nullptr;
+	}
+}
+
+void CameraStream::postProcessingComplete(Camera3RequestDescriptor::StreamBuffer *streamBuffer,
+					  PostProcessor::Status status)
+{
+	Camera3RequestDescriptor::Status bufferStatus;
+
+	if (status == PostProcessor::Status::Success)
+		bufferStatus = Camera3RequestDescriptor::Status::Success;
+	else
+		bufferStatus = Camera3RequestDescriptor::Status::Error;
+
+	cameraDevice_->streamProcessingComplete(streamBuffer, bufferStatus);
+}
+
 int CameraStream::configure()
 {
 	if (type_ == Type::Internal || type_ == Type::Mapped) {
@@ -92,16 +256,8 @@ int CameraStream::configure()
 		output.size.width = camera3Stream_->width;
 		output.size.height = camera3Stream_->height;
 
-		switch (outFormat) {
-		case formats::NV12:
-			postProcessor_ = std::make_unique<PostProcessorYuv>();
-			break;
-
-		case formats::MJPEG:
-			postProcessor_ = std::make_unique<PostProcessorJpeg>(cameraDevice_);
-			break;
-
-		default:
+		postProcessor_ = createPostProcessor(outFormat);
+		if (!postProcessor_) {
 			LOG(HAL, Error) << "Unsupported format: " << outFormat;
 			return -EINVAL;
 		}
@@ -110,98 +266,192 @@ int CameraStream::configure()
 		if (ret)
 			return ret;
 
-		worker_ = std::make_unique<PostProcessorWorker>(postProcessor_.get());
 		postProcessor_->processComplete.connect(
-			this, [&](Camera3RequestDescriptor::StreamBuffer *streamBuffer,
-				  PostProcessor::Status status) {
-				Camera3RequestDescriptor::Status bufferStatus;
-
-				if (status == PostProcessor::Status::Success)
-					bufferStatus = Camera3RequestDescriptor::Status::Success;
-				else
-					bufferStatus = Camera3RequestDescriptor::Status::Error;
+			this, &CameraStream::postProcessingComplete);
 
-				cameraDevice_->streamProcessingComplete(streamBuffer,
-									bufferStatus);
-			});
-
-		worker_->start();
+		dstMaps_ = std::make_unique<MappedFrameBufferCache>(
+			MappedFrameBuffer::MapFlag::ReadWrite);
 	}
 
 	allocator_ = std::make_unique<PlatformFrameBufferAllocator>(cameraDevice_);
 	mutex_ = std::make_unique<Mutex>();
 
+	/*
+	 * The stream has reached its final location in the CameraDevice
+	 * streams vector and can be referenced by the waiter.
+	 */
+	fenceWaiter_ = std::make_unique<FenceWaiter>(this);
+	fenceWaiter_->moveToThread(cameraDevice_->camera()->thread());
+
 	camera3Stream_->max_buffers = configuration().bufferCount;
 
 	return 0;
 }
 
-int CameraStream::waitFence(int fence)
+/*
+ * Prepare the stream to be produced by reprocessing requests, from NV12 input
+ * buffers of size \a inputSize. Streams whose format or size can't be produced
+ * from the input buffers are only reported, reprocessing requests that include
+ * them complete with errors.
+ */
+int CameraStream::configureReprocessing(const Size &inputSize)
 {
-	/*
-	 * \todo The implementation here is copied from camera_worker.cpp
-	 * and both should be removed once libcamera is instrumented to handle
-	 * fences waiting in the core.
-	 *
-	 * \todo Better characterize the timeout. Currently equal to the one
-	 * used by the Rockchip Camera HAL on ChromeOS.
-	 */
-	constexpr unsigned int timeoutMs = 300;
-	struct pollfd fds = { fence, POLLIN, 0 };
+	const PixelFormat outFormat =
+		cameraDevice_->capabilities()->toPixelFormat(camera3Stream_->format);
+
+	StreamConfiguration input = configuration();
+	input.pixelFormat = formats::NV12;
+	input.size = inputSize;
+
+	StreamConfiguration output = configuration();
+	output.pixelFormat = outFormat;
+	output.size.width = camera3Stream_->width;
+	output.size.height = camera3Stream_->height;
+
+	reprocessor_ = createPostProcessor(outFormat);
+	if (!reprocessor_ || reprocessor_->configure(input, output)) {
+		LOG(HAL, Warning)
+			<< "Stream " << output.toString()
+			<< " can't be reprocessed from " << inputSize;
+		reprocessor_.reset();
+		return 0;
+	}
 
-	do {
-		int ret = poll(&fds, 1, timeoutMs);
-		if (ret == 0)
-			return -ETIME;
+	reprocessor_->processComplete.connect(
+		this, &CameraStream::postProcessingComplete);
 
-		if (ret > 0) {
-			if (fds.revents & (POLLERR | POLLNVAL))
-				return -EINVAL;
+	reprocessDstMaps_ = std::make_unique<MappedFrameBufferCache>(
+		MappedFrameBuffer::MapFlag::ReadWrite);
 
-			return 0;
-		}
-	} while (errno == EINTR || errno == EAGAIN);
+	return 0;
+}
+
+PostProcessor *
+CameraStream::postProcessorFor(const Camera3RequestDescriptor::StreamBuffer *streamBuffer) const
+{
+	if (streamBuffer->request->isReprocess())
+		return reprocessor_.get();
 
-	return -errno;
+	return postProcessor_.get();
 }
 
-int CameraStream::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+/*
+ * Wait asynchronously for the acquire fence of the destination buffer to be
+ * signalled, and queue the buffer for post-processing when it is.
+ *
+ * The fence is waited on with an event notifier in the camera thread, to
+ * avoid blocking either the camera thread or the post-processing worker on a
+ * slow producer. Errors that occur
+ * after this function returns are reported through
+ * CameraDevice::streamProcessingComplete().
+ *
+ * Return 1 if the fence has already been signalled and the buffer can be
+ * processed immediately, 0 if the wait is pending, or a negative error code
+ * otherwise.
+ */
+int CameraStream::waitFence(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
 {
-	ASSERT(type_ != Type::Direct);
+	int fence = streamBuffer->fence.get();
 
-	/* Handle waiting on fences on the destination buffer. */
-	if (streamBuffer->fence.isValid()) {
-		int ret = waitFence(streamBuffer->fence.get());
-		if (ret < 0) {
-			LOG(HAL, Error) << "Failed waiting for fence: "
-					<< streamBuffer->fence.get() << ": "
-					<< strerror(-ret);
-			return ret;
-		}
+	/* Skip the notifier if the fence has already been signalled. */
+	struct pollfd fds = { fence, POLLIN, 0 };
+	int ret = poll(&fds, 1, 0);
+	if (ret > 0) {
+		if (fds.revents & (POLLERR | POLLNVAL))
+			return -EINVAL;
 
 		streamBuffer->fence.reset();
+		return 1;
 	}
 
+	/*
+	 * Reprocessing requests are processed in the framework thread, which
+	 * has no event loop. The wait is then queued to the camera thread.
+	 */
+	fenceWaiter_->invokeMethod(&FenceWaiter::wait, ConnectionTypeAuto,
+				   streamBuffer);
+
+	return 0;
+}
+
+int CameraStream::queueToWorker(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
 	const StreamConfiguration &output = configuration();
+
+	/*
+	 * The destination buffer is mapped by the post-processor in the pool
+	 * worker, which processes the buffers of the post-processor one at a
+	 * time. Its cache is thus never accessed concurrently.
+	 */
+	MappedFrameBufferCache *maps = streamBuffer->request->isReprocess()
+				     ? reprocessDstMaps_.get()
+				     : dstMaps_.get();
+
 	streamBuffer->dstBuffer = std::make_unique<CameraBuffer>(
 		*streamBuffer->camera3Buffer, output.pixelFormat, output.size,
-		PROT_READ | PROT_WRITE);
+		PROT_READ | PROT_WRITE, maps);
 	if (!streamBuffer->dstBuffer->isValid()) {
 		LOG(HAL, Error) << "Failed to create destination buffer";
 		return -EINVAL;
 	}
 
-	worker_->queueRequest(streamBuffer);
+	cameraDevice_->postProcessorPool()->queue(postProcessorFor(streamBuffer),
+						  streamBuffer);
 
 	return 0;
 }
 
+int CameraStream::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
+	/*
+	 * Direct streams have no post-processor, but can have a reprocessor to
+	 * serve reprocessing requests.
+	 */
+	if (!postProcessorFor(streamBuffer)) {
+		LOG(HAL, Error) << "Stream can't be produced by post-processing";
+		return -EINVAL;
+	}
+
+	/* Handle waiting on fences on the destination buffer. */
+	if (streamBuffer->fence.isValid()) {
+		int ret = waitFence(streamBuffer);
+		if (ret < 0) {
+			LOG(HAL, Error) << "Failed waiting for fence: "
+					<< streamBuffer->fence.get() << ": "
+					<< strerror(-ret);
+			return ret;
+		}
+
+		if (ret == 0)
+			return 0;
+	}
+
+	return queueToWorker(streamBuffer);
+}
+
 void CameraStream::flush()
 {
-	if (!postProcessor_)
+	if (!postProcessor_ && !reprocessor_)
 		return;
 
-	worker_->flush();
+	/* Complete the buffers still waiting on their fence with errors. */
+	if (fenceWaiter_)
+		fenceWaiter_->invokeMethod(&FenceWaiter::flush,
+					   ConnectionTypeBlocking);
+
+	if (postProcessor_)
+		cameraDevice_->postProcessorPool()->flush(postProcessor_.get());
+	if (reprocessor_)
+		cameraDevice_->postProcessorPool()->flush(reprocessor_.get());
+
+	/*
+	 * No buffer is being processed anymore, release the mappings of the
+	 * framework buffers.
+	 */
+	if (dstMaps_)
+		dstMaps_->clear();
+	if (reprocessDstMaps_)
+		reprocessDstMaps_->clear();
 }
 
 FrameBuffer *CameraStream::getBuffer()
@@ -243,99 +493,3 @@ void CameraStream::putBuffer(FrameBuffer *buffer)
 
 	buffers_.push_back(buffer);
 }
-
-/**
- * \class CameraStream::PostProcessorWorker
- * \brief Post-process a CameraStream in an internal thread
- *
- * If the association between CameraStream and camera3_stream_t dictated by
- * CameraStream::Type is internal or mapped, the stream is generated by post
- * processing of a libcamera stream. Such a request is queued to a
- * PostProcessorWorker in CameraStream::process(). A queue of post-processing
- * requests is maintained by the PostProcessorWorker and it will run the
- * post-processing on an internal thread as soon as any request is available on
- * its queue.
- */
-CameraStream::PostProcessorWorker::PostProcessorWorker(PostProcessor *postProcessor)
-	: postProcessor_(postProcessor)
-{
-}
-
-CameraStream::PostProcessorWorker::~PostProcessorWorker()
-{
-	{
-		MutexLocker lock(mutex_);
-		state_ = State::Stopped;
-	}
-
-	cv_.notify_one();
-	wait();
-}
-
-void CameraStream::PostProcessorWorker::start()
-{
-	{
-		MutexLocker lock(mutex_);
-		ASSERT(state_ != State::Running);
-		state_ = State::Running;
-	}
-
-	Thread::start();
-}
-
-void CameraStream::PostProcessorWorker::queueRequest(Camera3RequestDescriptor::StreamBuffer *dest)
-{
-	{
-		MutexLocker lock(mutex_);
-		ASSERT(state_ == State::Running);
-		requests_.push(dest);
-	}
-
-	cv_.notify_one();
-}
-
-void CameraStream::PostProcessorWorker::run()
-{
-	MutexLocker locker(mutex_);
-
-	while (1) {
-		cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
-			return state_ != State::Running || !requests_.empty();
-		});
-
-		if (state_ != State::Running)
-			break;
-
-		Camera3RequestDescriptor::StreamBuffer *streamBuffer = requests_.front();
-		requests_.pop();
-		locker.unlock();
-
-		postProcessor_->process(streamBuffer);
-
-		locker.lock();
-	}
-
-	if (state_ == State::Flushing) {
-		std::queue<Camera3RequestDescriptor::StreamBuffer *> requests =
-			std::move(requests_);
-		locker.unlock();
-
-		while (!requests.empty()) {
-			postProcessor_->processComplete.emit(
-				requests.front(), PostProcessor::Status::Error);
-			requests.pop();
-		}
-
-		locker.lock();
-		state_ = State::Stopped;
-	}
-}
-
-void CameraStream::PostProcessorWorker::flush()
-{
-	MutexLocker lock(mutex_);
-	state_ = State::Flushing;
-	lock.unlock();
-
-	cv_.notify_one();
-}
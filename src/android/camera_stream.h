@@ -7,14 +7,13 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
-#include <queue>
 #include <vector>
 
 #include <hardware/camera3.h>
 
 #include <libcamera/base/mutex.h>
-#include <libcamera/base/thread.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/framebuffer.h>
@@ -24,6 +23,10 @@
 #include "camera_request.h"
 #include "post_processor.h"
 
+namespace libcamera {
+class MappedFrameBufferCache;
+} /* namespace libcamera */
+
 class CameraDevice;
 class PlatformFrameBufferAllocator;
 
@@ -127,44 +130,22 @@ public:
 	CameraStream *sourceStream() const { return sourceStream_; }
 
 	int configure();
+	int configureReprocessing(const libcamera::Size &inputSize);
 	int process(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
 	libcamera::FrameBuffer *getBuffer();
 	void putBuffer(libcamera::FrameBuffer *buffer);
 	void flush();
 
 private:
-	class PostProcessorWorker : public libcamera::Thread
-	{
-	public:
-		enum class State {
-			Stopped,
-			Running,
-			Flushing,
-		};
-
-		PostProcessorWorker(PostProcessor *postProcessor);
-		~PostProcessorWorker();
-
-		void start();
-		void queueRequest(Camera3RequestDescriptor::StreamBuffer *request);
-		void flush();
+	class FenceWaiter;
 
-	protected:
-		void run() override;
+	std::unique_ptr<PostProcessor> createPostProcessor(const libcamera::PixelFormat &format);
+	void postProcessingComplete(Camera3RequestDescriptor::StreamBuffer *streamBuffer,
+				    PostProcessor::Status status);
+	PostProcessor *postProcessorFor(const Camera3RequestDescriptor::StreamBuffer *streamBuffer) const;
 
-	private:
-		PostProcessor *postProcessor_;
-
-		libcamera::Mutex mutex_;
-		libcamera::ConditionVariable cv_;
-
-		std::queue<Camera3RequestDescriptor::StreamBuffer *> requests_
-			LIBCAMERA_TSA_GUARDED_BY(mutex_);
-
-		State state_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = State::Stopped;
-	};
-
-	int waitFence(int fence);
+	int waitFence(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	int queueToWorker(Camera3RequestDescriptor::StreamBuffer *streamBuffer);
 
 	CameraDevice *const cameraDevice_;
 	const libcamera::CameraConfiguration *config_;
@@ -182,6 +163,16 @@ private:
 	 */
 	std::unique_ptr<libcamera::Mutex> mutex_;
 	std::unique_ptr<PostProcessor> postProcessor_;
+	/* Produces the stream from the input buffer of reprocessing requests */
+	std::unique_ptr<PostProcessor> reprocessor_;
+
+	/*
+	 * Mappings of the destination buffers, one cache per post-processor
+	 * as they run concurrently in the post-processor pool.
+	 */
+	std::unique_ptr<libcamera::MappedFrameBufferCache> dstMaps_;
+	std::unique_ptr<libcamera::MappedFrameBufferCache> reprocessDstMaps_;
 
-	std::unique_ptr<PostProcessorWorker> worker_;
+	/* Waits on the acquire fences, in the camera thread */
+	std::unique_ptr<FenceWaiter> fenceWaiter_;
 };
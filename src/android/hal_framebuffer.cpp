@@ -7,16 +7,78 @@
 
 #include "hal_framebuffer.h"
 
+#include <sys/stat.h>
+
 #include <hardware/camera3.h>
 
+#include "libcamera/internal/framebuffer.h"
+
+namespace {
+
+ino_t fdInode(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st))
+		return 0;
+
+	return st.st_ino;
+}
+
+} /* namespace */
+
 HALFrameBuffer::HALFrameBuffer(std::unique_ptr<Private> d,
 			       buffer_handle_t handle)
-	: FrameBuffer(std::move(d)), handle_(handle)
+	: FrameBuffer(std::move(d))
 {
+	setHandle(handle);
 }
 
 HALFrameBuffer::HALFrameBuffer(const std::vector<Plane> &planes,
 			       buffer_handle_t handle)
-	: FrameBuffer(planes), handle_(handle)
+	: FrameBuffer(planes)
+{
+	setHandle(handle);
+}
+
+/*
+ * Check if the frame buffer wraps the gralloc buffer \a handle. The handle
+ * address alone isn't enough, as the framework may free a buffer and allocate
+ * a new one at the same address, possibly with the same file descriptor
+ * numbers. The dmabufs are identified by their inodes instead, which can't be
+ * reused while the frame buffer keeps them open.
+ */
+bool HALFrameBuffer::wraps(buffer_handle_t handle) const
+{
+	if (!handle || handle != handle_)
+		return false;
+
+	if (static_cast<size_t>(handle->numFds) != handleInodes_.size())
+		return false;
+
+	for (int i = 0; i < handle->numFds; i++) {
+		ino_t inode = fdInode(handle->data[i]);
+		if (!inode || inode != handleInodes_[i])
+			return false;
+	}
+
+	return true;
+}
+
+void HALFrameBuffer::retarget(const std::vector<Plane> &planes,
+			      buffer_handle_t handle)
+{
+	_d()->setPlanes(planes);
+	setHandle(handle);
+}
+
+void HALFrameBuffer::setHandle(buffer_handle_t handle)
 {
+	handle_ = handle;
+	handleInodes_.clear();
+
+	if (!handle)
+		return;
+
+	for (int i = 0; i < handle->numFds; i++)
+		handleInodes_.push_back(fdInode(handle->data[i]));
 }
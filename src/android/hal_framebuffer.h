@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <sys/types.h>
+#include <vector>
+
 #include "libcamera/internal/framebuffer.h"
 
 #include <hardware/camera3.h>
@@ -20,7 +23,13 @@ public:
 		       buffer_handle_t handle);
 
 	buffer_handle_t handle() const { return handle_; }
+	bool wraps(buffer_handle_t handle) const;
+	void retarget(const std::vector<Plane> &planes, buffer_handle_t handle);
 
 private:
+	void setHandle(buffer_handle_t handle);
+
 	buffer_handle_t handle_;
+	/* Inodes of the handle file descriptors, to detect reused handles */
+	std::vector<ino_t> handleInodes_;
 };
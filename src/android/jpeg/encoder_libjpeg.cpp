@@ -7,15 +7,19 @@
 
 #include "encoder_libjpeg.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/formats.h>
@@ -23,6 +27,7 @@
 
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/pixel_kernels.h"
 
 #include "../camera_buffer.h"
 
@@ -32,6 +37,22 @@ LOG_DECLARE_CATEGORY(JPEG)
 
 namespace {
 
+/*
+ * Strips are made of a multiple of 8 MCU rows, so that the restart markers
+ * that libjpeg writes in each strip, numbered modulo 8, follow the numbering
+ * of the complete image.
+ */
+constexpr unsigned int kStripMcuRows = 8;
+
+/* The number of threads that encode strips in parallel. */
+constexpr unsigned int kMaxStripThreads = 4;
+
+constexpr uint8_t kMarkerSof0 = 0xc0;
+constexpr uint8_t kMarkerSof2 = 0xc2;
+constexpr uint8_t kMarkerRst7 = 0xd7;
+constexpr uint8_t kMarkerEoi = 0xd9;
+constexpr uint8_t kMarkerSos = 0xda;
+
 struct JPEGPixelFormatInfo {
 	J_COLOR_SPACE colorSpace;
 	const PixelFormatInfo &pixelFormatInfo;
@@ -68,9 +89,144 @@ const struct JPEGPixelFormatInfo &findPixelInfo(const PixelFormat &format)
 	return iter->second;
 }
 
+/*
+ * Locate the frame header and the entropy-coded data of a single scan JPEG
+ * image produced by libjpeg. The entropy-coded data starts at scanOffset and
+ * ends with the EOI marker at the end of the image.
+ */
+bool parseImage(const std::vector<uint8_t> &data, size_t *sofOffset,
+		size_t *scanOffset)
+{
+	size_t size = data.size();
+	if (size < 4 || data[size - 2] != 0xff || data[size - 1] != kMarkerEoi)
+		return false;
+
+	*sofOffset = 0;
+
+	/* Skip the SOI marker, and walk the marker segments up to the scan. */
+	size_t pos = 2;
+	while (pos + 4 <= size) {
+		if (data[pos] != 0xff)
+			return false;
+
+		uint8_t marker = data[pos + 1];
+		size_t length = (data[pos + 2] << 8) | data[pos + 3];
+
+		if (marker >= kMarkerSof0 && marker <= kMarkerSof2)
+			*sofOffset = pos;
+
+		pos += 2 + length;
+
+		if (marker == kMarkerSos) {
+			*scanOffset = pos;
+			return *sofOffset && pos <= size - 2;
+		}
+	}
+
+	return false;
+}
+
 } /* namespace */
 
+/*
+ * A libjpeg compressor for the strips of an image, which writes its output to
+ * a vector that grows as needed.
+ */
+class EncoderLibJpeg::StripCompressor
+{
+public:
+	StripCompressor();
+	~StripCompressor();
+
+	struct jpeg_compress_struct *compress() { return &compress_; }
+	void setOutput(std::vector<uint8_t> *output) { destination_.output = output; }
+
+private:
+	struct Destination {
+		struct jpeg_destination_mgr pub;
+		std::vector<uint8_t> *output;
+	};
+
+	static void initDestination(j_compress_ptr cinfo);
+	static boolean emptyOutputBuffer(j_compress_ptr cinfo);
+	static void termDestination(j_compress_ptr cinfo);
+
+	struct jpeg_compress_struct compress_;
+	struct jpeg_error_mgr jerr_;
+	Destination destination_;
+};
+
+EncoderLibJpeg::StripCompressor::StripCompressor()
+{
+	compress_.err = jpeg_std_error(&jerr_);
+	jpeg_create_compress(&compress_);
+
+	destination_.pub.init_destination = &StripCompressor::initDestination;
+	destination_.pub.empty_output_buffer = &StripCompressor::emptyOutputBuffer;
+	destination_.pub.term_destination = &StripCompressor::termDestination;
+	destination_.output = nullptr;
+	compress_.dest = &destination_.pub;
+}
+
+EncoderLibJpeg::StripCompressor::~StripCompressor()
+{
+	jpeg_destroy_compress(&compress_);
+}
+
+void EncoderLibJpeg::StripCompressor::initDestination(j_compress_ptr cinfo)
+{
+	Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+	std::vector<uint8_t> *output = dest->output;
+
+	/* Reuse the memory of the previous frames. */
+	output->resize(std::max<size_t>(output->capacity(), 64 * 1024));
+	dest->pub.next_output_byte = output->data();
+	dest->pub.free_in_buffer = output->size();
+}
+
+boolean EncoderLibJpeg::StripCompressor::emptyOutputBuffer(j_compress_ptr cinfo)
+{
+	Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+	std::vector<uint8_t> *output = dest->output;
+
+	/* The whole buffer is full, grow it. */
+	size_t size = output->size();
+	output->resize(size * 2);
+	dest->pub.next_output_byte = output->data() + size;
+	dest->pub.free_in_buffer = output->size() - size;
+
+	return TRUE;
+}
+
+void EncoderLibJpeg::StripCompressor::termDestination(j_compress_ptr cinfo)
+{
+	Destination *dest = reinterpret_cast<Destination *>(cinfo->dest);
+
+	dest->output->resize(dest->output->size() - dest->pub.free_in_buffer);
+}
+
+class EncoderLibJpeg::StripWorker : public Thread
+{
+public:
+	StripWorker(EncoderLibJpeg *encoder, StripCompressor *compressor)
+		: Thread("JpegStrip"), encoder_(encoder), compressor_(compressor)
+	{
+		setRole(Role::LatencyCritical);
+	}
+
+protected:
+	void run() override
+	{
+		encoder_->processStrips(compressor_);
+	}
+
+private:
+	EncoderLibJpeg *encoder_;
+	StripCompressor *compressor_;
+};
+
 EncoderLibJpeg::EncoderLibJpeg()
+	: nextStrip_(0), pendingStrips_(0), stopWorkers_(false)
 {
 	/* \todo Expand error handling coverage with a custom handler. */
 	compress_.err = jpeg_std_error(&jerr_);
@@ -80,6 +236,15 @@ EncoderLibJpeg::EncoderLibJpeg()
 
 EncoderLibJpeg::~EncoderLibJpeg()
 {
+	{
+		MutexLocker lock(mutex_);
+		stopWorkers_ = true;
+	}
+	workCv_.notify_all();
+
+	for (auto &worker : workers_)
+		worker->wait();
+
 	jpeg_destroy_compress(&compress_);
 }
 
@@ -89,33 +254,120 @@ int EncoderLibJpeg::configure(const StreamConfiguration &cfg)
 	if (info.colorSpace == JCS_UNKNOWN)
 		return -ENOTSUP;
 
-	compress_.image_width = cfg.size.width;
-	compress_.image_height = cfg.size.height;
-	compress_.in_color_space = info.colorSpace;
-
-	compress_.input_components = info.colorSpace == JCS_GRAYSCALE ? 1 : 3;
-
-	jpeg_set_defaults(&compress_);
-
+	colorSpace_ = info.colorSpace;
 	pixelFormatInfo_ = &info.pixelFormatInfo;
 
 	nv_ = pixelFormatInfo_->numPlanes() == 2;
 	nvSwap_ = info.nvSwap;
+	rawNV_ = cfg.pixelFormat == formats::NV12 || cfg.pixelFormat == formats::NV21;
+
+	setupCompressor(&compress_, cfg.size);
+
+	/* Stop the workers of the previous configuration. */
+	{
+		MutexLocker lock(mutex_);
+		stopWorkers_ = true;
+	}
+	workCv_.notify_all();
+
+	for (auto &worker : workers_)
+		worker->wait();
+
+	workers_.clear();
+	compressors_.clear();
+	strips_.clear();
+
+	/*
+	 * Split the image in strips encoded in parallel when it is large
+	 * enough to give each thread at least one strip.
+	 */
+	const unsigned int mcuHeight = colorSpace_ == JCS_GRAYSCALE ? DCTSIZE : 2 * DCTSIZE;
+	const unsigned int mcuRows = (cfg.size.height + mcuHeight - 1) / mcuHeight;
+	const unsigned int numThreads = std::min({ std::thread::hardware_concurrency(),
+						   kMaxStripThreads,
+						   mcuRows / kStripMcuRows });
+
+	if (numThreads > 1) {
+		unsigned int stripMcuRows = (mcuRows + numThreads - 1) / numThreads;
+		stripMcuRows = utils::alignUp(stripMcuRows, kStripMcuRows);
+
+		for (unsigned int row = 0; row < cfg.size.height;
+		     row += stripMcuRows * mcuHeight) {
+			Strip strip;
+			strip.firstRow = row;
+			strip.numRows = std::min(stripMcuRows * mcuHeight,
+						 cfg.size.height - row);
+			strips_.push_back(std::move(strip));
+		}
+
+		for (unsigned int i = 0; i < numThreads; i++) {
+			auto compressor = std::make_unique<StripCompressor>();
+			setupCompressor(compressor->compress(), cfg.size);
+			/* Add a restart marker after each MCU row. */
+			compressor->compress()->restart_in_rows = 1;
+			compressors_.push_back(std::move(compressor));
+		}
+	}
+
+	{
+		MutexLocker lock(mutex_);
+		nextStrip_ = strips_.size();
+		pendingStrips_ = 0;
+		stopWorkers_ = false;
+	}
+
+	for (unsigned int i = 1; i < compressors_.size(); i++) {
+		workers_.push_back(std::make_unique<StripWorker>(this, compressors_[i].get()));
+		workers_.back()->start();
+	}
 
 	return 0;
 }
 
-void EncoderLibJpeg::compressRGB(const std::vector<Span<uint8_t>> &planes)
+void EncoderLibJpeg::setupCompressor(struct jpeg_compress_struct *compress,
+				     const Size &size) const
+{
+	compress->image_width = size.width;
+	compress->image_height = size.height;
+	compress->in_color_space = colorSpace_;
+
+	compress->input_components = colorSpace_ == JCS_GRAYSCALE ? 1 : 3;
+
+	jpeg_set_defaults(compress);
+
+	/*
+	 * The default 2x2 luma sampling of YCbCr images matches the NV12
+	 * chroma subsampling, which allows passing the planes to libjpeg
+	 * without colour conversion and downsampling.
+	 */
+	compress->raw_data_in = rawNV_;
+}
+
+void EncoderLibJpeg::compress(struct jpeg_compress_struct *compress,
+			      const std::vector<Span<uint8_t>> &planes,
+			      unsigned int firstRow)
+{
+	if (rawNV_)
+		compressNV12(compress, planes, firstRow);
+	else if (nv_)
+		compressNV(compress, planes, firstRow);
+	else
+		compressRGB(compress, planes, firstRow);
+}
+
+void EncoderLibJpeg::compressRGB(struct jpeg_compress_struct *compress,
+				 const std::vector<Span<uint8_t>> &planes,
+				 unsigned int firstRow)
 {
 	unsigned char *src = const_cast<unsigned char *>(planes[0].data());
 	/* \todo Stride information should come from buffer configuration. */
-	unsigned int stride = pixelFormatInfo_->stride(compress_.image_width, 0);
+	unsigned int stride = pixelFormatInfo_->stride(compress->image_width, 0);
 
 	JSAMPROW row_pointer[1];
 
-	while (compress_.next_scanline < compress_.image_height) {
-		row_pointer[0] = &src[compress_.next_scanline * stride];
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+	while (compress->next_scanline < compress->image_height) {
+		row_pointer[0] = &src[(firstRow + compress->next_scanline) * stride];
+		jpeg_write_scanlines(compress, row_pointer, 1);
 	}
 }
 
@@ -123,22 +375,21 @@ void EncoderLibJpeg::compressRGB(const std::vector<Span<uint8_t>> &planes)
  * Compress the incoming buffer from a supported NV format.
  * This naively unpacks the semi-planar NV12 to a YUV888 format for libjpeg.
  */
-void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
+void EncoderLibJpeg::compressNV(struct jpeg_compress_struct *compress,
+				const std::vector<Span<uint8_t>> &planes,
+				unsigned int firstRow)
 {
-	std::vector<uint8_t> tmprowbuf(compress_.image_width * 3);
+	std::vector<uint8_t> tmprowbuf(compress->image_width * 3);
 
 	/*
 	 * \todo Use the raw api, and only unpack the cb/cr samples to new line
-	 * buffers. If possible, see if we can set appropriate pixel strides
-	 * too to save even that copy.
-	 *
-	 * Possible hints at:
-	 * https://sourceforge.net/p/libjpeg/mailman/message/30815123/
+	 * buffers, as done for NV12 and NV21. The other formats would need
+	 * their chroma to be downsampled to 4:2:0 first.
 	 */
-	unsigned int y_stride = pixelFormatInfo_->stride(compress_.image_width, 0);
-	unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
+	unsigned int y_stride = pixelFormatInfo_->stride(compress->image_width, 0);
+	unsigned int c_stride = pixelFormatInfo_->stride(compress->image_width, 1);
 
-	unsigned int horzSubSample = 2 * compress_.image_width / c_stride;
+	unsigned int horzSubSample = 2 * compress->image_width / c_stride;
 	unsigned int vertSubSample = pixelFormatInfo_->planes[1].verticalSubSampling;
 
 	unsigned int c_inc = horzSubSample == 1 ? 2 : 0;
@@ -151,14 +402,14 @@ void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
 	JSAMPROW row_pointer[1];
 	row_pointer[0] = tmprowbuf.data();
 
-	for (unsigned int y = 0; y < compress_.image_height; y++) {
+	for (unsigned int y = firstRow; y < firstRow + compress->image_height; y++) {
 		unsigned char *dst = tmprowbuf.data();
 
 		const unsigned char *src_y = src + y * y_stride;
 		const unsigned char *src_cb = src_c + (y / vertSubSample) * c_stride + cb_pos;
 		const unsigned char *src_cr = src_c + (y / vertSubSample) * c_stride + cr_pos;
 
-		for (unsigned int x = 0; x < compress_.image_width; x += 2) {
+		for (unsigned int x = 0; x < compress->image_width; x += 2) {
 			dst[0] = *src_y;
 			dst[1] = *src_cb;
 			dst[2] = *src_cr;
@@ -176,7 +427,78 @@ void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
 			dst += 3;
 		}
 
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+		jpeg_write_scanlines(compress, row_pointer, 1);
+	}
+}
+
+/*
+ * Compress the incoming buffer from NV12 or NV21 with the raw data API. The
+ * luma rows are passed straight from the Y plane, and only the chroma samples
+ * are deinterleaved to line buffers. Rows and columns past the end of the
+ * image, which libjpeg reads to complete the last blocks, replicate the last
+ * ones.
+ */
+void EncoderLibJpeg::compressNV12(struct jpeg_compress_struct *compress,
+				  const std::vector<Span<uint8_t>> &planes,
+				  unsigned int firstRow)
+{
+	constexpr unsigned int lumaRows = 2 * DCTSIZE;
+	constexpr unsigned int chromaRows = DCTSIZE;
+
+	const unsigned int width = compress->image_width;
+	const unsigned int height = compress->image_height;
+	const unsigned int paddedWidth = utils::alignUp(width, 2 * DCTSIZE);
+	const unsigned int chromaWidth = (width + 1) / 2;
+
+	unsigned int yStride = pixelFormatInfo_->stride(width, 0);
+	unsigned int cStride = pixelFormatInfo_->stride(width, 1);
+
+	/* The luma rows are only copied if they're too short to be padded. */
+	const bool copyLuma = yStride < paddedWidth;
+	std::vector<uint8_t> lumaBuffer(copyLuma ? lumaRows * paddedWidth : 0);
+	std::vector<uint8_t> chromaBuffer(2 * chromaRows * paddedWidth / 2);
+
+	JSAMPROW yRows[lumaRows];
+	JSAMPROW cbRows[chromaRows];
+	JSAMPROW crRows[chromaRows];
+	JSAMPARRAY data[3] = { yRows, cbRows, crRows };
+
+	for (unsigned int i = 0; i < chromaRows; i++) {
+		cbRows[i] = &chromaBuffer[i * paddedWidth / 2];
+		crRows[i] = &chromaBuffer[(chromaRows + i) * paddedWidth / 2];
+	}
+
+	for (unsigned int row = 0; row < height; row += lumaRows) {
+		for (unsigned int i = 0; i < lumaRows; i++) {
+			unsigned int y = firstRow + std::min(row + i, height - 1);
+			uint8_t *src = planes[0].data() + y * yStride;
+
+			if (copyLuma) {
+				uint8_t *dst = &lumaBuffer[i * paddedWidth];
+				memcpy(dst, src, width);
+				memset(dst + width, src[width - 1], paddedWidth - width);
+				src = dst;
+			}
+
+			yRows[i] = src;
+		}
+
+		for (unsigned int i = 0; i < chromaRows; i++) {
+			unsigned int y = firstRow + std::min(row + 2 * i, height - 1);
+			const uint8_t *src = planes[1].data() + y / 2 * cStride;
+			uint8_t *cb = cbRows[i];
+			uint8_t *cr = crRows[i];
+
+			if (nvSwap_)
+				kernels::deinterleave(cr, cb, src, chromaWidth);
+			else
+				kernels::deinterleave(cb, cr, src, chromaWidth);
+
+			memset(cb + chromaWidth, cb[chromaWidth - 1], paddedWidth / 2 - chromaWidth);
+			memset(cr + chromaWidth, cr[chromaWidth - 1], paddedWidth / 2 - chromaWidth);
+		}
+
+		jpeg_write_raw_data(compress, data, lumaRows);
 	}
 }
 
@@ -192,6 +514,7 @@ int EncoderLibJpeg::encode(Camera3RequestDescriptor::StreamBuffer *buffer,
 		return frame.error();
 	}
 
+	MappedFrameBuffer::SyncScope sync = frame.syncScope();
 	return encode(frame.planes(), buffer->dstBuffer->plane(0),
 		      exifData, quality);
 }
@@ -200,6 +523,11 @@ int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
 			   Span<uint8_t> dest, Span<const uint8_t> exifData,
 			   unsigned int quality)
 {
+	ASSERT(src.size() == pixelFormatInfo_->numPlanes());
+
+	if (!strips_.empty())
+		return encodeStrips(src, dest, exifData, quality);
+
 	unsigned char *destination = dest.data();
 	unsigned long size = dest.size();
 
@@ -226,14 +554,166 @@ int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
 	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
 			 << "x" << compress_.image_height;
 
-	ASSERT(src.size() == pixelFormatInfo_->numPlanes());
-
-	if (nv_)
-		compressNV(src);
-	else
-		compressRGB(src);
+	compress(&compress_, src, 0);
 
 	jpeg_finish_compress(&compress_);
 
 	return size;
 }
+
+/*
+ * Encode the strips of the image in parallel, each as a complete JPEG image
+ * with a restart marker after every MCU row. As restart markers reset the
+ * entropy coder state, the entropy-coded data of the strips can then be
+ * joined with restart markers into a single image.
+ */
+int EncoderLibJpeg::encodeStrips(const std::vector<Span<uint8_t>> &planes,
+				 Span<uint8_t> destination,
+				 Span<const uint8_t> exifData,
+				 unsigned int quality)
+{
+	LOG(JPEG, Debug) << "JPEG Encode Starting:" << compress_.image_width
+			 << "x" << compress_.image_height << " in "
+			 << strips_.size() << " strips";
+
+	MutexLocker locker(mutex_);
+
+	planes_ = &planes;
+	exifData_ = exifData;
+	quality_ = quality;
+	nextStrip_ = 0;
+	pendingStrips_ = strips_.size();
+
+	workCv_.notify_all();
+
+	/* Encode strips on the calling thread too, until none is left. */
+	while (nextStrip_ < strips_.size()) {
+		unsigned int index = nextStrip_++;
+		locker.unlock();
+
+		encodeStrip(compressors_[0].get(), index);
+
+		locker.lock();
+		pendingStrips_--;
+	}
+
+	doneCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+		return pendingStrips_ == 0;
+	});
+
+	locker.unlock();
+
+	return stitchStrips(destination);
+}
+
+void EncoderLibJpeg::encodeStrip(StripCompressor *compressor, unsigned int index)
+{
+	Strip &strip = strips_[index];
+	struct jpeg_compress_struct *compress = compressor->compress();
+
+	compress->image_height = strip.numRows;
+	jpeg_set_quality(compress, quality_, TRUE);
+
+	compressor->setOutput(&strip.data);
+	jpeg_start_compress(compress, TRUE);
+
+	/* Only the headers of the first strip are kept. */
+	if (index == 0 && exifData_.size())
+		jpeg_write_marker(compress, JPEG_APP0 + 1,
+				  static_cast<const JOCTET *>(exifData_.data()),
+				  exifData_.size());
+
+	this->compress(compress, *planes_, strip.firstRow);
+
+	jpeg_finish_compress(compress);
+}
+
+void EncoderLibJpeg::processStrips(StripCompressor *compressor)
+{
+	MutexLocker locker(mutex_);
+
+	while (1) {
+		workCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return stopWorkers_ || nextStrip_ < strips_.size();
+		});
+
+		if (stopWorkers_)
+			break;
+
+		unsigned int index = nextStrip_++;
+		locker.unlock();
+
+		encodeStrip(compressor, index);
+
+		locker.lock();
+		if (--pendingStrips_ == 0)
+			doneCv_.notify_one();
+	}
+}
+
+int EncoderLibJpeg::stitchStrips(Span<uint8_t> destination)
+{
+	/*
+	 * The image is made of the headers of the first strip, with the height
+	 * of the complete image, followed by the entropy-coded data of each
+	 * strip separated by restart markers.
+	 */
+	std::vector<size_t> scanOffsets(strips_.size());
+	size_t sofOffset = 0;
+	size_t size = 0;
+
+	for (unsigned int i = 0; i < strips_.size(); i++) {
+		size_t offset;
+		if (!parseImage(strips_[i].data, &offset, &scanOffsets[i])) {
+			LOG(JPEG, Error) << "Failed to parse JPEG strip " << i;
+			return -EINVAL;
+		}
+
+		if (i == 0) {
+			sofOffset = offset;
+			size += scanOffsets[i];
+		} else {
+			size += 2;
+		}
+
+		size += strips_[i].data.size() - 2 - scanOffsets[i];
+	}
+
+	size += 2;
+
+	if (size > destination.size()) {
+		LOG(JPEG, Error) << "JPEG image of " << size
+				 << " bytes too large for the destination";
+		return -ENOSPC;
+	}
+
+	uint8_t *dst = destination.data();
+	const std::vector<uint8_t> &first = strips_[0].data;
+
+	memcpy(dst, first.data(), scanOffsets[0]);
+	dst[sofOffset + 5] = compress_.image_height >> 8;
+	dst[sofOffset + 6] = compress_.image_height & 0xff;
+	dst += scanOffsets[0];
+
+	for (unsigned int i = 0; i < strips_.size(); i++) {
+		const std::vector<uint8_t> &data = strips_[i].data;
+
+		/*
+		 * Strips start on a multiple of 8 MCU rows, the restart marker
+		 * that precedes them is always RST7.
+		 */
+		if (i > 0) {
+			*dst++ = 0xff;
+			*dst++ = kMarkerRst7;
+		}
+
+		size_t length = data.size() - 2 - scanOffsets[i];
+		memcpy(dst, data.data() + scanOffsets[i], length);
+		dst += length;
+	}
+
+	*dst++ = 0xff;
+	*dst++ = kMarkerEoi;
+
+	return size;
+}
@@ -9,8 +9,11 @@
 
 #include "encoder.h"
 
+#include <memory>
 #include <vector>
 
+#include <libcamera/base/mutex.h>
+
 #include "libcamera/internal/formats.h"
 
 #include <jpeglib.h>
@@ -31,14 +34,68 @@ public:
 		   unsigned int quality);
 
 private:
-	void compressRGB(const std::vector<libcamera::Span<uint8_t>> &planes);
-	void compressNV(const std::vector<libcamera::Span<uint8_t>> &planes);
+	class StripCompressor;
+	class StripWorker;
+
+	struct Strip {
+		unsigned int firstRow;
+		unsigned int numRows;
+		/* The strip encoded as a complete JPEG image */
+		std::vector<uint8_t> data;
+	};
+
+	void setupCompressor(struct jpeg_compress_struct *compress,
+			     const libcamera::Size &size) const;
+
+	void compress(struct jpeg_compress_struct *compress,
+		      const std::vector<libcamera::Span<uint8_t>> &planes,
+		      unsigned int firstRow);
+	void compressRGB(struct jpeg_compress_struct *compress,
+			 const std::vector<libcamera::Span<uint8_t>> &planes,
+			 unsigned int firstRow);
+	void compressNV(struct jpeg_compress_struct *compress,
+			const std::vector<libcamera::Span<uint8_t>> &planes,
+			unsigned int firstRow);
+	void compressNV12(struct jpeg_compress_struct *compress,
+			  const std::vector<libcamera::Span<uint8_t>> &planes,
+			  unsigned int firstRow);
+
+	int encodeStrips(const std::vector<libcamera::Span<uint8_t>> &planes,
+			 libcamera::Span<uint8_t> destination,
+			 libcamera::Span<const uint8_t> exifData,
+			 unsigned int quality);
+	void encodeStrip(StripCompressor *compressor, unsigned int index);
+	void processStrips(StripCompressor *compressor);
+	int stitchStrips(libcamera::Span<uint8_t> destination);
 
 	struct jpeg_compress_struct compress_;
 	struct jpeg_error_mgr jerr_;
 
 	const libcamera::PixelFormatInfo *pixelFormatInfo_;
+	J_COLOR_SPACE colorSpace_;
 
 	bool nv_;
 	bool nvSwap_;
+	/* NV12 and NV21 are fed to libjpeg as raw downsampled data. */
+	bool rawNV_;
+
+	/*
+	 * Large images are split in horizontal strips encoded in parallel,
+	 * one per compressor. The first compressor is used by the thread
+	 * calling encode(), the other ones by the strip workers.
+	 */
+	std::vector<std::unique_ptr<StripCompressor>> compressors_;
+	std::vector<std::unique_ptr<StripWorker>> workers_;
+	std::vector<Strip> strips_;
+
+	/* State of the strips being encoded, shared with the workers. */
+	libcamera::Mutex mutex_;
+	libcamera::ConditionVariable workCv_;
+	libcamera::ConditionVariable doneCv_;
+	const std::vector<libcamera::Span<uint8_t>> *planes_;
+	libcamera::Span<const uint8_t> exifData_;
+	unsigned int quality_;
+	unsigned int nextStrip_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int pendingStrips_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool stopWorkers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 };
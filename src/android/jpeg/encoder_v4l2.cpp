@@ -0,0 +1,464 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * JPEG encoding using a V4L2 memory-to-memory encoder
+ */
+
+#include "encoder_v4l2.h"
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/object.h>
+
+#include <libcamera/controls.h>
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/v4l2_videodevice.h"
+
+#include "../camera_buffer.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+LOG_DECLARE_CATEGORY(JPEG)
+
+namespace {
+
+/* The time after which an encoding that hasn't completed is aborted. */
+constexpr auto kEncodeTimeout = 1000ms;
+
+/*
+ * The number of source dmabufs kept imported by the device, to avoid
+ * importing the buffers of the camera again for each capture.
+ */
+constexpr unsigned int kNumSourceBuffers = 4;
+
+constexpr uint8_t kMarkerSoi = 0xd8;
+constexpr uint8_t kMarkerApp1 = 0xe1;
+
+bool supportsJpegCapture(int fd, const V4L2Capability &caps)
+{
+	struct v4l2_fmtdesc fmtdesc = {};
+	fmtdesc.type = caps.isMultiplanar() ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+					    : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	for (fmtdesc.index = 0; !::ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc); fmtdesc.index++) {
+		if (fmtdesc.pixelformat == V4L2_PIX_FMT_JPEG)
+			return true;
+	}
+
+	return false;
+}
+
+} /* namespace */
+
+class EncoderV4L2::Device : public Object
+{
+public:
+	Device(const std::string &deviceNode);
+
+	int configure(const StreamConfiguration &cfg);
+	void stop();
+	void reset();
+	int queue(const FrameBuffer *source, unsigned int quality);
+
+	int wait();
+	int copy(unsigned int size, Span<uint8_t> destination,
+		 Span<const uint8_t> exifData) const;
+
+private:
+	void bufferReady(FrameBuffer *buffer);
+
+	std::string deviceNode_;
+	std::unique_ptr<V4L2M2MDevice> m2m_;
+
+	std::vector<std::unique_ptr<FrameBuffer>> captureBuffers_;
+	std::unique_ptr<MappedFrameBuffer> captureMapped_;
+	/* Wraps the planes of the source buffer being encoded */
+	std::unique_ptr<FrameBuffer> source_;
+	int quality_;
+
+	Mutex mutex_;
+	ConditionVariable doneCv_;
+	/* Number of buffers queued to the device that haven't completed */
+	unsigned int pendingBuffers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int result_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+EncoderV4L2::Device::Device(const std::string &deviceNode)
+	: deviceNode_(deviceNode), quality_(-1), pendingBuffers_(0), result_(0)
+{
+}
+
+int EncoderV4L2::Device::configure(const StreamConfiguration &cfg)
+{
+	stop();
+
+	m2m_ = std::make_unique<V4L2M2MDevice>(deviceNode_);
+	m2m_->output()->bufferReady.connect(this, &Device::bufferReady);
+	m2m_->capture()->bufferReady.connect(this, &Device::bufferReady);
+
+	int ret = m2m_->open();
+	if (ret < 0) {
+		m2m_.reset();
+		return ret;
+	}
+
+	const V4L2PixelFormat sourceFourcc =
+		m2m_->output()->toV4L2PixelFormat(cfg.pixelFormat);
+
+	V4L2DeviceFormat format;
+	format.fourcc = sourceFourcc;
+	format.size = cfg.size;
+	format.planesCount = 1;
+	format.planes[0].bpl = cfg.stride;
+
+	ret = m2m_->output()->setFormat(&format);
+	if (ret < 0)
+		goto error;
+
+	if (format.fourcc != sourceFourcc || format.size != cfg.size ||
+	    format.planes[0].bpl != cfg.stride) {
+		LOG(JPEG, Error)
+			<< "Unsupported V4L2 encoder input " << cfg.toString()
+			<< " (got " << format << ")";
+		ret = -EINVAL;
+		goto error;
+	}
+
+	format = {};
+	format.fourcc = V4L2PixelFormat(V4L2_PIX_FMT_JPEG);
+	format.size = cfg.size;
+	format.planesCount = 1;
+
+	ret = m2m_->capture()->setFormat(&format);
+	if (ret < 0)
+		goto error;
+
+	if (format.fourcc != V4L2PixelFormat(V4L2_PIX_FMT_JPEG) ||
+	    format.size != cfg.size) {
+		LOG(JPEG, Error)
+			<< "Unsupported V4L2 encoder output " << format;
+		ret = -EINVAL;
+		goto error;
+	}
+
+	/*
+	 * The source buffers are imported as dmabufs, while the JPEG data is
+	 * produced in a buffer of the device, from which it is copied along
+	 * with the Exif data to the destination buffer.
+	 */
+	ret = m2m_->output()->importBuffers(kNumSourceBuffers);
+	if (ret < 0)
+		goto error;
+
+	ret = m2m_->capture()->allocateBuffers(1, &captureBuffers_);
+	if (ret < 0)
+		goto error;
+
+	captureMapped_ = std::make_unique<MappedFrameBuffer>(captureBuffers_[0].get(),
+							     MappedFrameBuffer::MapFlag::Read);
+	if (!captureMapped_->isValid()) {
+		ret = captureMapped_->error();
+		goto error;
+	}
+
+	ret = m2m_->output()->streamOn();
+	if (ret < 0)
+		goto error;
+
+	ret = m2m_->capture()->streamOn();
+	if (ret < 0)
+		goto error;
+
+	quality_ = -1;
+
+	return 0;
+
+error:
+	stop();
+	return ret;
+}
+
+void EncoderV4L2::Device::stop()
+{
+	if (!m2m_)
+		return;
+
+	m2m_->capture()->streamOff();
+	m2m_->output()->streamOff();
+
+	captureMapped_.reset();
+	m2m_->capture()->releaseBuffers();
+	m2m_->output()->releaseBuffers();
+	captureBuffers_.clear();
+	source_.reset();
+
+	m2m_->close();
+	m2m_.reset();
+}
+
+/*
+ * Stop and restart streaming to return the buffers queued to the device.
+ * Stopping streaming completes the buffers with errors.
+ */
+void EncoderV4L2::Device::reset()
+{
+	m2m_->capture()->streamOff();
+	m2m_->output()->streamOff();
+
+	m2m_->output()->streamOn();
+	m2m_->capture()->streamOn();
+}
+
+int EncoderV4L2::Device::queue(const FrameBuffer *source, unsigned int quality)
+{
+	if (!m2m_)
+		return -ENODEV;
+
+	if (static_cast<int>(quality) != quality_) {
+		const ControlInfoMap &controls = m2m_->capture()->controls();
+		if (controls.find(V4L2_CID_JPEG_COMPRESSION_QUALITY) != controls.end()) {
+			ControlList ctrls(controls);
+			ctrls.set(V4L2_CID_JPEG_COMPRESSION_QUALITY,
+				  static_cast<int32_t>(quality));
+			if (m2m_->capture()->setControls(&ctrls) < 0)
+				LOG(JPEG, Warning)
+					<< "Failed to set the JPEG quality to "
+					<< quality;
+		}
+
+		quality_ = quality;
+	}
+
+	/*
+	 * Queue a buffer wrapping the source planes, as the device updates
+	 * the metadata of the buffers it completes.
+	 */
+	source_ = std::make_unique<FrameBuffer>(source->planes());
+
+	{
+		MutexLocker locker(mutex_);
+		pendingBuffers_ = 2;
+		result_ = -EIO;
+	}
+
+	int ret = m2m_->capture()->queueBuffer(captureBuffers_[0].get());
+	if (ret < 0) {
+		MutexLocker locker(mutex_);
+		pendingBuffers_ = 0;
+		return ret;
+	}
+
+	ret = m2m_->output()->queueBuffer(source_.get());
+	if (ret < 0) {
+		reset();
+		return ret;
+	}
+
+	return 0;
+}
+
+void EncoderV4L2::Device::bufferReady(FrameBuffer *buffer)
+{
+	const FrameMetadata &metadata = buffer->metadata();
+
+	MutexLocker locker(mutex_);
+
+	if (buffer == captureBuffers_[0].get())
+		result_ = metadata.status == FrameMetadata::FrameSuccess
+			? static_cast<int>(metadata.planes()[0].bytesused)
+			: -EIO;
+
+	if (pendingBuffers_ && --pendingBuffers_ == 0)
+		doneCv_.notify_one();
+}
+
+/*
+ * Wait for the buffers queued by queue() to complete, and return the size of
+ * the JPEG data or a negative error code.
+ */
+int EncoderV4L2::Device::wait()
+{
+	MutexLocker locker(mutex_);
+
+	bool done = doneCv_.wait_for(locker, kEncodeTimeout,
+				     [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+					     return pendingBuffers_ == 0;
+				     });
+	if (!done)
+		return -ETIMEDOUT;
+
+	return result_;
+}
+
+/*
+ * Copy the JPEG data produced by the device to the destination with the Exif
+ * data inserted in an APP1 segment following the SOI marker, and return the
+ * size of the resulting image.
+ */
+int EncoderV4L2::Device::copy(unsigned int size, Span<uint8_t> destination,
+			      Span<const uint8_t> exifData) const
+{
+	Span<const uint8_t> jpeg = captureMapped_->planes()[0];
+	if (size < 2 || size > jpeg.size() ||
+	    jpeg[0] != 0xff || jpeg[1] != kMarkerSoi) {
+		LOG(JPEG, Error) << "Invalid JPEG data produced by the encoder";
+		return -EINVAL;
+	}
+
+	/* The segment size, including the length field, is limited to 64kB. */
+	if (exifData.size() + 2 > 0xffff) {
+		LOG(JPEG, Warning)
+			<< "Exif data too large (" << exifData.size()
+			<< " bytes), dropping it";
+		exifData = {};
+	}
+
+	size_t exifSize = exifData.empty() ? 0 : exifData.size() + 4;
+	if (size + exifSize > destination.size()) {
+		LOG(JPEG, Error) << "JPEG image too large for the destination";
+		return -ENOSPC;
+	}
+
+	uint8_t *data = destination.data();
+
+	MappedFrameBuffer::SyncScope sync = captureMapped_->syncScope();
+
+	data[0] = 0xff;
+	data[1] = kMarkerSoi;
+	data += 2;
+
+	if (!exifData.empty()) {
+		uint16_t length = exifData.size() + 2;
+
+		data[0] = 0xff;
+		data[1] = kMarkerApp1;
+		data[2] = length >> 8;
+		data[3] = length & 0xff;
+		memcpy(data + 4, exifData.data(), exifData.size());
+		data += exifSize;
+	}
+
+	memcpy(data, jpeg.data() + 2, size - 2);
+
+	return size + exifSize;
+}
+
+/*
+ * \class EncoderV4L2
+ * \brief Encode JPEG images with a stateful V4L2 memory-to-memory encoder
+ *
+ * The source frames are imported by the encoder from their dmabufs, without
+ * any CPU access. The device is operated from a dedicated thread, while
+ * encode() blocks the calling thread until the image has been encoded.
+ */
+EncoderV4L2::EncoderV4L2(const std::string &deviceNode)
+	: thread_("JpegV4L2")
+{
+	device_ = std::make_unique<Device>(deviceNode);
+	device_->moveToThread(&thread_);
+
+	thread_.start();
+}
+
+EncoderV4L2::~EncoderV4L2()
+{
+	device_->invokeMethod(&Device::stop, ConnectionTypeBlocking);
+
+	thread_.exit();
+	thread_.wait();
+}
+
+/*
+ * Find a V4L2 memory-to-memory device that produces JPEG images, and return
+ * its device node, or an empty string if none is available. The device nodes
+ * are only scanned once.
+ */
+std::string EncoderV4L2::findDevice()
+{
+	static const std::string deviceNode = []() {
+		DIR *dir = opendir("/dev");
+		if (!dir)
+			return std::string();
+
+		std::vector<std::string> nodes;
+		while (struct dirent *ent = readdir(dir)) {
+			if (!strncmp(ent->d_name, "video", 5))
+				nodes.push_back(std::string("/dev/") + ent->d_name);
+		}
+
+		closedir(dir);
+
+		std::sort(nodes.begin(), nodes.end());
+
+		for (const std::string &node : nodes) {
+			int fd = ::open(node.c_str(), O_RDWR | O_NONBLOCK);
+			if (fd < 0)
+				continue;
+
+			V4L2Capability caps;
+			bool found = !::ioctl(fd, VIDIOC_QUERYCAP, &caps) &&
+				     caps.isM2M() && supportsJpegCapture(fd, caps);
+
+			::close(fd);
+
+			if (found) {
+				LOG(JPEG, Info)
+					<< "Using V4L2 JPEG encoder " << node
+					<< " (" << caps.driver() << ")";
+				return node;
+			}
+		}
+
+		return std::string();
+	}();
+
+	return deviceNode;
+}
+
+int EncoderV4L2::configure(const StreamConfiguration &cfg)
+{
+	return device_->invokeMethod(&Device::configure, ConnectionTypeBlocking,
+				     cfg);
+}
+
+int EncoderV4L2::encode(Camera3RequestDescriptor::StreamBuffer *buffer,
+			Span<const uint8_t> exifData,
+			unsigned int quality)
+{
+	int ret = device_->invokeMethod(&Device::queue, ConnectionTypeBlocking,
+					buffer->srcBuffer, quality);
+	if (ret < 0) {
+		LOG(JPEG, Error) << "Failed to queue buffers to the encoder: "
+				 << strerror(-ret);
+		return ret;
+	}
+
+	ret = device_->wait();
+	if (ret == -ETIMEDOUT) {
+		LOG(JPEG, Error) << "Timeout waiting for the encoder";
+		device_->invokeMethod(&Device::reset, ConnectionTypeBlocking);
+		return ret;
+	}
+
+	if (ret < 0) {
+		LOG(JPEG, Error) << "Failed to encode the image";
+		return ret;
+	}
+
+	return device_->copy(ret, buffer->dstBuffer->plane(0), exifData);
+}
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * JPEG encoding using a V4L2 memory-to-memory encoder
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <libcamera/base/thread.h>
+
+#include "encoder.h"
+
+class EncoderV4L2 : public Encoder
+{
+public:
+	EncoderV4L2(const std::string &deviceNode);
+	~EncoderV4L2();
+
+	static std::string findDevice();
+
+	int configure(const libcamera::StreamConfiguration &cfg) override;
+	int encode(Camera3RequestDescriptor::StreamBuffer *buffer,
+		   libcamera::Span<const uint8_t> exifData,
+		   unsigned int quality) override;
+
+private:
+	class Device;
+
+	/*
+	 * The V4L2 device is operated from a thread running an event loop, to
+	 * which its buffer completion events are delivered.
+	 */
+	libcamera::Thread thread_;
+	std::unique_ptr<Device> device_;
+};
@@ -41,6 +41,10 @@ enum class _ExifTag {
  * Calls to generate() must check the return code to determine if any error
  * occurred during the construction of the Exif data, and if successful the
  * data can be obtained using the data() function.
+ *
+ * An instance can be reused to generate the Exif data of multiple images.
+ * Properties keep their value until they are set again or cleared, and
+ * setting a property to a value of the same size updates its entry in place.
  */
 Exif::Exif()
 	: valid_(false), data_(nullptr), order_(EXIF_BYTE_ORDER_INTEL),
@@ -125,9 +129,19 @@ ExifEntry *Exif::createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 {
 	ExifContent *content = data_->ifd[ifd];
 
-	/* Replace any existing entry with the same tag. */
+	/*
+	 * Reuse any existing entry with the same tag and layout, or replace
+	 * it otherwise.
+	 */
 	ExifEntry *existing = exif_content_get_entry(content, tag);
-	exif_content_remove_entry(content, existing);
+	if (existing && existing->format == format &&
+	    existing->components == components && existing->size == size) {
+		exif_entry_ref(existing);
+		return existing;
+	}
+
+	if (existing)
+		exif_content_remove_entry(content, existing);
 
 	ExifEntry *entry = exif_entry_new_mem(mem_);
 	if (!entry) {
@@ -155,6 +169,17 @@ ExifEntry *Exif::createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 	return entry;
 }
 
+void Exif::removeEntries(ExifIfd ifd, std::initializer_list<ExifTag> tags)
+{
+	ExifContent *content = data_->ifd[ifd];
+
+	for (ExifTag tag : tags) {
+		ExifEntry *entry = exif_content_get_entry(content, tag);
+		if (entry)
+			exif_content_remove_entry(content, entry);
+	}
+}
+
 void Exif::setByte(ExifIfd ifd, ExifTag tag, uint8_t item)
 {
 	ExifEntry *entry = createEntry(ifd, tag, EXIF_FORMAT_BYTE, 1, 1);
@@ -355,6 +380,14 @@ void Exif::setGPSDateTimestamp(time_t timestamp)
 		    ts);
 }
 
+void Exif::clearGPSDateTimestamp()
+{
+	removeEntries(EXIF_IFD_GPS, {
+		static_cast<ExifTag>(EXIF_TAG_GPS_DATE_STAMP),
+		static_cast<ExifTag>(EXIF_TAG_GPS_TIME_STAMP),
+	});
+}
+
 std::tuple<int, int, int> Exif::degreesToDMS(double decimalDegrees)
 {
 	int degrees = std::trunc(decimalDegrees);
@@ -408,6 +441,25 @@ void Exif::setGPSMethod(const std::string &method)
 		  EXIF_FORMAT_UNDEFINED, method, NoEncoding);
 }
 
+void Exif::clearGPSLocation()
+{
+	removeEntries(EXIF_IFD_GPS, {
+		static_cast<ExifTag>(EXIF_TAG_GPS_LATITUDE_REF),
+		static_cast<ExifTag>(EXIF_TAG_GPS_LATITUDE),
+		static_cast<ExifTag>(EXIF_TAG_GPS_LONGITUDE_REF),
+		static_cast<ExifTag>(EXIF_TAG_GPS_LONGITUDE),
+		static_cast<ExifTag>(EXIF_TAG_GPS_ALTITUDE_REF),
+		static_cast<ExifTag>(EXIF_TAG_GPS_ALTITUDE),
+	});
+}
+
+void Exif::clearGPSMethod()
+{
+	removeEntries(EXIF_IFD_GPS, {
+		static_cast<ExifTag>(EXIF_TAG_GPS_PROCESSING_METHOD),
+	});
+}
+
 void Exif::setOrientation(int orientation)
 {
 	int value;
@@ -430,10 +482,11 @@ void Exif::setOrientation(int orientation)
 	setShort(EXIF_IFD_0, EXIF_TAG_ORIENTATION, value);
 }
 
-void Exif::setThumbnail(std::vector<unsigned char> &&thumbnail,
+void Exif::setThumbnail(Span<const unsigned char> thumbnail,
 			Compression compression)
 {
-	thumbnailData_ = std::move(thumbnail);
+	/* Copy to the storage of the previous thumbnail to avoid allocations. */
+	thumbnailData_.assign(thumbnail.begin(), thumbnail.end());
 
 	data_->data = thumbnailData_.data();
 	data_->size = thumbnailData_.size();
@@ -441,6 +494,14 @@ void Exif::setThumbnail(std::vector<unsigned char> &&thumbnail,
 	setShort(EXIF_IFD_0, EXIF_TAG_COMPRESSION, compression);
 }
 
+void Exif::clearThumbnail()
+{
+	data_->data = nullptr;
+	data_->size = 0;
+
+	removeEntries(EXIF_IFD_0, { EXIF_TAG_COMPRESSION });
+}
+
 void Exif::setFocalLength(float length)
 {
 	ExifRational rational = { static_cast<ExifLong>(length * 1000), 1000 };
@@ -459,6 +520,11 @@ void Exif::setAperture(float size)
 	setRational(EXIF_IFD_EXIF, EXIF_TAG_FNUMBER, rational);
 }
 
+void Exif::clearAperture()
+{
+	removeEntries(EXIF_IFD_EXIF, { EXIF_TAG_FNUMBER });
+}
+
 void Exif::setISO(uint16_t iso)
 {
 	setShort(EXIF_IFD_EXIF, EXIF_TAG_ISO_SPEED_RATINGS, iso);
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <chrono>
+#include <initializer_list>
 #include <string>
 #include <time.h>
 #include <vector>
@@ -61,17 +62,22 @@ public:
 
 	void setOrientation(int orientation);
 	void setSize(const libcamera::Size &size);
-	void setThumbnail(std::vector<unsigned char> &&thumbnail,
+	void setThumbnail(libcamera::Span<const unsigned char> thumbnail,
 			  Compression compression);
+	void clearThumbnail();
 	void setTimestamp(time_t timestamp, std::chrono::milliseconds msec);
 
 	void setGPSDateTimestamp(time_t timestamp);
 	void setGPSLocation(const double *coords);
 	void setGPSMethod(const std::string &method);
+	void clearGPSDateTimestamp();
+	void clearGPSLocation();
+	void clearGPSMethod();
 
 	void setFocalLength(float length);
 	void setExposureTime(uint64_t nsec);
 	void setAperture(float size);
+	void clearAperture();
 	void setISO(uint16_t iso);
 	void setFlash(Flash flash);
 	void setWhiteBalance(WhiteBalance wb);
@@ -84,6 +90,8 @@ private:
 	ExifEntry *createEntry(ExifIfd ifd, ExifTag tag, ExifFormat format,
 			       unsigned long components, unsigned int size);
 
+	void removeEntries(ExifIfd ifd, std::initializer_list<ExifTag> tags);
+
 	void setByte(ExifIfd ifd, ExifTag tag, uint8_t item);
 	void setShort(ExifIfd ifd, ExifTag tag, uint16_t item);
 	void setLong(ExifIfd ifd, ExifTag tag, uint32_t item);
@@ -7,6 +7,7 @@
 
 #include "post_processor_jpeg.h"
 
+#include <algorithm>
 #include <chrono>
 
 #include "../camera_device.h"
@@ -16,8 +17,8 @@
 #include "encoder_jea.h"
 #else /* !defined(OS_CHROMEOS) */
 #include "encoder_libjpeg.h"
+#include "encoder_v4l2.h"
 #endif
-#include "exif.h"
 
 #include <libcamera/base/log.h>
 
@@ -29,7 +30,7 @@ using namespace std::chrono_literals;
 LOG_DEFINE_CATEGORY(JPEG)
 
 PostProcessorJpeg::PostProcessorJpeg(CameraDevice *const device)
-	: cameraDevice_(device)
+	: cameraDevice_(device), copyAccount_("android_jpeg")
 {
 }
 
@@ -50,36 +51,66 @@ int PostProcessorJpeg::configure(const StreamConfiguration &inCfg,
 
 	thumbnailer_.configure(inCfg.size, inCfg.pixelFormat);
 
+	createExif();
+
 #if defined(OS_CHROMEOS)
 	encoder_ = std::make_unique<EncoderJea>();
 #else /* !defined(OS_CHROMEOS) */
+	/*
+	 * Prefer a hardware encoder when the platform has one, and fall back
+	 * to libjpeg if it can't encode the stream.
+	 */
+	std::string encoderNode = EncoderV4L2::findDevice();
+	if (!encoderNode.empty()) {
+		encoder_ = std::make_unique<EncoderV4L2>(encoderNode);
+		if (!encoder_->configure(inCfg))
+			return 0;
+
+		LOG(JPEG, Warning)
+			<< "Failed to configure the V4L2 JPEG encoder, using libjpeg";
+	}
+
 	encoder_ = std::make_unique<EncoderLibJpeg>();
 #endif
 
 	return encoder_->configure(inCfg);
 }
 
+/*
+ * Create the Exif instance reused for all the captures of the stream, with
+ * the tags that don't depend on the capture.
+ */
+void PostProcessorJpeg::createExif()
+{
+	exif_ = std::make_unique<Exif>();
+	exif_->setMake(cameraDevice_->maker());
+	exif_->setModel(cameraDevice_->model());
+	exif_->setSize(streamSize_);
+	exif_->setFlash(Exif::Flash::FlashNotPresent);
+	exif_->setWhiteBalance(Exif::WhiteBalance::Auto);
+	exif_->setFocalLength(1.0);
+}
+
 void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
 					  const Size &targetSize,
 					  unsigned int quality,
 					  std::vector<unsigned char> *thumbnail)
 {
-	/* Stores the raw scaled-down thumbnail bytes. */
-	std::vector<unsigned char> rawThumbnail;
+	thumbnail->clear();
 
-	thumbnailer_.createThumbnail(source, targetSize, &rawThumbnail);
+	thumbnailer_.createThumbnail(source, targetSize, &rawThumbnail_);
 
 	StreamConfiguration thCfg;
 	thCfg.size = targetSize;
 	thCfg.pixelFormat = thumbnailer_.pixelFormat();
 	int ret = thumbnailEncoder_.configure(thCfg);
 
-	if (!rawThumbnail.empty() && !ret) {
+	if (!rawThumbnail_.empty() && !ret) {
 		/*
 		 * \todo Avoid value-initialization of all elements of the
 		 * vector.
 		 */
-		thumbnail->resize(rawThumbnail.size());
+		thumbnail->resize(rawThumbnail_.size());
 
 		/*
 		 * Split planes manually as the encoder expects a vector of
@@ -93,12 +124,12 @@ void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
 		const PixelFormatInfo &formatNV12 = PixelFormatInfo::info(formats::NV12);
 		size_t yPlaneSize = formatNV12.planeSize(targetSize, 0);
 		size_t uvPlaneSize = formatNV12.planeSize(targetSize, 1);
-		thumbnailPlanes.push_back({ rawThumbnail.data(), yPlaneSize });
-		thumbnailPlanes.push_back({ rawThumbnail.data() + yPlaneSize, uvPlaneSize });
+		thumbnailPlanes.push_back({ rawThumbnail_.data(), yPlaneSize });
+		thumbnailPlanes.push_back({ rawThumbnail_.data() + yPlaneSize, uvPlaneSize });
 
 		int jpeg_size = thumbnailEncoder_.encode(thumbnailPlanes,
 							 *thumbnail, {}, quality);
-		thumbnail->resize(jpeg_size);
+		thumbnail->resize(std::max(jpeg_size, 0));
 
 		LOG(JPEG, Debug)
 			<< "Thumbnail compress returned "
@@ -120,10 +151,11 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	camera_metadata_ro_entry_t entry;
 	int ret;
 
-	/* Set EXIF metadata for various tags. */
-	Exif exif;
-	exif.setMake(cameraDevice_->maker());
-	exif.setModel(cameraDevice_->model());
+	/*
+	 * Update the EXIF tags that depend on the capture, and clear the
+	 * optional ones not set for this capture.
+	 */
+	Exif &exif = *exif_;
 
 	ret = requestMetadata.getEntry(ANDROID_JPEG_ORIENTATION, &entry);
 
@@ -131,7 +163,6 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	resultMetadata->addEntry(ANDROID_JPEG_ORIENTATION, jpegOrientation);
 	exif.setOrientation(jpegOrientation);
 
-	exif.setSize(streamSize_);
 	/*
 	 * We set the frame's EXIF timestamp as the time of encode.
 	 * Since the precision we need for EXIF timestamp is only one
@@ -144,22 +175,22 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	ret = requestMetadata.getEntry(ANDROID_LENS_APERTURE, &entry);
 	if (ret)
 		exif.setAperture(*entry.data.f);
+	else
+		exif.clearAperture();
 
 	ret = resultMetadata->getEntry(ANDROID_SENSOR_SENSITIVITY, &entry);
 	exif.setISO(ret ? *entry.data.i32 : 100);
 
-	exif.setFlash(Exif::Flash::FlashNotPresent);
-	exif.setWhiteBalance(Exif::WhiteBalance::Auto);
-
-	exif.setFocalLength(1.0);
-
 	ret = requestMetadata.getEntry(ANDROID_JPEG_GPS_TIMESTAMP, &entry);
 	if (ret) {
 		exif.setGPSDateTimestamp(*entry.data.i64);
 		resultMetadata->addEntry(ANDROID_JPEG_GPS_TIMESTAMP,
 					 *entry.data.i64);
+	} else {
+		exif.clearGPSDateTimestamp();
 	}
 
+	bool hasThumbnail = false;
 	ret = requestMetadata.getEntry(ANDROID_JPEG_THUMBNAIL_SIZE, &entry);
 	if (ret) {
 		const int32_t *data = entry.data.i32;
@@ -171,20 +202,26 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, quality);
 
 		if (thumbnailSize != Size(0, 0)) {
-			std::vector<unsigned char> thumbnail;
-			generateThumbnail(source, thumbnailSize, quality, &thumbnail);
-			if (!thumbnail.empty())
-				exif.setThumbnail(std::move(thumbnail), Exif::Compression::JPEG);
+			generateThumbnail(source, thumbnailSize, quality, &thumbnail_);
+			if (!thumbnail_.empty()) {
+				exif.setThumbnail(thumbnail_, Exif::Compression::JPEG);
+				hasThumbnail = true;
+			}
 		}
 
 		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_SIZE, data, 2);
 	}
 
+	if (!hasThumbnail)
+		exif.clearThumbnail();
+
 	ret = requestMetadata.getEntry(ANDROID_JPEG_GPS_COORDINATES, &entry);
 	if (ret) {
 		exif.setGPSLocation(entry.data.d);
 		resultMetadata->addEntry(ANDROID_JPEG_GPS_COORDINATES,
 					 entry.data.d, 3);
+	} else {
+		exif.clearGPSLocation();
 	}
 
 	ret = requestMetadata.getEntry(ANDROID_JPEG_GPS_PROCESSING_METHOD, &entry);
@@ -193,9 +230,12 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 		exif.setGPSMethod(method);
 		resultMetadata->addEntry(ANDROID_JPEG_GPS_PROCESSING_METHOD,
 					 entry.data.u8, entry.count);
+	} else {
+		exif.clearGPSMethod();
 	}
 
-	if (exif.generate() != 0)
+	bool exifValid = exif.generate() == 0;
+	if (!exifValid)
 		LOG(JPEG, Error) << "Failed to generate valid EXIF data";
 
 	ret = requestMetadata.getEntry(ANDROID_JPEG_QUALITY, &entry);
@@ -203,6 +243,11 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	resultMetadata->addEntry(ANDROID_JPEG_QUALITY, quality);
 
 	int jpeg_size = encoder_->encode(streamBuffer, exif.data(), quality);
+
+	/* An Exif instance stays invalid once an error occurred, replace it. */
+	if (!exifValid)
+		createExif();
+
 	if (jpeg_size < 0) {
 		LOG(JPEG, Error) << "Failed to encode stream image";
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
@@ -219,5 +264,18 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 
 	/* Update the JPEG result Metadata. */
 	resultMetadata->addEntry(ANDROID_JPEG_SIZE, jpeg_size);
+
+	/*
+	 * The encoder reads the whole source frame and writes the JPEG image,
+	 * the copies internal to the encoders aren't accounted.
+	 */
+	if (copyAccount_.active()) {
+		size_t touched = jpeg_size;
+		for (const FrameBuffer::Plane &plane : source.planes())
+			touched += plane.length;
+
+		copyAccount_.record(0, touched);
+	}
+
 	processComplete.emit(streamBuffer, PostProcessor::Status::Success);
 }
@@ -9,10 +9,13 @@
 
 #include "../post_processor.h"
 #include "encoder_libjpeg.h"
+#include "exif.h"
 #include "thumbnailer.h"
 
 #include <libcamera/geometry.h>
 
+#include "libcamera/internal/copy_accounting.h"
+
 class CameraDevice;
 
 class PostProcessorJpeg : public PostProcessor
@@ -25,6 +28,7 @@ public:
 	void process(Camera3RequestDescriptor::StreamBuffer *streamBuffer) override;
 
 private:
+	void createExif();
 	void generateThumbnail(const libcamera::FrameBuffer &source,
 			       const libcamera::Size &targetSize,
 			       unsigned int quality,
@@ -35,4 +39,10 @@ private:
 	libcamera::Size streamSize_;
 	EncoderLibJpeg thumbnailEncoder_;
 	Thumbnailer thumbnailer_;
+	/* Stores the raw scaled-down thumbnail bytes, reused for each capture. */
+	std::vector<unsigned char> rawThumbnail_;
+	std::vector<unsigned char> thumbnail_;
+	/* Holds the tags that don't change between captures of the stream. */
+	std::unique_ptr<Exif> exif_;
+	libcamera::CopyAccount copyAccount_;
 };
@@ -11,6 +11,7 @@
 #include <libcamera/geometry.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/mapped_framebuffer.h"
 
 class Thumbnailer
 {
@@ -28,5 +29,8 @@ private:
 	libcamera::PixelFormat pixelFormat_;
 	libcamera::Size sourceSize_;
 
+	/* The source buffers are recycled, keep them mapped. */
+	libcamera::MappedFrameBufferCache sourceMaps_;
+
 	bool valid_;
 };
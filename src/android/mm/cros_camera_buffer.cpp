@@ -22,7 +22,7 @@ class CameraBuffer::Private : public Extensible::Private
 public:
 	Private(CameraBuffer *cameraBuffer, buffer_handle_t camera3Buffer,
 		PixelFormat pixelFormat, const Size &size,
-		int flags);
+		int flags, MappedFrameBufferCache *cache);
 	~Private();
 
 	bool isValid() const { return registered_; }
@@ -55,7 +55,8 @@ CameraBuffer::Private::Private([[maybe_unused]] CameraBuffer *cameraBuffer,
 			       buffer_handle_t camera3Buffer,
 			       [[maybe_unused]] PixelFormat pixelFormat,
 			       [[maybe_unused]] const Size &size,
-			       [[maybe_unused]] int flags)
+			       [[maybe_unused]] int flags,
+			       [[maybe_unused]] MappedFrameBufferCache *cache)
 	: handle_(camera3Buffer), numPlanes_(0), mapped_(false),
 	  registered_(false)
 {
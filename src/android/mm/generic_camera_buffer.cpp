@@ -9,8 +9,12 @@
 
 #include <sys/mman.h>
 #include <unistd.h>
+#include <vector>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/shared_fd.h>
+
+#include <libcamera/framebuffer.h>
 
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/mapped_framebuffer.h"
@@ -26,7 +30,8 @@ class CameraBuffer::Private : public Extensible::Private,
 
 public:
 	Private(CameraBuffer *cameraBuffer, buffer_handle_t camera3Buffer,
-		PixelFormat pixelFormat, const Size &size, int flags);
+		PixelFormat pixelFormat, const Size &size, int flags,
+		MappedFrameBufferCache *cache);
 	~Private();
 
 	unsigned int numPlanes() const;
@@ -47,9 +52,11 @@ private:
 	};
 
 	void map();
+	void mapCached();
 
 	int fd_;
 	int flags_;
+	MappedFrameBufferCache *cache_;
 	off_t bufferLength_;
 	bool mapped_;
 	std::vector<PlaneInfo> planeInfo_;
@@ -58,8 +65,10 @@ private:
 CameraBuffer::Private::Private([[maybe_unused]] CameraBuffer *cameraBuffer,
 			       buffer_handle_t camera3Buffer,
 			       PixelFormat pixelFormat,
-			       const Size &size, int flags)
-	: fd_(-1), flags_(flags), bufferLength_(-1), mapped_(false)
+			       const Size &size, int flags,
+			       MappedFrameBufferCache *cache)
+	: fd_(-1), flags_(flags), cache_(cache), bufferLength_(-1),
+	  mapped_(false)
 {
 	error_ = 0;
 
@@ -179,6 +188,11 @@ void CameraBuffer::Private::map()
 	ASSERT(fd_ != -1);
 	ASSERT(bufferLength_ >= 0);
 
+	if (cache_) {
+		mapCached();
+		return;
+	}
+
 	void *address = mmap(nullptr, bufferLength_, flags_, MAP_SHARED, fd_, 0);
 	if (address == MAP_FAILED) {
 		error_ = -errno;
@@ -196,4 +210,34 @@ void CameraBuffer::Private::map()
 	mapped_ = true;
 }
 
+/*
+ * Map the buffer through the cache, which keeps the mappings of the buffers
+ * recycled by the framework alive across requests. The flags of the cache
+ * apply instead of flags_.
+ */
+void CameraBuffer::Private::mapCached()
+{
+	/* The dmabuf is identified by its inode, wrap it in a FrameBuffer. */
+	SharedFD fd(fd_);
+	std::vector<FrameBuffer::Plane> planes;
+	for (const auto &info : planeInfo_) {
+		FrameBuffer::Plane plane;
+		plane.fd = fd;
+		plane.offset = info.offset;
+		plane.length = info.size;
+		planes.push_back(std::move(plane));
+	}
+
+	FrameBuffer buffer(planes);
+	const MappedFrameBuffer *mapping = cache_->map(&buffer);
+	if (!mapping) {
+		error_ = -ENOMEM;
+		LOG(HAL, Error) << "Failed to map buffer";
+		return;
+	}
+
+	planes_ = mapping->planes();
+	mapped_ = true;
+}
+
 PUBLIC_CAMERA_BUFFER_IMPLEMENTATION
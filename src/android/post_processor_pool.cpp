@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Pool of threads shared by the post-processors of a camera device
+ */
+
+#include "post_processor_pool.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include "post_processor.h"
+
+using namespace libcamera;
+
+/*
+ * \class PostProcessorPool
+ * \brief Run the post-processors of all the streams of a camera device
+ *
+ * The streams of a camera device that are produced by post-processing, such
+ * as a JPEG stream and a scaled YUV stream, queue their buffers to a pool
+ * of worker threads shared by the device. Buffers of different streams are
+ * processed concurrently, while the buffers of each stream are processed one
+ * at a time and in the order they have been queued, as the post-processors
+ * are not reentrant. The completion order of the requests is then preserved
+ * by the descriptors queue of the CameraDevice.
+ *
+ * Each post-processor has a channel in the pool, which holds its pending
+ * buffers. A channel with pending buffers that no worker is processing is
+ * listed in the ready queue, from which idle workers pick the next buffer to
+ * process.
+ */
+
+/*
+ * The JPEG encoder runs its own strip threads, limit the number of workers to
+ * avoid oversubscribing the CPUs.
+ */
+static constexpr unsigned int kMaxWorkers = 4;
+
+class PostProcessorPool::Worker : public Thread
+{
+public:
+	Worker(PostProcessorPool *pool, unsigned int index)
+		: Thread("HALPostProc" + std::to_string(index)), pool_(pool)
+	{
+		setRole(Role::LatencyCritical);
+	}
+
+protected:
+	void run() override
+	{
+		pool_->run();
+	}
+
+private:
+	PostProcessorPool *pool_;
+};
+
+PostProcessorPool::PostProcessorPool()
+	: stopping_(false)
+{
+}
+
+PostProcessorPool::~PostProcessorPool()
+{
+	{
+		MutexLocker locker(mutex_);
+		stopping_ = true;
+	}
+
+	workCv_.notify_all();
+
+	for (auto &worker : workers_)
+		worker->wait();
+}
+
+/*
+ * Queue a buffer to be processed by a post-processor. The buffer is completed
+ * through the processComplete signal of the post-processor, emitted from one
+ * of the workers.
+ */
+void PostProcessorPool::queue(PostProcessor *postProcessor,
+			      Camera3RequestDescriptor::StreamBuffer *streamBuffer)
+{
+	{
+		MutexLocker locker(mutex_);
+
+		if (workers_.empty())
+			start();
+
+		Channel &channel = channels_[postProcessor];
+		channel.buffers.push(streamBuffer);
+		if (channel.busy || channel.buffers.size() > 1)
+			return;
+
+		ready_.push_back(postProcessor);
+	}
+
+	workCv_.notify_one();
+}
+
+/*
+ * Complete the buffers queued to a post-processor that haven't been processed
+ * yet with errors. The buffer being processed, if any, is completed normally
+ * before this function returns.
+ */
+void PostProcessorPool::flush(PostProcessor *postProcessor)
+{
+	std::queue<Camera3RequestDescriptor::StreamBuffer *> buffers;
+
+	{
+		MutexLocker locker(mutex_);
+
+		auto it = channels_.find(postProcessor);
+		if (it == channels_.end())
+			return;
+
+		Channel &channel = it->second;
+		buffers = std::move(channel.buffers);
+		channel.buffers = {};
+		ready_.erase(std::remove(ready_.begin(), ready_.end(), postProcessor),
+			     ready_.end());
+
+		doneCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return !channel.busy;
+		});
+	}
+
+	while (!buffers.empty()) {
+		postProcessor->processComplete.emit(buffers.front(),
+						    PostProcessor::Status::Error);
+		buffers.pop();
+	}
+}
+
+/*
+ * Drop the buffers queued to a post-processor without completing them, and
+ * wait for the buffer being processed, if any. The post-processor can be
+ * destroyed when this function returns.
+ */
+void PostProcessorPool::unregister(PostProcessor *postProcessor)
+{
+	MutexLocker locker(mutex_);
+
+	auto it = channels_.find(postProcessor);
+	if (it == channels_.end())
+		return;
+
+	Channel &channel = it->second;
+	channel.buffers = {};
+	ready_.erase(std::remove(ready_.begin(), ready_.end(), postProcessor),
+		     ready_.end());
+
+	doneCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+		return !channel.busy;
+	});
+
+	channels_.erase(it);
+}
+
+void PostProcessorPool::start()
+{
+	unsigned int numWorkers =
+		std::clamp(std::thread::hardware_concurrency(), 1U, kMaxWorkers);
+
+	for (unsigned int i = 0; i < numWorkers; i++) {
+		workers_.push_back(std::make_unique<Worker>(this, i));
+		workers_.back()->start();
+	}
+}
+
+void PostProcessorPool::run()
+{
+	MutexLocker locker(mutex_);
+
+	while (1) {
+		workCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return stopping_ || !ready_.empty();
+		});
+
+		if (stopping_)
+			break;
+
+		PostProcessor *postProcessor = ready_.front();
+		ready_.pop_front();
+
+		/*
+		 * The channel can't be erased while it is busy, the reference
+		 * stays valid until the buffer has been processed.
+		 */
+		Channel &channel = channels_[postProcessor];
+		Camera3RequestDescriptor::StreamBuffer *streamBuffer =
+			channel.buffers.front();
+		channel.buffers.pop();
+		channel.busy = true;
+
+		locker.unlock();
+
+		postProcessor->process(streamBuffer);
+
+		locker.lock();
+
+		channel.busy = false;
+		if (!channel.buffers.empty()) {
+			ready_.push_back(postProcessor);
+			workCv_.notify_one();
+		}
+
+		doneCv_.notify_all();
+	}
+}
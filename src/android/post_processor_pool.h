@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Pool of threads shared by the post-processors of a camera device
+ */
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/thread.h>
+
+#include "camera_request.h"
+
+class PostProcessor;
+
+class PostProcessorPool
+{
+public:
+	PostProcessorPool();
+	~PostProcessorPool();
+
+	void queue(PostProcessor *postProcessor,
+		   Camera3RequestDescriptor::StreamBuffer *streamBuffer);
+	void flush(PostProcessor *postProcessor);
+	void unregister(PostProcessor *postProcessor);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(PostProcessorPool)
+
+	class Worker;
+
+	struct Channel {
+		std::queue<Camera3RequestDescriptor::StreamBuffer *> buffers;
+		bool busy = false;
+	};
+
+	void start() LIBCAMERA_TSA_REQUIRES(mutex_);
+	void run();
+
+	libcamera::Mutex mutex_;
+	/* Signalled when a channel becomes ready or the pool is stopped */
+	libcamera::ConditionVariable workCv_;
+	/* Signalled when a worker is done with a buffer */
+	libcamera::ConditionVariable doneCv_;
+
+	std::map<PostProcessor *, Channel> channels_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	/* Channels with pending buffers that no worker is processing */
+	std::deque<PostProcessor *> ready_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool stopping_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	/* Started on first use, only modified with the mutex held */
+	std::vector<std::unique_ptr<Worker>> workers_;
+};
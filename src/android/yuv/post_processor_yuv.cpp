@@ -7,9 +7,14 @@
 
 #include "post_processor_yuv.h"
 
+#include <algorithm>
+#include <thread>
+
 #include <libyuv/scale.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/formats.h>
 #include <libcamera/geometry.h>
@@ -22,6 +27,49 @@ using namespace libcamera;
 
 LOG_DEFINE_CATEGORY(YUV)
 
+namespace {
+
+/* The number of threads that scale bands in parallel. */
+constexpr unsigned int kMaxBandThreads = 4;
+
+/*
+ * The minimum number of destination rows of a band, below which the cost of
+ * dispatching the band outweighs the parallel scaling gain.
+ */
+constexpr unsigned int kMinBandRows = 128;
+
+} /* namespace */
+
+class PostProcessorYuv::BandWorker : public Thread
+{
+public:
+	BandWorker(PostProcessorYuv *postProcessor)
+		: Thread("YuvScaleBand"), postProcessor_(postProcessor)
+	{
+		setRole(Role::LatencyCritical);
+	}
+
+protected:
+	void run() override
+	{
+		postProcessor_->processBands();
+	}
+
+private:
+	PostProcessorYuv *postProcessor_;
+};
+
+PostProcessorYuv::PostProcessorYuv()
+	: nextBand_(0), pendingBands_(0), bandsResult_(0), stopWorkers_(false),
+	  copyAccount_("android_yuv")
+{
+}
+
+PostProcessorYuv::~PostProcessorYuv()
+{
+	stopWorkers();
+}
+
 int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 				const StreamConfiguration &outCfg)
 {
@@ -46,6 +94,22 @@ int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 	}
 
 	calculateLengths(inCfg, outCfg);
+
+	stopWorkers();
+	createBands();
+
+	{
+		MutexLocker locker(mutex_);
+		nextBand_ = bands_.size();
+		pendingBands_ = 0;
+		stopWorkers_ = false;
+	}
+
+	for (unsigned int i = 1; i < bands_.size(); i++) {
+		workers_.push_back(std::make_unique<BandWorker>(this));
+		workers_.back()->start();
+	}
+
 	return 0;
 }
 
@@ -66,27 +130,152 @@ void PostProcessorYuv::process(Camera3RequestDescriptor::StreamBuffer *streamBuf
 		return;
 	}
 
-	int ret = libyuv::NV12Scale(sourceMapped.planes()[0].data(),
-				    sourceStride_[0],
-				    sourceMapped.planes()[1].data(),
-				    sourceStride_[1],
-				    sourceSize_.width, sourceSize_.height,
-				    destination->plane(0).data(),
-				    destinationStride_[0],
-				    destination->plane(1).data(),
-				    destinationStride_[1],
-				    destinationSize_.width,
-				    destinationSize_.height,
-				    libyuv::FilterMode::kFilterBilinear);
+	MappedFrameBuffer::SyncScope sync = sourceMapped.syncScope();
+
+	sourcePlanes_[0] = sourceMapped.planes()[0].data();
+	sourcePlanes_[1] = sourceMapped.planes()[1].data();
+	destinationPlanes_[0] = destination->plane(0).data();
+	destinationPlanes_[1] = destination->plane(1).data();
+
+	int ret = bands_.size() > 1 ? scaleBands() : scaleBand(0);
+	sync.clear();
 	if (ret) {
 		LOG(YUV, Error) << "Failed NV12 scaling: " << ret;
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
 		return;
 	}
 
+	/* The scaled frame is a CPU-written duplicate of the source frame. */
+	const size_t destinationBytes = destinationLength_[0] + destinationLength_[1];
+	copyAccount_.record(destinationBytes,
+			    sourceLength_[0] + sourceLength_[1] + destinationBytes);
+
 	processComplete.emit(streamBuffer, PostProcessor::Status::Success);
 }
 
+void PostProcessorYuv::stopWorkers()
+{
+	{
+		MutexLocker locker(mutex_);
+		stopWorkers_ = true;
+	}
+	workCv_.notify_all();
+
+	for (auto &worker : workers_)
+		worker->wait();
+
+	workers_.clear();
+}
+
+/*
+ * Split the destination image in horizontal bands, each scaled from the
+ * source rows that map to it. The band boundaries are aligned to the chroma
+ * subsampling, and the bilinear filter of each band is clamped to its source
+ * rows. This differs from scaling the complete image by at most a fraction
+ * of a source row at the band boundaries, which isn't noticeable when
+ * down-scaling.
+ */
+void PostProcessorYuv::createBands()
+{
+	bands_.clear();
+
+	const unsigned int numThreads = std::min({ std::thread::hardware_concurrency(),
+						   kMaxBandThreads,
+						   destinationSize_.height / kMinBandRows });
+	const unsigned int numBands = std::max(numThreads, 1U);
+	const unsigned int bandRows =
+		utils::alignUp((destinationSize_.height + numBands - 1) / numBands, 2);
+
+	for (unsigned int row = 0; row < destinationSize_.height; row += bandRows) {
+		Band band;
+		band.destinationRow = row;
+		band.destinationRows = std::min(bandRows, destinationSize_.height - row);
+
+		unsigned int end = row + band.destinationRows;
+		band.sourceRow = utils::alignDown(static_cast<uint64_t>(row) * sourceSize_.height
+						  / destinationSize_.height, 2);
+		unsigned int sourceEnd = end == destinationSize_.height
+				       ? sourceSize_.height
+				       : utils::alignDown(static_cast<uint64_t>(end) * sourceSize_.height
+							  / destinationSize_.height, 2);
+		band.sourceRows = sourceEnd - band.sourceRow;
+
+		bands_.push_back(band);
+	}
+}
+
+int PostProcessorYuv::scaleBands()
+{
+	MutexLocker locker(mutex_);
+
+	nextBand_ = 0;
+	pendingBands_ = bands_.size();
+	bandsResult_ = 0;
+
+	workCv_.notify_all();
+
+	/* Scale bands on the calling thread too, until none is left. */
+	while (nextBand_ < bands_.size()) {
+		unsigned int index = nextBand_++;
+		locker.unlock();
+
+		int ret = scaleBand(index);
+
+		locker.lock();
+		if (ret)
+			bandsResult_ = ret;
+		pendingBands_--;
+	}
+
+	doneCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+		return pendingBands_ == 0;
+	});
+
+	return bandsResult_;
+}
+
+int PostProcessorYuv::scaleBand(unsigned int index)
+{
+	const Band &band = bands_[index];
+
+	return libyuv::NV12Scale(sourcePlanes_[0] + band.sourceRow * sourceStride_[0],
+				 sourceStride_[0],
+				 sourcePlanes_[1] + band.sourceRow / 2 * sourceStride_[1],
+				 sourceStride_[1],
+				 sourceSize_.width, band.sourceRows,
+				 destinationPlanes_[0] + band.destinationRow * destinationStride_[0],
+				 destinationStride_[0],
+				 destinationPlanes_[1] + band.destinationRow / 2 * destinationStride_[1],
+				 destinationStride_[1],
+				 destinationSize_.width, band.destinationRows,
+				 libyuv::FilterMode::kFilterBilinear);
+}
+
+void PostProcessorYuv::processBands()
+{
+	MutexLocker locker(mutex_);
+
+	while (1) {
+		workCv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return stopWorkers_ || nextBand_ < bands_.size();
+		});
+
+		if (stopWorkers_)
+			break;
+
+		unsigned int index = nextBand_++;
+		locker.unlock();
+
+		int ret = scaleBand(index);
+
+		locker.lock();
+		if (ret)
+			bandsResult_ = ret;
+		if (--pendingBands_ == 0)
+			doneCv_.notify_one();
+	}
+}
+
 bool PostProcessorYuv::isValidBuffers(const FrameBuffer &source,
 				      const CameraBuffer &destination) const
 {
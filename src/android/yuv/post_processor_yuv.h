@@ -9,18 +9,41 @@
 
 #include "../post_processor.h"
 
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
+
 #include <libcamera/geometry.h>
 
+#include "libcamera/internal/copy_accounting.h"
+
 class PostProcessorYuv : public PostProcessor
 {
 public:
-	PostProcessorYuv() = default;
+	PostProcessorYuv();
+	~PostProcessorYuv();
 
 	int configure(const libcamera::StreamConfiguration &incfg,
 		      const libcamera::StreamConfiguration &outcfg) override;
 	void process(Camera3RequestDescriptor::StreamBuffer *streamBuffer) override;
 
 private:
+	class BandWorker;
+
+	struct Band {
+		unsigned int sourceRow;
+		unsigned int sourceRows;
+		unsigned int destinationRow;
+		unsigned int destinationRows;
+	};
+
+	void stopWorkers();
+	void createBands();
+	int scaleBands();
+	int scaleBand(unsigned int index);
+	void processBands();
+
 	bool isValidBuffers(const libcamera::FrameBuffer &source,
 			    const CameraBuffer &destination) const;
 	void calculateLengths(const libcamera::StreamConfiguration &inCfg,
@@ -32,4 +55,25 @@ private:
 	unsigned int destinationLength_[2] = {};
 	unsigned int sourceStride_[2] = {};
 	unsigned int destinationStride_[2] = {};
+
+	/*
+	 * Large images are scaled in horizontal bands in parallel. The first
+	 * band is scaled by the thread calling process(), the other ones by
+	 * the band workers.
+	 */
+	std::vector<Band> bands_;
+	std::vector<std::unique_ptr<BandWorker>> workers_;
+
+	/* State of the bands being scaled, shared with the workers. */
+	libcamera::Mutex mutex_;
+	libcamera::ConditionVariable workCv_;
+	libcamera::ConditionVariable doneCv_;
+	const uint8_t *sourcePlanes_[2] = {};
+	uint8_t *destinationPlanes_[2] = {};
+	unsigned int nextBand_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	unsigned int pendingBands_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int bandsResult_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	bool stopWorkers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	libcamera::CopyAccount copyAccount_;
 };
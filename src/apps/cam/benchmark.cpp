@@ -0,0 +1,258 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Capture performance measurements
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <sys/resource.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer.h>
+
+using namespace libcamera;
+
+namespace {
+
+void processTimes(uint64_t *user, uint64_t *system)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	*user = usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec;
+	*system = usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec;
+}
+
+std::string jsonString(const std::string &str)
+{
+	std::ostringstream out;
+
+	out << '"';
+
+	for (char c : str) {
+		switch (c) {
+		case '"':
+			out << "\\\"";
+			break;
+		case '\\':
+			out << "\\\\";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				out << "\\u" << std::hex << std::setw(4)
+				    << std::setfill('0') << static_cast<int>(c)
+				    << std::dec;
+			else
+				out << c;
+			break;
+		}
+	}
+
+	out << '"';
+
+	return out.str();
+}
+
+/*
+ * Print the distribution of a set of samples, in microseconds, as a JSON
+ * object with values in milliseconds.
+ */
+void printDistribution(std::ostream &out, std::vector<double> samples)
+{
+	if (samples.empty()) {
+		out << "null";
+		return;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	/* Use the nearest-rank method. */
+	auto percentile = [&samples](double p) {
+		size_t rank = std::ceil(p / 100 * samples.size());
+		return samples[std::max<size_t>(rank, 1) - 1] / 1000;
+	};
+
+	double mean = std::accumulate(samples.begin(), samples.end(), 0.0) /
+		      samples.size();
+
+	out << "{ \"min\": " << samples.front() / 1000
+	    << ", \"mean\": " << mean / 1000
+	    << ", \"p50\": " << percentile(50)
+	    << ", \"p90\": " << percentile(90)
+	    << ", \"p99\": " << percentile(99)
+	    << ", \"max\": " << samples.back() / 1000
+	    << " }";
+}
+
+} /* namespace */
+
+Benchmark::Benchmark(const CameraConfiguration &config,
+		     const std::map<const Stream *, std::string> &streamNames)
+	: lastSensorTimestamp_(0), frames_(0), startUserTime_(0),
+	  startSystemTime_(0), userTime_(0), systemTime_(0)
+{
+	for (const StreamConfiguration &cfg : config) {
+		StreamStats &stats = streams_[cfg.stream()];
+		stats.name = streamNames.at(cfg.stream());
+		stats.configuration = cfg.toString();
+	}
+}
+
+/* Start the measurements, right before starting the camera. */
+void Benchmark::start()
+{
+	startTime_ = clock::now();
+	processTimes(&startUserTime_, &startSystemTime_);
+}
+
+void Benchmark::stop()
+{
+	stopTime_ = clock::now();
+	processTimes(&userTime_, &systemTime_);
+
+	userTime_ -= startUserTime_;
+	systemTime_ -= startSystemTime_;
+}
+
+void Benchmark::requestQueued(const Request *request)
+{
+	queued_[request] = clock::now();
+}
+
+/*
+ * Account for a completed request. The completion time is sampled in the
+ * request completion handler, before the request is deferred to the event
+ * loop.
+ */
+void Benchmark::requestCompleted(Request *request,
+				 clock::time_point completed)
+{
+	if (!frames_)
+		firstFrameTime_ = completed;
+
+	frames_++;
+
+	auto queued = queued_.find(request);
+	if (queued != queued_.end()) {
+		std::chrono::duration<double, std::micro> latency =
+			completed - queued->second;
+		latencies_.push_back(latency.count());
+	}
+
+	for (const auto &[stream, buffer] : request->buffers()) {
+		auto it = streams_.find(stream);
+		if (it == streams_.end())
+			continue;
+
+		StreamStats &stats = it->second;
+		const FrameMetadata &metadata = buffer->metadata();
+
+		if (metadata.status != FrameMetadata::FrameSuccess)
+			continue;
+
+		if (stats.frames) {
+			if (metadata.sequence > stats.lastSequence + 1)
+				stats.dropped += metadata.sequence - stats.lastSequence - 1;
+		} else {
+			stats.firstTimestamp = metadata.timestamp;
+		}
+
+		stats.frames++;
+		stats.lastSequence = metadata.sequence;
+		stats.lastTimestamp = metadata.timestamp;
+	}
+
+	/*
+	 * Measure the frame intervals on the sensor timestamps, falling back
+	 * to the timestamp of the first buffer if the pipeline handler doesn't
+	 * report them.
+	 */
+	uint64_t timestamp = request->buffers().begin()->second->metadata().timestamp;
+	const auto sensorTimestamp = request->metadata().get(controls::SensorTimestamp);
+	if (sensorTimestamp)
+		timestamp = *sensorTimestamp;
+
+	if (lastSensorTimestamp_ && timestamp > lastSensorTimestamp_)
+		intervals_.push_back((timestamp - lastSensorTimestamp_) / 1000.0);
+	lastSensorTimestamp_ = timestamp;
+}
+
+void Benchmark::report(std::ostream &out, const std::string &cameraName,
+		       const std::string &cameraId) const
+{
+	std::chrono::duration<double> duration = stopTime_ - startTime_;
+	std::chrono::duration<double, std::milli> firstFrame =
+		firstFrameTime_ - startTime_;
+
+	/* The jitter is the deviation of the intervals from their mean. */
+	std::vector<double> jitter;
+	if (!intervals_.empty()) {
+		double mean = std::accumulate(intervals_.begin(), intervals_.end(), 0.0) /
+			      intervals_.size();
+
+		for (double interval : intervals_)
+			jitter.push_back(std::abs(interval - mean));
+	}
+
+	out << std::fixed << std::setprecision(3);
+
+	out << "{" << std::endl
+	    << "  \"camera\": " << jsonString(cameraName) << "," << std::endl
+	    << "  \"id\": " << jsonString(cameraId) << "," << std::endl
+	    << "  \"frames\": " << frames_ << "," << std::endl
+	    << "  \"duration_s\": " << duration.count() << "," << std::endl
+	    << "  \"time_to_first_frame_ms\": ";
+
+	if (frames_)
+		out << firstFrame.count();
+	else
+		out << "null";
+
+	out << "," << std::endl
+	    << "  \"process_cpu_user_s\": " << userTime_ / 1000000.0 << "," << std::endl
+	    << "  \"process_cpu_system_s\": " << systemTime_ / 1000000.0 << "," << std::endl
+	    << "  \"process_cpu_load\": "
+	    << (duration.count() ? (userTime_ + systemTime_) / 1000000.0 / duration.count() : 0.0)
+	    << "," << std::endl;
+
+	out << "  \"streams\": {";
+
+	bool first = true;
+	for (const auto &[stream, stats] : streams_) {
+		double fps = 0.0;
+		if (stats.frames > 1 && stats.lastTimestamp > stats.firstTimestamp)
+			fps = (stats.frames - 1) * 1000000000.0 /
+			      (stats.lastTimestamp - stats.firstTimestamp);
+
+		out << (first ? "" : ",") << std::endl
+		    << "    " << jsonString(stats.name) << ": { "
+		    << "\"configuration\": " << jsonString(stats.configuration)
+		    << ", \"frames\": " << stats.frames
+		    << ", \"fps\": " << fps
+		    << ", \"dropped\": " << stats.dropped << " }";
+
+		first = false;
+	}
+
+	out << std::endl << "  }," << std::endl;
+
+	out << "  \"request_latency_ms\": ";
+	printDistribution(out, latencies_);
+	out << "," << std::endl
+	    << "  \"frame_interval_ms\": ";
+	printDistribution(out, intervals_);
+	out << "," << std::endl
+	    << "  \"frame_jitter_ms\": ";
+	printDistribution(out, jitter);
+	out << std::endl << "}" << std::endl;
+
+	out << std::defaultfloat;
+}
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Capture performance measurements
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/camera.h>
+#include <libcamera/request.h>
+#include <libcamera/stream.h>
+
+class Benchmark
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	Benchmark(const libcamera::CameraConfiguration &config,
+		  const std::map<const libcamera::Stream *, std::string> &streamNames);
+
+	void start();
+	void stop();
+
+	void requestQueued(const libcamera::Request *request);
+	void requestCompleted(libcamera::Request *request,
+			      clock::time_point completed);
+
+	void report(std::ostream &out, const std::string &cameraName,
+		    const std::string &cameraId) const;
+
+private:
+	struct StreamStats {
+		std::string name;
+		std::string configuration;
+
+		unsigned int frames = 0;
+		unsigned int dropped = 0;
+		uint32_t lastSequence = 0;
+		uint64_t firstTimestamp = 0;
+		uint64_t lastTimestamp = 0;
+	};
+
+	std::map<const libcamera::Stream *, StreamStats> streams_;
+
+	std::map<const libcamera::Request *, clock::time_point> queued_;
+
+	/* Latencies and frame intervals, in microseconds */
+	std::vector<double> latencies_;
+	std::vector<double> intervals_;
+	uint64_t lastSensorTimestamp_;
+
+	unsigned int frames_;
+
+	clock::time_point startTime_;
+	clock::time_point firstFrameTime_;
+	clock::time_point stopTime_;
+
+	/* Process CPU time, in microseconds */
+	uint64_t startUserTime_;
+	uint64_t startSystemTime_;
+	uint64_t userTime_;
+	uint64_t systemTime_;
+};
@@ -16,6 +16,7 @@
 #include "../common/event_loop.h"
 #include "../common/stream_options.h"
 
+#include "benchmark.h"
 #include "camera_session.h"
 #include "capture_script.h"
 #include "file_sink.h"
@@ -35,7 +36,7 @@ CameraSession::CameraSession(CameraManager *cm,
 			     const OptionsParser::Options &options)
 	: options_(options), cameraIndex_(cameraIndex), last_(0),
 	  queueCount_(0), captureCount_(0), captureLimit_(0),
-	  printMetadata_(false)
+	  timedOut_(false), printMetadata_(false)
 {
 	char *endptr;
 	unsigned long index = strtoul(cameraId.c_str(), &endptr, 10);
@@ -105,20 +106,31 @@ CameraSession::CameraSession(CameraManager *cm,
 			return;
 		}
 
-		if (roles.size() != 1) {
-			std::cerr << "Display doesn't support multiple streams"
+		if (roles[0] != StreamRole::Viewfinder) {
+			std::cerr << "Display requires the first stream to be a viewfinder"
 				  << std::endl;
 			return;
 		}
 
-		if (roles[0] != StreamRole::Viewfinder) {
-			std::cerr << "Display requires a viewfinder stream"
-				  << std::endl;
-			return;
+		if (options_.isSet(OptDisplayDepth)) {
+			unsigned int depth = options_[OptDisplayDepth].toInteger();
+			if (depth < 1 || depth > 2) {
+				std::cerr << "Display commit depth must be 1 or 2"
+					  << std::endl;
+				return;
+			}
 		}
 	}
 #endif
 
+	if (options_.isSet(OptBenchmark) &&
+	    (options_.isSet(OptDisplay) || options_.isSet(OptFile) ||
+	     options_.isSet(OptSDL))) {
+		std::cerr << "--benchmark can't be combined with frame sinks"
+			  << std::endl;
+		return;
+	}
+
 	if (options_.isSet(OptCaptureScript)) {
 		std::string scriptName = options_[OptCaptureScript].toString();
 		script_ = std::make_unique<CaptureScript>(camera_, scriptName);
@@ -231,6 +243,7 @@ int CameraSession::start()
 	queueCount_ = 0;
 	captureCount_ = 0;
 	captureLimit_ = options_[OptCapture].toInteger();
+	timedOut_ = false;
 	printMetadata_ = options_.isSet(OptMetadata);
 
 	ret = camera_->configure(config_.get());
@@ -248,9 +261,15 @@ int CameraSession::start()
 
 	camera_->requestCompleted.connect(this, &CameraSession::requestComplete);
 
+	if (options_.isSet(OptBenchmark))
+		benchmark_ = std::make_unique<Benchmark>(*config_, streamNames_);
+
 #ifdef HAVE_KMS
 	if (options_.isSet(OptDisplay))
-		sink_ = std::make_unique<KMSSink>(options_[OptDisplay].toString());
+		sink_ = std::make_unique<KMSSink>(options_[OptDisplay].toString(),
+						  options_.isSet(OptDisplayDepth)
+						  ? options_[OptDisplayDepth].toInteger()
+						  : 2);
 #endif
 
 #ifdef HAVE_SDL
@@ -268,6 +287,9 @@ int CameraSession::start()
 				return ret;
 		}
 
+		sink->setDirectIO(options_.isSet(OptDirectIO));
+		sink->setDngThumbnail(!options_.isSet(OptNoDngThumbnail));
+
 		sink_ = std::move(sink);
 	}
 
@@ -289,6 +311,9 @@ int CameraSession::start()
 
 void CameraSession::stop()
 {
+	if (benchmark_)
+		benchmark_->stop();
+
 	int ret = camera_->stop();
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
@@ -304,6 +329,12 @@ void CameraSession::stop()
 	requests_.clear();
 
 	allocator_.reset();
+
+	if (benchmark_) {
+		benchmark_->report(std::cout, "cam" + std::to_string(cameraIndex_),
+				   camera_->id());
+		benchmark_.reset();
+	}
 }
 
 int CameraSession::startCapture()
@@ -363,6 +394,9 @@ int CameraSession::startCapture()
 		}
 	}
 
+	if (benchmark_)
+		benchmark_->start();
+
 	ret = camera_->start();
 	if (ret) {
 		std::cout << "Failed to start capture" << std::endl;
@@ -382,7 +416,16 @@ int CameraSession::startCapture()
 		}
 	}
 
-	if (captureLimit_)
+	unsigned int duration = options_[OptBenchmark].toInteger();
+	if (duration)
+		EventLoop::instance()->addTimerEvent(std::chrono::seconds(duration),
+						     [this]() { benchmarkTimeout(); });
+
+	if (duration)
+		std::cout << "cam" << cameraIndex_
+			  << ": Capture for " << duration << " seconds"
+			  << std::endl;
+	else if (captureLimit_)
 		std::cout << "cam" << cameraIndex_
 			  << ": Capture " << captureLimit_ << " frames"
 			  << std::endl;
@@ -396,14 +439,17 @@ int CameraSession::startCapture()
 
 int CameraSession::queueRequest(Request *request)
 {
-	if (captureLimit_ && queueCount_ >= captureLimit_)
+	if (timedOut_ || (captureLimit_ && queueCount_ >= captureLimit_))
 		return 0;
 
 	if (script_)
-		request->controls() = script_->frameControls(queueCount_);
+		script_->applyFrameControls(queueCount_, request->controls());
 
 	queueCount_++;
 
+	if (benchmark_)
+		benchmark_->requestQueued(request);
+
 	return camera_->queueRequest(request);
 }
 
@@ -414,12 +460,19 @@ void CameraSession::requestComplete(Request *request)
 
 	/*
 	 * Defer processing of the completed request to the event loop, to avoid
-	 * blocking the camera manager thread.
+	 * blocking the camera manager thread. The completion time is sampled
+	 * here to exclude the event loop latency from the measurements.
 	 */
-	EventLoop::instance()->callLater([this, request]() { processRequest(request); });
+	std::chrono::steady_clock::time_point completed =
+		std::chrono::steady_clock::now();
+
+	EventLoop::instance()->callLater([this, request, completed]() {
+		processRequest(request, completed);
+	});
 }
 
-void CameraSession::processRequest(Request *request)
+void CameraSession::processRequest(Request *request,
+				   std::chrono::steady_clock::time_point completed)
 {
 	/*
 	 * If we've reached the capture limit, we're done. This doesn't
@@ -428,9 +481,48 @@ void CameraSession::processRequest(Request *request)
 	 * capture limit is reached and we don't want to emit the signal every
 	 * single time.
 	 */
-	if (captureLimit_ && captureCount_ >= captureLimit_)
+	if (timedOut_ || (captureLimit_ && captureCount_ >= captureLimit_))
+		return;
+
+	bool requeue = true;
+
+	if (sink_) {
+		if (!sink_->processRequest(request))
+			requeue = false;
+	}
+
+	/*
+	 * In benchmark mode, only record the measurements, printing information
+	 * about every frame would skew them.
+	 */
+	if (benchmark_)
+		benchmark_->requestCompleted(request, completed);
+	else
+		printRequest(request);
+
+	/*
+	 * Notify the user that capture is complete if the limit has just been
+	 * reached.
+	 */
+	captureCount_++;
+	if (captureLimit_ && captureCount_ >= captureLimit_) {
+		captureDone.emit();
+		return;
+	}
+
+	/*
+	 * If the frame sink holds on the request, we'll requeue it later in the
+	 * complete handler.
+	 */
+	if (!requeue)
 		return;
 
+	request->reuse(Request::ReuseBuffers);
+	queueRequest(request);
+}
+
+void CameraSession::printRequest(Request *request)
+{
 	const Request::BufferMap &buffers = request->buffers();
 
 	/*
@@ -442,8 +534,6 @@ void CameraSession::processRequest(Request *request)
 	fps = last_ != 0 && fps ? 1000000000.0 / fps : 0.0;
 	last_ = ts;
 
-	bool requeue = true;
-
 	std::stringstream info;
 	info << ts / 1000000000 << "."
 	     << std::setw(6) << std::setfill('0') << ts / 1000 % 1000000
@@ -464,11 +554,6 @@ void CameraSession::processRequest(Request *request)
 		}
 	}
 
-	if (sink_) {
-		if (!sink_->processRequest(request))
-			requeue = false;
-	}
-
 	std::cout << info.str() << std::endl;
 
 	if (printMetadata_) {
@@ -479,26 +564,6 @@ void CameraSession::processRequest(Request *request)
 				  << value.toString() << std::endl;
 		}
 	}
-
-	/*
-	 * Notify the user that capture is complete if the limit has just been
-	 * reached.
-	 */
-	captureCount_++;
-	if (captureLimit_ && captureCount_ >= captureLimit_) {
-		captureDone.emit();
-		return;
-	}
-
-	/*
-	 * If the frame sink holds on the request, we'll requeue it later in the
-	 * complete handler.
-	 */
-	if (!requeue)
-		return;
-
-	request->reuse(Request::ReuseBuffers);
-	queueRequest(request);
 }
 
 void CameraSession::sinkRelease(Request *request)
@@ -506,3 +571,13 @@ void CameraSession::sinkRelease(Request *request)
 	request->reuse(Request::ReuseBuffers);
 	queueRequest(request);
 }
+
+void CameraSession::benchmarkTimeout()
+{
+	/* The timer is periodic, and the capture limit may be reached first. */
+	if (timedOut_ || (captureLimit_ && captureCount_ >= captureLimit_))
+		return;
+
+	timedOut_ = true;
+	captureDone.emit();
+}
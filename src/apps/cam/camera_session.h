@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <stdint.h>
 #include <string>
@@ -23,6 +24,7 @@
 
 #include "../common/options.h"
 
+class Benchmark;
 class CaptureScript;
 class FrameSink;
 
@@ -54,8 +56,11 @@ private:
 
 	int queueRequest(libcamera::Request *request);
 	void requestComplete(libcamera::Request *request);
-	void processRequest(libcamera::Request *request);
+	void processRequest(libcamera::Request *request,
+			    std::chrono::steady_clock::time_point completed);
+	void printRequest(libcamera::Request *request);
 	void sinkRelease(libcamera::Request *request);
+	void benchmarkTimeout();
 
 	const OptionsParser::Options &options_;
 	std::shared_ptr<libcamera::Camera> camera_;
@@ -65,6 +70,7 @@ private:
 
 	std::map<const libcamera::Stream *, std::string> streamNames_;
 	std::unique_ptr<FrameSink> sink_;
+	std::unique_ptr<Benchmark> benchmark_;
 	unsigned int cameraIndex_;
 
 	uint64_t last_;
@@ -72,6 +78,7 @@ private:
 	unsigned int queueCount_;
 	unsigned int captureCount_;
 	unsigned int captureLimit_;
+	bool timedOut_;
 	bool printMetadata_;
 
 	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
@@ -7,7 +7,9 @@
 
 #include "capture_script.h"
 
+#include <cmath>
 #include <iostream>
+#include <set>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -40,10 +42,13 @@ CaptureScript::CaptureScript(std::shared_ptr<Camera> camera,
 	valid_ = true;
 }
 
-/* Retrieve the control list associated with a frame number. */
-const ControlList &CaptureScript::frameControls(unsigned int frame)
+/*
+ * Set the controls associated with a frame number in a control list. The
+ * values of the generators are computed for the frame and take precedence over
+ * the controls listed in the frames section.
+ */
+void CaptureScript::applyFrameControls(unsigned int frame, ControlList &controls) const
 {
-	static ControlList controls{};
 	unsigned int idx = frame;
 
 	/* If we loop, repeat the controls every 'loop_' frames. */
@@ -51,10 +56,47 @@ const ControlList &CaptureScript::frameControls(unsigned int frame)
 		idx = frame % loop_;
 
 	auto it = frameControls_.find(idx);
-	if (it == frameControls_.end())
-		return controls;
+	if (it != frameControls_.end()) {
+		for (const auto &[id, value] : it->second)
+			controls.set(id, value);
+	}
 
-	return it->second;
+	for (const Generator &generator : generators_) {
+		if (frame < generator.start)
+			continue;
+
+		unsigned int pos = frame - generator.start;
+		if (generator.frames) {
+			if (pos >= generator.frames && !generator.repeat)
+				continue;
+
+			pos %= generator.frames;
+		}
+
+		controls.set(generator.id->id(), generatorValue(generator, pos));
+	}
+}
+
+ControlValue CaptureScript::generatorValue(const Generator &generator,
+					   unsigned int frame) const
+{
+	if (generator.type == Generator::Type::Cycle)
+		return generator.values[frame / generator.hold % generator.values.size()];
+
+	double ratio = generator.frames > 1 ? frame / (generator.frames - 1.0) : 0.0;
+	double value = generator.from + (generator.to - generator.from) * ratio;
+
+	switch (generator.id->type()) {
+	case ControlTypeByte:
+		return static_cast<uint8_t>(std::lround(value));
+	case ControlTypeInteger32:
+		return static_cast<int32_t>(std::lround(value));
+	case ControlTypeInteger64:
+		return static_cast<int64_t>(std::llround(value));
+	case ControlTypeFloat:
+	default:
+		return static_cast<float>(value);
+	}
 }
 
 CaptureScript::EventPtr CaptureScript::nextEvent(yaml_event_type_t expectedType)
@@ -162,6 +204,10 @@ int CaptureScript::parseScript(FILE *script)
 			ret = parseFrames();
 			if (ret)
 				return ret;
+		} else if (section == "generators") {
+			ret = parseGenerators();
+			if (ret)
+				return ret;
 		} else {
 			std::cerr << "Unsupported section '" << section << "'"
 				  << std::endl;
@@ -322,6 +368,148 @@ int CaptureScript::parseControl(EventPtr event, ControlList &controls)
 	return 0;
 }
 
+int CaptureScript::parseGenerators()
+{
+	EventPtr event = nextEvent(YAML_SEQUENCE_START_EVENT);
+	if (!event)
+		return -EINVAL;
+
+	while (1) {
+		event = nextEvent();
+		if (!event)
+			return -EINVAL;
+
+		if (event->type == YAML_SEQUENCE_END_EVENT)
+			return 0;
+
+		int ret = parseGenerator(std::move(event));
+		if (ret)
+			return ret;
+	}
+}
+
+int CaptureScript::parseGenerator(EventPtr event)
+{
+	static const std::set<std::string> keys = {
+		"control", "type", "start", "frames", "repeat",
+		"from", "to", "hold",
+	};
+
+	if (!checkEvent(event, YAML_MAPPING_START_EVENT))
+		return -EINVAL;
+
+	std::map<std::string, std::string> params;
+	std::vector<std::string> values;
+
+	while (1) {
+		event = nextEvent();
+		if (!event)
+			return -EINVAL;
+
+		if (event->type == YAML_MAPPING_END_EVENT)
+			break;
+
+		if (!checkEvent(event, YAML_SCALAR_EVENT))
+			return -EINVAL;
+
+		std::string key = eventScalarValue(event);
+
+		if (key == "values") {
+			event = nextEvent(YAML_SEQUENCE_START_EVENT);
+			if (!event)
+				return -EINVAL;
+
+			values = parseSingleArray();
+			if (values.empty()) {
+				std::cerr << "Invalid generator values" << std::endl;
+				return -EINVAL;
+			}
+		} else if (keys.count(key)) {
+			std::string value = parseScalar();
+			if (value.empty())
+				return -EINVAL;
+
+			params[key] = value;
+		} else {
+			std::cerr << "Unsupported generator key '" << key << "'"
+				  << std::endl;
+			return -EINVAL;
+		}
+	}
+
+	auto it = controls_.find(params["control"]);
+	if (it == controls_.end()) {
+		std::cerr << "Unsupported control '" << params["control"]
+			  << "' for generator" << std::endl;
+		return -EINVAL;
+	}
+
+	Generator generator{};
+	generator.id = it->second;
+	generator.start = strtoul(params["start"].c_str(), NULL, 10);
+	generator.frames = strtoul(params["frames"].c_str(), NULL, 10);
+	generator.repeat = params["repeat"] == "true";
+
+	const std::string &type = params["type"];
+
+	if (type == "ramp") {
+		switch (generator.id->type()) {
+		case ControlTypeByte:
+		case ControlTypeInteger32:
+		case ControlTypeInteger64:
+		case ControlTypeFloat:
+			break;
+		default:
+			std::cerr << "Ramps are only supported for numerical controls"
+				  << std::endl;
+			return -EINVAL;
+		}
+
+		if (!generator.frames || params["from"].empty() ||
+		    params["to"].empty()) {
+			std::cerr << "Ramps require 'frames', 'from' and 'to' parameters"
+				  << std::endl;
+			return -EINVAL;
+		}
+
+		generator.type = Generator::Type::Ramp;
+		generator.from = strtod(params["from"].c_str(), NULL);
+		generator.to = strtod(params["to"].c_str(), NULL);
+	} else if (type == "cycle") {
+		if (values.empty()) {
+			std::cerr << "Cycles require a 'values' parameter"
+				  << std::endl;
+			return -EINVAL;
+		}
+
+		generator.type = Generator::Type::Cycle;
+		generator.hold = params["hold"].empty()
+			       ? 1 : strtoul(params["hold"].c_str(), NULL, 10);
+		if (!generator.hold) {
+			std::cerr << "Invalid cycle hold '" << params["hold"]
+				  << "'" << std::endl;
+			return -EINVAL;
+		}
+
+		/* Convert the values once, to avoid parsing them every frame. */
+		for (const std::string &repr : values) {
+			ControlValue value = parseScalarControl(generator.id, repr);
+			if (value.isNone())
+				return -EINVAL;
+
+			generator.values.push_back(std::move(value));
+		}
+	} else {
+		std::cerr << "Unsupported generator type '" << type << "'"
+			  << std::endl;
+		return -EINVAL;
+	}
+
+	generators_.push_back(std::move(generator));
+
+	return 0;
+}
+
 std::string CaptureScript::parseScalar()
 {
 	EventPtr event = nextEvent(YAML_SCALAR_EVENT);
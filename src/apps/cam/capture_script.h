@@ -10,6 +10,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <libcamera/camera.h>
 #include <libcamera/controls.h>
@@ -24,9 +25,38 @@ public:
 
 	bool valid() const { return valid_; }
 
-	const libcamera::ControlList &frameControls(unsigned int frame);
+	void applyFrameControls(unsigned int frame, libcamera::ControlList &controls) const;
 
 private:
+	/*
+	 * A generator computes the value of a control for every frame, from
+	 * its position relative to the generator start frame. Ramps
+	 * interpolate linearly between two values over a number of frames,
+	 * cycles iterate over a list of values, holding each of them for a
+	 * number of frames.
+	 */
+	struct Generator {
+		enum class Type {
+			Ramp,
+			Cycle,
+		};
+
+		const libcamera::ControlId *id;
+		Type type;
+
+		unsigned int start;
+		unsigned int frames;
+		bool repeat;
+
+		/* Ramp parameters */
+		double from;
+		double to;
+
+		/* Cycle parameters */
+		unsigned int hold;
+		std::vector<libcamera::ControlValue> values;
+	};
+
 	struct EventDeleter {
 		void operator()(yaml_event_t *event) const
 		{
@@ -38,6 +68,7 @@ private:
 
 	std::map<std::string, const libcamera::ControlId *> controls_;
 	std::map<unsigned int, libcamera::ControlList> frameControls_;
+	std::vector<Generator> generators_;
 	std::shared_ptr<libcamera::Camera> camera_;
 	yaml_parser_t parser_;
 	unsigned int loop_;
@@ -55,6 +86,11 @@ private:
 	int parseFrames();
 	int parseFrame(EventPtr event);
 	int parseControl(EventPtr event, libcamera::ControlList &controls);
+	int parseGenerators();
+	int parseGenerator(EventPtr event);
+
+	libcamera::ControlValue generatorValue(const Generator &generator,
+					       unsigned int frame) const;
 
 	libcamera::ControlValue parseScalarControl(const libcamera::ControlId *id,
 						   const std::string repr);
@@ -5,19 +5,24 @@
  * File Sink
  */
 
+#include <algorithm>
 #include <array>
 #include <assert.h>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
+#include <limits.h>
 #include <sstream>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <utility>
 
 #include <libcamera/camera.h>
+#include <libcamera/control_ids.h>
 
 #include "../common/dng_writer.h"
+#include "../common/event_loop.h"
 #include "../common/image.h"
 #include "../common/ppm_writer.h"
 
@@ -25,6 +30,52 @@
 
 using namespace libcamera;
 
+/*
+ * The alignment of the memory, length and file offset of the writes with
+ * O_DIRECT. The logical block size of most storage devices is a divisor of the
+ * page size.
+ */
+static constexpr size_t kDirectIOAlignment = 4096;
+
+/*
+ * The container files start with a header, padded to the alignment. The frames
+ * follow, each starting on an aligned offset, and are followed by the index. The
+ * index offset and the frame count are zero until the capture is stopped. All
+ * fields are stored in the native byte order, which the magic identifies.
+ *
+ * Each index entry stores, in order, the offset, timestamp, sequence number,
+ * status and number of planes of the frame as 64-bit and 32-bit integers, the
+ * size of the metadata text, the bytes used in each plane and the metadata as
+ * "name = value" lines. Entries are padded to 8 bytes.
+ */
+struct ContainerHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t alignment;
+	uint32_t fourcc;
+	uint64_t modifier;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t numPlanes;
+	uint64_t frameCount;
+	uint64_t indexOffset;
+};
+
+static_assert(sizeof(ContainerHeader) == 64);
+
+static constexpr char kContainerMagic[8] = { 'L', 'C', 'S', 'T', 'R', 'E', 'A', 'M' };
+static constexpr uint32_t kContainerVersion = 1;
+
+/* The number of frames the container files are grown by. */
+static constexpr unsigned int kPreallocFrames = 64;
+
+static off_t alignUp(off_t value)
+{
+	return (value + kDirectIOAlignment - 1) / kDirectIOAlignment * kDirectIOAlignment;
+}
+
 FileSink::FileSink([[maybe_unused]] const libcamera::Camera *camera,
 		   const std::map<const libcamera::Stream *, std::string> &streamNames)
 	:
@@ -32,7 +83,8 @@ FileSink::FileSink([[maybe_unused]] const libcamera::Camera *camera,
 	  camera_(camera),
 #endif
 	  pattern_(kDefaultFilePattern), fileType_(FileType::Binary),
-	  streamNames_(streamNames)
+	  streamNames_(streamNames), directIO_(false), dngThumbnail_(true),
+	  stopping_(false), queueLimit_(1), maxQueueDepth_(0), written_(0), dropped_(0)
 {
 }
 
@@ -42,8 +94,9 @@ FileSink::~FileSink()
 
 int FileSink::setFilePattern(const std::string &pattern)
 {
-	static const std::array<std::pair<std::string, FileType>, 2> types{{
+	static const std::array<std::pair<std::string, FileType>, 3> types{{
 		{ ".dng", FileType::Dng },
+		{ ".lcap", FileType::Container },
 		{ ".ppm", FileType::Ppm },
 	}};
 
@@ -81,6 +134,23 @@ int FileSink::configure(const libcamera::CameraConfiguration &config)
 	if (ret < 0)
 		return ret;
 
+	/*
+	 * Keep at least one request queued to the camera, frames that complete
+	 * while the writer is that far behind are dropped.
+	 */
+	unsigned int bufferCount = UINT_MAX;
+	for (const StreamConfiguration &cfg : config)
+		bufferCount = std::min(bufferCount, cfg.bufferCount);
+
+	queueLimit_ = std::max(bufferCount, 2U) - 1;
+
+	if (fileType_ == FileType::Container && config.size() > 1 &&
+	    pattern_.find('#') == std::string::npos) {
+		std::cerr << "Container file name must contain '#' to capture multiple streams"
+			  << std::endl;
+		return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -93,12 +163,95 @@ void FileSink::mapBuffer(FrameBuffer *buffer)
 	mappedBuffers_[buffer] = std::move(image);
 }
 
+int FileSink::start()
+{
+	stopping_ = false;
+	maxQueueDepth_ = 0;
+	written_ = 0;
+	dropped_ = 0;
+
+	if (fileType_ == FileType::Container) {
+		int ret = openContainers();
+		if (ret)
+			return ret;
+	}
+
+	thread_ = std::thread(&FileSink::writerThread, this);
+
+	return 0;
+}
+
+int FileSink::stop()
+{
+	if (!thread_.joinable())
+		return 0;
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stopping_ = true;
+	}
+
+	cv_.notify_one();
+	thread_.join();
+
+	closeContainers();
+
+	std::cout << "File sink: " << written_ << " frames written, "
+		  << dropped_ << " dropped, max queue depth "
+		  << maxQueueDepth_ << "/" << queueLimit_ << std::endl;
+
+	return 0;
+}
+
 bool FileSink::processRequest(Request *request)
 {
-	for (auto [stream, buffer] : request->buffers())
-		writeBuffer(stream, buffer, request->metadata());
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+
+		if (queue_.size() >= queueLimit_) {
+			dropped_++;
+			std::cerr << "File sink queue full, dropping frame "
+				  << request->sequence() << std::endl;
+			return true;
+		}
+
+		queue_.push(request);
+		maxQueueDepth_ = std::max<unsigned int>(maxQueueDepth_, queue_.size());
+	}
+
+	cv_.notify_one();
+
+	return false;
+}
+
+void FileSink::writerThread()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cv_.wait(locker, [&] { return stopping_ || !queue_.empty(); });
+
+		/* Write the pending requests before stopping. */
+		if (queue_.empty())
+			break;
+
+		Request *request = queue_.front();
+
+		locker.unlock();
+
+		for (auto [stream, buffer] : request->buffers())
+			writeBuffer(stream, buffer, request->metadata());
+
+		/* Release the request from the event loop thread. */
+		EventLoop::instance()->callLater([this, request]() {
+			requestProcessed.emit(request);
+		});
 
-	return true;
+		locker.lock();
+
+		queue_.pop();
+		written_++;
+	}
 }
 
 void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
@@ -108,6 +261,11 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 	size_t pos;
 	int fd, ret = 0;
 
+	if (fileType_ == FileType::Container) {
+		writeContainer(stream, buffer, metadata);
+		return;
+	}
+
 	pos = filename.find_first_of('#');
 	if (pos != std::string::npos) {
 		std::stringstream ss;
@@ -117,12 +275,14 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 	}
 
 	Image *image = mappedBuffers_[buffer].get();
+	Image::CpuAccess access(image);
 
 #ifdef HAVE_TIFF
 	if (fileType_ == FileType::Dng) {
 		ret = DNGWriter::write(filename.c_str(), camera_,
 				       stream->configuration(), metadata,
-				       buffer, image->data(0).data());
+				       buffer, image->data(0).data(),
+				       dngThumbnail_);
 		if (ret < 0)
 			std::cerr << "failed to write DNG file `" << filename
 				  << "'" << std::endl;
@@ -140,9 +300,16 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 		return;
 	}
 
-	fd = open(filename.c_str(), O_CREAT | O_WRONLY |
-		  (pos == std::string::npos ? O_APPEND : O_TRUNC),
-		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+	int flags = O_CREAT | O_WRONLY |
+		    (pos == std::string::npos ? O_APPEND : O_TRUNC);
+	mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+
+	/* Not all file systems support O_DIRECT, fall back to buffered I/O. */
+	fd = -1;
+	if (directIO_)
+		fd = open(filename.c_str(), flags | O_DIRECT, mode);
+	if (fd == -1)
+		fd = open(filename.c_str(), flags, mode);
 	if (fd == -1) {
 		ret = -errno;
 		std::cerr << "failed to open file " << filename << ": "
@@ -150,6 +317,11 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 		return;
 	}
 
+	/* Appended writes start at the end of the file. */
+	off_t offset = lseek(fd, 0, SEEK_END);
+	if (offset < 0)
+		offset = 0;
+
 	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
 		/*
 		 * This was formerly a local "const FrameMetadata::Plane &"
@@ -166,9 +338,8 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 				  << " larger than plane size " << data.size()
 				  << std::endl;
 
-		ret = ::write(fd, data.data(), length);
+		ret = writeData(fd, data.data(), length, &offset);
 		if (ret < 0) {
-			ret = -errno;
 			std::cerr << "write error: " << strerror(-ret)
 				  << std::endl;
 			break;
@@ -182,3 +353,234 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 
 	close(fd);
 }
+
+/*
+ * Write data at the current offset of the file. When the file has been opened
+ * with O_DIRECT, the largest aligned part of the data is written directly, and
+ * the remainder through the page cache, as O_DIRECT requires the memory, the
+ * length and the file offset to be aligned. The offset is updated with the
+ * number of bytes written.
+ */
+int FileSink::writeData(int fd, const uint8_t *data, size_t length,
+			off_t *offset)
+{
+	int flags = fcntl(fd, F_GETFL);
+	bool restore = false;
+	size_t direct = 0;
+
+	if (flags & O_DIRECT &&
+	    !(reinterpret_cast<uintptr_t>(data) % kDirectIOAlignment) &&
+	    !(*offset % kDirectIOAlignment))
+		direct = length - length % kDirectIOAlignment;
+
+	size_t written = 0;
+	int err = 0;
+
+	while (written < length) {
+		size_t size = written < direct ? direct - written : length - written;
+
+		/* Switch to buffered I/O for the unaligned remainder. */
+		if (written == direct && flags & O_DIRECT) {
+			fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+			restore = true;
+		}
+
+		ssize_t ret = ::write(fd, data + written, size);
+		if (ret < 0) {
+			err = -errno;
+			break;
+		}
+		if (ret == 0)
+			break;
+
+		written += ret;
+		*offset += ret;
+	}
+
+	if (restore)
+		fcntl(fd, F_SETFL, flags);
+
+	return err ? err : written;
+}
+
+int FileSink::openContainers()
+{
+	for (const auto &[stream, name] : streamNames_) {
+		std::string filename = pattern_;
+		size_t pos = filename.find_first_of('#');
+		if (pos != std::string::npos)
+			filename.replace(pos, 1, name);
+
+		int fd = open(filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+			      S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd == -1) {
+			int ret = -errno;
+			std::cerr << "failed to open file " << filename << ": "
+				  << strerror(-ret) << std::endl;
+			closeContainers();
+			return ret;
+		}
+
+		Container &container = containers_[stream];
+		container = { stream, fd, static_cast<off_t>(kDirectIOAlignment),
+			      0, 0, 0, {} };
+
+		int ret = writeContainerHeader(container, 0);
+		if (ret < 0) {
+			std::cerr << "failed to write header to " << filename
+				  << ": " << strerror(-ret) << std::endl;
+			closeContainers();
+			return ret;
+		}
+
+		/* The header is written, the frames are aligned. */
+		if (directIO_ &&
+		    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) < 0)
+			std::cerr << "O_DIRECT not supported for " << filename
+				  << ", using buffered I/O" << std::endl;
+	}
+
+	return 0;
+}
+
+void FileSink::closeContainers()
+{
+	for (auto &[stream, container] : containers_) {
+		int fd = container.fd;
+
+		/* The index and header are not aligned. */
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+
+		off_t indexOffset = container.offset;
+		ssize_t ret = pwrite(fd, container.index.data(),
+				     container.index.size(), indexOffset);
+		if (ret != static_cast<ssize_t>(container.index.size())) {
+			std::cerr << "failed to write the container index" << std::endl;
+			close(fd);
+			continue;
+		}
+
+		/* Release the preallocated space past the index. */
+		if (ftruncate(fd, indexOffset + container.index.size()) < 0)
+			std::cerr << "failed to truncate the container" << std::endl;
+
+		writeContainerHeader(container, indexOffset);
+
+		close(fd);
+	}
+
+	containers_.clear();
+}
+
+int FileSink::writeContainerHeader(const Container &container,
+				   off_t indexOffset)
+{
+	const StreamConfiguration &cfg = container.stream->configuration();
+	ContainerHeader header = {};
+
+	memcpy(header.magic, kContainerMagic, sizeof(header.magic));
+	header.version = kContainerVersion;
+	header.headerSize = sizeof(header);
+	header.alignment = kDirectIOAlignment;
+	header.fourcc = cfg.pixelFormat.fourcc();
+	header.modifier = cfg.pixelFormat.modifier();
+	header.width = cfg.size.width;
+	header.height = cfg.size.height;
+	header.stride = cfg.stride;
+	header.numPlanes = container.numPlanes;
+	header.frameCount = container.frames;
+	header.indexOffset = indexOffset;
+
+	ssize_t ret = pwrite(container.fd, &header, sizeof(header), 0);
+	if (ret < 0)
+		return -errno;
+
+	return ret == sizeof(header) ? 0 : -EIO;
+}
+
+void FileSink::writeContainer(const Stream *stream, FrameBuffer *buffer,
+			      const ControlList &metadata)
+{
+	Container &container = containers_.at(stream);
+	const FrameMetadata &frameMetadata = buffer->metadata();
+
+	Image *image = mappedBuffers_[buffer].get();
+	Image::CpuAccess access(image);
+
+	std::vector<uint32_t> lengths;
+	off_t size = 0;
+
+	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
+		const unsigned int bytesused = frameMetadata.planes()[i].bytesused;
+		const unsigned int length =
+			std::min<unsigned int>(bytesused, image->data(i).size());
+
+		lengths.push_back(length);
+		size += length;
+	}
+
+	size = alignUp(size);
+
+	/*
+	 * Grow the file ahead of the writes, to keep it contiguous on disk and
+	 * avoid allocating blocks for every frame.
+	 */
+	if (container.allocated >= 0 &&
+	    container.offset + size > container.allocated) {
+		off_t length = size * kPreallocFrames;
+
+		if (fallocate(container.fd, FALLOC_FL_KEEP_SIZE,
+			      container.offset, length) < 0)
+			container.allocated = -1;
+		else
+			container.allocated = container.offset + length;
+	}
+
+	off_t frameOffset = container.offset;
+	off_t offset = frameOffset;
+
+	if (lseek(container.fd, frameOffset, SEEK_SET) < 0) {
+		std::cerr << "seek error: " << strerror(errno) << std::endl;
+		return;
+	}
+
+	for (unsigned int i = 0; i < lengths.size(); ++i) {
+		int ret = writeData(container.fd, image->data(i).data(),
+				    lengths[i], &offset);
+		if (ret != static_cast<int>(lengths[i])) {
+			std::cerr << "write error: "
+				  << (ret < 0 ? strerror(-ret) : "short write")
+				  << std::endl;
+			return;
+		}
+	}
+
+	container.offset = frameOffset + size;
+	container.numPlanes = lengths.size();
+	container.frames++;
+
+	std::stringstream ss;
+	for (const auto &[key, value] : metadata) {
+		const ControlId *id = controls::controls.at(key);
+		ss << id->name() << " = " << value.toString() << "\n";
+	}
+	const std::string text = ss.str();
+
+	std::vector<uint8_t> &index = container.index;
+	auto append = [&index](const auto &value) {
+		const uint8_t *data = reinterpret_cast<const uint8_t *>(&value);
+		index.insert(index.end(), data, data + sizeof(value));
+	};
+
+	append(static_cast<uint64_t>(frameOffset));
+	append(static_cast<uint64_t>(frameMetadata.timestamp));
+	append(static_cast<uint32_t>(frameMetadata.sequence));
+	append(static_cast<uint32_t>(frameMetadata.status));
+	append(static_cast<uint32_t>(lengths.size()));
+	append(static_cast<uint32_t>(text.size()));
+	for (uint32_t length : lengths)
+		append(length);
+
+	index.insert(index.end(), text.begin(), text.end());
+	index.resize((index.size() + 7) / 8 * 8, 0);
+}
@@ -7,9 +7,16 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
 
 #include <libcamera/stream.h>
 
@@ -25,11 +32,16 @@ public:
 	~FileSink();
 
 	int setFilePattern(const std::string &pattern);
+	void setDirectIO(bool enable) { directIO_ = enable; }
+	void setDngThumbnail(bool enable) { dngThumbnail_ = enable; }
 
 	int configure(const libcamera::CameraConfiguration &config) override;
 
 	void mapBuffer(libcamera::FrameBuffer *buffer) override;
 
+	int start() override;
+	int stop() override;
+
 	bool processRequest(libcamera::Request *request) override;
 
 private:
@@ -37,13 +49,34 @@ private:
 
 	enum class FileType {
 		Binary,
+		Container,
 		Dng,
 		Ppm,
 	};
 
+	void writerThread();
 	void writeBuffer(const libcamera::Stream *stream,
 			 libcamera::FrameBuffer *buffer,
 			 const libcamera::ControlList &metadata);
+	int writeData(int fd, const uint8_t *data, size_t length, off_t *offset);
+
+	/* A container file, holding all the frames of a stream */
+	struct Container {
+		const libcamera::Stream *stream;
+		int fd;
+		off_t offset;
+		off_t allocated;
+		unsigned int numPlanes;
+		uint64_t frames;
+		std::vector<uint8_t> index;
+	};
+
+	int openContainers();
+	void closeContainers();
+	int writeContainerHeader(const Container &container, off_t indexOffset);
+	void writeContainer(const libcamera::Stream *stream,
+			    libcamera::FrameBuffer *buffer,
+			    const libcamera::ControlList &metadata);
 
 #ifdef HAVE_TIFF
 	const libcamera::Camera *camera_;
@@ -54,4 +87,24 @@ private:
 
 	std::map<const libcamera::Stream *, std::string> streamNames_;
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<Image>> mappedBuffers_;
+	std::map<const libcamera::Stream *, Container> containers_;
+
+	bool directIO_;
+	bool dngThumbnail_;
+
+	/*
+	 * The requests are written by a separate thread, to avoid stalling the
+	 * event loop on storage. The request being written stays at the front
+	 * of the queue until it is released.
+	 */
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::queue<libcamera::Request *> queue_;
+	bool stopping_;
+
+	unsigned int queueLimit_;
+	unsigned int maxQueueDepth_;
+	unsigned int written_;
+	unsigned int dropped_;
 };
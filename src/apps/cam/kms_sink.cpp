@@ -23,8 +23,32 @@
 
 #include "drm.h"
 
-KMSSink::KMSSink(const std::string &connectorName)
-	: connector_(nullptr), crtc_(nullptr), plane_(nullptr), mode_(nullptr)
+namespace {
+
+/*
+ * If the requested format has an alpha channel, also consider the X variant.
+ */
+libcamera::PixelFormat opaqueFormat(const libcamera::PixelFormat &format)
+{
+	switch (format) {
+	case libcamera::formats::ABGR8888:
+		return libcamera::formats::XBGR8888;
+	case libcamera::formats::ARGB8888:
+		return libcamera::formats::XRGB8888;
+	case libcamera::formats::BGRA8888:
+		return libcamera::formats::BGRX8888;
+	case libcamera::formats::RGBA8888:
+		return libcamera::formats::RGBX8888;
+	default:
+		return {};
+	}
+}
+
+} /* namespace */
+
+KMSSink::KMSSink(const std::string &connectorName, unsigned int commitDepth)
+	: connector_(nullptr), crtc_(nullptr), mode_(nullptr),
+	  commitDepth_(commitDepth)
 {
 	int ret = dev_.init();
 	if (ret < 0)
@@ -66,14 +90,19 @@ KMSSink::KMSSink(const std::string &connectorName)
 	dev_.requestComplete.connect(this, &KMSSink::requestComplete);
 }
 
-void KMSSink::mapBuffer(libcamera::FrameBuffer *buffer)
+DRM::FrameBuffer *KMSSink::importBuffer(const Layer &layer,
+					libcamera::FrameBuffer *buffer)
 {
+	auto iter = buffers_.find(buffer);
+	if (iter != buffers_.end())
+		return iter->second.get();
+
 	std::array<uint32_t, 4> strides = {};
 
 	/* \todo Should libcamera report per-plane strides ? */
 	unsigned int uvStrideMultiplier;
 
-	switch (format_) {
+	switch (layer.format) {
 	case libcamera::formats::NV24:
 	case libcamera::formats::NV42:
 		uvStrideMultiplier = 4;
@@ -88,18 +117,20 @@ void KMSSink::mapBuffer(libcamera::FrameBuffer *buffer)
 		break;
 	}
 
-	strides[0] = stride_;
+	strides[0] = layer.stride;
 	for (unsigned int i = 1; i < buffer->planes().size(); ++i)
-		strides[i] = stride_ * uvStrideMultiplier / 2;
+		strides[i] = layer.stride * uvStrideMultiplier / 2;
 
 	std::unique_ptr<DRM::FrameBuffer> drmBuffer =
-		dev_.createFrameBuffer(*buffer, format_, size_, strides);
+		dev_.createFrameBuffer(*buffer, layer.format, layer.size, strides);
 	if (!drmBuffer)
-		return;
+		return nullptr;
 
-	buffers_.emplace(std::piecewise_construct,
-			 std::forward_as_tuple(buffer),
-			 std::forward_as_tuple(std::move(drmBuffer)));
+	iter = buffers_.emplace(std::piecewise_construct,
+				std::forward_as_tuple(buffer),
+				std::forward_as_tuple(std::move(drmBuffer))).first;
+
+	return iter->second.get();
 }
 
 int KMSSink::configure(const libcamera::CameraConfiguration &config)
@@ -108,15 +139,22 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 		return -EINVAL;
 
 	crtc_ = nullptr;
-	plane_ = nullptr;
 	mode_ = nullptr;
+	layers_.clear();
 
-	const libcamera::StreamConfiguration &cfg = config.at(0);
+	/*
+	 * Find the best mode for the streams, laid out side by side on the
+	 * display.
+	 */
+	libcamera::Size layoutSize;
+	for (const libcamera::StreamConfiguration &cfg : config) {
+		layoutSize.width += cfg.size.width;
+		layoutSize.height = std::max(layoutSize.height, cfg.size.height);
+	}
 
-	/* Find the best mode for the stream size. */
 	const std::vector<DRM::Mode> &modes = connector_->modes();
 
-	unsigned int cfgArea = cfg.size.width * cfg.size.height;
+	unsigned int cfgArea = layoutSize.width * layoutSize.height;
 	unsigned int bestDistance = UINT_MAX;
 
 	for (const DRM::Mode &mode : modes) {
@@ -142,19 +180,34 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 		return -EINVAL;
 	}
 
-	int ret = configurePipeline(cfg.pixelFormat);
+	int ret = configurePipeline(config);
 	if (ret < 0)
 		return ret;
 
-	size_ = cfg.size;
-	stride_ = cfg.stride;
+	for (Layer &layer : layers_) {
+		for (const libcamera::StreamConfiguration &cfg : config) {
+			if (cfg.stream() != layer.stream)
+				continue;
+
+			layer.size = cfg.size;
+			layer.stride = cfg.stride;
+			configureColorSpace(layer, cfg);
+			break;
+		}
+	}
+
+	return 0;
+}
 
-	/* Configure color space. */
-	colorEncoding_ = std::nullopt;
-	colorRange_ = std::nullopt;
+void KMSSink::configureColorSpace(Layer &layer,
+				  const libcamera::StreamConfiguration &cfg)
+{
+	layer.colorEncoding = std::nullopt;
+	layer.colorRange = std::nullopt;
 
-	if (cfg.colorSpace->ycbcrEncoding == libcamera::ColorSpace::YcbcrEncoding::None)
-		return 0;
+	if (!cfg.colorSpace ||
+	    cfg.colorSpace->ycbcrEncoding == libcamera::ColorSpace::YcbcrEncoding::None)
+		return;
 
 	/*
 	 * The encoding and range enums are defined in the kernel but not
@@ -171,8 +224,8 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 		DRM_COLOR_YCBCR_FULL_RANGE,
 	};
 
-	const DRM::Property *colorEncoding = plane_->property("COLOR_ENCODING");
-	const DRM::Property *colorRange = plane_->property("COLOR_RANGE");
+	const DRM::Property *colorEncoding = layer.plane->property("COLOR_ENCODING");
+	const DRM::Property *colorRange = layer.plane->property("COLOR_RANGE");
 
 	if (colorEncoding) {
 		drm_color_encoding encoding;
@@ -192,7 +245,7 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 
 		for (const auto &[id, name] : colorEncoding->enums()) {
 			if (id == encoding) {
-				colorEncoding_ = encoding;
+				layer.colorEncoding = encoding;
 				break;
 			}
 		}
@@ -213,87 +266,104 @@ int KMSSink::configure(const libcamera::CameraConfiguration &config)
 
 		for (const auto &[id, name] : colorRange->enums()) {
 			if (id == range) {
-				colorRange_ = range;
+				layer.colorRange = range;
 				break;
 			}
 		}
 	}
 
-	if (!colorEncoding_ || !colorRange_)
+	if (!layer.colorEncoding || !layer.colorRange)
 		std::cerr << "Color space " << cfg.colorSpace->toString()
 			  << " not supported by the display device."
 			  << " Colors may be wrong." << std::endl;
-
-	return 0;
 }
 
-int KMSSink::selectPipeline(const libcamera::PixelFormat &format)
+int KMSSink::selectPipeline(const libcamera::CameraConfiguration &config)
 {
 	/*
-	 * If the requested format has an alpha channel, also consider the X
-	 * variant.
-	 */
-	libcamera::PixelFormat xFormat;
-
-	switch (format) {
-	case libcamera::formats::ABGR8888:
-		xFormat = libcamera::formats::XBGR8888;
-		break;
-	case libcamera::formats::ARGB8888:
-		xFormat = libcamera::formats::XRGB8888;
-		break;
-	case libcamera::formats::BGRA8888:
-		xFormat = libcamera::formats::BGRX8888;
-		break;
-	case libcamera::formats::RGBA8888:
-		xFormat = libcamera::formats::RGBX8888;
-		break;
-	}
-
-	/*
-	 * Find a CRTC and plane suitable for the request format and the
-	 * connector at the end of the pipeline. Restrict the search to primary
-	 * planes for now.
+	 * Find a CRTC for the connector at the end of the pipeline, and one
+	 * plane per stream on that CRTC. The first stream uses the primary
+	 * plane, the other ones overlay planes. Streams in formats that no
+	 * plane supports, such as raw streams, are not displayed. Pick the
+	 * CRTC that can display the largest number of streams.
 	 */
 	for (const DRM::Encoder *encoder : connector_->encoders()) {
 		for (const DRM::Crtc *crtc : encoder->possibleCrtcs()) {
-			for (const DRM::Plane *plane : crtc->planes()) {
-				if (plane->type() != DRM::Plane::TypePrimary)
-					continue;
-
-				if (plane->supportsFormat(format)) {
-					crtc_ = crtc;
-					plane_ = plane;
-					format_ = format;
-					return 0;
+			std::vector<Layer> layers;
+			std::vector<const DRM::Plane *> used;
+
+			for (const libcamera::StreamConfiguration &cfg : config) {
+				libcamera::PixelFormat xFormat = opaqueFormat(cfg.pixelFormat);
+				DRM::Plane::Type type = layers.empty()
+						      ? DRM::Plane::TypePrimary
+						      : DRM::Plane::TypeOverlay;
+
+				for (const DRM::Plane *plane : crtc->planes()) {
+					if (plane->type() != type)
+						continue;
+
+					if (std::find(used.begin(), used.end(), plane) != used.end())
+						continue;
+
+					libcamera::PixelFormat format;
+					if (plane->supportsFormat(cfg.pixelFormat))
+						format = cfg.pixelFormat;
+					else if (xFormat.isValid() && plane->supportsFormat(xFormat))
+						format = xFormat;
+					else
+						continue;
+
+					Layer layer{};
+					layer.stream = cfg.stream();
+					layer.plane = plane;
+					layer.format = format;
+					layers.push_back(layer);
+					used.push_back(plane);
+					break;
 				}
+			}
 
-				if (plane->supportsFormat(xFormat)) {
-					crtc_ = crtc;
-					plane_ = plane;
-					format_ = xFormat;
-					return 0;
-				}
+			if (layers.size() > layers_.size()) {
+				crtc_ = crtc;
+				layers_ = std::move(layers);
 			}
+
+			if (layers_.size() == config.size())
+				return 0;
 		}
 	}
 
-	return -EPIPE;
+	return layers_.empty() ? -EPIPE : 0;
 }
 
-int KMSSink::configurePipeline(const libcamera::PixelFormat &format)
+int KMSSink::configurePipeline(const libcamera::CameraConfiguration &config)
 {
-	const int ret = selectPipeline(format);
+	const int ret = selectPipeline(config);
 	if (ret) {
 		std::cerr
 			<< "Unable to find display pipeline for format "
-			<< format << std::endl;
+			<< config.at(0).pixelFormat << std::endl;
 
 		return ret;
 	}
 
+	for (const libcamera::StreamConfiguration &cfg : config) {
+		auto layer = std::find_if(layers_.begin(), layers_.end(),
+					  [&cfg](const Layer &l) {
+						  return l.stream == cfg.stream();
+					  });
+		if (layer == layers_.end())
+			std::cerr
+				<< "No KMS plane available for stream "
+				<< cfg.toString() << ", not displaying it"
+				<< std::endl;
+	}
+
+	std::cout << "Using KMS";
+	for (const Layer &layer : layers_)
+		std::cout << " plane " << layer.plane->id() << ",";
 	std::cout
-		<< "Using KMS plane " << plane_->id() << ", CRTC " << crtc_->id()
+		<< " CRTC " << crtc_->id()
 		<< ", connector " << connector_->name()
 		<< " (" << connector_->id() << "), mode " << mode_->hdisplay
 		<< "x" << mode_->vdisplay << "@" << mode_->vrefresh << std::endl;
@@ -337,8 +407,11 @@ int KMSSink::stop()
 	request.addProperty(connector_, "CRTC_ID", 0);
 	request.addProperty(crtc_, "ACTIVE", 0);
 	request.addProperty(crtc_, "MODE_ID", 0);
-	request.addProperty(plane_, "CRTC_ID", 0);
-	request.addProperty(plane_, "FB_ID", 0);
+
+	for (const Layer &layer : layers_) {
+		request.addProperty(layer.plane, "CRTC_ID", 0);
+		request.addProperty(layer.plane, "FB_ID", 0);
+	}
 
 	int ret = request.commit(DRM::AtomicRequest::FlagAllowModeset);
 	if (ret < 0) {
@@ -357,9 +430,30 @@ int KMSSink::stop()
 	return FrameSink::stop();
 }
 
-bool KMSSink::testModeSet(DRM::FrameBuffer *drmBuffer,
-			  const libcamera::Rectangle &src,
-			  const libcamera::Rectangle &dst)
+void KMSSink::addLayer(DRM::AtomicRequest *request, const Layer &layer,
+		       DRM::FrameBuffer *drmBuffer,
+		       const libcamera::Rectangle &src,
+		       const libcamera::Rectangle &dst)
+{
+	request->addProperty(layer.plane, "CRTC_ID", crtc_->id());
+	request->addProperty(layer.plane, "FB_ID", drmBuffer->id());
+	request->addProperty(layer.plane, "SRC_X", src.x << 16);
+	request->addProperty(layer.plane, "SRC_Y", src.y << 16);
+	request->addProperty(layer.plane, "SRC_W", src.width << 16);
+	request->addProperty(layer.plane, "SRC_H", src.height << 16);
+	request->addProperty(layer.plane, "CRTC_X", dst.x);
+	request->addProperty(layer.plane, "CRTC_Y", dst.y);
+	request->addProperty(layer.plane, "CRTC_W", dst.width);
+	request->addProperty(layer.plane, "CRTC_H", dst.height);
+
+	if (layer.colorEncoding)
+		request->addProperty(layer.plane, "COLOR_ENCODING", *layer.colorEncoding);
+	if (layer.colorRange)
+		request->addProperty(layer.plane, "COLOR_RANGE", *layer.colorRange);
+}
+
+bool KMSSink::testModeSet(const std::vector<DRM::FrameBuffer *> &drmBuffers,
+			  const std::vector<Composition> &compositions)
 {
 	DRM::AtomicRequest drmRequest{ &dev_ };
 
@@ -368,79 +462,96 @@ bool KMSSink::testModeSet(DRM::FrameBuffer *drmBuffer,
 	drmRequest.addProperty(crtc_, "ACTIVE", 1);
 	drmRequest.addProperty(crtc_, "MODE_ID", mode_->toBlob(&dev_));
 
-	drmRequest.addProperty(plane_, "CRTC_ID", crtc_->id());
-	drmRequest.addProperty(plane_, "FB_ID", drmBuffer->id());
-	drmRequest.addProperty(plane_, "SRC_X", src.x << 16);
-	drmRequest.addProperty(plane_, "SRC_Y", src.y << 16);
-	drmRequest.addProperty(plane_, "SRC_W", src.width << 16);
-	drmRequest.addProperty(plane_, "SRC_H", src.height << 16);
-	drmRequest.addProperty(plane_, "CRTC_X", dst.x);
-	drmRequest.addProperty(plane_, "CRTC_Y", dst.y);
-	drmRequest.addProperty(plane_, "CRTC_W", dst.width);
-	drmRequest.addProperty(plane_, "CRTC_H", dst.height);
+	for (unsigned int i = 0; i < layers_.size(); ++i)
+		addLayer(&drmRequest, layers_[i], drmBuffers[i],
+			 compositions[i].src, compositions[i].dst);
 
 	return !drmRequest.commit(DRM::AtomicRequest::FlagAllowModeset |
 				  DRM::AtomicRequest::FlagTestOnly);
 }
 
-bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
+bool KMSSink::setupComposition(const std::vector<DRM::FrameBuffer *> &drmBuffers)
 {
 	/*
-	 * Test composition options, from most to least desirable, to select the
-	 * best one.
+	 * Split the display in one column per layer, and test composition
+	 * options, from most to least desirable, to select the best one. The
+	 * same option is used for all layers.
 	 */
-	const libcamera::Rectangle framebuffer{ size_ };
-	const libcamera::Rectangle display{ 0, 0, mode_->hdisplay, mode_->vdisplay };
-
-	/* 1. Scale the frame buffer to full screen, preserving aspect ratio. */
-	libcamera::Rectangle src = framebuffer;
-	libcamera::Rectangle dst = display.size().boundedToAspectRatio(framebuffer.size())
-						 .centeredTo(display.center());
-
-	if (testModeSet(drmBuffer, src, dst)) {
-		std::cout << "KMS: full-screen scaled output, square pixels"
-			  << std::endl;
-		src_ = src;
-		dst_ = dst;
+	const unsigned int columns = layers_.size();
+	const unsigned int columnWidth = mode_->hdisplay / columns;
+
+	std::vector<libcamera::Rectangle> cells;
+	for (unsigned int i = 0; i < columns; ++i)
+		cells.emplace_back(i * columnWidth, 0, columnWidth, mode_->vdisplay);
+
+	std::vector<Composition> compositions(columns);
+
+	auto test = [&](const char *description, auto &&compose) {
+		for (unsigned int i = 0; i < columns; ++i) {
+			const libcamera::Rectangle framebuffer{ layers_[i].size };
+			compositions[i] = compose(framebuffer, cells[i]);
+		}
+
+		if (!testModeSet(drmBuffers, compositions))
+			return false;
+
+		std::cout << "KMS: " << description << std::endl;
+
+		for (unsigned int i = 0; i < columns; ++i) {
+			layers_[i].src = compositions[i].src;
+			layers_[i].dst = compositions[i].dst;
+		}
+
+		return true;
+	};
+
+	/* 1. Scale the frame buffers to the cells, preserving aspect ratio. */
+	if (test("full-screen scaled output, square pixels",
+		 [](const libcamera::Rectangle &framebuffer,
+		    const libcamera::Rectangle &cell) {
+			 return Composition{
+				 framebuffer,
+				 cell.size().boundedToAspectRatio(framebuffer.size())
+					 .centeredTo(cell.center())
+			 };
+		 }))
 		return true;
-	}
 
 	/*
-	 * 2. Scale the frame buffer to full screen, without preserving aspect
+	 * 2. Scale the frame buffers to the cells, without preserving aspect
 	 *    ratio.
 	 */
-	src = framebuffer;
-	dst = display;
-
-	if (testModeSet(drmBuffer, src, dst)) {
-		std::cout << "KMS: full-screen scaled output, non-square pixels"
-			  << std::endl;
-		src_ = src;
-		dst_ = dst;
+	if (test("full-screen scaled output, non-square pixels",
+		 [](const libcamera::Rectangle &framebuffer,
+		    const libcamera::Rectangle &cell) {
+			 return Composition{ framebuffer, cell };
+		 }))
 		return true;
-	}
-
-	/* 3. Center the frame buffer on the display. */
-	src = display.size().centeredTo(framebuffer.center()).boundedTo(framebuffer);
-	dst = framebuffer.size().centeredTo(display.center()).boundedTo(display);
 
-	if (testModeSet(drmBuffer, src, dst)) {
-		std::cout << "KMS: centered output" << std::endl;
-		src_ = src;
-		dst_ = dst;
+	/* 3. Center the frame buffers in the cells. */
+	if (test("centered output",
+		 [](const libcamera::Rectangle &framebuffer,
+		    const libcamera::Rectangle &cell) {
+			 return Composition{
+				 cell.size().centeredTo(framebuffer.center())
+					 .boundedTo(framebuffer),
+				 framebuffer.size().centeredTo(cell.center())
+					 .boundedTo(cell)
+			 };
+		 }))
 		return true;
-	}
 
-	/* 4. Align the frame buffer on the top-left of the display. */
-	src = framebuffer.boundedTo(display);
-	dst = display.boundedTo(framebuffer);
-
-	if (testModeSet(drmBuffer, src, dst)) {
-		std::cout << "KMS: top-left aligned output" << std::endl;
-		src_ = src;
-		dst_ = dst;
+	/* 4. Align the frame buffers on the top-left of the cells. */
+	if (test("top-left aligned output",
+		 [](const libcamera::Rectangle &framebuffer,
+		    const libcamera::Rectangle &cell) {
+			 libcamera::Rectangle src =
+				 framebuffer.boundedTo(libcamera::Rectangle{ cell.size() });
+			 return Composition{
+				 src, libcamera::Rectangle{ cell.x, cell.y, src.size() }
+			 };
+		 }))
 		return true;
-	}
 
 	return false;
 }
@@ -448,89 +559,123 @@ bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
 bool KMSSink::processRequest(libcamera::Request *camRequest)
 {
 	/*
-	 * Perform a very crude rate adaptation by simply dropping the request
-	 * if the display queue is full.
+	 * Import the buffers the first time they are displayed. The stream
+	 * they belong to, and thus the plane format, is only known here.
 	 */
-	if (pending_)
-		return true;
+	std::vector<DRM::FrameBuffer *> drmBuffers;
 
-	libcamera::FrameBuffer *buffer = camRequest->buffers().begin()->second;
-	auto iter = buffers_.find(buffer);
-	if (iter == buffers_.end())
-		return true;
+	for (const Layer &layer : layers_) {
+		libcamera::FrameBuffer *buffer = camRequest->findBuffer(layer.stream);
+		if (!buffer)
+			return true;
 
-	DRM::FrameBuffer *drmBuffer = iter->second.get();
+		DRM::FrameBuffer *drmBuffer = importBuffer(layer, buffer);
+		if (!drmBuffer)
+			return true;
 
-	unsigned int flags = DRM::AtomicRequest::FlagAsync;
-	std::unique_ptr<DRM::AtomicRequest> drmRequest =
-		std::make_unique<DRM::AtomicRequest>(&dev_);
-	drmRequest->addProperty(plane_, "FB_ID", drmBuffer->id());
+		drmBuffers.push_back(drmBuffer);
+	}
 
-	if (!active_ && !queued_) {
-		/* Enable the display pipeline on the first frame. */
-		if (!setupComposition(drmBuffer)) {
-			std::cerr << "Failed to setup composition" << std::endl;
-			return true;
-		}
+	std::unique_ptr<Request> dropped;
 
-		drmRequest->addProperty(connector_, "CRTC_ID", crtc_->id());
+	{
+		std::lock_guard<std::mutex> lock(lock_);
 
-		drmRequest->addProperty(crtc_, "ACTIVE", 1);
-		drmRequest->addProperty(crtc_, "MODE_ID", mode_->toBlob(&dev_));
+		/*
+		 * Perform a very crude rate adaptation by simply dropping the
+		 * request if the display queue is full.
+		 */
+		if (queued_ && commitDepth_ < 2)
+			return true;
 
-		drmRequest->addProperty(plane_, "CRTC_ID", crtc_->id());
-		drmRequest->addProperty(plane_, "SRC_X", src_.x << 16);
-		drmRequest->addProperty(plane_, "SRC_Y", src_.y << 16);
-		drmRequest->addProperty(plane_, "SRC_W", src_.width << 16);
-		drmRequest->addProperty(plane_, "SRC_H", src_.height << 16);
-		drmRequest->addProperty(plane_, "CRTC_X", dst_.x);
-		drmRequest->addProperty(plane_, "CRTC_Y", dst_.y);
-		drmRequest->addProperty(plane_, "CRTC_W", dst_.width);
-		drmRequest->addProperty(plane_, "CRTC_H", dst_.height);
+		unsigned int flags = DRM::AtomicRequest::FlagAsync;
+		std::unique_ptr<DRM::AtomicRequest> drmRequest =
+			std::make_unique<DRM::AtomicRequest>(&dev_);
 
-		if (colorEncoding_)
-			drmRequest->addProperty(plane_, "COLOR_ENCODING", *colorEncoding_);
-		if (colorRange_)
-			drmRequest->addProperty(plane_, "COLOR_RANGE", *colorRange_);
+		if (!active_ && !queued_) {
+			/* Enable the display pipeline on the first frame. */
+			if (!setupComposition(drmBuffers)) {
+				std::cerr << "Failed to setup composition" << std::endl;
+				return true;
+			}
 
-		flags |= DRM::AtomicRequest::FlagAllowModeset;
-	}
+			drmRequest->addProperty(connector_, "CRTC_ID", crtc_->id());
 
-	pending_ = std::make_unique<Request>(std::move(drmRequest), camRequest);
+			drmRequest->addProperty(crtc_, "ACTIVE", 1);
+			drmRequest->addProperty(crtc_, "MODE_ID", mode_->toBlob(&dev_));
 
-	std::lock_guard<std::mutex> lock(lock_);
+			for (unsigned int i = 0; i < layers_.size(); ++i)
+				addLayer(drmRequest.get(), layers_[i], drmBuffers[i],
+					 layers_[i].src, layers_[i].dst);
 
-	if (!queued_) {
-		int ret = pending_->drmRequest_->commit(flags);
-		if (ret < 0) {
-			std::cerr
-				<< "Failed to commit atomic request: "
-				<< strerror(-ret) << std::endl;
-			/* \todo Implement error handling */
+			flags |= DRM::AtomicRequest::FlagAllowModeset;
+		} else {
+			for (unsigned int i = 0; i < layers_.size(); ++i)
+				drmRequest->addProperty(layers_[i].plane, "FB_ID",
+							drmBuffers[i]->id());
 		}
 
-		queued_ = std::move(pending_);
+		std::unique_ptr<Request> request =
+			std::make_unique<Request>(std::move(drmRequest), camRequest);
+
+		if (queued_) {
+			/*
+			 * A commit is already in flight, keep the newest frame
+			 * ready to be committed when it completes, and release
+			 * the older one.
+			 */
+			dropped = std::move(pending_);
+			pending_ = std::move(request);
+		} else {
+			int ret = request->drmRequest_->commit(flags);
+			if (ret < 0) {
+				std::cerr
+					<< "Failed to commit atomic request: "
+					<< strerror(-ret) << std::endl;
+				return true;
+			}
+
+			queued_ = std::move(request);
+		}
 	}
 
+	if (dropped)
+		requestProcessed.emit(dropped->camRequest_);
+
 	return false;
 }
 
 void KMSSink::requestComplete([[maybe_unused]] DRM::AtomicRequest *request)
 {
-	std::lock_guard<std::mutex> lock(lock_);
-
-	assert(queued_ && queued_->drmRequest_.get() == request);
-
-	/* Complete the active request, if any. */
-	if (active_)
-		requestProcessed.emit(active_->camRequest_);
-
-	/* The queued request becomes active. */
-	active_ = std::move(queued_);
-
-	/* Queue the pending request, if any. */
-	if (pending_) {
-		pending_->drmRequest_->commit(DRM::AtomicRequest::FlagAsync);
-		queued_ = std::move(pending_);
+	std::unique_ptr<Request> completed;
+	std::unique_ptr<Request> failed;
+
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+
+		assert(queued_ && queued_->drmRequest_.get() == request);
+
+		/* The queued request becomes active. */
+		completed = std::move(active_);
+		active_ = std::move(queued_);
+
+		/* Queue the pending request, if any. */
+		if (pending_) {
+			int ret = pending_->drmRequest_->commit(DRM::AtomicRequest::FlagAsync);
+			if (ret < 0) {
+				std::cerr
+					<< "Failed to commit atomic request: "
+					<< strerror(-ret) << std::endl;
+				failed = std::move(pending_);
+			} else {
+				queued_ = std::move(pending_);
+			}
+		}
 	}
+
+	/* Complete the previously active request, if any. */
+	if (completed)
+		requestProcessed.emit(completed->camRequest_);
+	if (failed)
+		requestProcessed.emit(failed->camRequest_);
 }
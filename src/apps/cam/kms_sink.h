@@ -8,16 +8,19 @@
 #pragma once
 
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <libcamera/base/signal.h>
 
 #include <libcamera/geometry.h>
 #include <libcamera/pixel_format.h>
+#include <libcamera/stream.h>
 
 #include "drm.h"
 #include "frame_sink.h"
@@ -25,9 +28,7 @@
 class KMSSink : public FrameSink
 {
 public:
-	KMSSink(const std::string &connectorName);
-
-	void mapBuffer(libcamera::FrameBuffer *buffer) override;
+	KMSSink(const std::string &connectorName, unsigned int commitDepth = 2);
 
 	int configure(const libcamera::CameraConfiguration &config) override;
 	int start() override;
@@ -49,12 +50,40 @@ private:
 		libcamera::Request *camRequest_;
 	};
 
-	int selectPipeline(const libcamera::PixelFormat &format);
-	int configurePipeline(const libcamera::PixelFormat &format);
-	bool testModeSet(DRM::FrameBuffer *drmBuffer,
-			 const libcamera::Rectangle &src,
-			 const libcamera::Rectangle &dst);
-	bool setupComposition(DRM::FrameBuffer *drmBuffer);
+	struct Layer {
+		const libcamera::Stream *stream;
+		const DRM::Plane *plane;
+
+		libcamera::PixelFormat format;
+		libcamera::Size size;
+		unsigned int stride;
+		std::optional<unsigned int> colorEncoding;
+		std::optional<unsigned int> colorRange;
+
+		libcamera::Rectangle src;
+		libcamera::Rectangle dst;
+	};
+
+	struct Composition {
+		libcamera::Rectangle src;
+		libcamera::Rectangle dst;
+	};
+
+	int selectPipeline(const libcamera::CameraConfiguration &config);
+	int configurePipeline(const libcamera::CameraConfiguration &config);
+	void configureColorSpace(Layer &layer,
+				 const libcamera::StreamConfiguration &cfg);
+
+	DRM::FrameBuffer *importBuffer(const Layer &layer,
+				       libcamera::FrameBuffer *buffer);
+
+	void addLayer(DRM::AtomicRequest *request, const Layer &layer,
+		      DRM::FrameBuffer *drmBuffer,
+		      const libcamera::Rectangle &src,
+		      const libcamera::Rectangle &dst);
+	bool testModeSet(const std::vector<DRM::FrameBuffer *> &drmBuffers,
+			 const std::vector<Composition> &compositions);
+	bool setupComposition(const std::vector<DRM::FrameBuffer *> &drmBuffers);
 
 	void requestComplete(DRM::AtomicRequest *request);
 
@@ -62,17 +91,16 @@ private:
 
 	const DRM::Connector *connector_;
 	const DRM::Crtc *crtc_;
-	const DRM::Plane *plane_;
 	const DRM::Mode *mode_;
 
-	libcamera::PixelFormat format_;
-	libcamera::Size size_;
-	unsigned int stride_;
-	std::optional<unsigned int> colorEncoding_;
-	std::optional<unsigned int> colorRange_;
+	/*
+	 * Number of frames the display can hold ahead of the one being scanned
+	 * out: 1 allows a single commit in flight, 2 also keeps the next frame
+	 * ready to be committed as soon as the current flip completes.
+	 */
+	unsigned int commitDepth_;
 
-	libcamera::Rectangle src_;
-	libcamera::Rectangle dst_;
+	std::vector<Layer> layers_;
 
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<DRM::FrameBuffer>> buffers_;
 
@@ -143,6 +143,13 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "Display viewfinder through DRM/KMS on specified connector",
 			 "display", ArgumentOptional, "connector", false,
 			 OptCamera);
+	parser.addOption(OptDisplayDepth, OptionInteger,
+			 "Set the number of frames queued for display (1 or 2)\n"
+			 "1 commits a frame only when the display is idle, 2 also keeps\n"
+			 "the next frame ready to be shown on the following vblank.\n"
+			 "Defaults to 2.",
+			 "display-depth", ArgumentRequired, "depth", false,
+			 OptCamera);
 #endif
 	parser.addOption(OptFile, OptionString,
 			 "Write captured frames to disk\n"
@@ -156,9 +163,22 @@ int CamApp::parseOptions(int argc, char *argv[])
 #endif
 			 "If the file name ends with '.ppm', then the frame will be written to\n"
 			 "the output file(s) in PPM format.\n"
+			 "If the file name ends with '.lcap', then the frames of each stream will\n"
+			 "be appended to a single container file, with '#' expanded to the stream\n"
+			 "name only.\n"
 			 "The default file name is 'frame-#.bin'.",
 			 "file", ArgumentOptional, "filename", false,
 			 OptCamera);
+	parser.addOption(OptDirectIO, OptionNone,
+			 "Bypass the page cache when writing frames to disk with --file",
+			 "direct-io", ArgumentNone, nullptr, false,
+			 OptCamera);
+#ifdef HAVE_TIFF
+	parser.addOption(OptNoDngThumbnail, OptionNone,
+			 "Don't generate thumbnails when writing DNG files",
+			 "no-dng-thumbnail", ArgumentNone, nullptr, false,
+			 OptCamera);
+#endif
 #ifdef HAVE_SDL
 	parser.addOption(OptSDL, OptionNone, "Display viewfinder through SDL",
 			 "sdl", ArgumentNone, "", false, OptCamera);
@@ -178,6 +198,13 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "Load a capture session configuration script from a file",
 			 "script", ArgumentRequired, "script", false,
 			 OptCamera);
+	parser.addOption(OptBenchmark, OptionInteger,
+			 "Capture frames without processing them, and report performance\n"
+			 "measurements in JSON format when the capture stops. The capture\n"
+			 "runs for <duration> seconds if specified, or until the limit set by\n"
+			 "--capture is reached or the user interrupts by SIGINT otherwise.",
+			 "benchmark", ArgumentOptional, "duration", false,
+			 OptCamera);
 
 	options_ = parser.parse(argc, argv);
 	if (!options_.valid())
@@ -265,7 +292,8 @@ int CamApp::run()
 
 	/* 4. Start capture. */
 	for (const auto &session : sessions) {
-		if (!session->options().isSet(OptCapture))
+		if (!session->options().isSet(OptCapture) &&
+		    !session->options().isSet(OptBenchmark))
 			continue;
 
 		ret = session->start();
@@ -293,7 +321,8 @@ int CamApp::run()
 
 	/* 6. Stop capture. */
 	for (const auto &session : sessions) {
-		if (!session->options().isSet(OptCapture))
+		if (!session->options().isSet(OptCapture) &&
+		    !session->options().isSet(OptBenchmark))
 			continue;
 
 		session->stop();
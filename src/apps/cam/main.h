@@ -24,4 +24,8 @@ enum {
 	OptStrictFormats = 257,
 	OptMetadata = 258,
 	OptCaptureScript = 259,
+	OptDirectIO = 260,
+	OptNoDngThumbnail = 261,
+	OptBenchmark = 262,
+	OptDisplayDepth = 263,
 };
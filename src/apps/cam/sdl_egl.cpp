@@ -0,0 +1,361 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * SDL rendering of dma-buf frames through EGL
+ */
+
+#include "sdl_egl.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+#include <libcamera/formats.h>
+
+using namespace libcamera;
+
+namespace {
+
+const char *kVertexShader = R"(
+attribute vec2 position;
+varying vec2 texCoord;
+
+void main()
+{
+	texCoord = vec2(position.x + 1.0, 1.0 - position.y) / 2.0;
+	gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+
+/*
+ * The frames are sampled through external textures, which convert YUV to RGB
+ * in the GPU.
+ */
+const char *kFragmentShader = R"(
+#extension GL_OES_EGL_image_external : require
+precision mediump float;
+
+uniform samplerExternalOES frame;
+varying vec2 texCoord;
+
+void main()
+{
+	gl_FragColor = texture2D(frame, texCoord);
+}
+)";
+
+const GLfloat kVertices[] = {
+	-1.0f, -1.0f,
+	1.0f, -1.0f,
+	-1.0f, 1.0f,
+	1.0f, 1.0f,
+};
+
+bool hasExtension(const char *extensions, const char *extension)
+{
+	if (!extensions)
+		return false;
+
+	size_t len = strlen(extension);
+
+	for (const char *pos = extensions; (pos = strstr(pos, extension)); pos += len) {
+		if ((pos == extensions || pos[-1] == ' ') &&
+		    (pos[len] == ' ' || pos[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+GLuint compileShader(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	GLint status;
+
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		char log[1024];
+
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		std::cerr << "Failed to compile shader: " << log << std::endl;
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+} /* namespace */
+
+SDLEGLRenderer::SDLEGLRenderer(const StreamConfiguration &cfg)
+	: format_(cfg.pixelFormat), size_(cfg.size), stride_(cfg.stride),
+	  colorSpace_(cfg.colorSpace), window_(nullptr), context_(nullptr),
+	  display_(EGL_NO_DISPLAY), program_(0), eglCreateImageKHR_(nullptr),
+	  eglDestroyImageKHR_(nullptr), glEGLImageTargetTexture2DOES_(nullptr)
+{
+}
+
+SDLEGLRenderer::~SDLEGLRenderer()
+{
+	if (!context_)
+		return;
+
+	SDL_GL_MakeCurrent(window_, context_);
+
+	for (auto &[buffer, image] : images_) {
+		glDeleteTextures(1, &image.texture);
+		eglDestroyImageKHR_(display_, image.image);
+	}
+
+	if (program_)
+		glDeleteProgram(program_);
+
+	SDL_GL_DeleteContext(context_);
+}
+
+bool SDLEGLRenderer::isSupported(const PixelFormat &format)
+{
+	/* The libcamera formats use the DRM fourccs. */
+	static const std::vector<PixelFormat> formats = {
+		formats::NV12,
+		formats::NV21,
+		formats::YUYV,
+		formats::UYVY,
+		formats::XRGB8888,
+		formats::XBGR8888,
+		formats::ARGB8888,
+		formats::ABGR8888,
+		formats::RGB565,
+	};
+
+	return std::find(formats.begin(), formats.end(), format) != formats.end();
+}
+
+/*
+ * Create an OpenGL ES context for the window, and import all the buffers the
+ * frames will be rendered from. An error is returned if the context isn't
+ * backed by EGL, or if the buffers can't be imported, for the caller to fall
+ * back to uploading the frames.
+ */
+int SDLEGLRenderer::create(SDL_Window *window,
+			   const std::vector<const FrameBuffer *> &buffers)
+{
+	window_ = window;
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+
+	context_ = SDL_GL_CreateContext(window_);
+	if (!context_) {
+		std::cerr << "Failed to create OpenGL ES context: "
+			  << SDL_GetError() << std::endl;
+		return -ENOTSUP;
+	}
+
+	/* The context isn't backed by EGL when SDL uses GLX. */
+	display_ = eglGetCurrentDisplay();
+	if (display_ == EGL_NO_DISPLAY)
+		return -ENOTSUP;
+
+	int ret = initGL();
+	if (ret)
+		return ret;
+
+	for (const FrameBuffer *buffer : buffers) {
+		ret = import(buffer);
+		if (ret)
+			return ret;
+	}
+
+	/* Don't block the event loop until the vertical blanking. */
+	SDL_GL_SetSwapInterval(0);
+
+	return 0;
+}
+
+int SDLEGLRenderer::initGL()
+{
+	const char *extensions = eglQueryString(display_, EGL_EXTENSIONS);
+	if (!hasExtension(extensions, "EGL_EXT_image_dma_buf_import"))
+		return -ENOTSUP;
+
+	const char *glExtensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+	if (!hasExtension(glExtensions, "GL_OES_EGL_image_external"))
+		return -ENOTSUP;
+
+	eglCreateImageKHR_ = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+		eglGetProcAddress("eglCreateImageKHR"));
+	eglDestroyImageKHR_ = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+		eglGetProcAddress("eglDestroyImageKHR"));
+	glEGLImageTargetTexture2DOES_ = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(
+		eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+	if (!eglCreateImageKHR_ || !eglDestroyImageKHR_ || !glEGLImageTargetTexture2DOES_)
+		return -ENOTSUP;
+
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, kVertexShader);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, kFragmentShader);
+	if (!vertexShader || !fragmentShader) {
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return -EINVAL;
+	}
+
+	/* The shaders are deleted along with the program. */
+	program_ = glCreateProgram();
+	glAttachShader(program_, vertexShader);
+	glAttachShader(program_, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	glBindAttribLocation(program_, 0, "position");
+	glLinkProgram(program_);
+
+	GLint status;
+	glGetProgramiv(program_, GL_LINK_STATUS, &status);
+	if (!status) {
+		char log[1024];
+
+		glGetProgramInfoLog(program_, sizeof(log), nullptr, log);
+		std::cerr << "Failed to link program: " << log << std::endl;
+		return -EINVAL;
+	}
+
+	glUseProgram(program_);
+	glUniform1i(glGetUniformLocation(program_, "frame"), 0);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, kVertices);
+	glEnableVertexAttribArray(0);
+
+	return 0;
+}
+
+int SDLEGLRenderer::import(const FrameBuffer *buffer)
+{
+	static const EGLint planeAttribs[][3] = {
+		{ EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT,
+		  EGL_DMA_BUF_PLANE0_PITCH_EXT },
+		{ EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT,
+		  EGL_DMA_BUF_PLANE1_PITCH_EXT },
+		{ EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT,
+		  EGL_DMA_BUF_PLANE2_PITCH_EXT },
+	};
+
+	std::vector<EGLint> attribs = {
+		EGL_WIDTH, static_cast<EGLint>(size_.width),
+		EGL_HEIGHT, static_cast<EGLint>(size_.height),
+		EGL_LINUX_DRM_FOURCC_EXT, static_cast<EGLint>(format_.fourcc()),
+	};
+
+	/*
+	 * The planes other than the first one are chroma planes of
+	 * semi-planar formats, which have the same stride as the luma plane.
+	 */
+	const std::vector<FrameBuffer::Plane> &planes = buffer->planes();
+	if (planes.size() > std::size(planeAttribs))
+		return -EINVAL;
+
+	for (unsigned int i = 0; i < planes.size(); i++) {
+		attribs.insert(attribs.end(), {
+			planeAttribs[i][0], planes[i].fd.get(),
+			planeAttribs[i][1], static_cast<EGLint>(planes[i].offset),
+			planeAttribs[i][2], static_cast<EGLint>(stride_),
+		});
+	}
+
+	/* A single buffer can hold the luma and chroma planes of NV12. */
+	if (planes.size() == 1 && (format_ == formats::NV12 || format_ == formats::NV21)) {
+		attribs.insert(attribs.end(), {
+			planeAttribs[1][0], planes[0].fd.get(),
+			planeAttribs[1][1],
+			static_cast<EGLint>(planes[0].offset + stride_ * size_.height),
+			planeAttribs[1][2], static_cast<EGLint>(stride_),
+		});
+	}
+
+	const bool yuv = format_ == formats::NV12 || format_ == formats::NV21 ||
+			 format_ == formats::YUYV || format_ == formats::UYVY;
+
+	if (yuv && colorSpace_) {
+		EGLint encoding;
+
+		switch (colorSpace_->ycbcrEncoding) {
+		case ColorSpace::YcbcrEncoding::Rec709:
+			encoding = EGL_ITU_REC709_EXT;
+			break;
+		case ColorSpace::YcbcrEncoding::Rec2020:
+			encoding = EGL_ITU_REC2020_EXT;
+			break;
+		case ColorSpace::YcbcrEncoding::Rec601:
+		default:
+			encoding = EGL_ITU_REC601_EXT;
+			break;
+		}
+
+		attribs.insert(attribs.end(), {
+			EGL_YUV_COLOR_SPACE_HINT_EXT, encoding,
+			EGL_SAMPLE_RANGE_HINT_EXT,
+			colorSpace_->range == ColorSpace::Range::Full
+				? EGL_YUV_FULL_RANGE_EXT : EGL_YUV_NARROW_RANGE_EXT,
+		});
+	}
+
+	attribs.push_back(EGL_NONE);
+
+	Image image;
+	image.image = eglCreateImageKHR_(display_, EGL_NO_CONTEXT,
+					 EGL_LINUX_DMA_BUF_EXT, nullptr,
+					 attribs.data());
+	if (image.image == EGL_NO_IMAGE_KHR) {
+		std::cerr << "Failed to import dma-buf as EGL image: 0x"
+			  << std::hex << eglGetError() << std::dec << std::endl;
+		return -EINVAL;
+	}
+
+	glGenTextures(1, &image.texture);
+	glBindTexture(GL_TEXTURE_EXTERNAL_OES, image.texture);
+	glEGLImageTargetTexture2DOES_(GL_TEXTURE_EXTERNAL_OES, image.image);
+	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	images_[buffer] = image;
+
+	return 0;
+}
+
+void SDLEGLRenderer::render(const FrameBuffer *buffer)
+{
+	auto it = images_.find(buffer);
+	if (it == images_.end())
+		return;
+
+	/* Scale the frame to the window, preserving its aspect ratio. */
+	int width, height;
+	SDL_GL_GetDrawableSize(window_, &width, &height);
+
+	float scale = std::min(static_cast<float>(width) / size_.width,
+			       static_cast<float>(height) / size_.height);
+	int w = size_.width * scale;
+	int h = size_.height * scale;
+
+	glViewport(0, 0, width, height);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glViewport((width - w) / 2, (height - h) / 2, w, h);
+
+	glBindTexture(GL_TEXTURE_EXTERNAL_OES, it->second.texture);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	/*
+	 * The buffer is requeued to the camera when this function returns,
+	 * wait for the GPU to be done reading it.
+	 */
+	glFinish();
+
+	SDL_GL_SwapWindow(window_);
+}
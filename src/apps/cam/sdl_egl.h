@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * SDL rendering of dma-buf frames through EGL
+ */
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <libcamera/color_space.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+#include <libcamera/stream.h>
+
+#include <SDL2/SDL.h>
+
+class SDLEGLRenderer
+{
+public:
+	SDLEGLRenderer(const libcamera::StreamConfiguration &cfg);
+	~SDLEGLRenderer();
+
+	static bool isSupported(const libcamera::PixelFormat &format);
+
+	int create(SDL_Window *window,
+		   const std::vector<const libcamera::FrameBuffer *> &buffers);
+	void render(const libcamera::FrameBuffer *buffer);
+
+private:
+	struct Image {
+		EGLImageKHR image;
+		GLuint texture;
+	};
+
+	int initGL();
+	int import(const libcamera::FrameBuffer *buffer);
+
+	const libcamera::PixelFormat format_;
+	const libcamera::Size size_;
+	const unsigned int stride_;
+	const std::optional<libcamera::ColorSpace> colorSpace_;
+
+	SDL_Window *window_;
+	SDL_GLContext context_;
+	EGLDisplay display_;
+	GLuint program_;
+
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_;
+	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES_;
+
+	std::map<const libcamera::FrameBuffer *, Image> images_;
+};
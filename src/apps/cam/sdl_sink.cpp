@@ -27,6 +27,10 @@
 #endif
 #include "sdl_texture_yuv.h"
 
+#ifdef HAVE_EGL
+#include "sdl_egl.h"
+#endif
+
 using namespace libcamera;
 
 using namespace std::chrono_literals;
@@ -62,6 +66,12 @@ int SDLSink::configure(const libcamera::CameraConfiguration &config)
 	rect_.w = cfg.size.width;
 	rect_.h = cfg.size.height;
 
+#ifdef HAVE_EGL
+	/* Import the buffers in the GPU when possible, to avoid copies. */
+	if (SDLEGLRenderer::isSupported(cfg.pixelFormat))
+		egl_ = std::make_unique<SDLEGLRenderer>(cfg);
+#endif
+
 	switch (cfg.pixelFormat) {
 #ifdef HAVE_LIBJPEG
 	case libcamera::formats::MJPEG:
@@ -77,6 +87,10 @@ int SDLSink::configure(const libcamera::CameraConfiguration &config)
 		texture_ = std::make_unique<SDLTextureYUYV>(rect_, cfg.stride);
 		break;
 	default:
+#ifdef HAVE_EGL
+		if (egl_)
+			break;
+#endif
 		std::cerr << "Unsupported pixel format "
 			  << cfg.pixelFormat.toString() << std::endl;
 		return -EINVAL;
@@ -87,6 +101,14 @@ int SDLSink::configure(const libcamera::CameraConfiguration &config)
 
 int SDLSink::start()
 {
+#ifdef HAVE_EGL
+	/* Create OpenGL ES contexts through EGL, to import dma-bufs. */
+	SDL_SetHint(SDL_HINT_OPENGL_ES_DRIVER, "1");
+#ifdef SDL_HINT_VIDEO_X11_FORCE_EGL
+	SDL_SetHint(SDL_HINT_VIDEO_X11_FORCE_EGL, "1");
+#endif
+#endif
+
 	int ret = SDL_Init(SDL_INIT_VIDEO);
 	if (ret) {
 		std::cerr << "Failed to initialize SDL: " << SDL_GetError()
@@ -95,15 +117,36 @@ int SDLSink::start()
 	}
 
 	init_ = true;
-	window_ = SDL_CreateWindow("", SDL_WINDOWPOS_UNDEFINED,
-				   SDL_WINDOWPOS_UNDEFINED, rect_.w,
-				   rect_.h,
-				   SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-	if (!window_) {
-		std::cerr << "Failed to create SDL window: " << SDL_GetError()
+
+#ifdef HAVE_EGL
+	if (egl_) {
+		std::vector<const FrameBuffer *> buffers;
+		for (const auto &[buffer, image] : mappedBuffers_)
+			buffers.push_back(buffer);
+
+		ret = createWindow(SDL_WINDOW_OPENGL);
+		if (!ret)
+			ret = egl_->create(window_, buffers);
+		if (!ret) {
+			EventLoop::instance()->addTimerEvent(
+				10ms, std::bind(&SDLSink::processSDLEvents, this));
+			return 0;
+		}
+
+		std::cerr << "dma-buf import not available, uploading frames"
 			  << std::endl;
-		return -EINVAL;
+
+		egl_.reset();
+		destroyWindow();
+
+		if (!texture_)
+			return -EINVAL;
 	}
+#endif
+
+	ret = createWindow(0);
+	if (ret)
+		return ret;
 
 	renderer_ = SDL_CreateRenderer(window_, -1, 0);
 	if (!renderer_) {
@@ -136,7 +179,37 @@ int SDLSink::start()
 int SDLSink::stop()
 {
 	texture_.reset();
+#ifdef HAVE_EGL
+	egl_.reset();
+#endif
 
+	destroyWindow();
+
+	if (init_) {
+		SDL_Quit();
+		init_ = false;
+	}
+
+	return FrameSink::stop();
+}
+
+int SDLSink::createWindow(uint32_t flags)
+{
+	window_ = SDL_CreateWindow("", SDL_WINDOWPOS_UNDEFINED,
+				   SDL_WINDOWPOS_UNDEFINED, rect_.w,
+				   rect_.h,
+				   SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | flags);
+	if (!window_) {
+		std::cerr << "Failed to create SDL window: " << SDL_GetError()
+			  << std::endl;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+void SDLSink::destroyWindow()
+{
 	if (renderer_) {
 		SDL_DestroyRenderer(renderer_);
 		renderer_ = nullptr;
@@ -146,13 +219,6 @@ int SDLSink::stop()
 		SDL_DestroyWindow(window_);
 		window_ = nullptr;
 	}
-
-	if (init_) {
-		SDL_Quit();
-		init_ = false;
-	}
-
-	return FrameSink::stop();
 }
 
 void SDLSink::mapBuffer(FrameBuffer *buffer)
@@ -189,7 +255,15 @@ void SDLSink::processSDLEvents()
 
 void SDLSink::renderBuffer(FrameBuffer *buffer)
 {
+#ifdef HAVE_EGL
+	if (egl_) {
+		egl_->render(buffer);
+		return;
+	}
+#endif
+
 	Image *image = mappedBuffers_[buffer].get();
+	Image::CpuAccess access(image);
 
 	std::vector<Span<const uint8_t>> planes;
 	unsigned int i = 0;
@@ -17,6 +17,7 @@
 #include "frame_sink.h"
 
 class Image;
+class SDLEGLRenderer;
 class SDLTexture;
 
 class SDLSink : public FrameSink
@@ -33,6 +34,8 @@ public:
 	bool processRequest(libcamera::Request *request) override;
 
 private:
+	int createWindow(uint32_t flags);
+	void destroyWindow();
 	void renderBuffer(libcamera::FrameBuffer *buffer);
 	void processSDLEvents();
 
@@ -40,6 +43,9 @@ private:
 		mappedBuffers_;
 
 	std::unique_ptr<SDLTexture> texture_;
+#ifdef HAVE_EGL
+	std::unique_ptr<SDLEGLRenderer> egl_;
+#endif
 
 	SDL_Window *window_;
 	SDL_Renderer *renderer_;
@@ -8,9 +8,13 @@
 #include "dng_writer.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <endian.h>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <tiffio.h>
@@ -203,14 +207,25 @@ void packScanlineRaw10_CSI2P(void *output, const void *input, unsigned int width
 	const uint8_t *in = static_cast<const uint8_t *>(input);
 	uint8_t *out = static_cast<uint8_t *>(output);
 
-	/* \todo Can this be made more efficient? */
+	/*
+	 * Assemble the four pixels of each group in a 40-bit word, most
+	 * significant pixel first, and store it in big-endian order.
+	 */
 	for (unsigned int x = 0; x < width; x += 4) {
-		*out++ = in[0];
-		*out++ = (in[4] & 0x03) << 6 | in[1] >> 2;
-		*out++ = (in[1] & 0x03) << 6 | (in[4] & 0x0c) << 2 | in[2] >> 4;
-		*out++ = (in[2] & 0x0f) << 4 | (in[4] & 0x30) >> 2 | in[3] >> 6;
-		*out++ = (in[3] & 0x3f) << 2 | (in[4] & 0xc0) >> 6;
+		const uint64_t lsbs = in[4];
+		const uint64_t group = (uint64_t)in[0] << 32 | (uint64_t)in[1] << 22
+				     | (uint64_t)in[2] << 12 | (uint64_t)in[3] << 2
+				     | (lsbs & 0x03) << 30 | (lsbs & 0x0c) << 18
+				     | (lsbs & 0x30) << 6 | (lsbs & 0xc0) >> 6;
+
+		out[0] = group >> 32;
+		out[1] = group >> 24;
+		out[2] = group >> 16;
+		out[3] = group >> 8;
+		out[4] = group;
+
 		in += 5;
+		out += 5;
 	}
 }
 
@@ -346,6 +361,12 @@ void thumbScanlineIPU3([[maybe_unused]] const FormatInfo &info, void *output,
 	}
 }
 
+/* The approximate size of the RAW image strips. */
+constexpr unsigned int kStripSize = 256 * 1024;
+
+/* The maximum number of threads packing the RAW image strips. */
+constexpr unsigned int kMaxPackThreads = 4;
+
 const std::map<PixelFormat, FormatInfo> formatInfo = {
 	{ formats::SBGGR8, {
 		.bitsPerSample = 8,
@@ -517,13 +538,92 @@ const std::map<PixelFormat, FormatInfo> formatInfo = {
 	} },
 };
 
+/*
+ * Pack the RAW image in strips, from multiple threads, and write the strips to
+ * the file in order as soon as they are packed. Writing whole strips also
+ * avoids the overhead of writing one scanline at a time.
+ */
+int writeRawStrips(TIFF *tif, const FormatInfo &info,
+		   const StreamConfiguration &config, const void *data)
+{
+	const unsigned int width = config.size.width;
+	const unsigned int height = config.size.height;
+	const unsigned int lineSize = (width * info.bitsPerSample + 7) / 8;
+	const unsigned int rowsPerStrip =
+		std::clamp(kStripSize / lineSize, 1U, height);
+	const unsigned int numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+
+	std::vector<uint8_t> packed(static_cast<size_t>(lineSize) * height);
+	std::vector<bool> packedStrips(numStrips, false);
+	std::atomic<unsigned int> nextStrip = 0;
+	std::mutex mutex;
+	std::condition_variable cv;
+
+	auto pack = [&]() {
+		const uint8_t *input = static_cast<const uint8_t *>(data);
+
+		while (true) {
+			unsigned int strip = nextStrip++;
+			if (strip >= numStrips)
+				return;
+
+			unsigned int first = strip * rowsPerStrip;
+			unsigned int last = std::min(first + rowsPerStrip, height);
+
+			for (unsigned int y = first; y < last; y++)
+				info.packScanline(packed.data() + static_cast<size_t>(y) * lineSize,
+						  input + static_cast<size_t>(y) * config.stride,
+						  width);
+
+			{
+				std::lock_guard<std::mutex> locker(mutex);
+				packedStrips[strip] = true;
+			}
+
+			cv.notify_all();
+		}
+	};
+
+	unsigned int numThreads =
+		std::clamp(std::thread::hardware_concurrency(), 1U, kMaxPackThreads);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < numThreads; i++)
+		threads.emplace_back(pack);
+
+	int ret = 0;
+
+	for (unsigned int strip = 0; strip < numStrips; strip++) {
+		{
+			std::unique_lock<std::mutex> locker(mutex);
+			cv.wait(locker, [&] { return packedStrips[strip]; });
+		}
+
+		unsigned int rows = std::min(rowsPerStrip, height - strip * rowsPerStrip);
+		size_t offset = static_cast<size_t>(strip) * rowsPerStrip * lineSize;
+
+		if (TIFFWriteEncodedStrip(tif, strip, packed.data() + offset,
+					  static_cast<tmsize_t>(rows) * lineSize) < 0) {
+			std::cerr << "Failed to write RAW strip" << std::endl;
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	return ret;
+}
+
 } /* namespace */
 
 int DNGWriter::write(const char *filename, const Camera *camera,
 		     const StreamConfiguration &config,
 		     const ControlList &metadata,
 		     [[maybe_unused]] const FrameBuffer *buffer,
-		     const void *data)
+		     const void *data, bool thumbnail)
 {
 	const ControlList &cameraProperties = camera->properties();
 
@@ -540,20 +640,14 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 		return -EINVAL;
 	}
 
-	/*
-	 * Scanline buffer, has to be large enough to store both a RAW scanline
-	 * or a thumbnail scanline. The latter will always be much smaller than
-	 * the former as we downscale by 16 in both directions.
-	 */
-	std::vector<uint8_t> scanline((config.size.width * info->bitsPerSample + 7) / 8);
-
 	toff_t rawIFDOffset = 0;
 	toff_t exifIFDOffset = 0;
 
 	/*
 	 * Start with a thumbnail in IFD 0 for compatibility with TIFF baseline
 	 * readers, as required by the TIFF/EP specification. Tags that apply to
-	 * the whole file are stored here.
+	 * the whole file are stored here. When the thumbnail is skipped, the
+	 * RAW image is stored in IFD 0 instead, which DNG readers also accept.
 	 */
 	const uint8_t version[] = { 1, 2, 0, 0 };
 
@@ -571,21 +665,6 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_SOFTWARE, "qcam");
 	TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
 
-	/*
-	 * Thumbnail-specific tags. The thumbnail is stored as an RGB image
-	 * with 1/16 of the raw image resolution. Greyscale would save space,
-	 * but doesn't seem well supported by RawTherapee.
-	 */
-	TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
-	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, config.size.width / 16);
-	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, config.size.height / 16);
-	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
-	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
-	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-	TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
-
 	/*
 	 * Fill in some reasonable colour information in the DNG. We supply
 	 * the "neutral" colour values which determine the white balance, and the
@@ -639,27 +718,46 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	 * for the raw image and EXIF data respectively. The real offsets will
 	 * be set later.
 	 */
-	TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &rawIFDOffset);
+	if (thumbnail)
+		TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &rawIFDOffset);
 	TIFFSetField(tif, TIFFTAG_EXIFIFD, exifIFDOffset);
 
-	/* Write the thumbnail. */
-	const uint8_t *row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height / 16; y++) {
-		info->thumbScanline(*info, scanline.data(), row,
-				    config.size.width / 16, config.stride);
-
-		if (TIFFWriteScanline(tif, scanline.data(), y, 0) != 1) {
-			std::cerr << "Failed to write thumbnail scanline"
-				  << std::endl;
-			TIFFClose(tif);
-			return -EINVAL;
+	if (thumbnail) {
+		/*
+		 * Thumbnail-specific tags. The thumbnail is stored as an RGB
+		 * image with 1/16 of the raw image resolution. Greyscale would
+		 * save space, but doesn't seem well supported by RawTherapee.
+		 */
+		TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+		TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, config.size.width / 16);
+		TIFFSetField(tif, TIFFTAG_IMAGELENGTH, config.size.height / 16);
+		TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+		TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+		TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+		TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+		TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+		TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+
+		/* Write the thumbnail. */
+		std::vector<uint8_t> scanline(config.size.width / 16 * 3);
+		const uint8_t *row = static_cast<const uint8_t *>(data);
+		for (unsigned int y = 0; y < config.size.height / 16; y++) {
+			info->thumbScanline(*info, scanline.data(), row,
+					    config.size.width / 16, config.stride);
+
+			if (TIFFWriteScanline(tif, scanline.data(), y, 0) != 1) {
+				std::cerr << "Failed to write thumbnail scanline"
+					  << std::endl;
+				TIFFClose(tif);
+				return -EINVAL;
+			}
+
+			row += config.stride * 16;
 		}
 
-		row += config.stride * 16;
+		TIFFWriteDirectory(tif);
 	}
 
-	TIFFWriteDirectory(tif);
-
 	/*
 	 * Workaround for a bug introduced in libtiff version 4.5.1 and no fix
 	 * released. In these versions the CFA* tags were missing in the field
@@ -677,7 +775,7 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 		TIFFMergeFieldInfo(tif, infos, 2);
 	}
 
-	/* Create a new IFD for the RAW image. */
+	/* Create a new IFD for the RAW image, or fill IFD 0. */
 	const uint16_t cfaRepeatPatternDim[] = { 2, 2 };
 	const uint8_t cfaPlaneColor[] = {
 		CFAPatternRed,
@@ -746,18 +844,10 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
 
 	/* Write RAW content. */
-	row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height; y++) {
-		info->packScanline(scanline.data(), row, config.size.width);
-
-		if (TIFFWriteScanline(tif, scanline.data(), y, 0) != 1) {
-			std::cerr << "Failed to write RAW scanline"
-				  << std::endl;
-			TIFFClose(tif);
-			return -EINVAL;
-		}
-
-		row += config.stride;
+	int ret = writeRawStrips(tif, *info, config, data);
+	if (ret < 0) {
+		TIFFClose(tif);
+		return ret;
 	}
 
 	/* Checkpoint the IFD to retrieve its offset, and write it out. */
@@ -799,7 +889,8 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 
 	/* Update the IFD offsets and close the file. */
 	TIFFSetDirectory(tif, 0);
-	TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &rawIFDOffset);
+	if (thumbnail)
+		TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &rawIFDOffset);
 	TIFFSetField(tif, TIFFTAG_EXIFIFD, exifIFDOffset);
 	TIFFWriteDirectory(tif);
 
@@ -20,7 +20,8 @@ public:
 	static int write(const char *filename, const libcamera::Camera *camera,
 			 const libcamera::StreamConfiguration &config,
 			 const libcamera::ControlList &metadata,
-			 const libcamera::FrameBuffer *buffer, const void *data);
+			 const libcamera::FrameBuffer *buffer, const void *data,
+			 bool thumbnail = true);
 };
 
 #endif /* HAVE_TIFF */
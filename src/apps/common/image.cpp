@@ -12,9 +12,12 @@
 #include <iostream>
 #include <map>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <linux/dma-buf.h>
+
 using namespace libcamera;
 
 std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode mode)
@@ -25,11 +28,15 @@ std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode
 
 	int mmapFlags = 0;
 
-	if (mode & MapMode::ReadOnly)
+	if (mode & MapMode::ReadOnly) {
 		mmapFlags |= PROT_READ;
+		image->syncFlags_ |= DMA_BUF_SYNC_READ;
+	}
 
-	if (mode & MapMode::WriteOnly)
+	if (mode & MapMode::WriteOnly) {
 		mmapFlags |= PROT_WRITE;
+		image->syncFlags_ |= DMA_BUF_SYNC_WRITE;
+	}
 
 	struct MappedBufferInfo {
 		uint8_t *address = nullptr;
@@ -43,6 +50,7 @@ std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode
 		if (mappedBuffers.find(fd) == mappedBuffers.end()) {
 			const size_t length = lseek(fd, 0, SEEK_END);
 			mappedBuffers[fd] = MappedBufferInfo{ nullptr, 0, length };
+			image->fds_.push_back(fd);
 		}
 
 		const size_t length = mappedBuffers[fd].dmabufLength;
@@ -83,7 +91,10 @@ std::unique_ptr<Image> Image::fromFrameBuffer(const FrameBuffer *buffer, MapMode
 	return image;
 }
 
-Image::Image() = default;
+Image::Image()
+	: syncFlags_(0)
+{
+}
 
 Image::~Image()
 {
@@ -107,3 +118,38 @@ Span<const uint8_t> Image::data(unsigned int plane) const
 	assert(plane <= planes_.size());
 	return planes_[plane];
 }
+
+/*
+ * Cached buffers must be synchronized between the CPU and the devices. The
+ * CpuAccess class makes device writes visible to the CPU for the image memory
+ * for its lifetime, and CPU writes visible to devices when it is destroyed.
+ */
+Image::CpuAccess::CpuAccess(const Image *image)
+	: image_(image)
+{
+	sync(DMA_BUF_SYNC_START);
+}
+
+Image::CpuAccess::~CpuAccess()
+{
+	sync(DMA_BUF_SYNC_END);
+}
+
+void Image::CpuAccess::sync(uint64_t flags)
+{
+	struct dma_buf_sync sync = {
+		.flags = image_->syncFlags_ | flags
+	};
+
+	for (int fd : image_->fds_) {
+		int ret;
+
+		do {
+			ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+		} while (ret && errno == EINTR);
+
+		if (ret)
+			std::cerr << "Failed to sync dma-buf " << fd << ": "
+				  << strerror(errno) << std::endl;
+	}
+}
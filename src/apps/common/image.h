@@ -26,6 +26,20 @@ public:
 		ReadWrite = ReadOnly | WriteOnly,
 	};
 
+	class CpuAccess
+	{
+	public:
+		CpuAccess(const Image *image);
+		~CpuAccess();
+
+	private:
+		LIBCAMERA_DISABLE_COPY_AND_MOVE(CpuAccess)
+
+		void sync(uint64_t flags);
+
+		const Image *image_;
+	};
+
 	static std::unique_ptr<Image> fromFrameBuffer(const libcamera::FrameBuffer *buffer,
 						      MapMode mode);
 
@@ -43,6 +57,8 @@ private:
 
 	std::vector<libcamera::Span<uint8_t>> maps_;
 	std::vector<libcamera::Span<uint8_t>> planes_;
+	std::vector<int> fds_;
+	uint64_t syncFlags_;
 };
 
 namespace libcamera {
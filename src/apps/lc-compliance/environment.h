@@ -7,21 +7,43 @@
 
 #pragma once
 
+#include <chrono>
+
 #include <libcamera/libcamera.h>
 
+/*
+ * Thresholds of the performance tests. The defaults are meant to be loose
+ * enough for any platform, and can be tightened on the command line.
+ */
+struct PerformanceLimits {
+	/* Frame duration to request, 0 selects the camera minimum */
+	std::chrono::microseconds frameDuration{ 0 };
+	/* Minimum ratio of the achieved to the requested frame rate */
+	double minFrameRateRatio = 0.95;
+	/* Maximum ratio of dropped frames during the soak test */
+	double maxDropRate = 0.001;
+	std::chrono::seconds soakDuration{ 120 };
+	std::chrono::milliseconds maxStartLatency{ 1000 };
+	std::chrono::milliseconds maxStopLatency{ 1000 };
+	std::chrono::milliseconds maxFirstFrameLatency{ 1000 };
+};
+
 class Environment
 {
 public:
 	static Environment *get();
 
 	void setup(libcamera::CameraManager *cm, std::string cameraId);
+	void setPerformanceLimits(const PerformanceLimits &limits);
 
 	const std::string &cameraId() const { return cameraId_; }
 	libcamera::CameraManager *cm() const { return cm_; }
+	const PerformanceLimits &performanceLimits() const { return limits_; }
 
 private:
 	Environment() = default;
 
 	std::string cameraId_;
 	libcamera::CameraManager *cm_;
+	PerformanceLimits limits_;
 };
@@ -42,17 +42,23 @@ void Capture::configure(StreamRole role)
 	}
 }
 
-void Capture::start()
+void Capture::allocate()
 {
 	Stream *stream = config_->at(0).stream();
 	int count = allocator_->allocate(stream);
 
 	ASSERT_GE(count, 0) << "Failed to allocate buffers";
 	EXPECT_EQ(count, config_->at(0).bufferCount) << "Allocated less buffers than expected";
+}
+
+void Capture::start(const ControlList *controls)
+{
+	if (!allocator_->allocated())
+		allocate();
 
 	camera_->requestCompleted.connect(this, &Capture::requestComplete);
 
-	ASSERT_EQ(camera_->start(), 0) << "Failed to start camera";
+	ASSERT_EQ(camera_->start(controls), 0) << "Failed to start camera";
 }
 
 void Capture::stop()
@@ -141,6 +147,100 @@ void CaptureBalanced::requestComplete(Request *request)
 		loop_->exit(-EINVAL);
 }
 
+/* CapturePerformance */
+
+CapturePerformance::CapturePerformance(std::shared_ptr<Camera> camera)
+	: Capture(camera), running_(false), stats_{}
+{
+}
+
+/*
+ * Capture continuously for the given duration, and measure the frame rate,
+ * the dropped frames and the latencies of the camera start and stop.
+ */
+void CapturePerformance::capture(clock::duration duration,
+				 const ControlList &controls)
+{
+	/* Allocate the buffers first to exclude them from the start latency. */
+	allocate();
+
+	Stream *stream = config_->at(0).stream();
+	const std::vector<std::unique_ptr<FrameBuffer>> &buffers = allocator_->buffers(stream);
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		std::unique_ptr<Request> request = camera_->createRequest();
+		ASSERT_TRUE(request) << "Can't create request";
+
+		ASSERT_EQ(request->addBuffer(stream, buffer.get()), 0) << "Can't set buffer for request";
+
+		requests_.push_back(std::move(request));
+	}
+
+	stats_ = {};
+	lastSequence_ = 0;
+	firstTimestamp_ = 0;
+	lastTimestamp_ = 0;
+	running_ = true;
+
+	loop_ = new EventLoop();
+	loop_->addTimerEvent(std::chrono::duration_cast<std::chrono::microseconds>(duration),
+			     [this]() {
+				     running_ = false;
+				     loop_->exit(0);
+			     });
+
+	startTime_ = clock::now();
+	start(&controls);
+	stats_.startLatency = clock::now() - startTime_;
+
+	for (const std::unique_ptr<Request> &request : requests_)
+		ASSERT_EQ(camera_->queueRequest(request.get()), 0) << "Failed to queue request";
+
+	/* Run capture session. */
+	int status = loop_->exec();
+
+	clock::time_point stopTime = clock::now();
+	stop();
+	stats_.stopLatency = clock::now() - stopTime;
+
+	delete loop_;
+
+	ASSERT_EQ(status, 0) << "Failed to requeue request";
+
+	if (stats_.frames > 1 && lastTimestamp_ > firstTimestamp_)
+		stats_.frameRate = (stats_.frames - 1) * 1e9 /
+				   (lastTimestamp_ - firstTimestamp_);
+}
+
+void CapturePerformance::requestComplete(Request *request)
+{
+	if (request->status() == Request::Status::RequestCancelled)
+		return;
+
+	EXPECT_EQ(request->status(), Request::Status::RequestComplete)
+		<< "Request didn't complete successfully";
+
+	const FrameMetadata &metadata = request->buffers().begin()->second->metadata();
+
+	if (!stats_.frames) {
+		stats_.firstFrameLatency = clock::now() - startTime_;
+		firstTimestamp_ = metadata.timestamp;
+	} else if (metadata.sequence > lastSequence_ + 1) {
+		stats_.dropped += metadata.sequence - lastSequence_ - 1;
+	}
+
+	stats_.frames++;
+	lastSequence_ = metadata.sequence;
+	lastTimestamp_ = metadata.timestamp;
+
+	if (!running_)
+		return;
+
+	request->reuse(Request::ReuseBuffers);
+	if (camera_->queueRequest(request))
+		loop_->exit(-EINVAL);
+}
+
 /* CaptureUnbalanced */
 
 CaptureUnbalanced::CaptureUnbalanced(std::shared_ptr<Camera> camera)
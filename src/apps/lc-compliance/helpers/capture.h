@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 
 #include <libcamera/libcamera.h>
@@ -22,7 +24,8 @@ protected:
 	Capture(std::shared_ptr<libcamera::Camera> camera);
 	virtual ~Capture();
 
-	void start();
+	void allocate();
+	void start(const libcamera::ControlList *controls = nullptr);
 	void stop();
 
 	virtual void requestComplete(libcamera::Request *request) = 0;
@@ -51,6 +54,40 @@ private:
 	unsigned int captureLimit_;
 };
 
+class CapturePerformance : public Capture
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Stats {
+		unsigned int frames;
+		unsigned int dropped;
+		double frameRate;
+
+		clock::duration startLatency;
+		clock::duration stopLatency;
+		clock::duration firstFrameLatency;
+	};
+
+	CapturePerformance(std::shared_ptr<libcamera::Camera> camera);
+
+	void capture(clock::duration duration, const libcamera::ControlList &controls);
+
+	const Stats &stats() const { return stats_; }
+
+private:
+	void requestComplete(libcamera::Request *request) override;
+
+	/* Accessed from the camera manager thread while capturing */
+	std::atomic<bool> running_;
+	clock::time_point startTime_;
+	uint32_t lastSequence_;
+	uint64_t firstTimestamp_;
+	uint64_t lastTimestamp_;
+
+	Stats stats_;
+};
+
 class CaptureUnbalanced : public Capture
 {
 public:
@@ -8,6 +8,7 @@
 
 #include <iomanip>
 #include <iostream>
+#include <stdlib.h>
 #include <string.h>
 
 #include <gtest/gtest.h>
@@ -25,6 +26,7 @@ enum {
 	OptList = 'l',
 	OptFilter = 'f',
 	OptHelp = 'h',
+	OptPerformance = 'P',
 };
 
 /*
@@ -80,6 +82,60 @@ static int initCamera(CameraManager *cm, OptionsParser::Options options)
 	return 0;
 }
 
+static int parseRatio(const KeyValueParser::Options &values, const char *name,
+		      double *ratio)
+{
+	if (!values.isSet(name))
+		return 0;
+
+	std::string value = values[name].toString();
+	char *endptr;
+	double parsed = strtod(value.c_str(), &endptr);
+
+	if (value.empty() || *endptr != '\0' || parsed < 0.0 || parsed > 1.0) {
+		std::cout << "Invalid " << name << " value " << value
+			  << ", expected a ratio between 0 and 1" << std::endl;
+		return -EINVAL;
+	}
+
+	*ratio = parsed;
+	return 0;
+}
+
+static int initPerformanceLimits(OptionsParser::Options options)
+{
+	PerformanceLimits limits;
+	int ret;
+
+	if (!options.isSet(OptPerformance))
+		return 0;
+
+	const KeyValueParser::Options &values = options[OptPerformance].toKeyValues();
+
+	if (values.isSet("frame-duration"))
+		limits.frameDuration = std::chrono::microseconds(values["frame-duration"].toInteger());
+	if (values.isSet("soak-duration"))
+		limits.soakDuration = std::chrono::seconds(values["soak-duration"].toInteger());
+	if (values.isSet("max-start-latency"))
+		limits.maxStartLatency = std::chrono::milliseconds(values["max-start-latency"].toInteger());
+	if (values.isSet("max-stop-latency"))
+		limits.maxStopLatency = std::chrono::milliseconds(values["max-stop-latency"].toInteger());
+	if (values.isSet("max-first-frame-latency"))
+		limits.maxFirstFrameLatency = std::chrono::milliseconds(values["max-first-frame-latency"].toInteger());
+
+	ret = parseRatio(values, "min-fps-ratio", &limits.minFrameRateRatio);
+	if (ret)
+		return ret;
+
+	ret = parseRatio(values, "max-drop-rate", &limits.maxDropRate);
+	if (ret)
+		return ret;
+
+	Environment::get()->setPerformanceLimits(limits);
+
+	return 0;
+}
+
 static int initGtestParameters(char *arg0, OptionsParser::Options options)
 {
 	const std::map<std::string, std::string> gtestFlags = { { "list", "--gtest_list_tests" },
@@ -138,6 +194,29 @@ static int initGtest(char *arg0, OptionsParser::Options options)
 
 static int parseOptions(int argc, char **argv, OptionsParser::Options *options)
 {
+	KeyValueParser performanceKeyValue;
+	performanceKeyValue.addOption("frame-duration", OptionInteger,
+				      "Frame duration to request, in microseconds (default: camera minimum)",
+				      ArgumentRequired);
+	performanceKeyValue.addOption("min-fps-ratio", OptionString,
+				      "Minimum ratio of the achieved to the requested frame rate (default: 0.95)",
+				      ArgumentRequired);
+	performanceKeyValue.addOption("max-drop-rate", OptionString,
+				      "Maximum ratio of dropped frames in the soak test (default: 0.001)",
+				      ArgumentRequired);
+	performanceKeyValue.addOption("soak-duration", OptionInteger,
+				      "Duration of the soak test, in seconds (default: 120)",
+				      ArgumentRequired);
+	performanceKeyValue.addOption("max-start-latency", OptionInteger,
+				      "Maximum duration of Camera::start(), in milliseconds (default: 1000)",
+				      ArgumentRequired);
+	performanceKeyValue.addOption("max-stop-latency", OptionInteger,
+				      "Maximum duration of Camera::stop(), in milliseconds (default: 1000)",
+				      ArgumentRequired);
+	performanceKeyValue.addOption("max-first-frame-latency", OptionInteger,
+				      "Maximum time from start to the first frame, in milliseconds (default: 1000)",
+				      ArgumentRequired);
+
 	OptionsParser parser;
 	parser.addOption(OptCamera, OptionString,
 			 "Specify which camera to operate on, by id", "camera",
@@ -148,6 +227,8 @@ static int parseOptions(int argc, char **argv, OptionsParser::Options *options)
 			 ArgumentRequired, "filter");
 	parser.addOption(OptHelp, OptionNone, "Display this help message",
 			 "help");
+	parser.addOption(OptPerformance, &performanceKeyValue,
+			 "Set the thresholds of the performance tests", "performance");
 
 	*options = parser.parse(argc, argv);
 	if (!options->valid())
@@ -172,6 +253,10 @@ int main(int argc, char **argv)
 	if (ret < 0)
 		return EXIT_FAILURE;
 
+	ret = initPerformanceLimits(options);
+	if (ret)
+		return EXIT_FAILURE;
+
 	std::unique_ptr<CameraManager> cm = std::make_unique<CameraManager>();
 
 	/* No need to initialize the camera if we'll just list tests */
@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Test camera capture performance
+ */
+
+#include "capture.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include <gtest/gtest.h>
+
+#include "environment.h"
+
+using namespace libcamera;
+using namespace std::literals::chrono_literals;
+
+namespace {
+
+const std::vector<StreamRole> ROLES = {
+	StreamRole::VideoRecording,
+	StreamRole::Viewfinder
+};
+
+/* Duration of the captures that measure the frame rate and latencies. */
+constexpr std::chrono::seconds kCaptureDuration = 5s;
+
+/* Number of start/stop cycles to measure the latencies. */
+constexpr unsigned int kStartStopCycles = 3;
+
+double toMilliseconds(CapturePerformance::clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} /* namespace */
+
+class Performance : public testing::TestWithParam<StreamRole>
+{
+public:
+	static std::string nameParameters(const testing::TestParamInfo<Performance::ParamType> &info);
+
+protected:
+	void SetUp() override;
+	void TearDown() override;
+
+	void frameDurationControls(ControlList *controls, double *frameRate);
+
+	std::shared_ptr<Camera> camera_;
+};
+
+void Performance::SetUp()
+{
+	Environment *env = Environment::get();
+
+	camera_ = env->cm()->get(env->cameraId());
+
+	ASSERT_EQ(camera_->acquire(), 0);
+}
+
+void Performance::TearDown()
+{
+	if (!camera_)
+		return;
+
+	camera_->release();
+	camera_.reset();
+}
+
+std::string Performance::nameParameters(const testing::TestParamInfo<Performance::ParamType> &info)
+{
+	std::map<StreamRole, std::string> rolesMap = {
+		{ StreamRole::VideoRecording, "VideoRecording" },
+		{ StreamRole::Viewfinder, "Viewfinder" }
+	};
+
+	return rolesMap[info.param];
+}
+
+/*
+ * Create the controls that fix the frame duration to the one requested on the
+ * command line, or to the minimum supported by the camera for the current
+ * configuration, and return the corresponding frame rate.
+ */
+void Performance::frameDurationControls(ControlList *controls, double *frameRate)
+{
+	const ControlInfoMap &infoMap = camera_->controls();
+	auto info = infoMap.find(&controls::FrameDurationLimits);
+	if (info == infoMap.end()) {
+		std::cout << "Frame duration control not supported by camera" << std::endl;
+		GTEST_SKIP();
+	}
+
+	int64_t minDuration = info->second.min().get<int64_t>();
+	int64_t maxDuration = info->second.max().get<int64_t>();
+	int64_t duration = Environment::get()->performanceLimits().frameDuration.count();
+	if (!duration)
+		duration = minDuration;
+
+	duration = std::clamp(duration, minDuration, maxDuration);
+	ASSERT_GT(duration, 0) << "Invalid frame duration";
+
+	*frameRate = 1000000.0 / duration;
+
+	controls->set(controls::FrameDurationLimits, { duration, duration });
+}
+
+/*
+ * Test the sustained frame rate
+ *
+ * Makes sure the camera delivers frames at the rate set by the frame duration
+ * limits. Example failure is a pipeline handler that can't keep up with the
+ * sensor and delays requests.
+ */
+TEST_P(Performance, FrameRate)
+{
+	const PerformanceLimits &limits = Environment::get()->performanceLimits();
+	double frameRate = 0.0;
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(GetParam());
+
+	ControlList controls;
+	frameDurationControls(&controls, &frameRate);
+
+	capture.capture(kCaptureDuration, controls);
+
+	const CapturePerformance::Stats &stats = capture.stats();
+
+	std::cout << std::fixed << std::setprecision(2)
+		  << "Frame rate " << stats.frameRate << " fps, requested "
+		  << frameRate << " fps" << std::endl;
+
+	EXPECT_GE(stats.frameRate, frameRate * limits.minFrameRateRatio)
+		<< "Frame rate too low";
+}
+
+/*
+ * Test frame drops over a long capture
+ *
+ * Makes sure the camera doesn't drop frames when capturing continuously for
+ * the soak duration. Example failure is a pipeline handler that leaks buffers
+ * or occasionally misses the deadline of a frame.
+ */
+TEST_P(Performance, Soak)
+{
+	const PerformanceLimits &limits = Environment::get()->performanceLimits();
+	double frameRate = 0.0;
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(GetParam());
+
+	ControlList controls;
+	frameDurationControls(&controls, &frameRate);
+
+	capture.capture(limits.soakDuration, controls);
+
+	const CapturePerformance::Stats &stats = capture.stats();
+	ASSERT_GT(stats.frames, 0U) << "No frame captured";
+
+	double dropRate = static_cast<double>(stats.dropped) /
+			  (stats.frames + stats.dropped);
+
+	std::cout << "Captured " << stats.frames << " frames, dropped "
+		  << stats.dropped << " in " << limits.soakDuration.count()
+		  << " seconds" << std::endl;
+
+	EXPECT_LE(dropRate, limits.maxDropRate) << "Too many dropped frames";
+	EXPECT_GE(stats.frameRate, frameRate * limits.minFrameRateRatio)
+		<< "Frame rate too low";
+}
+
+/*
+ * Test the start and stop latencies
+ *
+ * Makes sure Camera::start(), the delivery of the first frame and
+ * Camera::stop() complete in a bounded time over multiple start/stop cycles.
+ * Example failure is a pipeline handler that waits for a timeout when
+ * stopping.
+ */
+TEST_P(Performance, StartStopLatency)
+{
+	const PerformanceLimits &limits = Environment::get()->performanceLimits();
+
+	CapturePerformance capture(camera_);
+
+	capture.configure(GetParam());
+
+	for (unsigned int cycle = 0; cycle < kStartStopCycles; cycle++) {
+		capture.capture(1s, {});
+
+		const CapturePerformance::Stats &stats = capture.stats();
+		ASSERT_GT(stats.frames, 0U) << "No frame captured";
+
+		std::cout << std::fixed << std::setprecision(2)
+			  << "Start " << toMilliseconds(stats.startLatency)
+			  << " ms, first frame " << toMilliseconds(stats.firstFrameLatency)
+			  << " ms, stop " << toMilliseconds(stats.stopLatency)
+			  << " ms" << std::endl;
+
+		EXPECT_LE(stats.startLatency, limits.maxStartLatency)
+			<< "Camera start too slow";
+		EXPECT_LE(stats.firstFrameLatency, limits.maxFirstFrameLatency)
+			<< "First frame too late";
+		EXPECT_LE(stats.stopLatency, limits.maxStopLatency)
+			<< "Camera stop too slow";
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(PerformanceTests,
+			 Performance,
+			 testing::ValuesIn(ROLES),
+			 Performance::nameParameters);
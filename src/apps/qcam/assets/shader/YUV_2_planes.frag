@@ -13,6 +13,14 @@ varying vec2 textureOut;
 uniform sampler2D tex_y;
 uniform sampler2D tex_u;
 
+/*
+ * The channel of the tex_u texture that holds the second chroma component of
+ * each pair.
+ */
+#ifndef TEX_UV_SECOND
+#define TEX_UV_SECOND a
+#endif
+
 const mat3 yuv2rgb_matrix = mat3(
 	YUV2RGB_MATRIX
 );
@@ -28,9 +36,9 @@ void main(void)
 	yuv.x = texture2D(tex_y, textureOut).r;
 #if defined(YUV_PATTERN_UV)
 	yuv.y = texture2D(tex_u, textureOut).r;
-	yuv.z = texture2D(tex_u, textureOut).a;
+	yuv.z = texture2D(tex_u, textureOut).TEX_UV_SECOND;
 #elif defined(YUV_PATTERN_VU)
-	yuv.y = texture2D(tex_u, textureOut).a;
+	yuv.y = texture2D(tex_u, textureOut).TEX_UV_SECOND;
 	yuv.z = texture2D(tex_u, textureOut).r;
 #else
 #error Invalid pattern
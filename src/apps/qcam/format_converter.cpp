@@ -7,6 +7,7 @@
 
 #include "format_converter.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <utility>
 
@@ -202,158 +203,140 @@ void FormatConverter::convert(const Image *src, size_t size, QImage *dst)
 	};
 }
 
-static void yuv_to_rgb(int y, int u, int v, int *r, int *g, int *b)
+/*
+ * Split the conversion of the image lines across the threads of the pool, in
+ * chunks of at least kMinLinesPerThread lines. The first chunk is converted
+ * by the calling thread.
+ */
+void FormatConverter::convertLines(const std::function<void(unsigned int, unsigned int)> &convert)
+{
+	static constexpr unsigned int kMinLinesPerThread = 32;
+
+	unsigned int threads = std::clamp<unsigned int>(height_ / kMinLinesPerThread, 1,
+							threadPool_.maxThreadCount());
+	unsigned int lines = (height_ + threads - 1) / threads;
+
+	for (unsigned int start = lines; start < height_; start += lines) {
+		unsigned int end = std::min(start + lines, height_);
+		threadPool_.start([&convert, start, end]() {
+			convert(start, end);
+		});
+	}
+
+	convert(0, std::min(lines, height_));
+
+	threadPool_.waitForDone();
+}
+
+static inline void yuv_to_bgra(int y, int u, int v, unsigned char *dst)
 {
 	int c = y - 16;
 	int d = u - 128;
 	int e = v - 128;
-	*r = CLIP(( 298 * c           + 409 * e + 128) >> RGBSHIFT);
-	*g = CLIP(( 298 * c - 100 * d - 208 * e + 128) >> RGBSHIFT);
-	*b = CLIP(( 298 * c + 516 * d           + 128) >> RGBSHIFT);
+	dst[0] = CLIP(( 298 * c + 516 * d           + 128) >> RGBSHIFT);
+	dst[1] = CLIP(( 298 * c - 100 * d - 208 * e + 128) >> RGBSHIFT);
+	dst[2] = CLIP(( 298 * c           + 409 * e + 128) >> RGBSHIFT);
+	dst[3] = 0xff;
+}
+
+/*
+ * Convert one line of YUV pixels to BGRA. The luma samples are YStep bytes
+ * apart, and each chroma sample is shared by HorzSubSample pixels and located
+ * ChromaStep bytes after the previous one. Using compile-time constant steps
+ * and no dependency between iterations allows the compiler to vectorize the
+ * loop.
+ */
+template<unsigned int YStep, unsigned int HorzSubSample, unsigned int ChromaStep>
+static void convertLineYUV(const unsigned char *__restrict src_y,
+			   const unsigned char *__restrict src_cb,
+			   const unsigned char *__restrict src_cr,
+			   unsigned char *__restrict dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		unsigned int c = x / HorzSubSample * ChromaStep;
+
+		yuv_to_bgra(src_y[x * YStep], src_cb[c], src_cr[c], &dst[4 * x]);
+	}
 }
 
 void FormatConverter::convertRGB(const Image *srcImage, unsigned char *dst)
 {
 	const unsigned char *src = srcImage->data(0).data();
-	unsigned int x, y;
-	int r, g, b;
-
-	for (y = 0; y < height_; y++) {
-		for (x = 0; x < width_; x++) {
-			r = src[bpp_ * x + r_pos_];
-			g = src[bpp_ * x + g_pos_];
-			b = src[bpp_ * x + b_pos_];
-
-			dst[4 * x + 0] = b;
-			dst[4 * x + 1] = g;
-			dst[4 * x + 2] = r;
-			dst[4 * x + 3] = 0xff;
-		}
 
-		src += stride_;
-		dst += width_ * 4;
-	}
+	convertLines([&](unsigned int start, unsigned int end) {
+		for (unsigned int y = start; y < end; y++) {
+			const unsigned char *line = src + y * stride_;
+			unsigned char *out = dst + y * width_ * 4;
+
+			for (unsigned int x = 0; x < width_; x++) {
+				out[4 * x + 0] = line[bpp_ * x + b_pos_];
+				out[4 * x + 1] = line[bpp_ * x + g_pos_];
+				out[4 * x + 2] = line[bpp_ * x + r_pos_];
+				out[4 * x + 3] = 0xff;
+			}
+		}
+	});
 }
 
 void FormatConverter::convertYUVPacked(const Image *srcImage, unsigned char *dst)
 {
 	const unsigned char *src = srcImage->data(0).data();
-	unsigned int src_x, src_y, dst_x, dst_y;
-	unsigned int src_stride;
-	unsigned int dst_stride;
-	unsigned int cr_pos;
-	int r, g, b, y, cr, cb;
-
-	cr_pos = (cb_pos_ + 2) % 4;
-	src_stride = stride_;
-	dst_stride = width_ * 4;
-
-	for (src_y = 0, dst_y = 0; dst_y < height_; src_y++, dst_y++) {
-		for (src_x = 0, dst_x = 0; dst_x < width_; ) {
-			cb = src[src_y * src_stride + src_x * 4 + cb_pos_];
-			cr = src[src_y * src_stride + src_x * 4 + cr_pos];
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_ + 2];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			src_x++;
+	unsigned int cr_pos = (cb_pos_ + 2) % 4;
+
+	convertLines([&](unsigned int start, unsigned int end) {
+		for (unsigned int y = start; y < end; y++) {
+			const unsigned char *line = src + y * stride_;
+
+			convertLineYUV<2, 2, 4>(line + y_pos_, line + cb_pos_,
+						line + cr_pos,
+						dst + y * width_ * 4, width_);
 		}
-	}
+	});
 }
 
 void FormatConverter::convertYUVPlanar(const Image *srcImage, unsigned char *dst)
 {
 	unsigned int c_stride = stride_ / horzSubSample_;
-	unsigned int c_inc = horzSubSample_ == 1 ? 1 : 0;
 	const unsigned char *src_y = srcImage->data(0).data();
 	const unsigned char *src_cb = srcImage->data(1).data();
 	const unsigned char *src_cr = srcImage->data(2).data();
-	int r, g, b;
 
 	if (nvSwap_)
 		std::swap(src_cb, src_cr);
 
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *line_y = src_y + y * stride_;
-		const unsigned char *line_cb = src_cb + (y / vertSubSample_) *
-					       c_stride;
-		const unsigned char *line_cr = src_cr + (y / vertSubSample_) *
-					       c_stride;
-
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += c_inc;
-			line_cr += c_inc;
-			dst += 4;
-
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += 1;
-			line_cr += 1;
-			dst += 4;
+	auto convertLine = horzSubSample_ == 1 ? convertLineYUV<1, 1, 1>
+					       : convertLineYUV<1, 2, 1>;
+
+	convertLines([&](unsigned int start, unsigned int end) {
+		for (unsigned int y = start; y < end; y++) {
+			unsigned int c_offset = (y / vertSubSample_) * c_stride;
+
+			convertLine(src_y + y * stride_, src_cb + c_offset,
+				    src_cr + c_offset, dst + y * width_ * 4,
+				    width_);
 		}
-	}
+	});
 }
 
 void FormatConverter::convertYUVSemiPlanar(const Image *srcImage, unsigned char *dst)
 {
 	unsigned int c_stride = stride_ * (2 / horzSubSample_);
-	unsigned int c_inc = horzSubSample_ == 1 ? 2 : 0;
 	unsigned int cb_pos = nvSwap_ ? 1 : 0;
 	unsigned int cr_pos = nvSwap_ ? 0 : 1;
 	const unsigned char *src = srcImage->data(0).data();
 	const unsigned char *src_c = srcImage->data(1).data();
-	int r, g, b;
-
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *src_y = src + y * stride_;
-		const unsigned char *src_cb = src_c + (y / vertSubSample_) *
-					      c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample_) *
-					      c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 4;
-
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 4;
+
+	auto convertLine = horzSubSample_ == 1 ? convertLineYUV<1, 1, 2>
+					       : convertLineYUV<1, 2, 2>;
+
+	convertLines([&](unsigned int start, unsigned int end) {
+		for (unsigned int y = start; y < end; y++) {
+			const unsigned char *line_c = src_c + (y / vertSubSample_) *
+						      c_stride;
+
+			convertLine(src + y * stride_, line_c + cb_pos,
+				    line_c + cr_pos, dst + y * width_ * 4,
+				    width_);
 		}
-	}
+	});
 }
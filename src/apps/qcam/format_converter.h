@@ -7,9 +7,11 @@
 
 #pragma once
 
+#include <functional>
 #include <stddef.h>
 
 #include <QSize>
+#include <QThreadPool>
 
 #include <libcamera/pixel_format.h>
 
@@ -33,6 +35,8 @@ private:
 		YUVSemiPlanar,
 	};
 
+	void convertLines(const std::function<void(unsigned int, unsigned int)> &convert);
+
 	void convertRGB(const Image *src, unsigned char *dst);
 	void convertYUVPacked(const Image *src, unsigned char *dst);
 	void convertYUVPlanar(const Image *src, unsigned char *dst);
@@ -59,4 +63,6 @@ private:
 	/* YUV parameters */
 	unsigned int y_pos_;
 	unsigned int cb_pos_;
+
+	QThreadPool threadPool_;
 };
@@ -658,7 +658,9 @@ void MainWindow::processRaw(FrameBuffer *buffer,
 							"DNG Files (*.dng)");
 
 	if (!filename.isEmpty()) {
-		uint8_t *memory = mappedBuffers_[buffer]->data(0).data();
+		Image *image = mappedBuffers_[buffer].get();
+		Image::CpuAccess access(image);
+		uint8_t *memory = image->data(0).data();
 		DNGWriter::write(filename.toStdString().c_str(), camera_.get(),
 				 rawStream_->configuration(), metadata, buffer,
 				 memory);
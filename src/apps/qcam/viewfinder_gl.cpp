@@ -13,8 +13,11 @@
 #include <QFile>
 #include <QImage>
 #include <QMatrix4x4>
+#include <QOpenGLContext>
 #include <QStringList>
 
+#include <linux/drm_fourcc.h>
+
 #include <libcamera/formats.h>
 
 #include "../common/image.h"
@@ -68,6 +71,12 @@ ViewFinderGL::ViewFinderGL(QWidget *parent)
 
 ViewFinderGL::~ViewFinderGL()
 {
+#ifdef HAVE_EGL
+	makeCurrent();
+	clearDmaBufs();
+	doneCurrent();
+#endif
+
 	removeShader();
 }
 
@@ -114,6 +123,13 @@ void ViewFinderGL::stop()
 		buffer_ = nullptr;
 		image_ = nullptr;
 	}
+
+#ifdef HAVE_EGL
+	/* The buffers are freed after the camera stops, drop their imports. */
+	makeCurrent();
+	clearDmaBufs();
+	doneCurrent();
+#endif
 }
 
 QImage ViewFinderGL::getCurrentImage()
@@ -427,7 +443,20 @@ bool ViewFinderGL::createFragmentShader()
 		return false;
 	}
 
-	QString defines = fragmentShaderDefines_.join('\n') + "\n";
+	QStringList fragmentShaderDefines = fragmentShaderDefines_;
+
+#ifdef HAVE_EGL
+	/*
+	 * The second component of the semi-planar chroma plane is stored in
+	 * the alpha channel of the uploaded GL_LUMINANCE_ALPHA textures, but
+	 * in the green channel of the imported GR88 textures.
+	 */
+	dmabufShader_ = dmabufImport_;
+	if (dmabufShader_)
+		fragmentShaderDefines.append("#define TEX_UV_SECOND g");
+#endif
+
+	QString defines = fragmentShaderDefines.join('\n') + "\n";
 	QByteArray src = file.readAll();
 	src.prepend(defines.toUtf8());
 
@@ -486,9 +515,9 @@ bool ViewFinderGL::createFragmentShader()
 	return true;
 }
 
-void ViewFinderGL::configureTexture(QOpenGLTexture &texture)
+void ViewFinderGL::configureTexture(GLuint texture)
 {
-	glBindTexture(GL_TEXTURE_2D, texture.textureId());
+	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
 			textureMinMagFilters_);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
@@ -497,6 +526,164 @@ void ViewFinderGL::configureTexture(QOpenGLTexture &texture)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
+/*
+ * Bind a plane of the current frame to a texture unit. The plane is imported
+ * from its dma-buf when possible, and uploaded from the mapped image otherwise.
+ */
+void ViewFinderGL::bindPlane(unsigned int index, unsigned int plane,
+			     GLenum format, GLsizei width, GLsizei height)
+{
+	glActiveTexture(GL_TEXTURE0 + index);
+
+#ifdef HAVE_EGL
+	if (dmabufImport_) {
+		GLuint texture = importPlane(plane, format, width, height);
+		if (texture) {
+			configureTexture(texture);
+			return;
+		}
+
+		disableDmaBufImport();
+	}
+#endif
+
+	configureTexture(textures_[index]->textureId());
+	glTexImage2D(GL_TEXTURE_2D,
+		     0,
+		     format,
+		     width,
+		     height,
+		     0,
+		     format,
+		     GL_UNSIGNED_BYTE,
+		     image_->data(plane).data());
+}
+
+#ifdef HAVE_EGL
+void ViewFinderGL::initDmaBufImport()
+{
+	/*
+	 * Frames can only be imported when Qt renders through EGL, the display
+	 * isn't available with GLX.
+	 */
+	display_ = eglGetCurrentDisplay();
+	if (display_ == EGL_NO_DISPLAY)
+		return;
+
+	QList<QByteArray> extensions =
+		QByteArray(eglQueryString(display_, EGL_EXTENSIONS)).split(' ');
+	if (!extensions.contains("EGL_EXT_image_dma_buf_import") ||
+	    !context()->hasExtension("GL_OES_EGL_image"))
+		return;
+
+	eglCreateImageKHR_ = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+		eglGetProcAddress("eglCreateImageKHR"));
+	eglDestroyImageKHR_ = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+		eglGetProcAddress("eglDestroyImageKHR"));
+	glEGLImageTargetTexture2DOES_ =
+		reinterpret_cast<void (*)(GLenum, void *)>(
+			context()->getProcAddress("glEGLImageTargetTexture2DOES"));
+
+	dmabufImport_ = eglCreateImageKHR_ && eglDestroyImageKHR_ &&
+			glEGLImageTargetTexture2DOES_;
+}
+
+/*
+ * Import a plane of the current frame buffer as a texture. The textures
+ * are created the first time a buffer is rendered, and reused for all the
+ * subsequent frames it holds. Return the texture, or 0 if the plane can't be
+ * imported.
+ */
+GLuint ViewFinderGL::importPlane(unsigned int plane, GLenum format,
+				 GLsizei width, GLsizei height)
+{
+	DmaBufPlane &dmabuf = dmabufs_[buffer_][plane];
+	if (dmabuf.texture)
+		return dmabuf.texture;
+
+	if (plane >= buffer_->planes().size())
+		return 0;
+
+	/* Pick the DRM format whose texels match the uploaded ones. */
+	uint32_t fourcc;
+	unsigned int bytesPerTexel;
+
+	switch (format) {
+	case GL_LUMINANCE:
+		fourcc = DRM_FORMAT_R8;
+		bytesPerTexel = 1;
+		break;
+	case GL_LUMINANCE_ALPHA:
+		fourcc = DRM_FORMAT_GR88;
+		bytesPerTexel = 2;
+		break;
+	case GL_RGB:
+		fourcc = DRM_FORMAT_BGR888;
+		bytesPerTexel = 3;
+		break;
+	case GL_RGBA:
+		fourcc = DRM_FORMAT_ABGR8888;
+		bytesPerTexel = 4;
+		break;
+	default:
+		return 0;
+	}
+
+	const libcamera::FrameBuffer::Plane &fbPlane = buffer_->planes()[plane];
+
+	const EGLint attribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_LINUX_DRM_FOURCC_EXT, static_cast<EGLint>(fourcc),
+		EGL_DMA_BUF_PLANE0_FD_EXT, fbPlane.fd.get(),
+		EGL_DMA_BUF_PLANE0_OFFSET_EXT, static_cast<EGLint>(fbPlane.offset),
+		EGL_DMA_BUF_PLANE0_PITCH_EXT, static_cast<EGLint>(width * bytesPerTexel),
+		EGL_NONE,
+	};
+
+	dmabuf.image = eglCreateImageKHR_(display_, EGL_NO_CONTEXT,
+					  EGL_LINUX_DMA_BUF_EXT, nullptr,
+					  attribs);
+	if (dmabuf.image == EGL_NO_IMAGE_KHR) {
+		qWarning() << "[ViewFinderGL]: failed to import plane" << plane
+			   << "with error" << Qt::hex << eglGetError();
+		return 0;
+	}
+
+	glGenTextures(1, &dmabuf.texture);
+	glBindTexture(GL_TEXTURE_2D, dmabuf.texture);
+	glEGLImageTargetTexture2DOES_(GL_TEXTURE_2D, dmabuf.image);
+
+	return dmabuf.texture;
+}
+
+/*
+ * Fall back to uploading the frames. The fragment shader is recreated by
+ * paintGL() if it was built for imported textures.
+ */
+void ViewFinderGL::disableDmaBufImport()
+{
+	qWarning() << "[ViewFinderGL]: dma-buf import failed, uploading frames";
+
+	clearDmaBufs();
+	dmabufImport_ = false;
+}
+
+void ViewFinderGL::clearDmaBufs()
+{
+	for (auto &[buffer, planes] : dmabufs_) {
+		for (DmaBufPlane &dmabuf : planes) {
+			if (dmabuf.texture)
+				glDeleteTextures(1, &dmabuf.texture);
+			if (dmabuf.image != EGL_NO_IMAGE_KHR)
+				eglDestroyImageKHR_(display_, dmabuf.image);
+		}
+	}
+
+	dmabufs_.clear();
+}
+#endif
+
 void ViewFinderGL::removeShader()
 {
 	if (shaderProgram_.isLinked()) {
@@ -535,6 +722,10 @@ void ViewFinderGL::initializeGL()
 	/* Create Vertex Shader */
 	if (!createVertexShader())
 		qWarning() << "[ViewFinderGL]: create vertex shader failed.";
+
+#ifdef HAVE_EGL
+	initDmaBufImport();
+#endif
 }
 
 void ViewFinderGL::doRender()
@@ -550,31 +741,13 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::NV24:
 	case libcamera::formats::NV42:
 		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		bindPlane(0, 0, GL_LUMINANCE, stride_, size_.height());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/* Activate texture UV/VU */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE_ALPHA,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE_ALPHA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
+		bindPlane(1, 1, GL_LUMINANCE_ALPHA,
+			  stride_ / horzSubSample_,
+			  size_.height() / vertSubSample_);
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
 
 		stridePixels = stride_;
@@ -582,45 +755,19 @@ void ViewFinderGL::doRender()
 
 	case libcamera::formats::YUV420:
 		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		bindPlane(0, 0, GL_LUMINANCE, stride_, size_.height());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/* Activate texture U */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
+		bindPlane(1, 1, GL_LUMINANCE,
+			  stride_ / horzSubSample_,
+			  size_.height() / vertSubSample_);
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
 
 		/* Activate texture V */
-		glActiveTexture(GL_TEXTURE2);
-		configureTexture(*textures_[2]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(2).data());
+		bindPlane(2, 2, GL_LUMINANCE,
+			  stride_ / horzSubSample_,
+			  size_.height() / vertSubSample_);
 		shaderProgram_.setUniformValue(textureUniformV_, 2);
 
 		stridePixels = stride_;
@@ -628,45 +775,19 @@ void ViewFinderGL::doRender()
 
 	case libcamera::formats::YVU420:
 		/* Activate texture Y */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		bindPlane(0, 0, GL_LUMINANCE, stride_, size_.height());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/* Activate texture V */
-		glActiveTexture(GL_TEXTURE2);
-		configureTexture(*textures_[2]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(1).data());
+		bindPlane(2, 1, GL_LUMINANCE,
+			  stride_ / horzSubSample_,
+			  size_.height() / vertSubSample_);
 		shaderProgram_.setUniformValue(textureUniformV_, 2);
 
 		/* Activate texture U */
-		glActiveTexture(GL_TEXTURE1);
-		configureTexture(*textures_[1]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_ / horzSubSample_,
-			     size_.height() / vertSubSample_,
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(2).data());
+		bindPlane(1, 2, GL_LUMINANCE,
+			  stride_ / horzSubSample_,
+			  size_.height() / vertSubSample_);
 		shaderProgram_.setUniformValue(textureUniformU_, 1);
 
 		stridePixels = stride_;
@@ -681,17 +802,7 @@ void ViewFinderGL::doRender()
 		 * OpenGL texel size with the 4 bytes repeating pattern in YUV.
 		 * The texture width is thus half of the image_ with.
 		 */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGBA,
-			     stride_ / 4,
-			     size_.height(),
-			     0,
-			     GL_RGBA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		bindPlane(0, 0, GL_RGBA, stride_ / 4, size_.height());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		/*
@@ -711,17 +822,7 @@ void ViewFinderGL::doRender()
 	case libcamera::formats::ARGB8888:
 	case libcamera::formats::BGRA8888:
 	case libcamera::formats::RGBA8888:
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGBA,
-			     stride_ / 4,
-			     size_.height(),
-			     0,
-			     GL_RGBA,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		bindPlane(0, 0, GL_RGBA, stride_ / 4, size_.height());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		stridePixels = stride_ / 4;
@@ -729,17 +830,7 @@ void ViewFinderGL::doRender()
 
 	case libcamera::formats::BGR888:
 	case libcamera::formats::RGB888:
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_RGB,
-			     stride_ / 3,
-			     size_.height(),
-			     0,
-			     GL_RGB,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		bindPlane(0, 0, GL_RGB, stride_ / 3, size_.height());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 
 		stridePixels = stride_ / 3;
@@ -762,17 +853,7 @@ void ViewFinderGL::doRender()
 		 * are stored in a GL_LUMINANCE texture. The texture width is
 		 * equal to the stride.
 		 */
-		glActiveTexture(GL_TEXTURE0);
-		configureTexture(*textures_[0]);
-		glTexImage2D(GL_TEXTURE_2D,
-			     0,
-			     GL_LUMINANCE,
-			     stride_,
-			     size_.height(),
-			     0,
-			     GL_LUMINANCE,
-			     GL_UNSIGNED_BYTE,
-			     image_->data(0).data());
+		bindPlane(0, 0, GL_LUMINANCE, stride_, size_.height());
 		shaderProgram_.setUniformValue(textureUniformY_, 0);
 		shaderProgram_.setUniformValue(textureUniformBayerFirstRed_,
 					       firstRed_);
@@ -838,6 +919,21 @@ void ViewFinderGL::paintGL()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	doRender();
+
+#ifdef HAVE_EGL
+	/*
+	 * If the import failed, the fragment shader may expect the textures
+	 * of imported frames. Rebuild it and render the frame again.
+	 */
+	if (dmabufShader_ && !dmabufImport_) {
+		shaderProgram_.release();
+		shaderProgram_.removeShader(fragmentShader_.get());
+		fragmentShader_.reset();
+		update();
+		return;
+	}
+#endif
+
 	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
@@ -8,8 +8,14 @@
 #pragma once
 
 #include <array>
+#include <map>
 #include <memory>
 
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 #include <QImage>
 #include <QMutex>
 #include <QOpenGLBuffer>
@@ -57,12 +63,27 @@ private:
 	bool selectFormat(const libcamera::PixelFormat &format);
 	void selectColorSpace(const libcamera::ColorSpace &colorSpace);
 
-	void configureTexture(QOpenGLTexture &texture);
+	void configureTexture(GLuint texture);
+	void bindPlane(unsigned int index, unsigned int plane, GLenum format,
+		       GLsizei width, GLsizei height);
 	bool createFragmentShader();
 	bool createVertexShader();
 	void removeShader();
 	void doRender();
 
+#ifdef HAVE_EGL
+	struct DmaBufPlane {
+		EGLImageKHR image = EGL_NO_IMAGE_KHR;
+		GLuint texture = 0;
+	};
+
+	void initDmaBufImport();
+	GLuint importPlane(unsigned int plane, GLenum format,
+			   GLsizei width, GLsizei height);
+	void disableDmaBufImport();
+	void clearDmaBufs();
+#endif
+
 	/* Captured image size, format and buffer */
 	libcamera::FrameBuffer *buffer_;
 	libcamera::PixelFormat format_;
@@ -85,6 +106,17 @@ private:
 	/* Textures */
 	std::array<std::unique_ptr<QOpenGLTexture>, 3> textures_;
 
+#ifdef HAVE_EGL
+	/* Textures imported from the dma-bufs of the frame buffers */
+	EGLDisplay display_ = EGL_NO_DISPLAY;
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_ = nullptr;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_ = nullptr;
+	void (*glEGLImageTargetTexture2DOES_)(GLenum target, void *image) = nullptr;
+	std::map<const libcamera::FrameBuffer *, std::array<DmaBufPlane, 3>> dmabufs_;
+	bool dmabufImport_ = false;
+	bool dmabufShader_ = false;
+#endif
+
 	/* Common texture parameters */
 	GLuint textureMinMagFilters_;
 	GLuint projMatrixUniform_;
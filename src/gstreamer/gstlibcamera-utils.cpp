@@ -407,6 +407,48 @@ gst_libcamera_stream_configuration_to_caps(const StreamConfiguration &stream_cfg
 	return caps;
 }
 
+/*
+ * Fill the video info for the raw video caps of a stream, with the layout of
+ * the buffers produced by the camera. The strides of all planes are scaled
+ * from the stride of the first plane, and the planes are laid out one after
+ * the other, with as many lines as in the default GStreamer layout.
+ */
+gboolean
+gst_libcamera_stream_configuration_to_video_info(const StreamConfiguration &stream_cfg,
+						 GstCaps *caps, GstVideoInfo *info)
+{
+	if (!gst_video_info_from_caps(info, caps))
+		return FALSE;
+
+	guint default_stride = GST_VIDEO_INFO_PLANE_STRIDE(info, 0);
+	if (!stream_cfg.stride || !default_stride ||
+	    stream_cfg.stride == default_stride)
+		return TRUE;
+
+	GstVideoInfo default_info = *info;
+	guint n_planes = GST_VIDEO_INFO_N_PLANES(info);
+	gsize offset = 0;
+
+	for (guint i = 0; i < n_planes; i++) {
+		guint plane_stride = GST_VIDEO_INFO_PLANE_STRIDE(&default_info, i);
+		gsize plane_end = i + 1 < n_planes
+				? GST_VIDEO_INFO_PLANE_OFFSET(&default_info, i + 1)
+				: GST_VIDEO_INFO_SIZE(&default_info);
+		gsize lines = (plane_end - GST_VIDEO_INFO_PLANE_OFFSET(&default_info, i))
+			    / plane_stride;
+		guint stride = static_cast<guint64>(plane_stride) * stream_cfg.stride
+			     / default_stride;
+
+		GST_VIDEO_INFO_PLANE_STRIDE(info, i) = stride;
+		GST_VIDEO_INFO_PLANE_OFFSET(info, i) = offset;
+		offset += lines * stride;
+	}
+
+	GST_VIDEO_INFO_SIZE(info) = offset;
+
+	return TRUE;
+}
+
 void
 gst_libcamera_configure_stream_from_caps(StreamConfiguration &stream_cfg,
 					 GstCaps *caps)
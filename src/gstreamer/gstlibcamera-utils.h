@@ -17,6 +17,8 @@
 
 GstCaps *gst_libcamera_stream_formats_to_caps(const libcamera::StreamFormats &formats);
 GstCaps *gst_libcamera_stream_configuration_to_caps(const libcamera::StreamConfiguration &stream_cfg);
+gboolean gst_libcamera_stream_configuration_to_video_info(const libcamera::StreamConfiguration &stream_cfg,
+							  GstCaps *caps, GstVideoInfo *info);
 void gst_libcamera_configure_stream_from_caps(libcamera::StreamConfiguration &stream_cfg,
 					      GstCaps *caps);
 void gst_libcamera_get_framerate_from_caps(GstCaps *caps, GstStructure *element_caps);
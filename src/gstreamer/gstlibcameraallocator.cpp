@@ -8,6 +8,8 @@
 
 #include "gstlibcameraallocator.h"
 
+#include <algorithm>
+
 #include <libcamera/camera.h>
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/stream.h>
@@ -197,7 +199,8 @@ gst_libcamera_allocator_class_init(GstLibcameraAllocatorClass *klass)
 
 GstLibcameraAllocator *
 gst_libcamera_allocator_new(std::shared_ptr<Camera> camera,
-			    CameraConfiguration *config_)
+			    CameraConfiguration *config_,
+			    const std::vector<Stream *> &imported_streams)
 {
 	auto *self = GST_LIBCAMERA_ALLOCATOR(g_object_new(GST_TYPE_LIBCAMERA_ALLOCATOR,
 							  nullptr));
@@ -213,6 +216,11 @@ gst_libcamera_allocator_new(std::shared_ptr<Camera> camera,
 	for (StreamConfiguration &streamCfg : *config_) {
 		Stream *stream = streamCfg.stream();
 
+		/* Buffers of the streams imported from downstream aren't needed. */
+		if (std::find(imported_streams.begin(), imported_streams.end(),
+			      stream) != imported_streams.end())
+			continue;
+
 		ret = self->fb_allocator->allocate(stream);
 		if (ret == 0)
 			return nullptr;
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <gst/gst.h>
 #include <gst/allocators/allocators.h>
 
@@ -19,7 +21,8 @@ G_DECLARE_FINAL_TYPE(GstLibcameraAllocator, gst_libcamera_allocator,
 		     GST_LIBCAMERA, ALLOCATOR, GstDmaBufAllocator)
 
 GstLibcameraAllocator *gst_libcamera_allocator_new(std::shared_ptr<libcamera::Camera> camera,
-						   libcamera::CameraConfiguration *config_);
+						   libcamera::CameraConfiguration *config_,
+						   const std::vector<libcamera::Stream *> &imported_streams);
 
 bool gst_libcamera_allocator_prepare_buffer(GstLibcameraAllocator *self,
 					    libcamera::Stream *stream,
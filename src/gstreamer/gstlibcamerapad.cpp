@@ -8,22 +8,36 @@
 
 #include "gstlibcamerapad.h"
 
+#include <algorithm>
+#include <array>
+
 #include <libcamera/stream.h>
 
 #include "gstlibcamera-utils.h"
 
 using namespace libcamera;
 
+/*
+ * The number of frames over which the latency is measured. The reported
+ * latency is the largest one of the window, so that downstream doesn't
+ * consider the frames with a latency above the average late.
+ */
+static constexpr unsigned int kLatencyWindow = 16;
+
 struct _GstLibcameraPad {
 	GstPad parent;
 	StreamRole role;
+	guint buffer_count;
 	GstLibcameraPool *pool;
 	GstClockTime latency;
+	std::array<GstClockTime, kLatencyWindow> latency_samples;
+	unsigned int latency_index;
 };
 
 enum {
 	PROP_0,
-	PROP_STREAM_ROLE
+	PROP_STREAM_ROLE,
+	PROP_BUFFER_COUNT,
 };
 
 G_DEFINE_TYPE(GstLibcameraPad, gst_libcamera_pad, GST_TYPE_PAD)
@@ -39,6 +53,9 @@ gst_libcamera_pad_set_property(GObject *object, guint prop_id,
 	case PROP_STREAM_ROLE:
 		self->role = (StreamRole)g_value_get_enum(value);
 		break;
+	case PROP_BUFFER_COUNT:
+		self->buffer_count = g_value_get_uint(value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -56,6 +73,9 @@ gst_libcamera_pad_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_STREAM_ROLE:
 		g_value_set_enum(value, static_cast<gint>(self->role));
 		break;
+	case PROP_BUFFER_COUNT:
+		g_value_set_uint(value, self->buffer_count);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -70,9 +90,18 @@ gst_libcamera_pad_query(GstPad *pad, GstObject *parent, GstQuery *query)
 	if (query->type != GST_QUERY_LATENCY)
 		return gst_pad_query_default(pad, parent, query);
 
-	/* TRUE here means live, we assumes that max latency is the same as min
-	 * as we have no idea that duration of frames. */
-	gst_query_set_latency(query, TRUE, self->latency, self->latency);
+	GstClockTime latency;
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		latency = self->latency;
+	}
+
+	/*
+	 * TRUE here means live. The latency is the measured delay between the
+	 * capture of the frames and their push, the max latency is the same
+	 * as the min as frames are not buffered once they are ready.
+	 */
+	gst_query_set_latency(query, TRUE, latency, latency);
 	return TRUE;
 }
 
@@ -126,6 +155,15 @@ gst_libcamera_pad_class_init(GstLibcameraPadClass *klass)
 						     | G_PARAM_READWRITE
 						     | G_PARAM_STATIC_STRINGS));
 	g_object_class_install_property(object_class, PROP_STREAM_ROLE, spec);
+
+	spec = g_param_spec_uint("buffer-count", "Buffer Count",
+				 "The number of buffers of the stream, which bounds the "
+				 "number of requests in flight (0 = camera default)",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(GST_PARAM_MUTABLE_READY
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_BUFFER_COUNT, spec);
 }
 
 StreamRole
@@ -136,6 +174,14 @@ gst_libcamera_pad_get_role(GstPad *pad)
 	return self->role;
 }
 
+guint
+gst_libcamera_pad_get_buffer_count(GstPad *pad)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GLibLocker lock(GST_OBJECT(self));
+	return self->buffer_count;
+}
+
 GstLibcameraPool *
 gst_libcamera_pad_get_pool(GstPad *pad)
 {
@@ -164,10 +210,39 @@ gst_libcamera_pad_get_stream(GstPad *pad)
 	return nullptr;
 }
 
-void
+/*
+ * Record the latency of a frame, and return true if the reported latency has
+ * changed enough for the pipeline latency to be recomputed.
+ */
+bool
 gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency)
 {
 	auto *self = GST_LIBCAMERA_PAD(pad);
 	GLibLocker lock(GST_OBJECT(self));
-	self->latency = latency;
+
+	self->latency_samples[self->latency_index] = latency;
+	self->latency_index = (self->latency_index + 1) % kLatencyWindow;
+
+	GstClockTime peak = *std::max_element(self->latency_samples.begin(),
+					      self->latency_samples.end());
+
+	/* Ignore changes below a millisecond or a tenth of the latency. */
+	GstClockTime delta = peak > self->latency ? peak - self->latency
+						  : self->latency - peak;
+	if (delta < std::max<GstClockTime>(GST_MSECOND, self->latency / 10))
+		return false;
+
+	self->latency = peak;
+	return true;
+}
+
+void
+gst_libcamera_pad_reset_latency(GstPad *pad)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GLibLocker lock(GST_OBJECT(self));
+
+	self->latency = 0;
+	self->latency_samples.fill(0);
+	self->latency_index = 0;
 }
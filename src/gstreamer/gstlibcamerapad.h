@@ -19,10 +19,14 @@ G_DECLARE_FINAL_TYPE(GstLibcameraPad, gst_libcamera_pad, GST_LIBCAMERA, PAD, Gst
 
 libcamera::StreamRole gst_libcamera_pad_get_role(GstPad *pad);
 
+guint gst_libcamera_pad_get_buffer_count(GstPad *pad);
+
 GstLibcameraPool *gst_libcamera_pad_get_pool(GstPad *pad);
 
 void gst_libcamera_pad_set_pool(GstPad *pad, GstLibcameraPool *pool);
 
 libcamera::Stream *gst_libcamera_pad_get_stream(GstPad *pad);
 
-void gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency);
+bool gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency);
+
+void gst_libcamera_pad_reset_latency(GstPad *pad);
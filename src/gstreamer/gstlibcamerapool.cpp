@@ -8,8 +8,15 @@
 
 #include "gstlibcamerapool.h"
 
+#include <algorithm>
 #include <deque>
+#include <memory>
+#include <vector>
 
+#include <gst/allocators/allocators.h>
+#include <gst/video/video.h>
+
+#include <libcamera/framebuffer.h>
 #include <libcamera/stream.h>
 
 #include "gstlibcamera-utils.h"
@@ -28,11 +35,213 @@ struct _GstLibcameraPool {
 
 	std::deque<GstBuffer *> *queue;
 	GstLibcameraAllocator *allocator;
+	/*
+	 * The downstream pool from which the buffers are imported, or nullptr
+	 * if they are allocated by the allocator.
+	 */
+	GstBufferPool *import_pool;
 	Stream *stream;
+
+	/* The layout of the allocated buffers, described by a video meta */
+	GstVideoInfo info;
+	bool has_info;
 };
 
 G_DEFINE_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_TYPE_BUFFER_POOL)
 
+/**
+ * \struct ImportedFrame
+ * \brief An internal wrapper of a FrameBuffer for a buffer of a downstream pool
+ *
+ * The wrapper is attached to the downstream buffer, which is recycled by its
+ * pool, to create the FrameBuffer once only. The memories it has been created
+ * for are recorded, to detect pools that replace the memories of their
+ * buffers.
+ */
+struct ImportedFrame {
+	std::unique_ptr<FrameBuffer> buffer_;
+	std::vector<GstMemory *> memories_;
+
+	static GQuark getQuark();
+};
+
+GQuark ImportedFrame::getQuark()
+{
+	static gsize frame_quark = 0;
+
+	if (g_once_init_enter(&frame_quark)) {
+		GQuark quark = g_quark_from_string("GstLibcameraImportedFrame");
+		g_once_init_leave(&frame_quark, quark);
+	}
+
+	return frame_quark;
+}
+
+/* The downstream buffer whose memories a buffer of the pool holds. */
+static GQuark
+gst_libcamera_pool_imported_buffer_quark()
+{
+	static gsize buffer_quark = 0;
+
+	if (g_once_init_enter(&buffer_quark)) {
+		GQuark quark = g_quark_from_string("GstLibcameraImportedBuffer");
+		g_once_init_leave(&buffer_quark, quark);
+	}
+
+	return buffer_quark;
+}
+
+static void
+gst_libcamera_pool_free_imported_frame(gpointer data)
+{
+	delete reinterpret_cast<ImportedFrame *>(data);
+}
+
+static bool
+gst_libcamera_imported_frame_matches(ImportedFrame *frame, GstBuffer *buffer)
+{
+	if (frame->memories_.size() != gst_buffer_n_memory(buffer))
+		return false;
+
+	for (guint i = 0; i < frame->memories_.size(); i++) {
+		if (frame->memories_[i] != gst_buffer_peek_memory(buffer, i))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Create a FrameBuffer for the planes of a dmabuf-backed video buffer, as
+ * described by its video meta.
+ */
+static ImportedFrame *
+gst_libcamera_imported_frame_new(GstBuffer *buffer)
+{
+	GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+	if (!meta)
+		return nullptr;
+
+	gsize buffer_size = gst_buffer_get_size(buffer);
+	std::vector<FrameBuffer::Plane> planes;
+
+	for (guint i = 0; i < meta->n_planes; i++) {
+		guint index, length;
+		gsize skip;
+
+		if (!gst_buffer_find_memory(buffer, meta->offset[i], 1,
+					    &index, &length, &skip))
+			return nullptr;
+
+		GstMemory *mem = gst_buffer_peek_memory(buffer, index);
+		if (!gst_is_dmabuf_memory(mem))
+			return nullptr;
+
+		gsize end = i + 1 < meta->n_planes ? meta->offset[i + 1] : buffer_size;
+
+		/* The dmabuf is duplicated, as it is owned by the memory. */
+		const int fd = gst_dmabuf_memory_get_fd(mem);
+
+		FrameBuffer::Plane plane;
+		plane.fd = SharedFD(fd);
+		plane.offset = mem->offset + skip;
+		plane.length = std::min<gsize>(end - meta->offset[i], mem->size - skip);
+		planes.push_back(std::move(plane));
+	}
+
+	auto *frame = new ImportedFrame();
+	frame->buffer_ = std::make_unique<FrameBuffer>(planes);
+	for (guint i = 0; i < gst_buffer_n_memory(buffer); i++)
+		frame->memories_.push_back(gst_buffer_peek_memory(buffer, i));
+
+	return frame;
+}
+
+static ImportedFrame *
+gst_libcamera_pool_get_imported_frame(GstBuffer *buffer)
+{
+	auto *frame = reinterpret_cast<ImportedFrame *>(gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer),
+										  ImportedFrame::getQuark()));
+	if (frame && gst_libcamera_imported_frame_matches(frame, buffer))
+		return frame;
+
+	frame = gst_libcamera_imported_frame_new(buffer);
+	gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer), ImportedFrame::getQuark(),
+				  frame, gst_libcamera_pool_free_imported_frame);
+
+	return frame;
+}
+
+/*
+ * Fill a buffer of the pool with the memories of a buffer acquired from the
+ * downstream pool, which is held until the buffer is released to the pool.
+ */
+static bool
+gst_libcamera_pool_import_buffer(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	GstBufferPoolAcquireParams params = {};
+	params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+	GstBuffer *imported;
+	if (gst_buffer_pool_acquire_buffer(self->import_pool, &imported, &params) != GST_FLOW_OK)
+		return false;
+
+	ImportedFrame *frame = gst_libcamera_pool_get_imported_frame(imported);
+	if (!frame) {
+		GST_WARNING_OBJECT(self, "Failed to import downstream buffer");
+		gst_buffer_unref(imported);
+		return false;
+	}
+
+	/*
+	 * Reference the memories instead of copying them with the buffer, to
+	 * share them with downstream without a copy in all cases.
+	 */
+	for (guint i = 0; i < gst_buffer_n_memory(imported); i++)
+		gst_buffer_append_memory(buffer, gst_memory_ref(gst_buffer_peek_memory(imported, i)));
+
+	GstVideoMeta *meta = gst_buffer_get_video_meta(imported);
+	gst_buffer_add_video_meta_full(buffer, meta->flags, meta->format,
+				       meta->width, meta->height, meta->n_planes,
+				       meta->offset, meta->stride);
+
+	gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer),
+				  gst_libcamera_pool_imported_buffer_quark(),
+				  imported, reinterpret_cast<GDestroyNotify>(gst_buffer_unref));
+
+	return true;
+}
+
+/*
+ * Describe the layout of a buffer filled by the allocator with a video meta.
+ * The planes of the FrameBuffer are appended as separate memories, locate
+ * them in the buffer from their sizes in that case.
+ */
+static void
+gst_libcamera_pool_add_video_meta(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	const GstVideoInfo *info = &self->info;
+	gsize offset[GST_VIDEO_MAX_PLANES];
+	guint n_planes = GST_VIDEO_INFO_N_PLANES(info);
+
+	for (guint i = 0; i < n_planes; i++)
+		offset[i] = GST_VIDEO_INFO_PLANE_OFFSET(info, i);
+
+	if (gst_buffer_n_memory(buffer) == n_planes) {
+		gsize mem_offset = 0;
+		for (guint i = 0; i < n_planes; i++) {
+			offset[i] = mem_offset;
+			mem_offset += gst_buffer_peek_memory(buffer, i)->size;
+		}
+	}
+
+	gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE,
+				       GST_VIDEO_INFO_FORMAT(info),
+				       GST_VIDEO_INFO_WIDTH(info),
+				       GST_VIDEO_INFO_HEIGHT(info), n_planes,
+				       offset, info->stride);
+}
+
 static GstBuffer *
 gst_libcamera_pool_pop_buffer(GstLibcameraPool *self)
 {
@@ -58,12 +267,19 @@ gst_libcamera_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer,
 	if (!buf)
 		return GST_FLOW_ERROR;
 
-	if (!gst_libcamera_allocator_prepare_buffer(self->allocator, self->stream, buf)) {
+	bool prepared = self->import_pool
+		      ? gst_libcamera_pool_import_buffer(self, buf)
+		      : gst_libcamera_allocator_prepare_buffer(self->allocator, self->stream, buf);
+	if (!prepared) {
 		GLibLocker lock(GST_OBJECT(self));
 		self->queue->push_back(buf);
 		return GST_FLOW_ERROR;
 	}
 
+	/* Imported buffers carry the video meta of the downstream buffer. */
+	if (!self->import_pool && self->has_info)
+		gst_libcamera_pool_add_video_meta(self, buf);
+
 	*buffer = buf;
 	return GST_FLOW_OK;
 }
@@ -75,6 +291,12 @@ gst_libcamera_pool_reset_buffer(GstBufferPool *pool, GstBuffer *buffer)
 
 	/* Clears all the memories and only pool the GstBuffer objects */
 	gst_buffer_remove_all_memory(buffer);
+
+	/* Return the imported buffer, if any, to the downstream pool. */
+	gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer),
+				  gst_libcamera_pool_imported_buffer_quark(),
+				  nullptr, nullptr);
+
 	klass->reset_buffer(pool, buffer);
 	GST_BUFFER_FLAGS(buffer) = 0;
 }
@@ -99,6 +321,7 @@ static void
 gst_libcamera_pool_init(GstLibcameraPool *self)
 {
 	self->queue = new std::deque<GstBuffer *>();
+	self->has_info = false;
 }
 
 static void
@@ -111,7 +334,12 @@ gst_libcamera_pool_finalize(GObject *object)
 		gst_buffer_unref(buf);
 
 	delete self->queue;
-	g_object_unref(self->allocator);
+	g_clear_object(&self->allocator);
+
+	if (self->import_pool) {
+		gst_buffer_pool_set_active(self->import_pool, FALSE);
+		gst_object_unref(self->import_pool);
+	}
 
 	G_OBJECT_CLASS(gst_libcamera_pool_parent_class)->finalize(object);
 }
@@ -151,15 +379,56 @@ gst_libcamera_pool_new(GstLibcameraAllocator *allocator, Stream *stream)
 	return pool;
 }
 
+/*
+ * Create a pool that imports the buffers of a downstream pool, which must
+ * be active and produce dmabuf-backed buffers with a video meta. The pool
+ * takes ownership of the downstream pool.
+ */
+GstLibcameraPool *
+gst_libcamera_pool_new_import(GstBufferPool *import_pool, Stream *stream,
+			      gsize pool_size)
+{
+	auto *pool = GST_LIBCAMERA_POOL(g_object_new(GST_TYPE_LIBCAMERA_POOL, nullptr));
+
+	pool->import_pool = import_pool;
+	pool->stream = stream;
+
+	for (gsize i = 0; i < pool_size; i++) {
+		GstBuffer *buffer = gst_buffer_new();
+		pool->queue->push_back(buffer);
+	}
+
+	return pool;
+}
+
 Stream *
 gst_libcamera_pool_get_stream(GstLibcameraPool *self)
 {
 	return self->stream;
 }
 
+/*
+ * Set the layout of the buffers allocated for the stream, which is attached
+ * to them with a video meta.
+ */
+void
+gst_libcamera_pool_set_video_info(GstLibcameraPool *self, const GstVideoInfo *info)
+{
+	self->info = *info;
+	self->has_info = true;
+}
+
 FrameBuffer *
 gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer)
 {
+	auto *imported = reinterpret_cast<GstBuffer *>(gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer),
+										 gst_libcamera_pool_imported_buffer_quark()));
+	if (imported) {
+		auto *frame = reinterpret_cast<ImportedFrame *>(gst_mini_object_get_qdata(GST_MINI_OBJECT(imported),
+											  ImportedFrame::getQuark()));
+		return frame->buffer_.get();
+	}
+
 	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
 	return gst_libcamera_memory_get_frame_buffer(mem);
 }
@@ -14,6 +14,7 @@
 #include "gstlibcameraallocator.h"
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #include <libcamera/stream.h>
 
@@ -23,6 +24,13 @@ G_DECLARE_FINAL_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_LIBCAMERA, POOL,
 GstLibcameraPool *gst_libcamera_pool_new(GstLibcameraAllocator *allocator,
 					 libcamera::Stream *stream);
 
+GstLibcameraPool *gst_libcamera_pool_new_import(GstBufferPool *import_pool,
+						libcamera::Stream *stream,
+						gsize pool_size);
+
 libcamera::Stream *gst_libcamera_pool_get_stream(GstLibcameraPool *self);
 
+void gst_libcamera_pool_set_video_info(GstLibcameraPool *self,
+				       const GstVideoInfo *info);
+
 libcamera::FrameBuffer *gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer);
@@ -15,31 +15,32 @@
  *    + Evaluate if a single streaming thread is fine
  *  - Add application driven request (snapshot)
  *  - Add framerate control
- *  - Add buffer importation support
  *
  *  Requires new libcamera API:
  *  - Add framerate negotiation support
  *  - Add colorimetry support
  *  - Add timestamp support
  *  - Use unique names to select the camera devices
- *  - Add GstVideoMeta support (strides and offsets)
  */
 
 #include "gstlibcamerasrc.h"
 
+#include <algorithm>
 #include <atomic>
-#include <queue>
 #include <vector>
 
 #include <libcamera/camera.h>
 #include <libcamera/camera_manager.h>
 #include <libcamera/control_ids.h>
 
+#include <gst/allocators/allocators.h>
 #include <gst/base/base.h>
+#include <gst/video/video.h>
 
 #include "gstlibcameraallocator.h"
 #include "gstlibcamerapad.h"
 #include "gstlibcamerapool.h"
+#include "gstlibcamerasync.h"
 #include "gstlibcamera-utils.h"
 
 using namespace libcamera;
@@ -48,7 +49,7 @@ GST_DEBUG_CATEGORY_STATIC(source_debug);
 #define GST_CAT_DEFAULT source_debug
 
 struct RequestWrap {
-	RequestWrap(std::unique_ptr<Request> request);
+	RequestWrap();
 	~RequestWrap();
 
 	void attachBuffer(Stream *stream, GstBuffer *buffer);
@@ -57,12 +58,16 @@ struct RequestWrap {
 	std::unique_ptr<Request> request_;
 	std::map<Stream *, GstBuffer *> buffers_;
 
-	GstClockTime latency_;
+	/* The sensor timestamp, in the monotonic clock */
+	GstClockTime sensorTimestamp_;
 	GstClockTime pts_;
+
+	/* Link in the CompletedRequestQueue */
+	RequestWrap *next_;
 };
 
-RequestWrap::RequestWrap(std::unique_ptr<Request> request)
-	: request_(std::move(request)), latency_(0), pts_(GST_CLOCK_TIME_NONE)
+RequestWrap::RequestWrap()
+	: sensorTimestamp_(0), pts_(GST_CLOCK_TIME_NONE), next_(nullptr)
 {
 }
 
@@ -102,6 +107,79 @@ GstBuffer *RequestWrap::detachBuffer(Stream *stream)
 	return buffer;
 }
 
+/*
+ * A lock-free queue of completed requests, with a single producer, the
+ * request completion handler, and a single consumer, the streaming task. The
+ * producer pushes the requests to a stack, which the consumer takes at once
+ * and reverses to process the requests in completion order.
+ */
+class CompletedRequestQueue
+{
+public:
+	~CompletedRequestQueue()
+	{
+		clear();
+	}
+
+	/* Return true if the queue was empty, for the consumer to be woken. */
+	bool push(std::unique_ptr<RequestWrap> wrap)
+	{
+		RequestWrap *node = wrap.release();
+		RequestWrap *head = pushed_.load(std::memory_order_relaxed);
+
+		do {
+			node->next_ = head;
+		} while (!pushed_.compare_exchange_weak(head, node,
+							std::memory_order_release,
+							std::memory_order_relaxed));
+
+		return !head;
+	}
+
+	std::unique_ptr<RequestWrap> pop()
+	{
+		if (!pending_)
+			take();
+
+		RequestWrap *wrap = pending_;
+		if (!wrap)
+			return nullptr;
+
+		pending_ = wrap->next_;
+		wrap->next_ = nullptr;
+
+		return std::unique_ptr<RequestWrap>(wrap);
+	}
+
+	bool empty() const
+	{
+		return !pending_ && !pushed_.load(std::memory_order_acquire);
+	}
+
+	void clear()
+	{
+		while (pop())
+			;
+	}
+
+private:
+	void take()
+	{
+		RequestWrap *node = pushed_.exchange(nullptr, std::memory_order_acquire);
+
+		while (node) {
+			RequestWrap *next = node->next_;
+			node->next_ = pending_;
+			pending_ = node;
+			node = next;
+		}
+	}
+
+	std::atomic<RequestWrap *> pushed_{ nullptr };
+	/* The requests taken from the stack, only accessed by the consumer */
+	RequestWrap *pending_ = nullptr;
+};
+
 /* Used for C++ object with destructors. */
 struct GstLibcameraSrcState {
 	GstLibcameraSrc *src_;
@@ -113,18 +191,21 @@ struct GstLibcameraSrcState {
 	std::vector<GstPad *> srcpads_; /* Protected by stream_lock */
 
 	/*
-	 * Contention on this lock_ must be minimized, as it has to be taken in
-	 * the realtime-sensitive requestCompleted() handler to protect
-	 * queuedRequests_ and completedRequests_.
-	 *
-	 * stream_lock must be taken before lock_ in contexts where both locks
-	 * need to be taken. In particular, this means that the lock_ must not
-	 * be held while calling into other graph elements (e.g. when calling
-	 * gst_pad_query()).
+	 * The requests queued to the camera are owned by the camera until they
+	 * complete, through their cookie. The realtime-sensitive
+	 * requestCompleted() handler hands them to the streaming task without
+	 * taking any lock.
 	 */
-	GMutex lock_;
-	std::queue<std::unique_ptr<RequestWrap>> queuedRequests_;
-	std::queue<std::unique_ptr<RequestWrap>> completedRequests_;
+	std::atomic<unsigned int> queuedRequests_{ 0 };
+	CompletedRequestQueue completedRequests_;
+
+	/*
+	 * The sync group the frames are pushed in lockstep with, and the
+	 * completed request waiting for a match. Only accessed by the
+	 * streaming task.
+	 */
+	std::shared_ptr<GstLibcameraSyncGroup> syncGroup_;
+	std::unique_ptr<RequestWrap> syncPending_;
 
 	ControlList initControls_;
 	guint group_id_;
@@ -138,11 +219,19 @@ struct GstLibcameraSrcState {
 struct _GstLibcameraSrc {
 	GstElement parent;
 
+	/*
+	 * Protects the pads list. The task has its own lock, to avoid holding
+	 * the stream_lock while pushing buffers downstream.
+	 */
 	GRecMutex stream_lock;
+	GRecMutex task_lock;
 	GstTask *task;
 
 	gchar *camera_name;
 	controls::AfModeEnum auto_focus_mode = controls::AfModeManual;
+	guint max_inflight_requests;
+	gchar *sync_group;
+	guint64 sync_tolerance;
 
 	std::atomic<GstEvent *> pending_eos;
 
@@ -155,6 +244,9 @@ enum {
 	PROP_0,
 	PROP_CAMERA_NAME,
 	PROP_AUTO_FOCUS_MODE,
+	PROP_MAX_INFLIGHT_REQUESTS,
+	PROP_SYNC_GROUP,
+	PROP_SYNC_TOLERANCE,
 };
 
 static void gst_libcamera_src_child_proxy_init(gpointer g_iface,
@@ -181,12 +273,23 @@ GstStaticPadTemplate request_src_template = {
 /* Must be called with stream_lock held. */
 int GstLibcameraSrcState::queueRequest()
 {
-	std::unique_ptr<Request> request = cam_->createRequest();
-	if (!request)
-		return -ENOMEM;
+	guint max_requests;
+	{
+		GLibLocker lock(GST_OBJECT(src_));
+		max_requests = src_->max_inflight_requests;
+	}
 
-	std::unique_ptr<RequestWrap> wrap =
-		std::make_unique<RequestWrap>(std::move(request));
+	/*
+	 * Limit the number of requests in flight when requested, the task is
+	 * resumed when a request completes.
+	 */
+	if (max_requests && queuedRequests_ >= max_requests)
+		return -ENOBUFS;
+
+	std::unique_ptr<RequestWrap> wrap = std::make_unique<RequestWrap>();
+	wrap->request_ = cam_->createRequest(reinterpret_cast<uintptr_t>(wrap.get()));
+	if (!wrap->request_)
+		return -ENOMEM;
 
 	for (GstPad *srcpad : srcpads_) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
@@ -208,14 +311,18 @@ int GstLibcameraSrcState::queueRequest()
 	}
 
 	GST_TRACE_OBJECT(src_, "Requesting buffers");
-	cam_->queueRequest(wrap->request_.get());
 
-	{
-		GLibLocker locker(&lock_);
-		queuedRequests_.push(std::move(wrap));
+	queuedRequests_++;
+	int ret = cam_->queueRequest(wrap->request_.get());
+	if (ret) {
+		queuedRequests_--;
+		GST_WARNING_OBJECT(src_, "Failed to queue request: %s",
+				   g_strerror(-ret));
+		return -ENOBUFS;
 	}
 
 	/* The RequestWrap will be deleted in the completion handler. */
+	wrap.release();
 	return 0;
 }
 
@@ -224,13 +331,8 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 {
 	GST_DEBUG_OBJECT(src_, "buffers are ready");
 
-	std::unique_ptr<RequestWrap> wrap;
-
-	{
-		GLibLocker locker(&lock_);
-		wrap = std::move(queuedRequests_.front());
-		queuedRequests_.pop();
-	}
+	std::unique_ptr<RequestWrap> wrap(reinterpret_cast<RequestWrap *>(request->cookie()));
+	queuedRequests_--;
 
 	g_return_if_fail(wrap->request_.get() == request);
 
@@ -239,9 +341,10 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 		return;
 	}
 
-	if (GST_ELEMENT_CLOCK(src_)) {
-		int64_t timestamp = request->metadata().get(controls::SensorTimestamp).value_or(0);
+	int64_t timestamp = request->metadata().get(controls::SensorTimestamp).value_or(0);
+	wrap->sensorTimestamp_ = timestamp;
 
+	if (GST_ELEMENT_CLOCK(src_)) {
 		GstClockTime gst_base_time = GST_ELEMENT(src_)->base_time;
 		GstClockTime gst_now = gst_clock_get_time(GST_ELEMENT_CLOCK(src_));
 		/* \todo Need to expose which reference clock the timestamp relates to. */
@@ -250,50 +353,78 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 		/* Deduced from: sys_now - sys_base_time == gst_now - gst_base_time */
 		GstClockTime sys_base_time = sys_now - (gst_now - gst_base_time);
 		wrap->pts_ = timestamp - sys_base_time;
-		wrap->latency_ = sys_now - timestamp;
-	}
-
-	{
-		GLibLocker locker(&lock_);
-		completedRequests_.push(std::move(wrap));
 	}
 
-	gst_task_resume(src_->task);
+	/*
+	 * Only wake the task when the queue becomes non-empty, the task
+	 * processes all the requests it contains before pausing.
+	 */
+	if (completedRequests_.push(std::move(wrap)))
+		gst_task_resume(src_->task);
 }
 
-/* Must be called with stream_lock held. */
+/*
+ * Must be called without stream_lock held, which is only taken to access the
+ * pads and not to push the buffers downstream.
+ */
 int GstLibcameraSrcState::processRequest()
 {
-	std::unique_ptr<RequestWrap> wrap;
-	int err = 0;
+	std::unique_ptr<RequestWrap> wrap = std::move(syncPending_);
+	if (!wrap)
+		wrap = completedRequests_.pop();
+	if (!wrap)
+		return -ENOBUFS;
 
-	{
-		GLibLocker locker(&lock_);
+	if (syncGroup_) {
+		GstClockTime pts = wrap->pts_;
 
-		if (!completedRequests_.empty()) {
-			wrap = std::move(completedRequests_.front());
-			completedRequests_.pop();
-		}
+		switch (syncGroup_->submit(src_->task, wrap->sensorTimestamp_, &pts)) {
+		case GstLibcameraSyncGroup::Action::Wait:
+			/* The sync group resumes the task when it changes. */
+			syncPending_ = std::move(wrap);
+			return -ENOBUFS;
 
-		if (completedRequests_.empty())
-			err = -ENOBUFS;
+		case GstLibcameraSyncGroup::Action::Drop:
+			GST_DEBUG_OBJECT(src_, "Dropping unmatched frame");
+			return completedRequests_.empty() ? -ENOBUFS : 0;
+
+		case GstLibcameraSyncGroup::Action::Push:
+			wrap->pts_ = pts;
+			break;
+		}
 	}
 
-	if (!wrap)
-		return -ENOBUFS;
+	int err = completedRequests_.empty() ? -ENOBUFS : 0;
+
+	std::vector<GstPad *> srcpads;
+	{
+		GLibRecLocker lock(&src_->stream_lock);
+		for (GstPad *srcpad : srcpads_)
+			srcpads.push_back(GST_PAD(gst_object_ref(srcpad)));
+	}
 
 	GstFlowReturn ret = GST_FLOW_OK;
 	gst_flow_combiner_reset(src_->flow_combiner);
 
-	for (GstPad *srcpad : srcpads_) {
+	bool latency_changed = false;
+
+	for (GstPad *srcpad : srcpads) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
 		GstBuffer *buffer = wrap->detachBuffer(stream);
 
+		/* The pad may have been released in the meantime. */
+		if (!buffer)
+			continue;
+
 		FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
 
 		if (GST_CLOCK_TIME_IS_VALID(wrap->pts_)) {
 			GST_BUFFER_PTS(buffer) = wrap->pts_;
-			gst_libcamera_pad_set_latency(srcpad, wrap->latency_);
+
+			/* Measure the delay between the capture and the push. */
+			GstClockTime sys_now = g_get_monotonic_time() * 1000;
+			if (gst_libcamera_pad_set_latency(srcpad, sys_now - wrap->sensorTimestamp_))
+				latency_changed = true;
 		} else {
 			GST_BUFFER_PTS(buffer) = 0;
 		}
@@ -306,11 +437,22 @@ int GstLibcameraSrcState::processRequest()
 							srcpad, ret);
 	}
 
+	for (GstPad *srcpad : srcpads)
+		gst_object_unref(srcpad);
+
+	/* Let the pipeline query the latency again. */
+	if (latency_changed) {
+		GST_DEBUG_OBJECT(src_, "Latency changed");
+		gst_element_post_message(GST_ELEMENT(src_),
+					 gst_message_new_latency(GST_OBJECT(src_)));
+	}
+
 	switch (ret) {
 	case GST_FLOW_OK:
 		break;
 
 	case GST_FLOW_NOT_NEGOTIATED: {
+		GLibRecLocker lock(&src_->stream_lock);
 		bool reconfigure = false;
 		for (GstPad *srcpad : srcpads_) {
 			if (gst_pad_needs_reconfigure(srcpad)) {
@@ -330,6 +472,8 @@ int GstLibcameraSrcState::processRequest()
 		g_autoptr(GstEvent) eos = gst_event_new_eos();
 		guint32 seqnum = gst_util_seqnum_next();
 		gst_event_set_seqnum(eos, seqnum);
+
+		GLibRecLocker lock(&src_->stream_lock);
 		for (GstPad *srcpad : srcpads_)
 			gst_pad_push_event(srcpad, gst_event_ref(eos));
 
@@ -353,8 +497,8 @@ int GstLibcameraSrcState::processRequest()
 
 void GstLibcameraSrcState::clearRequests()
 {
-	GLibLocker locker(&lock_);
-	completedRequests_ = {};
+	syncPending_.reset();
+	completedRequests_.clear();
 }
 
 static bool
@@ -419,6 +563,105 @@ gst_libcamera_src_open(GstLibcameraSrc *self)
 	return true;
 }
 
+/*
+ * Retrieve the stride alignment required by downstream for the first plane,
+ * as a mask, from the video meta parameters of the allocation query.
+ */
+static guint
+gst_libcamera_src_get_stride_align(GstQuery *query)
+{
+	guint index;
+	if (!gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, &index))
+		return 0;
+
+	const GstStructure *params;
+	gst_query_parse_nth_allocation_meta(query, index, &params);
+
+	guint align = 0;
+	if (params)
+		gst_structure_get_uint(params, "stride-align0", &align);
+
+	return align;
+}
+
+/*
+ * Retrieve the buffer pool proposed by downstream for a stream, if its buffers
+ * can be imported by the camera. This requires dmabuf-backed raw video buffers
+ * with the same layout as the buffers produced by the camera, described by
+ * info.
+ */
+static GstBufferPool *
+gst_libcamera_src_get_import_pool(GstLibcameraSrc *self, GstQuery *query,
+				  GstCaps *caps, const GstVideoInfo &info,
+				  const StreamConfiguration &stream_cfg,
+				  guint *pool_size)
+{
+	if (!gst_query_get_n_allocation_pools(query))
+		return nullptr;
+
+	GstBufferPool *pool;
+	guint size, min, max;
+	gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+	if (!pool)
+		return nullptr;
+
+	if (!gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_VIDEO_META)) {
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	/* The pool must provide the buffers queued to the camera at least. */
+	min = std::max(min, stream_cfg.bufferCount);
+	if (max && max < min) {
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	GstStructure *config = gst_buffer_pool_get_config(pool);
+	gst_buffer_pool_config_set_params(config, caps,
+					  std::max<gsize>({ size, stream_cfg.frameSize,
+							    GST_VIDEO_INFO_SIZE(&info) }),
+					  min, max);
+	gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+	if (!gst_buffer_pool_set_config(pool, config) ||
+	    !gst_buffer_pool_set_active(pool, TRUE)) {
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	/* Check the layout of the buffers against the one of the camera. */
+	GstBuffer *buffer;
+	bool usable = false;
+	if (gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr) == GST_FLOW_OK) {
+		GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+
+		usable = meta && meta->n_planes == GST_VIDEO_INFO_N_PLANES(&info);
+		for (guint i = 0; usable && i < meta->n_planes; i++) {
+			usable = meta->offset[i] == GST_VIDEO_INFO_PLANE_OFFSET(&info, i) &&
+				 meta->stride[i] == GST_VIDEO_INFO_PLANE_STRIDE(&info, i);
+		}
+
+		for (guint i = 0; usable && i < gst_buffer_n_memory(buffer); i++)
+			usable = gst_is_dmabuf_memory(gst_buffer_peek_memory(buffer, i));
+
+		gst_buffer_unref(buffer);
+	}
+
+	if (!usable) {
+		gst_buffer_pool_set_active(pool, FALSE);
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	GST_INFO_OBJECT(self, "Importing buffers from downstream pool %" GST_PTR_FORMAT,
+			pool);
+
+	*pool_size = max ? max : min;
+
+	return pool;
+}
+
 /* Must be called with stream_lock held. */
 static bool
 gst_libcamera_src_negotiate(GstLibcameraSrc *self)
@@ -441,6 +684,10 @@ gst_libcamera_src_negotiate(GstLibcameraSrc *self)
 		caps = gst_caps_make_writable(caps);
 		gst_libcamera_configure_stream_from_caps(stream_cfg, caps);
 		gst_libcamera_get_framerate_from_caps(caps, element_caps);
+
+		guint buffer_count = gst_libcamera_pad_get_buffer_count(srcpad);
+		if (buffer_count)
+			stream_cfg.bufferCount = buffer_count;
 	}
 
 	/* Validate the configuration. */
@@ -463,43 +710,157 @@ gst_libcamera_src_negotiate(GstLibcameraSrc *self)
 	 * Regardless if it has been modified, create clean caps and push the
 	 * caps event. Downstream will decide if the caps are acceptable.
 	 */
-	for (gsize i = 0; i < state->srcpads_.size(); i++) {
+	gsize n_pads = state->srcpads_.size();
+	std::vector<GstCaps *> pad_caps(n_pads, nullptr);
+	std::vector<GstQuery *> queries(n_pads, nullptr);
+	std::vector<GstBufferPool *> import_pools(n_pads, nullptr);
+	std::vector<guint> import_pool_sizes(n_pads, 0);
+	std::vector<Stream *> imported_streams;
+	bool restride = false;
+
+	auto clear_allocation_state = [&]() {
+		for (GstBufferPool *pool : import_pools) {
+			if (!pool)
+				continue;
+
+			gst_buffer_pool_set_active(pool, FALSE);
+			gst_object_unref(pool);
+		}
+
+		for (GstQuery *query : queries) {
+			if (query)
+				gst_query_unref(query);
+		}
+
+		for (GstCaps *caps : pad_caps) {
+			if (caps)
+				gst_caps_unref(caps);
+		}
+	};
+
+	for (gsize i = 0; i < n_pads; i++) {
 		GstPad *srcpad = state->srcpads_[i];
-		const StreamConfiguration &stream_cfg = state->config_->at(i);
+		StreamConfiguration &stream_cfg = state->config_->at(i);
 
-		g_autoptr(GstCaps) caps = gst_libcamera_stream_configuration_to_caps(stream_cfg);
+		GstCaps *caps = gst_libcamera_stream_configuration_to_caps(stream_cfg);
 		gst_libcamera_framerate_to_caps(caps, element_caps);
+		pad_caps[i] = caps;
 
-		if (!gst_pad_push_event(srcpad, gst_event_new_caps(caps)))
+		if (!gst_pad_push_event(srcpad, gst_event_new_caps(caps))) {
+			clear_allocation_state();
 			return false;
+		}
+
+		GstQuery *query = gst_query_new_allocation(caps, TRUE);
+		if (!gst_pad_peer_query(srcpad, query)) {
+			gst_query_unref(query);
+			continue;
+		}
+
+		queries[i] = query;
+
+		/*
+		 * Request a stride matching the alignment required downstream,
+		 * the stride isn't part of the caps and can be changed without
+		 * renegotiating.
+		 */
+		guint align = gst_libcamera_src_get_stride_align(query);
+		if (align && (stream_cfg.stride & align)) {
+			stream_cfg.stride = (stream_cfg.stride + align) & ~align;
+			restride = true;
+		}
+	}
+
+	/*
+	 * Reconfigure the camera with the strides required downstream. The
+	 * pipeline handler may not honour them, in which case the buffers are
+	 * still produced with a stride described by their video meta.
+	 */
+	if (restride) {
+		GST_DEBUG_OBJECT(self, "Reconfiguring the camera with downstream strides");
+
+		if (state->config_->validate() == CameraConfiguration::Invalid ||
+		    state->cam_->configure(state->config_.get())) {
+			clear_allocation_state();
+			GST_ELEMENT_ERROR(self, RESOURCE, SETTINGS,
+					  ("Failed to configure camera with the downstream strides"),
+					  ("Camera::configure() failed"));
+			return false;
+		}
+	}
+
+	std::vector<GstVideoInfo> infos(n_pads);
+	std::vector<bool> has_info(n_pads, false);
+
+	for (gsize i = 0; i < n_pads; i++) {
+		const StreamConfiguration &stream_cfg = state->config_->at(i);
+
+		has_info[i] = gst_libcamera_stream_configuration_to_video_info(stream_cfg, pad_caps[i],
+									       &infos[i]);
+		if (!has_info[i] || !queries[i])
+			continue;
+
+		if (!gst_query_find_allocation_meta(queries[i], GST_VIDEO_META_API_TYPE, nullptr) &&
+		    GST_VIDEO_INFO_PLANE_STRIDE(&infos[i], 0) != static_cast<gint>(stream_cfg.stride))
+			GST_WARNING_OBJECT(self, "Downstream doesn't support video meta, "
+					   "the stride of %u may not be honoured",
+					   stream_cfg.stride);
+
+		/*
+		 * Import the buffers of the pool proposed by downstream when
+		 * possible, to capture frames directly to the memory of the
+		 * consumer. Fall back to buffers allocated from the camera
+		 * otherwise.
+		 */
+		import_pools[i] = gst_libcamera_src_get_import_pool(self, queries[i], pad_caps[i],
+								    infos[i], stream_cfg,
+								    &import_pool_sizes[i]);
+		if (import_pools[i])
+			imported_streams.push_back(stream_cfg.stream());
 	}
 
 	if (self->allocator)
 		g_clear_object(&self->allocator);
 
-	self->allocator = gst_libcamera_allocator_new(state->cam_, state->config_.get());
+	self->allocator = gst_libcamera_allocator_new(state->cam_, state->config_.get(),
+						      imported_streams);
 	if (!self->allocator) {
+		clear_allocation_state();
 		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
 				  ("Failed to allocate memory"),
 				  ("gst_libcamera_allocator_new() failed."));
 		return false;
 	}
 
-	for (gsize i = 0; i < state->srcpads_.size(); i++) {
+	for (gsize i = 0; i < n_pads; i++) {
 		GstPad *srcpad = state->srcpads_[i];
 		const StreamConfiguration &stream_cfg = state->config_->at(i);
 
-		GstLibcameraPool *pool = gst_libcamera_pool_new(self->allocator,
-								stream_cfg.stream());
+		/* The pool takes ownership of the downstream pool. */
+		GstLibcameraPool *pool =
+			import_pools[i]
+				? gst_libcamera_pool_new_import(import_pools[i],
+								stream_cfg.stream(),
+								import_pool_sizes[i])
+				: gst_libcamera_pool_new(self->allocator,
+							 stream_cfg.stream());
+		import_pools[i] = nullptr;
+
+		if (has_info[i])
+			gst_libcamera_pool_set_video_info(pool, &infos[i]);
+
 		g_signal_connect_swapped(pool, "buffer-notify",
 					 G_CALLBACK(gst_task_resume), self->task);
 
 		gst_libcamera_pad_set_pool(srcpad, pool);
+		gst_libcamera_pad_reset_latency(srcpad);
 
 		/* Clear all reconfigure flags. */
 		gst_pad_check_reconfigure(srcpad);
 	}
 
+	clear_allocation_state();
+
 	return true;
 }
 
@@ -522,67 +883,77 @@ gst_libcamera_src_task_run(gpointer user_data)
 	gst_task_pause(self->task);
 
 	bool doResume = false;
+	int ret;
 
-	g_autoptr(GstEvent) event = self->pending_eos.exchange(nullptr);
-	if (event) {
-		for (GstPad *srcpad : state->srcpads_)
-			gst_pad_push_event(srcpad, gst_event_ref(event));
+	/*
+	 * The stream_lock is held while accessing the pads, but not while
+	 * processing the completed requests, to avoid blocking the pads
+	 * requests and releases while pushing buffers downstream.
+	 */
+	{
+		GLibRecLocker lock(&self->stream_lock);
 
-		return;
-	}
+		g_autoptr(GstEvent) event = self->pending_eos.exchange(nullptr);
+		if (event) {
+			for (GstPad *srcpad : state->srcpads_)
+				gst_pad_push_event(srcpad, gst_event_ref(event));
 
-	/* Check if a srcpad requested a renegotiation. */
-	bool reconfigure = false;
-	for (GstPad *srcpad : state->srcpads_) {
-		if (gst_pad_check_reconfigure(srcpad)) {
-			/* Check if the caps even need changing. */
-			g_autoptr(GstCaps) caps = gst_pad_get_current_caps(srcpad);
-			if (!gst_pad_peer_query_accept_caps(srcpad, caps)) {
-				reconfigure = true;
-				break;
+			return;
+		}
+
+		/* Check if a srcpad requested a renegotiation. */
+		bool reconfigure = false;
+		for (GstPad *srcpad : state->srcpads_) {
+			if (gst_pad_check_reconfigure(srcpad)) {
+				/* Check if the caps even need changing. */
+				g_autoptr(GstCaps) caps = gst_pad_get_current_caps(srcpad);
+				if (!gst_pad_peer_query_accept_caps(srcpad, caps)) {
+					reconfigure = true;
+					break;
+				}
 			}
 		}
-	}
 
-	if (reconfigure) {
-		state->cam_->stop();
-		state->clearRequests();
+		if (reconfigure) {
+			state->cam_->stop();
+			state->clearRequests();
 
-		if (!gst_libcamera_src_negotiate(self)) {
-			GST_ELEMENT_FLOW_ERROR(self, GST_FLOW_NOT_NEGOTIATED);
-			gst_task_stop(self->task);
-		}
+			if (!gst_libcamera_src_negotiate(self)) {
+				GST_ELEMENT_FLOW_ERROR(self, GST_FLOW_NOT_NEGOTIATED);
+				gst_task_stop(self->task);
+			}
 
-		state->cam_->start(&state->initControls_);
-	}
+			state->cam_->start(&state->initControls_);
+		}
 
-	/*
-	 * Create and queue one request. If no buffers are available the
-	 * function returns -ENOBUFS, which we ignore here as that's not a
-	 * fatal error.
-	 */
-	int ret = state->queueRequest();
-	switch (ret) {
-	case 0:
 		/*
-		 * The request was successfully queued, there may be enough
-		 * buffers to create a new one. Don't pause the task to give it
-		 * another try.
+		 * Create and queue one request. If no buffers are available
+		 * the function returns -ENOBUFS, which we ignore here as that's
+		 * not a fatal error.
 		 */
-		doResume = true;
-		break;
-
-	case -ENOMEM:
-		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
-				  ("Failed to allocate request for camera '%s'.",
-				   state->cam_->id().c_str()),
-				  ("libcamera::Camera::createRequest() failed"));
-		gst_task_stop(self->task);
-		return;
+		ret = state->queueRequest();
+		switch (ret) {
+		case 0:
+			/*
+			 * The request was successfully queued, there may be
+			 * enough buffers to create a new one. Don't pause the
+			 * task to give it another try.
+			 */
+			doResume = true;
+			break;
+
+		case -ENOMEM:
+			GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
+					  ("Failed to allocate request for camera '%s'.",
+					   state->cam_->id().c_str()),
+					  ("libcamera::Camera::createRequest() failed"));
+			gst_task_stop(self->task);
+			return;
 
-	case -ENOBUFS:
-	default:
-		break;
+		case -ENOBUFS:
+		default:
+			break;
+		}
 	}
 
 	/*
@@ -683,6 +1054,21 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		gst_task_stop(task);
 		return;
 	}
+
+	g_autofree gchar *sync_group = nullptr;
+	GstClockTime sync_tolerance;
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		sync_group = g_strdup(self->sync_group);
+		sync_tolerance = self->sync_tolerance;
+	}
+
+	if (sync_group && *sync_group) {
+		GST_DEBUG_OBJECT(self, "Joining sync group '%s'", sync_group);
+
+		state->syncGroup_ = GstLibcameraSyncGroup::get(sync_group);
+		state->syncGroup_->join(task, sync_tolerance);
+	}
 }
 
 static void
@@ -698,6 +1084,11 @@ gst_libcamera_src_task_leave([[maybe_unused]] GstTask *task,
 	state->cam_->stop();
 	state->clearRequests();
 
+	if (state->syncGroup_) {
+		state->syncGroup_->leave(task);
+		state->syncGroup_.reset();
+	}
+
 	{
 		GLibRecLocker locker(&self->stream_lock);
 		for (GstPad *srcpad : state->srcpads_)
@@ -745,6 +1136,16 @@ gst_libcamera_src_set_property(GObject *object, guint prop_id,
 	case PROP_AUTO_FOCUS_MODE:
 		self->auto_focus_mode = static_cast<controls::AfModeEnum>(g_value_get_enum(value));
 		break;
+	case PROP_MAX_INFLIGHT_REQUESTS:
+		self->max_inflight_requests = g_value_get_uint(value);
+		break;
+	case PROP_SYNC_GROUP:
+		g_free(self->sync_group);
+		self->sync_group = g_value_dup_string(value);
+		break;
+	case PROP_SYNC_TOLERANCE:
+		self->sync_tolerance = g_value_get_uint64(value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -765,6 +1166,15 @@ gst_libcamera_src_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_AUTO_FOCUS_MODE:
 		g_value_set_enum(value, static_cast<gint>(self->auto_focus_mode));
 		break;
+	case PROP_MAX_INFLIGHT_REQUESTS:
+		g_value_set_uint(value, self->max_inflight_requests);
+		break;
+	case PROP_SYNC_GROUP:
+		g_value_set_string(value, self->sync_group);
+		break;
+	case PROP_SYNC_TOLERANCE:
+		g_value_set_uint64(value, self->sync_tolerance);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -848,9 +1258,10 @@ gst_libcamera_src_finalize(GObject *object)
 	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(object);
 
 	g_rec_mutex_clear(&self->stream_lock);
+	g_rec_mutex_clear(&self->task_lock);
 	g_clear_object(&self->task);
-	g_mutex_clear(&self->state->lock_);
 	g_free(self->camera_name);
+	g_free(self->sync_group);
 	delete self->state;
 
 	return klass->finalize(object);
@@ -863,12 +1274,11 @@ gst_libcamera_src_init(GstLibcameraSrc *self)
 	GstPadTemplate *templ = gst_element_get_pad_template(GST_ELEMENT(self), "src");
 
 	g_rec_mutex_init(&self->stream_lock);
+	g_rec_mutex_init(&self->task_lock);
 	self->task = gst_task_new(gst_libcamera_src_task_run, self, nullptr);
 	gst_task_set_enter_callback(self->task, gst_libcamera_src_task_enter, self, nullptr);
 	gst_task_set_leave_callback(self->task, gst_libcamera_src_task_leave, self, nullptr);
-	gst_task_set_lock(self->task, &self->stream_lock);
-
-	g_mutex_init(&state->lock_);
+	gst_task_set_lock(self->task, &self->task_lock);
 
 	GstPad *pad = gst_pad_new_from_template(templ, "src");
 	state->srcpads_.push_back(pad);
@@ -975,6 +1385,33 @@ gst_libcamera_src_class_init(GstLibcameraSrcClass *klass)
 				 static_cast<gint>(controls::AfModeManual),
 				 G_PARAM_WRITABLE);
 	g_object_class_install_property(object_class, PROP_AUTO_FOCUS_MODE, spec);
+
+	spec = g_param_spec_uint("max-inflight-requests", "Max In-flight Requests",
+				 "The maximum number of requests queued to the camera, "
+				 "which trades robustness for latency (0 = unlimited)",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(GST_PARAM_MUTABLE_PLAYING
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_MAX_INFLIGHT_REQUESTS, spec);
+
+	spec = g_param_spec_string("sync-group", "Sync Group",
+				   "Push the frames in lockstep with the other sources "
+				   "of the same group, matched by sensor timestamp", nullptr,
+				   (GParamFlags)(GST_PARAM_MUTABLE_READY
+						 | G_PARAM_READWRITE
+						 | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_SYNC_GROUP, spec);
+
+	spec = g_param_spec_uint64("sync-tolerance", "Sync Tolerance",
+				   "The maximum difference between the sensor timestamps "
+				   "of matched frames in a sync group, in nanoseconds",
+				   0, G_MAXUINT64, 1000000,
+				   (GParamFlags)(GST_PARAM_MUTABLE_READY
+						 | G_PARAM_CONSTRUCT
+						 | G_PARAM_READWRITE
+						 | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_SYNC_TOLERANCE, spec);
 }
 
 /* GstChildProxy implementation */
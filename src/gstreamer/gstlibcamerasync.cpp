@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Synchronization of the frames of multiple cameras
+ */
+
+#include "gstlibcamerasync.h"
+
+#include <algorithm>
+#include <map>
+
+#include "gstlibcamera-utils.h"
+
+/* The groups are shared by all the elements of the process, by name. */
+G_LOCK_DEFINE_STATIC(groups_lock);
+static std::map<std::string, std::weak_ptr<GstLibcameraSyncGroup>> groups;
+
+std::shared_ptr<GstLibcameraSyncGroup>
+GstLibcameraSyncGroup::get(const std::string &name)
+{
+	G_LOCK(groups_lock);
+
+	std::shared_ptr<GstLibcameraSyncGroup> group = groups[name].lock();
+	if (!group) {
+		group = std::make_shared<GstLibcameraSyncGroup>(name);
+		groups[name] = group;
+	}
+
+	G_UNLOCK(groups_lock);
+
+	return group;
+}
+
+GstLibcameraSyncGroup::GstLibcameraSyncGroup(const std::string &name)
+	: name_(name), matchedPts_(GST_CLOCK_TIME_NONE)
+{
+	g_mutex_init(&lock_);
+}
+
+GstLibcameraSyncGroup::~GstLibcameraSyncGroup()
+{
+	G_LOCK(groups_lock);
+
+	/* The entry may already have been replaced by a new group. */
+	auto it = groups.find(name_);
+	if (it != groups.end() && it->second.expired())
+		groups.erase(it);
+
+	G_UNLOCK(groups_lock);
+
+	g_mutex_clear(&lock_);
+}
+
+/*
+ * Add the streaming task of an element to the group. The task is resumed when
+ * the state of the group changes and the frame it waits for may be pushed or
+ * dropped.
+ */
+void GstLibcameraSyncGroup::join(GstTask *task, GstClockTime tolerance)
+{
+	GLibLocker lock(&lock_);
+
+	members_.push_back({ task, tolerance, false, false, 0, GST_CLOCK_TIME_NONE });
+}
+
+void GstLibcameraSyncGroup::leave(GstTask *task)
+{
+	GLibLocker lock(&lock_);
+
+	members_.erase(std::remove_if(members_.begin(), members_.end(),
+				      [task](const Member &member) {
+					      return member.task == task;
+				      }),
+		       members_.end());
+
+	/* The frames of the remaining members may now be matched. */
+	for (Member &member : members_)
+		gst_task_resume(member.task);
+}
+
+/*
+ * Submit the next frame of a member, identified by its sensor timestamp. The
+ * frame is pushed, with the PTS of the group stored in \a pts, when all the
+ * members have a frame within the tolerance of the group. A frame older than
+ * the newest frame of the group by more than the tolerance can't be matched
+ * anymore and is dropped. Otherwise the member must wait for its task to be
+ * resumed and submit the same frame again.
+ */
+GstLibcameraSyncGroup::Action
+GstLibcameraSyncGroup::submit(GstTask *task, GstClockTime timestamp,
+			      GstClockTime *pts)
+{
+	GLibLocker lock(&lock_);
+
+	Member *member = find(task);
+	if (!member || members_.size() < 2)
+		return Action::Push;
+
+	if (member->matched) {
+		member->matched = false;
+		member->hasFrame = false;
+		*pts = matchedPts_;
+		return Action::Push;
+	}
+
+	member->hasFrame = true;
+	member->timestamp = timestamp;
+	member->pts = *pts;
+
+	GstClockTime tol = tolerance();
+	GstClockTime newest = 0;
+	GstClockTime oldest = GST_CLOCK_TIME_NONE;
+	bool complete = true;
+
+	/*
+	 * The frames of a previous match that haven't been pushed yet don't
+	 * take part in the next match.
+	 */
+	for (const Member &m : members_) {
+		if (!m.hasFrame || m.matched) {
+			complete = false;
+			continue;
+		}
+
+		newest = std::max(newest, m.timestamp);
+		oldest = std::min(oldest, m.timestamp);
+	}
+
+	if (member->timestamp + tol < newest) {
+		member->hasFrame = false;
+		return Action::Drop;
+	}
+
+	if (!complete)
+		return Action::Wait;
+
+	if (newest - oldest <= tol) {
+		matchedPts_ = GST_CLOCK_TIME_NONE;
+		for (const Member &m : members_)
+			matchedPts_ = std::min(matchedPts_, m.pts);
+
+		for (Member &m : members_) {
+			if (&m == member)
+				continue;
+
+			m.matched = true;
+			gst_task_resume(m.task);
+		}
+
+		member->hasFrame = false;
+		*pts = matchedPts_;
+		return Action::Push;
+	}
+
+	/* Wake the members whose frames are too old to be matched. */
+	for (Member &m : members_) {
+		if (m.timestamp + tol < newest)
+			gst_task_resume(m.task);
+	}
+
+	return Action::Wait;
+}
+
+GstLibcameraSyncGroup::Member *GstLibcameraSyncGroup::find(GstTask *task)
+{
+	for (Member &member : members_) {
+		if (member.task == task)
+			return &member;
+	}
+
+	return nullptr;
+}
+
+GstClockTime GstLibcameraSyncGroup::tolerance() const
+{
+	GstClockTime tolerance = 0;
+
+	for (const Member &member : members_)
+		tolerance = std::max(tolerance, member.tolerance);
+
+	return tolerance;
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Synchronization of the frames of multiple cameras
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gst/gst.h>
+
+/*
+ * A group of libcamerasrc elements whose frames are pushed in lockstep. Each
+ * member submits the sensor timestamp of its next frame, which is held until
+ * all the members have a frame captured within the tolerance of the group.
+ * The frames of a match are then pushed with the same PTS, frames that can't
+ * be matched anymore are dropped.
+ */
+class GstLibcameraSyncGroup
+{
+public:
+	enum class Action {
+		Wait,
+		Drop,
+		Push,
+	};
+
+	static std::shared_ptr<GstLibcameraSyncGroup> get(const std::string &name);
+
+	GstLibcameraSyncGroup(const std::string &name);
+	~GstLibcameraSyncGroup();
+
+	const std::string &name() const { return name_; }
+
+	void join(GstTask *task, GstClockTime tolerance);
+	void leave(GstTask *task);
+
+	Action submit(GstTask *task, GstClockTime timestamp, GstClockTime *pts);
+
+private:
+	struct Member {
+		GstTask *task;
+		GstClockTime tolerance;
+
+		bool hasFrame;
+		bool matched;
+		GstClockTime timestamp;
+		GstClockTime pts;
+	};
+
+	Member *find(GstTask *task);
+	GstClockTime tolerance() const;
+
+	std::string name_;
+
+	/* Protects the members and the matched PTS */
+	GMutex lock_;
+	std::vector<Member> members_;
+	GstClockTime matchedPts_;
+};
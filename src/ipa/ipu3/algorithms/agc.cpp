@@ -122,8 +122,8 @@ int Agc::configure(IPAContext &context,
 	return 0;
 }
 
-Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
-			       const ipu3_uapi_grid_config &grid)
+void Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
+			  const ipu3_uapi_grid_config &grid)
 {
 	uint32_t hist[knumHistogramBins] = { 0 };
 
@@ -152,7 +152,7 @@ Histogram Agc::parseStatistics(const ipu3_uapi_stats_3a *stats,
 		}
 	}
 
-	return Histogram(Span<uint32_t>(hist));
+	histogram_.update(hist);
 }
 
 /**
@@ -208,7 +208,7 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 		  const ipu3_uapi_stats_3a *stats,
 		  ControlList &metadata)
 {
-	Histogram hist = parseStatistics(stats, context.configuration.grid.bdsGrid);
+	parseStatistics(stats, context.configuration.grid.bdsGrid);
 	rGain_ = context.activeState.awb.gains.red;
 	gGain_ = context.activeState.awb.gains.blue;
 	bGain_ = context.activeState.awb.gains.green;
@@ -226,7 +226,7 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	double aGain, dGain;
 	std::tie(shutterTime, aGain, dGain) =
 		calculateNewEv(context.activeState.agc.constraintMode,
-			       context.activeState.agc.exposureMode, hist,
+			       context.activeState.agc.exposureMode, histogram_,
 			       effectiveExposureValue);
 
 	LOG(IPU3Agc, Debug)
@@ -39,8 +39,8 @@ public:
 
 private:
 	double estimateLuminance(double gain) const override;
-	Histogram parseStatistics(const ipu3_uapi_stats_3a *stats,
-				  const ipu3_uapi_grid_config &grid);
+	void parseStatistics(const ipu3_uapi_stats_3a *stats,
+			     const ipu3_uapi_grid_config &grid);
 
 	utils::Duration minShutterSpeed_;
 	utils::Duration maxShutterSpeed_;
@@ -54,6 +54,7 @@ private:
 	double bGain_;
 	ipu3_uapi_grid_config bdsGrid_;
 	std::vector<std::tuple<uint8_t, uint8_t, uint8_t>> rgbTriples_;
+	Histogram histogram_;
 };
 
 } /* namespace ipa::ipu3::algorithms */
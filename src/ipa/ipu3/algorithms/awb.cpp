@@ -356,38 +356,58 @@ void Awb::generateAwbStats(const ipu3_uapi_stats_3a *stats)
 	/*
 	 * Generate a (kAwbStatsSizeX x kAwbStatsSizeY) array from the IPU3 grid which is
 	 * (grid.width x grid.height).
+	 *
+	 * The grid is walked one row of cells at a time, the cells of a zone
+	 * being contiguous in memory. Saturated cells are masked out instead of
+	 * being skipped, which keeps the inner loop free of branches and lets
+	 * the compiler vectorize it.
 	 */
-	for (unsigned int cellY = 0; cellY < kAwbStatsSizeY * cellsPerZoneY_; cellY++) {
-		for (unsigned int cellX = 0; cellX < kAwbStatsSizeX * cellsPerZoneX_; cellX++) {
-			uint32_t cellPosition = cellY * stride_ + cellX;
-			uint32_t zoneX = cellX / cellsPerZoneX_;
-			uint32_t zoneY = cellY / cellsPerZoneY_;
+	for (unsigned int zoneY = 0; zoneY < kAwbStatsSizeY; zoneY++) {
+		Accumulator *zones = &awbStats_[zoneY * kAwbStatsSizeX];
 
-			uint32_t awbZonePosition = zoneY * kAwbStatsSizeX + zoneX;
+		for (unsigned int y = 0; y < cellsPerZoneY_; y++) {
+			unsigned int cellY = zoneY * cellsPerZoneY_ + y;
 
 			/* Cast the initial IPU3 structure to simplify the reading */
-			const ipu3_uapi_awb_set_item *currentCell =
+			const ipu3_uapi_awb_set_item *row =
 				reinterpret_cast<const ipu3_uapi_awb_set_item *>(
-					&stats->awb_raw_buffer.meta_data[cellPosition]
+					&stats->awb_raw_buffer.meta_data[cellY * stride_]
 				);
 
-			/*
-			 * Use cells which have less than 90%
-			 * saturation as an initial means to include
-			 * otherwise bright cells which are not fully
-			 * saturated.
-			 *
-			 * \todo The 90% saturation rate may require
-			 * further empirical measurements and
-			 * optimisation during camera tuning phases.
-			 */
-			if (currentCell->sat_ratio <= kMinCellsPerZoneRatio) {
-				/* The cell is not saturated, use the current cell */
-				awbStats_[awbZonePosition].counted++;
-				uint32_t greenValue = currentCell->Gr_avg + currentCell->Gb_avg;
-				awbStats_[awbZonePosition].sum.green += greenValue / 2;
-				awbStats_[awbZonePosition].sum.red += currentCell->R_avg;
-				awbStats_[awbZonePosition].sum.blue += currentCell->B_avg;
+			for (unsigned int zoneX = 0; zoneX < kAwbStatsSizeX; zoneX++) {
+				const ipu3_uapi_awb_set_item *cells = row + zoneX * cellsPerZoneX_;
+				uint32_t counted = 0;
+				uint32_t red = 0;
+				uint32_t green = 0;
+				uint32_t blue = 0;
+
+				for (unsigned int x = 0; x < cellsPerZoneX_; x++) {
+					const ipu3_uapi_awb_set_item &cell = cells[x];
+
+					/*
+					 * Use cells which have less than 90%
+					 * saturation as an initial means to
+					 * include otherwise bright cells which
+					 * are not fully saturated.
+					 *
+					 * \todo The 90% saturation rate may
+					 * require further empirical
+					 * measurements and optimisation during
+					 * camera tuning phases.
+					 */
+					uint32_t valid = cell.sat_ratio <= kMinCellsPerZoneRatio;
+					uint32_t mask = -valid;
+
+					counted += valid;
+					green += ((cell.Gr_avg + cell.Gb_avg) / 2) & mask;
+					red += cell.R_avg & mask;
+					blue += cell.B_avg & mask;
+				}
+
+				zones[zoneX].counted += counted;
+				zones[zoneX].sum.green += green;
+				zones[zoneX].sum.red += red;
+				zones[zoneX].sum.blue += blue;
 			}
 		}
 	}
@@ -408,24 +428,34 @@ void Awb::awbGreyWorld()
 	LOG(IPU3Awb, Debug) << "Grey world AWB";
 	/*
 	 * Make a separate list of the derivatives for each of red and blue, so
-	 * that we can sort them to exclude the extreme gains. We could
+	 * that we can partition them to exclude the extreme gains. We could
 	 * consider some variations, such as normalising all the zones first, or
 	 * doing an L2 average etc.
 	 */
 	std::vector<RGB> &redDerivative(zones_);
 	std::vector<RGB> blueDerivative(redDerivative);
-	std::sort(redDerivative.begin(), redDerivative.end(),
-		  [](RGB const &a, RGB const &b) {
-			  return a.G * b.R < b.G * a.R;
-		  });
-	std::sort(blueDerivative.begin(), blueDerivative.end(),
-		  [](RGB const &a, RGB const &b) {
-			  return a.G * b.B < b.G * a.B;
-		  });
-
-	/* Average the middle half of the values. */
+
+	/*
+	 * Only the middle half of the values is averaged, its order doesn't
+	 * matter. Partition the lists around the first and last quarters
+	 * instead of sorting them fully.
+	 */
 	int discard = redDerivative.size() / 4;
 
+	auto partition = [discard](std::vector<RGB> &values, auto compare) {
+		std::nth_element(values.begin(), values.begin() + discard,
+				 values.end(), compare);
+		std::nth_element(values.begin() + discard, values.end() - discard,
+				 values.end(), compare);
+	};
+
+	partition(redDerivative, [](RGB const &a, RGB const &b) {
+		return a.G * b.R < b.G * a.R;
+	});
+	partition(blueDerivative, [](RGB const &a, RGB const &b) {
+		return a.G * b.B < b.G * a.B;
+	});
+
 	RGB sumRed(0, 0, 0);
 	RGB sumBlue(0, 0, 0);
 	for (auto ri = redDerivative.begin() + discard,
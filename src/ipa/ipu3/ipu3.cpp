@@ -213,6 +213,8 @@ void IPAIPU3::updateSessionConfiguration(const ControlInfoMap &sensorControls)
 	int32_t minGain = v4l2Gain.min().get<int32_t>();
 	int32_t maxGain = v4l2Gain.max().get<int32_t>();
 
+	camHelper_->setGainCodeRange(minGain, maxGain);
+
 	/*
 	 * When the AGC computes the new exposure values for a frame, it needs
 	 * to know the limits for shutter speed and analogue gain.
@@ -563,8 +565,11 @@ void IPAIPU3::fillParamsBuffer(const uint32_t frame, const uint32_t bufferId)
 
 	IPAFrameContext &frameContext = context_.frameContexts.get(frame);
 
-	for (auto const &algo : algorithms())
+	for (auto const &algo : algorithms()) {
+		AlgorithmTiming::Measurement m =
+			measure(algo.get(), AlgorithmTiming::Stage::Prepare);
 		algo->prepare(context_, frame, frameContext, params);
+	}
 
 	paramsBufferReady.emit(frame);
 }
@@ -601,8 +606,11 @@ void IPAIPU3::processStatsBuffer(const uint32_t frame,
 
 	ControlList metadata(controls::controls);
 
-	for (auto const &algo : algorithms())
+	for (auto const &algo : algorithms()) {
+		AlgorithmTiming::Measurement m =
+			measure(algo.get(), AlgorithmTiming::Stage::Process);
 		algo->process(context_, frame, frameContext, stats, metadata);
+	}
 
 	setControls(frame);
 
@@ -629,8 +637,11 @@ void IPAIPU3::queueRequest(const uint32_t frame, const ControlList &controls)
 {
 	IPAFrameContext &frameContext = context_.frameContexts.alloc(frame);
 
-	for (auto const &algo : algorithms())
+	for (auto const &algo : algorithms()) {
+		AlgorithmTiming::Measurement m =
+			measure(algo.get(), AlgorithmTiming::Stage::QueueRequest);
 		algo->queueRequest(context_, frame, frameContext, controls);
+	}
 }
 
 /**
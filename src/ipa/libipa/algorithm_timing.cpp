@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Per-algorithm execution time instrumentation
+ */
+
+#include "algorithm_timing.h"
+
+#include <string.h>
+#include <vector>
+
+/**
+ * \file algorithm_timing.h
+ * \brief Per-algorithm execution time instrumentation
+ */
+
+namespace libcamera {
+
+namespace ipa {
+
+namespace {
+
+/* Bucket bounds in seconds, from 50µs to 20ms. */
+const std::vector<double> timingBounds = {
+	0.00005, 0.0001, 0.0002, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02,
+};
+
+const char *const stageNames[] = {
+	"queue_request",
+	"prepare",
+	"process",
+};
+
+} /* namespace */
+
+/**
+ * \class AlgorithmTiming
+ * \brief Measure the execution time of an algorithm
+ *
+ * When an IPA module overruns its frame budget, the total processing time
+ * doesn't tell which algorithm is responsible. The AlgorithmTiming class
+ * records the execution time of each call to an algorithm in latency
+ * histograms, one per processing stage, registered in the metrics registry as
+ * "ipa_algorithm_<stage>_seconds" and labelled with the module and algorithm
+ * names.
+ *
+ * Instrumentation is disabled by default and enabled by setting the
+ * LIBCAMERA_IPA_ALGORITHM_TIMING environment variable to 1. When disabled, no
+ * metric is registered and measurements don't read the clock.
+ *
+ * When the IPA module runs isolated, the histograms are registered in the IPA
+ * proxy process and aren't included in the CameraManager metrics.
+ */
+
+/**
+ * \enum AlgorithmTiming::Stage
+ * \brief The algorithm processing stage being measured
+ * \var AlgorithmTiming::Stage::QueueRequest
+ * \brief Handling of the controls of a request
+ * \var AlgorithmTiming::Stage::Prepare
+ * \brief Computation of the ISP parameters
+ * \var AlgorithmTiming::Stage::Process
+ * \brief Processing of the ISP statistics
+ */
+
+/**
+ * \class AlgorithmTiming::Measurement
+ * \brief Scoped measurement of an algorithm execution time
+ *
+ * A Measurement reads the clock when constructed and records the elapsed time
+ * in the histogram when destroyed. It is created by AlgorithmTiming::measure()
+ * and shall be kept in scope for the duration of the algorithm call.
+ */
+
+/**
+ * \fn AlgorithmTiming::Measurement::Measurement()
+ * \brief Start a measurement
+ * \param[in] metric The histogram to record the measurement in, or nullptr if
+ * instrumentation is disabled
+ */
+
+/**
+ * \fn AlgorithmTiming::Measurement::~Measurement()
+ * \brief Stop the measurement and record the elapsed time
+ */
+
+/**
+ * \brief Construct the timing instrumentation for an algorithm
+ * \param[in] module The IPA module name
+ * \param[in] algorithm The algorithm name
+ *
+ * The histograms are only registered if instrumentation is enabled().
+ */
+AlgorithmTiming::AlgorithmTiming(const std::string &module,
+				 const std::string &algorithm)
+{
+	if (!enabled())
+		return;
+
+	const std::string label = module + "/" + algorithm;
+
+	for (unsigned int i = 0; i < metrics_.size(); i++) {
+		const std::string name = std::string("ipa_algorithm_") +
+					 stageNames[i] + "_seconds";
+		metrics_[i] = std::make_unique<HistogramMetric>(name, label,
+								timingBounds);
+	}
+}
+
+/**
+ * \brief Check if algorithm timing instrumentation is enabled
+ *
+ * The LIBCAMERA_IPA_ALGORITHM_TIMING environment variable is read once, the
+ * first time this function is called.
+ *
+ * \return True if instrumentation is enabled, false otherwise
+ */
+bool AlgorithmTiming::enabled()
+{
+	static const bool enabled = [] {
+		const char *env = utils::secure_getenv("LIBCAMERA_IPA_ALGORITHM_TIMING");
+		return env && !strcmp(env, "1");
+	}();
+
+	return enabled;
+}
+
+/**
+ * \fn AlgorithmTiming::measure()
+ * \brief Start measuring the execution time of a processing stage
+ * \param[in] stage The processing stage
+ *
+ * The returned Measurement records the elapsed time when it goes out of scope.
+ *
+ * \return A scoped measurement
+ */
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
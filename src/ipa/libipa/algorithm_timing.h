@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Per-algorithm execution time instrumentation
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/metrics.h>
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+namespace ipa {
+
+class AlgorithmTiming
+{
+public:
+	enum class Stage {
+		QueueRequest,
+		Prepare,
+		Process,
+	};
+
+	class Measurement
+	{
+	public:
+		Measurement(HistogramMetric *metric)
+			: metric_(metric)
+		{
+			if (metric_)
+				start_ = utils::clock::now();
+		}
+
+		~Measurement()
+		{
+			if (!metric_)
+				return;
+
+			std::chrono::duration<double> elapsed = utils::clock::now() - start_;
+			metric_->observe(elapsed.count());
+		}
+
+	private:
+		LIBCAMERA_DISABLE_COPY_AND_MOVE(Measurement)
+
+		HistogramMetric *metric_;
+		utils::time_point start_;
+	};
+
+	AlgorithmTiming(const std::string &module, const std::string &algorithm);
+
+	static bool enabled();
+
+	Measurement measure(Stage stage)
+	{
+		return Measurement(metrics_[static_cast<unsigned int>(stage)].get());
+	}
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(AlgorithmTiming)
+
+	std::array<std::unique_ptr<HistogramMetric>, 3> metrics_;
+};
+
+} /* namespace ipa */
+
+} /* namespace libcamera */
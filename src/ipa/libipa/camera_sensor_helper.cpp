@@ -7,6 +7,7 @@
  */
 #include "camera_sensor_helper.h"
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
@@ -76,6 +77,82 @@ namespace ipa {
  * \return The black level of the sensor, or std::nullopt if not known
  */
 
+/**
+ * \brief Set the range of the sensor analogue gain codes
+ * \param[in] minGainCode The minimum V4L2 subdev control gain code
+ * \param[in] maxGainCode The maximum V4L2 subdev control gain code
+ *
+ * This function precomputes the real gain of all the gain codes in the
+ * [\a minGainCode, \a maxGainCode] range, and the sorted list of the distinct
+ * gains the sensor can realize. gain() and gainCode() then use table lookups
+ * instead of evaluating the analogue gain model, which makes them cheap enough
+ * to be called repeatedly by the AGC algorithms.
+ *
+ * It shall be called when the sensor is configured, with the limits of the
+ * V4L2_CID_ANALOGUE_GAIN control. Until then, and if the gain model isn't
+ * monotonic over the range, the gains are computed from the model.
+ */
+void CameraSensorHelper::setGainCodeRange(uint32_t minGainCode, uint32_t maxGainCode)
+{
+	/* Limit the memory usage with pathological control ranges. */
+	static constexpr uint32_t kMaxGainCodes = 1 << 16;
+
+	minGainCode_ = 0;
+	gains_.clear();
+	quantizedGains_.clear();
+	quantizedGainCodes_.clear();
+
+	if (minGainCode > maxGainCode || maxGainCode - minGainCode >= kMaxGainCodes) {
+		LOG(CameraSensorHelper, Debug)
+			<< "Not tabulating gain codes [" << minGainCode << ", "
+			<< maxGainCode << "]";
+		return;
+	}
+
+	std::vector<double> gains;
+	std::vector<double> quantizedGains;
+	std::vector<uint32_t> quantizedGainCodes;
+
+	gains.reserve(maxGainCode - minGainCode + 1);
+
+	for (uint32_t code = minGainCode; code <= maxGainCode; ++code) {
+		double gain = computeGain(code);
+		gains.push_back(gain);
+
+		/*
+		 * Skip the gains that the model raises when converting them,
+		 * such as the gains below the recommended minimum of some
+		 * sensors.
+		 */
+		if (computeGain(computeGainCode(gain)) > gain)
+			continue;
+
+		/*
+		 * Codes that realize the same gain as a lower code, such as the
+		 * fine gain steps ignored by some sensors, are skipped, so that
+		 * gainCode() returns the lowest code for each gain.
+		 */
+		if (!quantizedGains.empty() && gain <= quantizedGains.back()) {
+			if (gain < quantizedGains.back()) {
+				LOG(CameraSensorHelper, Warning)
+					<< "Analogue gain isn't monotonic at code "
+					<< code << ", using the gain model";
+				return;
+			}
+
+			continue;
+		}
+
+		quantizedGains.push_back(gain);
+		quantizedGainCodes.push_back(code);
+	}
+
+	minGainCode_ = minGainCode;
+	gains_ = std::move(gains);
+	quantizedGains_ = std::move(quantizedGains);
+	quantizedGainCodes_ = std::move(quantizedGainCodes);
+}
+
 /**
  * \brief Compute gain code from the analogue gain absolute value
  * \param[in] gain The real gain to pass
@@ -83,9 +160,59 @@ namespace ipa {
  * This function aims to abstract the calculation of the gain letting the IPA
  * use the real gain for its estimations.
  *
+ * When the gain code range has been set with setGainCodeRange(), the function
+ * returns the code of the highest gain the sensor can realize that doesn't
+ * exceed \a gain, clamped to the range, with a binary search.
+ *
  * \return The gain code to pass to V4L2
  */
 uint32_t CameraSensorHelper::gainCode(double gain) const
+{
+	if (quantizedGains_.empty())
+		return computeGainCode(gain);
+
+	auto it = std::upper_bound(quantizedGains_.begin(),
+				   quantizedGains_.end(), gain);
+	if (it == quantizedGains_.begin())
+		return quantizedGainCodes_.front();
+
+	return quantizedGainCodes_[it - quantizedGains_.begin() - 1];
+}
+
+/**
+ * \brief Compute the real gain from the V4L2 subdev control gain code
+ * \param[in] gainCode The V4L2 subdev control gain
+ *
+ * This function aims to abstract the calculation of the gain letting the IPA
+ * use the real gain for its estimations. It is the counterpart of the function
+ * CameraSensorHelper::gainCode.
+ *
+ * When the gain code range has been set with setGainCodeRange(), gain codes
+ * within the range are looked up in constant time.
+ *
+ * \return The real gain
+ */
+double CameraSensorHelper::gain(uint32_t gainCode) const
+{
+	if (gainCode >= minGainCode_ && gainCode - minGainCode_ < gains_.size())
+		return gains_[gainCode - minGainCode_];
+
+	return computeGain(gainCode);
+}
+
+/**
+ * \brief Compute gain code from the analogue gain absolute value with the gain
+ * model
+ * \param[in] gain The real gain to pass
+ *
+ * This function evaluates the analogue gain model of the sensor. Sensors whose
+ * gain can't be expressed with the AnalogueGainLinear or
+ * AnalogueGainExponential models shall override it, together with
+ * computeGain().
+ *
+ * \return The gain code to pass to V4L2
+ */
+uint32_t CameraSensorHelper::computeGainCode(double gain) const
 {
 	const AnalogueGainConstants &k = gainConstants_;
 
@@ -108,16 +235,16 @@ uint32_t CameraSensorHelper::gainCode(double gain) const
 }
 
 /**
- * \brief Compute the real gain from the V4L2 subdev control gain code
+ * \brief Compute the real gain from the V4L2 subdev control gain code with the
+ * gain model
  * \param[in] gainCode The V4L2 subdev control gain
  *
- * This function aims to abstract the calculation of the gain letting the IPA
- * use the real gain for its estimations. It is the counterpart of the function
- * CameraSensorHelper::gainCode.
+ * This function evaluates the analogue gain model of the sensor. It is the
+ * counterpart of the function CameraSensorHelper::computeGainCode.
  *
  * \return The real gain
  */
-double CameraSensorHelper::gain(uint32_t gainCode) const
+double CameraSensorHelper::computeGain(uint32_t gainCode) const
 {
 	const AnalogueGainConstants &k = gainConstants_;
 	double gain = static_cast<double>(gainCode);
@@ -410,7 +537,7 @@ public:
 		blackLevel_ = 2688;
 	}
 
-	uint32_t gainCode(double gain) const override
+	uint32_t computeGainCode(double gain) const override
 	{
 		/* The recommended minimum gain is 1.6842 to avoid artifacts. */
 		gain = std::clamp(gain, 1.0 / (1.0 - 13.0 / 32.0), 18.45);
@@ -437,7 +564,7 @@ public:
 		return (coarse << 4) | (fine & 0xf);
 	}
 
-	double gain(uint32_t gainCode) const override
+	double computeGain(uint32_t gainCode) const override
 	{
 		unsigned int coarse = gainCode >> 4;
 		unsigned int fine = gainCode & 0xf;
@@ -497,7 +624,7 @@ REGISTER_CAMERA_SENSOR_HELPER("ar0144", CameraSensorHelperAr0144)
 class CameraSensorHelperAr0521 : public CameraSensorHelper
 {
 public:
-	uint32_t gainCode(double gain) const override
+	uint32_t computeGainCode(double gain) const override
 	{
 		gain = std::clamp(gain, 1.0, 15.5);
 		unsigned int coarse = std::log2(gain);
@@ -506,7 +633,7 @@ public:
 		return (coarse << 4) | (fine & 0xf);
 	}
 
-	double gain(uint32_t gainCode) const override
+	double computeGain(uint32_t gainCode) const override
 	{
 		unsigned int coarse = gainCode >> 4;
 		unsigned int fine = gainCode & 0xf;
@@ -26,10 +26,15 @@ public:
 	virtual ~CameraSensorHelper() = default;
 
 	std::optional<int16_t> blackLevel() const { return blackLevel_; }
-	virtual uint32_t gainCode(double gain) const;
-	virtual double gain(uint32_t gainCode) const;
+
+	void setGainCodeRange(uint32_t minGainCode, uint32_t maxGainCode);
+	uint32_t gainCode(double gain) const;
+	double gain(uint32_t gainCode) const;
 
 protected:
+	virtual uint32_t computeGainCode(double gain) const;
+	virtual double computeGain(uint32_t gainCode) const;
+
 	enum AnalogueGainType {
 		AnalogueGainLinear,
 		AnalogueGainExponential,
@@ -58,6 +63,11 @@ protected:
 
 private:
 	LIBCAMERA_DISABLE_COPY_AND_MOVE(CameraSensorHelper)
+
+	uint32_t minGainCode_ = 0;
+	std::vector<double> gains_;
+	std::vector<double> quantizedGains_;
+	std::vector<uint32_t> quantizedGainCodes_;
 };
 
 class CameraSensorHelperFactoryBase
@@ -78,7 +78,9 @@ namespace ipa {
  *
  * At its core, the queue uses a circular buffer to avoid dynamic memory
  * allocation at runtime. The buffer is pre-allocated with a maximum number of
- * entries when the FCQueue instance is constructed. Entries are initialized on
+ * entries when the FCQueue instance is constructed. Each entry is aligned on a
+ * cache line, and sizes that are a power of two avoid a division when looking
+ * up entries. Entries are initialized on
  * first use by alloc() or, in underrun conditions, get(). The queue is not
  * allowed to overflow, which must be ensured by pipeline handlers never
  * queuing more in-flight requests to the IPA module than the queue size. If an
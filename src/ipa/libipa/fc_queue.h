@@ -32,19 +32,19 @@ class FCQueue
 {
 public:
 	FCQueue(unsigned int size)
-		: contexts_(size)
+		: contexts_(size), mask_(size & (size - 1) ? 0 : size - 1)
 	{
 	}
 
 	void clear()
 	{
-		for (FrameContext &ctx : contexts_)
-			ctx.frame = 0;
+		for (Slot &slot : contexts_)
+			slot.context.frame = 0;
 	}
 
 	FrameContext &alloc(const uint32_t frame)
 	{
-		FrameContext &frameContext = contexts_[frame % contexts_.size()];
+		FrameContext &frameContext = slot(frame);
 
 		/*
 		 * Do not re-initialise if a get() call has already fetched this
@@ -68,7 +68,7 @@ public:
 
 	FrameContext &get(uint32_t frame)
 	{
-		FrameContext &frameContext = contexts_[frame % contexts_.size()];
+		FrameContext &frameContext = slot(frame);
 
 		/*
 		 * If the IPA algorithms try to access a frame context slot which
@@ -104,13 +104,31 @@ public:
 	}
 
 private:
+	/*
+	 * Align the contexts on cache lines, so that the algorithms touch the
+	 * minimum number of cache lines when accessing a frame context.
+	 */
+	struct alignas(64) Slot {
+		FrameContext context;
+	};
+
+	FrameContext &slot(uint32_t frame)
+	{
+		/* Avoid the division for power of two sizes. */
+		if (mask_)
+			return contexts_[frame & mask_].context;
+
+		return contexts_[frame % contexts_.size()].context;
+	}
+
 	void init(FrameContext &frameContext, const uint32_t frame)
 	{
 		frameContext = {};
 		frameContext.frame = frame;
 	}
 
-	std::vector<FrameContext> contexts_;
+	std::vector<Slot> contexts_;
+	uint32_t mask_;
 };
 
 } /* namespace ipa */
@@ -6,8 +6,6 @@
  */
 #include "histogram.h"
 
-#include <cmath>
-
 #include <libcamera/base/log.h>
 
 /**
@@ -38,16 +36,10 @@ namespace ipa {
  */
 
 /**
+ * \fn Histogram::Histogram(Span<const uint32_t> data)
  * \brief Create a cumulative histogram
  * \param[in] data A (non-cumulative) histogram
  */
-Histogram::Histogram(Span<const uint32_t> data)
-{
-	cumulative_.resize(data.size() + 1);
-	cumulative_[0] = 0;
-	for (const auto &[i, value] : utils::enumerate(data))
-		cumulative_[i + 1] = cumulative_[i] + value;
-}
 
 /**
  * \fn Histogram::Histogram(Span<const uint32_t> data, Transform transform)
@@ -56,6 +48,26 @@ Histogram::Histogram(Span<const uint32_t> data)
  * \param[in] transform The transformation function to apply to every bin
  */
 
+/**
+ * \fn Histogram::update(Span<const uint32_t> data)
+ * \brief Replace the contents of the histogram
+ * \param[in] data A (non-cumulative) histogram
+ *
+ * The histogram is rebuilt in place, reusing its storage when the number of
+ * bins doesn't grow. Algorithms that process a histogram for every frame
+ * should keep a Histogram instance and update it rather than construct a new
+ * one.
+ */
+
+/**
+ * \fn Histogram::update(Span<const uint32_t> data, Transform transform)
+ * \brief Replace the contents of the histogram
+ * \param[in] data A (non-cumulative) histogram
+ * \param[in] transform The transformation function to apply to every bin
+ *
+ * \sa update(Span<const uint32_t> data)
+ */
+
 /**
  * \fn Histogram::bins()
  * \brief Retrieve the number of bins currently used by the Histogram
@@ -137,6 +149,11 @@ double Histogram::quantile(double q, uint32_t first, uint32_t last) const
  * Instead, a concept is introduced here: inter-quantile mean.
  * It returns the mean of all pixels between lowQuantile and highQuantile.
  *
+ * The cumulative sums of the frequencies and of the frequencies weighted by
+ * the bin index are both computed when the histogram is built, which makes
+ * the cost of the calculation independent of the number of bins between the
+ * two quantiles.
+ *
  * \return The mean histogram bin value between the two quantiles
  */
 double Histogram::interQuantileMean(double lowQuantile, double highQuantile) const
@@ -146,20 +163,26 @@ double Histogram::interQuantileMean(double lowQuantile, double highQuantile) con
 	double lowPoint = quantile(lowQuantile);
 	/* Proportion of pixels which lies below highQuantile */
 	double highPoint = quantile(highQuantile, static_cast<uint32_t>(lowPoint));
-	double sumBinFreq = 0, cumulFreq = 0;
-
-	for (double p_next = floor(lowPoint) + 1.0;
-	     p_next <= ceil(highPoint);
-	     lowPoint = p_next, p_next += 1.0) {
-		int bin = floor(lowPoint);
-		double freq = (cumulative_[bin + 1] - cumulative_[bin])
-			* (std::min(p_next, highPoint) - lowPoint);
-
-		/* Accumulate weighted bin */
-		sumBinFreq += bin * freq;
-		/* Accumulate weights */
-		cumulFreq += freq;
+	double sumBinFreq, cumulFreq;
+
+	uint32_t lowBin = static_cast<uint32_t>(lowPoint);
+	uint32_t highBin = static_cast<uint32_t>(highPoint);
+
+	if (lowBin == highBin) {
+		cumulFreq = frequency(lowBin) * (highPoint - lowPoint);
+		sumBinFreq = lowBin * cumulFreq;
+	} else {
+		/* Weight the partial bins at both ends... */
+		double lowFreq = frequency(lowBin) * (lowBin + 1 - lowPoint);
+		double highFreq = frequency(highBin) * (highPoint - highBin);
+
+		/* ...and add the whole bins in between. */
+		cumulFreq = lowFreq + highFreq +
+			    (cumulative_[highBin] - cumulative_[lowBin + 1]);
+		sumBinFreq = lowBin * lowFreq + highBin * highFreq +
+			     (weighted_[highBin] - weighted_[lowBin + 1]);
 	}
+
 	/* add 0.5 to give an average for bin mid-points */
 	return sumBinFreq / cumulFreq + 0.5;
 }
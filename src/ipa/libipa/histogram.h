@@ -22,17 +22,40 @@ namespace ipa {
 class Histogram
 {
 public:
-	Histogram() { cumulative_.push_back(0); }
-	Histogram(Span<const uint32_t> data);
+	Histogram() { update({}); }
+	Histogram(Span<const uint32_t> data) { update(data); }
 
 	template<typename Transform,
 		 std::enable_if_t<std::is_invocable_v<Transform, uint32_t>> * = nullptr>
 	Histogram(Span<const uint32_t> data, Transform transform)
+	{
+		update(data, transform);
+	}
+
+	void update(Span<const uint32_t> data)
+	{
+		update(data, [](uint32_t value) { return value; });
+	}
+
+	template<typename Transform,
+		 std::enable_if_t<std::is_invocable_v<Transform, uint32_t>> * = nullptr>
+	void update(Span<const uint32_t> data, Transform transform)
 	{
 		cumulative_.resize(data.size() + 1);
+		weighted_.resize(data.size() + 1);
+
+		uint64_t cumulative = 0;
+		uint64_t weighted = 0;
 		cumulative_[0] = 0;
-		for (const auto &[i, value] : utils::enumerate(data))
-			cumulative_[i + 1] = cumulative_[i] + transform(value);
+		weighted_[0] = 0;
+
+		for (const auto &[i, value] : utils::enumerate(data)) {
+			uint64_t frequency = transform(value);
+			cumulative += frequency;
+			weighted += i * frequency;
+			cumulative_[i + 1] = cumulative;
+			weighted_[i + 1] = weighted;
+		}
 	}
 
 	size_t bins() const { return cumulative_.size() - 1; }
@@ -42,7 +65,13 @@ public:
 	double interQuantileMean(double lowQuantile, double hiQuantile) const;
 
 private:
+	uint64_t frequency(uint32_t bin) const
+	{
+		return bin < bins() ? cumulative_[bin + 1] - cumulative_[bin] : 0;
+	}
+
 	std::vector<uint64_t> cumulative_;
+	std::vector<uint64_t> weighted_;
 };
 
 } /* namespace ipa */
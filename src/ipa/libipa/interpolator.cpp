@@ -135,6 +135,21 @@ namespace ipa {
  * is not recalculated.
  */
 
+/**
+ * \fn void Interpolator<T>::getInterpolated(unsigned int key, T &dest,
+ * unsigned int *quantizedKey)
+ * \brief Interpolate a value for the given key into a destination object
+ * \param[in] key The unsigned integer key of the object to retrieve
+ * \param[out] dest The object to store the interpolated value in
+ * \param[out] quantizedKey If provided, the key value after quantization
+ *
+ * This function behaves as getInterpolated(unsigned int key, unsigned int
+ * *quantizedKey), but interpolates directly into \a dest rather than into the
+ * internal cache. Callers that keep the interpolated value in an object of
+ * their own, such as a cache of large tables, should use it to avoid an extra
+ * copy, and to reuse the storage of \a dest.
+ */
+
 /**
  * \fn void Interpolator<T>::interpolate(const T &a, const T &b, T &dest, double
  * lambda)
@@ -82,6 +82,49 @@ public:
 	}
 
 	const T &getInterpolated(unsigned int key, unsigned int *quantizedKey = nullptr)
+	{
+		key = quantize(key, quantizedKey);
+
+		if (lastInterpolatedKey_.has_value() &&
+		    *lastInterpolatedKey_ == key)
+			return lastInterpolatedValue_;
+
+		auto [first, second, lambda] = bracket(key);
+		if (first == second)
+			return first->second;
+
+		interpolate(first->second, second->second, lastInterpolatedValue_, lambda);
+		lastInterpolatedKey_ = key;
+
+		return lastInterpolatedValue_;
+	}
+
+	void getInterpolated(unsigned int key, T &dest, unsigned int *quantizedKey = nullptr)
+	{
+		key = quantize(key, quantizedKey);
+
+		if (lastInterpolatedKey_.has_value() &&
+		    *lastInterpolatedKey_ == key) {
+			dest = lastInterpolatedValue_;
+			return;
+		}
+
+		auto [first, second, lambda] = bracket(key);
+		if (first == second)
+			dest = first->second;
+		else
+			interpolate(first->second, second->second, dest, lambda);
+	}
+
+	void interpolate(const T &a, const T &b, T &dest, double lambda)
+	{
+		dest = a * (1.0 - lambda) + b * lambda;
+	}
+
+private:
+	using Iterator = typename std::map<unsigned int, T>::const_iterator;
+
+	unsigned int quantize(unsigned int key, unsigned int *quantizedKey) const
 	{
 		ASSERT(data_.size() > 0);
 
@@ -91,35 +134,32 @@ public:
 		if (quantizedKey)
 			*quantizedKey = key;
 
-		if (lastInterpolatedKey_.has_value() &&
-		    *lastInterpolatedKey_ == key)
-			return lastInterpolatedValue_;
+		return key;
+	}
 
+	/*
+	 * Find the two entries to interpolate between for the key, and the
+	 * interpolation factor. Both entries are the same when the key matches
+	 * an entry or lies outside of the range of the keys.
+	 */
+	std::tuple<Iterator, Iterator, double> bracket(unsigned int key) const
+	{
 		auto it = data_.lower_bound(key);
 
 		if (it == data_.begin())
-			return it->second;
+			return { it, it, 0.0 };
 
 		if (it == data_.end())
-			return std::prev(it)->second;
+			return { std::prev(it), std::prev(it), 0.0 };
 
 		if (it->first == key)
-			return it->second;
+			return { it, it, 0.0 };
 
 		auto it2 = std::prev(it);
 		double lambda = (key - it2->first) / static_cast<double>(it->first - it2->first);
-		interpolate(it2->second, it->second, lastInterpolatedValue_, lambda);
-		lastInterpolatedKey_ = key;
-
-		return lastInterpolatedValue_;
-	}
-
-	void interpolate(const T &a, const T &b, T &dest, double lambda)
-	{
-		dest = a * (1.0 - lambda) + b * lambda;
+		return { it2, it, lambda };
 	}
 
-private:
 	std::map<unsigned int, T> data_;
 	T lastInterpolatedValue_;
 	std::optional<unsigned int> lastInterpolatedKey_;
@@ -73,6 +73,12 @@ namespace ipa {
  * \copydoc Matrix::operator[](size_t i) const
  */
 
+/**
+ * \fn Matrix::transpose()
+ * \brief Compute the transpose of the matrix
+ * \return The transposed matrix
+ */
+
 /**
  * \fn Matrix<T, Rows, Cols> &Matrix::operator*=(U d)
  * \brief Multiply the matrix by a scalar in-place
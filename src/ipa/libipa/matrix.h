@@ -30,9 +30,9 @@ template<typename T, unsigned int Rows, unsigned int Cols>
 class Matrix
 {
 public:
-	Matrix()
+	constexpr Matrix()
+		: data_{}
 	{
-		data_.fill(static_cast<T>(0));
 	}
 
 	Matrix(const std::vector<T> &data)
@@ -40,7 +40,7 @@ public:
 		std::copy(data.begin(), data.end(), data_.begin());
 	}
 
-	static Matrix identity()
+	static constexpr Matrix identity()
 	{
 		Matrix ret;
 		for (size_t i = 0; i < std::min(Rows, Cols); i++)
@@ -68,22 +68,34 @@ public:
 		return out.str();
 	}
 
-	Span<const T, Cols> operator[](size_t i) const
+	constexpr Span<const T, Cols> operator[](size_t i) const
 	{
 		return Span<const T, Cols>{ &data_.data()[i * Cols], Cols };
 	}
 
-	Span<T, Cols> operator[](size_t i)
+	constexpr Span<T, Cols> operator[](size_t i)
 	{
 		return Span<T, Cols>{ &data_.data()[i * Cols], Cols };
 	}
 
+	constexpr Matrix<T, Cols, Rows> transpose() const
+	{
+		Matrix<T, Cols, Rows> result;
+
+		for (unsigned int i = 0; i < Rows; i++) {
+			for (unsigned int j = 0; j < Cols; j++)
+				result[j][i] = (*this)[i][j];
+		}
+
+		return result;
+	}
+
 #ifndef __DOXYGEN__
-	template<typename U, std::enable_if_t<std::is_arithmetic_v<U>>>
+	template<typename U, std::enable_if_t<std::is_arithmetic_v<U>> * = nullptr>
 #else
 	template<typename U>
 #endif /* __DOXYGEN__ */
-	Matrix<T, Rows, Cols> &operator*=(U d)
+	constexpr Matrix<T, Rows, Cols> &operator*=(U d)
 	{
 		for (unsigned int i = 0; i < Rows * Cols; i++)
 			data_[i] *= d;
@@ -100,7 +112,7 @@ template<typename T, typename U, unsigned int Rows, unsigned int Cols,
 #else
 template<typename T, typename U, unsigned int Rows, unsigned int Cols>
 #endif /* __DOXYGEN__ */
-Matrix<U, Rows, Cols> operator*(T d, const Matrix<U, Rows, Cols> &m)
+constexpr Matrix<U, Rows, Cols> operator*(T d, const Matrix<U, Rows, Cols> &m)
 {
 	Matrix<U, Rows, Cols> result;
 
@@ -118,7 +130,7 @@ template<typename T, typename U, unsigned int Rows, unsigned int Cols,
 #else
 template<typename T, typename U, unsigned int Rows, unsigned int Cols>
 #endif /* __DOXYGEN__ */
-Matrix<U, Rows, Cols> operator*(const Matrix<U, Rows, Cols> &m, T d)
+constexpr Matrix<U, Rows, Cols> operator*(const Matrix<U, Rows, Cols> &m, T d)
 {
 	return d * m;
 }
@@ -129,9 +141,9 @@ template<typename T,
 	 unsigned int R2, unsigned int C2,
 	 std::enable_if_t<C1 == R2> * = nullptr>
 #else
-template<typename T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned in C2>
+template<typename T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned int C2>
 #endif /* __DOXYGEN__ */
-Matrix<T, R1, C2> operator*(const Matrix<T, R1, C1> &m1, const Matrix<T, R2, C2> &m2)
+constexpr Matrix<T, R1, C2> operator*(const Matrix<T, R1, C1> &m1, const Matrix<T, R2, C2> &m2)
 {
 	Matrix<T, R1, C2> result;
 
@@ -150,7 +162,7 @@ Matrix<T, R1, C2> operator*(const Matrix<T, R1, C1> &m1, const Matrix<T, R2, C2>
 }
 
 template<typename T, unsigned int Rows, unsigned int Cols>
-Matrix<T, Rows, Cols> operator+(const Matrix<T, Rows, Cols> &m1, const Matrix<T, Rows, Cols> &m2)
+constexpr Matrix<T, Rows, Cols> operator+(const Matrix<T, Rows, Cols> &m1, const Matrix<T, Rows, Cols> &m2)
 {
 	Matrix<T, Rows, Cols> result;
 
@@ -97,6 +97,20 @@ namespace ipa {
  * \return 0 on success, or a negative error code on failure
  */
 
+/**
+ * \fn Module::measure()
+ * \brief Measure the execution time of an algorithm call
+ * \param[in] algo The algorithm
+ * \param[in] stage The processing stage
+ *
+ * IPA modules call this function before calling an algorithm, and keep the
+ * returned measurement in scope for the duration of the call. The execution
+ * time is recorded in the algorithm's AlgorithmTiming histograms when
+ * instrumentation is enabled, and the function has no effect otherwise.
+ *
+ * \return A scoped measurement
+ */
+
 /**
  * \fn Module::registerAlgorithm()
  * \brief Add an algorithm factory class to the list of available algorithms
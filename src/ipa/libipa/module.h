@@ -8,6 +8,7 @@
 #pragma once
 
 #include <list>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -18,6 +19,7 @@
 #include "libcamera/internal/yaml_parser.h"
 
 #include "algorithm.h"
+#include "algorithm_timing.h"
 
 namespace libcamera {
 
@@ -52,12 +54,14 @@ public:
 				LOG(IPAModuleAlgo, Error)
 					<< "Invalid YAML syntax for algorithm " << i;
 				algorithms_.clear();
+				timings_.clear();
 				return -EINVAL;
 			}
 
 			int ret = createAlgorithm(context, algo);
 			if (ret) {
 				algorithms_.clear();
+				timings_.clear();
 				return ret;
 			}
 		}
@@ -65,6 +69,19 @@ public:
 		return 0;
 	}
 
+	AlgorithmTiming::Measurement measure(const Algorithm<Module> *algo,
+					     AlgorithmTiming::Stage stage) const
+	{
+		if (timings_.empty())
+			return AlgorithmTiming::Measurement(nullptr);
+
+		auto it = timings_.find(algo);
+		if (it == timings_.end())
+			return AlgorithmTiming::Measurement(nullptr);
+
+		return it->second->measure(stage);
+	}
+
 	static void registerAlgorithm(AlgorithmFactoryBase<Module> *factory)
 	{
 		factories().push_back(factory);
@@ -91,6 +108,10 @@ private:
 		LOG(IPAModuleAlgo, Debug)
 			<< "Instantiated algorithm '" << name << "'";
 
+		if (AlgorithmTiming::enabled())
+			timings_.emplace(algo.get(),
+					 std::make_unique<AlgorithmTiming>(logPrefix(), name));
+
 		algorithms_.push_back(std::move(algo));
 		return 0;
 	}
@@ -117,6 +138,7 @@ private:
 	}
 
 	std::list<std::unique_ptr<Algorithm<Module>>> algorithms_;
+	std::map<const Algorithm<Module> *, std::unique_ptr<AlgorithmTiming>> timings_;
 };
 
 } /* namespace ipa */
@@ -134,8 +134,10 @@ Pwl::Pwl(std::vector<Point> &&points)
  */
 void Pwl::append(double x, double y, const double eps)
 {
-	if (points_.empty() || points_.back().x() + eps < x)
+	if (points_.empty() || points_.back().x() + eps < x) {
 		points_.push_back(Point({ x, y }));
+		spanTable_.clear();
+	}
 }
 
 /**
@@ -149,8 +151,10 @@ void Pwl::append(double x, double y, const double eps)
  */
 void Pwl::prepend(double x, double y, const double eps)
 {
-	if (points_.empty() || points_.front().x() - eps > x)
+	if (points_.empty() || points_.front().x() - eps > x) {
 		points_.insert(points_.begin(), Point({ x, y }));
+		spanTable_.clear();
+	}
 }
 
 /**
@@ -197,13 +201,15 @@ Pwl::Interval Pwl::range() const
  * the "span" value but don't have an initial guess you can set it to
  * -1.
  *
+ * Without an initial guess, the search for the span starts from the lookup
+ * table built by buildSpanTable() if there is one, or from the middle of the
+ * function otherwise.
+ *
  *  \return The result of evaluating the piecewise linear function at position \a x
  */
 double Pwl::eval(double x, int *span, bool updateSpan) const
 {
-	int index = findSpan(x, span && *span != -1
-					? *span
-					: points_.size() / 2 - 1);
+	int index = findSpan(x, span && *span != -1 ? *span : initialSpan(x));
 	if (span && updateSpan)
 		*span = index;
 	return points_[index].y() +
@@ -211,6 +217,57 @@ double Pwl::eval(double x, int *span, bool updateSpan) const
 		       (points_[index + 1].x() - points_[index].x());
 }
 
+/**
+ * \brief Build a lookup table to speed up the evaluation of the function
+ * \param[in] cells The number of cells of the table (optional)
+ *
+ * The table divides the domain of the function in \a cells cells of equal
+ * width, and records the span in which each cell starts. eval() then finds
+ * the span of any x value in constant time, instead of searching linearly
+ * through the points of the function, which is worth it for functions that
+ * have many points and are evaluated many times without a span guess.
+ *
+ * When \a cells is 0, the size of the table is chosen such that no cell
+ * contains more than one point, within a limit of 1024 cells. The table is
+ * discarded when points are added to the function.
+ */
+void Pwl::buildSpanTable(unsigned int cells)
+{
+	static constexpr unsigned int kMaxCells = 1024;
+
+	spanTable_.clear();
+	if (points_.size() < 2)
+		return;
+
+	if (!cells) {
+		double minLength = domain().length();
+		for (unsigned int i = 1; i < points_.size(); i++)
+			minLength = std::min(minLength,
+					     points_[i].x() - points_[i - 1].x());
+
+		cells = std::min<double>(std::ceil(domain().length() / minLength),
+					 kMaxCells);
+	}
+
+	spanTableScale_ = cells / domain().length();
+	spanTable_.resize(cells);
+
+	int span = 0;
+	for (unsigned int i = 0; i < cells; i++) {
+		span = findSpan(points_[0].x() + i / spanTableScale_, span);
+		spanTable_[i] = span;
+	}
+}
+
+int Pwl::initialSpan(double x) const
+{
+	if (spanTable_.empty())
+		return points_.size() / 2 - 1;
+
+	double cell = (x - points_[0].x()) * spanTableScale_;
+	return spanTable_[cell > 0 ? std::min<double>(cell, spanTable_.size() - 1) : 0];
+}
+
 int Pwl::findSpan(double x, int span) const
 {
 	/*
@@ -450,6 +507,8 @@ YamlObject::Getter<ipa::Pwl>::get(const YamlObject &obj) const
 	if (pwl.size() != obj.size() / 2)
 		return std::nullopt;
 
+	pwl.buildSpanTable();
+
 	return pwl;
 }
 #endif /* __DOXYGEN__ */
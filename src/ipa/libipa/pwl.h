@@ -57,6 +57,8 @@ public:
 	double eval(double x, int *span = nullptr,
 		    bool updateSpan = true) const;
 
+	void buildSpanTable(unsigned int cells = 0);
+
 	std::pair<Pwl, bool> inverse(double eps = 1e-6) const;
 	Pwl compose(const Pwl &other, double eps = 1e-6) const;
 
@@ -75,9 +77,14 @@ private:
 	static void map2(const Pwl &pwl0, const Pwl &pwl1,
 			 std::function<void(double x, double y0, double y1)> f);
 	void prepend(double x, double y, double eps = 1e-6);
+	int initialSpan(double x) const;
 	int findSpan(double x, int span) const;
 
 	std::vector<Point> points_;
+
+	/* First span of each cell of a uniform grid over the domain */
+	std::vector<int> spanTable_;
+	double spanTableScale_;
 };
 
 } /* namespace ipa */
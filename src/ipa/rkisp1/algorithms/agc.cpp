@@ -121,6 +121,7 @@ uint8_t Agc::computeHistogramPredivider(const Size &size,
 }
 
 Agc::Agc()
+	: lastExposureTime_(0s), lastGain_(0.0)
 {
 	supportsRaw_ = true;
 }
@@ -167,6 +168,28 @@ int Agc::configure(IPAContext &context, const IPACameraSensorInfo &configInfo)
 	context.activeState.agc.automatic.gain = context.configuration.sensor.minAnalogueGain;
 	context.activeState.agc.automatic.exposure =
 		10ms / context.configuration.sensor.lineDuration;
+
+	/*
+	 * Start from the exposure and gain the previous streaming session
+	 * ended with, if any, to avoid converging again on repeated captures.
+	 */
+	if (lastExposureTime_) {
+		utils::Duration exposureTime =
+			std::clamp(lastExposureTime_,
+				   context.configuration.sensor.minShutterSpeed,
+				   context.configuration.sensor.maxShutterSpeed);
+		context.activeState.agc.automatic.exposure =
+			exposureTime / context.configuration.sensor.lineDuration;
+		context.activeState.agc.automatic.gain =
+			std::clamp(lastGain_,
+				   context.configuration.sensor.minAnalogueGain,
+				   context.configuration.sensor.maxAnalogueGain);
+
+		LOG(RkISP1Agc, Debug)
+			<< "Restored exposure " << exposureTime << " and gain "
+			<< context.activeState.agc.automatic.gain;
+	}
+
 	context.activeState.agc.manual.gain = context.activeState.agc.automatic.gain;
 	context.activeState.agc.manual.exposure = context.activeState.agc.automatic.exposure;
 	context.activeState.agc.autoEnabled = !context.configuration.raw;
@@ -420,8 +443,8 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	const rkisp1_cif_isp_stat *params = &stats->params;
 
 	/* The lower 4 bits are fractional and meant to be discarded. */
-	Histogram hist({ params->hist.hist_bins, context.hw->numHistogramBins },
-		       [](uint32_t x) { return x >> 4; });
+	histogram_.update({ params->hist.hist_bins, context.hw->numHistogramBins },
+			  [](uint32_t x) { return x >> 4; });
 	expMeans_ = { params->ae.exp_mean, context.hw->numAeCells };
 
 	utils::Duration maxShutterSpeed =
@@ -447,7 +470,7 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	std::tie(shutterTime, aGain, dGain) =
 		calculateNewEv(frameContext.agc.constraintMode,
 			       frameContext.agc.exposureMode,
-			       hist, effectiveExposureValue);
+			       histogram_, effectiveExposureValue);
 
 	LOG(RkISP1Agc, Debug)
 		<< "Divided up shutter, analogue gain and digital gain are "
@@ -458,6 +481,9 @@ void Agc::process(IPAContext &context, [[maybe_unused]] const uint32_t frame,
 	activeState.agc.automatic.exposure = shutterTime / context.configuration.sensor.lineDuration;
 	activeState.agc.automatic.gain = aGain;
 
+	lastExposureTime_ = shutterTime;
+	lastGain_ = aGain;
+
 	fillMetadata(context, frameContext, metadata);
 	expMeans_ = {};
 }
@@ -15,6 +15,7 @@
 #include <libcamera/geometry.h>
 
 #include "libipa/agc_mean_luminance.h"
+#include "libipa/histogram.h"
 
 #include "algorithm.h"
 
@@ -52,8 +53,13 @@ private:
 	double estimateLuminance(double gain) const override;
 
 	Span<const uint8_t> expMeans_;
+	Histogram histogram_;
 
 	std::map<int32_t, std::vector<uint8_t>> meteringModes_;
+
+	/* Estimates of the last processed frame, kept across sessions */
+	utils::Duration lastExposureTime_;
+	double lastGain_;
 };
 
 } /* namespace ipa::rkisp1::algorithms */
@@ -35,7 +35,8 @@ LOG_DEFINE_CATEGORY(RkISP1Awb)
 constexpr double kMeanMinThreshold = 2.0;
 
 Awb::Awb()
-	: rgbMode_(false)
+	: rgbMode_(false), lastRedGain_(0.0), lastBlueGain_(0.0),
+	  lastTemperatureK_(0)
 {
 }
 
@@ -53,6 +54,16 @@ int Awb::configure(IPAContext &context,
 	context.activeState.awb.gains.automatic.green = 1.0;
 	context.activeState.awb.autoEnabled = true;
 
+	/*
+	 * Start from the gains the previous streaming session ended with, if
+	 * any, to avoid converging again on repeated captures.
+	 */
+	if (lastRedGain_ && lastBlueGain_) {
+		context.activeState.awb.gains.automatic.red = lastRedGain_;
+		context.activeState.awb.gains.automatic.blue = lastBlueGain_;
+		context.activeState.awb.temperatureK = lastTemperatureK_;
+	}
+
 	/*
 	 * Define the measurement window for AWB as a centered rectangle
 	 * covering 3/4 of the image width and height.
@@ -310,6 +321,10 @@ void Awb::process(IPAContext &context,
 	activeState.awb.gains.automatic.blue = blueGain;
 	activeState.awb.gains.automatic.green = 1.0;
 
+	lastRedGain_ = redGain;
+	lastBlueGain_ = blueGain;
+	lastTemperatureK_ = activeState.awb.temperatureK;
+
 	LOG(RkISP1Awb, Debug)
 		<< std::showpoint
 		<< "Means [" << redMean << ", " << greenMean << ", " << blueMean
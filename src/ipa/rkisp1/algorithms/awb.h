@@ -35,6 +35,11 @@ private:
 	uint32_t estimateCCT(double red, double green, double blue);
 
 	bool rgbMode_;
+
+	/* Estimates of the last processed frame, kept across sessions */
+	double lastRedGain_;
+	double lastBlueGain_;
+	unsigned int lastTemperatureK_;
 };
 
 } /* namespace ipa::rkisp1::algorithms */
@@ -27,8 +27,6 @@ namespace libcamera {
 
 namespace ipa {
 
-constexpr int kColourTemperatureChangeThreshhold = 10;
-
 template<typename T>
 void interpolateVector(const std::vector<T> &a, const std::vector<T> &b,
 		       std::vector<T> &dest, double lambda)
@@ -67,10 +65,27 @@ namespace ipa::rkisp1::algorithms {
  * The Lens Shading Correction algorithm applies multipliers to all pixels
  * to compensate for the lens shading effect. The coefficients are
  * specified in a downscaled table in the YAML tuning file.
+ *
+ * The tables are interpolated for the colour temperature estimated by the
+ * AWB, quantized to buckets of 'ct-quantization' kelvins (10K by default).
+ * To avoid switching tables back and forth when the colour temperature
+ * oscillates around the boundary of two buckets, the table is only updated
+ * once the colour temperature moves away from the current bucket by more
+ * than 'ct-hysteresis' kelvins (5K by default). The last interpolated tables
+ * are cached, so that returning to a recently used bucket doesn't require
+ * interpolating again.
  */
 
 LOG_DEFINE_CATEGORY(RkISP1Lsc)
 
+namespace {
+
+constexpr unsigned int kDefaultCtQuantization = 10;
+constexpr unsigned int kDefaultCtHysteresis = 5;
+constexpr unsigned int kMaxCachedTables = 4;
+
+} /* namespace */
+
 class LscPolynomialLoader
 {
 public:
@@ -296,9 +311,9 @@ static std::vector<double> parseSizes(const YamlObject &tuningData,
 }
 
 LensShadingCorrection::LensShadingCorrection()
-	: lastAppliedCt_(0), lastAppliedQuantizedCt_(0)
+	: ctQuantization_(kDefaultCtQuantization),
+	  ctHysteresis_(kDefaultCtHysteresis), lastAppliedQuantizedCt_(0)
 {
-	sets_.setQuantization(kColourTemperatureChangeThreshhold);
 }
 
 /**
@@ -313,6 +328,14 @@ int LensShadingCorrection::init([[maybe_unused]] IPAContext &context,
 	if (xSize_.empty() || ySize_.empty())
 		return -EINVAL;
 
+	ctQuantization_ = tuningData["ct-quantization"].get<uint32_t>(kDefaultCtQuantization);
+	ctHysteresis_ = tuningData["ct-hysteresis"].get<uint32_t>(kDefaultCtHysteresis);
+	if (!ctQuantization_) {
+		LOG(RkISP1Lsc, Error)
+			<< "Invalid 'ct-quantization' value, must not be 0";
+		return -EINVAL;
+	}
+
 	/* Get all defined sets to apply. */
 	const YamlObject &yamlSets = tuningData["sets"];
 	if (!yamlSets.isList()) {
@@ -345,6 +368,8 @@ int LensShadingCorrection::init([[maybe_unused]] IPAContext &context,
 		return res;
 
 	sets_.setData(std::move(lscData));
+	sets_.setQuantization(ctQuantization_);
+	tableCache_.clear();
 
 	return 0;
 }
@@ -401,29 +426,66 @@ void LensShadingCorrection::copyTable(rkisp1_cif_isp_lsc_config &config,
 	std::copy(set.b.begin(), set.b.end(), &config.b_data_tbl[0][0]);
 }
 
+const LensShadingCorrection::Components &
+LensShadingCorrection::cachedTable(unsigned int quantizedCt)
+{
+	auto it = std::find_if(tableCache_.begin(), tableCache_.end(),
+			       [&](const auto &entry) {
+				       return entry.first == quantizedCt;
+			       });
+	if (it != tableCache_.end()) {
+		tableCache_.splice(tableCache_.begin(), tableCache_, it);
+		return it->second;
+	}
+
+	/*
+	 * Reuse the least recently used entry when the cache is full, to keep
+	 * the storage of its tables.
+	 */
+	if (tableCache_.size() < kMaxCachedTables)
+		tableCache_.emplace_front();
+	else
+		tableCache_.splice(tableCache_.begin(), tableCache_,
+				   std::prev(tableCache_.end()));
+
+	auto &entry = tableCache_.front();
+	entry.first = quantizedCt;
+	sets_.getInterpolated(quantizedCt, entry.second);
+
+	return entry.second;
+}
+
 /**
  * \copydoc libcamera::ipa::Algorithm::prepare
  */
 void LensShadingCorrection::prepare(IPAContext &context,
-				    [[maybe_unused]] const uint32_t frame,
+				    const uint32_t frame,
 				    [[maybe_unused]] IPAFrameContext &frameContext,
 				    RkISP1Params *params)
 {
-	uint32_t ct = context.activeState.awb.temperatureK;
-	if (std::abs(static_cast<int>(ct) - static_cast<int>(lastAppliedCt_)) <
-	    kColourTemperatureChangeThreshhold)
+	unsigned int ct = context.activeState.awb.temperatureK;
+
+	/*
+	 * Keep the current table until the colour temperature moves out of its
+	 * bucket by more than the hysteresis.
+	 */
+	unsigned int distance = std::abs(static_cast<int>(ct) -
+					 static_cast<int>(lastAppliedQuantizedCt_));
+	if (frame > 0 && distance <= ctQuantization_ / 2 + ctHysteresis_)
 		return;
-	unsigned int quantizedCt;
-	const Components &set = sets_.getInterpolated(ct, &quantizedCt);
-	if (lastAppliedQuantizedCt_ == quantizedCt)
+
+	unsigned int quantizedCt = std::lround(ct / static_cast<double>(ctQuantization_)) *
+				   ctQuantization_;
+	if (frame > 0 && lastAppliedQuantizedCt_ == quantizedCt)
 		return;
 
+	const Components &set = cachedTable(quantizedCt);
+
 	auto config = params->block<BlockType::Lsc>();
 	config.setEnabled(true);
 	setParameters(*config);
 	copyTable(*config, set);
 
-	lastAppliedCt_ = ct;
 	lastAppliedQuantizedCt_ = quantizedCt;
 
 	LOG(RkISP1Lsc, Debug)
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <list>
 #include <map>
+#include <utility>
 
 #include "libipa/interpolator.h"
 
@@ -43,6 +45,7 @@ private:
 	void interpolateTable(rkisp1_cif_isp_lsc_config &config,
 			      const Components &set0, const Components &set1,
 			      const uint32_t ct);
+	const Components &cachedTable(unsigned int quantizedCt);
 
 	ipa::Interpolator<Components> sets_;
 	std::vector<double> xSize_;
@@ -52,7 +55,11 @@ private:
 	uint16_t xSizes_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 	uint16_t ySizes_[RKISP1_CIF_ISP_LSC_SECTORS_TBL_SIZE];
 
-	unsigned int lastAppliedCt_;
+	unsigned int ctQuantization_;
+	unsigned int ctHysteresis_;
+	/* Interpolated tables, most recently used first */
+	std::list<std::pair<unsigned int, Components>> tableCache_;
+
 	unsigned int lastAppliedQuantizedCt_;
 };
 
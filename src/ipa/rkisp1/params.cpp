@@ -128,6 +128,72 @@ RkISP1Params::RkISP1Params(uint32_t format, Span<uint8_t> data)
 	}
 }
 
+/*
+ * The cache records the contents of the last parameters block of each type
+ * written to the extensible parameters buffers, including the block header.
+ * As the ISP keeps its configuration for blocks that are not present in a
+ * parameters buffer, it must be reset when the ISP configuration is lost,
+ * typically when the camera is started.
+ */
+void RkISP1ParamsCache::reset()
+{
+	blocks_.clear();
+}
+
+/*
+ * Remove from the parameters buffer the blocks whose contents are identical to
+ * the last block of the same type recorded in the cache, and update the cache
+ * with the other blocks. This must be called once all blocks have been filled,
+ * after which no block can be added or modified.
+ *
+ * Only the extensible format supports leaving out blocks, the function is a
+ * no-op for the legacy format.
+ */
+void RkISP1Params::elideUnchanged(RkISP1ParamsCache &cache)
+{
+	if (format_ != V4L2_META_FMT_RK_ISP1_EXT_PARAMS)
+		return;
+
+	const size_t begin = offsetof(struct rkisp1_ext_params_cfg, data);
+	size_t read = begin;
+	size_t write = begin;
+
+	/*
+	 * Walk the blocks in the order they have been allocated, and compact
+	 * the buffer by moving the changed blocks over the elided ones.
+	 */
+	while (read < used_) {
+		const struct rkisp1_ext_params_block_header *header =
+			reinterpret_cast<const struct rkisp1_ext_params_block_header *>(data_.data() + read);
+		Span<uint8_t> block = data_.subspan(read, header->size);
+		read += block.size();
+
+		std::vector<uint8_t> &last = cache.blocks_[header->type];
+		if (last.size() == block.size() &&
+		    !memcmp(last.data(), block.data(), block.size()))
+			continue;
+
+		last.assign(block.begin(), block.end());
+
+		if (write != read - block.size())
+			memmove(data_.data() + write, block.data(), block.size());
+		write += block.size();
+	}
+
+	struct rkisp1_ext_params_cfg *cfg =
+		reinterpret_cast<struct rkisp1_ext_params_cfg *>(data_.data());
+
+	LOG(RkISP1Params, Debug)
+		<< "Elided " << used_ - write << " of " << cfg->data_size
+		<< " bytes of unchanged parameters blocks";
+
+	cfg->data_size = write - begin;
+	used_ = write;
+
+	/* The blocks may have moved, invalidate the cache of allocated blocks. */
+	blocks_.clear();
+}
+
 void RkISP1Params::setBlockEnabled(BlockType type, bool enabled)
 {
 	const BlockTypeInfo &info = kBlockTypeInfo.at(type);
@@ -9,6 +9,7 @@
 
 #include <map>
 #include <stdint.h>
+#include <vector>
 
 #include <linux/rkisp1-config.h>
 
@@ -130,6 +131,17 @@ public:
 	}
 };
 
+class RkISP1ParamsCache
+{
+public:
+	void reset();
+
+private:
+	friend class RkISP1Params;
+
+	std::map<uint16_t, std::vector<uint8_t>> blocks_;
+};
+
 class RkISP1Params
 {
 public:
@@ -141,6 +153,8 @@ public:
 		return RkISP1ParamsBlock<B>(this, block(B));
 	}
 
+	void elideUnchanged(RkISP1ParamsCache &cache);
+
 	uint32_t format() const { return format_; }
 	size_t size() const { return used_; }
 
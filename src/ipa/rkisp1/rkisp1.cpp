@@ -83,6 +83,9 @@ private:
 
 	ControlInfoMap sensorControls_;
 
+	/* Last parameters blocks written to the ISP */
+	RkISP1ParamsCache paramsCache_;
+
 	/* Local parameter storage */
 	struct IPAContext context_;
 };
@@ -210,6 +213,8 @@ int IPARkISP1::init(const IPASettings &settings, unsigned int hwRevision,
 
 int IPARkISP1::start()
 {
+	paramsCache_.reset();
+
 	setControls(0);
 
 	return 0;
@@ -238,6 +243,8 @@ int IPARkISP1::configure(const IPAConfigInfo &ipaConfig,
 		<< "Exposure: [" << minExposure << ", " << maxExposure
 		<< "], gain: [" << minGain << ", " << maxGain << "]";
 
+	context_.camHelper->setGainCodeRange(minGain, maxGain);
+
 	/* Clear the IPA context before the streaming session. */
 	context_.configuration = {};
 	context_.activeState = {};
@@ -331,6 +338,9 @@ void IPARkISP1::queueRequest(const uint32_t frame, const ControlList &controls)
 		Algorithm *algo = static_cast<Algorithm *>(a.get());
 		if (algo->disabled_)
 			continue;
+
+		AlgorithmTiming::Measurement m =
+			measure(algo, AlgorithmTiming::Stage::QueueRequest);
 		algo->queueRequest(context_, frame, frameContext, controls);
 	}
 }
@@ -342,8 +352,13 @@ void IPARkISP1::fillParamsBuffer(const uint32_t frame, const uint32_t bufferId)
 	RkISP1Params params(context_.configuration.paramFormat,
 			    mappedBuffers_.at(bufferId).planes()[0]);
 
-	for (auto const &algo : algorithms())
+	for (auto const &algo : algorithms()) {
+		AlgorithmTiming::Measurement m =
+			measure(algo.get(), AlgorithmTiming::Stage::Prepare);
 		algo->prepare(context_, frame, frameContext, &params);
+	}
+
+	params.elideUnchanged(paramsCache_);
 
 	paramsBufferReady.emit(frame, params.size());
 }
@@ -373,6 +388,9 @@ void IPARkISP1::processStatsBuffer(const uint32_t frame, const uint32_t bufferId
 		Algorithm *algo = static_cast<Algorithm *>(a.get());
 		if (algo->disabled_)
 			continue;
+
+		AlgorithmTiming::Measurement m =
+			measure(algo, AlgorithmTiming::Stage::Process);
 		algo->process(context_, frame, frameContext, stats, metadata);
 	}
 
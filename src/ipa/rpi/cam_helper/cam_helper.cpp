@@ -217,6 +217,15 @@ unsigned int CamHelper::mistrustFramesModeSwitch() const
 	return 0;
 }
 
+unsigned int CamHelper::maxOutputTensorSize() const
+{
+	/*
+	 * The largest CNN output tensor reported by the sensor in bytes, or 0
+	 * if the sensor doesn't run neural networks.
+	 */
+	return 0;
+}
+
 void CamHelper::parseEmbeddedData(Span<const uint8_t> buffer,
 				  Metadata &metadata)
 {
@@ -240,8 +249,8 @@ void CamHelper::parseEmbeddedData(Span<const uint8_t> buffer,
 	 * Fetch it first in case any other fields were set meaningfully.
 	 */
 	DeviceStatus deviceStatus, parsedDeviceStatus;
-	if (metadata.get("device.status", deviceStatus) ||
-	    parsedMetadata.get("device.status", parsedDeviceStatus)) {
+	if (metadata.get(tags::deviceStatus, deviceStatus) ||
+	    parsedMetadata.get(tags::deviceStatus, parsedDeviceStatus)) {
 		LOG(IPARPI, Error) << "DeviceStatus not found";
 		return;
 	}
@@ -255,7 +264,7 @@ void CamHelper::parseEmbeddedData(Span<const uint8_t> buffer,
 
 	LOG(IPARPI, Debug) << "Metadata updated - " << deviceStatus;
 
-	metadata.set("device.status", deviceStatus);
+	metadata.set(tags::deviceStatus, deviceStatus);
 }
 
 void CamHelper::populateMetadata([[maybe_unused]] const MdParser::RegisterMap &registers,
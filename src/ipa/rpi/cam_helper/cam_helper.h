@@ -100,6 +100,7 @@ public:
 	virtual unsigned int hideFramesModeSwitch() const;
 	virtual unsigned int mistrustFramesStartup() const;
 	virtual unsigned int mistrustFramesModeSwitch() const;
+	virtual unsigned int maxOutputTensorSize() const;
 
 protected:
 	void parseEmbeddedData(libcamera::Span<const uint8_t> buffer,
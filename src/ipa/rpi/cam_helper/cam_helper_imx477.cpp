@@ -90,7 +90,7 @@ void CamHelperImx477::prepare(libcamera::Span<const uint8_t> buffer, Metadata &m
 	MdParser::RegisterMap registers;
 	DeviceStatus deviceStatus;
 
-	if (metadata.get("device.status", deviceStatus)) {
+	if (metadata.get(tags::deviceStatus, deviceStatus)) {
 		LOG(IPARPI, Error) << "DeviceStatus not found from DelayedControls";
 		return;
 	}
@@ -111,10 +111,10 @@ void CamHelperImx477::prepare(libcamera::Span<const uint8_t> buffer, Metadata &m
 	if (deviceStatus.frameLength > frameLengthMax) {
 		DeviceStatus parsedDeviceStatus;
 
-		metadata.get("device.status", parsedDeviceStatus);
+		metadata.get(tags::deviceStatus, parsedDeviceStatus);
 		parsedDeviceStatus.shutterSpeed = deviceStatus.shutterSpeed;
 		parsedDeviceStatus.frameLength = deviceStatus.frameLength;
-		metadata.set("device.status", parsedDeviceStatus);
+		metadata.set(tags::deviceStatus, parsedDeviceStatus);
 
 		LOG(IPARPI, Debug) << "Metadata updated for long exposure: "
 				   << parsedDeviceStatus;
@@ -186,7 +186,7 @@ void CamHelperImx477::populateMetadata(const MdParser::RegisterMap &registers,
 	deviceStatus.frameLength = registers.at(frameLengthHiReg) * 256 + registers.at(frameLengthLoReg);
 	deviceStatus.sensorTemperature = std::clamp<int8_t>(registers.at(temperatureReg), -20, 80);
 
-	metadata.set("device.status", deviceStatus);
+	metadata.set(tags::deviceStatus, deviceStatus);
 }
 
 static CamHelper *create()
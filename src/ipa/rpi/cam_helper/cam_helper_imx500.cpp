@@ -61,6 +61,7 @@ public:
 	void getDelays(int &exposureDelay, int &gainDelay,
 		       int &vblankDelay, int &hblankDelay) const override;
 	bool sensorEmbeddedDataPresent() const override;
+	unsigned int maxOutputTensorSize() const override;
 
 private:
 	/*
@@ -100,7 +101,7 @@ void CamHelperImx500::prepare(libcamera::Span<const uint8_t> buffer, Metadata &m
 	MdParser::RegisterMap registers;
 	DeviceStatus deviceStatus;
 
-	if (metadata.get("device.status", deviceStatus)) {
+	if (metadata.get(tags::deviceStatus, deviceStatus)) {
 		LOG(IPARPI, Error) << "DeviceStatus not found from DelayedControls";
 		return;
 	}
@@ -121,10 +122,10 @@ void CamHelperImx500::prepare(libcamera::Span<const uint8_t> buffer, Metadata &m
 	if (deviceStatus.frameLength > frameLengthMax) {
 		DeviceStatus parsedDeviceStatus;
 
-		metadata.get("device.status", parsedDeviceStatus);
+		metadata.get(tags::deviceStatus, parsedDeviceStatus);
 		parsedDeviceStatus.shutterSpeed = deviceStatus.shutterSpeed;
 		parsedDeviceStatus.frameLength = deviceStatus.frameLength;
-		metadata.set("device.status", parsedDeviceStatus);
+		metadata.set(tags::deviceStatus, parsedDeviceStatus);
 
 		LOG(IPARPI, Debug) << "Metadata updated for long exposure: "
 				   << parsedDeviceStatus;
@@ -185,6 +186,15 @@ bool CamHelperImx500::sensorEmbeddedDataPresent() const
 	return true;
 }
 
+unsigned int CamHelperImx500::maxOutputTensorSize() const
+{
+	/*
+	 * The output tensors of the networks the sensor runs are well within
+	 * this bound once converted to floating point values.
+	 */
+	return 4 << 20;
+}
+
 void CamHelperImx500::parseInferenceData(libcamera::Span<const uint8_t> buffer,
 					 Metadata &metadata)
 {
@@ -199,7 +209,7 @@ void CamHelperImx500::parseInferenceData(libcamera::Span<const uint8_t> buffer,
 
 	/* Check if an input tensor is needed - this is sticky! */
 	bool enableInputTensor = false;
-	metadata.get("cnn.enable_input_tensor", enableInputTensor);
+	metadata.get(tags::cnnEnableInputTensor, enableInputTensor);
 
 	/* Cache the DNN metadata for fast parsing. */
 	unsigned int tensorBufferSize = buffer.size() - (StartLine * bytesPerLine);
@@ -259,9 +269,9 @@ void CamHelperImx500::parseInferenceData(libcamera::Span<const uint8_t> buffer,
 				strncpy(exported.networkName, inputTensorInfo.networkName.c_str(),
 					sizeof(exported.networkName));
 				exported.networkName[sizeof(exported.networkName) - 1] = '\0';
-				metadata.set("cnn.input_tensor_info", exported);
-				metadata.set("cnn.input_tensor", std::move(inputTensorInfo.data));
-				metadata.set("cnn.input_tensor_size", inputTensorInfo.size);
+				metadata.set(tags::cnnInputTensorInfo, exported);
+				metadata.set(tags::cnnInputTensor, std::move(inputTensorInfo.data));
+				metadata.set(tags::cnnInputTensorSize, inputTensorInfo.size);
 			}
 
 			/* We can now safely clear the saved input tensor. */
@@ -292,9 +302,9 @@ void CamHelperImx500::parseInferenceData(libcamera::Span<const uint8_t> buffer,
 			strncpy(exported.networkName, outputTensorInfo.networkName.c_str(),
 				sizeof(exported.networkName));
 			exported.networkName[sizeof(exported.networkName) - 1] = '\0';
-			metadata.set("cnn.output_tensor_info", exported);
-			metadata.set("cnn.output_tensor", std::move(outputTensorInfo.data));
-			metadata.set("cnn.output_tensor_size", outputTensorInfo.totalSize);
+			metadata.set(tags::cnnOutputTensorInfo, exported);
+			metadata.set(tags::cnnOutputTensor, std::move(outputTensorInfo.data));
+			metadata.set(tags::cnnOutputTensorSize, outputTensorInfo.totalSize);
 
 			auto itKpi = offsets.find(TensorType::Kpi);
 			if (itKpi != offsets.end()) {
@@ -311,7 +321,7 @@ void CamHelperImx500::parseInferenceData(libcamera::Span<const uint8_t> buffer,
 						 k[4 * DspRuntimeOffset + 2] << 16 |
 						 k[4 * DspRuntimeOffset + 1] << 8 |
 						 k[4 * DspRuntimeOffset];
-				metadata.set("cnn.kpi_info", kpi);
+				metadata.set(tags::cnnKpiInfo, kpi);
 			}
 		}
 	}
@@ -330,7 +340,7 @@ void CamHelperImx500::populateMetadata(const MdParser::RegisterMap &registers,
 	deviceStatus.frameLength = registers.at(frameLengthHiReg) * 256 + registers.at(frameLengthLoReg);
 	deviceStatus.sensorTemperature = std::clamp<int8_t>(registers.at(temperatureReg), -20, 80);
 
-	metadata.set("device.status", deviceStatus);
+	metadata.set(tags::deviceStatus, deviceStatus);
 }
 
 static CamHelper *create()
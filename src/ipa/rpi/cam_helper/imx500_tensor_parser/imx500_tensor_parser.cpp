@@ -7,11 +7,13 @@
 
 #include "imx500_tensor_parser.h"
 
+#include <algorithm>
 #include <cmath>
 #include <future>
 #include <limits>
 #include <optional>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -224,29 +226,66 @@ int populateOutputTensorInfo(IMX500OutputTensorInfo &outputTensorInfo,
 	return 0;
 }
 
+/* Read a little-endian element of type T from the tensor data. */
 template<typename T>
-float getVal8(const uint8_t *src, const OutputTensorApParams &param)
+T readElement(const uint8_t *src)
 {
-	T temp = (T)*src;
-	float value = (temp - param.shift) * param.scale;
-	return value;
+	using U = std::make_unsigned_t<T>;
+	U value = 0;
+
+	for (unsigned int i = 0; i < sizeof(T); i++)
+		value |= static_cast<U>(src[i]) << (8 * i);
+
+	return static_cast<T>(value);
+}
+
+/*
+ * Dequantize count consecutive elements of type T. The loop has no branches
+ * and no dependencies between iterations, which lets the compiler vectorise
+ * it.
+ */
+template<typename T>
+void dequantize(float *dst, const uint8_t *src, unsigned int count,
+		const OutputTensorApParams &param)
+{
+	const uint16_t shift = param.shift;
+	const float scale = param.scale;
+
+	for (unsigned int i = 0; i < count; i++)
+		dst[i] = (readElement<T>(src + i * sizeof(T)) - shift) * scale;
 }
 
+/*
+ * Dequantize the numElements elements of a tensor, stored in lines of
+ * maxLineLen bytes spaced by TensorStride in the sensor data.
+ */
 template<typename T>
-float getVal16(const uint8_t *src, const OutputTensorApParams &param)
+void dequantizeTensor(float *dst, const uint8_t *src, uint32_t numElements,
+		      uint16_t maxLineLen, const OutputTensorApParams &param)
 {
-	T temp = (((T) * (src + 1)) & 0xff) << 8 | (*src & 0xff);
-	float value = (temp - param.shift) * param.scale;
-	return value;
+	const uint32_t elementsPerLine = (maxLineLen + sizeof(T) - 1) / sizeof(T);
+
+	while (numElements) {
+		uint32_t count = std::min(elementsPerLine, numElements);
+		dequantize<T>(dst, src, count, param);
+
+		dst += count;
+		src += TensorStride;
+		numElements -= count;
+	}
 }
 
+/* Dequantize a tensor of signed or unsigned elements of the size of T. */
 template<typename T>
-float getVal32(const uint8_t *src, const OutputTensorApParams &param)
+void dequantizeTensorData(float *dst, const uint8_t *src, uint32_t numElements,
+			  uint16_t maxLineLen, const OutputTensorApParams &param)
 {
-	T temp = (((T) * (src + 3)) & 0xff) << 24 | (((T) * (src + 2)) & 0xff) << 16 |
-		 (((T) * (src + 1)) & 0xff) << 8 | (*src & 0xff);
-	float value = (temp - param.shift) * param.scale;
-	return value;
+	using S = std::make_signed_t<T>;
+
+	if (param.format == TensorDataType::Signed)
+		dequantizeTensor<S>(dst, src, numElements, maxLineLen, param);
+	else
+		dequantizeTensor<T>(dst, src, numElements, maxLineLen, param);
 }
 
 int parseOutputTensorBody(IMX500OutputTensorInfo &outputTensorInfo, const uint8_t *src,
@@ -261,7 +300,6 @@ int parseOutputTensorBody(IMX500OutputTensorInfo &outputTensorInfo, const uint8_
 		return -1;
 	}
 
-	std::unique_ptr<float[]> tmpDst = std::make_unique<float[]>(outputTensorInfo.totalSize);
 	std::vector<uint16_t> numLinesVec(outputApParams.size());
 	std::vector<uint32_t> outSizes(outputApParams.size());
 	std::vector<uint32_t> offsets(outputApParams.size());
@@ -331,147 +369,107 @@ int parseOutputTensorBody(IMX500OutputTensorInfo &outputTensorInfo, const uint8_
 		}
 	}
 
-	std::vector<std::future<int>> futures;
-	for (unsigned int ii = 0; ii < idxs.size(); ii++) {
-		uint32_t idx = idxs[ii];
-		futures.emplace_back(std::async(
-			std::launch::async,
-			[&tmpDst, &outSizes, &numLinesVec, &actualDims, &serializedDims,
-			 &outputApParams, &dnnHeader, dst](int tensorIdx, const uint8_t *tsrc, int toffset) -> int {
-				uint32_t outputTensorSize = outSizes[tensorIdx];
-				uint16_t numLines = numLinesVec[tensorIdx];
-				bool sortingRequired = false;
-
-				const OutputTensorApParams &param = outputApParams[tensorIdx];
-				const std::vector<Dimensions> &serializedDim = serializedDims[tensorIdx];
-				const std::vector<Dimensions> &actualDim = actualDims[tensorIdx];
-
-				for (unsigned i = 0; i < param.numDimensions; i++) {
-					if (param.vecDim.at(i).serializationIndex != param.vecDim.at(i).ordinal)
-						sortingRequired = true;
-				}
+	auto needsSorting = [](const OutputTensorApParams &param) {
+		for (unsigned i = 0; i < param.numDimensions; i++) {
+			if (param.vecDim.at(i).serializationIndex != param.vecDim.at(i).ordinal)
+				return true;
+		}
+		return false;
+	};
 
-				if (!outputTensorSize) {
-					LOG(IMX500, Error) << "Invalid output tensorsize (0)";
-					return -1;
-				}
+	/* Only the tensors that need to be reordered use a temporary buffer. */
+	std::unique_ptr<float[]> tmpDst;
+	if (std::any_of(outputApParams.begin(), outputApParams.end(), needsSorting))
+		tmpDst = std::make_unique<float[]>(outputTensorInfo.totalSize);
 
-				/* Extract output tensor data */
-				uint32_t elementIndex = 0;
-				if (param.bitsPerElement == 8) {
-					for (unsigned int i = 0; i < numLines; i++) {
-						int lineIndex = 0;
-						while (lineIndex < dnnHeader.maxLineLen) {
-							if (param.format == TensorDataType::Signed)
-								tmpDst[toffset + elementIndex] =
-									getVal8<int8_t>(tsrc + lineIndex, param);
-							else
-								tmpDst[toffset + elementIndex] =
-									getVal8<uint8_t>(tsrc + lineIndex, param);
-							elementIndex++;
-							lineIndex++;
-							if (elementIndex == outputTensorSize)
-								break;
-						}
-						tsrc += TensorStride;
-						if (elementIndex == outputTensorSize)
-							break;
-					}
-				} else if (param.bitsPerElement == 16) {
-					for (unsigned int i = 0; i < numLines; i++) {
-						int lineIndex = 0;
-						while (lineIndex < dnnHeader.maxLineLen) {
-							if (param.format == TensorDataType::Signed)
-								tmpDst[toffset + elementIndex] =
-									getVal16<int16_t>(tsrc + lineIndex, param);
-							else
-								tmpDst[toffset + elementIndex] =
-									getVal16<uint16_t>(tsrc + lineIndex, param);
-							elementIndex++;
-							lineIndex += 2;
-							if (elementIndex >= (outputTensorSize >> 1))
-								break;
-						}
-						tsrc += TensorStride;
-						if (elementIndex >= (outputTensorSize >> 1))
-							break;
-					}
-				} else if (param.bitsPerElement == 32) {
-					for (unsigned int i = 0; i < numLines; i++) {
-						int lineIndex = 0;
-						while (lineIndex < dnnHeader.maxLineLen) {
-							if (param.format == TensorDataType::Signed)
-								tmpDst[toffset + elementIndex] =
-									getVal32<int32_t>(tsrc + lineIndex, param);
-							else
-								tmpDst[toffset + elementIndex] =
-									getVal32<uint32_t>(tsrc + lineIndex, param);
-							elementIndex++;
-							lineIndex += 4;
-							if (elementIndex >= (outputTensorSize >> 2))
-								break;
-						}
-						tsrc += TensorStride;
-						if (elementIndex >= (outputTensorSize >> 2))
-							break;
-					}
+	auto parseTensor = [&tmpDst, &outSizes, &actualDims, &serializedDims, &outputApParams,
+			    &dnnHeader, &needsSorting, dst](int tensorIdx, const uint8_t *tsrc, int toffset) -> int {
+		uint32_t outputTensorSize = outSizes[tensorIdx];
+
+		const OutputTensorApParams &param = outputApParams[tensorIdx];
+		const std::vector<Dimensions> &serializedDim = serializedDims[tensorIdx];
+		const std::vector<Dimensions> &actualDim = actualDims[tensorIdx];
+		bool sortingRequired = needsSorting(param);
+
+		if (!outputTensorSize) {
+			LOG(IMX500, Error) << "Invalid output tensorsize (0)";
+			return -1;
+		}
+
+		/*
+		 * Extract the output tensor data. Tensors that need to be
+		 * reordered are dequantized to a temporary buffer first, the
+		 * others straight to the output.
+		 */
+		uint32_t numElements = outputTensorSize / (param.bitsPerElement / 8);
+		float *out = sortingRequired ? tmpDst.get() + toffset : dst + toffset;
+
+		if (param.bitsPerElement == 8)
+			dequantizeTensorData<uint8_t>(out, tsrc, numElements,
+						      dnnHeader.maxLineLen, param);
+		else if (param.bitsPerElement == 16)
+			dequantizeTensorData<uint16_t>(out, tsrc, numElements,
+						       dnnHeader.maxLineLen, param);
+		else if (param.bitsPerElement == 32)
+			dequantizeTensorData<uint32_t>(out, tsrc, numElements,
+						       dnnHeader.maxLineLen, param);
+		else {
+			LOG(IMX500, Error)
+				<< "Invalid bitsPerElement value =" << param.bitsPerElement;
+			return -1;
+		}
+
+		/*
+		 * Sorting in order according to AP Params. Not supported if larger than 3D
+		 * Preparation:
+		 */
+		if (sortingRequired) {
+			constexpr unsigned int DimensionMax = 3;
+
+			std::array<uint32_t, DimensionMax> loopCnt{ 1, 1, 1 };
+			std::array<uint32_t, DimensionMax> coef{ 1, 1, 1 };
+			for (unsigned int i = 0; i < param.numDimensions; i++) {
+				if (i >= DimensionMax) {
+					LOG(IMX500, Error) << "numDimensions value is 3 or higher";
+					break;
 				}
 
-				/*
-				 * Sorting in order according to AP Params. Not supported if larger than 3D
-				 * Preparation:
-				 */
-				if (sortingRequired) {
-					constexpr unsigned int DimensionMax = 3;
-
-					std::array<uint32_t, DimensionMax> loopCnt{ 1, 1, 1 };
-					std::array<uint32_t, DimensionMax> coef{ 1, 1, 1 };
-					for (unsigned int i = 0; i < param.numDimensions; i++) {
-						if (i >= DimensionMax) {
-							LOG(IMX500, Error) << "numDimensions value is 3 or higher";
-							break;
-						}
-
-						loopCnt[i] = serializedDim.at(i).size;
-
-						for (unsigned int j = serializedDim.at(i).serializationIndex; j > 0; j--)
-							coef[i] *= actualDim.at(j - 1).size;
-					}
-					/* Sort execution */
-					unsigned int srcIndex = 0;
-					unsigned int dstIndex;
-					for (unsigned int i = 0; i < loopCnt[DimensionMax - 1]; i++) {
-						for (unsigned int j = 0; j < loopCnt[DimensionMax - 2]; j++) {
-							for (unsigned int k = 0; k < loopCnt[DimensionMax - 3]; k++) {
-								dstIndex = (coef[DimensionMax - 1] * i) +
-									   (coef[DimensionMax - 2] * j) +
-									   (coef[DimensionMax - 3] * k);
-								dst[toffset + dstIndex] = tmpDst[toffset + srcIndex++];
-							}
-						}
-					}
-				} else {
-					if (param.bitsPerElement == 8)
-						memcpy(dst + toffset, tmpDst.get() + toffset,
-						       outputTensorSize * sizeof(float));
-					else if (param.bitsPerElement == 16)
-						memcpy(dst + toffset, tmpDst.get() + toffset,
-						       (outputTensorSize >> 1) * sizeof(float));
-					else if (param.bitsPerElement == 32)
-						memcpy(dst + toffset, tmpDst.get() + toffset,
-						       (outputTensorSize >> 2) * sizeof(float));
-					else {
-						LOG(IMX500, Error)
-							<< "Invalid bitsPerElement value =" << param.bitsPerElement;
-						return -1;
+				loopCnt[i] = serializedDim.at(i).size;
+
+				for (unsigned int j = serializedDim.at(i).serializationIndex; j > 0; j--)
+					coef[i] *= actualDim.at(j - 1).size;
+			}
+			/* Sort execution */
+			unsigned int srcIndex = 0;
+			unsigned int dstIndex;
+			for (unsigned int i = 0; i < loopCnt[DimensionMax - 1]; i++) {
+				for (unsigned int j = 0; j < loopCnt[DimensionMax - 2]; j++) {
+					for (unsigned int k = 0; k < loopCnt[DimensionMax - 3]; k++) {
+						dstIndex = (coef[DimensionMax - 1] * i) +
+							   (coef[DimensionMax - 2] * j) +
+							   (coef[DimensionMax - 3] * k);
+						dst[toffset + dstIndex] = tmpDst[toffset + srcIndex++];
 					}
 				}
+			}
+		}
+
+		return 0;
+	};
 
-				return 0;
-			},
-			idx, srcArr[idx], offsets[idx]));
+	/*
+	 * Parse the tensors in parallel, the largest one on the calling thread
+	 * and the others on threads of their own.
+	 */
+	std::vector<std::future<int>> futures;
+	for (unsigned int ii = 1; ii < idxs.size(); ii++) {
+		uint32_t idx = idxs[ii];
+		futures.emplace_back(std::async(std::launch::async, parseTensor,
+						idx, srcArr[idx], offsets[idx]));
 	}
 
+	ret += parseTensor(idxs[0], srcArr[idxs[0]], offsets[idxs[0]]);
+
 	for (auto &f : futures)
 		ret += f.get();
 
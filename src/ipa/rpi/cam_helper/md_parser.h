@@ -10,6 +10,8 @@
 #include <map>
 #include <optional>
 #include <stdint.h>
+#include <utility>
+#include <vector>
 
 #include <libcamera/base/span.h>
 
@@ -148,8 +150,15 @@ private:
 	};
 
 	ParseStatus findRegs(libcamera::Span<const uint8_t> buffer);
+	bool readRegs(libcamera::Span<const uint8_t> buffer,
+		      RegisterMap &registers) const;
 
 	OffsetMap offsets_;
+	/*
+	 * The offsets found by the last successful findRegs() call, which are
+	 * read directly on the following frames.
+	 */
+	std::vector<std::pair<uint32_t, uint32_t>> regOffsets_;
 };
 
 } /* namespace RPi */
@@ -36,42 +36,80 @@ MdParserSmia::MdParserSmia(std::initializer_list<uint32_t> registerList)
 MdParser::Status MdParserSmia::parse(libcamera::Span<const uint8_t> buffer,
 				     RegisterMap &registers)
 {
-	if (reset_) {
-		/*
-		 * Search again through the metadata for all the registers
-		 * requested.
-		 */
-		ASSERT(bitsPerPixel_);
-
-		for (const auto &kv : offsets_)
-			offsets_[kv.first] = {};
-
-		ParseStatus ret = findRegs(buffer);
-		/*
-		 * > 0 means "worked partially but parse again next time",
-		 * < 0 means "hard error".
-		 *
-		 * In either case, we retry parsing on the next frame.
-		 */
-		if (ret != ParseOk)
-			return ERROR;
-
-		reset_ = false;
+	/*
+	 * The layout of the embedded data doesn't change for a given sensor
+	 * mode, so read the registers at the offsets found previously.
+	 */
+	if (!reset_ && readRegs(buffer, registers))
+		return OK;
+
+	/*
+	 * Search again through the metadata for all the registers requested,
+	 * either because the layout may have changed or because the offsets
+	 * found previously don't match this buffer.
+	 */
+	ASSERT(bitsPerPixel_);
+
+	reset_ = true;
+	for (const auto &kv : offsets_)
+		offsets_[kv.first] = {};
+
+	ParseStatus ret = findRegs(buffer);
+	/*
+	 * > 0 means "worked partially but parse again next time",
+	 * < 0 means "hard error".
+	 *
+	 * In either case, we retry parsing on the next frame.
+	 */
+	if (ret != ParseOk)
+		return ERROR;
+
+	regOffsets_.clear();
+	for (const auto &[reg, offset] : offsets_) {
+		if (!offset)
+			return NOTFOUND;
+		regOffsets_.emplace_back(reg, offset.value());
 	}
 
+	reset_ = false;
+
 	/* Populate the register values requested. */
 	registers.clear();
-	for (const auto &[reg, offset] : offsets_) {
-		if (!offset) {
-			reset_ = true;
-			return NOTFOUND;
-		}
-		registers[reg] = buffer[offset.value()];
-	}
+	for (const auto &[reg, offset] : regOffsets_)
+		registers[reg] = buffer[offset];
 
 	return OK;
 }
 
+/*
+ * Read the register values at the offsets found by the last successful
+ * findRegs() call, checking that each of them still follows a register value
+ * tag. Return false if the buffer doesn't match, in which case it must be
+ * parsed again.
+ */
+bool MdParserSmia::readRegs(libcamera::Span<const uint8_t> buffer,
+			    RegisterMap &registers) const
+{
+	if (buffer.empty() || buffer[0] != LineStart)
+		return false;
+
+	for (const auto &[reg, offset] : regOffsets_) {
+		if (offset >= buffer.size())
+			return false;
+
+		/* A dummy byte may sit between the tag and the value. */
+		if (buffer[offset - 1] != RegValue &&
+		    (buffer[offset - 1] != RegSkip || buffer[offset - 2] != RegValue))
+			return false;
+	}
+
+	registers.clear();
+	for (const auto &[reg, offset] : regOffsets_)
+		registers[reg] = buffer[offset];
+
+	return true;
+}
+
 MdParserSmia::ParseStatus MdParserSmia::findRegs(libcamera::Span<const uint8_t> buffer)
 {
 	ASSERT(offsets_.size());
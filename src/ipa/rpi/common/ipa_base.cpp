@@ -8,6 +8,7 @@
 #include "ipa_base.h"
 
 #include <cmath>
+#include <string.h>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/span.h>
@@ -46,12 +47,19 @@ constexpr Duration defaultMinFrameDuration = 1.0s / 30.0;
 constexpr Duration defaultMaxFrameDuration = 250.0s;
 
 /*
- * Determine the minimum allowable inter-frame duration to run the controller
- * algorithms. If the pipeline handler provider frames at a rate higher than this,
- * we rate-limit the controller Prepare() and Process() calls to lower than or
- * equal to this rate.
+ * When skipping late frames, the controller still runs at least once every
+ * this many frames, so that the algorithms keep converging.
  */
-constexpr Duration controllerMinFrameDuration = 1.0s / 30.0;
+constexpr unsigned int maxLateFrameSkips = 4;
+
+/* Filter coefficient for the reported controller skip ratio. */
+constexpr double skipRatioFilter = 1.0 / 16;
+
+/*
+ * Number of slots in the CNN output tensor buffer, which bounds how long the
+ * tensors of a frame stay valid for applications.
+ */
+constexpr unsigned int numCnnOutputTensorSlots = 16;
 
 /* List of controls handled by the Raspberry Pi IPA */
 const ControlInfoMap::Map ipaControls{
@@ -75,6 +83,7 @@ const ControlInfoMap::Map ipaControls{
 	{ &controls::draft::NoiseReductionMode, ControlInfo(controls::draft::NoiseReductionModeValues) },
 	{ &controls::rpi::StatsOutputEnable, ControlInfo(false, true, false) },
 	{ &controls::rpi::CnnEnableInputTensor, ControlInfo(false, true, false) },
+	{ &controls::rpi::WarmStartState, ControlInfo(0.0f, 1000000.0f) },
 };
 
 /* IPA controls handled conditionally, if the sensor is not mono */
@@ -113,7 +122,9 @@ namespace ipa::RPi {
 IpaBase::IpaBase()
 	: controller_(), frameLengths_(FrameLengthsQueueSize, 0s), statsMetadataOutput_(false),
 	  stitchSwapBuffers_(false), frameCount_(0), mistrustCount_(0), lastRunTimestamp_(0),
-	  firstStart_(true), flickerState_({ 0, 0s }), cnnEnableInputTensor_(false)
+	  lastFrameTimestamp_(0), framesSinceRun_(0), skipRatio_(0.0),
+	  firstStart_(true), flickerState_({ 0, 0s }), cnnEnableInputTensor_(false),
+	  cnnOutputTensorSlot_(0), cnnEnableOutputTensorBuffer_(false)
 {
 }
 
@@ -176,6 +187,24 @@ int32_t IpaBase::init(const IPASettings &settings, const InitParams &params, Ini
 	if (!monoSensor_)
 		ctrlMap.merge(ControlInfoMap::Map(ipaColourControls));
 
+	/*
+	 * Allocate the buffer the CNN output tensors are delivered through if
+	 * the sensor produces them. The pages of the buffer are only allocated
+	 * when the tensors are first written to them.
+	 */
+	unsigned int maxOutputTensorSize = helper_->maxOutputTensorSize();
+	if (maxOutputTensorSize) {
+		cnnOutputTensorBuffer_ = SharedMem("rpi_cnn_output_tensors",
+						   numCnnOutputTensorSlots * maxOutputTensorSize);
+		if (cnnOutputTensorBuffer_) {
+			ctrlMap[&controls::rpi::CnnEnableOutputTensorBuffer] = ControlInfo(false, true, false);
+			result->cnnOutputTensorBuffer = cnnOutputTensorBuffer_.fd();
+		} else {
+			LOG(IPARPI, Warning)
+				<< "Failed to allocate the CNN output tensor buffer";
+		}
+	}
+
 	result->controlInfo = ControlInfoMap(std::move(ctrlMap), controls::controls);
 
 	return platformInit(params, result);
@@ -292,6 +321,13 @@ void IpaBase::start(const ControlList &controls, StartResult *result)
 		applyControls(controls);
 	}
 
+	/*
+	 * On the first start, the algorithms can start from the converged state
+	 * of a previous run saved by the application, instead of converging
+	 * from the defaults.
+	 */
+	bool warmStart = firstStart_ && restoreWarmStartState(controls);
+
 	controller_.switchMode(mode_, &metadata);
 
 	/* Reset the frame lengths queue state. */
@@ -304,7 +340,7 @@ void IpaBase::start(const ControlList &controls, StartResult *result)
 	agcStatus.shutterTime = 0.0s;
 	agcStatus.analogueGain = 0.0;
 
-	metadata.get("agc.status", agcStatus);
+	metadata.get(RPiController::tags::agcStatus, agcStatus);
 	if (agcStatus.shutterTime && agcStatus.analogueGain) {
 		ControlList ctrls(sensorCtrls_);
 		applyAGC(&agcStatus, ctrls);
@@ -330,11 +366,13 @@ void IpaBase::start(const ControlList &controls, StartResult *result)
 		 * we must allow for the frames with bad statistics
 		 * (mistrustCount_) that they won't see. But if zero (i.e.
 		 * no convergence necessary), no frames need to be dropped.
+		 * Neither do they on a warm start, as the algorithms start
+		 * from their converged state.
 		 */
 		unsigned int agcConvergenceFrames = 0;
 		RPiController::AgcAlgorithm *agc = dynamic_cast<RPiController::AgcAlgorithm *>(
 			controller_.getAlgorithm("agc"));
-		if (agc) {
+		if (agc && !warmStart) {
 			agcConvergenceFrames = agc->getConvergenceFrames();
 			if (agcConvergenceFrames)
 				agcConvergenceFrames += mistrustCount_;
@@ -343,7 +381,7 @@ void IpaBase::start(const ControlList &controls, StartResult *result)
 		unsigned int awbConvergenceFrames = 0;
 		RPiController::AwbAlgorithm *awb = dynamic_cast<RPiController::AwbAlgorithm *>(
 			controller_.getAlgorithm("awb"));
-		if (awb) {
+		if (awb && !warmStart) {
 			awbConvergenceFrames = awb->getConvergenceFrames();
 			if (awbConvergenceFrames)
 				awbConvergenceFrames += mistrustCount_;
@@ -360,10 +398,45 @@ void IpaBase::start(const ControlList &controls, StartResult *result)
 
 	firstStart_ = false;
 	lastRunTimestamp_ = 0;
+	lastFrameTimestamp_ = 0;
+	framesSinceRun_ = 0;
+	skipRatio_ = 0.0;
 
 	platformStart(controls, result);
 }
 
+bool IpaBase::restoreWarmStartState(const ControlList &controls)
+{
+	using RPiController::AgcAlgorithm;
+	using RPiController::AwbAlgorithm;
+
+	const auto state = controls.get(controls::rpi::WarmStartState);
+	if (!state)
+		return false;
+
+	const Duration shutter = (*state)[0] * 1.0us;
+	const double analogueGain = (*state)[1];
+	if (!shutter || analogueGain < 1.0) {
+		LOG(IPARPI, Warning) << "Invalid warm start state, ignoring";
+		return false;
+	}
+
+	AgcAlgorithm *agc = dynamic_cast<AgcAlgorithm *>(controller_.getAlgorithm("agc"));
+	if (agc)
+		agc->setInitialExposure(shutter, analogueGain);
+
+	AwbAlgorithm *awb = dynamic_cast<AwbAlgorithm *>(controller_.getAlgorithm("awb"));
+	if (awb && (*state)[2] > 0.0f && (*state)[3] > 0.0f && (*state)[4] > 0.0f)
+		awb->setInitialValues((*state)[2], (*state)[3], (*state)[4]);
+
+	LOG(IPARPI, Debug)
+		<< "Starting from exposure " << shutter << ", gain "
+		<< analogueGain << ", colour gains " << (*state)[2] << "/"
+		<< (*state)[3] << " at " << (*state)[4] << "K";
+
+	return true;
+}
+
 void IpaBase::mapBuffers(const std::vector<IPABuffer> &buffers)
 {
 	for (const IPABuffer &buffer : buffers) {
@@ -422,8 +495,8 @@ void IpaBase::prepareIsp(const PrepareParams &params)
 	AgcStatus agcStatus;
 	bool hdrChange = false;
 	RPiController::Metadata &delayedMetadata = rpiMetadata_[params.delayContext];
-	if (!delayedMetadata.get<AgcStatus>("agc.status", agcStatus)) {
-		rpiMetadata.set("agc.delayed_status", agcStatus);
+	if (!delayedMetadata.get<AgcStatus>(RPiController::tags::agcStatus, agcStatus)) {
+		rpiMetadata.set(RPiController::tags::agcDelayedStatus, agcStatus);
 		hdrChange = agcStatus.hdr.mode != hdrStatus_.mode;
 		hdrStatus_ = agcStatus.hdr;
 	}
@@ -434,10 +507,8 @@ void IpaBase::prepareIsp(const PrepareParams &params)
 	 */
 	helper_->prepare(embeddedBuffer, rpiMetadata);
 
-	/* Allow a 10% margin on the comparison below. */
-	Duration delta = (frameTimestamp - lastRunTimestamp_) * 1.0ns;
-	if (lastRunTimestamp_ && frameCount_ > dropFrameCount_ &&
-	    delta < controllerMinFrameDuration * 0.9 && !hdrChange) {
+	if (lastRunTimestamp_ && frameCount_ > dropFrameCount_ && !hdrChange &&
+	    skipControllerRun(frameTimestamp)) {
 		/*
 		 * Ensure we merge the previous frame's metadata with the current
 		 * frame. This will not overwrite exposure/gain values for the
@@ -448,11 +519,16 @@ void IpaBase::prepareIsp(const PrepareParams &params)
 			rpiMetadata_[(ipaContext ? ipaContext : rpiMetadata_.size()) - 1];
 		rpiMetadata.mergeCopy(lastMetadata);
 		processPending_ = false;
+		framesSinceRun_++;
 	} else {
 		processPending_ = true;
 		lastRunTimestamp_ = frameTimestamp;
+		framesSinceRun_ = 0;
 	}
 
+	lastFrameTimestamp_ = frameTimestamp;
+	skipRatio_ += ((processPending_ ? 0.0 : 1.0) - skipRatio_) * skipRatioFilter;
+
 	/*
 	 * If the statistics are inline (i.e. already available with the Bayer
 	 * frame), call processStats() now before prepare().
@@ -477,6 +553,35 @@ void IpaBase::prepareIsp(const PrepareParams &params)
 	prepareIspComplete.emit(params.buffers, stitchSwapBuffers_);
 }
 
+bool IpaBase::skipControllerRun(uint64_t frameTimestamp) const
+{
+	const RPiController::Controller::RateConfig &rate = controller_.getRateConfig();
+
+	/* Allow a 10% margin on the comparison below. */
+	Duration delta = (frameTimestamp - lastRunTimestamp_) * 1.0ns;
+	if (delta < rate.minFrameDuration * 0.9)
+		return true;
+
+	if (framesSinceRun_ + 1 < rate.frameDecimation)
+		return true;
+
+	/*
+	 * When the IPA falls behind, frames reach it longer after they were
+	 * captured. Skip the ones that are older than two frame intervals, as
+	 * their results would be stale by the time they are applied.
+	 */
+	if (rate.skipLateFrames && lastFrameTimestamp_ &&
+	    framesSinceRun_ < maxLateFrameSkips) {
+		Duration interval = (frameTimestamp - lastFrameTimestamp_) * 1.0ns;
+		Duration age = utils::clock::now().time_since_epoch() -
+			       frameTimestamp * 1.0ns;
+		if (age > 2 * interval)
+			return true;
+	}
+
+	return false;
+}
+
 void IpaBase::processStats(const ProcessParams &params)
 {
 	unsigned int ipaContext = params.ipaContext % rpiMetadata_.size();
@@ -493,13 +598,13 @@ void IpaBase::processStats(const ProcessParams &params)
 		RPiController::StatisticsPtr statistics = platformProcessStats(it->second.planes()[0]);
 
 		/* reportMetadata() will pick this up and set the FocusFoM metadata */
-		rpiMetadata.set("focus.status", statistics->focusRegions);
+		rpiMetadata.set(RPiController::tags::focusStatus, statistics->focusRegions);
 
 		helper_->process(statistics, rpiMetadata);
 		controller_.process(statistics, &rpiMetadata);
 
 		struct AgcStatus agcStatus;
-		if (rpiMetadata.get("agc.status", agcStatus) == 0) {
+		if (rpiMetadata.get(RPiController::tags::agcStatus, agcStatus) == 0) {
 			ControlList ctrls(sensorCtrls_);
 			applyAGC(&agcStatus, ctrls);
 			setDelayedControls.emit(ctrls, ipaContext);
@@ -1265,6 +1370,19 @@ void IpaBase::applyControls(const ControlList &controls)
 			cnnEnableInputTensor_ = ctrl.second.get<bool>();
 			break;
 
+		case controls::rpi::CNN_ENABLE_OUTPUT_TENSOR_BUFFER:
+			cnnEnableOutputTensorBuffer_ = ctrl.second.get<bool>();
+			break;
+
+		case controls::draft::LATENCY_REPORTING:
+		case controls::rpi::LOW_LATENCY:
+			/* Handled by the pipeline handler. */
+			break;
+
+		case controls::rpi::WARM_START_STATE:
+			/* Handled in start(). */
+			break;
+
 		default:
 			LOG(IPARPI, Warning)
 				<< "Ctrl " << controls::controls.at(ctrl.first)->name()
@@ -1298,7 +1416,7 @@ void IpaBase::fillDeviceStatus(const ControlList &sensorControls, unsigned int i
 
 	LOG(IPARPI, Debug) << "Metadata - " << deviceStatus;
 
-	rpiMetadata_[ipaContext].set("device.status", deviceStatus);
+	rpiMetadata_[ipaContext].set(RPiController::tags::deviceStatus, deviceStatus);
 }
 
 void IpaBase::reportMetadata(unsigned int ipaContext)
@@ -1311,7 +1429,7 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 	 * processed can be extracted and placed into the libcamera metadata
 	 * buffer, where an application could query it.
 	 */
-	DeviceStatus *deviceStatus = rpiMetadata.getLocked<DeviceStatus>("device.status");
+	DeviceStatus *deviceStatus = rpiMetadata.getLocked<DeviceStatus>(RPiController::tags::deviceStatus);
 	if (deviceStatus) {
 		libcameraMetadata_.set(controls::ExposureTime,
 				       deviceStatus->shutterSpeed.get<std::micro>());
@@ -1324,24 +1442,42 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 			libcameraMetadata_.set(controls::LensPosition, *deviceStatus->lensPosition);
 	}
 
-	AgcPrepareStatus *agcPrepareStatus = rpiMetadata.getLocked<AgcPrepareStatus>("agc.prepare_status");
+	AgcPrepareStatus *agcPrepareStatus = rpiMetadata.getLocked<AgcPrepareStatus>(RPiController::tags::agcPrepareStatus);
 	if (agcPrepareStatus) {
 		libcameraMetadata_.set(controls::AeLocked, agcPrepareStatus->locked);
 		libcameraMetadata_.set(controls::DigitalGain, agcPrepareStatus->digitalGain);
 	}
 
-	LuxStatus *luxStatus = rpiMetadata.getLocked<LuxStatus>("lux.status");
+	LuxStatus *luxStatus = rpiMetadata.getLocked<LuxStatus>(RPiController::tags::luxStatus);
 	if (luxStatus)
 		libcameraMetadata_.set(controls::Lux, luxStatus->lux);
 
-	AwbStatus *awbStatus = rpiMetadata.getLocked<AwbStatus>("awb.status");
+	libcameraMetadata_.set(controls::rpi::ControllerSkipRatio,
+			       static_cast<float>(skipRatio_));
+
+	AwbStatus *awbStatus = rpiMetadata.getLocked<AwbStatus>(RPiController::tags::awbStatus);
 	if (awbStatus) {
 		libcameraMetadata_.set(controls::ColourGains, { static_cast<float>(awbStatus->gainR),
 								static_cast<float>(awbStatus->gainB) });
 		libcameraMetadata_.set(controls::ColourTemperature, awbStatus->temperatureK);
 	}
 
-	BlackLevelStatus *blackLevelStatus = rpiMetadata.getLocked<BlackLevelStatus>("black_level.status");
+	/* Report the state to restart from, as documented with the control. */
+	if (deviceStatus) {
+		const float shutter = deviceStatus->shutterSpeed.get<std::micro>();
+		const float gain = deviceStatus->analogueGain;
+		if (awbStatus)
+			libcameraMetadata_.set(controls::rpi::WarmStartState,
+					       { shutter, gain,
+						 static_cast<float>(awbStatus->gainR),
+						 static_cast<float>(awbStatus->gainB),
+						 static_cast<float>(awbStatus->temperatureK) });
+		else
+			libcameraMetadata_.set(controls::rpi::WarmStartState,
+					       { shutter, gain, 1.0f, 1.0f, 0.0f });
+	}
+
+	BlackLevelStatus *blackLevelStatus = rpiMetadata.getLocked<BlackLevelStatus>(RPiController::tags::blackLevelStatus);
 	if (blackLevelStatus)
 		libcameraMetadata_.set(controls::SensorBlackLevels,
 				       { static_cast<int32_t>(blackLevelStatus->blackLevelR),
@@ -1350,7 +1486,7 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 					 static_cast<int32_t>(blackLevelStatus->blackLevelB) });
 
 	RPiController::FocusRegions *focusStatus =
-		rpiMetadata.getLocked<RPiController::FocusRegions>("focus.status");
+		rpiMetadata.getLocked<RPiController::FocusRegions>(RPiController::tags::focusStatus);
 	if (focusStatus) {
 		/*
 		 * Calculate the average FoM over the central (symmetric) positions
@@ -1374,7 +1510,7 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 		libcameraMetadata_.set(controls::FocusFoM, focusFoM);
 	}
 
-	CcmStatus *ccmStatus = rpiMetadata.getLocked<CcmStatus>("ccm.status");
+	CcmStatus *ccmStatus = rpiMetadata.getLocked<CcmStatus>(RPiController::tags::ccmStatus);
 	if (ccmStatus) {
 		float m[9];
 		for (unsigned int i = 0; i < 9; i++)
@@ -1382,7 +1518,7 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 		libcameraMetadata_.set(controls::ColourCorrectionMatrix, m);
 	}
 
-	const AfStatus *afStatus = rpiMetadata.getLocked<AfStatus>("af.status");
+	const AfStatus *afStatus = rpiMetadata.getLocked<AfStatus>(RPiController::tags::afStatus);
 	if (afStatus) {
 		int32_t s, p;
 		switch (afStatus->state) {
@@ -1419,7 +1555,7 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 	 * delayed_status to be available, we use the HDR status that came out of the
 	 * switchMode call.
 	 */
-	const AgcStatus *agcStatus = rpiMetadata.getLocked<AgcStatus>("agc.delayed_status");
+	const AgcStatus *agcStatus = rpiMetadata.getLocked<AgcStatus>(RPiController::tags::agcDelayedStatus);
 	const HdrStatus &hdrStatus = agcStatus ? agcStatus->hdr : hdrStatus_;
 	if (!hdrStatus.mode.empty() && hdrStatus.mode != "Off") {
 		int32_t hdrMode = controls::HdrModeOff;
@@ -1442,17 +1578,17 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 	}
 
 	const std::shared_ptr<uint8_t[]> *inputTensor =
-		rpiMetadata.getLocked<std::shared_ptr<uint8_t[]>>("cnn.input_tensor");
+		rpiMetadata.getLocked<std::shared_ptr<uint8_t[]>>(RPiController::tags::cnnInputTensor);
 	if (cnnEnableInputTensor_ && inputTensor) {
-		unsigned int size = *rpiMetadata.getLocked<unsigned int>("cnn.input_tensor_size");
+		unsigned int size = *rpiMetadata.getLocked<unsigned int>(RPiController::tags::cnnInputTensorSize);
 		Span<const uint8_t> tensor{ inputTensor->get(), size };
 		libcameraMetadata_.set(controls::rpi::CnnInputTensor, tensor);
 		/* No need to keep these big buffers any more. */
-		rpiMetadata.eraseLocked("cnn.input_tensor");
+		rpiMetadata.eraseLocked(RPiController::tags::cnnInputTensor);
 	}
 
 	const RPiController::CnnInputTensorInfo *inputTensorInfo =
-		rpiMetadata.getLocked<RPiController::CnnInputTensorInfo>("cnn.input_tensor_info");
+		rpiMetadata.getLocked<RPiController::CnnInputTensorInfo>(RPiController::tags::cnnInputTensorInfo);
 	if (inputTensorInfo) {
 		Span<const uint8_t> tensorInfo{ reinterpret_cast<const uint8_t *>(inputTensorInfo),
 						sizeof(*inputTensorInfo) };
@@ -1460,18 +1596,19 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 	}
 
 	const std::shared_ptr<float[]> *outputTensor =
-		rpiMetadata.getLocked<std::shared_ptr<float[]>>("cnn.output_tensor");
+		rpiMetadata.getLocked<std::shared_ptr<float[]>>(RPiController::tags::cnnOutputTensor);
 	if (outputTensor) {
-		unsigned int size = *rpiMetadata.getLocked<unsigned int>("cnn.output_tensor_size");
+		unsigned int size = *rpiMetadata.getLocked<unsigned int>(RPiController::tags::cnnOutputTensorSize);
 		Span<const float> tensor{ reinterpret_cast<const float *>(outputTensor->get()),
 					  size };
-		libcameraMetadata_.set(controls::rpi::CnnOutputTensor, tensor);
+		if (!cnnEnableOutputTensorBuffer_ || !writeCnnOutputTensor(tensor))
+			libcameraMetadata_.set(controls::rpi::CnnOutputTensor, tensor);
 		/* No need to keep these big buffers any more. */
-		rpiMetadata.eraseLocked("cnn.output_tensor");
+		rpiMetadata.eraseLocked(RPiController::tags::cnnOutputTensor);
 	}
 
 	const RPiController::CnnOutputTensorInfo *outputTensorInfo =
-		rpiMetadata.getLocked<RPiController::CnnOutputTensorInfo>("cnn.output_tensor_info");
+		rpiMetadata.getLocked<RPiController::CnnOutputTensorInfo>(RPiController::tags::cnnOutputTensorInfo);
 	if (outputTensorInfo) {
 		Span<const uint8_t> tensorInfo{ reinterpret_cast<const uint8_t *>(outputTensorInfo),
 						sizeof(*outputTensorInfo) };
@@ -1479,7 +1616,7 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 	}
 
 	const RPiController::CnnKpiInfo *kpiInfo =
-		rpiMetadata.getLocked<RPiController::CnnKpiInfo>("cnn.kpi_info");
+		rpiMetadata.getLocked<RPiController::CnnKpiInfo>(RPiController::tags::cnnKpiInfo);
 	if (kpiInfo) {
 		libcameraMetadata_.set(controls::rpi::CnnKpiInfo,
 				       { static_cast<int32_t>(kpiInfo->dnnRuntime),
@@ -1489,6 +1626,37 @@ void IpaBase::reportMetadata(unsigned int ipaContext)
 	metadataReady.emit(libcameraMetadata_);
 }
 
+bool IpaBase::writeCnnOutputTensor(Span<const float> tensor)
+{
+	if (!cnnOutputTensorBuffer_)
+		return false;
+
+	/*
+	 * Copy the tensor to the next slot of the shared buffer, and report
+	 * where to find it. The pipeline handler fills in its own file
+	 * descriptor for the buffer, as the IPA one may live in another
+	 * process.
+	 */
+	Span<uint8_t> mem = cnnOutputTensorBuffer_.mem();
+	std::size_t slotSize = mem.size() / numCnnOutputTensorSlots;
+	if (tensor.size_bytes() > slotSize) {
+		LOG(IPARPI, Warning)
+			<< "CNN output tensor of " << tensor.size_bytes()
+			<< " bytes too large for the output tensor buffer";
+		return false;
+	}
+
+	std::size_t offset = cnnOutputTensorSlot_ * slotSize;
+	memcpy(mem.data() + offset, tensor.data(), tensor.size_bytes());
+	cnnOutputTensorSlot_ = (cnnOutputTensorSlot_ + 1) % numCnnOutputTensorSlots;
+
+	libcameraMetadata_.set(controls::rpi::CnnOutputTensorBuffer,
+			       { -1, static_cast<int32_t>(offset),
+				 static_cast<int32_t>(tensor.size_bytes()) });
+
+	return true;
+}
+
 void IpaBase::applyFrameDurations(Duration minFrameDuration, Duration maxFrameDuration)
 {
 	/*
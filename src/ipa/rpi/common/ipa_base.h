@@ -17,6 +17,7 @@
 #include <libcamera/ipa/raspberrypi_ipa_interface.h>
 
 #include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/shared_mem_object.h"
 
 #include "cam_helper/cam_helper.h"
 #include "controller/agc_status.h"
@@ -93,9 +94,12 @@ private:
 	bool validateSensorControls();
 	bool validateLensControls();
 	void applyControls(const ControlList &controls);
+	bool restoreWarmStartState(const ControlList &controls);
 	virtual void handleControls(const ControlList &controls) = 0;
 	void fillDeviceStatus(const ControlList &sensorControls, unsigned int ipaContext);
 	void reportMetadata(unsigned int ipaContext);
+	bool writeCnnOutputTensor(Span<const float> tensor);
+	bool skipControllerRun(uint64_t frameTimestamp) const;
 	void applyFrameDurations(utils::Duration minFrameDuration, utils::Duration maxFrameDuration);
 	void applyAGC(const struct AgcStatus *agcStatus, ControlList &ctrls);
 
@@ -124,6 +128,13 @@ private:
 	/* Do we run a Controller::process() for this frame? */
 	bool processPending_;
 
+	/* Timestamp of the last frame, and frames since the last controller run. */
+	uint64_t lastFrameTimestamp_;
+	unsigned int framesSinceRun_;
+
+	/* Filtered proportion of frames the controller doesn't run on. */
+	double skipRatio_;
+
 	/* Distinguish the first camera start from others. */
 	bool firstStart_;
 
@@ -138,6 +149,11 @@ private:
 	} flickerState_;
 
 	bool cnnEnableInputTensor_;
+
+	/* Buffer shared with applications to deliver the CNN output tensors. */
+	SharedMem cnnOutputTensorBuffer_;
+	unsigned int cnnOutputTensorSlot_;
+	bool cnnEnableOutputTensorBuffer_;
 };
 
 } /* namespace ipa::RPi */
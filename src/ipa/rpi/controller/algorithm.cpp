@@ -32,6 +32,18 @@ void Algorithm::process([[maybe_unused]] StatisticsPtr &stats,
 {
 }
 
+void Algorithm::declarePrepare(std::vector<MetadataTag> reads,
+			       std::vector<MetadataTag> writes)
+{
+	prepareDependencies_ = { true, std::move(reads), std::move(writes) };
+}
+
+void Algorithm::declareProcess(std::vector<MetadataTag> reads,
+			       std::vector<MetadataTag> writes)
+{
+	processDependencies_ = { true, std::move(reads), std::move(writes) };
+}
+
 /* For registering algorithms with the system: */
 
 namespace {
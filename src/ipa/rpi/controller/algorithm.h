@@ -14,6 +14,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
 
 #include "libcamera/internal/yaml_parser.h"
 
@@ -26,6 +27,19 @@ namespace RPiController {
 class Algorithm
 {
 public:
+	/*
+	 * The metadata items that the prepare or process method of an algorithm
+	 * reads and writes. The Controller uses them to run algorithms that
+	 * don't depend on each other concurrently. Algorithms that don't
+	 * declare their dependencies are always run on their own, in tuning
+	 * file order.
+	 */
+	struct Dependencies {
+		bool declared = false;
+		std::vector<MetadataTag> reads;
+		std::vector<MetadataTag> writes;
+	};
+
 	Algorithm(Controller *controller)
 		: controller_(controller)
 	{
@@ -49,9 +63,25 @@ public:
 	{
 		return controller_->getHardwareConfig();
 	}
+	const Dependencies &prepareDependencies() const
+	{
+		return prepareDependencies_;
+	}
+	const Dependencies &processDependencies() const
+	{
+		return processDependencies_;
+	}
+
+protected:
+	void declarePrepare(std::vector<MetadataTag> reads,
+			    std::vector<MetadataTag> writes);
+	void declareProcess(std::vector<MetadataTag> reads,
+			    std::vector<MetadataTag> writes);
 
 private:
 	Controller *controller_;
+	Dependencies prepareDependencies_;
+	Dependencies processDependencies_;
 };
 
 /*
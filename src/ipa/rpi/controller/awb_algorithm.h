@@ -17,6 +17,8 @@ public:
 	/* An AWB algorithm must provide the following: */
 	virtual unsigned int getConvergenceFrames() const = 0;
 	virtual void initialValues(double &gainR, double &gainB) = 0;
+	virtual void setInitialValues(double gainR, double gainB,
+				      double temperatureK) = 0;
 	virtual void setMode(std::string const &modeName) = 0;
 	virtual void setManualGains(double manualR, double manualB) = 0;
 	virtual void enableAuto() = 0;
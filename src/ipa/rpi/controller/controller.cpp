@@ -5,7 +5,13 @@
  * ISP controller
  */
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/log.h>
@@ -21,6 +27,14 @@ using namespace std::literals::chrono_literals;
 
 LOG_DEFINE_CATEGORY(RPiController)
 
+/*
+ * Determine the minimum allowable inter-frame duration to run the controller
+ * algorithms. If the pipeline handler provider frames at a rate higher than this,
+ * we rate-limit the controller Prepare() and Process() calls to lower than or
+ * equal to this rate.
+ */
+static constexpr utils::Duration defaultControllerMinFrameDuration = 1.0s / 30.0;
+
 static const std::map<std::string, Controller::HardwareConfig> HardwareConfigMap = {
 	{
 		"bcm2835",
@@ -77,8 +91,153 @@ static const std::map<std::string, Controller::HardwareConfig> HardwareConfigMap
 	},
 };
 
+namespace {
+
+/* Upper bound of the number of threads that run algorithms besides the caller. */
+constexpr unsigned int MaxWorkers = 3;
+
+bool intersects(const std::vector<MetadataTag> &a, const std::vector<MetadataTag> &b)
+{
+	for (const MetadataTag &tagA : a) {
+		for (const MetadataTag &tagB : b) {
+			if (tagA.index() == tagB.index())
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Two algorithms must run one after the other when one of them writes metadata
+ * that the other one reads or writes, or when either of them hasn't declared
+ * what it accesses.
+ */
+bool conflicts(const Algorithm::Dependencies &a, const Algorithm::Dependencies &b)
+{
+	if (!a.declared || !b.declared)
+		return true;
+
+	return intersects(a.writes, b.reads) || intersects(a.writes, b.writes) ||
+	       intersects(a.reads, b.writes);
+}
+
+} /* namespace */
+
+/*
+ * A pool of threads that run the algorithms of one level of a schedule,
+ * together with the calling thread which also picks algorithms from the level.
+ */
+class Controller::WorkerPool
+{
+public:
+	WorkerPool(unsigned int numWorkers);
+	~WorkerPool();
+
+	void run(const std::vector<Algorithm *> &algos,
+		 const std::function<void(Algorithm *)> &func);
+
+private:
+	void worker();
+	void runAlgorithms(const std::vector<Algorithm *> &algos,
+			   const std::function<void(Algorithm *)> &func);
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable workSignal_;
+	std::condition_variable doneSignal_;
+
+	/* The level being run, protected by mutex_. */
+	const std::vector<Algorithm *> *algos_ = nullptr;
+	const std::function<void(Algorithm *)> *func_ = nullptr;
+	uint64_t generation_ = 0;
+	unsigned int active_ = 0;
+	bool abort_ = false;
+
+	/* The index of the next algorithm of the level to be run. */
+	std::atomic<unsigned int> next_ = 0;
+};
+
+Controller::WorkerPool::WorkerPool(unsigned int numWorkers)
+{
+	for (unsigned int i = 0; i < numWorkers; i++)
+		threads_.emplace_back(&WorkerPool::worker, this);
+}
+
+Controller::WorkerPool::~WorkerPool()
+{
+	{
+		std::scoped_lock lock(mutex_);
+		abort_ = true;
+	}
+	workSignal_.notify_all();
+
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+void Controller::WorkerPool::run(const std::vector<Algorithm *> &algos,
+				 const std::function<void(Algorithm *)> &func)
+{
+	{
+		std::scoped_lock lock(mutex_);
+		algos_ = &algos;
+		func_ = &func;
+		next_ = 0;
+		generation_++;
+	}
+	workSignal_.notify_all();
+
+	runAlgorithms(algos, func);
+
+	/*
+	 * All the algorithms have been picked at this point. Stop workers that
+	 * haven't woken up yet from joining, and wait for the ones that are
+	 * still running an algorithm.
+	 */
+	std::unique_lock<std::mutex> lock(mutex_);
+	algos_ = nullptr;
+	func_ = nullptr;
+	doneSignal_.wait(lock, [&] { return active_ == 0; });
+}
+
+void Controller::WorkerPool::worker()
+{
+	uint64_t generation = 0;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		workSignal_.wait(lock, [&] {
+			return abort_ || (algos_ && generation_ != generation);
+		});
+		if (abort_)
+			return;
+
+		generation = generation_;
+		const std::vector<Algorithm *> *algos = algos_;
+		const std::function<void(Algorithm *)> *func = func_;
+		active_++;
+
+		lock.unlock();
+		runAlgorithms(*algos, *func);
+		lock.lock();
+
+		if (--active_ == 0)
+			doneSignal_.notify_one();
+	}
+}
+
+void Controller::WorkerPool::runAlgorithms(const std::vector<Algorithm *> &algos,
+					   const std::function<void(Algorithm *)> &func)
+{
+	unsigned int index;
+	while ((index = next_.fetch_add(1, std::memory_order_relaxed)) < algos.size())
+		func(algos[index]);
+}
+
 Controller::Controller()
-	: switchModeCalled_(false)
+	: switchModeCalled_(false),
+	  rateConfig_({ defaultControllerMinFrameDuration, 1, false })
 {
 }
 
@@ -124,6 +283,12 @@ int Controller::read(char const *filename)
 				if (ret)
 					return ret;
 			}
+
+		if (root->contains("rate")) {
+			int ret = readRateConfig((*root)["rate"]);
+			if (ret)
+				return ret;
+		}
 	} else {
 		LOG(RPiController, Error)
 			<< "Unrecognised version " << version
@@ -156,6 +321,38 @@ void Controller::initialise()
 {
 	for (auto &algo : algorithms_)
 		algo->initialise();
+
+	timings_.clear();
+	if (ipa::AlgorithmTiming::enabled()) {
+		for (auto &algo : algorithms_)
+			timings_.emplace(algo.get(),
+					 std::make_unique<ipa::AlgorithmTiming>(target_, algo->name()));
+	}
+
+	prepareSchedule_ = buildSchedule(false);
+	processSchedule_ = buildSchedule(true);
+
+	/*
+	 * Size the worker pool for the widest level of the schedules, the
+	 * calling thread runs one of the algorithms of each level itself.
+	 */
+	size_t width = 1;
+	for (const Schedule *schedule : { &prepareSchedule_, &processSchedule_ }) {
+		for (const std::vector<Algorithm *> &level : *schedule)
+			width = std::max(width, level.size());
+	}
+
+	unsigned int cpus = std::max(std::thread::hardware_concurrency(), 1U);
+	unsigned int numWorkers = std::min<size_t>({ width, cpus, MaxWorkers + 1 }) - 1;
+
+	workers_.reset();
+	if (numWorkers)
+		workers_ = std::make_unique<WorkerPool>(numWorkers);
+
+	LOG(RPiController, Debug)
+		<< "Running algorithms in " << prepareSchedule_.size()
+		<< " prepare and " << processSchedule_.size()
+		<< " process steps with " << numWorkers << " workers";
 }
 
 void Controller::switchMode(CameraMode const &cameraMode, Metadata *metadata)
@@ -168,15 +365,81 @@ void Controller::switchMode(CameraMode const &cameraMode, Metadata *metadata)
 void Controller::prepare(Metadata *imageMetadata)
 {
 	assert(switchModeCalled_);
-	for (auto &algo : algorithms_)
-		algo->prepare(imageMetadata);
+	run(prepareSchedule_, ipa::AlgorithmTiming::Stage::Prepare,
+	    [imageMetadata](Algorithm *algo) {
+		    algo->prepare(imageMetadata);
+	    });
 }
 
 void Controller::process(StatisticsPtr stats, Metadata *imageMetadata)
 {
 	assert(switchModeCalled_);
-	for (auto &algo : algorithms_)
-		algo->process(stats, imageMetadata);
+	run(processSchedule_, ipa::AlgorithmTiming::Stage::Process,
+	    [&stats, imageMetadata](Algorithm *algo) {
+		    algo->process(stats, imageMetadata);
+	    });
+}
+
+/*
+ * Split the algorithms in levels, such that each algorithm only depends on
+ * algorithms of earlier levels. An algorithm depends on all the algorithms
+ * ahead of it in the tuning file that it conflicts with, which preserves the
+ * order in which they access the metadata.
+ */
+Controller::Schedule Controller::buildSchedule(bool process) const
+{
+	auto dependencies = [process](const Algorithm &algo) -> const Algorithm::Dependencies & {
+		return process ? algo.processDependencies() : algo.prepareDependencies();
+	};
+
+	std::vector<unsigned int> levels(algorithms_.size());
+	Schedule schedule;
+
+	for (unsigned int j = 0; j < algorithms_.size(); j++) {
+		const Algorithm::Dependencies &deps = dependencies(*algorithms_[j]);
+		unsigned int level = 0;
+
+		for (unsigned int i = 0; i < j; i++) {
+			if (conflicts(dependencies(*algorithms_[i]), deps))
+				level = std::max(level, levels[i] + 1);
+		}
+
+		levels[j] = level;
+		if (level >= schedule.size())
+			schedule.resize(level + 1);
+		schedule[level].push_back(algorithms_[j].get());
+	}
+
+	return schedule;
+}
+
+void Controller::run(const Schedule &schedule, ipa::AlgorithmTiming::Stage stage,
+		     const std::function<void(Algorithm *)> &func)
+{
+	/*
+	 * Wrap the function to time each algorithm when instrumentation is
+	 * enabled. The timings map isn't modified after initialise(), which
+	 * makes it safe to look up from the worker threads.
+	 */
+	std::function<void(Algorithm *)> timed;
+	if (!timings_.empty()) {
+		timed = [this, stage, &func](Algorithm *algo) {
+			ipa::AlgorithmTiming::Measurement m =
+				timings_.at(algo)->measure(stage);
+			func(algo);
+		};
+	}
+
+	const std::function<void(Algorithm *)> &call = timed ? timed : func;
+
+	for (const std::vector<Algorithm *> &level : schedule) {
+		if (level.size() == 1 || !workers_) {
+			for (Algorithm *algo : level)
+				call(algo);
+		} else {
+			workers_->run(level, call);
+		}
+	}
 }
 
 Metadata &Controller::getGlobalMetadata()
@@ -184,6 +447,37 @@ Metadata &Controller::getGlobalMetadata()
 	return globalMetadata_;
 }
 
+int Controller::readRateConfig(const YamlObject &params)
+{
+	/* The minimum frame duration is given in microseconds. */
+	if (params.contains("min_frame_duration")) {
+		std::optional<double> duration = params["min_frame_duration"].get<double>();
+		if (!duration || *duration < 0) {
+			LOG(RPiController, Error) << "Invalid rate min_frame_duration";
+			return -EINVAL;
+		}
+		rateConfig_.minFrameDuration = *duration * 1us;
+	}
+
+	rateConfig_.frameDecimation =
+		params["frame_decimation"].get<unsigned int>(rateConfig_.frameDecimation);
+	if (!rateConfig_.frameDecimation) {
+		LOG(RPiController, Error) << "Invalid rate frame_decimation";
+		return -EINVAL;
+	}
+
+	rateConfig_.skipLateFrames =
+		params["skip_late_frames"].get<bool>(rateConfig_.skipLateFrames);
+
+	LOG(RPiController, Debug)
+		<< "Controller rate: min frame duration "
+		<< rateConfig_.minFrameDuration << ", decimation "
+		<< rateConfig_.frameDecimation << ", skip late frames "
+		<< rateConfig_.skipLateFrames;
+
+	return 0;
+}
+
 Algorithm *Controller::getAlgorithm(std::string const &name) const
 {
 	/*
@@ -209,6 +503,11 @@ const std::string &Controller::getTarget() const
 	return target_;
 }
 
+const Controller::RateConfig &Controller::getRateConfig() const
+{
+	return rateConfig_;
+}
+
 const Controller::HardwareConfig &Controller::getHardwareConfig() const
 {
 	auto cfg = HardwareConfigMap.find(getTarget());
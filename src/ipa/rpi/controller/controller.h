@@ -12,12 +12,17 @@
  * convenient manner.
  */
 
+#include <functional>
+#include <map>
+#include <memory>
 #include <vector>
 #include <string>
 
 #include <libcamera/base/utils.h>
 #include "libcamera/internal/yaml_parser.h"
 
+#include "libipa/algorithm_timing.h"
+
 #include "camera_mode.h"
 #include "device_status.h"
 #include "metadata.h"
@@ -85,6 +90,20 @@ public:
 		bool cfeDataBufferStrided;
 	};
 
+	/*
+	 * Limits on how often the control algorithms run, from the optional
+	 * "rate" section of the tuning file. Frames for which they don't run
+	 * reuse the results of the last frame that they ran on.
+	 */
+	struct RateConfig {
+		/* Minimum interval between two frames the algorithms run on. */
+		libcamera::utils::Duration minFrameDuration;
+		/* Run the algorithms at most once every this many frames. */
+		unsigned int frameDecimation;
+		/* Skip frames that the IPA receives late, when it falls behind. */
+		bool skipLateFrames;
+	};
+
 	Controller();
 	~Controller();
 	int read(char const *filename);
@@ -96,16 +115,32 @@ public:
 	Algorithm *getAlgorithm(std::string const &name) const;
 	const std::string &getTarget() const;
 	const HardwareConfig &getHardwareConfig() const;
+	const RateConfig &getRateConfig() const;
 
 protected:
 	int createAlgorithm(const std::string &name, const libcamera::YamlObject &params);
+	int readRateConfig(const libcamera::YamlObject &params);
 
 	Metadata globalMetadata_;
 	std::vector<AlgorithmPtr> algorithms_;
 	bool switchModeCalled_;
 
 private:
+	class WorkerPool;
+
+	using Schedule = std::vector<std::vector<Algorithm *>>;
+
+	Schedule buildSchedule(bool process) const;
+	void run(const Schedule &schedule, libcamera::ipa::AlgorithmTiming::Stage stage,
+		 const std::function<void(Algorithm *)> &func);
+
 	std::string target_;
+	RateConfig rateConfig_;
+	Schedule prepareSchedule_;
+	Schedule processSchedule_;
+	std::unique_ptr<WorkerPool> workers_;
+	/* Per-algorithm timing, only populated when instrumentation is enabled. */
+	std::map<const Algorithm *, std::unique_ptr<libcamera::ipa::AlgorithmTiming>> timings_;
 };
 
 } /* namespace RPiController */
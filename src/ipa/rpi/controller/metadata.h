@@ -8,15 +8,54 @@
 
 /* A simple class for carrying arbitrary metadata, for example about an image. */
 
-#include <any>
 #include <map>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <libcamera/base/thread_annotations.h>
 
 namespace RPiController {
 
+/*
+ * A metadata tag identifies one item in the Metadata. Each distinct tag name
+ * is assigned a small integer index the first time a tag is constructed for
+ * it, which the Metadata uses to locate the item without string comparisons.
+ * Tags are meant to be constructed once, the well-known ones are listed in the
+ * tags namespace below.
+ */
+class MetadataTag
+{
+public:
+	explicit MetadataTag(std::string_view name)
+		: index_(lookup(name))
+	{
+	}
+
+	unsigned int index() const { return index_; }
+
+private:
+	static unsigned int lookup(std::string_view name)
+	{
+		static std::mutex mutex;
+		static std::map<std::string, unsigned int, std::less<>> registry;
+
+		std::scoped_lock lock(mutex);
+		auto it = registry.find(name);
+		if (it != registry.end())
+			return it->second;
+
+		unsigned int index = registry.size();
+		registry.emplace(name, index);
+		return index;
+	}
+
+	unsigned int index_;
+};
+
 class LIBCAMERA_TSA_CAPABILITY("mutex") Metadata
 {
 public:
@@ -25,59 +64,88 @@ public:
 	Metadata(Metadata const &other)
 	{
 		std::scoped_lock otherLock(other.mutex_);
-		data_ = other.data_;
+		copyFrom(other);
 	}
 
 	Metadata(Metadata &&other)
 	{
 		std::scoped_lock otherLock(other.mutex_);
-		data_ = std::move(other.data_);
-		other.data_.clear();
+		slots_.swap(other.slots_);
+	}
+
+	~Metadata()
+	{
+		for (Slot &slot : slots_)
+			slot.reset();
 	}
 
 	template<typename T>
-	void set(std::string const &tag, T &&value)
+	void set(MetadataTag const &tag, T &&value)
 	{
 		std::scoped_lock lock(mutex_);
-		data_[tag] = std::forward<T>(value);
+		setLocked(tag, std::forward<T>(value));
 	}
 
 	template<typename T>
-	int get(std::string const &tag, T &value) const
+	void set(std::string const &tag, T &&value)
+	{
+		set(MetadataTag(tag), std::forward<T>(value));
+	}
+
+	template<typename T>
+	int get(MetadataTag const &tag, T &value) const
 	{
 		std::scoped_lock lock(mutex_);
-		auto it = data_.find(tag);
-		if (it == data_.end())
+		const T *item = find<T>(tag);
+		if (!item)
 			return -1;
-		value = std::any_cast<T>(it->second);
+		value = *item;
 		return 0;
 	}
 
+	template<typename T>
+	int get(std::string const &tag, T &value) const
+	{
+		return get(MetadataTag(tag), value);
+	}
+
 	void clear()
 	{
 		std::scoped_lock lock(mutex_);
-		data_.clear();
+		/*
+		 * Keep the storage of the items, to reuse it when they are set
+		 * again for the next frame.
+		 */
+		for (Slot &slot : slots_)
+			slot.valid = false;
 	}
 
 	Metadata &operator=(Metadata const &other)
 	{
 		std::scoped_lock lock(mutex_, other.mutex_);
-		data_ = other.data_;
+		copyFrom(other);
 		return *this;
 	}
 
 	Metadata &operator=(Metadata &&other)
 	{
 		std::scoped_lock lock(mutex_, other.mutex_);
-		data_ = std::move(other.data_);
-		other.data_.clear();
+		slots_.swap(other.slots_);
+		for (Slot &slot : other.slots_)
+			slot.valid = false;
 		return *this;
 	}
 
 	void merge(Metadata &other)
 	{
 		std::scoped_lock lock(mutex_, other.mutex_);
-		data_.merge(other.data_);
+		/* Move the items that don't exist in this metadata from other. */
+		resize(other.slots_.size());
+		for (unsigned int i = 0; i < other.slots_.size(); i++) {
+			if (!other.slots_[i].valid || slots_[i].valid)
+				continue;
+			std::swap(slots_[i], other.slots_[i]);
+		}
 	}
 
 	void mergeCopy(const Metadata &other)
@@ -87,41 +155,76 @@ public:
 		 * If the metadata key exists, ignore this item and copy only
 		 * unique key/value pairs.
 		 */
-		data_.insert(other.data_.begin(), other.data_.end());
+		resize(other.slots_.size());
+		for (unsigned int i = 0; i < other.slots_.size(); i++) {
+			if (!slots_[i].valid)
+				slots_[i].copyFrom(other.slots_[i]);
+		}
 	}
 
-	void erase(std::string const &tag)
+	void erase(MetadataTag const &tag)
 	{
 		std::scoped_lock lock(mutex_);
 		eraseLocked(tag);
 	}
 
+	void erase(std::string const &tag)
+	{
+		erase(MetadataTag(tag));
+	}
+
 	template<typename T>
-	T *getLocked(std::string const &tag)
+	T *getLocked(MetadataTag const &tag)
 	{
 		/*
 		 * This allows in-place access to the Metadata contents,
 		 * for which you should be holding the lock.
 		 */
-		auto it = data_.find(tag);
-		if (it == data_.end())
-			return nullptr;
-		return std::any_cast<T>(&it->second);
+		return const_cast<T *>(find<T>(tag));
 	}
 
 	template<typename T>
-	void setLocked(std::string const &tag, T &&value)
+	T *getLocked(std::string const &tag)
+	{
+		return getLocked<T>(MetadataTag(tag));
+	}
+
+	template<typename T>
+	void setLocked(MetadataTag const &tag, T &&value)
 	{
 		/* Use this only if you're holding the lock yourself. */
-		data_[tag] = std::forward<T>(value);
+		using U = std::decay_t<T>;
+
+		resize(tag.index() + 1);
+		Slot &slot = slots_[tag.index()];
+
+		/* Reuse the storage when the item type doesn't change. */
+		if (slot.ops == &Slot::opsFor<U>) {
+			*static_cast<U *>(slot.value) = std::forward<T>(value);
+		} else {
+			slot.reset();
+			slot.value = new U(std::forward<T>(value));
+			slot.ops = &Slot::opsFor<U>;
+		}
+
+		slot.valid = true;
+	}
+
+	template<typename T>
+	void setLocked(std::string const &tag, T &&value)
+	{
+		setLocked(MetadataTag(tag), std::forward<T>(value));
+	}
+
+	void eraseLocked(MetadataTag const &tag)
+	{
+		if (tag.index() < slots_.size())
+			slots_[tag.index()].reset();
 	}
 
 	void eraseLocked(std::string const &tag)
 	{
-		auto it = data_.find(tag);
-		if (it == data_.end())
-			return;
-		data_.erase(it);
+		eraseLocked(MetadataTag(tag));
 	}
 
 	/*
@@ -134,8 +237,133 @@ public:
 	void unlock() LIBCAMERA_TSA_RELEASE() { mutex_.unlock(); }
 
 private:
+	/*
+	 * Each item is stored in the slot indexed by its tag. The slot keeps
+	 * a pointer to type-specific operations, which also identifies the
+	 * type of the stored value.
+	 */
+	struct Slot {
+		struct Ops {
+			void *(*clone)(const void *src);
+			void (*assign)(void *dst, const void *src);
+			void (*destroy)(void *value);
+		};
+
+		template<typename T>
+		static constexpr Ops opsFor = {
+			[](const void *src) -> void * {
+				return new T(*static_cast<const T *>(src));
+			},
+			[](void *dst, const void *src) {
+				*static_cast<T *>(dst) = *static_cast<const T *>(src);
+			},
+			[](void *value) {
+				delete static_cast<T *>(value);
+			},
+		};
+
+		void reset()
+		{
+			if (ops)
+				ops->destroy(value);
+			ops = nullptr;
+			value = nullptr;
+			valid = false;
+		}
+
+		void copyFrom(const Slot &other)
+		{
+			if (!other.valid) {
+				valid = false;
+				return;
+			}
+
+			if (ops == other.ops) {
+				ops->assign(value, other.value);
+			} else {
+				reset();
+				value = other.ops->clone(other.value);
+				ops = other.ops;
+			}
+
+			valid = true;
+		}
+
+		const Ops *ops = nullptr;
+		void *value = nullptr;
+		bool valid = false;
+	};
+
+	template<typename T>
+	const T *find(MetadataTag const &tag) const
+	{
+		if (tag.index() >= slots_.size())
+			return nullptr;
+
+		const Slot &slot = slots_[tag.index()];
+		if (!slot.valid || slot.ops != &Slot::opsFor<T>)
+			return nullptr;
+
+		return static_cast<const T *>(slot.value);
+	}
+
+	void resize(std::size_t size)
+	{
+		if (slots_.size() < size)
+			slots_.resize(size);
+	}
+
+	void copyFrom(const Metadata &other)
+	{
+		resize(other.slots_.size());
+		for (unsigned int i = 0; i < slots_.size(); i++) {
+			if (i < other.slots_.size())
+				slots_[i].copyFrom(other.slots_[i]);
+			else
+				slots_[i].valid = false;
+		}
+	}
+
 	mutable std::mutex mutex_;
-	std::map<std::string, std::any> data_;
+	std::vector<Slot> slots_;
 };
 
+namespace tags {
+
+inline const MetadataTag afStatus{ "af.status" };
+inline const MetadataTag agcDelayedStatus{ "agc.delayed_status" };
+inline const MetadataTag agcPrepareStatus{ "agc.prepare_status" };
+inline const MetadataTag agcStatus{ "agc.status" };
+inline const MetadataTag alscStatus{ "alsc.status" };
+inline const MetadataTag awbStatus{ "awb.status" };
+inline const MetadataTag blackLevelStatus{ "black_level.status" };
+inline const MetadataTag cacStatus{ "cac.status" };
+inline const MetadataTag ccmStatus{ "ccm.status" };
+inline const MetadataTag cdnStatus{ "cdn.status" };
+inline const MetadataTag cnnEnableInputTensor{ "cnn.enable_input_tensor" };
+inline const MetadataTag cnnInputTensor{ "cnn.input_tensor" };
+inline const MetadataTag cnnInputTensorInfo{ "cnn.input_tensor_info" };
+inline const MetadataTag cnnInputTensorSize{ "cnn.input_tensor_size" };
+inline const MetadataTag cnnKpiInfo{ "cnn.kpi_info" };
+inline const MetadataTag cnnOutputTensor{ "cnn.output_tensor" };
+inline const MetadataTag cnnOutputTensorInfo{ "cnn.output_tensor_info" };
+inline const MetadataTag cnnOutputTensorSize{ "cnn.output_tensor_size" };
+inline const MetadataTag contrastStatus{ "contrast.status" };
+inline const MetadataTag denoiseStatus{ "denoise.status" };
+inline const MetadataTag deviceStatus{ "device.status" };
+inline const MetadataTag dpcStatus{ "dpc.status" };
+inline const MetadataTag focusStatus{ "focus.status" };
+inline const MetadataTag geqStatus{ "geq.status" };
+inline const MetadataTag luxStatus{ "lux.status" };
+inline const MetadataTag noiseStatus{ "noise.status" };
+inline const MetadataTag pdafRegions{ "pdaf.regions" };
+inline const MetadataTag saturationStatus{ "saturation.status" };
+inline const MetadataTag sdnStatus{ "sdn.status" };
+inline const MetadataTag sharpenStatus{ "sharpen.status" };
+inline const MetadataTag stitchStatus{ "stitch.status" };
+inline const MetadataTag tdnStatus{ "tdn.status" };
+inline const MetadataTag tonemapStatus{ "tonemap.status" };
+
+} /* namespace tags */
+
 } /* namespace RPiController */
@@ -198,6 +198,9 @@ Af::Af(Controller *controller)
 	contrastWeights_.w.reserve(getHardwareConfig().focusRegions.width *
 				   getHardwareConfig().focusRegions.height);
 	scanData_.reserve(32);
+
+	declarePrepare({ tags::pdafRegions }, { tags::afStatus });
+	declareProcess({}, {});
 }
 
 Af::~Af()
@@ -301,6 +304,16 @@ void Af::computeWeights(RegionWeights *wgts, unsigned rows, unsigned cols)
 			}
 		}
 	}
+
+	/*
+	 * The windows usually cover a small part of the image, so let the
+	 * statistics loops skip the regions that don't contribute.
+	 */
+	wgts->active.clear();
+	for (unsigned i = 0; i < wgts->w.size(); ++i) {
+		if (wgts->w[i])
+			wgts->active.push_back(i);
+	}
 }
 
 void Af::invalidateWeights()
@@ -320,19 +333,17 @@ bool Af::getPhase(PdafRegions const &regions, double &phase, double &conf)
 
 	uint32_t sumWc = 0;
 	int64_t sumWcp = 0;
-	for (unsigned i = 0; i < regions.numRegions(); ++i) {
+	for (unsigned i : phaseWeights_.active) {
 		unsigned w = phaseWeights_.w[i];
-		if (w) {
-			const PdafData &data = regions.get(i).val;
-			unsigned c = data.conf;
-			if (c >= cfg_.confThresh) {
-				if (c > cfg_.confClip)
-					c = cfg_.confClip;
-				c -= (cfg_.confThresh >> 2);
-				sumWc += w * c;
-				c -= (cfg_.confThresh >> 2);
-				sumWcp += (int64_t)(w * c) * (int64_t)data.phase;
-			}
+		const PdafData &data = regions.get(i).val;
+		unsigned c = data.conf;
+		if (c >= cfg_.confThresh) {
+			if (c > cfg_.confClip)
+				c = cfg_.confClip;
+			c -= (cfg_.confThresh >> 2);
+			sumWc += w * c;
+			c -= (cfg_.confThresh >> 2);
+			sumWcp += (int64_t)(w * c) * (int64_t)data.phase;
 		}
 	}
 
@@ -358,7 +369,7 @@ double Af::getContrast(const FocusRegions &focusStats)
 	}
 
 	uint64_t sumWc = 0;
-	for (unsigned i = 0; i < focusStats.numRegions(); ++i)
+	for (unsigned i : contrastWeights_.active)
 		sumWc += contrastWeights_.w[i] * focusStats.get(i).val;
 
 	return (contrastWeights_.sum > 0) ? ((double)sumWc / (double)contrastWeights_.sum) : 0.0;
@@ -631,7 +642,7 @@ void Af::prepare(Metadata *imageMetadata)
 		double oldFs = fsmooth_;
 		ScanState oldSs = scanState_;
 		uint32_t oldSt = stepCount_;
-		if (imageMetadata->get("pdaf.regions", regions) == 0)
+		if (imageMetadata->get(tags::pdafRegions, regions) == 0)
 			getPhase(regions, phase, conf);
 		doAF(prevContrast_, phase, conf);
 		updateLensPosition();
@@ -660,7 +671,7 @@ void Af::prepare(Metadata *imageMetadata)
 		status.state = reportState_;
 	status.lensSetting = initted_ ? std::optional<int>(cfg_.map.eval(fsmooth_))
 				      : std::nullopt;
-	imageMetadata->set("af.status", status);
+	imageMetadata->set(tags::afStatus, status);
 }
 
 void Af::process(StatisticsPtr &stats, [[maybe_unused]] Metadata *imageMetadata)
@@ -120,9 +120,11 @@ private:
 		unsigned cols;
 		uint32_t sum;
 		std::vector<uint16_t> w;
+		/* indices of the regions with a non-zero weight */
+		std::vector<unsigned> active;
 
 		RegionWeights()
-			: rows(0), cols(0), sum(0), w() {}
+			: rows(0), cols(0), sum(0), w(), active() {}
 	};
 
 	void computeWeights(RegionWeights *wgts, unsigned rows, unsigned cols);
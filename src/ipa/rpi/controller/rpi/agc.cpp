@@ -24,6 +24,11 @@ Agc::Agc(Controller *controller)
 	: AgcAlgorithm(controller),
 	  activeChannels_({ 0 }), index_(0)
 {
+	declarePrepare({ tags::agcDelayedStatus, tags::deviceStatus, tags::awbStatus },
+		       { tags::agcPrepareStatus });
+	declareProcess({ tags::agcDelayedStatus, tags::deviceStatus,
+			 tags::awbStatus, tags::luxStatus },
+		       { tags::agcStatus });
 }
 
 char const *Agc::name() const
@@ -134,6 +139,15 @@ void Agc::setMaxShutter(Duration maxShutter)
 		data.channel.setMaxShutter(maxShutter);
 }
 
+void Agc::setInitialExposure(Duration shutter, double analogueGain)
+{
+	LOG(RPiAgc, Debug) << "setInitialExposure " << shutter
+			   << " gain " << analogueGain;
+
+	for (auto &data : channelData_)
+		data.channel.setInitialExposure(shutter, analogueGain);
+}
+
 void Agc::setFixedShutter(unsigned int channelIndex, Duration fixedShutter)
 {
 	if (checkChannel(channelIndex))
@@ -219,18 +233,18 @@ void Agc::switchMode(CameraMode const &cameraMode,
 		LOG(RPiAgc, Debug) << "switchMode for channel " << channelIndex;
 		channelData_[channelIndex].channel.switchMode(cameraMode, metadata);
 		if (channelIndex == activeChannels_[0])
-			metadata->get("agc.status", status);
+			metadata->get(tags::agcStatus, status);
 	}
 
 	status.channel = activeChannels_[0];
-	metadata->set("agc.status", status);
+	metadata->set(tags::agcStatus, status);
 	index_ = 0;
 }
 
 static void getDelayedChannelIndex(Metadata *metadata, const char *message, unsigned int &channelIndex)
 {
 	std::unique_lock<RPiController::Metadata> lock(*metadata);
-	AgcStatus *status = metadata->getLocked<AgcStatus>("agc.delayed_status");
+	AgcStatus *status = metadata->getLocked<AgcStatus>(tags::agcDelayedStatus);
 	if (status)
 		channelIndex = status->channel;
 	else {
@@ -243,7 +257,7 @@ static libcamera::utils::Duration
 setCurrentChannelIndexGetExposure(Metadata *metadata, const char *message, unsigned int channelIndex)
 {
 	std::unique_lock<RPiController::Metadata> lock(*metadata);
-	AgcStatus *status = metadata->getLocked<AgcStatus>("agc.status");
+	AgcStatus *status = metadata->getLocked<AgcStatus>(tags::agcStatus);
 	libcamera::utils::Duration dur = 0s;
 
 	if (status) {
@@ -299,7 +313,7 @@ void Agc::process(StatisticsPtr &stats, Metadata *imageMetadata)
 	 */
 	LOG(RPiAgc, Debug) << "Save DeviceStatus and stats for channel " << statsIndex;
 	DeviceStatus deviceStatus;
-	if (imageMetadata->get<DeviceStatus>("device.status", deviceStatus) == 0)
+	if (imageMetadata->get<DeviceStatus>(tags::deviceStatus, deviceStatus) == 0)
 		channelData_[statsIndex].deviceStatus = deviceStatus;
 	else
 		/* Every frame should have a DeviceStatus. */
@@ -37,6 +37,8 @@ public:
 			     libcamera::utils::Duration fixedShutter) override;
 	void setFixedAnalogueGain(unsigned int channelIndex,
 				  double fixedAnalogueGain) override;
+	void setInitialExposure(libcamera::utils::Duration shutter,
+				double analogueGain) override;
 	void setMeteringMode(std::string const &meteringModeName) override;
 	void setExposureMode(std::string const &exposureModeName) override;
 	void setConstraintMode(std::string const &contraintModeName) override;
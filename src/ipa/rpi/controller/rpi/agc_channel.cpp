@@ -269,7 +269,8 @@ AgcChannel::AgcChannel()
 	: meteringMode_(nullptr), exposureMode_(nullptr), constraintMode_(nullptr),
 	  frameCount_(0), lockCount_(0),
 	  lastTargetExposure_(0s), ev_(1.0), flickerPeriod_(0s),
-	  maxShutter_(0s), fixedShutter_(0s), fixedAnalogueGain_(0.0)
+	  maxShutter_(0s), fixedShutter_(0s), fixedAnalogueGain_(0.0),
+	  initialShutter_(0s), initialAnalogueGain_(0.0)
 {
 	/* Set AWB default values in case early frames have no updates in metadata. */
 	awb_.gainR = 1.0;
@@ -381,6 +382,12 @@ void AgcChannel::setFixedAnalogueGain(double fixedAnalogueGain)
 	status_.analogueGain = limitGain(fixedAnalogueGain);
 }
 
+void AgcChannel::setInitialExposure(Duration shutter, double analogueGain)
+{
+	initialShutter_ = shutter;
+	initialAnalogueGain_ = analogueGain;
+}
+
 void AgcChannel::setMeteringMode(std::string const &meteringModeName)
 {
 	meteringModeName_ = meteringModeName;
@@ -450,13 +457,18 @@ void AgcChannel::switchMode(CameraMode const &cameraMode,
 		/*
 		 * We come through here on startup, when at least one of the shutter
 		 * or gain has not been fixed. We must still write those values out so
-		 * that they will be applied immediately. We supply some arbitrary defaults
-		 * for any that weren't set.
+		 * that they will be applied immediately. We supply the initial
+		 * exposure, when restored from a previous run, or some arbitrary
+		 * defaults for any that weren't set.
 		 */
+		Duration initialShutter = initialShutter_ ? limitShutter(initialShutter_)
+							  : config_.defaultExposureTime;
+		double initialAnalogueGain = initialAnalogueGain_ ? limitGain(initialAnalogueGain_)
+								  : config_.defaultAnalogueGain;
 
 		/* Equivalent of divideUpExposure. */
-		filtered_.shutter = fixedShutter ? fixedShutter : config_.defaultExposureTime;
-		filtered_.analogueGain = fixedAnalogueGain_ ? fixedAnalogueGain_ : config_.defaultAnalogueGain;
+		filtered_.shutter = fixedShutter ? fixedShutter : initialShutter;
+		filtered_.analogueGain = fixedAnalogueGain_ ? fixedAnalogueGain_ : initialAnalogueGain;
 	}
 
 	writeAndFinish(metadata, false);
@@ -471,7 +483,7 @@ void AgcChannel::prepare(Metadata *imageMetadata)
 	/* Fetch the AWB status now because AWB also sets it in the prepare method. */
 	fetchAwbStatus(imageMetadata);
 
-	if (!imageMetadata->get("agc.delayed_status", delayedStatus))
+	if (!imageMetadata->get(tags::agcDelayedStatus, delayedStatus))
 		totalExposureValue = delayedStatus.totalExposureValue;
 
 	prepareStatus.digitalGain = 1.0;
@@ -480,7 +492,7 @@ void AgcChannel::prepare(Metadata *imageMetadata)
 	if (status_.totalExposureValue) {
 		/* Process has run, so we have meaningful values. */
 		DeviceStatus deviceStatus;
-		if (imageMetadata->get("device.status", deviceStatus) == 0) {
+		if (imageMetadata->get(tags::deviceStatus, deviceStatus) == 0) {
 			Duration actualExposure = deviceStatus.shutterSpeed *
 						  deviceStatus.analogueGain;
 			if (actualExposure) {
@@ -500,7 +512,7 @@ void AgcChannel::prepare(Metadata *imageMetadata)
 			}
 		} else
 			LOG(RPiAgc, Warning) << "AgcChannel: no device metadata";
-		imageMetadata->set("agc.prepare_status", prepareStatus);
+		imageMetadata->set(tags::agcPrepareStatus, prepareStatus);
 	}
 }
 
@@ -642,7 +654,7 @@ void AgcChannel::fetchCurrentExposure(DeviceStatus const &deviceStatus)
 
 void AgcChannel::fetchAwbStatus(Metadata *imageMetadata)
 {
-	if (imageMetadata->get("awb.status", awb_) != 0)
+	if (imageMetadata->get(tags::awbStatus, awb_) != 0)
 		LOG(RPiAgc, Debug) << "No AWB status found";
 }
 
@@ -727,7 +739,7 @@ void AgcChannel::computeGain(StatisticsPtr &statistics, Metadata *imageMetadata,
 {
 	struct LuxStatus lux = {};
 	lux.lux = 400; /* default lux level to 400 in case no metadata found */
-	if (imageMetadata->get("lux.status", lux) != 0)
+	if (imageMetadata->get(tags::luxStatus, lux) != 0)
 		LOG(RPiAgc, Warning) << "No lux level found";
 	const Histogram &h = statistics->yHist;
 	double evGain = status_.ev * config_.baseEv;
@@ -988,7 +1000,7 @@ void AgcChannel::writeAndFinish(Metadata *imageMetadata, bool desaturate)
 	 * Write to metadata as well, in case anyone wants to update the camera
 	 * immediately.
 	 */
-	imageMetadata->set("agc.status", status_);
+	imageMetadata->set(tags::agcStatus, status_);
 	LOG(RPiAgc, Debug) << "Output written, total exposure requested is "
 			   << filtered_.totalExposure;
 	LOG(RPiAgc, Debug) << "Camera exposure update: shutter time " << filtered_.shutter
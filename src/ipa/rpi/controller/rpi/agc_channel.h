@@ -93,6 +93,7 @@ public:
 	void setMaxShutter(libcamera::utils::Duration maxShutter);
 	void setFixedShutter(libcamera::utils::Duration fixedShutter);
 	void setFixedAnalogueGain(double fixedAnalogueGain);
+	void setInitialExposure(libcamera::utils::Duration shutter, double analogueGain);
 	void setMeteringMode(std::string const &meteringModeName);
 	void setExposureMode(std::string const &exposureModeName);
 	void setConstraintMode(std::string const &contraintModeName);
@@ -149,6 +150,9 @@ private:
 	libcamera::utils::Duration maxShutter_;
 	libcamera::utils::Duration fixedShutter_;
 	double fixedAnalogueGain_;
+	/* Exposure to start from instead of the defaults, if set. */
+	libcamera::utils::Duration initialShutter_;
+	double initialAnalogueGain_;
 };
 
 } /* namespace RPiController */
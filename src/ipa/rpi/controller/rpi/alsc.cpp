@@ -29,20 +29,17 @@ LOG_DEFINE_CATEGORY(RPiAlsc)
 static const double InsufficientData = -1.0;
 
 Alsc::Alsc(Controller *controller)
-	: Algorithm(controller)
+	: Algorithm(controller), asyncTask_([this] { doAlsc(); })
 {
-	asyncAbort_ = asyncStart_ = asyncStarted_ = asyncFinished_ = false;
-	asyncThread_ = std::thread(std::bind(&Alsc::asyncFunc, this));
+	asyncStarted_ = false;
+
+	declarePrepare({}, { tags::alscStatus });
+	declareProcess({ tags::awbStatus }, {});
 }
 
 Alsc::~Alsc()
 {
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncAbort_ = true;
-	}
-	asyncSignal_.notify_one();
-	asyncThread_.join();
+	asyncTask_.cancel();
 }
 
 char const *Alsc::name() const
@@ -224,6 +221,8 @@ void Alsc::initialise()
 	/* The lambdas are initialised in the SwitchMode. */
 	lambdaR_.resize(config_.tableSize);
 	lambdaB_.resize(config_.tableSize);
+	prevCalTableR_.resize(config_.tableSize);
+	prevCalTableB_.resize(config_.tableSize);
 
 	/* Temporaries for the computations, but sensible to allocate this up-front! */
 	for (auto &c : tmpC_)
@@ -236,11 +235,7 @@ void Alsc::waitForAysncThread()
 {
 	if (asyncStarted_) {
 		asyncStarted_ = false;
-		std::unique_lock<std::mutex> lock(mutex_);
-		syncSignal_.wait(lock, [&] {
-			return asyncFinished_;
-		});
-		asyncFinished_ = false;
+		asyncTask_.cancel();
 	}
 }
 
@@ -292,6 +287,18 @@ void Alsc::switchMode(CameraMode const &cameraMode,
 	 */
 	resampleCalTable(config_.luminanceLut, cameraMode_, luminanceTable_);
 
+	/*
+	 * The lambdas are relative to the calibration tables, which have to be
+	 * resampled for the new mode.
+	 */
+	Array2D<double> &calTableR = tmpC_[0], &calTableB = tmpC_[1], &calTableTmp = tmpC_[2];
+	getCalTable(ct_, config_.calibrationsCr, calTableTmp);
+	resampleCalTable(calTableTmp, cameraMode_, calTableR);
+	getCalTable(ct_, config_.calibrationsCb, calTableTmp);
+	resampleCalTable(calTableTmp, cameraMode_, calTableB);
+	prevCalTableR_ = calTableR;
+	prevCalTableB_ = calTableB;
+
 	if (resetTables) {
 		/*
 		 * Upon every "table reset", arrange for something sensible to be
@@ -302,11 +309,6 @@ void Alsc::switchMode(CameraMode const &cameraMode,
 		 */
 		std::fill(lambdaR_.begin(), lambdaR_.end(), 1.0);
 		std::fill(lambdaB_.begin(), lambdaB_.end(), 1.0);
-		Array2D<double> &calTableR = tmpC_[0], &calTableB = tmpC_[1], &calTableTmp = tmpC_[2];
-		getCalTable(ct_, config_.calibrationsCr, calTableTmp);
-		resampleCalTable(calTableTmp, cameraMode_, calTableR);
-		getCalTable(ct_, config_.calibrationsCb, calTableTmp);
-		resampleCalTable(calTableTmp, cameraMode_, calTableB);
 		compensateLambdasForCal(calTableR, lambdaR_, asyncLambdaR_);
 		compensateLambdasForCal(calTableB, lambdaB_, asyncLambdaB_);
 		addLuminanceToTables(syncResults_, asyncLambdaR_, 1.0, asyncLambdaB_,
@@ -320,7 +322,6 @@ void Alsc::switchMode(CameraMode const &cameraMode,
 void Alsc::fetchAsyncResults()
 {
 	LOG(RPiAlsc, Debug) << "Fetch ALSC results";
-	asyncFinished_ = false;
 	asyncStarted_ = false;
 	syncResults_ = asyncResults_;
 }
@@ -329,7 +330,7 @@ double getCt(Metadata *metadata, double defaultCt)
 {
 	AwbStatus awbStatus;
 	awbStatus.temperatureK = defaultCt; /* in case nothing found */
-	if (metadata->get("awb.status", awbStatus) != 0)
+	if (metadata->get(tags::awbStatus, awbStatus) != 0)
 		LOG(RPiAlsc, Debug) << "no AWB results found, using "
 				    << awbStatus.temperatureK;
 	else
@@ -374,11 +375,7 @@ void Alsc::restartAsync(StatisticsPtr &stats, Metadata *imageMetadata)
 	copyStats(statistics_, stats, prevSyncResults_);
 	framePhase_ = 0;
 	asyncStarted_ = true;
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncStart_ = true;
-	}
-	asyncSignal_.notify_one();
+	asyncTask_.start();
 }
 
 void Alsc::prepare(Metadata *imageMetadata)
@@ -394,11 +391,8 @@ void Alsc::prepare(Metadata *imageMetadata)
 			       : config_.speed;
 	LOG(RPiAlsc, Debug)
 		<< "frame count " << frameCount_ << " speed " << speed;
-	{
-		std::unique_lock<std::mutex> lock(mutex_);
-		if (asyncStarted_ && asyncFinished_)
-			fetchAsyncResults();
-	}
+	if (asyncStarted_ && asyncTask_.finished())
+		fetchAsyncResults();
 	/* Apply IIR filter to results and program into the pipeline. */
 	for (unsigned int j = 0; j < syncResults_.size(); j++) {
 		for (unsigned int i = 0; i < syncResults_[j].size(); i++)
@@ -409,12 +403,12 @@ void Alsc::prepare(Metadata *imageMetadata)
 	status.r = prevSyncResults_[0].data();
 	status.g = prevSyncResults_[1].data();
 	status.b = prevSyncResults_[2].data();
-	imageMetadata->set("alsc.status", status);
+	imageMetadata->set(tags::alscStatus, status);
 	/*
 	 * Put the results in the global metadata as well. This will be used by
 	 * AWB to factor in the colour shading correction.
 	 */
-	getGlobalMetadata().set("alsc.status", status);
+	getGlobalMetadata().set(tags::alscStatus, status);
 }
 
 void Alsc::process(StatisticsPtr &stats, Metadata *imageMetadata)
@@ -435,27 +429,6 @@ void Alsc::process(StatisticsPtr &stats, Metadata *imageMetadata)
 	}
 }
 
-void Alsc::asyncFunc()
-{
-	while (true) {
-		{
-			std::unique_lock<std::mutex> lock(mutex_);
-			asyncSignal_.wait(lock, [&] {
-				return asyncStart_ || asyncAbort_;
-			});
-			asyncStart_ = false;
-			if (asyncAbort_)
-				break;
-		}
-		doAlsc();
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			asyncFinished_ = true;
-		}
-		syncSignal_.notify_one();
-	}
-}
-
 void getCalTable(double ct, std::vector<AlscCalibration> const &calibrations,
 		 Array2D<double> &calTable)
 {
@@ -582,6 +555,28 @@ void compensateLambdasForCal(const Array2D<double> &calTable,
 		newLambdas[i] /= minNewLambda;
 }
 
+/*
+ * Adjust the lambdas, which apply on top of the old calibration table, to the
+ * new one. The overall gains, the products of the two, are kept where they
+ * were, up to a global scale that is removed so that the lambdas stay centred
+ * within their bounds.
+ */
+static void rescaleLambdasForCal(const Array2D<double> &oldCalTable,
+				 const Array2D<double> &newCalTable,
+				 Array2D<double> &lambda, double lambdaBound)
+{
+	const double min = 1 - lambdaBound, max = 1 + lambdaBound;
+	double sum = 0;
+
+	for (unsigned int i = 0; i < lambda.size(); i++)
+		sum += oldCalTable[i] / newCalTable[i];
+
+	double scale = lambda.size() / sum;
+	for (unsigned int i = 0; i < lambda.size(); i++)
+		lambda[i] = std::clamp(lambda[i] * oldCalTable[i] / newCalTable[i] * scale,
+				       min, max);
+}
+
 [[maybe_unused]] static void printCalTable(const Array2D<double> &C)
 {
 	const Size &size = C.dimensions();
@@ -651,86 +646,73 @@ static void constructM(const Array2D<double> &C,
 }
 
 /*
- * In the compute_lambda_ functions, note that the matrix coefficients for the
- * left/right neighbours are zero down the left/right edges, so we don't need
- * need to test the i value to exclude them.
+ * Update one row of lambdas in a Gauss-Seidel sweep, going right if forward is
+ * true and left otherwise. The terms for the rows above and below and for the
+ * neighbour that the sweep hasn't reached yet don't depend on the updates made
+ * to the row, so they are summed first in loops that the compiler can
+ * vectorise. Only the term for the neighbour updated just before is left in
+ * the sequential loop.
+ *
+ * The matrix coefficients are zero for the neighbours outside the table, so
+ * the missing rows above and below are substituted by the row itself, which
+ * keeps the loops free of tests.
  */
-static double computeLambdaBottom(int i, const SparseArray<double> &M,
-				  Array2D<double> &lambda)
-{
-	return M[i][1] * lambda[i + 1] + M[i][2] * lambda[i + lambda.dimensions().width] +
-	       M[i][3] * lambda[i - 1];
-}
-static double computeLambdaBottomStart(int i, const SparseArray<double> &M,
-				       Array2D<double> &lambda)
-{
-	return M[i][1] * lambda[i + 1] + M[i][2] * lambda[i + lambda.dimensions().width];
-}
-static double computeLambdaInterior(int i, const SparseArray<double> &M,
-				    Array2D<double> &lambda)
-{
-	return M[i][0] * lambda[i - lambda.dimensions().width] + M[i][1] * lambda[i + 1] +
-	       M[i][2] * lambda[i + lambda.dimensions().width] + M[i][3] * lambda[i - 1];
-}
-static double computeLambdaTop(int i, const SparseArray<double> &M,
-			       Array2D<double> &lambda)
-{
-	return M[i][0] * lambda[i - lambda.dimensions().width] + M[i][1] * lambda[i + 1] +
-	       M[i][3] * lambda[i - 1];
-}
-static double computeLambdaTopEnd(int i, const SparseArray<double> &M,
-				  Array2D<double> &lambda)
-{
-	return M[i][0] * lambda[i - lambda.dimensions().width] + M[i][3] * lambda[i - 1];
+static void gaussSeidelRow(const SparseArray<double> &M, Array2D<double> &lambda,
+			   std::vector<double> &partial, int y, bool forward,
+			   double min, double max)
+{
+	const int X = lambda.dimensions().width;
+	const int Y = lambda.dimensions().height;
+	double *row = lambda.ptr() + y * X;
+	const double *above = y > 0 ? row - X : row;
+	const double *below = y < Y - 1 ? row + X : row;
+	const std::array<double, 4> *m = M.data() + y * X;
+	double *sum = partial.data();
+
+	for (int x = 0; x < X; x++)
+		sum[x] = m[x][0] * above[x] + m[x][2] * below[x];
+
+	if (forward) {
+		for (int x = 0; x < X - 1; x++)
+			sum[x] += m[x][1] * row[x + 1];
+
+		double left = 0;
+		for (int x = 0; x < X; x++) {
+			row[x] = std::clamp(sum[x] + m[x][3] * left, min, max);
+			left = row[x];
+		}
+	} else {
+		for (int x = 1; x < X; x++)
+			sum[x] += m[x][3] * row[x - 1];
+
+		double right = 0;
+		for (int x = X - 1; x >= 0; x--) {
+			row[x] = std::clamp(sum[x] + m[x][1] * right, min, max);
+			right = row[x];
+		}
+	}
 }
 
 /* Gauss-Seidel iteration with over-relaxation. */
 static double gaussSeidel2Sor(const SparseArray<double> &M, double omega,
-			      Array2D<double> &lambda, double lambdaBound)
+			      Array2D<double> &lambda, double lambdaBound,
+			      Array2D<double> &oldLambda,
+			      std::vector<double> &partial)
 {
 	int XY = lambda.size();
-	int X = lambda.dimensions().width;
+	int Y = lambda.dimensions().height;
 	const double min = 1 - lambdaBound, max = 1 + lambdaBound;
-	Array2D<double> oldLambda = lambda;
-	int i;
-	lambda[0] = computeLambdaBottomStart(0, M, lambda);
-	lambda[0] = std::clamp(lambda[0], min, max);
-	for (i = 1; i < X; i++) {
-		lambda[i] = computeLambdaBottom(i, M, lambda);
-		lambda[i] = std::clamp(lambda[i], min, max);
-	}
-	for (; i < XY - X; i++) {
-		lambda[i] = computeLambdaInterior(i, M, lambda);
-		lambda[i] = std::clamp(lambda[i], min, max);
-	}
-	for (; i < XY - 1; i++) {
-		lambda[i] = computeLambdaTop(i, M, lambda);
-		lambda[i] = std::clamp(lambda[i], min, max);
-	}
-	lambda[i] = computeLambdaTopEnd(i, M, lambda);
-	lambda[i] = std::clamp(lambda[i], min, max);
+	oldLambda = lambda;
+	for (int y = 0; y < Y; y++)
+		gaussSeidelRow(M, lambda, partial, y, true, min, max);
 	/*
 	 * Also solve the system from bottom to top, to help spread the updates
 	 * better.
 	 */
-	lambda[i] = computeLambdaTopEnd(i, M, lambda);
-	lambda[i] = std::clamp(lambda[i], min, max);
-	for (i = XY - 2; i >= XY - X; i--) {
-		lambda[i] = computeLambdaTop(i, M, lambda);
-		lambda[i] = std::clamp(lambda[i], min, max);
-	}
-	for (; i >= X; i--) {
-		lambda[i] = computeLambdaInterior(i, M, lambda);
-		lambda[i] = std::clamp(lambda[i], min, max);
-	}
-	for (; i >= 1; i--) {
-		lambda[i] = computeLambdaBottom(i, M, lambda);
-		lambda[i] = std::clamp(lambda[i], min, max);
-	}
-	lambda[0] = computeLambdaBottomStart(0, M, lambda);
-	lambda[0] = std::clamp(lambda[0], min, max);
+	for (int y = Y - 1; y >= 0; y--)
+		gaussSeidelRow(M, lambda, partial, y, false, min, max);
 	double maxDiff = 0;
-	for (i = 0; i < XY; i++) {
+	for (int i = 0; i < XY; i++) {
 		lambda[i] = oldLambda[i] + (lambda[i] - oldLambda[i]) * omega;
 		if (std::abs(lambda[i] - oldLambda[i]) > std::abs(maxDiff))
 			maxDiff = lambda[i] - oldLambda[i];
@@ -758,13 +740,17 @@ static void reaverage(Array2D<double> &data)
 static void runMatrixIterations(const Array2D<double> &C,
 				Array2D<double> &lambda,
 				const SparseArray<double> &W,
-				SparseArray<double> &M, double omega,
-				unsigned int nIter, double threshold, double lambdaBound)
+				SparseArray<double> &M, Array2D<double> &oldLambda,
+				double omega, unsigned int nIter, double threshold,
+				double lambdaBound)
 {
+	std::vector<double> partial(lambda.dimensions().width);
+
 	constructM(C, W, M);
 	double lastMaxDiff = std::numeric_limits<double>::max();
 	for (unsigned int i = 0; i < nIter; i++) {
-		double maxDiff = std::abs(gaussSeidel2Sor(M, omega, lambda, lambdaBound));
+		double maxDiff = std::abs(gaussSeidel2Sor(M, omega, lambda, lambdaBound,
+							  oldLambda, partial));
 		if (maxDiff < threshold) {
 			LOG(RPiAlsc, Debug)
 				<< "Stop after " << i + 1 << " iterations";
@@ -816,7 +802,8 @@ void addLuminanceToTables(std::array<Array2D<double>, 3> &results,
 void Alsc::doAlsc()
 {
 	Array2D<double> &cr = tmpC_[0], &cb = tmpC_[1], &calTableR = tmpC_[2],
-			&calTableB = tmpC_[3], &calTableTmp = tmpC_[4];
+			&calTableB = tmpC_[3], &calTableTmp = tmpC_[4],
+			&oldLambda = tmpC_[5];
 	SparseArray<double> &wr = tmpM_[0], &wb = tmpM_[1], &M = tmpM_[2];
 
 	/*
@@ -840,14 +827,23 @@ void Alsc::doAlsc()
 	 */
 	applyCalTable(calTableR, cr);
 	applyCalTable(calTableB, cb);
+	/*
+	 * The iterations start from the lambdas of the previous run. Adjust
+	 * them for the change of calibration since then, so that a change of
+	 * colour temperature alone doesn't move the solution away.
+	 */
+	rescaleLambdasForCal(prevCalTableR_, calTableR, lambdaR_, config_.lambdaBound);
+	rescaleLambdasForCal(prevCalTableB_, calTableB, lambdaB_, config_.lambdaBound);
+	prevCalTableR_ = calTableR;
+	prevCalTableB_ = calTableB;
 	/* Compute weights between zones. */
 	computeW(cr, config_.sigmaCr, wr);
 	computeW(cb, config_.sigmaCb, wb);
 	/* Run Gauss-Seidel iterations over the resulting matrix, for R and B. */
-	runMatrixIterations(cr, lambdaR_, wr, M, config_.omega, config_.nIter,
-			    config_.threshold, config_.lambdaBound);
-	runMatrixIterations(cb, lambdaB_, wb, M, config_.omega, config_.nIter,
-			    config_.threshold, config_.lambdaBound);
+	runMatrixIterations(cr, lambdaR_, wr, M, oldLambda, config_.omega,
+			    config_.nIter, config_.threshold, config_.lambdaBound);
+	runMatrixIterations(cb, lambdaB_, wb, M, oldLambda, config_.omega,
+			    config_.nIter, config_.threshold, config_.lambdaBound);
 	/*
 	 * Fold the calibrated gains into our final lambda values. (Note that on
 	 * the next run, we re-start with the lambda values that don't have the
@@ -7,9 +7,6 @@
 #pragma once
 
 #include <array>
-#include <mutex>
-#include <condition_variable>
-#include <thread>
 #include <vector>
 
 #include <libcamera/geometry.h>
@@ -17,6 +14,7 @@
 #include "../algorithm.h"
 #include "../alsc_status.h"
 #include "../statistics.h"
+#include "../task_pool.h"
 
 namespace RPiController {
 
@@ -122,19 +120,8 @@ private:
 	bool firstTime_;
 	CameraMode cameraMode_;
 	Array2D<double> luminanceTable_;
-	std::thread asyncThread_;
-	void asyncFunc(); /* asynchronous thread function */
-	std::mutex mutex_;
-	/* condvar for async thread to wait on */
-	std::condition_variable asyncSignal_;
-	/* condvar for synchronous thread to wait on */
-	std::condition_variable syncSignal_;
-	/* for sync thread to check  if async thread finished (requires mutex) */
-	bool asyncFinished_;
-	/* for async thread to check if it's been told to run (requires mutex) */
-	bool asyncStart_;
-	/* for async thread to check if it's been told to quit (requires mutex) */
-	bool asyncAbort_;
+	/* the asynchronous calculation, run on the shared task pool */
+	AsyncTask asyncTask_;
 
 	/*
 	 * The following are only for the synchronous thread to use:
@@ -165,9 +152,12 @@ private:
 	void doAlsc();
 	Array2D<double> lambdaR_;
 	Array2D<double> lambdaB_;
+	/* the calibration tables that lambdaR_ and lambdaB_ apply on top of */
+	Array2D<double> prevCalTableR_;
+	Array2D<double> prevCalTableB_;
 
 	/* Temporaries for the computations */
-	std::array<Array2D<double>, 5> tmpC_;
+	std::array<Array2D<double>, 6> tmpC_;
 	std::array<SparseArray<double>, 3> tmpM_;
 };
 
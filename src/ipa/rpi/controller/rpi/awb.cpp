@@ -5,6 +5,7 @@
  * AWB control algorithm
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <cmath>
 #include <functional>
@@ -23,6 +24,9 @@ LOG_DEFINE_CATEGORY(RPiAwb)
 
 constexpr double kDefaultCT = 4500.0;
 
+/* Number of lux buckets per stop for which the prior is interpolated. */
+constexpr double kPriorBucketsPerStop = 4.0;
+
 #define NAME "rpi.awb"
 
 /*
@@ -182,22 +186,19 @@ int AwbConfig::read(const libcamera::YamlObject &params)
 }
 
 Awb::Awb(Controller *controller)
-	: AwbAlgorithm(controller)
+	: AwbAlgorithm(controller), asyncTask_([this] { doAwb(); })
 {
-	asyncAbort_ = asyncStart_ = asyncStarted_ = asyncFinished_ = false;
+	asyncStarted_ = false;
 	mode_ = nullptr;
 	manualR_ = manualB_ = 0.0;
-	asyncThread_ = std::thread(std::bind(&Awb::asyncFunc, this));
+
+	declarePrepare({}, { tags::awbStatus });
+	declareProcess({ tags::luxStatus }, {});
 }
 
 Awb::~Awb()
 {
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncAbort_ = true;
-	}
-	asyncSignal_.notify_one();
-	asyncThread_.join();
+	asyncTask_.cancel();
 }
 
 char const *Awb::name() const
@@ -238,6 +239,17 @@ void Awb::initialValues(double &gainR, double &gainB)
 	gainB = syncResults_.gainB;
 }
 
+void Awb::setInitialValues(double gainR, double gainB, double temperatureK)
+{
+	/* Start filtering from the given values instead of the defaults. */
+	syncResults_.temperatureK = temperatureK;
+	syncResults_.gainR = gainR;
+	syncResults_.gainG = 1.0;
+	syncResults_.gainB = gainB;
+	prevSyncResults_ = syncResults_;
+	asyncResults_ = syncResults_;
+}
+
 void Awb::disableAuto()
 {
 	/* Freeze the most recent values, and treat them as manual gains */
@@ -297,7 +309,7 @@ void Awb::switchMode([[maybe_unused]] CameraMode const &cameraMode,
 		     Metadata *metadata)
 {
 	/* Let other algorithms know the current white balance values. */
-	metadata->set("awb.status", prevSyncResults_);
+	metadata->set(tags::awbStatus, prevSyncResults_);
 }
 
 bool Awb::isAutoEnabled() const
@@ -308,7 +320,6 @@ bool Awb::isAutoEnabled() const
 void Awb::fetchAsyncResults()
 {
 	LOG(RPiAwb, Debug) << "Fetch AWB results";
-	asyncFinished_ = false;
 	asyncStarted_ = false;
 	/*
 	 * It's possible manual gains could be set even while the async
@@ -334,11 +345,7 @@ void Awb::restartAsync(StatisticsPtr &stats, double lux)
 	size_t len = modeName_.copy(asyncResults_.mode,
 				    sizeof(asyncResults_.mode) - 1);
 	asyncResults_.mode[len] = '\0';
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		asyncStart_ = true;
-	}
-	asyncSignal_.notify_one();
+	asyncTask_.start();
 }
 
 void Awb::prepare(Metadata *imageMetadata)
@@ -350,11 +357,8 @@ void Awb::prepare(Metadata *imageMetadata)
 			       : config_.speed;
 	LOG(RPiAwb, Debug)
 		<< "frame_count " << frameCount_ << " speed " << speed;
-	{
-		std::unique_lock<std::mutex> lock(mutex_);
-		if (asyncStarted_ && asyncFinished_)
-			fetchAsyncResults();
-	}
+	if (asyncStarted_ && asyncTask_.finished())
+		fetchAsyncResults();
 	/* Finally apply IIR filter to results and put into metadata. */
 	memcpy(prevSyncResults_.mode, syncResults_.mode,
 	       sizeof(prevSyncResults_.mode));
@@ -366,7 +370,7 @@ void Awb::prepare(Metadata *imageMetadata)
 				 (1.0 - speed) * prevSyncResults_.gainG;
 	prevSyncResults_.gainB = speed * syncResults_.gainB +
 				 (1.0 - speed) * prevSyncResults_.gainB;
-	imageMetadata->set("awb.status", prevSyncResults_);
+	imageMetadata->set(tags::awbStatus, prevSyncResults_);
 	LOG(RPiAwb, Debug)
 		<< "Using AWB gains r " << prevSyncResults_.gainR << " g "
 		<< prevSyncResults_.gainG << " b "
@@ -386,7 +390,7 @@ void Awb::process(StatisticsPtr &stats, Metadata *imageMetadata)
 		/* Update any settings and any image metadata that we need. */
 		struct LuxStatus luxStatus = {};
 		luxStatus.lux = 400; /* in case no metadata */
-		if (imageMetadata->get("lux.status", luxStatus) != 0)
+		if (imageMetadata->get(tags::luxStatus, luxStatus) != 0)
 			LOG(RPiAwb, Debug) << "No lux metadata found";
 		LOG(RPiAwb, Debug) << "Awb lux value is " << luxStatus.lux;
 
@@ -395,27 +399,6 @@ void Awb::process(StatisticsPtr &stats, Metadata *imageMetadata)
 	}
 }
 
-void Awb::asyncFunc()
-{
-	while (true) {
-		{
-			std::unique_lock<std::mutex> lock(mutex_);
-			asyncSignal_.wait(lock, [&] {
-				return asyncStart_ || asyncAbort_;
-			});
-			asyncStart_ = false;
-			if (asyncAbort_)
-				break;
-		}
-		doAwb();
-		{
-			std::lock_guard<std::mutex> lock(mutex_);
-			asyncFinished_ = true;
-		}
-		syncSignal_.notify_one();
-	}
-}
-
 static void generateStats(std::vector<Awb::RGB> &zones,
 			  StatisticsPtr &stats, double minPixels,
 			  double minG, Metadata &globalMetadata,
@@ -441,7 +424,7 @@ static void generateStats(std::vector<Awb::RGB> &zones,
 			zone.B += proportion * biasCtB;
 			zone.G += proportion * 1.0;
 			/* Factor in the ALSC applied colour shading correction if required. */
-			const AlscStatus *alscStatus = globalMetadata.getLocked<AlscStatus>("alsc.status");
+			const AlscStatus *alscStatus = globalMetadata.getLocked<AlscStatus>(tags::alscStatus);
 			if (stats->colourStatsPos == Statistics::ColourStatsPos::PreLsc && alscStatus) {
 				zone.R *= alscStatus->r[i];
 				zone.G *= alscStatus->g[i];
@@ -474,25 +457,39 @@ void Awb::prepareStats()
 	}
 }
 
-double Awb::computeDelta2Sum(double gainR, double gainB)
+void Awb::computeDelta2Sums(std::vector<Candidate> const &candidates,
+			    std::vector<double> &delta2Sums)
 {
 	/*
-	 * Compute the sum of the squared colour error (non-greyness) as it
-	 * appears in the log likelihood equation.
+	 * Compute the sums of the squared colour error (non-greyness) as they
+	 * appear in the log likelihood equation, for all the candidate gains
+	 * at once. Each zone is loaded once for all the candidates, and the
+	 * inner loop has no dependencies between iterations so that the
+	 * compiler can vectorise it.
 	 */
-	double delta2Sum = 0;
-	for (auto &z : zones_) {
-		double deltaR = gainR * z.R - 1 - config_.whitepointR;
-		double deltaB = gainB * z.B - 1 - config_.whitepointB;
-		double delta2 = deltaR * deltaR + deltaB * deltaB;
-		/* LOG(RPiAwb, Debug) << "deltaR " << deltaR << " deltaB " << deltaB << " delta2 " << delta2; */
-		delta2 = std::min(delta2, config_.deltaLimit);
-		delta2Sum += delta2;
+	const double whitepointR = config_.whitepointR;
+	const double whitepointB = config_.whitepointB;
+	const double deltaLimit = config_.deltaLimit;
+	const unsigned int numCandidates = candidates.size();
+
+	delta2Sums.assign(numCandidates, 0.0);
+	double *sums = delta2Sums.data();
+	const Candidate *gains = candidates.data();
+
+	for (unsigned int i = 0; i < zoneR_.size(); i++) {
+		const double zoneR = zoneR_[i];
+		const double zoneB = zoneB_[i];
+
+		for (unsigned int j = 0; j < numCandidates; j++) {
+			double deltaR = gains[j].gainR * zoneR - 1 - whitepointR;
+			double deltaB = gains[j].gainB * zoneB - 1 - whitepointB;
+			double delta2 = deltaR * deltaR + deltaB * deltaB;
+			sums[j] += std::min(delta2, deltaLimit);
+		}
 	}
-	return delta2Sum;
 }
 
-ipa::Pwl Awb::interpolatePrior()
+ipa::Pwl const &Awb::interpolatePrior()
 {
 	/*
 	 * Interpolate the prior log likelihood function for our current lux
@@ -502,20 +499,36 @@ ipa::Pwl Awb::interpolatePrior()
 		return config_.priors.front().prior;
 	else if (lux_ >= config_.priors.back().lux)
 		return config_.priors.back().prior;
-	else {
-		int idx = 0;
-		/* find which two we lie between */
-		while (config_.priors[idx + 1].lux < lux_)
-			idx++;
-		double lux0 = config_.priors[idx].lux,
-		       lux1 = config_.priors[idx + 1].lux;
-		return ipa::Pwl::combine(config_.priors[idx].prior,
-				    config_.priors[idx + 1].prior,
-				    [&](double /*x*/, double y0, double y1) {
-					    return y0 + (y1 - y0) *
-							(lux_ - lux0) / (lux1 - lux0);
-				    });
-	}
+
+	/*
+	 * The prior varies slowly with the lux level, so only interpolate it
+	 * again when the lux level moves to a different bucket, and use the
+	 * lux level at the centre of the bucket to make the result independent
+	 * of the history.
+	 */
+	int bucket = std::lround(std::log2(lux_) * kPriorBucketsPerStop);
+	if (priorBucket_ && *priorBucket_ == bucket)
+		return prior_;
+
+	double lux = std::clamp(std::exp2(bucket / kPriorBucketsPerStop),
+				config_.priors.front().lux,
+				config_.priors.back().lux);
+	int idx = 0;
+	/* find which two we lie between */
+	while (idx + 2 < static_cast<int>(config_.priors.size()) &&
+	       config_.priors[idx + 1].lux < lux)
+		idx++;
+	double lux0 = config_.priors[idx].lux,
+	       lux1 = config_.priors[idx + 1].lux;
+	prior_ = ipa::Pwl::combine(config_.priors[idx].prior,
+				   config_.priors[idx + 1].prior,
+				   [&](double /*x*/, double y0, double y1) {
+					   return y0 + (y1 - y0) *
+						       (lux - lux0) / (lux1 - lux0);
+				   });
+	priorBucket_ = bucket;
+
+	return prior_;
 }
 
 static double interpolateQuadatric(ipa::Pwl::Point const &a, ipa::Pwl::Point const &b,
@@ -540,30 +553,40 @@ static double interpolateQuadatric(ipa::Pwl::Point const &a, ipa::Pwl::Point con
 double Awb::coarseSearch(ipa::Pwl const &prior)
 {
 	points_.clear(); /* assume doesn't deallocate memory */
-	size_t bestPoint = 0;
+	candidates_.clear();
 	double t = mode_->ctLo;
 	int spanR = 0, spanB = 0;
-	/* Step down the CT curve evaluating log likelihood. */
+	/* Step down the CT curve to list the candidates first. */
 	while (true) {
 		double r = config_.ctR.eval(t, &spanR);
 		double b = config_.ctB.eval(t, &spanB);
-		double gainR = 1 / r, gainB = 1 / b;
-		double delta2Sum = computeDelta2Sum(gainR, gainB);
-		double priorLogLikelihood = prior.eval(prior.domain().clamp(t));
-		double finalLogLikelihood = delta2Sum - priorLogLikelihood;
-		LOG(RPiAwb, Debug)
-			<< "t: " << t << " gain R " << gainR << " gain B "
-			<< gainB << " delta2_sum " << delta2Sum
-			<< " prior " << priorLogLikelihood << " final "
-			<< finalLogLikelihood;
-		points_.push_back(ipa::Pwl::Point({ t, finalLogLikelihood }));
-		if (points_.back().y() < points_[bestPoint].y())
-			bestPoint = points_.size() - 1;
+		candidates_.push_back({ 1 / r, 1 / b });
+		points_.push_back(ipa::Pwl::Point({ t, 0 }));
 		if (t == mode_->ctHi)
 			break;
 		/* for even steps along the r/b curve scale them by the current t */
 		t = std::min(t + t / 10 * config_.coarseStep, mode_->ctHi);
 	}
+
+	/* Now evaluate the log likelihood of all of them in one pass. */
+	computeDelta2Sums(candidates_, delta2Sums_);
+
+	size_t bestPoint = 0;
+	int spanPrior = -1;
+	for (size_t i = 0; i < points_.size(); i++) {
+		t = points_[i].x();
+		double priorLogLikelihood =
+			prior.eval(prior.domain().clamp(t), &spanPrior);
+		double finalLogLikelihood = delta2Sums_[i] - priorLogLikelihood;
+		LOG(RPiAwb, Debug)
+			<< "t: " << t << " gain R " << candidates_[i].gainR
+			<< " gain B " << candidates_[i].gainB << " delta2_sum "
+			<< delta2Sums_[i] << " prior " << priorLogLikelihood
+			<< " final " << finalLogLikelihood;
+		points_[i][1] = finalLogLikelihood;
+		if (points_[i].y() < points_[bestPoint].y())
+			bestPoint = i;
+	}
 	t = points_[bestPoint].x();
 	LOG(RPiAwb, Debug) << "Coarse search found CT " << t;
 	/*
@@ -613,44 +636,68 @@ void Awb::fineSearch(double &t, double &r, double &b, ipa::Pwl const &prior)
 	 * large.
 	 */
 	nsteps += numDeltas;
-	for (int i = -nsteps; i <= nsteps; i++) {
-		double tTest = t + i * step;
-		double priorLogLikelihood =
-			prior.eval(prior.domain().clamp(tTest));
-		double rCurve = config_.ctR.eval(tTest, &spanR);
-		double bCurve = config_.ctB.eval(tTest, &spanB);
+	const int numSteps = 2 * nsteps + 1;
+
+	/*
+	 * Take some measurements transversely *off* the CT curve at every
+	 * step, evaluating all of them in a single pass over the zones.
+	 */
+	std::vector<ipa::Pwl::Point> rbCurves(numSteps);
+	std::vector<double> priorLogLikelihoods(numSteps);
+	int spanPrior = -1;
+	candidates_.clear();
+	for (int i = 0; i < numSteps; i++) {
+		double tTest = t + (i - nsteps) * step;
+		priorLogLikelihoods[i] =
+			prior.eval(prior.domain().clamp(tTest), &spanPrior);
+		rbCurves[i] = ipa::Pwl::Point({ config_.ctR.eval(tTest, &spanR),
+						config_.ctB.eval(tTest, &spanB) });
+		for (int j = 0; j < numDeltas; j++) {
+			double offset = -config_.transverseNeg +
+					(transverseRange * j) / (numDeltas - 1);
+			ipa::Pwl::Point rbTest = rbCurves[i] + transverse * offset;
+			candidates_.push_back({ 1 / rbTest.x(), 1 / rbTest.y() });
+		}
+	}
+	computeDelta2Sums(candidates_, delta2Sums_);
+
+	/*
+	 * We have NUM_DELTAS points transversely across the CT curve at each
+	 * step, now let's do a quadratic interpolation for the best result of
+	 * each of them, and evaluate these in a second pass.
+	 */
+	std::vector<Candidate> refined(numSteps);
+	for (int i = 0; i < numSteps; i++) {
+		double tTest = t + (i - nsteps) * step;
 		/* x will be distance off the curve, y the log likelihood there */
 		ipa::Pwl::Point points[maxNumDeltas];
 		int bestPoint = 0;
-		/* Take some measurements transversely *off* the CT curve. */
 		for (int j = 0; j < numDeltas; j++) {
+			const Candidate &candidate = candidates_[i * numDeltas + j];
 			points[j][0] = -config_.transverseNeg +
 				       (transverseRange * j) / (numDeltas - 1);
-			ipa::Pwl::Point rbTest = ipa::Pwl::Point({ rCurve, bCurve }) +
-						 transverse * points[j].x();
-			double rTest = rbTest.x(), bTest = rbTest.y();
-			double gainR = 1 / rTest, gainB = 1 / bTest;
-			double delta2Sum = computeDelta2Sum(gainR, gainB);
-			points[j][1] = delta2Sum - priorLogLikelihood;
+			points[j][1] = delta2Sums_[i * numDeltas + j] -
+				       priorLogLikelihoods[i];
 			LOG(RPiAwb, Debug)
-				<< "At t " << tTest << " r " << rTest << " b "
-				<< bTest << ": " << points[j].y();
+				<< "At t " << tTest << " r " << 1 / candidate.gainR
+				<< " b " << 1 / candidate.gainB << ": "
+				<< points[j].y();
 			if (points[j].y() < points[bestPoint].y())
 				bestPoint = j;
 		}
-		/*
-		 * We have NUM_DELTAS points transversely across the CT curve,
-		 * now let's do a quadratic interpolation for the best result.
-		 */
 		bestPoint = std::max(1, std::min(bestPoint, numDeltas - 2));
-		ipa::Pwl::Point rbTest = ipa::Pwl::Point({ rCurve, bCurve }) +
+		ipa::Pwl::Point rbTest = rbCurves[i] +
 					 transverse * interpolateQuadatric(points[bestPoint - 1],
 									   points[bestPoint],
 									   points[bestPoint + 1]);
-		double rTest = rbTest.x(), bTest = rbTest.y();
-		double gainR = 1 / rTest, gainB = 1 / bTest;
-		double delta2Sum = computeDelta2Sum(gainR, gainB);
-		double finalLogLikelihood = delta2Sum - priorLogLikelihood;
+		refined[i] = { 1 / rbTest.x(), 1 / rbTest.y() };
+	}
+	computeDelta2Sums(refined, delta2Sums_);
+
+	for (int i = 0; i < numSteps; i++) {
+		double tTest = t + (i - nsteps) * step;
+		double rTest = 1 / refined[i].gainR, bTest = 1 / refined[i].gainB;
+		double finalLogLikelihood = delta2Sums_[i] - priorLogLikelihoods[i];
 		LOG(RPiAwb, Debug)
 			<< "Finally "
 			<< tTest << " r " << rTest << " b " << bTest << ": "
@@ -671,8 +718,12 @@ void Awb::awbBayes()
 	 * May as well divide out G to save computeDelta2Sum from doing it over
 	 * and over.
 	 */
-	for (auto &z : zones_)
-		z.R = z.R / (z.G + 1), z.B = z.B / (z.G + 1);
+	zoneR_.resize(zones_.size());
+	zoneB_.resize(zones_.size());
+	for (unsigned int i = 0; i < zones_.size(); i++) {
+		zoneR_[i] = zones_[i].R / (zones_[i].G + 1);
+		zoneB_[i] = zones_[i].B / (zones_[i].G + 1);
+	}
 	/*
 	 * Get the current prior, and scale according to how many zones are
 	 * valid... not entirely sure about this.
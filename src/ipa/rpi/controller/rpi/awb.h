@@ -6,15 +6,15 @@
  */
 #pragma once
 
-#include <mutex>
-#include <condition_variable>
-#include <thread>
+#include <optional>
+#include <vector>
 
 #include <libcamera/geometry.h>
 
 #include "../awb_algorithm.h"
 #include "../awb_status.h"
 #include "../statistics.h"
+#include "../task_pool.h"
 
 #include "libipa/pwl.h"
 
@@ -103,6 +103,8 @@ public:
 	int read(const libcamera::YamlObject &params) override;
 	unsigned int getConvergenceFrames() const override;
 	void initialValues(double &gainR, double &gainB) override;
+	void setInitialValues(double gainR, double gainB,
+			      double temperatureK) override;
 	void setMode(std::string const &name) override;
 	void setManualGains(double manualR, double manualB) override;
 	void enableAuto() override;
@@ -127,19 +129,8 @@ private:
 	bool isAutoEnabled() const;
 	/* configuration is read-only, and available to both threads */
 	AwbConfig config_;
-	std::thread asyncThread_;
-	void asyncFunc(); /* asynchronous thread function */
-	std::mutex mutex_;
-	/* condvar for async thread to wait on */
-	std::condition_variable asyncSignal_;
-	/* condvar for synchronous thread to wait on */
-	std::condition_variable syncSignal_;
-	/* for sync thread to check  if async thread finished (requires mutex) */
-	bool asyncFinished_;
-	/* for async thread to check if it's been told to run (requires mutex) */
-	bool asyncStart_;
-	/* for async thread to check if it's been told to quit (requires mutex) */
-	bool asyncAbort_;
+	/* the asynchronous calculation, run on the shared task pool */
+	AsyncTask asyncTask_;
 
 	/*
 	 * The following are only for the synchronous thread to use:
@@ -167,12 +158,26 @@ private:
 	void awbBayes();
 	void awbGrey();
 	void prepareStats();
-	double computeDelta2Sum(double gainR, double gainB);
-	libcamera::ipa::Pwl interpolatePrior();
+	/* candidate gains evaluated by the Bayesian search */
+	struct Candidate {
+		double gainR;
+		double gainB;
+	};
+	void computeDelta2Sums(std::vector<Candidate> const &candidates,
+			       std::vector<double> &delta2Sums);
+	libcamera::ipa::Pwl const &interpolatePrior();
 	double coarseSearch(libcamera::ipa::Pwl const &prior);
 	void fineSearch(double &t, double &r, double &b, libcamera::ipa::Pwl const &prior);
 	std::vector<RGB> zones_;
+	/* zone R/G and B/G ratios, stored separately for the search loops */
+	std::vector<double> zoneR_;
+	std::vector<double> zoneB_;
 	std::vector<libcamera::ipa::Pwl::Point> points_;
+	std::vector<Candidate> candidates_;
+	std::vector<double> delta2Sums_;
+	/* prior interpolated for the lux bucket priorBucket_ */
+	std::optional<int> priorBucket_;
+	libcamera::ipa::Pwl prior_;
 	/* manual r setting */
 	double manualR_;
 	/* manual b setting */
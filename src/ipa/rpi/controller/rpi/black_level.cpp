@@ -23,6 +23,8 @@ LOG_DEFINE_CATEGORY(RPiBlackLevel)
 BlackLevel::BlackLevel(Controller *controller)
 	: BlackLevelAlgorithm(controller)
 {
+	declarePrepare({}, { tags::blackLevelStatus });
+	declareProcess({}, {});
 }
 
 char const *BlackLevel::name() const
@@ -62,7 +64,7 @@ void BlackLevel::prepare(Metadata *imageMetadata)
 	status.blackLevelR = blackLevelR_;
 	status.blackLevelG = blackLevelG_;
 	status.blackLevelB = blackLevelB_;
-	imageMetadata->set("black_level.status", status);
+	imageMetadata->set(tags::blackLevelStatus, status);
 }
 
 /* Register algorithm with the system. */
@@ -20,6 +20,8 @@ LOG_DEFINE_CATEGORY(RPiCac)
 Cac::Cac(Controller *controller)
 	: Algorithm(controller)
 {
+	declarePrepare({}, { tags::cacStatus });
+	declareProcess({}, {});
 }
 
 char const *Cac::name() const
@@ -96,7 +98,7 @@ int Cac::read(const libcamera::YamlObject &params)
 void Cac::prepare(Metadata *imageMetadata)
 {
 	if (config_.enabled)
-		imageMetadata->set("cac.status", cacStatus_);
+		imageMetadata->set(tags::cacStatus, cacStatus_);
 }
 
 // Register algorithm with the system.
@@ -59,7 +59,12 @@ int Matrix::read(const libcamera::YamlObject &params)
 }
 
 Ccm::Ccm(Controller *controller)
-	: CcmAlgorithm(controller), saturation_(1.0) {}
+	: CcmAlgorithm(controller), saturation_(1.0)
+{
+	declarePrepare({ tags::awbStatus, tags::luxStatus },
+		       { tags::ccmStatus });
+	declareProcess({}, {});
+}
 
 char const *Ccm::name() const
 {
@@ -116,7 +121,7 @@ void Ccm::initialise()
 namespace {
 
 template<typename T>
-bool getLocked(Metadata *metadata, std::string const &tag, T &value)
+bool getLocked(Metadata *metadata, MetadataTag const &tag, T &value)
 {
 	T *ptr = metadata->getLocked<T>(tag);
 	if (ptr == nullptr)
@@ -163,8 +168,8 @@ void Ccm::prepare(Metadata *imageMetadata)
 	{
 		/* grab mutex just once to get everything */
 		std::lock_guard<Metadata> lock(*imageMetadata);
-		awbOk = getLocked(imageMetadata, "awb.status", awb);
-		luxOk = getLocked(imageMetadata, "lux.status", lux);
+		awbOk = getLocked(imageMetadata, tags::awbStatus, awb);
+		luxOk = getLocked(imageMetadata, tags::luxStatus, lux);
 	}
 	if (!awbOk)
 		LOG(RPiCcm, Warning) << "no colour temperature found";
@@ -191,7 +196,7 @@ void Ccm::prepare(Metadata *imageMetadata)
 		<< " " << ccmStatus.matrix[5] << "     "
 		<< ccmStatus.matrix[6] << " " << ccmStatus.matrix[7]
 		<< " " << ccmStatus.matrix[8];
-	imageMetadata->set("ccm.status", ccmStatus);
+	imageMetadata->set(tags::ccmStatus, ccmStatus);
 }
 
 /* Register algorithm with the system. */
@@ -31,6 +31,8 @@ LOG_DEFINE_CATEGORY(RPiContrast)
 Contrast::Contrast(Controller *controller)
 	: ContrastAlgorithm(controller), brightness_(0.0), contrast_(1.0)
 {
+	declarePrepare({}, { tags::contrastStatus });
+	declareProcess({}, {});
 }
 
 char const *Contrast::name() const
@@ -91,7 +93,7 @@ void Contrast::initialise()
 
 void Contrast::prepare(Metadata *imageMetadata)
 {
-	imageMetadata->set("contrast.status", status_);
+	imageMetadata->set(tags::contrastStatus, status_);
 }
 
 namespace {
@@ -63,6 +63,9 @@ int DenoiseConfig::read(const libcamera::YamlObject &params)
 Denoise::Denoise(Controller *controller)
 	: DenoiseAlgorithm(controller), mode_(DenoiseMode::ColourHighQuality)
 {
+	declarePrepare({ tags::noiseStatus },
+		       { tags::sdnStatus, tags::tdnStatus, tags::cdnStatus });
+	declareProcess({}, {});
 }
 
 char const *Denoise::name() const
@@ -113,7 +116,7 @@ void Denoise::prepare(Metadata *imageMetadata)
 {
 	struct NoiseStatus noiseStatus = {};
 	noiseStatus.noiseSlope = 3.0; // in case no metadata
-	if (imageMetadata->get("noise.status", noiseStatus) != 0)
+	if (imageMetadata->get(tags::noiseStatus, noiseStatus) != 0)
 		LOG(RPiDenoise, Warning) << "no noise profile found";
 
 	LOG(RPiDenoise, Debug)
@@ -130,7 +133,7 @@ void Denoise::prepare(Metadata *imageMetadata)
 		sdn.noiseConstant2 = noiseStatus.noiseConstant * currentConfig_->sdnDeviation2;
 		sdn.noiseSlope2 = noiseStatus.noiseSlope * currentSdnDeviation2_;
 		sdn.strength = currentSdnStrength_;
-		imageMetadata->set("sdn.status", sdn);
+		imageMetadata->set(tags::sdnStatus, sdn);
 		LOG(RPiDenoise, Debug)
 			<< "const " << sdn.noiseConstant
 			<< " slope " << sdn.noiseSlope
@@ -150,7 +153,7 @@ void Denoise::prepare(Metadata *imageMetadata)
 		tdn.noiseConstant = noiseStatus.noiseConstant * currentConfig_->tdnDeviation;
 		tdn.noiseSlope = noiseStatus.noiseSlope * currentConfig_->tdnDeviation;
 		tdn.threshold = currentConfig_->tdnThreshold;
-		imageMetadata->set("tdn.status", tdn);
+		imageMetadata->set(tags::tdnStatus, tdn);
 		LOG(RPiDenoise, Debug)
 			<< "programmed tdn threshold " << tdn.threshold
 			<< " constant " << tdn.noiseConstant
@@ -161,7 +164,7 @@ void Denoise::prepare(Metadata *imageMetadata)
 		struct CdnStatus cdn;
 		cdn.threshold = currentConfig_->cdnDeviation * noiseStatus.noiseSlope + noiseStatus.noiseConstant;
 		cdn.strength = currentConfig_->cdnStrength;
-		imageMetadata->set("cdn.status", cdn);
+		imageMetadata->set(tags::cdnStatus, cdn);
 		LOG(RPiDenoise, Debug)
 			<< "programmed cdn threshold " << cdn.threshold
 			<< " strength " << cdn.strength;
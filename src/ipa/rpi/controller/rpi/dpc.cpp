@@ -24,6 +24,8 @@ LOG_DEFINE_CATEGORY(RPiDpc)
 Dpc::Dpc(Controller *controller)
 	: Algorithm(controller)
 {
+	declarePrepare({}, { tags::dpcStatus });
+	declareProcess({}, {});
 }
 
 char const *Dpc::name() const
@@ -48,7 +50,7 @@ void Dpc::prepare(Metadata *imageMetadata)
 	/* Should we vary this with lux level or analogue gain? TBD. */
 	dpcStatus.strength = config_.strength;
 	LOG(RPiDpc, Debug) << "strength " << dpcStatus.strength;
-	imageMetadata->set("dpc.status", dpcStatus);
+	imageMetadata->set(tags::dpcStatus, dpcStatus);
 }
 
 /* Register algorithm with the system. */
@@ -27,6 +27,9 @@ LOG_DEFINE_CATEGORY(RPiGeq)
 Geq::Geq(Controller *controller)
 	: Algorithm(controller)
 {
+	declarePrepare({ tags::luxStatus, tags::deviceStatus },
+		       { tags::geqStatus });
+	declareProcess({}, {});
 }
 
 char const *Geq::name() const
@@ -56,11 +59,11 @@ void Geq::prepare(Metadata *imageMetadata)
 {
 	LuxStatus luxStatus = {};
 	luxStatus.lux = 400;
-	if (imageMetadata->get("lux.status", luxStatus))
+	if (imageMetadata->get(tags::luxStatus, luxStatus))
 		LOG(RPiGeq, Warning) << "no lux data found";
 	DeviceStatus deviceStatus;
 	deviceStatus.analogueGain = 1.0; /* in case not found */
-	if (imageMetadata->get("device.status", deviceStatus))
+	if (imageMetadata->get(tags::deviceStatus, deviceStatus))
 		LOG(RPiGeq, Warning)
 			<< "no device metadata - use analogue gain of 1x";
 	GeqStatus geqStatus = {};
@@ -77,7 +80,7 @@ void Geq::prepare(Metadata *imageMetadata)
 		<< geqStatus.slope << " (analogue gain "
 		<< deviceStatus.analogueGain << " lux "
 		<< luxStatus.lux << ")";
-	imageMetadata->set("geq.status", geqStatus);
+	imageMetadata->set(tags::geqStatus, geqStatus);
 }
 
 /* Register algorithm with the system. */
@@ -104,6 +104,11 @@ Hdr::Hdr(Controller *controller)
 	numRegions_ = regions_.width * regions_.height;
 	gains_[0].resize(numRegions_, 1.0);
 	gains_[1].resize(numRegions_, 1.0);
+
+	declarePrepare({ tags::agcDelayedStatus, tags::alscStatus },
+		       { tags::alscStatus });
+	declareProcess({ tags::agcDelayedStatus, tags::agcStatus },
+		       { tags::agcStatus, tags::tonemapStatus, tags::stitchStatus });
 }
 
 char const *Hdr::name() const
@@ -154,7 +159,7 @@ std::vector<unsigned int> Hdr::getChannels() const
 void Hdr::updateAgcStatus(Metadata *metadata)
 {
 	std::scoped_lock lock(*metadata);
-	AgcStatus *agcStatus = metadata->getLocked<AgcStatus>("agc.status");
+	AgcStatus *agcStatus = metadata->getLocked<AgcStatus>(tags::agcStatus);
 	if (agcStatus) {
 		HdrConfig &hdrConfig = config_[status_.mode];
 		auto it = hdrConfig.channelMap.find(agcStatus->channel);
@@ -177,7 +182,7 @@ void Hdr::switchMode([[maybe_unused]] CameraMode const &cameraMode, Metadata *me
 void Hdr::prepare(Metadata *imageMetadata)
 {
 	AgcStatus agcStatus;
-	if (!imageMetadata->get<AgcStatus>("agc.delayed_status", agcStatus))
+	if (!imageMetadata->get<AgcStatus>(tags::agcDelayedStatus, agcStatus))
 		delayedStatus_ = agcStatus.hdr;
 
 	auto it = config_.find(delayedStatus_.mode);
@@ -192,7 +197,7 @@ void Hdr::prepare(Metadata *imageMetadata)
 		return;
 
 	AlscStatus alscStatus{}; /* some compilers seem to require the braces */
-	if (imageMetadata->get<AlscStatus>("alsc.status", alscStatus)) {
+	if (imageMetadata->get<AlscStatus>(tags::alscStatus, alscStatus)) {
 		LOG(RPiHdr, Warning) << "No ALSC status";
 		return;
 	}
@@ -204,7 +209,7 @@ void Hdr::prepare(Metadata *imageMetadata)
 		alscStatus.g[i] *= gains[i];
 		alscStatus.b[i] *= gains[i];
 	}
-	imageMetadata->set("alsc.status", alscStatus);
+	imageMetadata->set(tags::alscStatus, alscStatus);
 }
 
 bool Hdr::updateTonemap([[maybe_unused]] StatisticsPtr &stats, HdrConfig &config)
@@ -369,7 +374,7 @@ void Hdr::process(StatisticsPtr &stats, Metadata *imageMetadata)
 	 * case delayedStatus_ should be right.
 	 */
 	AgcStatus agcStatus;
-	if (!imageMetadata->get<AgcStatus>("agc.delayed_status", agcStatus))
+	if (!imageMetadata->get<AgcStatus>(tags::agcDelayedStatus, agcStatus))
 		delayedStatus_ = agcStatus.hdr;
 
 	auto it = config_.find(delayedStatus_.mode);
@@ -394,7 +399,7 @@ void Hdr::process(StatisticsPtr &stats, Metadata *imageMetadata)
 		tonemapStatus.strength = config.strength;
 		tonemapStatus.tonemap = tonemap_;
 
-		imageMetadata->set("tonemap.status", tonemapStatus);
+		imageMetadata->set(tags::tonemapStatus, tonemapStatus);
 	}
 
 	if (config.stitchEnable) {
@@ -405,7 +410,7 @@ void Hdr::process(StatisticsPtr &stats, Metadata *imageMetadata)
 		stitchStatus.motionThreshold = config.motionThreshold;
 		stitchStatus.thresholdLo = config.thresholdLo;
 
-		imageMetadata->set("stitch.status", stitchStatus);
+		imageMetadata->set(tags::stitchStatus, stitchStatus);
 	}
 }
 
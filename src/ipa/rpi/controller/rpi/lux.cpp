@@ -28,6 +28,9 @@ Lux::Lux(Controller *controller)
 	 */
 	status_.aperture = 1.0;
 	status_.lux = 400;
+
+	declarePrepare({}, { tags::luxStatus });
+	declareProcess({ tags::deviceStatus }, { tags::luxStatus });
 }
 
 char const *Lux::name() const
@@ -71,13 +74,13 @@ void Lux::setCurrentAperture(double aperture)
 void Lux::prepare(Metadata *imageMetadata)
 {
 	std::unique_lock<std::mutex> lock(mutex_);
-	imageMetadata->set("lux.status", status_);
+	imageMetadata->set(tags::luxStatus, status_);
 }
 
 void Lux::process(StatisticsPtr &stats, Metadata *imageMetadata)
 {
 	DeviceStatus deviceStatus;
-	if (imageMetadata->get("device.status", deviceStatus) == 0) {
+	if (imageMetadata->get(tags::deviceStatus, deviceStatus) == 0) {
 		double currentGain = deviceStatus.analogueGain;
 		double currentAperture = deviceStatus.aperture.value_or(currentAperture_);
 		double currentY = stats->yHist.interQuantileMean(0, 1);
@@ -101,7 +104,7 @@ void Lux::process(StatisticsPtr &stats, Metadata *imageMetadata)
 		 * Overwrite the metadata here as well, so that downstream
 		 * algorithms get the latest value.
 		 */
-		imageMetadata->set("lux.status", status);
+		imageMetadata->set(tags::luxStatus, status);
 	} else
 		LOG(RPiLux, Warning) << ": no device metadata";
 }
@@ -24,6 +24,8 @@ LOG_DEFINE_CATEGORY(RPiNoise)
 Noise::Noise(Controller *controller)
 	: Algorithm(controller), modeFactor_(1.0)
 {
+	declarePrepare({ tags::deviceStatus }, { tags::noiseStatus });
+	declareProcess({}, {});
 }
 
 char const *Noise::name() const
@@ -60,7 +62,7 @@ void Noise::prepare(Metadata *imageMetadata)
 {
 	struct DeviceStatus deviceStatus;
 	deviceStatus.analogueGain = 1.0; /* keep compiler calm */
-	if (imageMetadata->get("device.status", deviceStatus) == 0) {
+	if (imageMetadata->get(tags::deviceStatus, deviceStatus) == 0) {
 		/*
 		 * There is a slight question as to exactly how the noise
 		 * profile, specifically the constant part of it, scales. For
@@ -73,7 +75,7 @@ void Noise::prepare(Metadata *imageMetadata)
 		struct NoiseStatus status;
 		status.noiseConstant = referenceConstant_ * factor;
 		status.noiseSlope = referenceSlope_ * factor;
-		imageMetadata->set("noise.status", status);
+		imageMetadata->set(tags::noiseStatus, status);
 		LOG(RPiNoise, Debug)
 			<< "constant " << status.noiseConstant
 			<< " slope " << status.noiseSlope;
@@ -20,6 +20,8 @@ LOG_DEFINE_CATEGORY(RPiSaturation)
 Saturation::Saturation(Controller *controller)
 	: Algorithm(controller)
 {
+	declarePrepare({}, { tags::saturationStatus });
+	declareProcess({}, {});
 }
 
 char const *Saturation::name() const
@@ -46,7 +48,7 @@ void Saturation::prepare(Metadata *imageMetadata)
 	saturation.shiftR = config_.shiftR;
 	saturation.shiftG = config_.shiftG;
 	saturation.shiftB = config_.shiftB;
-	imageMetadata->set("saturation.status", saturation);
+	imageMetadata->set(tags::saturationStatus, saturation);
 }
 
 // Register algorithm with the system.
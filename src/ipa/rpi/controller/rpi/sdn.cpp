@@ -28,6 +28,8 @@ LOG_DEFINE_CATEGORY(RPiSdn)
 Sdn::Sdn(Controller *controller)
 	: DenoiseAlgorithm(controller), mode_(DenoiseMode::ColourOff)
 {
+	declarePrepare({ tags::noiseStatus }, { tags::denoiseStatus });
+	declareProcess({}, {});
 }
 
 char const *Sdn::name() const
@@ -52,7 +54,7 @@ void Sdn::prepare(Metadata *imageMetadata)
 {
 	struct NoiseStatus noiseStatus = {};
 	noiseStatus.noiseSlope = 3.0; /* in case no metadata */
-	if (imageMetadata->get("noise.status", noiseStatus) != 0)
+	if (imageMetadata->get(tags::noiseStatus, noiseStatus) != 0)
 		LOG(RPiSdn, Warning) << "no noise profile found";
 	LOG(RPiSdn, Debug)
 		<< "Noise profile: constant " << noiseStatus.noiseConstant
@@ -62,7 +64,7 @@ void Sdn::prepare(Metadata *imageMetadata)
 	status.noiseSlope = noiseStatus.noiseSlope * deviation_;
 	status.strength = strength_;
 	status.mode = utils::to_underlying(mode_);
-	imageMetadata->set("denoise.status", status);
+	imageMetadata->set(tags::denoiseStatus, status);
 	LOG(RPiSdn, Debug)
 		<< "programmed constant " << status.noiseConstant
 		<< " slope " << status.noiseSlope
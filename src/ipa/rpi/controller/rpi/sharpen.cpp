@@ -23,6 +23,8 @@ LOG_DEFINE_CATEGORY(RPiSharpen)
 Sharpen::Sharpen(Controller *controller)
 	: SharpenAlgorithm(controller), userStrength_(1.0)
 {
+	declarePrepare({}, { tags::sharpenStatus });
+	declareProcess({}, {});
 }
 
 char const *Sharpen::name() const
@@ -81,7 +83,7 @@ void Sharpen::prepare(Metadata *imageMetadata)
 	status.limit = limit_ / modeFactor_ * userStrengthSqrt;
 	/* Finally, report any application-supplied parameters that were used. */
 	status.userStrength = userStrength_;
-	imageMetadata->set("sharpen.status", status);
+	imageMetadata->set(tags::sharpenStatus, status);
 }
 
 /* Register algorithm with the system. */
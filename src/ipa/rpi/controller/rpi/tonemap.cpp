@@ -20,6 +20,8 @@ LOG_DEFINE_CATEGORY(RPiTonemap)
 Tonemap::Tonemap(Controller *controller)
 	: Algorithm(controller)
 {
+	declarePrepare({}, { tags::tonemapStatus });
+	declareProcess({}, {});
 }
 
 char const *Tonemap::name() const
@@ -50,7 +52,7 @@ void Tonemap::prepare(Metadata *imageMetadata)
 	tonemapStatus.iirStrength = config_.iirStrength;
 	tonemapStatus.strength = config_.strength;
 	tonemapStatus.tonemap = config_.tonemap;
-	imageMetadata->set("tonemap.status", tonemapStatus);
+	imageMetadata->set(tags::tonemapStatus, tonemapStatus);
 }
 
 // Register algorithm with the system.
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2024, Raspberry Pi Ltd
+ *
+ * shared pool of threads for asynchronous algorithm work
+ */
+
+#include "task_pool.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include <libcamera/base/thread.h>
+
+using namespace RPiController;
+
+/*
+ * Two threads let the AWB and ALSC calculations of a camera run at the same
+ * time, as they would with dedicated threads, while many cameras don't
+ * multiply the number of threads.
+ */
+static constexpr unsigned int DefaultNumThreads = 2;
+
+/*
+ * The workers are libcamera threads named RPiAsync<n>, which allows pinning
+ * them to CPUs and setting their scheduling policy with the
+ * LIBCAMERA_THREAD_AFFINITY and LIBCAMERA_THREAD_SCHEDULING environment
+ * variables.
+ */
+class TaskPool::Worker : public libcamera::Thread
+{
+public:
+	Worker(TaskPool *pool, unsigned int index)
+		: Thread("RPiAsync" + std::to_string(index)), pool_(pool)
+	{
+		/* Asynchronous algorithms lag the frames by design. */
+		setRole(Role::Housekeeping);
+	}
+
+protected:
+	void run() override
+	{
+		pool_->run();
+	}
+
+private:
+	TaskPool *pool_;
+};
+
+AsyncTask::AsyncTask(std::function<void()> func)
+	: AsyncTask(std::move(func), TaskPool::instance())
+{
+}
+
+AsyncTask::AsyncTask(std::function<void()> func, TaskPool &pool)
+	: pool_(pool), func_(std::move(func)), state_(State::Idle)
+{
+}
+
+AsyncTask::~AsyncTask()
+{
+	cancel();
+}
+
+/* Queue a run of the task, which must not be queued or running already. */
+void AsyncTask::start()
+{
+	pool_.submit(this);
+}
+
+/*
+ * Check if the last run of the task has completed. The results written by the
+ * task may be used once this returns true.
+ */
+bool AsyncTask::finished() const
+{
+	return pool_.finished(this);
+}
+
+/*
+ * Drop the run of the task if it hasn't started yet, or wait for it to
+ * complete otherwise. Its results must be ignored in either case.
+ */
+void AsyncTask::cancel()
+{
+	pool_.cancel(this);
+}
+
+TaskPool::TaskPool(unsigned int numThreads)
+	: abort_(false)
+{
+	for (unsigned int i = 0; i < numThreads; i++) {
+		workers_.push_back(std::make_unique<Worker>(this, i));
+		workers_.back()->start();
+	}
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		abort_ = true;
+	}
+	workSignal_.notify_all();
+
+	for (auto &worker : workers_)
+		worker->wait();
+}
+
+/* The pool shared by all the algorithms of the process. */
+TaskPool &TaskPool::instance()
+{
+	static TaskPool pool(std::clamp(std::thread::hardware_concurrency(),
+					1U, DefaultNumThreads));
+	return pool;
+}
+
+void TaskPool::submit(AsyncTask *task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		task->state_ = AsyncTask::State::Queued;
+		queue_.push_back(task);
+	}
+	workSignal_.notify_one();
+}
+
+bool TaskPool::finished(const AsyncTask *task)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return task->state_ == AsyncTask::State::Finished;
+}
+
+void TaskPool::cancel(AsyncTask *task)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	if (task->state_ == AsyncTask::State::Queued)
+		queue_.erase(std::find(queue_.begin(), queue_.end(), task));
+
+	doneSignal_.wait(lock, [&] {
+		return task->state_ != AsyncTask::State::Running;
+	});
+
+	task->state_ = AsyncTask::State::Idle;
+}
+
+void TaskPool::run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (true) {
+		workSignal_.wait(lock, [&] {
+			return abort_ || !queue_.empty();
+		});
+		if (abort_)
+			break;
+
+		AsyncTask *task = queue_.front();
+		queue_.pop_front();
+		task->state_ = AsyncTask::State::Running;
+
+		lock.unlock();
+		task->func_();
+		lock.lock();
+
+		task->state_ = AsyncTask::State::Finished;
+		doneSignal_.notify_all();
+	}
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2024, Raspberry Pi Ltd
+ *
+ * shared pool of threads for asynchronous algorithm work
+ */
+#pragma once
+
+/*
+ * Algorithms that run lengthy calculations in the background, such as AWB and
+ * ALSC, submit them to a TaskPool shared by all the camera instances of the
+ * process instead of each owning a thread that is idle most of the time.
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace RPiController {
+
+class TaskPool;
+
+/*
+ * A piece of asynchronous work that an algorithm runs repeatedly. Each call
+ * to start() queues one run of the work on the pool, and the task must have
+ * finished or been cancelled before it can be started again.
+ */
+class AsyncTask
+{
+public:
+	AsyncTask(std::function<void()> func);
+	AsyncTask(std::function<void()> func, TaskPool &pool);
+	~AsyncTask();
+
+	void start();
+	bool finished() const;
+	void cancel();
+
+private:
+	friend class TaskPool;
+
+	enum class State {
+		Idle,
+		Queued,
+		Running,
+		Finished,
+	};
+
+	TaskPool &pool_;
+	std::function<void()> func_;
+	/* Protected by the mutex of the pool. */
+	State state_;
+};
+
+class TaskPool
+{
+public:
+	TaskPool(unsigned int numThreads);
+	~TaskPool();
+
+	static TaskPool &instance();
+
+private:
+	friend class AsyncTask;
+
+	class Worker;
+
+	void submit(AsyncTask *task);
+	bool finished(const AsyncTask *task);
+	void cancel(AsyncTask *task);
+	void run();
+
+	mutable std::mutex mutex_;
+	/* condvar for the workers to wait on */
+	std::condition_variable workSignal_;
+	/* condvar for cancel() to wait on for a running task */
+	std::condition_variable doneSignal_;
+	std::deque<AsyncTask *> queue_;
+	bool abort_;
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+} /* namespace RPiController */
@@ -340,8 +340,8 @@ void IpaPiSP::platformPrepareIsp([[maybe_unused]] const PrepareParams &params,
 	global.rgb_enables &= ~(PISP_BE_RGB_ENABLE_GAMMA + PISP_BE_RGB_ENABLE_CCM +
 				PISP_BE_RGB_ENABLE_SHARPEN + PISP_BE_RGB_ENABLE_SAT_CONTROL);
 
-	NoiseStatus *noiseStatus = rpiMetadata.getLocked<NoiseStatus>("noise.status");
-	AgcPrepareStatus *agcPrepareStatus = rpiMetadata.getLocked<AgcPrepareStatus>("agc.prepare_status");
+	NoiseStatus *noiseStatus = rpiMetadata.getLocked<NoiseStatus>(tags::noiseStatus);
+	AgcPrepareStatus *agcPrepareStatus = rpiMetadata.getLocked<AgcPrepareStatus>(tags::agcPrepareStatus);
 
 	{
 		/* All Frontend config goes first, we do not want to hold the FE lock for long! */
@@ -351,11 +351,11 @@ void IpaPiSP::platformPrepareIsp([[maybe_unused]] const PrepareParams &params,
 			applyFocusStats(noiseStatus);
 
 		BlackLevelStatus *blackLevelStatus =
-			rpiMetadata.getLocked<BlackLevelStatus>("black_level.status");
+			rpiMetadata.getLocked<BlackLevelStatus>(tags::blackLevelStatus);
 		if (blackLevelStatus)
 			applyBlackLevel(blackLevelStatus, global);
 
-		AwbStatus *awbStatus = rpiMetadata.getLocked<AwbStatus>("awb.status");
+		AwbStatus *awbStatus = rpiMetadata.getLocked<AwbStatus>(tags::awbStatus);
 		if (awbStatus && agcPrepareStatus) {
 			/* Applies digital gain as well. */
 			applyWBG(awbStatus, agcPrepareStatus, global);
@@ -365,66 +365,66 @@ void IpaPiSP::platformPrepareIsp([[maybe_unused]] const PrepareParams &params,
 		}
 	}
 
-	CacStatus *cacStatus = rpiMetadata.getLocked<CacStatus>("cac.status");
+	CacStatus *cacStatus = rpiMetadata.getLocked<CacStatus>(tags::cacStatus);
 	if (cacStatus)
 		applyCAC(cacStatus, global);
 
 	ContrastStatus *contrastStatus =
-		rpiMetadata.getLocked<ContrastStatus>("contrast.status");
+		rpiMetadata.getLocked<ContrastStatus>(tags::contrastStatus);
 	if (contrastStatus)
 		applyContrast(contrastStatus, global);
 
-	CcmStatus *ccmStatus = rpiMetadata.getLocked<CcmStatus>("ccm.status");
+	CcmStatus *ccmStatus = rpiMetadata.getLocked<CcmStatus>(tags::ccmStatus);
 	if (ccmStatus)
 		applyCCM(ccmStatus, global);
 
-	AlscStatus *alscStatus = rpiMetadata.getLocked<AlscStatus>("alsc.status");
+	AlscStatus *alscStatus = rpiMetadata.getLocked<AlscStatus>(tags::alscStatus);
 	if (alscStatus)
 		applyLensShading(alscStatus, global);
 
-	DpcStatus *dpcStatus = rpiMetadata.getLocked<DpcStatus>("dpc.status");
+	DpcStatus *dpcStatus = rpiMetadata.getLocked<DpcStatus>(tags::dpcStatus);
 	if (dpcStatus)
 		applyDPC(dpcStatus, global);
 
-	SdnStatus *sdnStatus = rpiMetadata.getLocked<SdnStatus>("sdn.status");
+	SdnStatus *sdnStatus = rpiMetadata.getLocked<SdnStatus>(tags::sdnStatus);
 	if (sdnStatus)
 		applySdn(sdnStatus, global);
 
-	DeviceStatus *deviceStatus = rpiMetadata.getLocked<DeviceStatus>("device.status");
-	TdnStatus *tdnStatus = rpiMetadata.getLocked<TdnStatus>("tdn.status");
+	DeviceStatus *deviceStatus = rpiMetadata.getLocked<DeviceStatus>(tags::deviceStatus);
+	TdnStatus *tdnStatus = rpiMetadata.getLocked<TdnStatus>(tags::tdnStatus);
 	if (tdnStatus && deviceStatus)
 		applyTdn(tdnStatus, deviceStatus, global);
 
-	CdnStatus *cdnStatus = rpiMetadata.getLocked<CdnStatus>("cdn.status");
+	CdnStatus *cdnStatus = rpiMetadata.getLocked<CdnStatus>(tags::cdnStatus);
 	if (cdnStatus)
 		applyCdn(cdnStatus, global);
 
-	GeqStatus *geqStatus = rpiMetadata.getLocked<GeqStatus>("geq.status");
+	GeqStatus *geqStatus = rpiMetadata.getLocked<GeqStatus>(tags::geqStatus);
 	if (geqStatus)
 		applyGeq(geqStatus, global);
 
 	SaturationStatus *saturationStatus =
-		rpiMetadata.getLocked<SaturationStatus>("saturation.status");
+		rpiMetadata.getLocked<SaturationStatus>(tags::saturationStatus);
 	if (saturationStatus)
 		applySaturation(saturationStatus, global);
 
-	SharpenStatus *sharpenStatus = rpiMetadata.getLocked<SharpenStatus>("sharpen.status");
+	SharpenStatus *sharpenStatus = rpiMetadata.getLocked<SharpenStatus>(tags::sharpenStatus);
 	if (sharpenStatus)
 		applySharpen(sharpenStatus, global);
 
-	StitchStatus *stitchStatus = rpiMetadata.getLocked<StitchStatus>("stitch.status");
+	StitchStatus *stitchStatus = rpiMetadata.getLocked<StitchStatus>(tags::stitchStatus);
 	if (stitchStatus) {
 		/*
 		 * Note that it's the *delayed* AGC status that contains the HDR mode/channel
 		 * info that pertains to this frame!
 		 */
-		AgcStatus *agcStatus = rpiMetadata.getLocked<AgcStatus>("agc.delayed_status");
+		AgcStatus *agcStatus = rpiMetadata.getLocked<AgcStatus>(tags::agcDelayedStatus);
 		/* prepareIsp() will fetch this value. Maybe pass it back differently? */
 		stitchSwapBuffers_ = applyStitch(stitchStatus, deviceStatus, agcStatus, global);
 	} else
 		lastStitchHdrStatus_ = HdrStatus();
 
-	TonemapStatus *tonemapStatus = rpiMetadata.getLocked<TonemapStatus>("tonemap.status");
+	TonemapStatus *tonemapStatus = rpiMetadata.getLocked<TonemapStatus>(tags::tonemapStatus);
 	if (tonemapStatus)
 		applyTonemap(tonemapStatus, global);
 
@@ -434,7 +434,7 @@ void IpaPiSP::platformPrepareIsp([[maybe_unused]] const PrepareParams &params,
 	lastExposure_ = deviceStatus->shutterSpeed * deviceStatus->analogueGain;
 
 	/* Lens control */
-	const AfStatus *afStatus = rpiMetadata.getLocked<AfStatus>("af.status");
+	const AfStatus *afStatus = rpiMetadata.getLocked<AfStatus>(tags::afStatus);
 	if (afStatus) {
 		ControlList lensctrls(lensCtrls_);
 		applyAF(afStatus, lensctrls);
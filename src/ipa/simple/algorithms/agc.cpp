@@ -7,6 +7,7 @@
 
 #include "agc.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <libcamera/base/log.h>
@@ -36,9 +37,34 @@ static constexpr float kExposureOptimal = kExposureBinsCount / 2.0;
 static constexpr float kExposureSatisfactory = 0.2;
 
 Agc::Agc()
+	: lastExposure_(0), lastAgain_(0.0)
 {
 }
 
+int Agc::configure(IPAContext &context,
+		   [[maybe_unused]] const IPAConfigInfo &configInfo)
+{
+	/*
+	 * Start from the exposure and gain the previous streaming session
+	 * ended with, if any, to avoid converging again on repeated captures.
+	 */
+	if (!lastExposure_)
+		return 0;
+
+	context.activeState.agc.exposure =
+		std::clamp(lastExposure_, context.configuration.agc.exposureMin,
+			   context.configuration.agc.exposureMax);
+	context.activeState.agc.again =
+		std::clamp(lastAgain_, context.configuration.agc.againMin,
+			   context.configuration.agc.againMax);
+
+	LOG(IPASoftExposure, Debug)
+		<< "Restored exp " << context.activeState.agc.exposure
+		<< " again " << context.activeState.agc.again;
+
+	return 0;
+}
+
 void Agc::updateExposure(IPAContext &context, double exposureMSV)
 {
 	/*
@@ -90,6 +116,9 @@ void Agc::updateExposure(IPAContext &context, double exposureMSV)
 	again = std::clamp(again, context.configuration.agc.againMin,
 			   context.configuration.agc.againMax);
 
+	lastExposure_ = exposure;
+	lastAgain_ = again;
+
 	LOG(IPASoftExposure, Debug)
 		<< "exposureMSV " << exposureMSV
 		<< " exp " << exposure << " again " << again;
@@ -19,6 +19,8 @@ public:
 	Agc();
 	~Agc() = default;
 
+	int configure(IPAContext &context, const IPAConfigInfo &configInfo) override;
+
 	void process(IPAContext &context, const uint32_t frame,
 		     IPAFrameContext &frameContext,
 		     const SwIspStats *stats,
@@ -26,6 +28,10 @@ public:
 
 private:
 	void updateExposure(IPAContext &context, double exposureMSV);
+
+	/* Values of the last processed frame, kept across sessions */
+	int32_t lastExposure_;
+	double lastAgain_;
 };
 
 } /* namespace ipa::soft::algorithms */
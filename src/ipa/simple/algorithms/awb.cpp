@@ -7,6 +7,8 @@
 
 #include "awb.h"
 
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <stdint.h>
 
@@ -20,15 +22,55 @@ LOG_DEFINE_CATEGORY(IPASoftAwb)
 
 namespace ipa::soft::algorithms {
 
+/* Used until the colour temperature is first estimated */
+static constexpr unsigned int kDefaultTemperature = 5000;
+
+Awb::Awb()
+	: lastRedGain_(0.0), lastBlueGain_(0.0)
+{
+}
+
 int Awb::configure(IPAContext &context,
 		   [[maybe_unused]] const IPAConfigInfo &configInfo)
 {
 	auto &gains = context.activeState.gains;
 	gains.red = gains.green = gains.blue = 1.0;
+	context.activeState.awb.temperatureK = kDefaultTemperature;
+
+	/*
+	 * Start from the gains the previous streaming session ended with, if
+	 * any, to avoid converging again on repeated captures.
+	 */
+	if (lastRedGain_ && lastBlueGain_) {
+		gains.red = lastRedGain_;
+		gains.blue = lastBlueGain_;
+	}
 
 	return 0;
 }
 
+unsigned int Awb::estimateCCT(double red, double green, double blue)
+{
+	/* Convert the RGB values to CIE tristimulus values (XYZ) */
+	double X = (-0.14282) * (red) + (1.54924) * (green) + (-0.95641) * (blue);
+	double Y = (-0.32466) * (red) + (1.57837) * (green) + (-0.73191) * (blue);
+	double Z = (-0.68202) * (red) + (0.77073) * (green) + (0.56332) * (blue);
+
+	/* Calculate the normalized chromaticity values */
+	double x = X / (X + Y + Z);
+	double y = Y / (X + Y + Z);
+
+	/* Calculate CCT */
+	double n = (x - 0.3320) / (0.1858 - y);
+	double cct = 449 * n * n * n + 3525 * n * n + 6823.3 * n + 5520.33;
+
+	/* Keep the estimate within a plausible range */
+	if (!std::isfinite(cct))
+		return kDefaultTemperature;
+
+	return std::clamp(cct, 1000.0, 20000.0);
+}
+
 void Awb::process(IPAContext &context,
 		  [[maybe_unused]] const uint32_t frame,
 		  [[maybe_unused]] IPAFrameContext &frameContext,
@@ -59,7 +101,17 @@ void Awb::process(IPAContext &context,
 	gains.blue = sumB <= sumG / 4 ? 4.0 : static_cast<double>(sumG) / sumB;
 	/* Green gain is fixed to 1.0 */
 
-	LOG(IPASoftAwb, Debug) << "gain R/B " << gains.red << "/" << gains.blue;
+	lastRedGain_ = gains.red;
+	lastBlueGain_ = gains.blue;
+
+	/* The colour temperature is only used by the CCM algorithm. */
+	if (sumR && sumG && sumB)
+		context.activeState.awb.temperatureK =
+			estimateCCT(sumR, sumG / 2.0, sumB);
+
+	LOG(IPASoftAwb, Debug)
+		<< "gain R/B " << gains.red << "/" << gains.blue
+		<< ", temperature " << context.activeState.awb.temperatureK << "K";
 }
 
 REGISTER_IPA_ALGORITHM(Awb, "Awb")
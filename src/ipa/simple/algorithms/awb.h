@@ -16,7 +16,7 @@ namespace ipa::soft::algorithms {
 class Awb : public Algorithm
 {
 public:
-	Awb() = default;
+	Awb();
 	~Awb() = default;
 
 	int configure(IPAContext &context, const IPAConfigInfo &configInfo) override;
@@ -25,6 +25,13 @@ public:
 		     IPAFrameContext &frameContext,
 		     const SwIspStats *stats,
 		     ControlList &metadata) override;
+
+private:
+	unsigned int estimateCCT(double red, double green, double blue);
+
+	/* Gains of the last processed frame, kept across sessions */
+	double lastRedGain_;
+	double lastBlueGain_;
 };
 
 } /* namespace ipa::soft::algorithms */
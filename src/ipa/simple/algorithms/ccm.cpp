@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Colour correction matrix
+ */
+
+#include "ccm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
+
+#include "libcamera/internal/yaml_parser.h"
+
+#include "simple/ipa_context.h"
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(IPASoftCcm)
+
+namespace ipa::soft::algorithms {
+
+/*
+ * The matrix is only recomputed when the colour temperature changes by more
+ * than this value, as the estimate fluctuates from frame to frame.
+ */
+static constexpr unsigned int kTemperatureThreshold = 100;
+
+int Ccm::init([[maybe_unused]] IPAContext &context, const YamlObject &tuningData)
+{
+	int ret = ccm_.readYaml(tuningData["ccms"], "ct", "ccm");
+	if (ret < 0) {
+		LOG(IPASoftCcm, Error)
+			<< "Failed to parse 'ccm' parameter from tuning file";
+		return ret;
+	}
+
+	return 0;
+}
+
+int Ccm::configure(IPAContext &context,
+		   [[maybe_unused]] const IPAConfigInfo &configInfo)
+{
+	/* The Lut algorithm produces linear tables when the CCM is applied. */
+	context.configuration.ccm.enabled = true;
+	ct_ = 0;
+
+	return 0;
+}
+
+void Ccm::updateMatrix(IPAContext &context, unsigned int ct)
+{
+	constexpr float kScale = 1 << DebayerParams::kCcmShift;
+	const Matrix<float, 3, 3> &ccm = ccm_.getInterpolated(ct);
+
+	for (unsigned int i = 0; i < 3; i++) {
+		for (unsigned int j = 0; j < 3; j++) {
+			long value = std::lround(ccm[i][j] * kScale);
+			matrix_[i * 3 + j] = std::clamp<long>(value,
+							      std::numeric_limits<int16_t>::min(),
+							      std::numeric_limits<int16_t>::max());
+		}
+	}
+
+	context.activeState.ccm.ccm = ccm;
+	ct_ = ct;
+
+	LOG(IPASoftCcm, Debug) << "Setting matrix for " << ct << "K: " << ccm;
+}
+
+void Ccm::prepare(IPAContext &context,
+		  [[maybe_unused]] const uint32_t frame,
+		  [[maybe_unused]] IPAFrameContext &frameContext,
+		  DebayerParams *params)
+{
+	const unsigned int ct = context.activeState.awb.temperatureK;
+
+	if (!ct_ || utils::abs_diff(ct, ct_) > kTemperatureThreshold)
+		updateMatrix(context, ct);
+
+	/* The parameters buffers are used in turn, fill them every frame. */
+	params->ccmEnabled = true;
+	params->ccm = matrix_;
+}
+
+REGISTER_IPA_ALGORITHM(Ccm, "Ccm")
+
+} /* namespace ipa::soft::algorithms */
+
+} /* namespace libcamera */
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Colour correction matrix
+ */
+
+#pragma once
+
+#include <array>
+#include <stdint.h>
+
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "libipa/interpolator.h"
+#include "libipa/matrix.h"
+
+#include "algorithm.h"
+
+namespace libcamera {
+
+namespace ipa::soft::algorithms {
+
+class Ccm : public Algorithm
+{
+public:
+	Ccm() = default;
+	~Ccm() = default;
+
+	int init(IPAContext &context, const YamlObject &tuningData) override;
+	int configure(IPAContext &context, const IPAConfigInfo &configInfo) override;
+	void prepare(IPAContext &context,
+		     const uint32_t frame,
+		     IPAFrameContext &frameContext,
+		     DebayerParams *params) override;
+
+private:
+	void updateMatrix(IPAContext &context, unsigned int ct);
+
+	Interpolator<Matrix<float, 3, 3>> ccm_;
+	/* Colour temperature the matrix has been computed for, 0 if none */
+	unsigned int ct_ = 0;
+	std::array<int16_t, 9> matrix_;
+};
+
+} /* namespace ipa::soft::algorithms */
+
+} /* namespace libcamera */
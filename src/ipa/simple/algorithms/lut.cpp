@@ -19,12 +19,20 @@ namespace libcamera {
 
 namespace ipa::soft::algorithms {
 
+/*
+ * The lookup tables are only recomputed when a gain changes by more than this
+ * value. Smaller changes move the gamma table entries the tables are made of
+ * by less than one entry.
+ */
+static constexpr double kGainTolerance = 1.0 / IPAActiveState::kGammaLookupSize;
+
 int Lut::configure(IPAContext &context,
 		   [[maybe_unused]] const IPAConfigInfo &configInfo)
 {
 	/* Gamma value is fixed */
 	context.configuration.gamma = 0.5;
 	updateGammaTable(context);
+	valid_ = false;
 
 	return 0;
 }
@@ -42,12 +50,23 @@ void Lut::updateGammaTable(IPAContext &context)
 						     context.configuration.gamma);
 
 	context.activeState.gamma.blackLevel = blackLevel;
+
+	/*
+	 * When colour correction is enabled the black level is subtracted by
+	 * the linear tables, and the gamma table is indexed by colour corrected
+	 * values with two more bits of precision. The algorithms may be
+	 * configured in any order, compute the table unconditionally.
+	 */
+	const double ccmDivisor = (DebayerParams::kRGBLookupSize - 1) * 4.0;
+	for (unsigned int i = 0; i < gamma_.size(); i++)
+		gamma_[i] = UINT8_MAX * std::pow(std::min(i / ccmDivisor, 1.0),
+						 context.configuration.gamma);
 }
 
 void Lut::prepare(IPAContext &context,
 		  [[maybe_unused]] const uint32_t frame,
 		  [[maybe_unused]] IPAFrameContext &frameContext,
-		  [[maybe_unused]] DebayerParams *params)
+		  DebayerParams *params)
 {
 	/*
 	 * Update the gamma table if needed. This means if black level changes
@@ -55,9 +74,43 @@ void Lut::prepare(IPAContext &context,
 	 * observed, it's not permanently prone to minor fluctuations or
 	 * rounding errors.
 	 */
-	if (context.activeState.gamma.blackLevel != context.activeState.blc.level)
+	if (context.activeState.gamma.blackLevel != context.activeState.blc.level) {
 		updateGammaTable(context);
+		valid_ = false;
+	}
+
+	if (!valid_ || gainsChanged(context)) {
+		if (context.configuration.ccm.enabled)
+			updateLinearLuts(context);
+		else
+			updateLuts(context);
+	}
 
+	/*
+	 * The parameters buffers are used in turn, only copy the tables to the
+	 * ones that hold an older version.
+	 */
+	if (params->lutVersion != version_) {
+		params->red = red_;
+		params->green = green_;
+		params->blue = blue_;
+		if (context.configuration.ccm.enabled)
+			params->gamma = gamma_;
+		params->lutVersion = version_;
+	}
+}
+
+bool Lut::gainsChanged(const IPAContext &context) const
+{
+	const auto &gains = context.activeState.gains;
+
+	return std::abs(gains.red - gainRed_) > kGainTolerance ||
+	       std::abs(gains.green - gainGreen_) > kGainTolerance ||
+	       std::abs(gains.blue - gainBlue_) > kGainTolerance;
+}
+
+void Lut::updateLuts(IPAContext &context)
+{
 	auto &gains = context.activeState.gains;
 	auto &gammaTable = context.activeState.gamma.gammaTable;
 	const unsigned int gammaTableSize = gammaTable.size();
@@ -69,14 +122,52 @@ void Lut::prepare(IPAContext &context,
 		unsigned int idx;
 		idx = std::min({ static_cast<unsigned int>(i * gains.red / div),
 				 gammaTableSize - 1 });
-		params->red[i] = gammaTable[idx];
+		red_[i] = gammaTable[idx];
 		idx = std::min({ static_cast<unsigned int>(i * gains.green / div),
 				 gammaTableSize - 1 });
-		params->green[i] = gammaTable[idx];
+		green_[i] = gammaTable[idx];
 		idx = std::min({ static_cast<unsigned int>(i * gains.blue / div),
 				 gammaTableSize - 1 });
-		params->blue[i] = gammaTable[idx];
+		blue_[i] = gammaTable[idx];
+	}
+
+	gainRed_ = gains.red;
+	gainGreen_ = gains.green;
+	gainBlue_ = gains.blue;
+
+	/* Version 0 marks buffers that have never been filled. */
+	if (++version_ == 0)
+		version_ = 1;
+	valid_ = true;
+}
+
+/*
+ * Compute the tables mapping the debayered values to linear values, with the
+ * black level subtracted and the white balance gains applied, for the colour
+ * correction matrix. The gamma is applied after the matrix.
+ */
+void Lut::updateLinearLuts(IPAContext &context)
+{
+	auto &gains = context.activeState.gains;
+	const unsigned int blackLevel = context.activeState.blc.level;
+	const double scale = static_cast<double>(UINT8_MAX) /
+			     std::max(UINT8_MAX - blackLevel, 1U);
+
+	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
+		const double value = (i > blackLevel ? i - blackLevel : 0) * scale;
+
+		red_[i] = std::min(std::lround(value * gains.red), 255L);
+		green_[i] = std::min(std::lround(value * gains.green), 255L);
+		blue_[i] = std::min(std::lround(value * gains.blue), 255L);
 	}
+
+	gainRed_ = gains.red;
+	gainGreen_ = gains.green;
+	gainBlue_ = gains.blue;
+
+	if (++version_ == 0)
+		version_ = 1;
+	valid_ = true;
 }
 
 REGISTER_IPA_ALGORITHM(Lut, "Lut")
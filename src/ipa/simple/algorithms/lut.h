@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#include "libcamera/internal/software_isp/debayer_params.h"
+
 #include "algorithm.h"
 
 namespace libcamera {
@@ -27,6 +31,22 @@ public:
 
 private:
 	void updateGammaTable(IPAContext &context);
+	bool gainsChanged(const IPAContext &context) const;
+	void updateLuts(IPAContext &context);
+	void updateLinearLuts(IPAContext &context);
+
+	DebayerParams::ColorLookupTable red_;
+	DebayerParams::ColorLookupTable green_;
+	DebayerParams::ColorLookupTable blue_;
+	/* Applied after the colour correction matrix, if enabled */
+	DebayerParams::GammaLookupTable gamma_;
+	/* Version of the tables above, 0 until they are first computed */
+	uint32_t version_ = 0;
+	bool valid_ = false;
+	/* Gains the tables have been computed with */
+	double gainRed_;
+	double gainGreen_;
+	double gainBlue_;
 };
 
 } /* namespace ipa::soft::algorithms */
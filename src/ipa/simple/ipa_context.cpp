@@ -55,6 +55,15 @@ namespace libcamera::ipa::soft {
  * \brief Gamma value to be used in the raw image processing
  */
 
+/**
+ * \var IPASessionConfiguration::ccm
+ * \brief Colour correction configuration of the IPA
+ *
+ * \var IPASessionConfiguration::ccm.enabled
+ * \brief Indicates if the colour correction matrix is applied by the debayer
+ * pass, in which case the lookup tables are linear
+ */
+
 /**
  * \var IPAActiveState::black
  * \brief Context for the Black Level algorithm
@@ -77,6 +86,22 @@ namespace libcamera::ipa::soft {
  * \brief Gain of blue color
  */
 
+/**
+ * \var IPAActiveState::awb
+ * \brief Context for the AWB algorithm
+ *
+ * \var IPAActiveState::awb.temperatureK
+ * \brief Estimated colour temperature of the scene, in Kelvin
+ */
+
+/**
+ * \var IPAActiveState::ccm
+ * \brief Context for the colour correction matrix algorithm
+ *
+ * \var IPAActiveState::ccm.ccm
+ * \brief The colour correction matrix currently applied
+ */
+
 /**
  * \var IPAActiveState::agc
  * \brief Context for the AGC algorithm
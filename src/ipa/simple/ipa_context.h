@@ -12,6 +12,7 @@
 #include <stdint.h>
 
 #include <libipa/fc_queue.h>
+#include <libipa/matrix.h>
 
 namespace libcamera {
 
@@ -26,6 +27,9 @@ struct IPASessionConfiguration {
 	struct {
 		std::optional<uint8_t> level;
 	} black;
+	struct {
+		bool enabled;
+	} ccm;
 };
 
 struct IPAActiveState {
@@ -39,6 +43,14 @@ struct IPAActiveState {
 		double blue;
 	} gains;
 
+	struct {
+		unsigned int temperatureK;
+	} awb;
+
+	struct {
+		Matrix<float, 3, 3> ccm;
+	} ccm;
+
 	struct {
 		int32_t exposure;
 		double again;
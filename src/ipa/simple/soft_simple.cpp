@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <sys/mman.h>
+#include <vector>
 
 #include <linux/v4l2-controls.h>
 
@@ -48,8 +49,8 @@ public:
 	~IPASoftSimple();
 
 	int init(const IPASettings &settings,
-		 const SharedFD &fdStats,
-		 const SharedFD &fdParams,
+		 const std::vector<SharedFD> &fdStats,
+		 const std::vector<SharedFD> &fdParams,
 		 const ControlInfoMap &sensorInfoMap) override;
 	int configure(const IPAConfigInfo &configInfo) override;
 
@@ -57,7 +58,7 @@ public:
 	void stop() override;
 
 	void queueRequest(const uint32_t frame, const ControlList &controls) override;
-	void fillParamsBuffer(const uint32_t frame) override;
+	void fillParamsBuffer(const uint32_t frame, const uint32_t bufferId) override;
 	void processStats(const uint32_t frame, const uint32_t bufferId,
 			  const ControlList &sensorControls) override;
 
@@ -67,8 +68,8 @@ protected:
 private:
 	void updateExposure(double exposureMSV);
 
-	DebayerParams *params_;
-	SwIspStats *stats_;
+	std::vector<DebayerParams *> params_;
+	std::vector<SwIspStats *> stats_;
 	std::unique_ptr<CameraSensorHelper> camHelper_;
 	ControlInfoMap sensorInfoMap_;
 
@@ -78,15 +79,15 @@ private:
 
 IPASoftSimple::~IPASoftSimple()
 {
-	if (stats_)
-		munmap(stats_, sizeof(SwIspStats));
-	if (params_)
-		munmap(params_, sizeof(DebayerParams));
+	for (SwIspStats *stats : stats_)
+		munmap(stats, sizeof(SwIspStats));
+	for (DebayerParams *params : params_)
+		munmap(params, sizeof(DebayerParams));
 }
 
 int IPASoftSimple::init(const IPASettings &settings,
-			const SharedFD &fdStats,
-			const SharedFD &fdParams,
+			const std::vector<SharedFD> &fdStats,
+			const std::vector<SharedFD> &fdParams,
 			const ControlInfoMap &sensorInfoMap)
 {
 	camHelper_ = CameraSensorHelperFactoryBase::create(settings.sensorModel);
@@ -123,39 +124,50 @@ int IPASoftSimple::init(const IPASettings &settings,
 	if (ret)
 		return ret;
 
-	params_ = nullptr;
-	stats_ = nullptr;
-
-	if (!fdStats.isValid()) {
-		LOG(IPASoft, Error) << "Invalid Statistics handle";
+	if (fdStats.empty()) {
+		LOG(IPASoft, Error) << "No Statistics handle";
 		return -ENODEV;
 	}
 
-	if (!fdParams.isValid()) {
-		LOG(IPASoft, Error) << "Invalid Parameters handle";
+	for (const SharedFD &fd : fdStats) {
+		if (!fd.isValid()) {
+			LOG(IPASoft, Error) << "Invalid Statistics handle";
+			return -ENODEV;
+		}
+	}
+
+	if (fdParams.empty()) {
+		LOG(IPASoft, Error) << "No Parameters handle";
 		return -ENODEV;
 	}
 
-	{
+	for (const SharedFD &fd : fdParams) {
+		if (!fd.isValid()) {
+			LOG(IPASoft, Error) << "Invalid Parameters handle";
+			return -ENODEV;
+		}
+	}
+
+	for (const SharedFD &fd : fdParams) {
 		void *mem = mmap(nullptr, sizeof(DebayerParams), PROT_WRITE,
-				 MAP_SHARED, fdParams.get(), 0);
+				 MAP_SHARED, fd.get(), 0);
 		if (mem == MAP_FAILED) {
 			LOG(IPASoft, Error) << "Unable to map Parameters";
 			return -errno;
 		}
 
-		params_ = static_cast<DebayerParams *>(mem);
+		params_.push_back(static_cast<DebayerParams *>(mem));
 	}
 
-	{
+	for (const SharedFD &fd : fdStats) {
 		void *mem = mmap(nullptr, sizeof(SwIspStats), PROT_READ,
-				 MAP_SHARED, fdStats.get(), 0);
+				 MAP_SHARED, fd.get(), 0);
 		if (mem == MAP_FAILED) {
 			LOG(IPASoft, Error) << "Unable to map Statistics";
 			return -errno;
 		}
 
-		stats_ = static_cast<SwIspStats *>(mem);
+		stats_.push_back(static_cast<SwIspStats *>(mem));
 	}
 
 	/*
@@ -200,6 +212,7 @@ int IPASoftSimple::configure(const IPAConfigInfo &configInfo)
 	int32_t againMax = gainInfo.max().get<int32_t>();
 
 	if (camHelper_) {
+		camHelper_->setGainCodeRange(againMin, againMax);
 		context_.configuration.agc.againMin = camHelper_->gain(againMin);
 		context_.configuration.agc.againMax = camHelper_->gain(againMax);
 		context_.configuration.agc.againMinStep =
@@ -268,22 +281,38 @@ void IPASoftSimple::queueRequest(const uint32_t frame, const ControlList &contro
 {
 	IPAFrameContext &frameContext = context_.frameContexts.alloc(frame);
 
-	for (auto const &algo : algorithms())
+	for (auto const &algo : algorithms()) {
+		AlgorithmTiming::Measurement m =
+			measure(algo.get(), AlgorithmTiming::Stage::QueueRequest);
 		algo->queueRequest(context_, frame, frameContext, controls);
+	}
 }
 
-void IPASoftSimple::fillParamsBuffer(const uint32_t frame)
+void IPASoftSimple::fillParamsBuffer(const uint32_t frame, const uint32_t bufferId)
 {
+	if (bufferId >= params_.size()) {
+		LOG(IPASoft, Error) << "Invalid parameters buffer " << bufferId;
+		return;
+	}
+
 	IPAFrameContext &frameContext = context_.frameContexts.get(frame);
-	for (auto const &algo : algorithms())
-		algo->prepare(context_, frame, frameContext, params_);
-	setIspParams.emit();
+	for (auto const &algo : algorithms()) {
+		AlgorithmTiming::Measurement m =
+			measure(algo.get(), AlgorithmTiming::Stage::Prepare);
+		algo->prepare(context_, frame, frameContext, params_[bufferId]);
+	}
+	setIspParams.emit(frame);
 }
 
 void IPASoftSimple::processStats(const uint32_t frame,
-				 [[maybe_unused]] const uint32_t bufferId,
+				 const uint32_t bufferId,
 				 const ControlList &sensorControls)
 {
+	if (bufferId >= stats_.size()) {
+		LOG(IPASoft, Error) << "Invalid statistics buffer " << bufferId;
+		return;
+	}
+
 	IPAFrameContext &frameContext = context_.frameContexts.get(frame);
 
 	frameContext.sensor.exposure =
@@ -298,8 +327,14 @@ void IPASoftSimple::processStats(const uint32_t frame,
 	 * \todo Implement proper metadata handling
 	 */
 	ControlList metadata(controls::controls);
-	for (auto const &algo : algorithms())
-		algo->process(context_, frame, frameContext, stats_, metadata);
+	for (auto const &algo : algorithms()) {
+		AlgorithmTiming::Measurement m =
+			measure(algo.get(), AlgorithmTiming::Stage::Process);
+		algo->process(context_, frame, frameContext, stats_[bufferId], metadata);
+	}
+
+	/* The statistics aren't needed anymore, hand the buffer back. */
+	releaseStatsBuffer.emit(bufferId);
 
 	/* Sanity check */
 	if (!sensorControls.contains(V4L2_CID_EXPOSURE) ||
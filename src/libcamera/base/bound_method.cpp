@@ -50,8 +50,35 @@ namespace libcamera {
  * blocks until the receiver signals the completion of the invocation.
  */
 
+/**
+ * \brief Resolve the connection type of the bound method for the current thread
+ *
+ * ConnectionTypeAuto is resolved to ConnectionTypeDirect if the receiver lives
+ * in the current thread, and to ConnectionTypeQueued otherwise.
+ * ConnectionTypeBlocking is resolved to ConnectionTypeDirect if the receiver
+ * lives in the current thread.
+ *
+ * \return The connection type to use for an invocation from the current thread
+ */
+ConnectionType BoundMethodBase::resolveConnectionType() const
+{
+	ConnectionType type = connectionType_;
+	if (type == ConnectionTypeAuto) {
+		if (Thread::current() == object_->thread())
+			type = ConnectionTypeDirect;
+		else
+			type = ConnectionTypeQueued;
+	} else if (type == ConnectionTypeBlocking) {
+		if (Thread::current() == object_->thread())
+			type = ConnectionTypeDirect;
+	}
+
+	return type;
+}
+
 /**
  * \brief Invoke the bound method with packed arguments
+ * \param[in] type The connection type, as returned by resolveConnectionType()
  * \param[in] pack Packed arguments
  * \param[in] deleteMethod True to delete \a this bound method instance when
  * method invocation completes
@@ -62,23 +89,16 @@ namespace libcamera {
  * the return value is stored at an undefined point of time and shall thus not
  * be used by the caller.
  *
+ * Direct invocations are usually performed by the caller without packing the
+ * arguments, to avoid allocating the pack.
+ *
  * \return True if the return value contained in the \a pack may be used by the
  * caller, false otherwise
  */
-bool BoundMethodBase::activatePack(std::shared_ptr<BoundMethodPackBase> pack,
+bool BoundMethodBase::activatePack(ConnectionType type,
+				   std::shared_ptr<BoundMethodPackBase> pack,
 				   bool deleteMethod)
 {
-	ConnectionType type = connectionType_;
-	if (type == ConnectionTypeAuto) {
-		if (Thread::current() == object_->thread())
-			type = ConnectionTypeDirect;
-		else
-			type = ConnectionTypeQueued;
-	} else if (type == ConnectionTypeBlocking) {
-		if (Thread::current() == object_->thread())
-			type = ConnectionTypeDirect;
-	}
-
 	switch (type) {
 	case ConnectionTypeDirect:
 	default:
@@ -107,4 +127,99 @@ bool BoundMethodBase::activatePack(std::shared_ptr<BoundMethodPackBase> pack,
 	}
 }
 
+namespace details {
+
+/*
+ * The BoundMethodPool recycles the small memory blocks of bound methods,
+ * argument packs and invocation messages through per-thread free lists, one
+ * per size class. Blocks are returned to the free list of the thread that
+ * frees them. As cross-thread invocations usually flow in both directions
+ * between pairs of threads, the free lists stay balanced, and their length is
+ * capped to bound the memory they hold.
+ */
+namespace {
+
+constexpr size_t kPoolGranularity = 16;
+constexpr size_t kPoolMaxBlockSize = 256;
+constexpr unsigned int kPoolSizeClasses = kPoolMaxBlockSize / kPoolGranularity;
+constexpr unsigned int kPoolMaxFreeBlocks = 64;
+
+struct PoolBlock {
+	PoolBlock *next;
+};
+
+struct PoolCache {
+	~PoolCache();
+
+	PoolBlock *freeBlocks[kPoolSizeClasses] = {};
+	unsigned int numFreeBlocks[kPoolSizeClasses] = {};
+};
+
+/*
+ * Blocks may be freed during thread exit after the cache has been destroyed.
+ * Track the cache lifetime with a trivially destructible flag to fall back to
+ * the global allocator in that case.
+ */
+thread_local bool poolCacheDestroyed = false;
+thread_local PoolCache poolCache;
+
+PoolCache::~PoolCache()
+{
+	for (PoolBlock *&block : freeBlocks) {
+		while (block) {
+			PoolBlock *next = block->next;
+			::operator delete(block);
+			block = next;
+		}
+	}
+
+	poolCacheDestroyed = true;
+}
+
+} /* namespace */
+
+void *BoundMethodPool::allocate(size_t size)
+{
+	if (!size || size > kPoolMaxBlockSize)
+		return ::operator new(size);
+
+	unsigned int index = (size - 1) / kPoolGranularity;
+
+	if (!poolCacheDestroyed) {
+		PoolBlock *block = poolCache.freeBlocks[index];
+		if (block) {
+			poolCache.freeBlocks[index] = block->next;
+			poolCache.numFreeBlocks[index]--;
+			return block;
+		}
+	}
+
+	/* Round the size up to the size class to make the block reusable. */
+	return ::operator new((index + 1) * kPoolGranularity);
+}
+
+void BoundMethodPool::deallocate(void *ptr, size_t size) noexcept
+{
+	if (!ptr)
+		return;
+
+	if (!size || size > kPoolMaxBlockSize || poolCacheDestroyed) {
+		::operator delete(ptr);
+		return;
+	}
+
+	unsigned int index = (size - 1) / kPoolGranularity;
+	if (poolCache.numFreeBlocks[index] >= kPoolMaxFreeBlocks) {
+		::operator delete(ptr);
+		return;
+	}
+
+	PoolBlock *block = static_cast<PoolBlock *>(ptr);
+	block->next = poolCache.freeBlocks[index];
+	poolCache.freeBlocks[index] = block;
+	poolCache.numFreeBlocks[index]++;
+}
+
+} /* namespace details */
+
 } /* namespace libcamera */
@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Epoll-based event dispatcher
+ */
+
+#include <libcamera/base/event_dispatcher_epoll.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+/**
+ * \file base/event_dispatcher_epoll.h
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Event)
+
+namespace {
+
+const char *notifierType(EventNotifier::Type type)
+{
+	if (type == EventNotifier::Read)
+		return "read";
+	if (type == EventNotifier::Write)
+		return "write";
+	if (type == EventNotifier::Exception)
+		return "exception";
+
+	return "";
+}
+
+} /* namespace */
+
+/**
+ * \class EventDispatcherEpoll
+ * \brief An epoll-based event dispatcher
+ *
+ * The EventDispatcherEpoll registers file descriptors with the kernel
+ * incrementally when event notifiers are enabled and disabled, and only
+ * processes the file descriptors that are ready after every wakeup. Its cost
+ * per event is thus independent of the number of event notifiers, unlike the
+ * EventDispatcherPoll that it replaces on Linux.
+ *
+ * Timers are implemented with a timerfd armed for the earliest timer deadline,
+ * to preserve the nanosecond resolution of the timeouts.
+ *
+ * Constructing the dispatcher may fail if the kernel doesn't support epoll.
+ * Callers shall check isValid() and fall back to EventDispatcherPoll in that
+ * case.
+ */
+
+EventDispatcherEpoll::EventDispatcherEpoll()
+	: processingEvents_(false)
+{
+	epollfd_ = UniqueFD(epoll_create1(EPOLL_CLOEXEC));
+	if (!epollfd_.isValid()) {
+		LOG(Event, Warning)
+			<< "Unable to create epoll instance: " << strerror(errno);
+		return;
+	}
+
+	eventfd_ = UniqueFD(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+	timerfd_ = UniqueFD(timerfd_create(CLOCK_MONOTONIC,
+					   TFD_CLOEXEC | TFD_NONBLOCK));
+	if (!eventfd_.isValid() || !timerfd_.isValid()) {
+		LOG(Event, Warning)
+			<< "Unable to create eventfd or timerfd: "
+			<< strerror(errno);
+		epollfd_.reset();
+		return;
+	}
+
+	for (int fd : { eventfd_.get(), timerfd_.get() }) {
+		struct epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+
+		if (epoll_ctl(epollfd_.get(), EPOLL_CTL_ADD, fd, &event) < 0) {
+			LOG(Event, Warning)
+				<< "Unable to register fd " << fd << ": "
+				<< strerror(errno);
+			epollfd_.reset();
+			return;
+		}
+	}
+}
+
+EventDispatcherEpoll::~EventDispatcherEpoll()
+{
+}
+
+/**
+ * \fn EventDispatcherEpoll::isValid()
+ * \brief Check if the event dispatcher has been successfully created
+ * \return True if the event dispatcher is usable, false otherwise
+ */
+
+void EventDispatcherEpoll::registerEventNotifier(EventNotifier *notifier)
+{
+	EventNotifierSetEpoll &set = notifiers_[notifier->fd()];
+	EventNotifier::Type type = notifier->type();
+
+	if (set.notifiers[type] && set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< "Ignoring duplicate " << notifierType(type)
+			<< " notifier for fd " << notifier->fd();
+		return;
+	}
+
+	int op = set.events() ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	set.notifiers[type] = notifier;
+
+	int ret = updateNotifiers(op, notifier->fd(), set);
+	if (ret < 0) {
+		LOG(Event, Warning)
+			<< "Disabling " << notifierType(type)
+			<< " notifier for fd " << notifier->fd() << ": "
+			<< strerror(-ret);
+		unregisterEventNotifier(notifier);
+	}
+}
+
+void EventDispatcherEpoll::unregisterEventNotifier(EventNotifier *notifier)
+{
+	auto iter = notifiers_.find(notifier->fd());
+	if (iter == notifiers_.end())
+		return;
+
+	EventNotifierSetEpoll &set = iter->second;
+	EventNotifier::Type type = notifier->type();
+
+	if (!set.notifiers[type])
+		return;
+
+	if (set.notifiers[type] != notifier) {
+		LOG(Event, Warning)
+			<< notifierType(type) << " notifier for fd "
+			<< notifier->fd() << " is not registered";
+		return;
+	}
+
+	set.notifiers[type] = nullptr;
+
+	/*
+	 * The file descriptor may already have been closed, in which case the
+	 * kernel has removed it from the epoll set. Ignore errors.
+	 */
+	if (set.events()) {
+		updateNotifiers(EPOLL_CTL_MOD, notifier->fd(), set);
+		return;
+	}
+
+	updateNotifiers(EPOLL_CTL_DEL, notifier->fd(), set);
+
+	/*
+	 * Don't race with event processing if this function is called from an
+	 * event notifier. The notifiers_ entry will be erased by
+	 * processEvents().
+	 */
+	if (processingEvents_) {
+		unregisteredFds_.push_back(notifier->fd());
+		return;
+	}
+
+	notifiers_.erase(iter);
+}
+
+void EventDispatcherEpoll::registerTimer(Timer *timer)
+{
+	timers_.insert(timer);
+}
+
+void EventDispatcherEpoll::unregisterTimer(Timer *timer)
+{
+	timers_.remove(timer);
+}
+
+void EventDispatcherEpoll::processEvents()
+{
+	static constexpr unsigned int kMaxEvents = 32;
+
+	struct epoll_event events[kMaxEvents];
+	int ret;
+
+	Thread::current()->dispatchMessages();
+
+	armTimerfd();
+
+	/* Wait for events and process notifiers and timers. */
+	do {
+		ret = epoll_wait(epollfd_.get(), events, kMaxEvents, -1);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret < 0) {
+		ret = -errno;
+		LOG(Event, Warning) << "epoll_wait() failed with " << strerror(-ret);
+	} else {
+		processingEvents_ = true;
+
+		for (int i = 0; i < ret; ++i) {
+			int fd = events[i].data.fd;
+
+			if (fd == eventfd_.get())
+				processInterrupt();
+			else if (fd == timerfd_.get())
+				processTimerfd();
+			else
+				processNotifiers(events[i]);
+		}
+
+		processingEvents_ = false;
+
+		/* Erase the notifiers_ entries that have been emptied. */
+		for (int fd : unregisteredFds_) {
+			auto iter = notifiers_.find(fd);
+			if (iter != notifiers_.end() && !iter->second.events())
+				notifiers_.erase(iter);
+		}
+
+		unregisteredFds_.clear();
+	}
+
+	processTimers();
+}
+
+void EventDispatcherEpoll::interrupt()
+{
+	uint64_t value = 1;
+	ssize_t ret = write(eventfd_.get(), &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to interrupt event dispatcher ("
+			<< ret << ")";
+	}
+}
+
+uint32_t EventDispatcherEpoll::EventNotifierSetEpoll::events() const
+{
+	uint32_t events = 0;
+
+	if (notifiers[EventNotifier::Read])
+		events |= EPOLLIN;
+	if (notifiers[EventNotifier::Write])
+		events |= EPOLLOUT;
+	if (notifiers[EventNotifier::Exception])
+		events |= EPOLLPRI;
+
+	return events;
+}
+
+int EventDispatcherEpoll::updateNotifiers(int op, int fd,
+					  const EventNotifierSetEpoll &set)
+{
+	struct epoll_event event = {};
+	event.events = set.events();
+	event.data.fd = fd;
+
+	int ret = epoll_ctl(epollfd_.get(), op, fd, &event);
+	return ret < 0 ? -errno : 0;
+}
+
+void EventDispatcherEpoll::armTimerfd()
+{
+	utils::time_point deadline = !timers_.empty()
+				   ? timers_.front()->deadline()
+				   : utils::time_point{};
+
+	if (deadline == timerfdDeadline_)
+		return;
+
+	/*
+	 * The steady clock is based on CLOCK_MONOTONIC. A deadline in the past
+	 * makes the timerfd expire immediately, while a zero value disarms it.
+	 */
+	struct itimerspec spec = {};
+	if (deadline != utils::time_point{})
+		spec.it_value = utils::duration_to_timespec(deadline.time_since_epoch());
+
+	if (timerfd_settime(timerfd_.get(), TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+		LOG(Event, Error)
+			<< "Failed to arm timerfd: " << strerror(errno);
+		return;
+	}
+
+	timerfdDeadline_ = deadline;
+}
+
+void EventDispatcherEpoll::processInterrupt()
+{
+	uint64_t value;
+	ssize_t ret = read(eventfd_.get(), &value, sizeof(value));
+	if (ret != sizeof(value)) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to process interrupt (" << ret << ")";
+	}
+}
+
+void EventDispatcherEpoll::processTimerfd()
+{
+	uint64_t expirations;
+	ssize_t ret = read(timerfd_.get(), &expirations, sizeof(expirations));
+	if (ret != sizeof(expirations) && errno != EAGAIN) {
+		if (ret < 0)
+			ret = -errno;
+		LOG(Event, Error)
+			<< "Failed to process timer (" << ret << ")";
+	}
+
+	/* The timerfd has expired and is now disarmed. */
+	timerfdDeadline_ = {};
+}
+
+void EventDispatcherEpoll::processNotifiers(const struct epoll_event &event)
+{
+	static const struct {
+		EventNotifier::Type type;
+		uint32_t events;
+	} types[] = {
+		{ EventNotifier::Read, EPOLLIN },
+		{ EventNotifier::Write, EPOLLOUT },
+		{ EventNotifier::Exception, EPOLLPRI },
+	};
+
+	/*
+	 * The notifiers for the file descriptor may have been unregistered by
+	 * an event handler since the events have been retrieved.
+	 */
+	auto iter = notifiers_.find(event.data.fd);
+	if (iter == notifiers_.end())
+		return;
+
+	EventNotifierSetEpoll &set = iter->second;
+
+	for (const auto &type : types) {
+		EventNotifier *notifier = set.notifiers[type.type];
+
+		if (notifier && event.events & type.events)
+			notifier->activated.emit();
+	}
+}
+
+void EventDispatcherEpoll::processTimers()
+{
+	utils::time_point now = utils::clock::now();
+
+	while (!timers_.empty()) {
+		Timer *timer = timers_.front();
+		if (timer->deadline() > now)
+			break;
+
+		timers_.remove(timer);
+		timer->stop();
+		timer->timeout.emit();
+	}
+}
+
+} /* namespace libcamera */
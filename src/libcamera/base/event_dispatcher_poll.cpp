@@ -112,31 +112,12 @@ void EventDispatcherPoll::unregisterEventNotifier(EventNotifier *notifier)
 
 void EventDispatcherPoll::registerTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if ((*iter)->deadline() > timer->deadline()) {
-			timers_.insert(iter, timer);
-			return;
-		}
-	}
-
-	timers_.push_back(timer);
+	timers_.insert(timer);
 }
 
 void EventDispatcherPoll::unregisterTimer(Timer *timer)
 {
-	for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
-		if (*iter == timer) {
-			timers_.erase(iter);
-			return;
-		}
-
-		/*
-		 * As the timers list is ordered, we can stop as soon as we go
-		 * past the deadline.
-		 */
-		if ((*iter)->deadline() > timer->deadline())
-			break;
-	}
+	timers_.remove(timer);
 }
 
 void EventDispatcherPoll::processEvents()
@@ -297,7 +278,7 @@ void EventDispatcherPoll::processTimers()
 		if (timer->deadline() > now)
 			break;
 
-		timers_.pop_front();
+		timers_.remove(timer);
 		timer->stop();
 		timer->timeout.emit();
 	}
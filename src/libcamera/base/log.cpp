@@ -8,14 +8,22 @@
 #include <libcamera/base/log.h>
 
 #include <array>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <list>
+#include <mutex>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <syslog.h>
+#include <thread>
 #include <time.h>
+#include <unistd.h>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <libcamera/logging.h>
@@ -23,6 +31,7 @@
 #include <libcamera/base/backtrace.h>
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/thread.h>
+#include <libcamera/base/unique_fd.h>
 #include <libcamera/base/utils.h>
 
 /**
@@ -52,6 +61,19 @@
  * of the file. The file must be writable and is truncated if it exists. If any
  * error occurs when opening the file, the file is ignored and the log is output
  * to std::cerr.
+ *
+ * Log messages are written synchronously by default, in the context of the
+ * thread that logs them. Setting the LIBCAMERA_LOG_ASYNC environment variable
+ * to a number of messages instead queues messages to a ring buffer of that
+ * size, from which a background thread writes them to the log output. Messages
+ * logged while the ring buffer is full are dropped, and the number of dropped
+ * messages is reported in the log. Fatal messages are always written
+ * synchronously, after all queued messages.
+ *
+ * Log files can be written in a compact binary format instead of text by
+ * setting the LIBCAMERA_LOG_FORMAT environment variable to "binary". Binary
+ * log records store the timestamp, thread ID and source location of messages
+ * in raw form, deferring their formatting to the utils/decode-log.py tool.
  */
 
 /**
@@ -97,6 +119,24 @@ static const char *log_severity_name(LogSeverity severity)
 		return "UNKWN";
 }
 
+/**
+ * \brief A log message captured for output
+ *
+ * The LogRecord structure stores the information needed to output a log
+ * message, including the ID of the thread that logged it, independently of
+ * the LogMessage it has been captured from.
+ */
+struct LogRecord {
+	utils::time_point timestamp;
+	pid_t tid;
+	LogSeverity severity;
+	const LogCategory *category;
+	const char *fileName;
+	unsigned int line;
+	std::string prefix;
+	std::string msg;
+};
+
 /**
  * \brief Log output
  *
@@ -105,31 +145,41 @@ static const char *log_severity_name(LogSeverity severity)
 class LogOutput
 {
 public:
-	LogOutput(const char *path, bool color);
+	LogOutput(const char *path, bool color, bool binary = false);
 	LogOutput(std::ostream *stream, bool color);
 	LogOutput();
 	~LogOutput();
 
 	bool isValid() const;
-	void write(const LogMessage &msg);
+	void write(const LogRecord &record);
 	void write(const std::string &msg);
 
 private:
 	void writeSyslog(LogSeverity severity, const std::string &msg);
 	void writeStream(const std::string &msg);
+	void writeBinary(const LogRecord *record, const std::string &text);
 
 	std::ostream *stream_;
 	LoggingTarget target_;
 	bool color_;
+
+	/* Binary format state, protected by mutex_ */
+	bool binary_;
+	Mutex mutex_;
+	bool headerWritten_;
+	std::unordered_map<const LogCategory *, uint32_t> categoryIds_;
+	std::unordered_map<const char *, uint32_t> fileIds_;
 };
 
 /**
  * \brief Construct a log output based on a file
  * \param[in] path Full path to log file
  * \param[in] color True to output colored messages
+ * \param[in] binary True to write messages in the binary format
  */
-LogOutput::LogOutput(const char *path, bool color)
-	: target_(LoggingTargetFile), color_(color)
+LogOutput::LogOutput(const char *path, bool color, bool binary)
+	: target_(LoggingTargetFile), color_(color && !binary), binary_(binary),
+	  headerWritten_(false)
 {
 	stream_ = new std::ofstream(path);
 }
@@ -140,7 +190,8 @@ LogOutput::LogOutput(const char *path, bool color)
  * \param[in] color True to output colored messages
  */
 LogOutput::LogOutput(std::ostream *stream, bool color)
-	: stream_(stream), target_(LoggingTargetStream), color_(color)
+	: stream_(stream), target_(LoggingTargetStream), color_(color),
+	  binary_(false), headerWritten_(false)
 {
 }
 
@@ -148,7 +199,8 @@ LogOutput::LogOutput(std::ostream *stream, bool color)
  * \brief Construct a log output to syslog
  */
 LogOutput::LogOutput()
-	: stream_(nullptr), target_(LoggingTargetSyslog), color_(false)
+	: stream_(nullptr), target_(LoggingTargetSyslog), color_(false),
+	  binary_(false), headerWritten_(false)
 {
 	openlog("libcamera", LOG_PID, 0);
 }
@@ -205,7 +257,7 @@ constexpr const char *kColorBrightWhite = "\033[1;37m";
  * \brief Write message to log output
  * \param[in] msg Message to write
  */
-void LogOutput::write(const LogMessage &msg)
+void LogOutput::write(const LogRecord &msg)
 {
 	static const char *const severityColors[] = {
 		kColorBrightCyan,
@@ -220,9 +272,14 @@ void LogOutput::write(const LogMessage &msg)
 	const char *prefixColor = color_ ? kColorGreen : "";
 	const char *resetColor = color_ ? kColorReset : "";
 	const char *severityColor = "";
-	LogSeverity severity = msg.severity();
+	LogSeverity severity = msg.severity;
 	std::string str;
 
+	if (binary_) {
+		writeBinary(&msg, {});
+		return;
+	}
+
 	if (color_) {
 		if (static_cast<unsigned int>(severity) < std::size(severityColors))
 			severityColor = severityColors[severity];
@@ -233,22 +290,23 @@ void LogOutput::write(const LogMessage &msg)
 	switch (target_) {
 	case LoggingTargetSyslog:
 		str = std::string(log_severity_name(severity)) + " "
-		    + msg.category().name() + " " + msg.fileInfo() + " ";
-		if (!msg.prefix().empty())
-			str += msg.prefix() + ": ";
-		str += msg.msg();
+		    + msg.category->name() + " " + msg.fileName + ":"
+		    + std::to_string(msg.line) + " ";
+		if (!msg.prefix.empty())
+			str += msg.prefix + ": ";
+		str += msg.msg;
 		writeSyslog(severity, str);
 		break;
 	case LoggingTargetStream:
 	case LoggingTargetFile:
-		str = "[" + utils::time_point_to_string(msg.timestamp()) + "] ["
-		    + std::to_string(Thread::currentId()) + "] "
+		str = "[" + utils::time_point_to_string(msg.timestamp) + "] ["
+		    + std::to_string(msg.tid) + "] "
 		    + severityColor + log_severity_name(severity) + " "
-		    + categoryColor + msg.category().name() + " "
-		    + fileColor + msg.fileInfo() + " ";
-		if (!msg.prefix().empty())
-			str += prefixColor + msg.prefix() + ": ";
-		str += resetColor + msg.msg();
+		    + categoryColor + msg.category->name() + " "
+		    + fileColor + msg.fileName + ":" + std::to_string(msg.line) + " ";
+		if (!msg.prefix.empty())
+			str += prefixColor + msg.prefix + ": ";
+		str += resetColor + msg.msg;
 		writeStream(str);
 		break;
 	default:
@@ -268,7 +326,10 @@ void LogOutput::write(const std::string &str)
 		break;
 	case LoggingTargetStream:
 	case LoggingTargetFile:
-		writeStream(str);
+		if (binary_)
+			writeBinary(nullptr, str);
+		else
+			writeStream(str);
 		break;
 	default:
 		break;
@@ -286,6 +347,173 @@ void LogOutput::writeStream(const std::string &str)
 	stream_->flush();
 }
 
+namespace {
+
+/*
+ * The binary log format starts with an 8 bytes magic, followed by a 32-bit
+ * version. All integers are stored in the native byte order, the decoder
+ * uses the version to detect it. The header is followed by records, each made
+ * of an 8-bit type, a 32-bit payload size and the payload.
+ *
+ * Category and file records assign a 32-bit ID to a category or a source file
+ * name, before the first message that references it:
+ *
+ *   u32 id, u16 length, name
+ *
+ * Message records store the message fields in raw form:
+ *
+ *   u64 timestamp (ns), u32 tid, u32 category id, u32 file id, u32 line,
+ *   u8 severity, u16 prefix length, u32 message length, prefix, message
+ *
+ * Text records store free-form text, such as backtraces:
+ *
+ *   u32 length, text
+ */
+constexpr char kBinaryLogMagic[8] = { 'L', 'C', 'B', 'I', 'N', 'L', 'O', 'G' };
+constexpr uint32_t kBinaryLogVersion = 1;
+
+enum BinaryLogRecordType : uint8_t {
+	BinaryLogCategory = 1,
+	BinaryLogFile = 2,
+	BinaryLogMessage = 3,
+	BinaryLogText = 4,
+};
+
+template<typename T>
+void appendValue(std::string &buffer, T value)
+{
+	buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void appendRecord(std::string &buffer, BinaryLogRecordType type,
+		  const std::string &payload)
+{
+	appendValue<uint8_t>(buffer, type);
+	appendValue<uint32_t>(buffer, payload.size());
+	buffer += payload;
+}
+
+void appendName(std::string &buffer, BinaryLogRecordType type, uint32_t id,
+		const std::string &name)
+{
+	std::string payload;
+
+	appendValue<uint32_t>(payload, id);
+	appendValue<uint16_t>(payload, name.size());
+	payload += name;
+
+	appendRecord(buffer, type, payload);
+}
+
+} /* namespace */
+
+void LogOutput::writeBinary(const LogRecord *record, const std::string &text)
+{
+	std::string buffer;
+	std::string payload;
+
+	MutexLocker locker(mutex_);
+
+	if (!headerWritten_) {
+		buffer.append(kBinaryLogMagic, sizeof(kBinaryLogMagic));
+		appendValue<uint32_t>(buffer, kBinaryLogVersion);
+		headerWritten_ = true;
+	}
+
+	if (!record) {
+		appendValue<uint32_t>(payload, text.size());
+		payload += text;
+		appendRecord(buffer, BinaryLogText, payload);
+		writeStream(buffer);
+		return;
+	}
+
+	auto [category, newCategory] =
+		categoryIds_.try_emplace(record->category, categoryIds_.size());
+	if (newCategory)
+		appendName(buffer, BinaryLogCategory, category->second,
+			   record->category->name());
+
+	auto [file, newFile] =
+		fileIds_.try_emplace(record->fileName, fileIds_.size());
+	if (newFile)
+		appendName(buffer, BinaryLogFile, file->second, record->fileName);
+
+	uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		record->timestamp.time_since_epoch()).count();
+
+	appendValue<uint64_t>(payload, timestamp);
+	appendValue<uint32_t>(payload, record->tid);
+	appendValue<uint32_t>(payload, category->second);
+	appendValue<uint32_t>(payload, file->second);
+	appendValue<uint32_t>(payload, record->line);
+	appendValue<uint8_t>(payload, record->severity);
+	appendValue<uint16_t>(payload, record->prefix.size());
+	appendValue<uint32_t>(payload, record->msg.size());
+	payload += record->prefix;
+	payload += record->msg;
+	appendRecord(buffer, BinaryLogMessage, payload);
+
+	writeStream(buffer);
+}
+
+class Logger;
+
+/**
+ * \brief Asynchronous log writer
+ *
+ * The LogWriter class queues log records to a bounded ring buffer, and writes
+ * them to the logger output from a background thread. The ring buffer is
+ * lock-free, allowing any number of threads to queue records concurrently
+ * without blocking each other. When the ring buffer is full, records are
+ * dropped and counted, and the count is written to the log output when space
+ * becomes available again.
+ */
+class LogWriter
+{
+public:
+	LogWriter(Logger *logger, unsigned int capacity);
+	~LogWriter();
+
+	bool isValid() const { return eventfd_.isValid(); }
+	bool isActive() const;
+
+	void queue(LogRecord &&record);
+	void flush();
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		LogRecord record;
+	};
+
+	static void forked();
+
+	bool empty() const;
+	bool dequeue(LogRecord &record);
+	void wake();
+	void run();
+
+	static std::atomic<bool> forked_;
+
+	Logger *logger_;
+
+	std::unique_ptr<Cell[]> cells_;
+	size_t mask_;
+
+	alignas(64) std::atomic<size_t> enqueuePos_;
+	alignas(64) std::atomic<size_t> dequeuePos_;
+	std::atomic<size_t> written_;
+	std::atomic<unsigned int> dropped_;
+	std::atomic<bool> sleeping_;
+	std::atomic<bool> stop_;
+
+	UniqueFD eventfd_;
+	std::thread thread_;
+};
+
+std::atomic<bool> LogWriter::forked_ = false;
+
 /**
  * \brief Message logger
  *
@@ -301,7 +529,9 @@ public:
 	void write(const LogMessage &msg);
 	void backtrace();
 
-	int logSetFile(const char *path, bool color);
+	std::shared_ptr<LogOutput> output() const { return std::atomic_load(&output_); }
+
+	int logSetFile(const char *path, bool color, bool binary = false);
 	int logSetStream(std::ostream *stream, bool color);
 	int logSetTarget(LoggingTarget target);
 	void logSetLevel(const char *category, const char *level);
@@ -309,22 +539,215 @@ public:
 private:
 	Logger();
 
+	void setOutput(std::shared_ptr<LogOutput> output);
+
 	void parseLogFile();
 	void parseLogLevels();
+	void parseLogAsync();
 	static LogSeverity parseLogLevel(const std::string &level);
 
 	friend LogCategory;
 	void registerCategory(LogCategory *category);
 	LogCategory *findCategory(const char *name) const;
 
+	static constexpr unsigned long kMaxAsyncCapacity = 1 << 20;
+
 	static bool destroyed_;
 
 	std::vector<LogCategory *> categories_;
 	std::list<std::pair<std::string, LogSeverity>> levels_;
 
 	std::shared_ptr<LogOutput> output_;
+	std::unique_ptr<LogWriter> writer_;
 };
 
+/**
+ * \brief Construct an asynchronous log writer
+ * \param[in] logger The logger whose output the records are written to
+ * \param[in] capacity The ring buffer capacity, rounded up to a power of two
+ *
+ * The background thread is started immediately. If it can't be started, the
+ * writer is invalid and must not be used.
+ */
+LogWriter::LogWriter(Logger *logger, unsigned int capacity)
+	: logger_(logger), enqueuePos_(0), dequeuePos_(0), written_(0),
+	  dropped_(0), sleeping_(false), stop_(false)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	cells_ = std::make_unique<Cell[]>(size);
+	for (size_t i = 0; i < size; ++i)
+		cells_[i].sequence.store(i, std::memory_order_relaxed);
+	mask_ = size - 1;
+
+	eventfd_ = UniqueFD(eventfd(0, EFD_CLOEXEC));
+	if (!eventfd_.isValid())
+		return;
+
+	/*
+	 * The background thread doesn't survive fork(). Make sure log messages
+	 * are written synchronously in child processes.
+	 */
+	static std::once_flag atfork;
+	std::call_once(atfork, []() {
+		pthread_atfork(nullptr, nullptr, &LogWriter::forked);
+	});
+
+	thread_ = std::thread(&LogWriter::run, this);
+}
+
+LogWriter::~LogWriter()
+{
+	if (!thread_.joinable())
+		return;
+
+	stop_.store(true, std::memory_order_release);
+	wake();
+	thread_.join();
+}
+
+void LogWriter::forked()
+{
+	forked_.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Check if the writer can queue records
+ * \return True if the background thread is running, false otherwise
+ */
+bool LogWriter::isActive() const
+{
+	return thread_.joinable() && !forked_.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief Queue a record to be written by the background thread
+ * \param[in] record The record
+ *
+ * If the ring buffer is full, the record is dropped.
+ */
+void LogWriter::queue(LogRecord &&record)
+{
+	size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+	Cell *cell;
+
+	for (;;) {
+		cell = &cells_[pos & mask_];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence - pos);
+
+		if (diff == 0) {
+			if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+							      std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = enqueuePos_.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->record = std::move(record);
+	cell->sequence.store(pos + 1, std::memory_order_release);
+
+	/*
+	 * Pairs with the fence in run() to ensure that either the background
+	 * thread sees the record, or this thread sees it sleeping.
+	 */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping_.load(std::memory_order_relaxed) &&
+	    sleeping_.exchange(false, std::memory_order_relaxed))
+		wake();
+}
+
+/**
+ * \brief Wait until all queued records have been written
+ */
+void LogWriter::flush()
+{
+	size_t pos = enqueuePos_.load(std::memory_order_acquire);
+
+	wake();
+
+	while (written_.load(std::memory_order_acquire) < pos)
+		std::this_thread::yield();
+}
+
+bool LogWriter::empty() const
+{
+	size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+	const Cell &cell = cells_[pos & mask_];
+	return cell.sequence.load(std::memory_order_acquire) != pos + 1;
+}
+
+bool LogWriter::dequeue(LogRecord &record)
+{
+	size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+	Cell &cell = cells_[pos & mask_];
+
+	if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+		return false;
+
+	record = std::move(cell.record);
+	cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+	dequeuePos_.store(pos + 1, std::memory_order_release);
+
+	return true;
+}
+
+void LogWriter::wake()
+{
+	uint64_t value = 1;
+	[[maybe_unused]] ssize_t ret = ::write(eventfd_.get(), &value, sizeof(value));
+}
+
+void LogWriter::run()
+{
+	pthread_setname_np(pthread_self(), "libcamera-log");
+
+	LogRecord record;
+
+	for (;;) {
+		while (dequeue(record)) {
+			/*
+			 * Retrieve the output for every record, as it may have
+			 * been replaced since the previous one was written.
+			 */
+			std::shared_ptr<LogOutput> output = logger_->output();
+			if (output)
+				output->write(record);
+
+			written_.fetch_add(1, std::memory_order_release);
+		}
+
+		unsigned int dropped = dropped_.exchange(0, std::memory_order_relaxed);
+		if (dropped) {
+			std::shared_ptr<LogOutput> output = logger_->output();
+			if (output)
+				output->write(std::to_string(dropped) +
+					      " log messages dropped\n");
+		}
+
+		if (stop_.load(std::memory_order_acquire) && empty())
+			break;
+
+		sleeping_.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (!empty() || stop_.load(std::memory_order_acquire)) {
+			sleeping_.store(false, std::memory_order_relaxed);
+			continue;
+		}
+
+		uint64_t value;
+		[[maybe_unused]] ssize_t ret = ::read(eventfd_.get(), &value, sizeof(value));
+		sleeping_.store(false, std::memory_order_relaxed);
+	}
+}
+
 bool Logger::destroyed_ = false;
 
 /**
@@ -437,6 +860,9 @@ Logger::~Logger()
 {
 	destroyed_ = true;
 
+	/* Write all queued records before deleting the categories they use. */
+	writer_.reset();
+
 	for (LogCategory *category : categories_)
 		delete category;
 }
@@ -469,7 +895,28 @@ void Logger::write(const LogMessage &msg)
 	if (!output)
 		return;
 
-	output->write(msg);
+	LogRecord record{
+		msg.timestamp(),
+		Thread::currentId(),
+		msg.severity(),
+		&msg.category(),
+		msg.fileName(),
+		msg.line(),
+		msg.prefix(),
+		msg.msg(),
+	};
+
+	if (writer_ && writer_->isActive()) {
+		if (record.severity != LogFatal) {
+			writer_->queue(std::move(record));
+			return;
+		}
+
+		/* Write fatal messages synchronously, after the queued ones. */
+		writer_->flush();
+	}
+
+	output->write(record);
 }
 
 /**
@@ -499,19 +946,20 @@ void Logger::backtrace()
  * \brief Set the log file
  * \param[in] path Full path to the log file
  * \param[in] color True to output colored messages
+ * \param[in] binary True to write messages in the binary format
  *
  * \sa libcamera::logSetFile()
  *
  * \return Zero on success, or a negative error code otherwise.
  */
-int Logger::logSetFile(const char *path, bool color)
+int Logger::logSetFile(const char *path, bool color, bool binary)
 {
 	std::shared_ptr<LogOutput> output =
-		std::make_shared<LogOutput>(path, color);
+		std::make_shared<LogOutput>(path, color, binary);
 	if (!output->isValid())
 		return -EINVAL;
 
-	std::atomic_store(&output_, output);
+	setOutput(std::move(output));
 	return 0;
 }
 
@@ -528,7 +976,7 @@ int Logger::logSetStream(std::ostream *stream, bool color)
 {
 	std::shared_ptr<LogOutput> output =
 		std::make_shared<LogOutput>(stream, color);
-	std::atomic_store(&output_, output);
+	setOutput(std::move(output));
 	return 0;
 }
 
@@ -544,10 +992,10 @@ int Logger::logSetTarget(enum LoggingTarget target)
 {
 	switch (target) {
 	case LoggingTargetSyslog:
-		std::atomic_store(&output_, std::make_shared<LogOutput>());
+		setOutput(std::make_shared<LogOutput>());
 		break;
 	case LoggingTargetNone:
-		std::atomic_store(&output_, std::shared_ptr<LogOutput>());
+		setOutput(nullptr);
 		break;
 	default:
 		return -EINVAL;
@@ -556,6 +1004,27 @@ int Logger::logSetTarget(enum LoggingTarget target)
 	return 0;
 }
 
+/**
+ * \brief Replace the logger output
+ * \param[in] output The new output
+ *
+ * When logging asynchronously, messages queued before the output is replaced
+ * are written to the previous output, and the previous output is not used
+ * anymore when this function returns.
+ */
+void Logger::setOutput(std::shared_ptr<LogOutput> output)
+{
+	bool async = writer_ && writer_->isActive();
+
+	if (async)
+		writer_->flush();
+
+	std::atomic_store(&output_, std::move(output));
+
+	if (async)
+		writer_->flush();
+}
+
 /**
  * \brief Set the log level
  * \param[in] category Logging category
@@ -591,6 +1060,7 @@ Logger::Logger()
 
 	parseLogFile();
 	parseLogLevels();
+	parseLogAsync();
 }
 
 /**
@@ -601,6 +1071,9 @@ Logger::Logger()
  * is set to "syslog", then the logger output will be directed to syslog. Errors
  * are silently ignored and don't affect the logger output (set to std::cerr by
  * default).
+ *
+ * If the LIBCAMERA_LOG_FORMAT environment variable is set to "binary", the log
+ * file is written in the binary format.
  */
 void Logger::parseLogFile()
 {
@@ -613,7 +1086,35 @@ void Logger::parseLogFile()
 		return;
 	}
 
-	logSetFile(file, false);
+	const char *format = utils::secure_getenv("LIBCAMERA_LOG_FORMAT");
+	bool binary = format && !strcmp(format, "binary");
+
+	logSetFile(file, false, binary);
+}
+
+/**
+ * \brief Parse the asynchronous logging configuration from the environment
+ *
+ * If the LIBCAMERA_LOG_ASYNC environment variable is set to a non-zero number,
+ * write log messages from a background thread, through a ring buffer of that
+ * many messages. Errors are silently ignored and log messages are then
+ * written synchronously.
+ */
+void Logger::parseLogAsync()
+{
+	const char *async = utils::secure_getenv("LIBCAMERA_LOG_ASYNC");
+	if (!async)
+		return;
+
+	char *endptr;
+	unsigned long capacity = strtoul(async, &endptr, 10);
+	if (*async == '\0' || *endptr != '\0' || !capacity ||
+	    capacity > kMaxAsyncCapacity)
+		return;
+
+	writer_ = std::make_unique<LogWriter>(this, capacity);
+	if (!writer_->isValid())
+		writer_.reset();
 }
 
 /**
@@ -834,6 +1335,13 @@ void LogCategory::setSeverity(LogSeverity severity)
 	severity_ = severity;
 }
 
+/**
+ * \fn LogCategory::enabled()
+ * \brief Check if messages of a given severity are printed for the category
+ * \param[in] severity The message severity
+ * \return True if messages of \a severity are printed, false otherwise
+ */
+
 /**
  * \brief Retrieve the default log category
  *
@@ -894,19 +1402,22 @@ LogMessage::LogMessage(const char *fileName, unsigned int line,
  */
 LogMessage::LogMessage(LogMessage &&other)
 	: msgStream_(std::move(other.msgStream_)), category_(other.category_),
-	  severity_(other.severity_)
+	  severity_(other.severity_), timestamp_(other.timestamp_),
+	  fileName_(other.fileName_), line_(other.line_),
+	  prefix_(std::move(other.prefix_))
 {
 	other.severity_ = LogInvalid;
 }
 
 void LogMessage::init(const char *fileName, unsigned int line)
 {
-	/* Log the timestamp, severity and file information. */
+	/*
+	 * Log the timestamp and file information. The file information is
+	 * only formatted when the message is output.
+	 */
 	timestamp_ = utils::clock::now();
-
-	std::ostringstream ossFileInfo;
-	ossFileInfo << utils::basename(fileName) << ":" << line;
-	fileInfo_ = ossFileInfo.str();
+	fileName_ = utils::basename(fileName);
+	line_ = line;
 }
 
 LogMessage::~LogMessage()
@@ -959,10 +1470,25 @@ LogMessage::~LogMessage()
  */
 
 /**
- * \fn LogMessage::fileInfo()
+ * \fn LogMessage::fileName()
+ * \brief Retrieve the name of the file the message is logged from
+ * \return The base name of the source file of the message
+ */
+
+/**
+ * \fn LogMessage::line()
+ * \brief Retrieve the line number the message is logged from
+ * \return The source line number of the message
+ */
+
+/**
  * \brief Retrieve the file info of the log message
- * \return The file info of the message
+ * \return The file info of the message, formatted as "file:line"
  */
+std::string LogMessage::fileInfo() const
+{
+	return std::string(fileName_) + ":" + std::to_string(line_);
+}
 
 /**
  * \fn LogMessage::prefix()
@@ -1085,6 +1611,11 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
  * If the severity is set to Fatal, execution is aborted and the program
  * terminates immediately after printing the message.
  *
+ * The message is only constructed when it is printed. When it is discarded,
+ * the expressions written to the stream are not evaluated, and LOG() has no
+ * other cost than checking the log level of the category. Those expressions
+ * shall thus not have side effects.
+ *
  * \warning Logging from the destructor of a global object, either directly or
  * indirectly, results in undefined behaviour.
  *
@@ -1092,6 +1623,19 @@ LogMessage _log(const LogCategory *category, LogSeverity severity,
  * possible extent
  */
 
+/**
+ * \def LOG_ENABLED(category, severity)
+ * \hideinitializer
+ * \brief Check if a message would be printed
+ * \param[in] category Category (optional)
+ * \param[in] severity Severity
+ *
+ * Evaluate to true if a message logged with LOG() and the same \a category and
+ * \a severity would be printed, and to false if it would be discarded. This
+ * allows building expensive log message context, that doesn't fit in a single
+ * LOG() statement, only when the message is printed.
+ */
+
 /**
  * \def ASSERT(condition)
  * \hideinitializer
@@ -8,7 +8,10 @@
 #include <libcamera/base/memfd.h>
 
 #include <fcntl.h>
+#include <fstream>
+#include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 #include <unistd.h>
@@ -30,6 +33,10 @@ namespace {
 #define F_SEAL_GROW		0x0004
 #endif
 
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB		0x0004U
+#endif
+
 #if not HAVE_MEMFD_CREATE
 int memfd_create(const char *name, unsigned int flags)
 {
@@ -44,6 +51,67 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(File)
 
+#ifndef __DOXYGEN__
+namespace {
+
+/* Retrieve the default huge page size, or 0 if huge pages are not supported. */
+std::size_t hugePageSize()
+{
+	static const std::size_t size = []() -> std::size_t {
+		std::ifstream meminfo("/proc/meminfo");
+		std::string line;
+
+		while (std::getline(meminfo, line)) {
+			if (line.compare(0, 13, "Hugepagesize:"))
+				continue;
+
+			return strtoul(line.c_str() + 13, nullptr, 10) * 1024;
+		}
+
+		return 0;
+	}();
+
+	return size;
+}
+
+/*
+ * Create an anonymous file backed by huge pages, with its size rounded up to
+ * a multiple of the huge page size. The pages are allocated immediately, as a
+ * shortage of huge pages would otherwise only be reported through a SIGBUS
+ * when accessing the memory.
+ */
+UniqueFD createHugeTlb(const char *name, std::size_t size)
+{
+	const std::size_t pageSize = hugePageSize();
+	if (!pageSize)
+		return {};
+
+	int ret = memfd_create(name, MFD_ALLOW_SEALING | MFD_CLOEXEC | MFD_HUGETLB);
+	if (ret < 0) {
+		LOG(File, Debug)
+			<< "Failed to allocate huge pages memfd for " << name
+			<< ": " << strerror(errno);
+		return {};
+	}
+
+	UniqueFD memfd(ret);
+
+	size = (size + pageSize - 1) / pageSize * pageSize;
+
+	if (ftruncate(memfd.get(), size) < 0 ||
+	    fallocate(memfd.get(), 0, 0, size) < 0) {
+		LOG(File, Debug)
+			<< "Failed to allocate " << size << " bytes of huge pages for "
+			<< name << ": " << strerror(errno);
+		return {};
+	}
+
+	return memfd;
+}
+
+} /* namespace */
+#endif /* __DOXYGEN__ */
+
 /**
  * \class MemFd
  * \brief Helper class to create anonymous files
@@ -69,38 +137,71 @@ LOG_DECLARE_CATEGORY(File)
  * \brief A bitwise combination of MemFd::Seal values
  */
 
+/**
+ * \enum MemFd::Option
+ * \brief Options for the MemFd::create() function
+ * \var MemFd::Option::None
+ * \brief No option (used as default value)
+ * \var MemFd::Option::HugePages
+ * \brief Back the file with huge pages when possible
+ *
+ * The file is allocated from the hugetlbfs pool with its size rounded up to a
+ * multiple of the default huge page size, and its memory is allocated
+ * immediately. If huge pages are not available, the file is created with
+ * regular pages. Mappings of huge page backed files must be aligned to the
+ * huge page size, so this option is only suitable when all users of the file
+ * map it with its full size, or access it through another interface such as
+ * udmabuf.
+ */
+
+/**
+ * \typedef MemFd::Options
+ * \brief A bitwise combination of MemFd::Option values
+ */
+
 /**
  * \brief Create an anonymous file
  * \param[in] name The file name (displayed in symbolic links in /proc/self/fd/)
  * \param[in] size The file size
  * \param[in] seals The file seals
+ * \param[in] options The file creation options
  *
  * This function is a helper that wraps anonymous file (memfd) creation and
- * sets the file size and optional seals.
+ * sets the file size and optional seals. When \a options contains
+ * Option::HugePages, the file size may be larger than \a size.
  *
  * \return The descriptor of the anonymous file if creation succeeded, or an
  * invalid UniqueFD otherwise
  */
-UniqueFD MemFd::create(const char *name, std::size_t size, Seals seals)
+UniqueFD MemFd::create(const char *name, std::size_t size, Seals seals,
+		       Options options)
 {
-	int ret = memfd_create(name, MFD_ALLOW_SEALING | MFD_CLOEXEC);
-	if (ret < 0) {
-		ret = errno;
-		LOG(File, Error)
-			<< "Failed to allocate memfd storage for " << name
-			<< ": " << strerror(ret);
-		return {};
-	}
+	UniqueFD memfd;
+	int ret;
 
-	UniqueFD memfd(ret);
+	if (options & Option::HugePages)
+		memfd = createHugeTlb(name, size);
 
-	ret = ftruncate(memfd.get(), size);
-	if (ret < 0) {
-		ret = errno;
-		LOG(File, Error)
-			<< "Failed to set memfd size for " << name
-			<< ": " << strerror(ret);
-		return {};
+	if (!memfd.isValid()) {
+		ret = memfd_create(name, MFD_ALLOW_SEALING | MFD_CLOEXEC);
+		if (ret < 0) {
+			ret = errno;
+			LOG(File, Error)
+				<< "Failed to allocate memfd storage for " << name
+				<< ": " << strerror(ret);
+			return {};
+		}
+
+		memfd = UniqueFD(ret);
+
+		ret = ftruncate(memfd.get(), size);
+		if (ret < 0) {
+			ret = errno;
+			LOG(File, Error)
+				<< "Failed to set memfd size for " << name
+				<< ": " << strerror(ret);
+			return {};
+		}
 	}
 
 	if (seals) {
@@ -59,7 +59,7 @@ std::atomic_uint Message::nextUserType_{ Message::UserMessage };
  * \param[in] type The message type
  */
 Message::Message(Message::Type type)
-	: type_(type)
+	: type_(type), receiver_(nullptr), next_(nullptr)
 {
 }
 
@@ -138,6 +138,25 @@ InvokeMessage::~InvokeMessage()
 		delete method_;
 }
 
+/**
+ * \fn InvokeMessage::operator new(size_t size)
+ * \brief Allocate memory for an InvokeMessage
+ * \param[in] size The allocation size
+ *
+ * Invoke messages are allocated for every queued method invocation. Their
+ * memory is recycled through per-thread free lists to avoid the cost of the
+ * global allocator.
+ *
+ * \return A pointer to the allocated memory
+ */
+
+/**
+ * \fn InvokeMessage::operator delete(void *ptr, size_t size)
+ * \brief Free memory allocated for an InvokeMessage
+ * \param[in] ptr The memory to free
+ * \param[in] size The allocation size
+ */
+
 /**
  * \fn InvokeMessage::semaphore()
  * \brief Retrieve the message semaphore passed to the constructor
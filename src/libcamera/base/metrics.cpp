@@ -0,0 +1,469 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Lightweight metrics registry
+ */
+
+#include <libcamera/base/metrics.h>
+
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+
+#include <libcamera/base/mutex.h>
+
+/**
+ * \file base/metrics.h
+ * \brief Lightweight metrics registry
+ */
+
+namespace libcamera {
+
+namespace {
+
+struct MetricRegistry {
+	static MetricRegistry &instance()
+	{
+		static MetricRegistry registry;
+		return registry;
+	}
+
+	Mutex mutex;
+	std::vector<Metric *> metrics LIBCAMERA_TSA_GUARDED_BY(mutex);
+};
+
+} /* namespace */
+
+/**
+ * \class Metric
+ * \brief Base class for the metrics exported by libcamera
+ *
+ * Metrics are measurements of the health and performance of the camera stack,
+ * such as the number of dropped frames, the depth of a queue or the
+ * distribution of a processing time. They are registered by the components
+ * that update them, under a name and, optionally, the ID of the camera they
+ * relate to. The current value of all registered metrics can be retrieved at
+ * any time with snapshot(), and formatted in the Prometheus text exposition
+ * format with toPrometheus().
+ *
+ * Metrics are meant to be stored as members of the objects that update them,
+ * or as static variables. They register themselves when constructed and
+ * unregister when destroyed. Updating a metric is lock-free and can be done
+ * from any thread, only registration and snapshots take a lock.
+ *
+ * Multiple metrics can be registered with the same name and camera, for
+ * instance by all the instances of a class. Their values are then summed in
+ * the snapshots.
+ *
+ * Metric names follow the Prometheus conventions: they use lowercase letters,
+ * digits and underscores, and counters end with "_total".
+ */
+
+/**
+ * \enum Metric::Type
+ * \brief The type of a metric
+ * \var Metric::Type::Counter
+ * \brief A monotonically increasing count
+ * \var Metric::Type::Gauge
+ * \brief A value that can go up and down
+ * \var Metric::Type::Histogram
+ * \brief A distribution of values in fixed buckets
+ */
+
+/**
+ * \struct Metric::Sample
+ * \brief The value of a metric at the time of a snapshot
+ *
+ * \var Metric::Sample::name
+ * \brief The metric name
+ *
+ * \var Metric::Sample::camera
+ * \brief The ID of the camera the metric relates to, or an empty string
+ *
+ * \var Metric::Sample::type
+ * \brief The metric type
+ *
+ * \var Metric::Sample::value
+ * \brief The counter or gauge value, or the sum of the observed values for
+ * histograms
+ *
+ * \var Metric::Sample::bounds
+ * \brief The upper bounds of the histogram buckets
+ *
+ * \var Metric::Sample::buckets
+ * \brief The number of observed values in each histogram bucket
+ *
+ * The last bucket counts the values larger than the last bound, it has one
+ * more entry than the bounds.
+ *
+ * \var Metric::Sample::count
+ * \brief The number of values observed by the histogram
+ */
+
+/**
+ * \brief Construct and register a metric
+ * \param[in] type The metric type
+ * \param[in] name The metric name
+ * \param[in] camera The ID of the camera the metric relates to
+ * \param[in] bounds The upper bounds of the histogram buckets, in increasing
+ * order
+ */
+Metric::Metric(Type type, const std::string &name, const std::string &camera,
+	       const std::vector<double> &bounds)
+	: value_(0), bounds_(bounds), count_(0), sum_(0.0), type_(type),
+	  name_(name), camera_(camera)
+{
+	if (type_ == Type::Histogram) {
+		std::sort(bounds_.begin(), bounds_.end());
+
+		buckets_ = std::make_unique<std::atomic<uint64_t>[]>(bounds_.size() + 1);
+		for (unsigned int i = 0; i <= bounds_.size(); i++)
+			buckets_[i] = 0;
+	}
+
+	MetricRegistry &registry = MetricRegistry::instance();
+	MutexLocker locker(registry.mutex);
+	registry.metrics.push_back(this);
+}
+
+/**
+ * \brief Unregister and destroy the metric
+ */
+Metric::~Metric()
+{
+	MetricRegistry &registry = MetricRegistry::instance();
+	MutexLocker locker(registry.mutex);
+
+	auto it = std::find(registry.metrics.begin(), registry.metrics.end(), this);
+	if (it != registry.metrics.end())
+		registry.metrics.erase(it);
+}
+
+/**
+ * \fn Metric::name()
+ * \brief Retrieve the metric name
+ * \return The metric name
+ */
+
+/**
+ * \fn Metric::camera()
+ * \brief Retrieve the ID of the camera the metric relates to
+ * \return The camera ID, or an empty string if the metric isn't related to a
+ * camera
+ */
+
+/**
+ * \fn Metric::type()
+ * \brief Retrieve the metric type
+ * \return The metric type
+ */
+
+/**
+ * \var Metric::value_
+ * \brief The counter or gauge value
+ *
+ * \var Metric::bounds_
+ * \brief The upper bounds of the histogram buckets
+ *
+ * \var Metric::buckets_
+ * \brief The histogram buckets
+ *
+ * \var Metric::count_
+ * \brief The number of values observed by the histogram
+ *
+ * \var Metric::sum_
+ * \brief The sum of the values observed by the histogram
+ */
+
+Metric::Sample Metric::sample() const
+{
+	Sample sample{ name_, camera_, type_, 0.0, {}, {}, 0 };
+
+	switch (type_) {
+	case Type::Counter:
+	case Type::Gauge:
+		sample.value = value_.load(std::memory_order_relaxed);
+		break;
+
+	case Type::Histogram:
+		sample.value = sum_.load(std::memory_order_relaxed);
+		sample.count = count_.load(std::memory_order_relaxed);
+		sample.bounds = bounds_;
+		sample.buckets.resize(bounds_.size() + 1);
+		for (unsigned int i = 0; i <= bounds_.size(); i++)
+			sample.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+		break;
+	}
+
+	return sample;
+}
+
+/**
+ * \brief Retrieve the value of all registered metrics
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The value of the metrics, sorted by name and camera
+ */
+std::vector<Metric::Sample> Metric::snapshot()
+{
+	MetricRegistry &registry = MetricRegistry::instance();
+	std::vector<Sample> samples;
+
+	{
+		MutexLocker locker(registry.mutex);
+
+		samples.reserve(registry.metrics.size());
+		for (const Metric *metric : registry.metrics)
+			samples.push_back(metric->sample());
+	}
+
+	std::stable_sort(samples.begin(), samples.end(),
+			 [](const Sample &a, const Sample &b) {
+				 return std::tie(a.name, a.camera) <
+					std::tie(b.name, b.camera);
+			 });
+
+	/* Merge the metrics registered multiple times under one name. */
+	std::vector<Sample> merged;
+	for (Sample &sample : samples) {
+		if (merged.empty() || merged.back().name != sample.name ||
+		    merged.back().camera != sample.camera ||
+		    merged.back().type != sample.type ||
+		    merged.back().bounds != sample.bounds) {
+			merged.push_back(std::move(sample));
+			continue;
+		}
+
+		Sample &total = merged.back();
+		total.value += sample.value;
+		total.count += sample.count;
+		for (unsigned int i = 0; i < total.buckets.size(); i++)
+			total.buckets[i] += sample.buckets[i];
+	}
+
+	return merged;
+}
+
+namespace {
+
+std::string escapeLabel(const std::string &value)
+{
+	std::string escaped;
+
+	for (char c : value) {
+		switch (c) {
+		case '\\':
+			escaped += "\\\\";
+			break;
+		case '"':
+			escaped += "\\\"";
+			break;
+		case '\n':
+			escaped += "\\n";
+			break;
+		default:
+			escaped += c;
+			break;
+		}
+	}
+
+	return escaped;
+}
+
+std::string labels(const Metric::Sample &sample, const std::string &extra = {})
+{
+	std::string labels;
+
+	if (!sample.camera.empty())
+		labels = "camera=\"" + escapeLabel(sample.camera) + "\"";
+
+	if (!extra.empty())
+		labels += (labels.empty() ? "" : ",") + extra;
+
+	return labels.empty() ? "" : "{" + labels + "}";
+}
+
+} /* namespace */
+
+/**
+ * \brief Format metrics in the Prometheus text exposition format
+ * \param[in] samples The metrics, as returned by snapshot()
+ *
+ * The metric names are prefixed with "libcamera_", and the camera ID is
+ * reported in a "camera" label.
+ *
+ * \return The metrics in the Prometheus text format
+ */
+std::string Metric::toPrometheus(const std::vector<Sample> &samples)
+{
+	static const char *const typeNames[] = {
+		"counter", "gauge", "histogram",
+	};
+
+	std::ostringstream out;
+	const std::string *lastName = nullptr;
+
+	for (const Sample &sample : samples) {
+		const std::string name = "libcamera_" + sample.name;
+
+		if (!lastName || *lastName != sample.name)
+			out << "# TYPE " << name << " "
+			    << typeNames[static_cast<unsigned int>(sample.type)]
+			    << "\n";
+		lastName = &sample.name;
+
+		if (sample.type != Type::Histogram) {
+			out << name << labels(sample) << " " << sample.value << "\n";
+			continue;
+		}
+
+		uint64_t cumulative = 0;
+		for (unsigned int i = 0; i < sample.buckets.size(); i++) {
+			cumulative += sample.buckets[i];
+
+			std::ostringstream le;
+			if (i < sample.bounds.size())
+				le << sample.bounds[i];
+			else
+				le << "+Inf";
+
+			out << name << "_bucket"
+			    << labels(sample, "le=\"" + le.str() + "\"")
+			    << " " << cumulative << "\n";
+		}
+
+		out << name << "_sum" << labels(sample) << " " << sample.value << "\n";
+		out << name << "_count" << labels(sample) << " " << sample.count << "\n";
+	}
+
+	return out.str();
+}
+
+/**
+ * \class CounterMetric
+ * \brief A metric counting events
+ *
+ * Counters start at 0 and only increase, for instance to count the number of
+ * dropped frames.
+ */
+
+/**
+ * \brief Construct and register a counter
+ * \param[in] name The metric name
+ * \param[in] camera The ID of the camera the metric relates to
+ */
+CounterMetric::CounterMetric(const std::string &name, const std::string &camera)
+	: Metric(Type::Counter, name, camera)
+{
+}
+
+/**
+ * \fn CounterMetric::increment()
+ * \brief Increment the counter
+ * \param[in] value The value to add to the counter
+ *
+ * \context This function is \threadsafe.
+ */
+
+/**
+ * \fn CounterMetric::value()
+ * \brief Retrieve the counter value
+ * \return The counter value
+ */
+
+/**
+ * \class GaugeMetric
+ * \brief A metric reporting a value that can go up and down
+ *
+ * Gauges report instantaneous values, for instance the depth of a queue.
+ */
+
+/**
+ * \brief Construct and register a gauge
+ * \param[in] name The metric name
+ * \param[in] camera The ID of the camera the metric relates to
+ */
+GaugeMetric::GaugeMetric(const std::string &name, const std::string &camera)
+	: Metric(Type::Gauge, name, camera)
+{
+}
+
+/**
+ * \fn GaugeMetric::set()
+ * \brief Set the gauge value
+ * \param[in] value The new value
+ *
+ * \context This function is \threadsafe.
+ */
+
+/**
+ * \fn GaugeMetric::add()
+ * \brief Add to the gauge value
+ * \param[in] value The value to add, which may be negative
+ *
+ * \context This function is \threadsafe.
+ */
+
+/**
+ * \fn GaugeMetric::value()
+ * \brief Retrieve the gauge value
+ * \return The gauge value
+ */
+
+/**
+ * \class HistogramMetric
+ * \brief A metric reporting the distribution of values
+ *
+ * Histograms count the observed values in buckets with fixed upper bounds,
+ * for instance to report the distribution of a processing time. An additional
+ * bucket counts the values larger than the last bound. The sum and number of
+ * the observed values are also recorded.
+ */
+
+/**
+ * \brief Construct and register a histogram
+ * \param[in] name The metric name
+ * \param[in] camera The ID of the camera the metric relates to
+ * \param[in] bounds The upper bounds of the buckets
+ */
+HistogramMetric::HistogramMetric(const std::string &name,
+				 const std::string &camera,
+				 const std::vector<double> &bounds)
+	: Metric(Type::Histogram, name, camera, bounds)
+{
+}
+
+/**
+ * \brief Record an observed value
+ * \param[in] value The value
+ *
+ * \context This function is \threadsafe.
+ */
+void HistogramMetric::observe(double value)
+{
+	unsigned int index = std::lower_bound(bounds_.begin(), bounds_.end(), value)
+			   - bounds_.begin();
+	buckets_[index].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+
+	double sum = sum_.load(std::memory_order_relaxed);
+	while (!sum_.compare_exchange_weak(sum, sum + value,
+					   std::memory_order_relaxed))
+		;
+}
+
+/**
+ * \fn HistogramMetric::bounds()
+ * \brief Retrieve the upper bounds of the buckets
+ * \return The upper bounds of the buckets
+ */
+
+/**
+ * \fn HistogramMetric::count()
+ * \brief Retrieve the number of observed values
+ * \return The number of observed values
+ */
+
+} /* namespace libcamera */
@@ -7,6 +7,8 @@
 
 #include <libcamera/base/signal.h>
 
+#include <algorithm>
+
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/object.h>
 
@@ -28,6 +30,29 @@ Mutex signalsLock;
 
 } /* namespace */
 
+SignalBase::~SignalBase()
+{
+	MutexLocker locker(signalsLock);
+
+	/*
+	 * If the signal is destroyed by one of its slots, notify the ongoing
+	 * emissions and hand the slots disconnected during the emissions,
+	 * which may still be running, over to the outermost one for deletion.
+	 */
+	for (Emission *emission : emissions_)
+		emission->destroyed = true;
+
+	if (!emissions_.empty()) {
+		emissions_.front()->disconnected = std::move(disconnected_);
+		return;
+	}
+
+	locker.unlock();
+
+	for (BoundMethodBase *slot : disconnected_)
+		delete slot;
+}
+
 void SignalBase::connect(BoundMethodBase *slot)
 {
 	MutexLocker locker(signalsLock);
@@ -50,23 +75,75 @@ void SignalBase::disconnect(std::function<bool(SlotList::iterator &)> match)
 	MutexLocker locker(signalsLock);
 
 	for (auto iter = slots_.begin(); iter != slots_.end(); ) {
-		if (match(iter)) {
-			Object *object = (*iter)->object();
-			if (object)
-				object->disconnect(this);
-
-			delete *iter;
-			iter = slots_.erase(iter);
-		} else {
+		if (!*iter || !match(iter)) {
+			++iter;
+			continue;
+		}
+
+		Object *object = (*iter)->object();
+		if (object)
+			object->disconnect(this);
+
+		/*
+		 * Slots can't be deleted or removed from the list while the
+		 * signal is being emitted, as the emission may be about to
+		 * invoke them, and refers to the slots by index. Clear the
+		 * entry and defer the deletion to the end of the emission.
+		 */
+		if (!emissions_.empty()) {
+			disconnected_.push_back(*iter);
+			*iter = nullptr;
 			++iter;
+			continue;
 		}
+
+		delete *iter;
+		iter = slots_.erase(iter);
 	}
 }
 
-SignalBase::SlotList SignalBase::slots()
+size_t SignalBase::beginEmission(Emission *emission)
 {
 	MutexLocker locker(signalsLock);
-	return slots_;
+
+	emissions_.push_back(emission);
+	return slots_.size();
+}
+
+BoundMethodBase *SignalBase::slot(size_t index)
+{
+	MutexLocker locker(signalsLock);
+	return slots_[index];
+}
+
+void SignalBase::endEmission(Emission *emission)
+{
+	MutexLocker locker(signalsLock);
+
+	emissions_.erase(std::find(emissions_.begin(), emissions_.end(), emission));
+
+	if (!emissions_.empty() || disconnected_.empty())
+		return;
+
+	slots_.erase(std::remove(slots_.begin(), slots_.end(), nullptr),
+		     slots_.end());
+
+	std::vector<BoundMethodBase *> disconnected = std::move(disconnected_);
+	disconnected_.clear();
+	locker.unlock();
+
+	for (BoundMethodBase *slot : disconnected)
+		delete slot;
+}
+
+/*
+ * Complete an emission after the signal has been destroyed by a slot, deleting
+ * the slots handed over by the signal's destructor.
+ */
+void SignalBase::abortEmission(Emission *emission)
+{
+	for (BoundMethodBase *slot : emission->disconnected)
+		delete slot;
 }
 
 /**
@@ -198,6 +275,9 @@ SignalBase::SlotList SignalBase::slots()
  * of the arguments (when passed by pointer or reference), the modification is
  * thus visible to all subsequently called slots.
  *
+ * A slot may delete the signal, or the object that contains it. The emission
+ * then stops after the slot returns, and the remaining slots are not called.
+ *
  * This function is not \threadsafe, but thread-safety is guaranteed against
  * concurrent connect() and disconnect() calls.
  */
@@ -7,13 +7,22 @@
 
 #include <libcamera/base/thread.h>
 
+#include <algorithm>
 #include <atomic>
-#include <list>
+#include <errno.h>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/event_dispatcher_epoll.h>
 #include <libcamera/base/event_dispatcher_poll.h>
 #include <libcamera/base/log.h>
 #include <libcamera/base/message.h>
@@ -79,25 +88,134 @@ class ThreadMain;
 
 /**
  * \brief A queue of posted messages
+ *
+ * Messages are linked in the queue through their Message::next_ pointer, to
+ * avoid allocating list nodes. Posting a message is lock-free: producers push
+ * the message on the \ref posted_ stack with an atomic compare-and-swap. The
+ * consumer side, used to dispatch, remove and move messages, collects the
+ * posted messages into the \ref head_ list in posting order with the \ref
+ * mutex_ held. The mutex is thus only contended between the thread that
+ * dispatches messages and the rare removal and move operations.
+ *
+ * All functions but post() shall be called with the \ref mutex_ held.
  */
 class MessageQueue
 {
 public:
+	~MessageQueue();
+
+	void post(std::unique_ptr<Message> msg);
+	void collect();
+	void append(Message *msg);
+	Message *unlink(Message *prev, Message *msg);
+
 	/**
-	 * \brief List of queued Message instances
+	 * \brief Stack of posted messages not collected yet, most recent first
 	 */
-	std::list<std::unique_ptr<Message>> list_;
+	std::atomic<Message *> posted_{ nullptr };
 	/**
-	 * \brief Protects the \ref list_
+	 * \brief First message of the list of collected messages
 	 */
-	Mutex mutex_;
+	Message *head_ = nullptr;
+	/**
+	 * \brief Last message of the list of collected messages
+	 */
+	Message *tail_ = nullptr;
 	/**
-	 * \brief The recursion level for recursive Thread::dispatchMessages()
-	 * calls
+	 * \brief Protects the \ref head_ list
 	 */
-	unsigned int recursion_ = 0;
+	Mutex mutex_;
 };
 
+MessageQueue::~MessageQueue()
+{
+	MutexLocker locker(mutex_);
+
+	collect();
+
+	while (head_)
+		delete unlink(nullptr, head_);
+}
+
+/**
+ * \brief Post a message to the queue
+ * \param[in] msg The message
+ *
+ * \context This function is \threadsafe and lock-free.
+ */
+void MessageQueue::post(std::unique_ptr<Message> msg)
+{
+	Message *message = msg.release();
+	Message *head = posted_.load(std::memory_order_relaxed);
+
+	do {
+		message->next_ = head;
+	} while (!posted_.compare_exchange_weak(head, message,
+						std::memory_order_release,
+						std::memory_order_relaxed));
+}
+
+/**
+ * \brief Move the posted messages to the tail of the \ref head_ list
+ */
+void MessageQueue::collect()
+{
+	Message *posted = posted_.exchange(nullptr, std::memory_order_acquire);
+	if (!posted)
+		return;
+
+	/* Reverse the stack to restore the posting order. */
+	Message *first = nullptr;
+	Message *last = posted;
+	while (posted) {
+		Message *next = posted->next_;
+		posted->next_ = first;
+		first = posted;
+		posted = next;
+	}
+
+	if (tail_)
+		tail_->next_ = first;
+	else
+		head_ = first;
+	tail_ = last;
+}
+
+/**
+ * \brief Append a message to the tail of the \ref head_ list
+ * \param[in] msg The message
+ */
+void MessageQueue::append(Message *msg)
+{
+	msg->next_ = nullptr;
+
+	if (tail_)
+		tail_->next_ = msg;
+	else
+		head_ = msg;
+	tail_ = msg;
+}
+
+/**
+ * \brief Remove a message from the \ref head_ list
+ * \param[in] prev The message preceding \a msg, or nullptr if \a msg is first
+ * \param[in] msg The message
+ * \return The removed message
+ */
+Message *MessageQueue::unlink(Message *prev, Message *msg)
+{
+	if (prev)
+		prev->next_ = msg->next_;
+	else
+		head_ = msg->next_;
+
+	if (tail_ == msg)
+		tail_ = prev;
+
+	msg->next_ = nullptr;
+	return msg;
+}
+
 /**
  * \brief Thread-local internal data
  */
@@ -105,7 +223,8 @@ class ThreadData
 {
 public:
 	ThreadData()
-		: thread_(nullptr), running_(false), dispatcher_(nullptr)
+		: thread_(nullptr), running_(false), tid_(0),
+		  role_(Thread::Role::Default), priority_(0), dispatcher_(nullptr)
 	{
 	}
 
@@ -115,12 +234,23 @@ private:
 	friend class Thread;
 	friend class ThreadMain;
 
+	void loadConfiguration() LIBCAMERA_TSA_REQUIRES(mutex_);
+	int applyAffinity() LIBCAMERA_TSA_REQUIRES(mutex_);
+	int applySchedulingPolicy() LIBCAMERA_TSA_REQUIRES(mutex_);
+
 	Thread *thread_;
+	std::string name_;
 	bool running_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 	pid_t tid_;
 
 	Mutex mutex_;
 
+	Thread::Role role_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::optional<cpu_set_t> affinity_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::optional<cpu_set_t> placement_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::optional<Thread::SchedulingPolicy> policy_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	int priority_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
 	std::atomic<EventDispatcher *> dispatcher_;
 
 	ConditionVariable cv_;
@@ -130,6 +260,276 @@ private:
 	MessageQueue messages_;
 };
 
+namespace {
+
+const char *const schedulingPolicyNames[] = {
+	"other",
+	"batch",
+	"idle",
+	"fifo",
+	"rr",
+};
+
+const int schedulingPolicies[] = {
+	SCHED_OTHER,
+	SCHED_BATCH,
+	SCHED_IDLE,
+	SCHED_FIFO,
+	SCHED_RR,
+};
+
+const char *const roleNames[] = {
+	"",
+	"critical",
+	"housekeeping",
+};
+
+/*
+ * Look up the value associated with a thread name in an environment variable
+ * formatted as a semicolon-separated list of name=value entries.
+ */
+std::optional<std::string> threadEnvironment(const char *variable,
+					     const std::string &name)
+{
+	const char *env = utils::secure_getenv(variable);
+	if (!env || name.empty())
+		return std::nullopt;
+
+	for (const std::string &entry : utils::split(env, ";")) {
+		size_t pos = entry.find('=');
+		if (pos == std::string::npos)
+			continue;
+
+		if (entry.compare(0, pos, name) == 0)
+			return entry.substr(pos + 1);
+	}
+
+	return std::nullopt;
+}
+
+/* Parse a comma-separated CPU list, with ranges expressed as first-last. */
+std::optional<cpu_set_t> parseCpuList(const std::string &list)
+{
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+
+	for (const std::string &range : utils::split(list, ",")) {
+		char *end;
+
+		unsigned long first = strtoul(range.c_str(), &end, 10);
+		unsigned long last = first;
+		if (*end == '-')
+			last = strtoul(end + 1, &end, 10);
+
+		if (range.empty() || *end != '\0' || first > last ||
+		    last >= CPU_SETSIZE)
+			return std::nullopt;
+
+		for (unsigned long cpu = first; cpu <= last; ++cpu)
+			CPU_SET(cpu, &cpuset);
+	}
+
+	return cpuset;
+}
+
+/* Read an unsigned integer from a sysfs attribute of a CPU. */
+std::optional<unsigned long> cpuAttribute(unsigned int cpu, const char *name)
+{
+	std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+			   "/" + name);
+	unsigned long value;
+
+	if (!(file >> value))
+		return std::nullopt;
+
+	return value;
+}
+
+struct CpuClusters {
+	cpu_set_t big;
+	cpu_set_t little;
+};
+
+/*
+ * Group the CPUs the process may run on by capacity, as reported by the kernel
+ * on heterogeneous systems, or by maximum frequency otherwise. The big cluster
+ * contains the CPUs of the highest capacity and the little cluster the CPUs of
+ * the lowest capacity. Systems whose CPUs all have the same capacity have no
+ * clusters.
+ */
+std::optional<CpuClusters> detectCpuClusters()
+{
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+		return std::nullopt;
+
+	std::vector<std::pair<unsigned int, unsigned long>> capacities;
+
+	for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+
+		std::optional<unsigned long> capacity = cpuAttribute(cpu, "cpu_capacity");
+		if (!capacity)
+			capacity = cpuAttribute(cpu, "cpufreq/cpuinfo_max_freq");
+		if (!capacity)
+			return std::nullopt;
+
+		capacities.emplace_back(cpu, *capacity);
+	}
+
+	if (capacities.empty())
+		return std::nullopt;
+
+	auto [min, max] = std::minmax_element(capacities.begin(), capacities.end(),
+					      [](const auto &a, const auto &b) {
+						      return a.second < b.second;
+					      });
+	const unsigned long minCapacity = min->second;
+	const unsigned long maxCapacity = max->second;
+	if (minCapacity == maxCapacity)
+		return std::nullopt;
+
+	CpuClusters clusters;
+	CPU_ZERO(&clusters.big);
+	CPU_ZERO(&clusters.little);
+
+	for (const auto &[cpu, capacity] : capacities) {
+		if (capacity == maxCapacity)
+			CPU_SET(cpu, &clusters.big);
+		else if (capacity == minCapacity)
+			CPU_SET(cpu, &clusters.little);
+	}
+
+	return clusters;
+}
+
+const std::optional<CpuClusters> &cpuClusters()
+{
+	static const std::optional<CpuClusters> clusters = detectCpuClusters();
+	return clusters;
+}
+
+} /* namespace */
+
+/**
+ * \brief Load the thread configuration from the environment
+ *
+ * Override the CPU affinity and scheduling policy of the thread with the
+ * values specified for its name in the LIBCAMERA_THREAD_AFFINITY and
+ * LIBCAMERA_THREAD_SCHEDULING environment variables, if any. The CPUs assigned
+ * to the role of the thread in the LIBCAMERA_THREAD_PLACEMENT environment
+ * variable are used when no affinity is set for the thread.
+ */
+void ThreadData::loadConfiguration()
+{
+	std::optional<std::string> value;
+
+	placement_.reset();
+
+	const char *role = roleNames[static_cast<unsigned int>(role_)];
+	value = threadEnvironment("LIBCAMERA_THREAD_PLACEMENT", role);
+	if (value) {
+		const std::optional<CpuClusters> &clusters = cpuClusters();
+
+		if (*value == "big" || *value == "little") {
+			if (clusters)
+				placement_ = *value == "big" ? clusters->big
+							     : clusters->little;
+			else
+				LOG(Thread, Debug)
+					<< "No CPU clusters, not placing thread "
+					<< name_;
+		} else {
+			placement_ = parseCpuList(*value);
+			if (!placement_)
+				LOG(Thread, Error)
+					<< "Invalid CPU placement '" << *value
+					<< "' for thread role " << role;
+		}
+	}
+
+	value = threadEnvironment("LIBCAMERA_THREAD_AFFINITY", name_);
+	if (value) {
+		std::optional<cpu_set_t> cpuset = parseCpuList(*value);
+		if (cpuset)
+			affinity_ = cpuset;
+		else
+			LOG(Thread, Error)
+				<< "Invalid CPU list '" << *value
+				<< "' for thread " << name_;
+	}
+
+	value = threadEnvironment("LIBCAMERA_THREAD_SCHEDULING", name_);
+	if (value) {
+		std::string policy = value->substr(0, value->find(':'));
+		int priority = 0;
+
+		if (policy.size() < value->size())
+			priority = atoi(value->c_str() + policy.size() + 1);
+
+		unsigned int index;
+		for (index = 0; index < std::size(schedulingPolicyNames); ++index) {
+			if (policy == schedulingPolicyNames[index])
+				break;
+		}
+
+		if (index < std::size(schedulingPolicyNames)) {
+			policy_ = static_cast<Thread::SchedulingPolicy>(index);
+			priority_ = priority;
+		} else {
+			LOG(Thread, Error)
+				<< "Invalid scheduling policy '" << *value
+				<< "' for thread " << name_;
+		}
+	}
+}
+
+/**
+ * \brief Apply the CPU affinity to the running thread
+ * \return 0 on success or a negative error code otherwise
+ */
+int ThreadData::applyAffinity()
+{
+	const std::optional<cpu_set_t> &affinity = affinity_ ? affinity_ : placement_;
+	if (!affinity)
+		return 0;
+
+	if (sched_setaffinity(tid_, sizeof(*affinity), &*affinity) < 0) {
+		int ret = -errno;
+		LOG(Thread, Error)
+			<< "Failed to set CPU affinity of thread " << name_
+			<< ": " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Apply the scheduling policy and priority to the running thread
+ * \return 0 on success or a negative error code otherwise
+ */
+int ThreadData::applySchedulingPolicy()
+{
+	if (!policy_)
+		return 0;
+
+	struct sched_param param = {};
+	param.sched_priority = priority_;
+
+	int policy = schedulingPolicies[static_cast<unsigned int>(*policy_)];
+	if (sched_setscheduler(tid_, policy, &param) < 0) {
+		int ret = -errno;
+		LOG(Thread, Error)
+			<< "Failed to set scheduling policy of thread " << name_
+			<< ": " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
 /**
  * \brief Thread wrapper for the main thread
  */
@@ -224,13 +624,47 @@ ThreadData *ThreadData::current()
  * deleted without being processed when the Thread instance is destroyed.
  */
 
+/**
+ * \enum Thread::SchedulingPolicy
+ * \brief The scheduling policy of a thread
+ * \var Thread::SchedulingPolicy::Other
+ * \brief The default time-sharing policy (SCHED_OTHER)
+ * \var Thread::SchedulingPolicy::Batch
+ * \brief Time-sharing policy for CPU-intensive threads (SCHED_BATCH)
+ * \var Thread::SchedulingPolicy::Idle
+ * \brief Policy for very low priority background threads (SCHED_IDLE)
+ * \var Thread::SchedulingPolicy::Fifo
+ * \brief First in, first out real-time policy (SCHED_FIFO)
+ * \var Thread::SchedulingPolicy::RoundRobin
+ * \brief Round-robin real-time policy (SCHED_RR)
+ */
+
+/**
+ * \enum Thread::Role
+ * \brief The role of a thread, used to place it on CPU clusters
+ * \var Thread::Role::Default
+ * \brief The thread isn't placed
+ * \var Thread::Role::LatencyCritical
+ * \brief The thread runs frame processing work with real-time deadlines
+ * \var Thread::Role::Housekeeping
+ * \brief The thread runs background work without deadlines
+ */
+
 /**
  * \brief Create a thread
+ * \param[in] name The thread name
+ *
+ * The thread \a name is used to identify the thread in the system, and to
+ * select the CPU affinity and scheduling policy configured for the thread in
+ * the LIBCAMERA_THREAD_AFFINITY and LIBCAMERA_THREAD_SCHEDULING environment
+ * variables. Names longer than 15 characters are truncated when set on the
+ * system thread.
  */
-Thread::Thread()
+Thread::Thread(std::string name)
 {
 	data_ = new ThreadData;
 	data_->thread_ = this;
+	data_->name_ = std::move(name);
 }
 
 Thread::~Thread()
@@ -239,6 +673,119 @@ Thread::~Thread()
 	delete data_;
 }
 
+/**
+ * \brief Retrieve the thread name
+ * \context This function is \threadsafe.
+ * \return The name of the thread, or an empty string if the thread is unnamed
+ */
+const std::string &Thread::name() const
+{
+	return data_->name_;
+}
+
+/**
+ * \brief Set the CPU affinity of the thread
+ * \param[in] cpus The CPUs the thread is allowed to run on
+ *
+ * If the thread is running, the affinity is applied immediately. Otherwise it
+ * is stored and applied when the thread starts. Affinity configured for the
+ * thread in the LIBCAMERA_THREAD_AFFINITY environment variable takes
+ * precedence when the thread starts.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The \a cpus list is empty or contains an invalid CPU
+ */
+int Thread::setAffinity(const std::vector<unsigned int> &cpus)
+{
+	if (cpus.empty())
+		return -EINVAL;
+
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+
+	for (unsigned int cpu : cpus) {
+		if (cpu >= CPU_SETSIZE) {
+			LOG(Thread, Error) << "Invalid CPU " << cpu;
+			return -EINVAL;
+		}
+
+		CPU_SET(cpu, &cpuset);
+	}
+
+	MutexLocker locker(data_->mutex_);
+
+	data_->affinity_ = cpuset;
+
+	if (!data_->running_ || !data_->tid_)
+		return 0;
+
+	return data_->applyAffinity();
+}
+
+/**
+ * \brief Set the scheduling policy and priority of the thread
+ * \param[in] policy The scheduling policy
+ * \param[in] priority The static priority, for real-time policies only
+ *
+ * The \a priority ranges from 1 (lowest) to 99 (highest) for the
+ * SchedulingPolicy::Fifo and SchedulingPolicy::RoundRobin real-time policies,
+ * and shall be 0 for the other policies. Real-time policies usually require
+ * the CAP_SYS_NICE capability or an appropriate RLIMIT_RTPRIO resource limit.
+ *
+ * If the thread is running, the policy is applied immediately. Otherwise it is
+ * stored and applied when the thread starts, in which case failures are only
+ * logged. The policy configured for the thread in the
+ * LIBCAMERA_THREAD_SCHEDULING environment variable takes precedence when the
+ * thread starts.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The \a priority is invalid for the \a policy
+ */
+int Thread::setSchedulingPolicy(SchedulingPolicy policy, int priority)
+{
+	int sched = schedulingPolicies[static_cast<unsigned int>(policy)];
+	if (priority < sched_get_priority_min(sched) ||
+	    priority > sched_get_priority_max(sched))
+		return -EINVAL;
+
+	MutexLocker locker(data_->mutex_);
+
+	data_->policy_ = policy;
+	data_->priority_ = priority;
+
+	if (!data_->running_ || !data_->tid_)
+		return 0;
+
+	return data_->applySchedulingPolicy();
+}
+
+/**
+ * \brief Set the role of the thread
+ * \param[in] role The thread role
+ *
+ * On heterogeneous systems, such as big.LITTLE SoCs, the CPUs differ in
+ * performance, and threads can be placed on CPU clusters according to their
+ * role with the LIBCAMERA_THREAD_PLACEMENT environment variable. This is
+ * typically used to run latency-critical threads on the big cores and
+ * housekeeping threads on the little cores. The placement applies to threads
+ * whose affinity isn't set with setAffinity() or the LIBCAMERA_THREAD_AFFINITY
+ * environment variable.
+ *
+ * The role is applied when the thread starts.
+ *
+ * \context This function is \threadsafe.
+ */
+void Thread::setRole(Role role)
+{
+	MutexLocker locker(data_->mutex_);
+
+	data_->role_ = role;
+}
+
 /**
  * \brief Start the thread
  */
@@ -250,6 +797,7 @@ void Thread::start()
 		return;
 
 	data_->running_ = true;
+	data_->tid_ = 0;
 	data_->exitCode_ = -1;
 	data_->exit_.store(false, std::memory_order_relaxed);
 
@@ -278,9 +826,21 @@ void Thread::startThread()
 	 */
 	thread_local ThreadCleaner cleaner(this, &Thread::finishThread);
 
-	data_->tid_ = syscall(SYS_gettid);
 	currentThreadData = data_;
 
+	if (!data_->name_.empty())
+		pthread_setname_np(pthread_self(),
+				   data_->name_.substr(0, 15).c_str());
+
+	{
+		MutexLocker locker(data_->mutex_);
+
+		data_->tid_ = syscall(SYS_gettid);
+		data_->loadConfiguration();
+		data_->applyAffinity();
+		data_->applySchedulingPolicy();
+	}
+
 	run();
 }
 
@@ -471,9 +1031,19 @@ pid_t Thread::currentId()
  */
 EventDispatcher *Thread::eventDispatcher()
 {
-	if (!data_->dispatcher_.load(std::memory_order_relaxed))
-		data_->dispatcher_.store(new EventDispatcherPoll(),
-					 std::memory_order_release);
+	if (!data_->dispatcher_.load(std::memory_order_relaxed)) {
+		EventDispatcher *dispatcher;
+
+		/* Use epoll when available, and fall back to poll otherwise. */
+		std::unique_ptr<EventDispatcherEpoll> epoll =
+			std::make_unique<EventDispatcherEpoll>();
+		if (epoll->isValid())
+			dispatcher = epoll.release();
+		else
+			dispatcher = new EventDispatcherPoll();
+
+		data_->dispatcher_.store(dispatcher, std::memory_order_release);
+	}
 
 	return data_->dispatcher_.load(std::memory_order_relaxed);
 }
@@ -506,10 +1076,8 @@ void Thread::postMessage(std::unique_ptr<Message> msg, Object *receiver)
 
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
-	data_->messages_.list_.push_back(std::move(msg));
-	receiver->pendingMessages_++;
-	locker.unlock();
+	receiver->pendingMessages_.fetch_add(1, std::memory_order_relaxed);
+	data_->messages_.post(std::move(msg));
 
 	EventDispatcher *dispatcher =
 		data_->dispatcher_.load(std::memory_order_acquire);
@@ -527,31 +1095,50 @@ void Thread::removeMessages(Object *receiver)
 {
 	ASSERT(data_ == receiver->thread()->data_);
 
-	MutexLocker locker(data_->messages_.mutex_);
+	MessageQueue &queue = data_->messages_;
+
+	MutexLocker locker(queue.mutex_);
 	if (!receiver->pendingMessages_)
 		return;
 
-	std::vector<std::unique_ptr<Message>> toDelete;
-	for (std::unique_ptr<Message> &msg : data_->messages_.list_) {
-		if (!msg)
-			continue;
-		if (msg->receiver_ != receiver)
-			continue;
+	queue.collect();
 
-		/*
-		 * Move the message to the pending deletion list to delete it
-		 * after releasing the lock. The messages list element will
-		 * contain a null pointer, and will be removed when dispatching
-		 * messages.
-		 */
-		toDelete.push_back(std::move(msg));
-		receiver->pendingMessages_--;
+	/*
+	 * Move the messages to a pending deletion list to delete them after
+	 * releasing the lock.
+	 */
+	Message *toDelete = nullptr;
+	Message *prev = nullptr;
+	Message *msg = queue.head_;
+
+	while (msg) {
+		Message *next = msg->next_;
+
+		if (msg->receiver_ == receiver) {
+			queue.unlink(prev, msg);
+			msg->next_ = toDelete;
+			toDelete = msg;
+			receiver->pendingMessages_--;
+		} else {
+			prev = msg;
+		}
+
+		msg = next;
 	}
 
-	ASSERT(!receiver->pendingMessages_);
+	/*
+	 * The pending messages counter is incremented by postMessage() before
+	 * the message is published to the queue, without taking the lock. It
+	 * may thus still account for messages being posted concurrently, which
+	 * will be collected and dispatched later.
+	 */
 	locker.unlock();
 
-	toDelete.clear();
+	while (toDelete) {
+		Message *next = toDelete->next_;
+		delete toDelete;
+		toDelete = next;
+	}
 }
 
 /**
@@ -574,25 +1161,32 @@ void Thread::dispatchMessages(Message::Type type)
 {
 	ASSERT(data_ == ThreadData::current());
 
-	++data_->messages_.recursion_;
+	MessageQueue &queue = data_->messages_;
+	MutexLocker locker(queue.mutex_);
 
-	MutexLocker locker(data_->messages_.mutex_);
+	while (true) {
+		queue.collect();
 
-	std::list<std::unique_ptr<Message>> &messages = data_->messages_.list_;
+		/*
+		 * Find the first message matching the type. The search restarts
+		 * from the head of the list after every message, as the message
+		 * handler may have removed messages from the list, either
+		 * directly or by dispatching them recursively.
+		 */
+		Message *prev = nullptr;
+		Message *msg = queue.head_;
+
+		if (type != Message::Type::None) {
+			while (msg && msg->type() != type) {
+				prev = msg;
+				msg = msg->next_;
+			}
+		}
 
-	for (std::unique_ptr<Message> &msg : messages) {
 		if (!msg)
-			continue;
+			break;
 
-		if (type != Message::Type::None && msg->type() != type)
-			continue;
-
-		/*
-		 * Move the message, setting the entry in the list to null. It
-		 * will cause recursive calls to ignore the entry, and the erase
-		 * loop at the end of the function to delete it from the list.
-		 */
-		std::unique_ptr<Message> message = std::move(msg);
+		std::unique_ptr<Message> message(queue.unlink(prev, msg));
 
 		Object *receiver = message->receiver_;
 		ASSERT(data_ == receiver->thread()->data_);
@@ -603,20 +1197,6 @@ void Thread::dispatchMessages(Message::Type type)
 		message.reset();
 		locker.lock();
 	}
-
-	/*
-	 * If the recursion level is 0, erase all null messages in the list. We
-	 * can't do so during recursion, as it would invalidate the iterator of
-	 * the outer calls.
-	 */
-	if (!--data_->messages_.recursion_) {
-		for (auto iter = messages.begin(); iter != messages.end(); ) {
-			if (!*iter)
-				iter = messages.erase(iter);
-			else
-				++iter;
-		}
-	}
 }
 
 /**
@@ -632,6 +1212,9 @@ void Thread::moveObject(Object *object)
 	MutexLocker lockerTo(targetData->messages_.mutex_, std::defer_lock);
 	std::lock(lockerFrom, lockerTo);
 
+	currentData->messages_.collect();
+	targetData->messages_.collect();
+
 	moveObject(object, currentData, targetData);
 }
 
@@ -640,16 +1223,24 @@ void Thread::moveObject(Object *object, ThreadData *currentData,
 {
 	/* Move pending messages to the message queue of the new thread. */
 	if (object->pendingMessages_) {
+		MessageQueue &from = currentData->messages_;
+		MessageQueue &to = targetData->messages_;
 		unsigned int movedMessages = 0;
 
-		for (std::unique_ptr<Message> &msg : currentData->messages_.list_) {
-			if (!msg)
-				continue;
-			if (msg->receiver_ != object)
-				continue;
+		Message *prev = nullptr;
+		Message *msg = from.head_;
+
+		while (msg) {
+			Message *next = msg->next_;
+
+			if (msg->receiver_ == object) {
+				to.append(from.unlink(prev, msg));
+				movedMessages++;
+			} else {
+				prev = msg;
+			}
 
-			targetData->messages_.list_.push_back(std::move(msg));
-			movedMessages++;
+			msg = next;
 		}
 
 		if (movedMessages) {
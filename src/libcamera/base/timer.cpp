@@ -53,7 +53,8 @@ LOG_DEFINE_CATEGORY(Timer)
  * \param[in] parent The parent Object
  */
 Timer::Timer(Object *parent)
-	: Object(parent), running_(false)
+	: Object(parent), running_(false), queue_(nullptr), prev_(nullptr),
+	  next_(nullptr)
 {
 }
 
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Queue of timers ordered by deadline
+ */
+
+#include <libcamera/base/timer_queue.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/timer.h>
+
+/**
+ * \file base/timer_queue.h
+ * \brief Queue of timers ordered by deadline
+ */
+
+namespace libcamera {
+
+/**
+ * \class TimerQueue
+ * \brief A queue of timers ordered by deadline for event dispatchers
+ *
+ * The TimerQueue stores the running timers of an event dispatcher in deadline
+ * order. The queue is intrusive: timers are linked through pointers stored in
+ * the Timer instances, which makes insertion and removal free of memory
+ * allocation, and removal O(1).
+ *
+ * Insertion searches the position of the timer from the tail of the queue.
+ * Timers are usually started with a duration equal to or longer than the
+ * timers already running, such as watchdogs re-armed for every frame, and
+ * insertion is then O(1) as well.
+ *
+ * A timer can be queued to a single TimerQueue at a time.
+ */
+
+TimerQueue::TimerQueue()
+	: head_(nullptr), tail_(nullptr)
+{
+}
+
+TimerQueue::~TimerQueue()
+{
+	while (head_)
+		remove(head_);
+}
+
+/**
+ * \fn TimerQueue::empty()
+ * \brief Check if the queue is empty
+ * \return True if the queue contains no timer, false otherwise
+ */
+
+/**
+ * \fn TimerQueue::front()
+ * \brief Retrieve the timer with the earliest deadline
+ * \return The timer with the earliest deadline, or nullptr if the queue is
+ * empty
+ */
+
+/**
+ * \brief Insert a timer in the queue
+ * \param[in] timer The timer
+ *
+ * The \a timer is inserted after all the queued timers whose deadline is lower
+ * than or equal to its deadline.
+ */
+void TimerQueue::insert(Timer *timer)
+{
+	ASSERT(!timer->queue_);
+
+	Timer *prev = tail_;
+	while (prev && prev->deadline() > timer->deadline())
+		prev = prev->prev_;
+
+	Timer *next = prev ? prev->next_ : head_;
+
+	timer->prev_ = prev;
+	timer->next_ = next;
+	timer->queue_ = this;
+
+	if (prev)
+		prev->next_ = timer;
+	else
+		head_ = timer;
+
+	if (next)
+		next->prev_ = timer;
+	else
+		tail_ = timer;
+}
+
+/**
+ * \brief Remove a timer from the queue
+ * \param[in] timer The timer
+ *
+ * Removing a timer that isn't queued is a no-op.
+ */
+void TimerQueue::remove(Timer *timer)
+{
+	if (timer->queue_ != this)
+		return;
+
+	if (timer->prev_)
+		timer->prev_->next_ = timer->next_;
+	else
+		head_ = timer->next_;
+
+	if (timer->next_)
+		timer->next_->prev_ = timer->prev_;
+	else
+		tail_ = timer->prev_;
+
+	timer->prev_ = nullptr;
+	timer->next_ = nullptr;
+	timer->queue_ = nullptr;
+}
+
+} /* namespace libcamera */
@@ -9,6 +9,7 @@
 
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <ios>
 #include <memory>
 #include <optional>
@@ -19,14 +20,19 @@
 #include <libcamera/base/thread.h>
 
 #include <libcamera/color_space.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer.h>
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_controls.h"
+#include "libcamera/internal/frame_timing_monitor.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/request.h"
+#include "libcamera/internal/startup_profile.h"
+#include "libcamera/internal/trace_ring.h"
 
 /**
  * \file libcamera/camera.h
@@ -300,7 +306,8 @@ bool SensorConfiguration::isValid() const
  * \brief Create an empty camera configuration
  */
 CameraConfiguration::CameraConfiguration()
-	: orientation(Orientation::Rotate0), config_({})
+	: orientation(Orientation::Rotate0), metadataMode(MetadataMode::Full),
+	  config_({})
 {
 }
 
@@ -563,6 +570,50 @@ CameraConfiguration::Status CameraConfiguration::validateColorSpaces(ColorSpaceF
  * By default the orientation field is set to Orientation::Rotate0.
  */
 
+/**
+ * \enum CameraConfiguration::MetadataMode
+ * \brief How the metadata of completed requests is reported
+ *
+ * \var CameraConfiguration::MetadataMode::Full
+ * \brief Report all the metadata of each request
+ *
+ * \var CameraConfiguration::MetadataMode::Delta
+ * \brief Report only the metadata that changed since the previous request
+ */
+
+/**
+ * \var CameraConfiguration::metadataMode
+ * \brief The mode in which the metadata of completed requests is reported
+ *
+ * In the MetadataMode::Full mode, Request::metadata() holds all the metadata
+ * the pipeline handler produced for the request.
+ *
+ * In the MetadataMode::Delta mode, Request::metadata() only holds the
+ * metadata whose value differs from the one of the previous successfully
+ * completed request, or that wasn't reported since the camera was started.
+ * The first request completed after Camera::start() thus reports all of its
+ * metadata. Metadata which has not changed, such as the colour correction
+ * matrix in manual mode, is then not reported again, which saves applications
+ * from processing it for every frame. Cancelled requests report their
+ * metadata in full and don't affect the delta of the next requests.
+ *
+ * Applications carry the full metadata state by merging the metadata of each
+ * completed request in a list of their own:
+ *
+ * \code{.cpp}
+ * ControlList state(controls::controls);
+ *
+ * void requestComplete(Request *request)
+ * {
+ * 	state.merge(request->metadata(), ControlList::MergePolicy::OverwriteExisting);
+ * }
+ * \endcode
+ *
+ * Metadata that a pipeline handler stops reporting stays in such a state with
+ * its last value. By default the metadataMode field is set to
+ * MetadataMode::Full.
+ */
+
 /**
  * \var CameraConfiguration::config_
  * \brief The vector of stream configurations
@@ -587,7 +638,9 @@ CameraConfiguration::Status CameraConfiguration::validateColorSpaces(ColorSpaceF
  */
 Camera::Private::Private(PipelineHandler *pipe)
 	: requestSequence_(0), pipe_(pipe->shared_from_this()),
-	  disconnected_(false), state_(CameraAvailable)
+	  disconnected_(false), state_(CameraAvailable),
+	  metadataMode_(CameraConfiguration::MetadataMode::Full),
+	  reportedMetadata_(controls::controls)
 {
 }
 
@@ -652,6 +705,80 @@ Camera::Private::~Private()
  * over a single capture session.
  */
 
+/**
+ * \var Camera::Private::queuedRequestsMetric_
+ * \brief The metric reporting the number of requests queued to the device
+ *
+ * \var Camera::Private::completedRequestsMetric_
+ * \brief The metric counting the requests completed successfully
+ *
+ * \var Camera::Private::cancelledRequestsMetric_
+ * \brief The metric counting the cancelled requests
+ *
+ * \var Camera::Private::frameTimingMonitor_
+ * \brief The monitor detecting frame timing jitter and missed frames
+ */
+
+/**
+ * \brief Reduce the metadata of a completed request to the metadata mode
+ * \param[in] request The completed request
+ *
+ * This function is called by the pipeline handler base class for each
+ * request, in completion order, right before it is signalled to the
+ * application. When the camera is configured in the
+ * CameraConfiguration::MetadataMode::Delta mode, it removes from the request
+ * metadata all the controls whose value hasn't changed since they were last
+ * reported.
+ */
+void Camera::Private::reportMetadata(Request *request)
+{
+	if (metadataMode_ != CameraConfiguration::MetadataMode::Delta ||
+	    request->status() != Request::RequestComplete)
+		return;
+
+	ControlList &metadata = request->metadata();
+	ControlList delta(controls::controls);
+
+	for (const auto &[id, value] : metadata) {
+		if (reportedMetadata_.contains(id) && reportedMetadata_.get(id) == value)
+			continue;
+
+		delta.set(id, value);
+	}
+
+	reportedMetadata_.merge(delta, ControlList::MergePolicy::OverwriteExisting);
+	metadata = std::move(delta);
+}
+
+/**
+ * \brief Record the frame timing of a completed request
+ * \param[in] request The completed request
+ *
+ * This function is called by the pipeline handler base class for each
+ * request, in completion order, before the request metadata is reduced by
+ * reportMetadata(). It feeds the sensor timestamp and frame duration reported
+ * in the request metadata, along with the sequence number of the request
+ * buffers, to the frame timing monitor. Requests that have failed or don't
+ * report a sensor timestamp are ignored.
+ */
+void Camera::Private::monitorFrameTiming(const Request *request)
+{
+	if (request->status() != Request::RequestComplete ||
+	    request->buffers().empty())
+		return;
+
+	const ControlList &metadata = request->metadata();
+	const auto timestamp = metadata.get(controls::SensorTimestamp);
+	if (!timestamp)
+		return;
+
+	const auto frameDuration = metadata.get(controls::FrameDuration);
+	const FrameBuffer *buffer = request->buffers().begin()->second;
+
+	frameTimingMonitor_->frameCompleted(buffer->metadata().sequence, *timestamp,
+					    std::chrono::microseconds(frameDuration.value_or(0)));
+}
+
 static const char *const camera_state_names[] = {
 	"Available",
 	"Acquired",
@@ -712,6 +839,87 @@ int Camera::Private::isAccessAllowed(State low, State high,
 	return -EACCES;
 }
 
+int Camera::Private::validateRequest(const Request *request) const
+{
+	/* Requests can only be queued to the camera that created them. */
+	if (request->_d()->camera() != _o<Camera>()) {
+		LOG(Camera, Error) << "Request was not created by this camera";
+		return -EXDEV;
+	}
+
+	if (request->status() != Request::RequestPending) {
+		LOG(Camera, Error) << request->toString() << " is not valid";
+		return -EINVAL;
+	}
+
+	if (request->buffers().empty()) {
+		LOG(Camera, Error) << "Request contains no buffers";
+		return -EINVAL;
+	}
+
+	for (auto const &it : request->buffers()) {
+		const Stream *stream = it.first;
+
+		if (activeStreams_.find(stream) == activeStreams_.end()) {
+			LOG(Camera, Error) << "Invalid request";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+int Camera::Private::applyConfiguration(CameraConfiguration *config,
+					bool reconfigure)
+{
+	for (auto it : *config)
+		it.setStream(nullptr);
+
+	if (config->validate() != CameraConfiguration::Valid) {
+		LOG(Camera, Error)
+			<< "Can't configure camera with invalid configuration";
+		return -EINVAL;
+	}
+
+	std::ostringstream msg(reconfigure ? "reconfiguring streams:"
+					   : "configuring streams:",
+			       std::ios_base::ate);
+
+	for (unsigned int index = 0; index < config->size(); ++index) {
+		StreamConfiguration &cfg = config->at(index);
+		msg << " (" << index << ") " << cfg.toString();
+	}
+
+	LOG(Camera, Info) << msg.str();
+
+	Camera *camera = _o<Camera>();
+	int ret = pipe_->invokeMethod(reconfigure ? &PipelineHandler::reconfigure
+						  : &PipelineHandler::configure,
+				      ConnectionTypeBlocking, camera, config);
+	if (ret)
+		return ret;
+
+	activeStreams_.clear();
+	for (const StreamConfiguration &cfg : *config) {
+		Stream *stream = cfg.stream();
+		if (!stream) {
+			LOG(Camera, Fatal)
+				<< "Pipeline handler failed to update stream configuration";
+			activeStreams_.clear();
+			return -EINVAL;
+		}
+
+		stream->configuration_ = cfg;
+		activeStreams_.insert(stream);
+	}
+
+	metadataMode_ = config->metadataMode;
+
+	setState(CameraConfigured);
+
+	return 0;
+}
+
 void Camera::Private::disconnect()
 {
 	/*
@@ -916,6 +1124,14 @@ Camera::Camera(std::unique_ptr<Private> d, const std::string &id,
 	_d()->id_ = id;
 	_d()->streams_ = streams;
 	_d()->validator_ = std::make_unique<CameraControlValidator>(this);
+
+	_d()->queuedRequestsMetric_ =
+		std::make_unique<GaugeMetric>("requests_queued", id);
+	_d()->completedRequestsMetric_ =
+		std::make_unique<CounterMetric>("requests_completed_total", id);
+	_d()->cancelledRequestsMetric_ =
+		std::make_unique<CounterMetric>("requests_cancelled_total", id);
+	_d()->frameTimingMonitor_ = std::make_unique<FrameTimingMonitor>(id);
 }
 
 Camera::~Camera()
@@ -1178,46 +1394,49 @@ int Camera::configure(CameraConfiguration *config)
 	if (ret < 0)
 		return ret;
 
-	for (auto it : *config)
-		it.setStream(nullptr);
-
-	if (config->validate() != CameraConfiguration::Valid) {
-		LOG(Camera, Error)
-			<< "Can't configure camera with invalid configuration";
-		return -EINVAL;
-	}
-
-	std::ostringstream msg("configuring streams:", std::ios_base::ate);
+	StartupProfile::Scope scope("camera_configure", d->id_);
 
-	for (unsigned int index = 0; index < config->size(); ++index) {
-		StreamConfiguration &cfg = config->at(index);
-		msg << " (" << index << ") " << cfg.toString();
-	}
+	return d->applyConfiguration(config, false);
+}
 
-	LOG(Camera, Info) << msg.str();
+/**
+ * \brief Switch the camera to a new configuration
+ * \param[in] config The new configuration to apply
+ *
+ * This function applies a new configuration to a camera that has already been
+ * configured, and behaves as configure() otherwise. It allows the pipeline
+ * handler to retain the parts of the hardware setup that are not affected by
+ * the difference between the current and new configurations, such as media
+ * links, sensor formats and IPA state, and thus to switch faster between
+ * configurations, for instance between a preview and a still capture
+ * configuration. Pipeline handlers that don't implement a fast path perform a
+ * full configuration.
+ *
+ * The streams stay associated with the same Stream instances when the pipeline
+ * handler assigns them the same roles. Buffers allocated for a stream remain
+ * usable as long as their size is large enough for the new stream
+ * configuration, as reported by StreamConfiguration::frameSize, and
+ * applications don't need to free and reallocate them in that case.
+ *
+ * \context This function may only be called when the camera is in the
+ * Configured state as defined in \ref camera_operation, and shall be
+ * synchronized by the caller with other functions that affect the camera
+ * state.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in the Configured state
+ * \retval -EINVAL The configuration is not valid
+ */
+int Camera::reconfigure(CameraConfiguration *config)
+{
+	Private *const d = _d();
 
-	ret = d->pipe_->invokeMethod(&PipelineHandler::configure,
-				     ConnectionTypeBlocking, this, config);
-	if (ret)
+	int ret = d->isAccessAllowed(Private::CameraConfigured);
+	if (ret < 0)
 		return ret;
 
-	d->activeStreams_.clear();
-	for (const StreamConfiguration &cfg : *config) {
-		Stream *stream = cfg.stream();
-		if (!stream) {
-			LOG(Camera, Fatal)
-				<< "Pipeline handler failed to update stream configuration";
-			d->activeStreams_.clear();
-			return -EINVAL;
-		}
-
-		stream->configuration_ = cfg;
-		d->activeStreams_.insert(stream);
-	}
-
-	d->setState(Private::CameraConfigured);
-
-	return 0;
+	return d->applyConfiguration(config, true);
 }
 
 /**
@@ -1280,6 +1499,7 @@ std::unique_ptr<Request> Camera::createRequest(uint64_t cookie)
  * \retval -EXDEV The request does not belong to this camera
  * \retval -EINVAL The request is invalid
  * \retval -ENOMEM No buffer memory was available to handle the request
+ * \retval -ENOSPC The completion queue is full
  */
 int Camera::queueRequest(Request *request)
 {
@@ -1289,43 +1509,194 @@ int Camera::queueRequest(Request *request)
 	if (ret < 0)
 		return ret;
 
-	/* Requests can only be queued to the camera that created them. */
-	if (request->_d()->camera() != this) {
-		LOG(Camera, Error) << "Request was not created by this camera";
-		return -EXDEV;
-	}
-
-	if (request->status() != Request::RequestPending) {
-		LOG(Camera, Error) << request->toString() << " is not valid";
-		return -EINVAL;
-	}
-
 	/*
 	 * The camera state may change until the end of the function. No locking
 	 * is however needed as PipelineHandler::queueRequest() will handle
 	 * this.
 	 */
 
-	if (request->buffers().empty()) {
-		LOG(Camera, Error) << "Request contains no buffers";
-		return -EINVAL;
+	ret = d->validateRequest(request);
+	if (ret < 0)
+		return ret;
+
+	if (d->completionQueue_ && !d->completionQueue_->reserve(1)) {
+		LOG(Camera, Error) << "Completion queue full";
+		return -ENOSPC;
 	}
 
-	for (auto const &it : request->buffers()) {
-		const Stream *stream = it.first;
+	d->pipe_->invokeMethod(&PipelineHandler::queueRequest,
+			       ConnectionTypeQueued, request);
 
-		if (d->activeStreams_.find(stream) == d->activeStreams_.end()) {
-			LOG(Camera, Error) << "Invalid request";
+	return 0;
+}
+
+/**
+ * \brief Queue a batch of requests to the camera
+ * \param[in] requests The requests to queue to the camera
+ *
+ * This function queues all \a requests to the camera for capture, in the
+ * order they appear in the span. It behaves as calling queueRequest() for
+ * each request, but transfers the whole batch to the pipeline handler in a
+ * single operation, which lowers the overhead for applications that queue
+ * multiple requests at once.
+ *
+ * All requests are validated before any of them is queued. If any request is
+ * invalid, or if the same request appears multiple times, none of the requests
+ * are queued and the error corresponding to the first invalid request is
+ * returned.
+ *
+ * Once the requests have been queued, the camera will notify the completion of
+ * each of them through the \ref requestCompleted signal.
+ *
+ * \context This function is \threadsafe. It may only be called when the camera
+ * is in the Running state as defined in \ref camera_operation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not running so requests can't be queued
+ * \retval -EXDEV A request does not belong to this camera
+ * \retval -EINVAL A request is invalid or queued more than once
+ * \retval -ENOSPC The completion queue can't hold all the requests
+ */
+int Camera::queueRequests(Span<Request *const> requests)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraRunning);
+	if (ret < 0)
+		return ret;
+
+	std::set<const Request *> batch;
+
+	for (Request *request : requests) {
+		ret = d->validateRequest(request);
+		if (ret < 0)
+			return ret;
+
+		if (!batch.insert(request).second) {
+			LOG(Camera, Error)
+				<< request->toString() << " queued more than once";
 			return -EINVAL;
 		}
 	}
 
-	d->pipe_->invokeMethod(&PipelineHandler::queueRequest,
-			       ConnectionTypeQueued, request);
+	if (requests.empty())
+		return 0;
+
+	if (d->completionQueue_ && !d->completionQueue_->reserve(requests.size())) {
+		LOG(Camera, Error) << "Completion queue full";
+		return -ENOSPC;
+	}
+
+	d->pipe_->invokeMethod(&PipelineHandler::queueRequests,
+			       ConnectionTypeQueued,
+			       std::vector<Request *>(requests.begin(), requests.end()));
 
 	return 0;
 }
 
+/**
+ * \brief Enable the completion queue
+ * \param[in] capacity The number of requests the completion queue can hold
+ *
+ * The completion queue is an alternative to the \ref requestCompleted signal
+ * to retrieve completed requests. The signal is emitted in an internal
+ * libcamera thread, and applications commonly defer the processing of
+ * completed requests to their own thread. When the completion queue is
+ * enabled, the camera additionally stores completed requests in a lock-free
+ * queue, and signals them through a file descriptor returned by
+ * completionFd(). The application polls the file descriptor in its own event
+ * loop, and retrieves batches of completed requests with
+ * popCompletedRequests().
+ *
+ * The \a capacity sets the maximum number of requests that can be queued to
+ * the camera or waiting in the completion queue at any time. Queuing more
+ * requests fails with -ENOSPC until completed requests are popped. A capacity
+ * of 0 disables the completion queue.
+ *
+ * The \ref requestCompleted signal is emitted regardless of whether the
+ * completion queue is enabled. Applications should use one of the two
+ * mechanisms only, to avoid processing completed requests twice.
+ *
+ * \context This function may only be called when the camera is in the
+ * Configured state as defined in \ref camera_operation.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera has been disconnected from the system
+ * \retval -EACCES The camera is not in the Configured state
+ * \retval -EBUSY Completed requests haven't been popped from the queue
+ */
+int Camera::enableCompletionQueue(unsigned int capacity)
+{
+	Private *const d = _d();
+
+	int ret = d->isAccessAllowed(Private::CameraConfigured);
+	if (ret < 0)
+		return ret;
+
+	if (d->completionQueue_ && !d->completionQueue_->empty()) {
+		LOG(Camera, Error) << "Completion queue still holds requests";
+		return -EBUSY;
+	}
+
+	d->completionQueue_.reset();
+
+	if (!capacity)
+		return 0;
+
+	std::unique_ptr<CompletionQueue> queue = std::make_unique<CompletionQueue>();
+	ret = queue->init(capacity);
+	if (ret < 0)
+		return ret;
+
+	d->completionQueue_ = std::move(queue);
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve the file descriptor signalling completed requests
+ *
+ * The file descriptor becomes readable when completed requests are available
+ * in the completion queue. Applications shall not read from the file
+ * descriptor, but call popCompletedRequests() instead. The file descriptor
+ * remains owned by the camera and is valid until the completion queue is
+ * disabled.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The file descriptor, or -1 if the completion queue is not enabled
+ */
+int Camera::completionFd() const
+{
+	const Private *const d = _d();
+
+	return d->completionQueue_ ? d->completionQueue_->fd() : -1;
+}
+
+/**
+ * \brief Retrieve completed requests from the completion queue
+ * \param[out] requests The array to store the completed requests in
+ *
+ * Pop up to requests.size() completed requests from the completion queue, in
+ * completion order. Requests remaining in the queue keep the file descriptor
+ * returned by completionFd() readable.
+ *
+ * \context This function shall not be called concurrently from multiple
+ * threads.
+ *
+ * \return The number of requests stored in \a requests
+ */
+std::size_t Camera::popCompletedRequests(Span<Request *> requests)
+{
+	Private *const d = _d();
+
+	if (!d->completionQueue_)
+		return 0;
+
+	return d->completionQueue_->pop(requests);
+}
+
 /**
  * \brief Start capture from camera
  * \param[in] controls Controls to be applied before starting the Camera
@@ -1356,6 +1727,10 @@ int Camera::start(const ControlList *controls)
 
 	ASSERT(d->requestSequence_ == 0);
 
+	/* The first request reports all its metadata in the delta mode. */
+	d->reportedMetadata_.clear();
+	d->frameTimingMonitor_->reset();
+
 	ret = d->pipe_->invokeMethod(&PipelineHandler::start,
 				     ConnectionTypeBlocking, this, controls);
 	if (ret)
@@ -1405,6 +1780,13 @@ int Camera::stop()
 
 	ASSERT(!d->pipe_->hasPendingRequests(this));
 
+	TraceRing *ring = TraceRing::instance();
+	if (ring) {
+		std::ostringstream trace;
+		ring->dump(trace);
+		LOG(Camera, Info) << "Frame trace:\n" << trace.str();
+	}
+
 	d->setState(Private::CameraConfigured);
 
 	return 0;
@@ -1424,6 +1806,9 @@ void Camera::requestComplete(Request *request)
 				  true))
 		LOG(Camera, Fatal) << "Trying to complete a request when stopped";
 
+	if (_d()->completionQueue_)
+		_d()->completionQueue_->push(request);
+
 	requestCompleted.emit(request);
 }
 
@@ -0,0 +1,454 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Synchronized capture from multiple cameras
+ */
+
+#include "libcamera/internal/camera_group.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <limits>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/request.h>
+
+/**
+ * \file libcamera/camera_group.h
+ * \brief Synchronized capture from multiple cameras
+ */
+
+/**
+ * \internal
+ * \file libcamera/internal/camera_group.h
+ * \brief Camera group private data
+ */
+
+using namespace std::literals::chrono_literals;
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CameraGroup)
+
+namespace {
+
+/* Default maximum difference between the timestamps of matched frames */
+constexpr std::chrono::nanoseconds kDefaultTolerance = 1ms;
+
+/* Maximum number of completed requests held per camera waiting for a match */
+constexpr unsigned int kMaxPending = 4;
+
+/*
+ * Fraction of the phase error corrected on each frame, and maximum correction
+ * of the frame duration relative to the reference frame duration. The gain is
+ * kept low as the frame duration only takes effect after the sensor and
+ * request queue delays, a larger gain would overshoot.
+ */
+constexpr double kPhaseGain = 0.25;
+constexpr double kMaxCorrection = 0.05;
+
+int64_t timestamp(Request *request)
+{
+	return request->metadata().get(controls::SensorTimestamp).value_or(0);
+}
+
+} /* namespace */
+
+/**
+ * \class CameraGroup::Private
+ * \brief Base class for CameraGroup private data
+ *
+ * The CameraGroup::Private class stores the timing state of the cameras of a
+ * group and the completed requests waiting to be matched.
+ */
+
+/**
+ * \brief Construct a CameraGroup::Private instance
+ * \param[in] cameras The cameras in the group
+ */
+CameraGroup::Private::Private(const std::vector<std::shared_ptr<Camera>> &cameras)
+	: cameras_(cameras), tolerance_(kDefaultTolerance),
+	  members_(cameras.size())
+{
+	for (unsigned int i = 0; i < cameras_.size(); i++) {
+		const ControlInfoMap &controls = cameras_[i]->controls();
+
+		members_[i].frameDurationControl =
+			controls.find(&controls::FrameDurationLimits) != controls.end();
+
+		cameras_[i]->requestCompleted.connect(this, [this, i](Request *request) {
+			requestComplete(i, request);
+		});
+	}
+}
+
+CameraGroup::Private::~Private()
+{
+	for (const std::shared_ptr<Camera> &camera : cameras_)
+		camera->requestCompleted.disconnect(this);
+}
+
+/**
+ * \var CameraGroup::Private::cameras_
+ * \brief The cameras in the group, the first one being the timing reference
+ */
+
+/**
+ * \var CameraGroup::Private::tolerance_
+ * \brief The maximum difference between the timestamps of matched frames
+ */
+
+/**
+ * \brief Reset the timing state of the group
+ */
+void CameraGroup::Private::reset()
+{
+	MutexLocker locker(mutex_);
+
+	for (Member &member : members_) {
+		member.timestamp.reset();
+		member.frameDuration.reset();
+	}
+
+	referenceDuration_.reset();
+}
+
+/**
+ * \brief Apply the frame timing correction to a request
+ * \param[in] index The index of the camera in the group
+ * \param[in] request The request about to be queued to the camera
+ *
+ * Set the FrameDurationLimits control in \a request to the frame duration
+ * computed from the phase error of camera \a index relative to the reference
+ * camera. The reference camera, and cameras that don't support the control,
+ * are left untouched.
+ */
+void CameraGroup::Private::applyTiming(unsigned int index, Request *request)
+{
+	MutexLocker locker(mutex_);
+
+	const Member &member = members_[index];
+	if (!member.frameDurationControl || !member.frameDuration)
+		return;
+
+	int64_t duration = *member.frameDuration;
+	request->controls().set(controls::FrameDurationLimits, { duration, duration });
+}
+
+/*
+ * Track the frame timing of the cameras. The frame duration of the reference
+ * camera is the target, the frame duration of the other cameras is adjusted to
+ * bring the start of their frames in phase with the reference camera.
+ */
+void CameraGroup::Private::updateTiming(unsigned int index, Request *request)
+{
+	const ControlList &metadata = request->metadata();
+	int64_t ts = timestamp(request);
+	Member &member = members_[index];
+
+	if (index == 0) {
+		std::optional<int64_t> duration = metadata.get(controls::FrameDuration);
+		if (duration)
+			referenceDuration_ = *duration;
+		else if (member.timestamp && ts > *member.timestamp)
+			referenceDuration_ = (ts - *member.timestamp) / 1000;
+
+		member.timestamp = ts;
+		return;
+	}
+
+	member.timestamp = ts;
+
+	const Member &reference = members_[0];
+	if (!member.frameDurationControl || !referenceDuration_ ||
+	    !reference.timestamp || *referenceDuration_ <= 0)
+		return;
+
+	/*
+	 * The phase error is the offset of the frame relative to the closest
+	 * frame start of the reference camera. A positive error means the
+	 * camera lags behind the reference, and its frames must be shortened.
+	 */
+	int64_t period = *referenceDuration_ * 1000;
+	int64_t error = (ts - *reference.timestamp) % period;
+	if (error >= period / 2)
+		error -= period;
+	else if (error < -period / 2)
+		error += period;
+
+	int64_t maxCorrection = static_cast<int64_t>(*referenceDuration_ * kMaxCorrection);
+	int64_t correction = static_cast<int64_t>(error * kPhaseGain / 1000);
+	correction = std::clamp(correction, -maxCorrection, maxCorrection);
+
+	member.frameDuration = *referenceDuration_ - correction;
+
+	LOG(CameraGroup, Debug)
+		<< cameras_[index]->id() << " phase error " << error
+		<< "ns, frame duration " << *member.frameDuration << "us";
+}
+
+/*
+ * Match the completed requests of all cameras by timestamp. The oldest pending
+ * requests of all cameras are matched if their timestamps are within the
+ * tolerance of each other, otherwise the requests that are too old to be
+ * matched are dropped.
+ */
+void CameraGroup::Private::match(std::vector<std::vector<Request *>> *sets,
+				 std::vector<Request *> *dropped)
+{
+	while (true) {
+		int64_t latest = std::numeric_limits<int64_t>::min();
+
+		for (const Member &member : members_) {
+			if (member.pending.empty())
+				return;
+
+			latest = std::max(latest, timestamp(member.pending.front()));
+		}
+
+		bool aligned = true;
+
+		for (Member &member : members_) {
+			while (!member.pending.empty() &&
+			       timestamp(member.pending.front()) + tolerance_.count() < latest) {
+				dropped->push_back(member.pending.front());
+				member.pending.pop_front();
+				aligned = false;
+			}
+		}
+
+		if (!aligned)
+			continue;
+
+		std::vector<Request *> &set = sets->emplace_back();
+		for (Member &member : members_) {
+			set.push_back(member.pending.front());
+			member.pending.pop_front();
+		}
+	}
+}
+
+/**
+ * \brief Handle the completion of a request by a camera of the group
+ * \param[in] index The index of the camera in the group
+ * \param[in] request The completed request
+ */
+void CameraGroup::Private::requestComplete(unsigned int index, Request *request)
+{
+	std::vector<std::vector<Request *>> sets;
+	std::vector<Request *> dropped;
+
+	{
+		MutexLocker locker(mutex_);
+
+		if (request->status() != Request::RequestComplete ||
+		    !request->metadata().contains(controls::SensorTimestamp.id())) {
+			dropped.push_back(request);
+		} else {
+			updateTiming(index, request);
+
+			Member &member = members_[index];
+			member.pending.push_back(request);
+			if (member.pending.size() > kMaxPending) {
+				dropped.push_back(member.pending.front());
+				member.pending.pop_front();
+			}
+
+			match(&sets, &dropped);
+		}
+	}
+
+	/* Emit the signals without holding the lock, as handlers may requeue. */
+	CameraGroup *group = _o<CameraGroup>();
+
+	for (Request *req : dropped)
+		group->requestDropped.emit(req);
+
+	for (const std::vector<Request *> &set : sets)
+		group->requestsCompleted.emit(set);
+}
+
+/**
+ * \class CameraGroup
+ * \brief Capture frame-synchronized requests from multiple cameras
+ *
+ * The CameraGroup class captures frames from multiple cameras, typically for
+ * stereo or multi-view applications, and delivers sets of requests whose
+ * frames have been captured at the same time.
+ *
+ * Cameras are added to the group at construction time. They shall be acquired
+ * and configured by the application before the group is started with start().
+ * The application then queues one request per camera with queueRequests(),
+ * instead of queuing requests to the cameras directly.
+ *
+ * The first camera in the group is the timing reference. The frame duration of
+ * the other cameras is adjusted, through the FrameDurationLimits control
+ * added to the requests queued with queueRequests(), to bring the start of
+ * their frames in phase with the reference camera. The timing is measured from
+ * the SensorTimestamp metadata of the completed requests. The frame duration
+ * of cameras that don't support the FrameDurationLimits control is not
+ * adjusted, their frames are only matched.
+ *
+ * Completed requests are matched by timestamp. When all cameras have completed
+ * a request whose timestamps are within the tolerance set by setTolerance(),
+ * the requests are delivered together through the requestsCompleted signal.
+ * Requests that can't be matched, because they have failed or because no frame
+ * from the other cameras has been captured close enough in time, are delivered
+ * through the requestDropped signal. The number of completed requests held
+ * waiting for a match is bounded, applications shall thus keep enough requests
+ * queued to all cameras to sustain capture.
+ */
+
+/**
+ * \brief Construct a CameraGroup from a list of cameras
+ * \param[in] cameras The cameras in the group, the first one being the timing
+ * reference
+ */
+CameraGroup::CameraGroup(const std::vector<std::shared_ptr<Camera>> &cameras)
+	: Extensible(std::make_unique<Private>(cameras))
+{
+}
+
+CameraGroup::~CameraGroup() = default;
+
+/**
+ * \brief Retrieve the cameras in the group
+ * \return The cameras in the group
+ */
+const std::vector<std::shared_ptr<Camera>> &CameraGroup::cameras() const
+{
+	return _d()->cameras_;
+}
+
+/**
+ * \brief Set the maximum difference between the timestamps of matched frames
+ * \param[in] tolerance The timestamp tolerance
+ *
+ * The tolerance defaults to 1ms. It shall be set before starting the group.
+ */
+void CameraGroup::setTolerance(std::chrono::nanoseconds tolerance)
+{
+	_d()->tolerance_ = tolerance;
+}
+
+/**
+ * \brief Start capture on all cameras in the group
+ *
+ * The cameras are started back to back. If any camera fails to start, the
+ * cameras already started are stopped.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CameraGroup::start()
+{
+	Private *const d = _d();
+
+	d->reset();
+
+	for (unsigned int i = 0; i < d->cameras_.size(); i++) {
+		int ret = d->cameras_[i]->start();
+		if (ret < 0) {
+			LOG(CameraGroup, Error)
+				<< "Failed to start camera " << d->cameras_[i]->id();
+
+			while (i--)
+				d->cameras_[i]->stop();
+
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Stop capture on all cameras in the group
+ *
+ * All cameras are stopped. Requests that are pending, including completed
+ * requests waiting for a match, are delivered through the requestDropped
+ * signal before this function returns.
+ *
+ * \return 0 on success or the error code of the first camera that failed to
+ * stop otherwise
+ */
+int CameraGroup::stop()
+{
+	Private *const d = _d();
+	int ret = 0;
+
+	for (const std::shared_ptr<Camera> &camera : d->cameras_) {
+		int err = camera->stop();
+		if (err < 0 && !ret)
+			ret = err;
+	}
+
+	std::vector<Request *> dropped;
+
+	{
+		MutexLocker locker(d->mutex_);
+
+		for (Private::Member &member : d->members_) {
+			dropped.insert(dropped.end(), member.pending.begin(),
+				       member.pending.end());
+			member.pending.clear();
+		}
+	}
+
+	for (Request *request : dropped)
+		requestDropped.emit(request);
+
+	return ret;
+}
+
+/**
+ * \brief Queue one request to each camera in the group
+ * \param[in] requests The requests, one per camera in the order of cameras()
+ *
+ * Each request shall have been created by the camera it is queued to. The
+ * frame timing controls are added to the requests before they are queued. If
+ * queuing a request fails, the requests for the following cameras are not
+ * queued.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The number of requests doesn't match the number of cameras
+ */
+int CameraGroup::queueRequests(const std::vector<Request *> &requests)
+{
+	Private *const d = _d();
+
+	if (requests.size() != d->cameras_.size())
+		return -EINVAL;
+
+	for (unsigned int i = 0; i < requests.size(); i++) {
+		d->applyTiming(i, requests[i]);
+
+		int ret = d->cameras_[i]->queueRequest(requests[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \var CameraGroup::requestsCompleted
+ * \brief Signal emitted when a set of matched requests has completed
+ *
+ * The set contains one request per camera, in the order of cameras(). The
+ * signal is emitted from the camera manager thread.
+ */
+
+/**
+ * \var CameraGroup::requestDropped
+ * \brief Signal emitted when a request can't be matched
+ *
+ * The request is returned to the application, which is responsible for reusing
+ * or freeing it. The signal is emitted from the camera manager thread, or from
+ * the thread calling stop().
+ */
+
+} /* namespace libcamera */
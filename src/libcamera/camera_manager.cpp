@@ -7,7 +7,10 @@
 
 #include "libcamera/internal/camera_manager.h"
 
+#include <string.h>
+
 #include <libcamera/base/log.h>
+#include <libcamera/base/metrics.h>
 #include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
@@ -16,7 +19,9 @@
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/memory_accounting.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/startup_profile.h"
 
 /**
  * \file libcamera/camera_manager.h
@@ -38,13 +43,20 @@ LOG_DEFINE_CATEGORY(Camera)
 
 #ifndef __DOXYGEN_PUBLIC__
 CameraManager::Private::Private()
-	: initialized_(false)
+	: Thread("CameraManager"), initialized_(false)
 {
+	/* The pipeline handlers run in this thread, on the frame path. */
+	setRole(Role::LatencyCritical);
+
 	ipaManager_ = std::make_unique<IPAManager>();
+
+	const char *threads = utils::secure_getenv("LIBCAMERA_PIPELINE_THREADS");
+	usePipelineThreads_ = threads && *threads && strcmp(threads, "0");
 }
 
 int CameraManager::Private::start()
 {
+	utils::time_point begin = utils::clock::now();
 	int status;
 
 	/* Start the thread and wait for initialization to complete. */
@@ -65,6 +77,9 @@ int CameraManager::Private::start()
 		return status;
 	}
 
+	StartupProfile::record("camera_manager_start", {}, utils::clock::now() - begin);
+	LOG(Camera, Info) << "Startup phases: " << StartupProfile::toString();
+
 	return 0;
 }
 
@@ -91,9 +106,13 @@ void CameraManager::Private::run()
 
 int CameraManager::Private::init()
 {
-	enumerator_ = DeviceEnumerator::create();
-	if (!enumerator_ || enumerator_->enumerate())
-		return -ENODEV;
+	{
+		StartupProfile::Scope scope("device_enumeration");
+
+		enumerator_ = DeviceEnumerator::create();
+		if (!enumerator_ || enumerator_->enumerate())
+			return -ENODEV;
+	}
 
 	createPipelineHandlers();
 	enumerator_->devicesAdded.connect(this, &Private::createPipelineHandlers);
@@ -152,9 +171,41 @@ void CameraManager::Private::pipelineFactoryMatch(const PipelineHandlerFactoryBa
 
 	/* Provide as many matching pipelines as possible. */
 	while (1) {
+		StartupProfile::Scope scope("pipeline_match", factory->name());
 		std::shared_ptr<PipelineHandler> pipe = factory->create(o);
-		if (!pipe->match(enumerator_.get()))
-			break;
+
+		if (!usePipelineThreads_) {
+			if (!pipe->match(enumerator_.get()))
+				break;
+		} else {
+			/*
+			 * Run the pipeline handler in a dedicated thread. The
+			 * event notifiers, timers and other objects created by
+			 * the pipeline handler are bound to the thread that
+			 * creates them, match() must thus run in that thread.
+			 * Blocking the camera manager thread until match()
+			 * completes serializes access to the device enumerator
+			 * and the IPA manager.
+			 */
+			std::unique_ptr<Thread> thread = std::make_unique<Thread>(
+				"Pipeline" + std::to_string(pipelineThreads_.size()));
+			thread->start();
+			pipe->moveToThread(thread.get());
+
+			bool matched = pipe->invokeMethod(&PipelineHandler::match,
+							  ConnectionTypeBlocking,
+							  enumerator_.get());
+			if (!matched) {
+				thread->exit();
+				thread->wait();
+
+				/* Delete the pipeline handler before its thread. */
+				pipe.reset();
+				break;
+			}
+
+			pipelineThreads_.push_back(std::move(thread));
+		}
 
 		LOG(Camera, Debug)
 			<< "Pipeline handler \"" << factory->name()
@@ -178,6 +229,16 @@ void CameraManager::Private::cleanup()
 		cameras_.clear();
 	}
 
+	/*
+	 * Cameras created by pipeline handlers running in their own thread are
+	 * deleted by that thread, stop the threads to process the deletion
+	 * requests.
+	 */
+	for (std::unique_ptr<Thread> &thread : pipelineThreads_) {
+		thread->exit();
+		thread->wait();
+	}
+
 	dispatchMessages(Message::Type::DeferredDelete);
 
 	enumerator_.reset(nullptr);
@@ -194,12 +255,12 @@ void CameraManager::Private::cleanup()
  * Device numbers from the SystemDevices property are used by the V4L2
  * compatibility layer to map V4L2 device nodes to Camera instances.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the CameraManager thread, or
+ * from the pipeline handler thread when pipeline handlers run in dedicated
+ * threads.
  */
 void CameraManager::Private::addCamera(std::shared_ptr<Camera> camera)
 {
-	ASSERT(Thread::current() == this);
-
 	MutexLocker locker(mutex_);
 
 	for (const std::shared_ptr<Camera> &c : cameras_) {
@@ -228,12 +289,12 @@ void CameraManager::Private::addCamera(std::shared_ptr<Camera> camera)
  * camera manager. Unregistered cameras won't be reported anymore by the
  * cameras() and get() calls, but references may still exist in applications.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the CameraManager thread, or
+ * from the pipeline handler thread when pipeline handlers run in dedicated
+ * threads.
  */
 void CameraManager::Private::removeCamera(std::shared_ptr<Camera> camera)
 {
-	ASSERT(Thread::current() == this);
-
 	MutexLocker locker(mutex_);
 
 	auto iter = std::find_if(cameras_.begin(), cameras_.end(),
@@ -369,6 +430,133 @@ std::vector<std::shared_ptr<Camera>> CameraManager::cameras() const
 	return d->cameras_;
 }
 
+/**
+ * \struct CameraManager::MemoryUsage
+ * \brief The memory used by libcamera for a category of allocations
+ *
+ * The category identifies the owner of the allocations. Buffers allocated by
+ * V4L2 video devices are reported under the "V4L2" prefix followed by the
+ * device node, buffers allocated from dma-buf heaps by the DmaBufAllocator
+ * under "DmaBufAllocator" and "DmaBufAllocator pool", and shared memory objects
+ * under their name.
+ *
+ * \var CameraManager::MemoryUsage::category
+ * \brief The category of the allocations
+ * \var CameraManager::MemoryUsage::heap
+ * \brief The name of the heap backing the allocations ("cma", "system",
+ * "udmabuf", "memfd" or "driver")
+ * \var CameraManager::MemoryUsage::size
+ * \brief The total size of the allocations in bytes
+ * \var CameraManager::MemoryUsage::count
+ * \brief The number of allocations
+ */
+
+/**
+ * \brief Retrieve the memory allocated by libcamera
+ *
+ * This function reports the memory currently allocated by libcamera and the
+ * pipeline handlers in the calling process, grouped by category and heap. It
+ * covers the buffers allocated internally by V4L2 video devices, the buffers
+ * allocated from dma-buf heaps and shared memory objects. Frame buffers
+ * allocated by applications, and memory allocated by IPA modules running in
+ * isolated processes, are not included.
+ *
+ * The report can be used to track memory leaks or to tune the number of
+ * buffers used by pipeline handlers.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The memory usage, sorted by category
+ */
+std::vector<CameraManager::MemoryUsage> CameraManager::memoryUsage() const
+{
+	std::vector<MemoryUsage> usage;
+
+	for (const MemoryAccount::Usage &u : MemoryAccount::usage())
+		usage.push_back({ u.category, MemoryAccount::heapName(u.heap),
+				  u.size, u.count });
+
+	return usage;
+}
+
+/**
+ * \struct CameraManager::MetricSample
+ * \brief The value of a metric exported by libcamera
+ *
+ * Metrics measure the health and performance of the cameras, such as the
+ * number of dropped frames, the depth of the request queues or the processing
+ * time of frames. They are identified by a name and, for the metrics that
+ * relate to a camera, the camera ID.
+ *
+ * \var CameraManager::MetricSample::name
+ * \brief The metric name
+ * \var CameraManager::MetricSample::camera
+ * \brief The ID of the camera the metric relates to, or an empty string
+ * \var CameraManager::MetricSample::type
+ * \brief The metric type
+ * \var CameraManager::MetricSample::value
+ * \brief The counter or gauge value, or the sum of the observed values for
+ * histograms
+ * \var CameraManager::MetricSample::bounds
+ * \brief The upper bounds of the histogram buckets
+ * \var CameraManager::MetricSample::buckets
+ * \brief The number of observed values in each histogram bucket, the last
+ * bucket counting the values larger than the last bound
+ * \var CameraManager::MetricSample::count
+ * \brief The number of values observed by the histogram
+ */
+
+/**
+ * \enum CameraManager::MetricSample::Type
+ * \brief The type of a metric
+ * \var CameraManager::MetricSample::Type::Counter
+ * \brief A monotonically increasing count
+ * \var CameraManager::MetricSample::Type::Gauge
+ * \brief A value that can go up and down
+ * \var CameraManager::MetricSample::Type::Histogram
+ * \brief A distribution of values in fixed buckets
+ */
+
+/**
+ * \brief Retrieve a snapshot of the metrics exported by libcamera
+ *
+ * This function reports the current value of the metrics of libcamera
+ * and the pipeline handlers in the calling process. Metrics of IPA modules
+ * running in isolated processes are not included.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The metrics, sorted by name and camera
+ */
+std::vector<CameraManager::MetricSample> CameraManager::metrics() const
+{
+	std::vector<MetricSample> metrics;
+
+	for (Metric::Sample &s : Metric::snapshot())
+		metrics.push_back({ std::move(s.name), std::move(s.camera),
+				    static_cast<MetricSample::Type>(s.type),
+				    s.value, std::move(s.bounds),
+				    std::move(s.buckets), s.count });
+
+	return metrics;
+}
+
+/**
+ * \brief Retrieve the metrics exported by libcamera in the Prometheus format
+ *
+ * This function reports the same metrics as metrics(), formatted in the
+ * Prometheus text exposition format. The metric names are prefixed with
+ * "libcamera_", and the camera ID is reported in a "camera" label.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The metrics in the Prometheus text format
+ */
+std::string CameraManager::prometheusMetrics() const
+{
+	return Metric::toPrometheus(Metric::snapshot());
+}
+
 /**
  * \brief Get a camera based on ID
  * \param[in] id ID of camera to get
@@ -404,7 +592,9 @@ std::shared_ptr<Camera> CameraManager::get(const std::string &id)
  * connected to the system. When the signal is emitted the new camera is already
  * available from the list of cameras().
  *
- * The signal is emitted from the CameraManager thread. Applications shall
+ * The signal is emitted from the CameraManager thread, or from the pipeline
+ * handler thread when pipeline handlers run in dedicated threads (see the
+ * LIBCAMERA_PIPELINE_THREADS environment variable). Applications shall
  * minimize the time spent in the signal handler and shall in particular not
  * perform any blocking operation.
  */
@@ -417,7 +607,9 @@ std::shared_ptr<Camera> CameraManager::get(const std::string &id)
  * signal is emitted the camera is not available from the list of cameras()
  * anymore.
  *
- * The signal is emitted from the CameraManager thread. Applications shall
+ * The signal is emitted from the CameraManager thread, or from the pipeline
+ * handler thread when pipeline handlers run in dedicated threads (see the
+ * LIBCAMERA_PIPELINE_THREADS environment variable). Applications shall
  * minimize the time spent in the signal handler and shall in particular not
  * perform any blocking operation.
  */
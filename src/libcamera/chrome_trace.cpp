@@ -0,0 +1,359 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Chrome JSON trace event output
+ */
+
+#include "libcamera/internal/chrome_trace.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/request.h"
+
+/**
+ * \file chrome_trace.h
+ * \brief Chrome JSON trace event output
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(ChromeTrace)
+
+namespace {
+
+const char *const frameStageNames[] = {
+	"StartOfFrame",
+	"SensorDequeue",
+	"IpaPrepareBegin",
+	"IpaPrepareEnd",
+	"IpaProcessBegin",
+	"IpaProcessEnd",
+	"IspQueue",
+	"IspDequeue",
+	"RequestComplete",
+};
+
+/*
+ * Frame flow IDs combine a hash of the pipeline name with the frame sequence
+ * number. The top bit is set to avoid collisions with the request flow IDs,
+ * which are request addresses.
+ */
+uint64_t frameFlowId(const char *pipe, uint32_t frame)
+{
+	uint32_t hash = 2166136261u;
+	for (const char *c = pipe; *c; ++c)
+		hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+
+	return (1ULL << 63) | (static_cast<uint64_t>(hash & 0x7fffffff) << 32) | frame;
+}
+
+uint64_t requestFlowId(const Request *request)
+{
+	return reinterpret_cast<uintptr_t>(request);
+}
+
+std::string requestArgs(const Request *request)
+{
+	std::ostringstream args;
+	args << "\"cookie\": " << request->cookie()
+	     << ", \"sequence\": " << request->sequence()
+	     << ", \"status\": " << static_cast<int>(request->status());
+	return args.str();
+}
+
+std::string escape(const std::string &str)
+{
+	std::string escaped;
+
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20)
+			escaped += c;
+	}
+
+	return escaped;
+}
+
+} /* namespace */
+
+/**
+ * \class ChromeTrace
+ * \brief Write libcamera trace events in the Chrome JSON trace event format
+ *
+ * The ChromeTrace class is an alternative backend to LTTng for the libcamera
+ * tracepoints. It writes the events recorded by the LIBCAMERA_TRACEPOINT(),
+ * LIBCAMERA_TRACEPOINT_IPA_BEGIN(), LIBCAMERA_TRACEPOINT_IPA_END() and
+ * LIBCAMERA_TRACEPOINT_FRAME() macros to a file in the Chrome JSON trace event
+ * format, which can be loaded in Perfetto or chrome://tracing. It is
+ * independent of the meson tracing option, and enabled at runtime by setting
+ * the LIBCAMERA_CHROME_TRACE environment variable to the path of the output
+ * file. The process ID and a .json extension are appended to the path, to keep
+ * the traces of multiple processes separate.
+ *
+ * Events are recorded with the ID of the thread they occur in, and the
+ * threads are named after the libcamera Thread instances. Flows link the
+ * events of a request, from queueing to completion, and the stages of a frame
+ * across the pipeline handler, IPA and ISP threads. As the StartOfFrame and
+ * SensorDequeue stages are identified by the sensor sequence, their link to
+ * the later stages of a frame is only accurate when the sensor and request
+ * sequences match.
+ *
+ * Timestamps are based on the monotonic clock.
+ */
+
+/**
+ * \enum ChromeTrace::Flow
+ * \brief The position of an event in a flow
+ * \var ChromeTrace::Flow::None
+ * \brief The event isn't part of a flow
+ * \var ChromeTrace::Flow::Begin
+ * \brief The event starts a flow
+ * \var ChromeTrace::Flow::Step
+ * \brief The event continues a flow
+ * \var ChromeTrace::Flow::End
+ * \brief The event terminates a flow
+ */
+
+ChromeTrace::ChromeTrace(const std::string &path)
+	: pid_(getpid())
+{
+	MutexLocker locker(mutex_);
+
+	file_.open(path, std::ios::out | std::ios::trunc);
+	if (!file_.is_open()) {
+		LOG(ChromeTrace, Error) << "Failed to open trace file " << path;
+		return;
+	}
+
+	file_ << "[";
+	empty_ = true;
+
+	LOG(ChromeTrace, Info) << "Writing trace events to " << path;
+}
+
+ChromeTrace::~ChromeTrace()
+{
+	MutexLocker locker(mutex_);
+
+	if (file_.is_open())
+		file_ << "\n]\n";
+}
+
+/**
+ * \brief Retrieve the Chrome trace instance
+ * \return The Chrome trace, or nullptr if Chrome trace output is disabled
+ */
+ChromeTrace *ChromeTrace::instance()
+{
+	static std::unique_ptr<ChromeTrace> trace = []() {
+		const char *env = utils::secure_getenv("LIBCAMERA_CHROME_TRACE");
+		if (!env || *env == '\0')
+			return std::unique_ptr<ChromeTrace>();
+
+		std::string path = std::string(env) + "." +
+				   std::to_string(getpid()) + ".json";
+		return std::unique_ptr<ChromeTrace>(new ChromeTrace(path));
+	}();
+
+	return trace.get();
+}
+
+/**
+ * \fn ChromeTrace::trace()
+ * \brief Record a tracepoint, if Chrome trace output is enabled
+ * \param[in] name The tracepoint name
+ * \param[in] args The tracepoint arguments
+ *
+ * Request tracepoints are recorded as part of the request flow. The numerical
+ * arguments of other tracepoints are recorded as event arguments.
+ */
+
+/**
+ * \fn ChromeTrace::traceFrame()
+ * \brief Record a frame stage, if Chrome trace output is enabled
+ * \param[in] pipe The pipeline name, shall stay valid for the process lifetime
+ * \param[in] stage The frame stage
+ * \param[in] frame The frame sequence number
+ */
+
+/**
+ * \fn ChromeTrace::begin()
+ * \brief Record the beginning of an IPA call, if Chrome trace output is enabled
+ * \param[in] pipe The pipeline name
+ * \param[in] func The IPA function name
+ */
+
+/**
+ * \fn ChromeTrace::end()
+ * \brief Record the end of an IPA call, if Chrome trace output is enabled
+ * \param[in] pipe The pipeline name
+ * \param[in] func The IPA function name
+ */
+
+/**
+ * \brief Record a frame stage event
+ * \param[in] pipe The pipeline name
+ * \param[in] stage The frame stage
+ * \param[in] frame The frame sequence number
+ *
+ * The frame stages are linked in a flow, which starts at the StartOfFrame
+ * stage and terminates at the RequestComplete stage.
+ */
+void ChromeTrace::recordFrame(const char *pipe, FrameStage stage, uint32_t frame)
+{
+	unsigned int index = static_cast<unsigned int>(stage);
+	Flow flow = stage == FrameStage::StartOfFrame ? Flow::Begin
+		  : stage == FrameStage::RequestComplete ? Flow::End
+		  : Flow::Step;
+
+	record(index < std::size(frameStageNames) ? frameStageNames[index] : "Unknown",
+	       pipe, frameFlowId(pipe, frame), flow,
+	       "\"frame\": " + std::to_string(frame));
+}
+
+/**
+ * \brief Record the beginning or end of a duration event
+ * \param[in] phase 'B' for the beginning, 'E' for the end
+ * \param[in] category The event category
+ * \param[in] name The event name
+ */
+void ChromeTrace::recordDuration(char phase, const char *category, const char *name)
+{
+	std::chrono::duration<double, std::micro> ts =
+		utils::clock::now().time_since_epoch();
+	pid_t tid = Thread::currentId();
+
+	std::ostringstream event;
+	event << std::fixed << std::setprecision(3)
+	      << "{\"name\": \"" << escape(name) << "\", \"cat\": \""
+	      << escape(category) << "\", \"ph\": \"" << phase
+	      << "\", \"ts\": " << ts.count()
+	      << ", \"pid\": " << pid_ << ", \"tid\": " << tid << "}";
+
+	MutexLocker locker(mutex_);
+	writeThreadName(tid);
+	writeEvent(event.str());
+}
+
+/**
+ * \brief Record an event
+ * \param[in] name The event name
+ * \param[in] category The event category
+ * \param[in] flowId The flow ID, ignored if \a flow is Flow::None
+ * \param[in] flow The position of the event in the flow
+ * \param[in] args The event arguments, as a comma-separated list of JSON
+ * members
+ *
+ * \context This function is \threadsafe.
+ */
+void ChromeTrace::record(const char *name, const char *category, uint64_t flowId,
+			 Flow flow, const std::string &args)
+{
+	std::chrono::duration<double, std::micro> ts =
+		utils::clock::now().time_since_epoch();
+	pid_t tid = Thread::currentId();
+
+	std::ostringstream event;
+	event << std::fixed << std::setprecision(3)
+	      << "{\"name\": \"" << escape(name) << "\", \"cat\": \""
+	      << escape(category) << "\", \"ts\": " << ts.count()
+	      << ", \"pid\": " << pid_ << ", \"tid\": " << tid;
+
+	/*
+	 * Flows bind to slices, record the events that are part of a flow as
+	 * zero-duration complete events.
+	 */
+	if (flow == Flow::None) {
+		event << ", \"ph\": \"i\", \"s\": \"t\"";
+	} else {
+		event << ", \"ph\": \"X\", \"dur\": 0"
+		      << ", \"bind_id\": \"0x" << std::hex << flowId << std::dec << "\"";
+		if (flow != Flow::Begin)
+			event << ", \"flow_in\": true";
+		if (flow != Flow::End)
+			event << ", \"flow_out\": true";
+	}
+
+	if (!args.empty())
+		event << ", \"args\": {" << args << "}";
+
+	event << "}";
+
+	MutexLocker locker(mutex_);
+	writeThreadName(tid);
+	writeEvent(event.str());
+}
+
+void ChromeTrace::tracepoint(const char *name, Request *request)
+{
+	/* Requests flows start when queued, and are reset on reuse. */
+	std::string_view event(name);
+	Flow flow = event == "request_queue" ? Flow::Begin
+		  : event == "request_device_queue" ? Flow::Step
+		  : Flow::None;
+
+	record(name, "request", requestFlowId(request), flow, requestArgs(request));
+}
+
+void ChromeTrace::tracepoint(const char *name, Request::Private *request)
+{
+	const Request *req = request->_o<Request>();
+	std::string_view event(name);
+	Flow flow = event == "request_complete" || event == "request_cancel"
+		  ? Flow::End : Flow::None;
+
+	record(name, "request", requestFlowId(req), flow, requestArgs(req));
+}
+
+void ChromeTrace::tracepoint(const char *name, Request::Private *request,
+			     FrameBuffer *buffer)
+{
+	const Request *req = request->_o<Request>();
+	std::ostringstream args;
+	args << requestArgs(req) << ", \"buffer_status\": "
+	     << static_cast<int>(buffer->metadata().status);
+
+	record(name, "request", requestFlowId(req), Flow::Step, args.str());
+}
+
+void ChromeTrace::writeEvent(const std::string &event)
+{
+	if (!file_.is_open())
+		return;
+
+	file_ << (empty_ ? "\n" : ",\n") << event;
+	empty_ = false;
+}
+
+void ChromeTrace::writeThreadName(pid_t tid)
+{
+	if (!file_.is_open() || !threads_.insert(tid).second)
+		return;
+
+	std::string name = Thread::current()->name();
+	if (name.empty())
+		name = "thread-" + std::to_string(tid);
+
+	std::ostringstream event;
+	event << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid_
+	      << ", \"tid\": " << tid << ", \"args\": {\"name\": \""
+	      << escape(name) << "\"}}";
+
+	writeEvent(event.str());
+}
+
+} /* namespace libcamera */
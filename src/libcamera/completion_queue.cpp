@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Queue of completed requests
+ */
+
+#include "libcamera/internal/completion_queue.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+
+/**
+ * \file completion_queue.h
+ * \brief Queue of completed requests
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Camera)
+
+/**
+ * \class CompletionQueue
+ * \brief Lock-free queue handing completed requests over to the application
+ *
+ * The CompletionQueue stores requests completed by the pipeline handler until
+ * the application retrieves them, and notifies the application through an
+ * eventfd that it can poll. It implements a single-producer single-consumer
+ * ring: requests are pushed from the camera manager thread only, and popped
+ * from a single application thread at a time.
+ *
+ * The ring can't overflow, as slots are reserved when requests are queued to
+ * the camera and released when they are popped from the queue. Queuing
+ * requests fails when all slots are reserved.
+ *
+ * The eventfd is readable as long as the queue contains completed requests.
+ * Completions that occur while the application processes a batch coalesce in a
+ * single wakeup.
+ */
+
+CompletionQueue::CompletionQueue()
+	: mask_(0), capacity_(0), head_(0), tail_(0), reserved_(0)
+{
+}
+
+/**
+ * \brief Initialize the queue
+ * \param[in] capacity The maximum number of requests tracked by the queue
+ *
+ * The \a capacity bounds the number of requests that can be queued to the
+ * camera or waiting in the queue at any time.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CompletionQueue::init(unsigned int capacity)
+{
+	if (!capacity)
+		return -EINVAL;
+
+	eventfd_ = UniqueFD(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+	if (!eventfd_.isValid()) {
+		int ret = -errno;
+		LOG(Camera, Error)
+			<< "Failed to create completion eventfd: "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	size_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	slots_.assign(size, nullptr);
+	mask_ = size - 1;
+	capacity_ = capacity;
+
+	head_.store(0, std::memory_order_relaxed);
+	tail_.store(0, std::memory_order_relaxed);
+	reserved_.store(0, std::memory_order_relaxed);
+
+	return 0;
+}
+
+/**
+ * \fn CompletionQueue::fd()
+ * \brief Retrieve the file descriptor signalling completed requests
+ * \return The eventfd file descriptor, or -1 if the queue isn't initialized
+ */
+
+/**
+ * \brief Check if the queue tracks any request
+ *
+ * The queue is empty when no request is queued to the camera through the queue
+ * and no completed request is waiting to be popped.
+ *
+ * \return True if the queue is empty, false otherwise
+ */
+bool CompletionQueue::empty() const
+{
+	return reserved_.load(std::memory_order_acquire) == 0;
+}
+
+/**
+ * \brief Reserve slots for requests about to be queued to the camera
+ * \param[in] count The number of slots to reserve
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return True if the slots have been reserved, false if the queue is full
+ */
+bool CompletionQueue::reserve(unsigned int count)
+{
+	unsigned int reserved = reserved_.load(std::memory_order_relaxed);
+
+	do {
+		if (reserved + count > capacity_)
+			return false;
+	} while (!reserved_.compare_exchange_weak(reserved, reserved + count,
+						  std::memory_order_relaxed));
+
+	return true;
+}
+
+/**
+ * \brief Push a completed request to the queue
+ * \param[in] request The completed request
+ *
+ * The slot for the \a request must have been reserved with reserve().
+ *
+ * \context This function shall only be called from the camera manager thread.
+ */
+void CompletionQueue::push(Request *request)
+{
+	size_t head = head_.load(std::memory_order_relaxed);
+
+	/* The reservation guarantees that a slot is available. */
+	ASSERT(head - tail_.load(std::memory_order_acquire) < slots_.size());
+
+	slots_[head & mask_] = request;
+	head_.store(head + 1, std::memory_order_release);
+
+	notify();
+}
+
+/**
+ * \brief Pop completed requests from the queue
+ * \param[out] requests The array to store the completed requests
+ *
+ * Pop up to requests.size() completed requests, in completion order, and
+ * release their slots. The eventfd is cleared, unless completed requests are
+ * left in the queue.
+ *
+ * \context This function shall only be called from one thread at a time.
+ *
+ * \return The number of requests stored in \a requests
+ */
+size_t CompletionQueue::pop(Span<Request *> requests)
+{
+	if (!eventfd_.isValid())
+		return 0;
+
+	/*
+	 * Clear the eventfd before reading the ring, to ensure that a request
+	 * pushed concurrently either gets popped now or signals a new event.
+	 */
+	uint64_t value;
+	ssize_t ret = read(eventfd_.get(), &value, sizeof(value));
+	if (ret < 0 && errno != EAGAIN)
+		LOG(Camera, Error)
+			<< "Failed to read completion eventfd: " << strerror(errno);
+
+	size_t tail = tail_.load(std::memory_order_relaxed);
+	size_t head = head_.load(std::memory_order_acquire);
+	size_t count = std::min<size_t>(head - tail, requests.size());
+
+	for (size_t i = 0; i < count; ++i)
+		requests[i] = slots_[(tail + i) & mask_];
+
+	tail_.store(tail + count, std::memory_order_release);
+	reserved_.fetch_sub(count, std::memory_order_relaxed);
+
+	if (head - tail > count)
+		notify();
+
+	return count;
+}
+
+void CompletionQueue::notify()
+{
+	uint64_t value = 1;
+	ssize_t ret = write(eventfd_.get(), &value, sizeof(value));
+	if (ret < 0)
+		LOG(Camera, Error)
+			<< "Failed to signal completion eventfd: " << strerror(errno);
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,215 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Camera configuration validation cache
+ */
+
+#include "libcamera/internal/configuration_cache.h"
+
+#include <algorithm>
+
+/**
+ * \file configuration_cache.h
+ * \brief Memoization of camera configuration validation results
+ */
+
+namespace libcamera {
+
+/**
+ * \class ConfigurationCache
+ * \brief Cache of the results of CameraConfiguration::validate() for a camera
+ *
+ * Applications, the Android camera HAL and the GStreamer element commonly
+ * validate identical configurations many times while negotiating formats.
+ * Pipeline handlers whose validation is costly, for instance because it
+ * searches the sensor formats or queries devices, can use a ConfigurationCache
+ * to skip the search for configurations they have already validated.
+ *
+ * The cache is meant to be stored in the pipeline handler's camera data, one
+ * instance per camera. A pipeline handler's CameraConfiguration::validate()
+ * implementation creates a Key from the configuration before modifying it,
+ * and passes it to lookup(). On a cache hit, it restores the configuration
+ * with restore() and its own validation state from the returned configuration,
+ * and returns the cached status. Otherwise it validates the configuration and
+ * stores a copy of the result with insert().
+ *
+ * Cached results are only valid as long as the configurations supported by
+ * the camera don't change. Pipeline handlers shall clear() the cache when
+ * that happens.
+ *
+ * The cache holds a small number of entries, and evicts the least recently
+ * inserted entry when full. All functions are thread-safe.
+ */
+
+/**
+ * \class ConfigurationCache::Key
+ * \brief The inputs of the validation of a camera configuration
+ *
+ * The Key stores the fields of a CameraConfiguration that influence its
+ * validation: the pixel format, size, stride, buffer count and color space of
+ * each stream, the orientation and the sensor configuration. The other fields
+ * of the streams are outputs of the validation only.
+ */
+
+/**
+ * \brief Construct the key of a camera configuration
+ * \param[in] config The camera configuration, before validation
+ */
+ConfigurationCache::Key::Key(const CameraConfiguration &config)
+	: orientation_(config.orientation), sensorConfig_(config.sensorConfig)
+{
+	streams_.reserve(config.size());
+
+	for (const StreamConfiguration &cfg : config)
+		streams_.push_back({ cfg.pixelFormat, cfg.size, cfg.stride,
+				     cfg.bufferCount, cfg.colorSpace });
+}
+
+/**
+ * \brief Compare two keys for equality
+ * \param[in] other The other key
+ * \return True if the two keys describe identical configurations
+ */
+bool ConfigurationCache::Key::operator==(const Key &other) const
+{
+	if (orientation_ != other.orientation_)
+		return false;
+
+	if (sensorConfig_.has_value() != other.sensorConfig_.has_value())
+		return false;
+
+	if (sensorConfig_) {
+		const SensorConfiguration &a = *sensorConfig_;
+		const SensorConfiguration &b = *other.sensorConfig_;
+
+		if (a.bitDepth != b.bitDepth || a.analogCrop != b.analogCrop ||
+		    a.binning.binX != b.binning.binX ||
+		    a.binning.binY != b.binning.binY ||
+		    a.skipping.xOddInc != b.skipping.xOddInc ||
+		    a.skipping.xEvenInc != b.skipping.xEvenInc ||
+		    a.skipping.yOddInc != b.skipping.yOddInc ||
+		    a.skipping.yEvenInc != b.skipping.yEvenInc ||
+		    a.outputSize != b.outputSize)
+			return false;
+	}
+
+	return std::equal(streams_.begin(), streams_.end(),
+			  other.streams_.begin(), other.streams_.end(),
+			  [](const StreamKey &a, const StreamKey &b) {
+				  return a.pixelFormat == b.pixelFormat &&
+					 a.size == b.size &&
+					 a.stride == b.stride &&
+					 a.bufferCount == b.bufferCount &&
+					 a.colorSpace == b.colorSpace;
+			  });
+}
+
+/**
+ * \brief Construct a ConfigurationCache
+ * \param[in] size The maximum number of cached configurations
+ */
+ConfigurationCache::ConfigurationCache(unsigned int size)
+	: size_(size)
+{
+}
+
+/**
+ * \brief Look up the validation result of a configuration
+ * \param[in] key The key of the configuration to validate
+ * \param[out] status The cached validation status
+ *
+ * The returned configuration is the copy stored by insert(). Callers cast it
+ * to the CameraConfiguration derived class of the pipeline handler to restore
+ * their validation state.
+ *
+ * \return The validated configuration, or nullptr if the key isn't cached
+ */
+std::shared_ptr<const CameraConfiguration>
+ConfigurationCache::lookup(const Key &key, CameraConfiguration::Status *status) const
+{
+	MutexLocker locker(mutex_);
+
+	for (const Entry &entry : entries_) {
+		if (entry.key == key) {
+			*status = entry.status;
+			return entry.config;
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * \brief Store the validation result of a configuration
+ * \param[in] key The key of the configuration, created before validation
+ * \param[in] config A copy of the configuration after validation
+ * \param[in] status The validation status
+ */
+void ConfigurationCache::insert(Key &&key, std::unique_ptr<CameraConfiguration> config,
+				CameraConfiguration::Status status)
+{
+	MutexLocker locker(mutex_);
+
+	if (!size_)
+		return;
+
+	auto it = std::find_if(entries_.begin(), entries_.end(),
+			       [&](const Entry &entry) { return entry.key == key; });
+	if (it != entries_.end())
+		entries_.erase(it);
+	else if (entries_.size() >= size_)
+		entries_.pop_back();
+
+	entries_.push_front({ std::move(key), std::move(config), status });
+}
+
+/**
+ * \brief Drop all cached configurations
+ */
+void ConfigurationCache::clear()
+{
+	MutexLocker locker(mutex_);
+
+	entries_.clear();
+}
+
+/**
+ * \brief Restore a configuration from a cached configuration
+ * \param[in] config The cached configuration
+ * \param[inout] target The configuration being validated
+ * \param[inout] streams The stream configurations of \a target
+ *
+ * Copy the orientation and the sensor configuration of \a config, which
+ * validation may have adjusted, to \a target. Copy the validated fields and the
+ * stream of each stream configuration of \a config to \a streams, dropping the
+ * streams that validation removed. The stream formats of \a streams are
+ * preserved.
+ *
+ * The stream configurations are passed separately as they are only accessible
+ * to the CameraConfiguration derived classes.
+ */
+void ConfigurationCache::restore(const CameraConfiguration &config,
+				 CameraConfiguration *target,
+				 std::vector<StreamConfiguration> *streams)
+{
+	target->orientation = config.orientation;
+	target->sensorConfig = config.sensorConfig;
+
+	streams->resize(std::min<size_t>(streams->size(), config.size()));
+
+	for (unsigned int i = 0; i < streams->size(); i++) {
+		const StreamConfiguration &from = config.at(i);
+		StreamConfiguration &to = (*streams)[i];
+
+		to.pixelFormat = from.pixelFormat;
+		to.size = from.size;
+		to.stride = from.stride;
+		to.frameSize = from.frameSize;
+		to.bufferCount = from.bufferCount;
+		to.colorSpace = from.colorSpace;
+		to.setStream(from.stream());
+	}
+}
+
+} /* namespace libcamera */
@@ -31,6 +31,39 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(Serializer)
 
+namespace {
+
+/*
+ * Call \a func for each control of \a to that differs from \a from, and with a
+ * ControlTypeNone value for each control of \a from absent from \a to. Both
+ * lists store their controls sorted by ID.
+ */
+template<typename Func>
+void diff(const ControlList &from, const ControlList &to, Func func)
+{
+	static const ControlValue none;
+
+	auto a = from.begin();
+	auto b = to.begin();
+
+	while (a != from.end() || b != to.end()) {
+		if (b == to.end() || (a != from.end() && a->first < b->first)) {
+			func(a->first, none);
+			++a;
+		} else if (a == from.end() || b->first < a->first) {
+			func(b->first, b->second);
+			++b;
+		} else {
+			if (a->second != b->second)
+				func(b->first, b->second);
+			++a;
+			++b;
+		}
+	}
+}
+
+} /* namespace */
+
 /**
  * \class ControlSerializer
  * \brief Serializer and deserializer for control-related classes
@@ -83,6 +116,15 @@ LOG_DEFINE_CATEGORY(Serializer)
  * that time. A reset of the serializer invalidates all ControlList and
  * ControlInfoMap that have been previously deserialized. The caller shall thus
  * proceed with care to avoid stale references.
+ *
+ * When incremental serialization is enabled with setIncremental(), ControlList
+ * instances are serialized as a delta against the list last serialized with
+ * the same ControlInfoMap handle and id map type, when the delta is smaller
+ * than the full list. The receiving serializer reconstructs the full list from
+ * its own copy of that baseline. This requires all ControlList packets
+ * produced by the serializer to be deserialized, in order, by a single
+ * receiving serializer, which is the case for the IPA IPC transports.
+ * Resetting the serializer also clears the baselines.
  */
 
 /**
@@ -104,6 +146,7 @@ LOG_DEFINE_CATEGORY(Serializer)
  * \param[in] role The role of the IPC component using the serializer
  */
 ControlSerializer::ControlSerializer(Role role)
+	: incremental_(false)
 {
 	/*
 	 * Initialize the handle numerical space using the role of the
@@ -140,8 +183,20 @@ void ControlSerializer::reset()
 	infoMaps_.clear();
 	controlIds_.clear();
 	controlIdMaps_.clear();
+
+	txBaselines_.clear();
+	rxBaselines_.clear();
 }
 
+/**
+ * \fn ControlSerializer::setIncremental()
+ * \brief Enable or disable incremental ControlList serialization
+ * \param[in] enable True to enable incremental serialization
+ *
+ * Incremental serialization only affects the serialization side. Packets are
+ * deserialized according to their content regardless of this setting.
+ */
+
 size_t ControlSerializer::binarySize(const ControlValue &value)
 {
 	return sizeof(ControlType) + value.data().size_bytes();
@@ -254,6 +309,8 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
 	hdr.size = sizeof(hdr) + entriesSize + valuesSize;
 	hdr.data_offset = sizeof(hdr) + entriesSize;
 	hdr.id_map_type = idMapType;
+	hdr.flags = 0;
+	hdr.reserved[0] = 0;
 
 	buffer.write(&hdr);
 
@@ -306,6 +363,11 @@ int ControlSerializer::serialize(const ControlInfoMap &infoMap,
  * Serialize the \a list into the \a buffer using the serialization format
  * defined by the IPA context interface in ipa_controls.h.
  *
+ * When incremental serialization is enabled, the list may be serialized as a
+ * delta against the previously serialized list. The serialized data is then
+ * smaller than binarySize(), and the number of bytes written to the \a buffer
+ * is reported by its offset.
+ *
  * \return 0 on success, a negative error code otherwise
  * \retval -ENOENT The ControlList is related to an unknown ControlInfoMap
  * \retval -ENOSPC Not enough space is available in the buffer
@@ -340,44 +402,86 @@ int ControlSerializer::serialize(const ControlList &list,
 	else
 		idMapType = IPA_CONTROL_ID_MAP_V4L2;
 
-	size_t entriesSize = list.size() * sizeof(struct ipa_control_value_entry);
+	size_t entries = list.size();
 	size_t valuesSize = 0;
 	for (const auto &ctrl : list)
 		valuesSize += binarySize(ctrl.second);
 
+	/*
+	 * In incremental mode, compute the size of the delta against the
+	 * baseline, and use it if it is smaller than the full list.
+	 */
+	const ControlList *baseline = nullptr;
+	uint32_t flags = 0;
+
+	if (incremental_) {
+		flags |= IPA_CONTROLS_FLAG_BASELINE;
+
+		auto iter = txBaselines_.find(baselineKey(infoMapHandle, idMapType));
+		if (iter != txBaselines_.end()) {
+			size_t deltaEntries = 0;
+			size_t deltaValuesSize = 0;
+
+			diff(iter->second, list,
+			     [&](unsigned int, const ControlValue &value) {
+				     deltaEntries++;
+				     deltaValuesSize += binarySize(value);
+			     });
+
+			if (deltaEntries * sizeof(struct ipa_control_value_entry) + deltaValuesSize <
+			    entries * sizeof(struct ipa_control_value_entry) + valuesSize) {
+				baseline = &iter->second;
+				entries = deltaEntries;
+				valuesSize = deltaValuesSize;
+				flags |= IPA_CONTROLS_FLAG_DELTA;
+			}
+		}
+	}
+
+	size_t entriesSize = entries * sizeof(struct ipa_control_value_entry);
+
 	/* Prepare the packet header. */
 	struct ipa_controls_header hdr;
 	hdr.version = IPA_CONTROLS_FORMAT_VERSION;
 	hdr.handle = infoMapHandle;
-	hdr.entries = list.size();
+	hdr.entries = entries;
 	hdr.size = sizeof(hdr) + entriesSize + valuesSize;
 	hdr.data_offset = sizeof(hdr) + entriesSize;
 	hdr.id_map_type = idMapType;
+	hdr.flags = flags;
+	hdr.reserved[0] = 0;
 
 	buffer.write(&hdr);
 
-	ByteStreamBuffer entries = buffer.carveOut(entriesSize);
+	ByteStreamBuffer entriesBuffer = buffer.carveOut(entriesSize);
 	ByteStreamBuffer values = buffer.carveOut(valuesSize);
 
-	/* Serialize all entries. */
-	for (const auto &ctrl : list) {
-		unsigned int id = ctrl.first;
-		const ControlValue &value = ctrl.second;
-
+	auto storeEntry = [&](unsigned int id, const ControlValue &value) {
 		struct ipa_control_value_entry entry;
 		entry.id = id;
 		entry.type = value.type();
 		entry.is_array = value.isArray();
 		entry.count = value.numElements();
 		entry.offset = values.offset();
-		entries.write(&entry);
+		entriesBuffer.write(&entry);
 
 		store(value, values);
+	};
+
+	/* Serialize all entries. */
+	if (baseline) {
+		diff(*baseline, list, storeEntry);
+	} else {
+		for (const auto &ctrl : list)
+			storeEntry(ctrl.first, ctrl.second);
 	}
 
 	if (buffer.overflow())
 		return -ENOSPC;
 
+	if (incremental_)
+		txBaselines_[baselineKey(infoMapHandle, idMapType)] = list;
+
 	return 0;
 }
 
@@ -538,18 +642,45 @@ ControlInfoMap ControlSerializer::deserialize<ControlInfoMap>(ByteStreamBuffer &
  */
 template<>
 ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer)
+{
+	ControlList ctrls;
+
+	int ret = deserialize(buffer, &ctrls);
+	if (ret)
+		return {};
+
+	return ctrls;
+}
+
+/**
+ * \brief Deserialize a ControlList from a binary buffer into an existing list
+ * \param[in] buffer The memory buffer that contains the serialized list
+ * \param[out] list The control list to deserialize into
+ *
+ * Re-construct a ControlList in \a list from a binary \a buffer containing data
+ * serialized using the serialize() function. The previous contents of \a list
+ * are replaced. When the \a list already refers to the ControlIdMap of the
+ * serialized data, its storage is reused, avoiding memory allocations when
+ * deserializing lists of similar sizes repeatedly.
+ *
+ * \return 0 on success, a negative error code otherwise
+ * \retval -EINVAL The buffer contains invalid data
+ * \retval -ENOENT The ControlList is related to an unknown ControlInfoMap, or
+ * is a delta against an unknown baseline
+ */
+int ControlSerializer::deserialize(ByteStreamBuffer &buffer, ControlList *list)
 {
 	const struct ipa_controls_header *hdr = buffer.read<decltype(*hdr)>();
 	if (!hdr) {
 		LOG(Serializer, Error) << "Out of data";
-		return {};
+		return -EINVAL;
 	}
 
 	if (hdr->version != IPA_CONTROLS_FORMAT_VERSION) {
 		LOG(Serializer, Error)
 			<< "Unsupported controls format version "
 			<< hdr->version;
-		return {};
+		return -EINVAL;
 	}
 
 	ByteStreamBuffer entries = buffer.carveOut(hdr->data_offset - sizeof(*hdr));
@@ -557,7 +688,7 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 
 	if (buffer.overflow()) {
 		LOG(Serializer, Error) << "Out of data";
-		return {};
+		return -EINVAL;
 	}
 
 	/*
@@ -578,7 +709,7 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 		if (iter == infoMapHandles_.end()) {
 			LOG(Serializer, Error)
 				<< "Can't deserialize ControlList: unknown ControlInfoMap";
-			return {};
+			return -ENOENT;
 		}
 
 		const ControlInfoMap *infoMap = iter->first;
@@ -597,8 +728,22 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 		default:
 			LOG(Serializer, Fatal)
 				<< "A list of V4L2 controls requires an ControlInfoMap";
-			return {};
+			return -EINVAL;
+		}
+	}
+
+	uint64_t key = baselineKey(hdr->handle, hdr->id_map_type);
+	const ControlList *baseline = nullptr;
+
+	if (hdr->flags & IPA_CONTROLS_FLAG_DELTA) {
+		auto iter = rxBaselines_.find(key);
+		if (iter == rxBaselines_.end()) {
+			LOG(Serializer, Error)
+				<< "Can't deserialize ControlList: unknown baseline";
+			return -ENOENT;
 		}
+
+		baseline = &iter->second;
 	}
 
 	/*
@@ -607,28 +752,55 @@ ControlList ControlSerializer::deserialize<ControlList>(ByteStreamBuffer &buffer
 	 * Currently no validation is performed, so it's fine relying on the
 	 * idmap only.
 	 */
-	ControlList ctrls(*idMap);
+	if (list->idMap() != idMap)
+		*list = ControlList(*idMap);
+	else
+		list->clear();
+
+	/*
+	 * Delta entries are sorted by ID. Copy the baseline controls that
+	 * precede each entry, and skip the baseline control the entry
+	 * replaces or removes.
+	 */
+	static const ControlList empty;
+	auto base = baseline ? baseline->begin() : empty.begin();
+	auto baseEnd = baseline ? baseline->end() : empty.end();
 
 	for (unsigned int i = 0; i < hdr->entries; ++i) {
 		const struct ipa_control_value_entry *entry =
 			entries.read<decltype(*entry)>();
 		if (!entry) {
 			LOG(Serializer, Error) << "Out of data";
-			return {};
+			return -EINVAL;
 		}
 
 		if (entry->offset != values.offset()) {
 			LOG(Serializer, Error)
 				<< "Bad data, entry offset mismatch (entry "
 				<< i << ")";
-			return {};
+			return -EINVAL;
 		}
 
-		ctrls.set(entry->id,
-			  loadControlValue(values, entry->is_array, entry->count));
+		for (; base != baseEnd && base->first < entry->id; ++base)
+			list->set(base->first, base->second);
+		if (base != baseEnd && base->first == entry->id)
+			++base;
+
+		ControlValue value = loadControlValue(values, entry->is_array,
+						      entry->count);
+		if (baseline && value.isNone())
+			continue;
+
+		list->set(entry->id, value);
 	}
 
-	return ctrls;
+	for (; base != baseEnd; ++base)
+		list->set(base->first, base->second);
+
+	if (hdr->flags & IPA_CONTROLS_FLAG_BASELINE)
+		rxBaselines_[key] = *list;
+
+	return 0;
 }
 
 /**
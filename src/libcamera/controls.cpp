@@ -7,6 +7,7 @@
 
 #include <libcamera/controls.h>
 
+#include <algorithm>
 #include <sstream>
 #include <string.h>
 #include <string>
@@ -63,6 +64,9 @@ static constexpr size_t ControlValueSize[] = {
 	[ControlTypePoint]		= sizeof(Point),
 };
 
+/* Initial number of entries reserved when adding a control to a ControlList. */
+static constexpr size_t kInitialCapacity = 16;
+
 } /* namespace */
 
 /**
@@ -87,10 +91,17 @@ static constexpr size_t ControlValueSize[] = {
 /**
  * \class ControlValue
  * \brief Abstract type representing the value of a control
+ *
+ * Values up to 40 bytes are stored inline in the ControlValue instance. This
+ * covers all scalar controls and the small array controls commonly reported in
+ * per-frame metadata (such as colour gains, black levels, frame duration
+ * limits, a single rectangle or a 3x3 colour correction matrix), which can thus
+ * be set and copied without any memory allocation. Larger values are stored in
+ * heap-allocated memory.
  */
 
 /** \todo Revisit the ControlValue layout when stabilizing the ABI */
-static_assert(sizeof(ControlValue) == 16, "Invalid size of ControlValue class");
+static_assert(sizeof(ControlValue) == 48, "Invalid size of ControlValue class");
 
 /**
  * \brief Construct an empty ControlValue.
@@ -116,7 +127,7 @@ void ControlValue::release()
 {
 	std::size_t size = numElements_ * ControlValueSize[type_];
 
-	if (size > sizeof(value_)) {
+	if (size > kInlineStorageSize) {
 		delete[] reinterpret_cast<uint8_t *>(storage_);
 		storage_ = nullptr;
 	}
@@ -137,6 +148,23 @@ ControlValue::ControlValue(const ControlValue &other)
 	*this = other;
 }
 
+/**
+ * \brief Construct a ControlValue by moving the content of \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The \a other value is left with type ControlTypeNone.
+ */
+ControlValue::ControlValue(ControlValue &&other) noexcept
+	: type_(other.type_), isArray_(other.isArray_),
+	  numElements_(other.numElements_)
+{
+	memcpy(inlineStorage_, other.inlineStorage_, kInlineStorageSize);
+
+	other.type_ = ControlTypeNone;
+	other.isArray_ = false;
+	other.numElements_ = 0;
+}
+
 /**
  * \brief Replace the content of the ControlValue with a copy of the content
  * of \a other
@@ -150,6 +178,34 @@ ControlValue &ControlValue::operator=(const ControlValue &other)
 	return *this;
 }
 
+/**
+ * \brief Replace the content of the ControlValue by moving the content of
+ * \a other
+ * \param[in] other The ControlValue to move content from
+ *
+ * The \a other value is left with type ControlTypeNone.
+ *
+ * \return The ControlValue with its content replaced with the one of \a other
+ */
+ControlValue &ControlValue::operator=(ControlValue &&other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	release();
+
+	type_ = other.type_;
+	isArray_ = other.isArray_;
+	numElements_ = other.numElements_;
+	memcpy(inlineStorage_, other.inlineStorage_, kInlineStorageSize);
+
+	other.type_ = ControlTypeNone;
+	other.isArray_ = false;
+	other.numElements_ = 0;
+
+	return *this;
+}
+
 /**
  * \fn ControlValue::type()
  * \brief Retrieve the data type of the value
@@ -186,9 +242,9 @@ ControlValue &ControlValue::operator=(const ControlValue &other)
 Span<const uint8_t> ControlValue::data() const
 {
 	std::size_t size = numElements_ * ControlValueSize[type_];
-	const uint8_t *data = size > sizeof(value_)
+	const uint8_t *data = size > kInlineStorageSize
 			    ? reinterpret_cast<const uint8_t *>(storage_)
-			    : reinterpret_cast<const uint8_t *>(&value_);
+			    : inlineStorage_;
 	return { data, size };
 }
 
@@ -375,7 +431,7 @@ void ControlValue::reserve(ControlType type, bool isArray, std::size_t numElemen
 	if (oldSize == newSize)
 		return;
 
-	if (newSize > sizeof(value_))
+	if (newSize > kInlineStorageSize)
 		storage_ = reinterpret_cast<void *>(new uint8_t[newSize]);
 }
 
@@ -674,6 +730,13 @@ std::string ControlInfo::toString() const
  * providing access to the mapped elements using numerical ID keys, in addition
  * to the features of the standard unsorted map. All ControlId keys in the map
  * must appear in the ControlIdMap.
+ *
+ * Lookups by numerical ID are the hot path of control validation, and are
+ * served from an index built when the map is constructed. Control IDs are
+ * allocated in contiguous ranges (core, draft and vendor controls, or V4L2
+ * control classes), the index stores one array per range of IDs, indexed by
+ * the offset of the ID in the range. Looking up a numerical ID thus costs a
+ * scan of the handful of ranges and an indexed load, without hashing.
  */
 
 /**
@@ -682,10 +745,14 @@ std::string ControlInfo::toString() const
  */
 
 /**
- * \fn ControlInfoMap::ControlInfoMap(const ControlInfoMap &other)
  * \brief Copy constructor, construct a ControlInfoMap from a copy of \a other
  * \param[in] other The other ControlInfoMap
  */
+ControlInfoMap::ControlInfoMap(const ControlInfoMap &other)
+	: Map(other), idmap_(other.idmap_)
+{
+	buildIndex();
+}
 
 /**
  * \brief Construct a ControlInfoMap from an initializer list
@@ -697,6 +764,8 @@ ControlInfoMap::ControlInfoMap(std::initializer_list<Map::value_type> init,
 	: Map(init), idmap_(&idmap)
 {
 	ASSERT(validate());
+
+	buildIndex();
 }
 
 /**
@@ -711,14 +780,27 @@ ControlInfoMap::ControlInfoMap(Map &&info, const ControlIdMap &idmap)
 	: Map(std::move(info)), idmap_(&idmap)
 {
 	ASSERT(validate());
+
+	buildIndex();
 }
 
 /**
- * \fn ControlInfoMap &ControlInfoMap::operator=(const ControlInfoMap &other)
  * \brief Copy assignment operator, replace the contents with a copy of \a other
  * \param[in] other The other ControlInfoMap
  * \return A reference to the ControlInfoMap
  */
+ControlInfoMap &ControlInfoMap::operator=(const ControlInfoMap &other)
+{
+	if (this == &other)
+		return *this;
+
+	Map::operator=(other);
+	idmap_ = other.idmap_;
+
+	buildIndex();
+
+	return *this;
+}
 
 bool ControlInfoMap::validate()
 {
@@ -760,6 +842,58 @@ bool ControlInfoMap::validate()
 	return true;
 }
 
+/*
+ * Index the map entries by numerical ID. The iterators stored in the index stay
+ * valid as the map is never modified after construction, but they refer to
+ * this instance and the index must thus be rebuilt when the map is copied.
+ */
+void ControlInfoMap::buildIndex()
+{
+	/*
+	 * Gaps between consecutive IDs up to this size are stored as holes in
+	 * the current range, larger gaps start a new range.
+	 */
+	static constexpr unsigned int kMaxIndexGap = 64;
+
+	index_.clear();
+
+	std::vector<iterator> entries;
+	entries.reserve(size());
+	for (iterator it = Map::begin(); it != Map::end(); ++it)
+		entries.push_back(it);
+
+	std::sort(entries.begin(), entries.end(),
+		  [](const iterator &a, const iterator &b) {
+			  return a->first->id() < b->first->id();
+		  });
+
+	for (const iterator &it : entries) {
+		unsigned int id = it->first->id();
+
+		if (index_.empty() ||
+		    id - index_.back().first >= index_.back().entries.size() + kMaxIndexGap)
+			index_.push_back({ id, {} });
+
+		IndexRange &range = index_.back();
+		range.entries.resize(id - range.first, Map::end());
+		range.entries.push_back(it);
+	}
+}
+
+ControlInfoMap::iterator ControlInfoMap::lookup(unsigned int id) const
+{
+	for (const IndexRange &range : index_) {
+		if (id < range.first)
+			break;
+
+		unsigned int offset = id - range.first;
+		if (offset < range.entries.size())
+			return range.entries[offset];
+	}
+
+	return const_cast<ControlInfoMap *>(this)->Map::end();
+}
+
 /**
  * \brief Access specified element by numerical ID
  * \param[in] id The numerical ID
@@ -769,7 +903,11 @@ ControlInfoMap::mapped_type &ControlInfoMap::at(unsigned int id)
 {
 	ASSERT(idmap_);
 
-	return at(idmap_->at(id));
+	iterator iter = lookup(id);
+	if (iter == end())
+		return at(idmap_->at(id));
+
+	return iter->second;
 }
 
 /**
@@ -781,7 +919,11 @@ const ControlInfoMap::mapped_type &ControlInfoMap::at(unsigned int id) const
 {
 	ASSERT(idmap_);
 
-	return at(idmap_->at(id));
+	const_iterator iter = lookup(id);
+	if (iter == end())
+		return at(idmap_->at(id));
+
+	return iter->second;
 }
 
 /**
@@ -791,15 +933,7 @@ const ControlInfoMap::mapped_type &ControlInfoMap::at(unsigned int id) const
  */
 ControlInfoMap::size_type ControlInfoMap::count(unsigned int id) const
 {
-	if (!idmap_)
-		return 0;
-
-	/*
-	 * The ControlInfoMap and its idmap have a 1:1 mapping between their
-	 * entries, we can thus just count the matching entries in idmap to
-	 * avoid an additional lookup.
-	 */
-	return idmap_->count(id);
+	return lookup(id) != end() ? 1 : 0;
 }
 
 /**
@@ -810,14 +944,7 @@ ControlInfoMap::size_type ControlInfoMap::count(unsigned int id) const
  */
 ControlInfoMap::iterator ControlInfoMap::find(unsigned int id)
 {
-	if (!idmap_)
-		return end();
-
-	auto iter = idmap_->find(id);
-	if (iter == idmap_->end())
-		return end();
-
-	return find(iter->second);
+	return lookup(id);
 }
 
 /**
@@ -828,14 +955,7 @@ ControlInfoMap::iterator ControlInfoMap::find(unsigned int id)
  */
 ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
 {
-	if (!idmap_)
-		return end();
-
-	auto iter = idmap_->find(id);
-	if (iter == idmap_->end())
-		return end();
-
-	return find(iter->second);
+	return lookup(id);
 }
 
 /**
@@ -860,6 +980,11 @@ ControlInfoMap::const_iterator ControlInfoMap::find(unsigned int id) const
  * Control lists are constructed with a map of all the controls supported by
  * their object, and an optional ControlValidator to further validate the
  * controls.
+ *
+ * Controls are stored in a vector sorted by numerical ID, which is cheaper to
+ * copy, look up and iterate than a node-based container for the small number
+ * of controls typically held in a list. Iterating over a ControlList visits
+ * the controls in ascending ID order.
  */
 
 /**
@@ -977,8 +1102,8 @@ ControlList::ControlList(const ControlInfoMap &infoMap,
  * Only control lists created from the same ControlIdMap or ControlInfoMap may
  * be merged. Attempting to do otherwise results in undefined behaviour.
  *
- * \todo Reimplement or implement an overloaded version which internally uses
- * std::unordered_map::merge() and accepts a non-const argument.
+ * \todo Implement an overloaded version which accepts a non-const argument
+ * and moves the elements from the \a source.
  */
 void ControlList::merge(const ControlList &source, MergePolicy policy)
 {
@@ -1014,7 +1139,7 @@ void ControlList::merge(const ControlList &source, MergePolicy policy)
  */
 bool ControlList::contains(unsigned int id) const
 {
-	return controls_.find(id) != controls_.end();
+	return lookup(id) != nullptr;
 }
 
 /**
@@ -1109,17 +1234,29 @@ void ControlList::set(unsigned int id, const ControlValue &value)
  * nullptr is returned in that case.
  */
 
+const ControlValue *ControlList::lookup(unsigned int id) const
+{
+	const auto iter = std::lower_bound(controls_.begin(), controls_.end(), id,
+					   [](const auto &entry, unsigned int key) {
+						   return entry.first < key;
+					   });
+	if (iter == controls_.end() || iter->first != id)
+		return nullptr;
+
+	return &iter->second;
+}
+
 const ControlValue *ControlList::find(unsigned int id) const
 {
-	const auto iter = controls_.find(id);
-	if (iter == controls_.end()) {
+	const ControlValue *val = lookup(id);
+	if (!val) {
 		LOG(Controls, Error)
 			<< "Control " << utils::hex(id) << " not found";
 
 		return nullptr;
 	}
 
-	return &iter->second;
+	return val;
 }
 
 ControlValue *ControlList::find(unsigned int id)
@@ -1131,7 +1268,25 @@ ControlValue *ControlList::find(unsigned int id)
 		return nullptr;
 	}
 
-	return &controls_[id];
+	/*
+	 * Controls are commonly added in ascending ID order, append them
+	 * directly in that case.
+	 */
+	if (controls_.empty() || controls_.back().first < id) {
+		if (controls_.capacity() == 0)
+			controls_.reserve(kInitialCapacity);
+
+		return &controls_.emplace_back(id, ControlValue{}).second;
+	}
+
+	auto iter = std::lower_bound(controls_.begin(), controls_.end(), id,
+				     [](const auto &entry, unsigned int key) {
+					     return entry.first < key;
+				     });
+	if (iter->first != id)
+		iter = controls_.emplace(iter, id, ControlValue{});
+
+	return &iter->second;
 }
 
 } /* namespace libcamera */
@@ -160,7 +160,8 @@ Converter::~Converter()
  *
  * This function queues the \a input frame buffer on the output streams of the
  * \a outputs map key and retrieve the output frame buffer indicated by the
- * buffer map value.
+ * buffer map value. The \a outputs may reference a subset of the configured
+ * streams, in which case only those streams process the \a input.
  *
  * \return 0 on success or a negative error code otherwise
  */
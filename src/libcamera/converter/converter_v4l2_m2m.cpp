@@ -522,22 +522,32 @@ int V4L2M2MConverter::queueBuffers(FrameBuffer *input,
 	/*
 	 * Validate the outputs as a sanity check: at least one output is
 	 * required, all outputs must reference a valid stream and no two
-	 * streams can reference same output framebuffers.
+	 * streams can reference same output framebuffers. Streams without an
+	 * output buffer are left idle, each stream being processed in its own
+	 * M2M context.
 	 */
 	if (outputs.empty())
 		return -EINVAL;
 
 	for (auto [stream, buffer] : outputs) {
-		if (!buffer)
+		if (!buffer || streams_.find(stream) == streams_.end())
 			return -EINVAL;
 
 		outputBufs.insert(buffer);
 	}
 
-	if (outputBufs.size() != streams_.size())
+	if (outputBufs.size() != outputs.size())
 		return -EINVAL;
 
-	/* Queue the input and output buffers to all the streams. */
+	/*
+	 * Queue the input and output buffers to all the streams.
+	 *
+	 * \todo Each stream is processed as a separate job in its own M2M
+	 * context, and the device thus reads the input buffer once per stream.
+	 * Scheduling all the outputs of an input as a single job requires
+	 * devices that expose multiple capture queues in one context, which
+	 * the V4L2 M2M API doesn't support yet.
+	 */
 	for (auto [stream, buffer] : outputs) {
 		ret = streams_.at(stream)->queueBuffers(input, buffer);
 		if (ret < 0)
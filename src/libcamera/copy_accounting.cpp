@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Accounting of the frame data accessed by the CPU
+ */
+
+#include "libcamera/internal/copy_accounting.h"
+
+#include <string.h>
+#include <vector>
+
+#include <libcamera/base/utils.h>
+
+/**
+ * \file copy_accounting.h
+ * \brief Accounting of the frame data accessed by the CPU
+ */
+
+namespace libcamera {
+
+namespace {
+
+/* Bucket bounds in bytes, from 64kiB to 64MiB. */
+const std::vector<double> bytesBounds = {
+	64 << 10, 256 << 10, 1 << 20, 4 << 20, 16 << 20, 64 << 20,
+};
+
+} /* namespace */
+
+/**
+ * \class CopyAccount
+ * \brief Account the frame data copied and touched by the CPU in a stage
+ *
+ * On bandwidth-limited platforms, the cost of the frame path is dominated by
+ * the memory traffic of the CPU rather than by computation. The CopyAccount
+ * class records, for every frame processed by a stage of the frame path, the
+ * number of bytes copied by the CPU and the number of bytes of frame buffers
+ * read or written by the CPU. The values are recorded in histograms
+ * registered in the metrics registry as "cpu_bytes_copied_per_frame" and
+ * "cpu_bytes_touched_per_frame", labelled with the stage name. The sum of the
+ * histograms gives the total number of bytes, and their count the number of
+ * frames.
+ *
+ * Accounting is a debug instrumentation, disabled by default and enabled by
+ * setting the LIBCAMERA_COPY_ACCOUNTING environment variable to 1. When
+ * disabled, no metric is registered and active() returns false, allowing
+ * stages to skip computing the values.
+ */
+
+/**
+ * \brief Construct the accounting for a frame path stage
+ * \param[in] stage The stage name
+ *
+ * The histograms are only registered if accounting is enabled().
+ */
+CopyAccount::CopyAccount(const std::string &stage)
+{
+	if (!enabled())
+		return;
+
+	copied_ = std::make_unique<HistogramMetric>("cpu_bytes_copied_per_frame",
+						    stage, bytesBounds);
+	touched_ = std::make_unique<HistogramMetric>("cpu_bytes_touched_per_frame",
+						     stage, bytesBounds);
+}
+
+/**
+ * \brief Check if copy accounting is enabled
+ *
+ * The LIBCAMERA_COPY_ACCOUNTING environment variable is read once, the first
+ * time this function is called.
+ *
+ * \return True if accounting is enabled, false otherwise
+ */
+bool CopyAccount::enabled()
+{
+	static const bool enabled = [] {
+		const char *env = utils::secure_getenv("LIBCAMERA_COPY_ACCOUNTING");
+		return env && !strcmp(env, "1");
+	}();
+
+	return enabled;
+}
+
+/**
+ * \fn CopyAccount::active()
+ * \brief Check if the account records frames
+ * \return True if accounting was enabled when the account was constructed,
+ * false otherwise
+ */
+
+/**
+ * \brief Record the data accessed by the CPU for one frame
+ * \param[in] copied The number of bytes copied
+ * \param[in] touched The number of bytes of frame buffers read or written
+ *
+ * This function does nothing if the account isn't active().
+ */
+void CopyAccount::record(size_t copied, size_t touched)
+{
+	if (!active())
+		return;
+
+	copied_->observe(copied);
+	touched_->observe(touched);
+}
+
+} /* namespace libcamera */
@@ -7,6 +7,8 @@
 
 #include "libcamera/internal/delayed_controls.h"
 
+#include <algorithm>
+
 #include <libcamera/base/log.h>
 
 #include <libcamera/controls.h>
@@ -36,6 +38,21 @@ LOG_DEFINE_CATEGORY(DelayedControls)
  * control depth the controls are guaranteed to take effect for the correct
  * request. The control depth is determined by the control with the greatest
  * delay.
+ *
+ * The set of handled controls is fixed when the instance is created. Their
+ * values are stored in a flat history of fixed size, indexed by the position of
+ * the control in that set, so that pushing, reading and applying controls for
+ * each frame doesn't need to look up or allocate any per-control storage.
+ *
+ * Each set of controls pushed to the queue can be associated with a cookie,
+ * an opaque value that is returned by get() along with the controls in effect
+ * for a frame. Pipeline handlers can use it to identify the context in which
+ * the controls were computed, for instance the IPA frame they originate from.
+ */
+
+/**
+ * \var DelayedControls::kDefaultHistorySize
+ * \brief Default number of entries in the history of control values
  */
 
 /**
@@ -62,6 +79,8 @@ LOG_DEFINE_CATEGORY(DelayedControls)
  * \param[in] device The V4L2 device the controls have to be applied to
  * \param[in] controlParams Map of the numerical V4L2 control ids to their
  * associated control parameters.
+ * \param[in] historySize The number of entries in the history of control
+ * values, rounded up to a power of two
  *
  * The control parameters comprise of delays (in frames) and a priority write
  * flag. If this flag is set, the relevant control is written separately from,
@@ -70,16 +89,24 @@ LOG_DEFINE_CATEGORY(DelayedControls)
  * Only controls specified in \a controlParams are handled. If it's desired to
  * mix delayed controls and controls that take effect immediately the immediate
  * controls must be listed in the \a controlParams map with a delay value of 0.
+ *
+ * The history must hold the controls of all the frames queued ahead of the
+ * frame being read back with get(), in addition to the largest delay. Pipeline
+ * handlers that keep more than a few requests queued, typically with high
+ * frame rate sensor modes, shall increase \a historySize accordingly. The
+ * history always holds at least twice the largest delay.
  */
 DelayedControls::DelayedControls(V4L2Device *device,
-				 const std::unordered_map<uint32_t, ControlParams> &controlParams)
+				 const std::unordered_map<uint32_t, ControlParams> &controlParams,
+				 unsigned int historySize)
 	: device_(device), maxDelay_(0)
 {
 	const ControlInfoMap &controls = device_->controls();
 
 	/*
-	 * Create a map of control ids to delays for controls exposed by the
-	 * device.
+	 * Create the list of controls exposed by the device along with their
+	 * delays. The position of a control in the list indexes its values in
+	 * the history.
 	 */
 	for (auto const &param : controlParams) {
 		auto it = controls.find(param.first);
@@ -94,120 +121,235 @@ DelayedControls::DelayedControls(V4L2Device *device,
 
 		const ControlId *id = it->first;
 
-		controlParams_[id] = param.second;
+		controls_.push_back({ id, param.second });
 
 		LOG(DelayedControls, Debug)
-			<< "Set a delay of " << controlParams_[id].delay
-			<< " and priority write flag " << controlParams_[id].priorityWrite
+			<< "Set a delay of " << param.second.delay
+			<< " and priority write flag " << param.second.priorityWrite
 			<< " for " << id->name();
 
-		maxDelay_ = std::max(maxDelay_, controlParams_[id].delay);
+		maxDelay_ = std::max(maxDelay_, param.second.delay);
 	}
 
+	historySize = std::max(historySize, 2 * maxDelay_ + 1);
+
+	unsigned int entries = 1;
+	while (entries < historySize)
+		entries <<= 1;
+
+	historyMask_ = entries - 1;
+	values_.resize(entries * controls_.size());
+	cookies_.resize(entries);
+
 	reset();
 }
 
+int DelayedControls::findControl(unsigned int id) const
+{
+	for (unsigned int i = 0; i < controls_.size(); i++) {
+		if (controls_[i].id->id() == id)
+			return i;
+	}
+
+	return -1;
+}
+
 /**
  * \brief Reset state machine
+ * \param[in] cookie The cookie associated with the control values retrieved
+ * from the device
  *
  * Resets the state machine to a starting position based on control values
  * retrieved from the device.
  */
-void DelayedControls::reset()
+void DelayedControls::reset(unsigned int cookie)
 {
 	queueCount_ = 1;
 	writeCount_ = 0;
 
 	/* Retrieve control as reported by the device. */
 	std::vector<uint32_t> ids;
-	for (auto const &param : controlParams_)
-		ids.push_back(param.first->id());
+	for (auto const &control : controls_)
+		ids.push_back(control.id->id());
 
 	ControlList controls = device_->getControls(ids);
 
 	/* Seed the control queue with the controls reported by the device. */
-	values_.clear();
+	std::fill(values_.begin(), values_.end(), Info());
 	for (const auto &ctrl : controls) {
-		const ControlId *id = device_->controls().idmap().at(ctrl.first);
+		int index = findControl(ctrl.first);
+		if (index < 0)
+			continue;
+
 		/*
 		 * Do not mark this control value as updated, it does not need
 		 * to be written to to device on startup.
 		 */
-		values_[id][0] = Info(ctrl.second, false);
+		value(0, index) = Info(ctrl.second, false);
 	}
+
+	cookies_[0] = cookie;
 }
 
 /**
  * \brief Push a set of controls on the queue
  * \param[in] controls List of controls to add to the device queue
+ * \param[in] cookie The cookie associated with \a controls
  *
  * Push a set of controls to the control queue. This increases the control queue
  * depth by one.
  *
  * \returns true if \a controls are accepted, or false otherwise
  */
-bool DelayedControls::push(const ControlList &controls)
+bool DelayedControls::push(const ControlList &controls, unsigned int cookie)
 {
 	/* Copy state from previous frame. */
-	for (auto &ctrl : values_) {
-		Info &info = ctrl.second[queueCount_];
-		info = values_[ctrl.first][queueCount_ - 1];
+	for (unsigned int i = 0; i < controls_.size(); i++) {
+		Info &info = value(queueCount_, i);
+		info = value(queueCount_ - 1, i);
 		info.updated = false;
 	}
 
 	/* Update with new controls. */
-	const ControlIdMap &idmap = device_->controls().idmap();
 	for (const auto &control : controls) {
-		const auto &it = idmap.find(control.first);
-		if (it == idmap.end()) {
-			LOG(DelayedControls, Warning)
-				<< "Unknown control " << control.first;
+		int index = findControl(control.first);
+		if (index < 0) {
+			const ControlIdMap &idmap = device_->controls().idmap();
+			if (idmap.find(control.first) == idmap.end())
+				LOG(DelayedControls, Warning)
+					<< "Unknown control " << control.first;
 			return false;
 		}
 
-		const ControlId *id = it->second;
-
-		if (controlParams_.find(id) == controlParams_.end())
-			return false;
-
-		Info &info = values_[id][queueCount_];
+		Info &info = value(queueCount_, index);
 
 		info = Info(control.second);
 
 		LOG(DelayedControls, Debug)
-			<< "Queuing " << id->name()
+			<< "Queuing " << controls_[index].id->name()
 			<< " to " << info.toString()
 			<< " at index " << queueCount_;
 	}
 
+	cookies_[queueCount_ & historyMask_] = cookie;
 	queueCount_++;
 
 	return true;
 }
 
+/**
+ * \brief Push a set of controls to take effect at a given frame
+ * \param[in] sequence The sequence number of the frame the controls target
+ * \param[in] controls List of controls to add to the device queue
+ * \param[in] cookie The cookie associated with \a controls
+ *
+ * Schedule \a controls to take effect at frame \a sequence, instead of at the
+ * first frame following the controls already queued as push() does. This
+ * allows queuing controls for specific frames ahead of time, for instance to
+ * bracket the exposure of consecutive frames.
+ *
+ * If \a sequence is further ahead than the end of the queue, the queue is
+ * padded with the current controls state. If it falls within the queue, the
+ * values queued for frame \a sequence are updated, and carried over to the
+ * following frames until the next queued update of the same controls. The
+ * cookie of frame \a sequence is replaced by \a cookie in that case.
+ *
+ * Controls that target a frame too close to be reached given the control
+ * delays are scheduled for the earliest frame they can take effect at. The
+ * frame the controls take effect at is returned to the caller, which can then
+ * report it together with the request metadata.
+ *
+ * \return The sequence number of the frame \a controls take effect at, or
+ * std::nullopt if \a controls are not accepted or \a sequence is too far
+ * ahead to fit in the history
+ */
+std::optional<uint32_t> DelayedControls::pushAt(uint32_t sequence,
+						const ControlList &controls,
+						unsigned int cookie)
+{
+	/* Validate all controls before modifying the queue. */
+	for (const auto &control : controls) {
+		if (findControl(control.first) < 0) {
+			LOG(DelayedControls, Warning)
+				<< "Unknown control " << control.first;
+			return std::nullopt;
+		}
+	}
+
+	/*
+	 * The values at index i in the queue take effect at frame
+	 * i + maxDelay_, and indices from writeCount_ onwards haven't been
+	 * written to the device yet.
+	 */
+	uint32_t index = std::max<int>(writeCount_, sequence - maxDelay_);
+	if (index - writeCount_ + 2 * maxDelay_ > historyMask_) {
+		LOG(DelayedControls, Error)
+			<< "Frame " << sequence << " is too far ahead";
+		return std::nullopt;
+	}
+
+	while (queueCount_ < index)
+		push({}, cookies_[(queueCount_ - 1) & historyMask_]);
+
+	if (index == queueCount_) {
+		push(controls, cookie);
+		return index + maxDelay_;
+	}
+
+	for (const auto &control : controls) {
+		unsigned int i = findControl(control.first);
+
+		value(index, i) = Info(control.second);
+
+		LOG(DelayedControls, Debug)
+			<< "Updating " << controls_[i].id->name()
+			<< " to " << control.second.toString()
+			<< " at index " << index;
+
+		for (uint32_t next = index + 1; next < queueCount_; next++) {
+			Info &info = value(next, i);
+			if (info.updated)
+				break;
+
+			info = Info(control.second, false);
+		}
+	}
+
+	cookies_[index & historyMask_] = cookie;
+
+	return index + maxDelay_;
+}
+
 /**
  * \brief Read back controls in effect at a sequence number
  * \param[in] sequence The sequence number to get controls for
+ * \param[out] cookie The cookie associated with the controls, may be nullptr
  *
  * Read back what controls where in effect at a specific sequence number. The
- * history is a ring buffer of 16 entries where new and old values coexist. It's
- * the callers responsibility to not read too old sequence numbers that have been
- * pushed out of the history.
+ * history is a ring buffer, of the size specified at construction time, where
+ * new and old values coexist. It's the callers responsibility to not read too
+ * old sequence numbers that have been pushed out of the history.
  *
  * Historic values are evicted by pushing new values onto the queue using
  * push(). The max history from the current sequence number that yields valid
- * values are thus 16 minus number of controls pushed.
+ * values are thus the history size minus number of controls pushed.
+ *
+ * If \a cookie is not null, it is set to the cookie passed to push() along with
+ * the returned controls, or to reset() if no controls have been pushed since.
  *
  * \return The controls at \a sequence number
  */
-ControlList DelayedControls::get(uint32_t sequence)
+ControlList DelayedControls::get(uint32_t sequence, unsigned int *cookie)
 {
 	unsigned int index = std::max<int>(0, sequence - maxDelay_);
 
 	ControlList out(device_->controls());
-	for (const auto &ctrl : values_) {
-		const ControlId *id = ctrl.first;
-		const Info &info = ctrl.second[index];
+	for (unsigned int i = 0; i < controls_.size(); i++) {
+		const ControlId *id = controls_[i].id;
+		const Info &info = value(index, i);
+
+		if (info.isNone())
+			continue;
 
 		out.set(id->id(), info);
 
@@ -217,6 +359,9 @@ ControlList DelayedControls::get(uint32_t sequence)
 			<< " at index " << index;
 	}
 
+	if (cookie)
+		*cookie = cookies_[index & historyMask_];
+
 	return out;
 }
 
@@ -233,36 +378,60 @@ void DelayedControls::applyControls(uint32_t sequence)
 {
 	LOG(DelayedControls, Debug) << "frame " << sequence << " started";
 
+	writeControls(sequence, nullptr);
+}
+
+/**
+ * \brief Write the controls of a frame to a media request
+ * \param[in] sequence Sequence number of the frame the request applies to
+ * \param[in] request The media request
+ *
+ * When the device supports the Media Request API, the controls can be stored
+ * in the \a request that the kernel applies at the start of frame \a sequence,
+ * instead of being written from the start of frame events. This function
+ * shall then be called in sequence order when preparing the requests, in
+ * place of applyControls().
+ */
+void DelayedControls::queueControls(uint32_t sequence, const MediaRequest *request)
+{
+	LOG(DelayedControls, Debug) << "frame " << sequence << " queued";
+
+	writeControls(sequence, request);
+}
+
+void DelayedControls::writeControls(uint32_t sequence, const MediaRequest *request)
+{
+
 	/*
 	 * Create control list peeking ahead in the value queue to ensure
 	 * values are set in time to satisfy the sensor delay.
 	 */
 	ControlList out(device_->controls());
-	for (auto &ctrl : values_) {
-		const ControlId *id = ctrl.first;
-		unsigned int delayDiff = maxDelay_ - controlParams_[id].delay;
+	for (unsigned int i = 0; i < controls_.size(); i++) {
+		const Control &control = controls_[i];
+		unsigned int delayDiff = maxDelay_ - control.params.delay;
 		unsigned int index = std::max<int>(0, writeCount_ - delayDiff);
-		Info &info = ctrl.second[index];
+		Info &info = value(index, i);
 
 		if (info.updated) {
-			if (controlParams_[id].priorityWrite) {
+			if (control.params.priorityWrite) {
 				/*
 				 * This control must be written now, it could
 				 * affect validity of the other controls.
 				 */
 				ControlList priority(device_->controls());
-				priority.set(id->id(), info);
-				device_->setControls(&priority);
+				priority.set(control.id->id(), info);
+				device_->setControls(&priority, request);
 			} else {
 				/*
 				 * Batch up the list of controls and write them
 				 * at the end of the function.
 				 */
-				out.set(id->id(), info);
+				out.set(control.id->id(), info);
 			}
 
 			LOG(DelayedControls, Debug)
-				<< "Setting " << id->name()
+				<< "Setting " << control.id->name()
 				<< " to " << info.toString()
 				<< " at index " << index;
 
@@ -276,10 +445,10 @@ void DelayedControls::applyControls(uint32_t sequence)
 	while (writeCount_ > queueCount_) {
 		LOG(DelayedControls, Debug)
 			<< "Queue is empty, auto queue no-op.";
-		push({});
+		push({}, cookies_[(queueCount_ - 1) & historyMask_]);
 	}
 
-	device_->setControls(&out);
+	device_->setControls(&out, request);
 }
 
 } /* namespace libcamera */
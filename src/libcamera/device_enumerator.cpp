@@ -7,13 +7,19 @@
 
 #include "libcamera/internal/device_enumerator.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <string.h>
+#include <thread>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
 
 #include "libcamera/internal/device_enumerator_sysfs.h"
 #include "libcamera/internal/device_enumerator_udev.h"
 #include "libcamera/internal/media_device.h"
+#include "libcamera/internal/startup_profile.h"
 
 /**
  * \file device_enumerator.h
@@ -217,6 +223,7 @@ DeviceEnumerator::~DeviceEnumerator()
  */
 std::unique_ptr<MediaDevice> DeviceEnumerator::createDevice(const std::string &deviceNode)
 {
+	StartupProfile::Scope scope("media_populate", deviceNode);
 	std::unique_ptr<MediaDevice> media = std::make_unique<MediaDevice>(deviceNode);
 
 	int ret = media->populate();
@@ -234,6 +241,78 @@ std::unique_ptr<MediaDevice> DeviceEnumerator::createDevice(const std::string &d
 	return media;
 }
 
+namespace {
+
+/* Maximum number of threads used to populate media devices concurrently */
+constexpr unsigned int kMaxProbeThreads = 8;
+
+class MediaDeviceProbeWorker : public Thread
+{
+public:
+	MediaDeviceProbeWorker(unsigned int index, std::function<void()> probe)
+		: Thread("MediaProbe" + std::to_string(index)),
+		  probe_(std::move(probe))
+	{
+		setRole(Role::Housekeeping);
+	}
+
+protected:
+	void run() override
+	{
+		probe_();
+	}
+
+private:
+	std::function<void()> probe_;
+};
+
+} /* namespace */
+
+/**
+ * \brief Create multiple media device instances concurrently
+ * \param[in] deviceNodes paths to the media devices to create
+ *
+ * Create and populate a media device for each of the \a deviceNodes, as
+ * createDevice() does. Populating a media device only involves the device
+ * itself, so independent devices are populated concurrently by a pool of
+ * worker threads, which reduces the enumeration time on systems with many
+ * media devices. The calling thread takes part in the work and this function
+ * returns once all devices have been processed.
+ *
+ * The media devices are returned in the same order as the \a deviceNodes. The
+ * entries corresponding to devices that failed to be populated are null.
+ *
+ * \return The created media device instances
+ */
+std::vector<std::unique_ptr<MediaDevice>>
+DeviceEnumerator::createDevices(const std::vector<std::string> &deviceNodes)
+{
+	std::vector<std::unique_ptr<MediaDevice>> devices(deviceNodes.size());
+	std::atomic<unsigned int> next = 0;
+
+	auto probe = [&]() {
+		for (unsigned int i = next++; i < deviceNodes.size(); i = next++)
+			devices[i] = createDevice(deviceNodes[i]);
+	};
+
+	unsigned int threads = std::min<unsigned int>({
+		static_cast<unsigned int>(deviceNodes.size()),
+		std::thread::hardware_concurrency(), kMaxProbeThreads });
+
+	std::vector<std::unique_ptr<MediaDeviceProbeWorker>> workers;
+	for (unsigned int i = 1; i < threads; i++) {
+		workers.push_back(std::make_unique<MediaDeviceProbeWorker>(i, probe));
+		workers.back()->start();
+	}
+
+	probe();
+
+	for (auto &worker : workers)
+		worker->wait();
+
+	return devices;
+}
+
 /**
 * \var DeviceEnumerator::devicesAdded
 * \brief Notify of new media devices being found
@@ -260,7 +339,41 @@ void DeviceEnumerator::addDevice(std::unique_ptr<MediaDevice> media)
 
 	devices_.push_back(std::move(media));
 
-	/* \todo To batch multiple additions, emit with a small delay here. */
+	if (notificationsHeld_) {
+		devicesPending_ = true;
+		return;
+	}
+
+	devicesAdded.emit();
+}
+
+/**
+ * \brief Hold the devicesAdded signal emission
+ *
+ * Device enumerators that add multiple media devices at once call this
+ * function before adding the devices, and releaseNotifications() after, to
+ * emit the devicesAdded signal once for all devices. Calls can be nested.
+ */
+void DeviceEnumerator::holdNotifications()
+{
+	notificationsHeld_++;
+}
+
+/**
+ * \brief Release the devicesAdded signal emission
+ *
+ * Release the hold placed by holdNotifications() and, when the last hold is
+ * released, emit the devicesAdded signal if media devices have been added in
+ * the meantime.
+ */
+void DeviceEnumerator::releaseNotifications()
+{
+	ASSERT(notificationsHeld_);
+
+	if (--notificationsHeld_ || !devicesPending_)
+		return;
+
+	devicesPending_ = false;
 	devicesAdded.emit();
 }
 
@@ -8,6 +8,7 @@
 #include "libcamera/internal/device_enumerator_udev.h"
 
 #include <algorithm>
+#include <chrono>
 #include <fcntl.h>
 #include <libudev.h>
 #include <list>
@@ -27,15 +28,34 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(DeviceEnumerator)
 
+namespace {
+
+/*
+ * Hotplug events received within this window are processed together, to
+ * populate the media devices concurrently and match pipeline handlers once.
+ */
+constexpr std::chrono::milliseconds kHotplugDebounce{ 100 };
+
+} /* namespace */
+
 DeviceEnumeratorUdev::DeviceEnumeratorUdev()
-	: udev_(nullptr), monitor_(nullptr), notifier_(nullptr)
+	: udev_(nullptr), monitor_(nullptr), notifier_(nullptr),
+	  probeThread_("MediaHotplug"), prober_(this)
 {
+	debounceTimer_.timeout.connect(this, &DeviceEnumeratorUdev::processEvents);
+	prober_.moveToThread(&probeThread_);
 }
 
 DeviceEnumeratorUdev::~DeviceEnumeratorUdev()
 {
+	probeThread_.exit();
+	probeThread_.wait();
+
 	delete notifier_;
 
+	for (struct udev_device *dev : events_)
+		udev_device_unref(dev);
+
 	if (monitor_)
 		udev_monitor_unref(monitor_);
 	if (udev_)
@@ -76,50 +96,54 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 	if (!subsystem)
 		return -ENODEV;
 
-	if (!strcmp(subsystem, "media")) {
-		std::unique_ptr<MediaDevice> media =
-			createDevice(udev_device_get_devnode(dev));
-		if (!media)
-			return -ENODEV;
+	if (!strcmp(subsystem, "media"))
+		return addMediaDevice(createDevice(udev_device_get_devnode(dev)));
 
-		DependencyMap deps;
-		int ret = populateMediaDevice(media.get(), &deps);
-		if (ret < 0) {
-			LOG(DeviceEnumerator, Warning)
-				<< "Failed to populate media device "
-				<< media->deviceNode()
-				<< " (" << media->driver() << "), skipping";
-			return ret;
-		}
-
-		if (!deps.empty()) {
-			LOG(DeviceEnumerator, Debug)
-				<< "Defer media device " << media->deviceNode()
-				<< " due to " << deps.size()
-				<< " missing dependencies";
+	if (!strcmp(subsystem, "video4linux")) {
+		addV4L2Device(udev_device_get_devnum(dev));
+		return 0;
+	}
 
-			pending_.emplace_back(std::move(media), std::move(deps));
-			MediaDeviceDeps *mediaDeps = &pending_.back();
-			for (const auto &dep : mediaDeps->deps_)
-				devMap_[dep.first] = mediaDeps;
+	return -ENODEV;
+}
 
-			return 0;
-		}
+int DeviceEnumeratorUdev::addMediaDevice(std::unique_ptr<MediaDevice> media)
+{
+	if (!media)
+		return -ENODEV;
 
-		addDevice(std::move(media));
-		return 0;
+	DependencyMap deps;
+	int ret = populateMediaDevice(media.get(), &deps);
+	if (ret < 0) {
+		LOG(DeviceEnumerator, Warning)
+			<< "Failed to populate media device "
+			<< media->deviceNode()
+			<< " (" << media->driver() << "), skipping";
+		return ret;
 	}
 
-	if (!strcmp(subsystem, "video4linux")) {
-		addV4L2Device(udev_device_get_devnum(dev));
+	if (!deps.empty()) {
+		LOG(DeviceEnumerator, Debug)
+			<< "Defer media device " << media->deviceNode()
+			<< " due to " << deps.size()
+			<< " missing dependencies";
+
+		pending_.emplace_back(std::move(media), std::move(deps));
+		MediaDeviceDeps *mediaDeps = &pending_.back();
+		for (const auto &dep : mediaDeps->deps_)
+			devMap_[dep.first] = mediaDeps;
+
 		return 0;
 	}
 
-	return -ENODEV;
+	addDevice(std::move(media));
+	return 0;
 }
 
 int DeviceEnumeratorUdev::enumerate()
 {
+	std::vector<struct udev_device *> devs;
+	std::vector<std::string> mediaNodes;
 	struct udev_enumerate *udev_enum = nullptr;
 	struct udev_list_entry *ents, *ent;
 	int ret;
@@ -170,12 +194,39 @@ int DeviceEnumeratorUdev::enumerate()
 			continue;
 		}
 
-		if (addUdevDevice(dev) < 0)
-			LOG(DeviceEnumerator, Warning)
-				<< "Failed to add device for '"
-				<< syspath << "', skipping";
+		const char *subsystem = udev_device_get_subsystem(dev);
+		if (subsystem && !strcmp(subsystem, "media"))
+			mediaNodes.push_back(devnode);
 
-		udev_device_unref(dev);
+		devs.push_back(dev);
+	}
+
+	{
+		/*
+		 * Populate all media devices concurrently, and then add the
+		 * devices in enumeration order.
+		 */
+		std::vector<std::unique_ptr<MediaDevice>> media =
+			createDevices(mediaNodes);
+		auto next = media.begin();
+
+		for (struct udev_device *dev : devs) {
+			const char *subsystem = udev_device_get_subsystem(dev);
+			int err;
+
+			if (subsystem && !strcmp(subsystem, "media"))
+				err = addMediaDevice(std::move(*next++));
+			else
+				err = addUdevDevice(dev);
+
+			if (err < 0)
+				LOG(DeviceEnumerator, Warning)
+					<< "Failed to add device for '"
+					<< udev_device_get_syspath(dev)
+					<< "', skipping";
+
+			udev_device_unref(dev);
+		}
 	}
 
 done:
@@ -329,6 +380,11 @@ int DeviceEnumeratorUdev::addV4L2Device(dev_t devnum)
 	return 0;
 }
 
+/*
+ * Hotplug events are queued and processed after a debounce delay, to handle
+ * devices that appear together, such as multiple cameras behind a USB hub, in
+ * one go.
+ */
 void DeviceEnumeratorUdev::udevNotify()
 {
 	struct udev_device *dev = udev_monitor_receive_device(monitor_);
@@ -340,21 +396,110 @@ void DeviceEnumeratorUdev::udevNotify()
 		return;
 	}
 
-	std::string_view action(udev_device_get_action(dev));
-	std::string_view deviceNode(udev_device_get_devnode(dev));
-
 	LOG(DeviceEnumerator, Debug)
-		<< action << " device " << deviceNode;
+		<< udev_device_get_action(dev) << " device "
+		<< udev_device_get_devnode(dev);
+
+	events_.push_back(dev);
 
-	if (action == "add") {
-		addUdevDevice(dev);
-	} else if (action == "remove") {
+	if (!debounceTimer_.isRunning())
+		debounceTimer_.start(kHotplugDebounce);
+}
+
+void DeviceEnumeratorUdev::processEvents()
+{
+	std::vector<struct udev_device *> events = std::move(events_);
+	std::vector<std::string> mediaNodes;
+
+	holdNotifications();
+
+	for (struct udev_device *dev : events) {
+		std::string_view action(udev_device_get_action(dev));
 		const char *subsystem = udev_device_get_subsystem(dev);
-		if (subsystem && !strcmp(subsystem, "media"))
-			removeDevice(std::string(deviceNode));
+		const char *deviceNode = udev_device_get_devnode(dev);
+		bool isMedia = subsystem && !strcmp(subsystem, "media");
+
+		if (action == "add") {
+			/*
+			 * Populating media devices requires many ioctls. Defer
+			 * it to the probe thread to avoid delaying the
+			 * processing of requests for running cameras.
+			 */
+			if (isMedia && deviceNode) {
+				mediaNodes.push_back(deviceNode);
+				probing_.insert(deviceNode);
+			} else {
+				addUdevDevice(dev);
+			}
+		} else if (action == "remove" && isMedia && deviceNode) {
+			/*
+			 * A device removed while being probed is ignored when
+			 * the probe completes.
+			 */
+			if (probing_.erase(deviceNode))
+				mediaNodes.erase(std::remove(mediaNodes.begin(),
+							     mediaNodes.end(),
+							     deviceNode),
+						 mediaNodes.end());
+			else
+				removeDevice(deviceNode);
+		}
+
+		udev_device_unref(dev);
+	}
+
+	releaseNotifications();
+
+	if (mediaNodes.empty())
+		return;
+
+	if (!probeThread_.isRunning())
+		probeThread_.start();
+
+	prober_.invokeMethod(&Prober::probe, ConnectionTypeQueued, mediaNodes);
+}
+
+void DeviceEnumeratorUdev::Prober::probe(const std::vector<std::string> &deviceNodes)
+{
+	std::vector<std::unique_ptr<MediaDevice>> devices =
+		enumerator_->createDevices(deviceNodes);
+
+	{
+		MutexLocker locker(enumerator_->mutex_);
+
+		for (unsigned int i = 0; i < deviceNodes.size(); ++i)
+			enumerator_->probed_.emplace_back(deviceNodes[i],
+							  std::move(devices[i]));
+	}
+
+	enumerator_->invokeMethod(&DeviceEnumeratorUdev::devicesProbed,
+				  ConnectionTypeQueued);
+}
+
+void DeviceEnumeratorUdev::devicesProbed()
+{
+	std::vector<std::pair<std::string, std::unique_ptr<MediaDevice>>> probed;
+
+	{
+		MutexLocker locker(mutex_);
+		probed = std::move(probed_);
+	}
+
+	holdNotifications();
+
+	for (auto &[deviceNode, media] : probed) {
+		/* Skip devices removed while being probed. */
+		if (!probing_.erase(deviceNode))
+			continue;
+
+		/*
+		 * Entity device nodes are looked up through udev, which must
+		 * be done in the enumerator thread.
+		 */
+		addMediaDevice(std::move(media));
 	}
 
-	udev_device_unref(dev);
+	releaseNotifications();
 }
 
 } /* namespace libcamera */
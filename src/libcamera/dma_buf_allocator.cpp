@@ -9,10 +9,19 @@
 #include "libcamera/internal/dma_buf_allocator.h"
 
 #include <array>
+#include <dirent.h>
 #include <fcntl.h>
+#include <fstream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -22,6 +31,13 @@
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/memfd.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/memory_accounting.h"
+
+#include "libcamera/internal/framebuffer.h"
 
 /**
  * \file dma_buf_allocator.cpp
@@ -38,18 +54,275 @@ struct DmaBufAllocatorInfo {
 #endif
 
 static constexpr std::array<DmaBufAllocatorInfo, 4> providerInfos = { {
+	/*
+	 * The system heap comes first as it provides cached memory, which CPU
+	 * users can access efficiently when synchronizing with DmaSyncer.
+	 */
+	{ DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap, "/dev/dma_heap/system" },
 	/*
 	 * /dev/dma_heap/linux,cma is the CMA dma-heap. When the cma heap size is
 	 * specified on the kernel command line, this gets renamed to "reserved".
 	 */
 	{ DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap, "/dev/dma_heap/linux,cma" },
 	{ DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap, "/dev/dma_heap/reserved" },
-	{ DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap, "/dev/dma_heap/system" },
 	{ DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf, "/dev/udmabuf" },
 } };
 
 LOG_DEFINE_CATEGORY(DmaBufAllocator)
 
+#ifndef __DOXYGEN__
+class DmaBufAllocator::Pool
+{
+public:
+	Pool()
+		: limit_(0), size_(0)
+	{
+	}
+
+	UniqueFD get(std::size_t size);
+	void put(UniqueFD fd, std::size_t size, MemoryAccount::Heap heap);
+
+	void setLimit(std::size_t limit);
+	std::size_t limit() const;
+	std::size_t size() const;
+	void trim(std::size_t size);
+
+private:
+	struct Entry {
+		std::size_t size;
+		UniqueFD fd;
+		MemoryAccount account;
+	};
+
+	void trimLocked(std::size_t size) LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	mutable Mutex mutex_;
+	std::size_t limit_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::size_t size_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	/* Free buffers, from the least to the most recently freed */
+	std::list<Entry> entries_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	/* Free lists of the size classes */
+	std::multimap<std::size_t, std::list<Entry>::iterator> classes_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+UniqueFD DmaBufAllocator::Pool::get(std::size_t size)
+{
+	MutexLocker locker(mutex_);
+
+	auto it = classes_.find(size);
+	if (it == classes_.end())
+		return {};
+
+	UniqueFD fd = std::move(it->second->fd);
+	entries_.erase(it->second);
+	classes_.erase(it);
+	size_ -= size;
+
+	return fd;
+}
+
+void DmaBufAllocator::Pool::put(UniqueFD fd, std::size_t size,
+				MemoryAccount::Heap heap)
+{
+	MutexLocker locker(mutex_);
+
+	if (size > limit_)
+		return;
+
+	trimLocked(limit_ - size);
+
+	entries_.push_back({ size, std::move(fd),
+			     MemoryAccount("DmaBufAllocator pool", heap, size) });
+	classes_.emplace(size, std::prev(entries_.end()));
+	size_ += size;
+}
+
+void DmaBufAllocator::Pool::setLimit(std::size_t limit)
+{
+	MutexLocker locker(mutex_);
+
+	limit_ = limit;
+	trimLocked(limit);
+}
+
+std::size_t DmaBufAllocator::Pool::limit() const
+{
+	MutexLocker locker(mutex_);
+
+	return limit_;
+}
+
+std::size_t DmaBufAllocator::Pool::size() const
+{
+	MutexLocker locker(mutex_);
+
+	return size_;
+}
+
+void DmaBufAllocator::Pool::trim(std::size_t size)
+{
+	MutexLocker locker(mutex_);
+
+	trimLocked(size);
+}
+
+void DmaBufAllocator::Pool::trimLocked(std::size_t size)
+{
+	while (size_ > size) {
+		Entry &entry = entries_.front();
+
+		auto range = classes_.equal_range(entry.size);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == entries_.begin()) {
+				classes_.erase(it);
+				break;
+			}
+		}
+
+		size_ -= entry.size;
+		entries_.pop_front();
+	}
+}
+
+namespace {
+
+/*
+ * Check that the dma-buf referenced by fd isn't referenced by any other file
+ * descriptor or memory mapping of the process, as they would keep accessing
+ * the memory once it is reused. References from other processes can't be
+ * detected.
+ */
+bool isExclusive(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return false;
+
+	DIR *dir = opendir("/proc/self/fd");
+	if (!dir)
+		return false;
+
+	int dfd = dirfd(dir);
+	bool exclusive = true;
+
+	struct dirent *ent;
+	while (exclusive && (ent = readdir(dir)) != nullptr) {
+		char *endp;
+		int other = strtoul(ent->d_name, &endp, 10);
+		if (*endp || other == fd || other == dfd)
+			continue;
+
+		struct stat otherSt;
+		if (fstat(other, &otherSt) == 0 && otherSt.st_dev == st.st_dev &&
+		    otherSt.st_ino == st.st_ino)
+			exclusive = false;
+	}
+
+	closedir(dir);
+
+	if (!exclusive)
+		return false;
+
+	std::ifstream maps("/proc/self/maps");
+	if (!maps)
+		return false;
+
+	std::string line;
+	while (std::getline(maps, line)) {
+		std::istringstream fields(line);
+		std::string range, perms, offset, dev;
+		unsigned long inode;
+
+		if (!(fields >> range >> perms >> offset >> dev >> inode))
+			continue;
+
+		unsigned int major, minor;
+		if (sscanf(dev.c_str(), "%x:%x", &major, &minor) != 2)
+			continue;
+
+		if (inode == st.st_ino && makedev(major, minor) == st.st_dev)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Round the size up to a size class. Classes are spaced by at least a page
+ * and at most an eighth of the size, bounding the waste to 12.5%.
+ */
+std::size_t sizeClass(std::size_t size)
+{
+	std::size_t step = sysconf(_SC_PAGESIZE);
+
+	while (step * 16 < size)
+		step *= 2;
+
+	return (size + step - 1) / step * step;
+}
+
+MemoryAccount::Heap memoryHeap(DmaBufAllocator::DmaBufAllocatorFlag type)
+{
+	switch (type) {
+	case DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap:
+		return MemoryAccount::Heap::Cma;
+	case DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf:
+		return MemoryAccount::Heap::UDmaBuf;
+	case DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap:
+	default:
+		return MemoryAccount::Heap::System;
+	}
+}
+
+} /* namespace */
+
+/*
+ * A frame buffer that returns its dma-buf to the pool of the allocator it has
+ * been exported from when destroyed, if nothing else in the process references
+ * the dma-buf anymore.
+ */
+class DmaBufAllocator::PooledFrameBuffer : public FrameBuffer::Private
+{
+public:
+	PooledFrameBuffer(const std::vector<FrameBuffer::Plane> &planes,
+			  std::size_t size, std::weak_ptr<Pool> pool,
+			  MemoryAccount::Heap heap)
+		: FrameBuffer::Private(planes), fd_(planes[0].fd), size_(size),
+		  pool_(std::move(pool)),
+		  account_("DmaBufAllocator", heap, size)
+	{
+	}
+
+	~PooledFrameBuffer()
+	{
+		std::shared_ptr<Pool> pool = pool_.lock();
+		if (!pool || pool->limit() < size_)
+			return;
+
+		/*
+		 * The planes of the frame buffer share fd_, any other
+		 * reference to the dma-buf is a user still holding the memory.
+		 */
+		if (!isExclusive(fd_.get())) {
+			LOG(DmaBufAllocator, Debug)
+				<< "Buffer still referenced, not returning it to the pool";
+			return;
+		}
+
+		pool->put(fd_.dup(), size_, account_.heap());
+	}
+
+private:
+	SharedFD fd_;
+	std::size_t size_;
+	std::weak_ptr<Pool> pool_;
+	MemoryAccount account_;
+};
+
+#endif /* __DOXYGEN__ */
+
 /**
  * \class DmaBufAllocator
  * \brief Helper class for dma-buf allocations
@@ -60,6 +333,13 @@ LOG_DEFINE_CATEGORY(DmaBufAllocator)
  * Different providers may provide dma-buffers with different properties for
  * the underlying memory. Which providers are acceptable is specified through
  * the type argument passed to the DmaBufAllocator() constructor.
+ *
+ * Allocating a dma-buf is costly, as the kernel has to allocate and zero the
+ * memory. Frame buffers created with exportBuffers() return their memory to a
+ * pool when they are destroyed, from which later exportBuffers() calls
+ * allocate buffers of the same size class. This makes reconfiguring streams
+ * cheap. The pool is disabled by default, users enable it by setting the
+ * maximum amount of memory it may hold with setPoolLimit().
  */
 
 /**
@@ -83,15 +363,21 @@ LOG_DEFINE_CATEGORY(DmaBufAllocator)
  * \param[in] type The type(s) of the dma-buf providers to allocate from
  *
  * The dma-buf provider type is selected with the \a type parameter, which
- * defaults to the CMA heap. If no provider of the given type can be accessed,
- * the constructed DmaBufAllocator instance is invalid as indicated by
+ * defaults to the system heap. If no provider of the given type can be
+ * accessed, the constructed DmaBufAllocator instance is invalid as indicated by
  * the isValid() function.
  *
+ * The system heap allocates cached memory. CPU accesses to its buffers shall be
+ * synchronized with DmaSyncer or MappedFrameBuffer::syncScope(). Users that
+ * need physically-contiguous memory shall select the CMA heap explicitly.
+ *
  * Multiple types can be selected by combining type flags, in which case
  * the constructed DmaBufAllocator will match one of the types. If multiple
- * requested types can work on the system, which provider is used is undefined.
+ * requested types can work on the system, the system heap is preferred, then
+ * the CMA heap and finally udmabuf.
  */
 DmaBufAllocator::DmaBufAllocator(DmaBufAllocatorFlags type)
+	: hugePages_(false), pool_(std::make_shared<Pool>())
 {
 	for (const auto &info : providerInfos) {
 		if (!(type & info.type))
@@ -133,7 +419,9 @@ UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
 	size = (size + pageMask) & ~pageMask;
 
 	/* udmabuf dma-buffers *must* have the F_SEAL_SHRINK seal. */
-	UniqueFD memfd = MemFd::create(name, size, MemFd::Seal::Shrink);
+	UniqueFD memfd = MemFd::create(name, size, MemFd::Seal::Shrink,
+				       hugePages_ ? MemFd::Option::HugePages
+						  : MemFd::Option::None);
 	if (!memfd.isValid())
 		return {};
 
@@ -145,6 +433,20 @@ UniqueFD DmaBufAllocator::allocFromUDmaBuf(const char *name, std::size_t size)
 	create.size = size;
 
 	int ret = ::ioctl(providerHandle_.get(), UDMABUF_CREATE, &create);
+	if (ret < 0 && hugePages_) {
+		/* Older kernels don't support memfds backed by huge pages. */
+		LOG(DmaBufAllocator, Debug)
+			<< "Failed to create dma buf from huge pages for " << name
+			<< ", retrying with regular pages";
+
+		memfd = MemFd::create(name, size, MemFd::Seal::Shrink);
+		if (!memfd.isValid())
+			return {};
+
+		create.memfd = memfd.get();
+		ret = ::ioctl(providerHandle_.get(), UDMABUF_CREATE, &create);
+	}
+
 	if (ret < 0) {
 		ret = errno;
 		LOG(DmaBufAllocator, Error)
@@ -205,4 +507,221 @@ UniqueFD DmaBufAllocator::alloc(const char *name, std::size_t size)
 		return allocFromHeap(name, size);
 }
 
+/**
+ * \brief Allocate and export frame buffers from the DmaBufAllocator
+ * \param[in] count The number of frame buffers to allocate
+ * \param[in] planeSizes The sizes of the planes of the frame buffers
+ * \param[out] buffers Array of frame buffers to fill
+ *
+ * Allocate \a count frame buffers, each backed by a single dma-buf holding all
+ * planes contiguously, and append them to \a buffers. Memory is taken from the
+ * pool when possible, and returned to the pool when the frame buffers are
+ * destroyed. Buffers taken from the pool may be larger than the total size of
+ * the planes, and their content is undefined.
+ *
+ * When the pool is enabled, destroying a frame buffer hands its memory over to
+ * the next buffers exported from the allocator. Users of the frame buffers
+ * shall thus release all references to the dma-buf, such as duplicated file
+ * descriptors, memory mappings or imports in other devices or processes,
+ * before destroying the frame buffer. Buffers still referenced by a file
+ * descriptor or a memory mapping of the process when destroyed are freed
+ * instead of being pooled, but references held by other processes can't be
+ * detected.
+ *
+ * The exported buffers and the buffers held by the pool are recorded in the
+ * memory accounting under the "DmaBufAllocator" and "DmaBufAllocator pool"
+ * categories respectively. Buffers allocated with alloc() are owned by the
+ * caller and are not accounted for.
+ *
+ * \return The number of allocated buffers on success or a negative error code
+ * otherwise
+ * \retval -ENOMEM Out of memory
+ */
+int DmaBufAllocator::exportBuffers(unsigned int count,
+				   const std::vector<unsigned int> &planeSizes,
+				   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	std::size_t frameSize = 0;
+	for (unsigned int planeSize : planeSizes)
+		frameSize += planeSize;
+
+	const std::size_t size = sizeClass(frameSize);
+
+	for (unsigned int i = 0; i < count; i++) {
+		UniqueFD fd = pool_->get(size);
+		if (!fd.isValid()) {
+			const std::string name = "frame-" + std::to_string(i);
+
+			fd = alloc(name.c_str(), size);
+			if (!fd.isValid())
+				return -ENOMEM;
+		}
+
+		SharedFD sharedFd(std::move(fd));
+		std::vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+
+		for (unsigned int planeSize : planeSizes) {
+			FrameBuffer::Plane plane;
+			plane.fd = sharedFd;
+			plane.offset = offset;
+			plane.length = planeSize;
+			planes.push_back(std::move(plane));
+
+			offset += planeSize;
+		}
+
+		auto d = std::make_unique<PooledFrameBuffer>(planes, size, pool_,
+							     memoryHeap(type_));
+		buffers->emplace_back(std::make_unique<FrameBuffer>(std::move(d)));
+	}
+
+	return count;
+}
+
+/**
+ * \brief Set the maximum amount of memory held by the pool
+ * \param[in] limit The maximum size of the pool in bytes
+ *
+ * The pool only holds the memory of destroyed frame buffers. When a frame
+ * buffer returns to the pool and the limit would be exceeded, the least
+ * recently returned buffers are freed. Lowering the limit frees buffers
+ * immediately, and a limit of 0 disables pooling.
+ */
+void DmaBufAllocator::setPoolLimit(std::size_t limit)
+{
+	pool_->setLimit(limit);
+}
+
+/**
+ * \brief Back udmabuf allocations with huge pages
+ * \param[in] enable Whether to use huge pages
+ *
+ * When enabled, dma-bufs allocated from udmabuf are backed by memfds created
+ * with MemFd::Option::HugePages. This reduces the TLB pressure on large
+ * buffers processed by the CPU, at the cost of rounding the memory of each
+ * buffer up to a multiple of the huge page size. The allocator falls back to
+ * regular pages when huge pages are not available. Allocations from dma-buf
+ * heaps are not affected.
+ */
+void DmaBufAllocator::setHugePages(bool enable)
+{
+	hugePages_ = enable;
+}
+
+/**
+ * \brief Retrieve the amount of memory held by the pool
+ * \return The total size in bytes of the buffers held by the pool
+ */
+std::size_t DmaBufAllocator::poolSize() const
+{
+	return pool_->size();
+}
+
+/**
+ * \brief Free memory held by the pool
+ * \param[in] size The amount of memory to keep in bytes
+ *
+ * Free the least recently returned buffers until the pool holds at most
+ * \a size bytes, without affecting the limit set with setPoolLimit(). This
+ * can be used to give memory back to the system, for instance when a camera is
+ * released.
+ */
+void DmaBufAllocator::trimPool(std::size_t size)
+{
+	pool_->trim(size);
+}
+
+/**
+ * \class DmaSyncer
+ * \brief Helper class for dma-buf's synchronization
+ *
+ * This class wraps a userspace dma-buf's synchronization process with an
+ * object's lifetime.
+ *
+ * It's used when the user needs to access a dma-buf with CPU, mostly mapped
+ * with MappedFrameBuffer, so that the buffer is synchronized between CPU and
+ * ISP. The kernel flushes or invalidates the CPU caches of cached buffers when
+ * the access starts and ends, and waits for pending device accesses to the
+ * buffer to complete.
+ *
+ * The synchronization covers the whole dma-buf, as the DMA_BUF_IOCTL_SYNC
+ * interface has no provision for partial accesses.
+ */
+
+/**
+ * \enum DmaSyncer::SyncType
+ * \brief Read and/or write access via the CPU map
+ * \var DmaSyncer::Read
+ * \brief Indicates that the mapped dma-buf will be read by the client via the
+ * CPU map
+ * \var DmaSyncer::Write
+ * \brief Indicates that the mapped dma-buf will be written by the client via the
+ * CPU map
+ * \var DmaSyncer::ReadWrite
+ * \brief Indicates that the mapped dma-buf will be read and written by the
+ * client via the CPU map
+ */
+
+/**
+ * \brief Construct the DmaSyncer with a dma-buf's fd and the access type
+ * \param[in] fd The dma-buf's file descriptor to synchronize
+ * \param[in] type Read and/or write access via the CPU map
+ */
+DmaSyncer::DmaSyncer(SharedFD fd, SyncType type)
+	: fd_(std::move(fd))
+{
+	switch (type) {
+	case SyncType::Read:
+		flags_ = DMA_BUF_SYNC_READ;
+		break;
+	case SyncType::Write:
+		flags_ = DMA_BUF_SYNC_WRITE;
+		break;
+	case SyncType::ReadWrite:
+		flags_ = DMA_BUF_SYNC_RW;
+		break;
+	}
+
+	sync(DMA_BUF_SYNC_START);
+}
+
+/**
+ * \fn DmaSyncer::DmaSyncer(DmaSyncer &&other)
+ * \param[in] other The other instance
+ * \brief Enable move on class DmaSyncer
+ *
+ * The synchronization ends when the new instance is destroyed, \a other is
+ * left without any dma-buf to synchronize.
+ */
+
+/**
+ * \brief Destroy the DmaSyncer, ending the synchronization
+ */
+DmaSyncer::~DmaSyncer()
+{
+	if (fd_.isValid())
+		sync(DMA_BUF_SYNC_END);
+}
+
+void DmaSyncer::sync(uint64_t step)
+{
+	struct dma_buf_sync sync = {
+		.flags = flags_ | step
+	};
+
+	int ret;
+	do {
+		ret = ioctl(fd_.get(), DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret && (errno == EINTR || errno == EAGAIN));
+
+	if (ret) {
+		ret = errno;
+		LOG(DmaBufAllocator, Error)
+			<< "Unable to sync dma fd: " << fd_.get()
+			<< ", err: " << strerror(ret)
+			<< ", flags: " << sync.flags;
+	}
+}
+
 } /* namespace libcamera */
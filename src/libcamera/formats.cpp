@@ -7,7 +7,8 @@
 
 #include "libcamera/internal/formats.h"
 
-#include <map>
+#include <string_view>
+#include <unordered_map>
 
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
@@ -147,7 +148,18 @@ namespace {
 
 const PixelFormatInfo pixelFormatInfoInvalid{};
 
-const std::map<PixelFormat, PixelFormatInfo> pixelFormatInfo{
+struct PixelFormatHash {
+	size_t operator()(const PixelFormat &format) const noexcept
+	{
+		return format.fourcc() ^ std::hash<uint64_t>{}(format.modifier());
+	}
+};
+
+/*
+ * The pixel format information is looked up in per-frame and configuration
+ * validation paths, use hash tables to make the lookups constant-time.
+ */
+const std::unordered_map<PixelFormat, PixelFormatInfo, PixelFormatHash> pixelFormatInfo{
 	/* RGB formats. */
 	{ formats::RGB565, {
 		.name = "RGB565",
@@ -1039,12 +1051,20 @@ const PixelFormatInfo &PixelFormatInfo::info(const V4L2PixelFormat &format)
  */
 const PixelFormatInfo &PixelFormatInfo::info(const std::string &name)
 {
-	for (const auto &info : pixelFormatInfo) {
-		if (info.second.name == name)
-			return info.second;
-	}
+	static const std::unordered_map<std::string_view, const PixelFormatInfo *> names = [] {
+		std::unordered_map<std::string_view, const PixelFormatInfo *> map;
+
+		for (const auto &[format, info] : pixelFormatInfo)
+			map.emplace(info.name, &info);
+
+		return map;
+	}();
+
+	const auto iter = names.find(name);
+	if (iter == names.end())
+		return pixelFormatInfoInvalid;
 
-	return pixelFormatInfoInvalid;
+	return *iter->second;
 }
 
 /**
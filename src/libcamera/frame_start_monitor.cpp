@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Start of frame notification with a synthesized fallback
+ */
+
+#include "libcamera/internal/frame_start_monitor.h"
+
+#include <chrono>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/v4l2_device.h"
+#include "libcamera/internal/v4l2_videodevice.h"
+
+/**
+ * \file frame_start_monitor.h
+ * \brief Start of frame notification with a synthesized fallback
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(FrameStartMonitor)
+
+/**
+ * \class FrameStartMonitor
+ * \brief Signal the start of frames from the most suitable source
+ *
+ * Pipeline handlers time the application of sensor controls on the start of
+ * frame events, for instance by connecting the frameStart signal to
+ * DelayedControls::applyControls(). Depending on the platform, the
+ * V4L2_EVENT_FRAME_SYNC event is emitted by the CSI-2 receiver, by the ISP or
+ * by the capture video device, and some platforms don't emit it at all.
+ *
+ * The FrameStartMonitor is constructed with a list of candidate devices, in
+ * order of preference. When started, it subscribes to the start of frame
+ * events of the first device that supports them, and forwards them through the
+ * frameStart signal.
+ *
+ * When none of the devices support start of frame events, the events are
+ * synthesized from the buffers completed by the capture video device. The
+ * frame duration is estimated from the timestamps of consecutive buffers, and
+ * the start of the next frame is signalled one frame duration after the
+ * timestamp of the last completed buffer. As buffer timestamps are sampled at
+ * the start of the frame by most capture drivers, and buffers complete at the
+ * end of the frame, this closely approximates the timing of the real events.
+ */
+
+/**
+ * \brief Construct a FrameStartMonitor
+ * \param[in] devices The devices to take the start of frame events from, in
+ * order of preference
+ * \param[in] video The capture video device to synthesize events from, when
+ * none of the \a devices support start of frame events
+ *
+ * The \a video device may be one of the \a devices. It may be null, in which
+ * case the monitor fails to start if none of the \a devices support start of
+ * frame events.
+ */
+FrameStartMonitor::FrameStartMonitor(const std::vector<V4L2Device *> &devices,
+				     V4L2VideoDevice *video)
+	: devices_(devices), video_(video), source_(nullptr), running_(false),
+	  lastSequence_(0), lastTimestamp_(0), nextSequence_(0)
+{
+	timer_.timeout.connect(this, &FrameStartMonitor::timeout);
+}
+
+FrameStartMonitor::~FrameStartMonitor()
+{
+	stop();
+}
+
+/**
+ * \brief Start signalling the start of frames
+ *
+ * This function shall be called before starting streaming on the capture
+ * video device, to avoid missing the first events.
+ *
+ * \return 0 on success, a negative error code otherwise
+ */
+int FrameStartMonitor::start()
+{
+	if (running_)
+		return 0;
+
+	for (V4L2Device *device : devices_) {
+		if (device->setFrameStartEnabled(true))
+			continue;
+
+		LOG(FrameStartMonitor, Debug)
+			<< "Using start of frame events from "
+			<< device->deviceNode();
+
+		source_ = device;
+		source_->frameStart.connect(this, &FrameStartMonitor::frameStarted);
+		running_ = true;
+		return 0;
+	}
+
+	if (!video_) {
+		LOG(FrameStartMonitor, Error)
+			<< "No device supports start of frame events";
+		return -ENOTSUP;
+	}
+
+	LOG(FrameStartMonitor, Debug)
+		<< "Synthesizing start of frame events from "
+		<< video_->deviceNode();
+
+	lastSequence_ = 0;
+	lastTimestamp_ = 0;
+	frameDuration_ = {};
+
+	video_->bufferReady.connect(this, &FrameStartMonitor::bufferReady);
+	running_ = true;
+
+	return 0;
+}
+
+/**
+ * \brief Stop signalling the start of frames
+ */
+void FrameStartMonitor::stop()
+{
+	if (!running_)
+		return;
+
+	if (source_) {
+		source_->setFrameStartEnabled(false);
+		source_->frameStart.disconnect(this, &FrameStartMonitor::frameStarted);
+		source_ = nullptr;
+	} else {
+		video_->bufferReady.disconnect(this, &FrameStartMonitor::bufferReady);
+		timer_.stop();
+	}
+
+	running_ = false;
+}
+
+/**
+ * \fn FrameStartMonitor::synthesized()
+ * \brief Check if the start of frame events are synthesized
+ * \return True if the monitor is running and synthesizes the start of frame
+ * events from buffer timestamps, false otherwise
+ */
+
+/**
+ * \var FrameStartMonitor::frameStart
+ * \brief A Signal emitted when capture of a frame has started
+ *
+ * The signal carries the sequence number of the frame, in the same numbering
+ * as the V4L2Device::frameStart signal.
+ */
+
+void FrameStartMonitor::frameStarted(uint32_t sequence)
+{
+	frameStart.emit(sequence);
+}
+
+void FrameStartMonitor::bufferReady(FrameBuffer *buffer)
+{
+	const FrameMetadata &metadata = buffer->metadata();
+	if (metadata.status != FrameMetadata::FrameSuccess)
+		return;
+
+	if (lastTimestamp_ && metadata.sequence > lastSequence_ &&
+	    metadata.timestamp > lastTimestamp_)
+		frameDuration_ = std::chrono::nanoseconds(metadata.timestamp - lastTimestamp_)
+			       / (metadata.sequence - lastSequence_);
+
+	lastSequence_ = metadata.sequence;
+	lastTimestamp_ = metadata.timestamp;
+
+	/*
+	 * Signal the pending event right away if the previous buffer was
+	 * completed late, to keep one event per frame.
+	 */
+	if (timer_.isRunning()) {
+		timer_.stop();
+		timeout();
+	}
+
+	nextSequence_ = metadata.sequence + 1;
+
+	/* Signal the first frames as soon as they complete. */
+	if (!frameDuration_) {
+		timeout();
+		return;
+	}
+
+	utils::time_point deadline{ std::chrono::nanoseconds(metadata.timestamp) };
+	deadline += std::chrono::duration_cast<utils::clock::duration>(frameDuration_);
+
+	if (deadline <= utils::clock::now()) {
+		timeout();
+		return;
+	}
+
+	timer_.start(deadline);
+}
+
+void FrameStartMonitor::timeout()
+{
+	frameStart.emit(nextSequence_);
+}
+
+} /* namespace libcamera */
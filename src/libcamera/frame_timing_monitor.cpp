@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Frame timing jitter and deadline miss detection
+ */
+
+#include "libcamera/internal/frame_timing_monitor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <libcamera/base/log.h>
+
+/**
+ * \file frame_timing_monitor.h
+ * \brief Frame timing jitter and deadline miss detection
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(FrameTiming)
+
+namespace {
+
+/* Frames whose interval exceeds the expected duration by 25% are late. */
+constexpr double kLateThreshold = 0.25;
+
+/* The timing degrades with 8 missed frames in the window, and recovers at 4. */
+constexpr unsigned int kDegradedMisses = FrameTimingMonitor::kWindowSize / 16;
+constexpr unsigned int kRecoveredMisses = kDegradedMisses / 2;
+
+const std::vector<double> kJitterBounds = {
+	50e-6, 100e-6, 250e-6, 500e-6, 1e-3, 2.5e-3, 5e-3, 10e-3, 25e-3,
+};
+
+} /* namespace */
+
+/**
+ * \class FrameTimingMonitor
+ * \brief Detect frame timing jitter and missed frames of a camera
+ *
+ * The FrameTimingMonitor compares the interval between the sensor timestamps
+ * of consecutive completed frames with the expected frame duration. Frames
+ * whose sequence number skips values are counted as dropped, and frames whose
+ * interval exceeds the expected duration by more than 25% are counted as late.
+ * The absolute difference between the interval and the expected duration is
+ * recorded as the frame jitter.
+ *
+ * The counts and the jitter distribution are exported through the metrics
+ * registry, with the frames_late_total, frames_dropped_total and
+ * frame_jitter_seconds metrics. The monitor additionally tracks the missed
+ * frames, late or dropped, over a sliding window of the last kWindowSize
+ * frames. When their number exceeds a threshold, the timing is considered
+ * degraded, a warning is logged, the frame_timing_degraded gauge is set and
+ * the degradedChanged signal is emitted. The timing recovers with hysteresis,
+ * when the number of missed frames in the window falls to half the threshold.
+ *
+ * The monitor is cheap enough to be always enabled, it performs a constant
+ * amount of work per frame and doesn't allocate memory.
+ */
+
+/**
+ * \var FrameTimingMonitor::kWindowSize
+ * \brief The number of frames of the sliding window used to detect degraded
+ * timings
+ */
+
+/**
+ * \brief Construct a FrameTimingMonitor
+ * \param[in] camera The camera ID, used to label the metrics and messages
+ */
+FrameTimingMonitor::FrameTimingMonitor(const std::string &camera)
+	: camera_(camera),
+	  lateFramesMetric_("frames_late_total", camera),
+	  droppedFramesMetric_("frames_dropped_total", camera),
+	  jitterMetric_("frame_jitter_seconds", camera, kJitterBounds),
+	  degradedMetric_("frame_timing_degraded", camera), degraded_(false)
+{
+	reset();
+}
+
+/**
+ * \brief Reset the frame timing history
+ *
+ * This function shall be called when the camera is started, in order not to
+ * compare the timestamps of the first frame with the last frame of the
+ * previous capture session. The metrics counters are not reset.
+ */
+void FrameTimingMonitor::reset()
+{
+	started_ = false;
+	lastSequence_ = 0;
+	lastTimestamp_ = 0;
+	estimatedDuration_ = {};
+
+	misses_.fill(0);
+	jitter_.fill(0.0f);
+	index_ = 0;
+	frames_ = 0;
+	windowMisses_ = 0;
+
+	if (degraded_) {
+		degraded_ = false;
+		degradedMetric_.set(0);
+		degradedChanged.emit(false);
+	}
+}
+
+/**
+ * \brief Record the timing of a completed frame
+ * \param[in] sequence The frame sequence number
+ * \param[in] timestamp The sensor timestamp of the frame, in nanoseconds
+ * \param[in] frameDuration The expected frame duration
+ *
+ * Frames shall be recorded in completion order. When the expected
+ * \a frameDuration is not known, it is estimated from the intervals between
+ * frames.
+ */
+void FrameTimingMonitor::frameCompleted(uint32_t sequence, uint64_t timestamp,
+					utils::Duration frameDuration)
+{
+	/* Resynchronize on the first frame and on discontinuities. */
+	if (!started_ || sequence <= lastSequence_ || timestamp <= lastTimestamp_) {
+		started_ = true;
+		lastSequence_ = sequence;
+		lastTimestamp_ = timestamp;
+		return;
+	}
+
+	const uint32_t frames = sequence - lastSequence_;
+	const utils::Duration interval = std::chrono::nanoseconds(timestamp - lastTimestamp_);
+
+	lastSequence_ = sequence;
+	lastTimestamp_ = timestamp;
+
+	unsigned int misses = frames - 1;
+	if (misses)
+		droppedFramesMetric_.increment(misses);
+
+	utils::Duration expected = frameDuration;
+	if (!expected) {
+		const utils::Duration duration = interval / frames;
+		if (estimatedDuration_)
+			estimatedDuration_ = (estimatedDuration_ * 15 + duration) / 16;
+		else
+			estimatedDuration_ = duration;
+		expected = estimatedDuration_;
+	}
+
+	const utils::Duration error = interval - expected * frames;
+	const double jitter = std::abs(error.get<std::ratio<1>>());
+	jitterMetric_.observe(jitter);
+
+	if (error > expected * kLateThreshold) {
+		lateFramesMetric_.increment();
+		misses++;
+	}
+
+	windowMisses_ -= misses_[index_];
+	misses_[index_] = std::min(misses, 255U);
+	windowMisses_ += misses_[index_];
+	jitter_[index_] = jitter;
+	index_ = (index_ + 1) % kWindowSize;
+	frames_ = std::min(frames_ + 1, kWindowSize);
+
+	if (!degraded_ && windowMisses_ >= kDegradedMisses) {
+		LOG(FrameTiming, Warning)
+			<< "Camera " << camera_ << " missed " << windowMisses_
+			<< " of the last " << frames_ << " frames, jitter p50 "
+			<< jitterPercentile(0.5) * 1e6 << "us p99 "
+			<< jitterPercentile(0.99) * 1e6 << "us";
+
+		degraded_ = true;
+		degradedMetric_.set(1);
+		degradedChanged.emit(true);
+	} else if (degraded_ && windowMisses_ <= kRecoveredMisses) {
+		LOG(FrameTiming, Info)
+			<< "Camera " << camera_ << " frame timing recovered";
+
+		degraded_ = false;
+		degradedMetric_.set(0);
+		degradedChanged.emit(false);
+	}
+}
+
+/**
+ * \fn FrameTimingMonitor::lateFrames()
+ * \brief Retrieve the number of late frames
+ * \return The number of late frames since the monitor was created
+ */
+
+/**
+ * \fn FrameTimingMonitor::droppedFrames()
+ * \brief Retrieve the number of dropped frames
+ * \return The number of dropped frames since the monitor was created
+ */
+
+/**
+ * \fn FrameTimingMonitor::degraded()
+ * \brief Check if the frame timing is degraded
+ * \return True if the number of missed frames in the sliding window exceeded
+ * the threshold and hasn't recovered yet, false otherwise
+ */
+
+/**
+ * \var FrameTimingMonitor::degradedChanged
+ * \brief A Signal emitted when the frame timing degrades or recovers
+ *
+ * The signal carries the new degraded() state.
+ */
+
+double FrameTimingMonitor::jitterPercentile(double p) const
+{
+	/*
+	 * Only called when the timing degrades, the copy is acceptable. The
+	 * first frames_ entries of the window are valid.
+	 */
+	std::array<float, kWindowSize> values = jitter_;
+	auto nth = values.begin() + static_cast<unsigned int>(p * (frames_ - 1));
+	std::nth_element(values.begin(), nth, values.begin() + frames_);
+
+	return *nth;
+}
+
+} /* namespace libcamera */
@@ -8,6 +8,7 @@
 #include <libcamera/framebuffer.h>
 #include "libcamera/internal/framebuffer.h"
 
+#include <algorithm>
 #include <sys/stat.h>
 
 #include <libcamera/base/log.h>
@@ -124,9 +125,12 @@ LOG_DEFINE_CATEGORY(Buffer)
  * \param[in] cookie Cookie
  */
 FrameBuffer::Private::Private(const std::vector<Plane> &planes, uint64_t cookie)
-	: planes_(planes), cookie_(cookie), request_(nullptr),
-	  isContiguous_(true)
+	: cookie_(cookie), request_(nullptr), isContiguous_(true)
 {
+	planes_.reserve(std::max<size_t>(planes.size(), kInlinePlanes));
+	planes_ = planes;
+
+	metadata_.planes_.reserve(planes_.capacity());
 	metadata_.planes_.resize(planes_.size());
 }
 
@@ -137,6 +141,34 @@ FrameBuffer::Private::~Private()
 {
 }
 
+/**
+ * \var FrameBuffer::Private::kInlinePlanes
+ * \brief The number of planes the frame buffer can be re-targeted to without
+ * allocating memory
+ */
+
+/**
+ * \fn FrameBuffer::Private::setPlanes()
+ * \brief Re-target the frame buffer at new memory planes
+ * \param[in] planes The frame memory planes
+ *
+ * This function replaces the planes of the frame buffer, and resets its
+ * dynamic metadata, fence and request, making the frame buffer equivalent to
+ * a newly constructed instance of the same class. Components that wrap
+ * externally allocated memory in frame buffers for every request can recycle
+ * the frame buffers with this function instead of allocating new ones. The
+ * storage of the planes is reused, up to the largest number of planes the
+ * frame buffer has been constructed or re-targeted with, and at least
+ * kInlinePlanes.
+ *
+ * An empty \a planes releases the file descriptors of the current planes, for
+ * instance to avoid keeping memory alive while the frame buffer is unused.
+ *
+ * \note Pipeline handlers identify frame buffers by the file descriptors of
+ * their planes, not by their address. Re-targeted frame buffers shall not be
+ * queued to a camera while they are in use by a request.
+ */
+
 /**
  * \fn FrameBuffer::Private::setRequest()
  * \brief Set the request this buffer belongs to
@@ -301,8 +333,50 @@ ino_t fileDescriptorInode(const SharedFD &fd)
 	return st.st_ino;
 }
 
+bool planesContiguous(const std::vector<FrameBuffer::Plane> &planes)
+{
+	unsigned int offset = 0;
+	ino_t inode = 0;
+
+	for (const auto &plane : planes) {
+		ASSERT(plane.offset != FrameBuffer::Plane::kInvalidOffset);
+
+		if (plane.offset != offset)
+			return false;
+
+		/*
+		 * Two different dmabuf file descriptors may still refer to the
+		 * same dmabuf instance. Check this using inodes.
+		 */
+		if (plane.fd != planes[0].fd) {
+			if (!inode)
+				inode = fileDescriptorInode(planes[0].fd);
+			if (fileDescriptorInode(plane.fd) != inode)
+				return false;
+		}
+
+		offset += plane.length;
+	}
+
+	return true;
+}
+
 } /* namespace */
 
+void FrameBuffer::Private::setPlanes(const std::vector<Plane> &planes)
+{
+	planes_ = planes;
+
+	metadata_.status = FrameMetadata::FrameSuccess;
+	metadata_.sequence = 0;
+	metadata_.timestamp = 0;
+	metadata_.planes_.assign(planes_.size(), {});
+
+	fence_.reset();
+	request_ = nullptr;
+	isContiguous_ = planesContiguous(planes_);
+}
+
 /**
  * \brief Construct a FrameBuffer with an array of planes
  * \param[in] planes The frame memory planes
@@ -320,33 +394,7 @@ FrameBuffer::FrameBuffer(const std::vector<Plane> &planes, unsigned int cookie)
 FrameBuffer::FrameBuffer(std::unique_ptr<Private> d)
 	: Extensible(std::move(d))
 {
-	unsigned int offset = 0;
-	bool isContiguous = true;
-	ino_t inode = 0;
-
-	for (const auto &plane : _d()->planes_) {
-		ASSERT(plane.offset != Plane::kInvalidOffset);
-
-		if (plane.offset != offset) {
-			isContiguous = false;
-			break;
-		}
-
-		/*
-		 * Two different dmabuf file descriptors may still refer to the
-		 * same dmabuf instance. Check this using inodes.
-		 */
-		if (plane.fd != _d()->planes_[0].fd) {
-			if (!inode)
-				inode = fileDescriptorInode(_d()->planes_[0].fd);
-			if (fileDescriptorInode(plane.fd) != inode) {
-				isContiguous = false;
-				break;
-			}
-		}
-
-		offset += plane.length;
-	}
+	bool isContiguous = planesContiguous(_d()->planes_);
 
 	LOG(Buffer, Debug)
 		<< "Buffer is " << (isContiguous ? "" : "not ") << "contiguous";
@@ -16,6 +16,7 @@
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/startup_profile.h"
 
 /**
  * \file framebuffer_allocator.h
@@ -52,14 +53,37 @@ LOG_DEFINE_CATEGORY(Allocator)
  *
  * Usage of the FrameBufferAllocator is optional, if all buffers for a camera
  * are provided externally applications shall not use this class.
+ *
+ * The memory allocated by the allocator can be capped with setMemoryLimit(),
+ * in which case allocations that would exceed the limit fail. This allows
+ * applications running multiple cameras on memory-constrained systems to share
+ * the memory between the cameras explicitly. The memory needed by a camera
+ * configuration can be queried beforehand with memoryRequirement() to select
+ * configurations that fit in the available memory.
  */
 
+namespace {
+
+size_t buffersSize(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
+{
+	size_t size = 0;
+
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		for (const FrameBuffer::Plane &plane : buffer->planes())
+			size += plane.length;
+	}
+
+	return size;
+}
+
+} /* namespace */
+
 /**
  * \brief Construct a FrameBufferAllocator serving a camera
  * \param[in] camera The camera
  */
 FrameBufferAllocator::FrameBufferAllocator(std::shared_ptr<Camera> camera)
-	: camera_(std::move(camera))
+	: camera_(std::move(camera)), memoryLimit_(0), memoryUsage_(0)
 {
 }
 
@@ -82,9 +106,28 @@ FrameBufferAllocator::~FrameBufferAllocator() = default;
  * \retval -EINVAL The \a stream does not belong to the camera or the stream is
  * not part of the active camera configuration
  * \retval -EBUSY Buffers are already allocated for the \a stream
+ * \retval -ENOMEM The allocation would exceed the memory limit
  */
 int FrameBufferAllocator::allocate(Stream *stream)
 {
+	StartupProfile::Scope scope("buffer_allocation", camera_->id());
+
+	/*
+	 * Check the memory limit before allocating when the frame size is
+	 * known, to avoid allocating memory only to free it immediately.
+	 */
+	if (memoryLimit_ && stream) {
+		const StreamConfiguration &cfg = stream->configuration();
+		size_t size = static_cast<size_t>(cfg.frameSize) * cfg.bufferCount;
+
+		if (memoryUsage_ + size > memoryLimit_) {
+			LOG(Allocator, Error)
+				<< "Allocating " << size << " bytes for stream "
+				<< cfg.toString() << " would exceed the memory limit";
+			return -ENOMEM;
+		}
+	}
+
 	const auto &[it, inserted] = buffers_.try_emplace(stream);
 
 	if (!inserted) {
@@ -98,8 +141,20 @@ int FrameBufferAllocator::allocate(Stream *stream)
 			<< "Stream is not part of " << camera_->id()
 			<< " active configuration";
 
-	if (ret < 0)
+	if (ret < 0) {
 		buffers_.erase(it);
+		return ret;
+	}
+
+	size_t size = buffersSize(it->second);
+	if (memoryLimit_ && memoryUsage_ + size > memoryLimit_) {
+		LOG(Allocator, Error)
+			<< "Allocated " << size << " bytes, exceeding the memory limit";
+		buffers_.erase(it);
+		return -ENOMEM;
+	}
+
+	memoryUsage_ += size;
 
 	return ret;
 }
@@ -122,6 +177,7 @@ int FrameBufferAllocator::free(Stream *stream)
 	if (iter == buffers_.end())
 		return -EINVAL;
 
+	memoryUsage_ -= buffersSize(iter->second);
 	buffers_.erase(iter);
 
 	return 0;
@@ -156,4 +212,48 @@ FrameBufferAllocator::buffers(Stream *stream) const
 	return iter->second;
 }
 
+/**
+ * \fn FrameBufferAllocator::setMemoryLimit()
+ * \brief Set the maximum amount of memory the allocator can allocate
+ * \param[in] limit The memory limit in bytes, or 0 to disable the limit
+ *
+ * The limit applies to the total size of the buffers allocated for all streams
+ * by subsequent calls to allocate(). Buffers already allocated are not freed
+ * when the limit is lowered below the current usage.
+ */
+
+/**
+ * \fn FrameBufferAllocator::memoryLimit()
+ * \brief Retrieve the memory limit
+ * \return The memory limit in bytes, or 0 if the memory isn't limited
+ */
+
+/**
+ * \fn FrameBufferAllocator::memoryUsage()
+ * \brief Retrieve the amount of memory currently allocated
+ * \return The total size in bytes of the buffers allocated for all streams
+ */
+
+/**
+ * \brief Compute the memory needed to allocate buffers for a configuration
+ * \param[in] config The camera configuration
+ *
+ * Compute the amount of memory that allocate() needs to allocate buffers for
+ * all the streams in the \a config, based on the frame size and buffer count
+ * of each stream configuration. The \a config shall have been validated with
+ * CameraConfiguration::validate(), but doesn't need to be applied to the
+ * camera.
+ *
+ * \return The memory requirement in bytes
+ */
+size_t FrameBufferAllocator::memoryRequirement(const CameraConfiguration &config)
+{
+	size_t size = 0;
+
+	for (const StreamConfiguration &cfg : config)
+		size += static_cast<size_t>(cfg.frameSize) * cfg.bufferCount;
+
+	return size;
+}
+
 } /* namespace libcamera */
@@ -71,6 +71,15 @@
  * data section, and after the data section. They shall be ignored when parsing
  * the packet.
  *
+ * ControlList packets may be sent incrementally. A packet with the
+ * IPA_CONTROLS_FLAG_BASELINE flag set shall be recorded by the receiver as the
+ * baseline for the lists using the same ControlInfoMap handle and id map type.
+ * A packet with the IPA_CONTROLS_FLAG_DELTA flag set only contains the entries
+ * that differ from the baseline last recorded for that handle and id map type.
+ * Entries of type ControlTypeNone then denote controls removed from the
+ * baseline. Entries are stored in ascending numerical ID order in delta
+ * packets.
+ *
  * The following diagram describes the layout of the ControlInfoMap packet.
  *
  * ~~~~
@@ -138,6 +147,16 @@ namespace libcamera {
  * \brief The current control serialization format version
  */
 
+/**
+ * \def IPA_CONTROLS_FLAG_BASELINE
+ * \brief The ControlList packet shall be recorded as a baseline by the receiver
+ */
+
+/**
+ * \def IPA_CONTROLS_FLAG_DELTA
+ * \brief The ControlList packet is a delta against the last recorded baseline
+ */
+
 /**
  * \var ipa_controls_id_map_type
  * \brief Enumerates the different control id map types
@@ -182,6 +201,9 @@ namespace libcamera {
  * Offset in bytes from the beginning of the packet of the data section start
  * \var ipa_controls_header::id_map_type
  * The id map type as defined by the ipa_controls_id_map_type enumeration
+ * \var ipa_controls_header::flags
+ * For ControlList packets, a bitmask of IPA_CONTROLS_FLAG_* values. Shall be
+ * set to 0 for ControlInfoMap packets
  * \var ipa_controls_header::reserved
  * Reserved for future extensions
  */
@@ -346,6 +346,9 @@ IPADataSerializer<ControlList>::serialize(const ControlList &data, ControlSerial
 		return { {}, {} };
 	}
 
+	/* Incrementally serialized lists may be smaller than binarySize(). */
+	listData.resize(buffer.offset());
+
 	std::vector<uint8_t> dataVec;
 	dataVec.reserve(8 + infoData.size() + listData.size());
 	appendPOD<uint32_t>(dataVec, infoData.size());
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <dirent.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <libcamera/base/file.h>
@@ -19,6 +20,7 @@
 #include "libcamera/internal/ipa_module.h"
 #include "libcamera/internal/ipa_proxy.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/startup_profile.h"
 
 /**
  * \file ipa_manager.h
@@ -102,11 +104,33 @@ LOG_DEFINE_CATEGORY(IPAManager)
  * CameraManager.
  */
 IPAManager::IPAManager()
+	: modulesLoaded_(false)
 {
 #if HAVE_IPA_PUBKEY
 	if (!pubKey_.isValid())
 		LOG(IPAManager, Warning) << "Public key not valid";
 #endif
+}
+
+IPAManager::~IPAManager()
+{
+	for (IPAModule *module : modules_)
+		delete module;
+}
+
+/**
+ * \brief Discover the IPA modules
+ *
+ * Discovering IPA modules requires parsing all shared objects found in the IPA
+ * module search paths. To avoid this cost for applications that never create
+ * an IPA, modules are discovered the first time a pipeline handler looks up an
+ * IPA module, instead of when the IPAManager is constructed.
+ */
+void IPAManager::loadModules()
+{
+	StartupProfile::Scope scope("ipa_module_scan");
+
+	modulesLoaded_ = true;
 
 	unsigned int ipaCount = 0;
 
@@ -149,12 +173,6 @@ IPAManager::IPAManager()
 			<< "No IPA found in '" IPA_MODULE_DIR "'";
 }
 
-IPAManager::~IPAManager()
-{
-	for (IPAModule *module : modules_)
-		delete module;
-}
-
 /**
  * \brief Identify shared library objects within a directory
  * \param[in] libDir The directory to search for shared objects
@@ -250,6 +268,9 @@ unsigned int IPAManager::addDir(const char *libDir, unsigned int maxDepth)
 IPAModule *IPAManager::module(PipelineHandler *pipe, uint32_t minVersion,
 			      uint32_t maxVersion)
 {
+	if (!modulesLoaded_)
+		loadModules();
+
 	for (IPAModule *module : modules_) {
 		if (module->match(pipe, minVersion, maxVersion))
 			return module;
@@ -293,6 +314,28 @@ bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 		return false;
 	}
 
+	/*
+	 * Verifying the signature requires reading the whole module. Cache the
+	 * result, and reuse it as long as the module file isn't replaced or
+	 * modified.
+	 */
+	struct stat st;
+	if (stat(ipa->path().c_str(), &st))
+		return false;
+
+	auto it = signatureCache_.find(ipa->path());
+	if (it != signatureCache_.end()) {
+		const SignatureCacheEntry &entry = it->second;
+
+		if (entry.device == st.st_dev && entry.inode == st.st_ino &&
+		    entry.size == st.st_size &&
+		    entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+		    entry.mtime.tv_nsec == st.st_mtim.tv_nsec)
+			return entry.valid;
+	}
+
+	StartupProfile::Scope scope("ipa_signature_check", ipa->info().name);
+
 	File file{ ipa->path() };
 	if (!file.open(File::OpenModeFlag::ReadOnly))
 		return false;
@@ -307,6 +350,10 @@ bool IPAManager::isSignatureValid([[maybe_unused]] IPAModule *ipa) const
 		<< "IPA module " << ipa->path() << " signature is "
 		<< (valid ? "valid" : "not valid");
 
+	signatureCache_[ipa->path()] = {
+		st.st_dev, st.st_ino, st.st_size, st.st_mtim, valid
+	};
+
 	return valid;
 #else
 	return false;
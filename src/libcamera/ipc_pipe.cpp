@@ -153,8 +153,9 @@ IPCUnixSocket::Payload IPCMessage::payload() const
  * \brief IPC message pipe for IPA isolation
  *
  * Virtual class to model an IPC message pipe for use by IPA proxies for IPA
- * isolation. sendSync() and sendAsync() must be implemented, and the recvMessage
- * signal must be emitted whenever new data is available.
+ * isolation. sendSync(), sendSyncBegin(), sendSyncEnd() and sendAsync() must be
+ * implemented, and the recvMessage signal must be emitted whenever new data is
+ * available.
  */
 
 /**
@@ -194,6 +195,31 @@ IPCPipe::~IPCPipe()
  * the caller needs to implement to make this safe.
  */
 
+/**
+ * \fn IPCPipe::sendSyncBegin()
+ * \brief Start a synchronous call over IPC without waiting for the response
+ * \param[in] in Data to send
+ *
+ * This function sends the message \a in and returns immediately. The response
+ * shall be retrieved by calling sendSyncEnd() with the cookie of \a in. This
+ * allows the caller to perform other work while the remote side processes the
+ * call. Only one call can be pending for a given cookie.
+ *
+ * \return Zero on success, negative error code otherwise
+ */
+
+/**
+ * \fn IPCPipe::sendSyncEnd()
+ * \brief Wait for the response to a call started with sendSyncBegin()
+ * \param[in] cookie The cookie of the message passed to sendSyncBegin()
+ * \param[in] out IPCMessage instance in which to receive data, if applicable
+ *
+ * This function will not return until the response to the call identified by
+ * \a cookie is received, and has the same semantics as sendSync() otherwise.
+ *
+ * \return Zero on success, negative error code otherwise
+ */
+
 /**
  * \fn IPCPipe::sendAsync()
  * \brief Send a message over IPC asynchronously
@@ -7,12 +7,21 @@
 
 #include "libcamera/internal/ipc_pipe_unixsocket.h"
 
+#include <errno.h>
+#include <map>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/event_dispatcher.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/metrics.h>
+#include <libcamera/base/mutex.h>
 #include <libcamera/base/thread.h>
 #include <libcamera/base/timer.h>
+#include <libcamera/base/utils.h>
 
 #include "libcamera/internal/ipc_pipe.h"
 #include "libcamera/internal/ipc_unixsocket.h"
@@ -24,6 +33,132 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(IPCPipe)
 
+namespace {
+
+/* Synchronous calls to isolated IPA modules that got no reply in time */
+CounterMetric &callTimeouts()
+{
+	static CounterMetric metric("ipa_call_timeouts_total");
+	return metric;
+}
+
+} /* namespace */
+
+/*
+ * A worker process shared by all the pipes of an IPA module. The worker is
+ * started with a control channel, over which the channel of each pipe is sent
+ * to the worker to host an additional IPA instance. The worker is terminated
+ * when the last pipe using it is destroyed.
+ *
+ * Pipes may be created from different pipeline handler threads. The control
+ * channel is a plain socket only written to with the lock held, as an
+ * IPCUnixSocket would be bound to the event dispatcher of a single thread.
+ */
+class IPCPipeUnixSocket::SharedWorker
+{
+public:
+	static std::shared_ptr<SharedWorker> get(const char *ipaModulePath,
+						 const char *ipaProxyWorkerPath);
+
+	int attach(UniqueFD fd);
+
+private:
+	int start(const char *ipaModulePath, const char *ipaProxyWorkerPath);
+
+	Mutex mutex_;
+	Process proc_;
+	UniqueFD control_;
+};
+
+std::shared_ptr<IPCPipeUnixSocket::SharedWorker>
+IPCPipeUnixSocket::SharedWorker::get(const char *ipaModulePath,
+				     const char *ipaProxyWorkerPath)
+{
+	static Mutex mutex;
+	static std::map<std::pair<std::string, std::string>,
+			std::weak_ptr<SharedWorker>> workers;
+
+	MutexLocker locker(mutex);
+
+	std::weak_ptr<SharedWorker> &entry = workers[{ ipaModulePath, ipaProxyWorkerPath }];
+	std::shared_ptr<SharedWorker> worker = entry.lock();
+	if (worker)
+		return worker;
+
+	worker = std::make_shared<SharedWorker>();
+	if (worker->start(ipaModulePath, ipaProxyWorkerPath) < 0)
+		return nullptr;
+
+	entry = worker;
+
+	return worker;
+}
+
+int IPCPipeUnixSocket::SharedWorker::start(const char *ipaModulePath,
+					   const char *ipaProxyWorkerPath)
+{
+	int sockets[2];
+	int ret = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets);
+	if (ret) {
+		ret = -errno;
+		LOG(IPCPipe, Error)
+			<< "Failed to create control socket: " << strerror(-ret);
+		return ret;
+	}
+
+	control_ = UniqueFD(sockets[0]);
+	UniqueFD fd(sockets[1]);
+
+	std::vector<std::string> args = {
+		ipaModulePath,
+		std::to_string(fd.get()),
+		"shared",
+	};
+	std::vector<int> fds = { fd.get() };
+
+	ret = proc_.start(ipaProxyWorkerPath, args, fds);
+	if (ret) {
+		LOG(IPCPipe, Error)
+			<< "Failed to start shared proxy worker process";
+		return ret;
+	}
+
+	return 0;
+}
+
+int IPCPipeUnixSocket::SharedWorker::attach(UniqueFD fd)
+{
+	/* The worker receives a duplicate of the descriptor, \a fd can be closed. */
+	char data = 0;
+	struct iovec iov = { &data, sizeof(data) };
+
+	alignas(struct cmsghdr) char buf[CMSG_SPACE(sizeof(int))] = {};
+	struct msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof(buf);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	int raw = fd.get();
+	memcpy(CMSG_DATA(cmsg), &raw, sizeof(raw));
+
+	MutexLocker locker(mutex_);
+
+	if (sendmsg(control_.get(), &msg, MSG_NOSIGNAL) < 0) {
+		int ret = -errno;
+		LOG(IPCPipe, Error)
+			<< "Failed to attach to shared proxy worker: "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
 IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
 				     const char *ipaProxyWorkerPath)
 	: IPCPipe()
@@ -39,6 +174,21 @@ IPCPipeUnixSocket::IPCPipeUnixSocket(const char *ipaModulePath,
 		return;
 	}
 	socket_->readyRead.connect(this, &IPCPipeUnixSocket::readyRead);
+
+	/*
+	 * Host the IPA instance in a worker process shared with the other
+	 * instances of the same module when requested.
+	 */
+	const char *shared = utils::secure_getenv("LIBCAMERA_IPA_SHARED_WORKER");
+	if (shared && shared[0] != '\0') {
+		worker_ = SharedWorker::get(ipaModulePath, ipaProxyWorkerPath);
+		if (!worker_ || worker_->attach(std::move(fd)) < 0)
+			return;
+
+		connected_ = true;
+		return;
+	}
+
 	args.push_back(std::to_string(fd.get()));
 	fds.push_back(fd.get());
 
@@ -59,16 +209,59 @@ IPCPipeUnixSocket::~IPCPipeUnixSocket()
 
 int IPCPipeUnixSocket::sendSync(const IPCMessage &in, IPCMessage *out)
 {
-	IPCUnixSocket::Payload response;
+	int ret = sendSyncBegin(in);
+	if (ret)
+		return ret;
+
+	return sendSyncEnd(in.header().cookie, out);
+}
+
+int IPCPipeUnixSocket::sendSyncBegin(const IPCMessage &in)
+{
+	uint32_t cookie = in.header().cookie;
+
+	const auto result = callData_.insert({ cookie, { {}, false } });
+	if (!result.second) {
+		LOG(IPCPipe, Error) << "Call " << cookie << " already pending";
+		return -EBUSY;
+	}
 
-	int ret = call(in.payload(), &response, in.header().cookie);
+	int ret = socket_->send(in.payload());
 	if (ret) {
+		callData_.erase(result.first);
 		LOG(IPCPipe, Error) << "Failed to call sync";
 		return ret;
 	}
 
+	return 0;
+}
+
+int IPCPipeUnixSocket::sendSyncEnd(uint32_t cookie, IPCMessage *out)
+{
+	auto iter = callData_.find(cookie);
+	if (iter == callData_.end()) {
+		LOG(IPCPipe, Error) << "Call " << cookie << " not pending";
+		return -EINVAL;
+	}
+
+	/* \todo Make this less dangerous, see IPCPipe::sendSync() */
+	Timer timeout;
+	timeout.start(2000ms);
+	while (!iter->second.done) {
+		if (!timeout.isRunning()) {
+			LOG(IPCPipe, Error) << "Call timeout!";
+			callTimeouts().increment();
+			callData_.erase(iter);
+			return -ETIMEDOUT;
+		}
+
+		Thread::current()->eventDispatcher()->processEvents();
+	}
+
 	if (out)
-		*out = IPCMessage(response);
+		*out = IPCMessage(iter->second.response);
+
+	callData_.erase(iter);
 
 	return 0;
 }
@@ -103,7 +296,7 @@ void IPCPipeUnixSocket::readyRead()
 
 	auto callData = callData_.find(ipcMessage.header().cookie);
 	if (callData != callData_.end()) {
-		*callData->second.response = std::move(payload);
+		callData->second.response = std::move(payload);
 		callData->second.done = true;
 		return;
 	}
@@ -112,36 +305,4 @@ void IPCPipeUnixSocket::readyRead()
 	recv.emit(ipcMessage);
 }
 
-int IPCPipeUnixSocket::call(const IPCUnixSocket::Payload &message,
-			    IPCUnixSocket::Payload *response, uint32_t cookie)
-{
-	Timer timeout;
-	int ret;
-
-	const auto result = callData_.insert({ cookie, { response, false } });
-	const auto &iter = result.first;
-
-	ret = socket_->send(message);
-	if (ret) {
-		callData_.erase(iter);
-		return ret;
-	}
-
-	/* \todo Make this less dangerous, see IPCPipe::sendSync() */
-	timeout.start(2000ms);
-	while (!iter->second.done) {
-		if (!timeout.isRunning()) {
-			LOG(IPCPipe, Error) << "Call timeout!";
-			callData_.erase(iter);
-			return -ETIMEDOUT;
-		}
-
-		Thread::current()->eventDispatcher()->processEvents();
-	}
-
-	callData_.erase(iter);
-
-	return 0;
-}
-
 } /* namespace libcamera */
@@ -8,14 +8,20 @@
 #include "libcamera/internal/ipc_unixsocket.h"
 
 #include <array>
+#include <atomic>
 #include <poll.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/utils.h>
 
 /**
  * \file ipc_unixsocket.h
@@ -26,6 +32,54 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(IPCUnixSocket)
 
+namespace {
+
+/* Size of the data area of each ring, shall be a power of two. */
+constexpr uint32_t kRingSize = 256 * 1024;
+constexpr size_t kRingControlSize = 4096;
+constexpr size_t kRingRegionSize = kRingControlSize + kRingSize;
+
+constexpr uint32_t kRingSetupMagic = 0x4c435247; /* 'LCRG' */
+constexpr uint32_t kRingSetupVersion = 1;
+
+/*
+ * The ring setup message is sent by the creator of the channel as the first
+ * datagram on the socket, along with the ring memfd and the two doorbell
+ * eventfds. Its size differs from the size of IPCUnixSocket::Header to make it
+ * distinguishable.
+ */
+struct RingSetup {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+/* The payload is transported on the socket. */
+constexpr uint32_t kRingEntryExternal = (1 << 0);
+
+struct RingEntry {
+	uint32_t size;
+	uint32_t flags;
+};
+
+static_assert(kRingSize % sizeof(RingEntry) == 0);
+
+} /* namespace */
+
+/*
+ * The head and tail indices are free-running, and are only ever written by the
+ * producer and the consumer respectively. Both sides keep a local copy of the
+ * index they own, and validate the index owned by the peer, as the peer can't
+ * be trusted.
+ */
+struct IPCUnixSocket::RingControl {
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
 /**
  * \struct IPCUnixSocket::Payload
  * \brief Container for an IPC payload
@@ -66,11 +120,20 @@ LOG_DEFINE_CATEGORY(IPCUnixSocket)
  * it to the other side by passing the file descriptor to bind(). At that point
  * the channel is operation and communication is bidirectional and symmmetrical.
  *
+ * When the channel is created, a pair of shared memory rings, one per
+ * direction, is set up along with eventfd doorbells, and passed to the remote
+ * side over the socket. Payloads that carry no file descriptors and fit in the
+ * ring are then copied directly to shared memory, bypassing the socket. Other
+ * payloads are transported over the socket, with a marker in the ring to
+ * preserve message ordering. If the rings can't be set up, all payloads are
+ * transported over the socket. This is transparent to the users of the class.
+ *
  * \context This class is \threadbound.
  */
 
 IPCUnixSocket::IPCUnixSocket()
-	: headerReceived_(false), notifier_(nullptr)
+	: headerReceived_(false), notifier_(nullptr), ringMem_(nullptr),
+	  tx_{}, rx_{}, ringNotifier_(nullptr)
 {
 }
 
@@ -111,6 +174,11 @@ UniqueFD IPCUnixSocket::create()
 	if (bind(std::move(socketFds[0])) < 0)
 		return {};
 
+	/* Fall back to transporting all payloads over the socket on failure. */
+	if (createRings() < 0)
+		LOG(IPCUnixSocket, Warning)
+			<< "Failed to create shared memory rings";
+
 	return std::move(socketFds[1]);
 }
 
@@ -133,6 +201,12 @@ int IPCUnixSocket::bind(UniqueFD fd)
 	notifier_ = new EventNotifier(fd_.get(), EventNotifier::Read);
 	notifier_->activated.connect(this, &IPCUnixSocket::dataNotifier);
 
+	int ret = bindRings();
+	if (ret < 0) {
+		close();
+		return ret;
+	}
+
 	return 0;
 }
 
@@ -146,6 +220,8 @@ void IPCUnixSocket::close()
 	if (!isBound())
 		return;
 
+	unmapRings();
+
 	delete notifier_;
 	notifier_ = nullptr;
 
@@ -174,27 +250,16 @@ bool IPCUnixSocket::isBound() const
  */
 int IPCUnixSocket::send(const Payload &payload)
 {
-	int ret;
-
 	if (!isBound())
 		return -ENOTCONN;
 
-	Header hdr = {};
-	hdr.data = payload.data.size();
-	hdr.fds = payload.fds.size();
-
-	if (!hdr.data && !hdr.fds)
+	if (payload.data.empty() && payload.fds.empty())
 		return -EINVAL;
 
-	ret = ::send(fd_.get(), &hdr, sizeof(hdr), 0);
-	if (ret < 0) {
-		ret = -errno;
-		LOG(IPCUnixSocket, Error)
-			<< "Failed to send: " << strerror(-ret);
-		return ret;
-	}
+	if (ringMem_)
+		return sendRing(payload);
 
-	return sendData(payload.data.data(), hdr.data, payload.fds.data(), hdr.fds);
+	return sendSocket(payload);
 }
 
 /**
@@ -219,6 +284,9 @@ int IPCUnixSocket::receive(Payload *payload)
 	if (!isBound())
 		return -ENOTCONN;
 
+	if (ringMem_)
+		return receiveRing(payload);
+
 	if (!headerReceived_)
 		return -EAGAIN;
 
@@ -241,6 +309,47 @@ int IPCUnixSocket::receive(Payload *payload)
  * \brief A Signal emitted when a message is ready to be read
  */
 
+int IPCUnixSocket::sendSocket(const Payload &payload)
+{
+	Header hdr = {};
+	hdr.data = payload.data.size();
+	hdr.fds = payload.fds.size();
+
+	int ret = ::send(fd_.get(), &hdr, sizeof(hdr), 0);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to send: " << strerror(-ret);
+		return ret;
+	}
+
+	return sendData(payload.data.data(), hdr.data, payload.fds.data(), hdr.fds);
+}
+
+int IPCUnixSocket::receiveSocket(Payload *payload)
+{
+	Header hdr;
+
+	int ret = ::recv(fd_.get(), &hdr, sizeof(hdr), 0);
+	if (ret < 0) {
+		ret = -errno;
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to receive header: " << strerror(-ret);
+		return ret;
+	}
+
+	if (ret != sizeof(hdr)) {
+		LOG(IPCUnixSocket, Error) << "Invalid header size " << ret;
+		return -EPROTO;
+	}
+
+	payload->data.resize(hdr.data);
+	payload->fds.resize(hdr.fds);
+
+	return recvData(payload->data.data(), hdr.data,
+			payload->fds.data(), hdr.fds);
+}
+
 int IPCUnixSocket::sendData(const void *buffer, size_t length,
 			    const int32_t *fds, unsigned int num)
 {
@@ -313,6 +422,270 @@ int IPCUnixSocket::recvData(void *buffer, size_t length,
 	return 0;
 }
 
+int IPCUnixSocket::createRings()
+{
+	UniqueFD memfd = MemFd::create("libcamera-ipc", 2 * kRingRegionSize,
+				       MemFd::Seal::Shrink | MemFd::Seal::Grow);
+	if (!memfd.isValid())
+		return -ENOMEM;
+
+	std::array<UniqueFD, 2> doorbells;
+	for (UniqueFD &doorbell : doorbells) {
+		doorbell = UniqueFD(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK |
+					       EFD_SEMAPHORE));
+		if (!doorbell.isValid()) {
+			int ret = -errno;
+			LOG(IPCUnixSocket, Error)
+				<< "Failed to create eventfd: " << strerror(-ret);
+			return ret;
+		}
+	}
+
+	/*
+	 * The first doorbell rings from the creator to the remote side, the
+	 * second one in the other direction.
+	 */
+	tx_.doorbell = std::move(doorbells[0]);
+	rx_.doorbell = std::move(doorbells[1]);
+
+	int ret = mapRings(memfd, true);
+	if (ret < 0) {
+		unmapRings();
+		return ret;
+	}
+
+	RingSetup setup = {};
+	setup.magic = kRingSetupMagic;
+	setup.version = kRingSetupVersion;
+	setup.size = kRingSize;
+
+	const int32_t fds[] = {
+		memfd.get(), tx_.doorbell.get(), rx_.doorbell.get()
+	};
+
+	ret = sendData(&setup, sizeof(setup), fds, std::size(fds));
+	if (ret < 0) {
+		unmapRings();
+		return ret;
+	}
+
+	return 0;
+}
+
+int IPCUnixSocket::bindRings()
+{
+	/*
+	 * The ring setup message, if any, is the first datagram queued by the
+	 * creator of the channel. Peek at it without consuming anything else.
+	 */
+	RingSetup setup;
+	ssize_t size = ::recv(fd_.get(), &setup, sizeof(setup), MSG_PEEK);
+	if (size != sizeof(setup) || setup.magic != kRingSetupMagic)
+		return 0;
+
+	std::array<int32_t, 3> fds;
+	fds.fill(-1);
+
+	int ret = recvData(&setup, sizeof(setup), fds.data(), fds.size());
+	if (ret < 0)
+		return ret;
+
+	UniqueFD memfd(fds[0]);
+	rx_.doorbell = UniqueFD(fds[1]);
+	tx_.doorbell = UniqueFD(fds[2]);
+
+	if (setup.version != kRingSetupVersion || setup.size != kRingSize ||
+	    !memfd.isValid() || !rx_.doorbell.isValid() ||
+	    !tx_.doorbell.isValid()) {
+		LOG(IPCUnixSocket, Error) << "Invalid ring setup message";
+		return -EPROTO;
+	}
+
+	return mapRings(memfd, false);
+}
+
+int IPCUnixSocket::mapRings(const UniqueFD &memfd, bool creator)
+{
+	static_assert(sizeof(RingControl) <= kRingControlSize);
+
+	struct stat st;
+	if (fstat(memfd.get(), &st) < 0 ||
+	    static_cast<size_t>(st.st_size) < 2 * kRingRegionSize) {
+		LOG(IPCUnixSocket, Error) << "Invalid ring memory";
+		return -EINVAL;
+	}
+
+	void *mem = mmap(nullptr, 2 * kRingRegionSize, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, memfd.get(), 0);
+	if (mem == MAP_FAILED) {
+		int ret = -errno;
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to map rings: " << strerror(-ret);
+		return ret;
+	}
+
+	uint8_t *regions[2] = {
+		static_cast<uint8_t *>(mem),
+		static_cast<uint8_t *>(mem) + kRingRegionSize,
+	};
+
+	Ring *rings[2] = { &tx_, &rx_ };
+	if (!creator)
+		std::swap(rings[0], rings[1]);
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		rings[i]->control = reinterpret_cast<RingControl *>(regions[i]);
+		rings[i]->data = regions[i] + kRingControlSize;
+	}
+
+	tx_.pos = tx_.control->head.load(std::memory_order_relaxed);
+	rx_.pos = rx_.control->tail.load(std::memory_order_relaxed);
+
+	ringMem_ = mem;
+
+	/* All payloads are now signalled through the ring doorbell. */
+	notifier_->setEnabled(false);
+
+	ringNotifier_ = new EventNotifier(rx_.doorbell.get(), EventNotifier::Read);
+	ringNotifier_->activated.connect(this, &IPCUnixSocket::ringNotifier);
+
+	return 0;
+}
+
+void IPCUnixSocket::unmapRings()
+{
+	delete ringNotifier_;
+	ringNotifier_ = nullptr;
+
+	if (ringMem_) {
+		munmap(ringMem_, 2 * kRingRegionSize);
+		ringMem_ = nullptr;
+		notifier_->setEnabled(true);
+	}
+
+	tx_ = {};
+	rx_ = {};
+}
+
+int IPCUnixSocket::sendRing(const Payload &payload)
+{
+	uint32_t used = tx_.pos - tx_.control->tail.load(std::memory_order_acquire);
+	if (used > kRingSize) {
+		LOG(IPCUnixSocket, Error) << "Corrupted transmit ring";
+		return -EPROTO;
+	}
+
+	uint32_t available = kRingSize - used;
+	uint32_t length = utils::alignUp(payload.data.size(), sizeof(RingEntry));
+
+	RingEntry entry = {};
+	entry.size = payload.data.size();
+
+	/*
+	 * File descriptors can only be passed over the socket. Send payloads
+	 * that carry file descriptors or don't fit in the ring over the socket
+	 * first, and then queue a marker in the ring to preserve ordering.
+	 */
+	if (!payload.fds.empty() || payload.data.size() > kRingSize ||
+	    sizeof(entry) + length > available) {
+		if (sizeof(entry) > available) {
+			LOG(IPCUnixSocket, Error) << "Transmit ring full";
+			return -ENOBUFS;
+		}
+
+		int ret = sendSocket(payload);
+		if (ret < 0)
+			return ret;
+
+		entry.flags = kRingEntryExternal;
+		length = 0;
+	}
+
+	uint32_t offset = tx_.pos & (kRingSize - 1);
+	memcpy(tx_.data + offset, &entry, sizeof(entry));
+	offset = (offset + sizeof(entry)) & (kRingSize - 1);
+
+	if (length) {
+		size_t first = std::min<size_t>(entry.size, kRingSize - offset);
+		memcpy(tx_.data + offset, payload.data.data(), first);
+		memcpy(tx_.data, payload.data.data() + first, entry.size - first);
+	}
+
+	tx_.pos += sizeof(entry) + length;
+	tx_.control->head.store(tx_.pos, std::memory_order_release);
+
+	uint64_t value = 1;
+	if (write(tx_.doorbell.get(), &value, sizeof(value)) < 0) {
+		int ret = -errno;
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to ring doorbell: " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+int IPCUnixSocket::receiveRing(Payload *payload)
+{
+	/*
+	 * The doorbell is a semaphore incremented once per message after the
+	 * message is published. Consume one count first to guarantee that the
+	 * message is complete.
+	 */
+	uint64_t value;
+	if (read(rx_.doorbell.get(), &value, sizeof(value)) < 0) {
+		int ret = -errno;
+		if (ret == -EAGAIN) {
+			ringNotifier_->setEnabled(true);
+			return ret;
+		}
+
+		LOG(IPCUnixSocket, Error)
+			<< "Failed to read doorbell: " << strerror(-ret);
+		return ret;
+	}
+
+	uint32_t available = rx_.control->head.load(std::memory_order_acquire) - rx_.pos;
+
+	RingEntry entry;
+	if (available < sizeof(entry) || available > kRingSize) {
+		LOG(IPCUnixSocket, Error) << "Corrupted receive ring";
+		return -EPROTO;
+	}
+
+	uint32_t offset = rx_.pos & (kRingSize - 1);
+	memcpy(&entry, rx_.data + offset, sizeof(entry));
+	offset = (offset + sizeof(entry)) & (kRingSize - 1);
+
+	uint32_t length = 0;
+
+	if (entry.flags & kRingEntryExternal) {
+		int ret = receiveSocket(payload);
+		if (ret < 0)
+			return ret;
+	} else {
+		length = utils::alignUp(entry.size, sizeof(RingEntry));
+		if (entry.size > kRingSize || length > available - sizeof(entry)) {
+			LOG(IPCUnixSocket, Error) << "Corrupted receive ring";
+			return -EPROTO;
+		}
+
+		payload->data.resize(entry.size);
+		payload->fds.clear();
+
+		size_t first = std::min<size_t>(entry.size, kRingSize - offset);
+		memcpy(payload->data.data(), rx_.data + offset, first);
+		memcpy(payload->data.data() + first, rx_.data, entry.size - first);
+	}
+
+	rx_.pos += sizeof(entry) + length;
+	rx_.control->tail.store(rx_.pos, std::memory_order_release);
+
+	ringNotifier_->setEnabled(true);
+
+	return 0;
+}
+
 void IPCUnixSocket::dataNotifier()
 {
 	int ret;
@@ -347,4 +720,14 @@ void IPCUnixSocket::dataNotifier()
 	readyRead.emit();
 }
 
+void IPCUnixSocket::ringNotifier()
+{
+	/*
+	 * Disable the notifier and emit the readyRead signal. The notifier
+	 * will be reenabled by the receive() function.
+	 */
+	ringNotifier_->setEnabled(false);
+	readyRead.emit();
+}
+
 } /* namespace libcamera */
@@ -10,7 +10,9 @@
 #include <algorithm>
 #include <errno.h>
 #include <map>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <libcamera/base/log.h>
@@ -178,6 +180,7 @@ MappedBuffer::~MappedBuffer()
  * the MapFlag flags accordingly.
  */
 MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
+	: flags_(flags)
 {
 	ASSERT(!buffer->planes().empty());
 	planes_.reserve(buffer->planes().size());
@@ -202,6 +205,7 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 		if (mappedBuffers.find(fd) == mappedBuffers.end()) {
 			const size_t length = lseek(fd, 0, SEEK_END);
 			mappedBuffers[fd] = MappedBufferInfo{ nullptr, 0, length };
+			fds_.push_back(plane.fd);
 		}
 
 		const size_t length = mappedBuffers[fd].dmabufLength;
@@ -240,4 +244,155 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 	}
 }
 
+/**
+ * \typedef MappedFrameBuffer::SyncScope
+ * \brief The synchronization of CPU accesses to all dma-bufs of a mapping
+ */
+
+/**
+ * \fn MappedFrameBuffer::syncScope() const
+ * \brief Synchronize CPU accesses to the mapped buffer for the mapping flags
+ *
+ * This function is equivalent to syncScope(MapFlags access) with the \a access
+ * set to the flags the buffer has been mapped with.
+ *
+ * \return The synchronization scope
+ */
+
+/**
+ * \brief Synchronize CPU accesses to the mapped buffer
+ * \param[in] access The type of the CPU accesses
+ *
+ * Devices and cached CPU mappings don't share a coherent view of memory on
+ * all platforms. CPU accesses to the mapped planes shall be performed within
+ * the lifetime of the returned scope, which makes device writes visible to the
+ * CPU when it is created, and CPU writes visible to devices when it is
+ * destroyed. Accesses shall be declared with the narrowest flags possible, as
+ * read accesses only invalidate the CPU caches and write accesses only clean
+ * them.
+ *
+ * The scope covers all dma-bufs of the buffer in full, as the kernel doesn't
+ * support synchronizing a subset of a dma-buf.
+ *
+ * \return The synchronization scope
+ */
+MappedFrameBuffer::SyncScope MappedFrameBuffer::syncScope(MapFlags access) const
+{
+	DmaSyncer::SyncType type;
+
+	if (access == MapFlag::ReadWrite)
+		type = DmaSyncer::SyncType::ReadWrite;
+	else if (access & MapFlag::Write)
+		type = DmaSyncer::SyncType::Write;
+	else
+		type = DmaSyncer::SyncType::Read;
+
+	SyncScope scope;
+	scope.reserve(fds_.size());
+
+	for (const SharedFD &fd : fds_)
+		scope.emplace_back(fd, type);
+
+	return scope;
+}
+
+/**
+ * \class MappedFrameBufferCache
+ * \brief Keep the mappings of recycled frame buffers alive
+ *
+ * Mapping a FrameBuffer with MappedFrameBuffer costs a few system calls per
+ * plane, and unmapping it a TLB shootdown. Components that map the same
+ * buffers for every frame can instead use a MappedFrameBufferCache, which
+ * stores the mappings of the most recently used buffers and returns them when
+ * the buffers are mapped again.
+ *
+ * Mappings are identified by the inodes of the dmabufs of the buffer planes,
+ * along with the plane offsets and lengths, as FrameBuffer instances and file
+ * descriptor numbers may be recycled for different memory. As a mapping keeps
+ * its dmabufs alive, an inode can't be reused for another dmabuf while the
+ * mapping is cached.
+ *
+ * Cached mappings keep the memory of buffers freed by their owner allocated.
+ * Users shall call clear() when their buffers are released, for instance when
+ * stopping or reconfiguring a stream.
+ */
+
+/**
+ * \var MappedFrameBufferCache::kDefaultMaxEntries
+ * \brief The default maximum number of cached mappings
+ */
+
+/**
+ * \brief Construct a cache of frame buffer mappings
+ * \param[in] flags Protection flags to apply to the mappings
+ * \param[in] maxEntries The maximum number of cached mappings
+ *
+ * When the cache is full, mapping a new buffer unmaps the least recently used
+ * buffer.
+ */
+MappedFrameBufferCache::MappedFrameBufferCache(MappedFrameBuffer::MapFlags flags,
+					       unsigned int maxEntries)
+	: flags_(flags), maxEntries_(std::max(maxEntries, 1U))
+{
+}
+
+/**
+ * \brief Map all planes of a FrameBuffer, reusing a cached mapping if any
+ * \param[in] buffer FrameBuffer to be mapped
+ *
+ * The returned mapping stays valid until it is evicted to make room for the
+ * mapping of another buffer, until clear() is called or until the cache is
+ * destroyed.
+ *
+ * \return The mapping of \a buffer, or nullptr if the buffer can't be mapped
+ */
+const MappedFrameBuffer *MappedFrameBufferCache::map(const FrameBuffer *buffer)
+{
+	int lastFd = -1;
+	struct stat st = {};
+
+	key_.clear();
+
+	for (const FrameBuffer::Plane &plane : buffer->planes()) {
+		/* Planes of a buffer usually share the same dmabuf */
+		if (plane.fd.get() != lastFd) {
+			lastFd = plane.fd.get();
+			if (fstat(lastFd, &st) < 0) {
+				int ret = errno;
+				LOG(Buffer, Error) << "Failed to stat plane: "
+						   << strerror(ret);
+				return nullptr;
+			}
+		}
+
+		key_.push_back({ st.st_dev, st.st_ino, plane.offset, plane.length });
+	}
+
+	for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+		if (it->key == key_) {
+			entries_.splice(entries_.begin(), entries_, it);
+			return &entries_.front().mapping;
+		}
+	}
+
+	MappedFrameBuffer mapping(buffer, flags_);
+	if (!mapping.isValid())
+		return nullptr;
+
+	if (entries_.size() >= maxEntries_)
+		entries_.pop_back();
+
+	entries_.push_front({ key_, std::move(mapping) });
+
+	return &entries_.front().mapping;
+}
+
+/**
+ * \brief Unmap all cached mappings
+ */
+void MappedFrameBufferCache::clear()
+{
+	entries_.clear();
+}
+
 } /* namespace libcamera */
@@ -7,18 +7,23 @@
 
 #include "libcamera/internal/media_device.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
+#include <map>
+#include <new>
 #include <stdint.h>
 #include <string>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include <linux/media.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
 
 /**
  * \file media_device.h
@@ -30,6 +35,87 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(MediaDevice)
 
+namespace {
+
+/* Storage for the media graph topology reported by MEDIA_IOC_G_TOPOLOGY */
+struct MediaTopology {
+	std::vector<struct media_v2_entity> entities;
+	std::vector<struct media_v2_interface> interfaces;
+	std::vector<struct media_v2_link> links;
+	std::vector<struct media_v2_pad> pads;
+
+	struct media_v2_topology topology()
+	{
+		struct media_v2_topology topology = {};
+
+		topology.num_entities = entities.size();
+		topology.ptr_entities = reinterpret_cast<uintptr_t>(entities.data());
+		topology.num_interfaces = interfaces.size();
+		topology.ptr_interfaces = reinterpret_cast<uintptr_t>(interfaces.data());
+		topology.num_links = links.size();
+		topology.ptr_links = reinterpret_cast<uintptr_t>(links.data());
+		topology.num_pads = pads.size();
+		topology.ptr_pads = reinterpret_cast<uintptr_t>(pads.data());
+
+		return topology;
+	}
+
+	void resize(const struct media_v2_topology &counts)
+	{
+		entities.resize(counts.num_entities);
+		interfaces.resize(counts.num_interfaces);
+		links.resize(counts.num_links);
+		pads.resize(counts.num_pads);
+	}
+};
+
+/*
+ * Process-wide cache of the media graph object counts, to retrieve the
+ * topology with a single MEDIA_IOC_G_TOPOLOGY call when media devices are
+ * populated multiple times, for instance when a CameraManager is restarted.
+ * Entries are keyed by the media device identification. The topology itself
+ * isn't cached, as the link flags can change at any time.
+ */
+class MediaTopologyCache
+{
+public:
+	static MediaTopologyCache &instance()
+	{
+		static MediaTopologyCache cache;
+		return cache;
+	}
+
+	bool find(const std::string &key, struct media_v2_topology *counts)
+	{
+		MutexLocker locker(mutex_);
+
+		auto it = counts_.find(key);
+		if (it == counts_.end())
+			return false;
+
+		*counts = it->second;
+		return true;
+	}
+
+	void store(const std::string &key, const struct media_v2_topology &topology)
+	{
+		MutexLocker locker(mutex_);
+
+		struct media_v2_topology &counts = counts_[key];
+		counts = {};
+		counts.num_entities = topology.num_entities;
+		counts.num_interfaces = topology.num_interfaces;
+		counts.num_links = topology.num_links;
+		counts.num_pads = topology.num_pads;
+	}
+
+private:
+	Mutex mutex_;
+	std::map<std::string, struct media_v2_topology> counts_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace */
+
 /**
  * \class MediaDevice
  * \brief The MediaDevice represents a Media Controller device with its full
@@ -63,7 +149,8 @@ LOG_DEFINE_CATEGORY(MediaDevice)
  * populate() before the media graph can be queried.
  */
 MediaDevice::MediaDevice(const std::string &deviceNode)
-	: deviceNode_(deviceNode), valid_(false), acquired_(false)
+	: deviceNode_(deviceNode), valid_(false), acquired_(false),
+	  lockCount_(0), arenaSize_(0), arenaUsed_(0)
 {
 }
 
@@ -147,6 +234,8 @@ bool MediaDevice::lock()
 	if (lockf(fd_.get(), F_TLOCK, 0))
 		return false;
 
+	lockCount_++;
+
 	return true;
 }
 
@@ -167,6 +256,17 @@ void MediaDevice::unlock()
 	lockf(fd_.get(), F_ULOCK, 0);
 }
 
+/**
+ * \fn MediaDevice::lockCount()
+ * \brief Retrieve the number of times the device has been locked
+ *
+ * Other instances of libcamera may reconfigure the device while it is
+ * unlocked. Users caching device state can compare the lock count with the
+ * value recorded along with the cached state to detect that it may be stale.
+ *
+ * \return The number of times the device has been successfully locked
+ */
+
 /**
  * \fn MediaDevice::busy()
  * \brief Check if a device is in use
@@ -192,12 +292,10 @@ void MediaDevice::unlock()
  */
 int MediaDevice::populate()
 {
-	struct media_v2_topology topology = {};
-	struct media_v2_entity *ents = nullptr;
-	struct media_v2_interface *interfaces = nullptr;
-	struct media_v2_link *links = nullptr;
-	struct media_v2_pad *pads = nullptr;
-	__u64 version = -1;
+	struct media_v2_topology counts = {};
+	MediaTopology mediaTopology;
+	std::string cacheKey;
+	bool sized;
 	int ret;
 
 	clear();
@@ -220,56 +318,79 @@ int MediaDevice::populate()
 	version_ = info.media_version;
 	hwRevision_ = info.hw_revision;
 
+	cacheKey = deviceNode_ + ":" + driver_ + ":" + model_ + ":" +
+		   info.bus_info + ":" + info.serial + ":" +
+		   std::to_string(info.driver_version) + ":" +
+		   std::to_string(hwRevision_);
+
 	/*
-	 * Keep calling G_TOPOLOGY until the version number stays stable.
+	 * Size the topology storage from the cached object counts if available,
+	 * to retrieve the topology with a single G_TOPOLOGY call. Otherwise, or
+	 * if the topology has grown since, retrieve the object counts first.
 	 */
+	sized = MediaTopologyCache::instance().find(cacheKey, &counts);
+
 	while (true) {
-		topology.topology_version = 0;
-		topology.ptr_entities = reinterpret_cast<uintptr_t>(ents);
-		topology.ptr_interfaces = reinterpret_cast<uintptr_t>(interfaces);
-		topology.ptr_links = reinterpret_cast<uintptr_t>(links);
-		topology.ptr_pads = reinterpret_cast<uintptr_t>(pads);
+		if (!sized) {
+			counts = {};
+			ret = ioctl(fd_.get(), MEDIA_IOC_G_TOPOLOGY, &counts);
+			if (ret < 0) {
+				ret = -errno;
+				LOG(MediaDevice, Error)
+					<< "Failed to enumerate topology: "
+					<< strerror(-ret);
+				goto done;
+			}
+		}
+
+		mediaTopology.resize(counts);
 
+		struct media_v2_topology topology = mediaTopology.topology();
 		ret = ioctl(fd_.get(), MEDIA_IOC_G_TOPOLOGY, &topology);
-		if (ret < 0) {
-			ret = -errno;
+		if (ret == 0) {
+			counts = topology;
+			break;
+		}
+
+		ret = -errno;
+		if (ret != -ENOSPC) {
 			LOG(MediaDevice, Error)
-				<< "Failed to enumerate topology: "
-				<< strerror(-ret);
+				<< "Failed to enumerate topology: " << strerror(-ret);
 			goto done;
 		}
 
-		if (version == topology.topology_version)
-			break;
-
-		delete[] ents;
-		delete[] interfaces;
-		delete[] pads;
-		delete[] links;
+		sized = false;
+	}
 
-		ents = new struct media_v2_entity[topology.num_entities]();
-		interfaces = new struct media_v2_interface[topology.num_interfaces]();
-		links = new struct media_v2_link[topology.num_links]();
-		pads = new struct media_v2_pad[topology.num_pads]();
+	/* The kernel reports the number of objects it has filled. */
+	mediaTopology.resize(counts);
+	MediaTopologyCache::instance().store(cacheKey, counts);
 
-		version = topology.topology_version;
+	/*
+	 * The media_v2_entity structure was missing the flag field before
+	 * v4.19.
+	 */
+	if (!MEDIA_V2_ENTITY_HAS_FLAGS(version_)) {
+		for (struct media_v2_entity &entity : mediaTopology.entities)
+			fixupEntityFlags(&entity);
 	}
 
 	/* Populate entities, pads and links. */
-	if (populateEntities(topology) &&
-	    populatePads(topology) &&
-	    populateLinks(topology))
-		valid_ = true;
+	{
+		struct media_v2_topology topology = mediaTopology.topology();
+
+		allocateObjects(topology);
+
+		if (populateEntities(topology) &&
+		    populatePads(topology) &&
+		    populateLinks(topology))
+			valid_ = true;
+	}
 
 	ret = 0;
 done:
 	close();
 
-	delete[] ents;
-	delete[] interfaces;
-	delete[] pads;
-	delete[] links;
-
 	if (!valid_) {
 		clear();
 		return -EINVAL;
@@ -428,7 +549,8 @@ MediaLink *MediaDevice::link(const MediaPad *source, const MediaPad *sink)
  * \brief Disable all links in the media device
  *
  * Disable all the media device links, clearing the MEDIA_LNK_FL_ENABLED flag
- * on links which are not flagged as IMMUTABLE.
+ * on links which are not flagged as IMMUTABLE. Links that are already disabled
+ * are skipped.
  *
  * \return 0 on success or a negative error code otherwise
  */
@@ -440,7 +562,50 @@ int MediaDevice::disableLinks()
 				continue;
 
 			for (MediaLink *link : pad->links()) {
-				if (link->flags() & MEDIA_LNK_FL_IMMUTABLE)
+				if (link->flags() & MEDIA_LNK_FL_IMMUTABLE ||
+				    !(link->flags() & MEDIA_LNK_FL_ENABLED))
+					continue;
+
+				int ret = link->setEnabled(false);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Configure the media device links to the desired state
+ * \param[in] links The links to enable
+ *
+ * Enable all the \a links and disable all the other links in the media device,
+ * except for immutable links. This is equivalent to a call to disableLinks()
+ * followed by a call to MediaLink::setEnabled() for each link in \a links, but
+ * only changes the links whose state differs from the desired state, as
+ * recorded in the link flags.
+ *
+ * Links are disabled before enabling the \a links, as some entities don't
+ * allow multiple sink links to be enabled at the same time.
+ *
+ * All the \a links shall belong to this media device.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaDevice::configureLinks(const std::vector<MediaLink *> &links)
+{
+	for (MediaEntity *entity : entities_) {
+		for (MediaPad *pad : entity->pads()) {
+			if (!(pad->flags() & MEDIA_PAD_FL_SOURCE))
+				continue;
+
+			for (MediaLink *link : pad->links()) {
+				if (link->flags() & MEDIA_LNK_FL_IMMUTABLE ||
+				    !(link->flags() & MEDIA_LNK_FL_ENABLED))
+					continue;
+
+				if (std::find(links.begin(), links.end(), link) != links.end())
 					continue;
 
 				int ret = link->setEnabled(false);
@@ -450,9 +615,44 @@ int MediaDevice::disableLinks()
 		}
 	}
 
+	for (MediaLink *link : links) {
+		if (link->flags() & MEDIA_LNK_FL_ENABLED)
+			continue;
+
+		int ret = link->setEnabled(true);
+		if (ret)
+			return ret;
+	}
+
 	return 0;
 }
 
+/**
+ * \brief Allocate a request of the Media Controller Request API
+ *
+ * The media device shall be acquired to allocate requests.
+ *
+ * \return A new request, or nullptr if the driver doesn't support the Request
+ * API or an error occurred
+ */
+std::unique_ptr<MediaRequest> MediaDevice::allocateRequest()
+{
+	if (!fd_.isValid())
+		return nullptr;
+
+	int requestFd;
+	int ret = ioctl(fd_.get(), MEDIA_IOC_REQUEST_ALLOC, &requestFd);
+	if (ret < 0) {
+		ret = -errno;
+		if (ret != -ENOTTY)
+			LOG(MediaDevice, Error)
+				<< "Failed to allocate request: " << strerror(-ret);
+		return nullptr;
+	}
+
+	return std::make_unique<MediaRequest>(UniqueFD(requestFd));
+}
+
 /**
  * \var MediaDevice::disconnected
  * \brief Signal emitted when the media device is disconnected from the system
@@ -528,7 +728,7 @@ MediaObject *MediaDevice::object(unsigned int id)
  *
  * If the \a object has a unique id it is added to the media graph, and its
  * lifetime will be managed by the media device. Otherwise the object isn't
- * added to the graph and the caller must delete it.
+ * added to the graph and the caller must destroy it.
  *
  * \return true if the object was successfully added to the graph and false
  * otherwise
@@ -562,9 +762,10 @@ bool MediaDevice::addObject(MediaObject *object)
 void MediaDevice::clear()
 {
 	for (auto const &o : objects_)
-		delete o.second;
+		o.second->~MediaObject();
 
 	objects_.clear();
+	arenaUsed_ = 0;
 	entities_.clear();
 	valid_ = false;
 }
@@ -574,6 +775,47 @@ void MediaDevice::clear()
  * \brief Global list of media entities in the media graph
  */
 
+/*
+ * The media graph objects are allocated from a single memory arena, sized for
+ * the topology, instead of individually. The arena is reused when the media
+ * device is populated again, if large enough.
+ */
+namespace {
+
+constexpr size_t arenaUnits(size_t size)
+{
+	return (size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+}
+
+} /* namespace */
+
+void MediaDevice::allocateObjects(const struct media_v2_topology &topology)
+{
+	size_t size = topology.num_entities * arenaUnits(sizeof(MediaEntity))
+		    + topology.num_pads * arenaUnits(sizeof(MediaPad))
+		    + topology.num_links * arenaUnits(sizeof(MediaLink));
+
+	arenaUsed_ = 0;
+
+	if (size <= arenaSize_)
+		return;
+
+	arena_ = std::make_unique<std::max_align_t[]>(size);
+	arenaSize_ = size;
+}
+
+template<typename T, typename... Args>
+T *MediaDevice::createObject(Args &&...args)
+{
+	size_t size = arenaUnits(sizeof(T));
+	ASSERT(arenaUsed_ + size <= arenaSize_);
+
+	T *object = new (&arena_[arenaUsed_]) T(std::forward<Args>(args)...);
+	arenaUsed_ += size;
+
+	return object;
+}
+
 /**
  * \brief Find the interface associated with an entity
  * \param[in] topology The media topology as returned by MEDIA_IOC_G_TOPOLOGY
@@ -625,23 +867,16 @@ bool MediaDevice::populateEntities(const struct media_v2_topology &topology)
 	for (unsigned int i = 0; i < topology.num_entities; ++i) {
 		struct media_v2_entity *ent = &mediaEntities[i];
 
-		/*
-		 * The media_v2_entity structure was missing the flag field before
-		 * v4.19.
-		 */
-		if (!MEDIA_V2_ENTITY_HAS_FLAGS(version_))
-			fixupEntityFlags(ent);
-
 		/*
 		 * Find the interface linked to this entity to get the device
 		 * node major and minor numbers.
 		 */
 		struct media_v2_interface *iface =
 			findInterface(topology, ent->id);
-		MediaEntity *entity = new MediaEntity(this, ent, iface);
+		MediaEntity *entity = createObject<MediaEntity>(this, ent, iface);
 
 		if (!addObject(entity)) {
-			delete entity;
+			entity->~MediaEntity();
 			return false;
 		}
 
@@ -669,9 +904,9 @@ bool MediaDevice::populatePads(const struct media_v2_topology &topology)
 			return false;
 		}
 
-		MediaPad *pad = new MediaPad(&mediaPads[i], mediaEntity);
+		MediaPad *pad = createObject<MediaPad>(&mediaPads[i], mediaEntity);
 		if (!addObject(pad)) {
-			delete pad;
+			pad->~MediaPad();
 			return false;
 		}
 
@@ -720,10 +955,10 @@ bool MediaDevice::populateLinks(const struct media_v2_topology &topology)
 				return false;
 			}
 
-			MediaLink *link = new MediaLink(&mediaLinks[i],
-							sourcePad, sinkPad);
+			MediaLink *link = createObject<MediaLink>(&mediaLinks[i],
+								  sourcePad, sinkPad);
 			if (!addObject(link)) {
-				delete link;
+				link->~MediaLink();
 				return false;
 			}
 
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Media Controller request
+ */
+
+#include "libcamera/internal/media_request.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <linux/media.h>
+
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/log.h>
+
+/**
+ * \file media_request.h
+ * \brief Media Controller request, to apply parameters to a frame atomically
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(MediaDevice)
+
+/**
+ * \class MediaRequest
+ * \brief A request of the Media Controller Request API
+ *
+ * A MediaRequest bundles controls and buffers of the devices of a media graph
+ * that the kernel applies together when processing a frame. Controls are
+ * added with V4L2Device::setControls() and buffers with
+ * V4L2VideoDevice::queueBuffer(), passing the request to both. Neither takes
+ * effect until the request is queued with queue().
+ *
+ * The completed signal is emitted when the kernel has processed all the
+ * objects of the request. The request shall then be reinitialized with
+ * reinit() before being reused.
+ *
+ * Requests are allocated by MediaDevice::allocateRequest(), for the media
+ * devices whose drivers support the Request API.
+ */
+
+/**
+ * \brief Construct a MediaRequest from a request file descriptor
+ * \param[in] fd The file descriptor returned by MEDIA_IOC_REQUEST_ALLOC
+ */
+MediaRequest::MediaRequest(UniqueFD fd)
+	: fd_(std::move(fd)), queued_(false)
+{
+	notifier_ = std::make_unique<EventNotifier>(fd_.get(),
+						    EventNotifier::Exception);
+	notifier_->setEnabled(false);
+	notifier_->activated.connect(this, &MediaRequest::requestComplete);
+}
+
+MediaRequest::~MediaRequest() = default;
+
+/**
+ * \fn MediaRequest::fd()
+ * \brief Retrieve the request file descriptor
+ * \return The request file descriptor
+ */
+
+/**
+ * \fn MediaRequest::isQueued()
+ * \brief Check if the request has been queued and hasn't completed yet
+ * \return True if the request is queued, false otherwise
+ */
+
+/**
+ * \brief Queue the request to the kernel
+ *
+ * Queue the request to apply all the controls and buffers it contains. A
+ * request can't be modified once it has been queued.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaRequest::queue()
+{
+	if (queued_)
+		return -EBUSY;
+
+	if (::ioctl(fd_.get(), MEDIA_REQUEST_IOC_QUEUE) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to queue request: " << strerror(-ret);
+		return ret;
+	}
+
+	queued_ = true;
+	notifier_->setEnabled(true);
+
+	return 0;
+}
+
+/**
+ * \brief Reinitialize the request for reuse
+ *
+ * Drop the controls and buffers of a completed request, or of a request that
+ * hasn't been queued, to reuse it for another frame.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaRequest::reinit()
+{
+	if (queued_)
+		return -EBUSY;
+
+	if (::ioctl(fd_.get(), MEDIA_REQUEST_IOC_REINIT) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to reinitialize request: " << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * \var MediaRequest::completed
+ * \brief Signal emitted when the kernel has completed the request
+ */
+
+void MediaRequest::requestComplete()
+{
+	notifier_->setEnabled(false);
+	queued_ = false;
+
+	completed.emit(this);
+}
+
+} /* namespace libcamera */
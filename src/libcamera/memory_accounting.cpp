@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Accounting of the memory allocated by libcamera
+ */
+
+#include "libcamera/internal/memory_accounting.h"
+
+#include <map>
+#include <utility>
+
+#include <libcamera/base/mutex.h>
+
+/**
+ * \file memory_accounting.h
+ * \brief Accounting of the memory allocated by libcamera
+ */
+
+namespace libcamera {
+
+namespace {
+
+class MemoryAccounts
+{
+public:
+	static MemoryAccounts &instance()
+	{
+		static MemoryAccounts accounts;
+		return accounts;
+	}
+
+	void add(const std::string &category, MemoryAccount::Heap heap,
+		 std::size_t size)
+	{
+		MutexLocker locker(mutex_);
+
+		Totals &totals = totals_[{ category, heap }];
+		totals.size += size;
+		totals.count++;
+	}
+
+	void remove(const std::string &category, MemoryAccount::Heap heap,
+		    std::size_t size)
+	{
+		MutexLocker locker(mutex_);
+
+		auto it = totals_.find({ category, heap });
+		if (it == totals_.end())
+			return;
+
+		Totals &totals = it->second;
+		totals.size -= size;
+		if (!--totals.count)
+			totals_.erase(it);
+	}
+
+	std::vector<MemoryAccount::Usage> usage() const
+	{
+		MutexLocker locker(mutex_);
+
+		std::vector<MemoryAccount::Usage> usage;
+		usage.reserve(totals_.size());
+
+		for (const auto &[key, totals] : totals_)
+			usage.push_back({ key.first, key.second, totals.size,
+					  totals.count });
+
+		return usage;
+	}
+
+private:
+	struct Totals {
+		std::size_t size = 0;
+		unsigned int count = 0;
+	};
+
+	mutable Mutex mutex_;
+	std::map<std::pair<std::string, MemoryAccount::Heap>, Totals> totals_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+} /* namespace */
+
+/**
+ * \class MemoryAccount
+ * \brief Record a memory allocation in the libcamera memory accounting
+ *
+ * The MemoryAccount class accounts for the lifetime of a memory allocation.
+ * Components that allocate memory on behalf of cameras, such as frame buffers
+ * internal to pipeline handlers, dma-buf heap allocations or shared memory
+ * objects, store a MemoryAccount alongside the allocation. The size of the
+ * allocation is added to the totals of its category and heap when the account
+ * is created, and removed when the account is destroyed or reset.
+ *
+ * The category is a free-form string that identifies the owner of the
+ * allocation, for instance the device node of a video device or the name of a
+ * shared memory object. The totals of all live accounts, grouped by category
+ * and heap, can be retrieved with usage().
+ *
+ * MemoryAccount instances can be moved but not copied, and are meant to be
+ * stored as members of the objects that own the memory.
+ */
+
+/**
+ * \enum MemoryAccount::Heap
+ * \brief The type of memory backing an allocation
+ * \var MemoryAccount::Heap::Cma
+ * \brief Memory allocated from the CMA dma-buf heap
+ * \var MemoryAccount::Heap::System
+ * \brief Memory allocated from the system dma-buf heap
+ * \var MemoryAccount::Heap::UDmaBuf
+ * \brief Memory allocated from memfd and exported through udmabuf
+ * \var MemoryAccount::Heap::MemFd
+ * \brief Memory allocated from memfd
+ * \var MemoryAccount::Heap::Driver
+ * \brief Memory allocated by a kernel driver, such as V4L2 MMAP buffers
+ */
+
+/**
+ * \struct MemoryAccount::Usage
+ * \brief The memory usage of a category and heap
+ * \var MemoryAccount::Usage::category
+ * \brief The category of the allocations
+ * \var MemoryAccount::Usage::heap
+ * \brief The heap of the allocations
+ * \var MemoryAccount::Usage::size
+ * \brief The total size of the allocations in bytes
+ * \var MemoryAccount::Usage::count
+ * \brief The number of allocations
+ */
+
+/**
+ * \brief Construct an empty MemoryAccount that accounts for no memory
+ */
+MemoryAccount::MemoryAccount()
+	: heap_(Heap::System), size_(0), active_(false)
+{
+}
+
+/**
+ * \brief Construct a MemoryAccount for an allocation
+ * \param[in] category The category of the allocation
+ * \param[in] heap The heap the allocation has been made from
+ * \param[in] size The size of the allocation in bytes
+ */
+MemoryAccount::MemoryAccount(const std::string &category, Heap heap,
+			     std::size_t size)
+	: category_(category), heap_(heap), size_(size), active_(true)
+{
+	MemoryAccounts::instance().add(category_, heap_, size_);
+}
+
+/**
+ * \brief Move constructor, transfer the allocation of \a other to this account
+ * \param[in] other The other MemoryAccount
+ *
+ * The \a other account is left empty.
+ */
+MemoryAccount::MemoryAccount(MemoryAccount &&other)
+	: category_(std::move(other.category_)), heap_(other.heap_),
+	  size_(std::exchange(other.size_, 0)),
+	  active_(std::exchange(other.active_, false))
+{
+}
+
+/**
+ * \brief Destroy the MemoryAccount, removing the allocation from the totals
+ */
+MemoryAccount::~MemoryAccount()
+{
+	reset();
+}
+
+/**
+ * \brief Move assignment operator, transfer the allocation of \a other to
+ * this account
+ * \param[in] other The other MemoryAccount
+ *
+ * The allocation accounted for by this account, if any, is removed from the
+ * totals first. The \a other account is left empty.
+ *
+ * \return A reference to this MemoryAccount
+ */
+MemoryAccount &MemoryAccount::operator=(MemoryAccount &&other)
+{
+	if (this == &other)
+		return *this;
+
+	reset();
+
+	category_ = std::move(other.category_);
+	heap_ = other.heap_;
+	size_ = std::exchange(other.size_, 0);
+	active_ = std::exchange(other.active_, false);
+
+	return *this;
+}
+
+/**
+ * \brief Remove the allocation from the totals and empty the account
+ */
+void MemoryAccount::reset()
+{
+	if (!active_)
+		return;
+
+	MemoryAccounts::instance().remove(category_, heap_, size_);
+
+	category_.clear();
+	size_ = 0;
+	active_ = false;
+}
+
+/**
+ * \fn MemoryAccount::category()
+ * \brief Retrieve the category of the allocation
+ * \return The category of the allocation
+ */
+
+/**
+ * \fn MemoryAccount::heap()
+ * \brief Retrieve the heap of the allocation
+ * \return The heap of the allocation
+ */
+
+/**
+ * \fn MemoryAccount::size()
+ * \brief Retrieve the size of the allocation
+ * \return The size of the allocation in bytes, or 0 if the account is empty
+ */
+
+/**
+ * \brief Retrieve the memory usage of all live allocations
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The totals of the live allocations, grouped by category and heap,
+ * sorted by category
+ */
+std::vector<MemoryAccount::Usage> MemoryAccount::usage()
+{
+	return MemoryAccounts::instance().usage();
+}
+
+/**
+ * \brief Retrieve the name of a heap
+ * \param[in] heap The heap
+ * \return The name of the \a heap
+ */
+const char *MemoryAccount::heapName(Heap heap)
+{
+	switch (heap) {
+	case Heap::Cma:
+		return "cma";
+	case Heap::System:
+		return "system";
+	case Heap::UDmaBuf:
+		return "udmabuf";
+	case Heap::MemFd:
+		return "memfd";
+	case Heap::Driver:
+		return "driver";
+	}
+
+	return "unknown";
+}
+
+} /* namespace libcamera */
@@ -48,13 +48,14 @@ public:
 		 * available channels on i.MX8MP.
 		 */
 		streams_.resize(2);
+		streamPipes_.resize(streams_.size());
 	}
 
 	PipelineHandlerISI *pipe();
 
 	int init();
 
-	unsigned int pipeIndex(const Stream *stream)
+	unsigned int streamIndex(const Stream *stream)
 	{
 		return stream - &*streams_.begin();
 	}
@@ -69,6 +70,8 @@ public:
 	std::vector<Stream> streams_;
 
 	std::vector<Stream *> enabledStreams_;
+	/* ISI pipes assigned to the streams, indexed by stream index */
+	std::vector<unsigned int> streamPipes_;
 
 	unsigned int xbarSink_;
 };
@@ -77,7 +80,7 @@ class ISICameraConfiguration : public CameraConfiguration
 {
 public:
 	ISICameraConfiguration(ISICameraData *data)
-		: data_(data)
+		: data_(data), pipe_(data->pipe())
 	{
 	}
 
@@ -94,6 +97,7 @@ private:
 	validateYuv(std::set<Stream *> &availableStreams, const Size &maxResolution);
 
 	const ISICameraData *data_;
+	const PipelineHandlerISI *pipe_;
 };
 
 class PipelineHandlerISI : public PipelineHandler
@@ -112,7 +116,20 @@ public:
 
 	int start(Camera *camera, const ControlList *controls) override;
 
+	unsigned int availablePipes(const ISICameraData *data) const;
+	bool allocatePipes(const ISICameraData *data, unsigned int numStreams,
+			   unsigned int inputWidth,
+			   std::vector<unsigned int> *pipes) const;
+
+	/*
+	 * Maximum input width a single ISI pipe can process. Wider frames are
+	 * processed by chaining the pipe with the next one, which lends its
+	 * line buffer.
+	 */
+	static constexpr unsigned int kPipeLineBufferWidth = 2048;
+
 protected:
+	void releaseDevice(Camera *camera) override;
 	void stopDevice(Camera *camera) override;
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
@@ -124,6 +141,8 @@ private:
 	struct Pipe {
 		std::unique_ptr<V4L2Subdevice> isi;
 		std::unique_ptr<V4L2VideoDevice> capture;
+		/* Camera the pipe, or its line buffer, is assigned to */
+		const ISICameraData *owner = nullptr;
 	};
 
 	ISICameraData *cameraData(Camera *camera)
@@ -132,6 +151,7 @@ private:
 	}
 
 	Pipe *pipeFromStream(Camera *camera, const Stream *stream);
+	void releasePipes(const ISICameraData *data);
 
 	StreamConfiguration generateYUVConfiguration(Camera *camera,
 						     const Size &size);
@@ -500,26 +520,35 @@ CameraConfiguration::Status ISICameraConfiguration::validate()
 	if (config_.empty())
 		return Invalid;
 
-	/* Cap the number of streams to the number of available ISI pipes. */
-	if (config_.size() > availableStreams.size()) {
-		config_.resize(availableStreams.size());
+	/*
+	 * Cap the number of streams to the number of ISI pipes not assigned to
+	 * other cameras.
+	 */
+	unsigned int numPipes = std::min<unsigned int>(availableStreams.size(),
+						       pipe_->availablePipes(data_));
+	if (!numPipes) {
+		LOG(ISI, Error) << "All ISI pipes are in use by other cameras";
+		return Invalid;
+	}
+
+	if (config_.size() > numPipes) {
+		config_.resize(numPipes);
 		status = Adjusted;
 	}
 
 	/*
-	 * If more than a single stream is requested, the maximum allowed input
-	 * image width is 2048. Cap the maximum image size accordingly.
-	 *
-	 * \todo The (size > 1) check only applies to i.MX8MP which has 2 ISI
-	 * channels. SoCs with more channels than the i.MX8MP are capable of
-	 * supporting more streams with input width > 2048 by chaining
-	 * successive channels together. Define a policy for channels allocation
-	 * to fully support other SoCs.
+	 * Each stream is processed by one ISI pipe, whose line buffer limits
+	 * the input image width. Wider images require chaining the pipe with
+	 * the next one, which is then unavailable for other streams. If the
+	 * available pipes can't be chained for all streams, cap the maximum
+	 * image width to the line buffer width.
 	 */
+	constexpr unsigned int lineBufferWidth = PipelineHandlerISI::kPipeLineBufferWidth;
 	CameraSensor *sensor = data_->sensor_.get();
 	Size maxResolution = sensor->resolution();
-	if (config_.size() > 1)
-		maxResolution.width = std::min(2048U, maxResolution.width);
+	if (maxResolution.width > lineBufferWidth &&
+	    !pipe_->allocatePipes(data_, config_.size(), maxResolution.width, nullptr))
+		maxResolution.width = lineBufferWidth;
 
 	/* Validate streams according to the format of the first one. */
 	const PixelFormatInfo info = PixelFormatInfo::info(config_[0].pixelFormat);
@@ -600,6 +629,11 @@ CameraConfiguration::Status ISICameraConfiguration::validate()
 
 	LOG(ISI, Debug) << "Selected sensor format: " << sensorFormat_;
 
+	if (!pipe_->allocatePipes(data_, config_.size(), bestSize.width, nullptr)) {
+		LOG(ISI, Error) << "Unable to assign ISI pipes to the streams";
+		return Invalid;
+	}
+
 	return status;
 }
 
@@ -817,23 +851,64 @@ int PipelineHandlerISI::configure(Camera *camera, CameraConfiguration *c)
 	sensorSrc->links()[0]->setEnabled(true);
 
 	/*
-	 * Reset the crossbar switch routing and enable one route for each
-	 * requested stream configuration.
-	 *
-	 * \todo Handle concurrent usage of multiple cameras by adjusting the
-	 * routing table instead of resetting it.
+	 * Assign ISI pipes to the streams, releasing the ones previously
+	 * assigned to the camera first.
+	 */
+	releasePipes(data);
+
+	const unsigned int inputWidth = camConfig->sensorFormat_.size.width;
+	std::vector<unsigned int> pipes;
+	if (!allocatePipes(data, c->size(), inputWidth, &pipes)) {
+		LOG(ISI, Error) << "Unable to assign ISI pipes to the streams";
+		return -EBUSY;
+	}
+
+	const unsigned int span = inputWidth > kPipeLineBufferWidth ? 2 : 1;
+	for (unsigned int index : pipes) {
+		for (unsigned int i = 0; i < span; ++i)
+			pipes_[index + i].owner = data;
+	}
+
+	for (const auto &[idx, config] : utils::enumerate(*c))
+		data->streamPipes_[data->streamIndex(config.stream())] = pipes[idx];
+
+	unsigned int used = std::count_if(pipes_.begin(), pipes_.end(),
+					  [](const Pipe &p) { return p.owner; });
+	LOG(ISI, Info)
+		<< "Assigned ISI pipes " << utils::join(pipes, ", ")
+		<< (span > 1 ? " (chained)" : "") << " to camera "
+		<< data->sensor_->id() << ", " << used << " of "
+		<< pipes_.size() << " pipes in use";
+
+	/*
+	 * Update the crossbar switch routing, replacing the routes of the
+	 * camera and the routes to its pipes with one route for each stream.
+	 * The routes of the other cameras are kept.
 	 */
-	V4L2Subdevice::Routing routing = {};
+	V4L2Subdevice::Routing routing;
+	int ret = crossbar_->getRouting(&routing, V4L2Subdevice::ActiveFormat);
+	if (ret)
+		return ret;
+
 	unsigned int xbarFirstSource = crossbar_->entity()->pads().size() / 2 + 1;
 
-	for (const auto &[idx, config] : utils::enumerate(*c)) {
-		uint32_t sourcePad = xbarFirstSource + idx;
+	routing.erase(std::remove_if(routing.begin(), routing.end(),
+				     [&](const V4L2Subdevice::Route &route) {
+					     unsigned int pipe = route.source.pad - xbarFirstSource;
+					     return route.sink.pad == data->xbarSink_ ||
+						    (pipe < pipes_.size() &&
+						     pipes_[pipe].owner == data);
+				     }),
+		      routing.end());
+
+	for (unsigned int index : pipes) {
+		uint32_t sourcePad = xbarFirstSource + index;
 		routing.emplace_back(V4L2Subdevice::Stream{ data->xbarSink_, 0 },
 				     V4L2Subdevice::Stream{ sourcePad, 0 },
 				     V4L2_SUBDEV_ROUTE_FL_ACTIVE);
 	}
 
-	int ret = crossbar_->setRouting(&routing, V4L2Subdevice::ActiveFormat);
+	ret = crossbar_->setRouting(&routing, V4L2Subdevice::ActiveFormat);
 	if (ret)
 		return ret;
 
@@ -938,6 +1013,67 @@ int PipelineHandlerISI::start(Camera *camera,
 	return 0;
 }
 
+unsigned int PipelineHandlerISI::availablePipes(const ISICameraData *data) const
+{
+	return std::count_if(pipes_.begin(), pipes_.end(),
+			     [&](const Pipe &pipe) {
+				     return !pipe.owner || pipe.owner == data;
+			     });
+}
+
+/*
+ * Find ISI pipes for \a numStreams streams of a camera, with an input image
+ * width of \a inputWidth. Pipes assigned to other cameras are skipped, and a
+ * pipe is chained with the next one if the width exceeds its line buffer.
+ * Store the index of the first pipe used by each stream in \a pipes if not
+ * null.
+ */
+bool PipelineHandlerISI::allocatePipes(const ISICameraData *data,
+				       unsigned int numStreams,
+				       unsigned int inputWidth,
+				       std::vector<unsigned int> *pipes) const
+{
+	const unsigned int span = inputWidth > kPipeLineBufferWidth ? 2 : 1;
+	std::vector<unsigned int> allocated;
+
+	for (unsigned int index = 0;
+	     index + span <= pipes_.size() && allocated.size() < numStreams;) {
+		bool available = std::all_of(pipes_.begin() + index,
+					     pipes_.begin() + index + span,
+					     [&](const Pipe &pipe) {
+						     return !pipe.owner || pipe.owner == data;
+					     });
+		if (!available) {
+			index++;
+			continue;
+		}
+
+		allocated.push_back(index);
+		index += span;
+	}
+
+	if (allocated.size() < numStreams)
+		return false;
+
+	if (pipes)
+		*pipes = std::move(allocated);
+
+	return true;
+}
+
+void PipelineHandlerISI::releasePipes(const ISICameraData *data)
+{
+	for (Pipe &pipe : pipes_) {
+		if (pipe.owner == data)
+			pipe.owner = nullptr;
+	}
+}
+
+void PipelineHandlerISI::releaseDevice(Camera *camera)
+{
+	releasePipes(cameraData(camera));
+}
+
 void PipelineHandlerISI::stopDevice(Camera *camera)
 {
 	ISICameraData *data = cameraData(camera);
@@ -1088,11 +1224,11 @@ PipelineHandlerISI::Pipe *PipelineHandlerISI::pipeFromStream(Camera *camera,
 							     const Stream *stream)
 {
 	ISICameraData *data = cameraData(camera);
-	unsigned int pipeIndex = data->pipeIndex(stream);
+	unsigned int streamIndex = data->streamIndex(stream);
 
-	ASSERT(pipeIndex < pipes_.size());
+	ASSERT(streamIndex < data->streamPipes_.size());
 
-	return &pipes_[pipeIndex];
+	return &pipes_[data->streamPipes_[streamIndex]];
 }
 
 void PipelineHandlerISI::bufferReady(FrameBuffer *buffer)
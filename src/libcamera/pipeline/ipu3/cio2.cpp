@@ -18,6 +18,7 @@
 #include <libcamera/transform.h>
 
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/frame_start_monitor.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/v4l2_subdevice.h"
@@ -172,7 +173,14 @@ int CIO2Device::init(const MediaDevice *media, unsigned int index)
 
 	std::string cio2Name = "ipu3-cio2 " + std::to_string(index);
 	output_ = V4L2VideoDevice::fromEntityName(media, cio2Name);
-	return output_->open();
+	ret = output_->open();
+	if (ret)
+		return ret;
+
+	frameStartMonitor_ = std::make_unique<FrameStartMonitor>(
+		std::vector<V4L2Device *>{ csi2_.get() }, output_.get());
+
+	return 0;
 }
 
 /**
@@ -216,6 +224,14 @@ int CIO2Device::configure(const Size &size, const Transform &transform,
 
 	LOG(IPU3, Debug) << "CIO2 output format " << *outputFormat;
 
+	/*
+	 * The internal buffers are kept across stop() and start(), free them
+	 * if they are too small for the new format.
+	 */
+	if (!buffers_.empty() &&
+	    buffers_[0]->planes()[0].length < outputFormat->planes[0].size)
+		freeBuffers();
+
 	return 0;
 }
 
@@ -338,13 +354,29 @@ int CIO2Device::exportBuffers(unsigned int count,
 	return output_->exportBuffers(count, buffers);
 }
 
-int CIO2Device::start()
+/**
+ * \brief Start capture on the CIO2
+ * \param[in] bufferCount The number of buffers
+ *
+ * The internal buffers allocated for requests that don't capture the raw
+ * stream are reused from the previous capture session, unless their number
+ * changed.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CIO2Device::start(unsigned int bufferCount)
 {
-	int ret = output_->exportBuffers(kBufferCount, &buffers_);
-	if (ret < 0)
-		return ret;
+	int ret;
 
-	ret = output_->importBuffers(kBufferCount);
+	if (buffers_.size() != bufferCount) {
+		freeBuffers();
+
+		ret = output_->exportBuffers(bufferCount, &buffers_);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = output_->importBuffers(bufferCount);
 	if (ret)
 		LOG(IPU3, Error) << "Failed to import CIO2 buffers";
 
@@ -353,11 +385,11 @@ int CIO2Device::start()
 
 	ret = output_->streamOn();
 	if (ret) {
-		freeBuffers();
+		releaseBuffers();
 		return ret;
 	}
 
-	ret = csi2_->setFrameStartEnabled(true);
+	ret = frameStartMonitor_->start();
 	if (ret) {
 		stop();
 		return ret;
@@ -370,11 +402,11 @@ int CIO2Device::stop()
 {
 	int ret;
 
-	csi2_->setFrameStartEnabled(false);
+	frameStartMonitor_->stop();
 
 	ret = output_->streamOff();
 
-	freeBuffers();
+	releaseBuffers();
 
 	return ret;
 }
@@ -420,13 +452,24 @@ void CIO2Device::tryReturnBuffer(FrameBuffer *buffer)
 	bufferAvailable.emit();
 }
 
-void CIO2Device::freeBuffers()
+void CIO2Device::releaseBuffers()
 {
 	availableBuffers_ = {};
-	buffers_.clear();
 
 	if (output_->releaseBuffers())
 		LOG(IPU3, Error) << "Failed to release CIO2 buffers";
 }
 
+/**
+ * \brief Free the internal buffers
+ *
+ * The internal buffers are kept when the CIO2 is stopped, to be reused when
+ * it is started again. This function frees them, and shall only be called
+ * when the CIO2 is stopped.
+ */
+void CIO2Device::freeBuffers()
+{
+	buffers_.clear();
+}
+
 } /* namespace libcamera */
@@ -13,6 +13,7 @@
 
 #include <libcamera/base/signal.h>
 
+#include "libcamera/internal/frame_start_monitor.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
@@ -50,8 +51,9 @@ public:
 	V4L2SubdeviceFormat getSensorFormat(const std::vector<unsigned int> &mbusCodes,
 					    const Size &size) const;
 
-	int start();
+	int start(unsigned int bufferCount);
 	int stop();
+	void freeBuffers();
 
 	CameraSensor *sensor() { return sensor_.get(); }
 	const CameraSensor *sensor() const { return sensor_.get(); }
@@ -59,18 +61,19 @@ public:
 	FrameBuffer *queueBuffer(Request *request, FrameBuffer *rawBuffer);
 	void tryReturnBuffer(FrameBuffer *buffer);
 	Signal<FrameBuffer *> &bufferReady() { return output_->bufferReady; }
-	Signal<uint32_t> &frameStart() { return csi2_->frameStart; }
+	Signal<uint32_t> &frameStart() { return frameStartMonitor_->frameStart; }
 
 	Signal<> bufferAvailable;
 
 private:
-	void freeBuffers();
+	void releaseBuffers();
 
 	void cio2BufferReady(FrameBuffer *buffer);
 
 	std::unique_ptr<CameraSensor> sensor_;
 	std::unique_ptr<V4L2Subdevice> csi2_;
 	std::unique_ptr<V4L2VideoDevice> output_;
+	std::unique_ptr<FrameStartMonitor> frameStartMonitor_;
 
 	std::vector<std::unique_ptr<FrameBuffer>> buffers_;
 	std::queue<FrameBuffer *> availableBuffers_;
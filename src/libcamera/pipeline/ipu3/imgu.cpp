@@ -378,10 +378,37 @@ int ImgUDevice::init(MediaDevice *media, unsigned int index)
 /**
  * \brief Calculate the ImgU pipe configuration parameters
  * \param[in] pipe The requested ImgU configuration
+ *
+ * The search for the pipe configuration is costly, and the same configurations
+ * are typically validated and applied repeatedly. The result is thus cached
+ * for each combination of input, main and viewfinder sizes, failures
+ * included.
+ *
  * \return An ImgUDevice::PipeConfig instance on success, an empty configuration
  * otherwise
  */
 ImgUDevice::PipeConfig ImgUDevice::calculatePipeConfig(Pipe *pipe)
+{
+	auto key = std::make_tuple(pipe->input, pipe->main, pipe->viewfinder);
+	auto it = pipeConfigCache_.find(key);
+	if (it != pipeConfigCache_.end()) {
+		LOG(IPU3, Debug)
+			<< "Using cached pipe configuration for input "
+			<< pipe->input << ", main " << pipe->main
+			<< ", vf " << pipe->viewfinder;
+		return it->second;
+	}
+
+	PipeConfig pipeConfig = searchPipeConfig(pipe);
+
+	if (pipeConfigCache_.size() >= kMaxCachedPipeConfigs)
+		pipeConfigCache_.clear();
+	pipeConfigCache_[key] = pipeConfig;
+
+	return pipeConfig;
+}
+
+ImgUDevice::PipeConfig ImgUDevice::searchPipeConfig(Pipe *pipe)
 {
 	pipeConfigs.clear();
 
@@ -575,28 +602,43 @@ int ImgUDevice::configureVideoDevice(V4L2VideoDevice *dev, unsigned int pad,
 
 /**
  * \brief Allocate buffers for all the ImgU video devices
+ * \param[in] bufferCount The number of buffers
+ *
+ * The parameters and statistics buffers are kept by freeBuffers(), and are
+ * only allocated if their number changed since the last call. They can be
+ * freed explicitly with freeInternalBuffers().
+ *
+ * \return 0 on success or a negative error code otherwise
  */
 int ImgUDevice::allocateBuffers(unsigned int bufferCount)
 {
+	int ret;
+
+	if (paramBuffers_.size() != bufferCount) {
+		freeInternalBuffers();
+
+		ret = param_->allocateBuffers(bufferCount, &paramBuffers_);
+		if (ret < 0) {
+			LOG(IPU3, Error) << "Failed to allocate ImgU param buffers";
+			freeInternalBuffers();
+			return ret;
+		}
+
+		ret = stat_->allocateBuffers(bufferCount, &statBuffers_);
+		if (ret < 0) {
+			LOG(IPU3, Error) << "Failed to allocate ImgU stat buffers";
+			freeInternalBuffers();
+			return ret;
+		}
+	}
+
 	/* Share buffers between CIO2 output and ImgU input. */
-	int ret = input_->importBuffers(bufferCount);
+	ret = input_->importBuffers(bufferCount);
 	if (ret) {
 		LOG(IPU3, Error) << "Failed to import ImgU input buffers";
 		return ret;
 	}
 
-	ret = param_->allocateBuffers(bufferCount, &paramBuffers_);
-	if (ret < 0) {
-		LOG(IPU3, Error) << "Failed to allocate ImgU param buffers";
-		goto error;
-	}
-
-	ret = stat_->allocateBuffers(bufferCount, &statBuffers_);
-	if (ret < 0) {
-		LOG(IPU3, Error) << "Failed to allocate ImgU stat buffers";
-		goto error;
-	}
-
 	/*
 	 * Import buffers for all outputs, regardless of whether the
 	 * corresponding stream is active or inactive, as the driver needs
@@ -624,26 +666,18 @@ error:
 
 /**
  * \brief Release buffers for all the ImgU video devices
+ *
+ * The parameters and statistics buffers are kept, to be reused by the next
+ * call to allocateBuffers().
  */
 void ImgUDevice::freeBuffers()
 {
 	int ret;
 
-	paramBuffers_.clear();
-	statBuffers_.clear();
-
 	ret = output_->releaseBuffers();
 	if (ret)
 		LOG(IPU3, Error) << "Failed to release ImgU output buffers";
 
-	ret = param_->releaseBuffers();
-	if (ret)
-		LOG(IPU3, Error) << "Failed to release ImgU param buffers";
-
-	ret = stat_->releaseBuffers();
-	if (ret)
-		LOG(IPU3, Error) << "Failed to release ImgU stat buffers";
-
 	ret = viewfinder_->releaseBuffers();
 	if (ret)
 		LOG(IPU3, Error) << "Failed to release ImgU viewfinder buffers";
@@ -653,6 +687,25 @@ void ImgUDevice::freeBuffers()
 		LOG(IPU3, Error) << "Failed to release ImgU input buffers";
 }
 
+/**
+ * \brief Free the parameters and statistics buffers
+ */
+void ImgUDevice::freeInternalBuffers()
+{
+	int ret;
+
+	paramBuffers_.clear();
+	statBuffers_.clear();
+
+	ret = param_->releaseBuffers();
+	if (ret)
+		LOG(IPU3, Error) << "Failed to release ImgU param buffers";
+
+	ret = stat_->releaseBuffers();
+	if (ret)
+		LOG(IPU3, Error) << "Failed to release ImgU stat buffers";
+}
+
 int ImgUDevice::start()
 {
 	int ret;
@@ -7,8 +7,10 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <string>
+#include <tuple>
 
 #include "libcamera/internal/v4l2_subdevice.h"
 #include "libcamera/internal/v4l2_videodevice.h"
@@ -86,6 +88,7 @@ public:
 
 	int allocateBuffers(unsigned int bufferCount);
 	void freeBuffers();
+	void freeInternalBuffers();
 
 	int start();
 	int stop();
@@ -109,6 +112,8 @@ private:
 	static constexpr unsigned int PAD_VF = 3;
 	static constexpr unsigned int PAD_STAT = 4;
 
+	static constexpr unsigned int kMaxCachedPipeConfigs = 32;
+
 	int linkSetup(const std::string &source, unsigned int sourcePad,
 		      const std::string &sink, unsigned int sinkPad,
 		      bool enable);
@@ -117,8 +122,13 @@ private:
 				 const StreamConfiguration &cfg,
 				 V4L2DeviceFormat *outputFormat);
 
+	PipeConfig searchPipeConfig(Pipe *pipe);
+
 	std::string name_;
 	MediaDevice *media_;
+
+	/* Pipe configurations indexed by input, main and viewfinder sizes */
+	std::map<std::tuple<Size, Size, Size>, PipeConfig> pipeConfigCache_;
 };
 
 } /* namespace libcamera */
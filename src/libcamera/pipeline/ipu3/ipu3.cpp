@@ -28,6 +28,7 @@
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_lens.h"
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/configuration_cache.h"
 #include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/framebuffer.h"
@@ -78,6 +79,8 @@ public:
 	IPU3Frames frameInfos_;
 
 	std::unique_ptr<ipa::ipu3::IPAProxyIPU3> ipa_;
+	/* ImgU parameters and statistics buffers mapped to the IPA */
+	std::vector<IPABuffer> ipaBuffers_;
 
 	/* Requests for which no buffer has been queued to the CIO2 device yet. */
 	std::queue<Request *> pendingRequests_;
@@ -86,6 +89,9 @@ public:
 
 	ControlInfoMap ipaControls_;
 
+	/* Results of IPU3CameraConfiguration::validate() */
+	mutable ConfigurationCache configCache_;
+
 private:
 	void metadataReady(unsigned int id, const ControlList &metadata);
 	void paramsBufferReady(unsigned int id);
@@ -97,6 +103,7 @@ class IPU3CameraConfiguration : public CameraConfiguration
 {
 public:
 	static constexpr unsigned int kBufferCount = 4;
+	static constexpr unsigned int kMaxBufferCount = 16;
 	static constexpr unsigned int kMaxStreams = 3;
 
 	IPU3CameraConfiguration(IPU3CameraData *data);
@@ -110,6 +117,8 @@ public:
 	Transform combinedTransform_;
 
 private:
+	Status validateConfiguration();
+
 	/*
 	 * The IPU3CameraData instance is guaranteed to be valid as long as the
 	 * corresponding Camera instance is valid. In order to borrow a
@@ -158,15 +167,16 @@ private:
 	int updateControls(IPU3CameraData *data);
 	int registerCameras();
 
-	int allocateBuffers(Camera *camera);
+	int allocateBuffers(Camera *camera, unsigned int bufferCount);
 	int freeBuffers(Camera *camera);
+	void freeInternalBuffers(Camera *camera);
+
+	void releaseDevice(Camera *camera) override;
 
 	ImgUDevice imgu0_;
 	ImgUDevice imgu1_;
 	MediaDevice *cio2MediaDev_;
 	MediaDevice *imguMediaDev_;
-
-	std::vector<IPABuffer> ipaBuffers_;
 };
 
 IPU3CameraConfiguration::IPU3CameraConfiguration(IPU3CameraData *data)
@@ -176,6 +186,35 @@ IPU3CameraConfiguration::IPU3CameraConfiguration(IPU3CameraData *data)
 }
 
 CameraConfiguration::Status IPU3CameraConfiguration::validate()
+{
+	ConfigurationCache::Key key(*this);
+	Status status;
+
+	/* Skip the ImgU pipe configuration search for known configurations. */
+	std::shared_ptr<const CameraConfiguration> cached =
+		data_->configCache_.lookup(key, &status);
+	if (cached) {
+		const IPU3CameraConfiguration *config =
+			static_cast<const IPU3CameraConfiguration *>(cached.get());
+
+		ConfigurationCache::restore(*config, this, &config_);
+		combinedTransform_ = config->combinedTransform_;
+		cio2Configuration_ = config->cio2Configuration_;
+		pipeConfig_ = config->pipeConfig_;
+
+		return status;
+	}
+
+	status = validateConfiguration();
+
+	data_->configCache_.insert(std::move(key),
+				   std::make_unique<IPU3CameraConfiguration>(*this),
+				   status);
+
+	return status;
+}
+
+CameraConfiguration::Status IPU3CameraConfiguration::validateConfiguration()
 {
 	Status status = Valid;
 
@@ -289,7 +328,9 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 			/* Initialize the RAW stream with the CIO2 configuration. */
 			cfg->size = cio2Configuration_.size;
 			cfg->pixelFormat = cio2Configuration_.pixelFormat;
-			cfg->bufferCount = cio2Configuration_.bufferCount;
+			cfg->bufferCount = std::clamp(cfg->bufferCount,
+						      cio2Configuration_.bufferCount,
+						      kMaxBufferCount);
 			cfg->stride = info.stride(cfg->size.width, 0, 64);
 			cfg->frameSize = info.frameSize(cfg->size, 64);
 			cfg->setStream(const_cast<Stream *>(&data_->rawStream_));
@@ -333,7 +374,8 @@ CameraConfiguration::Status IPU3CameraConfiguration::validate()
 					      ImgUDevice::kOutputAlignHeight);
 
 			cfg->pixelFormat = formats::NV12;
-			cfg->bufferCount = kBufferCount;
+			cfg->bufferCount = std::clamp(cfg->bufferCount,
+						      kBufferCount, kMaxBufferCount);
 			cfg->stride = info.stride(cfg->size.width, 0, 1);
 			cfg->frameSize = info.frameSize(cfg->size, 1);
 
@@ -656,38 +698,40 @@ int PipelineHandlerIPU3::exportFrameBuffers(Camera *camera, Stream *stream,
  *
  * In order to be able to start the 'viewfinder' and 'stat' nodes, we need
  * memory to be reserved.
+ *
+ * The parameters and statistics buffers, and their mapping in the IPA, are
+ * kept across stop() and start() as long as the number of buffers doesn't
+ * change, to speed up switching between configurations.
  */
-int PipelineHandlerIPU3::allocateBuffers(Camera *camera)
+int PipelineHandlerIPU3::allocateBuffers(Camera *camera, unsigned int bufferCount)
 {
 	IPU3CameraData *data = cameraData(camera);
 	ImgUDevice *imgu = data->imgu_;
-	unsigned int bufferCount;
 	int ret;
 
-	bufferCount = std::max({
-		data->outStream_.configuration().bufferCount,
-		data->vfStream_.configuration().bufferCount,
-		data->rawStream_.configuration().bufferCount,
-	});
+	if (imgu->paramBuffers_.size() != bufferCount)
+		freeInternalBuffers(camera);
 
 	ret = imgu->allocateBuffers(bufferCount);
 	if (ret < 0)
 		return ret;
 
 	/* Map buffers to the IPA. */
-	unsigned int ipaBufferId = 1;
+	if (data->ipaBuffers_.empty()) {
+		unsigned int ipaBufferId = 1;
 
-	for (const std::unique_ptr<FrameBuffer> &buffer : imgu->paramBuffers_) {
-		buffer->setCookie(ipaBufferId++);
-		ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
-	}
+		for (const std::unique_ptr<FrameBuffer> &buffer : imgu->paramBuffers_) {
+			buffer->setCookie(ipaBufferId++);
+			data->ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
+		}
 
-	for (const std::unique_ptr<FrameBuffer> &buffer : imgu->statBuffers_) {
-		buffer->setCookie(ipaBufferId++);
-		ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
-	}
+		for (const std::unique_ptr<FrameBuffer> &buffer : imgu->statBuffers_) {
+			buffer->setCookie(ipaBufferId++);
+			data->ipaBuffers_.emplace_back(buffer->cookie(), buffer->planes());
+		}
 
-	data->ipa_->mapBuffers(ipaBuffers_);
+		data->ipa_->mapBuffers(data->ipaBuffers_);
+	}
 
 	data->frameInfos_.init(imgu->paramBuffers_, imgu->statBuffers_);
 	data->frameInfos_.bufferAvailable.connect(
@@ -701,17 +745,32 @@ int PipelineHandlerIPU3::freeBuffers(Camera *camera)
 	IPU3CameraData *data = cameraData(camera);
 
 	data->frameInfos_.clear();
+	data->imgu_->freeBuffers();
 
-	std::vector<unsigned int> ids;
-	for (IPABuffer &ipabuf : ipaBuffers_)
-		ids.push_back(ipabuf.id);
+	return 0;
+}
 
-	data->ipa_->unmapBuffers(ids);
-	ipaBuffers_.clear();
+/* Free the buffers kept across capture sessions, and unmap them from the IPA. */
+void PipelineHandlerIPU3::freeInternalBuffers(Camera *camera)
+{
+	IPU3CameraData *data = cameraData(camera);
 
-	data->imgu_->freeBuffers();
+	if (!data->ipaBuffers_.empty()) {
+		std::vector<unsigned int> ids;
+		for (IPABuffer &ipabuf : data->ipaBuffers_)
+			ids.push_back(ipabuf.id);
 
-	return 0;
+		data->ipa_->unmapBuffers(ids);
+		data->ipaBuffers_.clear();
+	}
+
+	data->imgu_->freeInternalBuffers();
+	data->cio2_.freeBuffers();
+}
+
+void PipelineHandlerIPU3::releaseDevice(Camera *camera)
+{
+	freeInternalBuffers(camera);
 }
 
 int PipelineHandlerIPU3::start(Camera *camera, [[maybe_unused]] const ControlList *controls)
@@ -728,7 +787,13 @@ int PipelineHandlerIPU3::start(Camera *camera, [[maybe_unused]] const ControlLis
 		return ret;
 
 	/* Allocate buffers for internal pipeline usage. */
-	ret = allocateBuffers(camera);
+	unsigned int bufferCount = std::max({
+		data->outStream_.configuration().bufferCount,
+		data->vfStream_.configuration().bufferCount,
+		data->rawStream_.configuration().bufferCount,
+	});
+
+	ret = allocateBuffers(camera, bufferCount);
 	if (ret)
 		return ret;
 
@@ -742,7 +807,7 @@ int PipelineHandlerIPU3::start(Camera *camera, [[maybe_unused]] const ControlLis
 	 * Start the ImgU video devices, buffers will be queued to the
 	 * ImgU output and viewfinder when requests will be queued.
 	 */
-	ret = cio2->start();
+	ret = cio2->start(bufferCount);
 	if (ret)
 		goto error;
 
@@ -734,18 +734,17 @@ int PipelineHandlerMaliC55::configure(Camera *camera,
 {
 	resetPipes();
 
-	int ret = media_->disableLinks();
-	if (ret)
-		return ret;
-
 	/* Link the graph depending if we are operating the TPG or a sensor. */
 	MaliC55CameraData *data = cameraData(camera);
+	MediaLink *link;
 	if (data->csi_) {
 		const MediaEntity *csiEntity = data->csi_->entity();
-		ret = csiEntity->getPadByIndex(1)->links()[0]->setEnabled(true);
+		link = csiEntity->getPadByIndex(1)->links()[0];
 	} else {
-		ret = data->entity_->getPadByIndex(0)->links()[0]->setEnabled(true);
+		link = data->entity_->getPadByIndex(0)->links()[0];
 	}
+
+	int ret = media_->configureLinks({ link });
 	if (ret)
 		return ret;
 
@@ -1050,6 +1049,14 @@ bool PipelineHandlerMaliC55::match(DeviceEnumerator *enumerator)
 
 			break;
 		case MEDIA_ENT_F_IO_V4L:
+			/*
+			 * \todo Support memory input. Reprocessing RAW frames
+			 * requires an API to queue input buffers to a Camera,
+			 * which libcamera doesn't have yet. Processing them
+			 * with the ISP, as for the live sensor path, also
+			 * requires an IPA module, which needs the Mali-C55
+			 * parameters and statistics uAPI.
+			 */
 			LOG(MaliC55, Warning) << "Memory input not yet supported";
 			break;
 		default:
@@ -41,6 +41,8 @@
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/request.h"
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
@@ -154,6 +156,7 @@ public:
 	std::unique_ptr<CameraConfiguration> generateConfiguration(Camera *camera,
 								   Span<const StreamRole> roles) override;
 	int configure(Camera *camera, CameraConfiguration *config) override;
+	int reconfigure(Camera *camera, CameraConfiguration *config) override;
 
 	int exportFrameBuffers(Camera *camera, Stream *stream,
 			       std::vector<std::unique_ptr<FrameBuffer>> *buffers) override;
@@ -176,8 +179,22 @@ private:
 	friend RkISP1CameraData;
 	friend RkISP1Frames;
 
+	struct InputConfiguration {
+		const Camera *camera;
+		V4L2SubdeviceFormat sensorFormat;
+		Transform transform;
+		std::vector<const Stream *> streams;
+		V4L2SubdeviceFormat format;
+	};
+
 	int initLinks(Camera *camera, const CameraSensor *sensor,
 		      const RkISP1CameraConfiguration &config);
+	int configureInput(Camera *camera, RkISP1CameraConfiguration *config,
+			   V4L2SubdeviceFormat *format);
+	int configureOutputs(Camera *camera, RkISP1CameraConfiguration *config,
+			     V4L2SubdeviceFormat format, bool configureMeta);
+	bool inputUnchanged(const Camera *camera,
+			    RkISP1CameraConfiguration &config) const;
 	int createCamera(MediaEntity *sensor);
 	void tryCompleteRequest(RkISP1FrameInfo *info);
 	void bufferReady(FrameBuffer *buffer);
@@ -189,6 +206,10 @@ private:
 	int allocateBuffers(Camera *camera);
 	int freeBuffers(Camera *camera);
 
+	void allocateMediaRequests(RkISP1CameraData *data, unsigned int count);
+	MediaRequest *acquireMediaRequest();
+	void mediaRequestComplete(MediaRequest *request);
+
 	int updateControls(RkISP1CameraData *data);
 
 	MediaDevice *media_;
@@ -208,6 +229,9 @@ private:
 
 	std::optional<Rectangle> activeCrop_;
 
+	/* Input setup applied by the last configuration, for reconfigure() */
+	std::optional<InputConfiguration> inputConfig_;
+
 	/* Internal buffers used when dewarper is being used */
 	std::vector<std::unique_ptr<FrameBuffer>> mainPathBuffers_;
 	std::queue<FrameBuffer *> availableMainPathBuffers_;
@@ -217,6 +241,13 @@ private:
 	std::queue<FrameBuffer *> availableParamBuffers_;
 	std::queue<FrameBuffer *> availableStatBuffers_;
 
+	/*
+	 * Media requests bundling the parameters buffer and the sensor
+	 * controls of a frame, when the drivers support the Request API.
+	 */
+	std::vector<std::unique_ptr<MediaRequest>> mediaRequests_;
+	std::queue<MediaRequest *> availableMediaRequests_;
+
 	Camera *activeCamera_;
 
 	const MediaPad *ispSink_;
@@ -407,8 +438,30 @@ void RkISP1CameraData::paramFilled(unsigned int frame, unsigned int bytesused)
 	if (!info)
 		return;
 
+	LIBCAMERA_TRACEPOINT_FRAME(pipe->name(), IpaPrepareEnd,
+				   info->request->sequence());
+
 	info->paramBuffer->_d()->metadata().planes()[0].bytesused = bytesused;
-	pipe->param_->queueBuffer(info->paramBuffer);
+
+	/*
+	 * When the drivers support the Request API, apply the parameters and
+	 * the sensor controls of the frame atomically through a media request.
+	 * Otherwise the sensor controls are written at the start of frames.
+	 */
+	MediaRequest *mediaRequest = pipe->acquireMediaRequest();
+	if (mediaRequest) {
+		delayedCtrls_->queueControls(info->frame, mediaRequest);
+		pipe->param_->queueBuffer(info->paramBuffer, mediaRequest);
+		mediaRequest->queue();
+	} else {
+		if (!pipe->mediaRequests_.empty()) {
+			LOG(RkISP1, Warning) << "Media request underrun";
+			delayedCtrls_->queueControls(info->frame, nullptr);
+		}
+
+		pipe->param_->queueBuffer(info->paramBuffer);
+	}
+
 	pipe->stat_->queueBuffer(info->statBuffer);
 
 	if (info->mainPathBuffer)
@@ -416,6 +469,9 @@ void RkISP1CameraData::paramFilled(unsigned int frame, unsigned int bytesused)
 
 	if (selfPath_ && info->selfPathBuffer)
 		selfPath_->queueBuffer(info->selfPathBuffer);
+
+	LIBCAMERA_TRACEPOINT_FRAME(pipe->name(), IspQueue,
+				   info->request->sequence());
 }
 
 void RkISP1CameraData::setSensorControls([[maybe_unused]] unsigned int frame,
@@ -430,7 +486,11 @@ void RkISP1CameraData::metadataReady(unsigned int frame, const ControlList &meta
 	if (!info)
 		return;
 
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaProcessEnd,
+				   info->request->sequence());
+
 	info->request->metadata().merge(metadata);
+	info->request->_d()->recordStage(Request::Private::Stage::IpaDone);
 	info->metadataProcessed = true;
 
 	pipe()->tryCompleteRequest(info);
@@ -757,6 +817,94 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 {
 	RkISP1CameraConfiguration *config =
 		static_cast<RkISP1CameraConfiguration *>(c);
+	V4L2SubdeviceFormat format;
+	int ret;
+
+	inputConfig_.reset();
+
+	ret = configureInput(camera, config, &format);
+	if (ret)
+		return ret;
+
+	ret = configureOutputs(camera, config, format, true);
+	if (ret)
+		return ret;
+
+	InputConfiguration input;
+	input.camera = camera;
+	input.sensorFormat = config->sensorFormat();
+	input.transform = config->combinedTransform();
+	for (const StreamConfiguration &cfg : *config)
+		input.streams.push_back(cfg.stream());
+	input.format = format;
+
+	/*
+	 * Sensor configurations can't be compared, don't skip the input setup
+	 * when they are used.
+	 */
+	if (!config->sensorConfig)
+		inputConfig_ = std::move(input);
+
+	return 0;
+}
+
+/*
+ * Switch to a new configuration, skipping the media links, sensor and ISP
+ * input setup when they are the same as for the current configuration. This
+ * is the case when the sensor format and the set of active paths don't change,
+ * for instance when only the output sizes or formats are modified.
+ */
+int PipelineHandlerRkISP1::reconfigure(Camera *camera, CameraConfiguration *c)
+{
+	RkISP1CameraConfiguration *config =
+		static_cast<RkISP1CameraConfiguration *>(c);
+
+	if (!inputUnchanged(camera, *config))
+		return configure(camera, c);
+
+	LOG(RkISP1, Debug) << "Input unchanged, reconfiguring outputs only";
+
+	int ret = configureOutputs(camera, config, inputConfig_->format, false);
+	if (ret)
+		inputConfig_.reset();
+
+	return ret;
+}
+
+bool PipelineHandlerRkISP1::inputUnchanged(const Camera *camera,
+					   RkISP1CameraConfiguration &config) const
+{
+	if (!inputConfig_ || inputConfig_->camera != camera || config.sensorConfig)
+		return false;
+
+	const V4L2SubdeviceFormat &sensorFormat = config.sensorFormat();
+	if (sensorFormat.code != inputConfig_->sensorFormat.code ||
+	    sensorFormat.size != inputConfig_->sensorFormat.size ||
+	    sensorFormat.colorSpace != inputConfig_->sensorFormat.colorSpace)
+		return false;
+
+	if (config.combinedTransform() != inputConfig_->transform)
+		return false;
+
+	if (config.size() != inputConfig_->streams.size())
+		return false;
+
+	for (unsigned int i = 0; i < config.size(); ++i) {
+		if (config.at(i).stream() != inputConfig_->streams[i])
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Configure the media links, the sensor and the ISP input, and return the
+ * format at the ISP input pad.
+ */
+int PipelineHandlerRkISP1::configureInput(Camera *camera,
+					  RkISP1CameraConfiguration *config,
+					  V4L2SubdeviceFormat *format)
+{
 	RkISP1CameraData *data = cameraData(camera);
 	CameraSensor *sensor = data->sensor_.get();
 	int ret;
@@ -769,40 +917,58 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 	 * Configure the format on the sensor output and propagate it through
 	 * the pipeline.
 	 */
-	V4L2SubdeviceFormat format = config->sensorFormat();
-	LOG(RkISP1, Debug) << "Configuring sensor with " << format;
+	*format = config->sensorFormat();
+	LOG(RkISP1, Debug) << "Configuring sensor with " << *format;
 
 	if (config->sensorConfig)
 		ret = sensor->applyConfiguration(*config->sensorConfig,
 						 config->combinedTransform(),
-						 &format);
+						 format);
 	else
-		ret = sensor->setFormat(&format, config->combinedTransform());
+		ret = sensor->setFormat(format, config->combinedTransform());
 
 	if (ret < 0)
 		return ret;
 
-	LOG(RkISP1, Debug) << "Sensor configured with " << format;
+	LOG(RkISP1, Debug) << "Sensor configured with " << *format;
 
 	if (csi_) {
-		ret = csi_->setFormat(0, &format);
+		ret = csi_->setFormat(0, format);
 		if (ret < 0)
 			return ret;
 	}
 
-	ret = isp_->setFormat(0, &format);
+	ret = isp_->setFormat(0, format);
 	if (ret < 0)
 		return ret;
 
-	Rectangle rect(0, 0, format.size);
+	Rectangle rect(0, 0, format->size);
 	ret = isp_->setSelection(0, V4L2_SEL_TGT_CROP, &rect);
 	if (ret < 0)
 		return ret;
 
 	LOG(RkISP1, Debug)
-		<< "ISP input pad configured with " << format
+		<< "ISP input pad configured with " << *format
 		<< " crop " << rect;
 
+	return 0;
+}
+
+/*
+ * Configure the ISP output, the main and self paths and the IPA. The format
+ * and buffers of the parameters and statistics video devices don't depend on
+ * the configuration, and are only set up when \a configureMeta is true.
+ */
+int PipelineHandlerRkISP1::configureOutputs(Camera *camera,
+					    RkISP1CameraConfiguration *config,
+					    V4L2SubdeviceFormat format,
+					    bool configureMeta)
+{
+	RkISP1CameraData *data = cameraData(camera);
+	int ret;
+
+	Rectangle rect(0, 0, format.size);
+
 	const PixelFormat &streamFormat = config->at(0).pixelFormat;
 	const PixelFormatInfo &info = PixelFormatInfo::info(streamFormat);
 	isRaw_ = info.colourEncoding == PixelFormatInfo::ColourEncodingRAW;
@@ -856,15 +1022,18 @@ int PipelineHandlerRkISP1::configure(Camera *camera, CameraConfiguration *c)
 
 	V4L2DeviceFormat paramFormat;
 	paramFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_EXT_PARAMS);
-	ret = param_->setFormat(&paramFormat);
-	if (ret)
-		return ret;
 
-	V4L2DeviceFormat statFormat;
-	statFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_STAT_3A);
-	ret = stat_->setFormat(&statFormat);
-	if (ret)
-		return ret;
+	if (configureMeta) {
+		ret = param_->setFormat(&paramFormat);
+		if (ret)
+			return ret;
+
+		V4L2DeviceFormat statFormat;
+		statFormat.fourcc = V4L2PixelFormat(V4L2_META_FMT_RK_ISP1_STAT_3A);
+		ret = stat_->setFormat(&statFormat);
+		if (ret)
+			return ret;
+	}
 
 	/* Inform IPA of stream configuration and sensor controls. */
 	ipa::rkisp1::IPAConfigInfo ipaConfig{};
@@ -928,6 +1097,8 @@ int PipelineHandlerRkISP1::allocateBuffers(Camera *camera)
 		if (ret < 0)
 			goto error;
 
+		allocateMediaRequests(data, maxCount);
+
 		/* If the dewarper is being used, allocate internal buffers for ISP. */
 		if (useDewarper_) {
 			ret = mainPath_.exportBuffers(maxCount, &mainPathBuffers_);
@@ -978,6 +1149,9 @@ int PipelineHandlerRkISP1::freeBuffers(Camera *camera)
 	while (!availableMainPathBuffers_.empty())
 		availableMainPathBuffers_.pop();
 
+	availableMediaRequests_ = {};
+	mediaRequests_.clear();
+
 	paramBuffers_.clear();
 	statBuffers_.clear();
 	mainPathBuffers_.clear();
@@ -998,6 +1172,62 @@ int PipelineHandlerRkISP1::freeBuffers(Camera *camera)
 	return 0;
 }
 
+/*
+ * Allocate the media requests used to queue the parameters buffers, if the
+ * drivers of the parameters video node and of the sensor support them. Twice
+ * as many requests as parameters buffers are allocated, as a request may
+ * complete after its buffer has been dequeued and queued again.
+ */
+void PipelineHandlerRkISP1::allocateMediaRequests(RkISP1CameraData *data,
+						  unsigned int count)
+{
+	if (!param_->supportsRequests())
+		return;
+
+	for (unsigned int i = 0; i < count * 2; i++) {
+		std::unique_ptr<MediaRequest> request = media_->allocateRequest();
+		if (!request) {
+			mediaRequests_.clear();
+			return;
+		}
+
+		request->completed.connect(this, &PipelineHandlerRkISP1::mediaRequestComplete);
+		mediaRequests_.push_back(std::move(request));
+	}
+
+	/* Check that the sensor controls can be stored in requests. */
+	MediaRequest *request = mediaRequests_.front().get();
+	ControlList ctrls = data->sensor_->getControls({ V4L2_CID_EXPOSURE });
+	int ret = data->sensor_->device()->setControls(&ctrls, request);
+	if (ret || request->reinit()) {
+		LOG(RkISP1, Debug) << "Sensor doesn't support media requests";
+		mediaRequests_.clear();
+		return;
+	}
+
+	for (std::unique_ptr<MediaRequest> &mediaRequest : mediaRequests_)
+		availableMediaRequests_.push(mediaRequest.get());
+
+	LOG(RkISP1, Debug) << "Using media requests for the frame parameters";
+}
+
+MediaRequest *PipelineHandlerRkISP1::acquireMediaRequest()
+{
+	if (availableMediaRequests_.empty())
+		return nullptr;
+
+	MediaRequest *request = availableMediaRequests_.front();
+	availableMediaRequests_.pop();
+
+	return request;
+}
+
+void PipelineHandlerRkISP1::mediaRequestComplete(MediaRequest *request)
+{
+	request->reinit();
+	availableMediaRequests_.push(request);
+}
+
 int PipelineHandlerRkISP1::start(Camera *camera, [[maybe_unused]] const ControlList *controls)
 {
 	RkISP1CameraData *data = cameraData(camera);
@@ -1120,6 +1350,8 @@ int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera, Request *request)
 		if (data->selfPath_ && info->selfPathBuffer)
 			data->selfPath_->queueBuffer(info->selfPathBuffer);
 	} else {
+		LIBCAMERA_TRACEPOINT_FRAME(name(), IpaPrepareBegin,
+					   request->sequence());
 		data->ipa_->fillParamsBuffer(data->frame_,
 					     info->paramBuffer->cookie());
 	}
@@ -1138,11 +1370,7 @@ int PipelineHandlerRkISP1::initLinks(Camera *camera,
 				     const RkISP1CameraConfiguration &config)
 {
 	RkISP1CameraData *data = cameraData(camera);
-	int ret;
-
-	ret = media_->disableLinks();
-	if (ret < 0)
-		return ret;
+	std::vector<MediaLink *> links;
 
 	/*
 	 * Configure the sensor links: enable the link corresponding to this
@@ -1157,32 +1385,22 @@ int PipelineHandlerRkISP1::initLinks(Camera *camera,
 			<< link->source()->entity()->name()
 			<< "' to ISP";
 
-		ret = link->setEnabled(true);
-		if (ret < 0)
-			return ret;
+		links.push_back(link);
 	}
 
-	if (csi_) {
-		MediaLink *link = isp_->entity()->getPadByIndex(0)->links().at(0);
-
-		ret = link->setEnabled(true);
-		if (ret < 0)
-			return ret;
-	}
+	if (csi_)
+		links.push_back(isp_->entity()->getPadByIndex(0)->links().at(0));
 
 	for (const StreamConfiguration &cfg : config) {
 		if (cfg.stream() == &data->mainPathStream_)
-			ret = data->mainPath_->setEnabled(true);
+			links.push_back(data->mainPath_->link());
 		else if (hasSelfPath_ && cfg.stream() == &data->selfPathStream_)
-			ret = data->selfPath_->setEnabled(true);
+			links.push_back(data->selfPath_->link());
 		else
 			return -EINVAL;
-
-		if (ret < 0)
-			return ret;
 	}
 
-	return 0;
+	return media_->configureLinks(links);
 }
 
 /**
@@ -1218,6 +1436,8 @@ int PipelineHandlerRkISP1::updateControls(RkISP1CameraData *data)
 	for (const auto &ipaControl : data->ipaControls_)
 		controls[ipaControl.first] = ipaControl.second;
 
+	controls[&controls::draft::LatencyReporting] = ControlInfo(false, true, false);
+
 	data->controlInfo_ = ControlInfoMap(std::move(controls),
 					    controls::controls);
 
@@ -1253,8 +1473,7 @@ int PipelineHandlerRkISP1::createCamera(MediaEntity *sensor)
 	data->delayedCtrls_ =
 		std::make_unique<DelayedControls>(data->sensor_->device(),
 						  params);
-	isp_->frameStart.connect(data->delayedCtrls_.get(),
-				 &DelayedControls::applyControls);
+	isp_->frameStart.connect(this, &PipelineHandlerRkISP1::frameStart);
 
 	ret = data->loadIPA(media_->hwRevision());
 	if (ret)
@@ -1412,6 +1631,10 @@ void PipelineHandlerRkISP1::bufferReady(FrameBuffer *buffer)
 	Request *request = info->request;
 
 	if (metadata.status != FrameMetadata::FrameCancelled) {
+		LIBCAMERA_TRACEPOINT_FRAME(name(), IspDequeue,
+					   request->sequence());
+		request->_d()->recordStage(Request::Private::Stage::IspDone);
+
 		/*
 		 * Record the sensor's timestamp in the request metadata.
 		 *
@@ -1422,6 +1645,8 @@ void PipelineHandlerRkISP1::bufferReady(FrameBuffer *buffer)
 					metadata.timestamp);
 
 		if (isRaw_) {
+			request->_d()->recordStage(Request::Private::Stage::BufferDequeue);
+
 			const ControlList &ctrls =
 				data->delayedCtrls_->get(metadata.sequence);
 			data->ipa_->processStatsBuffer(info->frame, 0, ctrls);
@@ -1539,10 +1764,23 @@ void PipelineHandlerRkISP1::statReady(FrameBuffer *buffer)
 	if (data->frame_ <= buffer->metadata().sequence)
 		data->frame_ = buffer->metadata().sequence + 1;
 
+	info->request->_d()->recordStage(Request::Private::Stage::BufferDequeue);
+
+	LIBCAMERA_TRACEPOINT_FRAME(name(), IpaProcessBegin,
+				   info->request->sequence());
 	data->ipa_->processStatsBuffer(info->frame, info->statBuffer->cookie(),
 				       data->delayedCtrls_->get(buffer->metadata().sequence));
 }
 
+void PipelineHandlerRkISP1::frameStart(uint32_t sequence)
+{
+	LIBCAMERA_TRACEPOINT_FRAME(name(), StartOfFrame, sequence);
+
+	/* The sensor controls are queued in the media requests if used. */
+	if (activeCamera_ && mediaRequests_.empty())
+		cameraData(activeCamera_)->delayedCtrls_->applyControls(sequence);
+}
+
 REGISTER_PIPELINE_HANDLER(PipelineHandlerRkISP1, "rkisp1")
 
 } /* namespace libcamera */
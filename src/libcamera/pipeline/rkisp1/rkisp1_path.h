@@ -40,6 +40,7 @@ public:
 
 	int setEnabled(bool enable) { return link_->setEnabled(enable); }
 	bool isEnabled() const { return link_->flags() & MEDIA_LNK_FL_ENABLED; }
+	MediaLink *link() const { return link_; }
 
 	StreamConfiguration generateConfiguration(const CameraSensor *sensor,
 						  const Size &resolution,
@@ -7,6 +7,7 @@
 
 #include "pipeline_base.h"
 
+#include <algorithm>
 #include <chrono>
 
 #include <linux/media-bus-format.h>
@@ -21,6 +22,7 @@
 
 #include "libcamera/internal/camera_lens.h"
 #include "libcamera/internal/ipa_manager.h"
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 
 using namespace std::chrono_literals;
@@ -152,6 +154,54 @@ CameraConfiguration::Status RPiCameraConfiguration::validateColorSpaces([[maybe_
 }
 
 CameraConfiguration::Status RPiCameraConfiguration::validate()
+{
+	ConfigurationCache::Key key(*this);
+	Status status;
+
+	/*
+	 * Skip the sensor format search and the device format tries for known
+	 * configurations.
+	 */
+	std::shared_ptr<const CameraConfiguration> cached =
+		data_->configCache_.lookup(key, &status);
+	if (cached) {
+		const RPiCameraConfiguration *config =
+			static_cast<const RPiCameraConfiguration *>(cached.get());
+
+		ConfigurationCache::restore(*config, this, &config_);
+		combinedTransform_ = config->combinedTransform_;
+		sensorFormat_ = config->sensorFormat_;
+		rawStreams_ = config->rawStreams_;
+		outStreams_ = config->outStreams_;
+		yuvColorSpace_ = config->yuvColorSpace_;
+		rgbColorSpace_ = config->rgbColorSpace_;
+		rebaseStreams(*config);
+
+		return status;
+	}
+
+	status = validateConfiguration();
+
+	auto config = std::make_unique<RPiCameraConfiguration>(*this);
+	config->rebaseStreams(*this);
+	data_->configCache_.insert(std::move(key), std::move(config), status);
+
+	return status;
+}
+
+/*
+ * The stream parameters point to the stream configurations. Make the ones
+ * copied from another configuration point to the configurations of this one.
+ */
+void RPiCameraConfiguration::rebaseStreams(const RPiCameraConfiguration &other)
+{
+	for (std::vector<StreamParams> *streams : { &rawStreams_, &outStreams_ }) {
+		for (StreamParams &params : *streams)
+			params.cfg = &config_[params.cfg - other.config_.data()];
+	}
+}
+
+CameraConfiguration::Status RPiCameraConfiguration::validateConfiguration()
 {
 	Status status = Valid;
 
@@ -540,13 +590,61 @@ int PipelineHandlerBase::configure(Camera *camera, CameraConfiguration *config)
 	if (ret)
 		return ret;
 
+	ret = data->configureIPABegin(config);
+	if (ret) {
+		LOG(RPI, Error) << "Failed to configure the IPA: " << ret;
+		return ret;
+	}
+
+	/* Setup the Video Mux/Bridge entities while the IPA is configured. */
+	int bridgeRet = 0;
+	for (auto &[device, link] : data->bridgeDevices_) {
+		/*
+		 * Start by disabling all the sink pad links on the devices in the
+		 * cascade, with the exception of the link connecting the device.
+		 */
+		for (const MediaPad *p : device->entity()->pads()) {
+			if (!(p->flags() & MEDIA_PAD_FL_SINK))
+				continue;
+
+			for (MediaLink *l : p->links()) {
+				if (l != link)
+					l->setEnabled(false);
+			}
+		}
+
+		/*
+		 * Next, enable the entity -> entity links, and setup the pad format.
+		 *
+		 * \todo Some bridge devices may chainge the media bus code, so we
+		 * ought to read the source pad format and propagate it to the sink pad.
+		 */
+		link->setEnabled(true);
+		const MediaPad *sinkPad = link->sink();
+		bridgeRet = device->setFormat(sinkPad->index(), sensorFormat);
+		if (bridgeRet) {
+			LOG(RPI, Error) << "Failed to set format on " << device->entity()->name()
+					<< " pad " << sinkPad->index()
+					<< " with format  " << *sensorFormat
+					<< ": " << bridgeRet;
+			break;
+		}
+
+		LOG(RPI, Debug) << "Configured media link on device " << device->entity()->name()
+				<< " on pad " << sinkPad->index();
+	}
+
+	/* Complete the IPA configuration even on failure, it is pending. */
 	ipa::RPi::ConfigResult result;
-	ret = data->configureIPA(config, &result);
+	ret = data->configureIPAEnd(&result);
 	if (ret) {
 		LOG(RPI, Error) << "Failed to configure the IPA: " << ret;
 		return ret;
 	}
 
+	if (bridgeRet)
+		return bridgeRet;
+
 	/*
 	 * Update the ScalerCropMaximum to the correct value for this camera mode.
 	 * For us, it's the same as the "analogue crop".
@@ -564,6 +662,9 @@ int PipelineHandlerBase::configure(Camera *camera, CameraConfiguration *config)
 	for (auto const &c : result.controlInfo)
 		ctrlMap.emplace(c.first, c.second);
 
+	ctrlMap[&controls::draft::LatencyReporting] = ControlInfo(false, true, false);
+	ctrlMap[&controls::rpi::LowLatency] = ControlInfo(false, true, false);
+
 	const auto cropParamsIt = data->cropParams_.find(0);
 	if (cropParamsIt != data->cropParams_.end()) {
 		const CameraData::CropParams &cropParams = cropParamsIt->second;
@@ -589,41 +690,22 @@ int PipelineHandlerBase::configure(Camera *camera, CameraConfiguration *config)
 
 	data->controlInfo_ = ControlInfoMap(std::move(ctrlMap), result.controlInfo.idmap());
 
-	/* Setup the Video Mux/Bridge entities. */
-	for (auto &[device, link] : data->bridgeDevices_) {
-		/*
-		 * Start by disabling all the sink pad links on the devices in the
-		 * cascade, with the exception of the link connecting the device.
-		 */
-		for (const MediaPad *p : device->entity()->pads()) {
-			if (!(p->flags() & MEDIA_PAD_FL_SINK))
-				continue;
-
-			for (MediaLink *l : p->links()) {
-				if (l != link)
-					l->setEnabled(false);
-			}
-		}
+	/*
+	 * Allocate the internal buffers for the default buffering profile now
+	 * if requested, to leave only streaming on to start(). They are
+	 * reallocated at start() if the application selects another profile.
+	 */
+	if (data->config_.prepareBuffersOnConfigure) {
+		data->lowLatency_ = data->config_.lowLatency;
 
-		/*
-		 * Next, enable the entity -> entity links, and setup the pad format.
-		 *
-		 * \todo Some bridge devices may chainge the media bus code, so we
-		 * ought to read the source pad format and propagate it to the sink pad.
-		 */
-		link->setEnabled(true);
-		const MediaPad *sinkPad = link->sink();
-		ret = device->setFormat(sinkPad->index(), sensorFormat);
+		ret = prepareBuffers(camera);
 		if (ret) {
-			LOG(RPI, Error) << "Failed to set format on " << device->entity()->name()
-					<< " pad " << sinkPad->index()
-					<< " with format  " << *sensorFormat
-					<< ": " << ret;
+			LOG(RPI, Error) << "Failed to allocate buffers";
+			data->freeBuffers();
 			return ret;
 		}
 
-		LOG(RPI, Debug) << "Configured media link on device " << device->entity()->name()
-				<< " on pad " << sinkPad->index();
+		data->buffersAllocated_ = true;
 	}
 
 	return 0;
@@ -659,8 +741,25 @@ int PipelineHandlerBase::start(Camera *camera, const ControlList *controls)
 	if (!result.controls.empty())
 		data->setSensorControls(result.controls);
 
-	/* Configure the number of dropped frames required on startup. */
-	data->dropFrameCount_ = data->config_.disableStartupFrameDrops
+	/*
+	 * Select the buffering profile. The internal buffers have to be
+	 * reallocated if it differs from the one they were allocated for.
+	 */
+	bool lowLatency = data->config_.lowLatency;
+	if (controls)
+		lowLatency = controls->get(controls::rpi::LowLatency).value_or(lowLatency);
+
+	if (data->buffersAllocated_ && lowLatency != data->lowLatency_)
+		data->freeBuffers();
+
+	data->lowLatency_ = lowLatency;
+
+	/*
+	 * Configure the number of dropped frames required on startup. In low
+	 * latency mode, the first frames are delivered even though the
+	 * algorithms haven't converged yet.
+	 */
+	data->dropFrameCount_ = data->config_.disableStartupFrameDrops || data->lowLatency_
 			      ? 0 : result.dropFrameCount;
 
 	for (auto const stream : data->streams_)
@@ -691,7 +790,7 @@ int PipelineHandlerBase::start(Camera *camera, const ControlList *controls)
 	 * the IPA.
 	 */
 	data->delayedCtrls_->reset(0);
-	data->state_ = CameraData::State::Idle;
+	data->state_ = CameraData::State::Running;
 
 	/* Enable SOF event generation. */
 	data->frontendDevice()->setFrameStartEnabled(true);
@@ -777,7 +876,7 @@ int PipelineHandlerBase::queueRequestDevice(Camera *camera, Request *request)
 	}
 
 	/* Push the request to the back of the queue. */
-	data->requestQueue_.push(request);
+	data->requestQueue_.push_back(request);
 	data->handleState();
 
 	return 0;
@@ -797,6 +896,10 @@ int PipelineHandlerBase::registerCamera(std::unique_ptr<RPi::CameraData> &camera
 	if (data->sensor_->init())
 		return -EINVAL;
 
+	data->droppedFramesMetric_ =
+		std::make_unique<CounterMetric>("frames_dropped_total",
+						data->sensor_->id());
+
 	/* Populate the map of sensor supported formats and sizes. */
 	for (auto const mbusCode : data->sensor_->mbusCodes())
 		data->sensorFormats_.emplace(mbusCode,
@@ -819,17 +922,28 @@ int PipelineHandlerBase::registerCamera(std::unique_ptr<RPi::CameraData> &camera
 	 * Setup our delayed control writer with the sensor default
 	 * gain and exposure delays. Mark VBLANK for priority write.
 	 */
-	std::unordered_map<uint32_t, RPi::DelayedControls::ControlParams> params = {
+	std::unordered_map<uint32_t, DelayedControls::ControlParams> params = {
 		{ V4L2_CID_ANALOGUE_GAIN, { result.sensorConfig.gainDelay, false } },
 		{ V4L2_CID_EXPOSURE, { result.sensorConfig.exposureDelay, false } },
 		{ V4L2_CID_HBLANK, { result.sensorConfig.hblankDelay, false } },
 		{ V4L2_CID_VBLANK, { result.sensorConfig.vblankDelay, true } }
 	};
-	data->delayedCtrls_ = std::make_unique<RPi::DelayedControls>(data->sensor_->device(), params);
+	data->delayedCtrls_ = std::make_unique<DelayedControls>(data->sensor_->device(), params);
 	data->sensorMetadata_ = result.sensorConfig.sensorMetadata;
+	data->cnnOutputTensorBuffer_ = result.cnnOutputTensorBuffer;
+
+	/*
+	 * Register initial controls that the Raspberry Pi IPA can handle, along
+	 * with the controls handled by the pipeline handler.
+	 */
+	ControlInfoMap::Map ctrlMap;
+	for (auto const &c : result.controlInfo)
+		ctrlMap.emplace(c.first, c.second);
 
-	/* Register initial controls that the Raspberry Pi IPA can handle. */
-	data->controlInfo_ = std::move(result.controlInfo);
+	ctrlMap[&controls::draft::LatencyReporting] = ControlInfo(false, true, false);
+	ctrlMap[&controls::rpi::LowLatency] = ControlInfo(false, true, false);
+
+	data->controlInfo_ = ControlInfoMap(std::move(ctrlMap), result.controlInfo.idmap());
 
 	/* Initialize the camera properties. */
 	data->properties_ = data->sensor_->properties();
@@ -1099,6 +1213,11 @@ int CameraData::loadPipelineConfiguration()
 	config_ = {
 		.disableStartupFrameDrops = false,
 		.cameraTimeoutValue = 0,
+		.lowLatency = false,
+		.prepareBuffersOnConfigure = false,
+		.adaptiveBuffers = false,
+		.minAdaptiveBuffers = 1,
+		.maxAdaptiveBuffers = 8,
 	};
 
 	/* Initial configuration of the platform, in case no config file is present */
@@ -1140,6 +1259,25 @@ int CameraData::loadPipelineConfiguration()
 	config_.cameraTimeoutValue =
 		phConfig["camera_timeout_value_ms"].get<unsigned int>(config_.cameraTimeoutValue);
 
+	config_.lowLatency = phConfig["low_latency"].get<bool>(config_.lowLatency);
+
+	config_.prepareBuffersOnConfigure =
+		phConfig["prepare_buffers_on_configure"].get<bool>(config_.prepareBuffersOnConfigure);
+
+	config_.adaptiveBuffers =
+		phConfig["adaptive_buffers"].get<bool>(config_.adaptiveBuffers);
+	config_.minAdaptiveBuffers =
+		phConfig["min_adaptive_buffers"].get<unsigned int>(config_.minAdaptiveBuffers);
+	config_.maxAdaptiveBuffers =
+		phConfig["max_adaptive_buffers"].get<unsigned int>(config_.maxAdaptiveBuffers);
+
+	if (config_.adaptiveBuffers &&
+	    (!config_.minAdaptiveBuffers ||
+	     config_.minAdaptiveBuffers > config_.maxAdaptiveBuffers)) {
+		LOG(RPI, Error) << "Invalid configuration: min_adaptive_buffers must be > 0 and <= max_adaptive_buffers";
+		return -EINVAL;
+	}
+
 	if (config_.cameraTimeoutValue) {
 		/* Disable the IPA signal to control timeout and set the user requested value. */
 		ipa_->setCameraTimeout.disconnect();
@@ -1149,6 +1287,20 @@ int CameraData::loadPipelineConfiguration()
 	return platformPipelineConfigure(root);
 }
 
+/*
+ * Let the number of internal buffers of a frontend stream adapt at runtime
+ * when enabled in the pipeline handler configuration, starting from the
+ * numBuffers prepared for the stream.
+ */
+void CameraData::enableAdaptiveBuffers(Stream *stream, unsigned int numBuffers)
+{
+	if (!config_.adaptiveBuffers)
+		return;
+
+	stream->setBufferBounds(std::min(numBuffers, config_.minAdaptiveBuffers),
+				std::max(numBuffers, config_.maxAdaptiveBuffers));
+}
+
 int CameraData::loadIPA(ipa::RPi::InitResult *result)
 {
 	int ret;
@@ -1190,7 +1342,7 @@ int CameraData::loadIPA(ipa::RPi::InitResult *result)
 	return ipa_->init(settings, params, result);
 }
 
-int CameraData::configureIPA(const CameraConfiguration *config, ipa::RPi::ConfigResult *result)
+int CameraData::configureIPABegin(const CameraConfiguration *config)
 {
 	ipa::RPi::ConfigParams params;
 	int ret;
@@ -1214,8 +1366,23 @@ int CameraData::configureIPA(const CameraConfiguration *config, ipa::RPi::Config
 	Transform transform = config->orientation / Orientation::Rotate0;
 	params.transform = static_cast<unsigned int>(transform);
 
-	/* Ready the IPA - it must know about the sensor resolution. */
-	ret = ipa_->configure(sensorInfo_, params, result);
+	/*
+	 * Ready the IPA - it must know about the sensor resolution. The call
+	 * completes in configureIPAEnd(), allowing the caller to configure
+	 * the rest of the pipeline in the meantime when the IPA is isolated.
+	 */
+	ret = ipa_->configureBegin(sensorInfo_, params);
+	if (ret < 0) {
+		LOG(RPI, Error) << "IPA configuration failed!";
+		return -EPIPE;
+	}
+
+	return 0;
+}
+
+int CameraData::configureIPAEnd(ipa::RPi::ConfigResult *result)
+{
+	int ret = ipa_->configureEnd(result);
 	if (ret < 0) {
 		LOG(RPI, Error) << "IPA configuration failed!";
 		return -EPIPE;
@@ -1234,11 +1401,25 @@ void CameraData::metadataReady(const ControlList &metadata)
 	if (!isRunning())
 		return;
 
+	Job *job = ipaJob();
+	ASSERT(job);
+
 	/* Add to the Request metadata buffer what the IPA has provided. */
 	/* Last thing to do is to fill up the request metadata. */
-	Request *request = requestQueue_.front();
+	Request *request = job->request;
 	request->metadata().merge(metadata);
 
+	/*
+	 * The IPA doesn't know the file descriptor of the CNN output tensor
+	 * buffer in the application process, replace it with ours.
+	 */
+	const auto &tensorBuffer = metadata.get(controls::rpi::CnnOutputTensorBuffer);
+	if (tensorBuffer)
+		request->metadata().set(controls::rpi::CnnOutputTensorBuffer,
+					{ cnnOutputTensorBuffer_.get(), (*tensorBuffer)[1],
+					  (*tensorBuffer)[2] });
+	request->_d()->recordStage(Request::Private::Stage::IpaDone);
+
 	/*
 	 * Inform the sensor of the latest colour gains if it has the
 	 * V4L2_CID_NOTIFY_GAINS control (which means notifyGainsUnity_ is set).
@@ -1384,6 +1565,7 @@ void CameraData::cameraTimeout()
 void CameraData::frameStarted(uint32_t sequence)
 {
 	LOG(RPI, Debug) << "Frame start " << sequence;
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), StartOfFrame, sequence);
 
 	/* Write any controls for the next frame as soon as we can. */
 	delayedCtrls_->applyControls(sequence);
@@ -1395,6 +1577,8 @@ void CameraData::clearIncompleteRequests()
 	 * All outstanding requests (and associated buffers) must be returned
 	 * back to the application.
 	 */
+	jobs_.clear();
+
 	while (!requestQueue_.empty()) {
 		Request *request = requestQueue_.front();
 
@@ -1411,7 +1595,7 @@ void CameraData::clearIncompleteRequests()
 		}
 
 		pipe()->completeRequest(request);
-		requestQueue_.pop();
+		requestQueue_.pop_front();
 	}
 }
 
@@ -1420,16 +1604,31 @@ void CameraData::handleStreamBuffer(FrameBuffer *buffer, RPi::Stream *stream)
 	/*
 	 * It is possible to be here without a pending request, so check
 	 * that we actually have one to action, otherwise we just return
-	 * buffer back to the stream.
+	 * buffer back to the stream. When jobs are in flight, the buffer
+	 * belongs to the first job whose request contains it.
 	 */
-	Request *request = requestQueue_.empty() ? nullptr : requestQueue_.front();
-	if (!dropFrameCount_ && request && request->findBuffer(stream) == buffer) {
+	Request *request = nullptr;
+	bool dropFrame = dropFrameCount_;
+
+	for (const Job &job : jobs_) {
+		if (job.request->findBuffer(stream) == buffer) {
+			request = job.request;
+			dropFrame = job.dropFrame;
+			break;
+		}
+	}
+
+	if (jobs_.empty() && !requestQueue_.empty())
+		request = requestQueue_.front();
+
+	if (!dropFrame && request && request->findBuffer(stream) == buffer) {
 		/*
 		 * Tag the buffer as completed, returning it to the
 		 * application.
 		 */
 		LOG(RPI, Debug) << "Completing request buffer for stream "
 				<< stream->name();
+		request->_d()->recordStage(Request::Private::Stage::IspDone);
 		pipe()->completeBuffer(request, buffer);
 	} else {
 		/*
@@ -1446,65 +1645,125 @@ void CameraData::handleStreamBuffer(FrameBuffer *buffer, RPi::Stream *stream)
 
 void CameraData::handleState()
 {
-	switch (state_) {
-	case State::Stopped:
-	case State::Busy:
-	case State::Error:
-		break;
-
-	case State::IpaComplete:
-		/* If the request is completed, we will switch to Idle state. */
-		checkRequestCompleted();
-		/*
-		 * No break here, we want to try running the pipeline again.
-		 * The fallthrough clause below suppresses compiler warnings.
-		 */
-		[[fallthrough]];
+	if (!isRunning())
+		return;
+
+	/* Complete the jobs that are done, and try to start new ones. */
+	checkRequestCompleted();
+	tryRunPipeline();
+}
+
+/*
+ * Retrieve the job being processed by the IPA, or nullptr if the IPA is idle.
+ */
+CameraData::Job *CameraData::ipaJob()
+{
+	if (jobs_.empty() || jobs_.back().ipaComplete)
+		return nullptr;
+
+	return &jobs_.back();
+}
 
-	case State::Idle:
-		tryRunPipeline();
-		break;
+/*
+ * Retrieve the oldest job whose ISP outputs haven't all been generated, to
+ * which ISP outputs are accounted as they are dequeued in order.
+ */
+CameraData::Job *CameraData::ispJob()
+{
+	for (Job &job : jobs_) {
+		if (job.ispOutputCount < ispOutputTotal_)
+			return &job;
 	}
+
+	return nullptr;
 }
 
-void CameraData::checkRequestCompleted()
+/*
+ * Retrieve the request to process with a new job, or nullptr if no job can be
+ * started at this time.
+ */
+Request *CameraData::nextRequest() const
 {
-	bool requestCompleted = false;
+	if (!isRunning() || jobs_.size() >= maxJobs_)
+		return nullptr;
+
+	/* The IPA processes one frame at a time. */
+	if (!jobs_.empty() && !jobs_.back().ipaComplete)
+		return nullptr;
+
 	/*
-	 * If we are dropping this frame, do not touch the request, simply
-	 * change the state to IDLE when ready.
+	 * Dropped frames don't consume their request, which is used again by
+	 * the next job.
 	 */
-	if (!dropFrameCount_) {
-		Request *request = requestQueue_.front();
-		if (request->hasPendingBuffers())
-			return;
+	unsigned int index = std::count_if(jobs_.begin(), jobs_.end(),
+					   [](const Job &job) { return !job.dropFrame; });
+	if (index >= requestQueue_.size())
+		return nullptr;
+
+	return requestQueue_[index];
+}
+
+/*
+ * In low latency mode, frames waiting to be processed are skipped when a more
+ * recent one is available. Check if the frame captured in a buffer can be
+ * skipped, which is not the case for buffers provided by the application as
+ * they must be returned with their request.
+ */
+bool CameraData::canSkipFrame(FrameBuffer *buffer, RPi::Stream *stream) const
+{
+	if (!lowLatency_)
+		return false;
+
+	return std::none_of(requestQueue_.begin(), requestQueue_.end(),
+			    [&](Request *request) {
+				    return request->findBuffer(stream) == buffer;
+			    });
+}
+
+CameraData::Job &CameraData::startJob(Request *request)
+{
+	unsigned int droppedJobs = std::count_if(jobs_.begin(), jobs_.end(),
+						 [](const Job &job) { return job.dropFrame; });
+
+	jobs_.push_back({ request, false, dropFrameCount_ > droppedJobs, 0 });
+	return jobs_.back();
+}
+
+void CameraData::checkRequestCompleted()
+{
+	while (!jobs_.empty()) {
+		Job &job = jobs_.front();
 
 		/* Must wait for metadata to be filled in before completing. */
-		if (state_ != State::IpaComplete)
+		if (!job.ipaComplete)
 			return;
 
-		LOG(RPI, Debug) << "Completing request sequence: "
-				<< request->sequence();
+		if (!job.dropFrame) {
+			if (job.request->hasPendingBuffers())
+				return;
 
-		pipe()->completeRequest(request);
-		requestQueue_.pop();
-		requestCompleted = true;
-	}
+			LOG(RPI, Debug) << "Completing request sequence: "
+					<< job.request->sequence();
+
+			ASSERT(job.request == requestQueue_.front());
+			pipe()->completeRequest(job.request);
+			requestQueue_.pop_front();
+		} else {
+			/*
+			 * If we are dropping this frame, do not touch the
+			 * request, simply wait for all the ISP outputs to be
+			 * generated.
+			 */
+			if (job.ispOutputCount != ispOutputTotal_)
+				return;
 
-	/*
-	 * Make sure we have three outputs completed in the case of a dropped
-	 * frame.
-	 */
-	if (state_ == State::IpaComplete &&
-	    ((ispOutputCount_ == ispOutputTotal_ && dropFrameCount_) ||
-	     requestCompleted)) {
-		LOG(RPI, Debug) << "Going into Idle state";
-		state_ = State::Idle;
-		if (dropFrameCount_) {
 			dropFrameCount_--;
+			droppedFramesMetric_->increment();
 			LOG(RPI, Debug) << "Dropping frame at the request of the IPA ("
 					<< dropFrameCount_ << " left)";
 		}
+
+		jobs_.pop_front();
 	}
 }
 
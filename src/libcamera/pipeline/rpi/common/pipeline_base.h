@@ -5,6 +5,7 @@
  * Pipeline handler base class for Raspberry Pi devices
  */
 
+#include <deque>
 #include <map>
 #include <memory>
 #include <optional>
@@ -14,23 +15,28 @@
 #include <utility>
 #include <vector>
 
+#include <libcamera/base/metrics.h>
+#include <libcamera/base/shared_fd.h>
+
 #include <libcamera/controls.h>
 #include <libcamera/request.h>
 
 #include "libcamera/internal/bayer_format.h"
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/configuration_cache.h"
+#include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/request.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 #include "libcamera/internal/yaml_parser.h"
 
 #include <libcamera/ipa/raspberrypi_ipa_interface.h>
 #include <libcamera/ipa/raspberrypi_ipa_proxy.h>
 
-#include "delayed_controls.h"
 #include "rpi_stream.h"
 
 using namespace std::chrono_literals;
@@ -47,9 +53,9 @@ class CameraData : public Camera::Private
 {
 public:
 	CameraData(PipelineHandler *pipe)
-		: Camera::Private(pipe), state_(State::Stopped),
-		  dropFrameCount_(0), buffersAllocated_(false),
-		  ispOutputCount_(0), ispOutputTotal_(0)
+		: Camera::Private(pipe), state_(State::Stopped), maxJobs_(1),
+		  dropFrameCount_(0), buffersAllocated_(false), lowLatency_(false),
+		  ispOutputTotal_(0)
 	{
 	}
 
@@ -71,8 +77,10 @@ public:
 	void enumerateVideoDevices(MediaLink *link, const std::string &frontend);
 
 	int loadPipelineConfiguration();
+	void enableAdaptiveBuffers(Stream *stream, unsigned int numBuffers);
 	int loadIPA(ipa::RPi::InitResult *result);
-	int configureIPA(const CameraConfiguration *config, ipa::RPi::ConfigResult *result);
+	int configureIPABegin(const CameraConfiguration *config);
+	int configureIPAEnd(ipa::RPi::ConfigResult *result);
 	virtual int platformInitIpa(ipa::RPi::InitParams &params) = 0;
 	virtual int platformConfigureIpa(ipa::RPi::ConfigParams &params) = 0;
 
@@ -102,6 +110,8 @@ public:
 
 	std::unique_ptr<CameraSensor> sensor_;
 	SensorFormats sensorFormats_;
+	/* Results of RPiCameraConfiguration::validate() */
+	mutable ConfigurationCache configCache_;
 
 	/* The vector below is just for convenience when iterating over all streams. */
 	std::vector<Stream *> streams_;
@@ -116,20 +126,55 @@ public:
 	std::unique_ptr<DelayedControls> delayedCtrls_;
 	bool sensorMetadata_;
 
+	/* Buffer the IPA delivers the CNN output tensors through, if any. */
+	SharedFD cnnOutputTensorBuffer_;
+
 	/*
 	 * All the functions in this class are called from a single calling
 	 * thread. So, we do not need to have any mutex to protect access to any
 	 * of the variables below.
 	 */
-	enum class State { Stopped, Idle, Busy, IpaComplete, Error };
+	enum class State { Stopped, Running, Error };
 	State state_;
 
-	bool isRunning()
+	bool isRunning() const
 	{
-		return state_ != State::Stopped && state_ != State::Error;
+		return state_ == State::Running;
 	}
 
-	std::queue<Request *> requestQueue_;
+	/*
+	 * Requests queued by the application, in order. A request stays in the
+	 * queue until it completes, including while jobs process it.
+	 */
+	std::deque<Request *> requestQueue_;
+
+	/*
+	 * A job tracks one frame through the IPA and the ISP. Jobs complete in
+	 * order, and up to maxJobs_ jobs can be in flight. Only the most recent
+	 * job can be waiting for the IPA, so with more than one job the IPA
+	 * prepares the next frame while the ISP processes the previous ones.
+	 */
+	struct Job {
+		Request *request;
+		/* The IPA has completed its processing for the frame. */
+		bool ipaComplete;
+		/* The frame is dropped at the request of the IPA. */
+		bool dropFrame;
+		/* Number of ISP outputs generated, to track dropped frames. */
+		unsigned int ispOutputCount;
+	};
+
+	std::deque<Job> jobs_;
+	unsigned int maxJobs_;
+
+	Job *ipaJob();
+	Job *ispJob();
+
+	/* Identify the request processed by a job in frame tracepoints. */
+	static uint32_t traceSequence(const Job *job)
+	{
+		return job ? job->request->sequence() : 0;
+	}
 
 	/* For handling digital zoom. */
 	IPACameraSensorInfo sensorInfo_;
@@ -152,6 +197,7 @@ public:
 	std::map<unsigned int, CropParams> cropParams_;
 
 	unsigned int dropFrameCount_;
+	std::unique_ptr<CounterMetric> droppedFramesMetric_;
 
 	/*
 	 * If set, this stores the value that represets a gain of one for
@@ -162,6 +208,12 @@ public:
 	/* Have internal buffers been allocated? */
 	bool buffersAllocated_;
 
+	/*
+	 * Is the camera running with minimal internal buffering? This is set
+	 * when the camera is started, and selects the buffer counts.
+	 */
+	bool lowLatency_;
+
 	struct Config {
 		/*
 		 * Override any request from the IPA to drop a number of startup
@@ -173,6 +225,25 @@ public:
 		 * on frame durations.
 		 */
 		unsigned int cameraTimeoutValue;
+		/*
+		 * Use the low latency profile unless the application selects
+		 * otherwise with the rpi::LowLatency control when starting the
+		 * camera.
+		 */
+		bool lowLatency;
+		/*
+		 * Allocate the internal buffers and map them to the IPA when
+		 * the camera is configured instead of when it is started.
+		 */
+		bool prepareBuffersOnConfigure;
+		/*
+		 * Adapt the number of internal frontend buffers at runtime,
+		 * starting from the static buffer count, between
+		 * minAdaptiveBuffers and maxAdaptiveBuffers.
+		 */
+		bool adaptiveBuffers;
+		unsigned int minAdaptiveBuffers;
+		unsigned int maxAdaptiveBuffers;
 	};
 
 	Config config_;
@@ -183,7 +254,10 @@ protected:
 
 	virtual void tryRunPipeline() = 0;
 
-	unsigned int ispOutputCount_;
+	Request *nextRequest() const;
+	bool canSkipFrame(FrameBuffer *buffer, RPi::Stream *stream) const;
+	Job &startJob(Request *request);
+
 	unsigned int ispOutputTotal_;
 
 private:
@@ -292,6 +366,9 @@ public:
 	std::optional<ColorSpace> rgbColorSpace_;
 
 private:
+	Status validateConfiguration();
+	void rebaseStreams(const RPiCameraConfiguration &other);
+
 	const CameraData *data_;
 };
 
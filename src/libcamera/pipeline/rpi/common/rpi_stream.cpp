@@ -7,6 +7,7 @@
 #include "rpi_stream.h"
 
 #include <algorithm>
+#include <limits.h>
 #include <tuple>
 #include <utility>
 
@@ -15,6 +16,12 @@
 /* Maximum number of buffer slots to allocate in the V4L2 device driver. */
 static constexpr unsigned int maxV4L2BufferCount = 32;
 
+/*
+ * Number of frames without any starvation after which an adaptive stream
+ * frees an internal buffer, if the device always had spare buffers queued.
+ */
+static constexpr unsigned int adaptationWindow = 300;
+
 namespace libcamera {
 
 LOG_DEFINE_CATEGORY(RPISTREAM)
@@ -73,6 +80,8 @@ void Stream::resetBuffers()
 	availableBuffers_ = {};
 	for (auto const &buffer : internalBuffers_)
 		availableBuffers_.push(buffer.get());
+
+	sharedBuffers_.clear();
 }
 
 void Stream::setExportedBuffers(std::vector<std::unique_ptr<FrameBuffer>> *buffers)
@@ -91,14 +100,12 @@ unsigned int Stream::getBufferId(FrameBuffer *buffer) const
 	if (flags_ & StreamFlag::ImportOnly)
 		return 0;
 
-	/* Find the buffer in the map, and return the buffer id. */
-	auto it = std::find_if(bufferMap_.begin(), bufferMap_.end(),
-			       [&buffer](auto const &p) { return p.second.buffer == buffer; });
-
-	if (it == bufferMap_.end())
+	/* Find the buffer in the reverse map, and return the buffer id. */
+	auto it = bufferIds_.find(buffer);
+	if (it == bufferIds_.end())
 		return 0;
 
-	return it->first;
+	return it->second;
 }
 
 void Stream::setExportedBuffer(FrameBuffer *buffer)
@@ -148,15 +155,16 @@ int Stream::queueBuffer(FrameBuffer *buffer)
 	}
 
 	/*
-	 * If no earlier requests are pending to be queued we can go ahead and
-	 * queue this buffer into the device.
+	 * If no earlier requests are pending to be queued, and the buffer is
+	 * not still in use by another device, we can go ahead and queue this
+	 * buffer into the device.
 	 */
-	if (requestBuffers_.empty())
+	if (requestBuffers_.empty() && !sharedBuffers_.count(buffer))
 		return queueToDevice(buffer);
 
 	/*
-	 * There are earlier Request buffers to be queued, so this buffer must go
-	 * on the waiting list.
+	 * There are earlier Request buffers to be queued, or the buffer is
+	 * shared, so this buffer must go on the waiting list.
 	 */
 	requestBuffers_.push(buffer);
 
@@ -165,6 +173,9 @@ int Stream::queueBuffer(FrameBuffer *buffer)
 
 void Stream::returnBuffer(FrameBuffer *buffer)
 {
+	if (pendingReleases_ && releaseInternalBuffer(buffer))
+		return;
+
 	if (!(flags_ & StreamFlag::External) && !(flags_ & StreamFlag::Recurrent)) {
 		/* For internal buffers, simply requeue back to the device. */
 		queueToDevice(buffer);
@@ -178,28 +189,31 @@ void Stream::returnBuffer(FrameBuffer *buffer)
 	 * Do we have any Request buffers that are waiting to be queued?
 	 * If so, do it now as availableBuffers_ will not be empty.
 	 */
-	while (!requestBuffers_.empty()) {
-		FrameBuffer *requestBuffer = requestBuffers_.front();
+	queueRequestBuffers();
+}
 
-		if (!requestBuffer) {
-			/*
-			 * We want to queue an internal buffer, but none
-			 * are available. Can't do anything, quit the loop.
-			 */
-			if (availableBuffers_.empty())
-				break;
+/*
+ * Mark a buffer that has been returned to the application as still being read
+ * by another device. The application may queue it again in a new Request, but
+ * it will only be queued into the device once releaseSharedBuffer() is called.
+ */
+void Stream::shareBuffer(FrameBuffer *buffer)
+{
+	sharedBuffers_.insert(buffer);
+}
 
-			/*
-			 * We want to queue an internal buffer, and at least one
-			 * is available.
-			 */
-			requestBuffer = availableBuffers_.front();
-			availableBuffers_.pop();
-		}
+/*
+ * Release a buffer marked with shareBuffer(), and queue it into the device if
+ * the application has already queued it again. Return false if the buffer is
+ * not shared, in which case it must be handled as any other buffer.
+ */
+bool Stream::releaseSharedBuffer(FrameBuffer *buffer)
+{
+	if (!sharedBuffers_.erase(buffer))
+		return false;
 
-		requestBuffers_.pop();
-		queueToDevice(requestBuffer);
-	}
+	queueRequestBuffers();
+	return true;
 }
 
 const BufferObject &Stream::getBuffer(unsigned int id)
@@ -247,6 +261,77 @@ void Stream::releaseBuffers()
 	clearBuffers();
 }
 
+/*
+ * Let the number of internal buffers adapt between minBuffers and maxBuffers
+ * while streaming, starting from the number of buffers allocated by
+ * prepareBuffers(). The pipeline handler must call adaptBuffers() every time
+ * a buffer is dequeued from the device.
+ */
+void Stream::setBufferBounds(unsigned int minBuffers, unsigned int maxBuffers)
+{
+	if (internalBuffers_.empty() || maxBuffers <= minBuffers) {
+		adaptation_.reset();
+		return;
+	}
+
+	adaptation_ = BufferAdaptation{
+		.minBuffers = minBuffers,
+		.maxBuffers = std::min(maxBuffers, maxV4L2BufferCount),
+		.sequenceGaps = dev_->stats().sequenceGaps,
+		.frames = 0,
+		.minSlack = UINT_MAX,
+	};
+}
+
+/*
+ * Grow the internal buffers by one when the device drops a frame or runs out
+ * of queued buffers, and shrink them by one when the device always had at
+ * least two spare buffers queued during the last adaptationWindow frames.
+ */
+void Stream::adaptBuffers()
+{
+	if (!adaptation_)
+		return;
+
+	BufferAdaptation &adaptation = *adaptation_;
+	const V4L2VideoDevice::Stats stats = dev_->stats();
+	const unsigned int numBuffers = internalBuffers_.size() - pendingReleases_;
+
+	bool starved = stats.sequenceGaps > adaptation.sequenceGaps ||
+		       !stats.queueDepth;
+	adaptation.sequenceGaps = stats.sequenceGaps;
+
+	if (starved) {
+		adaptation.frames = 0;
+		adaptation.minSlack = UINT_MAX;
+
+		if (pendingReleases_) {
+			pendingReleases_--;
+		} else if (numBuffers < adaptation.maxBuffers) {
+			if (growBuffers(1) > 0)
+				LOG(RPISTREAM, Debug)
+					<< "Grew " << name_ << " to "
+					<< internalBuffers_.size() << " buffers";
+		}
+
+		return;
+	}
+
+	adaptation.minSlack = std::min(adaptation.minSlack, stats.queueDepth);
+	if (++adaptation.frames < adaptationWindow)
+		return;
+
+	if (adaptation.minSlack >= 2 && numBuffers > adaptation.minBuffers) {
+		pendingReleases_++;
+		LOG(RPISTREAM, Debug)
+			<< "Shrinking " << name_ << " to " << numBuffers - 1
+			<< " buffers";
+	}
+
+	adaptation.frames = 0;
+	adaptation.minSlack = UINT_MAX;
+}
+
 void Stream::bufferEmplace(unsigned int id, FrameBuffer *buffer)
 {
 	if (flags_ & StreamFlag::RequiresMmap)
@@ -255,17 +340,121 @@ void Stream::bufferEmplace(unsigned int id, FrameBuffer *buffer)
 	else
 		bufferMap_.emplace(std::piecewise_construct, std::forward_as_tuple(id),
 				   std::forward_as_tuple(buffer, false));
+
+	bufferIds_.emplace(buffer, id);
 }
 
 void Stream::clearBuffers()
 {
+	adaptation_.reset();
+	pendingReleases_ = 0;
 	availableBuffers_ = std::queue<FrameBuffer *>{};
 	requestBuffers_ = std::queue<FrameBuffer *>{};
+	sharedBuffers_.clear();
 	internalBuffers_.clear();
 	bufferMap_.clear();
+	bufferIds_.clear();
 	id_ = 0;
 }
 
+void Stream::queueRequestBuffers()
+{
+	while (!requestBuffers_.empty()) {
+		FrameBuffer *requestBuffer = requestBuffers_.front();
+
+		if (!requestBuffer) {
+			/*
+			 * We want to queue an internal buffer, but none
+			 * are available. Can't do anything, quit the loop.
+			 */
+			if (availableBuffers_.empty())
+				break;
+
+			/*
+			 * We want to queue an internal buffer, and at least one
+			 * is available.
+			 */
+			requestBuffer = availableBuffers_.front();
+			availableBuffers_.pop();
+		} else if (sharedBuffers_.count(requestBuffer)) {
+			/*
+			 * The buffer is still in use by another device, and
+			 * the buffers must be queued in order, so wait for it
+			 * to be released.
+			 */
+			break;
+		}
+
+		requestBuffers_.pop();
+		queueToDevice(requestBuffer);
+	}
+}
+
+/*
+ * Add internal buffers while streaming. The device imports buffers, so the
+ * new buffers are allocated from the CMA heap with the layout of the existing
+ * internal buffers, and handed to the stream as if they had been returned.
+ */
+int Stream::growBuffers(unsigned int count)
+{
+	if (internalBuffers_.empty())
+		return -EINVAL;
+
+	if (!allocator_)
+		allocator_ = std::make_unique<DmaBufAllocator>(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap);
+
+	if (!allocator_->isValid())
+		return -ENODEV;
+
+	std::vector<unsigned int> planeSizes;
+	for (const FrameBuffer::Plane &plane : internalBuffers_.front()->planes())
+		planeSizes.push_back(plane.length);
+
+	std::vector<std::unique_ptr<FrameBuffer>> buffers;
+	int ret = allocator_->exportBuffers(count, planeSizes, &buffers);
+	if (ret < 0) {
+		LOG(RPISTREAM, Warning)
+			<< "Failed to add buffers to " << name_;
+		return ret;
+	}
+
+	for (std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		FrameBuffer *fb = buffer.get();
+
+		internalBuffers_.push_back(std::move(buffer));
+		bufferEmplace(++id_, fb);
+		returnBuffer(fb);
+	}
+
+	return ret;
+}
+
+/*
+ * Free an internal buffer returned to the stream when a release is pending.
+ * Return false if the buffer is not an internal buffer, in which case it must
+ * be handled as any other returned buffer.
+ */
+bool Stream::releaseInternalBuffer(FrameBuffer *buffer)
+{
+	auto it = std::find_if(internalBuffers_.begin(), internalBuffers_.end(),
+			       [buffer](const std::unique_ptr<FrameBuffer> &b) {
+				       return b.get() == buffer;
+			       });
+	if (it == internalBuffers_.end())
+		return false;
+
+	auto id = bufferIds_.find(buffer);
+	if (id != bufferIds_.end()) {
+		bufferMap_.erase(id->second);
+		bufferIds_.erase(id);
+	}
+
+	internalBuffers_.erase(it);
+	pendingReleases_--;
+
+	return true;
+}
+
 int Stream::queueToDevice(FrameBuffer *buffer)
 {
 	LOG(RPISTREAM, Debug) << "Queuing buffer " << getBufferId(buffer)
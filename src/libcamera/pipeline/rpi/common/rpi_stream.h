@@ -11,6 +11,7 @@
 #include <queue>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <libcamera/base/flags.h>
@@ -18,6 +19,7 @@
 
 #include <libcamera/stream.h>
 
+#include "libcamera/internal/dma_buf_allocator.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
@@ -92,14 +94,15 @@ public:
 	using StreamFlags = Flags<StreamFlag>;
 
 	Stream()
-		: flags_(StreamFlag::None), id_(0), swDownscale_(0)
+		: flags_(StreamFlag::None), id_(0), swDownscale_(0),
+		  pendingReleases_(0)
 	{
 	}
 
 	Stream(const char *name, MediaEntity *dev, StreamFlags flags = StreamFlag::None)
 		: flags_(flags), name_(name),
 		  dev_(std::make_unique<V4L2VideoDevice>(dev)), id_(0),
-		  swDownscale_(0)
+		  swDownscale_(0), pendingReleases_(0)
 	{
 	}
 
@@ -124,20 +127,30 @@ public:
 	int queueBuffer(FrameBuffer *buffer);
 	void returnBuffer(FrameBuffer *buffer);
 
+	void shareBuffer(FrameBuffer *buffer);
+	bool releaseSharedBuffer(FrameBuffer *buffer);
+
 	const BufferObject &getBuffer(unsigned int id);
 	const BufferObject &acquireBuffer();
 
 	int queueAllBuffers();
 	void releaseBuffers();
 
+	void setBufferBounds(unsigned int minBuffers, unsigned int maxBuffers);
+	void adaptBuffers();
+
 	/* For error handling. */
 	static const BufferObject errorBufferObject;
 
 private:
 	void bufferEmplace(unsigned int id, FrameBuffer *buffer);
 	void clearBuffers();
+	void queueRequestBuffers();
 	int queueToDevice(FrameBuffer *buffer);
 
+	int growBuffers(unsigned int count);
+	bool releaseInternalBuffer(FrameBuffer *buffer);
+
 	StreamFlags flags_;
 
 	/* Stream name identifier. */
@@ -154,6 +167,8 @@ private:
 
 	/* All frame buffers associated with this device stream. */
 	BufferMap bufferMap_;
+	/* Reverse lookup of the bufferMap_ ids, by frame buffer. */
+	std::unordered_map<FrameBuffer *, unsigned int> bufferIds_;
 
 	/*
 	 * List of frame buffers that we can use if none have been provided by
@@ -172,11 +187,39 @@ private:
 	 */
 	std::queue<FrameBuffer *> requestBuffers_;
 
+	/*
+	 * List of frame buffers that have been returned to the application
+	 * while still being read by another device. They are only queued back
+	 * into the device once that device has released them.
+	 */
+	std::unordered_set<FrameBuffer *> sharedBuffers_;
+
 	/*
 	 * This is a list of buffers exported internally. Need to keep this around
 	 * as the stream needs to maintain ownership of these buffers.
 	 */
 	std::vector<std::unique_ptr<FrameBuffer>> internalBuffers_;
+
+	/*
+	 * State of the adaptive internal buffer count, enabled by
+	 * setBufferBounds(). The slack is the number of buffers still queued
+	 * in the device when a buffer is dequeued.
+	 */
+	struct BufferAdaptation {
+		unsigned int minBuffers;
+		unsigned int maxBuffers;
+		uint64_t sequenceGaps;
+		unsigned int frames;
+		unsigned int minSlack;
+	};
+
+	std::optional<BufferAdaptation> adaptation_;
+
+	/* Number of internal buffers to free when they are next returned. */
+	unsigned int pendingReleases_;
+
+	/* Allocator for the internal buffers added while streaming. */
+	std::unique_ptr<DmaBufAllocator> allocator_;
 };
 
 /*
@@ -14,11 +14,10 @@
 #include <set>
 #include <sstream>
 #include <string>
-#include <sys/ioctl.h>
+#include <string.h>
 #include <unordered_map>
 #include <vector>
 
-#include <linux/dma-buf.h>
 #include <linux/v4l2-controls.h>
 #include <linux/videodev2.h>
 
@@ -28,6 +27,7 @@
 
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/shared_mem_object.h"
+#include "libcamera/internal/tracepoints.h"
 
 #include "../common/pipeline_base.h"
 #include "../common/rpi_stream.h"
@@ -383,33 +383,6 @@ void setupOutputClipping(const V4L2DeviceFormat &v4l2Format,
 	}
 }
 
-int dmabufSyncStart(const SharedFD &fd)
-{
-	struct dma_buf_sync dma_sync {
-	};
-	dma_sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW;
-
-	int ret = ::ioctl(fd.get(), DMA_BUF_IOCTL_SYNC, &dma_sync);
-	if (ret)
-		LOG(RPI, Error) << "failed to lock-sync-write dma buf";
-
-	return ret;
-}
-
-int dmabufSyncEnd(const SharedFD &fd)
-{
-	struct dma_buf_sync dma_sync {
-	};
-	dma_sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW;
-
-	int ret = ::ioctl(fd.get(), DMA_BUF_IOCTL_SYNC, &dma_sync);
-
-	if (ret)
-		LOG(RPI, Error) << "failed to unlock-sync-write dma buf";
-
-	return ret;
-}
-
 void do32BitConversion(void *mem, unsigned int width, unsigned int height,
 		       unsigned int stride)
 {
@@ -779,7 +752,9 @@ class PiSPCameraData final : public RPi::CameraData
 {
 public:
 	PiSPCameraData(PipelineHandler *pipe, const libpisp::PiSPVariant &variant)
-		: RPi::CameraData(pipe), pispVariant_(variant)
+		: RPi::CameraData(pipe), pispVariant_(variant),
+		  beConfig_(std::make_unique<pisp_be_tiles_config>()),
+		  beTilesVersion_(0), lastIpaTimestamp_(0), lastIpaContext_(0)
 	{
 		/* Initialise internal libpisp logging. */
 		::libpisp::logging_init();
@@ -821,6 +796,7 @@ public:
 
 	void processStatsComplete(const ipa::RPi::BufferIds &buffers);
 	void prepareIspComplete(const ipa::RPi::BufferIds &buffers, bool stitchSwapBuffers);
+	void ipaMetadataReady(const ControlList &metadata);
 	void setCameraTimeout(uint32_t maxFrameLengthMs);
 
 	/* Array of CFE and ISP device streams and associated buffers/streams. */
@@ -842,6 +818,16 @@ public:
 	unsigned int tdnInputIndex_;
 	unsigned int stitchInputIndex_;
 
+	/*
+	 * Backend configuration prepared in regular memory. The tile layout
+	 * only changes with the geometry, so it is written to each ISP
+	 * Config buffer only when the version the buffer holds is stale.
+	 */
+	std::unique_ptr<pisp_be_tiles_config> beConfig_;
+	std::vector<pisp_tile> beTiles_;
+	unsigned int beTilesVersion_;
+	std::unordered_map<const FrameBuffer *, unsigned int> beConfigTilesVersion_;
+
 	struct Config {
 		/*
 		 * Number of CFE config and stats buffers to allocate and use. A
@@ -858,6 +844,25 @@ public:
 		bool disableTdn;
 		/* Don't use BE HDR and free some memory resources. */
 		bool disableHdr;
+		/*
+		 * Number of frames that can be processed by the IPA and the
+		 * BE at the same time. With 2 jobs, the IPA prepares the next
+		 * frame while the BE processes the current one.
+		 */
+		unsigned int numBeJobs;
+		/*
+		 * Return the RAW buffers to the application as soon as the
+		 * frame is picked up, while the Backend still reads from them,
+		 * and allocate fewer internal RAW buffers.
+		 */
+		bool sharedRawBuffers;
+		/*
+		 * Maximum rate, in frames per second, at which the IPA runs.
+		 * Frames captured in between are processed by the Backend
+		 * with the configuration of the last IPA run. 0 to run the IPA
+		 * on every frame.
+		 */
+		unsigned int ipaMaxFrameRate;
 	};
 
 	Config config_;
@@ -883,7 +888,11 @@ private:
 	void platformSetIspCrop(unsigned int index, const Rectangle &ispCrop) override;
 
 	void prepareCfe();
-	void prepareBe(uint32_t bufferId, bool stitchSwapBuffers);
+	void prepareBe(const Job &job, uint32_t bufferId, bool stitchSwapBuffers);
+	void runBe(Job &job, const ipa::RPi::BufferIds &buffers, bool stitchSwapBuffers);
+
+	bool skipIpa(const Job &job, int64_t timestamp) const;
+	void reuseIpaResults(Job &job, const ipa::RPi::BufferIds &buffers);
 
 	void tryRunPipeline() override;
 
@@ -908,6 +917,11 @@ private:
 	}
 
 	std::string last_dump_file_;
+
+	/* The last frame the IPA ran on, when running it at a reduced rate. */
+	int64_t lastIpaTimestamp_;
+	uint32_t lastIpaContext_;
+	ControlList lastIpaMetadata_;
 };
 
 class PipelineHandlerPiSP : public RPi::PipelineHandlerBase
@@ -1034,30 +1048,42 @@ int PipelineHandlerPiSP::prepareBuffers(Camera *camera)
 		}
 	}
 
+	/*
+	 * For CFE, allocate a minimum of 4 buffers as we want to avoid any
+	 * frame drops. If an application has configured a RAW stream, allocate
+	 * additional buffers to make up the minimum, but ensure we have at
+	 * least 2 sets of internal buffers to use to minimise frame drops.
+	 *
+	 * When RAW buffers are shared with the application, they are given
+	 * back to the CFE as soon as both the application and the Backend are
+	 * done with them. A single internal buffer is then enough, for the
+	 * startup drop frames and the requests without a RAW buffer, if the
+	 * application provides the minimum itself.
+	 *
+	 * In low latency mode, use the smallest number of buffers that can
+	 * sustain the full frame rate, one being written while the other is
+	 * processed.
+	 */
+	const unsigned int minBuffers = data->lowLatency_ ? 2 : 4;
+	unsigned int numInternalRawBuffers;
+	if ((data->config_.sharedRawBuffers || data->lowLatency_) &&
+	    numRawBuffers >= minBuffers)
+		numInternalRawBuffers = 1;
+	else
+		numInternalRawBuffers = std::max<int>(data->lowLatency_ ? 1 : 2,
+						      minBuffers - numRawBuffers);
+
 	/* Decide how many internal buffers to allocate. */
 	for (auto const stream : data->streams_) {
 		unsigned int numBuffers;
-		/*
-		 * For CFE, allocate a minimum of 4 buffers as we want
-		 * to avoid any frame drops.
-		 */
-		constexpr unsigned int minBuffers = 4;
 		if (stream == &data->cfe_[Cfe::Output0]) {
-			/*
-			 * If an application has configured a RAW stream, allocate
-			 * additional buffers to make up the minimum, but ensure
-			 * we have at least 2 sets of internal buffers to use to
-			 * minimise frame drops.
-			 */
-			numBuffers = std::max<int>(2, minBuffers - numRawBuffers);
+			numBuffers = numInternalRawBuffers;
 		} else if (stream == &data->isp_[Isp::Input]) {
 			/*
-			 * ISP input buffers are imported from the CFE, so follow
-			 * similar logic as above to count all the RAW buffers
-			 * available.
+			 * ISP input buffers are imported from the CFE, so count
+			 * all the RAW buffers available.
 			 */
-			numBuffers = numRawBuffers +
-				     std::max<int>(2, minBuffers - numRawBuffers);
+			numBuffers = numRawBuffers + numInternalRawBuffers;
 		} else if (stream == &data->cfe_[Cfe::Embedded]) {
 			/*
 			 * Embedded data buffers are (currently) for internal use,
@@ -1087,6 +1113,9 @@ int PipelineHandlerPiSP::prepareBuffers(Camera *camera)
 		ret = stream->prepareBuffers(numBuffers);
 		if (ret < 0)
 			return ret;
+
+		if (stream == &data->cfe_[Cfe::Output0])
+			data->enableAdaptiveBuffers(stream, numBuffers);
 	}
 
 	/*
@@ -1220,6 +1249,7 @@ int PipelineHandlerPiSP::platformRegister(std::unique_ptr<RPi::CameraData> &came
 	data->ipa_->prepareIspComplete.connect(data, &PiSPCameraData::prepareIspComplete);
 	data->ipa_->processStatsComplete.connect(data, &PiSPCameraData::processStatsComplete);
 	data->ipa_->setCameraTimeout.connect(data, &PiSPCameraData::setCameraTimeout);
+	data->ipa_->metadataReady.connect(data, &PiSPCameraData::ipaMetadataReady);
 
 	/*
 	 * List the available streams an application may request. At present, we
@@ -1398,8 +1428,13 @@ int PiSPCameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject>
 		.numCfeConfigQueue = 2,
 		.disableTdn = false,
 		.disableHdr = false,
+		.numBeJobs = 1,
+		.sharedRawBuffers = false,
+		.ipaMaxFrameRate = 0,
 	};
 
+	maxJobs_ = config_.numBeJobs;
+
 	if (!root)
 		return 0;
 
@@ -1423,6 +1458,11 @@ int PiSPCameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject>
 		phConfig["num_cfe_config_queue"].get<unsigned int>(config_.numCfeConfigQueue);
 	config_.disableTdn = phConfig["disable_tdn"].get<bool>(config_.disableTdn);
 	config_.disableHdr = phConfig["disable_hdr"].get<bool>(config_.disableHdr);
+	config_.numBeJobs = phConfig["num_be_jobs"].get<unsigned int>(config_.numBeJobs);
+	config_.sharedRawBuffers =
+		phConfig["shared_raw_buffers"].get<bool>(config_.sharedRawBuffers);
+	config_.ipaMaxFrameRate =
+		phConfig["ipa_max_frame_rate"].get<unsigned int>(config_.ipaMaxFrameRate);
 
 	if (config_.disableTdn) {
 		LOG(RPI, Info) << "TDN disabled by user config";
@@ -1452,6 +1492,18 @@ int PiSPCameraData::platformPipelineConfigure(const std::unique_ptr<YamlObject>
 		return -EINVAL;
 	}
 
+	/*
+	 * The BE config, TDN and Stitch buffers are allocated in pairs, which
+	 * limits the number of jobs the BE can have queued.
+	 */
+	if (config_.numBeJobs < 1 || config_.numBeJobs > 2) {
+		LOG(RPI, Error)
+			<< "Invalid configuration: num_be_jobs must be 1 or 2";
+		return -EINVAL;
+	}
+
+	maxJobs_ = config_.numBeJobs;
+
 	return 0;
 }
 
@@ -1717,7 +1769,15 @@ void PiSPCameraData::platformStart()
 
 	cfeJobQueue_ = {};
 
-	for (unsigned int i = 0; i < config_.numCfeConfigQueue; i++)
+	/* Run the IPA on the first frame. */
+	lastIpaTimestamp_ = 0;
+
+	/*
+	 * In low latency mode, queue a single CFE configuration ahead so that
+	 * the 3A changes are applied as early as possible.
+	 */
+	unsigned int numCfeConfigQueue = lowLatency_ ? 1 : config_.numCfeConfigQueue;
+	for (unsigned int i = 0; i < numCfeConfigQueue; i++)
 		prepareCfe();
 
 	/* Clear the debug dump file history. */
@@ -1733,6 +1793,7 @@ void PiSPCameraData::platformFreeBuffers()
 {
 	tdnBuffers_.clear();
 	stitchBuffers_.clear();
+	beConfigTilesVersion_.clear();
 }
 
 void PiSPCameraData::cfeBufferDequeue(FrameBuffer *buffer)
@@ -1767,6 +1828,11 @@ void PiSPCameraData::cfeBufferDequeue(FrameBuffer *buffer)
 	job.buffers[stream] = buffer;
 
 	if (stream == &cfe_[Cfe::Output0]) {
+		LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), SensorDequeue,
+					   buffer->metadata().sequence);
+
+		stream->adaptBuffers();
+
 		/* Do an endian swap if needed. */
 		if (stream->getFlags() & StreamFlag::Needs16bitEndianSwap) {
 			const unsigned int stride = stream->configuration().stride;
@@ -1777,16 +1843,17 @@ void PiSPCameraData::cfeBufferDequeue(FrameBuffer *buffer)
 			ASSERT(b.mapped);
 			void *mem = b.mapped->planes()[0].data();
 
-			dmabufSyncStart(buffer->planes()[0].fd);
+			MappedFrameBuffer::SyncScope sync = b.mapped->syncScope();
 			do16BitEndianSwap(mem, width, height, stride);
-			dmabufSyncEnd(buffer->planes()[0].fd);
 		}
 
 		/*
 		 * Lookup the sensor controls used for this frame sequence from
 		 * DelayedControl and queue them along with the frame buffer.
 		 */
-		auto [ctrl, delayContext] = delayedCtrls_->get(buffer->metadata().sequence);
+		unsigned int delayContext;
+		ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence,
+						       &delayContext);
 		/*
 		 * Add the frame timestamp to the ControlList for the IPA to use
 		 * as it does not receive the FrameBuffer object.
@@ -1812,8 +1879,13 @@ void PiSPCameraData::beInputDequeue(FrameBuffer *buffer)
 			<< ", buffer id " << cfe_[Cfe::Output0].getBufferId(buffer)
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
-	/* The ISP input buffer gets re-queued into CFE. */
-	handleStreamBuffer(buffer, &cfe_[Cfe::Output0]);
+	/*
+	 * The ISP input buffer gets re-queued into CFE. If it has already been
+	 * returned to the application, it is re-queued when the application
+	 * queues it again.
+	 */
+	if (!cfe_[Cfe::Output0].releaseSharedBuffer(buffer))
+		handleStreamBuffer(buffer, &cfe_[Cfe::Output0]);
 	handleState();
 }
 
@@ -1840,11 +1912,16 @@ void PiSPCameraData::beOutputDequeue(FrameBuffer *buffer)
 			<< ", buffer id " << index
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
+	Job *job = ispJob();
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IspDequeue,
+				   traceSequence(job));
+
 	bool downscale = stream->swDownscale() > 1;
 	bool needs32bitConv = !!(stream->getFlags() & StreamFlag::Needs32bitConv);
 
+	MappedFrameBuffer::SyncScope sync;
 	if (downscale || needs32bitConv)
-		dmabufSyncStart(buffer->planes()[0].fd);
+		sync = stream->getBuffer(index).mapped->syncScope();
 
 	if (downscale) {
 		/* Further software downscaling must be applied. */
@@ -1864,8 +1941,7 @@ void PiSPCameraData::beOutputDequeue(FrameBuffer *buffer)
 		do32BitConversion(mem, width, height, stride);
 	}
 
-	if (downscale || needs32bitConv)
-		dmabufSyncEnd(buffer->planes()[0].fd);
+	sync.clear();
 
 	handleStreamBuffer(buffer, stream);
 
@@ -1873,7 +1949,8 @@ void PiSPCameraData::beOutputDequeue(FrameBuffer *buffer)
 	 * Increment the number of ISP outputs generated.
 	 * This is needed to track dropped frames.
 	 */
-	ispOutputCount_++;
+	if (job)
+		job->ispOutputCount++;
 	handleState();
 }
 
@@ -1882,6 +1959,9 @@ void PiSPCameraData::processStatsComplete(const ipa::RPi::BufferIds &buffers)
 	if (!isRunning())
 		return;
 
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaProcessEnd,
+				   traceSequence(ipaJob()));
+
 	handleStreamBuffer(cfe_[Cfe::Stats].getBuffers().at(buffers.stats & RPi::MaskID).buffer,
 			   &cfe_[Cfe::Stats]);
 }
@@ -1902,33 +1982,46 @@ void PiSPCameraData::setCameraTimeout(uint32_t maxFrameLengthMs)
 
 void PiSPCameraData::prepareIspComplete(const ipa::RPi::BufferIds &buffers, bool stitchSwapBuffers)
 {
-	unsigned int embeddedId = buffers.embedded & RPi::MaskID;
-	unsigned int bayerId = buffers.bayer & RPi::MaskID;
-	FrameBuffer *buffer;
-
 	if (!isRunning())
 		return;
 
-	if (sensorMetadata_ && embeddedId) {
-		buffer = cfe_[Cfe::Embedded].getBuffers().at(embeddedId).buffer;
-		handleStreamBuffer(buffer, &cfe_[Cfe::Embedded]);
-	}
+	Job *job = ipaJob();
+	ASSERT(job);
 
-	if (!beEnabled_) {
-		/*
-		 * If there is no need to run the Backend, just signal that the
-		 * input buffer is completed and all Backend outputs are ready.
-		 */
-		ispOutputCount_ = ispOutputTotal_;
-		buffer = cfe_[Cfe::Output0].getBuffers().at(bayerId).buffer;
-		handleStreamBuffer(buffer, &cfe_[Cfe::Output0]);
-	} else
-		prepareBe(bayerId, stitchSwapBuffers);
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaPrepareEnd,
+				   traceSequence(job));
 
-	state_ = State::IpaComplete;
+	runBe(*job, buffers, stitchSwapBuffers);
 	handleState();
 }
 
+void PiSPCameraData::ipaMetadataReady(const ControlList &metadata)
+{
+	if (!config_.ipaMaxFrameRate)
+		return;
+
+	/*
+	 * Keep the metadata for the frames processed without the IPA, except
+	 * for the statistics and CNN outputs specific to this frame.
+	 */
+	static const std::set<unsigned int> frameControls = {
+		controls::rpi::Bcm2835StatsOutput.id(),
+		controls::rpi::PispStatsOutput.id(),
+		controls::rpi::CnnOutputTensor.id(),
+		controls::rpi::CnnOutputTensorInfo.id(),
+		controls::rpi::CnnInputTensor.id(),
+		controls::rpi::CnnInputTensorInfo.id(),
+		controls::rpi::CnnKpiInfo.id(),
+		controls::rpi::CnnOutputTensorBuffer.id(),
+	};
+
+	lastIpaMetadata_ = ControlList(controls::controls);
+	for (const auto &[id, value] : metadata) {
+		if (!frameControls.count(id))
+			lastIpaMetadata_.set(id, value);
+	}
+}
+
 int PiSPCameraData::configureCfe()
 {
 	V4L2DeviceFormat cfeFormat;
@@ -2262,6 +2355,8 @@ void PiSPCameraData::prepareCfe()
 
 	{
 		std::scoped_lock<FrontEnd> l(*fe_);
+		MappedFrameBuffer::SyncScope sync =
+			config.mapped->syncScope(MappedFrameBuffer::MapFlag::Write);
 		Span<uint8_t> configBuffer = config.mapped->planes()[0];
 		fe_->Prepare(reinterpret_cast<pisp_fe_config *>(configBuffer.data()));
 	}
@@ -2270,15 +2365,15 @@ void PiSPCameraData::prepareCfe()
 	cfe_[Cfe::Config].queueBuffer(config.buffer);
 }
 
-void PiSPCameraData::prepareBe(uint32_t bufferId, bool stitchSwapBuffers)
+void PiSPCameraData::prepareBe(const Job &job, uint32_t bufferId, bool stitchSwapBuffers)
 {
-	ispOutputCount_ = 0;
-
 	FrameBuffer *buffer = cfe_[Cfe::Output0].getBuffers().at(bufferId).buffer;
 
 	LOG(RPI, Debug) << "Input re-queue to ISP, buffer id " << bufferId
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IspQueue,
+				   traceSequence(&job));
 	isp_[Isp::Input].queueBuffer(buffer);
 
 	/* Ping-pong between input/output buffers for the TDN and Stitch nodes. */
@@ -2299,9 +2394,34 @@ void PiSPCameraData::prepareBe(uint32_t bufferId, bool stitchSwapBuffers)
 	const RPi::BufferObject &config = isp_[Isp::Config].acquireBuffer();
 	ASSERT(config.mapped);
 
+	/*
+	 * Prepare the configuration in regular memory, libpisp only retiles
+	 * when the geometry has changed. Detect a new tile layout to avoid
+	 * rewriting the tiles of every ISP Config buffer on every frame.
+	 */
+	be_->Prepare(beConfig_.get());
+
+	Span<const pisp_tile> tiles{ beConfig_->tiles, beConfig_->num_tiles };
+	if (!std::equal(tiles.begin(), tiles.end(), beTiles_.begin(), beTiles_.end(),
+			[](const pisp_tile &a, const pisp_tile &b) {
+				return !memcmp(&a, &b, sizeof(a));
+			})) {
+		beTiles_.assign(tiles.begin(), tiles.end());
+		beTilesVersion_++;
+	}
+
+	MappedFrameBuffer::SyncScope sync = config.mapped->syncScope();
 	Span<uint8_t> configBufferSpan = config.mapped->planes()[0];
 	pisp_be_tiles_config *configBuffer = reinterpret_cast<pisp_be_tiles_config *>(configBufferSpan.data());
-	be_->Prepare(configBuffer);
+
+	configBuffer->config = beConfig_->config;
+	configBuffer->num_tiles = beConfig_->num_tiles;
+
+	unsigned int &tilesVersion = beConfigTilesVersion_[config.buffer];
+	if (tilesVersion != beTilesVersion_) {
+		std::copy(tiles.begin(), tiles.end(), configBuffer->tiles);
+		tilesVersion = beTilesVersion_;
+	}
 
 	/*
 	 * If the LIBCAMERA_RPI_PISP_CONFIG_DUMP environment variable is set,
@@ -2317,24 +2437,110 @@ void PiSPCameraData::prepareBe(uint32_t bufferId, bool stitchSwapBuffers)
 	if (config_dump && last_dump_file_ != config_dump) {
 		std::ofstream of(config_dump);
 		if (of.is_open()) {
-			of << be_->GetJsonConfig(configBuffer);
+			of << be_->GetJsonConfig(beConfig_.get());
 			last_dump_file_ = config_dump;
 		}
 	}
 
+	sync.clear();
 	isp_[Isp::Config].queueBuffer(config.buffer);
 }
 
+/*
+ * Hand the buffers of a frame prepared by the IPA, or processed without it,
+ * over to the Backend. This completes the IPA part of the job.
+ */
+void PiSPCameraData::runBe(Job &job, const ipa::RPi::BufferIds &buffers,
+			   bool stitchSwapBuffers)
+{
+	unsigned int embeddedId = buffers.embedded & RPi::MaskID;
+	unsigned int bayerId = buffers.bayer & RPi::MaskID;
+	FrameBuffer *buffer;
+
+	if (sensorMetadata_ && embeddedId) {
+		buffer = cfe_[Cfe::Embedded].getBuffers().at(embeddedId).buffer;
+		handleStreamBuffer(buffer, &cfe_[Cfe::Embedded]);
+	}
+
+	if (!beEnabled_) {
+		/*
+		 * If there is no need to run the Backend, just signal that the
+		 * input buffer is completed and all Backend outputs are ready.
+		 */
+		job.ispOutputCount = ispOutputTotal_;
+		buffer = cfe_[Cfe::Output0].getBuffers().at(bayerId).buffer;
+		if (!cfe_[Cfe::Output0].releaseSharedBuffer(buffer))
+			handleStreamBuffer(buffer, &cfe_[Cfe::Output0]);
+	} else
+		prepareBe(job, bayerId, stitchSwapBuffers);
+
+	job.ipaComplete = true;
+}
+
+/*
+ * With a maximum IPA frame rate, check if a frame can be processed without
+ * running the IPA. Frames dropped at startup and frames whose request carries
+ * controls always go through the IPA.
+ */
+bool PiSPCameraData::skipIpa(const Job &job, int64_t timestamp) const
+{
+	if (!config_.ipaMaxFrameRate || !lastIpaTimestamp_ || job.dropFrame ||
+	    !job.request->controls().empty())
+		return false;
+
+	/* Allow a 10% margin on the comparison below. */
+	utils::Duration interval = (timestamp - lastIpaTimestamp_) * 1.0ns;
+	return interval < 1.0s / config_.ipaMaxFrameRate * 0.9;
+}
+
+/*
+ * Process a frame without running the IPA. The Backend reuses the configuration
+ * computed by the last IPA run, and the request gets the metadata of that run,
+ * tagged with the rpi::IpaContext control.
+ */
+void PiSPCameraData::reuseIpaResults(Job &job, const ipa::RPi::BufferIds &buffers)
+{
+	Request *request = job.request;
+
+	request->metadata().merge(lastIpaMetadata_);
+	request->metadata().set(controls::rpi::IpaContext, lastIpaContext_);
+	request->_d()->recordStage(Request::Private::Stage::IpaDone);
+
+	unsigned int statsId = buffers.stats & RPi::MaskID;
+	handleStreamBuffer(cfe_[Cfe::Stats].getBuffers().at(statsId).buffer,
+			   &cfe_[Cfe::Stats]);
+
+	runBe(job, buffers, false);
+}
+
 void PiSPCameraData::tryRunPipeline()
 {
-	/* If any of our request or buffer queues are empty, we cannot proceed. */
-	if (state_ != State::Idle || requestQueue_.empty() || !cfeJobComplete())
+	/*
+	 * If any of our request or buffer queues are empty, we cannot proceed.
+	 * With more than one job in flight, the IPA prepares this frame while
+	 * the Backend processes the previous ones.
+	 */
+	Request *request = nextRequest();
+	if (!request || !cfeJobComplete())
 		return;
 
-	CfeJob &job = cfeJobQueue_.front();
+	/* In low latency mode, skip to the most recent frame if possible. */
+	while (cfeJobQueue_.size() > 1 &&
+	       canSkipFrame(cfeJobQueue_.front().buffers[&cfe_[Cfe::Output0]],
+			    &cfe_[Cfe::Output0])) {
+		CfeJob &stale = cfeJobQueue_.front();
 
-	/* Take the first request from the queue and action the IPA. */
-	Request *request = requestQueue_.front();
+		cfe_[Cfe::Output0].returnBuffer(stale.buffers[&cfe_[Cfe::Output0]]);
+		cfe_[Cfe::Stats].returnBuffer(stale.buffers[&cfe_[Cfe::Stats]]);
+		if (sensorMetadata_)
+			cfe_[Cfe::Embedded].returnBuffer(stale.buffers[&cfe_[Cfe::Embedded]]);
+
+		cfeJobQueue_.pop();
+		LOG(RPI, Debug) << "Skipping stale frame in stream "
+				<< cfe_[Cfe::Output0].name();
+	}
+
+	CfeJob &job = cfeJobQueue_.front();
 
 	/* See if a new ScalerCrop value needs to be applied. */
 	applyScalerCrop(request->controls());
@@ -2346,24 +2552,34 @@ void PiSPCameraData::tryRunPipeline()
 	 */
 	request->metadata().clear();
 	fillRequestMetadata(job.sensorControls, request);
+	/* Record when the frame was picked up for latency reporting. */
+	request->_d()->recordStage(Request::Private::Stage::BufferDequeue);
+
+	/* Start a job to track the frame through the IPA and Backend. */
+	Job &frameJob = startJob(request);
+	bool dropFrame = frameJob.dropFrame;
 
-	/* Set our state to say the pipeline is active. */
-	state_ = State::Busy;
+	FrameBuffer *bayerBuffer = job.buffers[&cfe_[Cfe::Output0]];
+	if (config_.sharedRawBuffers && !dropFrame &&
+	    request->findBuffer(&cfe_[Cfe::Output0]) == bayerBuffer) {
+		/*
+		 * Complete the RAW buffer straight away, it stays shared with
+		 * the Backend which only reads from it. The CFE will not write
+		 * to it again before the Backend has released it.
+		 */
+		cfe_[Cfe::Output0].shareBuffer(bayerBuffer);
+		pipe()->completeBuffer(request, bayerBuffer);
+	}
 
-	unsigned int bayerId = cfe_[Cfe::Output0].getBufferId(job.buffers[&cfe_[Cfe::Output0]]);
+	unsigned int bayerId = cfe_[Cfe::Output0].getBufferId(bayerBuffer);
 	unsigned int statsId = cfe_[Cfe::Stats].getBufferId(job.buffers[&cfe_[Cfe::Stats]]);
 	ASSERT(bayerId && statsId);
 
-	std::stringstream ss;
-	ss << "Signalling IPA processStats and prepareIsp:"
-	   << " Bayer buffer id: " << bayerId
-	   << " Stats buffer id: " << statsId;
-
 	ipa::RPi::PrepareParams params;
 	params.buffers.bayer = RPi::MaskBayerData | bayerId;
 	params.buffers.stats = RPi::MaskStats | statsId;
 	params.buffers.embedded = 0;
-	params.ipaContext = requestQueue_.front()->sequence();
+	params.ipaContext = request->sequence();
 	params.delayContext = job.delayContext;
 	params.sensorControls = std::move(job.sensorControls);
 	params.requestControls = request->controls();
@@ -2374,12 +2590,37 @@ void PiSPCameraData::tryRunPipeline()
 
 		ASSERT(embeddedId);
 		params.buffers.embedded = RPi::MaskEmbeddedData | embeddedId;
-		ss << " Embedded buffer id: " << embeddedId;
 	}
 
-	LOG(RPI, Debug) << ss.str();
+	if (LOG_ENABLED(RPI, Debug)) {
+		std::stringstream ss;
+		ss << "Signalling IPA processStats and prepareIsp:"
+		   << " Bayer buffer id: " << bayerId
+		   << " Stats buffer id: " << statsId;
+		if (sensorMetadata_)
+			ss << " Embedded buffer id: "
+			   << (params.buffers.embedded & RPi::MaskID);
+
+		LOG(RPI, Debug) << ss.str();
+	}
 
 	cfeJobQueue_.pop();
+
+	int64_t timestamp = params.sensorControls.get(controls::SensorTimestamp).value_or(0);
+	if (skipIpa(frameJob, timestamp)) {
+		LOG(RPI, Debug) << "Reusing the IPA results of frame " << lastIpaContext_;
+		reuseIpaResults(frameJob, params.buffers);
+		handleState();
+		return;
+	}
+
+	lastIpaTimestamp_ = timestamp;
+	lastIpaContext_ = params.ipaContext;
+	request->metadata().set(controls::rpi::IpaContext, lastIpaContext_);
+
+	/* The PiSP IPA processes the statistics as part of prepareIsp(). */
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaProcessBegin, params.ipaContext);
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaPrepareBegin, params.ipaContext);
 	ipa_->prepareIsp(params);
 }
 
@@ -13,6 +13,7 @@
 
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/tracepoints.h"
 
 #include "../common/pipeline_base.h"
 #include "../common/rpi_stream.h"
@@ -37,7 +38,8 @@ class Vc4CameraData final : public RPi::CameraData
 {
 public:
 	Vc4CameraData(PipelineHandler *pipe)
-		: RPi::CameraData(pipe)
+		: RPi::CameraData(pipe),
+		  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap)
 	{
 	}
 
@@ -234,6 +236,16 @@ int PipelineHandlerVc4::prepareBuffers(Camera *camera)
 	unsigned int numRawBuffers = 0, minIspBuffers = 1;
 	int ret;
 
+	/*
+	 * In low latency mode, use the smallest number of Unicam buffers that
+	 * can sustain the full frame rate, one being written while the other
+	 * is processed.
+	 */
+	if (data->lowLatency_) {
+		minUnicamBuffers = std::min(minUnicamBuffers, 1U);
+		minTotalUnicamBuffers = std::min(minTotalUnicamBuffers, 2U);
+	}
+
 	if (data->unicam_[Unicam::Image].getFlags() & StreamFlag::External) {
 		numRawBuffers = data->unicam_[Unicam::Image].getBuffers().size();
 		/*
@@ -335,6 +347,9 @@ int PipelineHandlerVc4::prepareBuffers(Camera *camera)
 		ret = stream->prepareBuffers(numBuffers);
 		if (ret < 0)
 			return ret;
+
+		if (stream == &data->unicam_[Unicam::Image])
+			data->enableAdaptiveBuffers(stream, numBuffers);
 	}
 
 	/*
@@ -826,11 +841,18 @@ void Vc4CameraData::unicamBufferDequeue(FrameBuffer *buffer)
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
 	if (stream == &unicam_[Unicam::Image]) {
+		LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), SensorDequeue,
+					   buffer->metadata().sequence);
+
+		stream->adaptBuffers();
+
 		/*
 		 * Lookup the sensor controls used for this frame sequence from
 		 * DelayedControl and queue them along with the frame buffer.
 		 */
-		auto [ctrl, delayContext] = delayedCtrls_->get(buffer->metadata().sequence);
+		unsigned int delayContext;
+		ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence,
+						       &delayContext);
 		/*
 		 * Add the frame timestamp to the ControlList for the IPA to use
 		 * as it does not receive the FrameBuffer object.
@@ -881,6 +903,10 @@ void Vc4CameraData::ispOutputDequeue(FrameBuffer *buffer)
 			<< ", buffer id " << index
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
+	Job *job = ispJob();
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IspDequeue,
+				   traceSequence(job));
+
 	/*
 	 * ISP statistics buffer must not be re-queued or sent back to the
 	 * application until after the IPA signals so.
@@ -888,7 +914,9 @@ void Vc4CameraData::ispOutputDequeue(FrameBuffer *buffer)
 	if (stream == &isp_[Isp::Stats]) {
 		ipa::RPi::ProcessParams params;
 		params.buffers.stats = index | RPi::MaskStats;
-		params.ipaContext = requestQueue_.front()->sequence();
+		params.ipaContext = traceSequence(job);
+		LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaProcessBegin,
+					   params.ipaContext);
 		ipa_->processStats(params);
 	} else {
 		/* Any other ISP output can be handed back to the application now. */
@@ -899,7 +927,8 @@ void Vc4CameraData::ispOutputDequeue(FrameBuffer *buffer)
 	 * Increment the number of ISP outputs generated.
 	 * This is needed to track dropped frames.
 	 */
-	ispOutputCount_++;
+	if (job)
+		job->ispOutputCount++;
 
 	handleState();
 }
@@ -909,11 +938,17 @@ void Vc4CameraData::processStatsComplete(const ipa::RPi::BufferIds &buffers)
 	if (!isRunning())
 		return;
 
+	Job *job = ipaJob();
+	ASSERT(job);
+
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaProcessEnd,
+				   traceSequence(job));
+
 	FrameBuffer *buffer = isp_[Isp::Stats].getBuffers().at(buffers.stats & RPi::MaskID).buffer;
 
 	handleStreamBuffer(buffer, &isp_[Isp::Stats]);
 
-	state_ = State::IpaComplete;
+	job->ipaComplete = true;
 	handleState();
 }
 
@@ -927,12 +962,15 @@ void Vc4CameraData::prepareIspComplete(const ipa::RPi::BufferIds &buffers,
 	if (!isRunning())
 		return;
 
+	uint32_t sequence = traceSequence(ipaJob());
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaPrepareEnd, sequence);
+
 	buffer = unicam_[Unicam::Image].getBuffers().at(bayer & RPi::MaskID).buffer;
 	LOG(RPI, Debug) << "Input re-queue to ISP, buffer id " << (bayer & RPi::MaskID)
 			<< ", timestamp: " << buffer->metadata().timestamp;
 
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IspQueue, sequence);
 	isp_[Isp::Input].queueBuffer(buffer);
-	ispOutputCount_ = 0;
 
 	if (sensorMetadata_ && embeddedId) {
 		buffer = unicam_[Unicam::Embedded].getBuffers().at(embeddedId & RPi::MaskID).buffer;
@@ -979,16 +1017,14 @@ void Vc4CameraData::tryRunPipeline()
 	BayerFrame bayerFrame;
 
 	/* If any of our request or buffer queues are empty, we cannot proceed. */
-	if (state_ != State::Idle || requestQueue_.empty() ||
-	    bayerQueue_.empty() || (embeddedQueue_.empty() && sensorMetadata_))
+	Request *request = nextRequest();
+	if (!request || bayerQueue_.empty() ||
+	    (embeddedQueue_.empty() && sensorMetadata_))
 		return;
 
 	if (!findMatchingBuffers(bayerFrame, embeddedBuffer))
 		return;
 
-	/* Take the first request from the queue and action the IPA. */
-	Request *request = requestQueue_.front();
-
 	/* See if a new ScalerCrop value needs to be applied. */
 	applyScalerCrop(request->controls());
 
@@ -999,9 +1035,11 @@ void Vc4CameraData::tryRunPipeline()
 	 */
 	request->metadata().clear();
 	fillRequestMetadata(bayerFrame.controls, request);
+	/* Record when the frame was picked up for latency reporting. */
+	request->_d()->recordStage(Request::Private::Stage::BufferDequeue);
 
-	/* Set our state to say the pipeline is active. */
-	state_ = State::Busy;
+	/* Start a job to track the frame through the pipeline. */
+	startJob(request);
 
 	unsigned int bayer = unicam_[Unicam::Image].getBufferId(bayerFrame.buffer);
 
@@ -1024,6 +1062,7 @@ void Vc4CameraData::tryRunPipeline()
 				<< " Embedded buffer id: " << embeddedId;
 	}
 
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaPrepareBegin, params.ipaContext);
 	ipa_->prepareIsp(params);
 }
 
@@ -1032,6 +1071,15 @@ bool Vc4CameraData::findMatchingBuffers(BayerFrame &bayerFrame, FrameBuffer *&em
 	if (bayerQueue_.empty())
 		return false;
 
+	/* In low latency mode, skip to the most recent frame if possible. */
+	while (bayerQueue_.size() > 1 &&
+	       canSkipFrame(bayerQueue_.front().buffer, &unicam_[Unicam::Image])) {
+		unicam_[Unicam::Image].returnBuffer(bayerQueue_.front().buffer);
+		bayerQueue_.pop();
+		LOG(RPI, Debug) << "Skipping stale frame in stream "
+				<< unicam_[Unicam::Image].name();
+	}
+
 	/*
 	 * Find the embedded data buffer with a matching timestamp to pass to
 	 * the IPA. Any embedded buffers with a timestamp lower than the
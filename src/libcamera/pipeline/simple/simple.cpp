@@ -17,26 +17,34 @@
 #include <string.h>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include <linux/media-bus-format.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
+#include <libcamera/color_space.h>
 #include <libcamera/control_ids.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/configuration_cache.h"
 #include "libcamera/internal/converter.h"
 #include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/frame_start_monitor.h"
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/software_isp/software_isp.h"
+#include "libcamera/internal/tracepoints.h"
 #include "libcamera/internal/v4l2_subdevice.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
@@ -155,6 +163,12 @@ LOG_DEFINE_CATEGORY(SimplePipeline)
  * the capture video node, and stores the information in the outputFormats and
  * outputSizes of the SimpleCameraData::Configuration structure.
  *
+ * When the Software ISP is enabled along with a converter, raw capture formats
+ * that the converter can't process are debayered by the Software ISP to an
+ * intermediate format, which the converter then scales and converts. No
+ * platform enables this by default, the LIBCAMERA_SIMPLE_SOFTISP environment
+ * variable enables the Software ISP on platforms it isn't enabled for.
+ *
  * Concurrent Access to Cameras
  * ----------------------------
  *
@@ -190,7 +204,9 @@ struct SimplePipelineInfo {
 	/*
 	 * Using Software ISP is to be enabled per driver.
 	 *
-	 * The Software ISP can't be used together with the converters.
+	 * When used together with the converters, the Software ISP debayers
+	 * the raw frames to an intermediate format that the converters then
+	 * scale and convert to the requested output formats.
 	 */
 	bool swIspEnabled;
 };
@@ -226,6 +242,7 @@ public:
 			 V4L2Subdevice::Whence whence,
 			 Transform transform = Transform::Identity);
 	void bufferReady(FrameBuffer *buffer);
+	void frameStarted(uint32_t sequence);
 
 	unsigned int streamIndex(const Stream *stream) const
 	{
@@ -264,6 +281,12 @@ public:
 		Size captureSize;
 		std::vector<PixelFormat> outputFormats;
 		SizeRange outputSizes;
+		/*
+		 * The format and size output by the Software ISP to the
+		 * converters when the two are chained, invalid otherwise.
+		 */
+		PixelFormat swIspFormat;
+		Size swIspSize;
 	};
 
 	std::vector<Stream> streams_;
@@ -278,22 +301,57 @@ public:
 
 	std::vector<Configuration> configs_;
 	std::map<PixelFormat, std::vector<const Configuration *>> formats_;
+	/* Results of SimpleCameraConfiguration::validate() */
+	ConfigurationCache configCache_;
 
 	std::unique_ptr<DelayedControls> delayedCtrls_;
+	std::unique_ptr<FrameStartMonitor> frameStartMonitor_;
 
 	std::vector<std::unique_ptr<FrameBuffer>> conversionBuffers_;
 	std::queue<std::map<const Stream *, FrameBuffer *>> conversionQueue_;
+	/* Number of converters still using each input buffer */
+	std::map<FrameBuffer *, unsigned int> conversionInputs_;
 	bool useConversion_;
 
-	std::unique_ptr<Converter> converter_;
+	/*
+	 * Converter instances, each processing converterStreams_ consecutive
+	 * streams.
+	 */
+	std::vector<std::unique_ptr<Converter>> converters_;
+	/* Converters processing at least one stream of the configuration */
+	std::vector<Converter *> activeConverters_;
+	unsigned int converterStreams_;
 	std::unique_ptr<SoftwareIsp> swIsp_;
+	bool useSwIsp_;
+
+	/*
+	 * Intermediate buffers between the Software ISP and the converters,
+	 * when they are chained.
+	 */
+	Stream swIspStream_;
+	std::vector<std::unique_ptr<FrameBuffer>> swIspBuffers_;
+	std::queue<FrameBuffer *> swIspFreeBuffers_;
+	/* Output buffers of the frames being processed by the Software ISP */
+	std::queue<std::map<const Stream *, FrameBuffer *>> swIspJobs_;
+
+	Converter *converter(const Stream *stream) const
+	{
+		unsigned int index = stream - &streams_.front();
+		return converters_[index / converterStreams_].get();
+	}
 
 private:
 	void tryPipeline(unsigned int code, const Size &size);
 	static std::vector<const MediaPad *> routedSourcePads(MediaPad *sink);
 
+	void queueConversion(FrameBuffer *input,
+			     const std::map<const Stream *, FrameBuffer *> &outputs);
+	bool queueSwIspConversion(uint32_t frame, FrameBuffer *input,
+				  const std::map<const Stream *, FrameBuffer *> &outputs);
+	void releaseConversionInput(FrameBuffer *buffer);
 	void conversionInputDone(FrameBuffer *buffer);
 	void conversionOutputDone(FrameBuffer *buffer);
+	void swIspOutputDone(FrameBuffer *buffer);
 
 	void ispStatsReady(uint32_t frame, uint32_t bufferId);
 	void setSensorControls(const ControlList &sensorControls);
@@ -313,8 +371,11 @@ public:
 
 	bool needConversion() const { return needConversion_; }
 	const Transform &combinedTransform() const { return combinedTransform_; }
+	const Transform &ispTransform() const { return ispTransform_; }
 
 private:
+	Status validateConfiguration();
+
 	/*
 	 * The SimpleCameraData instance is guaranteed to be valid as long as
 	 * the corresponding Camera instance is valid. In order to borrow a
@@ -326,6 +387,7 @@ private:
 	const SimpleCameraData::Configuration *pipeConfig_;
 	bool needConversion_;
 	Transform combinedTransform_;
+	Transform ispTransform_;
 };
 
 class SimplePipelineHandler : public PipelineHandler
@@ -347,7 +409,8 @@ public:
 
 	V4L2VideoDevice *video(const MediaEntity *entity);
 	V4L2Subdevice *subdev(const MediaEntity *entity);
-	MediaDevice *converter() { return converter_; }
+	const std::vector<MediaDevice *> &converters() const { return converters_; }
+	unsigned int converterStreams() const { return converterStreams_; }
 	bool swIspEnabled() const { return swIspEnabled_; }
 
 protected:
@@ -375,7 +438,8 @@ private:
 
 	std::map<const MediaEntity *, EntityData> entities_;
 
-	MediaDevice *converter_;
+	std::vector<MediaDevice *> converters_;
+	unsigned int converterStreams_;
 	bool swIspEnabled_;
 };
 
@@ -386,7 +450,7 @@ private:
 SimpleCameraData::SimpleCameraData(SimplePipelineHandler *pipe,
 				   unsigned int numStreams,
 				   MediaEntity *sensor)
-	: Camera::Private(pipe), streams_(numStreams)
+	: Camera::Private(pipe), streams_(numStreams), converterStreams_(1)
 {
 	int ret;
 
@@ -512,24 +576,32 @@ int SimpleCameraData::init()
 	SimplePipelineHandler *pipe = SimpleCameraData::pipe();
 	int ret;
 
-	/* Open the converter, if any. */
-	MediaDevice *converter = pipe->converter();
-	if (converter) {
-		converter_ = ConverterFactoryBase::create(converter);
-		if (!converter_) {
+	/*
+	 * Open the converters, if any. Each converter instance processes its
+	 * own subset of the streams, allowing them to be converted in
+	 * parallel.
+	 */
+	converterStreams_ = pipe->converterStreams();
+	for (MediaDevice *converter : pipe->converters()) {
+		std::unique_ptr<Converter> conv = ConverterFactoryBase::create(converter);
+		if (!conv) {
 			LOG(SimplePipeline, Warning)
 				<< "Failed to create converter, disabling format conversion";
-			converter_.reset();
-		} else {
-			converter_->inputBufferReady.connect(this, &SimpleCameraData::conversionInputDone);
-			converter_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
+			converters_.clear();
+			break;
 		}
+
+		conv->inputBufferReady.connect(this, &SimpleCameraData::conversionInputDone);
+		conv->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
+		converters_.push_back(std::move(conv));
 	}
 
 	/*
-	 * Instantiate Soft ISP if this is enabled for the given driver and no converter is used.
+	 * Instantiate Soft ISP if this is enabled for the given driver. When
+	 * converters are also available, the Soft ISP is chained before them
+	 * for the raw formats they can't process.
 	 */
-	if (!converter_ && pipe->swIspEnabled()) {
+	if (pipe->swIspEnabled()) {
 		swIsp_ = std::make_unique<SoftwareIsp>(pipe, sensor_.get());
 		if (!swIsp_->isValid()) {
 			LOG(SimplePipeline, Warning)
@@ -551,7 +623,7 @@ int SimpleCameraData::init()
 			swIsp_->inputBufferReady.connect(pipe, [this](FrameBuffer *buffer) {
 				this->conversionInputDone(buffer);
 			});
-			swIsp_->outputBufferReady.connect(this, &SimpleCameraData::conversionOutputDone);
+			swIsp_->outputBufferReady.connect(this, &SimpleCameraData::swIspOutputDone);
 			swIsp_->ispStatsReady.connect(this, &SimpleCameraData::ispStatsReady);
 			swIsp_->setSensorControls.connect(this, &SimpleCameraData::setSensorControls);
 		}
@@ -647,11 +719,38 @@ void SimpleCameraData::tryPipeline(unsigned int code, const Size &size)
 		config.captureFormat = pixelFormat;
 		config.captureSize = format.size;
 
-		if (converter_) {
-			config.outputFormats = converter_->formats(pixelFormat);
-			config.outputSizes = converter_->sizes(format.size);
+		std::vector<PixelFormat> swIspFormats;
+		if (swIsp_)
+			swIspFormats = swIsp_->formats(pixelFormat);
+
+		if (!converters_.empty() && !swIspFormats.empty() &&
+		    converters_[0]->formats(pixelFormat).empty()) {
+			/*
+			 * When the converters can't process the captured
+			 * format, debayer with the Software ISP to the first of
+			 * its output formats accepted by the converters, which
+			 * then produce the output streams. The Software ISP
+			 * doesn't scale, use the largest size it can output.
+			 */
+			for (const PixelFormat &fmt : swIspFormats) {
+				if (!converters_[0]->formats(fmt).empty()) {
+					config.swIspFormat = fmt;
+					break;
+				}
+			}
+
+			config.swIspSize = swIsp_->sizes(pixelFormat, format.size).max;
+		}
+
+		if (config.swIspFormat.isValid() && !config.swIspSize.isNull()) {
+			config.outputFormats = converters_[0]->formats(config.swIspFormat);
+			config.outputSizes = converters_[0]->sizes(config.swIspSize);
+		} else if (!converters_.empty()) {
+			config.swIspFormat = PixelFormat();
+			config.outputFormats = converters_[0]->formats(pixelFormat);
+			config.outputSizes = converters_[0]->sizes(format.size);
 		} else if (swIsp_) {
-			config.outputFormats = swIsp_->formats(pixelFormat);
+			config.outputFormats = swIspFormats;
 			config.outputSizes = swIsp_->sizes(pixelFormat, format.size);
 			if (config.outputFormats.empty()) {
 				/* Do not use swIsp for unsupported pixelFormat's. */
@@ -826,13 +925,17 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 		return;
 	}
 
+	LIBCAMERA_TRACEPOINT_FRAME(pipe->name(), SensorDequeue,
+				   buffer->metadata().sequence);
+
 	/*
 	 * Record the sensor's timestamp in the request metadata. The request
 	 * needs to be obtained from the user-facing buffer, as internal
 	 * buffers are free-wheeling and have no request associated with them.
 	 *
 	 * \todo The sensor timestamp should be better estimated by connecting
-	 * to the V4L2Device::frameStart signal if the platform provides it.
+	 * to the FrameStartMonitor::frameStart signal if the platform provides
+	 * start of frame events.
 	 */
 	Request *request = buffer->request();
 
@@ -861,9 +964,20 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 			return;
 		}
 
-		if (converter_)
-			converter_->queueBuffers(buffer, conversionQueue_.front());
-		else
+		if (request)
+			LIBCAMERA_TRACEPOINT_FRAME(pipe->name(), IspQueue,
+						   request->sequence());
+
+		if (useSwIsp_ && !converters_.empty()) {
+			if (!queueSwIspConversion(request->sequence(), buffer,
+						  conversionQueue_.front())) {
+				/* Retry with the next frame. */
+				video_->queueBuffer(buffer);
+				return;
+			}
+		} else if (!converters_.empty()) {
+			queueConversion(buffer, conversionQueue_.front());
+		} else {
 			/*
 			 * request->sequence() cannot be retrieved from `buffer' inside
 			 * queueBuffers because unique_ptr's make buffer->request() invalid
@@ -871,6 +985,7 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 			 */
 			swIsp_->queueBuffers(request->sequence(), buffer,
 					     conversionQueue_.front());
+		}
 
 		conversionQueue_.pop();
 		return;
@@ -881,10 +996,90 @@ void SimpleCameraData::bufferReady(FrameBuffer *buffer)
 	pipe->completeRequest(request);
 }
 
+void SimpleCameraData::queueConversion(FrameBuffer *input,
+				       const std::map<const Stream *, FrameBuffer *> &outputs)
+{
+	/* Split the output buffers between the converters of their streams. */
+	std::map<Converter *, std::map<const Stream *, FrameBuffer *>> jobs;
+	for (const auto &[stream, buffer] : outputs)
+		jobs[converter(stream)].emplace(stream, buffer);
+
+	unsigned int queued = 0;
+	for (const auto &[conv, buffers] : jobs) {
+		if (conv->queueBuffers(input, buffers) < 0) {
+			LOG(SimplePipeline, Error)
+				<< "Failed to queue buffers to the converter";
+			continue;
+		}
+
+		queued++;
+	}
+
+	/*
+	 * The input buffer is queued back for capture once all the converters
+	 * are done with it.
+	 */
+	if (queued)
+		conversionInputs_[input] = queued;
+	else
+		releaseConversionInput(input);
+}
+
+/*
+ * Queue a captured frame to the Software ISP when it is chained with the
+ * converters. The output buffers are handed to the converters once the
+ * Software ISP has processed the frame to an intermediate buffer.
+ */
+bool SimpleCameraData::queueSwIspConversion(uint32_t frame, FrameBuffer *input,
+					    const std::map<const Stream *, FrameBuffer *> &outputs)
+{
+	if (swIspFreeBuffers_.empty()) {
+		LOG(SimplePipeline, Debug)
+			<< "No intermediate buffer available for frame " << frame;
+		return false;
+	}
+
+	FrameBuffer *buffer = swIspFreeBuffers_.front();
+	int ret = swIsp_->queueBuffers(frame, input, { { &swIspStream_, buffer } });
+	if (ret < 0) {
+		LOG(SimplePipeline, Error)
+			<< "Failed to queue buffers to the software ISP";
+		return false;
+	}
+
+	swIspFreeBuffers_.pop();
+	swIspJobs_.push(outputs);
+
+	return true;
+}
+
+void SimpleCameraData::releaseConversionInput(FrameBuffer *buffer)
+{
+	/*
+	 * Intermediate buffers are made available to the Software ISP again,
+	 * captured buffers are queued back for capture.
+	 */
+	auto it = std::find_if(swIspBuffers_.begin(), swIspBuffers_.end(),
+			       [buffer](const std::unique_ptr<FrameBuffer> &b) {
+				       return b.get() == buffer;
+			       });
+	if (it != swIspBuffers_.end())
+		swIspFreeBuffers_.push(buffer);
+	else
+		video_->queueBuffer(buffer);
+}
+
 void SimpleCameraData::conversionInputDone(FrameBuffer *buffer)
 {
-	/* Queue the input buffer back for capture. */
-	video_->queueBuffer(buffer);
+	auto it = conversionInputs_.find(buffer);
+	if (it != conversionInputs_.end()) {
+		if (--it->second)
+			return;
+
+		conversionInputs_.erase(it);
+	}
+
+	releaseConversionInput(buffer);
 }
 
 void SimpleCameraData::conversionOutputDone(FrameBuffer *buffer)
@@ -893,21 +1088,71 @@ void SimpleCameraData::conversionOutputDone(FrameBuffer *buffer)
 
 	/* Complete the buffer and the request. */
 	Request *request = buffer->request();
+	LIBCAMERA_TRACEPOINT_FRAME(pipe->name(), IspDequeue, request->sequence());
+
+	if (useSwIsp_)
+		request->metadata().set(controls::draft::ThrottleLevel,
+					swIsp_->throttleLevel());
+
 	if (pipe->completeBuffer(request, buffer))
 		pipe->completeRequest(request);
 }
 
+void SimpleCameraData::swIspOutputDone(FrameBuffer *buffer)
+{
+	SimplePipelineHandler *pipe = SimpleCameraData::pipe();
+
+	if (converters_.empty()) {
+		conversionOutputDone(buffer);
+		return;
+	}
+
+	/*
+	 * The Software ISP is chained with the converters, pass the
+	 * intermediate buffer to them along with the output buffers of the
+	 * frame, or complete the request if processing failed. Late frames
+	 * delivered after the camera has been stopped have no job anymore, and
+	 * are dropped.
+	 */
+	if (swIspJobs_.empty())
+		return;
+
+	std::map<const Stream *, FrameBuffer *> outputs = std::move(swIspJobs_.front());
+	swIspJobs_.pop();
+
+	if (buffer->metadata().status == FrameMetadata::FrameSuccess) {
+		queueConversion(buffer, outputs);
+		return;
+	}
+
+	swIspFreeBuffers_.push(buffer);
+
+	Request *request = nullptr;
+	for (auto &[stream, outputBuffer] : outputs) {
+		request = outputBuffer->request();
+		outputBuffer->_d()->cancel();
+		pipe->completeBuffer(request, outputBuffer);
+	}
+
+	if (request)
+		pipe->completeRequest(request);
+}
+
 void SimpleCameraData::ispStatsReady(uint32_t frame, uint32_t bufferId)
 {
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), IpaProcessBegin, frame);
 	swIsp_->processStats(frame, bufferId,
 			     delayedCtrls_->get(frame));
 }
 
+void SimpleCameraData::frameStarted(uint32_t sequence)
+{
+	LIBCAMERA_TRACEPOINT_FRAME(pipe()->name(), StartOfFrame, sequence);
+}
+
 void SimpleCameraData::setSensorControls(const ControlList &sensorControls)
 {
 	delayedCtrls_->push(sensorControls);
-	ControlList ctrls(sensorControls);
-	sensor_->setControls(&ctrls);
 }
 
 /* Retrieve all source pads connected to a sink pad through active routes. */
@@ -986,6 +1231,40 @@ static Size adjustSize(const Size &requestedSize, const SizeRange &supportedSize
 } /* namespace */
 
 CameraConfiguration::Status SimpleCameraConfiguration::validate()
+{
+	ConfigurationCache::Key key(*this);
+	Status status;
+
+	/* Skip the pipeline configuration search for known configurations. */
+	std::shared_ptr<const CameraConfiguration> cached =
+		data_->configCache_.lookup(key, &status);
+	if (cached) {
+		const SimpleCameraConfiguration *config =
+			static_cast<const SimpleCameraConfiguration *>(cached.get());
+
+		ConfigurationCache::restore(*config, this, &config_);
+		pipeConfig_ = config->pipeConfig_;
+		needConversion_ = config->needConversion_;
+		combinedTransform_ = config->combinedTransform_;
+		ispTransform_ = config->ispTransform_;
+
+		return status;
+	}
+
+	status = validateConfiguration();
+
+	/*
+	 * The cache is owned by the camera data, don't let the copy keep a
+	 * reference to the camera.
+	 */
+	auto config = std::make_unique<SimpleCameraConfiguration>(*this);
+	config->camera_.reset();
+	data_->configCache_.insert(std::move(key), std::move(config), status);
+
+	return status;
+}
+
+CameraConfiguration::Status SimpleCameraConfiguration::validateConfiguration()
 {
 	const CameraSensor *sensor = data_->sensor_.get();
 	Status status = Valid;
@@ -995,19 +1274,48 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 
 	Orientation requestedOrientation = orientation;
 	combinedTransform_ = sensor->computeTransform(&orientation);
-	if (orientation != requestedOrientation)
-		status = Adjusted;
 
-	/* Cap the number of entries to the available streams. */
-	if (config_.size() > data_->streams_.size()) {
-		config_.resize(data_->streams_.size());
+	/*
+	 * Cap the number of entries to the available streams. Without
+	 * converters, multiple streams are produced by the software ISP.
+	 */
+	const bool swIspStreams = data_->swIsp_ && data_->converters_.empty();
+	unsigned int maxStreams = data_->streams_.size();
+	if (data_->converters_.empty())
+		maxStreams = std::min(maxStreams,
+				      swIspStreams ? data_->swIsp_->maxOutputs() : 1U);
+
+	if (config_.size() > maxStreams) {
+		config_.resize(maxStreams);
 		status = Adjusted;
 	}
 
+	/*
+	 * When the software ISP produces the stream on its own, it applies the
+	 * part of the requested orientation that the sensor can't, including
+	 * transpositions, while writing the output frames.
+	 */
+	const Transform residualTransform = requestedOrientation / orientation;
+	auto ispTransform = [&](const PixelFormat &pixelFormat) {
+		if (residualTransform == Transform::Identity || !data_->swIsp_ ||
+		    !data_->converters_.empty() || config_.size() != 1 ||
+		    !data_->swIsp_->supportsTransform(pixelFormat, residualTransform))
+			return Transform::Identity;
+
+		return residualTransform;
+	};
+
+	/* Sizes are matched before transposition by the software ISP. */
+	auto debayeredSize = [](const Size &size, Transform transform) {
+		return !!(transform & Transform::Transpose)
+			       ? Size(size.height, size.width)
+			       : size;
+	};
+
 	/* Find the largest stream size. */
 	Size maxStreamSize;
 	for (const StreamConfiguration &cfg : config_)
-		maxStreamSize.expandTo(cfg.size);
+		maxStreamSize.expandTo(debayeredSize(cfg.size, ispTransform(cfg.pixelFormat)));
 
 	LOG(SimplePipeline, Debug)
 		<< "Largest stream size is " << maxStreamSize;
@@ -1082,6 +1390,7 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 	 * left as a future improvement.
 	 */
 	needConversion_ = config_.size() > 1;
+	ispTransform_ = Transform::Identity;
 
 	for (unsigned int i = 0; i < config_.size(); ++i) {
 		StreamConfiguration &cfg = config_[i];
@@ -1100,7 +1409,44 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 			status = Adjusted;
 		}
 
-		if (!pipeConfig_->outputSizes.contains(cfg.size)) {
+		/* Only the stream captured through the software ISP is set. */
+		ispTransform_ = ispTransform(cfg.pixelFormat);
+
+		Size size = debayeredSize(cfg.size, ispTransform_);
+		if (i > 0 && swIspStreams) {
+			/*
+			 * The software ISP produces the other streams from the
+			 * pixels of the first one, in the same pass.
+			 */
+			auto secondarySize = [&](const PixelFormat &format) {
+				return data_->swIsp_->secondarySize(format, config_[0].size,
+								    cfg.size);
+			};
+
+			if (secondarySize(cfg.pixelFormat).isNull()) {
+				auto format = std::find_if(pipeConfig_->outputFormats.begin(),
+							   pipeConfig_->outputFormats.end(),
+							   [&](const PixelFormat &f) {
+								   return !secondarySize(f).isNull();
+							   });
+				if (format == pipeConfig_->outputFormats.end())
+					return Invalid;
+
+				LOG(SimplePipeline, Debug)
+					<< "Adjusting pixel format of stream " << i;
+				cfg.pixelFormat = *format;
+				status = Adjusted;
+			}
+
+			Size adjustedSize = secondarySize(cfg.pixelFormat);
+			if (cfg.size != adjustedSize) {
+				LOG(SimplePipeline, Debug)
+					<< "Adjusting size of stream " << i << " from "
+					<< cfg.size << " to " << adjustedSize;
+				cfg.size = adjustedSize;
+				status = Adjusted;
+			}
+		} else if (!pipeConfig_->outputSizes.contains(size)) {
 			Size adjustedSize = pipeConfig_->captureSize;
 			/*
 			 * The converter (when present) may not be able to output
@@ -1109,7 +1455,8 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 			 * the smaller valid output size closest to the requested.
 			 */
 			if (!pipeConfig_->outputSizes.contains(adjustedSize))
-				adjustedSize = adjustSize(cfg.size, pipeConfig_->outputSizes);
+				adjustedSize = adjustSize(size, pipeConfig_->outputSizes);
+			adjustedSize = debayeredSize(adjustedSize, ispTransform_);
 			LOG(SimplePipeline, Debug)
 				<< "Adjusting size from " << cfg.size
 				<< " to " << adjustedSize;
@@ -1119,19 +1466,30 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 
 		/* \todo Create a libcamera core class to group format and size */
 		if (cfg.pixelFormat != pipeConfig_->captureFormat ||
-		    cfg.size != pipeConfig_->captureSize)
+		    cfg.size != pipeConfig_->captureSize ||
+		    ispTransform_ != Transform::Identity)
 			needConversion_ = true;
 
 		/* Set the stride, frameSize and bufferCount. */
 		if (needConversion_) {
 			std::tie(cfg.stride, cfg.frameSize) =
-				data_->converter_
-					? data_->converter_->strideAndFrameSize(cfg.pixelFormat,
-										cfg.size)
+				!data_->converters_.empty()
+					? data_->converters_[0]->strideAndFrameSize(cfg.pixelFormat,
+										    cfg.size)
 					: data_->swIsp_->strideAndFrameSize(cfg.pixelFormat,
 									    cfg.size);
 			if (cfg.stride == 0)
 				return Invalid;
+
+			/* The software ISP converts to YUV with the stream colour space */
+			const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+			if (data_->swIsp_ && data_->converters_.empty() &&
+			    info.colourEncoding == PixelFormatInfo::ColourEncodingYUV) {
+				if (!cfg.colorSpace)
+					cfg.colorSpace = ColorSpace::Sycc;
+				if (cfg.colorSpace->adjust(cfg.pixelFormat))
+					status = Adjusted;
+			}
 		} else {
 			V4L2DeviceFormat format;
 			format.fourcc = data_->video_->toV4L2PixelFormat(cfg.pixelFormat);
@@ -1148,6 +1506,11 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
 		cfg.bufferCount = 4;
 	}
 
+	if (ispTransform_ != Transform::Identity)
+		orientation = requestedOrientation;
+	else if (orientation != requestedOrientation)
+		status = Adjusted;
+
 	return status;
 }
 
@@ -1156,7 +1519,7 @@ CameraConfiguration::Status SimpleCameraConfiguration::validate()
  */
 
 SimplePipelineHandler::SimplePipelineHandler(CameraManager *manager)
-	: PipelineHandler(manager), converter_(nullptr)
+	: PipelineHandler(manager), converterStreams_(1)
 {
 }
 
@@ -1273,6 +1636,8 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 	/* Configure the converter if needed. */
 	std::vector<std::reference_wrapper<StreamConfiguration>> outputCfgs;
 	data->useConversion_ = config->needConversion();
+	data->useSwIsp_ = data->useConversion_ && data->swIsp_ &&
+			  (data->converters_.empty() || pipeConfig->swIspFormat.isValid());
 
 	for (unsigned int i = 0; i < config->size(); ++i) {
 		StreamConfiguration &cfg = config->at(i);
@@ -1283,6 +1648,8 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 			outputCfgs.push_back(cfg);
 	}
 
+	data->frameStartMonitor_.reset();
+
 	if (outputCfgs.empty())
 		return 0;
 
@@ -1293,8 +1660,24 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 	data->delayedCtrls_ =
 		std::make_unique<DelayedControls>(data->sensor_->device(),
 						  params);
-	data->video_->frameStart.connect(data->delayedCtrls_.get(),
-					 &DelayedControls::applyControls);
+
+	/*
+	 * Take the start of frame events from the first entity of the pipeline
+	 * that emits them, or synthesize them from the captured buffers.
+	 */
+	std::vector<V4L2Device *> devices;
+	for (const SimpleCameraData::Entity &e : data->entities_) {
+		V4L2Subdevice *sd = subdev(e.entity);
+		if (sd)
+			devices.push_back(sd);
+	}
+	devices.push_back(data->video_);
+
+	data->frameStartMonitor_ =
+		std::make_unique<FrameStartMonitor>(devices, data->video_);
+	data->frameStartMonitor_->frameStart.connect(data->delayedCtrls_.get(),
+						     &DelayedControls::applyControls);
+	data->frameStartMonitor_->frameStart.connect(data, &SimpleCameraData::frameStarted);
 
 	StreamConfiguration inputCfg;
 	inputCfg.pixelFormat = pipeConfig->captureFormat;
@@ -1302,12 +1685,53 @@ int SimplePipelineHandler::configure(Camera *camera, CameraConfiguration *c)
 	inputCfg.stride = captureFormat.planes[0].bpl;
 	inputCfg.bufferCount = kNumInternalBuffers;
 
-	if (data->converter_) {
-		return data->converter_->configure(inputCfg, outputCfgs);
+	if (!data->converters_.empty()) {
+		if (data->useSwIsp_) {
+			/*
+			 * Configure the Software ISP to output to intermediate
+			 * buffers, which are then the input of the converters.
+			 */
+			StreamConfiguration swIspCfg;
+			swIspCfg.pixelFormat = pipeConfig->swIspFormat;
+			swIspCfg.size = pipeConfig->swIspSize;
+			std::tie(swIspCfg.stride, swIspCfg.frameSize) =
+				data->swIsp_->strideAndFrameSize(swIspCfg.pixelFormat,
+								 swIspCfg.size);
+			swIspCfg.bufferCount = kNumInternalBuffers;
+			swIspCfg.setStream(&data->swIspStream_);
+
+			ipa::soft::IPAConfigInfo configInfo;
+			configInfo.sensorControls = data->sensor_->controls();
+			std::vector<std::reference_wrapper<StreamConfiguration>> swIspCfgs = { swIspCfg };
+			ret = data->swIsp_->configure(inputCfg, swIspCfgs, configInfo);
+			if (ret)
+				return ret;
+
+			inputCfg.pixelFormat = swIspCfg.pixelFormat;
+			inputCfg.size = swIspCfg.size;
+			inputCfg.stride = swIspCfg.stride;
+		}
+
+		/* Configure each converter with the outputs of its streams. */
+		std::map<Converter *, std::vector<std::reference_wrapper<StreamConfiguration>>> converterCfgs;
+		for (StreamConfiguration &cfg : outputCfgs)
+			converterCfgs[data->converter(cfg.stream())].push_back(cfg);
+
+		data->activeConverters_.clear();
+		for (auto &[converter, cfgs] : converterCfgs) {
+			ret = converter->configure(inputCfg, cfgs);
+			if (ret)
+				return ret;
+
+			data->activeConverters_.push_back(converter);
+		}
+
+		return 0;
 	} else {
 		ipa::soft::IPAConfigInfo configInfo;
 		configInfo.sensorControls = data->sensor_->controls();
-		return data->swIsp_->configure(inputCfg, outputCfgs, configInfo);
+		return data->swIsp_->configure(inputCfg, outputCfgs, configInfo,
+					       config->ispTransform());
 	}
 }
 
@@ -1322,8 +1746,8 @@ int SimplePipelineHandler::exportFrameBuffers(Camera *camera, Stream *stream,
 	 * whether the converter is used or not.
 	 */
 	if (data->useConversion_)
-		return data->converter_
-			       ? data->converter_->exportBuffers(stream, count, buffers)
+		return !data->converters_.empty()
+			       ? data->converter(stream)->exportBuffers(stream, count, buffers)
 			       : data->swIsp_->exportBuffers(stream, count, buffers);
 	else
 		return data->video_->exportBuffers(count, buffers);
@@ -1362,6 +1786,16 @@ int SimplePipelineHandler::start(Camera *camera, [[maybe_unused]] const ControlL
 
 	video->bufferReady.connect(data, &SimpleCameraData::bufferReady);
 
+	if (data->frameStartMonitor_) {
+		data->delayedCtrls_->reset();
+
+		ret = data->frameStartMonitor_->start();
+		if (ret < 0) {
+			stop(camera);
+			return ret;
+		}
+	}
+
 	ret = video->streamOn();
 	if (ret < 0) {
 		stop(camera);
@@ -1369,12 +1803,29 @@ int SimplePipelineHandler::start(Camera *camera, [[maybe_unused]] const ControlL
 	}
 
 	if (data->useConversion_) {
-		if (data->converter_)
-			ret = data->converter_->start();
-		else if (data->swIsp_)
+		ret = 0;
+		if (data->useSwIsp_ && !data->converters_.empty()) {
+			/* Allocate the intermediate buffers of the chain. */
+			ret = data->swIsp_->exportBuffers(&data->swIspStream_,
+							  kNumInternalBuffers,
+							  &data->swIspBuffers_);
+			if (ret >= 0) {
+				for (std::unique_ptr<FrameBuffer> &buffer : data->swIspBuffers_)
+					data->swIspFreeBuffers_.push(buffer.get());
+				ret = 0;
+			}
+		}
+
+		if (ret == 0 && data->useSwIsp_)
 			ret = data->swIsp_->start();
-		else
-			ret = 0;
+
+		if (ret == 0 && !data->converters_.empty()) {
+			for (Converter *converter : data->activeConverters_) {
+				ret = converter->start();
+				if (ret < 0)
+					break;
+			}
+		}
 
 		if (ret < 0) {
 			stop(camera);
@@ -1395,18 +1846,41 @@ void SimplePipelineHandler::stopDevice(Camera *camera)
 	V4L2VideoDevice *video = data->video_;
 
 	if (data->useConversion_) {
-		if (data->converter_)
-			data->converter_->stop();
-		else if (data->swIsp_)
+		if (data->useSwIsp_)
 			data->swIsp_->stop();
+
+		if (!data->converters_.empty()) {
+			for (Converter *converter : data->activeConverters_)
+				converter->stop();
+		}
 	}
 
 	video->streamOff();
 	video->releaseBuffers();
 
+	if (data->frameStartMonitor_)
+		data->frameStartMonitor_->stop();
+
 	video->bufferReady.disconnect(data, &SimpleCameraData::bufferReady);
 
+	/* Cancel the frames that didn't reach the converters. */
+	while (!data->swIspJobs_.empty()) {
+		Request *request = nullptr;
+		for (auto &[stream, buffer] : data->swIspJobs_.front()) {
+			request = buffer->request();
+			buffer->_d()->cancel();
+			completeBuffer(request, buffer);
+		}
+		data->swIspJobs_.pop();
+
+		if (request)
+			completeRequest(request);
+	}
+
 	data->conversionBuffers_.clear();
+	data->conversionInputs_.clear();
+	data->swIspFreeBuffers_ = {};
+	data->swIspBuffers_.clear();
 
 	releasePipeline(data);
 }
@@ -1435,7 +1909,7 @@ int SimplePipelineHandler::queueRequestDevice(Camera *camera, Request *request)
 
 	if (data->useConversion_) {
 		data->conversionQueue_.push(std::move(buffers));
-		if (data->swIsp_)
+		if (data->useSwIsp_)
 			data->swIsp_->queueRequest(request->sequence(), request->controls());
 	}
 
@@ -1557,17 +2031,32 @@ bool SimplePipelineHandler::match(DeviceEnumerator *enumerator)
 	if (!media)
 		return false;
 
+	/*
+	 * Acquire all instances of the first available converter. Each
+	 * instance processes a subset of the streams.
+	 */
 	for (const auto &[name, streams] : info->converters) {
 		DeviceMatch converterMatch(name);
-		converter_ = acquireMediaDevice(enumerator, converterMatch);
-		if (converter_) {
-			numStreams = streams;
+		while (MediaDevice *converter = acquireMediaDevice(enumerator, converterMatch))
+			converters_.push_back(converter);
+
+		if (!converters_.empty()) {
+			converterStreams_ = streams;
+			numStreams = streams * converters_.size();
 			break;
 		}
 	}
 
 	swIspEnabled_ = info->swIspEnabled;
 
+	const char *swIsp = utils::secure_getenv("LIBCAMERA_SIMPLE_SOFTISP");
+	if (swIsp)
+		swIspEnabled_ = strcmp(swIsp, "0") != 0;
+
+	/* Without converters, the software ISP may produce multiple streams. */
+	if (converters_.empty() && swIspEnabled_)
+		numStreams = SoftwareIsp::kMaxOutputs;
+
 	/* Locate the sensors. */
 	std::vector<MediaEntity *> sensors = locateSensors(media);
 	if (sensors.empty()) {
@@ -0,0 +1,417 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Multi-threaded MJPEG decoder for uvcvideo devices
+ */
+
+#include "mjpeg_decoder.h"
+
+#include <algorithm>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include <jpeglib.h>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(UVC)
+
+/*
+ * Each worker decodes complete frames with its own libjpeg instance, in its
+ * own thread. Frames are distributed to the workers in turn, which lets
+ * several frames be decoded concurrently.
+ */
+class MjpegDecoder::Worker : public Object
+{
+public:
+	Worker();
+	~Worker();
+
+	int configure(const PixelFormat &format, const Size &size);
+	void decode(unsigned int cookie, FrameBuffer *input, FrameBuffer *output);
+	void stop();
+
+	Signal<unsigned int> decoded;
+
+private:
+	struct ErrorManager {
+		struct jpeg_error_mgr pub;
+		jmp_buf escape;
+	};
+
+	static void errorExit(j_common_ptr cinfo);
+	static void outputMessage(j_common_ptr cinfo);
+
+	int decompress(FrameBuffer *input, FrameBuffer *output);
+	void writeChroma(uint8_t *cb, uint8_t *cr, const JSAMPROW *cbRows,
+			 const JSAMPROW *crRows, unsigned int linesPerPass) const;
+
+	struct jpeg_decompress_struct cinfo_;
+	ErrorManager error_;
+
+	Size size_;
+	bool semiPlanar_;
+	std::vector<unsigned int> planeSizes_;
+	std::vector<unsigned int> strides_;
+
+	/* Lines decoded by libjpeg, padded to the JPEG block size */
+	std::vector<uint8_t> lines_[3];
+	std::vector<JSAMPROW> rows_[3];
+
+	MappedFrameBufferCache inputMaps_;
+	MappedFrameBufferCache outputMaps_;
+};
+
+MjpegDecoder::Worker::Worker()
+	: semiPlanar_(false), inputMaps_(MappedFrameBuffer::MapFlag::Read),
+	  outputMaps_(MappedFrameBuffer::MapFlag::Write)
+{
+	cinfo_.err = jpeg_std_error(&error_.pub);
+	error_.pub.error_exit = &Worker::errorExit;
+	error_.pub.output_message = &Worker::outputMessage;
+
+	jpeg_create_decompress(&cinfo_);
+}
+
+MjpegDecoder::Worker::~Worker()
+{
+	jpeg_destroy_decompress(&cinfo_);
+}
+
+void MjpegDecoder::Worker::errorExit(j_common_ptr cinfo)
+{
+	ErrorManager *error = reinterpret_cast<ErrorManager *>(cinfo->err);
+
+	(*cinfo->err->output_message)(cinfo);
+	longjmp(error->escape, 1);
+}
+
+void MjpegDecoder::Worker::outputMessage(j_common_ptr cinfo)
+{
+	char message[JMSG_LENGTH_MAX];
+
+	(*cinfo->err->format_message)(cinfo, message);
+	LOG(UVC, Debug) << "libjpeg: " << message;
+}
+
+int MjpegDecoder::Worker::configure(const PixelFormat &format, const Size &size)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(format);
+
+	size_ = size;
+	semiPlanar_ = format == formats::NV12;
+	planeSizes_ = MjpegDecoder::planeSizes(format, size);
+
+	strides_.clear();
+	for (unsigned int i = 0; i < planeSizes_.size(); i++)
+		strides_.push_back(info.stride(size.width, i, 1));
+
+	return 0;
+}
+
+void MjpegDecoder::Worker::decode(unsigned int cookie, FrameBuffer *input,
+				  FrameBuffer *output)
+{
+	FrameMetadata &metadata = output->_d()->metadata();
+	metadata.status = input->metadata().status;
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+
+	if (metadata.status == FrameMetadata::FrameSuccess &&
+	    decompress(input, output) < 0)
+		metadata.status = FrameMetadata::FrameError;
+
+	decoded.emit(cookie);
+}
+
+void MjpegDecoder::Worker::stop()
+{
+	inputMaps_.clear();
+	outputMaps_.clear();
+}
+
+int MjpegDecoder::Worker::decompress(FrameBuffer *input, FrameBuffer *output)
+{
+	const MappedFrameBuffer *inMap = inputMaps_.map(input);
+	const MappedFrameBuffer *outMap = outputMaps_.map(output);
+	if (!inMap || !outMap) {
+		LOG(UVC, Error) << "Failed to map the MJPEG decoder buffers";
+		return -EINVAL;
+	}
+
+	MappedFrameBuffer::SyncScope inSync = inMap->syncScope();
+	MappedFrameBuffer::SyncScope outSync = outMap->syncScope();
+
+	const Span<uint8_t> src = inMap->planes()[0];
+	unsigned long length = std::min<unsigned long>(input->metadata().planes()[0].bytesused,
+						       src.size());
+
+	/* Buffers exported by the pipeline handler have one plane per YUV plane */
+	uint8_t *planes[3];
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < planeSizes_.size(); i++) {
+		planes[i] = outMap->planes().size() > i
+				    ? outMap->planes()[i].data()
+				    : outMap->planes()[0].data() + offset;
+		offset += planeSizes_[i];
+	}
+
+	if (setjmp(error_.escape)) {
+		jpeg_abort_decompress(&cinfo_);
+		return -EINVAL;
+	}
+
+	jpeg_mem_src(&cinfo_, src.data(), length);
+	jpeg_read_header(&cinfo_, TRUE);
+
+	/*
+	 * Decode the raw YCbCr components, skipping the upsampling and colour
+	 * conversion. Only the 4:2:2 and 4:2:0 subsamplings used by UVC
+	 * cameras are supported, the chroma components are then output at
+	 * half the luma resolution in both directions.
+	 */
+	const jpeg_component_info *comp = cinfo_.comp_info;
+	if (cinfo_.image_width != size_.width ||
+	    cinfo_.image_height != size_.height ||
+	    cinfo_.num_components != 3 ||
+	    comp[0].h_samp_factor != 2 || comp[0].v_samp_factor > 2 ||
+	    comp[1].h_samp_factor != 1 || comp[1].v_samp_factor != 1 ||
+	    comp[2].h_samp_factor != 1 || comp[2].v_samp_factor != 1) {
+		LOG(UVC, Error)
+			<< "Unsupported MJPEG frame "
+			<< Size(cinfo_.image_width, cinfo_.image_height)
+			<< " with " << cinfo_.num_components << " components";
+		jpeg_abort_decompress(&cinfo_);
+		return -EINVAL;
+	}
+
+	cinfo_.out_color_space = JCS_YCbCr;
+	cinfo_.raw_data_out = TRUE;
+	cinfo_.do_fancy_upsampling = FALSE;
+	cinfo_.dct_method = JDCT_IFAST;
+
+	jpeg_start_decompress(&cinfo_);
+
+	const unsigned int linesPerPass = cinfo_.max_v_samp_factor * DCTSIZE;
+	const unsigned int chromaHeight = planeSizes_[1] / strides_[1];
+	JSAMPARRAY rows[3];
+
+	for (unsigned int i = 0; i < 3; i++) {
+		unsigned int width = comp[i].width_in_blocks * DCTSIZE;
+		unsigned int lines = comp[i].v_samp_factor * DCTSIZE;
+
+		lines_[i].resize(width * lines);
+		rows_[i].resize(lines);
+		for (unsigned int j = 0; j < lines; j++)
+			rows_[i][j] = lines_[i].data() + j * width;
+
+		rows[i] = rows_[i].data();
+	}
+
+	while (cinfo_.output_scanline < cinfo_.output_height) {
+		unsigned int row = cinfo_.output_scanline;
+
+		if (!jpeg_read_raw_data(&cinfo_, rows, linesPerPass))
+			break;
+
+		unsigned int lines = std::min(linesPerPass, size_.height - row);
+		for (unsigned int i = 0; i < lines; i++)
+			memcpy(planes[0] + (row + i) * strides_[0], rows[0][i],
+			       size_.width);
+
+		/*
+		 * With 4:2:2 subsampling, each pass decodes two chroma lines
+		 * per output chroma line, average them.
+		 */
+		unsigned int chromaLines = std::min((lines + 1) / 2,
+						    chromaHeight - row / 2);
+		for (unsigned int i = 0; i < chromaLines; i++) {
+			unsigned int line = row / 2 + i;
+			unsigned int index = linesPerPass == DCTSIZE ? i * 2 : i;
+
+			if (semiPlanar_) {
+				uint8_t *dst = planes[1] + line * strides_[1];
+				writeChroma(dst, dst + 1, &rows[1][index],
+					    &rows[2][index], linesPerPass);
+			} else {
+				writeChroma(planes[1] + line * strides_[1],
+					    planes[2] + line * strides_[2],
+					    &rows[1][index], &rows[2][index],
+					    linesPerPass);
+			}
+		}
+	}
+
+	jpeg_finish_decompress(&cinfo_);
+
+	for (unsigned int i = 0; i < output->planes().size(); i++)
+		output->_d()->metadata().planes()[i].bytesused =
+			output->planes()[i].length;
+
+	return 0;
+}
+
+void MjpegDecoder::Worker::writeChroma(uint8_t *cb, uint8_t *cr,
+				       const JSAMPROW *cbRows,
+				       const JSAMPROW *crRows,
+				       unsigned int linesPerPass) const
+{
+	const unsigned int width = (size_.width + 1) / 2;
+	const unsigned int step = semiPlanar_ ? 2 : 1;
+
+	if (linesPerPass != DCTSIZE) {
+		/* 4:2:0, the chroma lines are output as-is. */
+		for (unsigned int x = 0; x < width; x++) {
+			cb[x * step] = cbRows[0][x];
+			cr[x * step] = crRows[0][x];
+		}
+		return;
+	}
+
+	for (unsigned int x = 0; x < width; x++) {
+		cb[x * step] = (cbRows[0][x] + cbRows[1][x] + 1) / 2;
+		cr[x * step] = (crRows[0][x] + crRows[1][x] + 1) / 2;
+	}
+}
+
+/*
+ * The MjpegDecoder distributes the frames to the workers and delivers the
+ * decoded frames in the order they have been queued, regardless of which
+ * worker completes first.
+ */
+MjpegDecoder::MjpegDecoder(unsigned int numThreads)
+	: nextWorker_(0), nextCookie_(0)
+{
+	for (unsigned int i = 0; i < std::max(numThreads, 1U); i++) {
+		threads_.push_back(std::make_unique<Thread>("MjpegDecoder" + std::to_string(i)));
+		workers_.push_back(std::make_unique<Worker>());
+
+		workers_.back()->decoded.connect(this, &MjpegDecoder::jobDone);
+		workers_.back()->moveToThread(threads_.back().get());
+	}
+}
+
+MjpegDecoder::~MjpegDecoder()
+{
+	stop();
+}
+
+/* Pixel formats the decoder can output */
+const std::vector<PixelFormat> &MjpegDecoder::formats()
+{
+	static const std::vector<PixelFormat> formats = {
+		formats::NV12,
+		formats::YUV420,
+	};
+
+	return formats;
+}
+
+std::vector<unsigned int> MjpegDecoder::planeSizes(const PixelFormat &format,
+						   const Size &size)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(format);
+	std::vector<unsigned int> sizes;
+
+	for (unsigned int i = 0; i < info.numPlanes(); i++)
+		sizes.push_back(info.planeSize(size, i, 1));
+
+	return sizes;
+}
+
+int MjpegDecoder::configure(const PixelFormat &format, const Size &size)
+{
+	const std::vector<PixelFormat> &supported = formats();
+	if (std::find(supported.begin(), supported.end(), format) == supported.end()) {
+		LOG(UVC, Error) << "MJPEG decoding to " << format << " not supported";
+		return -EINVAL;
+	}
+
+	/* The workers are not running yet, configure them directly. */
+	for (std::unique_ptr<Worker> &worker : workers_) {
+		int ret = worker->configure(format, size);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+void MjpegDecoder::start()
+{
+	for (std::unique_ptr<Thread> &thread : threads_)
+		thread->start();
+}
+
+void MjpegDecoder::stop()
+{
+	for (unsigned int i = 0; i < threads_.size(); i++) {
+		if (!threads_[i]->isRunning())
+			continue;
+
+		workers_[i]->invokeMethod(&Worker::stop, ConnectionTypeBlocking);
+		threads_[i]->exit();
+		threads_[i]->wait();
+	}
+
+	/*
+	 * Return the buffers of all the frames not delivered yet. Completion
+	 * notifications still in flight are ignored, as their cookie doesn't
+	 * match any job anymore.
+	 */
+	while (!jobs_.empty()) {
+		Job job = jobs_.front();
+		jobs_.pop_front();
+
+		if (!job.done)
+			job.output->_d()->cancel();
+
+		inputBufferReady.emit(job.input);
+		outputBufferReady.emit(job.output);
+	}
+}
+
+void MjpegDecoder::queueBuffers(FrameBuffer *input, FrameBuffer *output)
+{
+	unsigned int cookie = nextCookie_++;
+	jobs_.push_back({ cookie, input, output, false });
+
+	Worker *worker = workers_[nextWorker_].get();
+	nextWorker_ = (nextWorker_ + 1) % workers_.size();
+
+	worker->invokeMethod(&Worker::decode, ConnectionTypeQueued,
+			     cookie, input, output);
+}
+
+void MjpegDecoder::jobDone(unsigned int cookie)
+{
+	auto it = std::find_if(jobs_.begin(), jobs_.end(),
+			       [cookie](const Job &job) { return job.cookie == cookie; });
+	if (it == jobs_.end())
+		return;
+
+	it->done = true;
+
+	/* Deliver the frames in order, up to the first one still decoding. */
+	while (!jobs_.empty() && jobs_.front().done) {
+		Job job = jobs_.front();
+		jobs_.pop_front();
+
+		inputBufferReady.emit(job.input);
+		outputBufferReady.emit(job.output);
+	}
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * Multi-threaded MJPEG decoder for uvcvideo devices
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/object.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/thread.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+
+namespace libcamera {
+
+class FrameBuffer;
+
+class MjpegDecoder : public Object
+{
+public:
+	MjpegDecoder(unsigned int numThreads);
+	~MjpegDecoder();
+
+	static const std::vector<PixelFormat> &formats();
+	static std::vector<unsigned int> planeSizes(const PixelFormat &format,
+						    const Size &size);
+
+	unsigned int numThreads() const { return threads_.size(); }
+
+	int configure(const PixelFormat &format, const Size &size);
+	void start();
+	void stop();
+
+	void queueBuffers(FrameBuffer *input, FrameBuffer *output);
+
+	Signal<FrameBuffer *> inputBufferReady;
+	Signal<FrameBuffer *> outputBufferReady;
+
+private:
+	class Worker;
+
+	struct Job {
+		unsigned int cookie;
+		FrameBuffer *input;
+		FrameBuffer *output;
+		bool done;
+	};
+
+	void jobDone(unsigned int cookie);
+
+	std::vector<std::unique_ptr<Thread>> threads_;
+	std::vector<std::unique_ptr<Worker>> workers_;
+	unsigned int nextWorker_;
+	unsigned int nextCookie_;
+
+	/* Jobs being decoded, in the order the frames have been queued */
+	std::deque<Job> jobs_;
+};
+
+} /* namespace libcamera */
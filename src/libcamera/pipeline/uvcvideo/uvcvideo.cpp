@@ -10,8 +10,11 @@
 #include <fstream>
 #include <map>
 #include <memory>
+#include <optional>
+#include <queue>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <libcamera/base/log.h>
@@ -19,19 +22,28 @@
 #include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
+#include <libcamera/color_space.h>
 #include <libcamera/control_ids.h>
 #include <libcamera/controls.h>
+#include <libcamera/formats.h>
 #include <libcamera/property_ids.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
 #include "libcamera/internal/camera.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/pipeline_handler.h"
 #include "libcamera/internal/sysfs.h"
 #include "libcamera/internal/v4l2_videodevice.h"
 
+#ifdef HAVE_LIBJPEG
+#include "mjpeg_decoder.h"
+#endif
+
 namespace libcamera {
 
 LOG_DEFINE_CATEGORY(UVC)
@@ -51,13 +63,43 @@ public:
 
 	const std::string &id() const { return id_; }
 
+	bool isDecoded(const PixelFormat &format) const
+	{
+		return decodedFormats_.count(format);
+	}
+	PixelFormat defaultFormat(const std::vector<PixelFormat> &pixelFormats) const;
+
 	Mutex openLock_;
 	std::unique_ptr<V4L2VideoDevice> video_;
 	Stream stream_;
 	std::map<PixelFormat, std::vector<SizeRange>> formats_;
 
+#ifdef HAVE_LIBJPEG
+	/*
+	 * Optional MJPEG decoding. The formats output by the decoder that the
+	 * camera doesn't support natively are captured in MJPEG to internal
+	 * buffers, and decoded to the request buffers.
+	 */
+	std::unique_ptr<MjpegDecoder> decoder_;
+	std::unique_ptr<DmaBufAllocator> dmaHeap_;
+	std::vector<std::unique_ptr<FrameBuffer>> mjpegBuffers_;
+	/* Request buffers waiting for a captured frame */
+	std::queue<FrameBuffer *> decodeQueue_;
+#endif
+	std::set<PixelFormat> decodedFormats_;
+	bool useDecoder_ = false;
+
 private:
 	bool generateId();
+	void initDecoder();
+
+#ifdef HAVE_LIBJPEG
+	static constexpr unsigned int kMaxDecoderThreads = 4;
+
+	void mjpegBufferReady(FrameBuffer *buffer);
+	void decoderInputDone(FrameBuffer *buffer);
+	void decodedBufferReady(FrameBuffer *buffer);
+#endif
 
 	std::string id_;
 };
@@ -137,7 +179,7 @@ CameraConfiguration::Status UVCCameraConfiguration::validate()
 	const std::vector<PixelFormat> pixelFormats = formats.pixelformats();
 	auto iter = std::find(pixelFormats.begin(), pixelFormats.end(), pixelFormat);
 	if (iter == pixelFormats.end()) {
-		cfg.pixelFormat = pixelFormats.front();
+		cfg.pixelFormat = data_->defaultFormat(pixelFormats);
 		LOG(UVC, Debug)
 			<< "Adjusting pixel format from " << pixelFormat
 			<< " to " << cfg.pixelFormat;
@@ -161,8 +203,12 @@ CameraConfiguration::Status UVCCameraConfiguration::validate()
 
 	cfg.bufferCount = 4;
 
+	/* Decoded formats are captured in MJPEG. */
+	const bool decoded = data_->isDecoded(cfg.pixelFormat);
+
 	V4L2DeviceFormat format;
-	format.fourcc = data_->video_->toV4L2PixelFormat(cfg.pixelFormat);
+	format.fourcc = data_->video_->toV4L2PixelFormat(decoded ? formats::MJPEG
+								 : cfg.pixelFormat);
 	format.size = cfg.size;
 
 	/*
@@ -189,11 +235,22 @@ CameraConfiguration::Status UVCCameraConfiguration::validate()
 			return Invalid;
 	}
 
-	cfg.stride = format.planes[0].bpl;
-	cfg.frameSize = format.planes[0].size;
+	std::optional<ColorSpace> colorSpace;
+
+	if (decoded) {
+		/* The decoder outputs packed planes in the JPEG colour space. */
+		const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+		cfg.stride = info.stride(cfg.size.width, 0, 1);
+		cfg.frameSize = info.frameSize(cfg.size, 1);
+		colorSpace = ColorSpace::Sycc;
+	} else {
+		cfg.stride = format.planes[0].bpl;
+		cfg.frameSize = format.planes[0].size;
+		colorSpace = format.colorSpace;
+	}
 
-	if (cfg.colorSpace != format.colorSpace) {
-		cfg.colorSpace = format.colorSpace;
+	if (cfg.colorSpace != colorSpace) {
+		cfg.colorSpace = colorSpace;
 		status = Adjusted;
 	}
 
@@ -219,7 +276,7 @@ PipelineHandlerUVC::generateConfiguration(Camera *camera,
 	StreamFormats formats(data->formats_);
 	StreamConfiguration cfg(formats);
 
-	cfg.pixelFormat = formats.pixelformats().front();
+	cfg.pixelFormat = data->defaultFormat(formats.pixelformats());
 	cfg.size = formats.sizes(cfg.pixelFormat).back();
 	cfg.bufferCount = 4;
 
@@ -236,18 +293,31 @@ int PipelineHandlerUVC::configure(Camera *camera, CameraConfiguration *config)
 	StreamConfiguration &cfg = config->at(0);
 	int ret;
 
+	data->useDecoder_ = data->isDecoded(cfg.pixelFormat);
+
+	V4L2PixelFormat fourcc =
+		data->video_->toV4L2PixelFormat(data->useDecoder_ ? formats::MJPEG
+								  : cfg.pixelFormat);
+
 	V4L2DeviceFormat format;
-	format.fourcc = data->video_->toV4L2PixelFormat(cfg.pixelFormat);
+	format.fourcc = fourcc;
 	format.size = cfg.size;
 
 	ret = data->video_->setFormat(&format);
 	if (ret)
 		return ret;
 
-	if (format.size != cfg.size ||
-	    format.fourcc != data->video_->toV4L2PixelFormat(cfg.pixelFormat))
+	if (format.size != cfg.size || format.fourcc != fourcc)
 		return -EINVAL;
 
+#ifdef HAVE_LIBJPEG
+	if (data->useDecoder_) {
+		ret = data->decoder_->configure(cfg.pixelFormat, cfg.size);
+		if (ret)
+			return ret;
+	}
+#endif
+
 	cfg.setStream(&data->stream_);
 
 	return 0;
@@ -257,7 +327,17 @@ int PipelineHandlerUVC::exportFrameBuffers(Camera *camera, Stream *stream,
 					   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
 {
 	UVCCameraData *data = cameraData(camera);
-	unsigned int count = stream->configuration().bufferCount;
+	const StreamConfiguration &cfg = stream->configuration();
+	unsigned int count = cfg.bufferCount;
+
+#ifdef HAVE_LIBJPEG
+	/* Decoded frames are written to buffers allocated from a dma-buf heap. */
+	if (data->useDecoder_)
+		return data->dmaHeap_->exportBuffers(count,
+						     MjpegDecoder::planeSizes(cfg.pixelFormat,
+									      cfg.size),
+						     buffers);
+#endif
 
 	return data->video_->exportBuffers(count, buffers);
 }
@@ -266,25 +346,73 @@ int PipelineHandlerUVC::start(Camera *camera, [[maybe_unused]] const ControlList
 {
 	UVCCameraData *data = cameraData(camera);
 	unsigned int count = data->stream_.configuration().bufferCount;
+	int ret;
 
-	int ret = data->video_->importBuffers(count);
+#ifdef HAVE_LIBJPEG
+	/*
+	 * When decoding, capture to internal buffers, enough to keep all the
+	 * decoder threads busy while capturing the next frame.
+	 */
+	if (data->useDecoder_)
+		ret = data->video_->allocateBuffers(data->decoder_->numThreads() + 2,
+						    &data->mjpegBuffers_);
+	else
+#endif
+		ret = data->video_->importBuffers(count);
 	if (ret < 0)
 		return ret;
 
 	ret = data->video_->streamOn();
 	if (ret < 0) {
 		data->video_->releaseBuffers();
+#ifdef HAVE_LIBJPEG
+		data->mjpegBuffers_.clear();
+#endif
 		return ret;
 	}
 
+#ifdef HAVE_LIBJPEG
+	if (data->useDecoder_) {
+		data->decoder_->start();
+
+		for (std::unique_ptr<FrameBuffer> &buffer : data->mjpegBuffers_)
+			data->video_->queueBuffer(buffer.get());
+	}
+#endif
+
 	return 0;
 }
 
 void PipelineHandlerUVC::stopDevice(Camera *camera)
 {
 	UVCCameraData *data = cameraData(camera);
+
+#ifdef HAVE_LIBJPEG
+	/* Complete the frames being decoded before stopping the capture. */
+	if (data->useDecoder_)
+		data->decoder_->stop();
+#endif
+
 	data->video_->streamOff();
+
+#ifdef HAVE_LIBJPEG
+	/* Cancel the requests still waiting for a frame to be captured. */
+	while (!data->decodeQueue_.empty()) {
+		FrameBuffer *buffer = data->decodeQueue_.front();
+		data->decodeQueue_.pop();
+
+		Request *request = buffer->request();
+		buffer->_d()->cancel();
+		completeBuffer(request, buffer);
+		completeRequest(request);
+	}
+#endif
+
 	data->video_->releaseBuffers();
+
+#ifdef HAVE_LIBJPEG
+	data->mjpegBuffers_.clear();
+#endif
 }
 
 int PipelineHandlerUVC::processControl(ControlList *controls, unsigned int id,
@@ -404,6 +532,14 @@ int PipelineHandlerUVC::queueRequestDevice(Camera *camera, Request *request)
 	if (ret < 0)
 		return ret;
 
+#ifdef HAVE_LIBJPEG
+	/* The buffer is handed to the decoder when a frame is captured. */
+	if (data->useDecoder_) {
+		data->decodeQueue_.push(buffer);
+		return 0;
+	}
+#endif
+
 	ret = data->video_->queueBuffer(buffer);
 	if (ret < 0)
 		return ret;
@@ -510,6 +646,8 @@ int UVCCameraData::init(MediaDevice *media)
 		return -EINVAL;
 	}
 
+	initDecoder();
+
 	/* Populate the camera properties. */
 	properties_.set(properties::Model, utils::toAscii(media->model()));
 
@@ -747,8 +885,109 @@ void UVCCameraData::addControl(uint32_t cid, const ControlInfo &v4l2Info,
 	ctrls->emplace(id, info);
 }
 
+/*
+ * Offer the formats the MJPEG decoder can produce, on top of the ones the
+ * camera supports natively, at the sizes the camera supports for MJPEG.
+ */
+void UVCCameraData::initDecoder()
+{
+#ifdef HAVE_LIBJPEG
+	auto mjpeg = formats_.find(formats::MJPEG);
+	if (mjpeg == formats_.end())
+		return;
+
+	dmaHeap_ = std::make_unique<DmaBufAllocator>(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+						     DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+						     DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf);
+	if (!dmaHeap_->isValid()) {
+		LOG(UVC, Warning)
+			<< "Failed to create dma-buf allocator, disabling MJPEG decoding";
+		dmaHeap_.reset();
+		return;
+	}
+
+	unsigned int numThreads = std::clamp(std::thread::hardware_concurrency(),
+					     1U, kMaxDecoderThreads);
+	decoder_ = std::make_unique<MjpegDecoder>(numThreads);
+	decoder_->inputBufferReady.connect(this, &UVCCameraData::decoderInputDone);
+	decoder_->outputBufferReady.connect(this, &UVCCameraData::decodedBufferReady);
+
+	for (const PixelFormat &format : MjpegDecoder::formats()) {
+		if (formats_.count(format))
+			continue;
+
+		formats_[format] = mjpeg->second;
+		decodedFormats_.insert(format);
+	}
+#endif
+}
+
+/* Prefer the formats supported natively over the decoded ones. */
+PixelFormat UVCCameraData::defaultFormat(const std::vector<PixelFormat> &pixelFormats) const
+{
+	auto it = std::find_if(pixelFormats.begin(), pixelFormats.end(),
+			       [this](const PixelFormat &format) {
+				       return !isDecoded(format);
+			       });
+
+	return it != pixelFormats.end() ? *it : pixelFormats.front();
+}
+
+#ifdef HAVE_LIBJPEG
+void UVCCameraData::mjpegBufferReady(FrameBuffer *buffer)
+{
+	if (buffer->metadata().status == FrameMetadata::FrameCancelled)
+		return;
+
+	/* Capture again to the same buffer if no request is waiting. */
+	if (decodeQueue_.empty()) {
+		video_->queueBuffer(buffer);
+		return;
+	}
+
+	FrameBuffer *output = decodeQueue_.front();
+	decodeQueue_.pop();
+
+	/* \todo Use the UVC metadata to calculate a more precise timestamp */
+	Request *request = output->request();
+	request->metadata().set(controls::SensorTimestamp,
+				buffer->metadata().timestamp);
+
+	/*
+	 * Capture errors are reported by the decoder in the output buffer
+	 * metadata, without decoding.
+	 */
+	decoder_->queueBuffers(buffer, output);
+}
+
+void UVCCameraData::decoderInputDone(FrameBuffer *buffer)
+{
+	/* Queue the MJPEG buffer back for capture. */
+	video_->queueBuffer(buffer);
+}
+
+void UVCCameraData::decodedBufferReady(FrameBuffer *buffer)
+{
+	Request *request = buffer->request();
+
+	pipe()->completeBuffer(request, buffer);
+	pipe()->completeRequest(request);
+}
+#endif
+
 void UVCCameraData::bufferReady(FrameBuffer *buffer)
 {
+#ifdef HAVE_LIBJPEG
+	/*
+	 * When decoding, the captured buffers are internal, and are returned
+	 * by the decoder once decoded.
+	 */
+	if (useDecoder_) {
+		mjpegBufferReady(buffer);
+		return;
+	}
+#endif
+
 	Request *request = buffer->request();
 
 	/* \todo Use the UVC metadata to calculate a more precise timestamp */
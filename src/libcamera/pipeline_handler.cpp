@@ -7,6 +7,7 @@
 
 #include "libcamera/internal/pipeline_handler.h"
 
+#include <algorithm>
 #include <chrono>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
@@ -16,6 +17,7 @@
 #include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
+#include <libcamera/control_ids.h>
 #include <libcamera/framebuffer.h>
 #include <libcamera/property_ids.h>
 
@@ -68,7 +70,7 @@ LOG_DEFINE_CATEGORY(Pipeline)
  * through the PipelineHandlerFactoryBase::create() function.
  */
 PipelineHandler::PipelineHandler(CameraManager *manager)
-	: manager_(manager), useCount_(0)
+	: manager_(manager), batching_(false), useCount_(0)
 {
 }
 
@@ -309,6 +311,30 @@ void PipelineHandler::unlockMediaDevices()
  * \return 0 on success or a negative error code otherwise
  */
 
+/**
+ * \brief Reconfigure a group of streams for capture
+ * \param[in] camera The camera to reconfigure
+ * \param[in] config The camera configurations to setup
+ *
+ * Apply a new configuration to a \a camera that has already been configured
+ * and is stopped. This function behaves as configure(), and the same
+ * requirements apply to its implementation. Pipeline handlers may however
+ * retain the hardware setup that doesn't depend on the parts of the
+ * configuration that have changed since the previous configuration, such as
+ * media links, subdevice formats or IPA state, to switch faster between
+ * configurations.
+ *
+ * The default implementation calls configure().
+ *
+ * \context This function is called from the CameraManager thread.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int PipelineHandler::reconfigure(Camera *camera, CameraConfiguration *config)
+{
+	return configure(camera, config);
+}
+
 /**
  * \fn PipelineHandler::exportFrameBuffers()
  * \brief Allocate and export buffers for \a stream
@@ -366,7 +392,7 @@ void PipelineHandler::stop(Camera *camera)
 	/* Cancel and signal as complete all waiting requests. */
 	while (!waitingRequests_.empty()) {
 		Request *request = waitingRequests_.front();
-		waitingRequests_.pop();
+		waitingRequests_.pop_front();
 
 		request->_d()->cancel();
 		completeRequest(request);
@@ -446,11 +472,34 @@ void PipelineHandler::queueRequest(Request *request)
 {
 	LIBCAMERA_TRACEPOINT(request_queue, request);
 
-	waitingRequests_.push(request);
+	waitingRequests_.push_back(request);
 
 	request->_d()->prepare(300ms);
 }
 
+/**
+ * \brief Queue a batch of requests
+ * \param[in] requests The requests to queue
+ *
+ * This function queues multiple capture requests to the pipeline handler in
+ * one go. It behaves as calling queueRequest() for each request in order, but
+ * only tries to queue the waiting requests to the device once all of them
+ * have been added to the waiting list.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::queueRequests(const std::vector<Request *> &requests)
+{
+	batching_ = true;
+
+	for (Request *request : requests)
+		queueRequest(request);
+
+	batching_ = false;
+
+	doQueueRequests();
+}
+
 /**
  * \brief Queue one requests to the device
  */
@@ -461,8 +510,11 @@ void PipelineHandler::doQueueRequest(Request *request)
 	Camera *camera = request->_d()->camera();
 	Camera::Private *data = camera->_d();
 	data->queuedRequests_.push_back(request);
+	data->queuedRequestsMetric_->set(data->queuedRequests_.size());
 
 	request->_d()->sequence_ = data->requestSequence_++;
+	request->_d()->reportLatency_ =
+		request->controls().get(controls::draft::LatencyReporting).value_or(false);
 
 	if (request->_d()->cancelled_) {
 		completeRequest(request);
@@ -484,13 +536,29 @@ void PipelineHandler::doQueueRequest(Request *request)
  */
 void PipelineHandler::doQueueRequests()
 {
+	/* Requests prepared while queuing a batch are handled at its end. */
+	if (batching_)
+		return;
+
 	while (!waitingRequests_.empty()) {
-		Request *request = waitingRequests_.front();
+		/*
+		 * Queue the requests with the highest priority first, in
+		 * queueing order for requests with the same priority. A request
+		 * that isn't prepared yet blocks the requests with the same or
+		 * a lower priority.
+		 */
+		auto it = std::max_element(waitingRequests_.begin(),
+					   waitingRequests_.end(),
+					   [](const Request *a, const Request *b) {
+						   return a->priority() < b->priority();
+					   });
+
+		Request *request = *it;
 		if (!request->_d()->prepared_)
 			break;
 
 		doQueueRequest(request);
-		waitingRequests_.pop();
+		waitingRequests_.erase(it);
 	}
 }
 
@@ -547,12 +615,29 @@ bool PipelineHandler::completeBuffer(Request *request, FrameBuffer *buffer)
  * submission order, the pipeline handler may call it on any complete request
  * without any ordering constraint.
  *
+ * If the draft::LatencyReporting control is enabled in the request, the
+ * processing stage timestamps recorded with Request::Private::recordStage() are
+ * added to the request metadata.
+ *
  * \context This function shall be called from the CameraManager thread.
  */
 void PipelineHandler::completeRequest(Request *request)
 {
 	Camera *camera = request->_d()->camera();
 
+	LIBCAMERA_TRACEPOINT_FRAME(name(), RequestComplete, request->sequence());
+
+	if (request->_d()->reportLatency_) {
+		std::array<int64_t, 5> &timestamps = request->_d()->stageTimestamps_;
+
+		timestamps[0] = request->metadata().get(controls::SensorTimestamp).value_or(0);
+		timestamps[4] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			utils::clock::now().time_since_epoch()).count();
+
+		request->metadata().set(controls::draft::ProcessingTimestamps,
+					timestamps);
+	}
+
 	request->_d()->complete();
 
 	Camera::Private *data = camera->_d();
@@ -564,6 +649,15 @@ void PipelineHandler::completeRequest(Request *request)
 
 		ASSERT(!req->hasPendingBuffers());
 		data->queuedRequests_.pop_front();
+		data->queuedRequestsMetric_->set(data->queuedRequests_.size());
+
+		if (req->status() == Request::RequestCancelled)
+			data->cancelledRequestsMetric_->increment();
+		else
+			data->completedRequestsMetric_->increment();
+
+		data->monitorFrameTiming(req);
+		data->reportMetadata(req);
 		camera->requestComplete(req);
 	}
 }
@@ -0,0 +1,365 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Vectorized pixel conversion kernels
+ */
+
+#include "libcamera/internal/pixel_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <libcamera/base/log.h>
+
+/**
+ * \file pixel_kernels.h
+ * \brief Vectorized pixel conversion kernels
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(PixelKernels)
+
+/**
+ * \namespace libcamera::kernels
+ * \brief Pixel conversion kernels shared by libcamera components
+ *
+ * The kernels process one line, or a run of contiguous pixels, per call.
+ * Each of them has a portable C implementation and vectorized implementations
+ * for the instruction sets available on the CPU, selected at runtime the first
+ * time a kernel is called. All implementations produce identical results.
+ *
+ * Kernels don't access memory before the start or past the end of the source
+ * and destination pixels they're given, and have no alignment requirements.
+ */
+
+namespace kernels {
+
+namespace {
+
+void deinterleaveC(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+		   unsigned int count)
+{
+	for (unsigned int x = 0; x < count; x++) {
+		dst0[x] = src[2 * x];
+		dst1[x] = src[2 * x + 1];
+	}
+}
+
+void unpackCSI2P10C(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x += 4) {
+		const uint8_t lsbs = src[4];
+
+		for (unsigned int i = 0; i < 4 && x + i < width; i++)
+			dst[i] = src[i] << 2 | ((lsbs >> (2 * i)) & 0x03);
+
+		src += 5;
+		dst += 4;
+	}
+}
+
+void unpackCSI2P12C(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x += 2) {
+		dst[0] = src[0] << 4 | (src[2] & 0x0f);
+		if (x + 1 < width)
+			dst[1] = src[1] << 4 | src[2] >> 4;
+
+		src += 3;
+		dst += 2;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+void deinterleaveSSE2(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+		      unsigned int count)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	unsigned int x = 0;
+
+	for (; x + 16 <= count; x += 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+
+		__m128i even = _mm_packus_epi16(_mm_and_si128(a, mask),
+						_mm_and_si128(b, mask));
+		__m128i odd = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					       _mm_srli_epi16(b, 8));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst0), even);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst1), odd);
+
+		src += 32;
+		dst0 += 16;
+		dst1 += 16;
+	}
+
+	deinterleaveC(dst0, dst1, src, count - x);
+}
+
+/*
+ * The CSI-2 kernels gather the byte holding the MSBs and the byte holding the
+ * LSBs of each of 8 pixels in 16-bit lanes. The LSBs are then aligned with a
+ * multiplication, as SSE has no per-lane shifts.
+ */
+__attribute__((target("ssse3")))
+void unpackCSI2P10SSSE3(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	const __m128i msbIndices = _mm_setr_epi8(0, -1, 1, -1, 2, -1, 3, -1,
+						 5, -1, 6, -1, 7, -1, 8, -1);
+	const __m128i lsbIndices = _mm_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1,
+						 9, -1, 9, -1, 9, -1, 9, -1);
+	/* Move the 2 LSBs of each pixel to bits 7:6 */
+	const __m128i lsbShifts = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+	const __m128i lsbMask = _mm_set1_epi16(0x0003);
+	unsigned int x = 0;
+
+	/* Each iteration reads 16 bytes and consumes 10 */
+	for (; x + 16 <= width; x += 8) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+		__m128i msbs = _mm_shuffle_epi8(in, msbIndices);
+		__m128i lsbs = _mm_shuffle_epi8(in, lsbIndices);
+
+		lsbs = _mm_mullo_epi16(lsbs, lsbShifts);
+		lsbs = _mm_and_si128(_mm_srli_epi16(lsbs, 6), lsbMask);
+
+		__m128i out = _mm_or_si128(_mm_slli_epi16(msbs, 2), lsbs);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), out);
+
+		src += 10;
+		dst += 8;
+	}
+
+	unpackCSI2P10C(dst, src, width - x);
+}
+
+__attribute__((target("ssse3")))
+void unpackCSI2P12SSSE3(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	const __m128i msbIndices = _mm_setr_epi8(0, -1, 1, -1, 3, -1, 4, -1,
+						 6, -1, 7, -1, 9, -1, 10, -1);
+	const __m128i lsbIndices = _mm_setr_epi8(2, -1, 2, -1, 5, -1, 5, -1,
+						 8, -1, 8, -1, 11, -1, 11, -1);
+	/* Move the 4 LSBs of each pixel to bits 7:4 */
+	const __m128i lsbShifts = _mm_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1);
+	const __m128i lsbMask = _mm_set1_epi16(0x000f);
+	unsigned int x = 0;
+
+	/* Each iteration reads 16 bytes and consumes 12 */
+	for (; x + 16 <= width; x += 8) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+		__m128i msbs = _mm_shuffle_epi8(in, msbIndices);
+		__m128i lsbs = _mm_shuffle_epi8(in, lsbIndices);
+
+		lsbs = _mm_mullo_epi16(lsbs, lsbShifts);
+		lsbs = _mm_and_si128(_mm_srli_epi16(lsbs, 4), lsbMask);
+
+		__m128i out = _mm_or_si128(_mm_slli_epi16(msbs, 4), lsbs);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), out);
+
+		src += 12;
+		dst += 8;
+	}
+
+	unpackCSI2P12C(dst, src, width - x);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+#if defined(__ARM_NEON)
+
+void deinterleaveNEON(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+		      unsigned int count)
+{
+	unsigned int x = 0;
+
+	for (; x + 16 <= count; x += 16) {
+		uint8x16x2_t in = vld2q_u8(src);
+
+		vst1q_u8(dst0, in.val[0]);
+		vst1q_u8(dst1, in.val[1]);
+
+		src += 32;
+		dst0 += 16;
+		dst1 += 16;
+	}
+
+	deinterleaveC(dst0, dst1, src, count - x);
+}
+
+#if defined(__aarch64__)
+
+/* Table lookups return 0 for the out of range 0xff indices */
+void unpackCSI2P10NEON(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	const uint8x16_t msbIndices = { 0, 0xff, 1, 0xff, 2, 0xff, 3, 0xff,
+					5, 0xff, 6, 0xff, 7, 0xff, 8, 0xff };
+	const uint8x16_t lsbIndices = { 4, 0xff, 4, 0xff, 4, 0xff, 4, 0xff,
+					9, 0xff, 9, 0xff, 9, 0xff, 9, 0xff };
+	const int16x8_t lsbShifts = { 0, -2, -4, -6, 0, -2, -4, -6 };
+	const uint16x8_t lsbMask = vdupq_n_u16(0x0003);
+	unsigned int x = 0;
+
+	/* Each iteration reads 16 bytes and consumes 10 */
+	for (; x + 16 <= width; x += 8) {
+		uint8x16_t in = vld1q_u8(src);
+		uint16x8_t msbs = vreinterpretq_u16_u8(vqtbl1q_u8(in, msbIndices));
+		uint16x8_t lsbs = vreinterpretq_u16_u8(vqtbl1q_u8(in, lsbIndices));
+
+		lsbs = vandq_u16(vshlq_u16(lsbs, lsbShifts), lsbMask);
+		vst1q_u16(dst, vorrq_u16(vshlq_n_u16(msbs, 2), lsbs));
+
+		src += 10;
+		dst += 8;
+	}
+
+	unpackCSI2P10C(dst, src, width - x);
+}
+
+void unpackCSI2P12NEON(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	const uint8x16_t msbIndices = { 0, 0xff, 1, 0xff, 3, 0xff, 4, 0xff,
+					6, 0xff, 7, 0xff, 9, 0xff, 10, 0xff };
+	const uint8x16_t lsbIndices = { 2, 0xff, 2, 0xff, 5, 0xff, 5, 0xff,
+					8, 0xff, 8, 0xff, 11, 0xff, 11, 0xff };
+	const int16x8_t lsbShifts = { 0, -4, 0, -4, 0, -4, 0, -4 };
+	const uint16x8_t lsbMask = vdupq_n_u16(0x000f);
+	unsigned int x = 0;
+
+	/* Each iteration reads 16 bytes and consumes 12 */
+	for (; x + 16 <= width; x += 8) {
+		uint8x16_t in = vld1q_u8(src);
+		uint16x8_t msbs = vreinterpretq_u16_u8(vqtbl1q_u8(in, msbIndices));
+		uint16x8_t lsbs = vreinterpretq_u16_u8(vqtbl1q_u8(in, lsbIndices));
+
+		lsbs = vandq_u16(vshlq_u16(lsbs, lsbShifts), lsbMask);
+		vst1q_u16(dst, vorrq_u16(vshlq_n_u16(msbs, 4), lsbs));
+
+		src += 12;
+		dst += 8;
+	}
+
+	unpackCSI2P12C(dst, src, width - x);
+}
+
+#endif /* __aarch64__ */
+
+#endif /* __ARM_NEON */
+
+struct Implementation {
+	const char *name;
+	void (*deinterleave)(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+			     unsigned int count);
+	void (*unpackCSI2P10)(uint16_t *dst, const uint8_t *src, unsigned int width);
+	void (*unpackCSI2P12)(uint16_t *dst, const uint8_t *src, unsigned int width);
+};
+
+Implementation selectImplementation()
+{
+	Implementation impl = {
+		"c", deinterleaveC, unpackCSI2P10C, unpackCSI2P12C,
+	};
+
+#if defined(__ARM_NEON)
+	impl.name = "neon";
+	impl.deinterleave = deinterleaveNEON;
+#if defined(__aarch64__)
+	impl.unpackCSI2P10 = unpackCSI2P10NEON;
+	impl.unpackCSI2P12 = unpackCSI2P12NEON;
+#endif
+#elif defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("sse2")) {
+		impl.name = "sse2";
+		impl.deinterleave = deinterleaveSSE2;
+	}
+
+	if (__builtin_cpu_supports("ssse3")) {
+		impl.name = "ssse3";
+		impl.unpackCSI2P10 = unpackCSI2P10SSSE3;
+		impl.unpackCSI2P12 = unpackCSI2P12SSSE3;
+	}
+#endif
+
+	LOG(PixelKernels, Debug) << "Using " << impl.name << " pixel kernels";
+
+	return impl;
+}
+
+const Implementation &implementations()
+{
+	static const Implementation impl = selectImplementation();
+	return impl;
+}
+
+} /* namespace */
+
+/**
+ * \brief Retrieve the name of the kernels implementation in use
+ *
+ * The name identifies the most capable instruction set used by the kernels,
+ * such as "ssse3" or "neon", or is "c" when none of the kernels is vectorized.
+ *
+ * \return The name of the implementation
+ */
+const char *implementation()
+{
+	return implementations().name;
+}
+
+/**
+ * \brief Split interleaved samples in two planes
+ * \param[out] dst0 The destination of the even samples
+ * \param[out] dst1 The destination of the odd samples
+ * \param[in] src The interleaved samples
+ * \param[in] count The number of sample pairs
+ *
+ * This is typically used to extract the Cb and Cr planes from the chroma plane
+ * of semi-planar YUV formats.
+ */
+void deinterleave(uint8_t *dst0, uint8_t *dst1, const uint8_t *src,
+		  unsigned int count)
+{
+	implementations().deinterleave(dst0, dst1, src, count);
+}
+
+/**
+ * \brief Unpack a line of CSI-2 packed 10-bit pixels
+ * \param[out] dst The unpacked pixels, one per 16-bit value
+ * \param[in] src The CSI-2 packed pixels
+ * \param[in] width The number of pixels
+ *
+ * The source holds groups of 4 pixels stored in 5 bytes. The last group may
+ * hold less than 4 pixels, it still occupies 5 bytes. The pixel values are stored in \a dst in the low 10 bits
+ * of each 16-bit value, in host endianness.
+ */
+void unpackCSI2P10(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	implementations().unpackCSI2P10(dst, src, width);
+}
+
+/**
+ * \brief Unpack a line of CSI-2 packed 12-bit pixels
+ * \param[out] dst The unpacked pixels, one per 16-bit value
+ * \param[in] src The CSI-2 packed pixels
+ * \param[in] width The number of pixels
+ *
+ * The source holds groups of 2 pixels stored in 3 bytes. The last group may
+ * hold a single pixel, it still occupies 3 bytes. The pixel values are stored in \a dst in the low 12 bits
+ * of each 16-bit value, in host endianness.
+ */
+void unpackCSI2P12(uint16_t *dst, const uint8_t *src, unsigned int width)
+{
+	implementations().unpackCSI2P12(dst, src, width);
+}
+
+} /* namespace kernels */
+
+} /* namespace libcamera */
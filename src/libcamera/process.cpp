@@ -17,6 +17,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include <libcamera/base/event_notifier.h>
@@ -75,19 +76,28 @@ void ProcessManager::sighandler()
 		return;
 	}
 
-	for (auto it = processes_.begin(); it != processes_.end(); ) {
-		Process *process = *it;
+	std::vector<std::pair<Process *, int>> died;
 
-		int wstatus;
-		pid_t pid = waitpid(process->pid_, &wstatus, WNOHANG);
-		if (process->pid_ != pid) {
-			++it;
-			continue;
+	{
+		MutexLocker locker(mutex_);
+
+		for (auto it = processes_.begin(); it != processes_.end(); ) {
+			Process *process = *it;
+
+			int wstatus;
+			pid_t pid = waitpid(process->pid_, &wstatus, WNOHANG);
+			if (process->pid_ != pid) {
+				++it;
+				continue;
+			}
+
+			it = processes_.erase(it);
+			died.emplace_back(process, wstatus);
 		}
+	}
 
-		it = processes_.erase(it);
+	for (auto &[process, wstatus] : died)
 		process->died(wstatus);
-	}
 }
 
 /**
@@ -97,9 +107,12 @@ void ProcessManager::sighandler()
  * This function registers the \a proc with the process manager. It
  * shall be called by the parent process after successfully forking, in
  * order to let the parent signal process termination.
+ *
+ * \context This function is \threadsafe.
  */
 void ProcessManager::registerProcess(Process *proc)
 {
+	MutexLocker locker(mutex_);
 	processes_.push_back(proc);
 }
 
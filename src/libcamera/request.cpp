@@ -7,10 +7,17 @@
 
 #include "libcamera/internal/request.h"
 
+#include <algorithm>
 #include <map>
+#include <poll.h>
 #include <sstream>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <linux/sync_file.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
@@ -86,8 +93,8 @@ bool Request::Private::hasPendingBuffers() const
  * \brief Complete a buffer for the request
  * \param[in] buffer The buffer that has completed
  *
- * A request tracks the status of all buffers it contains through a set of
- * pending buffers. This function removes the \a buffer from the set to mark it
+ * A request tracks the status of all buffers it contains through a list of
+ * pending buffers. This function removes the \a buffer from the list to mark it
  * as complete. All buffers associate with the request shall be marked as
  * complete by calling this function once and once only before reporting the
  * request as complete with the complete() function.
@@ -99,8 +106,9 @@ bool Request::Private::completeBuffer(FrameBuffer *buffer)
 {
 	LIBCAMERA_TRACEPOINT(request_complete_buffer, this, buffer);
 
-	int ret = pending_.erase(buffer);
-	ASSERT(ret == 1);
+	auto it = std::find(pending_.begin(), pending_.end(), buffer);
+	ASSERT(it != pending_.end());
+	pending_.erase(it);
 
 	buffer->_d()->setRequest(nullptr);
 
@@ -142,8 +150,7 @@ void Request::Private::doCancelRequest()
 
 	cancelled_ = true;
 	pending_.clear();
-	notifiers_.clear();
-	timer_.reset();
+	clearFences();
 }
 
 /**
@@ -168,18 +175,92 @@ void Request::Private::cancel()
  * \brief Reset the request internal data to default values
  *
  * After calling this function, all request internal data will have default
- * values as if the Request::Private instance had just been constructed.
+ * values as if the Request::Private instance had just been constructed. The
+ * storage of the internal containers is retained, to avoid reallocating it
+ * when the request is reused.
  */
 void Request::Private::reset()
 {
 	sequence_ = 0;
 	cancelled_ = false;
 	prepared_ = false;
+	reportLatency_ = false;
+	stageTimestamps_ = {};
 	pending_.clear();
-	notifiers_.clear();
-	timer_.reset();
+	clearFences();
+}
+
+/**
+ * \enum Request::Private::Stage
+ * \brief Frame processing stages reported in the ProcessingTimestamps metadata
+ * \var Request::Private::Stage::BufferDequeue
+ * \brief The frame has been dequeued from the receiver
+ * \var Request::Private::Stage::IpaDone
+ * \brief The IPA has completed processing the frame
+ * \var Request::Private::Stage::IspDone
+ * \brief The ISP has completed processing the frame
+ */
+
+/**
+ * \brief Record the time at which the request's frame reached a processing stage
+ * \param[in] stage The processing stage
+ *
+ * Pipeline handlers call this function when the frame captured for the request
+ * reaches \a stage. The timestamps are reported to the application through the
+ * draft::ProcessingTimestamps metadata when the request completes, if the
+ * draft::LatencyReporting control is enabled in the request. Otherwise this
+ * function is a no-op.
+ *
+ * Recording the same stage multiple times keeps the most recent timestamp.
+ */
+void Request::Private::recordStage(Stage stage)
+{
+	if (!reportLatency_)
+		return;
+
+	stageTimestamps_[static_cast<unsigned int>(stage)] =
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			utils::clock::now().time_since_epoch()).count();
+}
+
+namespace {
+
+bool fenceSignalled(const Fence *fence)
+{
+	struct pollfd pfd = {};
+	pfd.fd = fence->fd().get();
+	pfd.events = POLLIN;
+
+	return poll(&pfd, 1, 0) == 1 && pfd.revents & POLLIN;
 }
 
+/*
+ * Merge the fences of the buffers into a single sync_file that signals once
+ * all of them have signalled. Return an invalid file descriptor if any fence
+ * isn't a sync_file.
+ */
+UniqueFD mergeFences(const std::vector<FrameBuffer *> &buffers)
+{
+	UniqueFD merged;
+
+	for (unsigned int i = 1; i < buffers.size(); i++) {
+		struct sync_merge_data data = {};
+		strncpy(data.name, "libcamera", sizeof(data.name) - 1);
+		data.fd2 = buffers[i]->_d()->fence()->fd().get();
+
+		int fd = merged.isValid() ? merged.get()
+					  : buffers[0]->_d()->fence()->fd().get();
+		if (ioctl(fd, SYNC_IOC_MERGE, &data) < 0)
+			return {};
+
+		merged = UniqueFD(data.fence);
+	}
+
+	return merged;
+}
+
+} /* namespace */
+
 /*
  * Helper function to save some lines of code and make sure prepared_ is set
  * to true before emitting the signal.
@@ -213,6 +294,10 @@ void Request::Private::emitPrepareCompleted()
  * is emitted when all fences have been signalled or the optional timeout has
  * expired.
  *
+ * Fences already signalled are released without waiting. When multiple fences
+ * remain to be waited on and they are all sync_file fences, they are merged
+ * into a single sync_file to register a single notifier.
+ *
  * If not all the fences have been correctly signalled or the optional timeout
  * has expired the Request will be cancelled and the Request::prepared signal
  * emitted.
@@ -222,28 +307,52 @@ void Request::Private::emitPrepareCompleted()
  */
 void Request::Private::prepare(std::chrono::milliseconds timeout)
 {
-	/* Create and connect one notifier for each synchronization fence. */
+	std::vector<FrameBuffer *> fenced;
+
 	for (FrameBuffer *buffer : pending_) {
 		const Fence *fence = buffer->_d()->fence();
 		if (!fence)
 			continue;
 
-		std::unique_ptr<EventNotifier> notifier =
-			std::make_unique<EventNotifier>(fence->fd().get(),
-							EventNotifier::Read);
-
-		notifier->activated.connect(this, [this, buffer] {
-							notifierActivated(buffer);
-					    });
+		/* Close the fences that have already been signalled. */
+		if (fenceSignalled(fence)) {
+			buffer->releaseFence();
+			continue;
+		}
 
-		notifiers_[buffer] = std::move(notifier);
+		fenced.push_back(buffer);
 	}
 
-	if (notifiers_.empty()) {
+	if (fenced.empty()) {
 		emitPrepareCompleted();
 		return;
 	}
 
+	if (fenced.size() > 1)
+		mergedFence_ = mergeFences(fenced);
+
+	if (mergedFence_.isValid()) {
+		mergedBuffers_ = std::move(fenced);
+		mergedNotifier_ = std::make_unique<EventNotifier>(mergedFence_.get(),
+								  EventNotifier::Read);
+		mergedNotifier_->activated.connect(this, &Request::Private::mergedFenceActivated);
+	} else {
+		/* Create and connect one notifier for each synchronization fence. */
+		for (FrameBuffer *buffer : fenced) {
+			const Fence *fence = buffer->_d()->fence();
+
+			std::unique_ptr<EventNotifier> notifier =
+				std::make_unique<EventNotifier>(fence->fd().get(),
+								EventNotifier::Read);
+
+			notifier->activated.connect(this, [this, buffer] {
+								notifierActivated(buffer);
+						    });
+
+			notifiers_[buffer] = std::move(notifier);
+		}
+	}
+
 	/*
 	 * In case a timeout is specified, create a timer and set it up.
 	 *
@@ -294,11 +403,36 @@ void Request::Private::notifierActivated(FrameBuffer *buffer)
 	emitPrepareCompleted();
 }
 
+void Request::Private::mergedFenceActivated()
+{
+	/* All the merged fences have been signalled, close them. */
+	for (FrameBuffer *buffer : mergedBuffers_)
+		buffer->releaseFence();
+
+	Request *request = _o<Request>();
+	LOG(Request, Debug)
+		<< "Request " << request->cookie() << " "
+		<< mergedBuffers_.size() << " fences signalled";
+
+	clearFences();
+	emitPrepareCompleted();
+}
+
 void Request::Private::timeout()
 {
 	/* A timeout can only happen if there are fences not yet signalled. */
-	ASSERT(!notifiers_.empty());
-	notifiers_.clear();
+	ASSERT(!notifiers_.empty() || mergedNotifier_);
+
+	/*
+	 * Close the merged fences that have been signalled, the others are
+	 * left in the buffers for the application to retrieve them.
+	 */
+	for (FrameBuffer *buffer : mergedBuffers_) {
+		if (fenceSignalled(buffer->_d()->fence()))
+			buffer->releaseFence();
+	}
+
+	clearFences();
 
 	Request *request = _o<Request>();
 	LOG(Request, Debug) << "Request prepare timeout: " << request->cookie();
@@ -307,6 +441,15 @@ void Request::Private::timeout()
 
 	emitPrepareCompleted();
 }
+
+void Request::Private::clearFences()
+{
+	notifiers_.clear();
+	mergedNotifier_.reset();
+	mergedFence_.reset();
+	mergedBuffers_.clear();
+	timer_.reset();
+}
 #endif /* __DOXYGEN_PUBLIC__ */
 
 /**
@@ -386,6 +529,10 @@ Request::~Request()
  * prior to queueing the request to the camera, in lieu of constructing a new
  * request. The application can reuse the buffers that were previously added
  * to the request via addBuffer() by setting \a flags to ReuseBuffers.
+ *
+ * The memory used by the request internal data, the controls and metadata
+ * lists and the buffer map is retained. Reusing a request with the same streams
+ * and a similar set of controls thus doesn't cause any memory allocation.
  */
 void Request::reuse(ReuseFlag flags)
 {
@@ -397,10 +544,12 @@ void Request::reuse(ReuseFlag flags)
 		for (auto pair : bufferMap_) {
 			FrameBuffer *buffer = pair.second;
 			buffer->_d()->setRequest(this);
-			_d()->pending_.insert(buffer);
+			_d()->pending_.push_back(buffer);
 		}
 	} else {
-		bufferMap_.clear();
+		/* Keep the map nodes to recycle them in addBuffer(). */
+		while (!bufferMap_.empty())
+			_d()->spareBufferNodes_.push_back(bufferMap_.extract(bufferMap_.begin()));
 	}
 
 	status_ = RequestPending;
@@ -482,8 +631,19 @@ int Request::addBuffer(const Stream *stream, FrameBuffer *buffer,
 	}
 
 	buffer->_d()->setRequest(this);
-	_d()->pending_.insert(buffer);
-	bufferMap_[stream] = buffer;
+	_d()->pending_.push_back(buffer);
+
+	std::vector<BufferMap::node_type> &spareNodes = _d()->spareBufferNodes_;
+	if (!spareNodes.empty()) {
+		BufferMap::node_type node = std::move(spareNodes.back());
+		spareNodes.pop_back();
+
+		node.key() = stream;
+		node.mapped() = buffer;
+		bufferMap_.insert(std::move(node));
+	} else {
+		bufferMap_[stream] = buffer;
+	}
 
 	/*
 	 * Make sure the fence has been extracted from the buffer
@@ -532,6 +692,16 @@ FrameBuffer *Request::findBuffer(const Stream *stream) const
  * \return The metadata associated with the request
  */
 
+/**
+ * \fn Request::metadata() const
+ * \brief Retrieve the request's metadata
+ *
+ * This read-only variant gives access to the metadata of requests shared with
+ * multiple consumers, such as the requests distributed by RequestFanout.
+ *
+ * \return The metadata associated with the request
+ */
+
 /**
  * \brief Retrieve the sequence number for the request
  *
@@ -558,6 +728,39 @@ uint32_t Request::sequence() const
  * \return The request cookie
  */
 
+/**
+ * \brief Retrieve the request priority
+ * \return The request priority
+ * \sa setPriority()
+ */
+unsigned int Request::priority() const
+{
+	return _d()->priority_;
+}
+
+/**
+ * \brief Set the request priority
+ * \param[in] priority The request priority
+ *
+ * Requests wait to be queued to the device until their buffer fences are
+ * signalled. When multiple requests are ready, the requests with the highest
+ * priority are queued to the device first, and requests with the same
+ * priority are queued in the order they have been queued to the camera. This
+ * allows latency-critical requests, such as viewfinder requests, to overtake
+ * requests queued earlier with a lower priority. As requests complete in the
+ * order they are queued to the device, a higher priority request may complete
+ * before requests queued to the camera before it.
+ *
+ * Requests already queued to the device are not reordered. The priority
+ * defaults to 0, and is kept when the request is reused.
+ *
+ * The priority shall be set before queuing the request to the camera.
+ */
+void Request::setPriority(unsigned int priority)
+{
+	_d()->priority_ = priority;
+}
+
 /**
  * \fn Request::status()
  * \brief Retrieve the request completion status
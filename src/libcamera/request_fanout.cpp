@@ -0,0 +1,416 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Distribution of completed requests to multiple consumers
+ */
+
+#include "libcamera/internal/request_fanout.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/request.h>
+
+/**
+ * \file libcamera/request_fanout.h
+ * \brief Distribution of completed requests to multiple consumers
+ */
+
+/**
+ * \internal
+ * \file libcamera/internal/request_fanout.h
+ * \brief Request fan-out private data
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(RequestFanout)
+
+/**
+ * \class RequestFanout::Private
+ * \brief Base class for RequestFanout private data
+ *
+ * The RequestFanout::Private class stores the requests owned by the fan-out,
+ * their reference counts and the queues of the consumers.
+ */
+
+/**
+ * \brief Construct a RequestFanout::Private instance
+ * \param[in] camera The camera whose requests are distributed
+ */
+RequestFanout::Private::Private(std::shared_ptr<Camera> camera)
+	: camera_(std::move(camera)), running_(false)
+{
+	camera_->requestCompleted.connect(this, &Private::requestComplete);
+}
+
+RequestFanout::Private::~Private()
+{
+	camera_->requestCompleted.disconnect(this);
+}
+
+/**
+ * \brief Distribute a completed request to the consumers
+ * \param[in] request The completed request
+ *
+ * Requests that the fan-out doesn't own are ignored. Cancelled requests are not
+ * distributed, they are kept and queued again when the fan-out is restarted.
+ */
+void RequestFanout::Private::requestComplete(Request *request)
+{
+	std::vector<unsigned int> available;
+	std::vector<Request *> unused;
+
+	{
+		MutexLocker locker(mutex_);
+
+		auto iter = refs_.find(request);
+		if (iter == refs_.end())
+			return;
+
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		for (unsigned int i = 0; i < consumers_.size(); i++) {
+			Consumer &consumer = consumers_[i];
+
+			if (consumer.ready.size() >= consumer.queueDepth) {
+				if (consumer.policy == DropPolicy::DropNewest)
+					continue;
+
+				Request *oldest = consumer.ready.front();
+				consumer.ready.pop_front();
+
+				if (!--refs_[oldest])
+					unused.push_back(oldest);
+			}
+
+			consumer.ready.push_back(request);
+			iter->second++;
+			available.push_back(i);
+		}
+
+		if (!iter->second)
+			unused.push_back(request);
+	}
+
+	recycle(unused);
+
+	RequestFanout *const o = _o<RequestFanout>();
+	for (unsigned int consumer : available)
+		o->requestAvailable.emit(consumer);
+}
+
+/**
+ * \brief Queue requests released by all consumers back to the camera
+ * \param[in] requests The requests
+ *
+ * Requests are only queued while the fan-out is running. Otherwise they are
+ * left idle, and will be queued when the fan-out is started.
+ */
+void RequestFanout::Private::recycle(const std::vector<Request *> &requests)
+{
+	{
+		MutexLocker locker(mutex_);
+		if (!running_)
+			return;
+	}
+
+	for (Request *request : requests) {
+		request->reuse(Request::ReuseBuffers);
+
+		int ret = camera_->queueRequest(request);
+		if (ret < 0 && ret != -EACCES)
+			LOG(RequestFanout, Error)
+				<< "Failed to queue request: " << strerror(-ret);
+	}
+}
+
+/**
+ * \var RequestFanout::Private::camera_
+ * \brief The camera whose requests are distributed
+ */
+
+/**
+ * \var RequestFanout::Private::mutex_
+ * \brief Protects the consumers, requests and reference counts
+ */
+
+/**
+ * \struct RequestFanout::Private::Consumer
+ * \brief The state of a consumer
+ *
+ * \var RequestFanout::Private::Consumer::queueDepth
+ * \brief The maximum number of requests waiting to be acquired
+ *
+ * \var RequestFanout::Private::Consumer::policy
+ * \brief The policy applied when the queue is full
+ *
+ * \var RequestFanout::Private::Consumer::ready
+ * \brief The requests waiting to be acquired, oldest first
+ */
+
+/**
+ * \var RequestFanout::Private::consumers_
+ * \brief The consumers, indexed by consumer ID
+ */
+
+/**
+ * \var RequestFanout::Private::requests_
+ * \brief The requests owned by the fan-out
+ */
+
+/**
+ * \var RequestFanout::Private::refs_
+ * \brief The number of consumers holding each request
+ */
+
+/**
+ * \var RequestFanout::Private::running_
+ * \brief True if the fan-out has been started
+ */
+
+/**
+ * \class RequestFanout
+ * \brief Distribute the completed requests of a camera to multiple consumers
+ *
+ * The RequestFanout class shares the frames captured by a camera between
+ * multiple consumers in the same process, for instance a recorder, a preview
+ * and an analysis component, without copying them. The consumers access the
+ * buffers and metadata of the completed requests read-only, and the requests
+ * are queued back to the camera when all consumers have released them.
+ *
+ * The application creates requests of the camera, adds buffers to them, and
+ * transfers their ownership to the fan-out with addRequest(). Consumers are
+ * registered with addConsumer(), which returns the consumer ID. Once started
+ * with start(), the fan-out queues all its requests to the camera.
+ *
+ * When a request completes, it is added to the queue of every consumer, and
+ * the requestAvailable signal is emitted with the consumer ID. Consumers
+ * retrieve requests from their queue with acquire(), and return them with
+ * release() when they're done with the buffers. The request is recycled and
+ * queued back to the camera when it has been released by all the consumers it
+ * has been given to.
+ *
+ * The queue of each consumer is bounded by the depth specified when adding
+ * the consumer. When a consumer falls behind and its queue is full, its drop
+ * policy selects whether the oldest request in the queue is dropped to make
+ * space for the new one, or the new request is not added to the queue. Dropped
+ * requests are recycled as soon as no other consumer holds them, so a slow
+ * consumer doesn't stall the others. Requests acquired by a consumer are never
+ * taken back, a consumer that doesn't release them will eventually starve the
+ * camera.
+ *
+ * Sharing buffers across processes isn't handled by this class. The dmabuf file
+ * descriptors of the buffers can be passed to other processes by a broker built
+ * on top of it.
+ */
+
+/**
+ * \enum RequestFanout::DropPolicy
+ * \brief Policy applied when the queue of a consumer is full
+ * \var RequestFanout::DropPolicy::DropOldest
+ * \brief Drop the oldest request in the queue to make space for the new one
+ * \var RequestFanout::DropPolicy::DropNewest
+ * \brief Don't add the new request to the queue
+ */
+
+/**
+ * \brief Construct a RequestFanout for a camera
+ * \param[in] camera The camera whose requests are distributed
+ *
+ * The camera shall be acquired and configured by the application.
+ */
+RequestFanout::RequestFanout(std::shared_ptr<Camera> camera)
+	: Extensible(std::make_unique<Private>(std::move(camera)))
+{
+}
+
+RequestFanout::~RequestFanout() = default;
+
+/**
+ * \brief Register a consumer
+ * \param[in] queueDepth The maximum number of requests waiting to be acquired
+ * by the consumer
+ * \param[in] policy The policy applied when the queue of the consumer is full
+ *
+ * Consumers can only be added while the fan-out is stopped.
+ *
+ * \return The consumer ID on success or a negative error code otherwise
+ * \retval -EBUSY The fan-out is running
+ * \retval -EINVAL The \a queueDepth is zero
+ */
+int RequestFanout::addConsumer(unsigned int queueDepth, DropPolicy policy)
+{
+	Private *const d = _d();
+
+	if (!queueDepth)
+		return -EINVAL;
+
+	MutexLocker locker(d->mutex_);
+
+	if (d->running_)
+		return -EBUSY;
+
+	d->consumers_.push_back({ queueDepth, policy, {} });
+
+	return d->consumers_.size() - 1;
+}
+
+/**
+ * \brief Transfer the ownership of a request to the fan-out
+ * \param[in] request The request
+ *
+ * The request shall have been created by the camera of the fan-out, and its
+ * buffers added. Requests can only be added while the fan-out is stopped.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The fan-out is running
+ * \retval -EINVAL The request is null
+ */
+int RequestFanout::addRequest(std::unique_ptr<Request> request)
+{
+	Private *const d = _d();
+
+	if (!request)
+		return -EINVAL;
+
+	MutexLocker locker(d->mutex_);
+
+	if (d->running_)
+		return -EBUSY;
+
+	d->refs_[request.get()] = 0;
+	d->requests_.push_back(std::move(request));
+
+	return 0;
+}
+
+/**
+ * \brief Start the camera and queue the requests
+ * \param[in] controls Controls to be applied before starting the camera
+ *
+ * Start the camera and queue all the requests that are not held by any
+ * consumer.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int RequestFanout::start(const ControlList *controls)
+{
+	Private *const d = _d();
+	std::vector<Request *> idle;
+
+	int ret = d->camera_->start(controls);
+	if (ret < 0)
+		return ret;
+
+	{
+		MutexLocker locker(d->mutex_);
+
+		d->running_ = true;
+
+		for (const std::unique_ptr<Request> &request : d->requests_) {
+			if (!d->refs_[request.get()])
+				idle.push_back(request.get());
+		}
+	}
+
+	d->recycle(idle);
+
+	return 0;
+}
+
+/**
+ * \brief Stop the camera
+ *
+ * Stop the camera. Requests that are waiting to be acquired stay in the
+ * consumer queues, and acquired requests stay valid until released.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int RequestFanout::stop()
+{
+	Private *const d = _d();
+
+	{
+		MutexLocker locker(d->mutex_);
+		d->running_ = false;
+	}
+
+	return d->camera_->stop();
+}
+
+/**
+ * \brief Retrieve the oldest request waiting in the queue of a consumer
+ * \param[in] consumer The consumer ID
+ *
+ * The returned request stays valid, and its buffers are not reused, until the
+ * consumer releases it with release().
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The request, or nullptr if the queue of the consumer is empty
+ */
+const Request *RequestFanout::acquire(unsigned int consumer)
+{
+	Private *const d = _d();
+
+	MutexLocker locker(d->mutex_);
+
+	if (consumer >= d->consumers_.size())
+		return nullptr;
+
+	std::deque<Request *> &ready = d->consumers_[consumer].ready;
+	if (ready.empty())
+		return nullptr;
+
+	Request *request = ready.front();
+	ready.pop_front();
+
+	return request;
+}
+
+/**
+ * \brief Release a request acquired by a consumer
+ * \param[in] request The request
+ *
+ * The request is queued back to the camera when all the consumers it has been
+ * given to have released it.
+ *
+ * \context This function is \threadsafe.
+ */
+void RequestFanout::release(const Request *request)
+{
+	Private *const d = _d();
+	Request *unused = nullptr;
+
+	{
+		MutexLocker locker(d->mutex_);
+
+		auto iter = d->refs_.find(request);
+		if (iter == d->refs_.end() || !iter->second) {
+			LOG(RequestFanout, Error) << "Releasing a request not held";
+			return;
+		}
+
+		if (!--iter->second)
+			unused = const_cast<Request *>(request);
+	}
+
+	if (unused)
+		d->recycle({ unused });
+}
+
+/**
+ * \var RequestFanout::requestAvailable
+ * \brief Signal emitted when a request is added to the queue of a consumer
+ *
+ * The signal carries the consumer ID. It is emitted from the camera manager
+ * thread.
+ */
+
+} /* namespace libcamera */
@@ -9,9 +9,14 @@
 
 #include <algorithm>
 #include <cmath>
+#include <ctype.h>
+#include <errno.h>
 #include <float.h>
+#include <fstream>
 #include <limits.h>
+#include <sstream>
 #include <string.h>
+#include <unistd.h>
 
 #include <libcamera/base/utils.h>
 
@@ -23,6 +28,7 @@
 #include "libcamera/internal/camera_lens.h"
 #include "libcamera/internal/camera_sensor_properties.h"
 #include "libcamera/internal/media_device.h"
+#include "libcamera/internal/startup_profile.h"
 #include "libcamera/internal/sysfs.h"
 
 /**
@@ -34,6 +40,12 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(CameraSensor)
 
+namespace {
+
+constexpr const char *kModeCacheHeader = "# libcamera sensor modes 1";
+
+} /* namespace */
+
 /**
  * \class CameraSensor
  * \brief A camera sensor based on V4L2 subdevices
@@ -77,6 +89,8 @@ CameraSensor::~CameraSensor()
  */
 int CameraSensor::init()
 {
+	StartupProfile::Scope scope("sensor_init", entity_->name());
+
 	for (const MediaPad *pad : entity_->pads()) {
 		if (pad->flags() & MEDIA_PAD_FL_SOURCE) {
 			pad_ = pad->index();
@@ -119,27 +133,9 @@ int CameraSensor::init()
 		ctrls.set(V4L2_CID_VFLIP, 0);
 	subdev_->setControls(&ctrls);
 
-	/* Enumerate, sort and cache media bus codes and sizes. */
-	formats_ = subdev_->formats(pad_);
-	if (formats_.empty()) {
-		LOG(CameraSensor, Error) << "No image format found";
-		return -EINVAL;
-	}
-
-	mbusCodes_ = utils::map_keys(formats_);
-	std::sort(mbusCodes_.begin(), mbusCodes_.end());
-
-	for (const auto &format : formats_) {
-		const std::vector<SizeRange> &ranges = format.second;
-		std::transform(ranges.begin(), ranges.end(), std::back_inserter(sizes_),
-			       [](const SizeRange &range) { return range.max; });
-	}
-
-	std::sort(sizes_.begin(), sizes_.end());
-
-	/* Remove duplicates. */
-	auto last = std::unique(sizes_.begin(), sizes_.end());
-	sizes_.erase(last, sizes_.end());
+	ret = initModes();
+	if (ret)
+		return ret;
 
 	/*
 	 * VIMC is a bit special, as it does not yet support all the mandatory
@@ -200,6 +196,151 @@ int CameraSensor::init()
 	return applyTestPatternMode(controls::draft::TestPatternModeEnum::TestPatternModeOff);
 }
 
+/*
+ * Build the table of modes supported by the sensor, from the mode cache if
+ * available, or by enumerating the media bus codes and frame sizes on the
+ * subdevice otherwise. The latter requires one ioctl per code and size, which
+ * is slow for sensors that support many modes.
+ */
+int CameraSensor::initModes()
+{
+	const std::string cachePath = modeCachePath();
+
+	if (cachePath.empty() || !loadModes(cachePath)) {
+		modes_.clear();
+
+		V4L2Subdevice::Formats formats = subdev_->formats(pad_);
+		for (const auto &[code, ranges] : formats) {
+			for (const SizeRange &range : ranges)
+				modes_.push_back({ code, range.max });
+		}
+
+		if (!modes_.empty() && !cachePath.empty())
+			storeModes(cachePath);
+	}
+
+	if (modes_.empty()) {
+		LOG(CameraSensor, Error) << "No image format found";
+		return -EINVAL;
+	}
+
+	std::stable_sort(modes_.begin(), modes_.end(),
+			 [](const Mode &a, const Mode &b) {
+				 return a.size.width * a.size.height <
+					b.size.width * b.size.height;
+			 });
+
+	/* Cache the sorted media bus codes and sizes. */
+	mbusCodes_.clear();
+	sizes_.clear();
+
+	for (const Mode &mode : modes_) {
+		mbusCodes_.push_back(mode.code);
+		sizes_.push_back(mode.size);
+	}
+
+	std::sort(mbusCodes_.begin(), mbusCodes_.end());
+	mbusCodes_.erase(std::unique(mbusCodes_.begin(), mbusCodes_.end()),
+			 mbusCodes_.end());
+
+	std::sort(sizes_.begin(), sizes_.end());
+	sizes_.erase(std::unique(sizes_.begin(), sizes_.end()), sizes_.end());
+
+	return 0;
+}
+
+/*
+ * The mode cache is stored in the directory pointed to by the
+ * LIBCAMERA_SENSOR_MODES_CACHE environment variable, in one file per sensor.
+ * The file name is made of the sensor entity name, the media device driver
+ * name and the kernel driver version to invalidate the cache when the driver
+ * changes.
+ */
+std::string CameraSensor::modeCachePath() const
+{
+	const char *dir = utils::secure_getenv("LIBCAMERA_SENSOR_MODES_CACHE");
+	if (!dir || !*dir)
+		return {};
+
+	const MediaDevice *media = entity_->device();
+
+	std::ostringstream name;
+	name << entity_->name() << "-" << media->driver() << "-"
+	     << utils::hex(media->version(), 6);
+
+	std::string file = name.str();
+	std::replace_if(file.begin(), file.end(),
+			[](char c) { return !isalnum(c) && c != '-' && c != '.'; },
+			'_');
+
+	return std::string(dir) + "/" + file + ".modes";
+}
+
+bool CameraSensor::loadModes(const std::string &path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		return false;
+
+	std::string header;
+	if (!std::getline(file, header) || header != kModeCacheHeader)
+		return false;
+
+	modes_.clear();
+
+	unsigned int code;
+	unsigned int width;
+	unsigned int height;
+
+	while (file >> std::hex >> code >> std::dec >> width >> height)
+		modes_.push_back({ code, Size(width, height) });
+
+	if (!file.eof() || modes_.empty()) {
+		LOG(CameraSensor, Warning) << "Invalid mode cache " << path;
+		return false;
+	}
+
+	LOG(CameraSensor, Debug)
+		<< "Loaded " << modes_.size() << " modes from " << path;
+
+	return true;
+}
+
+void CameraSensor::storeModes(const std::string &path) const
+{
+	/* Write to a temporary file and rename it to update the cache atomically. */
+	const std::string tmpPath = path + ".tmp";
+
+	{
+		std::ofstream file(tmpPath, std::ios::trunc);
+		if (!file.is_open()) {
+			LOG(CameraSensor, Warning)
+				<< "Can't create mode cache " << path;
+			return;
+		}
+
+		file << kModeCacheHeader << "\n";
+
+		for (const Mode &mode : modes_)
+			file << std::hex << mode.code << std::dec << " "
+			     << mode.size.width << " " << mode.size.height << "\n";
+
+		if (!file.good()) {
+			LOG(CameraSensor, Warning)
+				<< "Failed to write mode cache " << path;
+			unlink(tmpPath.c_str());
+			return;
+		}
+	}
+
+	if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+		LOG(CameraSensor, Warning)
+			<< "Failed to update mode cache " << path << ": "
+			<< strerror(errno);
+		unlink(tmpPath.c_str());
+	}
+}
+
 int CameraSensor::generateId()
 {
 	const std::string devPath = subdev_->devicePath();
@@ -630,13 +771,10 @@ std::vector<Size> CameraSensor::sizes(unsigned int mbusCode) const
 {
 	std::vector<Size> sizes;
 
-	const auto &format = formats_.find(mbusCode);
-	if (format == formats_.end())
-		return sizes;
-
-	const std::vector<SizeRange> &ranges = format->second;
-	std::transform(ranges.begin(), ranges.end(), std::back_inserter(sizes),
-		       [](const SizeRange &range) { return range.max; });
+	for (const Mode &mode : modes_) {
+		if (mode.code == mbusCode)
+			sizes.push_back(mode.size);
+	}
 
 	std::sort(sizes.begin(), sizes.end());
 
@@ -704,35 +842,55 @@ V4L2SubdeviceFormat CameraSensor::getFormat(const std::vector<unsigned int> &mbu
 	unsigned int bestArea = UINT_MAX;
 	float desiredRatio = static_cast<float>(size.width) / size.height;
 	float bestRatio = FLT_MAX;
+	unsigned int bestRank = UINT_MAX;
 	const Size *bestSize = nullptr;
 	uint32_t bestCode = 0;
 
-	for (unsigned int code : mbusCodes) {
-		const auto formats = formats_.find(code);
-		if (formats == formats_.end())
+	/*
+	 * The modes are sorted by area, skip the ones too small to contain the
+	 * desired size.
+	 */
+	auto first = std::lower_bound(modes_.begin(), modes_.end(), desiredArea,
+				      [](const Mode &mode, unsigned int area) {
+					      return mode.size.width * mode.size.height < area;
+				      });
+
+	for (auto mode = first; mode != modes_.end(); ++mode) {
+		const Size &sz = mode->size;
+
+		if (sz.width < size.width || sz.height < size.height)
 			continue;
 
-		for (const SizeRange &range : formats->second) {
-			const Size &sz = range.max;
+		auto code = std::find(mbusCodes.begin(), mbusCodes.end(), mode->code);
+		if (code == mbusCodes.end())
+			continue;
 
-			if (sz.width < size.width || sz.height < size.height)
-				continue;
+		unsigned int rank = code - mbusCodes.begin();
 
-			float ratio = static_cast<float>(sz.width) / sz.height;
-			float ratioDiff = std::abs(ratio - desiredRatio);
-			unsigned int area = sz.width * sz.height;
-			unsigned int areaDiff = area - desiredArea;
+		float ratio = static_cast<float>(sz.width) / sz.height;
+		float ratioDiff = std::abs(ratio - desiredRatio);
+		unsigned int area = sz.width * sz.height;
+		unsigned int areaDiff = area - desiredArea;
 
-			if (ratioDiff > bestRatio)
-				continue;
+		/*
+		 * Prefer the closest aspect ratio, then the smallest size, then
+		 * the most preferred media bus code.
+		 */
+		if (ratioDiff > bestRatio)
+			continue;
 
-			if (ratioDiff < bestRatio || areaDiff < bestArea) {
-				bestRatio = ratioDiff;
-				bestArea = areaDiff;
-				bestSize = &sz;
-				bestCode = code;
-			}
+		if (ratioDiff == bestRatio) {
+			if (areaDiff > bestArea)
+				continue;
+			if (areaDiff == bestArea && rank >= bestRank)
+				continue;
 		}
+
+		bestRatio = ratioDiff;
+		bestArea = areaDiff;
+		bestRank = rank;
+		bestSize = &sz;
+		bestCode = mode->code;
 	}
 
 	if (!bestSize) {
@@ -52,8 +52,9 @@ SharedMem::SharedMem() = default;
  * \param[in] name Name of the SharedMem
  * \param[in] size Size of the shared memory to allocate and map
  *
- * The \a name is used for debugging purpose only. Multiple SharedMem instances
- * can have the same name.
+ * The \a name is used for debugging purpose and as the category of the
+ * allocation in the memory accounting (see MemoryAccount). Multiple SharedMem
+ * instances can have the same name.
  */
 SharedMem::SharedMem(const std::string &name, std::size_t size)
 {
@@ -71,7 +72,21 @@ SharedMem::SharedMem(const std::string &name, std::size_t size)
 		return;
 	}
 
+#ifdef MADV_HUGEPAGE
+	/*
+	 * Let objects spanning huge pages, using the most common huge page
+	 * size, be backed by transparent huge pages. This is only an advice,
+	 * ignored when shmem THP is disabled, and it doesn't constrain the
+	 * mappings created by other processes.
+	 */
+	static constexpr std::size_t kHugePageSize = 2 << 20;
+
+	if (size >= kHugePageSize)
+		madvise(mem, size, MADV_HUGEPAGE);
+#endif
+
 	mem_ = { static_cast<uint8_t *>(mem), size };
+	account_ = MemoryAccount(name, MemoryAccount::Heap::MemFd, size);
 }
 
 /**
@@ -82,6 +97,7 @@ SharedMem::SharedMem(SharedMem &&rhs)
 {
 	this->fd_ = std::move(rhs.fd_);
 	this->mem_ = rhs.mem_;
+	this->account_ = std::move(rhs.account_);
 	rhs.mem_ = {};
 }
 
@@ -111,6 +127,7 @@ SharedMem &SharedMem::operator=(SharedMem &&rhs)
 {
 	this->fd_ = std::move(rhs.fd_);
 	this->mem_ = rhs.mem_;
+	this->account_ = std::move(rhs.account_);
 	rhs.mem_ = {};
 	return *this;
 }
@@ -175,8 +192,9 @@ SharedMem &SharedMem::operator=(SharedMem &&rhs)
  * \param[in] name Name of the SharedMemObject
  * \param[in] args Arguments to pass to the constructor of the object T
  *
- * The \a name is used for debugging purpose only. Multiple SharedMem instances
- * can have the same name.
+ * The \a name is used for debugging purpose and as the category of the
+ * allocation in the memory accounting (see MemoryAccount). Multiple SharedMem
+ * instances can have the same name.
  */
 
 /**
@@ -23,11 +23,27 @@ namespace libcamera {
  * \brief Size of a color lookup table
  */
 
+/**
+ * \var DebayerParams::kGammaLookupSize
+ * \brief Size of the gamma lookup table
+ */
+
+/**
+ * \var DebayerParams::kCcmShift
+ * \brief Number of fractional bits of the colour correction matrix
+ * coefficients
+ */
+
 /**
  * \typedef DebayerParams::ColorLookupTable
  * \brief Type of the lookup tables for red, green, blue values
  */
 
+/**
+ * \typedef DebayerParams::GammaLookupTable
+ * \brief Type of the gamma lookup table
+ */
+
 /**
  * \var DebayerParams::red
  * \brief Lookup table for red color, mapping input values to output values
@@ -43,28 +59,102 @@ namespace libcamera {
  * \brief Lookup table for blue color, mapping input values to output values
  */
 
+/**
+ * \var DebayerParams::gamma
+ * \brief Lookup table applied after the colour correction matrix
+ *
+ * The table maps the colour corrected values, with two more bits of precision
+ * than the red, green and blue lookup tables outputs, to output values. It is
+ * only used when ccmEnabled is true.
+ */
+
+/**
+ * \var DebayerParams::lutVersion
+ * \brief Version of the lookup tables
+ *
+ * The version is changed every time the contents of the lookup tables,
+ * including the gamma table, change, and is never 0 for valid tables. Debayer
+ * implementations may skip updating their lookup tables when the version
+ * matches the one they last applied.
+ */
+
+/**
+ * \var DebayerParams::ccmEnabled
+ * \brief Apply the colour correction matrix
+ *
+ * When colour correction is enabled, the red, green and blue lookup tables
+ * map the input values to linear values, which are multiplied by the ccm
+ * matrix and then mapped to output values by the gamma lookup table, all in
+ * the same pass. Otherwise the red, green and blue lookup tables produce the
+ * output values directly.
+ */
+
+/**
+ * \var DebayerParams::ccm
+ * \brief Colour correction matrix
+ *
+ * The 3x3 matrix is stored in row-major order, for red, green and blue rows
+ * and columns, as signed fixed-point values with kCcmShift fractional bits.
+ */
+
 /**
  * \class Debayer
  * \brief Base debayering class
  *
  * Base class that provides functions for setting up the debayering process.
+ *
+ * Debayering implementations gather statistics on the input frames in the
+ * buffers of a SwStatsCpu instance, which hands them over to the IPA.
  */
 
 LOG_DEFINE_CATEGORY(Debayer)
 
+/**
+ * \brief Construct a Debayer object
+ * \param[in] stats Pointer to the stats object to use
+ */
+Debayer::Debayer(std::unique_ptr<SwStatsCpu> stats)
+	: stats_(std::move(stats))
+{
+}
+
 Debayer::~Debayer()
 {
 }
 
 /**
- * \fn int Debayer::configure(const StreamConfiguration &inputCfg, const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
+ * \fn int Debayer::configure(const StreamConfiguration &inputCfg, const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs, Transform transform)
  * \brief Configure the debayer object according to the passed in parameters
  * \param[in] inputCfg The input configuration
  * \param[in] outputCfgs The output configurations
+ * \param[in] transform The transform applied to the debayered frame
+ *
+ * The \a transform is applied when writing the output, the size of the output
+ * configurations is thus transposed when \a transform contains a
+ * transposition. It shall be supported as reported by supportsTransform().
+ *
+ * Up to maxOutputs() output configurations may be passed. The outputs after
+ * the first one shall be sized as reported by secondarySize().
  *
  * \return 0 on success, a negative errno on failure
  */
 
+/**
+ * \brief Check if a transform can be applied to an output format
+ * \param[in] outputFormat The output format
+ * \param[in] transform The transform
+ *
+ * The default implementation only supports the identity transform.
+ *
+ * \return True if the debayer object can write \a outputFormat frames
+ * transformed by \a transform, false otherwise
+ */
+bool Debayer::supportsTransform([[maybe_unused]] PixelFormat outputFormat,
+				Transform transform)
+{
+	return transform == Transform::Identity;
+}
+
 /**
  * \fn Size Debayer::patternSize(PixelFormat inputFormat)
  * \brief Get the width and height at which the bayer pattern repeats
@@ -94,29 +184,177 @@ Debayer::~Debayer()
  */
 
 /**
- * \fn void Debayer::process(uint32_t frame, FrameBuffer *input, FrameBuffer *output, DebayerParams params)
+ * \struct DebayerFrameTiming
+ * \brief Timing information of a frame processed by a Debayer
+ *
+ * The timing information is not used by the Debayer. It is passed through
+ * Debayer::process() to the Debayer::inputBufferReady signal of the frame, to
+ * let the caller measure the processing latency without sharing per-frame
+ * state with the thread processing frames.
+ *
+ * \var DebayerFrameTiming::queued
+ * \brief The time at which the frame has been queued for processing
+ *
+ * \var DebayerFrameTiming::interval
+ * \brief The interval between the frame and the previous input frame, zero
+ * if unknown
+ */
+
+/**
+ * \fn void Debayer::process(uint32_t frame, FrameBuffer *input, const std::vector<FrameBuffer *> &outputs, const DebayerParams *params, const DebayerFrameTiming &timing)
  * \brief Process the bayer data into the requested format
  * \param[in] frame The frame number
  * \param[in] input The input buffer
- * \param[in] output The output buffer
+ * \param[in] outputs The output buffers
  * \param[in] params The parameters to be used in debayering
+ * \param[in] timing The timing of the frame, passed to inputBufferReady
  *
- * \note DebayerParams is passed by value deliberately so that a copy is passed
- * when this is run in another thread by invokeMethod().
+ * The \a outputs are ordered as the output configurations passed to
+ * configure(). Entries may be null for the outputs that are not produced for
+ * \a frame, but at least one of them shall be a valid buffer.
+ *
+ * The \a params point to the per-frame parameters buffer filled by the IPA for
+ * \a frame. The buffer is not reused for another frame before processing of
+ * \a frame completes, so it is read in place instead of being copied through
+ * the message queue when this is run in another thread by invokeMethod().
  */
 
 /**
- * \fn virtual SizeRange Debayer::sizes(PixelFormat inputFormat, const Size &inputSize)
  * \brief Get the supported output sizes for the given input format and size
  * \param[in] inputFormat The input format
  * \param[in] inputSize The input size
  *
+ * A border of one pattern is kept around the whole image for the
+ * interpolation, except at the top and bottom for patterns of height 2.
+ *
  * \return The valid size ranges or an empty range if there are none
  */
+SizeRange Debayer::sizes(PixelFormat inputFormat, const Size &inputSize)
+{
+	Size patternSize = this->patternSize(inputFormat);
+	unsigned int borderHeight = patternSize.height;
+
+	if (patternSize.isNull())
+		return {};
+
+	/* No need for top/bottom border with a pattern height of 2 */
+	if (patternSize.height == 2)
+		borderHeight = 0;
+
+	/*
+	 * For debayer interpolation a border is kept around the entire image
+	 * and the minimum output size is pattern-height x pattern-width.
+	 */
+	if (inputSize.width < (3 * patternSize.width) ||
+	    inputSize.height < (2 * borderHeight + patternSize.height)) {
+		LOG(Debayer, Warning)
+			<< "Input format size too small: " << inputSize.toString();
+		return {};
+	}
+
+	return SizeRange(Size(patternSize.width, patternSize.height),
+			 Size((inputSize.width - 2 * patternSize.width) & ~(patternSize.width - 1),
+			      (inputSize.height - 2 * borderHeight) & ~(patternSize.height - 1)),
+			 patternSize.width, patternSize.height);
+}
 
 /**
- * \var Signal<FrameBuffer *> Debayer::inputBufferReady
+ * \fn unsigned int Debayer::maxOutputs() const
+ * \brief Get the maximum number of outputs produced from one input frame
+ *
+ * The default implementation supports a single output.
+ *
+ * \return The maximum number of output configurations accepted by configure()
+ */
+
+/**
+ * \brief Get the size of a secondary output
+ * \param[in] outputFormat The secondary output format
+ * \param[in] primarySize The size of the first output
+ * \param[in] size The requested secondary output size
+ *
+ * Outputs other than the first one, called secondary outputs, are produced
+ * in the same pass as the first output, from the same debayered pixels. Their
+ * formats and sizes are constrained by the first output. This function
+ * returns the supported size closest to \a size, for secondary outputs in
+ * \a outputFormat.
+ *
+ * The default implementation doesn't support secondary outputs.
+ *
+ * \return The secondary output size, or an empty size if \a outputFormat
+ * can't be produced as a secondary output
+ */
+Size Debayer::secondarySize([[maybe_unused]] PixelFormat outputFormat,
+			    [[maybe_unused]] const Size &primarySize,
+			    [[maybe_unused]] const Size &size)
+{
+	return {};
+}
+
+/**
+ * \fn void Debayer::stop()
+ * \brief Stop processing frames
+ *
+ * This function is called in the thread processing frames, before the thread
+ * stops, to release resources bound to that thread. The default
+ * implementation does nothing.
+ */
+
+/**
+ * \fn unsigned int Debayer::frameSize(unsigned int output)
+ * \brief Get the output frame size
+ * \param[in] output The output index, in the order of the configure() outputs
+ *
+ * \return The output frame size
+ */
+
+/**
+ * \fn const std::vector<unsigned int> &Debayer::planeSizes(unsigned int output)
+ * \brief Get the size of each plane of the output frame
+ * \param[in] output The output index, in the order of the configure() outputs
+ *
+ * \return The output plane sizes
+ */
+
+/**
+ * \fn std::vector<SharedFD> Debayer::getStatsFDs()
+ * \brief Get the file descriptors for the statistics buffers
+ *
+ * \return The file descriptors pointing to the statistics buffers
+ */
+
+/**
+ * \fn void Debayer::releaseStatsBuffer(uint32_t bufferId)
+ * \brief Return a statistics buffer once processed
+ * \param[in] bufferId ID of the statistics buffer
+ */
+
+/**
+ * \fn void Debayer::releaseStatsBuffers()
+ * \brief Reclaim all statistics buffers once streaming is stopped
+ */
+
+/**
+ * \fn void Debayer::setStatsThrottle(unsigned int factor)
+ * \brief Lower the statistics resolution from the next frame
+ * \param[in] factor The factor to multiply the statistics subsampling factor by
+ *
+ * This function shall be called in the thread of the Debayer, between frames.
+ *
+ * \sa SwStatsCpu::setThrottle()
+ */
+
+/**
+ * \var Debayer::stats_
+ * \brief The statistics object the statistics are gathered in
+ */
+
+/**
+ * \var Signal<FrameBuffer *, const DebayerFrameTiming &> Debayer::inputBufferReady
  * \brief Signals when the input buffer is ready
+ *
+ * The signal is emitted last when processing a frame, after the
+ * outputBufferReady signals of the frame, with the timing passed to process().
  */
 
 /**
@@ -11,42 +11,79 @@
 
 #pragma once
 
+#include <memory>
 #include <stdint.h>
+#include <vector>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/signal.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/geometry.h>
 #include <libcamera/stream.h>
+#include <libcamera/transform.h>
 
 #include "libcamera/internal/software_isp/debayer_params.h"
 
+#include "swstats_cpu.h"
+
 namespace libcamera {
 
 class FrameBuffer;
 
 LOG_DECLARE_CATEGORY(Debayer)
 
-class Debayer
+struct DebayerFrameTiming {
+	utils::time_point queued;
+	utils::Duration interval;
+};
+
+class Debayer : public Object
 {
 public:
+	Debayer(std::unique_ptr<SwStatsCpu> stats);
 	virtual ~Debayer() = 0;
 
 	virtual int configure(const StreamConfiguration &inputCfg,
-			      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs) = 0;
+			      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+			      Transform transform) = 0;
 
 	virtual std::vector<PixelFormat> formats(PixelFormat inputFormat) = 0;
 
+	virtual bool supportsTransform(PixelFormat outputFormat, Transform transform);
+
 	virtual std::tuple<unsigned int, unsigned int>
 	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size) = 0;
 
-	virtual void process(uint32_t frame, FrameBuffer *input, FrameBuffer *output, DebayerParams params) = 0;
+	virtual void process(uint32_t frame, FrameBuffer *input,
+			     const std::vector<FrameBuffer *> &outputs,
+			     const DebayerParams *params,
+			     const DebayerFrameTiming &timing) = 0;
+
+	virtual SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
 
-	virtual SizeRange sizes(PixelFormat inputFormat, const Size &inputSize) = 0;
+	virtual unsigned int maxOutputs() const { return 1; }
+	virtual Size secondarySize(PixelFormat outputFormat, const Size &primarySize,
+				   const Size &size);
 
-	Signal<FrameBuffer *> inputBufferReady;
+	virtual void stop() {}
+
+	virtual unsigned int frameSize(unsigned int output) = 0;
+	virtual const std::vector<unsigned int> &planeSizes(unsigned int output) = 0;
+
+	std::vector<SharedFD> getStatsFDs() { return stats_->getStatsFDs(); }
+	void releaseStatsBuffer(uint32_t bufferId) { stats_->releaseBuffer(bufferId); }
+	void releaseStatsBuffers() { stats_->releaseBuffers(); }
+	void setStatsThrottle(unsigned int factor) { stats_->setThrottle(factor); }
+
+	Signal<FrameBuffer *, const DebayerFrameTiming &> inputBufferReady;
 	Signal<FrameBuffer *> outputBufferReady;
 
+protected:
+	std::unique_ptr<SwStatsCpu> stats_;
+
 private:
 	virtual Size patternSize(PixelFormat inputFormat) = 0;
 };
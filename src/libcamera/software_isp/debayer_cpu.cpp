@@ -11,17 +11,31 @@
 
 #include "debayer_cpu.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <numeric>
 #include <stdlib.h>
-#include <sys/ioctl.h>
+#include <string>
+#include <thread>
 #include <time.h>
 
-#include <linux/dma-buf.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <libcamera/base/utils.h>
 
 #include <libcamera/formats.h>
 
 #include "libcamera/internal/bayer_format.h"
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/tracepoints.h"
 
 namespace libcamera {
 
@@ -37,25 +51,144 @@ namespace libcamera {
  * \param[in] stats Pointer to the stats object to use
  */
 DebayerCpu::DebayerCpu(std::unique_ptr<SwStatsCpu> stats)
-	: stats_(std::move(stats))
+	: Debayer(std::move(stats)), inputMaps_(MappedFrameBuffer::MapFlag::Read),
+	  outputMaps_(MappedFrameBuffer::MapFlag::Write,
+		      kMaxOutputs * MappedFrameBufferCache::kDefaultMaxEntries),
+	  copyAccount_("softisp_debayer")
 {
 	/*
 	 * Reading from uncached buffers may be very slow.
 	 * In such a case, it's better to copy input buffer data to normal memory.
 	 * But in case of cached buffers, copying the data is unnecessary overhead.
-	 * enable_input_memcpy_ makes this behavior configurable.  At the moment, we
-	 * always set it to true as the safer choice but this should be changed in
-	 * future.
+	 * The input buffers are allocated by the capture device, so their heap
+	 * type is unknown. Start with memcpy enabled as the safer choice, and
+	 * let probeInputMemcpy() decide on the first frame of each
+	 * configuration.
 	 */
 	enableInputMemcpy_ = true;
+	inputMemcpyProbed_ = false;
 
 	/* Initialize color lookup tables */
 	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
 		red_[i] = green_[i] = blue_[i] = i;
+	for (unsigned int i = 0; i < DebayerParams::kGammaLookupSize; i++)
+		gamma_[i] = i * DebayerParams::kRGBLookupSize / DebayerParams::kGammaLookupSize;
+	lutVersion_ = 0;
+	ccmEnabled_ = false;
+
+#if defined(__x86_64__) || defined(__i386__)
+	ccmAVX2_ = __builtin_cpu_supports("avx2");
+#else
+	ccmAVX2_ = false;
+#endif
+
+	/*
+	 * The frame is split in horizontal stripes, debayered in parallel by
+	 * the calling thread and threadCount_ - 1 stripe workers. Default to
+	 * one thread per CPU, limited to kDefaultMaxThreads, unless overridden
+	 * by the LIBCAMERA_SOFTISP_THREADS environment variable.
+	 */
+	threadCount_ = std::clamp(std::thread::hardware_concurrency(),
+				  1U, kDefaultMaxThreads);
+
+	const char *threads = utils::secure_getenv("LIBCAMERA_SOFTISP_THREADS");
+	if (threads) {
+		char *end;
+		unsigned long value = strtoul(threads, &end, 10);
+		if (*end != '\0' || value == 0)
+			LOG(Debayer, Warning)
+				<< "Invalid software ISP thread count '"
+				<< threads << "', using " << threadCount_;
+		else
+			threadCount_ = value;
+	}
+
+	for (unsigned int i = 1; i < threadCount_; i++) {
+		workers_.push_back(std::make_unique<StripeWorker>(this, i));
+		workers_.back()->start();
+	}
 }
 
 DebayerCpu::~DebayerCpu() = default;
 
+/**
+ * \class DebayerCpu::StripeWorker
+ * \brief Worker thread debayering one stripe of each frame
+ *
+ * Stripe workers run their own loop instead of an event loop, to avoid
+ * allocating a message for each stripe of each frame.
+ */
+
+DebayerCpu::StripeWorker::StripeWorker(DebayerCpu *debayer, unsigned int stripe)
+	: Thread("SoftIspStripe" + std::to_string(stripe)), debayer_(debayer),
+	  stripe_(stripe), src_(nullptr), dst_(nullptr),
+	  pending_(false), running_(false)
+{
+	setRole(Role::LatencyCritical);
+}
+
+DebayerCpu::StripeWorker::~StripeWorker()
+{
+	{
+		MutexLocker locker(mutex_);
+		running_ = false;
+	}
+
+	cv_.notify_one();
+	wait();
+}
+
+void DebayerCpu::StripeWorker::start()
+{
+	{
+		MutexLocker locker(mutex_);
+		running_ = true;
+	}
+
+	Thread::start();
+}
+
+/*
+ * Queue the stripe of a frame for processing. Completion is signalled by
+ * releasing the DebayerCpu::stripesDone_ semaphore.
+ */
+void DebayerCpu::StripeWorker::queueFrame(const uint8_t *src, uint8_t *dst)
+{
+	{
+		MutexLocker locker(mutex_);
+		ASSERT(!pending_);
+		src_ = src;
+		dst_ = dst;
+		pending_ = true;
+	}
+
+	cv_.notify_one();
+}
+
+void DebayerCpu::StripeWorker::run()
+{
+	MutexLocker locker(mutex_);
+
+	while (1) {
+		cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return !running_ || pending_;
+		});
+
+		if (!running_)
+			break;
+
+		const uint8_t *src = src_;
+		uint8_t *dst = dst_;
+		locker.unlock();
+
+		debayer_->processStripe(stripe_, src, dst);
+
+		locker.lock();
+		pending_ = false;
+		debayer_->stripesDone_.release();
+	}
+}
+
 #define DECLARE_SRC_POINTERS(pixel_t)                            \
 	const pixel_t *prev = (const pixel_t *)src[0] + xShift_; \
 	const pixel_t *curr = (const pixel_t *)src[1] + xShift_; \
@@ -114,33 +247,33 @@ DebayerCpu::~DebayerCpu() = default;
 	x++;
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer8_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer8_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
 	DECLARE_SRC_POINTERS(uint8_t)
 
-	for (int x = 0; x < (int)window_.width;) {
+	for (int x = 0; x < (int)width;) {
 		BGGR_BGR888(1, 1, 1)
 		GBRG_BGR888(1, 1, 1)
 	}
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer8_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer8_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
 	DECLARE_SRC_POINTERS(uint8_t)
 
-	for (int x = 0; x < (int)window_.width;) {
+	for (int x = 0; x < (int)width;) {
 		GRBG_BGR888(1, 1, 1)
 		RGGB_BGR888(1, 1, 1)
 	}
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
 	DECLARE_SRC_POINTERS(uint16_t)
 
-	for (int x = 0; x < (int)window_.width;) {
+	for (int x = 0; x < (int)width;) {
 		/* divide values by 4 for 10 -> 8 bpp value */
 		BGGR_BGR888(1, 1, 4)
 		GBRG_BGR888(1, 1, 4)
@@ -148,11 +281,11 @@ void DebayerCpu::debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
 	DECLARE_SRC_POINTERS(uint16_t)
 
-	for (int x = 0; x < (int)window_.width;) {
+	for (int x = 0; x < (int)width;) {
 		/* divide values by 4 for 10 -> 8 bpp value */
 		GRBG_BGR888(1, 1, 4)
 		RGGB_BGR888(1, 1, 4)
@@ -160,11 +293,11 @@ void DebayerCpu::debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
 	DECLARE_SRC_POINTERS(uint16_t)
 
-	for (int x = 0; x < (int)window_.width;) {
+	for (int x = 0; x < (int)width;) {
 		/* divide values by 16 for 12 -> 8 bpp value */
 		BGGR_BGR888(1, 1, 16)
 		GBRG_BGR888(1, 1, 16)
@@ -172,11 +305,11 @@ void DebayerCpu::debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
 	DECLARE_SRC_POINTERS(uint16_t)
 
-	for (int x = 0; x < (int)window_.width;) {
+	for (int x = 0; x < (int)width;) {
 		/* divide values by 16 for 12 -> 8 bpp value */
 		GRBG_BGR888(1, 1, 16)
 		RGGB_BGR888(1, 1, 16)
@@ -184,9 +317,9 @@ void DebayerCpu::debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
-	const int widthInBytes = window_.width * 5 / 4;
+	const int widthInBytes = width * 5 / 4;
 	const uint8_t *prev = src[0];
 	const uint8_t *curr = src[1];
 	const uint8_t *next = src[2];
@@ -210,9 +343,9 @@ void DebayerCpu::debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[])
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
-	const int widthInBytes = window_.width * 5 / 4;
+	const int widthInBytes = width * 5 / 4;
 	const uint8_t *prev = src[0];
 	const uint8_t *curr = src[1];
 	const uint8_t *next = src[2];
@@ -231,9 +364,9 @@ void DebayerCpu::debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[])
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
-	const int widthInBytes = window_.width * 5 / 4;
+	const int widthInBytes = width * 5 / 4;
 	const uint8_t *prev = src[0];
 	const uint8_t *curr = src[1];
 	const uint8_t *next = src[2];
@@ -252,9 +385,9 @@ void DebayerCpu::debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[])
 }
 
 template<bool addAlphaByte>
-void DebayerCpu::debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[])
+void DebayerCpu::debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
 {
-	const int widthInBytes = window_.width * 5 / 4;
+	const int widthInBytes = width * 5 / 4;
 	const uint8_t *prev = src[0];
 	const uint8_t *curr = src[1];
 	const uint8_t *next = src[2];
@@ -272,6 +405,457 @@ void DebayerCpu::debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[])
 	}
 }
 
+/*
+ * Vectorized debayering of unpacked formats.
+ *
+ * The vector kernels compute, for each pixel of a line, the value of the pixel
+ * itself and the horizontal, vertical, cross and diagonal averages of its
+ * neighbours in 16-bit lanes. The averages needed for the pixel colour are
+ * selected based on the pixel column parity, and the results are run through
+ * the lookup tables with scalar code, as lookups can't be vectorized
+ * efficiently. The results are identical to the scalar implementations, which
+ * handle the pixels left over at the end of the line.
+ */
+
+#define DEBAYER_LOOKUP_PIXELS(count)                          \
+	for (unsigned int i = 0; i < (count); i++) {          \
+		*dst++ = blue_[b[i]];                         \
+		*dst++ = green_[g[i]];                        \
+		*dst++ = red_[r[i]];                          \
+		if constexpr (addAlphaByte)                   \
+			*dst++ = 255;                         \
+	}
+
+#define DEBAYER_FINISH_LINE(div)                              \
+	for (; x < (int)width;) {                             \
+		if constexpr (gatherStats)                    \
+			stats.add(curr, next, x, 2);          \
+		if constexpr (bgLine) {                       \
+			BGGR_BGR888(1, 1, div)                \
+			GBRG_BGR888(1, 1, div)                \
+		} else {                                      \
+			GRBG_BGR888(1, 1, div)                \
+			RGGB_BGR888(1, 1, div)                \
+		}                                             \
+	}
+
+namespace {
+
+/*
+ * Statistics of the first line of a line pair, gathered by the debayer
+ * functions for unpacked formats, identical to the ones computed by
+ * SwStatsCpu::processLine0(). Quads are read in the BGGR orientation: on BGBG
+ * lines the current line holds the blue and first green pixels, on GRGR lines
+ * the next line does. The line stays in the L1 cache while it is debayered,
+ * and the quads are read along with the pixels being debayered.
+ */
+template<unsigned int shift, bool bgLine>
+class QuadStats
+{
+public:
+	QuadStats(const SwStatsCpu::LineStats *line)
+		: line_(line), width_(line ? line->width : 0),
+		  step_(line ? line->stepMask + 1 : 1),
+		  sumR_(0), sumG_(0), sumB_(0)
+	{
+	}
+
+	/* Accumulate the sampled quads starting at columns [x, x + count) */
+	template<typename pixel_t>
+	void add(const pixel_t *curr, const pixel_t *next, int x, int count)
+	{
+		const pixel_t *src0 = bgLine ? curr : next;
+		const pixel_t *src1 = bgLine ? next : curr;
+		const int end = std::min(x + count, width_);
+
+		for (int i = utils::alignUp(x, step_); i < end; i += step_) {
+			const unsigned int b = src0[i];
+			const unsigned int g = (src0[i + 1] + src1[i]) / 2;
+			const unsigned int r = src1[i + 1];
+
+			sumR_ += r;
+			sumG_ += g;
+			sumB_ += b;
+
+			line_->stats->yHistogram[SwStatsCpu::yHistogramBin<1 << shift>(r, g, b)]++;
+		}
+	}
+
+	void finish()
+	{
+		line_->stats->sumR_ += sumR_;
+		line_->stats->sumG_ += sumG_;
+		line_->stats->sumB_ += sumB_;
+	}
+
+private:
+	const SwStatsCpu::LineStats *line_;
+	const int width_;
+	const int step_;
+	uint64_t sumR_;
+	uint64_t sumG_;
+	uint64_t sumB_;
+};
+
+} /* namespace */
+
+template<typename pixel_t, unsigned int shift, bool bgLine, bool addAlphaByte>
+void DebayerCpu::debayerStats_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width,
+				     const SwStatsCpu::LineStats *line)
+{
+	constexpr bool gatherStats = true;
+	DECLARE_SRC_POINTERS(pixel_t)
+	QuadStats<shift, bgLine> stats(line);
+	int x = 0;
+
+	DEBAYER_FINISH_LINE(1 << shift)
+
+	stats.finish();
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+namespace {
+
+template<typename pixel_t>
+__attribute__((target("avx2"))) inline __m256i loadPixelsAVX2(const pixel_t *src)
+{
+	if constexpr (sizeof(pixel_t) == 1)
+		return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+	else
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+}
+
+} /* namespace */
+
+template<typename pixel_t, unsigned int shift, bool bgLine, bool addAlphaByte,
+	 bool gatherStats>
+__attribute__((target("avx2"))) void DebayerCpu::debayerAVX2_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width,
+								    const SwStatsCpu::LineStats *line)
+{
+	constexpr unsigned int kPixels = 16;
+	DECLARE_SRC_POINTERS(pixel_t)
+	alignas(32) uint16_t b[kPixels];
+	alignas(32) uint16_t g[kPixels];
+	alignas(32) uint16_t r[kPixels];
+	QuadStats<shift, bgLine> stats(line);
+	int x = 0;
+
+	/* Keep one pixel of margin on the right for the x + 1 neighbours */
+	for (; x + (int)kPixels < (int)width; x += kPixels) {
+		const __m256i c = loadPixelsAVX2(curr + x);
+		const __m256i cl = loadPixelsAVX2(curr + x - 1);
+		const __m256i cr = loadPixelsAVX2(curr + x + 1);
+		const __m256i p = loadPixelsAVX2(prev + x);
+		const __m256i pl = loadPixelsAVX2(prev + x - 1);
+		const __m256i pr = loadPixelsAVX2(prev + x + 1);
+		const __m256i n = loadPixelsAVX2(next + x);
+		const __m256i nl = loadPixelsAVX2(next + x - 1);
+		const __m256i nr = loadPixelsAVX2(next + x + 1);
+
+		const __m256i h = _mm256_add_epi16(cl, cr);
+		const __m256i v = _mm256_add_epi16(p, n);
+
+		const __m256i same = _mm256_srli_epi16(c, shift);
+		const __m256i horz = _mm256_srli_epi16(h, shift + 1);
+		const __m256i vert = _mm256_srli_epi16(v, shift + 1);
+		const __m256i cross = _mm256_srli_epi16(_mm256_add_epi16(h, v), shift + 2);
+		const __m256i diag = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(pl, pr),
+									_mm256_add_epi16(nl, nr)),
+						       shift + 2);
+
+		/* Blend mask 0xaa selects the second operand for odd pixels */
+		__m256i vb, vg, vr;
+		if constexpr (bgLine) {
+			vb = _mm256_blend_epi16(same, horz, 0xaa);
+			vg = _mm256_blend_epi16(cross, same, 0xaa);
+			vr = _mm256_blend_epi16(diag, vert, 0xaa);
+		} else {
+			vb = _mm256_blend_epi16(vert, diag, 0xaa);
+			vg = _mm256_blend_epi16(same, cross, 0xaa);
+			vr = _mm256_blend_epi16(horz, same, 0xaa);
+		}
+
+		_mm256_store_si256(reinterpret_cast<__m256i *>(b), vb);
+		_mm256_store_si256(reinterpret_cast<__m256i *>(g), vg);
+		_mm256_store_si256(reinterpret_cast<__m256i *>(r), vr);
+
+		if constexpr (gatherStats)
+			stats.add(curr, next, x, kPixels);
+
+		DEBAYER_LOOKUP_PIXELS(kPixels)
+	}
+
+	DEBAYER_FINISH_LINE(1 << shift)
+
+	if constexpr (gatherStats)
+		stats.finish();
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+#if defined(__ARM_NEON)
+
+namespace {
+
+template<typename pixel_t>
+inline uint16x8_t loadPixelsNEON(const pixel_t *src)
+{
+	if constexpr (sizeof(pixel_t) == 1)
+		return vmovl_u8(vld1_u8(src));
+	else
+		return vld1q_u16(src);
+}
+
+} /* namespace */
+
+template<typename pixel_t, unsigned int shift, bool bgLine, bool addAlphaByte,
+	 bool gatherStats>
+void DebayerCpu::debayerNEON_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width,
+				    const SwStatsCpu::LineStats *line)
+{
+	constexpr unsigned int kPixels = 8;
+	DECLARE_SRC_POINTERS(pixel_t)
+	uint16_t b[kPixels];
+	uint16_t g[kPixels];
+	uint16_t r[kPixels];
+	QuadStats<shift, bgLine> stats(line);
+	int x = 0;
+
+	/* Select the first operand of vbslq_u16() for even pixels */
+	static const uint16_t evenMask[kPixels] = {
+		0xffff, 0, 0xffff, 0, 0xffff, 0, 0xffff, 0
+	};
+	const uint16x8_t even = vld1q_u16(evenMask);
+	const int16x8_t shift0 = vdupq_n_s16(-static_cast<int>(shift));
+	const int16x8_t shift1 = vdupq_n_s16(-static_cast<int>(shift + 1));
+	const int16x8_t shift2 = vdupq_n_s16(-static_cast<int>(shift + 2));
+
+	/* Keep one pixel of margin on the right for the x + 1 neighbours */
+	for (; x + (int)kPixels < (int)width; x += kPixels) {
+		const uint16x8_t c = loadPixelsNEON(curr + x);
+		const uint16x8_t cl = loadPixelsNEON(curr + x - 1);
+		const uint16x8_t cr = loadPixelsNEON(curr + x + 1);
+		const uint16x8_t p = loadPixelsNEON(prev + x);
+		const uint16x8_t pl = loadPixelsNEON(prev + x - 1);
+		const uint16x8_t pr = loadPixelsNEON(prev + x + 1);
+		const uint16x8_t n = loadPixelsNEON(next + x);
+		const uint16x8_t nl = loadPixelsNEON(next + x - 1);
+		const uint16x8_t nr = loadPixelsNEON(next + x + 1);
+
+		const uint16x8_t h = vaddq_u16(cl, cr);
+		const uint16x8_t v = vaddq_u16(p, n);
+
+		const uint16x8_t same = vshlq_u16(c, shift0);
+		const uint16x8_t horz = vshlq_u16(h, shift1);
+		const uint16x8_t vert = vshlq_u16(v, shift1);
+		const uint16x8_t cross = vshlq_u16(vaddq_u16(h, v), shift2);
+		const uint16x8_t diag = vshlq_u16(vaddq_u16(vaddq_u16(pl, pr),
+							    vaddq_u16(nl, nr)),
+						  shift2);
+
+		if constexpr (bgLine) {
+			vst1q_u16(b, vbslq_u16(even, same, horz));
+			vst1q_u16(g, vbslq_u16(even, cross, same));
+			vst1q_u16(r, vbslq_u16(even, diag, vert));
+		} else {
+			vst1q_u16(b, vbslq_u16(even, vert, diag));
+			vst1q_u16(g, vbslq_u16(even, same, cross));
+			vst1q_u16(r, vbslq_u16(even, horz, same));
+		}
+
+		if constexpr (gatherStats)
+			stats.add(curr, next, x, kPixels);
+
+		DEBAYER_LOOKUP_PIXELS(kPixels)
+	}
+
+	DEBAYER_FINISH_LINE(1 << shift)
+
+	if constexpr (gatherStats)
+		stats.finish();
+}
+
+#endif /* __ARM_NEON */
+
+/*
+ * Colour correction of debayered lines.
+ *
+ * When colour correction is enabled, the lookup tables applied by the debayer
+ * functions produce linear values. The lines are then multiplied by the colour
+ * correction matrix in fixed point, while they are still in the cache, and the
+ * results are mapped to output values through the gamma lookup table, indexed
+ * with two more bits of precision. The vectorized functions compute the matrix
+ * product for multiple pixels at once and perform the gamma lookups with
+ * scalar code, as DEBAYER_LOOKUP_PIXELS() does.
+ */
+
+#define CORRECT_LOOKUP_PIXELS(count)                                  \
+	for (unsigned int i = 0; i < (count); i++) {                  \
+		p[i * pixelBytes] = gamma_[out[0][i]];                \
+		p[i * pixelBytes + 1] = gamma_[out[1][i]];            \
+		p[i * pixelBytes + 2] = gamma_[out[2][i]];            \
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+template<unsigned int pixelBytes>
+__attribute__((target("avx2"))) unsigned int DebayerCpu::correctLineAVX2(uint8_t *line, unsigned int width)
+{
+	constexpr unsigned int kPixels = 8;
+	const __m256i offsets = _mm256_setr_epi32(0, pixelBytes, 2 * pixelBytes, 3 * pixelBytes,
+						  4 * pixelBytes, 5 * pixelBytes, 6 * pixelBytes,
+						  7 * pixelBytes);
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	const __m256i round = _mm256_set1_epi32(1 << (kCcmIndexShift - 1));
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i maxIndex = _mm256_set1_epi32(DebayerParams::kGammaLookupSize - 1);
+	alignas(32) int32_t out[3][kPixels];
+	__m256i m[3][3];
+	unsigned int x = 0;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		for (unsigned int j = 0; j < 3; j++)
+			m[i][j] = _mm256_set1_epi32(ccm_[i][j]);
+	}
+
+	/* The gathers read 4 bytes per pixel, keep one pixel of margin */
+	for (; x + kPixels < width; x += kPixels) {
+		uint8_t *p = line + x * pixelBytes;
+		const __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int *>(p),
+							 offsets, 1);
+		const __m256i c0 = _mm256_and_si256(v, mask);
+		const __m256i c1 = _mm256_and_si256(_mm256_srli_epi32(v, 8), mask);
+		const __m256i c2 = _mm256_and_si256(_mm256_srli_epi32(v, 16), mask);
+
+		for (unsigned int i = 0; i < 3; i++) {
+			__m256i s = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[i][0], c0),
+								      _mm256_mullo_epi32(m[i][1], c1)),
+						     _mm256_mullo_epi32(m[i][2], c2));
+			s = _mm256_srai_epi32(_mm256_add_epi32(s, round), kCcmIndexShift);
+			s = _mm256_min_epi32(_mm256_max_epi32(s, zero), maxIndex);
+			_mm256_store_si256(reinterpret_cast<__m256i *>(out[i]), s);
+		}
+
+		CORRECT_LOOKUP_PIXELS(kPixels)
+	}
+
+	return x;
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+#if defined(__ARM_NEON)
+
+template<unsigned int pixelBytes>
+unsigned int DebayerCpu::correctLineNEON(uint8_t *line, unsigned int width)
+{
+	constexpr unsigned int kPixels = 8;
+	const uint16x8_t maxIndex = vdupq_n_u16(DebayerParams::kGammaLookupSize - 1);
+	uint16_t out[3][kPixels];
+	unsigned int x = 0;
+
+	for (; x + kPixels <= width; x += kPixels) {
+		uint8_t *p = line + x * pixelBytes;
+		int16x8_t c[3];
+
+		if constexpr (pixelBytes == 3) {
+			const uint8x8x3_t v = vld3_u8(p);
+			for (unsigned int j = 0; j < 3; j++)
+				c[j] = vreinterpretq_s16_u16(vmovl_u8(v.val[j]));
+		} else {
+			const uint8x8x4_t v = vld4_u8(p);
+			for (unsigned int j = 0; j < 3; j++)
+				c[j] = vreinterpretq_s16_u16(vmovl_u8(v.val[j]));
+		}
+
+		for (unsigned int i = 0; i < 3; i++) {
+			int32x4_t lo = vmull_n_s16(vget_low_s16(c[0]), ccm_[i][0]);
+			int32x4_t hi = vmull_n_s16(vget_high_s16(c[0]), ccm_[i][0]);
+			lo = vmlal_n_s16(lo, vget_low_s16(c[1]), ccm_[i][1]);
+			hi = vmlal_n_s16(hi, vget_high_s16(c[1]), ccm_[i][1]);
+			lo = vmlal_n_s16(lo, vget_low_s16(c[2]), ccm_[i][2]);
+			hi = vmlal_n_s16(hi, vget_high_s16(c[2]), ccm_[i][2]);
+
+			/* Round, and saturate negative values to 0 */
+			const uint16x8_t s = vcombine_u16(vqrshrun_n_s32(lo, kCcmIndexShift),
+							  vqrshrun_n_s32(hi, kCcmIndexShift));
+			vst1q_u16(out[i], vminq_u16(s, maxIndex));
+		}
+
+		CORRECT_LOOKUP_PIXELS(kPixels)
+	}
+
+	return x;
+}
+
+#endif /* __ARM_NEON */
+
+template<unsigned int pixelBytes>
+void DebayerCpu::correctLine(uint8_t *line, unsigned int width)
+{
+	const int16_t(&m)[3][3] = ccm_;
+	const int round = 1 << (kCcmIndexShift - 1);
+	constexpr int kMaxIndex = DebayerParams::kGammaLookupSize - 1;
+	unsigned int x = 0;
+
+#if defined(__ARM_NEON)
+	x = correctLineNEON<pixelBytes>(line, width);
+#elif defined(__x86_64__) || defined(__i386__)
+	if (ccmAVX2_)
+		x = correctLineAVX2<pixelBytes>(line, width);
+#endif
+
+	for (uint8_t *p = line + x * pixelBytes; x < width; x++, p += pixelBytes) {
+		const int c0 = p[0];
+		const int c1 = p[1];
+		const int c2 = p[2];
+
+		for (unsigned int i = 0; i < 3; i++) {
+			const int s = (m[i][0] * c0 + m[i][1] * c1 + m[i][2] * c2 + round)
+				      >> kCcmIndexShift;
+			p[i] = gamma_[std::clamp(s, 0, kMaxIndex)];
+		}
+	}
+}
+
+/*
+ * Binned debayering averages the quads of each factor x factor block of the
+ * input to a single output pixel, taking red and blue from the binRed_ and
+ * opposite positions and green from the other two. No interpolation takes
+ * place, so the block lines are the only source lines needed.
+ */
+template<typename pixel_t, unsigned int shift, unsigned int factor, bool addAlphaByte>
+void DebayerCpu::debayerBinned_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width)
+{
+	constexpr unsigned int kQuads = factor / 2;
+	/* Sum of kQuads^2 reds or blues, and twice as many greens */
+	constexpr unsigned int kShift = shift + (kQuads == 2 ? 2 : 0);
+	const unsigned int rx = binRed_.x;
+	const unsigned int bx = 1 - rx;
+
+	for (unsigned int x = 0; x < width / factor; x++) {
+		unsigned int r = 0, g = 0, b = 0;
+
+		for (unsigned int qy = 0; qy < kQuads; qy++) {
+			const pixel_t *rLine = reinterpret_cast<const pixel_t *>(src[2 * qy + binRed_.y]);
+			const pixel_t *bLine = reinterpret_cast<const pixel_t *>(src[2 * qy + 1 - binRed_.y]);
+
+			for (unsigned int i = x * factor; i < (x + 1) * factor; i += 2) {
+				r += rLine[i + rx];
+				g += rLine[i + bx] + bLine[i + rx];
+				b += bLine[i + bx];
+			}
+		}
+
+		*dst++ = blue_[b >> kShift];
+		*dst++ = green_[g >> (kShift + 1)];
+		*dst++ = red_[r >> kShift];
+		if constexpr (addAlphaByte)
+			*dst++ = 255;
+	}
+}
+
 static bool isStandardBayerOrder(BayerFormat::Order order)
 {
 	return order == BayerFormat::BGGR || order == BayerFormat::GBRG ||
@@ -299,7 +883,9 @@ int DebayerCpu::getInputConfig(PixelFormat inputFormat, DebayerInputConfig &conf
 								  formats::ARGB8888,
 								  formats::BGR888,
 								  formats::XBGR8888,
-								  formats::ABGR8888 });
+								  formats::ABGR8888,
+								  formats::NV12,
+								  formats::YUV420 });
 		return 0;
 	}
 
@@ -314,7 +900,9 @@ int DebayerCpu::getInputConfig(PixelFormat inputFormat, DebayerInputConfig &conf
 								  formats::ARGB8888,
 								  formats::BGR888,
 								  formats::XBGR8888,
-								  formats::ABGR8888 });
+								  formats::ABGR8888,
+								  formats::NV12,
+								  formats::YUV420 });
 		return 0;
 	}
 
@@ -325,6 +913,9 @@ int DebayerCpu::getInputConfig(PixelFormat inputFormat, DebayerInputConfig &conf
 
 int DebayerCpu::getOutputConfig(PixelFormat outputFormat, DebayerOutputConfig &config)
 {
+	config.yuv = false;
+	config.semiPlanar = false;
+
 	if (outputFormat == formats::RGB888 || outputFormat == formats::BGR888) {
 		config.bpp = 24;
 		return 0;
@@ -336,6 +927,14 @@ int DebayerCpu::getOutputConfig(PixelFormat outputFormat, DebayerOutputConfig &c
 		return 0;
 	}
 
+	/* bpp is for the luma plane, chroma is subsampled 2x2 */
+	if (outputFormat == formats::NV12 || outputFormat == formats::YUV420) {
+		config.bpp = 8;
+		config.yuv = true;
+		config.semiPlanar = outputFormat == formats::NV12;
+		return 0;
+	}
+
 	LOG(Debayer, Info)
 		<< "Unsupported output format " << outputFormat.toString();
 	return -EINVAL;
@@ -355,10 +954,12 @@ int DebayerCpu::setupStandardBayerOrder(BayerFormat::Order order)
 		break;
 	case BayerFormat::GRBG:
 		std::swap(debayer0_, debayer1_); /* BGGR -> GRBG */
+		std::swap(debayer0Stats_, debayer1Stats_);
 		break;
 	case BayerFormat::RGGB:
 		xShift_ = 1; /* BGGR -> GBRG */
 		std::swap(debayer0_, debayer1_); /* GBRG -> RGGB */
+		std::swap(debayer0Stats_, debayer1Stats_);
 		break;
 	default:
 		return -EINVAL;
@@ -367,6 +968,12 @@ int DebayerCpu::setupStandardBayerOrder(BayerFormat::Order order)
 	return 0;
 }
 
+#define SET_STATS_DEBAYER_FUNCTIONS(fn, pixel_t, shift)                                \
+	debayer0Stats_ = addAlphaByte ? &DebayerCpu::fn<pixel_t, shift, true, true>    \
+				      : &DebayerCpu::fn<pixel_t, shift, true, false>;  \
+	debayer1Stats_ = addAlphaByte ? &DebayerCpu::fn<pixel_t, shift, false, true>   \
+				      : &DebayerCpu::fn<pixel_t, shift, false, false>;
+
 int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputFormat)
 {
 	BayerFormat bayerFormat =
@@ -375,6 +982,8 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 
 	xShift_ = 0;
 	swapRedBlueGains_ = false;
+	debayer0Stats_ = nullptr;
+	debayer1Stats_ = nullptr;
 
 	auto invalidFmt = []() -> int {
 		LOG(Debayer, Error) << "Unsupported input output format combination";
@@ -388,6 +997,10 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 		[[fallthrough]];
 	case formats::RGB888:
 		break;
+	case formats::NV12:
+	case formats::YUV420:
+		/* Debayer to RGB888 lines, converted by convertLinePair() */
+		break;
 	case formats::XBGR8888:
 	case formats::ABGR8888:
 		addAlphaByte = true;
@@ -424,17 +1037,34 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 		case 8:
 			debayer0_ = addAlphaByte ? &DebayerCpu::debayer8_BGBG_BGR888<true> : &DebayerCpu::debayer8_BGBG_BGR888<false>;
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer8_GRGR_BGR888<true> : &DebayerCpu::debayer8_GRGR_BGR888<false>;
+			SET_STATS_DEBAYER_FUNCTIONS(debayerStats_BGR888, uint8_t, 0)
 			break;
 		case 10:
 			debayer0_ = addAlphaByte ? &DebayerCpu::debayer10_BGBG_BGR888<true> : &DebayerCpu::debayer10_BGBG_BGR888<false>;
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer10_GRGR_BGR888<true> : &DebayerCpu::debayer10_GRGR_BGR888<false>;
+			SET_STATS_DEBAYER_FUNCTIONS(debayerStats_BGR888, uint16_t, 2)
 			break;
 		case 12:
 			debayer0_ = addAlphaByte ? &DebayerCpu::debayer12_BGBG_BGR888<true> : &DebayerCpu::debayer12_BGBG_BGR888<false>;
 			debayer1_ = addAlphaByte ? &DebayerCpu::debayer12_GRGR_BGR888<true> : &DebayerCpu::debayer12_GRGR_BGR888<false>;
+			SET_STATS_DEBAYER_FUNCTIONS(debayerStats_BGR888, uint16_t, 4)
 			break;
 		}
+		setVectorDebayerFunctions(bayerFormat.bitDepth, addAlphaByte);
 		setupStandardBayerOrder(bayerFormat.order);
+
+		/*
+		 * Statistics are gathered in the BGGR orientation of the input,
+		 * which the swapped red and blue orders don't match, and binned
+		 * lines don't read the quads of the statistics.
+		 */
+		if (swapRedBlueGains_ || binning_ > 1) {
+			debayer0Stats_ = nullptr;
+			debayer1Stats_ = nullptr;
+		}
+
+		if (binning_ > 1)
+			return setBinnedDebayerFunctions(bayerFormat, addAlphaByte);
 		return 0;
 	}
 
@@ -465,8 +1095,126 @@ int DebayerCpu::setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputF
 	return invalidFmt();
 }
 
+#define SET_VECTOR_DEBAYER_FUNCTIONS(fn, pixel_t, shift)                                                  \
+	debayer0_ = addAlphaByte                                                                          \
+		? &DebayerCpu::debayerWithoutStats<&DebayerCpu::fn<pixel_t, shift, true, true, false>>    \
+		: &DebayerCpu::debayerWithoutStats<&DebayerCpu::fn<pixel_t, shift, true, false, false>>;  \
+	debayer1_ = addAlphaByte                                                                          \
+		? &DebayerCpu::debayerWithoutStats<&DebayerCpu::fn<pixel_t, shift, false, true, false>>   \
+		: &DebayerCpu::debayerWithoutStats<&DebayerCpu::fn<pixel_t, shift, false, false, false>>; \
+	debayer0Stats_ = addAlphaByte ? &DebayerCpu::fn<pixel_t, shift, true, true, true>                 \
+				      : &DebayerCpu::fn<pixel_t, shift, true, false, true>;               \
+	debayer1Stats_ = addAlphaByte ? &DebayerCpu::fn<pixel_t, shift, false, true, true>                \
+				      : &DebayerCpu::fn<pixel_t, shift, false, false, true>;
+
+/*
+ * Replace the scalar debayer functions for unpacked formats with vectorized
+ * implementations when the CPU supports them. The scalar functions are kept
+ * otherwise.
+ */
+void DebayerCpu::setVectorDebayerFunctions([[maybe_unused]] unsigned int bitDepth,
+					   [[maybe_unused]] bool addAlphaByte)
+{
+#if defined(__ARM_NEON)
+	switch (bitDepth) {
+	case 8:
+		SET_VECTOR_DEBAYER_FUNCTIONS(debayerNEON_BGR888, uint8_t, 0)
+		break;
+	case 10:
+		SET_VECTOR_DEBAYER_FUNCTIONS(debayerNEON_BGR888, uint16_t, 2)
+		break;
+	case 12:
+		SET_VECTOR_DEBAYER_FUNCTIONS(debayerNEON_BGR888, uint16_t, 4)
+		break;
+	default:
+		return;
+	}
+
+	LOG(Debayer, Debug) << "Using NEON debayering";
+#elif defined(__x86_64__) || defined(__i386__)
+	if (!__builtin_cpu_supports("avx2"))
+		return;
+
+	switch (bitDepth) {
+	case 8:
+		SET_VECTOR_DEBAYER_FUNCTIONS(debayerAVX2_BGR888, uint8_t, 0)
+		break;
+	case 10:
+		SET_VECTOR_DEBAYER_FUNCTIONS(debayerAVX2_BGR888, uint16_t, 2)
+		break;
+	case 12:
+		SET_VECTOR_DEBAYER_FUNCTIONS(debayerAVX2_BGR888, uint16_t, 4)
+		break;
+	default:
+		return;
+	}
+
+	LOG(Debayer, Debug) << "Using AVX2 debayering";
+#endif
+}
+
+#define SET_BINNED_DEBAYER_FUNCTION(pixel_t, shift, factor)                                 \
+	debayer0_ = addAlphaByte ? &DebayerCpu::debayerBinned_BGR888<pixel_t, shift, factor, true> \
+				 : &DebayerCpu::debayerBinned_BGR888<pixel_t, shift, factor, false>;
+
+/*
+ * Use the binned debayer function for all output lines, in place of the
+ * functions for the line pairs.
+ */
+int DebayerCpu::setBinnedDebayerFunctions(const BayerFormat &bayerFormat,
+					  bool addAlphaByte)
+{
+	switch (bayerFormat.order) {
+	case BayerFormat::BGGR:
+		binRed_ = Point(1, 1);
+		break;
+	case BayerFormat::GBRG:
+		binRed_ = Point(0, 1);
+		break;
+	case BayerFormat::GRBG:
+		binRed_ = Point(1, 0);
+		break;
+	case BayerFormat::RGGB:
+		binRed_ = Point(0, 0);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (bayerFormat.bitDepth) {
+	case 8:
+		if (binning_ == 2) {
+			SET_BINNED_DEBAYER_FUNCTION(uint8_t, 0, 2)
+		} else {
+			SET_BINNED_DEBAYER_FUNCTION(uint8_t, 0, 4)
+		}
+		break;
+	case 10:
+		if (binning_ == 2) {
+			SET_BINNED_DEBAYER_FUNCTION(uint16_t, 2, 2)
+		} else {
+			SET_BINNED_DEBAYER_FUNCTION(uint16_t, 2, 4)
+		}
+		break;
+	case 12:
+		if (binning_ == 2) {
+			SET_BINNED_DEBAYER_FUNCTION(uint16_t, 4, 2)
+		} else {
+			SET_BINNED_DEBAYER_FUNCTION(uint16_t, 4, 4)
+		}
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	debayer1_ = debayer0_;
+
+	return 0;
+}
+
 int DebayerCpu::configure(const StreamConfiguration &inputCfg,
-			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs)
+			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+			  Transform transform)
 {
 	if (getInputConfig(inputCfg.pixelFormat, inputConfig_) != 0)
 		return -EINVAL;
@@ -485,79 +1233,235 @@ int DebayerCpu::configure(const StreamConfiguration &inputCfg,
 
 	inputConfig_.stride = inputCfg.stride;
 
-	if (outputCfgs.size() != 1) {
+	if (outputCfgs.empty() || outputCfgs.size() > kMaxOutputs) {
 		LOG(Debayer, Error)
 			<< "Unsupported number of output streams: "
 			<< outputCfgs.size();
 		return -EINVAL;
 	}
 
+	/* Secondary outputs are downscaled from the untransformed first output */
+	if (outputCfgs.size() > 1 && transform != Transform::Identity) {
+		LOG(Debayer, Error)
+			<< "Transforms are only supported with a single output";
+		return -EINVAL;
+	}
+
 	const StreamConfiguration &outputCfg = outputCfgs[0];
+	if (!supportsTransform(outputCfg.pixelFormat, transform)) {
+		LOG(Debayer, Error)
+			<< "Unsupported transform " << transformToString(transform)
+			<< " for " << outputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	/* The output size is transposed, the debayered size isn't */
+	const Size size = !!(transform & Transform::Transpose)
+				? Size(outputCfg.size.height, outputCfg.size.width)
+				: outputCfg.size;
+
 	SizeRange outSizeRange = sizes(inputCfg.pixelFormat, inputCfg.size);
 	std::tie(outputConfig_.stride, outputConfig_.frameSize) =
 		strideAndFrameSize(outputCfg.pixelFormat, outputCfg.size);
 
-	if (!outSizeRange.contains(outputCfg.size) || outputConfig_.stride != outputCfg.stride) {
+	if (!outSizeRange.contains(size) || outputConfig_.stride != outputCfg.stride) {
 		LOG(Debayer, Error)
 			<< "Invalid output size/stride: "
-			<< "\n  " << outputCfg.size << " (" << outSizeRange << ")"
+			<< "\n  " << size << " (" << outSizeRange << ")"
 			<< "\n  " << outputCfg.stride << " (" << outputConfig_.stride << ")";
 		return -EINVAL;
 	}
 
-	if (setDebayerFunctions(inputCfg.pixelFormat, outputCfg.pixelFormat) != 0)
+	/*
+	 * Bin the input when the output is at least 2 or 4 times smaller, to
+	 * debayer and gather statistics on a frame close to the output size,
+	 * rather than on a central crop of the input.
+	 */
+	binning_ = 1;
+	if (inputConfig_.patternSize == Size(2, 2)) {
+		for (unsigned int factor = kMaxBinning; factor > 1; factor /= 2) {
+			if (size.width * factor <= inputCfg.size.width &&
+			    size.height * factor <= inputCfg.size.height) {
+				binning_ = factor;
+				break;
+			}
+		}
+	}
+
+	if (getOutputConfig(outputCfg.pixelFormat, outputConfig_) != 0 ||
+	    setDebayerFunctions(inputCfg.pixelFormat, outputCfg.pixelFormat) != 0)
 		return -EINVAL;
 
-	window_.x = ((inputCfg.size.width - outputCfg.size.width) / 2) &
+	const unsigned int lumaSize = outputConfig_.stride * outputCfg.size.height;
+	if (outputConfig_.yuv) {
+		outputConfig_.chromaStride = outputConfig_.semiPlanar
+					   ? outputConfig_.stride
+					   : outputConfig_.stride / 2;
+		outputConfig_.planeSizes = outputConfig_.semiPlanar
+					 ? std::vector<unsigned int>{ lumaSize, lumaSize / 2 }
+					 : std::vector<unsigned int>{ lumaSize, lumaSize / 4, lumaSize / 4 };
+		setupYUVConversion(outputCfg.colorSpace.value_or(ColorSpace::Sycc));
+	} else {
+		outputConfig_.planeSizes = { lumaSize };
+	}
+
+	outputSize_ = size;
+	transform_ = transform;
+
+	secondaryOutputs_.clear();
+	for (unsigned int i = 1; i < outputCfgs.size(); i++) {
+		if (configureSecondaryOutput(outputCfgs[i]) != 0)
+			return -EINVAL;
+	}
+	window_.width = outputSize_.width * binning_;
+	window_.height = outputSize_.height * binning_;
+	window_.x = ((inputCfg.size.width - window_.width) / 2) &
 		    ~(inputConfig_.patternSize.width - 1);
-	window_.y = ((inputCfg.size.height - outputCfg.size.height) / 2) &
+	window_.y = ((inputCfg.size.height - window_.height) / 2) &
 		    ~(inputConfig_.patternSize.height - 1);
-	window_.width = outputCfg.size.width;
-	window_.height = outputCfg.size.height;
 
 	/* Don't pass x,y since process() already adjusts src before passing it */
 	stats_->setWindow(Rectangle(window_.size()));
 
 	/* pad with patternSize.Width on both left and right side */
 	lineBufferPadding_ = inputConfig_.patternSize.width * inputConfig_.bpp / 8;
-	lineBufferLength_ = window_.width * inputConfig_.bpp / 8 +
-			    2 * lineBufferPadding_;
 
-	if (enableInputMemcpy_) {
-		for (unsigned int i = 0; i <= inputConfig_.patternSize.height; i++)
-			lineBuffers_[i].resize(lineBufferLength_);
-	}
+	/* Buffers may come from a different allocator, probe them again */
+	enableInputMemcpy_ = true;
+	inputMemcpyProbed_ = false;
+
+	inputMaps_.clear();
+	outputMaps_.clear();
+
+	setupStripes();
 
 	measuredFrames_ = 0;
 	frameProcessTime_ = 0;
 
+	/* The red and blue tables may be swapped differently. */
+	lutVersion_ = 0;
+
 	return 0;
 }
 
+#define SET_SCALE_FUNCTION(factor)                                                \
+	output.scale = inBytes == 4                                               \
+			       ? (outBytes == 4 ? &DebayerCpu::scaleLinePair<factor, 4, 4> \
+						: &DebayerCpu::scaleLinePair<factor, 4, 3>) \
+			       : (outBytes == 4 ? &DebayerCpu::scaleLinePair<factor, 3, 4> \
+						: &DebayerCpu::scaleLinePair<factor, 3, 3>);
+
 /*
- * Get width and height at which the bayer-pattern repeats.
- * Return pattern-size or an empty Size for an unsupported inputFormat.
+ * Add a secondary output, once the first output is configured. Its size shall
+ * be the size of the first output divided by a supported factor, as returned
+ * by secondarySize().
  */
-Size DebayerCpu::patternSize(PixelFormat inputFormat)
+int DebayerCpu::configureSecondaryOutput(const StreamConfiguration &outputCfg)
 {
-	DebayerCpu::DebayerInputConfig config;
+	DebayerOutputConfig config;
 
-	if (getInputConfig(inputFormat, config) != 0)
-		return {};
-
-	return config.patternSize;
-}
+	if (getOutputConfig(outputCfg.pixelFormat, config) != 0 || config.yuv) {
+		LOG(Debayer, Error)
+			<< "Unsupported secondary output format "
+			<< outputCfg.pixelFormat;
+		return -EINVAL;
+	}
 
-std::vector<PixelFormat> DebayerCpu::formats(PixelFormat inputFormat)
-{
-	DebayerCpu::DebayerInputConfig config;
+	SecondaryOutput output = {};
+	output.size = outputCfg.size;
 
-	if (getInputConfig(inputFormat, config) != 0)
+	for (unsigned int factor = 1; factor <= kMaxScaleFactor; factor *= 2) {
+		if (output.size == Size(outputSize_.width / factor,
+					outputSize_.height / factor)) {
+			output.factor = factor;
+			break;
+		}
+	}
+
+	unsigned int frameSize;
+	std::tie(output.stride, frameSize) =
+		strideAndFrameSize(outputCfg.pixelFormat, output.size);
+
+	if (!output.factor || output.size.isNull() || output.stride != outputCfg.stride) {
+		LOG(Debayer, Error)
+			<< "Invalid secondary output size/stride: "
+			<< "\n  " << output.size << " (from " << outputSize_ << ")"
+			<< "\n  " << outputCfg.stride << " (" << output.stride << ")";
+		return -EINVAL;
+	}
+
+	output.planeSizes = { frameSize };
+
+	/*
+	 * Lines are debayered to RGB888 pixels, or BGR888 when the red and blue
+	 * tables are swapped, the red and blue bytes are swapped to produce the
+	 * other order.
+	 */
+	const PixelFormat &format = outputCfg.pixelFormat;
+	const bool swapRedBlue = format == formats::BGR888 ||
+				 format == formats::XBGR8888 ||
+				 format == formats::ABGR8888;
+	output.swapRedBlue = swapRedBlue != swapRedBlueGains_;
+
+	const unsigned int inBytes = outputConfig_.yuv ? 3 : outputConfig_.bpp / 8;
+	const unsigned int outBytes = config.bpp / 8;
+
+	switch (output.factor) {
+	case 1:
+		SET_SCALE_FUNCTION(1)
+		break;
+	case 2:
+		SET_SCALE_FUNCTION(2)
+		break;
+	case 4:
+		SET_SCALE_FUNCTION(4)
+		break;
+	}
+
+	secondaryOutputs_.push_back(std::move(output));
+
+	return 0;
+}
+
+/*
+ * Get width and height at which the bayer-pattern repeats.
+ * Return pattern-size or an empty Size for an unsupported inputFormat.
+ */
+Size DebayerCpu::patternSize(PixelFormat inputFormat)
+{
+	DebayerCpu::DebayerInputConfig config;
+
+	if (getInputConfig(inputFormat, config) != 0)
+		return {};
+
+	return config.patternSize;
+}
+
+std::vector<PixelFormat> DebayerCpu::formats(PixelFormat inputFormat)
+{
+	DebayerCpu::DebayerInputConfig config;
+
+	if (getInputConfig(inputFormat, config) != 0)
 		return std::vector<PixelFormat>();
 
 	return config.outputFormats;
 }
 
+/*
+ * All outputs can be flipped, RGB outputs can also be transposed. Transposing
+ * the 2x2 subsampled chroma of YUV outputs would require converting blocks of
+ * 2 lines instead of the line pairs.
+ */
+bool DebayerCpu::supportsTransform(PixelFormat outputFormat, Transform transform)
+{
+	DebayerCpu::DebayerOutputConfig config;
+
+	if (getOutputConfig(outputFormat, config) != 0)
+		return false;
+
+	return !config.yuv || !(transform & Transform::Transpose);
+}
+
 std::tuple<unsigned int, unsigned int>
 DebayerCpu::strideAndFrameSize(const PixelFormat &outputFormat, const Size &size)
 {
@@ -568,26 +1472,253 @@ DebayerCpu::strideAndFrameSize(const PixelFormat &outputFormat, const Size &size
 
 	/* round up to multiple of 8 for 64 bits alignment */
 	unsigned int stride = (size.width * config.bpp / 8 + 7) & ~7;
+	unsigned int frameSize = stride * size.height;
+
+	/* Add the 2x2 subsampled chroma, stored with half the luma stride */
+	if (config.yuv)
+		frameSize += frameSize / 2;
+
+	return std::make_tuple(stride, frameSize);
+}
+
+/*
+ * Secondary outputs are RGB outputs downscaled from the first output by a
+ * power of two factor, pick the smallest one covering the requested size.
+ */
+Size DebayerCpu::secondarySize(PixelFormat outputFormat, const Size &primarySize,
+			       const Size &size)
+{
+	DebayerCpu::DebayerOutputConfig config;
+
+	if (getOutputConfig(outputFormat, config) != 0 || config.yuv)
+		return {};
+
+	for (unsigned int factor = kMaxScaleFactor; factor > 1; factor /= 2) {
+		const Size scaled(primarySize.width / factor,
+				  primarySize.height / factor);
+
+		if (!scaled.isNull() && scaled.width >= size.width &&
+		    scaled.height >= size.height)
+			return scaled;
+	}
+
+	return primarySize;
+}
 
-	return std::make_tuple(stride, stride * size.height);
+unsigned int DebayerCpu::frameSize(unsigned int output)
+{
+	if (!output)
+		return outputConfig_.frameSize;
+
+	return secondaryOutputs_[output - 1].planeSizes[0];
 }
 
-void DebayerCpu::setupInputMemcpy(const uint8_t *linePointers[])
+const std::vector<unsigned int> &DebayerCpu::planeSizes(unsigned int output)
+{
+	if (!output)
+		return outputConfig_.planeSizes;
+
+	return secondaryOutputs_[output - 1].planeSizes;
+}
+
+/*
+ * Split the window in at most threadCount_ stripes. Each stripe starts on a
+ * pattern boundary, so that it can be debayered with the same line pointers
+ * setup as a full frame, and gets its own line buffers and statistics.
+ */
+void DebayerCpu::setupStripes()
 {
 	const unsigned int patternHeight = inputConfig_.patternSize.height;
+	unsigned int count = std::clamp(outputSize_.height / kMinStripeHeight,
+					1U, threadCount_);
+
+	/* Blocks of lines downscaled to secondary outputs don't span stripes */
+	unsigned int alignment = patternHeight;
+	for (const SecondaryOutput &output : secondaryOutputs_)
+		alignment = std::max(alignment, output.factor);
+
+	const unsigned int stripeHeight =
+		(outputSize_.height / count + alignment - 1) & ~(alignment - 1);
+
+	/* Rounding the stripe height up may leave the last stripes empty */
+	count = (outputSize_.height + stripeHeight - 1) / stripeHeight;
+
+	/*
+	 * Lines are debayered in place, unless they have to be converted to
+	 * YUV, mirrored, or transposed by tiles of kTransposeLines lines.
+	 */
+	const unsigned int pixelBytes = outputConfig_.yuv ? 3 : outputConfig_.bpp / 8;
+	if (!!(transform_ & Transform::Transpose))
+		bufferedLines_ = kTransposeLines;
+	else if (outputConfig_.yuv || !!(transform_ & Transform::HFlip))
+		bufferedLines_ = 2;
+	else
+		bufferedLines_ = 0;
+
+	setupTiles();
+	lineBufferLength_ = tileWidth_ * inputConfig_.bpp / 8 + 2 * lineBufferPadding_;
+
+	stripes_.clear();
+	stripes_.resize(count);
+
+	for (unsigned int i = 0; i < count; i++) {
+		Stripe &stripe = stripes_[i];
+
+		stripe.index = i;
+		stripe.y = i * stripeHeight;
+		stripe.height = std::min(stripeHeight, outputSize_.height - stripe.y);
+
+		/*
+		 * Allocate the line buffers unconditionally, memcpy may only
+		 * be disabled once the input buffers have been probed.
+		 */
+		for (unsigned int j = 0; j <= patternHeight; j++)
+			stripe.lineBuffers[j].resize(lineBufferLength_);
+
+		/* Frames may be debayered for the secondary outputs only */
+		stripe.rgbLines.resize(bufferedLines_ ? bufferedLines_
+				       : secondaryOutputs_.empty() ? 0 : 2);
+		for (std::vector<uint8_t> &line : stripe.rgbLines)
+			line.resize(outputSize_.width * pixelBytes);
+
+		stripe.sums.resize(secondaryOutputs_.size());
+		for (unsigned int j = 0; j < secondaryOutputs_.size(); j++) {
+			const SecondaryOutput &output = secondaryOutputs_[j];
+			if (output.factor > 2)
+				stripe.sums[j].resize(output.size.width * 3);
+		}
+	}
+
+	stats_->setStripeCount(count);
+
+	LOG(Debayer, Debug)
+		<< "Debayering " << window_.size() << " to " << outputSize_
+		<< " in " << count
+		<< " stripe(s) of " << stripeHeight << " lines"
+		<< (tileWidth_ < window_.width
+			    ? " and tiles of " + std::to_string(tileWidth_) + " columns"
+			    : "")
+		<< (transform_ != Transform::Identity
+			    ? ", " + std::string(transformToString(transform_))
+			    : "");
+}
+
+namespace {
+
+/* Size of the level 1 data cache of the first CPU in bytes, 0 if unknown */
+unsigned int dataCacheSize()
+{
+	for (unsigned int i = 0;; i++) {
+		const std::string path = "/sys/devices/system/cpu/cpu0/cache/index" +
+					 std::to_string(i) + "/";
+		std::ifstream levelFile(path + "level");
+		std::ifstream typeFile(path + "type");
+		unsigned int level;
+		std::string type;
+
+		if (!(levelFile >> level) || !(typeFile >> type))
+			return 0;
+
+		if (level != 1 || type == "Instruction")
+			continue;
+
+		std::ifstream sizeFile(path + "size");
+		std::string size;
+		if (!(sizeFile >> size))
+			return 0;
+
+		char *end;
+		unsigned long value = strtoul(size.c_str(), &end, 10);
+		if (*end == 'K')
+			value *= 1024;
+		else if (*end == 'M')
+			value *= 1024 * 1024;
+
+		return value;
+	}
+}
+
+} /* namespace */
+
+/*
+ * Split the window in vertical tiles when the lines debayered together don't
+ * fit in the data cache, as with 48 and 64MP sensors. Stripes are then
+ * debayered from top to bottom one tile at a time, so that the input lines are
+ * still in the cache when read again as the neighbours of the next lines, and
+ * the output line is written without evicting them. Tiles overlap by the
+ * neighbour pixels read on both of their sides.
+ *
+ * Three quarters of the cache are used for the input lines and an output line,
+ * leaving space for the lookup tables and the statistics. The
+ * LIBCAMERA_SOFTISP_TILE_WIDTH environment variable overrides the tile width,
+ * 0 disabling tiling.
+ *
+ * Lines that go through the stripe RGB lines, and binned lines, are processed
+ * in full.
+ */
+void DebayerCpu::setupTiles()
+{
+	const unsigned int patternHeight = inputConfig_.patternSize.height;
+
+	tileWidth_ = window_.width;
+
+	if (bufferedLines_ || binning_ > 1)
+		return;
+
+	unsigned int width;
+
+	const char *tileWidth = utils::secure_getenv("LIBCAMERA_SOFTISP_TILE_WIDTH");
+	if (tileWidth) {
+		char *end;
+		width = strtoul(tileWidth, &end, 10);
+		if (*end != '\0') {
+			LOG(Debayer, Warning)
+				<< "Invalid software ISP tile width '" << tileWidth << "'";
+			return;
+		}
+
+		if (!width)
+			return;
+
+		width = std::max(width & ~(kTileAlignment - 1), kTileAlignment);
+	} else {
+		unsigned int size = dataCacheSize();
+		if (!size)
+			size = kDefaultCacheSize;
+
+		const unsigned int columnBits = (patternHeight + 1) * inputConfig_.bpp +
+						outputConfig_.bpp;
+		width = size / 4 * 3 * 8 / columnBits;
+		width = std::max(width & ~(kTileAlignment - 1), kMinTileWidth);
+	}
+
+	if (width >= window_.width)
+		return;
+
+	/* Spread the columns evenly over the tiles */
+	const unsigned int count = (window_.width + width - 1) / width;
+	tileWidth_ = (window_.width / count + kTileAlignment - 1) & ~(kTileAlignment - 1);
+}
+
+void DebayerCpu::setupInputMemcpy(Stripe &stripe, const uint8_t *linePointers[])
+{
+	const unsigned int patternHeight = inputConfig_.patternSize.height;
+	const unsigned int length = stripe.tileWidth * inputConfig_.bpp / 8 +
+				    2 * lineBufferPadding_;
 
 	if (!enableInputMemcpy_)
 		return;
 
 	for (unsigned int i = 0; i < patternHeight; i++) {
-		memcpy(lineBuffers_[i].data(),
-		       linePointers[i + 1] - lineBufferPadding_,
-		       lineBufferLength_);
-		linePointers[i + 1] = lineBuffers_[i].data() + lineBufferPadding_;
+		memcpy(stripe.lineBuffers[i].data(),
+		       linePointers[i + 1] - lineBufferPadding_, length);
+		linePointers[i + 1] = stripe.lineBuffers[i].data() + lineBufferPadding_;
 	}
 
-	/* Point lineBufferIndex_ to first unused lineBuffer */
-	lineBufferIndex_ = patternHeight;
+	stripe.copiedBytes += patternHeight * length;
+
+	/* Point lineBufferIndex to first unused lineBuffer */
+	stripe.lineBufferIndex = patternHeight;
 }
 
 void DebayerCpu::shiftLinePointers(const uint8_t *linePointers[], const uint8_t *src)
@@ -601,87 +1732,508 @@ void DebayerCpu::shiftLinePointers(const uint8_t *linePointers[], const uint8_t
 				      (patternHeight / 2) * (int)inputConfig_.stride;
 }
 
-void DebayerCpu::memcpyNextLine(const uint8_t *linePointers[])
+void DebayerCpu::memcpyNextLine(Stripe &stripe, const uint8_t *linePointers[])
 {
 	const unsigned int patternHeight = inputConfig_.patternSize.height;
+	const unsigned int length = stripe.tileWidth * inputConfig_.bpp / 8 +
+				    2 * lineBufferPadding_;
 
 	if (!enableInputMemcpy_)
 		return;
 
-	memcpy(lineBuffers_[lineBufferIndex_].data(),
-	       linePointers[patternHeight] - lineBufferPadding_,
-	       lineBufferLength_);
-	linePointers[patternHeight] = lineBuffers_[lineBufferIndex_].data() + lineBufferPadding_;
+	memcpy(stripe.lineBuffers[stripe.lineBufferIndex].data(),
+	       linePointers[patternHeight] - lineBufferPadding_, length);
+	linePointers[patternHeight] = stripe.lineBuffers[stripe.lineBufferIndex].data() + lineBufferPadding_;
+	stripe.copiedBytes += length;
+
+	stripe.lineBufferIndex = (stripe.lineBufferIndex + 1) % (patternHeight + 1);
+}
+
+/*
+ * Compute the fixed-point RGB to YCbCr matrix for the colour space encoding
+ * and range. The debayered values are already gamma corrected, so they are
+ * used directly as R'G'B'.
+ */
+void DebayerCpu::setupYUVConversion(const ColorSpace &colorSpace)
+{
+	double kr, kb;
+
+	switch (colorSpace.ycbcrEncoding) {
+	case ColorSpace::YcbcrEncoding::Rec709:
+		kr = 0.2126;
+		kb = 0.0722;
+		break;
+	case ColorSpace::YcbcrEncoding::Rec2020:
+		kr = 0.2627;
+		kb = 0.0593;
+		break;
+	case ColorSpace::YcbcrEncoding::None:
+	case ColorSpace::YcbcrEncoding::Rec601:
+	default:
+		kr = 0.299;
+		kb = 0.114;
+		break;
+	}
+
+	const double kg = 1.0 - kr - kb;
+	const bool limited = colorSpace.range == ColorSpace::Range::Limited;
+	const double yScale = limited ? 219.0 / 255.0 : 1.0;
+	const double cScale = limited ? 224.0 / 255.0 : 1.0;
+	const double scale = 1 << kYUVShift;
+
+	const double matrix[3][3] = {
+		{ yScale * kr, yScale * kg, yScale * kb },
+		{ -cScale * kr / (2 * (1 - kb)), -cScale * kg / (2 * (1 - kb)), cScale / 2 },
+		{ cScale / 2, -cScale * kg / (2 * (1 - kr)), -cScale * kb / (2 * (1 - kr)) },
+	};
+
+	for (unsigned int i = 0; i < 3; i++)
+		for (unsigned int j = 0; j < 3; j++)
+			yuvMatrix_[i][j] = std::lround(matrix[i][j] * scale);
+
+	yOffset_ = limited ? 16 : 0;
+
+	LOG(Debayer, Debug) << "Converting to YUV with " << colorSpace.toString();
+}
+
+/* Row of the output written with the window-relative debayered line y */
+unsigned int DebayerCpu::outputRow(unsigned int y) const
+{
+	return !!(transform_ & Transform::VFlip) ? outputSize_.height - 1 - y : y;
+}
+
+/*
+ * Lines that can't be written in place are debayered to the stripe RGB lines
+ * first, y being the window-relative debayered line.
+ */
+uint8_t *DebayerCpu::outputLine(Stripe &stripe, uint8_t *dst, unsigned int y)
+{
+	if (bufferedLines_)
+		return stripe.rgbLines[(y - stripe.y) % bufferedLines_].data();
+
+	/* Without the first output, lines are debayered for the secondary ones */
+	if (!dst)
+		return stripe.rgbLines[(y - stripe.y) % 2].data() +
+		       stripe.tileX * outputConfig_.bpp / 8;
+
+	return dst + outputRow(y) * outputConfig_.stride;
+}
+
+/*
+ * Apply the colour correction matrix to the width pixels of the line pair
+ * starting at the window-relative debayered line y, where they have been
+ * debayered.
+ */
+void DebayerCpu::correctLinePair(Stripe &stripe, uint8_t *dst, unsigned int y,
+				 unsigned int width)
+{
+	if (!ccmEnabled_)
+		return;
+
+	const bool fourBytes = !outputConfig_.yuv && outputConfig_.bpp == 32;
+
+	for (unsigned int i = 0; i < 2; i++) {
+		uint8_t *line = outputLine(stripe, dst, y + i);
+
+		if (fourBytes)
+			correctLine<4>(line, width);
+		else
+			correctLine<3>(line, width);
+	}
+}
+
+/*
+ * Downscale the line pair starting at the window-relative debayered line y to
+ * the secondary outputs of the frame, from the width pixels where it has been
+ * debayered.
+ */
+void DebayerCpu::scaleLinePairs(Stripe &stripe, uint8_t *dst, unsigned int y,
+				unsigned int width)
+{
+	if (secondaryOutputs_.empty())
+		return;
+
+	const uint8_t *lines[2] = {
+		outputLine(stripe, dst, y),
+		outputLine(stripe, dst, y + 1),
+	};
+
+	for (unsigned int i = 0; i < secondaryOutputs_.size(); i++) {
+		const SecondaryOutput &output = secondaryOutputs_[i];
+
+		if (output.dst)
+			(this->*output.scale)(output, stripe.sums[i], lines, y,
+					      stripe.tileX, width);
+	}
+}
+
+/*
+ * Average factor x factor blocks of debayered pixels of inBytes to secondary
+ * output pixels of outBytes. Blocks of 4 lines span 2 line pairs, the sums of
+ * the first pair are kept until the second one is debayered.
+ */
+template<unsigned int factor, unsigned int inBytes, unsigned int outBytes>
+void DebayerCpu::scaleLinePair(const SecondaryOutput &output,
+			       std::vector<uint16_t> &sums,
+			       const uint8_t *lines[], unsigned int y,
+			       unsigned int x, unsigned int width)
+{
+	/* Tiles start on multiples of kTileAlignment, x / factor is exact */
+	const unsigned int xStart = x / factor;
+	const unsigned int xEnd = std::min((x + width) / factor, output.size.width);
+	const unsigned int c0 = output.swapRedBlue ? 2 : 0;
+	const unsigned int c2 = 2 - c0;
+
+	if constexpr (factor == 1) {
+		for (unsigned int i = 0; i < 2; i++) {
+			const uint8_t *in = lines[i];
+			uint8_t *out = output.dst + (y + i) * output.stride +
+				       xStart * outBytes;
+
+			for (unsigned int xo = xStart; xo < xEnd; xo++) {
+				out[0] = in[c0];
+				out[1] = in[1];
+				out[2] = in[c2];
+				if constexpr (outBytes == 4)
+					out[3] = 255;
+				in += inBytes;
+				out += outBytes;
+			}
+		}
+
+		return;
+	}
+
+	const unsigned int row = y / factor;
+	if (row >= output.size.height)
+		return;
+
+	constexpr unsigned int shift = factor == 2 ? 2 : 4;
+	constexpr unsigned int round = 1 << (shift - 1);
+	const bool lastPair = (y + 2) % factor == 0;
+	const uint8_t *in0 = lines[0];
+	const uint8_t *in1 = lines[1];
+	uint16_t *sum = factor > 2 ? sums.data() + xStart * 3 : nullptr;
+	uint8_t *out = output.dst + row * output.stride + xStart * outBytes;
+
+	for (unsigned int xo = xStart; xo < xEnd; xo++) {
+		unsigned int block[3] = {};
+
+		for (unsigned int i = 0; i < factor; i++) {
+			for (unsigned int c = 0; c < 3; c++)
+				block[c] += in0[i * inBytes + c] + in1[i * inBytes + c];
+		}
+
+		in0 += factor * inBytes;
+		in1 += factor * inBytes;
+
+		if constexpr (factor > 2) {
+			for (unsigned int c = 0; c < 3; c++) {
+				if (lastPair)
+					block[c] += sum[c];
+				else
+					sum[c] = block[c];
+			}
+
+			sum += 3;
+
+			if (!lastPair)
+				continue;
+		}
 
-	lineBufferIndex_ = (lineBufferIndex_ + 1) % (patternHeight + 1);
+		out[0] = (block[c0] + round) >> shift;
+		out[1] = (block[1] + round) >> shift;
+		out[2] = (block[c2] + round) >> shift;
+		if constexpr (outBytes == 4)
+			out[3] = 255;
+		out += outBytes;
+	}
 }
 
-void DebayerCpu::process2(const uint8_t *src, uint8_t *dst)
+/*
+ * Write the line pair starting at the window-relative debayered line y to the
+ * output frame at dst, when it hasn't been debayered in place.
+ */
+void DebayerCpu::convertLinePair(Stripe &stripe, uint8_t *dst, unsigned int y)
 {
-	unsigned int yEnd = window_.y + window_.height;
+	if (!bufferedLines_ || !dst)
+		return;
+
+	if (outputConfig_.yuv) {
+		convertYUVLinePair(stripe, dst, y);
+		return;
+	}
+
+	const bool transpose = !!(transform_ & Transform::Transpose);
+	const bool fourBytes = outputConfig_.bpp == 32;
+
+	if (!transpose) {
+		if (fourBytes)
+			mirrorLinePair<4>(stripe, dst, y);
+		else
+			mirrorLinePair<3>(stripe, dst, y);
+		return;
+	}
+
+	/* Transpose the buffered lines once all of them, or the stripe, are done */
+	const unsigned int end = y + 2;
+	unsigned int count = (end - stripe.y) % bufferedLines_;
+	if (!count)
+		count = bufferedLines_;
+	else if (end != stripe.y + stripe.height)
+		return;
+
+	if (fourBytes)
+		transposeLines<4>(stripe, dst, end - count, count);
+	else
+		transposeLines<3>(stripe, dst, end - count, count);
+}
+
+/*
+ * Convert the 2 RGB lines of a stripe to luma lines and one chroma line of the
+ * output frame, the window-relative y selecting the lines. The RGB lines hold
+ * RGB888 pixels, stored as B, G, R bytes. Flips are applied by writing the
+ * lines in reverse order and the pixels from right to left.
+ */
+void DebayerCpu::convertYUVLinePair(Stripe &stripe, uint8_t *dst, unsigned int y)
+{
+	/* Chroma is computed from sums of 4 pixels, with 2 more bits */
+	const int yBias = (yOffset_ << kYUVShift) + (1 << (kYUVShift - 1));
+	const int cBias = (128 << (kYUVShift + 2)) + (1 << (kYUVShift + 1));
+	const int(&m)[3][3] = yuvMatrix_;
+	const uint8_t *rgb0 = outputLine(stripe, dst, y);
+	const uint8_t *rgb1 = outputLine(stripe, dst, y + 1);
+	const bool hflip = !!(transform_ & Transform::HFlip);
+	const int dir = hflip ? -1 : 1;
+	const unsigned int x0 = hflip ? outputSize_.width - 1 : 0;
+	const unsigned int row0 = outputRow(y);
+	const unsigned int row1 = outputRow(y + 1);
+	uint8_t *y0 = dst + row0 * outputConfig_.stride + x0;
+	uint8_t *y1 = dst + row1 * outputConfig_.stride + x0;
+	const unsigned int step = outputConfig_.semiPlanar ? 2 : 1;
+	const unsigned int chromaOffset = std::min(row0, row1) / 2 * outputConfig_.chromaStride +
+					  x0 / 2 * step;
+	uint8_t *u = chroma_[0] + chromaOffset;
+	uint8_t *v = chroma_[1] + chromaOffset;
+	const int chromaStep = dir * static_cast<int>(step);
+
+	/*
+	 * Rounding of the matrix coefficients can push the values slightly out
+	 * of range for saturated colours, clamp them to avoid wrapping around.
+	 */
+	auto luma = [&m, yBias](const uint8_t *rgb) -> uint8_t {
+		int value = (m[0][0] * rgb[2] + m[0][1] * rgb[1] + m[0][2] * rgb[0] + yBias) >> kYUVShift;
+		return std::clamp(value, 0, 255);
+	};
+	auto chroma = [cBias](const int(&coeffs)[3], int r, int g, int b) -> uint8_t {
+		int value = (coeffs[0] * r + coeffs[1] * g + coeffs[2] * b + cBias) >> (kYUVShift + 2);
+		return std::clamp(value, 0, 255);
+	};
+
+	for (unsigned int x = 0; x < outputSize_.width; x += 2) {
+		int b = 0, g = 0, r = 0;
+
+		for (const uint8_t *rgb : { rgb0, rgb0 + 3, rgb1, rgb1 + 3 }) {
+			b += rgb[0];
+			g += rgb[1];
+			r += rgb[2];
+		}
+
+		y0[0] = luma(rgb0);
+		y0[dir] = luma(rgb0 + 3);
+		y1[0] = luma(rgb1);
+		y1[dir] = luma(rgb1 + 3);
+		y0 += 2 * dir;
+		y1 += 2 * dir;
+
+		*u = chroma(m[1], r, g, b);
+		*v = chroma(m[2], r, g, b);
+		u += chromaStep;
+		v += chromaStep;
+		rgb0 += 6;
+		rgb1 += 6;
+	}
+}
+
+/* Write the 2 RGB lines of a stripe from right to left to the output */
+template<unsigned int pixelBytes>
+void DebayerCpu::mirrorLinePair(Stripe &stripe, uint8_t *dst, unsigned int y)
+{
+	for (unsigned int i = 0; i < 2; i++) {
+		const uint8_t *src = outputLine(stripe, dst, y + i);
+		uint8_t *out = dst + outputRow(y + i) * outputConfig_.stride +
+			       (outputSize_.width - 1) * pixelBytes;
+
+		for (unsigned int x = 0; x < outputSize_.width; x++) {
+			memcpy(out, src, pixelBytes);
+			src += pixelBytes;
+			out -= pixelBytes;
+		}
+	}
+
+	stripe.copiedBytes += 2 * outputSize_.width * pixelBytes;
+}
+
+/*
+ * Write count RGB lines of a stripe, starting at the window-relative line y,
+ * as columns of the output. Every output row gets count consecutive pixels,
+ * which keeps the writes to the output sequential within a cache line. The
+ * flips are applied before the transposition, as specified by Transform.
+ */
+template<unsigned int pixelBytes>
+void DebayerCpu::transposeLines(Stripe &stripe, uint8_t *dst, unsigned int y,
+				unsigned int count)
+{
+	const bool hflip = !!(transform_ & Transform::HFlip);
+	const bool vflip = !!(transform_ & Transform::VFlip);
+	const uint8_t *lines[kTransposeLines];
+
+	for (unsigned int i = 0; i < count; i++)
+		lines[i] = outputLine(stripe, dst, y + i);
+
+	/* Output columns of the first line, and direction of the next ones */
+	const unsigned int column = vflip ? outputSize_.height - 1 - y : y;
+	const int dir = vflip ? -1 : 1;
+
+	for (unsigned int x = 0; x < outputSize_.width; x++) {
+		const unsigned int row = hflip ? outputSize_.width - 1 - x : x;
+		uint8_t *out = dst + row * outputConfig_.stride + column * pixelBytes;
+
+		for (unsigned int i = 0; i < count; i++) {
+			memcpy(out, lines[i] + x * pixelBytes, pixelBytes);
+			out += dir * static_cast<int>(pixelBytes);
+		}
+	}
+
+	stripe.copiedBytes += count * outputSize_.width * pixelBytes;
+}
+
+/*
+ * Debayer the first line of a line pair and gather its statistics, in the same
+ * pass when the debayer functions support it.
+ */
+void DebayerCpu::debayerLine0(Stripe &stripe, uint8_t *dst, const uint8_t *src[],
+			      unsigned int y)
+{
+	uint8_t *line = outputLine(stripe, dst, y - window_.y);
+
+	if (debayer0Stats_) {
+		SwStatsCpu::LineStats stats;
+
+		if (stats_->lineStats(y, stripe.index, stripe.tileX,
+				      stripe.tileWidth, &stats))
+			(this->*debayer0Stats_)(line, src, stripe.tileWidth, &stats);
+		else
+			(this->*debayer0_)(line, src, stripe.tileWidth);
+		return;
+	}
+
+	stats_->processLine0(y, src, stripe.index, stripe.tileX, stripe.tileWidth);
+	(this->*debayer0_)(line, src, stripe.tileWidth);
+}
+
+void DebayerCpu::processStripe(unsigned int index, const uint8_t *src, uint8_t *dst)
+{
+	Stripe &stripe = stripes_[index];
+
+	stripe.copiedBytes = 0;
+
+	if (binning_ > 1) {
+		processBinned(stripe, src, dst);
+		return;
+	}
+
+	for (stripe.tileX = 0; stripe.tileX < window_.width; stripe.tileX += tileWidth_) {
+		stripe.tileWidth = std::min(tileWidth_, window_.width - stripe.tileX);
+
+		if (inputConfig_.patternSize.height == 2)
+			process2(stripe, src, dst);
+		else
+			process4(stripe, src, dst);
+	}
+}
+
+void DebayerCpu::process2(Stripe &stripe, const uint8_t *src, uint8_t *dst)
+{
+	const unsigned int yStart = window_.y + stripe.y;
+	unsigned int yEnd = yStart + stripe.height;
 	/* Holds [0] previous- [1] current- [2] next-line */
 	const uint8_t *linePointers[3];
+	/* With window_.y == 0 the last 2 lines of the frame need special handling */
+	const bool lastLines = window_.y == 0 && stripe.index == stripes_.size() - 1;
 
-	/* Adjust src to top left corner of the window */
-	src += window_.y * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	/* Adjust src and dst to the top left corner of the tile */
+	src += yStart * inputConfig_.stride +
+	       (window_.x + stripe.tileX) * inputConfig_.bpp / 8;
+	if (dst)
+		dst += stripe.tileX * outputConfig_.bpp / 8;
 
 	/* [x] becomes [x - 1] after initial shiftLinePointers() call */
-	if (window_.y) {
+	if (yStart) {
 		linePointers[1] = src - inputConfig_.stride; /* previous-line */
 		linePointers[2] = src;
 	} else {
-		/* window_.y == 0, use the next line as prev line */
+		/* yStart == 0, use the next line as prev line */
 		linePointers[1] = src + inputConfig_.stride;
 		linePointers[2] = src;
-		/* Last 2 lines also need special handling */
-		yEnd -= 2;
 	}
 
-	setupInputMemcpy(linePointers);
+	if (lastLines)
+		yEnd -= 2;
+
+	setupInputMemcpy(stripe, linePointers);
 
-	for (unsigned int y = window_.y; y < yEnd; y += 2) {
+	for (unsigned int y = yStart; y < yEnd; y += 2) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(y, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		debayerLine0(stripe, dst, linePointers, y);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer1_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		(this->*debayer1_)(outputLine(stripe, dst, y + 1 - window_.y), linePointers,
+				   stripe.tileWidth);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+
+		correctLinePair(stripe, dst, y - window_.y, stripe.tileWidth);
+		scaleLinePairs(stripe, dst, y - window_.y, stripe.tileWidth);
+		convertLinePair(stripe, dst, y - window_.y);
 	}
 
-	if (window_.y == 0) {
+	if (lastLines) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(yEnd, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		debayerLine0(stripe, dst, linePointers, yEnd);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
 		/* next line may point outside of src, use prev. */
 		linePointers[2] = linePointers[0];
-		(this->*debayer1_)(dst, linePointers);
+		(this->*debayer1_)(outputLine(stripe, dst, yEnd + 1 - window_.y), linePointers,
+				   stripe.tileWidth);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+
+		correctLinePair(stripe, dst, yEnd - window_.y, stripe.tileWidth);
+		scaleLinePairs(stripe, dst, yEnd - window_.y, stripe.tileWidth);
+		convertLinePair(stripe, dst, yEnd - window_.y);
 	}
 }
 
-void DebayerCpu::process4(const uint8_t *src, uint8_t *dst)
+void DebayerCpu::process4(Stripe &stripe, const uint8_t *src, uint8_t *dst)
 {
-	const unsigned int yEnd = window_.y + window_.height;
+	const unsigned int yStart = window_.y + stripe.y;
+	const unsigned int yEnd = yStart + stripe.height;
 	/*
 	 * This holds pointers to [0] 2-lines-up [1] 1-line-up [2] current-line
 	 * [3] 1-line-down [4] 2-lines-down.
 	 */
 	const uint8_t *linePointers[5];
 
-	/* Adjust src to top left corner of the window */
-	src += window_.y * inputConfig_.stride + window_.x * inputConfig_.bpp / 8;
+	/* Adjust src and dst to the top left corner of the tile */
+	src += yStart * inputConfig_.stride +
+	       (window_.x + stripe.tileX) * inputConfig_.bpp / 8;
+	if (dst)
+		dst += stripe.tileX * outputConfig_.bpp / 8;
 
 	/* [x] becomes [x - 1] after initial shiftLinePointers() call */
 	linePointers[1] = src - 2 * inputConfig_.stride;
@@ -689,65 +2241,154 @@ void DebayerCpu::process4(const uint8_t *src, uint8_t *dst)
 	linePointers[3] = src;
 	linePointers[4] = src + inputConfig_.stride;
 
-	setupInputMemcpy(linePointers);
+	setupInputMemcpy(stripe, linePointers);
 
-	for (unsigned int y = window_.y; y < yEnd; y += 4) {
+	for (unsigned int y = yStart; y < yEnd; y += 4) {
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine0(y, linePointers);
-		(this->*debayer0_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine0(y, linePointers, stripe.index,
+				     stripe.tileX, stripe.tileWidth);
+		(this->*debayer0_)(outputLine(stripe, dst, y - window_.y), linePointers,
+				   stripe.tileWidth);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer1_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		(this->*debayer1_)(outputLine(stripe, dst, y + 1 - window_.y), linePointers,
+				   stripe.tileWidth);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+
+		correctLinePair(stripe, dst, y - window_.y, stripe.tileWidth);
+		scaleLinePairs(stripe, dst, y - window_.y, stripe.tileWidth);
+		convertLinePair(stripe, dst, y - window_.y);
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		stats_->processLine2(y, linePointers);
-		(this->*debayer2_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		stats_->processLine2(y, linePointers, stripe.index,
+				     stripe.tileX, stripe.tileWidth);
+		(this->*debayer2_)(outputLine(stripe, dst, y + 2 - window_.y), linePointers,
+				   stripe.tileWidth);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
 
 		shiftLinePointers(linePointers, src);
-		memcpyNextLine(linePointers);
-		(this->*debayer3_)(dst, linePointers);
+		memcpyNextLine(stripe, linePointers);
+		(this->*debayer3_)(outputLine(stripe, dst, y + 3 - window_.y), linePointers,
+				   stripe.tileWidth);
 		src += inputConfig_.stride;
-		dst += outputConfig_.stride;
+
+		correctLinePair(stripe, dst, y + 2 - window_.y, stripe.tileWidth);
+		scaleLinePairs(stripe, dst, y + 2 - window_.y, stripe.tileWidth);
+		convertLinePair(stripe, dst, y + 2 - window_.y);
 	}
 }
 
-namespace {
-
-void syncBufferForCPU(FrameBuffer *buffer, uint64_t syncFlags)
+/*
+ * Debayer binning_ input lines per output line. The block lines are read in
+ * place, each of them is only read once. Statistics are gathered on the first
+ * quad line of every other output line, so that their cost scales with the
+ * output size rather than with the input size.
+ */
+void DebayerCpu::processBinned(Stripe &stripe, const uint8_t *src, uint8_t *dst)
 {
-	for (const FrameBuffer::Plane &plane : buffer->planes()) {
-		const int fd = plane.fd.get();
-		struct dma_buf_sync sync = { syncFlags };
-		int ret;
-
-		ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
-		if (ret < 0) {
-			ret = errno;
-			LOG(Debayer, Error)
-				<< "Syncing buffer FD " << fd << " with flags "
-				<< syncFlags << " failed: " << strerror(ret);
+	const uint8_t *linePointers[kMaxBinning + 1];
+	const uint8_t *statsLines[3];
+
+	/* Adjust src to the top left corner of the stripe */
+	src += (window_.y + stripe.y * binning_) * inputConfig_.stride +
+	       window_.x * inputConfig_.bpp / 8;
+
+	for (unsigned int y = stripe.y; y < stripe.y + stripe.height; y += 2) {
+		for (unsigned int i = 0; i < 2; i++) {
+			for (unsigned int j = 0; j < binning_; j++)
+				linePointers[j] = src + j * inputConfig_.stride;
+
+			if (i == 0) {
+				statsLines[1] = linePointers[0];
+				statsLines[2] = linePointers[1];
+				stats_->processLine0(y * binning_, statsLines, stripe.index);
+			}
+
+			(this->*debayer0_)(outputLine(stripe, dst, y + i), linePointers,
+					   window_.width);
+			src += binning_ * inputConfig_.stride;
 		}
+
+		correctLinePair(stripe, dst, y, outputSize_.width);
+		scaleLinePairs(stripe, dst, y, outputSize_.width);
+		convertLinePair(stripe, dst, y);
 	}
 }
 
+namespace {
+
 inline int64_t timeDiff(timespec &after, timespec &before)
 {
 	return (after.tv_sec - before.tv_sec) * 1000000000LL +
 	       (int64_t)after.tv_nsec - (int64_t)before.tv_nsec;
 }
 
+int64_t readBuffer(const uint8_t *data, size_t size)
+{
+	const uint64_t *words = reinterpret_cast<const uint64_t *>(data);
+	volatile uint64_t sum = 0;
+	timespec before = {};
+	timespec after = {};
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &before);
+	for (size_t i = 0; i < size / sizeof(*words); i++)
+		sum = sum + words[i];
+	clock_gettime(CLOCK_MONOTONIC_RAW, &after);
+
+	return timeDiff(after, before);
+}
+
 } /* namespace */
 
-void DebayerCpu::process(uint32_t frame, FrameBuffer *input, FrameBuffer *output, DebayerParams params)
+/*
+ * Find out whether the input buffer is CPU-cacheable by reading the same
+ * region twice right after the DMA_BUF_SYNC_START. With a cached buffer the
+ * second read hits the CPU cache and is much faster than the first one, while
+ * both are equally slow on uncached memory. Debayering reads every input
+ * line several times, so in place reads are only worth it in the first case.
+ *
+ * A single sample is easily skewed by preemption or interrupts, so
+ * kInputProbeSamples regions spread over the buffer are timed, and the medians
+ * of the cold and warm read times are compared.
+ */
+void DebayerCpu::probeInputMemcpy(const uint8_t *src, size_t size)
+{
+	const size_t spacing = (size / kInputProbeSamples) & ~(sizeof(uint64_t) - 1);
+	const size_t length = std::min(spacing, kInputProbeSize);
+	std::array<int64_t, kInputProbeSamples> colds;
+	std::array<int64_t, kInputProbeSamples> warms;
+
+	for (unsigned int i = 0; i < kInputProbeSamples; i++) {
+		colds[i] = readBuffer(src + i * spacing, length);
+		warms[i] = readBuffer(src + i * spacing, length);
+	}
+
+	std::nth_element(colds.begin(), colds.begin() + kInputProbeSamples / 2, colds.end());
+	std::nth_element(warms.begin(), warms.begin() + kInputProbeSamples / 2, warms.end());
+
+	const int64_t cold = colds[kInputProbeSamples / 2];
+	const int64_t warm = warms[kInputProbeSamples / 2];
+
+	enableInputMemcpy_ = warm * 2 > cold;
+	inputMemcpyProbed_ = true;
+
+	LOG(Debayer, Info)
+		<< "Input buffers look " << (enableInputMemcpy_ ? "uncached" : "cached")
+		<< " (" << cold << "ns/" << warm << "ns), "
+		<< (enableInputMemcpy_ ? "copying" : "reading in place")
+		<< " input lines";
+
+	LIBCAMERA_TRACEPOINT(softisp_input_memcpy, enableInputMemcpy_, cold, warm);
+}
+
+void DebayerCpu::process(uint32_t frame, FrameBuffer *input,
+			 const std::vector<FrameBuffer *> &outputs,
+			 const DebayerParams *params,
+			 const DebayerFrameTiming &timing)
 {
 	timespec frameStartTime;
 
@@ -756,38 +2397,146 @@ void DebayerCpu::process(uint32_t frame, FrameBuffer *input, FrameBuffer *output
 		clock_gettime(CLOCK_MONOTONIC_RAW, &frameStartTime);
 	}
 
-	syncBufferForCPU(input, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
-	syncBufferForCPU(output, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+	if (params->lutVersion != lutVersion_) {
+		green_ = params->green;
+		red_ = swapRedBlueGains_ ? params->blue : params->red;
+		blue_ = swapRedBlueGains_ ? params->red : params->blue;
+		gamma_ = params->gamma;
+		lutVersion_ = params->lutVersion;
+	}
+
+	/*
+	 * The matrix is small enough to be applied on every frame. Reorder it
+	 * to the byte order of the output pixels, the red and blue lookup
+	 * tables having been swapped accordingly.
+	 */
+	ccmEnabled_ = params->ccmEnabled;
+	if (ccmEnabled_) {
+		static constexpr unsigned int kBGR[3] = { 2, 1, 0 };
+		static constexpr unsigned int kRGB[3] = { 0, 1, 2 };
+		const unsigned int *order = swapRedBlueGains_ ? kRGB : kBGR;
+
+		for (unsigned int i = 0; i < 3; i++) {
+			for (unsigned int j = 0; j < 3; j++)
+				ccm_[i][j] = params->ccm[order[i] * 3 + order[j]];
+		}
+	}
 
-	green_ = params.green;
-	red_ = swapRedBlueGains_ ? params.blue : params.red;
-	blue_ = swapRedBlueGains_ ? params.red : params.blue;
+	const unsigned int outputCount =
+		std::min<std::size_t>(outputs.size(), secondaryOutputs_.size() + 1);
 
 	/* Copy metadata from the input buffer */
-	FrameMetadata &metadata = output->_d()->metadata();
-	metadata.status = input->metadata().status;
-	metadata.sequence = input->metadata().sequence;
-	metadata.timestamp = input->metadata().timestamp;
-
-	MappedFrameBuffer in(input, MappedFrameBuffer::MapFlag::Read);
-	MappedFrameBuffer out(output, MappedFrameBuffer::MapFlag::Write);
-	if (!in.isValid() || !out.isValid()) {
+	for (unsigned int i = 0; i < outputCount; i++) {
+		if (!outputs[i])
+			continue;
+
+		FrameMetadata &metadata = outputs[i]->_d()->metadata();
+		metadata.status = input->metadata().status;
+		metadata.sequence = input->metadata().sequence;
+		metadata.timestamp = input->metadata().timestamp;
+	}
+
+	/* The same buffers are recycled every few frames, keep them mapped */
+	const MappedFrameBuffer *inMap = inputMaps_.map(input);
+	std::array<const MappedFrameBuffer *, kMaxOutputs> outMaps = {};
+	bool mapped = inMap;
+
+	for (unsigned int i = 0; i < outputCount; i++) {
+		if (!outputs[i])
+			continue;
+
+		outMaps[i] = outputMaps_.map(outputs[i]);
+		if (!outMaps[i])
+			mapped = false;
+	}
+
+	if (!mapped) {
 		LOG(Debayer, Error) << "mmap-ing buffer(s) failed";
-		metadata.status = FrameMetadata::FrameError;
+		for (unsigned int i = 0; i < outputCount; i++) {
+			if (outputs[i])
+				outputs[i]->_d()->metadata().status = FrameMetadata::FrameError;
+		}
 		return;
 	}
 
+	const MappedFrameBuffer &in = *inMap;
+
+	MappedFrameBuffer::SyncScope inSync = in.syncScope();
+	std::array<MappedFrameBuffer::SyncScope, kMaxOutputs> outSyncs;
+	for (unsigned int i = 0; i < outputCount; i++) {
+		if (outMaps[i])
+			outSyncs[i] = outMaps[i]->syncScope();
+	}
+
 	stats_->startFrame();
 
-	if (inputConfig_.patternSize.height == 2)
-		process2(in.planes()[0].data(), out.planes()[0].data());
-	else
-		process4(in.planes()[0].data(), out.planes()[0].data());
+	const uint8_t *src = in.planes()[0].data();
+	uint8_t *dst = outMaps[0] ? outMaps[0]->planes()[0].data() : nullptr;
+
+	/* Buffers exported by the software ISP have one plane per YUV plane */
+	if (outputConfig_.yuv && dst) {
+		const MappedFrameBuffer &out = *outMaps[0];
+		auto plane = [&](unsigned int i) {
+			return out.planes().size() > i
+				       ? out.planes()[i].data()
+				       : dst + std::accumulate(outputConfig_.planeSizes.begin(),
+							       outputConfig_.planeSizes.begin() + i, 0U);
+		};
+
+		chroma_[0] = plane(1);
+		chroma_[1] = outputConfig_.semiPlanar ? chroma_[0] + 1 : plane(2);
+	}
+
+	for (unsigned int i = 0; i < secondaryOutputs_.size(); i++) {
+		const MappedFrameBuffer *out = i + 1 < outputCount ? outMaps[i + 1] : nullptr;
+		secondaryOutputs_[i].dst = out ? out->planes()[0].data() : nullptr;
+	}
+
+	/* Workers aren't running yet, safe to switch the line handling */
+	if (!inputMemcpyProbed_)
+		probeInputMemcpy(src, in.planes()[0].size());
+
+	/* Stripe 0 is processed in this thread, the others by the workers */
+	for (unsigned int i = 1; i < stripes_.size(); i++)
+		workers_[i - 1]->queueFrame(src, dst);
 
-	metadata.planes()[0].bytesused = out.planes()[0].size();
+	processStripe(0, src, dst);
 
-	syncBufferForCPU(output, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
-	syncBufferForCPU(input, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+	stripesDone_.acquire(stripes_.size() - 1);
+
+	for (unsigned int i = 0; i < outputCount; i++) {
+		if (outMaps[i])
+			outputs[i]->_d()->metadata().planes()[0].bytesused =
+				outMaps[i]->planes()[0].size();
+	}
+
+	/*
+	 * Account the input lines copied to the line buffers and the output
+	 * lines copied from the RGB lines, on top of the input window read and
+	 * the output written.
+	 */
+	if (copyAccount_.active()) {
+		size_t copied = 0;
+		for (const Stripe &stripe : stripes_)
+			copied += stripe.copiedBytes;
+
+		size_t touched = static_cast<size_t>(window_.width) * inputConfig_.bpp / 8 *
+				 window_.height;
+		for (const MappedFrameBuffer *out : outMaps) {
+			if (!out)
+				continue;
+
+			for (const auto &plane : out->planes())
+				touched += plane.size();
+		}
+
+		copyAccount_.record(copied, touched);
+	}
+
+	/* End the CPU accesses before handing the buffers over */
+	for (MappedFrameBuffer::SyncScope &outSync : outSyncs)
+		outSync.clear();
+	inSync.clear();
 
 	/* Measure before emitting signals */
 	if (measuredFrames_ < DebayerCpu::kLastFrameToMeasure &&
@@ -806,43 +2555,19 @@ void DebayerCpu::process(uint32_t frame, FrameBuffer *input, FrameBuffer *output
 		}
 	}
 
-	/*
-	 * Buffer ids are currently not used, so pass zeros as its parameter.
-	 *
-	 * \todo Pass real bufferId once stats buffer passing is changed.
-	 */
-	stats_->finishFrame(frame, 0);
-	outputBufferReady.emit(output);
-	inputBufferReady.emit(input);
+	stats_->finishFrame(frame);
+	for (unsigned int i = 0; i < outputCount; i++) {
+		if (outputs[i])
+			outputBufferReady.emit(outputs[i]);
+	}
+	inputBufferReady.emit(input, timing);
 }
 
-SizeRange DebayerCpu::sizes(PixelFormat inputFormat, const Size &inputSize)
+/* Release the cached mappings, the buffers may be freed once stopped */
+void DebayerCpu::stop()
 {
-	Size patternSize = this->patternSize(inputFormat);
-	unsigned int borderHeight = patternSize.height;
-
-	if (patternSize.isNull())
-		return {};
-
-	/* No need for top/bottom border with a pattern height of 2 */
-	if (patternSize.height == 2)
-		borderHeight = 0;
-
-	/*
-	 * For debayer interpolation a border is kept around the entire image
-	 * and the minimum output size is pattern-height x pattern-width.
-	 */
-	if (inputSize.width < (3 * patternSize.width) ||
-	    inputSize.height < (2 * borderHeight + patternSize.height)) {
-		LOG(Debayer, Warning)
-			<< "Input format size too small: " << inputSize.toString();
-		return {};
-	}
-
-	return SizeRange(Size(patternSize.width, patternSize.height),
-			 Size((inputSize.width - 2 * patternSize.width) & ~(patternSize.width - 1),
-			      (inputSize.height - 2 * borderHeight) & ~(patternSize.height - 1)),
-			 patternSize.width, patternSize.height);
+	inputMaps_.clear();
+	outputMaps_.clear();
 }
 
 } /* namespace libcamera */
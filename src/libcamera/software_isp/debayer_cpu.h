@@ -15,49 +15,64 @@
 #include <stdint.h>
 #include <vector>
 
-#include <libcamera/base/object.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/semaphore.h>
+#include <libcamera/base/thread.h>
+
+#include <libcamera/color_space.h>
+#include <libcamera/transform.h>
 
 #include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/copy_accounting.h"
+#include "libcamera/internal/mapped_framebuffer.h"
 
 #include "debayer.h"
 #include "swstats_cpu.h"
 
 namespace libcamera {
 
-class DebayerCpu : public Debayer, public Object
+class DebayerCpu : public Debayer
 {
 public:
 	DebayerCpu(std::unique_ptr<SwStatsCpu> stats);
 	~DebayerCpu();
 
 	int configure(const StreamConfiguration &inputCfg,
-		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs);
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+		      Transform transform);
 	Size patternSize(PixelFormat inputFormat);
 	std::vector<PixelFormat> formats(PixelFormat input);
+	bool supportsTransform(PixelFormat outputFormat, Transform transform);
 	std::tuple<unsigned int, unsigned int>
 	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size);
-	void process(uint32_t frame, FrameBuffer *input, FrameBuffer *output, DebayerParams params);
-	SizeRange sizes(PixelFormat inputFormat, const Size &inputSize);
+	void process(uint32_t frame, FrameBuffer *input,
+		     const std::vector<FrameBuffer *> &outputs,
+		     const DebayerParams *params,
+		     const DebayerFrameTiming &timing);
+	void stop();
 
-	/**
-	 * \brief Get the file descriptor for the statistics
-	 *
-	 * \return the file descriptor pointing to the statistics
-	 */
-	const SharedFD &getStatsFD() { return stats_->getStatsFD(); }
+	unsigned int maxOutputs() const { return kMaxOutputs; }
+	Size secondarySize(PixelFormat outputFormat, const Size &primarySize,
+			   const Size &size);
 
 	/**
-	 * \brief Get the output frame size
+	 * \brief Tell whether input lines are copied to normal memory
+	 *
+	 * The choice is made on the first frame processed after configure().
 	 *
-	 * \return The output frame size
+	 * \return True if input lines are copied before debayering
 	 */
-	unsigned int frameSize() { return outputConfig_.frameSize; }
+	bool inputMemcpyEnabled() const { return enableInputMemcpy_; }
+
+	unsigned int frameSize(unsigned int output);
+	const std::vector<unsigned int> &planeSizes(unsigned int output);
 
 private:
 	/**
 	 * \brief Called to debayer 1 line of Bayer input data to output format
 	 * \param[out] dst Pointer to the start of the output line to write
 	 * \param[in] src The input data
+	 * \param[in] width The number of input pixels to debayer
 	 *
 	 * Input data is an array of (patternSize_.height + 1) src
 	 * pointers each pointing to a line in the Bayer source. The middle
@@ -81,33 +96,131 @@ private:
 	 * Similarly for bayer patterns which repeat every 4 lines, 5 src
 	 * pointers are passed holding: src[0] = 2-lines-up, src[1] = 1-line-up
 	 * src[2] = current-line, src[3] = 1-line-down, src[4] = 2-lines-down.
+	 *
+	 * When lines are debayered in vertical tiles, the src pointers point
+	 * to the first pixel of the tile, and the pixels on both sides of the
+	 * tile are read as neighbours.
+	 */
+	using debayerFn = void (DebayerCpu::*)(uint8_t *dst, const uint8_t *src[],
+					     unsigned int width);
+
+	/*
+	 * Same as debayerFn, for the first line of a line pair, also gathering
+	 * the statistics of the line as described by line. A null line skips
+	 * the statistics.
 	 */
-	using debayerFn = void (DebayerCpu::*)(uint8_t *dst, const uint8_t *src[]);
+	using debayerStatsFn = void (DebayerCpu::*)(uint8_t *dst, const uint8_t *src[],
+						    unsigned int width,
+						    const SwStatsCpu::LineStats *line);
+
+	template<debayerStatsFn fn>
+	void debayerWithoutStats(uint8_t *dst, const uint8_t *src[], unsigned int width)
+	{
+		(this->*fn)(dst, src, width, nullptr);
+	}
 
 	/* 8-bit raw bayer format */
 	template<bool addAlphaByte>
-	void debayer8_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer8_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	template<bool addAlphaByte>
-	void debayer8_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer8_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	/* unpacked 10-bit raw bayer format */
 	template<bool addAlphaByte>
-	void debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer10_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	template<bool addAlphaByte>
-	void debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer10_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	/* unpacked 12-bit raw bayer format */
 	template<bool addAlphaByte>
-	void debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer12_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	template<bool addAlphaByte>
-	void debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer12_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	/* CSI-2 packed 10-bit raw bayer format (all the 4 orders) */
 	template<bool addAlphaByte>
-	void debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer10P_BGBG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	template<bool addAlphaByte>
-	void debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer10P_GRGR_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	template<bool addAlphaByte>
-	void debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer10P_GBGB_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
 	template<bool addAlphaByte>
-	void debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[]);
+	void debayer10P_RGRG_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
+	/* unpacked 8, 10 and 12-bit raw bayer formats, gathering statistics */
+	template<typename pixel_t, unsigned int shift, bool bgLine, bool addAlphaByte>
+	void debayerStats_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width,
+				 const SwStatsCpu::LineStats *line);
+	/*
+	 * Vectorized unpacked 8, 10 and 12-bit raw bayer formats, for BGBG
+	 * (bgLine == true) and GRGR lines. Pixel values are shifted right by
+	 * shift bits to produce 8-bit lookup table indices. Statistics are
+	 * only gathered when gatherStats is true.
+	 */
+#if defined(__x86_64__) || defined(__i386__)
+	template<typename pixel_t, unsigned int shift, bool bgLine, bool addAlphaByte,
+		 bool gatherStats>
+	void debayerAVX2_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width,
+				const SwStatsCpu::LineStats *line);
+#endif
+#if defined(__ARM_NEON)
+	template<typename pixel_t, unsigned int shift, bool bgLine, bool addAlphaByte,
+		 bool gatherStats>
+	void debayerNEON_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width,
+				const SwStatsCpu::LineStats *line);
+#endif
+	/*
+	 * Binned unpacked 8, 10 and 12-bit raw bayer formats, producing one
+	 * output pixel per factor x factor block of input pixels. src holds
+	 * the factor input lines of the block, from top to bottom.
+	 */
+	template<typename pixel_t, unsigned int shift, unsigned int factor, bool addAlphaByte>
+	void debayerBinned_BGR888(uint8_t *dst, const uint8_t *src[], unsigned int width);
+
+	/*
+	 * Colour correction of debayered lines, in place. The vectorized
+	 * functions return the number of pixels they have processed, the
+	 * remaining ones are handled by the scalar code.
+	 */
+	template<unsigned int pixelBytes>
+	void correctLine(uint8_t *line, unsigned int width);
+#if defined(__x86_64__) || defined(__i386__)
+	template<unsigned int pixelBytes>
+	unsigned int correctLineAVX2(uint8_t *line, unsigned int width);
+#endif
+#if defined(__ARM_NEON)
+	template<unsigned int pixelBytes>
+	unsigned int correctLineNEON(uint8_t *line, unsigned int width);
+#endif
+
+	/*
+	 * An RGB output downscaled by an integer factor from the first output,
+	 * by averaging factor x factor blocks of its debayered pixels.
+	 */
+	struct SecondaryOutput;
+
+	/*
+	 * Called to downscale the 2 debayered lines starting at the
+	 * window-relative line y to a secondary output. lines point to the
+	 * pixel of input column x in each line, and width pixels are available
+	 * from there. Lines that don't complete an output line are accumulated
+	 * in sums.
+	 */
+	using scaleFn = void (DebayerCpu::*)(const SecondaryOutput &output,
+					     std::vector<uint16_t> &sums,
+					     const uint8_t *lines[], unsigned int y,
+					     unsigned int x, unsigned int width);
+
+	struct SecondaryOutput {
+		Size size;
+		unsigned int factor;
+		unsigned int stride;
+		std::vector<unsigned int> planeSizes;
+		bool swapRedBlue; /* Relative to the first output */
+		scaleFn scale;
+		uint8_t *dst; /* Of the frame being processed, nullptr if unused */
+	};
+
+	template<unsigned int factor, unsigned int inBytes, unsigned int outBytes>
+	void scaleLinePair(const SecondaryOutput &output, std::vector<uint16_t> &sums,
+			   const uint8_t *lines[], unsigned int y,
+			   unsigned int x, unsigned int width);
 
 	struct DebayerInputConfig {
 		Size patternSize;
@@ -120,39 +233,169 @@ private:
 		unsigned int bpp; /* Memory used per pixel, not precision */
 		unsigned int stride;
 		unsigned int frameSize;
+		std::vector<unsigned int> planeSizes;
+		/* YUV 4:2:0 outputs only */
+		bool yuv;
+		bool semiPlanar;
+		unsigned int chromaStride;
 	};
 
 	int getInputConfig(PixelFormat inputFormat, DebayerInputConfig &config);
 	int getOutputConfig(PixelFormat outputFormat, DebayerOutputConfig &config);
 	int setupStandardBayerOrder(BayerFormat::Order order);
 	int setDebayerFunctions(PixelFormat inputFormat, PixelFormat outputFormat);
-	void setupInputMemcpy(const uint8_t *linePointers[]);
-	void shiftLinePointers(const uint8_t *linePointers[], const uint8_t *src);
-	void memcpyNextLine(const uint8_t *linePointers[]);
-	void process2(const uint8_t *src, uint8_t *dst);
-	void process4(const uint8_t *src, uint8_t *dst);
+	void setVectorDebayerFunctions(unsigned int bitDepth, bool addAlphaByte);
+	int setBinnedDebayerFunctions(const BayerFormat &bayerFormat, bool addAlphaByte);
+	int configureSecondaryOutput(const StreamConfiguration &outputCfg);
 
 	/* Max. supported Bayer pattern height is 4, debayering this requires 5 lines */
 	static constexpr unsigned int kMaxLineBuffers = 5;
 
+	/*
+	 * A horizontal band of the output window, debayered independently of
+	 * the other stripes. y and height are output lines relative to the top
+	 * of the window and are multiples of the pattern height. The stripe
+	 * is debayered one vertical tile at a time, tileX and tileWidth being
+	 * the input columns of the current tile, relative to the window.
+	 */
+	struct Stripe {
+		unsigned int index;
+		unsigned int y;
+		unsigned int height;
+		unsigned int tileX;
+		unsigned int tileWidth;
+		std::vector<uint8_t> lineBuffers[kMaxLineBuffers];
+		unsigned int lineBufferIndex;
+		/*
+		 * Debayered lines, for YUV and mirrored or transposed outputs,
+		 * and for frames without the first output
+		 */
+		std::vector<std::vector<uint8_t>> rgbLines;
+		/* Per secondary output, for factors larger than 2 */
+		std::vector<std::vector<uint16_t>> sums;
+		/* Bytes copied in the current frame, for copy accounting */
+		size_t copiedBytes;
+	};
+
+	class StripeWorker : public Thread
+	{
+	public:
+		StripeWorker(DebayerCpu *debayer, unsigned int stripe);
+		~StripeWorker();
+
+		void start();
+		void queueFrame(const uint8_t *src, uint8_t *dst);
+
+	protected:
+		void run() override;
+
+	private:
+		DebayerCpu *debayer_;
+		const unsigned int stripe_;
+
+		Mutex mutex_;
+		ConditionVariable cv_;
+
+		const uint8_t *src_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		uint8_t *dst_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		bool pending_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		bool running_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	};
+
+	void setupStripes();
+	void setupTiles();
+	void probeInputMemcpy(const uint8_t *src, size_t size);
+	void setupInputMemcpy(Stripe &stripe, const uint8_t *linePointers[]);
+	void shiftLinePointers(const uint8_t *linePointers[], const uint8_t *src);
+	void memcpyNextLine(Stripe &stripe, const uint8_t *linePointers[]);
+	void setupYUVConversion(const ColorSpace &colorSpace);
+	unsigned int outputRow(unsigned int y) const;
+	uint8_t *outputLine(Stripe &stripe, uint8_t *dst, unsigned int y);
+	void correctLinePair(Stripe &stripe, uint8_t *dst, unsigned int y,
+			     unsigned int width);
+	void scaleLinePairs(Stripe &stripe, uint8_t *dst, unsigned int y,
+			    unsigned int width);
+	void convertLinePair(Stripe &stripe, uint8_t *dst, unsigned int y);
+	void convertYUVLinePair(Stripe &stripe, uint8_t *dst, unsigned int y);
+	template<unsigned int pixelBytes>
+	void mirrorLinePair(Stripe &stripe, uint8_t *dst, unsigned int y);
+	template<unsigned int pixelBytes>
+	void transposeLines(Stripe &stripe, uint8_t *dst, unsigned int y,
+			    unsigned int count);
+	void debayerLine0(Stripe &stripe, uint8_t *dst, const uint8_t *src[],
+			  unsigned int y);
+	void processStripe(unsigned int index, const uint8_t *src, uint8_t *dst);
+	void process2(Stripe &stripe, const uint8_t *src, uint8_t *dst);
+	void process4(Stripe &stripe, const uint8_t *src, uint8_t *dst);
+	void processBinned(Stripe &stripe, const uint8_t *src, uint8_t *dst);
+
+	/* Stripes smaller than this aren't worth the synchronization cost */
+	static constexpr unsigned int kMinStripeHeight = 32;
+	static constexpr unsigned int kDefaultMaxThreads = 4;
+	/* Fixed-point precision of the YUV conversion matrix */
+	static constexpr unsigned int kYUVShift = 8;
+	/* Turns colour corrected 8-bit values into gamma lookup table indices */
+	static constexpr unsigned int kCcmIndexShift = DebayerParams::kCcmShift - 2;
+	/* Small enough to fit in the L1 or L2 cache */
+	static constexpr size_t kInputProbeSize = 16 * 1024;
+	/* Input regions timed to probe the cacheability, odd for the median */
+	static constexpr unsigned int kInputProbeSamples = 5;
+	/* Largest factor by which the input is binned for small outputs */
+	static constexpr unsigned int kMaxBinning = 4;
+	/* The first output and the secondary outputs */
+	static constexpr unsigned int kMaxOutputs = 3;
+	/* Largest factor by which secondary outputs are downscaled */
+	static constexpr unsigned int kMaxScaleFactor = 4;
+	/* Lines written together to transposed outputs, a multiple of 4 */
+	static constexpr unsigned int kTransposeLines = 16;
+	/* Tile widths are multiples of this, for the statistics subsampling */
+	static constexpr unsigned int kTileAlignment = 64;
+	/* Narrower tiles spend more time on the overlap than they save */
+	static constexpr unsigned int kMinTileWidth = 512;
+	/* Used when the cache size can't be read from sysfs */
+	static constexpr unsigned int kDefaultCacheSize = 32 * 1024;
+
 	DebayerParams::ColorLookupTable red_;
 	DebayerParams::ColorLookupTable green_;
 	DebayerParams::ColorLookupTable blue_;
+	DebayerParams::GammaLookupTable gamma_;
+	uint32_t lutVersion_; /* Version of the tables above, 0 if invalid */
+	bool ccmEnabled_;
+	bool ccmAVX2_;
+	int16_t ccm_[3][3]; /* In the byte order of the output pixels */
 	debayerFn debayer0_;
 	debayerFn debayer1_;
 	debayerFn debayer2_;
 	debayerFn debayer3_;
-	Rectangle window_;
+	/* Variants of debayer0_ and debayer1_ gathering statistics, if any */
+	debayerStatsFn debayer0Stats_;
+	debayerStatsFn debayer1Stats_;
+	Rectangle window_; /* Input pixels debayered to the output */
+	Size outputSize_; /* Before transposition */
+	Transform transform_; /* Applied when writing the output */
+	unsigned int bufferedLines_; /* Per stripe, 0 if written in place */
+	unsigned int tileWidth_; /* Input columns, window_.width if not tiled */
+	unsigned int binning_; /* 1 when not binning */
+	Point binRed_; /* Position of red in the 2x2 quads, when binning */
 	DebayerInputConfig inputConfig_;
 	DebayerOutputConfig outputConfig_;
-	std::unique_ptr<SwStatsCpu> stats_;
-	std::vector<uint8_t> lineBuffers_[kMaxLineBuffers];
+	std::vector<SecondaryOutput> secondaryOutputs_;
+	std::vector<Stripe> stripes_;
+	MappedFrameBufferCache inputMaps_;
+	MappedFrameBufferCache outputMaps_;
+	CopyAccount copyAccount_;
+	std::vector<std::unique_ptr<StripeWorker>> workers_;
+	Semaphore stripesDone_;
+	unsigned int threadCount_;
 	unsigned int lineBufferLength_;
 	unsigned int lineBufferPadding_;
-	unsigned int lineBufferIndex_;
 	unsigned int xShift_; /* Offset of 0/1 applied to window_.x */
 	bool enableInputMemcpy_;
+	bool inputMemcpyProbed_;
 	bool swapRedBlueGains_;
+	int yuvMatrix_[3][3];
+	int yOffset_;
+	uint8_t *chroma_[2]; /* Cb and Cr of the frame being processed */
 	unsigned int measuredFrames_;
 	int64_t frameProcessTime_;
 	/* Skip 30 frames for things to stabilize then measure 30 frames */
@@ -0,0 +1,871 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * GPU based debayering class
+ */
+
+#include "debayer_egl.h"
+
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <string.h>
+
+#include <libcamera/base/utils.h>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/framebuffer.h"
+
+namespace libcamera {
+
+/**
+ * \class DebayerEGL
+ * \brief Class for debayering on the GPU
+ *
+ * Implementation of debayering and statistics gathering with OpenGL ES 3.1.
+ * The input and output dma_bufs are imported as EGL images, frames are
+ * debayered and the colour lookup tables applied by a fragment shader
+ * rendering to the output buffer, and the statistics are gathered by a compute
+ * shader. Only the statistics are read back by the CPU.
+ *
+ * The EGL context is created at construction time on the surfaceless Mesa
+ * platform, isValid() tells whether a usable GPU has been found. GL objects
+ * are created and used in the thread processing frames, which must call
+ * stop() before it stops. Only standard Bayer orders of 8, 10 and 12 bits
+ * unpacked and 10 bits CSI-2 packed formats are supported, to 32 bits RGB
+ * output formats.
+ */
+
+namespace {
+
+const char *kVertexShader = R"(
+void main()
+{
+	/* A triangle covering the whole viewport */
+	vec2 pos = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1));
+	gl_Position = vec4(pos - 1.0, 0.0, 1.0);
+}
+)";
+
+/*
+ * Shared by both shaders, fetch the pixel at pos as an integer value, with
+ * the coordinates clamped to the input frame.
+ */
+const char *kFetchShader = R"(
+precision highp float;
+precision highp int;
+
+uniform highp sampler2D bayer;
+uniform ivec2 maxCoord;
+uniform ivec2 firstRed;
+uniform ivec2 offset;
+
+int fetch(ivec2 pos)
+{
+	pos = clamp(pos, ivec2(0), maxCoord);
+#if PACKED
+	/* Skip the byte holding the least significant bits of 4 pixels */
+	pos.x += pos.x >> 2;
+#endif
+	return int(texelFetch(bayer, pos, 0).r * SCALE + 0.5);
+}
+)";
+
+/*
+ * Bilinear interpolation, matching the DebayerCpu results. The first lookup
+ * table row holds red values, the second green, the third blue and the fourth
+ * the gamma table applied after the colour correction matrix.
+ */
+const char *kDebayerShader = R"(
+uniform highp sampler2D lut;
+uniform bool ccmEnabled;
+uniform mat3 ccm;
+
+out vec4 fragColor;
+
+float lookup(int value, int channel)
+{
+	return texelFetch(lut, ivec2(value >> SHIFT, channel), 0).r;
+}
+
+void main()
+{
+	ivec2 pos = ivec2(gl_FragCoord.xy) + offset;
+	ivec2 phase = (pos + firstRed) & 1;
+
+	int c = fetch(pos);
+	int h = fetch(pos + ivec2(-1, 0)) + fetch(pos + ivec2(1, 0));
+	int v = fetch(pos + ivec2(0, -1)) + fetch(pos + ivec2(0, 1));
+	int d = fetch(pos + ivec2(-1, -1)) + fetch(pos + ivec2(1, -1)) +
+		fetch(pos + ivec2(-1, 1)) + fetch(pos + ivec2(1, 1));
+	int r, g, b;
+
+	if (phase == ivec2(0, 0)) {
+		r = c;
+		g = (h + v) >> 2;
+		b = d >> 2;
+	} else if (phase == ivec2(1, 1)) {
+		r = d >> 2;
+		g = (h + v) >> 2;
+		b = c;
+	} else if (phase.y == 0) {
+		/* Green on a red line */
+		r = h >> 1;
+		g = c;
+		b = v >> 1;
+	} else {
+		/* Green on a blue line */
+		r = v >> 1;
+		g = c;
+		b = h >> 1;
+	}
+
+	vec3 rgb = vec3(lookup(r, 0), lookup(g, 1), lookup(b, 2));
+
+	if (ccmEnabled) {
+		/* Index the gamma table with 2 more bits, as DebayerCpu does */
+		ivec3 index = ivec3(clamp(ccm * rgb * 1020.0 + 0.5, 0.0,
+					  float(GAMMA_SIZE - 1)));
+		rgb = vec3(texelFetch(lut, ivec2(index.r, 3), 0).r,
+			   texelFetch(lut, ivec2(index.g, 3), 0).r,
+			   texelFetch(lut, ivec2(index.b, 3), 0).r);
+	}
+
+	fragColor = vec4(rgb, 1.0);
+}
+)";
+
+/*
+ * Sample one 2x2 block out of SwStatsCpu::subsampling() blocks in each
+ * direction, as SwStatsCpu does. Sums are accumulated per workgroup to avoid overflows, and added up
+ * by the CPU.
+ */
+const char *kStatsShader = R"(
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+uniform ivec2 blocks;
+
+layout(std430, binding = 0) buffer Stats {
+	uint histogram[HISTOGRAM_SIZE];
+	uvec4 sums[];
+};
+
+shared uint sumR;
+shared uint sumG;
+shared uint sumB;
+shared uint groupHistogram[HISTOGRAM_SIZE];
+
+void main()
+{
+	uint index = gl_LocalInvocationIndex;
+	ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+
+	if (index == 0u) {
+		sumR = 0u;
+		sumG = 0u;
+		sumB = 0u;
+	}
+	if (index < uint(HISTOGRAM_SIZE))
+		groupHistogram[index] = 0u;
+	barrier();
+
+	if (all(lessThan(block, blocks))) {
+		ivec2 pos = offset + block * STATS_STEP;
+		uint r = uint(fetch(pos + firstRed));
+		uint b = uint(fetch(pos + 1 - firstRed));
+		uint g = uint(fetch(pos + ivec2(1 - firstRed.x, firstRed.y)) +
+			      fetch(pos + ivec2(firstRed.x, 1 - firstRed.y))) / 2u;
+		uint y = r * 77u + g * 150u + b * 29u;
+
+		atomicAdd(sumR, r);
+		atomicAdd(sumG, g);
+		atomicAdd(sumB, b);
+		atomicAdd(groupHistogram[y * uint(HISTOGRAM_SIZE) / (256u * 256u * uint(1 << SHIFT))], 1u);
+	}
+	barrier();
+
+	if (index < uint(HISTOGRAM_SIZE))
+		atomicAdd(histogram[index], groupHistogram[index]);
+	if (index == 0u)
+		sums[gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x] =
+			uvec4(sumR, sumG, sumB, 0u);
+}
+)";
+
+bool hasExtension(const char *extensions, const char *extension)
+{
+	if (!extensions)
+		return false;
+
+	std::string list = std::string(" ") + extensions + " ";
+	return list.find(std::string(" ") + extension + " ") != std::string::npos;
+}
+
+GLuint compileShader(GLenum type, const std::string &source)
+{
+	GLuint shader = glCreateShader(type);
+	const char *src = source.c_str();
+	GLint status;
+
+	glShaderSource(shader, 1, &src, nullptr);
+	glCompileShader(shader);
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		char log[1024];
+
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		LOG(Debayer, Error) << "Failed to compile shader: " << log;
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+GLuint linkProgram(const std::vector<std::pair<GLenum, std::string>> &sources)
+{
+	GLuint program = glCreateProgram();
+	GLint status;
+
+	for (const auto &[type, source] : sources) {
+		GLuint shader = compileShader(type, source);
+		if (!shader) {
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		/* The shader is deleted along with the program */
+		glAttachShader(program, shader);
+		glDeleteShader(shader);
+	}
+
+	glLinkProgram(program);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		char log[1024];
+
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		LOG(Debayer, Error) << "Failed to link program: " << log;
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+bool isSupportedInput(const BayerFormat &bayerFormat)
+{
+	if (bayerFormat.order != BayerFormat::BGGR && bayerFormat.order != BayerFormat::GBRG &&
+	    bayerFormat.order != BayerFormat::GRBG && bayerFormat.order != BayerFormat::RGGB)
+		return false;
+
+	if (bayerFormat.packing == BayerFormat::Packing::None)
+		return bayerFormat.bitDepth == 8 || bayerFormat.bitDepth == 10 ||
+		       bayerFormat.bitDepth == 12;
+
+	return bayerFormat.packing == BayerFormat::Packing::CSI2 &&
+	       bayerFormat.bitDepth == 10;
+}
+
+} /* namespace */
+
+/**
+ * \brief Constructs a DebayerEGL object
+ * \param[in] stats Pointer to the stats object to use
+ */
+DebayerEGL::DebayerEGL(std::unique_ptr<SwStatsCpu> stats)
+	: Debayer(std::move(stats)), display_(EGL_NO_DISPLAY),
+	  context_(EGL_NO_CONTEXT), reconfigured_(false), debayerProgram_(0),
+	  statsProgram_(0), lutTexture_(0), lutVersion_(0), statsBuffer_(0)
+{
+	if (initEGL() < 0 && context_ != EGL_NO_CONTEXT) {
+		eglDestroyContext(display_, context_);
+		context_ = EGL_NO_CONTEXT;
+	}
+}
+
+DebayerEGL::~DebayerEGL()
+{
+	if (context_ != EGL_NO_CONTEXT) {
+		if (eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_)) {
+			destroyImages();
+			destroyGLObjects();
+			eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				       EGL_NO_CONTEXT);
+		}
+
+		eglDestroyContext(display_, context_);
+	}
+
+	if (display_ != EGL_NO_DISPLAY)
+		eglTerminate(display_);
+}
+
+/**
+ * \fn bool DebayerEGL::isValid() const
+ * \brief Tell whether a usable GPU has been found
+ * \return True if frames can be debayered on the GPU, false otherwise
+ */
+
+int DebayerEGL::initEGL()
+{
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (!hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		LOG(Debayer, Debug) << "EGL surfaceless platform not supported";
+		return -ENODEV;
+	}
+
+	auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+		eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (!getPlatformDisplay)
+		return -ENODEV;
+
+	EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+						EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+		LOG(Debayer, Debug) << "Failed to initialize EGL display";
+		return -ENODEV;
+	}
+
+	display_ = display;
+
+	const char *extensions = eglQueryString(display_, EGL_EXTENSIONS);
+	for (const char *extension : { "EGL_EXT_image_dma_buf_import",
+				       "EGL_KHR_surfaceless_context" }) {
+		if (!hasExtension(extensions, extension)) {
+			LOG(Debayer, Debug) << extension << " not supported";
+			return -ENOTSUP;
+		}
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_ES_API))
+		return -ENOTSUP;
+
+	static const EGLint configAttribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs;
+
+	if (!eglChooseConfig(display_, configAttribs, &config, 1, &numConfigs) ||
+	    numConfigs == 0) {
+		LOG(Debayer, Debug) << "No OpenGL ES 3 EGL configuration";
+		return -ENOTSUP;
+	}
+
+	static const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 1,
+		EGL_NONE
+	};
+
+	context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context_ == EGL_NO_CONTEXT) {
+		LOG(Debayer, Debug) << "Failed to create OpenGL ES 3.1 context";
+		return -ENOTSUP;
+	}
+
+	eglCreateImageKHR_ = reinterpret_cast<PFNEGLCREATEIMAGEKHRPROC>(
+		eglGetProcAddress("eglCreateImageKHR"));
+	eglDestroyImageKHR_ = reinterpret_cast<PFNEGLDESTROYIMAGEKHRPROC>(
+		eglGetProcAddress("eglDestroyImageKHR"));
+	glEGLImageTargetTexture2DOES_ = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(
+		eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+	if (!eglCreateImageKHR_ || !eglDestroyImageKHR_ || !glEGLImageTargetTexture2DOES_)
+		return -ENOTSUP;
+
+	/* Release the context after checking it, for the processing thread */
+	if (!eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_))
+		return -ENOTSUP;
+
+	const char *glExtensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+	const bool supported = hasExtension(glExtensions, "GL_OES_EGL_image");
+
+	LOG(Debayer, Debug)
+		<< "Using GPU "
+		<< reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+
+	eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+	if (!supported) {
+		LOG(Debayer, Debug) << "GL_OES_EGL_image not supported";
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+Size DebayerEGL::patternSize(PixelFormat inputFormat)
+{
+	BayerFormat bayerFormat = BayerFormat::fromPixelFormat(inputFormat);
+
+	if (!isSupportedInput(bayerFormat))
+		return {};
+
+	/* 5 bytes per *4* pixels for packed formats */
+	if (bayerFormat.packing == BayerFormat::Packing::CSI2)
+		return { 4, 2 };
+
+	return { 2, 2 };
+}
+
+std::vector<PixelFormat> DebayerEGL::formats(PixelFormat inputFormat)
+{
+	if (patternSize(inputFormat).isNull())
+		return {};
+
+	/* The output memory layout is handled by the dma_buf import */
+	return { formats::XRGB8888, formats::ARGB8888,
+		 formats::XBGR8888, formats::ABGR8888 };
+}
+
+std::tuple<unsigned int, unsigned int>
+DebayerEGL::strideAndFrameSize(const PixelFormat &outputFormat, const Size &size)
+{
+	if (outputFormat != formats::XRGB8888 && outputFormat != formats::ARGB8888 &&
+	    outputFormat != formats::XBGR8888 && outputFormat != formats::ABGR8888)
+		return std::make_tuple(0, 0);
+
+	unsigned int stride = utils::alignUp(size.width * 4, kStrideAlignment);
+
+	return std::make_tuple(stride, stride * size.height);
+}
+
+int DebayerEGL::configure(const StreamConfiguration &inputCfg,
+			  const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+			  Transform transform)
+{
+	if (transform != Transform::Identity) {
+		LOG(Debayer, Error)
+			<< "Unsupported transform " << transformToString(transform);
+		return -EINVAL;
+	}
+
+	const Size patternSize = this->patternSize(inputCfg.pixelFormat);
+	if (patternSize.isNull())
+		return -EINVAL;
+
+	if (stats_->configure(inputCfg) != 0)
+		return -EINVAL;
+
+	if (outputCfgs.size() != 1) {
+		LOG(Debayer, Error)
+			<< "Unsupported number of output streams: "
+			<< outputCfgs.size();
+		return -EINVAL;
+	}
+
+	const StreamConfiguration &outputCfg = outputCfgs[0];
+	SizeRange outSizeRange = sizes(inputCfg.pixelFormat, inputCfg.size);
+	std::tie(outputStride_, frameSize_) =
+		strideAndFrameSize(outputCfg.pixelFormat, outputCfg.size);
+
+	if (!outputStride_) {
+		LOG(Debayer, Error)
+			<< "Unsupported output format " << outputCfg.pixelFormat;
+		return -EINVAL;
+	}
+
+	if (!outSizeRange.contains(outputCfg.size) || outputStride_ != outputCfg.stride) {
+		LOG(Debayer, Error)
+			<< "Invalid output size/stride: "
+			<< "\n  " << outputCfg.size << " (" << outSizeRange << ")"
+			<< "\n  " << outputCfg.stride << " (" << outputStride_ << ")";
+		return -EINVAL;
+	}
+
+	inputFormat_ = BayerFormat::fromPixelFormat(inputCfg.pixelFormat);
+	inputSize_ = inputCfg.size;
+	inputStride_ = inputCfg.stride;
+	outputFormat_ = outputCfg.pixelFormat;
+	planeSizes_ = { frameSize_ };
+
+	window_.x = ((inputCfg.size.width - outputCfg.size.width) / 2) &
+		    ~(patternSize.width - 1);
+	window_.y = ((inputCfg.size.height - outputCfg.size.height) / 2) &
+		    ~(patternSize.height - 1);
+	window_.width = outputCfg.size.width;
+	window_.height = outputCfg.size.height;
+
+	switch (inputFormat_.order) {
+	case BayerFormat::BGGR:
+		firstRed_ = { 1, 1 };
+		break;
+	case BayerFormat::GBRG:
+		firstRed_ = { 0, 1 };
+		break;
+	case BayerFormat::GRBG:
+		firstRed_ = { 1, 0 };
+		break;
+	default:
+		firstRed_ = { 0, 0 };
+		break;
+	}
+
+	/* The statistics cover the whole output window */
+	stats_->setWindow(Rectangle(window_.size()));
+	const unsigned int step = statsStep();
+	statsBlocks_ = { (window_.width + step - 1) / step,
+			 (window_.height + step - 1) / step };
+	statsGroups_ = { (statsBlocks_.width + kStatsGroupSize - 1) / kStatsGroupSize,
+			 (statsBlocks_.height + kStatsGroupSize - 1) / kStatsGroupSize };
+
+	/* GL objects are recreated in the thread processing frames */
+	reconfigured_ = true;
+
+	return 0;
+}
+
+bool DebayerEGL::makeCurrent()
+{
+	if (eglGetCurrentContext() == context_)
+		return true;
+
+	if (!eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_)) {
+		LOG(Debayer, Error)
+			<< "Failed to make EGL context current: 0x"
+			<< utils::hex(eglGetError());
+		return false;
+	}
+
+	return true;
+}
+
+/* Distance between the sampled statistics blocks, in pixels */
+unsigned int DebayerEGL::statsStep() const
+{
+	return stats_->subsampling() * 2;
+}
+
+std::string DebayerEGL::shaderHeader(const char *version) const
+{
+	const bool packed = inputFormat_.packing == BayerFormat::Packing::CSI2;
+	const bool wide = !packed && inputFormat_.bitDepth > 8;
+	std::stringstream header;
+
+	header << "#version " << version << "\n"
+	       << "#define PACKED " << packed << "\n"
+	       /* Only the 8 most significant bits of packed pixels are used */
+	       << "#define SHIFT " << (wide ? inputFormat_.bitDepth - 8 : 0) << "\n"
+	       << "#define SCALE " << (wide ? "65535.0" : "255.0") << "\n"
+	       << "#define GROUP_SIZE " << kStatsGroupSize << "\n"
+	       << "#define STATS_STEP " << statsStep() << "\n"
+	       << "#define HISTOGRAM_SIZE " << SwIspStats::kYHistogramSize << "\n"
+	       << "#define GAMMA_SIZE " << DebayerParams::kGammaLookupSize << "\n";
+
+	return header.str();
+}
+
+int DebayerEGL::createGLObjects()
+{
+	destroyImages();
+	destroyGLObjects();
+
+	debayerProgram_ = linkProgram({
+		{ GL_VERTEX_SHADER, shaderHeader("300 es") + kVertexShader },
+		{ GL_FRAGMENT_SHADER, shaderHeader("300 es") + kFetchShader + kDebayerShader },
+	});
+	statsProgram_ = linkProgram({
+		{ GL_COMPUTE_SHADER, shaderHeader("310 es") + kFetchShader + kStatsShader },
+	});
+	if (!debayerProgram_ || !statsProgram_)
+		return -EINVAL;
+
+	const GLint maxCoord[2] = { static_cast<GLint>(inputSize_.width - 1),
+				    static_cast<GLint>(inputSize_.height - 1) };
+
+	for (GLuint program : { debayerProgram_, statsProgram_ }) {
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "bayer"), 0);
+		glUniform2iv(glGetUniformLocation(program, "maxCoord"), 1, maxCoord);
+		glUniform2i(glGetUniformLocation(program, "firstRed"),
+			    firstRed_.x, firstRed_.y);
+	}
+
+	glUseProgram(debayerProgram_);
+	glUniform1i(glGetUniformLocation(debayerProgram_, "lut"), 1);
+	glUniform2i(glGetUniformLocation(debayerProgram_, "offset"),
+		    window_.x, window_.y);
+
+	glUseProgram(statsProgram_);
+	glUniform2i(glGetUniformLocation(statsProgram_, "offset"),
+		    window_.x, window_.y);
+	glUniform2i(glGetUniformLocation(statsProgram_, "blocks"),
+		    statsBlocks_.width, statsBlocks_.height);
+
+	/*
+	 * One row of DebayerParams::kRGBLookupSize entries per colour, and one
+	 * row of DebayerParams::kGammaLookupSize entries for the gamma table.
+	 */
+	glGenTextures(1, &lutTexture_);
+	glBindTexture(GL_TEXTURE_2D, lutTexture_);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, DebayerParams::kGammaLookupSize, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	lutVersion_ = 0;
+
+	const std::vector<uint8_t> zero(SwIspStats::kYHistogramSize * sizeof(uint32_t) +
+					statsGroups_.width * statsGroups_.height * 4 * sizeof(uint32_t));
+	glGenBuffers(1, &statsBuffer_);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer_);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, zero.size(), zero.data(), GL_DYNAMIC_READ);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	reconfigured_ = false;
+
+	return 0;
+}
+
+void DebayerEGL::destroyGLObjects()
+{
+	if (debayerProgram_)
+		glDeleteProgram(debayerProgram_);
+	if (statsProgram_)
+		glDeleteProgram(statsProgram_);
+	if (lutTexture_)
+		glDeleteTextures(1, &lutTexture_);
+	if (statsBuffer_)
+		glDeleteBuffers(1, &statsBuffer_);
+
+	debayerProgram_ = 0;
+	statsProgram_ = 0;
+	lutTexture_ = 0;
+	statsBuffer_ = 0;
+}
+
+/*
+ * Import the first plane of a dma_buf. Images are cached, and recreated when
+ * the FrameBuffer now wraps a different dma_buf. Packed input lines are
+ * imported as lines of bytes, unpacked 10 and 12 bits pixels as 16 bits
+ * values.
+ */
+DebayerEGL::Image *DebayerEGL::importBuffer(FrameBuffer *buffer, bool output)
+{
+	const FrameBuffer::Plane &plane = buffer->planes()[0];
+
+	auto it = images_.find(buffer);
+	if (it != images_.end()) {
+		if (it->second.fd == plane.fd.get())
+			return &it->second;
+
+		glDeleteFramebuffers(1, &it->second.framebuffer);
+		glDeleteTextures(1, &it->second.texture);
+		eglDestroyImageKHR_(display_, it->second.image);
+		images_.erase(it);
+	}
+
+	EGLint fourcc, width, height, pitch;
+
+	if (output) {
+		fourcc = outputFormat_.fourcc();
+		width = window_.width;
+		height = window_.height;
+		pitch = outputStride_;
+	} else if (inputFormat_.packing == BayerFormat::Packing::CSI2) {
+		fourcc = formats::R8.fourcc();
+		width = inputStride_;
+		height = inputSize_.height;
+		pitch = inputStride_;
+	} else {
+		fourcc = (inputFormat_.bitDepth > 8 ? formats::R16 : formats::R8).fourcc();
+		width = inputSize_.width;
+		height = inputSize_.height;
+		pitch = inputStride_;
+	}
+
+	const EGLint attribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_LINUX_DRM_FOURCC_EXT, fourcc,
+		EGL_DMA_BUF_PLANE0_FD_EXT, plane.fd.get(),
+		EGL_DMA_BUF_PLANE0_OFFSET_EXT, static_cast<EGLint>(plane.offset),
+		EGL_DMA_BUF_PLANE0_PITCH_EXT, pitch,
+		EGL_NONE
+	};
+
+	Image image = {};
+	image.fd = plane.fd.get();
+	image.image = eglCreateImageKHR_(display_, EGL_NO_CONTEXT,
+					 EGL_LINUX_DMA_BUF_EXT, nullptr, attribs);
+	if (image.image == EGL_NO_IMAGE_KHR) {
+		LOG(Debayer, Error)
+			<< "Failed to import dma_buf " << image.fd << ": 0x"
+			<< utils::hex(eglGetError());
+		return nullptr;
+	}
+
+	glGenTextures(1, &image.texture);
+	glBindTexture(GL_TEXTURE_2D, image.texture);
+	glEGLImageTargetTexture2DOES_(GL_TEXTURE_2D, image.image);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	if (output) {
+		glGenFramebuffers(1, &image.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, image.framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				       GL_TEXTURE_2D, image.texture, 0);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			LOG(Debayer, Error)
+				<< "Can't render to " << outputFormat_ << " buffers";
+			glDeleteFramebuffers(1, &image.framebuffer);
+			glDeleteTextures(1, &image.texture);
+			eglDestroyImageKHR_(display_, image.image);
+			return nullptr;
+		}
+	}
+
+	return &images_.emplace(buffer, image).first->second;
+}
+
+void DebayerEGL::destroyImages()
+{
+	for (auto &[buffer, image] : images_) {
+		glDeleteFramebuffers(1, &image.framebuffer);
+		glDeleteTextures(1, &image.texture);
+		eglDestroyImageKHR_(display_, image.image);
+	}
+
+	images_.clear();
+}
+
+void DebayerEGL::readStats()
+{
+	const unsigned int groups = statsGroups_.width * statsGroups_.height;
+	const GLsizeiptr size = (SwIspStats::kYHistogramSize + 4 * groups) * sizeof(uint32_t);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer_);
+
+	const uint32_t *data = static_cast<const uint32_t *>(
+		glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, GL_MAP_READ_BIT));
+	if (!data) {
+		LOG(Debayer, Error) << "Failed to map statistics buffer";
+		return;
+	}
+
+	SwIspStats stats = {};
+	std::copy(data, data + SwIspStats::kYHistogramSize, stats.yHistogram.begin());
+
+	const uint32_t *sums = data + SwIspStats::kYHistogramSize;
+	for (unsigned int i = 0; i < groups; i++) {
+		stats.sumR_ += sums[4 * i];
+		stats.sumG_ += sums[4 * i + 1];
+		stats.sumB_ += sums[4 * i + 2];
+	}
+
+	glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+
+	/* The sums are overwritten by every frame, only reset the histogram */
+	static const SwIspStats::Histogram zero = {};
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero.data());
+
+	stats_->accumulate(stats);
+}
+
+void DebayerEGL::process(uint32_t frame, FrameBuffer *input,
+			 const std::vector<FrameBuffer *> &outputs,
+			 const DebayerParams *params,
+			 const DebayerFrameTiming &timing)
+{
+	/* A single output is supported */
+	FrameBuffer *output = outputs[0];
+
+	/* Copy metadata from the input buffer */
+	FrameMetadata &metadata = output->_d()->metadata();
+	metadata.status = input->metadata().status;
+	metadata.sequence = input->metadata().sequence;
+	metadata.timestamp = input->metadata().timestamp;
+
+	Image *in = nullptr;
+	Image *out = nullptr;
+
+	if (makeCurrent() && (!reconfigured_ || createGLObjects() == 0)) {
+		in = importBuffer(input, false);
+		out = importBuffer(output, true);
+	}
+
+	if (!in || !out) {
+		metadata.status = FrameMetadata::FrameError;
+		outputBufferReady.emit(output);
+		inputBufferReady.emit(input, timing);
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, lutTexture_);
+	if (params->lutVersion != lutVersion_) {
+		const DebayerParams::ColorLookupTable *luts[] = {
+			&params->red, &params->green, &params->blue
+		};
+		for (unsigned int i = 0; i < 3; i++)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i, DebayerParams::kRGBLookupSize, 1,
+					GL_RED, GL_UNSIGNED_BYTE, luts[i]->data());
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 3, DebayerParams::kGammaLookupSize, 1,
+				GL_RED, GL_UNSIGNED_BYTE, params->gamma.data());
+		lutVersion_ = params->lutVersion;
+	}
+
+	glUseProgram(debayerProgram_);
+	glUniform1i(glGetUniformLocation(debayerProgram_, "ccmEnabled"),
+		    params->ccmEnabled);
+	if (params->ccmEnabled) {
+		GLfloat ccm[9];
+		for (unsigned int i = 0; i < 9; i++)
+			ccm[i] = params->ccm[i] / static_cast<float>(1 << DebayerParams::kCcmShift);
+
+		/* The matrix is stored in row-major order */
+		glUniformMatrix3fv(glGetUniformLocation(debayerProgram_, "ccm"),
+				   1, GL_TRUE, ccm);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, in->texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, lutTexture_);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, out->framebuffer);
+	glViewport(0, 0, window_.width, window_.height);
+	glUseProgram(debayerProgram_);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	stats_->startFrame();
+
+	glUseProgram(statsProgram_);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, statsBuffer_);
+	glDispatchCompute(statsGroups_.width, statsGroups_.height, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	readStats();
+
+	/* Wait for rendering to complete before handing the output over */
+	glFinish();
+
+	metadata.planes()[0].bytesused = frameSize_;
+
+	stats_->finishFrame(frame);
+	outputBufferReady.emit(output);
+	inputBufferReady.emit(input, timing);
+}
+
+/*
+ * Release the imported buffers, which may be freed once stopped, and the EGL
+ * context, to make it current in the thread processing frames after the next
+ * start.
+ */
+void DebayerEGL::stop()
+{
+	if (eglGetCurrentContext() != context_)
+		return;
+
+	destroyImages();
+	eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * GPU based debayering class
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl31.h>
+#include <GLES2/gl2ext.h>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+
+#include "libcamera/internal/bayer_format.h"
+
+#include "debayer.h"
+#include "swstats_cpu.h"
+
+namespace libcamera {
+
+class DebayerEGL : public Debayer
+{
+public:
+	DebayerEGL(std::unique_ptr<SwStatsCpu> stats);
+	~DebayerEGL();
+
+	bool isValid() const { return context_ != EGL_NO_CONTEXT; }
+
+	int configure(const StreamConfiguration &inputCfg,
+		      const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
+		      Transform transform);
+	Size patternSize(PixelFormat inputFormat);
+	std::vector<PixelFormat> formats(PixelFormat input);
+	std::tuple<unsigned int, unsigned int>
+	strideAndFrameSize(const PixelFormat &outputFormat, const Size &size);
+	void process(uint32_t frame, FrameBuffer *input,
+		     const std::vector<FrameBuffer *> &outputs,
+		     const DebayerParams *params,
+		     const DebayerFrameTiming &timing);
+	void stop();
+
+	unsigned int frameSize([[maybe_unused]] unsigned int output) { return frameSize_; }
+	const std::vector<unsigned int> &planeSizes([[maybe_unused]] unsigned int output)
+	{
+		return planeSizes_;
+	}
+
+private:
+	/* A dma_buf imported as a texture, and as a render target for outputs */
+	struct Image {
+		int fd;
+		EGLImageKHR image;
+		GLuint texture;
+		GLuint framebuffer;
+	};
+
+	/* Align lines to 256 bytes, as commonly required for GPU render targets */
+	static constexpr unsigned int kStrideAlignment = 256;
+	/* Workgroup size of the statistics compute shader */
+	static constexpr unsigned int kStatsGroupSize = 16;
+
+	int initEGL();
+	bool makeCurrent();
+	int createGLObjects();
+	void destroyGLObjects();
+	Image *importBuffer(FrameBuffer *buffer, bool output);
+	void destroyImages();
+	unsigned int statsStep() const;
+	std::string shaderHeader(const char *version) const;
+	void readStats();
+
+	EGLDisplay display_;
+	EGLContext context_;
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR_;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR_;
+	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES_;
+
+	BayerFormat inputFormat_;
+	Size inputSize_;
+	unsigned int inputStride_;
+	PixelFormat outputFormat_;
+	unsigned int outputStride_;
+	unsigned int frameSize_;
+	std::vector<unsigned int> planeSizes_;
+	Rectangle window_;
+	Point firstRed_;
+	Size statsBlocks_;
+	Size statsGroups_;
+	bool reconfigured_;
+
+	/* GL objects, only used with the context current */
+	std::map<FrameBuffer *, Image> images_;
+	GLuint debayerProgram_;
+	GLuint statsProgram_;
+	GLuint lutTexture_;
+	uint32_t lutVersion_; /* Version of the lookup tables in lutTexture_ */
+	GLuint statsBuffer_;
+};
+
+} /* namespace libcamera */
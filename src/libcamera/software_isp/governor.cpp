@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Software ISP performance governor
+ */
+
+#include "governor.h"
+
+#include <algorithm>
+
+#include <libcamera/base/log.h>
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(SoftwareIsp)
+
+/**
+ * \class SwIspGovernor
+ * \brief Trade processing quality for throughput when the software ISP lags
+ *
+ * The software ISP runs on the CPU, and can fail to keep up with the sensor
+ * frame rate when the CPU is loaded by other tasks or throttled for thermal
+ * reasons. The governor observes, for every processed frame, the time taken
+ * to process it compared to the frame interval. It steps down through
+ * throttling levels when frames miss their deadline, i.e. aren't processed
+ * before the next frame is captured, or when the processing load is close to
+ * the frame interval, and steps back up when there is enough headroom.
+ *
+ * Level 0 runs the full quality processing. Each higher level sheds more
+ * load, by running the IPA algorithms only on one frame out of
+ * Level::ipaInterval, and by gathering the statistics at a lower resolution,
+ * see SwStatsCpu::setThrottle().
+ *
+ * Decisions are taken once every kWindowFrames frames, which leaves time for
+ * the effect of a level change to be measured before the next one.
+ */
+
+/**
+ * \struct SwIspGovernor::Level
+ * \brief The processing settings of a throttling level
+ *
+ * \var SwIspGovernor::Level::ipaInterval
+ * \brief Run the IPA algorithms on one frame out of this many
+ *
+ * \var SwIspGovernor::Level::statsThrottle
+ * \brief The factor to lower the statistics resolution by
+ */
+
+/**
+ * \var SwIspGovernor::kMaxLevel
+ * \brief The highest throttling level
+ */
+
+/**
+ * \brief Construct a SwIspGovernor
+ * \param[in] maxLevel The highest throttling level the governor may select
+ *
+ * A \a maxLevel of 0 disables the governor.
+ */
+SwIspGovernor::SwIspGovernor(unsigned int maxLevel)
+	: maxLevel_(std::min(maxLevel, kMaxLevel)), level_(0)
+{
+	reset();
+}
+
+/**
+ * \brief Reset the governor to full quality processing
+ */
+void SwIspGovernor::reset()
+{
+	level_ = 0;
+	frames_ = 0;
+	misses_ = 0;
+	load_ = 0.0;
+}
+
+/**
+ * \brief Account for a processed frame
+ * \param[in] interval The time between the capture of the frame and of the
+ * previous one
+ * \param[in] latency The time taken to process the frame
+ *
+ * \return True if the throttling level has changed, false otherwise
+ */
+bool SwIspGovernor::update(utils::Duration interval, utils::Duration latency)
+{
+	if (!maxLevel_ || !interval)
+		return false;
+
+	const double load = latency / interval;
+	load_ = frames_ ? load_ * (1.0 - kLoadFilter) + load * kLoadFilter : load;
+
+	if (latency > interval)
+		misses_++;
+
+	if (++frames_ < kWindowFrames)
+		return false;
+
+	unsigned int level = level_;
+	if ((misses_ >= kMaxMisses || load_ > kHighLoad) && level < maxLevel_)
+		level++;
+	else if (!misses_ && load_ < kLowLoad && level > 0)
+		level--;
+
+	LOG(SoftwareIsp, Debug)
+		<< "Processing load " << load_ << ", " << misses_
+		<< " missed deadlines in " << frames_ << " frames";
+
+	frames_ = 0;
+	misses_ = 0;
+
+	if (level == level_)
+		return false;
+
+	LOG(SoftwareIsp, Info)
+		<< (level > level_ ? "Lowering" : "Raising")
+		<< " processing quality, throttle level " << level;
+
+	level_ = level;
+	return true;
+}
+
+/**
+ * \fn SwIspGovernor::level()
+ * \brief Retrieve the current throttling level
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The throttling level, 0 for full quality processing
+ */
+
+/**
+ * \fn SwIspGovernor::settings()
+ * \brief Retrieve the processing settings of the current throttling level
+ * \return The processing settings
+ */
+
+} /* namespace libcamera */
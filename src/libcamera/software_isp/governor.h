@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Software ISP performance governor
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include <libcamera/base/utils.h>
+
+namespace libcamera {
+
+class SwIspGovernor
+{
+public:
+	struct Level {
+		unsigned int ipaInterval;
+		unsigned int statsThrottle;
+	};
+
+	static constexpr unsigned int kMaxLevel = 3;
+
+	SwIspGovernor(unsigned int maxLevel = kMaxLevel);
+
+	void reset();
+	bool update(utils::Duration interval, utils::Duration latency);
+
+	unsigned int level() const { return level_; }
+	const Level &settings() const { return kLevels[level_]; }
+
+private:
+	static constexpr std::array<Level, kMaxLevel + 1> kLevels = { {
+		{ 1, 1 },
+		{ 2, 1 },
+		{ 2, 4 },
+		{ 4, 8 },
+	} };
+
+	/* Number of frames over which each governor decision is made */
+	static constexpr unsigned int kWindowFrames = 30;
+	static constexpr unsigned int kMaxMisses = 3;
+	static constexpr double kHighLoad = 0.9;
+	static constexpr double kLowLoad = 0.5;
+	static constexpr double kLoadFilter = 0.1;
+
+	unsigned int maxLevel_;
+	/* Updated in the ISP thread, read from the pipeline handler thread */
+	std::atomic<unsigned int> level_;
+
+	unsigned int frames_;
+	unsigned int misses_;
+	double load_;
+};
+
+} /* namespace libcamera */
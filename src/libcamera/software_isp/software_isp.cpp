@@ -7,12 +7,16 @@
 
 #include "libcamera/internal/software_isp/software_isp.h"
 
-#include <cmath>
+#include <algorithm>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <libcamera/base/utils.h>
+
 #include <libcamera/formats.h>
 #include <libcamera/stream.h>
 
@@ -20,6 +24,10 @@
 #include "libcamera/internal/software_isp/debayer_params.h"
 
 #include "debayer_cpu.h"
+#if HAVE_SOFTISP_GPU
+#include "debayer_egl.h"
+#endif
+#include "governor.h"
 
 /**
  * \file software_isp.cpp
@@ -33,6 +41,19 @@ LOG_DEFINE_CATEGORY(SoftwareIsp)
 /**
  * \class SoftwareIsp
  * \brief Class for the Software ISP
+ *
+ * The Software ISP produces up to maxOutputs() output streams from each input
+ * frame, in a single pass. The first output stream, called the primary
+ * output, supports all output formats and sizes. The other outputs, called
+ * secondary outputs, are produced from the pixels of the primary output and
+ * their format and size are constrained accordingly, as reported by
+ * secondarySize().
+ */
+
+/**
+ * \var SoftwareIsp::kMaxOutputs
+ * \brief The largest number of outputs supported by any Software ISP
+ * implementation
  */
 
 /**
@@ -63,46 +84,84 @@ LOG_DEFINE_CATEGORY(SoftwareIsp)
  * handler
  */
 SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor)
-	: dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+	: ispWorkerThread_("SoftwareIsp"),
+	  dmaHeap_(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
 		   DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
-		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf)
+		   DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf),
+	  lastInputTimestamp_(0), framesInFlight_(0), running_(false),
+	  latencyMetric_("softisp_frame_latency_seconds", sensor->id(),
+			 { 0.005, 0.01, 0.02, 0.033, 0.05, 0.1, 0.2 }),
+	  throttleLevelMetric_("softisp_throttle_level", sensor->id())
 {
+	if (!dmaHeap_.isValid()) {
+		LOG(SoftwareIsp, Error) << "Failed to create DmaBufAllocator object";
+		return;
+	}
+
 	/*
-	 * debayerParams_ must be initialized because the initial value is used for
-	 * the first two frames, i.e. until stats processing starts providing its
-	 * own parameters.
-	 *
-	 * \todo This should be handled in the same place as the related
-	 * operations, in the IPA module.
+	 * Keep the output buffers freed by the application to reuse them when
+	 * the camera is reconfigured, as allocating buffers is slow. This is
+	 * only safe when the application doesn't hand the buffers over to other
+	 * processes, pooling is thus enabled on request only.
 	 */
-	std::array<uint8_t, 256> gammaTable;
-	for (unsigned int i = 0; i < 256; i++)
-		gammaTable[i] = UINT8_MAX * std::pow(i / 256.0, 0.5);
-	for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++) {
-		debayerParams_.red[i] = gammaTable[i];
-		debayerParams_.green[i] = gammaTable[i];
-		debayerParams_.blue[i] = gammaTable[i];
+	unsigned long poolSize = 0;
+	const char *poolSizeEnv = utils::secure_getenv("LIBCAMERA_SOFTISP_BUFFER_POOL_SIZE");
+	if (poolSizeEnv) {
+		char *end;
+		unsigned long value = strtoul(poolSizeEnv, &end, 10);
+		if (*poolSizeEnv != '\0' && *end == '\0')
+			poolSize = value;
+		else
+			LOG(SoftwareIsp, Warning)
+				<< "Invalid buffer pool size '" << poolSizeEnv
+				<< "', using " << poolSize << " MiB";
 	}
 
-	if (!dmaHeap_.isValid()) {
-		LOG(SoftwareIsp, Error) << "Failed to create DmaBufAllocator object";
-		return;
+	dmaHeap_.setPoolLimit(static_cast<std::size_t>(poolSize) << 20);
+
+	/*
+	 * Back udmabuf output buffers with huge pages on request, to reduce
+	 * the TLB misses of the CPU debayering.
+	 */
+	const char *hugePages = utils::secure_getenv("LIBCAMERA_SOFTISP_HUGE_PAGES");
+	if (hugePages && !strcmp(hugePages, "1"))
+		dmaHeap_.setHugePages(true);
+
+	/*
+	 * Trade processing quality for throughput when frames can't be
+	 * processed in time, up to the maximum throttle level.
+	 */
+	unsigned long maxLevel = SwIspGovernor::kMaxLevel;
+	const char *maxLevelEnv = utils::secure_getenv("LIBCAMERA_SOFTISP_MAX_THROTTLE_LEVEL");
+	if (maxLevelEnv) {
+		char *end;
+		unsigned long value = strtoul(maxLevelEnv, &end, 10);
+		if (*maxLevelEnv != '\0' && *end == '\0' &&
+		    value <= SwIspGovernor::kMaxLevel)
+			maxLevel = value;
+		else
+			LOG(SoftwareIsp, Warning)
+				<< "Invalid maximum throttle level '" << maxLevelEnv
+				<< "', using " << maxLevel;
 	}
 
-	sharedParams_ = SharedMemObject<DebayerParams>("softIsp_params");
-	if (!sharedParams_) {
-		LOG(SoftwareIsp, Error) << "Failed to create shared memory for parameters";
-		return;
+	governor_ = std::make_unique<SwIspGovernor>(maxLevel);
+
+	std::vector<SharedFD> paramsFDs;
+	for (SharedMemObject<DebayerParams> &params : sharedParams_) {
+		params = SharedMemObject<DebayerParams>("softIsp_params");
+		if (!params) {
+			LOG(SoftwareIsp, Error) << "Failed to create shared memory for parameters";
+			return;
+		}
+
+		paramsFDs.push_back(params.fd());
 	}
 
-	auto stats = std::make_unique<SwStatsCpu>();
-	if (!stats->isValid()) {
-		LOG(SoftwareIsp, Error) << "Failed to create SwStatsCpu object";
+	debayer_ = createDebayer();
+	if (!debayer_)
 		return;
-	}
-	stats->statsReady.connect(this, &SoftwareIsp::statsReady);
 
-	debayer_ = std::make_unique<DebayerCpu>(std::move(stats));
 	debayer_->inputBufferReady.connect(this, &SoftwareIsp::inputReady);
 	debayer_->outputBufferReady.connect(this, &SoftwareIsp::outputReady);
 
@@ -122,8 +181,8 @@ SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor)
 		ipa_->configurationFile(sensor->model() + ".yaml", "uncalibrated.yaml");
 
 	int ret = ipa_->init(IPASettings{ ipaTuningFile, sensor->model() },
-			     debayer_->getStatsFD(),
-			     sharedParams_.fd(),
+			     debayer_->getStatsFDs(),
+			     paramsFDs,
 			     sensor->controls());
 	if (ret) {
 		LOG(SoftwareIsp, Error) << "IPA init failed";
@@ -131,18 +190,63 @@ SoftwareIsp::SoftwareIsp(PipelineHandler *pipe, const CameraSensor *sensor)
 		return;
 	}
 
-	ipa_->setIspParams.connect(this, &SoftwareIsp::saveIspParams);
+	ipa_->setIspParams.connect(this, &SoftwareIsp::paramsReady);
 	ipa_->setSensorControls.connect(this, &SoftwareIsp::setSensorCtrls);
+	ipa_->releaseStatsBuffer.connect(this, &SoftwareIsp::releaseStatsBuffer);
 
+	ispWorkerThread_.setRole(Thread::Role::LatencyCritical);
 	debayer_->moveToThread(&ispWorkerThread_);
 }
 
 SoftwareIsp::~SoftwareIsp()
 {
-	/* make sure to destroy the DebayerCpu before the ispWorkerThread_ is gone */
+	/* make sure to destroy the Debayer before the ispWorkerThread_ is gone */
 	debayer_.reset();
 }
 
+/*
+ * Debayer on the GPU when one is usable, unless disabled by setting the
+ * LIBCAMERA_SOFTISP_GPU environment variable to 0, and on the CPU otherwise.
+ */
+std::unique_ptr<Debayer> SoftwareIsp::createDebayer()
+{
+	auto createStats = [this]() -> std::unique_ptr<SwStatsCpu> {
+		auto stats = std::make_unique<SwStatsCpu>();
+		if (!stats->isValid()) {
+			LOG(SoftwareIsp, Error) << "Failed to create SwStatsCpu object";
+			return nullptr;
+		}
+
+		stats->statsReady.connect(this, &SoftwareIsp::statsReady);
+		return stats;
+	};
+
+	std::unique_ptr<SwStatsCpu> stats;
+
+#if HAVE_SOFTISP_GPU
+	const char *gpu = utils::secure_getenv("LIBCAMERA_SOFTISP_GPU");
+	if (!gpu || strcmp(gpu, "0")) {
+		stats = createStats();
+		if (!stats)
+			return nullptr;
+
+		auto debayer = std::make_unique<DebayerEGL>(std::move(stats));
+		if (debayer->isValid()) {
+			LOG(SoftwareIsp, Info) << "Debayering on the GPU";
+			return debayer;
+		}
+
+		LOG(SoftwareIsp, Info) << "No usable GPU, debayering on the CPU";
+	}
+#endif
+
+	stats = createStats();
+	if (!stats)
+		return nullptr;
+
+	return std::make_unique<DebayerCpu>(std::move(stats));
+}
+
 /**
  * \fn int SoftwareIsp::loadConfiguration([[maybe_unused]] const std::string &filename)
  * \brief Load a configuration from a file
@@ -160,12 +264,22 @@ SoftwareIsp::~SoftwareIsp()
  * \param[in] sensorControls The sensor controls
  *
  * Requests the IPA to calculate new parameters for ISP and new control
- * values for the sensor.
+ * values for the sensor. The IPA returns the statistics buffer to the
+ * software ISP once done with it.
+ *
+ * When the frames are throttled, the IPA algorithms only run on some of the
+ * frames, and the statistics of the other frames are dropped.
  */
 void SoftwareIsp::processStats(const uint32_t frame, const uint32_t bufferId,
 			       const ControlList &sensorControls)
 {
 	ASSERT(ipa_);
+
+	if (frame % governor_->settings().ipaInterval) {
+		debayer_->releaseStatsBuffer(bufferId);
+		return;
+	}
+
 	ipa_->processStats(frame, bufferId, sensorControls);
 }
 
@@ -203,6 +317,38 @@ SizeRange SoftwareIsp::sizes(PixelFormat inputFormat, const Size &inputSize)
 	return debayer_->sizes(inputFormat, inputSize);
 }
 
+/**
+ * \brief Get the maximum number of outputs produced from one input frame
+ * \return The maximum number of output streams, at most kMaxOutputs
+ */
+unsigned int SoftwareIsp::maxOutputs() const
+{
+	ASSERT(debayer_);
+
+	return std::min(debayer_->maxOutputs(), kMaxOutputs);
+}
+
+/**
+ * \brief Get the size of a secondary output
+ * \param[in] outputFormat The secondary output format
+ * \param[in] primarySize The size of the primary output
+ * \param[in] size The requested secondary output size
+ *
+ * Secondary outputs are downscaled from the primary output, without any
+ * transform. This function returns the supported size closest to \a size
+ * for a secondary output in \a outputFormat.
+ *
+ * \return The secondary output size, or an empty size if \a outputFormat
+ * can't be produced as a secondary output
+ */
+Size SoftwareIsp::secondarySize(const PixelFormat &outputFormat, const Size &primarySize,
+				const Size &size)
+{
+	ASSERT(debayer_);
+
+	return debayer_->secondarySize(outputFormat, primarySize, size);
+}
+
 /**
  * Get the output stride and the frame size in bytes for the given output format and size
  * \param[in] outputFormat The output format
@@ -218,25 +364,62 @@ SoftwareIsp::strideAndFrameSize(const PixelFormat &outputFormat, const Size &siz
 	return debayer_->strideAndFrameSize(outputFormat, size);
 }
 
+/**
+ * \brief Check if the output can be transformed
+ * \param[in] outputFormat The output format
+ * \param[in] transform The transform to apply to the output
+ *
+ * Flips and transpositions are applied when writing the output frames, at no
+ * extra memory pass. Pipeline handlers use this to implement the parts of the
+ * CameraConfiguration::orientation the sensor can't.
+ *
+ * \return True if frames in \a outputFormat can be written transformed by
+ * \a transform, false otherwise
+ */
+bool SoftwareIsp::supportsTransform(const PixelFormat &outputFormat, Transform transform)
+{
+	ASSERT(debayer_);
+
+	return debayer_->supportsTransform(outputFormat, transform);
+}
+
 /**
  * \brief Configure the SoftwareIsp object according to the passed in parameters
  * \param[in] inputCfg The input configuration
  * \param[in] outputCfgs The output configurations
  * \param[in] configInfo The IPA configuration data, received from the pipeline
  * handler
+ * \param[in] transform The transform to apply to the output
+ *
+ * The size of the output configurations is the transformed size, with the
+ * width and height swapped when \a transform contains a transposition.
+ *
+ * The first of the \a outputCfgs is the primary output, the other ones are
+ * secondary outputs, sized as reported by secondarySize(). Transforms are only
+ * supported with a single output. Each output configuration shall be
+ * associated with its stream.
+ *
  * \return 0 on success, a negative errno on failure
  */
 int SoftwareIsp::configure(const StreamConfiguration &inputCfg,
 			   const std::vector<std::reference_wrapper<StreamConfiguration>> &outputCfgs,
-			   const ipa::soft::IPAConfigInfo &configInfo)
+			   const ipa::soft::IPAConfigInfo &configInfo,
+			   Transform transform)
 {
 	ASSERT(ipa_ && debayer_);
 
+	if (outputCfgs.size() > maxOutputs())
+		return -EINVAL;
+
 	int ret = ipa_->configure(configInfo);
 	if (ret < 0)
 		return ret;
 
-	return debayer_->configure(inputCfg, outputCfgs);
+	outputStreams_.clear();
+	for (const StreamConfiguration &cfg : outputCfgs)
+		outputStreams_.push_back(cfg.stream());
+
+	return debayer_->configure(inputCfg, outputCfgs, transform);
 }
 
 /**
@@ -252,29 +435,16 @@ int SoftwareIsp::exportBuffers(const Stream *stream, unsigned int count,
 {
 	ASSERT(debayer_ != nullptr);
 
-	/* single output for now */
-	if (stream == nullptr)
+	auto it = std::find(outputStreams_.begin(), outputStreams_.end(), stream);
+	if (stream == nullptr || it == outputStreams_.end())
 		return -EINVAL;
 
-	for (unsigned int i = 0; i < count; i++) {
-		const std::string name = "frame-" + std::to_string(i);
-		const size_t frameSize = debayer_->frameSize();
-
-		FrameBuffer::Plane outPlane;
-		outPlane.fd = SharedFD(dmaHeap_.alloc(name.c_str(), frameSize));
-		if (!outPlane.fd.isValid()) {
-			LOG(SoftwareIsp, Error)
-				<< "failed to allocate a dma_buf";
-			return -ENOMEM;
-		}
-		outPlane.offset = 0;
-		outPlane.length = frameSize;
-
-		std::vector<FrameBuffer::Plane> planes{ outPlane };
-		buffers->emplace_back(std::make_unique<FrameBuffer>(std::move(planes)));
-	}
+	const unsigned int output = it - outputStreams_.begin();
+	int ret = dmaHeap_.exportBuffers(count, debayer_->planeSizes(output), buffers);
+	if (ret < 0)
+		LOG(SoftwareIsp, Error) << "failed to allocate a dma_buf";
 
-	return count;
+	return ret;
 }
 
 /**
@@ -300,20 +470,23 @@ int SoftwareIsp::queueBuffers(uint32_t frame, FrameBuffer *input,
 {
 	/*
 	 * Validate the outputs as a sanity check: at least one output is
-	 * required, all outputs must reference a valid stream.
+	 * required, all outputs must reference a configured stream. Streams
+	 * without a buffer aren't produced for this frame.
 	 */
 	if (outputs.empty())
 		return -EINVAL;
 
+	std::vector<FrameBuffer *> buffers(outputStreams_.size());
+
 	for (auto [stream, buffer] : outputs) {
-		if (!buffer)
-			return -EINVAL;
-		if (outputs.size() != 1) /* only single stream atm */
+		auto it = std::find(outputStreams_.begin(), outputStreams_.end(), stream);
+		if (!buffer || it == outputStreams_.end())
 			return -EINVAL;
+
+		buffers[it - outputStreams_.begin()] = buffer;
 	}
 
-	for (auto iter = outputs.begin(); iter != outputs.end(); iter++)
-		process(frame, input, iter->second);
+	process(frame, input, buffers);
 
 	return 0;
 }
@@ -328,6 +501,15 @@ int SoftwareIsp::start()
 	if (ret)
 		return ret;
 
+	/* The ISP thread isn't running, the Debayer can be accessed directly */
+	governor_->reset();
+	throttleLevelMetric_.set(0);
+	debayer_->setStatsThrottle(governor_->settings().statsThrottle);
+	queuedFrames_.fill({});
+	framesInFlight_ = 0;
+	lastInputTimestamp_ = 0;
+
+	running_ = true;
 	ispWorkerThread_.start();
 	return 0;
 }
@@ -337,28 +519,94 @@ int SoftwareIsp::start()
  */
 void SoftwareIsp::stop()
 {
+	/*
+	 * Stop the IPA first, stopping the IPA thread may deliver pending
+	 * paramsReady signals. The ISP thread is still running, those frames
+	 * are queued to it and their buffers are returned. Only signals
+	 * delivered after the IPA has stopped are dropped.
+	 */
+	ipa_->stop();
+	running_ = false;
+
+	/*
+	 * Messages are delivered in order, the frames already queued to the ISP
+	 * thread are processed before the Debayer stops, and no message is left
+	 * in the queue when the thread exits.
+	 */
+	debayer_->invokeMethod(&Debayer::stop, ConnectionTypeBlocking);
 	ispWorkerThread_.exit();
 	ispWorkerThread_.wait();
 
-	ipa_->stop();
+	/* The IPA is stopped, the statistics it hasn't returned are stale. */
+	debayer_->releaseStatsBuffers();
 }
 
 /**
  * \brief Passes the input framebuffer to the ISP worker to process
  * \param[in] frame The frame number
  * \param[in] input The input framebuffer
- * \param[out] output The framebuffer to write the processed frame to
+ * \param[out] outputs The framebuffers to write the processed frame to
+ *
+ * The \a outputs are ordered as the output configurations passed to
+ * configure(), with null entries for the outputs not produced for \a frame.
+ *
+ * The IPA is first requested to fill the parameters buffer of the frame, and
+ * the frame is passed to the ISP worker once the parameters are ready.
  */
-void SoftwareIsp::process(uint32_t frame, FrameBuffer *input, FrameBuffer *output)
+void SoftwareIsp::process(uint32_t frame, FrameBuffer *input,
+			  const std::vector<FrameBuffer *> &outputs)
 {
-	ipa_->fillParamsBuffer(frame);
-	debayer_->invokeMethod(&DebayerCpu::process,
-			       ConnectionTypeQueued, frame, input, output, debayerParams_);
+	const unsigned int bufferId = frame % kParamsBufferCount;
+	const uint64_t timestamp = input->metadata().timestamp;
+
+	utils::Duration interval{};
+	if (lastInputTimestamp_ && timestamp > lastInputTimestamp_)
+		interval = std::chrono::nanoseconds(timestamp - lastInputTimestamp_);
+	lastInputTimestamp_ = timestamp;
+
+	/*
+	 * The parameters buffer and queued frame slots are reused every
+	 * kParamsBufferCount frames, processing more frames concurrently would
+	 * overwrite the slot of a frame still in flight.
+	 */
+	[[maybe_unused]] unsigned int inFlight = framesInFlight_.fetch_add(1);
+	ASSERT(inFlight < kParamsBufferCount);
+
+	queuedFrames_[bufferId] = { input, outputs, utils::clock::now(), interval };
+	ipa_->fillParamsBuffer(frame, bufferId);
 }
 
-void SoftwareIsp::saveIspParams()
+/**
+ * \brief Retrieve the current throttle level
+ *
+ * The software ISP lowers the processing quality when it can't keep up with
+ * the frame rate, in steps from 0 for full quality processing up to the
+ * maximum level set by the LIBCAMERA_SOFTISP_MAX_THROTTLE_LEVEL environment
+ * variable. Pipeline handlers report the level in the
+ * controls::draft::ThrottleLevel metadata.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return The throttle level
+ */
+unsigned int SoftwareIsp::throttleLevel() const
 {
-	debayerParams_ = *sharedParams_;
+	return governor_->level();
+}
+
+void SoftwareIsp::paramsReady(uint32_t frame)
+{
+	if (!running_)
+		return;
+
+	const unsigned int bufferId = frame % kParamsBufferCount;
+	const QueuedFrame &queued = queuedFrames_[bufferId];
+
+	/* The outputs are copied, the slot can be reused right away. */
+	debayer_->invokeMethod(&Debayer::process,
+			       ConnectionTypeQueued, frame, queued.input,
+			       queued.outputs, &*sharedParams_[bufferId],
+			       DebayerFrameTiming{ queued.queued, queued.interval });
 }
 
 void SoftwareIsp::setSensorCtrls(const ControlList &sensorControls)
@@ -366,13 +614,33 @@ void SoftwareIsp::setSensorCtrls(const ControlList &sensorControls)
 	setSensorControls.emit(sensorControls);
 }
 
+void SoftwareIsp::releaseStatsBuffer(uint32_t bufferId)
+{
+	debayer_->releaseStatsBuffer(bufferId);
+}
+
 void SoftwareIsp::statsReady(uint32_t frame, uint32_t bufferId)
 {
 	ispStatsReady.emit(frame, bufferId);
 }
 
-void SoftwareIsp::inputReady(FrameBuffer *input)
+/*
+ * This is called in the ISP thread, between frames, the statistics resolution
+ * can thus be changed right away. The input buffer is released last, after the
+ * output buffers of the frame.
+ */
+void SoftwareIsp::inputReady(FrameBuffer *input, const DebayerFrameTiming &timing)
 {
+	utils::Duration latency = utils::clock::now() - timing.queued;
+	latencyMetric_.observe(latency.get<std::ratio<1>>());
+
+	if (governor_->update(timing.interval, latency)) {
+		debayer_->setStatsThrottle(governor_->settings().statsThrottle);
+		throttleLevelMetric_.set(governor_->level());
+	}
+
+	/* The frame is complete. */
+	framesInFlight_.fetch_sub(1);
 	inputBufferReady.emit(input);
 }
 
@@ -11,7 +11,10 @@
 
 #include "swstats_cpu.h"
 
+#include <algorithm>
+
 #include <libcamera/base/log.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/stream.h>
 
@@ -32,20 +35,42 @@ namespace libcamera {
  *
  * It is also possible to specify a window over which to gather statistics
  * instead of processing the whole frame.
+ *
+ * The frame may be processed in multiple horizontal stripes concurrently, see
+ * setStripeCount(). Each stripe accumulates partial statistics of its own,
+ * which are merged when the frame is finished.
+ *
+ * Statistics are gathered directly in a ring of kStatsBufferCount shared
+ * memory buffers. The statsReady signal carries the ID of the buffer holding
+ * the frame statistics, which stays owned by the consumer until it is handed
+ * back with releaseBuffer(). When no buffer is free at the start of a frame,
+ * the statistics of that frame are dropped.
+ *
+ * Statistics are gathered on a subset of the 2x2 Bayer quads of the window,
+ * one quad out of every subsampling() quads horizontally and vertically, see
+ * setSubsampling(). The default of kDefaultSubsampling can be overridden with
+ * the LIBCAMERA_SOFTISP_STATS_SUBSAMPLING environment variable.
  */
 
 /**
- * \fn bool SwStatsCpu::isValid() const
- * \brief Gets whether the statistics object is valid
- *
- * \return True if it's valid, false otherwise
+ * \var SwStatsCpu::kStatsBufferCount
+ * \brief The number of statistics buffers in the ring
  */
 
 /**
- * \fn const SharedFD &SwStatsCpu::getStatsFD()
- * \brief Get the file descriptor for the statistics
- *
- * \return The file descriptor
+ * \var SwStatsCpu::kDefaultSubsampling
+ * \brief The default statistics subsampling factor
+ */
+
+/**
+ * \var SwStatsCpu::kMaxSubsampling
+ * \brief The largest supported statistics subsampling factor
+ */
+
+/**
+ * \fn unsigned int SwStatsCpu::subsampling() const
+ * \brief Get the statistics subsampling factor
+ * \return The number of quads in each direction for each sampled quad
  */
 
 /**
@@ -62,10 +87,11 @@ namespace libcamera {
  */
 
 /**
- * \fn void SwStatsCpu::processLine0(unsigned int y, const uint8_t *src[])
+ * \fn void SwStatsCpu::processLine0(unsigned int y, const uint8_t *src[], unsigned int stripe)
  * \brief Process line 0
  * \param[in] y The y coordinate.
  * \param[in] src The input data.
+ * \param[in] stripe The index of the stripe the line belongs to.
  *
  * This function processes line 0 for input formats with
  * patternSize height == 1.
@@ -74,25 +100,131 @@ namespace libcamera {
  */
 
 /**
- * \fn void SwStatsCpu::processLine2(unsigned int y, const uint8_t *src[])
+ * \fn void SwStatsCpu::processLine2(unsigned int y, const uint8_t *src[], unsigned int stripe)
  * \brief Process line 2 and 3
  * \param[in] y The y coordinate.
  * \param[in] src The input data.
+ * \param[in] stripe The index of the stripe the line belongs to.
  *
  * This function processes line 2 and 3 for input formats with
  * patternSize height == 4.
  * This function may only be called after a successful setWindow() call.
  */
 
+/**
+ * \fn void SwStatsCpu::processLine0(unsigned int y, const uint8_t *src[], unsigned int stripe,
+ *				   unsigned int x, unsigned int width)
+ * \brief Process line 0 of a vertical tile
+ * \param[in] y The y coordinate.
+ * \param[in] src The input data, pointing to column \a x of the lines.
+ * \param[in] stripe The index of the stripe the line belongs to.
+ * \param[in] x The first column of the tile, relative to the window.
+ * \param[in] width The width of the tile.
+ *
+ * This function is equivalent to the processLine0() function, but gathers the
+ * statistics of \a width columns of the lines only, clipped to the window. It
+ * allows processing lines in vertical tiles, each tile being processed once.
+ * \a x shall be a multiple of 64, so that the tiles sample the same pixels as
+ * full lines.
+ */
+
+/**
+ * \fn void SwStatsCpu::processLine2(unsigned int y, const uint8_t *src[], unsigned int stripe,
+ *				   unsigned int x, unsigned int width)
+ * \brief Process line 2 and 3 of a vertical tile
+ * \param[in] y The y coordinate.
+ * \param[in] src The input data, pointing to column \a x of the lines.
+ * \param[in] stripe The index of the stripe the line belongs to.
+ * \param[in] x The first column of the tile, relative to the window.
+ * \param[in] width The width of the tile.
+ *
+ * This function is the vertical tile equivalent of the processLine2()
+ * function, with the same constraints on \a x as for processLine0().
+ */
+
+/**
+ * \struct SwStatsCpu::LineStats
+ * \brief Statistics sampling parameters of a line
+ *
+ * Debayering implementations that read the Bayer quads of line 0 of a line
+ * pair anyway can gather the statistics of the line while debayering it,
+ * instead of calling processLine0(). The sampling parameters of the line are
+ * retrieved with lineStats(), and the statistics of the sampled quads are
+ * accumulated in \a stats, with the luminance histogram bin computed by
+ * yHistogramBin().
+ *
+ * This is only supported for unpacked Bayer formats. The quads are read in
+ * the orientation of the BGGR order, the pixels at even columns of line 0
+ * being blue.
+ *
+ * \var SwStatsCpu::LineStats::stats
+ * \brief The statistics of the stripe to accumulate the line statistics to
+ *
+ * \var SwStatsCpu::LineStats::width
+ * \brief The number of columns of the line to sample, from the start of the
+ * tile
+ *
+ * \var SwStatsCpu::LineStats::stepMask
+ * \brief The quads at the columns x for which (x & stepMask) is 0 are sampled
+ */
+
+/**
+ * \fn bool SwStatsCpu::lineStats(unsigned int y, unsigned int stripe,
+ *				 unsigned int x, unsigned int width,
+ *				 LineStats *line) const
+ * \brief Get the sampling parameters of line 0 for fused statistics gathering
+ * \param[in] y The y coordinate
+ * \param[in] stripe The index of the stripe the line belongs to
+ * \param[in] x The first column of the tile, relative to the window
+ * \param[in] width The width of the tile
+ * \param[out] line The sampling parameters of the line
+ *
+ * This function replaces a processLine0() call with the same arguments when
+ * the caller gathers the statistics of the line itself, see LineStats. Lines
+ * are sampled identically in both cases.
+ *
+ * \return True if the line is sampled, false if it shall be skipped
+ */
+
+/**
+ * \fn unsigned int SwStatsCpu::yHistogramBin(unsigned int r, unsigned int g,
+ *					     unsigned int b)
+ * \brief Compute the luminance histogram bin of a quad
+ * \tparam div The divider to scale the pixel values to 8 bits
+ * \param[in] r The red value of the quad
+ * \param[in] g The green value of the quad, the average of its two green pixels
+ * \param[in] b The blue value of the quad
+ * \return The index of the luminance histogram bin
+ */
+
+/**
+ * \var SwStatsCpu::kRedYMul
+ * \brief The weight of the red component in the luminance, in 1/256th
+ */
+
+/**
+ * \var SwStatsCpu::kGreenYMul
+ * \brief The weight of the green component in the luminance, in 1/256th
+ */
+
+/**
+ * \var SwStatsCpu::kBlueYMul
+ * \brief The weight of the blue component in the luminance, in 1/256th
+ */
+
 /**
  * \var Signal<> SwStatsCpu::statsReady
  * \brief Signals that the statistics are ready
+ *
+ * The signal carries the frame number and the ID of the statistics buffer,
+ * which shall be returned with releaseBuffer() once processed.
  */
 
 /**
  * \typedef SwStatsCpu::statsProcessFn
  * \brief Called when there is data to get statistics from
  * \param[in] src The input data
+ * \param[out] stats The partial statistics of the stripe being processed
  *
  * These functions take an array of (patternSize_.height + 1) src
  * pointers each pointing to a line in the source image. The middle
@@ -108,6 +240,28 @@ namespace libcamera {
  * \brief Skip lines where this bitmask is set in y
  */
 
+/**
+ * \var unsigned int SwStatsCpu::xStep_
+ * \brief Distance between sampled quads of a line, in pixels or in bytes
+ * for packed formats
+ */
+
+/**
+ * \var unsigned int SwStatsCpu::subsampling_
+ * \brief The requested statistics subsampling factor
+ */
+
+/**
+ * \var unsigned int SwStatsCpu::minSubsampling_
+ * \brief The minimum subsampling factor of the configured input format
+ */
+
+/**
+ * \var unsigned int SwStatsCpu::throttle_
+ * \brief The factor the subsampling is raised by at runtime, set by
+ * setThrottle()
+ */
+
 /**
  * \var Rectangle SwStatsCpu::window_
  * \brief Statistics window, set by setWindow(), used every line
@@ -130,20 +284,67 @@ namespace libcamera {
 LOG_DEFINE_CATEGORY(SwStatsCpu)
 
 SwStatsCpu::SwStatsCpu()
-	: sharedStats_("softIsp_stats")
+	: subsampling_(kDefaultSubsampling), minSubsampling_(1), throttle_(1),
+	  stripeStats_(1, &discardStats_)
 {
-	if (!sharedStats_)
-		LOG(SwStatsCpu, Error)
-			<< "Failed to create shared memory for statistics";
+	const char *subsampling = utils::secure_getenv("LIBCAMERA_SOFTISP_STATS_SUBSAMPLING");
+	if (subsampling) {
+		char *end;
+		unsigned long value = strtoul(subsampling, &end, 10);
+		if (*end != '\0' || value > kMaxSubsampling ||
+		    setSubsampling(value) < 0)
+			LOG(SwStatsCpu, Warning)
+				<< "Invalid statistics subsampling '" << subsampling
+				<< "', using " << subsampling_;
+	}
+
+	for (unsigned int i = 0; i < kStatsBufferCount; i++) {
+		sharedStats_[i] = SharedMemObject<SwIspStats>("softIsp_stats");
+		if (!sharedStats_[i]) {
+			LOG(SwStatsCpu, Error)
+				<< "Failed to create shared memory for statistics";
+			return;
+		}
+	}
+
+	freeBuffers_.set();
 }
 
-static constexpr unsigned int kRedYMul = 77; /* 0.299 * 256 */
-static constexpr unsigned int kGreenYMul = 150; /* 0.587 * 256 */
-static constexpr unsigned int kBlueYMul = 29; /* 0.114 * 256 */
+/**
+ * \brief Gets whether the statistics object is valid
+ *
+ * \return True if it's valid, false otherwise
+ */
+bool SwStatsCpu::isValid() const
+{
+	for (const SharedMemObject<SwIspStats> &stats : sharedStats_) {
+		if (!stats.fd().isValid())
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Get the file descriptors for the statistics buffers
+ *
+ * The buffer ID carried by the statsReady signal is the index of the buffer
+ * file descriptor in the returned vector.
+ *
+ * \return The file descriptors
+ */
+std::vector<SharedFD> SwStatsCpu::getStatsFDs() const
+{
+	std::vector<SharedFD> fds;
+
+	for (const SharedMemObject<SwIspStats> &stats : sharedStats_)
+		fds.push_back(stats.fd());
+
+	return fds;
+}
 
 #define SWSTATS_START_LINE_STATS(pixel_t) \
 	pixel_t r, g, g2, b;              \
-	uint64_t yVal;                    \
                                           \
 	uint64_t sumR = 0;                \
 	uint64_t sumG = 0;                \
@@ -154,17 +355,15 @@ static constexpr unsigned int kBlueYMul = 29; /* 0.114 * 256 */
 	sumG += g;                         \
 	sumB += b;                         \
                                            \
-	yVal = r * kRedYMul;               \
-	yVal += g * kGreenYMul;            \
-	yVal += b * kBlueYMul;             \
-	stats_.yHistogram[yVal * SwIspStats::kYHistogramSize / (256 * 256 * (div))]++;
+	stats.yHistogram[yHistogramBin<(div)>(r, g, b)]++;
 
 #define SWSTATS_FINISH_LINE_STATS() \
-	stats_.sumR_ += sumR;       \
-	stats_.sumG_ += sumG;       \
-	stats_.sumB_ += sumB;
+	stats.sumR_ += sumR;        \
+	stats.sumG_ += sumG;        \
+	stats.sumB_ += sumB;
 
-void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[], SwIspStats &stats,
+				 unsigned int width)
 {
 	const uint8_t *src0 = src[1] + window_.x;
 	const uint8_t *src1 = src[2] + window_.x;
@@ -174,8 +373,7 @@ void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
+	for (int x = 0; x < (int)width; x += xStep_) {
 		b = src0[x];
 		g = src0[x + 1];
 		g2 = src1[x];
@@ -189,7 +387,8 @@ void SwStatsCpu::statsBGGR8Line0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[], SwIspStats &stats,
+				  unsigned int width)
 {
 	const uint16_t *src0 = (const uint16_t *)src[1] + window_.x;
 	const uint16_t *src1 = (const uint16_t *)src[2] + window_.x;
@@ -199,8 +398,7 @@ void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
+	for (int x = 0; x < (int)width; x += xStep_) {
 		b = src0[x];
 		g = src0[x + 1];
 		g2 = src1[x];
@@ -215,7 +413,8 @@ void SwStatsCpu::statsBGGR10Line0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[], SwIspStats &stats,
+				  unsigned int width)
 {
 	const uint16_t *src0 = (const uint16_t *)src[1] + window_.x;
 	const uint16_t *src1 = (const uint16_t *)src[2] + window_.x;
@@ -225,8 +424,7 @@ void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
 	if (swapLines_)
 		std::swap(src0, src1);
 
-	/* x += 4 sample every other 2x2 block */
-	for (int x = 0; x < (int)window_.width; x += 4) {
+	for (int x = 0; x < (int)width; x += xStep_) {
 		b = src0[x];
 		g = src0[x + 1];
 		g2 = src1[x];
@@ -241,19 +439,19 @@ void SwStatsCpu::statsBGGR12Line0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[])
+void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[], SwIspStats &stats,
+				   unsigned int width)
 {
 	const uint8_t *src0 = src[1] + window_.x * 5 / 4;
 	const uint8_t *src1 = src[2] + window_.x * 5 / 4;
-	const int widthInBytes = window_.width * 5 / 4;
+	const int widthInBytes = width * 5 / 4;
 
 	if (swapLines_)
 		std::swap(src0, src1);
 
 	SWSTATS_START_LINE_STATS(uint8_t)
 
-	/* x += 5 sample every other 2x2 block */
-	for (int x = 0; x < widthInBytes; x += 5) {
+	for (int x = 0; x < widthInBytes; x += xStep_) {
 		/* BGGR */
 		b = src0[x];
 		g = src0[x + 1];
@@ -267,19 +465,19 @@ void SwStatsCpu::statsBGGR10PLine0(const uint8_t *src[])
 	SWSTATS_FINISH_LINE_STATS()
 }
 
-void SwStatsCpu::statsGBRG10PLine0(const uint8_t *src[])
+void SwStatsCpu::statsGBRG10PLine0(const uint8_t *src[], SwIspStats &stats,
+				   unsigned int width)
 {
 	const uint8_t *src0 = src[1] + window_.x * 5 / 4;
 	const uint8_t *src1 = src[2] + window_.x * 5 / 4;
-	const int widthInBytes = window_.width * 5 / 4;
+	const int widthInBytes = width * 5 / 4;
 
 	if (swapLines_)
 		std::swap(src0, src1);
 
 	SWSTATS_START_LINE_STATS(uint8_t)
 
-	/* x += 5 sample every other 2x2 block */
-	for (int x = 0; x < widthInBytes; x += 5) {
+	for (int x = 0; x < widthInBytes; x += xStep_) {
 		/* GBRG */
 		g = src0[x];
 		b = src0[x + 1];
@@ -303,23 +501,108 @@ void SwStatsCpu::startFrame(void)
 	if (window_.width == 0)
 		LOG(SwStatsCpu, Error) << "Calling startFrame() without setWindow()";
 
-	stats_.sumR_ = 0;
-	stats_.sumB_ = 0;
-	stats_.sumG_ = 0;
-	stats_.yHistogram.fill(0);
+	{
+		MutexLocker locker(mutex_);
+
+		bufferId_.reset();
+		for (unsigned int i = 0; i < kStatsBufferCount; i++) {
+			if (freeBuffers_[i]) {
+				freeBuffers_.reset(i);
+				bufferId_ = i;
+				break;
+			}
+		}
+	}
+
+	if (!bufferId_)
+		LOG(SwStatsCpu, Debug)
+			<< "No free statistics buffer, dropping frame statistics";
+
+	stripeStats_[0] = bufferId_ ? &*sharedStats_[*bufferId_] : &discardStats_;
+
+	for (SwIspStats *stats : stripeStats_) {
+		stats->sumR_ = 0;
+		stats->sumB_ = 0;
+		stats->sumG_ = 0;
+		stats->yHistogram.fill(0);
+	}
+}
+
+/**
+ * \brief Add statistics gathered outside of this class to the current frame
+ * \param[in] stats The statistics to add
+ *
+ * This allows debayering implementations that don't process lines on the CPU,
+ * such as GPU based ones, to publish their statistics through the buffers of
+ * this class. It may only be called between startFrame() and finishFrame().
+ */
+void SwStatsCpu::accumulate(const SwIspStats &stats)
+{
+	SwIspStats &frameStats = *stripeStats_[0];
+
+	frameStats.sumR_ += stats.sumR_;
+	frameStats.sumG_ += stats.sumG_;
+	frameStats.sumB_ += stats.sumB_;
+	for (unsigned int i = 0; i < SwIspStats::kYHistogramSize; i++)
+		frameStats.yHistogram[i] += stats.yHistogram[i];
 }
 
 /**
  * \brief Finish statistics calculation for the current frame
  * \param[in] frame The frame number
+ *
+ * Merge the partial statistics of all stripes and publish them through the
+ * statsReady signal. This may only be called after a successful setWindow()
+ * call, once all stripes of the frame have been processed.
+ */
+void SwStatsCpu::finishFrame(uint32_t frame)
+{
+	SwIspStats &stats = *stripeStats_[0];
+
+	for (const SwIspStats &partial : partialStats_) {
+		stats.sumR_ += partial.sumR_;
+		stats.sumG_ += partial.sumG_;
+		stats.sumB_ += partial.sumB_;
+		for (unsigned int i = 0; i < SwIspStats::kYHistogramSize; i++)
+			stats.yHistogram[i] += partial.yHistogram[i];
+	}
+
+	if (!bufferId_)
+		return;
+
+	statsReady.emit(frame, *bufferId_);
+	bufferId_.reset();
+}
+
+/**
+ * \brief Return a statistics buffer to the ring
  * \param[in] bufferId ID of the statistics buffer
  *
- * This may only be called after a successful setWindow() call.
+ * This function may be called from any thread.
  */
-void SwStatsCpu::finishFrame(uint32_t frame, uint32_t bufferId)
+void SwStatsCpu::releaseBuffer(uint32_t bufferId)
 {
-	*sharedStats_ = stats_;
-	statsReady.emit(frame, bufferId);
+	if (bufferId >= kStatsBufferCount) {
+		LOG(SwStatsCpu, Error)
+			<< "Invalid statistics buffer ID " << bufferId;
+		return;
+	}
+
+	MutexLocker locker(mutex_);
+	freeBuffers_.set(bufferId);
+}
+
+/**
+ * \brief Return all statistics buffers to the ring
+ *
+ * Statistics buffers still owned by the consumer when it stops are never
+ * released. This function reclaims them, and shall only be called when
+ * streaming is stopped and the consumer doesn't access any buffer anymore.
+ */
+void SwStatsCpu::releaseBuffers()
+{
+	MutexLocker locker(mutex_);
+	freeBuffers_.set();
 }
 
 /**
@@ -354,10 +637,75 @@ int SwStatsCpu::setupStandardBayerOrder(BayerFormat::Order order)
 
 	patternSize_.height = 2;
 	patternSize_.width = 2;
-	ySkipMask_ = 0x02; /* Skip every 3th and 4th line */
+	return 0;
+}
+
+/*
+ * Compute the line skip mask and the horizontal step between the sampled
+ * quads, from the subsampling factor multiplied by the throttle factor and
+ * raised to at least minSubsampling. The mask skips the quad lines, i.e. line
+ * pairs, which aren't sampled.
+ */
+void SwStatsCpu::setupSampling(unsigned int minSubsampling)
+{
+	const unsigned int factor =
+		std::max(std::min(subsampling_ * throttle_, kMaxSubsampling),
+			 minSubsampling);
+
+	minSubsampling_ = minSubsampling;
+
+	ySkipMask_ = (factor - 1) << 1;
+
+	/* Packed formats store 2 quads in 5 bytes */
+	if (patternSize_.width == 4)
+		xStep_ = factor / 2 * 5;
+	else
+		xStep_ = factor * 2;
+}
+
+/**
+ * \brief Set the statistics subsampling factor
+ * \param[in] factor The number of quads in each direction for each sampled quad
+ *
+ * Gather statistics on one 2x2 Bayer quad out of \a factor quads horizontally
+ * and vertically, from the top left corner of the window. The factor shall be
+ * a power of two not larger than kMaxSubsampling. Larger factors lower the
+ * statistics processing cost, at the expense of precision. CSI-2 packed
+ * formats are sampled with a factor of at least 2.
+ *
+ * This takes effect at the next configure() call.
+ *
+ * \return 0 on success, a negative errno value on failure
+ */
+int SwStatsCpu::setSubsampling(unsigned int factor)
+{
+	if (!factor || factor > kMaxSubsampling || (factor & (factor - 1)))
+		return -EINVAL;
+
+	subsampling_ = factor;
 	return 0;
 }
 
+/**
+ * \brief Lower the statistics resolution at runtime
+ * \param[in] factor The factor to multiply the subsampling factor by
+ *
+ * Unlike setSubsampling(), this takes effect at the next frame, and is meant
+ * to shed load while streaming when frames can't be processed in time. The
+ * resulting subsampling factor is limited to kMaxSubsampling. The factor shall
+ * be a power of two, and 1 restores the configured subsampling.
+ *
+ * This function shall not be called while a frame is processed.
+ */
+void SwStatsCpu::setThrottle(unsigned int factor)
+{
+	if (!factor || (factor & (factor - 1)) || factor == throttle_)
+		return;
+
+	throttle_ = factor;
+	setupSampling(minSubsampling_);
+}
+
 /**
  * \brief Configure the statistics object for the passed in input format
  * \param[in] inputCfg The input format
@@ -371,6 +719,8 @@ int SwStatsCpu::configure(const StreamConfiguration &inputCfg)
 
 	if (bayerFormat.packing == BayerFormat::Packing::None &&
 	    setupStandardBayerOrder(bayerFormat.order) == 0) {
+		setupSampling(1);
+
 		switch (bayerFormat.bitDepth) {
 		case 8:
 			stats0_ = &SwStatsCpu::statsBGGR8Line0;
@@ -388,9 +738,8 @@ int SwStatsCpu::configure(const StreamConfiguration &inputCfg)
 	    bayerFormat.packing == BayerFormat::Packing::CSI2) {
 		patternSize_.height = 2;
 		patternSize_.width = 4; /* 5 bytes per *4* pixels */
-		/* Skip every 3th and 4th line, sample every other 2x2 block */
-		ySkipMask_ = 0x02;
 		xShift_ = 0;
+		setupSampling(2);
 
 		switch (bayerFormat.order) {
 		case BayerFormat::BGGR:
@@ -431,4 +780,23 @@ void SwStatsCpu::setWindow(const Rectangle &window)
 	window_.height &= ~(patternSize_.height - 1);
 }
 
+/**
+ * \brief Set the number of stripes the frame is processed in
+ * \param[in] count The number of stripes
+ *
+ * Lines of different stripes may be processed concurrently from different
+ * threads, as long as lines of a given stripe are processed from a single
+ * thread. The \a stripe argument passed to processLine0() and processLine2()
+ * shall be lower than \a count.
+ */
+void SwStatsCpu::setStripeCount(unsigned int count)
+{
+	count = std::max(count, 1U);
+
+	partialStats_.resize(count - 1);
+	stripeStats_.resize(count);
+	for (unsigned int i = 1; i < count; i++)
+		stripeStats_[i] = &partialStats_[i - 1];
+}
+
 } /* namespace libcamera */
@@ -11,8 +11,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <optional>
 #include <stdint.h>
+#include <vector>
 
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/signal.h>
 
 #include <libcamera/geometry.h>
@@ -29,53 +36,116 @@ struct StreamConfiguration;
 class SwStatsCpu
 {
 public:
+	static constexpr unsigned int kStatsBufferCount = 4;
+	static constexpr unsigned int kDefaultSubsampling = 2;
+	static constexpr unsigned int kMaxSubsampling = 16;
+
+	struct LineStats {
+		SwIspStats *stats;
+		unsigned int width;
+		unsigned int stepMask;
+	};
+
 	SwStatsCpu();
 	~SwStatsCpu() = default;
 
-	bool isValid() const { return sharedStats_.fd().isValid(); }
+	bool isValid() const;
 
-	const SharedFD &getStatsFD() { return sharedStats_.fd(); }
+	std::vector<SharedFD> getStatsFDs() const;
 
 	const Size &patternSize() { return patternSize_; }
+	unsigned int subsampling() const { return subsampling_; }
 
 	int configure(const StreamConfiguration &inputCfg);
+	int setSubsampling(unsigned int factor);
+	void setThrottle(unsigned int factor);
 	void setWindow(const Rectangle &window);
+	void setStripeCount(unsigned int count);
 	void startFrame();
-	void finishFrame(uint32_t frame, uint32_t bufferId);
+	void accumulate(const SwIspStats &stats);
+	void finishFrame(uint32_t frame);
+	void releaseBuffer(uint32_t bufferId);
+	void releaseBuffers();
+
+	void processLine0(unsigned int y, const uint8_t *src[], unsigned int stripe = 0)
+	{
+		processLine0(y, src, stripe, 0, window_.width);
+	}
 
-	void processLine0(unsigned int y, const uint8_t *src[])
+	void processLine0(unsigned int y, const uint8_t *src[], unsigned int stripe,
+			  unsigned int x, unsigned int width)
 	{
 		if ((y & ySkipMask_) || y < static_cast<unsigned int>(window_.y) ||
-		    y >= (window_.y + window_.height))
+		    y >= (window_.y + window_.height) || x >= window_.width)
 			return;
 
-		(this->*stats0_)(src);
+		(this->*stats0_)(src, *stripeStats_[stripe],
+				 std::min(width, window_.width - x));
 	}
 
-	void processLine2(unsigned int y, const uint8_t *src[])
+	void processLine2(unsigned int y, const uint8_t *src[], unsigned int stripe = 0)
+	{
+		processLine2(y, src, stripe, 0, window_.width);
+	}
+
+	void processLine2(unsigned int y, const uint8_t *src[], unsigned int stripe,
+			  unsigned int x, unsigned int width)
 	{
 		if ((y & ySkipMask_) || y < static_cast<unsigned int>(window_.y) ||
-		    y >= (window_.y + window_.height))
+		    y >= (window_.y + window_.height) || x >= window_.width)
 			return;
 
-		(this->*stats2_)(src);
+		(this->*stats2_)(src, *stripeStats_[stripe],
+				 std::min(width, window_.width - x));
+	}
+
+	bool lineStats(unsigned int y, unsigned int stripe, unsigned int x,
+		       unsigned int width, LineStats *line) const
+	{
+		if ((y & ySkipMask_) || y < static_cast<unsigned int>(window_.y) ||
+		    y >= (window_.y + window_.height) || x >= window_.width)
+			return false;
+
+		line->stats = stripeStats_[stripe];
+		line->width = std::min(width, window_.width - x);
+		line->stepMask = xStep_ - 1;
+		return true;
+	}
+
+	template<unsigned int div>
+	static unsigned int yHistogramBin(unsigned int r, unsigned int g, unsigned int b)
+	{
+		const unsigned int y = r * kRedYMul + g * kGreenYMul + b * kBlueYMul;
+
+		return y * SwIspStats::kYHistogramSize / (256 * 256 * div);
 	}
 
 	Signal<uint32_t, uint32_t> statsReady;
 
 private:
-	using statsProcessFn = void (SwStatsCpu::*)(const uint8_t *src[]);
+	static constexpr unsigned int kRedYMul = 77; /* 0.299 * 256 */
+	static constexpr unsigned int kGreenYMul = 150; /* 0.587 * 256 */
+	static constexpr unsigned int kBlueYMul = 29; /* 0.114 * 256 */
+
+	using statsProcessFn = void (SwStatsCpu::*)(const uint8_t *src[], SwIspStats &stats,
+						    unsigned int width);
 
 	int setupStandardBayerOrder(BayerFormat::Order order);
+	void setupSampling(unsigned int minSubsampling);
 	/* Bayer 8 bpp unpacked */
-	void statsBGGR8Line0(const uint8_t *src[]);
+	void statsBGGR8Line0(const uint8_t *src[], SwIspStats &stats,
+			     unsigned int width);
 	/* Bayer 10 bpp unpacked */
-	void statsBGGR10Line0(const uint8_t *src[]);
+	void statsBGGR10Line0(const uint8_t *src[], SwIspStats &stats,
+			      unsigned int width);
 	/* Bayer 12 bpp unpacked */
-	void statsBGGR12Line0(const uint8_t *src[]);
+	void statsBGGR12Line0(const uint8_t *src[], SwIspStats &stats,
+			      unsigned int width);
 	/* Bayer 10 bpp packed */
-	void statsBGGR10PLine0(const uint8_t *src[]);
-	void statsGBRG10PLine0(const uint8_t *src[]);
+	void statsBGGR10PLine0(const uint8_t *src[], SwIspStats &stats,
+			       unsigned int width);
+	void statsGBRG10PLine0(const uint8_t *src[], SwIspStats &stats,
+			       unsigned int width);
 
 	/* Variables set by configure(), used every line */
 	statsProcessFn stats0_;
@@ -83,6 +153,10 @@ private:
 	bool swapLines_;
 
 	unsigned int ySkipMask_;
+	unsigned int xStep_;
+	unsigned int subsampling_;
+	unsigned int minSubsampling_;
+	unsigned int throttle_;
 
 	Rectangle window_;
 
@@ -90,8 +164,18 @@ private:
 
 	unsigned int xShift_;
 
-	SharedMemObject<SwIspStats> sharedStats_;
-	SwIspStats stats_;
+	std::array<SharedMemObject<SwIspStats>, kStatsBufferCount> sharedStats_;
+
+	Mutex mutex_;
+	std::bitset<kStatsBufferCount> freeBuffers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	/* Buffer the current frame statistics are gathered in, if any */
+	std::optional<uint32_t> bufferId_;
+	/* Statistics of frames for which no buffer is available */
+	SwIspStats discardStats_;
+	/* Partial statistics of stripes other than the first one */
+	std::vector<SwIspStats> partialStats_;
+	std::vector<SwIspStats *> stripeStats_;
 };
 
 } /* namespace libcamera */
@@ -0,0 +1,175 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Startup phase timing
+ */
+
+#include "libcamera/internal/startup_profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+
+/**
+ * \file startup_profile.h
+ * \brief Startup phase timing
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Startup)
+
+namespace {
+
+struct PhaseRegistry {
+	Mutex mutex;
+	std::vector<StartupProfile::Phase> phases LIBCAMERA_TSA_GUARDED_BY(mutex);
+};
+
+PhaseRegistry &registry()
+{
+	static PhaseRegistry registry;
+	return registry;
+}
+
+} /* namespace */
+
+/**
+ * \class StartupProfile
+ * \brief Measure the time spent in the phases of the camera startup
+ *
+ * The StartupProfile records the duration of the steps that contribute to the
+ * time it takes to get a camera streaming, such as device enumeration, media
+ * graph population, pipeline handler matching, IPA module loading and
+ * initialization, camera sensor initialization, camera configuration and
+ * buffer allocation.
+ *
+ * Phases are identified by a name and an owner, which is the pipeline handler,
+ * camera, device or IPA module the phase applies to, or an empty string for
+ * global phases. Phases recorded multiple times with the same name and owner
+ * are accumulated. Each phase is logged at the Debug level in the Startup
+ * category when it completes, the CameraManager logs a summary of all the
+ * phases recorded during its startup at the Info level, and the phases()
+ * function can be used to query the recorded phases at any time.
+ *
+ * Phases are most easily measured with the StartupProfile::Scope class.
+ *
+ * \context This class is \threadsafe.
+ */
+
+/**
+ * \struct StartupProfile::Phase
+ * \brief The accumulated duration of a startup phase
+ *
+ * \var StartupProfile::Phase::name
+ * \brief The phase name
+ *
+ * \var StartupProfile::Phase::owner
+ * \brief The pipeline handler, camera, device or IPA module the phase applies
+ * to, empty for global phases
+ *
+ * \var StartupProfile::Phase::duration
+ * \brief The total time spent in the phase
+ *
+ * \var StartupProfile::Phase::count
+ * \brief The number of times the phase has been recorded
+ */
+
+/**
+ * \class StartupProfile::Scope
+ * \brief Record the duration of a startup phase over a scope
+ *
+ * The Scope class records the time elapsed between its construction and its
+ * destruction as a startup phase.
+ */
+
+/**
+ * \brief Start measuring a startup phase
+ * \param[in] name The phase name, shall stay valid for the lifetime of the
+ * scope
+ * \param[in] owner The phase owner
+ */
+StartupProfile::Scope::Scope(const char *name, const std::string &owner)
+	: name_(name), owner_(owner), start_(utils::clock::now())
+{
+}
+
+/**
+ * \brief Stop measuring the startup phase and record its duration
+ */
+StartupProfile::Scope::~Scope()
+{
+	record(name_, owner_, utils::clock::now() - start_);
+}
+
+/**
+ * \brief Record the duration of a startup phase
+ * \param[in] name The phase name
+ * \param[in] owner The phase owner
+ * \param[in] duration The duration of the phase
+ */
+void StartupProfile::record(const char *name, const std::string &owner,
+			    utils::Duration duration)
+{
+	LOG(Startup, Debug)
+		<< name << (owner.empty() ? "" : " [" + owner + "]")
+		<< " took " << duration.get<std::milli>() << "ms";
+
+	PhaseRegistry &reg = registry();
+	MutexLocker locker(reg.mutex);
+
+	auto it = std::find_if(reg.phases.begin(), reg.phases.end(),
+			       [&](const Phase &phase) {
+				       return phase.name == name &&
+					      phase.owner == owner;
+			       });
+	if (it == reg.phases.end()) {
+		reg.phases.push_back({ name, owner, duration, 1 });
+		return;
+	}
+
+	it->duration += duration;
+	it->count++;
+}
+
+/**
+ * \brief Retrieve the recorded startup phases
+ * \return The recorded startup phases, in the order they were first recorded
+ */
+std::vector<StartupProfile::Phase> StartupProfile::phases()
+{
+	PhaseRegistry &reg = registry();
+	MutexLocker locker(reg.mutex);
+
+	return reg.phases;
+}
+
+/**
+ * \brief Format the recorded startup phases as a human-readable string
+ * \return A string listing the recorded startup phases and their durations
+ */
+std::string StartupProfile::toString()
+{
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(2);
+
+	for (const Phase &phase : phases()) {
+		if (ss.tellp() > 0)
+			ss << ", ";
+
+		ss << phase.name;
+		if (!phase.owner.empty())
+			ss << " [" << phase.owner << "]";
+		ss << " " << phase.duration.get<std::milli>() << "ms";
+		if (phase.count > 1)
+			ss << " (" << phase.count << "x)";
+	}
+
+	return ss.str();
+}
+
+} /* namespace libcamera */
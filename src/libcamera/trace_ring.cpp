@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * In-process frame trace ring
+ */
+
+#include "libcamera/internal/trace_ring.h"
+
+#include <chrono>
+#include <iterator>
+#include <stdlib.h>
+
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
+
+/**
+ * \file trace_ring.h
+ * \brief In-process frame trace ring
+ */
+
+namespace libcamera {
+
+/**
+ * \enum FrameStage
+ * \brief Processing stages of a frame through a pipeline
+ *
+ * The frame stages are recorded with the LIBCAMERA_TRACEPOINT_FRAME() macro,
+ * both as LTTng tracepoints when tracing is enabled, and in the TraceRing.
+ *
+ * The StartOfFrame and SensorDequeue stages are identified by the sensor frame
+ * sequence number, as no request is known yet at that point. All other stages
+ * are identified by the sequence number of the associated request.
+ *
+ * \var FrameStage::StartOfFrame
+ * \brief The sensor started transmitting the frame
+ * \var FrameStage::SensorDequeue
+ * \brief The frame has been dequeued from the receiver (CSI-2 or frontend)
+ * \var FrameStage::IpaPrepareBegin
+ * \brief The IPA has been requested to prepare the ISP parameters
+ * \var FrameStage::IpaPrepareEnd
+ * \brief The IPA has completed preparing the ISP parameters
+ * \var FrameStage::IpaProcessBegin
+ * \brief The IPA has been requested to process the frame statistics
+ * \var FrameStage::IpaProcessEnd
+ * \brief The IPA has completed processing the frame statistics
+ * \var FrameStage::IspQueue
+ * \brief The frame has been queued to the ISP
+ * \var FrameStage::IspDequeue
+ * \brief The ISP has completed processing the frame
+ * \var FrameStage::RequestComplete
+ * \brief The request associated with the frame has completed
+ */
+
+namespace {
+
+const char *const frameStageNames[] = {
+	"StartOfFrame",
+	"SensorDequeue",
+	"IpaPrepareBegin",
+	"IpaPrepareEnd",
+	"IpaProcessBegin",
+	"IpaProcessEnd",
+	"IspQueue",
+	"IspDequeue",
+	"RequestComplete",
+};
+
+constexpr unsigned long kMaxTraceRingSize = 1 << 20;
+
+} /* namespace */
+
+/**
+ * \class TraceRing
+ * \brief Fixed-size in-process ring of frame processing events
+ *
+ * The TraceRing records the time at which frames reach each FrameStage in a
+ * fixed-size ring, overwriting the oldest events when full. It allows
+ * attributing frame latency to pipeline stages on systems where LTTng is not
+ * available.
+ *
+ * The ring is disabled by default, and is enabled by setting the
+ * LIBCAMERA_TRACE_RING environment variable to the number of events it shall
+ * hold. Recording events is lock-free and never blocks. The ring contents can
+ * be dumped at any time with dump(), and are written to the log when a camera
+ * is stopped.
+ */
+
+/**
+ * \brief Construct a trace ring
+ * \param[in] size The number of entries, rounded up to a power of two
+ */
+TraceRing::TraceRing(unsigned int size)
+	: head_(0)
+{
+	uint64_t entries = 1;
+	while (entries < size)
+		entries <<= 1;
+
+	entries_ = std::make_unique<Entry[]>(entries);
+	for (uint64_t i = 0; i < entries; ++i)
+		entries_[i].sequence.store(0, std::memory_order_relaxed);
+
+	mask_ = entries - 1;
+}
+
+/**
+ * \brief Retrieve the trace ring instance
+ * \return The trace ring, or nullptr if the trace ring is disabled
+ */
+TraceRing *TraceRing::instance()
+{
+	static std::unique_ptr<TraceRing> ring = []() {
+		const char *env = utils::secure_getenv("LIBCAMERA_TRACE_RING");
+		if (!env)
+			return std::unique_ptr<TraceRing>();
+
+		char *endptr;
+		unsigned long size = strtoul(env, &endptr, 10);
+		if (*env == '\0' || *endptr != '\0' || !size ||
+		    size > kMaxTraceRingSize)
+			return std::unique_ptr<TraceRing>();
+
+		return std::unique_ptr<TraceRing>(new TraceRing(size));
+	}();
+
+	return ring.get();
+}
+
+/**
+ * \fn TraceRing::trace()
+ * \brief Record a frame event in the trace ring, if enabled
+ * \param[in] pipe The pipeline name
+ * \param[in] stage The frame stage
+ * \param[in] frame The frame sequence number
+ */
+
+/**
+ * \brief Record a frame event
+ * \param[in] pipe The pipeline name, shall stay valid for the process lifetime
+ * \param[in] stage The frame stage
+ * \param[in] frame The frame sequence number
+ *
+ * \context This function is \threadsafe.
+ */
+void TraceRing::record(const char *pipe, FrameStage stage, uint32_t frame)
+{
+	uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		utils::clock::now().time_since_epoch()).count();
+
+	uint64_t pos = head_.fetch_add(1, std::memory_order_relaxed);
+	Entry &entry = entries_[pos & mask_];
+
+	/*
+	 * Mark the entry as being written with an odd sequence, and publish it
+	 * with the even sequence corresponding to its position.
+	 */
+	entry.sequence.store(pos * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	entry.timestamp.store(timestamp, std::memory_order_relaxed);
+	entry.pipe.store(pipe, std::memory_order_relaxed);
+	entry.tid.store(Thread::currentId(), std::memory_order_relaxed);
+	entry.frame.store(frame, std::memory_order_relaxed);
+	entry.stage.store(stage, std::memory_order_relaxed);
+
+	entry.sequence.store(pos * 2 + 2, std::memory_order_release);
+}
+
+/**
+ * \brief Dump the trace ring contents
+ * \param[in] stream The output stream
+ *
+ * Write all events currently stored in the ring to \a stream, from the oldest
+ * to the most recent, one per line. Events recorded concurrently with the dump
+ * may be skipped.
+ *
+ * \context This function is \threadsafe.
+ */
+void TraceRing::dump(std::ostream &stream)
+{
+	uint64_t head = head_.load(std::memory_order_acquire);
+	uint64_t size = mask_ + 1;
+	uint64_t pos = head > size ? head - size : 0;
+
+	for (; pos < head; ++pos) {
+		Entry &entry = entries_[pos & mask_];
+
+		uint64_t sequence = entry.sequence.load(std::memory_order_acquire);
+		if (sequence != pos * 2 + 2)
+			continue;
+
+		uint64_t timestamp = entry.timestamp.load(std::memory_order_relaxed);
+		const char *pipe = entry.pipe.load(std::memory_order_relaxed);
+		uint32_t tid = entry.tid.load(std::memory_order_relaxed);
+		uint32_t frame = entry.frame.load(std::memory_order_relaxed);
+		FrameStage stage = entry.stage.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (entry.sequence.load(std::memory_order_relaxed) != sequence)
+			continue;
+
+		utils::time_point time{ std::chrono::nanoseconds(timestamp) };
+		unsigned int index = static_cast<unsigned int>(stage);
+
+		stream << "[" << utils::time_point_to_string(time) << "] ["
+		       << tid << "] " << pipe << " frame " << frame << " "
+		       << (index < std::size(frameStageNames)
+				   ? frameStageNames[index] : "Unknown")
+		       << std::endl;
+	}
+}
+
+} /* namespace libcamera */
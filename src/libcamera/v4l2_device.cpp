@@ -23,6 +23,7 @@
 #include <libcamera/base/utils.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/media_request.h"
 #include "libcamera/internal/sysfs.h"
 
 /**
@@ -258,6 +259,7 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
 /**
  * \brief Write controls to the device
  * \param[in] ctrls The list of controls to write
+ * \param[in] request The media request to store the controls in, if any
  *
  * This function writes the value of all controls contained in \a ctrls, and
  * stores the values actually applied to the device in the corresponding
@@ -273,11 +275,17 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
  * are written and their values are updated in \a ctrls, while all other
  * controls are not written and their values are not changed.
  *
+ * When a \a request is given, the controls are stored in the request instead
+ * of being applied immediately, and take effect when the request is queued.
+ * The values stored in \a ctrls are then those of the request.
+ *
+ * Writing a control that modifies the format layout calls layoutChanged().
+ *
  * \return 0 on success or an error code otherwise
  * \retval -EINVAL One of the control is not supported or not accessible
  * \retval i The index of the control that failed
  */
-int V4L2Device::setControls(ControlList *ctrls)
+int V4L2Device::setControls(ControlList *ctrls, const MediaRequest *request)
 {
 	if (ctrls->empty())
 		return 0;
@@ -342,6 +350,11 @@ int V4L2Device::setControls(ControlList *ctrls)
 	v4l2ExtCtrls.controls = v4l2Ctrls.data();
 	v4l2ExtCtrls.count = v4l2Ctrls.size();
 
+	if (request) {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		v4l2ExtCtrls.request_fd = request->fd();
+	}
+
 	int ret = ioctl(VIDIOC_S_EXT_CTRLS, &v4l2ExtCtrls);
 	if (ret) {
 		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
@@ -364,6 +377,14 @@ int V4L2Device::setControls(ControlList *ctrls)
 
 	updateControls(ctrls, v4l2Ctrls);
 
+	for (const v4l2_ext_control &v4l2Ctrl : v4l2Ctrls) {
+		const v4l2_query_ext_ctrl *info = controlInfo(v4l2Ctrl.id);
+		if (info && info->flags & V4L2_CTRL_FLAG_MODIFY_LAYOUT) {
+			layoutChanged();
+			break;
+		}
+	}
+
 	return ret;
 }
 
@@ -474,6 +495,16 @@ int V4L2Device::ioctl(unsigned long request, void *argp)
  * \return The V4L2 device file descriptor, -1 if the device node is not open
  */
 
+/**
+ * \fn V4L2Device::layoutChanged()
+ * \brief Notify that a control modifying the format layout has been written
+ *
+ * This function is called by setControls() when it writes a control flagged
+ * with V4L2_CTRL_FLAG_MODIFY_LAYOUT, such as the flips of Bayer sensors that
+ * change the media bus code. Derived classes that cache formats shall override
+ * it to drop the cached state. The default implementation does nothing.
+ */
+
 /**
  * \brief Retrieve the libcamera control type associated with the V4L2 control
  * \param[in] ctrlType The V4L2 control type
@@ -942,6 +973,12 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 		return 0;
 	}
 
+	/*
+	 * This function is static, log with the libcamera::_log() function as
+	 * there is no V4L2Device instance to provide a log prefix.
+	 */
+	using libcamera::_log;
+
 	/*
 	 * If the colorSpace doesn't precisely match a standard color space,
 	 * then we must choose a V4L2 colorspace with matching primaries.
@@ -952,7 +989,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itPrimaries != primariesToV4l2.end()) {
 		v4l2Format.colorspace = itPrimaries->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised primaries in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -962,7 +999,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itTransfer != transferFunctionToV4l2.end()) {
 		v4l2Format.xfer_func = itTransfer->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised transfer function in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -972,7 +1009,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itYcbcrEncoding != ycbcrEncodingToV4l2.end()) {
 		v4l2Format.ycbcr_enc = itYcbcrEncoding->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised YCbCr encoding in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -982,7 +1019,7 @@ int V4L2Device::fromColorSpace(const std::optional<ColorSpace> &colorSpace, T &v
 	if (itRange != rangeToV4l2.end()) {
 		v4l2Format.quantization = itRange->second;
 	} else {
-		libcamera::LOG(V4L2, Warning)
+		LOG(V4L2, Warning)
 			<< "Unrecognised quantization in "
 			<< ColorSpace::toString(colorSpace);
 		ret = -EINVAL;
@@ -9,8 +9,8 @@
 #include "libcamera/internal/v4l2_pixelformat.h"
 
 #include <ctype.h>
-#include <map>
 #include <string.h>
+#include <unordered_map>
 
 #include <libcamera/base/log.h>
 
@@ -45,7 +45,7 @@ LOG_DECLARE_CATEGORY(V4L2)
 
 namespace {
 
-const std::map<V4L2PixelFormat, V4L2PixelFormat::Info> vpf2pf{
+const std::unordered_map<V4L2PixelFormat, V4L2PixelFormat::Info> vpf2pf{
 	/* RGB formats. */
 	{ V4L2PixelFormat(V4L2_PIX_FMT_RGB565),
 		{ formats::RGB565, "16-bit RGB 5-6-5" } },
@@ -853,6 +853,15 @@ std::ostream &operator<<(std::ostream &out, const V4L2SubdeviceFormat &f)
  * path of the entity's device node. No API call other than open(), isOpen()
  * and close() shall be called on an unopened device instance. Upon destruction
  * any device left open will be closed, and any resources released.
+ *
+ * The formats and selection rectangles are cached per stream. Retrieving them
+ * is served from the cache when possible, and setting a value identical to
+ * the cached one doesn't issue any ioctl. Setting a format or rectangle drops
+ * the cached state it may affect through propagation in the subdevice, that
+ * is the state of the source pads and the rectangles of the same pad. The
+ * whole cache is dropped when the routing table or a control modifying the
+ * format layout is set, and when the media device is locked again, as other
+ * users may have reconfigured it in the meantime.
  */
 
 /**
@@ -1002,7 +1011,7 @@ std::ostream &operator<<(std::ostream &out, const V4L2Subdevice::Routing &routin
  * path
  */
 V4L2Subdevice::V4L2Subdevice(const MediaEntity *entity)
-	: V4L2Device(entity->deviceNode()), entity_(entity)
+	: V4L2Device(entity->deviceNode()), entity_(entity), cacheLockCount_(0)
 {
 }
 
@@ -1021,6 +1030,8 @@ int V4L2Subdevice::open()
 	if (ret)
 		return ret;
 
+	clearCache();
+
 	/*
 	 * Try to query the subdev capabilities. The VIDIOC_SUBDEV_QUERYCAP API
 	 * was introduced in kernel v5.8, ENOTTY errors must be ignored to
@@ -1072,6 +1083,15 @@ int V4L2Subdevice::open()
 int V4L2Subdevice::getSelection(const Stream &stream, unsigned int target,
 				Rectangle *rect)
 {
+	validateCache();
+
+	const auto key = std::make_tuple(stream.pad, stream.stream, target);
+	const auto cached = selectionCache_.find(key);
+	if (cached != selectionCache_.end()) {
+		*rect = cached->second.rect;
+		return 0;
+	}
+
 	struct v4l2_subdev_selection sel = {};
 
 	sel.which = V4L2_SUBDEV_FORMAT_ACTIVE;
@@ -1093,6 +1113,8 @@ int V4L2Subdevice::getSelection(const Stream &stream, unsigned int target,
 	rect->width = sel.r.width;
 	rect->height = sel.r.height;
 
+	selectionCache_[key] = { *rect, *rect };
+
 	return 0;
 }
 
@@ -1120,6 +1142,17 @@ int V4L2Subdevice::getSelection(const Stream &stream, unsigned int target,
 int V4L2Subdevice::setSelection(const Stream &stream, unsigned int target,
 				Rectangle *rect)
 {
+	validateCache();
+
+	const auto key = std::make_tuple(stream.pad, stream.stream, target);
+	const auto cached = selectionCache_.find(key);
+	if (cached != selectionCache_.end() &&
+	    (cached->second.request == *rect || cached->second.rect == *rect)) {
+		*rect = cached->second.rect;
+		return 0;
+	}
+
+	const Rectangle request = *rect;
 	struct v4l2_subdev_selection sel = {};
 
 	sel.which = V4L2_SUBDEV_FORMAT_ACTIVE;
@@ -1134,6 +1167,7 @@ int V4L2Subdevice::setSelection(const Stream &stream, unsigned int target,
 	sel.r.height = rect->height;
 
 	int ret = ioctl(VIDIOC_SUBDEV_S_SELECTION, &sel);
+	invalidateCache(ActiveFormat, stream);
 	if (ret < 0) {
 		LOG(V4L2, Error)
 			<< "Unable to set rectangle " << target << " on pad "
@@ -1146,6 +1180,8 @@ int V4L2Subdevice::setSelection(const Stream &stream, unsigned int target,
 	rect->width = sel.r.width;
 	rect->height = sel.r.height;
 
+	selectionCache_[key] = { request, *rect };
+
 	return 0;
 }
 
@@ -1238,6 +1274,16 @@ std::optional<ColorSpace> V4L2Subdevice::toColorSpace(const v4l2_mbus_framefmt &
 	return V4L2Device::toColorSpace(format, colourEncoding);
 }
 
+namespace {
+
+bool sameFormat(const V4L2SubdeviceFormat &lhs, const V4L2SubdeviceFormat &rhs)
+{
+	return lhs.code == rhs.code && lhs.size == rhs.size &&
+	       lhs.colorSpace == rhs.colorSpace;
+}
+
+} /* namespace */
+
 /**
  * \brief Retrieve the image format set on one of the V4L2 subdevice streams
  * \param[in] stream The stream the format is to be retrieved from
@@ -1249,6 +1295,15 @@ std::optional<ColorSpace> V4L2Subdevice::toColorSpace(const v4l2_mbus_framefmt &
 int V4L2Subdevice::getFormat(const Stream &stream, V4L2SubdeviceFormat *format,
 			     Whence whence)
 {
+	validateCache();
+
+	const auto key = std::make_tuple(whence, stream.pad, stream.stream);
+	const auto cached = formatCache_.find(key);
+	if (cached != formatCache_.end()) {
+		*format = cached->second.format;
+		return 0;
+	}
+
 	struct v4l2_subdev_format subdevFmt = {};
 	subdevFmt.which = whence;
 	subdevFmt.pad = stream.pad;
@@ -1267,6 +1322,8 @@ int V4L2Subdevice::getFormat(const Stream &stream, V4L2SubdeviceFormat *format,
 	format->code = subdevFmt.format.code;
 	format->colorSpace = toColorSpace(subdevFmt.format);
 
+	formatCache_[key] = { *format, *format };
+
 	return 0;
 }
 
@@ -1296,6 +1353,18 @@ int V4L2Subdevice::getFormat(const Stream &stream, V4L2SubdeviceFormat *format,
 int V4L2Subdevice::setFormat(const Stream &stream, V4L2SubdeviceFormat *format,
 			     Whence whence)
 {
+	validateCache();
+
+	const auto key = std::make_tuple(whence, stream.pad, stream.stream);
+	const auto cached = formatCache_.find(key);
+	if (cached != formatCache_.end() &&
+	    (sameFormat(cached->second.request, *format) ||
+	     sameFormat(cached->second.format, *format))) {
+		*format = cached->second.format;
+		return 0;
+	}
+
+	const V4L2SubdeviceFormat request = *format;
 	struct v4l2_subdev_format subdevFmt = {};
 	subdevFmt.which = whence;
 	subdevFmt.pad = stream.pad;
@@ -1313,6 +1382,7 @@ int V4L2Subdevice::setFormat(const Stream &stream, V4L2SubdeviceFormat *format,
 	}
 
 	int ret = ioctl(VIDIOC_SUBDEV_S_FMT, &subdevFmt);
+	invalidateCache(whence, stream);
 	if (ret) {
 		LOG(V4L2, Error)
 			<< "Unable to set format on pad " << stream << ": "
@@ -1325,6 +1395,8 @@ int V4L2Subdevice::setFormat(const Stream &stream, V4L2SubdeviceFormat *format,
 	format->code = subdevFmt.format.code;
 	format->colorSpace = toColorSpace(subdevFmt.format);
 
+	formatCache_[key] = { request, *format };
+
 	return 0;
 }
 
@@ -1526,6 +1598,9 @@ int V4L2Subdevice::setRouting(Routing *routing, Whence whence)
 		return 0;
 	}
 
+	/* Setting the routing table resets the formats of all streams. */
+	clearCache();
+
 	std::vector<struct v4l2_subdev_route> routes{ routing->size() };
 
 	for (const auto &[i, route] : utils::enumerate(*routing))
@@ -1660,6 +1735,59 @@ std::string V4L2Subdevice::logPrefix() const
 	return "'" + entity_->name() + "'";
 }
 
+void V4L2Subdevice::layoutChanged()
+{
+	clearCache();
+}
+
+/* Drop the cache if another user may have reconfigured the device. */
+void V4L2Subdevice::validateCache()
+{
+	unsigned int lockCount = entity_->device()->lockCount();
+	if (lockCount == cacheLockCount_)
+		return;
+
+	clearCache();
+	cacheLockCount_ = lockCount;
+}
+
+/*
+ * Drop the cached state that setting a format or rectangle on \a stream may
+ * modify. Formats propagate from the sink pads to the source pads, and from
+ * the formats to the rectangles of the same pad.
+ */
+void V4L2Subdevice::invalidateCache(Whence whence, const Stream &stream)
+{
+	const auto isSource = [&](unsigned int pad) {
+		return entity_->pads()[pad]->flags() & MEDIA_PAD_FL_SOURCE;
+	};
+
+	for (auto it = formatCache_.begin(); it != formatCache_.end();) {
+		const auto &[w, pad, s] = it->first;
+		if (w == whence && (isSource(pad) || Stream{ pad, s } == stream))
+			it = formatCache_.erase(it);
+		else
+			++it;
+	}
+
+	if (whence != ActiveFormat)
+		return;
+
+	for (auto it = selectionCache_.begin(); it != selectionCache_.end();) {
+		const unsigned int pad = std::get<0>(it->first);
+		if (pad == stream.pad || isSource(pad))
+			it = selectionCache_.erase(it);
+		else
+			++it;
+	}
+}
+
+void V4L2Subdevice::clearCache()
+{
+	formatCache_.clear();
+	selectionCache_.clear();
+}
+
 std::vector<unsigned int> V4L2Subdevice::enumPadCodes(const Stream &stream)
 {
 	std::vector<unsigned int> codes;
@@ -22,6 +22,7 @@
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/metrics.h>
 #include <libcamera/base/shared_fd.h>
 #include <libcamera/base/unique_fd.h>
 #include <libcamera/base/utils.h>
@@ -30,6 +31,7 @@
 #include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/media_request.h"
 
 /**
  * \file v4l2_videodevice.h
@@ -40,6 +42,23 @@ namespace libcamera {
 
 LOG_DECLARE_CATEGORY(V4L2)
 
+namespace {
+
+/* Buffer cache statistics, accumulated over all video devices */
+CounterMetric &bufferCacheMisses()
+{
+	static CounterMetric metric("v4l2_buffer_cache_misses_total");
+	return metric;
+}
+
+CounterMetric &bufferCacheEvictions()
+{
+	static CounterMetric metric("v4l2_buffer_cache_evictions_total");
+	return metric;
+}
+
+} /* namespace */
+
 /**
  * \struct V4L2Capability
  * \brief struct v4l2_capability object wrapper and helpers
@@ -163,6 +182,40 @@ LOG_DECLARE_CATEGORY(V4L2)
  * buffer for a set of dmabufs.
  */
 
+/**
+ * \struct V4L2BufferCache::Counters
+ * \brief Instrumentation counters of a V4L2BufferCache
+ *
+ * The counters record the outcome of the get() calls. A high ratio of misses
+ * to hits indicates that the FrameBuffer instances queued to the device change
+ * over time, forcing dmabufs to be remapped.
+ *
+ * \var V4L2BufferCache::Counters::hits
+ * \brief Number of lookups that found a free V4L2 buffer previously used with
+ * the same dmabufs
+ *
+ * \var V4L2BufferCache::Counters::misses
+ * \brief Number of lookups that didn't find such a V4L2 buffer
+ *
+ * \var V4L2BufferCache::Counters::evictions
+ * \brief Number of misses that replaced the dmabufs associated with a V4L2
+ * buffer
+ */
+
+/**
+ * \brief Add the counters of \a other to the counters
+ * \param[in] other The counters to add
+ * \return A reference to the counters
+ */
+V4L2BufferCache::Counters &V4L2BufferCache::Counters::operator+=(const Counters &other)
+{
+	hits += other.hits;
+	misses += other.misses;
+	evictions += other.evictions;
+
+	return *this;
+}
+
 /**
  * \brief Create an empty cache with \a numEntries entries
  * \param[in] numEntries Number of entries to reserve in the cache
@@ -172,9 +225,9 @@ LOG_DECLARE_CATEGORY(V4L2)
  * buffer import, with buffers added to the cache as they are queued.
  */
 V4L2BufferCache::V4L2BufferCache(unsigned int numEntries)
-	: lastUsedCounter_(1), missCounter_(0)
+	: lastUsedCounter_(1)
 {
-	cache_.resize(numEntries);
+	addEntries(numEntries);
 }
 
 /**
@@ -186,33 +239,78 @@ V4L2BufferCache::V4L2BufferCache(unsigned int numEntries)
  * allocated.
  */
 V4L2BufferCache::V4L2BufferCache(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
-	: lastUsedCounter_(1), missCounter_(0)
+	: lastUsedCounter_(1)
 {
-	for (const std::unique_ptr<FrameBuffer> &buffer : buffers)
-		cache_.emplace_back(true,
-				    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
-				    *buffer.get());
+	addEntries(buffers);
 }
 
 V4L2BufferCache::~V4L2BufferCache()
 {
-	if (missCounter_ > cache_.size())
-		LOG(V4L2, Debug) << "Cache misses: " << missCounter_;
+	if (counters_.misses > cache_.size())
+		LOG(V4L2, Debug)
+			<< "Cache misses: " << counters_.misses
+			<< ", evictions: " << counters_.evictions;
 }
 
 /**
- * \brief Check if all the entries in the cache are unused
+ * \brief Add \a numEntries unused entries to the cache
+ * \param[in] numEntries Number of entries to add
+ *
+ * The new entries are indexed after the existing ones, matching the V4L2
+ * buffers added to a device with VIDIOC_CREATE_BUFS. As they have never been
+ * used, they will be picked before any other free entry by cache misses.
  */
-bool V4L2BufferCache::isEmpty() const
+void V4L2BufferCache::addEntries(unsigned int numEntries)
 {
-	for (auto const &entry : cache_) {
-		if (!entry.free_)
-			return false;
+	const unsigned int first = cache_.size();
+
+	cache_.resize(first + numEntries);
+
+	for (unsigned int index = first; index < cache_.size(); index++)
+		freeEntries_.emplace(0, index);
+}
+
+/**
+ * \brief Add entries pre-populated with \a buffers to the cache
+ * \param[in] buffers Array of buffers to add
+ *
+ * The new entries are indexed after the existing ones, in the order of
+ * \a buffers.
+ */
+void V4L2BufferCache::addEntries(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
+{
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		const unsigned int index = cache_.size();
+		const Entry &entry =
+			cache_.emplace_back(true,
+					    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
+					    *buffer.get());
+
+		index_.emplace(entry.hash_, index);
+		freeEntries_.emplace(entry.lastUsed_, index);
 	}
+}
 
-	return true;
+/**
+ * \fn V4L2BufferCache::size()
+ * \brief Retrieve the number of entries in the cache
+ * \return The number of entries
+ */
+
+/**
+ * \brief Check if all the entries in the cache are unused
+ */
+bool V4L2BufferCache::isEmpty() const
+{
+	return freeEntries_.size() == cache_.size();
 }
 
+/**
+ * \fn V4L2BufferCache::counters()
+ * \brief Retrieve the instrumentation counters of the cache
+ * \return The cache counters
+ */
+
 /**
  * \brief Find the best V4L2 buffer for a FrameBuffer
  * \param[in] buffer The FrameBuffer
@@ -220,48 +318,58 @@ bool V4L2BufferCache::isEmpty() const
  * Find the best V4L2 buffer index to be used for the FrameBuffer \a buffer
  * based on previous mappings of frame buffers to V4L2 buffers. If a free V4L2
  * buffer previously used with the same dmabufs as \a buffer is found in the
- * cache, return its index. Otherwise return the index of the first free V4L2
- * buffer and record its association with the dmabufs of \a buffer.
+ * cache, return its index. Otherwise return the index of the least recently
+ * used free V4L2 buffer and record its association with the dmabufs of
+ * \a buffer.
+ *
+ * Entries are indexed by a hash of their dmabufs, the lookup doesn't depend on
+ * the number of entries in the cache.
  *
  * \return The index of the best V4L2 buffer, or -ENOENT if no free V4L2 buffer
  * is available
  */
 int V4L2BufferCache::get(const FrameBuffer &buffer)
 {
-	bool hit = false;
-	int use = -1;
-	uint64_t oldest = UINT64_MAX;
+	const auto [first, last] = index_.equal_range(Entry::hash(buffer));
 
-	for (unsigned int index = 0; index < cache_.size(); index++) {
+	/* Try to find a cache hit by comparing the planes. */
+	for (auto it = first; it != last; ++it) {
+		const unsigned int index = it->second;
 		const Entry &entry = cache_[index];
 
-		if (!entry.free_)
-			continue;
-
-		/* Try to find a cache hit by comparing the planes. */
-		if (entry == buffer) {
-			hit = true;
-			use = index;
-			break;
-		}
-
-		if (entry.lastUsed_ < oldest) {
-			use = index;
-			oldest = entry.lastUsed_;
+		if (entry.free_ && entry == buffer) {
+			counters_.hits++;
+			use(index, buffer);
+			return index;
 		}
 	}
 
-	if (!hit)
-		missCounter_++;
+	counters_.misses++;
+	bufferCacheMisses().increment();
 
-	if (use < 0)
+	if (freeEntries_.empty())
 		return -ENOENT;
 
-	cache_[use] = Entry(false,
-			    lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
-			    buffer);
+	const unsigned int index = freeEntries_.begin()->second;
+	Entry &entry = cache_[index];
+
+	if (!entry.isEmpty()) {
+		counters_.evictions++;
+		bufferCacheEvictions().increment();
 
-	return use;
+		auto [begin, end] = index_.equal_range(entry.hash_);
+		for (auto it = begin; it != end; ++it) {
+			if (it->second == index) {
+				index_.erase(it);
+				break;
+			}
+		}
+	}
+
+	use(index, buffer);
+	index_.emplace(entry.hash_, index);
+
+	return index;
 }
 
 /**
@@ -271,16 +379,36 @@ int V4L2BufferCache::get(const FrameBuffer &buffer)
 void V4L2BufferCache::put(unsigned int index)
 {
 	ASSERT(index < cache_.size());
-	cache_[index].free_ = true;
+
+	Entry &entry = cache_[index];
+	if (entry.free_)
+		return;
+
+	entry.free_ = true;
+	freeEntries_.emplace(entry.lastUsed_, index);
+}
+
+/*
+ * Mark the free entry \a index as used by \a buffer. The caller is responsible
+ * for updating index_ when the dmabufs of the entry change.
+ */
+void V4L2BufferCache::use(unsigned int index, const FrameBuffer &buffer)
+{
+	Entry &entry = cache_[index];
+
+	freeEntries_.erase({ entry.lastUsed_, index });
+	entry = Entry(false,
+		      lastUsedCounter_.fetch_add(1, std::memory_order_acq_rel),
+		      buffer);
 }
 
 V4L2BufferCache::Entry::Entry()
-	: free_(true), lastUsed_(0)
+	: free_(true), lastUsed_(0), hash_(0)
 {
 }
 
 V4L2BufferCache::Entry::Entry(bool free, uint64_t lastUsed, const FrameBuffer &buffer)
-	: free_(free), lastUsed_(lastUsed)
+	: free_(free), lastUsed_(lastUsed), hash_(hash(buffer))
 {
 	for (const FrameBuffer::Plane &plane : buffer.planes())
 		planes_.emplace_back(plane);
@@ -300,6 +428,21 @@ bool V4L2BufferCache::Entry::operator==(const FrameBuffer &buffer) const
 	return true;
 }
 
+/* Hash the plane fds and lengths compared by operator==() */
+size_t V4L2BufferCache::Entry::hash(const FrameBuffer &buffer)
+{
+	size_t hash = 0;
+
+	for (const FrameBuffer::Plane &plane : buffer.planes()) {
+		const uint64_t key = (static_cast<uint64_t>(plane.fd.get()) << 32) |
+				     plane.length;
+		hash ^= std::hash<uint64_t>{}(key) + 0x9e3779b9 +
+			(hash << 6) + (hash >> 2);
+	}
+
+	return hash;
+}
+
 /**
  * \class V4L2DeviceFormat
  * \brief The V4L2 video device image format and sizes
@@ -507,6 +650,11 @@ std::ostream &operator<<(std::ostream &out, const V4L2DeviceFormat &f)
  *   of the two video device that participate in buffer sharing inside
  *   pipelines, the other video device typically using allocateBuffers().
  *
+ * - The addBuffers() function grows the driver's internal buffer management
+ *   initialized by allocateBuffers() or importBuffers(), allocating more
+ *   buffers in MMAP mode. It can be called while streaming, to let pools grow
+ *   when consumers hold on to buffers for longer than expected.
+ *
  * - The releaseBuffers() function resets the driver's internal buffer
  *   management that was initialized by a previous call to allocateBuffers() or
  *   importBuffers(). Any memory allocated by allocateBuffers() is freed.
@@ -527,13 +675,86 @@ std::ostream &operator<<(std::ostream &out, const V4L2DeviceFormat &f)
  * \brief A map of supported V4L2 pixel formats to frame sizes
  */
 
+/**
+ * \struct V4L2VideoDevice::Stats
+ * \brief Streaming statistics of a V4L2VideoDevice
+ *
+ * The statistics record the activity of the device buffer queue. They help
+ * sizing the number of buffers allocated for a stream, and diagnosing frame
+ * drops: a queue depth that frequently reaches zero indicates buffer
+ * starvation, while sequence gaps with buffers queued point to the driver or
+ * hardware.
+ *
+ * The statistics are accumulated until reset with resetStats(), and logged
+ * periodically at the Debug level while the device is streaming.
+ *
+ * \var V4L2VideoDevice::Stats::kLatencyBins
+ * \brief Number of bins of the latency histogram
+ *
+ * \var V4L2VideoDevice::Stats::queued
+ * \brief Number of buffers queued to the device
+ *
+ * \var V4L2VideoDevice::Stats::dequeued
+ * \brief Number of buffers dequeued from the device
+ *
+ * \var V4L2VideoDevice::Stats::errors
+ * \brief Number of buffers dequeued with the V4L2_BUF_FLAG_ERROR flag
+ *
+ * \var V4L2VideoDevice::Stats::sequenceGaps
+ * \brief Number of frames missing from the sequence numbers of the dequeued
+ * buffers, for capture devices only
+ *
+ * \var V4L2VideoDevice::Stats::queueDepth
+ * \brief Number of buffers currently queued to the device
+ *
+ * \var V4L2VideoDevice::Stats::maxQueueDepth
+ * \brief Maximum number of buffers queued to the device at the same time
+ *
+ * \var V4L2VideoDevice::Stats::totalLatency
+ * \brief Sum of the times between queuing and dequeuing all dequeued buffers
+ *
+ * \var V4L2VideoDevice::Stats::maxLatency
+ * \brief Maximum time between queuing and dequeuing a buffer
+ *
+ * \var V4L2VideoDevice::Stats::latencyHistogram
+ * \brief Histogram of the times between queuing and dequeuing buffers
+ *
+ * The first bin counts the latencies lower than 1ms. Each bin \a i after the
+ * first counts the latencies in the [2^(i-1), 2^i) ms range, and the last bin
+ * additionally counts all longer latencies.
+ */
+
+/**
+ * \brief Assemble and return a string describing the statistics
+ * \return A string describing the statistics
+ */
+std::string V4L2VideoDevice::Stats::toString() const
+{
+	std::stringstream ss;
+
+	ss << "queued " << queued << ", dequeued " << dequeued
+	   << ", errors " << errors << ", sequence gaps " << sequenceGaps
+	   << ", depth " << queueDepth << "/" << maxQueueDepth;
+
+	if (dequeued)
+		ss << ", latency avg " << totalLatency.get<std::milli>() / dequeued
+		   << "ms max " << maxLatency.get<std::milli>() << "ms";
+
+	ss << ", histogram [";
+	for (unsigned int i = 0; i < kLatencyBins; i++)
+		ss << (i ? " " : "") << latencyHistogram[i];
+	ss << "]";
+
+	return ss.str();
+}
+
 /**
  * \brief Construct a V4L2VideoDevice
  * \param[in] deviceNode The file-system path to the video device node
  */
 V4L2VideoDevice::V4L2VideoDevice(const std::string &deviceNode)
-	: V4L2Device(deviceNode), formatInfo_(nullptr), cache_(nullptr),
-	  fdBufferNotifier_(nullptr), state_(State::Stopped),
+	: V4L2Device(deviceNode), formatInfo_(nullptr), bufferCaps_(0),
+	  cache_(nullptr), fdBufferNotifier_(nullptr), state_(State::Stopped),
 	  watchdogDuration_(0.0)
 {
 	/*
@@ -1308,6 +1529,8 @@ int V4L2VideoDevice::requestBuffers(unsigned int count,
 		return -ENOMEM;
 	}
 
+	bufferCaps_ = rb.capabilities;
+
 	LOG(V4L2, Debug) << rb.count << " buffers requested.";
 
 	return 0;
@@ -1333,9 +1556,10 @@ int V4L2VideoDevice::requestBuffers(unsigned int count,
  * V4L2_PIX_FMT_NV12M.
  *
  * Buffers allocated with this function shall later be free with
- * releaseBuffers(). If buffers have already been allocated with
- * allocateBuffers() or imported with importBuffers(), this function returns
- * -EBUSY.
+ * releaseBuffers(). Until then, they are recorded in the memory accounting
+ * (see MemoryAccount) in a category named after the device node. If buffers
+ * have already been allocated with allocateBuffers() or imported with
+ * importBuffers(), this function returns -EBUSY.
  *
  * \return The number of allocated buffers on success or a negative error code
  * otherwise
@@ -1351,6 +1575,16 @@ int V4L2VideoDevice::allocateBuffers(unsigned int count,
 	cache_ = new V4L2BufferCache(*buffers);
 	memoryType_ = V4L2_MEMORY_MMAP;
 
+	const std::string category = "V4L2 " + deviceNode();
+	for (const std::unique_ptr<FrameBuffer> &buffer : *buffers) {
+		std::size_t size = 0;
+		for (const FrameBuffer::Plane &plane : buffer->planes())
+			size += plane.length;
+
+		bufferAccounts_.emplace_back(category, MemoryAccount::Heap::Driver,
+					     size);
+	}
+
 	return ret;
 }
 
@@ -1580,6 +1814,107 @@ int V4L2VideoDevice::importBuffers(unsigned int count)
 	return 0;
 }
 
+/**
+ * \brief Add buffers to the video device while it may be streaming
+ * \param[in] count Number of buffers to add
+ * \param[out] buffers Vector to store the allocated buffers
+ *
+ * This function grows the driver's buffer management initialized by a previous
+ * call to allocateBuffers() or importBuffers() with VIDIOC_CREATE_BUFS, without
+ * affecting the existing buffers. It can be called at any time, including
+ * while the device is streaming, to let the device cope with consumers that
+ * hold on to buffers longer than expected.
+ *
+ * When the device has been initialized with importBuffers(), this function
+ * prepares the device to import \a count more buffers, and \a buffers is
+ * ignored. When the device has been initialized with allocateBuffers(), it
+ * allocates \a count more buffers with the current format, and appends them
+ * to \a buffers.
+ *
+ * The driver may allocate less buffers than requested, in which case the
+ * function succeeds and returns the number of buffers actually added.
+ *
+ * \return The number of buffers added on success or a negative error code
+ * otherwise
+ * \retval -EINVAL buffers have not been allocated or imported yet
+ * \retval -ENOTTY the driver doesn't support VIDIOC_CREATE_BUFS
+ */
+int V4L2VideoDevice::addBuffers(unsigned int count,
+				std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (!cache_) {
+		LOG(V4L2, Error) << "No buffers allocated or imported";
+		return -EINVAL;
+	}
+
+	if (memoryType_ == V4L2_MEMORY_MMAP && !buffers) {
+		LOG(V4L2, Error) << "No vector to store the allocated buffers";
+		return -EINVAL;
+	}
+
+	struct v4l2_create_buffers create = {};
+	create.count = count;
+	create.memory = memoryType_;
+	create.format.type = bufferType_;
+
+	/* Size the buffers for the active format. */
+	int ret = ioctl(VIDIOC_G_FMT, &create.format);
+	if (ret < 0) {
+		LOG(V4L2, Error) << "Unable to get format: " << strerror(-ret);
+		return ret;
+	}
+
+	ret = ioctl(VIDIOC_CREATE_BUFS, &create);
+	if (ret < 0) {
+		LOG(V4L2, Error)
+			<< "Unable to create " << count << " buffers: "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	if (create.index != cache_->size()) {
+		LOG(V4L2, Error)
+			<< "Unexpected index " << create.index
+			<< " for new buffers, expected " << cache_->size();
+		return -EINVAL;
+	}
+
+	if (memoryType_ == V4L2_MEMORY_DMABUF) {
+		cache_->addEntries(create.count);
+	} else {
+		std::vector<std::unique_ptr<FrameBuffer>> newBuffers;
+
+		for (unsigned int i = 0; i < create.count; i++) {
+			std::unique_ptr<FrameBuffer> buffer =
+				createBuffer(create.index + i);
+			if (!buffer) {
+				LOG(V4L2, Error) << "Unable to create buffer";
+				break;
+			}
+
+			newBuffers.push_back(std::move(buffer));
+		}
+
+		/*
+		 * V4L2 has no way to release individual buffers. Keep entries
+		 * for the buffers that couldn't be exported, unused, to keep
+		 * the cache indexes in sync with the device.
+		 */
+		cache_->addEntries(newBuffers);
+		cache_->addEntries(create.count - newBuffers.size());
+		create.count = newBuffers.size();
+
+		for (std::unique_ptr<FrameBuffer> &buffer : newBuffers)
+			buffers->push_back(std::move(buffer));
+	}
+
+	LOG(V4L2, Debug)
+		<< "Added " << create.count << " buffers, " << cache_->size()
+		<< " in total";
+
+	return create.count;
+}
+
 /**
  * \brief Release resources allocated by allocateBuffers() or importBuffers()
  *
@@ -1595,8 +1930,10 @@ int V4L2VideoDevice::releaseBuffers()
 
 	LOG(V4L2, Debug) << "Releasing buffers";
 
+	releasedCacheCounters_ += cache_->counters();
 	delete cache_;
 	cache_ = nullptr;
+	bufferAccounts_.clear();
 
 	return requestBuffers(0, memoryType_);
 }
@@ -1604,6 +1941,7 @@ int V4L2VideoDevice::releaseBuffers()
 /**
  * \brief Queue a buffer to the video device if possible
  * \param[in] buffer The buffer to be queued
+ * \param[in] request The media request to queue the buffer in, if any
  *
  * For capture video devices the \a buffer will be filled with data by the
  * device. For output video devices the \a buffer shall contain valid data and
@@ -1613,22 +1951,34 @@ int V4L2VideoDevice::releaseBuffers()
  * The best available V4L2 buffer is picked for \a buffer using the V4L2 buffer
  * cache.
  *
+ * When a \a request is given, the buffer is only processed once the request
+ * is queued, together with the other objects of the request. This requires
+ * the device to support requests, as reported by supportsRequests().
+ *
  * Note that queueBuffer() will fail if the device is in the process of being
  * stopped from a streaming state through streamOff().
  *
  * V4L2 only allows upto VIDEO_MAX_FRAME frames to be queued at a time, so if
  * we reach this limit, store the framebuffers in a pending queue, and try to
- * enqueue once a buffer has been dequeued.
+ * enqueue once a buffer has been dequeued. Buffers queued in a request can't
+ * be deferred, and fail to queue with -ENOBUFS instead.
  *
  * \return 0 on success or a negative error code otherwise
  */
-int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
+int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer, const MediaRequest *request)
 {
 	if (state_ == State::Stopping) {
 		LOG(V4L2, Error) << "Device is in a stopping state.";
 		return -ESHUTDOWN;
 	}
 
+	if (request) {
+		if (queuedBuffers_.size() == VIDEO_MAX_FRAME)
+			return -ENOBUFS;
+
+		return queueToDevice(buffer, request);
+	}
+
 	if (queuedBuffers_.size() == VIDEO_MAX_FRAME) {
 		LOG(V4L2, Debug) << "V4L2 queue has " << VIDEO_MAX_FRAME
 				 << " already queued, differing queueing.";
@@ -1653,20 +2003,45 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 /**
  * \brief Slot to handle completed buffer events from the V4L2 video device
  *
- * When this slot is called, a Buffer has become available from the device, and
- * will be emitted through the bufferReady Signal.
+ * When this slot is called, one or more buffers have become available from the
+ * device. All of them are dequeued, and then emitted through the bufferReady
+ * Signal in the order they have completed. Draining the device on every
+ * notification avoids waking up the event loop once per buffer when several
+ * buffers complete in a short time.
  *
  * For Capture video devices the FrameBuffer will contain valid data.
  * For Output video devices the FrameBuffer can be considered empty.
  */
 void V4L2VideoDevice::bufferAvailable()
 {
-	FrameBuffer *buffer = dequeueBuffer();
-	if (!buffer)
-		return;
+	while (!queuedBuffers_.empty()) {
+		FrameBuffer *buffer = dequeueBuffer();
+		if (!buffer)
+			break;
+
+		readyBuffers_.push(buffer);
+	}
 
 	/* Notify anyone listening to the device. */
-	bufferReady.emit(buffer);
+	flushReadyBuffers();
+}
+
+/**
+ * \brief Emit the bufferReady signal for all dequeued buffers
+ *
+ * The bufferReady signal handlers may stop the stream while a batch of
+ * dequeued buffers is being emitted. This function is then called by
+ * streamOff() to complete the batch before cancelling the buffers still queued
+ * to the device, preserving the buffers completion order.
+ */
+void V4L2VideoDevice::flushReadyBuffers()
+{
+	while (!readyBuffers_.empty()) {
+		FrameBuffer *buffer = readyBuffers_.front();
+		readyBuffers_.pop();
+
+		bufferReady.emit(buffer);
+	}
 }
 
 /**
@@ -1700,6 +2075,10 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 
 	ret = ioctl(VIDIOC_DQBUF, &buf);
 	if (ret < 0) {
+		/* No more buffer ready, the device has been drained. */
+		if (ret == -EAGAIN)
+			return nullptr;
+
 		LOG(V4L2, Error)
 			<< "Failed to dequeue buffer: " << strerror(-ret);
 		return nullptr;
@@ -1732,6 +2111,8 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 	FrameBuffer *buffer = it->second;
 	queuedBuffers_.erase(it);
 
+	updateStats(buf.index, buf);
+
 	if (!pendingBuffersToQueue_.empty()) {
 		FrameBuffer *pending = pendingBuffersToQueue_.front();
 
@@ -1847,6 +2228,7 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 /**
  * \brief Queue a buffer to the video device if possible
  * \param[in] buffer The buffer to be queued
+ * \param[in] request The media request to queue the buffer in, if any
  *
  * For capture video devices the \a buffer will be filled with data by the
  * device. For output video devices the \a buffer shall contain valid data and
@@ -1861,7 +2243,7 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
  *
  * \return 0 on success or a negative error code otherwise
  */
-int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
+int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer, const MediaRequest *request)
 {
 	struct v4l2_plane v4l2Planes[VIDEO_MAX_PLANES] = {};
 	struct v4l2_buffer buf = {};
@@ -1886,6 +2268,11 @@ int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
 	buf.memory = memoryType_;
 	buf.field = V4L2_FIELD_NONE;
 
+	if (request) {
+		buf.flags |= V4L2_BUF_FLAG_REQUEST_FD;
+		buf.request_fd = request->fd();
+	}
+
 	bool multiPlanar = V4L2_TYPE_IS_MULTIPLANAR(buf.type);
 	const std::vector<FrameBuffer::Plane> &planes = buffer->planes();
 	const unsigned int numV4l2Planes = format_.planesCount;
@@ -2003,6 +2390,14 @@ int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
 
 	queuedBuffers_[buf.index] = buffer;
 
+	if (buf.index >= queueTimes_.size())
+		queueTimes_.resize(buf.index + 1);
+	queueTimes_[buf.index] = utils::clock::now();
+
+	stats_.queued++;
+	stats_.maxQueueDepth = std::max<unsigned int>(stats_.maxQueueDepth,
+						      queuedBuffers_.size());
+
 	return 0;
 }
 
@@ -2011,6 +2406,88 @@ int V4L2VideoDevice::queueToDevice(FrameBuffer *buffer)
  * \brief A Signal emitted when a framebuffer completes
  */
 
+/**
+ * \brief Retrieve the instrumentation counters of the V4L2 buffer cache
+ *
+ * The counters are accumulated over the lifetime of the device, across the
+ * buffer caches created by allocateBuffers() and importBuffers() and
+ * destroyed by releaseBuffers(). A steadily increasing miss count with buffers
+ * imported through importBuffers() indicates that the dmabufs queued to the
+ * device are remapped, usually because the FrameBuffer pool is larger than the
+ * number of V4L2 buffers.
+ *
+ * This function shall be called from the thread the device belongs to.
+ *
+ * \return The buffer cache counters
+ */
+V4L2BufferCache::Counters V4L2VideoDevice::bufferCacheCounters() const
+{
+	V4L2BufferCache::Counters counters = releasedCacheCounters_;
+
+	if (cache_)
+		counters += cache_->counters();
+
+	return counters;
+}
+
+/**
+ * \brief Retrieve the streaming statistics of the device
+ *
+ * This function shall be called from the thread the device belongs to.
+ *
+ * \return The streaming statistics
+ */
+V4L2VideoDevice::Stats V4L2VideoDevice::stats() const
+{
+	Stats stats = stats_;
+	stats.queueDepth = queuedBuffers_.size();
+
+	return stats;
+}
+
+/**
+ * \brief Reset the streaming statistics of the device
+ *
+ * This function shall be called from the thread the device belongs to.
+ */
+void V4L2VideoDevice::resetStats()
+{
+	stats_ = {};
+	stats_.maxQueueDepth = queuedBuffers_.size();
+}
+
+void V4L2VideoDevice::updateStats(unsigned int index, const struct v4l2_buffer &buf)
+{
+	static constexpr std::chrono::seconds kStatsLogInterval{ 10 };
+
+	utils::time_point now = utils::clock::now();
+	utils::Duration latency = now - queueTimes_[index];
+
+	stats_.dequeued++;
+	stats_.totalLatency += latency;
+	stats_.maxLatency = std::max(stats_.maxLatency, latency);
+
+	unsigned int bin = 0;
+	for (uint64_t ms = latency.get<std::milli>();
+	     ms && bin < Stats::kLatencyBins - 1; ms >>= 1)
+		bin++;
+	stats_.latencyHistogram[bin]++;
+
+	if (buf.flags & V4L2_BUF_FLAG_ERROR)
+		stats_.errors++;
+
+	if (!V4L2_TYPE_IS_OUTPUT(buf.type)) {
+		if (lastSequence_ && buf.sequence > *lastSequence_ + 1)
+			stats_.sequenceGaps += buf.sequence - *lastSequence_ - 1;
+		lastSequence_ = buf.sequence;
+	}
+
+	if (now - lastStatsLog_ >= kStatsLogInterval) {
+		LOG(V4L2, Debug) << "Stats: " << stats().toString();
+		lastStatsLog_ = now;
+	}
+}
+
 /**
  * \brief Start the video stream
  * \return 0 on success or a negative error code otherwise
@@ -2020,6 +2497,8 @@ int V4L2VideoDevice::streamOn()
 	int ret;
 
 	firstFrame_.reset();
+	lastSequence_.reset();
+	lastStatsLog_ = utils::clock::now();
 
 	ret = ioctl(VIDIOC_STREAMON, &bufferType_);
 	if (ret < 0) {
@@ -2067,6 +2546,9 @@ int V4L2VideoDevice::streamOff()
 
 	state_ = State::Stopping;
 
+	/* Complete the batch of dequeued buffers being emitted, if any. */
+	flushReadyBuffers();
+
 	/* Send back all queued buffers. */
 	for (auto it : queuedBuffers_) {
 		FrameBuffer *buffer = it.second;
@@ -2083,6 +2565,8 @@ int V4L2VideoDevice::streamOff()
 	fdBufferNotifier_->setEnabled(false);
 	state_ = State::Stopped;
 
+	LOG(V4L2, Debug) << "Stats: " << stats().toString();
+
 	return 0;
 }
 
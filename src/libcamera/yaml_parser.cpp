@@ -7,13 +7,21 @@
 
 #include "libcamera/internal/yaml_parser.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <errno.h>
 #include <functional>
+#include <iomanip>
 #include <limits>
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/log.h>
+#include <libcamera/base/span.h>
+#include <libcamera/base/utils.h>
 
 #include <yaml.h>
 
@@ -40,8 +48,48 @@ static const YamlObject empty;
  * The YamlObject class represents the tree structure of YAML content. A
  * YamlObject can be empty, a dictionary or list of YamlObjects, or a value if a
  * tree leaf.
+ *
+ * All the YamlObject instances of a tree are allocated in chunks from an arena
+ * owned by the root object, and are destroyed with it. Dictionaries are
+ * indexed by a hash table of their keys, which makes member lookups constant
+ * time.
  */
 
+#ifndef __DOXYGEN__
+
+class YamlObject::Arena
+{
+public:
+	YamlObject *create();
+
+private:
+	static constexpr unsigned int kMinChunkSize = 16;
+	static constexpr unsigned int kMaxChunkSize = 1024;
+
+	std::vector<std::unique_ptr<YamlObject[]>> chunks_;
+	unsigned int chunkSize_ = 0;
+	unsigned int used_ = 0;
+};
+
+YamlObject *YamlObject::Arena::create()
+{
+	/*
+	 * Grow the chunk size geometrically, to limit the number of unused
+	 * objects for small trees while keeping allocations rare for large
+	 * ones.
+	 */
+	if (used_ == chunkSize_) {
+		chunkSize_ = chunkSize_ ? std::min(chunkSize_ * 2, kMaxChunkSize)
+					: kMinChunkSize;
+		chunks_.push_back(std::make_unique<YamlObject[]>(chunkSize_));
+		used_ = 0;
+	}
+
+	return &chunks_.back()[used_++];
+}
+
+#endif /* __DOXYGEN__ */
+
 YamlObject::YamlObject()
 	: type_(Type::Empty)
 {
@@ -49,6 +97,92 @@ YamlObject::YamlObject()
 
 YamlObject::~YamlObject() = default;
 
+/**
+ * \brief Retrieve the arena of a YamlObject tree
+ * \param[in] root The root object of the tree
+ *
+ * The arena is created the first time this function is called for \a root.
+ * All children of the tree shall be allocated from the arena of its root.
+ *
+ * \return The arena that allocates children of the \a root tree
+ */
+YamlObject::Arena *YamlObject::arena(YamlObject &root)
+{
+	if (!root.arena_)
+		root.arena_ = std::make_unique<Arena>();
+
+	return root.arena_.get();
+}
+
+/**
+ * \brief Build the hash index of the dictionary keys
+ *
+ * The index is an open addressing hash table, with linear probing, that stores
+ * the position of each element in list_ incremented by one, with 0 marking
+ * empty slots. When a key is present multiple times, the first element takes
+ * precedence.
+ *
+ * This function shall be called once all elements of the dictionary have been
+ * added.
+ */
+void YamlObject::buildIndex()
+{
+	if (list_.empty()) {
+		index_.clear();
+		return;
+	}
+
+	/* Keep the load factor below 0.5 to shorten probe sequences. */
+	std::size_t slots = 1;
+	while (slots < list_.size() * 2)
+		slots <<= 1;
+
+	const std::size_t mask = slots - 1;
+	index_.assign(slots, 0);
+
+	for (std::size_t i = 0; i < list_.size(); ++i) {
+		const std::string &key = list_[i].key;
+		std::size_t pos = std::hash<std::string_view>{}(key) & mask;
+		bool duplicate = false;
+
+		while (index_[pos]) {
+			if (list_[index_[pos] - 1].key == key) {
+				duplicate = true;
+				break;
+			}
+
+			pos = (pos + 1) & mask;
+		}
+
+		if (!duplicate)
+			index_[pos] = i + 1;
+	}
+}
+
+/**
+ * \brief Find a dictionary element by key
+ * \param[in] key The element key
+ * \return The element, or nullptr if no element matches \a key
+ */
+const YamlObject *YamlObject::find(std::string_view key) const
+{
+	if (index_.empty())
+		return nullptr;
+
+	const std::size_t mask = index_.size() - 1;
+	std::size_t pos = std::hash<std::string_view>{}(key) & mask;
+
+	while (index_[pos]) {
+		const Value &elem = list_[index_[pos] - 1];
+		if (elem.key == key)
+			return elem.value;
+
+		pos = (pos + 1) & mask;
+	}
+
+	return nullptr;
+}
+
 /**
  * \fn YamlObject::isValue()
  * \brief Return whether the YamlObject is a value
@@ -483,7 +617,7 @@ const YamlObject &YamlObject::operator[](std::size_t index) const
  */
 bool YamlObject::contains(std::string_view key) const
 {
-	return dictionary_.find(key) != dictionary_.end();
+	return find(key) != nullptr;
 }
 
 /**
@@ -502,11 +636,11 @@ const YamlObject &YamlObject::operator[](std::string_view key) const
 	if (type_ != Type::Dictionary)
 		return empty;
 
-	auto iter = dictionary_.find(key);
-	if (iter == dictionary_.end())
+	const YamlObject *obj = find(key);
+	if (!obj)
 		return empty;
 
-	return *iter->second;
+	return *obj;
 }
 
 #ifndef __DOXYGEN__
@@ -542,6 +676,7 @@ private:
 
 	bool parserValid_;
 	yaml_parser_t parser_;
+	YamlObject::Arena *arena_;
 };
 
 /**
@@ -552,7 +687,7 @@ private:
  * helper functions to do event-based parsing for YAML files.
  */
 YamlParserContext::YamlParserContext()
-	: parserValid_(false)
+	: parserValid_(false), arena_(nullptr)
 {
 }
 
@@ -640,6 +775,8 @@ YamlParserContext::EventPtr YamlParserContext::nextEvent()
  */
 int YamlParserContext::parseContent(YamlObject &yamlObject)
 {
+	arena_ = YamlObject::arena(yamlObject);
+
 	/* Check start of the YAML file. */
 	EventPtr event = nextEvent();
 	if (!event || event->type != YAML_STREAM_START_EVENT)
@@ -755,7 +892,7 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
 		yamlObject.type_ = YamlObject::Type::List;
 		auto &list = yamlObject.list_;
 		auto handler = [this, &list](EventPtr evt) {
-			list.emplace_back(std::string{}, std::make_unique<YamlObject>());
+			list.emplace_back(std::string{}, arena_->create());
 			return parseNextYamlObject(*list.back().value, std::move(evt));
 		};
 		return parseDictionaryOrList(YamlObject::Type::List, handler);
@@ -783,16 +920,14 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
 				return -EINVAL;
 
 			auto &elem = list.emplace_back(std::move(key),
-						       std::make_unique<YamlObject>());
+						       arena_->create());
 			return parseNextYamlObject(*elem.value, std::move(evtValue));
 		};
 		int ret = parseDictionaryOrList(YamlObject::Type::Dictionary, handler);
 		if (ret)
 			return ret;
 
-		auto &dictionary = yamlObject.dictionary_;
-		for (const auto &elem : list)
-			dictionary.emplace(elem.key, elem.value.get());
+		yamlObject.buildIndex();
 
 		return 0;
 	}
@@ -803,6 +938,284 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
 	}
 }
 
+/*
+ * Binary cache of parsed YAML files
+ *
+ * Each cache file stores a header identifying the source file, followed by the
+ * YamlObject tree in pre-order. Every node starts with its type on one byte.
+ * Values are stored as a 32-bit length followed by the string bytes, lists as a
+ * 32-bit count followed by the elements, and dictionaries as a 32-bit count
+ * followed by key strings and elements. All integers use the native byte
+ * order, the cache is not meant to be shared between machines.
+ */
+class YamlCache
+{
+public:
+	YamlCache(const File &file);
+
+	bool valid() const { return !cachePath_.empty(); }
+
+	std::unique_ptr<YamlObject> load();
+	void store(const YamlObject &root);
+
+private:
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t size;
+		int64_t mtimeSec;
+		int64_t mtimeNsec;
+		uint32_t pathLength;
+		uint32_t reserved;
+	};
+
+	class Reader
+	{
+	public:
+		Reader(Span<const uint8_t> data)
+			: data_(data), pos_(0)
+		{
+		}
+
+		bool read(void *dst, size_t size);
+		bool readString(std::string &str);
+		bool readU32(uint32_t &value) { return read(&value, sizeof(value)); }
+
+		bool atEnd() const { return pos_ == data_.size(); }
+
+	private:
+		Span<const uint8_t> data_;
+		size_t pos_;
+	};
+
+	static constexpr uint32_t kVersion = 1;
+	static constexpr unsigned int kMaxDepth = 256;
+
+	static void writeString(std::vector<uint8_t> &data, const std::string &str);
+	static void encode(std::vector<uint8_t> &data, const YamlObject &obj);
+	static int decode(Reader &reader, YamlObject::Arena *arena,
+			  YamlObject &obj, unsigned int depth);
+
+	std::string sourcePath_;
+	std::string cachePath_;
+	Header header_;
+};
+
+YamlCache::YamlCache(const File &file)
+{
+	const char *dir = utils::secure_getenv("LIBCAMERA_YAML_CACHE_DIR");
+	if (!dir || !*dir || file.fileName().empty())
+		return;
+
+	char *path = realpath(file.fileName().c_str(), nullptr);
+	if (!path)
+		return;
+
+	sourcePath_ = path;
+	free(path);
+
+	struct stat st;
+	if (stat(sourcePath_.c_str(), &st) || !S_ISREG(st.st_mode))
+		return;
+
+	header_ = {};
+	memcpy(header_.magic, "LCYC", sizeof(header_.magic));
+	header_.version = kVersion;
+	header_.size = st.st_size;
+	header_.mtimeSec = st.st_mtim.tv_sec;
+	header_.mtimeNsec = st.st_mtim.tv_nsec;
+	header_.pathLength = sourcePath_.size();
+
+	/* Name the cache file after the FNV-1a hash of the source path. */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : sourcePath_) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ULL;
+	}
+
+	std::stringstream ss;
+	ss << dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+	   << hash << ".yamlc";
+	cachePath_ = ss.str();
+}
+
+bool YamlCache::Reader::read(void *dst, size_t size)
+{
+	if (size > data_.size() - pos_)
+		return false;
+
+	memcpy(dst, data_.data() + pos_, size);
+	pos_ += size;
+	return true;
+}
+
+bool YamlCache::Reader::readString(std::string &str)
+{
+	uint32_t length;
+	if (!readU32(length) || length > data_.size() - pos_)
+		return false;
+
+	str.assign(reinterpret_cast<const char *>(data_.data() + pos_), length);
+	pos_ += length;
+	return true;
+}
+
+std::unique_ptr<YamlObject> YamlCache::load()
+{
+	File file(cachePath_);
+	if (!file.open(File::OpenModeFlag::ReadOnly))
+		return nullptr;
+
+	Span<const uint8_t> data = file.map();
+	if (data.empty())
+		return nullptr;
+
+	Reader reader(data);
+
+	Header header;
+	if (!reader.read(&header, sizeof(header)) ||
+	    memcmp(&header, &header_, sizeof(header)))
+		return nullptr;
+
+	std::string path;
+	path.resize(header.pathLength);
+	if (!reader.read(path.data(), path.size()) || path != sourcePath_)
+		return nullptr;
+
+	std::unique_ptr<YamlObject> root(new YamlObject());
+	if (decode(reader, YamlObject::arena(*root), *root, 0) || !reader.atEnd()) {
+		LOG(YamlParser, Warning)
+			<< "Ignoring corrupted YAML cache " << cachePath_;
+		return nullptr;
+	}
+
+	LOG(YamlParser, Debug)
+		<< "Loaded " << sourcePath_ << " from cache " << cachePath_;
+
+	return root;
+}
+
+void YamlCache::store(const YamlObject &root)
+{
+	std::vector<uint8_t> data;
+	const uint8_t *header = reinterpret_cast<const uint8_t *>(&header_);
+	data.insert(data.end(), header, header + sizeof(header_));
+	data.insert(data.end(), sourcePath_.begin(), sourcePath_.end());
+	encode(data, root);
+
+	/*
+	 * Write the cache to a temporary file and rename it, to ensure that
+	 * concurrent readers never see a partially written cache. Failures are
+	 * not fatal, the YAML file will simply be parsed again next time.
+	 */
+	std::string tmpPath = cachePath_ + "." + std::to_string(getpid()) + ".tmp";
+	unlink(tmpPath.c_str());
+
+	File file(tmpPath);
+	if (!file.open(File::OpenModeFlag::WriteOnly)) {
+		LOG(YamlParser, Debug)
+			<< "Failed to create YAML cache " << tmpPath << ": "
+			<< strerror(-file.error());
+		return;
+	}
+
+	ssize_t ret = file.write(data);
+	file.close();
+
+	if (ret != static_cast<ssize_t>(data.size()) ||
+	    rename(tmpPath.c_str(), cachePath_.c_str())) {
+		LOG(YamlParser, Debug)
+			<< "Failed to write YAML cache " << cachePath_;
+		unlink(tmpPath.c_str());
+	}
+}
+
+void YamlCache::writeString(std::vector<uint8_t> &data, const std::string &str)
+{
+	uint32_t length = str.size();
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&length);
+	data.insert(data.end(), bytes, bytes + sizeof(length));
+	data.insert(data.end(), str.begin(), str.end());
+}
+
+void YamlCache::encode(std::vector<uint8_t> &data, const YamlObject &obj)
+{
+	data.push_back(static_cast<uint8_t>(obj.type_));
+
+	switch (obj.type_) {
+	case YamlObject::Type::Value:
+		writeString(data, obj.value_);
+		break;
+
+	case YamlObject::Type::List:
+	case YamlObject::Type::Dictionary: {
+		uint32_t count = obj.list_.size();
+		const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&count);
+		data.insert(data.end(), bytes, bytes + sizeof(count));
+
+		for (const auto &elem : obj.list_) {
+			if (obj.type_ == YamlObject::Type::Dictionary)
+				writeString(data, elem.key);
+			encode(data, *elem.value);
+		}
+		break;
+	}
+
+	case YamlObject::Type::Empty:
+		break;
+	}
+}
+
+int YamlCache::decode(Reader &reader, YamlObject::Arena *arena,
+		      YamlObject &obj, unsigned int depth)
+{
+	if (depth > kMaxDepth)
+		return -EINVAL;
+
+	uint8_t type;
+	if (!reader.read(&type, sizeof(type)))
+		return -EINVAL;
+
+	obj.type_ = static_cast<YamlObject::Type>(type);
+
+	switch (obj.type_) {
+	case YamlObject::Type::Value:
+		return reader.readString(obj.value_) ? 0 : -EINVAL;
+
+	case YamlObject::Type::List:
+	case YamlObject::Type::Dictionary: {
+		bool isDictionary = obj.type_ == YamlObject::Type::Dictionary;
+
+		uint32_t count;
+		if (!reader.readU32(count))
+			return -EINVAL;
+
+		for (uint32_t i = 0; i < count; ++i) {
+			std::string key;
+			if (isDictionary && !reader.readString(key))
+				return -EINVAL;
+
+			auto &elem = obj.list_.emplace_back(std::move(key),
+							    arena->create());
+			int ret = decode(reader, arena, *elem.value, depth + 1);
+			if (ret)
+				return ret;
+		}
+
+		if (isDictionary)
+			obj.buildIndex();
+
+		return 0;
+	}
+
+	case YamlObject::Type::Empty:
+		return 0;
+
+	default:
+		return -EINVAL;
+	}
+}
+
 #endif /* __DOXYGEN__ */
 
 /**
@@ -853,6 +1266,12 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
  *
  * The parser preserves the order of items in the YAML file, for both lists and
  * dictionaries.
+ *
+ * When the LIBCAMERA_YAML_CACHE_DIR environment variable is set, parsed files
+ * are cached in a binary format in the directory it points to. The cache is
+ * keyed by the canonical path of the YAML file and invalidated when the file
+ * size or modification time changes. Loading a cached file skips the YAML
+ * parser, which speeds up opening cameras with large tuning files.
  */
 
 /**
@@ -867,6 +1286,13 @@ int YamlParserContext::parseNextYamlObject(YamlObject &yamlObject, EventPtr even
  */
 std::unique_ptr<YamlObject> YamlParser::parse(File &file)
 {
+	YamlCache cache(file);
+	if (cache.valid()) {
+		std::unique_ptr<YamlObject> root = cache.load();
+		if (root)
+			return root;
+	}
+
 	YamlParserContext context;
 
 	if (context.init(file))
@@ -881,6 +1307,9 @@ std::unique_ptr<YamlObject> YamlParser::parse(File &file)
 		return nullptr;
 	}
 
+	if (cache.valid())
+		cache.store(*root);
+
 	return root;
 }
 
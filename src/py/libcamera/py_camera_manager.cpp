@@ -12,6 +12,7 @@
 #include <unistd.h>
 #include <vector>
 
+#include "py_helpers.h"
 #include "py_main.h"
 
 namespace py = pybind11;
@@ -31,7 +32,12 @@ PyCameraManager::PyCameraManager()
 
 	eventFd_ = UniqueFD(fd);
 
-	int ret = cameraManager_->start();
+	/* Enumerating the cameras may take a while, let other threads run. */
+	int ret;
+	{
+		py::gil_scoped_release release;
+		ret = cameraManager_->start();
+	}
 	if (ret)
 		throw std::system_error(-ret, std::generic_category(),
 					"Failed to start CameraManager");
@@ -40,6 +46,16 @@ PyCameraManager::PyCameraManager()
 PyCameraManager::~PyCameraManager()
 {
 	LOG(Python, Debug) << "~PyCameraManager()";
+
+	/*
+	 * Stopping the camera manager joins its threads, release the GIL if
+	 * held, as the destructor may also run when the interpreter shuts
+	 * down.
+	 */
+	if (PyGILState_Check()) {
+		py::gil_scoped_release release;
+		cameraManager_.reset();
+	}
 }
 
 py::list PyCameraManager::cameras()
@@ -60,23 +76,28 @@ py::list PyCameraManager::cameras()
 	return l;
 }
 
-std::vector<py::object> PyCameraManager::getReadyRequests()
+py::list PyCameraManager::getReadyRequests(bool withMetadata)
 {
 	int ret = readFd();
 
 	if (ret == -EAGAIN)
-		return std::vector<py::object>();
+		return py::list();
 
 	if (ret != 0)
 		throw std::system_error(-ret, std::generic_category());
 
-	std::vector<py::object> py_reqs;
+	py::list py_reqs;
 
 	for (Request *request : getCompletedRequests()) {
 		py::object o = py::cast(request);
 		/* Decrease the ref increased in Camera.queue_request() */
 		o.dec_ref();
-		py_reqs.push_back(o);
+
+		if (withMetadata)
+			py_reqs.append(py::make_tuple(o, controlListToPy(request->metadata(),
+									 controls::controls)));
+		else
+			py_reqs.append(o);
 	}
 
 	return py_reqs;
@@ -85,8 +106,13 @@ std::vector<py::object> PyCameraManager::getReadyRequests()
 /* Note: Called from another thread */
 void PyCameraManager::handleRequestCompleted(Request *req)
 {
-	pushRequest(req);
-	writeFd();
+	/*
+	 * Only signal the eventfd when the first request is queued, the
+	 * following ones are retrieved along with it. As the completed
+	 * requests are taken after reading the eventfd, no wakeup is lost.
+	 */
+	if (pushRequest(req))
+		writeFd();
 }
 
 void PyCameraManager::writeFd()
@@ -116,10 +142,11 @@ int PyCameraManager::readFd()
 		return -EIO;
 }
 
-void PyCameraManager::pushRequest(Request *req)
+bool PyCameraManager::pushRequest(Request *req)
 {
 	MutexLocker guard(completedRequestsMutex_);
 	completedRequests_.push_back(req);
+	return completedRequests_.size() == 1;
 }
 
 std::vector<Request *> PyCameraManager::getCompletedRequests()
@@ -26,7 +26,7 @@ public:
 
 	int eventFd() const { return eventFd_.get(); }
 
-	std::vector<pybind11::object> getReadyRequests();
+	pybind11::list getReadyRequests(bool withMetadata);
 
 	void handleRequestCompleted(Request *req);
 
@@ -40,6 +40,6 @@ private:
 
 	void writeFd();
 	int readFd();
-	void pushRequest(Request *req);
+	bool pushRequest(Request *req);
 	std::vector<Request *> getCompletedRequests();
 };
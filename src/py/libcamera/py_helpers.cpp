@@ -8,6 +8,7 @@
 #include <libcamera/libcamera.h>
 
 #include <pybind11/functional.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
 
@@ -15,6 +16,24 @@ namespace py = pybind11;
 
 using namespace libcamera;
 
+/*
+ * NumPy is an optional runtime dependency. Check once if it can be imported,
+ * to fall back to tuples for array values otherwise.
+ */
+static bool hasNumpy()
+{
+	static const bool available = []() {
+		try {
+			py::module_::import("numpy");
+			return true;
+		} catch (py::error_already_set &) {
+			return false;
+		}
+	}();
+
+	return available;
+}
+
 template<typename T>
 static py::object valueOrTuple(const ControlValue &cv)
 {
@@ -31,6 +50,21 @@ static py::object valueOrTuple(const ControlValue &cv)
 	return py::cast(cv.get<T>());
 }
 
+/*
+ * Convert arrays of numerical values to NumPy arrays, copying the data at once
+ * instead of converting each element to a Python object.
+ */
+template<typename T>
+static py::object valueOrArray(const ControlValue &cv)
+{
+	if (cv.isArray() && hasNumpy()) {
+		const T *v = reinterpret_cast<const T *>(cv.data().data());
+		return py::array_t<T>(cv.numElements(), v);
+	}
+
+	return valueOrTuple<T>(cv);
+}
+
 py::object controlValueToPy(const ControlValue &cv)
 {
 	switch (cv.type()) {
@@ -39,13 +73,13 @@ py::object controlValueToPy(const ControlValue &cv)
 	case ControlTypeBool:
 		return valueOrTuple<bool>(cv);
 	case ControlTypeByte:
-		return valueOrTuple<uint8_t>(cv);
+		return valueOrArray<uint8_t>(cv);
 	case ControlTypeInteger32:
-		return valueOrTuple<int32_t>(cv);
+		return valueOrArray<int32_t>(cv);
 	case ControlTypeInteger64:
-		return valueOrTuple<int64_t>(cv);
+		return valueOrArray<int64_t>(cv);
 	case ControlTypeFloat:
-		return valueOrTuple<float>(cv);
+		return valueOrArray<float>(cv);
 	case ControlTypeString:
 		return py::cast(cv.get<std::string>());
 	case ControlTypeSize: {
@@ -64,7 +98,8 @@ py::object controlValueToPy(const ControlValue &cv)
 template<typename T>
 static ControlValue controlValueMaybeArray(const py::object &ob)
 {
-	if (py::isinstance<py::list>(ob) || py::isinstance<py::tuple>(ob)) {
+	if (py::isinstance<py::list>(ob) || py::isinstance<py::tuple>(ob) ||
+	    (hasNumpy() && py::isinstance<py::array>(ob))) {
 		std::vector<T> vec = ob.cast<std::vector<T>>();
 		return ControlValue(Span<const T>(vec));
 	}
@@ -99,3 +134,69 @@ ControlValue pyToControlValue(const py::object &ob, ControlType type)
 		throw std::runtime_error("Control type not implemented");
 	}
 }
+
+/* Convert a ControlList to a std container, for conversion to a dict */
+std::unordered_map<const ControlId *, py::object>
+controlListToPy(const ControlList &list, const ControlIdMap &idmap)
+{
+	std::unordered_map<const ControlId *, py::object> ret;
+
+	for (const auto &[key, cv] : list) {
+		const ControlId *id = idmap.at(key);
+		ret[id] = controlValueToPy(cv);
+	}
+
+	return ret;
+}
+
+py::object PyControlListView::getItem(const ControlId *id) const
+{
+	if (!list_.contains(id->id()))
+		throw py::key_error(id->name());
+
+	return controlValueToPy(list_.get(id->id()));
+}
+
+py::object PyControlListView::get(const ControlId *id, py::object def) const
+{
+	if (!list_.contains(id->id()))
+		return def;
+
+	return controlValueToPy(list_.get(id->id()));
+}
+
+bool PyControlListView::contains(const ControlId *id) const
+{
+	return list_.contains(id->id());
+}
+
+py::list PyControlListView::keys() const
+{
+	py::list keys;
+
+	for (const auto &[key, cv] : list_)
+		keys.append(py::cast(idmap_.at(key), py::return_value_policy::reference));
+
+	return keys;
+}
+
+py::list PyControlListView::values() const
+{
+	py::list values;
+
+	for (const auto &[key, cv] : list_)
+		values.append(controlValueToPy(cv));
+
+	return values;
+}
+
+py::list PyControlListView::items() const
+{
+	py::list items;
+
+	for (const auto &[key, cv] : list_)
+		items.append(py::make_tuple(py::cast(idmap_.at(key), py::return_value_policy::reference),
+					    controlValueToPy(cv)));
+
+	return items;
+}
@@ -5,9 +5,41 @@
 
 #pragma once
 
+#include <unordered_map>
+
 #include <libcamera/libcamera.h>
 
 #include <pybind11/pybind11.h>
 
 pybind11::object controlValueToPy(const libcamera::ControlValue &cv);
 libcamera::ControlValue pyToControlValue(const pybind11::object &ob, libcamera::ControlType type);
+std::unordered_map<const libcamera::ControlId *, pybind11::object>
+controlListToPy(const libcamera::ControlList &list, const libcamera::ControlIdMap &idmap);
+
+/*
+ * A read-only mapping view of a ControlList, which converts the values to
+ * Python objects when they are accessed. The view reflects the current content
+ * of the list, and doesn't keep the list alive.
+ */
+class PyControlListView
+{
+public:
+	PyControlListView(const libcamera::ControlList &list,
+			  const libcamera::ControlIdMap &idmap)
+		: list_(list), idmap_(idmap)
+	{
+	}
+
+	pybind11::object getItem(const libcamera::ControlId *id) const;
+	pybind11::object get(const libcamera::ControlId *id, pybind11::object def) const;
+	bool contains(const libcamera::ControlId *id) const;
+	std::size_t size() const { return list_.size(); }
+
+	pybind11::list keys() const;
+	pybind11::list values() const;
+	pybind11::list items() const;
+
+private:
+	const libcamera::ControlList &list_;
+	const libcamera::ControlIdMap &idmap_;
+};
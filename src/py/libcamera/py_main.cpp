@@ -23,6 +23,7 @@
 
 #include "py_camera_manager.h"
 #include "py_helpers.h"
+#include "py_mapped_frame_buffer.h"
 
 namespace py = pybind11;
 
@@ -107,14 +108,18 @@ PYBIND11_MODULE(_libcamera, m)
 	auto pySensorConfiguration = py::class_<SensorConfiguration>(m, "SensorConfiguration");
 	auto pyCameraConfiguration = py::class_<CameraConfiguration>(m, "CameraConfiguration");
 	auto pyCameraConfigurationStatus = py::enum_<CameraConfiguration::Status>(pyCameraConfiguration, "Status");
+	auto pyCameraConfigurationMetadataMode = py::enum_<CameraConfiguration::MetadataMode>(pyCameraConfiguration, "MetadataMode");
 	auto pyStreamConfiguration = py::class_<StreamConfiguration>(m, "StreamConfiguration");
 	auto pyStreamFormats = py::class_<StreamFormats>(m, "StreamFormats");
 	auto pyFrameBufferAllocator = py::class_<FrameBufferAllocator>(m, "FrameBufferAllocator");
 	auto pyFrameBuffer = py::class_<FrameBuffer>(m, "FrameBuffer");
 	auto pyFrameBufferPlane = py::class_<FrameBuffer::Plane>(pyFrameBuffer, "Plane");
+	auto pyMappedFrameBuffer = py::class_<PyMappedFrameBuffer, std::shared_ptr<PyMappedFrameBuffer>>(m, "MappedFrameBuffer");
+	auto pyMappedFrameBufferPlane = py::class_<PyMappedPlane>(pyMappedFrameBuffer, "Plane", py::buffer_protocol());
 	auto pyStream = py::class_<Stream>(m, "Stream");
 	auto pyControlId = py::class_<ControlId>(m, "ControlId");
 	auto pyControlInfo = py::class_<ControlInfo>(m, "ControlInfo");
+	auto pyControlListView = py::class_<PyControlListView>(m, "ControlListView");
 	auto pyRequest = py::class_<Request>(m, "Request");
 	auto pyRequestStatus = py::enum_<Request::Status>(pyRequest, "Status");
 	auto pyRequestReuse = py::enum_<Request::ReuseFlag>(pyRequest, "Reuse");
@@ -146,18 +151,36 @@ PYBIND11_MODULE(_libcamera, m)
 		.def_property_readonly("cameras", &PyCameraManager::cameras)
 
 		.def_property_readonly("event_fd", &PyCameraManager::eventFd)
-		.def("get_ready_requests", &PyCameraManager::getReadyRequests);
+		/*
+		 * Return all the completed requests at once, optionally as
+		 * (request, metadata) tuples to avoid converting the metadata
+		 * of each request in a separate call.
+		 */
+		.def("get_ready_requests", &PyCameraManager::getReadyRequests,
+		     py::arg("metadata") = false);
 
 	pyCamera
 		.def_property_readonly("id", &Camera::id)
+		/*
+		 * The GIL is released around the calls to libcamera that may
+		 * block, to let the other Python threads run.
+		 */
 		.def("acquire", [](Camera &self) {
-			int ret = self.acquire();
+			int ret;
+			{
+				py::gil_scoped_release release;
+				ret = self.acquire();
+			}
 			if (ret)
 				throw std::system_error(-ret, std::generic_category(),
 							"Failed to acquire camera");
 		})
 		.def("release", [](Camera &self) {
-			int ret = self.release();
+			int ret;
+			{
+				py::gil_scoped_release release;
+				ret = self.release();
+			}
 			if (ret)
 				throw std::system_error(-ret, std::generic_category(),
 							"Failed to release camera");
@@ -178,7 +201,11 @@ PYBIND11_MODULE(_libcamera, m)
 				controlList.set(id->id(), val);
 			}
 
-			int ret = self.start(&controlList);
+			int ret;
+			{
+				py::gil_scoped_release release;
+				ret = self.start(&controlList);
+			}
 			if (ret) {
 				self.requestCompleted.disconnect();
 				throw std::system_error(-ret, std::generic_category(),
@@ -187,7 +214,11 @@ PYBIND11_MODULE(_libcamera, m)
 		}, py::arg("controls") = std::unordered_map<const ControlId *, py::object>())
 
 		.def("stop", [](Camera &self) {
-			int ret = self.stop();
+			int ret;
+			{
+				py::gil_scoped_release release;
+				ret = self.stop();
+			}
 
 			self.requestCompleted.disconnect();
 
@@ -206,7 +237,11 @@ PYBIND11_MODULE(_libcamera, m)
 		}, py::keep_alive<0, 1>())
 
 		.def("configure", [](Camera &self, CameraConfiguration *config) {
-			int ret = self.configure(config);
+			int ret;
+			{
+				py::gil_scoped_release release;
+				ret = self.configure(config);
+			}
 			if (ret)
 				throw std::system_error(-ret, std::generic_category(),
 							"Failed to configure camera");
@@ -230,7 +265,11 @@ PYBIND11_MODULE(_libcamera, m)
 
 			py_req.inc_ref();
 
-			int ret = self.queueRequest(req);
+			int ret;
+			{
+				py::gil_scoped_release release;
+				ret = self.queueRequest(req);
+			}
 			if (ret) {
 				py_req.dec_ref();
 				throw std::system_error(-ret, std::generic_category(),
@@ -321,13 +360,18 @@ PYBIND11_MODULE(_libcamera, m)
 		.def_property_readonly("size", &CameraConfiguration::size)
 		.def_property_readonly("empty", &CameraConfiguration::empty)
 		.def_readwrite("sensor_config", &CameraConfiguration::sensorConfig)
-		.def_readwrite("orientation", &CameraConfiguration::orientation);
+		.def_readwrite("orientation", &CameraConfiguration::orientation)
+		.def_readwrite("metadata_mode", &CameraConfiguration::metadataMode);
 
 	pyCameraConfigurationStatus
 		.value("Valid", CameraConfiguration::Valid)
 		.value("Adjusted", CameraConfiguration::Adjusted)
 		.value("Invalid", CameraConfiguration::Invalid);
 
+	pyCameraConfigurationMetadataMode
+		.value("Full", CameraConfiguration::MetadataMode::Full)
+		.value("Delta", CameraConfiguration::MetadataMode::Delta);
+
 	pyStreamConfiguration
 		.def("__str__", &StreamConfiguration::toString)
 		.def_property_readonly("stream", &StreamConfiguration::stream,
@@ -349,13 +393,20 @@ PYBIND11_MODULE(_libcamera, m)
 	pyFrameBufferAllocator
 		.def(py::init<PyCameraSmartPtr<Camera>>(), py::keep_alive<1, 2>())
 		.def("allocate", [](FrameBufferAllocator &self, Stream *stream) {
-			int ret = self.allocate(stream);
+			int ret;
+			{
+				py::gil_scoped_release release;
+				ret = self.allocate(stream);
+			}
 			if (ret < 0)
 				throw std::system_error(-ret, std::generic_category(),
 							"Failed to allocate buffers");
 			return ret;
 		})
 		.def_property_readonly("allocated", &FrameBufferAllocator::allocated)
+		.def_property("memory_limit", &FrameBufferAllocator::memoryLimit, &FrameBufferAllocator::setMemoryLimit)
+		.def_property_readonly("memory_usage", &FrameBufferAllocator::memoryUsage)
+		.def_static("memory_requirement", &FrameBufferAllocator::memoryRequirement)
 		/* Create a list of FrameBuffers, where each FrameBuffer has a keep-alive to FrameBufferAllocator */
 		.def("buffers", [](FrameBufferAllocator &self, Stream *stream) {
 			py::object py_self = py::cast(self);
@@ -393,6 +444,20 @@ PYBIND11_MODULE(_libcamera, m)
 		.def_readwrite("offset", &FrameBuffer::Plane::offset)
 		.def_readwrite("length", &FrameBuffer::Plane::length);
 
+	pyMappedFrameBuffer
+		/*
+		 * The planes are laid out as 2D arrays when the configuration of
+		 * the stream is given, and as 1D arrays otherwise.
+		 */
+		.def(py::init([](py::object buffer, const StreamConfiguration *config) {
+			return std::make_shared<PyMappedFrameBuffer>(buffer, config);
+		}), py::arg("buffer"), py::arg("config") = nullptr)
+		.def_property_readonly("buffer", &PyMappedFrameBuffer::buffer)
+		.def_property_readonly("planes", &PyMappedFrameBuffer::planes);
+
+	pyMappedFrameBufferPlane
+		.def_buffer(&PyMappedPlane::buffer);
+
 	pyStream
 		.def_property_readonly("configuration", &Stream::configuration);
 
@@ -430,6 +495,18 @@ PYBIND11_MODULE(_libcamera, m)
 				.format(self.toString());
 		});
 
+	pyControlListView
+		.def("__getitem__", &PyControlListView::getItem)
+		.def("get", &PyControlListView::get, py::arg("id"), py::arg("default") = py::none())
+		.def("__contains__", &PyControlListView::contains)
+		.def("__len__", &PyControlListView::size)
+		.def("__iter__", [](const PyControlListView &self) {
+			return py::iter(self.keys());
+		})
+		.def("keys", &PyControlListView::keys)
+		.def("values", &PyControlListView::values)
+		.def("items", &PyControlListView::items);
+
 	pyRequest
 		/* \todo Fence is not supported, so we cannot expose addBuffer() directly */
 		.def("add_buffer", [](Request &self, const Stream *stream, FrameBuffer *buffer) {
@@ -442,23 +519,19 @@ PYBIND11_MODULE(_libcamera, m)
 		.def_property_readonly("buffers", &Request::buffers)
 		.def_property_readonly("cookie", &Request::cookie)
 		.def_property_readonly("sequence", &Request::sequence)
+		.def_property("priority", &Request::priority, &Request::setPriority)
 		.def_property_readonly("has_pending_buffers", &Request::hasPendingBuffers)
 		.def("set_control", [](Request &self, const ControlId &id, py::object value) {
 			self.controls().set(id.id(), pyToControlValue(value, id.type()));
 		})
+		/*
+		 * The metadata values are converted when accessed. The view keeps
+		 * the request alive, use dict() to take a copy that outlives the
+		 * reuse of the request.
+		 */
 		.def_property_readonly("metadata", [](Request &self) {
-			/* Convert ControlList to std container */
-
-			std::unordered_map<const ControlId *, py::object> ret;
-
-			for (const auto &[key, cv] : self.metadata()) {
-				const ControlId *id = controls::controls.at(key);
-				py::object ob = controlValueToPy(cv);
-				ret[id] = ob;
-			}
-
-			return ret;
-		})
+			return PyControlListView(self.metadata(), controls::controls);
+		}, py::keep_alive<0, 1>())
 		/*
 		 * \todo As we add a keep_alive to the fb in addBuffers(), we
 		 * can only allow reuse with ReuseBuffers.
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Python bindings - Memory mapping of frame buffers
+ */
+
+#include "py_mapped_frame_buffer.h"
+
+#include <stdint.h>
+#include <system_error>
+
+#include "libcamera/internal/formats.h"
+
+namespace py = pybind11;
+
+PyMappedFrameBuffer::PyMappedFrameBuffer(py::object buffer,
+					 const StreamConfiguration *config)
+	: buffer_(buffer),
+	  mapping_(buffer.cast<FrameBuffer *>(), MappedFrameBuffer::MapFlag::ReadWrite)
+{
+	if (!mapping_.isValid())
+		throw std::system_error(mapping_.error(), std::generic_category(),
+					"Failed to map buffer");
+
+	const std::vector<MappedBuffer::Plane> &planes = mapping_.planes();
+	layouts_.resize(planes.size(), { 0, 0, 0 });
+
+	if (!config || !config->stride)
+		return;
+
+	const PixelFormatInfo &info = PixelFormatInfo::info(config->pixelFormat);
+	if (!info.isValid() || info.numPlanes() != planes.size())
+		return;
+
+	/*
+	 * Expose the planes as two-dimensional arrays of bytes with the line
+	 * stride of the stream, so that the padding at the end of the lines is
+	 * skipped without copying. The stride of the planes other than the
+	 * first one is computed from the horizontal subsampling, as done for
+	 * single-planar V4L2 buffers.
+	 */
+	for (unsigned int i = 0; i < planes.size(); i++) {
+		unsigned int stride = config->stride
+				    * info.planes[i].bytesPerGroup
+				    / info.planes[0].bytesPerGroup;
+		unsigned int size = info.planeSize(config->size.height, i, stride);
+
+		if (!stride || size > planes[i].size())
+			continue;
+
+		layouts_[i].rows = size / stride;
+		layouts_[i].bytesPerLine = info.stride(config->size.width, i);
+		layouts_[i].stride = stride;
+	}
+}
+
+py::tuple PyMappedFrameBuffer::planes()
+{
+	std::shared_ptr<PyMappedFrameBuffer> self = shared_from_this();
+	py::tuple planes(mapping_.planes().size());
+
+	for (unsigned int i = 0; i < mapping_.planes().size(); i++)
+		planes[i] = py::cast(PyMappedPlane(self, i));
+
+	return planes;
+}
+
+py::buffer_info PyMappedFrameBuffer::planeBuffer(unsigned int index)
+{
+	const MappedBuffer::Plane &plane = mapping_.planes()[index];
+	const Layout &layout = layouts_[index];
+
+	if (!layout.rows)
+		return py::buffer_info(plane.data(), sizeof(uint8_t),
+				       py::format_descriptor<uint8_t>::format(),
+				       1, { static_cast<py::ssize_t>(plane.size()) },
+				       { static_cast<py::ssize_t>(sizeof(uint8_t)) },
+				       false);
+
+	return py::buffer_info(plane.data(), sizeof(uint8_t),
+			       py::format_descriptor<uint8_t>::format(), 2,
+			       { static_cast<py::ssize_t>(layout.rows),
+				 static_cast<py::ssize_t>(layout.bytesPerLine) },
+			       { static_cast<py::ssize_t>(layout.stride),
+				 static_cast<py::ssize_t>(sizeof(uint8_t)) },
+			       false);
+}
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Python bindings - Memory mapping of frame buffers
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <libcamera/libcamera.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
+
+#include <pybind11/pybind11.h>
+
+using namespace libcamera;
+
+class PyMappedFrameBuffer : public std::enable_shared_from_this<PyMappedFrameBuffer>
+{
+public:
+	PyMappedFrameBuffer(pybind11::object buffer,
+			    const StreamConfiguration *config);
+
+	pybind11::tuple planes();
+	pybind11::buffer_info planeBuffer(unsigned int index);
+
+	pybind11::object buffer() const { return buffer_; }
+
+private:
+	struct Layout {
+		unsigned int rows;
+		unsigned int bytesPerLine;
+		unsigned int stride;
+	};
+
+	/* Keeps the FrameBuffer, and its allocator, alive */
+	pybind11::object buffer_;
+	MappedFrameBuffer mapping_;
+	std::vector<Layout> layouts_;
+};
+
+/*
+ * A plane of a PyMappedFrameBuffer, exposed through the buffer protocol. The
+ * plane keeps the mapping alive as long as any view of its memory exists.
+ */
+class PyMappedPlane
+{
+public:
+	PyMappedPlane(std::shared_ptr<PyMappedFrameBuffer> mapping,
+		      unsigned int index)
+		: mapping_(std::move(mapping)), index_(index)
+	{
+	}
+
+	pybind11::buffer_info buffer() { return mapping_->planeBuffer(index_); }
+
+private:
+	std::shared_ptr<PyMappedFrameBuffer> mapping_;
+	unsigned int index_;
+};
@@ -8,19 +8,23 @@
 #include "v4l2_camera.h"
 
 #include <errno.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <libcamera/base/log.h>
 
 #include <libcamera/control_ids.h>
 
+#include "libcamera/internal/formats.h"
+
 using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(V4L2Compat)
 
 V4L2Camera::V4L2Camera(std::shared_ptr<Camera> camera)
 	: camera_(camera), controls_(controls::controls), isRunning_(false),
-	  bufferAllocator_(nullptr), efd_(-1), bufferAvailableCount_(0)
+	  bufferAllocator_(nullptr), importing_(false), efd_(-1),
+	  bufferAvailableCount_(0)
 {
 	camera_->requestCompleted.connect(this, &V4L2Camera::requestComplete);
 }
@@ -52,6 +56,7 @@ int V4L2Camera::open(StreamConfiguration *streamConfig)
 void V4L2Camera::close()
 {
 	requestPool_.clear();
+	importedBuffers_.clear();
 
 	delete bufferAllocator_;
 	bufferAllocator_ = nullptr;
@@ -158,14 +163,8 @@ int V4L2Camera::validateConfiguration(const PixelFormat &pixelFormat,
 	return 0;
 }
 
-int V4L2Camera::allocBuffers(unsigned int count)
+int V4L2Camera::createRequests(unsigned int count)
 {
-	Stream *stream = config_->at(0).stream();
-
-	int ret = bufferAllocator_->allocate(stream);
-	if (ret < 0)
-		return ret;
-
 	for (unsigned int i = 0; i < count; i++) {
 		std::unique_ptr<Request> request = camera_->createRequest(i);
 		if (!request) {
@@ -175,14 +174,51 @@ int V4L2Camera::allocBuffers(unsigned int count)
 		requestPool_.push_back(std::move(request));
 	}
 
+	return 0;
+}
+
+int V4L2Camera::allocBuffers(unsigned int count)
+{
+	Stream *stream = config_->at(0).stream();
+
+	int ret = bufferAllocator_->allocate(stream);
+	if (ret < 0)
+		return ret;
+
+	int err = createRequests(count);
+	if (err < 0)
+		return err;
+
 	return ret;
 }
 
+/*
+ * Prepare for buffers imported from the application. The FrameBuffer
+ * instances are created when the buffers are queued with importBuffer().
+ */
+int V4L2Camera::importBuffers(unsigned int count)
+{
+	int ret = createRequests(count);
+	if (ret < 0)
+		return ret;
+
+	importedBuffers_.resize(count);
+	importing_ = true;
+
+	return count;
+}
+
 void V4L2Camera::freeBuffers()
 {
 	pendingRequests_.clear();
 	requestPool_.clear();
 
+	if (importing_) {
+		importedBuffers_.clear();
+		importing_ = false;
+		return;
+	}
+
 	Stream *stream = config_->at(0).stream();
 	bufferAllocator_->free(stream);
 }
@@ -199,6 +235,94 @@ int V4L2Camera::getBufferFd(unsigned int index)
 	return buffers[index]->planes()[0].fd.get();
 }
 
+/*
+ * Wrap the dmabuf fd queued by the application for the buffer at \a index in
+ * a FrameBuffer. Applications usually queue the same dmabuf for a given index,
+ * in which case the FrameBuffer created when it was first queued is reused.
+ */
+int V4L2Camera::importBuffer(unsigned int index, int fd)
+{
+	if (!importing_ || index >= importedBuffers_.size()) {
+		LOG(V4L2Compat, Error) << "Invalid index";
+		return -EINVAL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		LOG(V4L2Compat, Error) << "Invalid dmabuf fd " << fd;
+		return -EINVAL;
+	}
+
+	std::unique_ptr<FrameBuffer> &buffer = importedBuffers_[index];
+	if (buffer) {
+		struct stat current;
+		int ret = fstat(buffer->planes()[0].fd.get(), &current);
+		if (!ret && current.st_dev == st.st_dev &&
+		    current.st_ino == st.st_ino)
+			return 0;
+	}
+
+	const StreamConfiguration &streamConfig = config_->at(0);
+	const PixelFormatInfo &info = PixelFormatInfo::info(streamConfig.pixelFormat);
+
+	SharedFD dmabuf(fd);
+	if (!dmabuf.isValid())
+		return -EINVAL;
+
+	/*
+	 * The single-planar V4L2 API stores all the colour planes contiguously
+	 * in one dmabuf. Split it into FrameBuffer planes, computing the
+	 * stride of each plane from the stride of the first one.
+	 */
+	std::vector<FrameBuffer::Plane> planes;
+	unsigned int offset = 0;
+
+	if (info.isValid()) {
+		for (unsigned int i = 0; i < info.numPlanes(); i++) {
+			unsigned int stride = streamConfig.stride
+					    * info.planes[i].bytesPerGroup
+					    / info.planes[0].bytesPerGroup;
+
+			FrameBuffer::Plane plane;
+			plane.fd = dmabuf;
+			plane.offset = offset;
+			plane.length = info.planeSize(streamConfig.size.height,
+						      i, stride);
+			offset += plane.length;
+
+			planes.push_back(std::move(plane));
+		}
+	} else {
+		FrameBuffer::Plane plane;
+		plane.fd = dmabuf;
+		plane.offset = 0;
+		plane.length = streamConfig.frameSize;
+		offset = plane.length;
+
+		planes.push_back(std::move(plane));
+	}
+
+	off_t size = lseek(dmabuf.get(), 0, SEEK_END);
+	if (size >= 0 && static_cast<size_t>(size) < offset) {
+		LOG(V4L2Compat, Error)
+			<< "dmabuf too small (" << size << " < " << offset << ")";
+		return -EINVAL;
+	}
+
+	buffer = std::make_unique<FrameBuffer>(planes);
+
+	return 0;
+}
+
+FrameBuffer *V4L2Camera::buffer(unsigned int index)
+{
+	if (importing_)
+		return importedBuffers_[index].get();
+
+	Stream *stream = config_->at(0).stream();
+	return bufferAllocator_->buffers(stream)[index].get();
+}
+
 int V4L2Camera::streamOn()
 {
 	if (isRunning_)
@@ -257,8 +381,7 @@ int V4L2Camera::qbuf(unsigned int index)
 	Request *request = requestPool_[index].get();
 
 	Stream *stream = config_->at(0).stream();
-	FrameBuffer *buffer = bufferAllocator_->buffers(stream)[index].get();
-	int ret = request->addBuffer(stream, buffer);
+	int ret = request->addBuffer(stream, buffer(index));
 	if (ret < 0) {
 		LOG(V4L2Compat, Error) << "Can't set buffer for request";
 		return -ENOMEM;
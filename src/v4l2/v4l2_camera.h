@@ -54,8 +54,10 @@ public:
 	libcamera::ControlList &controls() { return controls_; }
 
 	int allocBuffers(unsigned int count);
+	int importBuffers(unsigned int count);
 	void freeBuffers();
 	int getBufferFd(unsigned int index);
+	int importBuffer(unsigned int index, int fd);
 
 	int streamOn();
 	int streamOff();
@@ -70,6 +72,8 @@ public:
 private:
 	void requestComplete(libcamera::Request *request)
 		LIBCAMERA_TSA_EXCLUDES(bufferLock_);
+	int createRequests(unsigned int count);
+	libcamera::FrameBuffer *buffer(unsigned int index);
 
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
@@ -80,6 +84,9 @@ private:
 
 	libcamera::Mutex bufferLock_;
 	libcamera::FrameBufferAllocator *bufferAllocator_;
+	/* Buffers imported from the application with V4L2_MEMORY_DMABUF */
+	std::vector<std::unique_ptr<libcamera::FrameBuffer>> importedBuffers_;
+	bool importing_;
 
 	std::vector<std::unique_ptr<libcamera::Request>> requestPool_;
 
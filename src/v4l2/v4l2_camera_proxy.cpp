@@ -41,7 +41,8 @@ LOG_DECLARE_CATEGORY(V4L2Compat)
 
 V4L2CameraProxy::V4L2CameraProxy(unsigned int index,
 				 std::shared_ptr<Camera> camera)
-	: refcount_(0), index_(index), bufferCount_(0), currentBuf_(0),
+	: refcount_(0), index_(index), bufferCount_(0),
+	  memory_(V4L2_MEMORY_MMAP), currentBuf_(0),
 	  vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr)
 {
 	querycap(camera);
@@ -121,6 +122,12 @@ void *V4L2CameraProxy::mmap(V4L2CameraFile *file, void *addr, size_t length,
 		return MAP_FAILED;
 	}
 
+	/* Imported buffers are mapped by the application from the dmabuf. */
+	if (memory_ != V4L2_MEMORY_MMAP) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
 	unsigned int index = offset / sizeimage_;
 	if (static_cast<off_t>(index * sizeimage_) != offset ||
 	    length != sizeimage_) {
@@ -175,7 +182,7 @@ bool V4L2CameraProxy::validateBufferType(uint32_t type)
 
 bool V4L2CameraProxy::validateMemoryType(uint32_t memory)
 {
-	return memory == V4L2_MEMORY_MMAP;
+	return memory == V4L2_MEMORY_MMAP || memory == V4L2_MEMORY_DMABUF;
 }
 
 void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
@@ -492,7 +499,8 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	if (!hasOwnership(file) && owner_)
 		return -EBUSY;
 
-	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP
+			  | V4L2_BUF_CAP_SUPPORTS_DMABUF;
 	arg->flags = 0;
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
@@ -524,8 +532,12 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 
 	arg->count = streamConfig_.bufferCount;
 	bufferCount_ = arg->count;
+	memory_ = arg->memory;
 
-	ret = vcam_->allocBuffers(arg->count);
+	if (memory_ == V4L2_MEMORY_DMABUF)
+		ret = vcam_->importBuffers(arg->count);
+	else
+		ret = vcam_->allocBuffers(arg->count);
 	if (ret < 0) {
 		arg->count = 0;
 		return ret;
@@ -536,8 +548,9 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 		struct v4l2_buffer buf = {};
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.length = v4l2PixFormat_.sizeimage;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.m.offset = i * v4l2PixFormat_.sizeimage;
+		buf.memory = memory_;
+		if (memory_ == V4L2_MEMORY_MMAP)
+			buf.m.offset = i * v4l2PixFormat_.sizeimage;
 		buf.index = i;
 		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
 
@@ -586,7 +599,7 @@ int V4L2CameraProxy::vidioc_prepare_buf(V4L2CameraFile *file, struct v4l2_buffer
 		return -EINVAL;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	    arg->memory != memory_)
 		return -EINVAL;
 
 	struct v4l2_buffer &buffer = buffers_[arg->index];
@@ -618,11 +631,20 @@ int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 		return -EBUSY;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory) ||
+	    arg->memory != memory_ ||
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
-	int ret = vcam_->qbuf(arg->index);
+	int ret;
+	if (memory_ == V4L2_MEMORY_DMABUF) {
+		ret = vcam_->importBuffer(arg->index, arg->m.fd);
+		if (ret < 0)
+			return ret;
+
+		buffers_[arg->index].m.fd = arg->m.fd;
+	}
+
+	ret = vcam_->qbuf(arg->index);
 	if (ret < 0)
 		return ret;
 
@@ -649,7 +671,7 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 		return -EINVAL;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	    arg->memory != memory_)
 		return -EINVAL;
 
 	if (!file->nonBlocking()) {
@@ -692,8 +714,8 @@ int V4L2CameraProxy::vidioc_expbuf(V4L2CameraFile *file, struct v4l2_exportbuffe
 	if (!hasOwnership(file))
 		return -EBUSY;
 
-	/* \todo Verify that the memory type is MMAP when adding DMABUF support */
-	if (!validateBufferType(arg->type))
+	/* Only buffers allocated by libcamera can be exported. */
+	if (!validateBufferType(arg->type) || memory_ != V4L2_MEMORY_MMAP)
 		return -EINVAL;
 
 	if (arg->index >= bufferCount_)
@@ -80,6 +80,8 @@ private:
 
 	libcamera::StreamConfiguration streamConfig_;
 	unsigned int bufferCount_;
+	/* The memory type of the buffers, set by reqbufs */
+	uint32_t memory_;
 	unsigned int currentBuf_;
 	unsigned int sizeimage_;
 
@@ -40,8 +40,11 @@ void get_symbol(T &func, const char *name)
 } /* namespace */
 
 V4L2CompatManager::V4L2CompatManager()
-	: cm_(nullptr)
+	: cm_(nullptr), highFiles_(0), numMmaps_(0)
 {
+	for (std::atomic<uint64_t> &bits : fdBitmap_)
+		bits.store(0, std::memory_order_relaxed);
+
 	get_symbol(fops_.openat, "openat64");
 	get_symbol(fops_.dup, "dup");
 	get_symbol(fops_.close, "close");
@@ -52,8 +55,11 @@ V4L2CompatManager::V4L2CompatManager()
 
 V4L2CompatManager::~V4L2CompatManager()
 {
-	files_.clear();
-	mmaps_.clear();
+	{
+		MutexLocker locker(mutex_);
+		files_.clear();
+		mmaps_.clear();
+	}
 
 	if (cm_) {
 		proxies_.clear();
@@ -97,13 +103,70 @@ V4L2CompatManager *V4L2CompatManager::instance()
 	return &instance;
 }
 
+/*
+ * Check, without locking, if a file descriptor may belong to a camera. False
+ * positives are possible for the file descriptors beyond the bitmap, but no
+ * false negatives, as a camera file descriptor is only returned to the
+ * application after being added to the bitmap.
+ */
+bool V4L2CompatManager::isCameraFd(int fd) const
+{
+	if (fd < 0)
+		return false;
+
+	if (static_cast<unsigned int>(fd) >= kFdBitmapSize)
+		return highFiles_.load(std::memory_order_acquire) != 0;
+
+	uint64_t bits = fdBitmap_[fd / 64].load(std::memory_order_acquire);
+	return bits & (UINT64_C(1) << (fd % 64));
+}
+
 std::shared_ptr<V4L2CameraFile> V4L2CompatManager::cameraFile(int fd)
 {
-	auto file = files_.find(fd);
-	if (file == files_.end())
+	if (!isCameraFd(fd))
 		return nullptr;
 
-	return file->second;
+	MutexLocker locker(mutex_);
+
+	if (static_cast<unsigned int>(fd) >= files_.size())
+		return nullptr;
+
+	return files_[fd];
+}
+
+void V4L2CompatManager::addFile(int fd, std::shared_ptr<V4L2CameraFile> file)
+{
+	if (static_cast<unsigned int>(fd) >= files_.size())
+		files_.resize(fd + 1);
+
+	/* The file descriptor may be reused if a close() wasn't intercepted. */
+	bool added = !files_[fd];
+	files_[fd] = std::move(file);
+
+	if (static_cast<unsigned int>(fd) >= kFdBitmapSize) {
+		if (added)
+			highFiles_.fetch_add(1, std::memory_order_release);
+		return;
+	}
+
+	fdBitmap_[fd / 64].fetch_or(UINT64_C(1) << (fd % 64),
+				    std::memory_order_release);
+}
+
+void V4L2CompatManager::removeFile(int fd)
+{
+	if (static_cast<unsigned int>(fd) >= files_.size() || !files_[fd])
+		return;
+
+	files_[fd].reset();
+
+	if (static_cast<unsigned int>(fd) >= kFdBitmapSize) {
+		highFiles_.fetch_sub(1, std::memory_order_release);
+		return;
+	}
+
+	fdBitmap_[fd / 64].fetch_and(~(UINT64_C(1) << (fd % 64)),
+				     std::memory_order_release);
 }
 
 int V4L2CompatManager::getCameraIndex(int fd)
@@ -177,9 +240,14 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 		return efd;
 
 	V4L2CameraProxy *proxy = proxies_[ret].get();
-	files_.emplace(efd, std::make_shared<V4L2CameraFile>(dirfd, path, efd,
-							     oflag & O_NONBLOCK,
-							     proxy));
+	std::shared_ptr<V4L2CameraFile> file =
+		std::make_shared<V4L2CameraFile>(dirfd, path, efd,
+						 oflag & O_NONBLOCK, proxy);
+
+	{
+		MutexLocker locker(mutex_);
+		addFile(efd, std::move(file));
+	}
 
 	LOG(V4L2Compat, Debug) << "Opened " << path << " -> fd " << efd;
 	return efd;
@@ -191,18 +259,21 @@ int V4L2CompatManager::dup(int oldfd)
 	if (newfd < 0)
 		return newfd;
 
-	auto file = files_.find(oldfd);
-	if (file != files_.end())
-		files_[newfd] = file->second;
+	std::shared_ptr<V4L2CameraFile> file = cameraFile(oldfd);
+	if (file) {
+		MutexLocker locker(mutex_);
+		addFile(newfd, std::move(file));
+	}
 
 	return newfd;
 }
 
 int V4L2CompatManager::close(int fd)
 {
-	auto file = files_.find(fd);
-	if (file != files_.end())
-		files_.erase(file);
+	if (isCameraFd(fd)) {
+		MutexLocker locker(mutex_);
+		removeFile(fd);
+	}
 
 	/* We still need to close the eventfd. */
 	return fops_.close(fd);
@@ -220,23 +291,39 @@ void *V4L2CompatManager::mmap(void *addr, size_t length, int prot, int flags,
 	if (map == MAP_FAILED)
 		return map;
 
-	mmaps_[map] = file;
+	MutexLocker locker(mutex_);
+	if (mmaps_.emplace(map, file).second)
+		numMmaps_.fetch_add(1, std::memory_order_release);
+
 	return map;
 }
 
 int V4L2CompatManager::munmap(void *addr, size_t length)
 {
-	auto device = mmaps_.find(addr);
-	if (device == mmaps_.end())
+	if (!numMmaps_.load(std::memory_order_acquire))
 		return fops_.munmap(addr, length);
 
-	V4L2CameraFile *file = device->second.get();
+	std::shared_ptr<V4L2CameraFile> file;
+
+	{
+		MutexLocker locker(mutex_);
+
+		auto device = mmaps_.find(addr);
+		if (device == mmaps_.end()) {
+			locker.unlock();
+			return fops_.munmap(addr, length);
+		}
+
+		file = device->second;
+	}
 
-	int ret = file->proxy()->munmap(file, addr, length);
+	int ret = file->proxy()->munmap(file.get(), addr, length);
 	if (ret < 0)
 		return ret;
 
-	mmaps_.erase(device);
+	MutexLocker locker(mutex_);
+	if (mmaps_.erase(addr))
+		numMmaps_.fetch_sub(1, std::memory_order_release);
 
 	return 0;
 }
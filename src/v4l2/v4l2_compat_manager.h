@@ -7,12 +7,17 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <fcntl.h>
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <sys/types.h>
 #include <vector>
 
+#include <libcamera/base/mutex.h>
+
 #include <libcamera/camera_manager.h>
 
 #include "v4l2_camera_proxy.h"
@@ -55,15 +60,38 @@ private:
 	V4L2CompatManager();
 	~V4L2CompatManager();
 
+	/* Number of file descriptors tracked in the fdBitmap_ */
+	static constexpr unsigned int kFdBitmapSize = 65536;
+
 	int start();
 	int getCameraIndex(int fd);
-	std::shared_ptr<V4L2CameraFile> cameraFile(int fd);
+	bool isCameraFd(int fd) const;
+	std::shared_ptr<V4L2CameraFile> cameraFile(int fd)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void addFile(int fd, std::shared_ptr<V4L2CameraFile> file)
+		LIBCAMERA_TSA_REQUIRES(mutex_);
+	void removeFile(int fd) LIBCAMERA_TSA_REQUIRES(mutex_);
 
 	FileOperations fops_;
 
 	libcamera::CameraManager *cm_;
 
 	std::vector<std::unique_ptr<V4L2CameraProxy>> proxies_;
-	std::map<int, std::shared_ptr<V4L2CameraFile>> files_;
-	std::map<void *, std::shared_ptr<V4L2CameraFile>> mmaps_;
+
+	/*
+	 * The C library calls are intercepted from any thread of the
+	 * application. The mutex protects the files and mappings, and the
+	 * lock-free bitmaps let calls on the file descriptors and mappings that
+	 * don't belong to a camera skip the lookup without locking.
+	 */
+	libcamera::Mutex mutex_;
+	std::vector<std::shared_ptr<V4L2CameraFile>> files_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::map<void *, std::shared_ptr<V4L2CameraFile>> mmaps_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	/* Camera file descriptors, the higher ones are counted in highFiles_ */
+	std::array<std::atomic<uint64_t>, kFdBitmapSize / 64> fdBitmap_;
+	std::atomic<unsigned int> highFiles_;
+	std::atomic<unsigned int> numMmaps_;
 };
@@ -0,0 +1,285 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * End-to-end capture latency, throughput and CPU usage benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/utils.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace {
+
+/*
+ * The camera defaults to vimc, and can be overridden with the
+ * LIBCAMERA_BENCHMARK_CAMERA environment variable, for instance to benchmark
+ * the simple pipeline handler and the software ISP. The environment is read
+ * before the CameraTest base class is constructed.
+ */
+const char *benchmarkCamera()
+{
+	const char *name = utils::secure_getenv("LIBCAMERA_BENCHMARK_CAMERA");
+	return name ? name : "platform/vimc.0 Sensor B";
+}
+
+double cpuTime()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec +
+	       usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec;
+}
+
+class CameraBenchmark : public CameraTest, public Test
+{
+public:
+	CameraBenchmark()
+		: CameraTest(benchmarkCamera()), cameraName_(benchmarkCamera())
+	{
+	}
+
+protected:
+	static constexpr unsigned int kWarmupFrames = 10;
+
+	void requestComplete(Request *request)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		const utils::time_point now = utils::clock::now();
+		const unsigned int index = request->cookie();
+
+		completed_++;
+
+		if (completed_ > kWarmupFrames) {
+			if (completed_ == kWarmupFrames + 1) {
+				start_ = now;
+				startCpu_ = cpuTime();
+			}
+
+			const duration<double, micro> latency = now - queued_[index];
+			requestLatencies_.push_back(latency.count());
+
+			/*
+			 * The sensor timestamp is in the CLOCK_MONOTONIC time
+			 * base, as the steady clock.
+			 */
+			auto timestamp = request->metadata().get(controls::SensorTimestamp);
+			if (timestamp) {
+				const auto captured = utils::time_point(nanoseconds(*timestamp));
+				const duration<double, micro> processing = now - captured;
+				processingLatencies_.push_back(processing.count());
+			}
+
+			end_ = now;
+			endCpu_ = cpuTime();
+		}
+
+		if (completed_ >= kWarmupFrames + frames_) {
+			dispatcher_->interrupt();
+			return;
+		}
+
+		const Request::BufferMap &buffers = request->buffers();
+		const Stream *stream = buffers.begin()->first;
+		FrameBuffer *buffer = buffers.begin()->second;
+
+		request->reuse();
+		request->addBuffer(stream, buffer);
+		queued_[index] = utils::clock::now();
+		camera_->queueRequest(request);
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		const char *frames = utils::secure_getenv("LIBCAMERA_BENCHMARK_FRAMES");
+		frames_ = frames ? strtoul(frames, nullptr, 10) : 1000;
+		if (!frames_) {
+			cerr << "Invalid number of frames" << endl;
+			return TestFail;
+		}
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cerr << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		allocator_.reset();
+	}
+
+	static double percentile(vector<double> &values, double p)
+	{
+		if (values.empty())
+			return 0.0;
+
+		sort(values.begin(), values.end());
+		size_t index = static_cast<size_t>(p * (values.size() - 1));
+		return values[index];
+	}
+
+	static void printLatency(const char *name, vector<double> &values)
+	{
+		cout << "\"" << name << "\": { "
+		     << "\"p50\": " << percentile(values, 0.5) << ", "
+		     << "\"p90\": " << percentile(values, 0.9) << ", "
+		     << "\"p99\": " << percentile(values, 0.99) << ", "
+		     << "\"max\": " << percentile(values, 1.0) << " }";
+	}
+
+	/* Emit the results as a single-line JSON object for CI to parse. */
+	void printResults(const StreamConfiguration &cfg, unsigned int numBuffers)
+	{
+		const unsigned int frames = requestLatencies_.size();
+		const duration<double> elapsed = end_ - start_;
+		const double fps = frames > 1 ? (frames - 1) / elapsed.count() : 0.0;
+		const char *isolated = utils::secure_getenv("LIBCAMERA_IPA_FORCE_ISOLATION");
+
+		cout << fixed << setprecision(1)
+		     << "{ \"camera\": \"" << cameraName_ << "\", "
+		     << "\"configuration\": \"" << cfg.toString() << "\", "
+		     << "\"buffers\": " << numBuffers << ", "
+		     << "\"ipa_isolated\": " << (isolated ? "true" : "false") << ", "
+		     << "\"frames\": " << frames << ", "
+		     << "\"fps\": " << fps << ", ";
+
+		printLatency("request_latency_us", requestLatencies_);
+		cout << ", ";
+		printLatency("processing_latency_us", processingLatencies_);
+
+		/*
+		 * The CPU time covers the threads of this process only. When
+		 * the IPA module is isolated, its proxy worker isn't included.
+		 */
+		cout << ", \"cpu_us_per_frame\": "
+		     << (frames ? (endCpu_ - startCpu_) / frames : 0.0)
+		     << " }" << endl;
+	}
+
+	int run() override
+	{
+		StreamConfiguration &cfg = config_->at(0);
+
+		if (camera_->acquire()) {
+			cerr << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cerr << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		const auto &buffers = allocator_->buffers(stream);
+		for (const auto &[i, buffer] : utils::enumerate(buffers)) {
+			std::unique_ptr<Request> request = camera_->createRequest(i);
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cerr << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		queued_.resize(requests_.size());
+		completed_ = 0;
+
+		camera_->requestCompleted.connect(this, &CameraBenchmark::requestComplete);
+
+		if (camera_->start()) {
+			cerr << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (const auto &[i, request] : utils::enumerate(requests_)) {
+			queued_[i] = utils::clock::now();
+			if (camera_->queueRequest(request.get())) {
+				cerr << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		Timer timer;
+		timer.start(500ms * (kWarmupFrames + frames_));
+		while (timer.isRunning() && completed_ < kWarmupFrames + frames_)
+			dispatcher_->processEvents();
+
+		if (camera_->stop()) {
+			cerr << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completed_ < kWarmupFrames + frames_) {
+			cerr << "Failed to capture " << frames_ << " frames, got "
+			     << completed_ << endl;
+			return TestFail;
+		}
+
+		printResults(cfg, buffers.size());
+
+		return TestPass;
+	}
+
+	string cameraName_;
+	unsigned int frames_;
+
+	EventDispatcher *dispatcher_;
+	unique_ptr<CameraConfiguration> config_;
+	unique_ptr<FrameBufferAllocator> allocator_;
+	vector<unique_ptr<Request>> requests_;
+
+	vector<utils::time_point> queued_;
+	unsigned int completed_;
+
+	utils::time_point start_;
+	utils::time_point end_;
+	double startCpu_;
+	double endCpu_;
+
+	vector<double> requestLatencies_;
+	vector<double> processingLatencies_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CameraBenchmark)
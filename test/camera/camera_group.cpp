@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Test capture through a camera group
+ */
+
+#include <iostream>
+
+#include <libcamera/camera_group.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class CameraGroupTest : public CameraTest, public Test
+{
+public:
+	CameraGroupTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	static constexpr unsigned int kNumFrames = 10;
+
+	void requestsCompleted(const std::vector<Request *> &requests)
+	{
+		if (requests.size() != 1) {
+			cout << "Invalid number of requests in set" << endl;
+			status_ = TestFail;
+			return;
+		}
+
+		Request *request = requests[0];
+		if (!request->metadata().contains(controls::SensorTimestamp.id())) {
+			cout << "Missing timestamp in request "
+			     << request->sequence() << endl;
+			status_ = TestFail;
+		}
+
+		completeRequestsCount_++;
+		requeue(request);
+	}
+
+	void requestDropped(Request *request)
+	{
+		if (request->status() == Request::RequestCancelled)
+			return;
+
+		/* A single camera group has nothing to match, no drop is expected. */
+		cout << "Request " << request->sequence() << " dropped" << endl;
+		status_ = TestFail;
+
+		requeue(request);
+	}
+
+	void requeue(Request *request)
+	{
+		const Request::BufferMap &buffers = request->buffers();
+		const Stream *stream = buffers.begin()->first;
+		FrameBuffer *buffer = buffers.begin()->second;
+
+		request->reuse();
+		request->addBuffer(stream, buffer);
+		group_->queueRequests({ request });
+
+		dispatcher_->interrupt();
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		group_ = std::make_unique<CameraGroup>(std::vector<std::shared_ptr<Camera>>{ camera_ });
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+		if (allocator_->allocate(stream) < 0)
+			return TestFail;
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		completeRequestsCount_ = 0;
+		group_->requestsCompleted.connect(this, &CameraGroupTest::requestsCompleted);
+		group_->requestDropped.connect(this, &CameraGroupTest::requestDropped);
+
+		if (group_->start()) {
+			cout << "Failed to start camera group" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			if (group_->queueRequests({ request.get() })) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		Timer timer;
+		timer.start(500ms * kNumFrames);
+		while (timer.isRunning() && completeRequestsCount_ < kNumFrames)
+			dispatcher_->processEvents();
+
+		if (group_->stop()) {
+			cout << "Failed to stop camera group" << endl;
+			return TestFail;
+		}
+
+		if (completeRequestsCount_ < kNumFrames) {
+			cout << "Failed to capture enough frames" << endl;
+			return TestFail;
+		}
+
+		return status_;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+
+	std::unique_ptr<CameraGroup> group_;
+	unsigned int completeRequestsCount_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CameraGroupTest)
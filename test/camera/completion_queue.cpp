@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Test retrieving completed requests through the camera completion queue
+ */
+
+#include <array>
+#include <iostream>
+#include <poll.h>
+
+#include <libcamera/framebuffer_allocator.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+class CompletionQueueTest : public CameraTest, public Test
+{
+public:
+	CompletionQueueTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = new FrameBufferAllocator(camera_);
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		delete allocator_;
+	}
+
+	int run() override
+	{
+		StreamConfiguration &cfg = config_->at(0);
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to set default configuration" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = cfg.stream();
+
+		int ret = allocator_->allocate(stream);
+		if (ret < 0)
+			return TestFail;
+
+		const unsigned int nBuffers = allocator_->buffers(stream).size();
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			if (request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to associate buffer with request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		if (camera_->completionFd() != -1) {
+			cout << "Completion queue enabled by default" << endl;
+			return TestFail;
+		}
+
+		/* Size the queue for all requests but one. */
+		if (camera_->enableCompletionQueue(nBuffers - 1)) {
+			cout << "Failed to enable completion queue" << endl;
+			return TestFail;
+		}
+
+		int fd = camera_->completionFd();
+		if (fd < 0) {
+			cout << "Invalid completion queue file descriptor" << endl;
+			return TestFail;
+		}
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < nBuffers - 1; i++) {
+			if (camera_->queueRequest(requests_[i].get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		/* The queue is full, the last request must be rejected. */
+		if (camera_->queueRequest(requests_.back().get()) != -ENOSPC) {
+			cout << "Request queued beyond the queue capacity" << endl;
+			return TestFail;
+		}
+
+		unsigned int nFrames = nBuffers * 2;
+		unsigned int completed = 0;
+
+		while (completed < nFrames) {
+			struct pollfd pfd = { fd, POLLIN, 0 };
+			ret = poll(&pfd, 1, 1000);
+			if (ret <= 0) {
+				cout << "Timeout waiting for completed requests" << endl;
+				return TestFail;
+			}
+
+			std::array<Request *, 4> batch;
+			size_t count = camera_->popCompletedRequests(batch);
+
+			for (size_t i = 0; i < count; i++) {
+				Request *request = batch[i];
+
+				if (request->status() != Request::RequestComplete) {
+					cout << "Request failed" << endl;
+					return TestFail;
+				}
+
+				completed++;
+
+				request->reuse(Request::ReuseBuffers);
+				if (camera_->queueRequest(request)) {
+					cout << "Failed to requeue request" << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		/* Requests cancelled by stop() are still held by the queue. */
+		if (camera_->enableCompletionQueue(0) != -EBUSY) {
+			cout << "Completion queue disabled with pending requests" << endl;
+			return TestFail;
+		}
+
+		std::array<Request *, 8> batch;
+		while (camera_->popCompletedRequests(batch))
+			;
+
+		if (camera_->enableCompletionQueue(0)) {
+			cout << "Failed to disable completion queue" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	FrameBufferAllocator *allocator_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(CompletionQueueTest)
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Test the delta metadata mode
+ */
+
+#include <iostream>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class MetadataDelta : public CameraTest, public Test
+{
+public:
+	MetadataDelta()
+		: CameraTest("platform/vimc.0 Sensor B"), state_(controls::controls)
+	{
+	}
+
+protected:
+	static constexpr unsigned int kNumFrames = 10;
+
+	void requestComplete(Request *request)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		const ControlList &metadata = request->metadata();
+
+		/* The timestamp changes on every frame, it's always reported. */
+		if (!metadata.contains(controls::SensorTimestamp.id())) {
+			cout << "Missing timestamp in request "
+			     << request->sequence() << endl;
+			status_ = TestFail;
+		}
+
+		for (const auto &[id, value] : metadata) {
+			if (state_.contains(id) && state_.get(id) == value) {
+				cout << "Unchanged control " << id
+				     << " reported in request " << request->sequence()
+				     << endl;
+				status_ = TestFail;
+			}
+		}
+
+		state_.merge(metadata, ControlList::MergePolicy::OverwriteExisting);
+		completeRequestsCount_++;
+
+		const Request::BufferMap &buffers = request->buffers();
+		const Stream *stream = buffers.begin()->first;
+		FrameBuffer *buffer = buffers.begin()->second;
+
+		request->reuse();
+		request->addBuffer(stream, buffer);
+		camera_->queueRequest(request);
+
+		dispatcher_->interrupt();
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		config_->metadataMode = CameraConfiguration::MetadataMode::Delta;
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+		if (allocator_->allocate(stream) < 0)
+			return TestFail;
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			requests_.push_back(std::move(request));
+		}
+
+		completeRequestsCount_ = 0;
+		camera_->requestCompleted.connect(this, &MetadataDelta::requestComplete);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			if (camera_->queueRequest(request.get())) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		Timer timer;
+		timer.start(500ms * kNumFrames);
+		while (timer.isRunning() && completeRequestsCount_ < kNumFrames)
+			dispatcher_->processEvents();
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (completeRequestsCount_ < kNumFrames) {
+			cout << "Failed to capture enough frames" << endl;
+			return TestFail;
+		}
+
+		return status_;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+
+	ControlList state_;
+	unsigned int completeRequestsCount_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(MetadataDelta)
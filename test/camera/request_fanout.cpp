@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Test distribution of requests to multiple consumers
+ */
+
+#include <iostream>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer_allocator.h>
+#include <libcamera/request_fanout.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class RequestFanoutTest : public CameraTest, public Test
+{
+public:
+	RequestFanoutTest()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	static constexpr unsigned int kNumFrames = 10;
+
+	void requestAvailable(unsigned int consumer)
+	{
+		/* The slow consumer never acquires requests. */
+		if (consumer != fastConsumer_)
+			return;
+
+		const Request *request = fanout_->acquire(consumer);
+		if (!request) {
+			cout << "No request available" << endl;
+			status_ = TestFail;
+			return;
+		}
+
+		if (!request->metadata().contains(controls::SensorTimestamp.id())) {
+			cout << "Missing timestamp in request "
+			     << request->sequence() << endl;
+			status_ = TestFail;
+		}
+
+		completeRequestsCount_++;
+		fanout_->release(request);
+
+		dispatcher_->interrupt();
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 1) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		fanout_ = std::make_unique<RequestFanout>(camera_);
+		dispatcher_ = Thread::current()->eventDispatcher();
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream = config_->at(0).stream();
+		if (allocator_->allocate(stream) < 0)
+			return TestFail;
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get())) {
+				cout << "Failed to create request" << endl;
+				return TestFail;
+			}
+
+			if (fanout_->addRequest(std::move(request))) {
+				cout << "Failed to add request" << endl;
+				return TestFail;
+			}
+		}
+
+		int fast = fanout_->addConsumer(1, RequestFanout::DropPolicy::DropOldest);
+		int slow = fanout_->addConsumer(1, RequestFanout::DropPolicy::DropOldest);
+		if (fast < 0 || slow < 0) {
+			cout << "Failed to add consumers" << endl;
+			return TestFail;
+		}
+
+		fastConsumer_ = fast;
+		completeRequestsCount_ = 0;
+		fanout_->requestAvailable.connect(this, &RequestFanoutTest::requestAvailable);
+
+		if (fanout_->start()) {
+			cout << "Failed to start the fan-out" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The slow consumer holds one request at most, the others must
+		 * keep flowing to the fast consumer.
+		 */
+		Timer timer;
+		timer.start(500ms * kNumFrames);
+		while (timer.isRunning() && completeRequestsCount_ < kNumFrames)
+			dispatcher_->processEvents();
+
+		if (fanout_->stop()) {
+			cout << "Failed to stop the fan-out" << endl;
+			return TestFail;
+		}
+
+		if (completeRequestsCount_ < kNumFrames) {
+			cout << "Failed to capture enough frames" << endl;
+			return TestFail;
+		}
+
+		const Request *request = fanout_->acquire(slow);
+		if (!request || fanout_->acquire(slow)) {
+			cout << "Invalid slow consumer queue" << endl;
+			return TestFail;
+		}
+
+		fanout_->release(request);
+
+		return status_;
+	}
+
+	EventDispatcher *dispatcher_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+
+	std::unique_ptr<RequestFanout> fanout_;
+	unsigned int fastConsumer_;
+	unsigned int completeRequestsCount_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(RequestFanoutTest)
@@ -32,6 +32,9 @@ protected:
 		if (camera_->configure(defconf_.get()) != -EACCES)
 			return TestFail;
 
+		if (camera_->reconfigure(defconf_.get()) != -EACCES)
+			return TestFail;
+
 		if (camera_->createRequest())
 			return TestFail;
 
@@ -62,6 +65,9 @@ protected:
 		if (camera_->acquire() != -EBUSY)
 			return TestFail;
 
+		if (camera_->reconfigure(defconf_.get()) != -EACCES)
+			return TestFail;
+
 		if (camera_->createRequest())
 			return TestFail;
 
@@ -104,6 +110,9 @@ protected:
 		if (!request2)
 			return TestFail;
 
+		if (camera_->reconfigure(defconf_.get()))
+			return TestFail;
+
 		if (camera_->stop())
 			return TestFail;
 
@@ -141,6 +150,9 @@ protected:
 		if (camera_->configure(defconf_.get()) != -EACCES)
 			return TestFail;
 
+		if (camera_->reconfigure(defconf_.get()) != -EACCES)
+			return TestFail;
+
 		if (camera_->start() != -EACCES)
 			return TestFail;
 
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Camera configuration validation cache test
+ */
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <libcamera/camera.h>
+#include <libcamera/formats.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/configuration_cache.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+/*
+ * Validation keeps a single stream, aligns its width to 64 pixels and limits
+ * the sensor bit depth to 10.
+ */
+class TestConfiguration : public CameraConfiguration
+{
+public:
+	Status validate() override
+	{
+		Status status = Valid;
+
+		if (config_.size() > 1) {
+			config_.resize(1);
+			status = Adjusted;
+		}
+
+		StreamConfiguration &cfg = config_[0];
+		Size size = cfg.size.alignedDownTo(64, 1);
+		if (size != cfg.size) {
+			cfg.size = size;
+			status = Adjusted;
+		}
+
+		cfg.stride = size.width;
+		cfg.frameSize = size.width * size.height;
+
+		if (sensorConfig && sensorConfig->bitDepth > 10) {
+			sensorConfig->bitDepth = 10;
+			status = Adjusted;
+		}
+
+		return status;
+	}
+
+	void restore(const TestConfiguration &other)
+	{
+		ConfigurationCache::restore(other, this, &config_);
+	}
+};
+
+unique_ptr<TestConfiguration> createConfiguration(const Size &size, unsigned int count = 1)
+{
+	std::map<PixelFormat, std::vector<SizeRange>> formats = {
+		{ formats::R8, { SizeRange{ size } } },
+	};
+
+	auto config = make_unique<TestConfiguration>();
+	for (unsigned int i = 0; i < count; i++) {
+		StreamConfiguration cfg{ StreamFormats{ formats } };
+		cfg.pixelFormat = formats::R8;
+		cfg.size = size;
+		config->addConfiguration(cfg);
+	}
+
+	return config;
+}
+
+} /* namespace */
+
+class ConfigurationCacheTest : public Test
+{
+protected:
+	int testKeys()
+	{
+		unique_ptr<TestConfiguration> a = createConfiguration({ 640, 480 });
+		unique_ptr<TestConfiguration> b = createConfiguration({ 640, 480 });
+
+		if (!(ConfigurationCache::Key(*a) == ConfigurationCache::Key(*b))) {
+			cerr << "Identical configurations have different keys" << endl;
+			return TestFail;
+		}
+
+		/* Output fields don't influence the key. */
+		b->at(0).frameSize = 1234;
+		if (!(ConfigurationCache::Key(*a) == ConfigurationCache::Key(*b))) {
+			cerr << "Frame size changes the key" << endl;
+			return TestFail;
+		}
+
+		b->at(0).bufferCount = 4;
+		if (ConfigurationCache::Key(*a) == ConfigurationCache::Key(*b)) {
+			cerr << "Buffer count doesn't change the key" << endl;
+			return TestFail;
+		}
+
+		b = createConfiguration({ 640, 480 });
+		b->orientation = Orientation::Rotate180;
+		if (ConfigurationCache::Key(*a) == ConfigurationCache::Key(*b)) {
+			cerr << "Orientation doesn't change the key" << endl;
+			return TestFail;
+		}
+
+		b = createConfiguration({ 640, 480 });
+		b->sensorConfig = SensorConfiguration{};
+		if (ConfigurationCache::Key(*a) == ConfigurationCache::Key(*b)) {
+			cerr << "Sensor configuration doesn't change the key" << endl;
+			return TestFail;
+		}
+
+		b = createConfiguration({ 640, 480 }, 2);
+		if (ConfigurationCache::Key(*a) == ConfigurationCache::Key(*b)) {
+			cerr << "Number of streams doesn't change the key" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testLookup()
+	{
+		ConfigurationCache cache(2);
+		CameraConfiguration::Status status;
+
+		unique_ptr<TestConfiguration> config = createConfiguration({ 650, 480 }, 2);
+		ConfigurationCache::Key key(*config);
+
+		if (cache.lookup(key, &status)) {
+			cerr << "Empty cache returned a configuration" << endl;
+			return TestFail;
+		}
+
+		CameraConfiguration::Status result = config->validate();
+		cache.insert(std::move(key), make_unique<TestConfiguration>(*config), result);
+
+		/* An identical configuration shall be restored from the cache. */
+		unique_ptr<TestConfiguration> other = createConfiguration({ 650, 480 }, 2);
+		shared_ptr<const CameraConfiguration> cached =
+			cache.lookup(ConfigurationCache::Key(*other), &status);
+		if (!cached || status != CameraConfiguration::Adjusted) {
+			cerr << "Validated configuration not cached" << endl;
+			return TestFail;
+		}
+
+		other->restore(static_cast<const TestConfiguration &>(*cached));
+
+		if (other->size() != 1 || other->at(0).size != Size(640, 480) ||
+		    other->at(0).stride != 640 ||
+		    other->at(0).frameSize != 640 * 480) {
+			cerr << "Restored configuration " << other->at(0).toString()
+			     << " doesn't match the validated one" << endl;
+			return TestFail;
+		}
+
+		if (other->at(0).formats().sizes(formats::R8) !=
+		    std::vector<Size>{ Size(650, 480) }) {
+			cerr << "Stream formats not preserved" << endl;
+			return TestFail;
+		}
+
+		/* Adjusted sensor configurations shall be restored. */
+		config = createConfiguration({ 640, 480 });
+		config->sensorConfig = SensorConfiguration{};
+		config->sensorConfig->bitDepth = 12;
+		ConfigurationCache::Key sensorKey(*config);
+		result = config->validate();
+		cache.insert(std::move(sensorKey), make_unique<TestConfiguration>(*config), result);
+
+		other = createConfiguration({ 640, 480 });
+		other->sensorConfig = SensorConfiguration{};
+		other->sensorConfig->bitDepth = 12;
+		cached = cache.lookup(ConfigurationCache::Key(*other), &status);
+		if (!cached || status != CameraConfiguration::Adjusted) {
+			cerr << "Sensor configuration not cached" << endl;
+			return TestFail;
+		}
+
+		other->restore(static_cast<const TestConfiguration &>(*cached));
+
+		if (!other->sensorConfig || other->sensorConfig->bitDepth != 10) {
+			cerr << "Sensor configuration not restored" << endl;
+			return TestFail;
+		}
+
+		/* The least recently inserted entry shall be evicted. */
+		for (unsigned int width : { 320, 160 }) {
+			config = createConfiguration({ width, 240 });
+			ConfigurationCache::Key k(*config);
+			result = config->validate();
+			cache.insert(std::move(k), make_unique<TestConfiguration>(*config), result);
+		}
+
+		other = createConfiguration({ 650, 480 }, 2);
+		if (cache.lookup(ConfigurationCache::Key(*other), &status)) {
+			cerr << "Oldest entry not evicted" << endl;
+			return TestFail;
+		}
+
+		other = createConfiguration({ 320, 240 });
+		if (!cache.lookup(ConfigurationCache::Key(*other), &status) ||
+		    status != CameraConfiguration::Valid) {
+			cerr << "Recent entry evicted" << endl;
+			return TestFail;
+		}
+
+		cache.clear();
+		if (cache.lookup(ConfigurationCache::Key(*other), &status)) {
+			cerr << "Entry not cleared" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		if (testKeys() != TestPass)
+			return TestFail;
+
+		if (testLookup() != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ConfigurationCacheTest)
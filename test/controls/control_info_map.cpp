@@ -82,6 +82,37 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Test that all entries of a copy can be looked up by numerical
+		 * ID, and that lookups point to the copy, not to the original.
+		 */
+		const ControlInfoMap copyInfoMap = infoMap;
+		for (auto it = copyInfoMap.begin(); it != copyInfoMap.end(); ++it) {
+			if (copyInfoMap.find(it->first->id()) != it) {
+				cerr << "find() on copied ControlInfoMap failed" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Test lookups in a map with IDs in distinct ranges. */
+		const ControlInfoMap sparseInfoMap({
+			{ &controls::Brightness, ControlInfo(-1.0f, 1.0f) },
+			{ &controls::draft::NoiseReductionMode,
+			  ControlInfo(controls::draft::NoiseReductionModeValues) },
+		}, controls::controls);
+
+		if (sparseInfoMap.count(controls::Brightness.id()) != 1 ||
+		    sparseInfoMap.count(controls::draft::NoiseReductionMode.id()) != 1) {
+			cerr << "count() on sparse ControlInfoMap failed" << endl;
+			return TestFail;
+		}
+
+		if (sparseInfoMap.count(controls::Contrast.id()) != 0 ||
+		    sparseInfoMap.count(controls::draft::NoiseReductionMode.id() + 1) != 0) {
+			cerr << "count() on sparse ControlInfoMap hole failed" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
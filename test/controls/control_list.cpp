@@ -246,6 +246,34 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Add controls in decreasing ID order and verify that iteration
+		 * visits them in ascending ID order.
+		 */
+		list.clear();
+		list.set(controls::Saturation, 0.4f);
+		list.set(controls::Contrast, 1.1f);
+		list.set(controls::Brightness, 0.5f);
+
+		unsigned int previous = 0;
+		for (const auto &[id, value] : list) {
+			if (id <= previous) {
+				cout << "List iteration is not sorted by control ID"
+				     << endl;
+				return TestFail;
+			}
+
+			previous = id;
+		}
+
+		if (list.size() != 3 || list.get(controls::Saturation) != 0.4f ||
+		    list.get(controls::Contrast) != 1.1f ||
+		    list.get(controls::Brightness) != 0.5f) {
+			cout << "Failed to retrieve controls added out of order"
+			     << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 };
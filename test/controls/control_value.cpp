@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <numeric>
 
 #include <libcamera/controls.h>
 
@@ -257,6 +258,40 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Copy and move values stored inline and in allocated memory,
+		 * and switch between both storages.
+		 */
+		std::array<float, 9> matrix{ 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+		std::array<int64_t, 16> large{};
+		std::iota(large.begin(), large.end(), 0);
+
+		for (unsigned int i = 0; i < 2; ++i) {
+			ControlValue source;
+			if (i == 0)
+				source.set(Span<const float>(matrix));
+			else
+				source.set(Span<const int64_t>(large));
+
+			ControlValue copy(source);
+			if (copy != source) {
+				cerr << "Control value mismatch after copy" << endl;
+				return TestFail;
+			}
+
+			ControlValue moved(std::move(source));
+			if (moved != copy || !source.isNone()) {
+				cerr << "Control value mismatch after move" << endl;
+				return TestFail;
+			}
+
+			value = std::move(moved);
+			if (value != copy || !moved.isNone()) {
+				cerr << "Control value mismatch after move assignment" << endl;
+				return TestFail;
+			}
+		}
+
 		return TestPass;
 	}
 };
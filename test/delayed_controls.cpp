@@ -267,6 +267,127 @@ protected:
 		return TestPass;
 	}
 
+	int singleControlWithCookie()
+	{
+		std::unordered_map<uint32_t, DelayedControls::ControlParams> delays = {
+			{ V4L2_CID_BRIGHTNESS, { 1, false } },
+		};
+		std::unique_ptr<DelayedControls> delayed =
+			std::make_unique<DelayedControls>(dev_.get(), delays);
+		ControlList ctrls;
+
+		/* Reset control to value that will be first in test. */
+		int32_t expected = 4;
+		unsigned int expectedCookie = 1000;
+		ctrls.set(V4L2_CID_BRIGHTNESS, expected);
+		dev_->setControls(&ctrls);
+		delayed->reset(expectedCookie);
+
+		/* Trigger the first frame start event */
+		delayed->applyControls(0);
+
+		/* Test the cookie follows the controls it has been pushed with. */
+		for (unsigned int i = 1; i < 100; i++) {
+			int32_t value = 10 + i;
+			unsigned int cookie = 1000 + i;
+
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			delayed->push(ctrls, cookie);
+
+			delayed->applyControls(i);
+
+			ControlList result = delayed->get(i, &cookie);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			if (brightness != expected || cookie != expectedCookie) {
+				cerr << "Failed single control with cookie"
+				     << " frame " << i
+				     << " expected " << expected
+				     << " cookie " << expectedCookie
+				     << " got " << brightness
+				     << " cookie " << cookie
+				     << endl;
+				return TestFail;
+			}
+
+			expected = value;
+			expectedCookie = 1000 + i;
+		}
+
+		return TestPass;
+	}
+
+	int dualControlsTargetFrame()
+	{
+		static const unsigned int maxDelay = 2;
+
+		std::unordered_map<uint32_t, DelayedControls::ControlParams> delays = {
+			{ V4L2_CID_BRIGHTNESS, { 1, false } },
+			{ V4L2_CID_CONTRAST, { maxDelay, false } }
+		};
+		std::unique_ptr<DelayedControls> delayed =
+			std::make_unique<DelayedControls>(dev_.get(), delays);
+		ControlList ctrls;
+
+		ctrls.set(V4L2_CID_BRIGHTNESS, 100);
+		ctrls.set(V4L2_CID_CONTRAST, 100);
+		dev_->setControls(&ctrls);
+		delayed->reset();
+
+		/* Trigger the first frame start event */
+		delayed->applyControls(0);
+
+		/*
+		 * Queue controls out of order for frames 5 and 4, and for frame
+		 * 0 which is too late and can only make it to frame 3.
+		 */
+		const std::vector<std::pair<uint32_t, uint32_t>> targets = {
+			{ 5, 5 }, { 4, 4 }, { 0, 3 },
+		};
+
+		for (const auto &[target, frame] : targets) {
+			ctrls.set(V4L2_CID_BRIGHTNESS, static_cast<int32_t>(10 * frame));
+			ctrls.set(V4L2_CID_CONTRAST, static_cast<int32_t>(10 * frame));
+
+			std::optional<uint32_t> achieved = delayed->pushAt(target, ctrls);
+			if (achieved != frame) {
+				cerr << "Failed target frame"
+				     << " target " << target
+				     << " expected " << frame
+				     << " got " << achieved.value_or(0)
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		/* Controls far beyond the history size must be rejected. */
+		if (delayed->pushAt(1000, ctrls)) {
+			cerr << "Failed to reject target frame out of history" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 1; i < 8; i++) {
+			int32_t expected = i < 3 ? 100 : 10 * std::min(i, 5U);
+
+			delayed->applyControls(i);
+
+			ControlList result = delayed->get(i);
+
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			int32_t contrast = result.get(V4L2_CID_CONTRAST).get<int32_t>();
+			if (brightness != expected || contrast != expected) {
+				cerr << "Failed target frame"
+				     << " frame " << i
+				     << " brightness " << brightness
+				     << " contrast " << contrast
+				     << " expected " << expected
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
 	int run() override
 	{
 		int ret;
@@ -291,6 +412,16 @@ protected:
 		if (ret)
 			return ret;
 
+		/* Test cookies associated with the control values. */
+		ret = singleControlWithCookie();
+		if (ret)
+			return ret;
+
+		/* Test controls queued for target frames. */
+		ret = dualControlsTargetFrame();
+		if (ret)
+			return ret;
+
 		return TestPass;
 	}
 
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * libcamera internal DmaBufAllocator buffer pool tests
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/dma_buf_allocator.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+class DmaBufPoolTest : public Test
+{
+protected:
+	static constexpr int kNumBuffers = 4;
+
+	int init() override
+	{
+		allocator_ = make_unique<DmaBufAllocator>(DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+							  DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+							  DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf);
+		if (!allocator_->isValid()) {
+			cout << "No dma-buf provider available" << endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	static ino_t inode(const FrameBuffer &buffer)
+	{
+		struct stat st;
+		if (fstat(buffer.planes()[0].fd.get(), &st) < 0)
+			return 0;
+
+		return st.st_ino;
+	}
+
+	int run() override
+	{
+		const vector<unsigned int> planeSizes = { 640 * 480, 640 * 480 / 2 };
+		vector<unique_ptr<FrameBuffer>> buffers;
+
+		/* The pool shall be disabled by default. */
+		int ret = allocator_->exportBuffers(1, planeSizes, &buffers);
+		if (ret != 1) {
+			cout << "Failed to export buffers" << endl;
+			return TestFail;
+		}
+
+		buffers.clear();
+
+		if (allocator_->poolSize() != 0) {
+			cout << "Buffer pooled with the pool disabled" << endl;
+			return TestFail;
+		}
+
+		allocator_->setPoolLimit(kNumBuffers * 1024 * 1024);
+
+		ret = allocator_->exportBuffers(kNumBuffers, planeSizes, &buffers);
+		if (ret != kNumBuffers) {
+			cout << "Failed to export buffers" << endl;
+			return TestFail;
+		}
+
+		if (buffers[0]->planes().size() != 2 ||
+		    buffers[0]->planes()[1].offset != planeSizes[0]) {
+			cout << "Invalid plane layout" << endl;
+			return TestFail;
+		}
+
+		vector<ino_t> inodes;
+		for (const unique_ptr<FrameBuffer> &buffer : buffers)
+			inodes.push_back(inode(*buffer));
+
+		buffers.clear();
+
+		if (allocator_->poolSize() < kNumBuffers * (planeSizes[0] + planeSizes[1])) {
+			cout << "Freed buffers not returned to the pool" << endl;
+			return TestFail;
+		}
+
+		/* Buffers of the same size class shall be reused. */
+		ret = allocator_->exportBuffers(kNumBuffers, { 640 * 480 * 3 / 2 }, &buffers);
+		if (ret != kNumBuffers || allocator_->poolSize() != 0) {
+			cout << "Pooled buffers not reused" << endl;
+			return TestFail;
+		}
+
+		for (const unique_ptr<FrameBuffer> &buffer : buffers) {
+			if (find(inodes.begin(), inodes.end(), inode(*buffer)) == inodes.end()) {
+				cout << "Buffer not allocated from the pool" << endl;
+				return TestFail;
+			}
+		}
+
+		buffers.clear();
+
+		allocator_->trimPool();
+		if (allocator_->poolSize() != 0) {
+			cout << "Failed to trim the pool" << endl;
+			return TestFail;
+		}
+
+		/* Buffers still referenced when destroyed shall not be pooled. */
+		ret = allocator_->exportBuffers(2, planeSizes, &buffers);
+		if (ret != 2) {
+			cout << "Failed to export buffers" << endl;
+			return TestFail;
+		}
+
+		UniqueFD fd = buffers[0]->planes()[0].fd.dup();
+		void *map = mmap(nullptr, planeSizes[0], PROT_READ, MAP_SHARED,
+				 buffers[1]->planes()[0].fd.get(), 0);
+		if (!fd.isValid() || map == MAP_FAILED) {
+			cout << "Failed to reference the buffers" << endl;
+			return TestFail;
+		}
+
+		buffers.clear();
+
+		munmap(map, planeSizes[0]);
+		fd.reset();
+
+		if (allocator_->poolSize() != 0) {
+			cout << "Referenced buffers returned to the pool" << endl;
+			return TestFail;
+		}
+
+		/* Buffers outliving the allocator shall be freed safely. */
+		ret = allocator_->exportBuffers(1, planeSizes, &buffers);
+		if (ret != 1) {
+			cout << "Failed to export buffers" << endl;
+			return TestFail;
+		}
+
+		allocator_.reset();
+		buffers.clear();
+
+		return TestPass;
+	}
+
+private:
+	unique_ptr<DmaBufAllocator> allocator_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(DmaBufPoolTest)
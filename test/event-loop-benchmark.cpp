@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Event loop, signal and cross-thread invocation benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/event_notifier.h>
+#include <libcamera/base/object.h>
+#include <libcamera/base/signal.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+#include <libcamera/base/unique_fd.h>
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace {
+
+/* Report the median of several runs to keep the results stable. */
+constexpr unsigned int kRuns = 5;
+
+template<typename Func>
+double measure(unsigned int iterations, Func func)
+{
+	func(iterations / 10);
+
+	vector<double> results;
+
+	for (unsigned int run = 0; run < kRuns; run++) {
+		auto start = steady_clock::now();
+		func(iterations);
+		auto duration = duration_cast<nanoseconds>(steady_clock::now() - start);
+		results.push_back(static_cast<double>(duration.count()) / iterations);
+	}
+
+	sort(results.begin(), results.end());
+	return results[kRuns / 2];
+}
+
+void printResult(const string &name, double ns)
+{
+	cout << left << setw(40) << name
+	     << right << fixed << setprecision(1)
+	     << setw(10) << ns << " ns/op" << endl;
+}
+
+class Receiver : public Object
+{
+public:
+	Receiver()
+		: count_(0)
+	{
+	}
+
+	void slot(unsigned int value)
+	{
+		count_ += value;
+	}
+
+	unsigned int count() const { return count_; }
+
+private:
+	unsigned int count_;
+};
+
+class EventLoopBenchmark : public Test
+{
+protected:
+	int benchmarkInvoke()
+	{
+		Thread thread;
+		Receiver receiver;
+
+		receiver.moveToThread(&thread);
+		thread.start();
+
+		/*
+		 * Queued invocations are posted in bursts, and flushed with a
+		 * blocking invocation, to measure the cost per message.
+		 */
+		double ns = measure(100000, [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				receiver.invokeMethod(&Receiver::slot,
+						      ConnectionTypeQueued, 1);
+			receiver.invokeMethod(&Receiver::slot,
+					      ConnectionTypeBlocking, 0);
+		});
+		printResult("invokeMethod queued", ns);
+
+		/* Blocking invocations measure the round-trip latency. */
+		ns = measure(10000, [&](unsigned int iterations) {
+			for (unsigned int i = 0; i < iterations; i++)
+				receiver.invokeMethod(&Receiver::slot,
+						      ConnectionTypeBlocking, 1);
+		});
+		printResult("invokeMethod blocking", ns);
+
+		thread.exit(0);
+		thread.wait();
+
+		return TestPass;
+	}
+
+	int benchmarkSignal()
+	{
+		for (unsigned int numSlots : { 1U, 8U, 64U }) {
+			vector<unique_ptr<Receiver>> receivers;
+			Signal<unsigned int> signal;
+
+			for (unsigned int i = 0; i < numSlots; i++) {
+				receivers.push_back(make_unique<Receiver>());
+				signal.connect(receivers.back().get(), &Receiver::slot);
+			}
+
+			double ns = measure(100000, [&](unsigned int iterations) {
+				for (unsigned int i = 0; i < iterations; i++)
+					signal.emit(1);
+			});
+			printResult("Signal::emit " + to_string(numSlots) + " slots", ns);
+
+			/* Slots without a receiver object. */
+			Signal<unsigned int> functorSignal;
+			unsigned int count = 0;
+
+			for (unsigned int i = 0; i < numSlots; i++)
+				functorSignal.connect(this, [&count](unsigned int value) {
+					count += value;
+				});
+
+			ns = measure(100000, [&](unsigned int iterations) {
+				for (unsigned int i = 0; i < iterations; i++)
+					functorSignal.emit(1);
+			});
+			printResult("Signal::emit " + to_string(numSlots) + " functors", ns);
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Measure the time from an event on one file descriptor to its
+	 * notifier being activated, while the dispatcher watches many other
+	 * idle file descriptors.
+	 */
+	int benchmarkDispatcher()
+	{
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+
+		for (unsigned int numNotifiers : { 1U, 16U, 256U }) {
+			vector<UniqueFD> fds;
+			vector<unique_ptr<EventNotifier>> notifiers;
+			unsigned int activations = 0;
+
+			for (unsigned int i = 0; i < numNotifiers; i++) {
+				UniqueFD fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+				if (!fd.isValid()) {
+					cerr << "Failed to create eventfd" << endl;
+					return TestFail;
+				}
+
+				auto notifier = make_unique<EventNotifier>(fd.get(),
+									   EventNotifier::Read);
+				notifier->activated.connect(this, [&activations, fd = fd.get()]() {
+					uint64_t value;
+					if (read(fd, &value, sizeof(value)) == sizeof(value))
+						activations++;
+				});
+
+				fds.push_back(std::move(fd));
+				notifiers.push_back(std::move(notifier));
+			}
+
+			const int fd = fds.back().get();
+			bool failed = false;
+
+			double ns = measure(10000, [&](unsigned int iterations) {
+				const uint64_t value = 1;
+
+				for (unsigned int i = 0; i < iterations; i++) {
+					unsigned int expected = activations + 1;
+
+					if (write(fd, &value, sizeof(value)) != sizeof(value)) {
+						failed = true;
+						return;
+					}
+
+					while (activations != expected)
+						dispatcher->processEvents();
+				}
+			});
+
+			if (failed) {
+				cerr << "Failed to signal eventfd" << endl;
+				return TestFail;
+			}
+
+			printResult("EventDispatcher wakeup " +
+				    to_string(numNotifiers) + " notifiers", ns);
+		}
+
+		return TestPass;
+	}
+
+	int benchmarkTimers()
+	{
+		for (unsigned int numTimers : { 1U, 64U, 1024U }) {
+			vector<unique_ptr<Timer>> timers;
+			for (unsigned int i = 0; i < numTimers; i++)
+				timers.push_back(make_unique<Timer>());
+
+			/*
+			 * Arm all timers and cancel them, as done for request
+			 * and frame timeouts. The cost grows with the number
+			 * of armed timers.
+			 */
+			double ns = measure(numTimers * 100, [&](unsigned int iterations) {
+				for (unsigned int i = 0; i < iterations; i += numTimers) {
+					for (auto &timer : timers)
+						timer->start(1s);
+					for (auto &timer : timers)
+						timer->stop();
+				}
+			});
+			printResult("Timer start/stop " + to_string(numTimers) + " timers", ns);
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (benchmarkInvoke() != TestPass ||
+		    benchmarkSignal() != TestPass ||
+		    benchmarkDispatcher() != TestPass ||
+		    benchmarkTimers() != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+};
+
+} /* namespace */
+
+TEST_REGISTER(EventLoopBenchmark)
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Frame timing monitor test
+ */
+
+#include <chrono>
+#include <iostream>
+
+#include <libcamera/base/object.h>
+
+#include "libcamera/internal/frame_timing_monitor.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+class FrameTimingMonitorTest : public Test, public Object
+{
+protected:
+	static constexpr uint64_t kFrameDuration = 33333000;
+
+	void degradedChanged(bool degraded)
+	{
+		transitions_++;
+		degraded_ = degraded;
+	}
+
+	int run()
+	{
+		FrameTimingMonitor monitor("camera0");
+		monitor.degradedChanged.connect(this, &FrameTimingMonitorTest::degradedChanged);
+
+		transitions_ = 0;
+		degraded_ = false;
+
+		/* Regular frames with a small jitter. */
+		uint64_t timestamp = 1000000000;
+		uint32_t sequence;
+		for (sequence = 0; sequence < 200; sequence++) {
+			monitor.frameCompleted(sequence, timestamp + (sequence % 2) * 100000,
+					       33333us);
+			timestamp += kFrameDuration;
+		}
+
+		if (monitor.lateFrames() || monitor.droppedFrames() || transitions_) {
+			cerr << "Regular frames reported as missed" << endl;
+			return TestFail;
+		}
+
+		/* Dropped frames shall be counted, but not as late. */
+		sequence += 2;
+		timestamp += 2 * kFrameDuration;
+		monitor.frameCompleted(sequence++, timestamp, 33333us);
+		timestamp += kFrameDuration;
+
+		if (monitor.droppedFrames() != 2 || monitor.lateFrames()) {
+			cerr << "Dropped frames not detected: "
+			     << monitor.droppedFrames() << " dropped, "
+			     << monitor.lateFrames() << " late" << endl;
+			return TestFail;
+		}
+
+		/* Late frames degrade the timing. */
+		for (unsigned int i = 0; i < 8; i++) {
+			timestamp += kFrameDuration / 2;
+			monitor.frameCompleted(sequence++, timestamp, 33333us);
+			timestamp += kFrameDuration;
+			monitor.frameCompleted(sequence++, timestamp, 33333us);
+			timestamp += kFrameDuration;
+		}
+
+		if (monitor.lateFrames() != 8 || !monitor.degraded() ||
+		    transitions_ != 1 || !degraded_) {
+			cerr << "Late frames not detected: "
+			     << monitor.lateFrames() << " late" << endl;
+			return TestFail;
+		}
+
+		/* The timing recovers once the misses leave the window. */
+		for (unsigned int i = 0; i < FrameTimingMonitor::kWindowSize; i++) {
+			monitor.frameCompleted(sequence++, timestamp, 33333us);
+			timestamp += kFrameDuration;
+		}
+
+		if (monitor.degraded() || transitions_ != 2 || degraded_) {
+			cerr << "Frame timing didn't recover" << endl;
+			return TestFail;
+		}
+
+		/* The frame duration is estimated when not reported. */
+		monitor.reset();
+		for (unsigned int i = 0; i < 100; i++) {
+			monitor.frameCompleted(sequence++, timestamp, {});
+			timestamp += kFrameDuration;
+		}
+
+		timestamp += kFrameDuration / 2;
+		monitor.frameCompleted(sequence++, timestamp, {});
+
+		if (monitor.lateFrames() != 9) {
+			cerr << "Late frame not detected with estimated duration" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	unsigned int transitions_;
+	bool degraded_;
+};
+
+TEST_REGISTER(FrameTimingMonitorTest)
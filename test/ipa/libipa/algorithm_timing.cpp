@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Per-algorithm execution time instrumentation test
+ */
+
+#include "../src/ipa/libipa/algorithm_timing.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace ipa;
+
+namespace {
+
+const Metric::Sample *findSample(const std::vector<Metric::Sample> &samples,
+				 const std::string &name,
+				 const std::string &camera)
+{
+	auto it = std::find_if(samples.begin(), samples.end(),
+			       [&](const Metric::Sample &s) {
+				       return s.name == name && s.camera == camera;
+			       });
+	return it != samples.end() ? &*it : nullptr;
+}
+
+} /* namespace */
+
+class AlgorithmTimingTest : public Test
+{
+protected:
+	int init()
+	{
+		setenv("LIBCAMERA_IPA_ALGORITHM_TIMING", "1", 1);
+		return TestPass;
+	}
+
+	int run()
+	{
+		if (!AlgorithmTiming::enabled()) {
+			cerr << "Instrumentation not enabled" << endl;
+			return TestFail;
+		}
+
+		AlgorithmTiming timing("test", "Agc");
+
+		for (unsigned int i = 0; i < 3; i++) {
+			AlgorithmTiming::Measurement m =
+				timing.measure(AlgorithmTiming::Stage::Process);
+		}
+
+		std::vector<Metric::Sample> samples = Metric::snapshot();
+
+		const Metric::Sample *s =
+			findSample(samples, "ipa_algorithm_process_seconds", "test/Agc");
+		if (!s || s->type != Metric::Type::Histogram || s->count != 3) {
+			cerr << "Invalid process timing sample" << endl;
+			return TestFail;
+		}
+
+		s = findSample(samples, "ipa_algorithm_prepare_seconds", "test/Agc");
+		if (!s || s->count != 0) {
+			cerr << "Invalid prepare timing sample" << endl;
+			return TestFail;
+		}
+
+		/* Measurements without a histogram are no-ops. */
+		{
+			AlgorithmTiming::Measurement m(nullptr);
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(AlgorithmTimingTest)
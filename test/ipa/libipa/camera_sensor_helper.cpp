@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Camera sensor helper gain code tables tests
+ */
+
+#include "../src/ipa/libipa/camera_sensor_helper.h"
+
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace ipa;
+
+class CameraSensorHelperTest : public Test
+{
+protected:
+	int testHelper(const string &name, uint32_t minCode, uint32_t maxCode)
+	{
+		unique_ptr<CameraSensorHelper> helper =
+			CameraSensorHelperFactoryBase::create(name);
+		if (!helper) {
+			cerr << "Failed to create " << name << " helper" << endl;
+			return TestFail;
+		}
+
+		/* Record the results of the gain model. */
+		vector<double> gains;
+		vector<uint32_t> codes;
+		for (uint32_t code = minCode; code <= maxCode; code++) {
+			gains.push_back(helper->gain(code));
+			codes.push_back(helper->gainCode(gains.back()));
+		}
+
+		helper->setGainCodeRange(minCode, maxCode);
+
+		for (uint32_t code = minCode; code <= maxCode; code++) {
+			unsigned int index = code - minCode;
+
+			if (helper->gain(code) != gains[index]) {
+				cerr << name << ": gain of code " << code
+				     << " doesn't match the model" << endl;
+				return TestFail;
+			}
+
+			/*
+			 * The tables return a code realizing the exact gain,
+			 * or the same code as the model for the gains it
+			 * refuses.
+			 */
+			uint32_t tableCode = helper->gainCode(gains[index]);
+			if (helper->gain(tableCode) != gains[index] &&
+			    tableCode != codes[index]) {
+				cerr << name << ": code of gain " << gains[index]
+				     << " is " << tableCode << ", model "
+				     << codes[index] << endl;
+				return TestFail;
+			}
+
+			/* Realizable gains between two steps round down. */
+			if (code < maxCode && gains[index + 1] > gains[index] &&
+			    helper->gain(tableCode) == gains[index]) {
+				double gain = (gains[index] + gains[index + 1]) / 2;
+				if (helper->gain(helper->gainCode(gain)) != gains[index]) {
+					cerr << name << ": gain " << gain
+					     << " not quantized to " << gains[index]
+					     << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/* Gains out of the range are clamped. */
+		if (helper->gainCode(gains.back() * 2) !=
+		    helper->gainCode(gains.back())) {
+			cerr << name << ": gain above range not clamped" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/* Linear, exponential and custom gain models. */
+		if (testHelper("imx219", 0, 232) != TestPass)
+			return TestFail;
+
+		if (testHelper("imx290", 0, 240) != TestPass)
+			return TestFail;
+
+		if (testHelper("ar0144", 0, 0x4f) != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(CameraSensorHelperTest)
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Frame context queue tests
+ */
+
+#include "../src/ipa/libipa/fc_queue.h"
+
+#include <iostream>
+#include <stdint.h>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace ipa;
+
+struct TestFrameContext : public FrameContext {
+	uint32_t value;
+};
+
+class FCQueueTest : public Test
+{
+protected:
+	int testQueue(unsigned int size)
+	{
+		FCQueue<TestFrameContext> queue(size);
+
+		for (uint32_t frame = 1; frame < size * 4; frame++) {
+			TestFrameContext &context = queue.alloc(frame);
+
+			if (reinterpret_cast<uintptr_t>(&context) % 64) {
+				cerr << "Frame context " << frame
+				     << " not aligned" << endl;
+				return TestFail;
+			}
+
+			if (context.value) {
+				cerr << "Frame context " << frame
+				     << " not initialised" << endl;
+				return TestFail;
+			}
+
+			context.value = frame;
+
+			/* Contexts shall be preserved until overwritten. */
+			uint32_t oldest = frame >= size ? frame - size + 1 : 1;
+			for (uint32_t f = oldest; f <= frame; f++) {
+				if (queue.get(f).value != f) {
+					cerr << "Frame context " << f
+					     << " lost at frame " << frame
+					     << " with size " << size << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		/* Test both the power of two and the generic index paths. */
+		if (testQueue(16) != TestPass)
+			return TestFail;
+
+		if (testQueue(5) != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(FCQueueTest)
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Histogram tests
+ */
+
+#include "../src/ipa/libipa/histogram.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace ipa;
+
+class HistogramTest : public Test
+{
+protected:
+	/* Reference implementation, summing the bins one by one. */
+	static double interQuantileMean(const vector<uint32_t> &data,
+					double lowPoint, double highPoint)
+	{
+		double sumBinFreq = 0, cumulFreq = 0;
+
+		for (double pNext = floor(lowPoint) + 1.0;
+		     pNext <= ceil(highPoint);
+		     lowPoint = pNext, pNext += 1.0) {
+			unsigned int bin = floor(lowPoint);
+			double freq = data[bin] * (min(pNext, highPoint) - lowPoint);
+
+			sumBinFreq += bin * freq;
+			cumulFreq += freq;
+		}
+
+		return sumBinFreq / cumulFreq + 0.5;
+	}
+
+	int run()
+	{
+		mt19937 gen(42);
+		Histogram hist;
+
+		if (hist.bins() != 0 || hist.total() != 0) {
+			cerr << "Empty histogram isn't empty" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int bins : { 1U, 2U, 64U, 256U, 1024U }) {
+			vector<uint32_t> data(bins);
+			uniform_int_distribution<uint32_t> dist(0, 1000);
+			uint64_t total = 0;
+
+			for (uint32_t &value : data) {
+				/* Leave some bins empty. */
+				value = dist(gen) < 200 ? 0 : dist(gen);
+				total += value;
+			}
+
+			/* Reuse the same histogram to test in-place updates. */
+			hist.update(data);
+
+			if (hist.bins() != bins || hist.total() != total) {
+				cerr << "Invalid histogram size or total for "
+				     << bins << " bins" << endl;
+				return TestFail;
+			}
+
+			const pair<double, double> quantiles[] = {
+				{ 0.0, 1.0 }, { 0.0, 0.5 }, { 0.25, 0.75 },
+				{ 0.5, 0.51 }, { 0.98, 1.0 }, { 0.1, 0.2 },
+			};
+
+			for (const auto &[low, high] : quantiles) {
+				double lowPoint = hist.quantile(low);
+				double highPoint = hist.quantile(high,
+								 static_cast<uint32_t>(lowPoint));
+				double expected = interQuantileMean(data, lowPoint,
+								    highPoint);
+				double value = hist.interQuantileMean(low, high);
+
+				if (std::abs(value - expected) > 1e-6 * bins) {
+					cerr << "Inter-quantile mean [" << low << ", "
+					     << high << "] of " << bins
+					     << " bins is " << value << ", expected "
+					     << expected << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/* The transform is applied to every bin. */
+		vector<uint32_t> data = { 16, 32, 48, 64 };
+		hist.update(data, [](uint32_t x) { return x >> 4; });
+		if (hist.total() != 10 || hist.cumulativeFrequency(2) != 3) {
+			cerr << "Transform not applied" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(HistogramTest)
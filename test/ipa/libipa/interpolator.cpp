@@ -47,6 +47,14 @@ protected:
 		ASSERT_EQ(interpolator.getInterpolated(24, &q), 200);
 		ASSERT_EQ(q, 20);
 
+		int value = 0;
+		interpolator.setQuantization(0);
+		interpolator.getInterpolated(15, value);
+		ASSERT_EQ(value, 150);
+		interpolator.getInterpolated(30, value, &q);
+		ASSERT_EQ(value, 300);
+		ASSERT_EQ(q, 30);
+
 		return TestPass;
 	}
 };
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Matrix tests
+ */
+
+#include "../src/ipa/libipa/matrix.h"
+
+#include <iostream>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace ipa;
+
+/* The fixed-size operations must be usable in constant expressions. */
+static constexpr Matrix<float, 3, 3> kScaled = Matrix<float, 3, 3>::identity() * 2.0f;
+static_assert(kScaled[1][1] == 2.0f && kScaled[0][1] == 0.0f);
+static_assert((kScaled * kScaled + kScaled)[2][2] == 6.0f);
+static_assert(Matrix<double, 4, 2>::identity().transpose()[1][1] == 1.0);
+
+class MatrixTest : public Test
+{
+protected:
+	int run()
+	{
+		Matrix<double, 2, 3> m({ 1, 2, 3, 4, 5, 6 });
+		Matrix<double, 3, 2> t = m.transpose();
+
+		for (unsigned int i = 0; i < 2; i++) {
+			for (unsigned int j = 0; j < 3; j++) {
+				if (t[j][i] != m[i][j]) {
+					cerr << "Invalid transpose " << t << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		Matrix<double, 2, 2> p = m * t;
+		if (p[0][0] != 14 || p[0][1] != 32 || p[1][0] != 32 || p[1][1] != 77) {
+			cerr << "Invalid product " << p << endl;
+			return TestFail;
+		}
+
+		p *= 0.5;
+		if (p[1][1] != 38.5) {
+			cerr << "Invalid scaled product " << p << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(MatrixTest)
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Piecewise linear function tests
+ */
+
+#include "../src/ipa/libipa/pwl.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace ipa;
+
+class PwlTest : public Test
+{
+protected:
+	int run()
+	{
+		mt19937 gen(42);
+		uniform_real_distribution<double> step(0.001, 2.0);
+		uniform_real_distribution<double> value(-10.0, 10.0);
+
+		/* A function with irregularly spaced points. */
+		Pwl pwl;
+		double x = -5.0;
+		for (unsigned int i = 0; i < 100; i++) {
+			pwl.append(x, value(gen));
+			x += step(gen);
+		}
+
+		Pwl table = pwl;
+
+		for (unsigned int cells : { 0U, 1U, 7U, 4096U }) {
+			table.buildSpanTable(cells);
+
+			uniform_real_distribution<double> input(-10.0, x + 5.0);
+			for (unsigned int i = 0; i < 10000; i++) {
+				double in = input(gen);
+				int span = -1, tableSpan = -1;
+				double expected = pwl.eval(in, &span);
+				double result = table.eval(in, &tableSpan);
+
+				if (result != expected || span != tableSpan) {
+					cerr << "Evaluation at " << in << " with "
+					     << cells << " cells gives " << result
+					     << " in span " << tableSpan
+					     << ", expected " << expected
+					     << " in span " << span << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		/* Adding points discards the table. */
+		pwl.append(x + 1.0, 100.0);
+		table.append(x + 1.0, 100.0);
+		if (table.eval(x + 0.5) != pwl.eval(x + 0.5)) {
+			cerr << "Stale lookup table after append" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(PwlTest)
@@ -0,0 +1,217 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * IPC pipe round-trip latency and throughput benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/shared_fd.h>
+#include <libcamera/base/thread.h>
+
+#include "libcamera/internal/ipc_pipe.h"
+#include "libcamera/internal/ipc_pipe_unixsocket.h"
+#include "libcamera/internal/process.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+enum {
+	CmdExit = 0,
+	CmdEcho = 1,
+};
+
+/* Report the median of several runs to keep the results stable. */
+constexpr unsigned int kWarmupIterations = 100;
+constexpr unsigned int kIterations = 1000;
+constexpr unsigned int kRuns = 5;
+
+class IPCBenchmarkWorker
+{
+public:
+	IPCBenchmarkWorker()
+		: exitCode_(EXIT_SUCCESS), exit_(false)
+	{
+		dispatcher_ = Thread::current()->eventDispatcher();
+		ipc_.readyRead.connect(this, &IPCBenchmarkWorker::readyRead);
+	}
+
+	int run(UniqueFD fd)
+	{
+		if (ipc_.bind(std::move(fd))) {
+			cerr << "Failed to connect to IPC channel" << endl;
+			return EXIT_FAILURE;
+		}
+
+		while (!exit_)
+			dispatcher_->processEvents();
+
+		ipc_.close();
+
+		return exitCode_;
+	}
+
+private:
+	void readyRead()
+	{
+		IPCUnixSocket::Payload message;
+
+		int ret = ipc_.receive(&message);
+		if (ret) {
+			cerr << "Receive message failed: " << ret << endl;
+			return;
+		}
+
+		IPCMessage ipcMessage(message);
+
+		switch (ipcMessage.header().cmd) {
+		case CmdExit:
+			exit_ = true;
+			break;
+
+		case CmdEcho: {
+			/* Send the data and file descriptors back. */
+			IPCMessage response(ipcMessage.header());
+			response.data() = std::move(ipcMessage.data());
+			response.fds() = std::move(ipcMessage.fds());
+
+			ret = ipc_.send(response.payload());
+			if (ret < 0) {
+				cerr << "Reply failed" << endl;
+				exitCode_ = EXIT_FAILURE;
+				exit_ = true;
+			}
+			break;
+		}
+		}
+	}
+
+	IPCUnixSocket ipc_;
+	EventDispatcher *dispatcher_;
+	int exitCode_;
+	bool exit_;
+};
+
+class IPCBenchmark : public Test
+{
+protected:
+	int benchmark(unsigned int size, unsigned int numFds)
+	{
+		IPCMessage msg(CmdEcho);
+		msg.data().resize(size, 0xa5);
+
+		for (unsigned int i = 0; i < numFds; i++) {
+			SharedFD fd(MemFd::create("benchmark", 4096));
+			if (!fd.isValid()) {
+				cerr << "Failed to create memfd" << endl;
+				return TestFail;
+			}
+
+			msg.fds().push_back(std::move(fd));
+		}
+
+		for (unsigned int i = 0; i < kWarmupIterations; i++) {
+			IPCMessage response;
+			if (ipc_->sendSync(msg, &response) < 0)
+				return TestFail;
+		}
+
+		vector<double> results;
+
+		for (unsigned int run = 0; run < kRuns; run++) {
+			auto start = steady_clock::now();
+
+			for (unsigned int i = 0; i < kIterations; i++) {
+				IPCMessage response;
+				if (ipc_->sendSync(msg, &response) < 0 ||
+				    response.data().size() != size ||
+				    response.fds().size() != numFds) {
+					cerr << "Round-trip failed" << endl;
+					return TestFail;
+				}
+			}
+
+			auto duration = duration_cast<nanoseconds>(steady_clock::now() - start);
+			results.push_back(static_cast<double>(duration.count()) / kIterations);
+		}
+
+		sort(results.begin(), results.end());
+		const double ns = results[kRuns / 2];
+
+		cout << right << setw(8) << size << " bytes"
+		     << setw(4) << numFds << " fds"
+		     << fixed << setprecision(1)
+		     << setw(12) << ns / 1000 << " us/round-trip"
+		     << setw(10) << size * 2 * 1000.0 / ns << " MB/s" << endl;
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		ipc_ = std::make_unique<IPCPipeUnixSocket>("", self().c_str());
+		if (!ipc_->isConnected()) {
+			cerr << "Failed to create IPCPipe" << endl;
+			return TestFail;
+		}
+
+		/* Latency of small messages, and throughput of larger payloads. */
+		for (unsigned int size : { 0U, 256U, 4096U, 16384U, 65536U }) {
+			if (benchmark(size, 0) != TestPass)
+				return TestFail;
+		}
+
+		/* Cost of passing file descriptors, as done to map buffers. */
+		for (unsigned int numFds : { 1U, 4U, 16U }) {
+			if (benchmark(4096, numFds) != TestPass)
+				return TestFail;
+		}
+
+		IPCMessage msg(CmdExit);
+		if (ipc_->sendAsync(msg) < 0) {
+			cerr << "Failed to call exit" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	ProcessManager processManager_;
+
+	unique_ptr<IPCPipeUnixSocket> ipc_;
+};
+
+} /* namespace */
+
+/*
+ * Can't use TEST_REGISTER() as single binary needs to act as both client and
+ * server
+ */
+int main(int argc, char **argv)
+{
+	/* IPCPipeUnixSocket passes IPA module path in argv[1] */
+	if (argc == 3) {
+		UniqueFD ipcfd = UniqueFD(std::stoi(argv[2]));
+		IPCBenchmarkWorker worker;
+		return worker.run(std::move(ipcfd));
+	}
+
+	IPCBenchmark test;
+	test.setArgs(argc, argv);
+	return test.execute();
+}
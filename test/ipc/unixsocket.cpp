@@ -93,6 +93,9 @@ private:
 			break;
 
 		case CMD_REVERSE: {
+			for (int fd : message.fds)
+				close(fd);
+
 			response.data = message.data;
 			std::reverse(response.data.begin() + 1, response.data.end());
 
@@ -357,9 +360,72 @@ protected:
 		return 0;
 	}
 
+	int testBurst()
+	{
+		/*
+		 * Queue messages mixing data only and file descriptors, and of
+		 * different sizes, without waiting for the responses, to test
+		 * that ordering is preserved.
+		 */
+		static const std::array<size_t, 4> sizes = { 7, 5000, 65536, 13 };
+		vector<IPCUnixSocket::Payload> messages;
+
+		for (unsigned int i = 0; i < 16; i++) {
+			for (size_t size : sizes) {
+				IPCUnixSocket::Payload message;
+
+				message.data.resize(size);
+				for (size_t j = 0; j < size; j++)
+					message.data[j] = j + messages.size();
+				message.data[0] = CMD_REVERSE;
+
+				if (messages.size() % 3 == 1) {
+					int fd = open(self().c_str(), O_RDONLY);
+					if (fd < 0)
+						return TestFail;
+					message.fds.push_back(fd);
+				}
+
+				messages.push_back(std::move(message));
+			}
+		}
+
+		burstResponses_.clear();
+		burst_ = true;
+
+		for (unsigned int i = 0; i < messages.size(); i++) {
+			int ret = ipc_.send(messages[i]);
+
+			for (int fd : messages[i].fds)
+				close(fd);
+
+			if (ret)
+				return ret;
+
+			/* Drain the responses regularly to avoid overflows. */
+			if (i % sizes.size() == sizes.size() - 1) {
+				ret = waitBurst(i + 1);
+				if (ret)
+					return ret;
+			}
+		}
+
+		burst_ = false;
+
+		for (unsigned int i = 0; i < messages.size(); i++) {
+			IPCUnixSocket::Payload &response = burstResponses_[i];
+			std::reverse(response.data.begin() + 1, response.data.end());
+			if (messages[i].data != response.data)
+				return TestFail;
+		}
+
+		return 0;
+	}
+
 	int init()
 	{
 		callResponse_ = nullptr;
+		burst_ = false;
 		return 0;
 	}
 
@@ -406,6 +472,12 @@ protected:
 			return TestFail;
 		}
 
+		/* Test ordering of queued messages. */
+		if (testBurst()) {
+			cerr << "Burst test failed" << endl;
+			return TestFail;
+		}
+
 		/* Close slave connection. */
 		IPCUnixSocket::Payload close;
 		close.data.push_back(CMD_CLOSE);
@@ -452,8 +524,37 @@ private:
 		return 0;
 	}
 
+	int waitBurst(size_t count)
+	{
+		Timer timeout;
+
+		timeout.start(2s);
+		while (burstResponses_.size() < count) {
+			if (!timeout.isRunning()) {
+				cerr << "Burst timeout!" << endl;
+				return -ETIMEDOUT;
+			}
+
+			Thread::current()->eventDispatcher()->processEvents();
+		}
+
+		return 0;
+	}
+
 	void readyRead()
 	{
+		if (burst_) {
+			IPCUnixSocket::Payload response;
+
+			if (ipc_.receive(&response)) {
+				cerr << "Receive message failed" << endl;
+				return;
+			}
+
+			burstResponses_.push_back(std::move(response));
+			return;
+		}
+
 		if (!callResponse_) {
 			cerr << "Read ready without expecting data, fail." << endl;
 			return;
@@ -492,6 +593,9 @@ private:
 	IPCUnixSocket ipc_;
 	bool callDone_;
 	IPCUnixSocket::Payload *callResponse_;
+
+	bool burst_;
+	vector<IPCUnixSocket::Payload> burstResponses_;
 };
 
 /*
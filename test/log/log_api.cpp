@@ -133,6 +133,30 @@ protected:
 		return TestPass;
 	}
 
+	int testDisabled()
+	{
+		unsigned int evaluations = 0;
+		auto evaluate = [&evaluations]() { return ++evaluations; };
+
+		logSetTarget(LoggingTargetNone);
+		logSetLevel("LogAPITest", "WARN");
+
+		/* Discarded messages must not be formatted. */
+		LOG(LogAPITest, Info) << evaluate();
+		if (evaluations != 0 || LOG_ENABLED(LogAPITest, Info)) {
+			cout << "Discarded message has been formatted" << endl;
+			return TestFail;
+		}
+
+		LOG(LogAPITest, Warning) << evaluate();
+		if (evaluations != 1 || !LOG_ENABLED(LogAPITest, Warning)) {
+			cout << "Printed message has not been formatted" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
 	int run() override
 	{
 		int ret = testFile();
@@ -147,6 +171,10 @@ protected:
 		if (ret != TestPass)
 			return TestFail;
 
+		ret = testDisabled();
+		if (ret != TestPass)
+			return TestFail;
+
 		return TestPass;
 	}
 };
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Google Inc.
+ *
+ * libcamera internal MappedFrameBufferCache tests
+ */
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/memfd.h>
+
+#include <libcamera/framebuffer.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+class MappedBufferCacheTest : public Test
+{
+protected:
+	static constexpr unsigned int kBufferSize = 4096;
+	static constexpr unsigned int kNumBuffers = 4;
+
+	unique_ptr<FrameBuffer> createBuffer(const SharedFD &fd)
+	{
+		FrameBuffer::Plane plane;
+		plane.fd = fd;
+		plane.offset = 0;
+		plane.length = kBufferSize;
+
+		return make_unique<FrameBuffer>(vector<FrameBuffer::Plane>{ plane });
+	}
+
+	int init() override
+	{
+		for (unsigned int i = 0; i < kNumBuffers; i++) {
+			SharedFD fd(MemFd::create("mapped-buffer-cache", kBufferSize));
+			if (!fd.isValid()) {
+				cout << "Failed to allocate buffer" << endl;
+				return TestFail;
+			}
+
+			fds_.push_back(fd);
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		MappedFrameBufferCache cache(MappedFrameBuffer::MapFlag::ReadWrite,
+					     kNumBuffers / 2);
+
+		unique_ptr<FrameBuffer> buffer = createBuffer(fds_[0]);
+		const MappedFrameBuffer *map = cache.map(buffer.get());
+		if (!map || map->planes().size() != 1 ||
+		    map->planes()[0].size() != kBufferSize) {
+			cout << "Failed to map buffer" << endl;
+			return TestFail;
+		}
+
+		map->planes()[0][0] = 0x5a;
+
+		/* A new FrameBuffer wrapping the same dmabuf shall hit. */
+		unique_ptr<FrameBuffer> alias = createBuffer(fds_[0]);
+		if (cache.map(alias.get()) != map) {
+			cout << "Mapping not reused for the same dmabuf" << endl;
+			return TestFail;
+		}
+
+		/* Different memory shall get a different mapping. */
+		unique_ptr<FrameBuffer> other = createBuffer(fds_[1]);
+		const MappedFrameBuffer *otherMap = cache.map(other.get());
+		if (!otherMap || otherMap == map ||
+		    otherMap->planes()[0].data() == map->planes()[0].data()) {
+			cout << "Mapping reused for a different dmabuf" << endl;
+			return TestFail;
+		}
+
+		/* Filling the cache shall evict the least recently used mapping. */
+		unique_ptr<FrameBuffer> third = createBuffer(fds_[2]);
+		if (!cache.map(third.get()) || cache.map(other.get()) != otherMap) {
+			cout << "Most recently used mapping evicted" << endl;
+			return TestFail;
+		}
+
+		map = cache.map(buffer.get());
+		if (!map || map->planes()[0][0] != 0x5a) {
+			cout << "Failed to map evicted buffer again" << endl;
+			return TestFail;
+		}
+
+		cache.clear();
+
+		return TestPass;
+	}
+
+private:
+	vector<SharedFD> fds_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(MappedBufferCacheTest)
@@ -210,6 +210,52 @@ class MediaDeviceLinkTest : public MediaDeviceTest
 			return TestFail;
 		}
 
+		/*
+		 * Configure the links to a desired state, and verify that the
+		 * links not part of the configuration get disabled.
+		 */
+		link2 = media_->link("Debayer A", 1, "Scaler", 0);
+		if (!link2) {
+			cerr << "Unable to find link: 'Debayer A':[1] -> 'Scaler':[0]"
+			     << " using lookup by name" << endl;
+			return TestFail;
+		}
+
+		if (media_->configureLinks({ link })) {
+			cerr << "Failed to configure links" << endl;
+			return TestFail;
+		}
+
+		if (!(link->flags() & MEDIA_LNK_FL_ENABLED)) {
+			cerr << "Link " << linkName
+			     << " was configured but it is reported as disabled"
+			     << endl;
+			return TestFail;
+		}
+
+		if (media_->configureLinks({ link2 })) {
+			cerr << "Failed to reconfigure links" << endl;
+			return TestFail;
+		}
+
+		if (link->flags() & MEDIA_LNK_FL_ENABLED ||
+		    !(link2->flags() & MEDIA_LNK_FL_ENABLED)) {
+			cerr << "Links not reconfigured to the desired state"
+			     << endl;
+			return TestFail;
+		}
+
+		if (media_->configureLinks({})) {
+			cerr << "Failed to disable links" << endl;
+			return TestFail;
+		}
+
+		if (link2->flags() & MEDIA_LNK_FL_ENABLED) {
+			cerr << "Links not disabled by empty configuration"
+			     << endl;
+			return TestFail;
+		}
+
 		return 0;
 	}
 
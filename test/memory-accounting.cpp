@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Memory accounting test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#include "libcamera/internal/memory_accounting.h"
+#include "libcamera/internal/shared_mem_object.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+const MemoryAccount::Usage *findUsage(const std::vector<MemoryAccount::Usage> &usage,
+				      const std::string &category)
+{
+	auto it = std::find_if(usage.begin(), usage.end(),
+			       [&](const MemoryAccount::Usage &u) {
+				       return u.category == category;
+			       });
+	return it != usage.end() ? &*it : nullptr;
+}
+
+} /* namespace */
+
+class MemoryAccountingTest : public Test
+{
+protected:
+	int run()
+	{
+		const std::string category = "memory-accounting-test";
+
+		{
+			MemoryAccount first(category, MemoryAccount::Heap::System, 4096);
+			MemoryAccount second(category, MemoryAccount::Heap::System, 8192);
+
+			std::vector<MemoryAccount::Usage> usage = MemoryAccount::usage();
+			const MemoryAccount::Usage *u = findUsage(usage, category);
+			if (!u || u->size != 12288 || u->count != 2 ||
+			    u->heap != MemoryAccount::Heap::System) {
+				cerr << "Invalid usage for two accounts" << endl;
+				return TestFail;
+			}
+
+			/* Moving an account must not change the totals. */
+			MemoryAccount moved(std::move(first));
+			if (first.size() != 0 || moved.size() != 4096) {
+				cerr << "Invalid sizes after move" << endl;
+				return TestFail;
+			}
+
+			usage = MemoryAccount::usage();
+			u = findUsage(usage, category);
+			if (!u || u->size != 12288 || u->count != 2) {
+				cerr << "Invalid usage after move" << endl;
+				return TestFail;
+			}
+
+			second.reset();
+
+			usage = MemoryAccount::usage();
+			u = findUsage(usage, category);
+			if (!u || u->size != 4096 || u->count != 1) {
+				cerr << "Invalid usage after reset" << endl;
+				return TestFail;
+			}
+		}
+
+		if (findUsage(MemoryAccount::usage(), category)) {
+			cerr << "Usage not released on destruction" << endl;
+			return TestFail;
+		}
+
+		/* Shared memory objects are accounted for under their name. */
+		{
+			SharedMem mem(category, 1024);
+			if (!mem) {
+				cerr << "Failed to allocate shared memory" << endl;
+				return TestFail;
+			}
+
+			std::vector<MemoryAccount::Usage> usage = MemoryAccount::usage();
+			const MemoryAccount::Usage *u = findUsage(usage, category);
+			if (!u || u->size != 1024 ||
+			    u->heap != MemoryAccount::Heap::MemFd) {
+				cerr << "Shared memory not accounted for" << endl;
+				return TestFail;
+			}
+		}
+
+		if (findUsage(MemoryAccount::usage(), category)) {
+			cerr << "Shared memory usage not released" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(MemoryAccountingTest)
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Metrics registry test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include <libcamera/base/metrics.h>
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+const Metric::Sample *findSample(const std::vector<Metric::Sample> &samples,
+				 const std::string &name)
+{
+	auto it = std::find_if(samples.begin(), samples.end(),
+			       [&](const Metric::Sample &s) {
+				       return s.name == name;
+			       });
+	return it != samples.end() ? &*it : nullptr;
+}
+
+} /* namespace */
+
+class MetricsTest : public Test
+{
+protected:
+	int run()
+	{
+		CounterMetric counter("test_frames_total", "camera0");
+		CounterMetric counter2("test_frames_total", "camera0");
+		GaugeMetric gauge("test_queue_depth");
+		HistogramMetric histogram("test_latency_seconds", "camera0",
+					  { 0.01, 0.1 });
+
+		counter.increment();
+		counter2.increment(2);
+		gauge.set(5);
+		gauge.add(-2);
+		histogram.observe(0.005);
+		histogram.observe(0.05);
+		histogram.observe(0.05);
+		histogram.observe(1.0);
+
+		std::vector<Metric::Sample> samples = Metric::snapshot();
+
+		/* Metrics registered twice are merged. */
+		const Metric::Sample *s = findSample(samples, "test_frames_total");
+		if (!s || s->camera != "camera0" || s->value != 3 ||
+		    s->type != Metric::Type::Counter) {
+			cerr << "Invalid counter sample" << endl;
+			return TestFail;
+		}
+
+		s = findSample(samples, "test_queue_depth");
+		if (!s || !s->camera.empty() || s->value != 3) {
+			cerr << "Invalid gauge sample" << endl;
+			return TestFail;
+		}
+
+		s = findSample(samples, "test_latency_seconds");
+		if (!s || s->count != 4 || s->buckets.size() != 3 ||
+		    s->buckets[0] != 1 || s->buckets[1] != 2 || s->buckets[2] != 1) {
+			cerr << "Invalid histogram sample" << endl;
+			return TestFail;
+		}
+
+		std::string text = Metric::toPrometheus(samples);
+		if (text.find("# TYPE libcamera_test_frames_total counter\n") == std::string::npos ||
+		    text.find("libcamera_test_frames_total{camera=\"camera0\"} 3\n") == std::string::npos ||
+		    text.find("libcamera_test_queue_depth 3\n") == std::string::npos ||
+		    text.find("libcamera_test_latency_seconds_bucket{camera=\"camera0\",le=\"0.1\"} 3\n") == std::string::npos ||
+		    text.find("libcamera_test_latency_seconds_bucket{camera=\"camera0\",le=\"+Inf\"} 4\n") == std::string::npos ||
+		    text.find("libcamera_test_latency_seconds_count{camera=\"camera0\"} 4\n") == std::string::npos) {
+			cerr << "Invalid Prometheus text:" << endl << text;
+			return TestFail;
+		}
+
+		/* Metrics are unregistered when destroyed. */
+		{
+			auto temporary = std::make_unique<GaugeMetric>("test_temporary");
+			if (!findSample(Metric::snapshot(), "test_temporary")) {
+				cerr << "Metric not registered" << endl;
+				return TestFail;
+			}
+		}
+
+		if (findSample(Metric::snapshot(), "test_temporary")) {
+			cerr << "Metric not unregistered" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(MetricsTest)
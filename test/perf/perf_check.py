@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Copyright (C) 2024, Ideas on Board Oy
+#
+# Run a benchmark and compare its results with an in-tree baseline
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+TestPass = 0
+TestFail = 1
+TestSkip = 77
+
+# Results reported in these units improve when they increase, all the others
+# when they decrease.
+higher_is_better = ['MB/s', 'MPix/s', 'fps']
+
+units = ['ns/op', 'us/round-trip', 'MB/s', 'MPix/s', 'ns/line', 'misses/frame']
+result_regex = re.compile(r'(-?\d+(?:\.\d+)?)\s+(' + '|'.join(re.escape(u) for u in units) + r')(?=\s|$)')
+
+# Fields of the JSON results that describe the run instead of measuring it.
+# The other fields report a frame rate or durations in microseconds.
+json_ignored = ['frames', 'buffers']
+
+
+def parse_json(line, results):
+    try:
+        data = json.loads(line)
+    except json.JSONDecodeError:
+        return
+
+    def flatten(prefix, value):
+        if isinstance(value, bool) or prefix in json_ignored:
+            return
+        if isinstance(value, dict):
+            for key, item in value.items():
+                flatten(f'{prefix}.{key}' if prefix else key, item)
+        elif isinstance(value, (int, float)):
+            unit = 'fps' if prefix == 'fps' else 'us'
+            results[f'{prefix} [{unit}]'] = float(value)
+
+    flatten('', data)
+
+
+def parse_results(output):
+    """Extract the results from the benchmark output
+
+    Text lines report one or more values followed by a unit, such as
+    "invokeMethod queued    183.2 ns/op". The results are named after the text
+    left once the values are removed, and the unit. JSON lines report one
+    result per numerical field.
+    """
+    results = {}
+
+    for line in output.splitlines():
+        line = line.strip()
+        if line.startswith('{'):
+            parse_json(line, results)
+            continue
+
+        matches = list(result_regex.finditer(line))
+        if not matches:
+            continue
+
+        name = ' '.join(result_regex.sub('', line).split())
+        for match in matches:
+            results[f'{name} [{match.group(2)}]'] = float(match.group(1))
+
+    return results
+
+
+def is_better_higher(name):
+    unit = name[name.rfind('[') + 1:-1]
+    return unit in higher_is_better
+
+
+def compare(baseline, results, tolerance):
+    regressions = []
+
+    for name, reference in baseline.items():
+        if name not in results:
+            print(f'warning: {name} not reported')
+            continue
+
+        value = results[name]
+        if is_better_higher(name):
+            change = (reference - value) / reference if reference else 0.0
+        else:
+            change = (value - reference) / reference if reference else 0.0
+
+        status = 'REGRESSION' if change > tolerance else 'ok'
+        print(f'{status:>10}  {name}: {value:.1f} (baseline {reference:.1f}, '
+              f'{-change * 100:+.1f}%)')
+
+        if change > tolerance:
+            regressions.append(name)
+
+    for name in results.keys() - baseline.keys():
+        print(f'       new  {name}: {results[name]:.1f}')
+
+    return regressions
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description='Run a benchmark and check for performance regressions')
+    parser.add_argument('-a', '--arch', type=str, required=True,
+                        help='Architecture selecting the baseline')
+    parser.add_argument('-b', '--baselines', type=str, required=True,
+                        help='Directory containing the per-architecture baselines')
+    parser.add_argument('-t', '--tolerance', type=float,
+                        default=float(os.environ.get('LIBCAMERA_PERF_TOLERANCE', '0')) or None,
+                        help='Relative regression tolerance, overrides the baseline value')
+    parser.add_argument('-u', '--update', action='store_true',
+                        default=os.environ.get('LIBCAMERA_PERF_UPDATE', '') == '1',
+                        help='Record the results as the new baseline')
+    parser.add_argument('name', type=str, help='Benchmark name')
+    parser.add_argument('command', nargs=argparse.REMAINDER,
+                        help='Benchmark command and arguments')
+    args = parser.parse_args(argv[1:])
+
+    proc = subprocess.run(args.command, stdout=subprocess.PIPE, text=True)
+    print(proc.stdout, end='')
+
+    if proc.returncode != 0:
+        return proc.returncode
+
+    results = parse_results(proc.stdout)
+    if not results:
+        print('No results reported by the benchmark')
+        return TestFail
+
+    baseline_file = os.path.join(args.baselines, args.arch, args.name + '.json')
+
+    if args.update:
+        baseline = {'tolerance': 0.2, 'results': {}}
+        if os.path.exists(baseline_file):
+            with open(baseline_file) as f:
+                baseline = json.load(f)
+
+        baseline['results'] = dict(sorted(results.items()))
+
+        os.makedirs(os.path.dirname(baseline_file), exist_ok=True)
+        with open(baseline_file, 'w') as f:
+            json.dump(baseline, f, indent=4)
+            f.write('\n')
+
+        print(f'Baseline written to {baseline_file}')
+        return TestPass
+
+    if not os.path.exists(baseline_file):
+        print(f'No baseline for {args.name} on {args.arch}')
+        return TestSkip
+
+    with open(baseline_file) as f:
+        baseline = json.load(f)
+
+    tolerance = args.tolerance or baseline.get('tolerance', 0.2)
+    regressions = compare(baseline['results'], results, tolerance)
+    if regressions:
+        print(f'{len(regressions)} result(s) regressed by more than {tolerance * 100:.0f}%')
+        return TestFail
+
+    return TestPass
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Pixel conversion kernels test
+ */
+
+#include <iostream>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include "libcamera/internal/pixel_kernels.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+/* Widths covering the vectorized loops and their tails */
+const vector<unsigned int> kWidths = { 1, 2, 3, 4, 7, 8, 15, 16, 17, 31, 32,
+				       33, 100, 640, 1283, 1920 };
+
+/* Written past the end of the destinations to catch overflows */
+constexpr uint8_t kGuard = 0xa5;
+
+} /* namespace */
+
+class PixelKernelsTest : public Test
+{
+protected:
+	int init()
+	{
+		cout << "Using " << kernels::implementation() << " kernels" << endl;
+
+		return TestPass;
+	}
+
+	vector<uint8_t> randomData(size_t size)
+	{
+		vector<uint8_t> data(size);
+
+		for (uint8_t &byte : data)
+			byte = rng_();
+
+		return data;
+	}
+
+	int testDeinterleave()
+	{
+		for (unsigned int count : kWidths) {
+			vector<uint8_t> src = randomData(2 * count);
+			vector<uint8_t> dst0(count + 1, kGuard);
+			vector<uint8_t> dst1(count + 1, kGuard);
+
+			kernels::deinterleave(dst0.data(), dst1.data(), src.data(), count);
+
+			for (unsigned int x = 0; x < count; x++) {
+				if (dst0[x] != src[2 * x] || dst1[x] != src[2 * x + 1]) {
+					cerr << "Deinterleave of " << count
+					     << " pairs failed at " << x << endl;
+					return TestFail;
+				}
+			}
+
+			if (dst0[count] != kGuard || dst1[count] != kGuard) {
+				cerr << "Deinterleave of " << count
+				     << " pairs overflowed" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int testUnpack(unsigned int bitDepth)
+	{
+		const unsigned int groupPixels = bitDepth == 10 ? 4 : 2;
+		const unsigned int groupBytes = bitDepth == 10 ? 5 : 3;
+		const uint16_t guard = kGuard << 8 | kGuard;
+
+		for (unsigned int width : kWidths) {
+			const unsigned int groups = (width + groupPixels - 1) / groupPixels;
+			vector<uint8_t> src = randomData(groups * groupBytes);
+			vector<uint16_t> dst(width + 1, guard);
+
+			if (bitDepth == 10)
+				kernels::unpackCSI2P10(dst.data(), src.data(), width);
+			else
+				kernels::unpackCSI2P12(dst.data(), src.data(), width);
+
+			for (unsigned int x = 0; x < width; x++) {
+				const uint8_t *group = &src[x / groupPixels * groupBytes];
+				const unsigned int i = x % groupPixels;
+				uint16_t expected;
+
+				if (bitDepth == 10)
+					expected = group[i] << 2 | ((group[4] >> (2 * i)) & 0x03);
+				else
+					expected = group[i] << 4 | ((group[2] >> (4 * i)) & 0x0f);
+
+				if (dst[x] != expected) {
+					cerr << "Unpacking " << width << " " << bitDepth
+					     << "-bit pixels failed at " << x << ": "
+					     << dst[x] << " != " << expected << endl;
+					return TestFail;
+				}
+			}
+
+			if (dst[width] != guard) {
+				cerr << "Unpacking " << width << " " << bitDepth
+				     << "-bit pixels overflowed" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run()
+	{
+		if (testDeinterleave() != TestPass)
+			return TestFail;
+
+		if (testUnpack(10) != TestPass)
+			return TestFail;
+
+		if (testUnpack(12) != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+
+private:
+	mt19937 rng_;
+};
+
+TEST_REGISTER(PixelKernelsTest)
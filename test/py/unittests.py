@@ -299,6 +299,50 @@ class SimpleCaptureMethods(CameraTesterBase):
         cam.stop()
 
 
+class MappedFrameBufferTestMethods(CameraTesterBase):
+    def test_mapped_frame_buffer(self):
+        cam = self.cam
+
+        camconfig = cam.generate_configuration([libcam.StreamRole.StillCapture])
+        self.assertTrue(camconfig.size == 1)
+
+        streamconfig = camconfig.at(0)
+
+        cam.configure(camconfig)
+
+        stream = streamconfig.stream
+
+        allocator = libcam.FrameBufferAllocator(cam)
+        num_bufs = allocator.allocate(stream)
+        self.assertTrue(num_bufs > 0)
+
+        buffer = allocator.buffers(stream)[0]
+        wr_buffer = weakref.ref(buffer)
+
+        mfb = libcam.MappedFrameBuffer(buffer, streamconfig)
+        view = memoryview(mfb.planes[0])
+
+        # The planes are exposed with the stride of the stream
+        self.assertTrue(view.ndim == 2)
+        self.assertTrue(view.shape[0] == streamconfig.size.height)
+        self.assertTrue(view.strides[0] == streamconfig.stride)
+        self.assertFalse(view.readonly)
+
+        # The view keeps the mapping and the buffer alive
+        del mfb
+        del buffer
+        del allocator
+        gc.collect()
+        self.assertIsAlive(wr_buffer)
+
+        view[0, 0] = 0x5a
+        self.assertTrue(view[0, 0] == 0x5a)
+
+        view.release()
+        gc.collect()
+        self.assertIsDead(wr_buffer)
+
+
 # Recursively expand slist's objects into olist, using seen to track already
 # processed objects.
 def _getr(slist, olist, seen):
@@ -169,6 +169,54 @@ protected:
 			return TestFail;
 		}
 
+		/*
+		 * Serialize lists incrementally. The first list is sent in
+		 * full, the next ones as deltas that update, add and remove
+		 * controls.
+		 */
+		serializer.setIncremental(true);
+
+		ControlList updated(infoMap);
+		updated.set(controls::Brightness, 0.5f);
+		updated.set(controls::Contrast, 1.5f);
+		updated.set(controls::Sharpness, 1.0f);
+
+		ControlList received;
+
+		for (const ControlList *source : { &list, &updated, &list }) {
+			size = serializer.binarySize(*source);
+			listData.resize(size);
+			buffer = ByteStreamBuffer(listData.data(), listData.size());
+
+			ret = serializer.serialize(*source, buffer);
+			if (ret || buffer.overflow()) {
+				cerr << "Failed to serialize ControlList incrementally"
+				     << endl;
+				return TestFail;
+			}
+
+			if (source == &updated && buffer.offset() >= size) {
+				cerr << "Incremental ControlList is not smaller than full list"
+				     << endl;
+				return TestFail;
+			}
+
+			buffer = ByteStreamBuffer(const_cast<const uint8_t *>(listData.data()),
+						  buffer.offset());
+
+			ret = deserializer.deserialize(buffer, &received);
+			if (ret || buffer.overflow()) {
+				cerr << "Failed to deserialize incremental ControlList"
+				     << endl;
+				return TestFail;
+			}
+
+			if (!equals(*source, received)) {
+				cerr << "Incremental list doesn't match original" << endl;
+				return TestFail;
+			}
+		}
+
 		return TestPass;
 	}
 };
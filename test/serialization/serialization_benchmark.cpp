@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Control and IPA data serialization benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/shared_fd.h>
+#include <libcamera/base/utils.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/geometry.h>
+
+#include <libcamera/ipa/core_ipa_serializer.h>
+
+#include "libcamera/internal/byte_stream_buffer.h"
+#include "libcamera/internal/control_serializer.h"
+#include "libcamera/internal/ipa_data_serializer.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+/*
+ * Report the median of several runs, each averaging many iterations, to keep
+ * the results stable in the presence of scheduling noise.
+ */
+constexpr unsigned int kWarmupIterations = 100;
+constexpr unsigned int kIterations = 2000;
+constexpr unsigned int kRuns = 7;
+
+template<typename Func>
+double measure(Func func)
+{
+	for (unsigned int i = 0; i < kWarmupIterations; i++)
+		func();
+
+	vector<double> results;
+
+	for (unsigned int run = 0; run < kRuns; run++) {
+		auto start = steady_clock::now();
+
+		for (unsigned int i = 0; i < kIterations; i++)
+			func();
+
+		auto duration = duration_cast<nanoseconds>(steady_clock::now() - start);
+		results.push_back(static_cast<double>(duration.count()) / kIterations);
+	}
+
+	sort(results.begin(), results.end());
+	return results[kRuns / 2];
+}
+
+void printResult(const string &name, size_t bytes, double ns)
+{
+	cout << left << setw(40) << name
+	     << right << setw(8) << bytes << " bytes"
+	     << fixed << setprecision(1)
+	     << setw(10) << ns << " ns/op"
+	     << setw(10) << bytes * 1000.0 / ns << " MB/s" << endl;
+}
+
+class SerializationBenchmark : public Test
+{
+protected:
+	int init() override
+	{
+		ControlInfoMap::Map map = {
+			{ &controls::AeEnable, ControlInfo(false, true) },
+			{ &controls::AeLocked, ControlInfo(false, true) },
+			{ &controls::ExposureTime, ControlInfo(1, 1000000) },
+			{ &controls::AnalogueGain, ControlInfo(1.0f, 16.0f) },
+			{ &controls::DigitalGain, ControlInfo(1.0f, 16.0f) },
+			{ &controls::ColourGains, ControlInfo(0.0f, 32.0f) },
+			{ &controls::ColourTemperature, ControlInfo(2000, 10000) },
+			{ &controls::Lux, ControlInfo(0.0f, 100000.0f) },
+			{ &controls::SensorBlackLevels, ControlInfo(0, 65535) },
+			{ &controls::ColourCorrectionMatrix, ControlInfo(-16.0f, 16.0f) },
+			{ &controls::FrameDuration, ControlInfo(INT64_C(0), INT64_C(1000000)) },
+			{ &controls::SensorTimestamp, ControlInfo(INT64_C(0), INT64_MAX) },
+			{ &controls::ScalerCrop, ControlInfo(Rectangle{}, Rectangle(0, 0, 4056, 3040)) },
+			{ &controls::FocusFoM, ControlInfo(0, 65535) },
+			{ &controls::LensPosition, ControlInfo(0.0f, 15.0f) },
+			{ &controls::AfState, ControlInfo(controls::AfStateValues) },
+#ifdef LIBCAMERA_HAS_RPI_VENDOR_CONTROLS
+			{ &controls::rpi::PispStatsOutput, ControlInfo(uint8_t(0), uint8_t(255)) },
+#endif
+		};
+
+		infoMap_ = ControlInfoMap(std::move(map), controls::controls);
+
+		return TestPass;
+	}
+
+	/* Per-frame metadata, as reported by the rkisp1 IPA module. */
+	ControlList rkisp1Metadata(unsigned int frame)
+	{
+		ControlList list(infoMap_);
+
+		list.set(controls::AeLocked, true);
+		list.set(controls::ExposureTime, 10000 + frame);
+		list.set(controls::AnalogueGain, 2.0f);
+		list.set(controls::DigitalGain, 1.0f);
+		list.set(controls::ColourGains, { 1.8f, 1.5f });
+		list.set(controls::ColourTemperature, 5000);
+		list.set(controls::Lux, 400.0f);
+		list.set(controls::SensorBlackLevels, { 4096, 4096, 4096, 4096 });
+		list.set(controls::ColourCorrectionMatrix,
+			 { 1.6f, -0.4f, -0.2f, -0.3f, 1.5f, -0.2f, 0.0f, -0.6f, 1.6f });
+		list.set(controls::FrameDuration, 33333);
+		list.set(controls::SensorTimestamp, 1000000000LL + frame * 33333000LL);
+
+		return list;
+	}
+
+	/*
+	 * Per-frame metadata, as reported by the PiSP IPA module with the
+	 * statistics output enabled. The statistics span is of the order of
+	 * the PiSP frontend statistics size, and is only included when the
+	 * Raspberry Pi vendor controls are available.
+	 */
+	ControlList pispMetadata(unsigned int frame)
+	{
+		ControlList list = rkisp1Metadata(frame);
+
+		list.set(controls::ScalerCrop, Rectangle(0, 0, 4056, 3040));
+		list.set(controls::FocusFoM, 1200);
+		list.set(controls::LensPosition, 1.0f);
+		list.set(controls::AfState, controls::AfStateScanning);
+
+#ifdef LIBCAMERA_HAS_RPI_VENDOR_CONTROLS
+		stats_.resize(32 * 1024);
+		list.set(controls::rpi::PispStatsOutput, Span<const uint8_t>(stats_));
+#endif
+
+		return list;
+	}
+
+	int benchmarkControlList(const string &name, const ControlList &list,
+				 const ControlList &next, bool incremental)
+	{
+		ControlSerializer serializer(ControlSerializer::Role::Proxy);
+		ControlSerializer deserializer(ControlSerializer::Role::Worker);
+
+		/* Serialize the info map first, as done by the IPA proxies. */
+		vector<uint8_t> infoData(serializer.binarySize(infoMap_));
+		ByteStreamBuffer buffer(infoData.data(), infoData.size());
+		if (serializer.serialize(infoMap_, buffer) < 0)
+			return TestFail;
+
+		buffer = ByteStreamBuffer(const_cast<const uint8_t *>(infoData.data()),
+					  infoData.size());
+		if (deserializer.deserialize<ControlInfoMap>(buffer).empty())
+			return TestFail;
+
+		serializer.setIncremental(incremental);
+
+		/*
+		 * Alternate between two lists for the incremental mode to
+		 * serialize deltas.
+		 */
+		vector<uint8_t> data(max(serializer.binarySize(list),
+					 serializer.binarySize(next)));
+		size_t size = 0;
+		bool odd = false;
+
+		double ns = measure([&]() {
+			ByteStreamBuffer out(data.data(), data.size());
+			odd = !odd;
+			serializer.serialize(odd ? list : next, out);
+			size = out.offset();
+		});
+
+		printResult(name + " serialize", size, ns);
+
+		/*
+		 * The deserializer can't replay the same delta, benchmark full
+		 * lists only.
+		 */
+		if (incremental)
+			return TestPass;
+
+		ByteStreamBuffer out(data.data(), data.size());
+		if (serializer.serialize(list, out) || out.overflow())
+			return TestFail;
+		size = out.offset();
+
+		bool valid = true;
+		ns = measure([&]() {
+			ByteStreamBuffer in(const_cast<const uint8_t *>(data.data()), size);
+			ControlList result = deserializer.deserialize<ControlList>(in);
+			valid &= result.size() == list.size();
+		});
+
+		if (!valid) {
+			cerr << "Failed to deserialize " << name << endl;
+			return TestFail;
+		}
+
+		printResult(name + " deserialize", size, ns);
+
+		return TestPass;
+	}
+
+	int benchmarkSensorInfo()
+	{
+		IPACameraSensorInfo info = {};
+		info.model = "imx477";
+		info.bitsPerPixel = 12;
+		info.activeAreaSize = { 4056, 3040 };
+		info.analogCrop = { 0, 0, 4056, 3040 };
+		info.outputSize = { 2028, 1520 };
+		info.pixelRate = 840000000;
+		info.minLineLength = 10168;
+		info.maxLineLength = 65535;
+		info.minFrameLength = 3060;
+		info.maxFrameLength = 65535;
+
+		vector<uint8_t> data;
+		vector<SharedFD> fds;
+
+		double ns = measure([&]() {
+			tie(data, fds) = IPADataSerializer<IPACameraSensorInfo>::serialize(info);
+		});
+		printResult("IPACameraSensorInfo serialize", data.size(), ns);
+
+		bool valid = true;
+		ns = measure([&]() {
+			IPACameraSensorInfo result =
+				IPADataSerializer<IPACameraSensorInfo>::deserialize(data, fds);
+			valid &= result.model == info.model;
+		});
+
+		if (!valid) {
+			cerr << "Failed to deserialize IPACameraSensorInfo" << endl;
+			return TestFail;
+		}
+
+		printResult("IPACameraSensorInfo deserialize", data.size(), ns);
+
+		return TestPass;
+	}
+
+	/* Buffers mapped by a pipeline handler, three planes each. */
+	int benchmarkBuffers()
+	{
+		SharedFD fd(MemFd::create("benchmark", 4096));
+		if (!fd.isValid()) {
+			cerr << "Failed to create memfd" << endl;
+			return TestFail;
+		}
+
+		vector<IPABuffer> buffers;
+		for (unsigned int id = 0; id < 8; id++) {
+			vector<FrameBuffer::Plane> planes(3);
+			for (auto [i, plane] : utils::enumerate(planes)) {
+				plane.fd = fd;
+				plane.offset = i * 1024;
+				plane.length = 1024;
+			}
+
+			buffers.push_back({ id, std::move(planes) });
+		}
+
+		vector<uint8_t> data;
+		vector<SharedFD> fds;
+
+		double ns = measure([&]() {
+			tie(data, fds) = IPADataSerializer<vector<IPABuffer>>::serialize(buffers);
+		});
+		printResult("vector<IPABuffer> serialize", data.size(), ns);
+
+		bool valid = true;
+		ns = measure([&]() {
+			vector<IPABuffer> result =
+				IPADataSerializer<vector<IPABuffer>>::deserialize(data, fds);
+			valid &= result.size() == buffers.size();
+		});
+
+		if (!valid) {
+			cerr << "Failed to deserialize vector<IPABuffer>" << endl;
+			return TestFail;
+		}
+
+		printResult("vector<IPABuffer> deserialize", data.size(), ns);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		const ControlList rkisp1 = rkisp1Metadata(0);
+		const ControlList rkisp1Next = rkisp1Metadata(1);
+		const ControlList pisp = pispMetadata(0);
+		const ControlList pispNext = pispMetadata(1);
+
+		if (benchmarkControlList("rkisp1 metadata", rkisp1, rkisp1Next, false) ||
+		    benchmarkControlList("rkisp1 metadata incremental", rkisp1, rkisp1Next, true) ||
+		    benchmarkControlList("pisp metadata", pisp, pispNext, false) ||
+		    benchmarkControlList("pisp metadata incremental", pisp, pispNext, true))
+			return TestFail;
+
+		if (benchmarkSensorInfo() != TestPass)
+			return TestFail;
+
+		if (benchmarkBuffers() != TestPass)
+			return TestFail;
+
+		return TestPass;
+	}
+
+private:
+	ControlInfoMap infoMap_;
+	vector<uint8_t> stats_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(SerializationBenchmark)
@@ -74,6 +74,25 @@ protected:
 		signalVoid_.disconnect(this, &SignalTest::slotDisconnect);
 	}
 
+	void slotDisconnectOther()
+	{
+		signalVoid_.disconnect(this, &SignalTest::slotVoid);
+	}
+
+	void slotDeleteSignal()
+	{
+		delete signalDeleted_;
+		signalDeleted_ = nullptr;
+	}
+
+	void slotEmitNested()
+	{
+		if (!nested_) {
+			nested_ = true;
+			signalDeleted_->emit();
+		}
+	}
+
 	void slotInteger1(int value)
 	{
 		values_[0] = value;
@@ -184,6 +203,47 @@ protected:
 			return TestFail;
 		}
 
+		/* Test disconnection of a pending slot from another slot. */
+		signalVoid_.disconnect();
+		signalVoid_.connect(this, &SignalTest::slotDisconnectOther);
+		signalVoid_.connect(this, &SignalTest::slotVoid);
+
+		called_ = false;
+		signalVoid_.emit();
+
+		if (called_) {
+			cout << "Signal disconnection of pending slot test failed" << endl;
+			return TestFail;
+		}
+
+		/* Test deletion of the signal from its own slot. */
+		signalDeleted_ = new Signal<>();
+		signalDeleted_->connect(this, &SignalTest::slotDeleteSignal);
+		signalDeleted_->connect(this, &SignalTest::slotVoid);
+
+		called_ = false;
+		signalDeleted_->emit();
+
+		if (signalDeleted_ || called_) {
+			cout << "Signal deletion from slot test failed" << endl;
+			return TestFail;
+		}
+
+		/* Test deletion of the signal from a nested emission. */
+		signalDeleted_ = new Signal<>();
+		signalDeleted_->connect(this, &SignalTest::slotEmitNested);
+		signalDeleted_->connect(this, &SignalTest::slotDeleteSignal);
+		signalDeleted_->connect(this, &SignalTest::slotVoid);
+
+		called_ = false;
+		nested_ = false;
+		signalDeleted_->emit();
+
+		if (signalDeleted_ || called_) {
+			cout << "Signal deletion from nested emission test failed" << endl;
+			return TestFail;
+		}
+
 		/*
 		 * Test connecting to slots that return a value. This targets
 		 * compilation, there's no need to check runtime results.
@@ -352,8 +412,10 @@ private:
 	Signal<> signalVoid2_;
 	Signal<int> signalInt_;
 	Signal<int, const std::string &> signalMultiArgs_;
+	Signal<> *signalDeleted_;
 
 	bool called_;
+	bool nested_;
 	int values_[3];
 	std::string name_;
 };
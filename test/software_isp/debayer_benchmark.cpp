@@ -0,0 +1,493 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Software ISP debayering and statistics benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdlib.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include <linux/perf_event.h>
+
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/logging.h>
+#include <libcamera/stream.h>
+#include <libcamera/transform.h>
+
+#include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/dma_buf_allocator.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "debayer_cpu.h"
+#if HAVE_SOFTISP_GPU
+#include "debayer_egl.h"
+#endif
+#include "swstats_cpu.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+/*
+ * Count the cache misses of the calling thread and of the threads it creates
+ * after the counter is opened, such as the DebayerCpu stripe workers. The
+ * counts of the workers are only accumulated when they exit.
+ */
+class CacheMissCounter
+{
+public:
+	CacheMissCounter()
+	{
+		struct perf_event_attr attr = {};
+
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		fd_ = UniqueFD(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+
+	bool isValid() const { return fd_.isValid(); }
+
+	void enable(bool enable)
+	{
+		if (isValid())
+			ioctl(fd_.get(), enable ? PERF_EVENT_IOC_ENABLE
+						: PERF_EVENT_IOC_DISABLE, 0);
+	}
+
+	uint64_t read()
+	{
+		uint64_t value;
+
+		if (!isValid() || ::read(fd_.get(), &value, sizeof(value)) != sizeof(value))
+			return 0;
+
+		return value;
+	}
+
+private:
+	UniqueFD fd_;
+};
+
+class DebayerBenchmark : public Test
+{
+protected:
+	static constexpr unsigned int kWarmupFrames = 2;
+	static constexpr unsigned int kFrames = 10;
+
+	struct Variant {
+		string name;
+		function<unique_ptr<Debayer>(unique_ptr<SwStatsCpu>)> create;
+		bool needsDmaBuf;
+	};
+
+	int init() override
+	{
+		/*
+		 * Prefer dma-bufs, as allocated by capture devices. Fall back to
+		 * memfds to benchmark the CPU implementation without dma-buf
+		 * providers, silencing the dma-buf sync errors they cause.
+		 */
+		dmaHeap_ = make_unique<DmaBufAllocator>(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+							 DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+							 DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf);
+		if (!dmaHeap_->isValid()) {
+			cout << "No dma-buf provider, using memfd buffers" << endl;
+			dmaHeap_.reset();
+			logSetLevel("Debayer", "FATAL");
+		}
+
+		if (!CacheMissCounter().isValid())
+			cout << "Cache miss counter unavailable" << endl;
+
+		return TestPass;
+	}
+
+	unique_ptr<FrameBuffer> createBuffer(const vector<unsigned int> &planeSizes)
+	{
+		unsigned int size = 0;
+		for (unsigned int planeSize : planeSizes)
+			size += planeSize;
+
+		UniqueFD fd = dmaHeap_ ? dmaHeap_->alloc("benchmark", size)
+				       : MemFd::create("benchmark", size);
+		if (!fd.isValid())
+			return nullptr;
+
+		SharedFD sharedFd(std::move(fd));
+		vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+
+		for (unsigned int planeSize : planeSizes) {
+			FrameBuffer::Plane plane;
+			plane.fd = sharedFd;
+			plane.offset = offset;
+			plane.length = planeSize;
+			planes.push_back(plane);
+			offset += planeSize;
+		}
+
+		return make_unique<FrameBuffer>(planes);
+	}
+
+	/* Fill the input with noise, to defeat any data dependent shortcut */
+	int fillInput(FrameBuffer *buffer)
+	{
+		MappedFrameBuffer map(buffer, MappedFrameBuffer::MapFlag::Write);
+		if (!map.isValid())
+			return -ENOMEM;
+
+		mt19937 rng(0);
+		for (uint8_t &byte : map.planes()[0])
+			byte = rng();
+
+		return 0;
+	}
+
+	StreamConfiguration inputConfiguration(PixelFormat format, const Size &size)
+	{
+		const BayerFormat bayer = BayerFormat::fromPixelFormat(format);
+		StreamConfiguration cfg;
+
+		cfg.pixelFormat = format;
+		cfg.size = size;
+		cfg.stride = bayer.packing == BayerFormat::Packing::CSI2
+				   ? size.width * 5 / 4
+				   : size.width * ((bayer.bitDepth + 7) / 8);
+
+		return cfg;
+	}
+
+	void printResult(const string &name, PixelFormat inputFormat,
+			 const Size &inputSize, const string &output,
+			 const Size &outputSize, double ns,
+			 optional<uint64_t> misses)
+	{
+		const double mpixs = outputSize.width * outputSize.height * 1000.0 / ns;
+
+		cout << left << setw(16) << inputFormat.toString()
+		     << setw(11) << inputSize.toString()
+		     << setw(10) << output
+		     << setw(10) << name
+		     << right << fixed << setprecision(1)
+		     << setw(10) << mpixs << " MPix/s"
+		     << setw(10) << ns / outputSize.height << " ns/line";
+
+		if (misses)
+			cout << setw(12) << *misses << " misses/frame";
+
+		cout << endl;
+	}
+
+	/* Gather statistics on all lines of a frame in normal memory */
+	int benchmarkStats(PixelFormat inputFormat, const Size &inputSize)
+	{
+		StreamConfiguration inputCfg = inputConfiguration(inputFormat, inputSize);
+		CacheMissCounter counter;
+		SwStatsCpu stats;
+
+		if (!stats.isValid() || stats.configure(inputCfg) < 0)
+			return TestFail;
+
+		stats.setWindow(Rectangle(inputSize));
+
+		vector<uint8_t> frame(inputCfg.stride * inputSize.height);
+		mt19937 rng(0);
+		for (uint8_t &byte : frame)
+			byte = rng();
+
+		auto processFrame = [&](uint32_t frameNumber) {
+			const uint8_t *lines[3];
+
+			stats.startFrame();
+			for (unsigned int y = 0; y < inputSize.height; y += 2) {
+				lines[1] = &frame[y * inputCfg.stride];
+				lines[2] = lines[1] + inputCfg.stride;
+				stats.processLine0(y, lines);
+			}
+			stats.finishFrame(frameNumber);
+		};
+
+		/* Nothing releases the buffers, the ring runs dry after a few frames */
+		for (unsigned int i = 0; i < kWarmupFrames; i++)
+			processFrame(i);
+
+		counter.enable(true);
+		auto start = steady_clock::now();
+
+		for (unsigned int i = 0; i < kFrames; i++)
+			processFrame(kWarmupFrames + i);
+
+		auto duration = duration_cast<nanoseconds>(steady_clock::now() - start);
+		counter.enable(false);
+
+		printResult("stats", inputFormat, inputSize, "-", inputSize,
+			    static_cast<double>(duration.count()) / kFrames,
+			    counter.isValid() ? optional(counter.read() / kFrames) : nullopt);
+
+		return TestPass;
+	}
+
+	int benchmark(const Variant &variant, PixelFormat inputFormat,
+		      const Size &inputSize, PixelFormat outputFormat,
+		      Transform transform = Transform::Identity, bool ccm = false)
+	{
+		CacheMissCounter counter;
+
+		auto stats = make_unique<SwStatsCpu>();
+		if (!stats->isValid())
+			return TestFail;
+
+		unique_ptr<Debayer> debayer = variant.create(std::move(stats));
+		if (!debayer)
+			return TestSkip;
+
+		const vector<PixelFormat> formats = debayer->formats(inputFormat);
+		if (find(formats.begin(), formats.end(), outputFormat) == formats.end())
+			return TestPass;
+
+		StreamConfiguration inputCfg = inputConfiguration(inputFormat, inputSize);
+
+		if (!debayer->supportsTransform(outputFormat, transform))
+			return TestPass;
+
+		StreamConfiguration outputCfg;
+		outputCfg.pixelFormat = outputFormat;
+		outputCfg.size = debayer->sizes(inputFormat, inputSize).max;
+		if (!!(transform & Transform::Transpose))
+			outputCfg.size = { outputCfg.size.height, outputCfg.size.width };
+		std::tie(outputCfg.stride, outputCfg.frameSize) =
+			debayer->strideAndFrameSize(outputFormat, outputCfg.size);
+
+		if (debayer->configure(inputCfg, { outputCfg }, transform) < 0) {
+			cerr << "Failed to configure " << variant.name << " for "
+			     << inputFormat << " " << inputSize << endl;
+			return TestFail;
+		}
+
+		unique_ptr<FrameBuffer> input =
+			createBuffer({ inputCfg.stride * inputSize.height });
+		unique_ptr<FrameBuffer> output = createBuffer(debayer->planeSizes(0));
+		if (!input || !output || fillInput(input.get()) < 0) {
+			cerr << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		DebayerParams params = {};
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
+			params.red[i] = params.green[i] = params.blue[i] = i;
+		params.lutVersion = 1;
+
+		/* A typical matrix, with rows summing to 1.0 */
+		if (ccm) {
+			for (unsigned int i = 0; i < DebayerParams::kGammaLookupSize; i++)
+				params.gamma[i] = i * DebayerParams::kRGBLookupSize /
+						  DebayerParams::kGammaLookupSize;
+			params.ccmEnabled = true;
+			params.ccm = { 410, -102, -52, -77, 384, -51, -26, -128, 410 };
+		}
+
+		for (unsigned int i = 0; i < kWarmupFrames; i++)
+			debayer->process(i, input.get(), { output.get() }, &params, {});
+
+		counter.enable(true);
+		auto start = steady_clock::now();
+
+		for (unsigned int i = 0; i < kFrames; i++)
+			debayer->process(kWarmupFrames + i, input.get(), { output.get() }, &params, {});
+
+		auto duration = duration_cast<nanoseconds>(steady_clock::now() - start);
+		counter.enable(false);
+
+		/* Join the worker threads to accumulate their cache misses */
+		debayer->stop();
+		debayer.reset();
+
+		string outputName = outputFormat.toString();
+		if (transform != Transform::Identity)
+			outputName += string("/") + transformToString(transform);
+
+		printResult(variant.name, inputFormat, inputSize,
+			    outputName, outputCfg.size,
+			    static_cast<double>(duration.count()) / kFrames,
+			    counter.isValid() ? optional(counter.read() / kFrames) : nullopt);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		const vector<PixelFormat> inputFormats = {
+			formats::SBGGR8, formats::SGBRG8, formats::SGRBG8, formats::SRGGB8,
+			formats::SBGGR10, formats::SGBRG10, formats::SGRBG10, formats::SRGGB10,
+			formats::SBGGR12, formats::SGBRG12, formats::SGRBG12, formats::SRGGB12,
+			formats::SBGGR10_CSI2P, formats::SGBRG10_CSI2P,
+			formats::SGRBG10_CSI2P, formats::SRGGB10_CSI2P,
+		};
+		const vector<Size> sizes = {
+			{ 640, 480 },
+			{ 1920, 1080 },
+			{ 3840, 2160 },
+		};
+		const vector<PixelFormat> outputFormats = {
+			formats::XRGB8888,
+			formats::NV12,
+		};
+
+		/*
+		 * The thread count is read by the DebayerCpu constructor, the
+		 * environment is restored once the debayer is created.
+		 */
+		auto createCpu = [](unique_ptr<SwStatsCpu> stats,
+				    const char *threads) -> unique_ptr<Debayer> {
+			const char *env = getenv("LIBCAMERA_SOFTISP_THREADS");
+			string saved = env ? env : "";
+
+			if (threads)
+				setenv("LIBCAMERA_SOFTISP_THREADS", threads, 1);
+
+			auto debayer = make_unique<DebayerCpu>(std::move(stats));
+
+			if (env)
+				setenv("LIBCAMERA_SOFTISP_THREADS", saved.c_str(), 1);
+			else
+				unsetenv("LIBCAMERA_SOFTISP_THREADS");
+
+			return debayer;
+		};
+
+		vector<Variant> variants = {
+			{ "cpu-1", [&](unique_ptr<SwStatsCpu> stats) {
+				  return createCpu(std::move(stats), "1");
+			  },
+			  false },
+			{ "cpu", [&](unique_ptr<SwStatsCpu> stats) {
+				  return createCpu(std::move(stats), nullptr);
+			  },
+			  false },
+#if HAVE_SOFTISP_GPU
+			{ "gpu", [](unique_ptr<SwStatsCpu> stats) -> unique_ptr<Debayer> {
+				  auto debayer = make_unique<DebayerEGL>(std::move(stats));
+				  if (!debayer->isValid())
+					  return nullptr;
+				  return debayer;
+			  },
+			  true },
+#endif
+		};
+
+		for (const PixelFormat &inputFormat : inputFormats) {
+			for (const Size &size : sizes) {
+				if (benchmarkStats(inputFormat, size) != TestPass)
+					return TestFail;
+			}
+		}
+
+		for (const Variant &variant : variants) {
+			if (variant.needsDmaBuf && !dmaHeap_) {
+				cout << "Skipping " << variant.name
+				     << ", dma-bufs are required" << endl;
+				continue;
+			}
+
+			for (const PixelFormat &inputFormat : inputFormats) {
+				for (const Size &size : sizes) {
+					for (const PixelFormat &outputFormat : outputFormats) {
+						int ret = benchmark(variant, inputFormat,
+								    size, outputFormat);
+						if (ret == TestSkip)
+							break;
+						if (ret != TestPass)
+							return ret;
+					}
+				}
+			}
+		}
+
+		/* Transforms are applied by the CPU implementation only */
+		for (Transform transform : { Transform::HFlip, Transform::VFlip,
+					     Transform::Rot90, Transform::Rot270 }) {
+			for (const PixelFormat &outputFormat : outputFormats) {
+				int ret = benchmark(variants[1], formats::SBGGR10,
+						    { 1920, 1080 }, outputFormat,
+						    transform);
+				if (ret != TestPass)
+					return ret;
+			}
+		}
+
+		/* Colour correction on top of the plain CPU debayering */
+		for (const PixelFormat &outputFormat : outputFormats) {
+			Variant variant = variants[1];
+			variant.name = "cpu-ccm";
+
+			int ret = benchmark(variant, formats::SBGGR10, { 1920, 1080 },
+					    outputFormat, Transform::Identity, true);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		/*
+		 * Compare full lines and vertical tiles on a 64MP sensor. The
+		 * tile width is read when the debayer is configured.
+		 */
+		const char *env = getenv("LIBCAMERA_SOFTISP_TILE_WIDTH");
+		string saved = env ? env : "";
+
+		for (bool tiled : { false, true }) {
+			Variant variant = variants[1];
+			variant.name = tiled ? "cpu-tiles" : "cpu-lines";
+
+			if (tiled)
+				unsetenv("LIBCAMERA_SOFTISP_TILE_WIDTH");
+			else
+				setenv("LIBCAMERA_SOFTISP_TILE_WIDTH", "0", 1);
+
+			int ret = benchmark(variant, formats::SBGGR10, { 9248, 6944 },
+					    formats::XRGB8888);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		if (env)
+			setenv("LIBCAMERA_SOFTISP_TILE_WIDTH", saved.c_str(), 1);
+		else
+			unsetenv("LIBCAMERA_SOFTISP_TILE_WIDTH");
+
+		return TestPass;
+	}
+
+private:
+	unique_ptr<DmaBufAllocator> dmaHeap_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(DebayerBenchmark)
@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Software ISP secondary outputs tests
+ */
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/logging.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/software_isp/debayer_params.h"
+
+#include "debayer_cpu.h"
+#include "swstats_cpu.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+class DebayerOutputsTest : public Test
+{
+protected:
+	static constexpr Size kInputSize{ 160, 100 };
+
+	struct Output {
+		StreamConfiguration cfg;
+		unique_ptr<FrameBuffer> buffer;
+	};
+
+	int init() override
+	{
+		/* Memfd buffers can't be synced, silence the errors */
+		logSetLevel("Debayer", "FATAL");
+
+		inputCfg_.pixelFormat = formats::SBGGR8;
+		inputCfg_.size = kInputSize;
+		inputCfg_.stride = kInputSize.width;
+
+		input_ = createBuffer({ inputCfg_.stride * kInputSize.height });
+		if (!input_)
+			return TestFail;
+
+		MappedFrameBuffer map(input_.get(), MappedFrameBuffer::MapFlag::Write);
+		if (!map.isValid())
+			return TestFail;
+
+		mt19937 rng(0);
+		for (uint8_t &byte : map.planes()[0])
+			byte = rng();
+
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
+			params_.red[i] = params_.green[i] = params_.blue[i] = i;
+		params_.lutVersion = 1;
+
+		return TestPass;
+	}
+
+	unique_ptr<FrameBuffer> createBuffer(const vector<unsigned int> &planeSizes)
+	{
+		unsigned int size = 0;
+		for (unsigned int planeSize : planeSizes)
+			size += planeSize;
+
+		UniqueFD fd = MemFd::create("debayer_outputs", size);
+		if (!fd.isValid())
+			return nullptr;
+
+		SharedFD sharedFd(std::move(fd));
+		vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+
+		for (unsigned int planeSize : planeSizes) {
+			FrameBuffer::Plane plane;
+			plane.fd = sharedFd;
+			plane.offset = offset;
+			plane.length = planeSize;
+			planes.push_back(plane);
+			offset += planeSize;
+		}
+
+		return make_unique<FrameBuffer>(planes);
+	}
+
+	/*
+	 * Configure the debayer with the outputs, sized from the first one,
+	 * and process a frame to the outputs selected by mask.
+	 */
+	int process(DebayerCpu &debayer, vector<Output> &outputs, unsigned int mask)
+	{
+		vector<reference_wrapper<StreamConfiguration>> cfgs;
+
+		for (unsigned int i = 0; i < outputs.size(); i++) {
+			StreamConfiguration &cfg = outputs[i].cfg;
+
+			if (i == 0)
+				cfg.size = debayer.sizes(inputCfg_.pixelFormat, kInputSize).max;
+			else
+				cfg.size = debayer.secondarySize(cfg.pixelFormat,
+								 outputs[0].cfg.size,
+								 cfg.size);
+
+			if (cfg.size.isNull()) {
+				cerr << "Unsupported output " << cfg.pixelFormat << endl;
+				return TestFail;
+			}
+
+			std::tie(cfg.stride, cfg.frameSize) =
+				debayer.strideAndFrameSize(cfg.pixelFormat, cfg.size);
+			cfgs.push_back(cfg);
+		}
+
+		if (debayer.configure(inputCfg_, cfgs, Transform::Identity) < 0) {
+			cerr << "Failed to configure " << outputs.size() << " outputs" << endl;
+			return TestFail;
+		}
+
+		vector<FrameBuffer *> buffers;
+		for (unsigned int i = 0; i < outputs.size(); i++) {
+			outputs[i].buffer = createBuffer(debayer.planeSizes(i));
+			if (!outputs[i].buffer)
+				return TestFail;
+
+			buffers.push_back(mask & (1 << i) ? outputs[i].buffer.get() : nullptr);
+		}
+
+		debayer.process(0, input_.get(), buffers, &params_, {});
+
+		return TestPass;
+	}
+
+	/*
+	 * Check that an RGB888 or BGR888 output is the average of the blocks
+	 * of the XRGB8888 reference.
+	 */
+	int checkOutput(const Output &reference, const Output &output)
+	{
+		MappedFrameBuffer ref(reference.buffer.get(), MappedFrameBuffer::MapFlag::Read);
+		MappedFrameBuffer out(output.buffer.get(), MappedFrameBuffer::MapFlag::Read);
+		if (!ref.isValid() || !out.isValid())
+			return TestFail;
+
+		const unsigned int factor = reference.cfg.size.width / output.cfg.size.width;
+		const bool bgr = output.cfg.pixelFormat == formats::BGR888;
+
+		for (unsigned int y = 0; y < output.cfg.size.height; y++) {
+			for (unsigned int x = 0; x < output.cfg.size.width; x++) {
+				for (unsigned int c = 0; c < 3; c++) {
+					unsigned int sum = 0;
+
+					for (unsigned int j = 0; j < factor; j++) {
+						const uint8_t *line = ref.planes()[0].data() +
+								      (y * factor + j) * reference.cfg.stride;
+						for (unsigned int i = 0; i < factor; i++)
+							sum += line[(x * factor + i) * 4 + c];
+					}
+
+					const unsigned int expected =
+						(sum + factor * factor / 2) / (factor * factor);
+					const uint8_t *pixel = out.planes()[0].data() +
+							       y * output.cfg.stride + x * 3;
+
+					if (pixel[bgr ? 2 - c : c] != expected) {
+						cerr << output.cfg.pixelFormat << " "
+						     << output.cfg.size << " pixel ("
+						     << x << ", " << y << ") value "
+						     << static_cast<unsigned int>(pixel[bgr ? 2 - c : c])
+						     << ", expected " << expected << endl;
+						return TestFail;
+					}
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+	Output output(const PixelFormat &format, const Size &size = {})
+	{
+		Output output;
+		output.cfg.pixelFormat = format;
+		output.cfg.size = size;
+		return output;
+	}
+
+	int run() override
+	{
+		DebayerCpu debayer(make_unique<SwStatsCpu>());
+
+		/* Reference output, produced alone */
+		vector<Output> reference;
+		reference.push_back(output(formats::XRGB8888));
+		if (process(debayer, reference, 1) != TestPass)
+			return TestFail;
+
+		const Size &size = reference[0].cfg.size;
+
+		/* Secondary outputs with and without the primary output */
+		for (unsigned int mask : { 7, 6 }) {
+			vector<Output> outputs;
+			outputs.push_back(output(formats::XRGB8888));
+			outputs.push_back(output(formats::RGB888, size / 2));
+			outputs.push_back(output(formats::BGR888, size / 4));
+
+			if (process(debayer, outputs, mask) != TestPass)
+				return TestFail;
+
+			for (unsigned int i = 1; i < outputs.size(); i++) {
+				if (checkOutput(reference[0], outputs[i]) != TestPass)
+					return TestFail;
+			}
+		}
+
+		/* Full size RGB next to a YUV primary output */
+		vector<Output> outputs;
+		outputs.push_back(output(formats::NV12));
+		outputs.push_back(output(formats::BGR888, size));
+
+		if (process(debayer, outputs, 3) != TestPass)
+			return TestFail;
+
+		if (checkOutput(reference[0], outputs[1]) != TestPass)
+			return TestFail;
+
+		/* Transforms aren't supported with multiple outputs */
+		vector<reference_wrapper<StreamConfiguration>> cfgs = {
+			outputs[0].cfg, outputs[1].cfg
+		};
+		if (debayer.configure(inputCfg_, cfgs, Transform::HFlip) == 0) {
+			cerr << "Transform accepted with multiple outputs" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	StreamConfiguration inputCfg_;
+	unique_ptr<FrameBuffer> input_;
+	DebayerParams params_ = {};
+};
+
+TEST_REGISTER(DebayerOutputsTest)
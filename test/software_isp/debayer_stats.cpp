@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Software ISP statistics gathered while debayering tests
+ */
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include <libcamera/base/memfd.h>
+#include <libcamera/base/unique_fd.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/framebuffer.h>
+#include <libcamera/logging.h>
+#include <libcamera/stream.h>
+
+#include "libcamera/internal/bayer_format.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+#include "libcamera/internal/software_isp/debayer_params.h"
+#include "libcamera/internal/software_isp/swisp_stats.h"
+
+#include "debayer_cpu.h"
+#include "swstats_cpu.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+class DebayerStatsTest : public Test
+{
+protected:
+	static constexpr Size kInputSize{ 320, 100 };
+
+	int init() override
+	{
+		/* Memfd buffers can't be synced, silence the errors */
+		logSetLevel("Debayer", "FATAL");
+
+		for (unsigned int i = 0; i < DebayerParams::kRGBLookupSize; i++)
+			params_.red[i] = params_.green[i] = params_.blue[i] = i;
+		params_.lutVersion = 1;
+
+		return TestPass;
+	}
+
+	unique_ptr<FrameBuffer> createBuffer(unsigned int size)
+	{
+		UniqueFD fd = MemFd::create("debayer_stats", size);
+		if (!fd.isValid())
+			return nullptr;
+
+		FrameBuffer::Plane plane;
+		plane.fd = SharedFD(std::move(fd));
+		plane.offset = 0;
+		plane.length = size;
+
+		return make_unique<FrameBuffer>(vector<FrameBuffer::Plane>{ plane });
+	}
+
+	int fillInput(const StreamConfiguration &cfg, FrameBuffer *buffer)
+	{
+		const unsigned int bitDepth =
+			BayerFormat::fromPixelFormat(cfg.pixelFormat).bitDepth;
+
+		MappedFrameBuffer map(buffer, MappedFrameBuffer::MapFlag::Write);
+		if (!map.isValid())
+			return TestFail;
+
+		mt19937 rng(bitDepth);
+		uint8_t *data = map.planes()[0].data();
+
+		if (bitDepth == 8) {
+			for (unsigned int i = 0; i < map.planes()[0].size(); i++)
+				data[i] = rng();
+		} else {
+			uint16_t *pixels = reinterpret_cast<uint16_t *>(data);
+			for (unsigned int i = 0; i < map.planes()[0].size() / 2; i++)
+				pixels[i] = rng() & ((1 << bitDepth) - 1);
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Debayer the input to an output format and retrieve the statistics
+	 * of the frame.
+	 */
+	int process(const StreamConfiguration &inputCfg, FrameBuffer *input,
+		    const PixelFormat &outputFormat, unsigned int subsampling,
+		    SwIspStats *stats)
+	{
+		unique_ptr<SwStatsCpu> swStats = make_unique<SwStatsCpu>();
+		SwStatsCpu *statsCpu = swStats.get();
+		if (!statsCpu->isValid() || statsCpu->setSubsampling(subsampling) < 0)
+			return TestFail;
+
+		DebayerCpu debayer(std::move(swStats));
+
+		StreamConfiguration outputCfg;
+		outputCfg.pixelFormat = outputFormat;
+		outputCfg.size = debayer.sizes(inputCfg.pixelFormat, inputCfg.size).max;
+		std::tie(outputCfg.stride, outputCfg.frameSize) =
+			debayer.strideAndFrameSize(outputFormat, outputCfg.size);
+
+		vector<reference_wrapper<StreamConfiguration>> cfgs = { outputCfg };
+		if (debayer.configure(inputCfg, cfgs, Transform::Identity) < 0) {
+			cerr << "Failed to configure " << inputCfg.pixelFormat
+			     << " -> " << outputFormat << endl;
+			return TestFail;
+		}
+
+		unique_ptr<FrameBuffer> output = createBuffer(debayer.frameSize(0));
+		if (!output)
+			return TestFail;
+
+		int bufferId = -1;
+		statsCpu->statsReady.connect(this, [&](uint32_t, uint32_t id) { bufferId = id; });
+
+		debayer.process(0, input, { output.get() }, &params_, {});
+
+		if (bufferId < 0) {
+			cerr << "No statistics for " << inputCfg.pixelFormat << endl;
+			return TestFail;
+		}
+
+		const SharedFD fd = statsCpu->getStatsFDs()[bufferId];
+		void *mem = mmap(nullptr, sizeof(*stats), PROT_READ, MAP_SHARED,
+				 fd.get(), 0);
+		if (mem == MAP_FAILED)
+			return TestFail;
+
+		memcpy(stats, mem, sizeof(*stats));
+		munmap(mem, sizeof(*stats));
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		static const PixelFormat inputFormats[] = {
+			formats::SBGGR8, formats::SGBRG8, formats::SGRBG8,
+			formats::SRGGB8, formats::SGBRG10, formats::SRGGB12,
+		};
+
+		for (const PixelFormat &format : inputFormats) {
+			const unsigned int bitDepth =
+				BayerFormat::fromPixelFormat(format).bitDepth;
+
+			StreamConfiguration inputCfg;
+			inputCfg.pixelFormat = format;
+			inputCfg.size = kInputSize;
+			inputCfg.stride = kInputSize.width * (bitDepth > 8 ? 2 : 1);
+
+			unique_ptr<FrameBuffer> input =
+				createBuffer(inputCfg.stride * kInputSize.height);
+			if (!input || fillInput(inputCfg, input.get()) != TestPass)
+				return TestFail;
+
+			for (unsigned int subsampling : { 1, 2, 8 }) {
+				/*
+				 * RGB888 output gathers the statistics while
+				 * debayering, BGR888 output in a separate pass.
+				 */
+				SwIspStats fused;
+				SwIspStats separate;
+
+				if (process(inputCfg, input.get(), formats::RGB888,
+					    subsampling, &fused) != TestPass ||
+				    process(inputCfg, input.get(), formats::BGR888,
+					    subsampling, &separate) != TestPass)
+					return TestFail;
+
+				if (!fused.sumG_) {
+					cerr << format << " statistics are empty" << endl;
+					return TestFail;
+				}
+
+				if (fused.sumR_ != separate.sumR_ ||
+				    fused.sumG_ != separate.sumG_ ||
+				    fused.sumB_ != separate.sumB_ ||
+				    fused.yHistogram != separate.yHistogram) {
+					cerr << format << " statistics mismatch with subsampling "
+					     << subsampling << ": sums (" << fused.sumR_
+					     << ", " << fused.sumG_ << ", " << fused.sumB_
+					     << ") vs (" << separate.sumR_ << ", "
+					     << separate.sumG_ << ", " << separate.sumB_
+					     << ")" << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+private:
+	DebayerParams params_ = {};
+};
+
+TEST_REGISTER(DebayerStatsTest)
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Linaro Ltd
+ *
+ * Software ISP performance governor test
+ */
+
+#include <iostream>
+
+#include "governor.h"
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+using namespace std::literals::chrono_literals;
+
+class GovernorTest : public Test
+{
+protected:
+	static constexpr unsigned int kFrames = 300;
+
+	/* Feed frames at 30fps, and return the throttle level reached */
+	unsigned int feed(SwIspGovernor &governor, utils::Duration latency,
+			  unsigned int frames = kFrames)
+	{
+		for (unsigned int i = 0; i < frames; i++)
+			governor.update(33333us, latency);
+
+		return governor.level();
+	}
+
+	int run() override
+	{
+		SwIspGovernor governor;
+
+		/* Frames processed in time keep full quality. */
+		if (feed(governor, 10ms) != 0) {
+			cerr << "Throttled frames processed in time" << endl;
+			return TestFail;
+		}
+
+		/* Frames missing their deadline throttle up to the maximum. */
+		if (feed(governor, 50ms) != SwIspGovernor::kMaxLevel) {
+			cerr << "Failed to throttle late frames" << endl;
+			return TestFail;
+		}
+
+		/* High load without missed deadlines keeps the level. */
+		if (feed(governor, 25ms) != SwIspGovernor::kMaxLevel) {
+			cerr << "Unthrottled without headroom" << endl;
+			return TestFail;
+		}
+
+		/* Headroom brings back full quality. */
+		if (feed(governor, 5ms) != 0) {
+			cerr << "Failed to unthrottle with headroom" << endl;
+			return TestFail;
+		}
+
+		/* The level is limited to the maximum. */
+		SwIspGovernor limited(1);
+		if (feed(limited, 50ms) != 1) {
+			cerr << "Throttled above the maximum level" << endl;
+			return TestFail;
+		}
+
+		/* A maximum level of 0 disables the governor. */
+		SwIspGovernor disabled(0);
+		if (feed(disabled, 50ms) != 0) {
+			cerr << "Disabled governor throttled frames" << endl;
+			return TestFail;
+		}
+
+		/* Frames without a known interval are ignored. */
+		SwIspGovernor unknown;
+		for (unsigned int i = 0; i < kFrames; i++)
+			unknown.update(utils::Duration(0), 50ms);
+		if (unknown.level() != 0) {
+			cerr << "Throttled frames without interval" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(GovernorTest)
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Startup phase timing test
+ */
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "libcamera/internal/startup_profile.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+class StartupProfileTest : public Test
+{
+protected:
+	int run()
+	{
+		for (unsigned int i = 0; i < 2; i++) {
+			StartupProfile::Scope scope("test_match", "pipe0");
+			this_thread::sleep_for(10ms);
+		}
+
+		StartupProfile::record("test_enumeration", {}, 5ms);
+
+		vector<StartupProfile::Phase> phases = StartupProfile::phases();
+		if (phases.size() != 2) {
+			cerr << "Expected 2 phases, got " << phases.size() << endl;
+			return TestFail;
+		}
+
+		/* Phases with the same name and owner are accumulated. */
+		const StartupProfile::Phase &match = phases[0];
+		if (match.name != "test_match" || match.owner != "pipe0" ||
+		    match.count != 2 || match.duration < 20ms) {
+			cerr << "Invalid accumulated phase" << endl;
+			return TestFail;
+		}
+
+		const StartupProfile::Phase &enumeration = phases[1];
+		if (enumeration.name != "test_enumeration" ||
+		    !enumeration.owner.empty() || enumeration.count != 1 ||
+		    enumeration.duration != 5ms) {
+			cerr << "Invalid recorded phase" << endl;
+			return TestFail;
+		}
+
+		string summary = StartupProfile::toString();
+		if (summary.find("test_match [pipe0]") == string::npos ||
+		    summary.find("(2x)") == string::npos) {
+			cerr << "Invalid summary: " << summary << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(StartupProfileTest)
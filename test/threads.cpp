@@ -6,9 +6,13 @@
  */
 
 #include <chrono>
+#include <errno.h>
 #include <iostream>
 #include <memory>
 #include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
 #include <thread>
 #include <time.h>
 
@@ -66,6 +70,24 @@ private:
 	bool &cancelled_;
 };
 
+class AffinityThread : public Thread
+{
+public:
+	AffinityThread(const std::string &name, cpu_set_t &cpuset)
+		: Thread(name), cpuset_(cpuset)
+	{
+	}
+
+protected:
+	void run()
+	{
+		sched_getaffinity(0, sizeof(cpuset_), &cpuset_);
+	}
+
+private:
+	cpu_set_t &cpuset_;
+};
+
 class ThreadTest : public Test
 {
 protected:
@@ -165,6 +187,81 @@ protected:
 			return TestFail;
 		}
 
+		/* Test setting the CPU affinity before starting the thread. */
+		cpu_set_t cpuset;
+		if (sched_getaffinity(0, sizeof(cpuset), &cpuset) < 0) {
+			cout << "Failed to get CPU affinity" << endl;
+			return TestFail;
+		}
+
+		unsigned int cpu = 0;
+		while (!CPU_ISSET(cpu, &cpuset))
+			cpu++;
+
+		cpu_set_t expected;
+		CPU_ZERO(&expected);
+		CPU_SET(cpu, &expected);
+
+		cpu_set_t affinity;
+		thread = std::make_unique<AffinityThread>("affinity", affinity);
+
+		if (thread->name() != "affinity") {
+			cout << "Invalid thread name" << endl;
+			return TestFail;
+		}
+
+		if (thread->setAffinity({ cpu })) {
+			cout << "Failed to set CPU affinity" << endl;
+			return TestFail;
+		}
+
+		thread->start();
+		thread->wait();
+
+		if (!CPU_EQUAL(&affinity, &expected)) {
+			cout << "CPU affinity not applied" << endl;
+			return TestFail;
+		}
+
+		/* Test configuring the CPU affinity from the environment. */
+		std::string env = "affinity=" + std::to_string(cpu);
+		setenv("LIBCAMERA_THREAD_AFFINITY", env.c_str(), 1);
+
+		thread = std::make_unique<AffinityThread>("affinity", affinity);
+		thread->start();
+		thread->wait();
+
+		unsetenv("LIBCAMERA_THREAD_AFFINITY");
+
+		if (!CPU_EQUAL(&affinity, &expected)) {
+			cout << "CPU affinity not configured from environment" << endl;
+			return TestFail;
+		}
+
+		/* Test placing the thread according to its role. */
+		env = "critical=" + std::to_string(cpu);
+		setenv("LIBCAMERA_THREAD_PLACEMENT", env.c_str(), 1);
+
+		thread = std::make_unique<AffinityThread>("placement", affinity);
+		thread->setRole(Thread::Role::LatencyCritical);
+		thread->start();
+		thread->wait();
+
+		unsetenv("LIBCAMERA_THREAD_PLACEMENT");
+
+		if (!CPU_EQUAL(&affinity, &expected)) {
+			cout << "CPU placement not applied" << endl;
+			return TestFail;
+		}
+
+		/* Test invalid parameters. */
+		if (thread->setAffinity({}) != -EINVAL ||
+		    thread->setSchedulingPolicy(Thread::SchedulingPolicy::Fifo, 0) != -EINVAL ||
+		    thread->setSchedulingPolicy(Thread::SchedulingPolicy::Other, 1) != -EINVAL) {
+			cout << "Invalid parameters not rejected" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
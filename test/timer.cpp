@@ -137,6 +137,17 @@ protected:
 			return TestFail;
 		}
 
+		/* Timer restart with an earlier deadline. */
+		timer.start(1000ms);
+		timer.start(100ms);
+
+		dispatcher->processEvents();
+
+		if (timer.hasFailed()) {
+			cout << "Timer restart with earlier deadline test failed" << endl;
+			return TestFail;
+		}
+
 		/* Timer with absolute deadline. */
 		timer.start(std::chrono::steady_clock::now() + std::chrono::milliseconds(200));
 
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * libcamera V4L2 Subdevice format cache test
+ */
+
+#include <iostream>
+#include <memory>
+
+#include <libcamera/geometry.h>
+
+#include "libcamera/internal/v4l2_subdevice.h"
+
+#include "v4l2_subdevice_test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * Test that the formats and rectangles cached by the "Scaler" subdevice of the
+ * vimc media device track the state of the device, by comparing them with the
+ * values read by a second, uncached, instance.
+ */
+
+class CachedFormatsTest : public V4L2SubdeviceTest
+{
+protected:
+	int run() override;
+
+private:
+	int checkFormat(unsigned int pad, const char *step);
+	int checkCrop(const char *step);
+};
+
+int CachedFormatsTest::checkFormat(unsigned int pad, const char *step)
+{
+	V4L2Subdevice device(scaler_->entity());
+	if (device.open()) {
+		cerr << "Unable to open the second subdevice instance" << endl;
+		return TestFail;
+	}
+
+	V4L2SubdeviceFormat cached = {};
+	V4L2SubdeviceFormat actual = {};
+	if (scaler_->getFormat(pad, &cached) || device.getFormat(pad, &actual)) {
+		cerr << "Failed to get format on pad " << pad << endl;
+		return TestFail;
+	}
+
+	if (cached.code != actual.code || cached.size != actual.size) {
+		cerr << step << ": cached format " << cached << " on pad "
+		     << pad << " doesn't match " << actual << endl;
+		return TestFail;
+	}
+
+	return TestPass;
+}
+
+int CachedFormatsTest::checkCrop(const char *step)
+{
+	V4L2Subdevice device(scaler_->entity());
+	if (device.open()) {
+		cerr << "Unable to open the second subdevice instance" << endl;
+		return TestFail;
+	}
+
+	Rectangle cached;
+	Rectangle actual;
+	if (scaler_->getSelection(0, V4L2_SEL_TGT_CROP, &cached) ||
+	    device.getSelection(0, V4L2_SEL_TGT_CROP, &actual)) {
+		cerr << "Failed to get the crop rectangle" << endl;
+		return TestFail;
+	}
+
+	if (cached != actual) {
+		cerr << step << ": cached crop " << cached
+		     << " doesn't match " << actual << endl;
+		return TestFail;
+	}
+
+	return TestPass;
+}
+
+int CachedFormatsTest::run()
+{
+	V4L2SubdeviceFormat format = {};
+
+	/* Populate the cache. */
+	if (checkFormat(0, "Initial") || checkFormat(1, "Initial") ||
+	    checkCrop("Initial"))
+		return TestFail;
+
+	/* Setting the sink format shall propagate to the source pad. */
+	if (scaler_->getFormat(0, &format))
+		return TestFail;
+
+	format.size = format.size == Size(640, 480) ? Size(320, 240) : Size(640, 480);
+	if (scaler_->setFormat(0, &format)) {
+		cerr << "Failed to set the sink format" << endl;
+		return TestFail;
+	}
+
+	if (checkFormat(0, "Sink format") || checkFormat(1, "Sink format") ||
+	    checkCrop("Sink format"))
+		return TestFail;
+
+	/* Setting the same format again shall return the applied format. */
+	V4L2SubdeviceFormat applied = format;
+	if (scaler_->setFormat(0, &format) ||
+	    format.code != applied.code || format.size != applied.size) {
+		cerr << "Failed to set the same sink format" << endl;
+		return TestFail;
+	}
+
+	/* Setting the crop rectangle shall propagate to the source pad. */
+	Rectangle crop{ 0, 0, format.size / 2 };
+	if (scaler_->setSelection(0, V4L2_SEL_TGT_CROP, &crop)) {
+		cerr << "Failed to set the crop rectangle" << endl;
+		return TestFail;
+	}
+
+	if (checkFormat(0, "Crop") || checkFormat(1, "Crop") || checkCrop("Crop"))
+		return TestFail;
+
+	/*
+	 * Changes made by other users while the media device is unlocked
+	 * shall be noticed once it is locked again.
+	 */
+	{
+		V4L2Subdevice device(scaler_->entity());
+		if (device.open())
+			return TestFail;
+
+		format.size = format.size == Size(640, 480) ? Size(320, 240) : Size(640, 480);
+		if (device.setFormat(0, &format)) {
+			cerr << "Failed to set the sink format on the second instance" << endl;
+			return TestFail;
+		}
+	}
+
+	if (!media_->acquire() || !media_->lock()) {
+		cerr << "Failed to lock the media device" << endl;
+		return TestFail;
+	}
+
+	int ret = checkFormat(0, "Lock") || checkFormat(1, "Lock") ||
+		  checkCrop("Lock") ? TestFail : TestPass;
+
+	media_->unlock();
+	media_->release();
+
+	return ret;
+}
+
+TEST_REGISTER(CachedFormatsTest)
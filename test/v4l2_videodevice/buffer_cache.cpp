@@ -155,6 +155,105 @@ public:
 		return TestPass;
 	}
 
+	/*
+	 * Test that the counters account for the first use of each buffer as
+	 * a miss, and for the use of more buffers than entries as evictions.
+	 */
+	int testCounters(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
+	{
+		const unsigned int numBuffers = buffers.size();
+		V4L2BufferCache cache(numBuffers);
+
+		if (testSequential(&cache, buffers) != TestPass)
+			return TestFail;
+
+		const V4L2BufferCache::Counters &counters = cache.counters();
+		if (counters.hits != numBuffers * 99 ||
+		    counters.misses != numBuffers || counters.evictions != 0) {
+			std::cout << "Unexpected counters after sequential run: "
+				  << counters.hits << " hits, "
+				  << counters.misses << " misses, "
+				  << counters.evictions << " evictions"
+				  << std::endl;
+			return TestFail;
+		}
+
+		/* Alternate between two halves of a cache with half the entries. */
+		V4L2BufferCache cacheHalf(numBuffers / 2);
+
+		for (unsigned int i = 0; i < numBuffers * 2; i++) {
+			int index = cacheHalf.get(*buffers[i % numBuffers].get());
+			if (index < 0)
+				return TestFail;
+
+			cacheHalf.put(index);
+		}
+
+		const V4L2BufferCache::Counters &halfCounters = cacheHalf.counters();
+		if (halfCounters.hits != 0 || halfCounters.misses != numBuffers * 2 ||
+		    halfCounters.evictions != numBuffers * 2 - numBuffers / 2) {
+			std::cout << "Unexpected counters with a small cache: "
+				  << halfCounters.hits << " hits, "
+				  << halfCounters.misses << " misses, "
+				  << halfCounters.evictions << " evictions"
+				  << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Test that entries added to a full cache are used for new buffers
+	 * without disturbing the buffers in use.
+	 */
+	int testAddEntries(const std::vector<std::unique_ptr<FrameBuffer>> &buffers)
+	{
+		const unsigned int numBuffers = buffers.size();
+		V4L2BufferCache cache(numBuffers / 2);
+		std::vector<int> indexes;
+
+		for (unsigned int i = 0; i < numBuffers / 2; i++)
+			indexes.push_back(cache.get(*buffers[i].get()));
+
+		if (cache.get(*buffers[numBuffers / 2].get()) != -ENOENT) {
+			std::cout << "Full cache returned an entry" << std::endl;
+			return TestFail;
+		}
+
+		cache.addEntries(numBuffers - numBuffers / 2);
+		if (cache.size() != numBuffers)
+			return TestFail;
+
+		for (unsigned int i = numBuffers / 2; i < numBuffers; i++) {
+			int index = cache.get(*buffers[i].get());
+			if (index < static_cast<int>(numBuffers / 2)) {
+				std::cout << "Unexpected index " << index
+					  << " for buffer " << i << std::endl;
+				return TestFail;
+			}
+
+			indexes.push_back(index);
+		}
+
+		for (unsigned int i = 0; i < numBuffers; i++)
+			cache.put(indexes[i]);
+
+		if (!cache.isEmpty())
+			return TestFail;
+
+		/* All buffers shall now hit. */
+		for (unsigned int i = 0; i < numBuffers; i++) {
+			if (cache.get(*buffers[i].get()) != indexes[i]) {
+				std::cout << "Buffer " << i << " missed after growth"
+					  << std::endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
 	int init() override
 	{
 		std::random_device rd;
@@ -240,6 +339,14 @@ public:
 		if (testIsEmpty(buffers) != TestPass)
 			return TestFail;
 
+		/* Test the instrumentation counters. */
+		if (testCounters(buffers) != TestPass)
+			return TestFail;
+
+		/* Test growing the cache while entries are in use. */
+		if (testAddEntries(buffers) != TestPass)
+			return TestFail;
+
 		return TestPass;
 	}
 
@@ -83,6 +83,14 @@ protected:
 
 		std::cout << "Processed " << frames << " frames" << std::endl;
 
+		V4L2VideoDevice::Stats stats = capture_->stats();
+		if (stats.dequeued != frames || stats.queued != frames + bufferCount ||
+		    stats.queueDepth != bufferCount || stats.errors) {
+			std::cout << "Invalid device statistics: "
+				  << stats.toString() << std::endl;
+			return TestFail;
+		}
+
 		ret = capture_->streamOff();
 		if (ret)
 			return TestFail;
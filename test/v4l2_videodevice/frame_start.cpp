@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024, Ideas on Board Oy
+ *
+ * Synthesized start of frame events test
+ */
+
+#include <iostream>
+
+#include <libcamera/framebuffer.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "libcamera/internal/frame_start_monitor.h"
+
+#include "v4l2_videodevice_test.h"
+
+using namespace libcamera;
+using namespace std::chrono_literals;
+
+class FrameStartTest : public V4L2VideoDeviceTest
+{
+public:
+	FrameStartTest()
+		: V4L2VideoDeviceTest("vimc", "Raw Capture 0"), frames_(0),
+		  events_(0), lastSequence_(0), ordered_(true)
+	{
+	}
+
+	void receiveBuffer(FrameBuffer *buffer)
+	{
+		frames_++;
+		capture_->queueBuffer(buffer);
+	}
+
+	void frameStart(uint32_t sequence)
+	{
+		if (events_ && sequence <= lastSequence_)
+			ordered_ = false;
+
+		lastSequence_ = sequence;
+		events_++;
+	}
+
+protected:
+	int run()
+	{
+		const unsigned int bufferCount = 8;
+		const unsigned int nFrames = 30;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		Timer timeout;
+		int ret;
+
+		ret = capture_->allocateBuffers(bufferCount, &buffers_);
+		if (ret < 0) {
+			std::cout << "Failed to allocate buffers" << std::endl;
+			return TestFail;
+		}
+
+		capture_->bufferReady.connect(this, &FrameStartTest::receiveBuffer);
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+			if (capture_->queueBuffer(buffer.get())) {
+				std::cout << "Failed to queue buffer" << std::endl;
+				return TestFail;
+			}
+		}
+
+		/* vimc doesn't emit start of frame events, they're synthesized. */
+		FrameStartMonitor monitor({ capture_ }, capture_);
+		monitor.frameStart.connect(this, &FrameStartTest::frameStart);
+
+		ret = monitor.start();
+		if (ret) {
+			std::cout << "Failed to start the monitor" << std::endl;
+			return TestFail;
+		}
+
+		if (!monitor.synthesized()) {
+			std::cout << "Start of frame events not synthesized" << std::endl;
+			return TestFail;
+		}
+
+		ret = capture_->streamOn();
+		if (ret)
+			return TestFail;
+
+		timeout.start(500ms * nFrames);
+		while (timeout.isRunning() && frames_ < nFrames)
+			dispatcher->processEvents();
+
+		monitor.stop();
+
+		ret = capture_->streamOff();
+		if (ret)
+			return TestFail;
+
+		if (frames_ < nFrames) {
+			std::cout << "Failed to capture " << nFrames
+				  << " frames within timeout." << std::endl;
+			return TestFail;
+		}
+
+		/* The event of the frame following the last one may be pending. */
+		if (events_ + 1 < frames_) {
+			std::cout << "Missing start of frame events: " << events_
+				  << " for " << frames_ << " frames" << std::endl;
+			return TestFail;
+		}
+
+		if (!ordered_) {
+			std::cout << "Start of frame events out of order" << std::endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	unsigned int frames_;
+	unsigned int events_;
+	uint32_t lastSequence_;
+	bool ordered_;
+};
+
+TEST_REGISTER(FrameStartTest)
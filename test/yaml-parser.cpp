@@ -6,10 +6,13 @@
  */
 
 #include <array>
+#include <dirent.h>
 #include <iostream>
 #include <map>
+#include <stdlib.h>
 #include <string>
 #include <unistd.h>
+#include <vector>
 
 #include <libcamera/base/file.h>
 #include <libcamera/base/utils.h>
@@ -603,6 +606,109 @@ protected:
 			return TestFail;
 		}
 
+		return testCache(*root);
+	}
+
+	bool compareObjects(const YamlObject &a, const YamlObject &b)
+	{
+		if (a.isValue() != b.isValue() || a.isList() != b.isList() ||
+		    a.isDictionary() != b.isDictionary() || a.size() != b.size())
+			return false;
+
+		if (a.isValue())
+			return a.get<string>() == b.get<string>();
+
+		if (a.isList()) {
+			for (size_t i = 0; i < a.size(); i++) {
+				if (!compareObjects(a[i], b[i]))
+					return false;
+			}
+		}
+
+		if (a.isDictionary()) {
+			for (const auto &[key, value] : a.asDict()) {
+				if (!b.contains(key) || !compareObjects(value, b[key]))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	vector<string> cacheFiles()
+	{
+		vector<string> files;
+
+		DIR *dir = opendir(cacheDir_.c_str());
+		if (!dir)
+			return files;
+
+		while (struct dirent *ent = readdir(dir)) {
+			string name = ent->d_name;
+			if (name != "." && name != "..")
+				files.push_back(cacheDir_ + "/" + name);
+		}
+
+		closedir(dir);
+		return files;
+	}
+
+	int testCache(const YamlObject &reference)
+	{
+		cacheDir_ = "/tmp/libcamera.test.XXXXXX";
+		if (!mkdtemp(&cacheDir_.front())) {
+			cerr << "Failed to create cache directory" << std::endl;
+			return TestFail;
+		}
+
+		setenv("LIBCAMERA_YAML_CACHE_DIR", cacheDir_.c_str(), 1);
+
+		/* The first parse populates the cache, the second uses it. */
+		for (unsigned int i = 0; i < 2; i++) {
+			File file{ testYamlFile_ };
+			if (!file.open(File::OpenModeFlag::ReadOnly)) {
+				cerr << "Fail to open test YAML file" << std::endl;
+				return TestFail;
+			}
+
+			std::unique_ptr<YamlObject> root = YamlParser::parse(file);
+			if (!root || !compareObjects(reference, *root)) {
+				cerr << "Cached YAML content differs from parsed content"
+				     << std::endl;
+				return TestFail;
+			}
+		}
+
+		if (cacheFiles().size() != 1) {
+			cerr << "YAML cache not populated" << std::endl;
+			return TestFail;
+		}
+
+		/* Modifying the YAML file shall invalidate the cache. */
+		string yaml = "string: modified\n";
+		File file{ testYamlFile_ };
+		unlink(testYamlFile_.c_str());
+		if (!file.open(File::OpenModeFlag::WriteOnly) ||
+		    file.write({ reinterpret_cast<const uint8_t *>(yaml.data()),
+				 yaml.size() }) != static_cast<ssize_t>(yaml.size())) {
+			cerr << "Failed to modify test YAML file" << std::endl;
+			return TestFail;
+		}
+		file.close();
+
+		if (!file.open(File::OpenModeFlag::ReadOnly)) {
+			cerr << "Fail to open modified YAML file" << std::endl;
+			return TestFail;
+		}
+
+		std::unique_ptr<YamlObject> root = YamlParser::parse(file);
+		if (!root || (*root)["string"].get<string>("") != "modified") {
+			cerr << "Stale YAML cache used" << std::endl;
+			return TestFail;
+		}
+
+		unsetenv("LIBCAMERA_YAML_CACHE_DIR");
+
 		return TestPass;
 	}
 
@@ -610,11 +716,18 @@ protected:
 	{
 		unlink(testYamlFile_.c_str());
 		unlink(invalidYamlFile_.c_str());
+
+		if (!cacheDir_.empty()) {
+			for (const string &name : cacheFiles())
+				unlink(name.c_str());
+			rmdir(cacheDir_.c_str());
+		}
 	}
 
 private:
 	std::string testYamlFile_;
 	std::string invalidYamlFile_;
+	std::string cacheDir_;
 };
 
 TEST_REGISTER(YamlParserTest)
@@ -192,6 +192,12 @@ def MethodParameters(method):
         params.append(f'{GetNameForElement(param)} *{param.mojom_name}')
     return params
 
+def MethodInputParameters(method):
+    return MethodParameters(method)[:len(method.parameters)]
+
+def MethodOutputParameters(method):
+    return MethodParameters(method)[len(method.parameters):]
+
 def MethodReturnValue(method):
     if method.response_parameters is None or len(method.response_parameters) == 0:
         return 'void'
@@ -444,7 +450,9 @@ class Generator(generator.Generator):
             'is_scoped': IsScoped,
             'is_str': IsStr,
             'method_input_has_fd': MethodInputHasFd,
+            'method_input_parameters': MethodInputParameters,
             'method_output_has_fd': MethodOutputHasFd,
+            'method_output_parameters': MethodOutputParameters,
             'method_param_names': MethodParamNames,
             'method_param_inputs': MethodParamInputs,
             'method_param_outputs': MethodParamOutputs,
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Copyright (C) 2024, Google Inc.
+#
+# Decode libcamera binary log files
+#
+# Binary log files are written when LIBCAMERA_LOG_FORMAT is set to "binary".
+# This script formats them in the same way as libcamera text log files.
+
+import argparse
+import struct
+import sys
+
+MAGIC = b'LCBINLOG'
+VERSION = 1
+
+RECORD_CATEGORY = 1
+RECORD_FILE = 2
+RECORD_MESSAGE = 3
+RECORD_TEXT = 4
+
+SEVERITIES = ['DEBUG', ' INFO', ' WARN', 'ERROR', 'FATAL']
+
+
+def format_timestamp(nsecs):
+    secs = nsecs // 1000000000
+    return f'{secs // 3600}:{secs // 60 % 60:02}:{secs % 60:02}.{nsecs % 1000000000:09}'
+
+
+def decode(data, out):
+    if data[:len(MAGIC)] != MAGIC:
+        raise ValueError('Invalid binary log magic')
+
+    pos = len(MAGIC)
+
+    # Detect the byte order from the version.
+    endian = '<'
+    if struct.unpack_from('<I', data, pos)[0] != VERSION:
+        endian = '>'
+        if struct.unpack_from('>I', data, pos)[0] != VERSION:
+            raise ValueError('Unsupported binary log version')
+    pos += 4
+
+    categories = {}
+    files = {}
+
+    while pos + 5 <= len(data):
+        rtype, size = struct.unpack_from(endian + 'BI', data, pos)
+        pos += 5
+
+        payload = data[pos:pos + size]
+        pos += size
+
+        if len(payload) < size:
+            print('Truncated record', file=sys.stderr)
+            break
+
+        if rtype in (RECORD_CATEGORY, RECORD_FILE):
+            rid, length = struct.unpack_from(endian + 'IH', payload)
+            name = payload[6:6 + length].decode(errors='replace')
+            if rtype == RECORD_CATEGORY:
+                categories[rid] = name
+            else:
+                files[rid] = name
+
+        elif rtype == RECORD_MESSAGE:
+            fmt = endian + 'QIIIIBHI'
+            (timestamp, tid, category, file, line, severity, prefix_len,
+             msg_len) = struct.unpack_from(fmt, payload)
+            offset = struct.calcsize(fmt)
+
+            prefix = payload[offset:offset + prefix_len].decode(errors='replace')
+            offset += prefix_len
+            msg = payload[offset:offset + msg_len].decode(errors='replace')
+
+            severity = SEVERITIES[severity] if severity < len(SEVERITIES) else 'UNKWN'
+
+            line = (f'[{format_timestamp(timestamp)}] [{tid}] {severity} '
+                    f'{categories.get(category, "?")} '
+                    f'{files.get(file, "?")}:{line} ')
+            if prefix:
+                line += prefix + ': '
+            out.write(line + msg)
+
+        elif rtype == RECORD_TEXT:
+            length = struct.unpack_from(endian + 'I', payload)[0]
+            out.write(payload[4:4 + length].decode(errors='replace'))
+
+        # Skip unknown record types.
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description='Decode a libcamera binary log file')
+    parser.add_argument('-o', '--output', type=str,
+                        help='Output file (defaults to stdout)')
+    parser.add_argument('input', type=str,
+                        help='Binary log file')
+    args = parser.parse_args(argv[1:])
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+
+    try:
+        decode(data, out)
+    except (ValueError, struct.error) as e:
+        print(f'Failed to decode {args.input}: {e}', file=sys.stderr)
+        return 1
+    finally:
+        if args.output:
+            out.close()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
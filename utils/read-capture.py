@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Copyright (C) 2024, Ideas on Board Oy
+#
+# Read cam capture container files
+#
+# Container files are written by cam when the file name passed to the --file
+# option ends with '.lcap'. This script lists the frames they contain and
+# extracts individual frames, using the index at the end of the file.
+
+import argparse
+import struct
+import sys
+
+MAGIC = b'LCSTREAM'
+VERSION = 1
+
+HEADER_FORMAT = '8sIIIIQIIIIQQ'
+ENTRY_FORMAT = 'QQIIII'
+
+
+def fourcc_to_str(fourcc):
+    return ''.join(chr((fourcc >> (8 * i)) & 0xff) for i in range(4))
+
+
+class Capture(object):
+    def __init__(self, f):
+        self.file = f
+
+        data = f.read(struct.calcsize('<' + HEADER_FORMAT))
+        if data[:len(MAGIC)] != MAGIC:
+            raise ValueError('Invalid capture magic')
+
+        # Detect the byte order from the version.
+        self.endian = '<'
+        if struct.unpack_from('<I', data, len(MAGIC))[0] != VERSION:
+            self.endian = '>'
+            if struct.unpack_from('>I', data, len(MAGIC))[0] != VERSION:
+                raise ValueError('Unsupported capture version')
+
+        (_, _, _, self.alignment, self.fourcc, self.modifier, self.width,
+         self.height, self.stride, self.num_planes, self.frame_count,
+         index_offset) = struct.unpack(self.endian + HEADER_FORMAT, data)
+
+        if not index_offset:
+            raise ValueError('Capture has no index, was it interrupted?')
+
+        f.seek(index_offset)
+        self.frames = self._parse_index(f.read())
+
+        if len(self.frames) != self.frame_count:
+            raise ValueError(f'Index holds {len(self.frames)} frames instead of {self.frame_count}')
+
+    def _parse_index(self, data):
+        frames = []
+        pos = 0
+
+        entry_size = struct.calcsize(self.endian + ENTRY_FORMAT)
+
+        while pos + entry_size <= len(data):
+            offset, timestamp, sequence, status, num_planes, metadata_size = \
+                struct.unpack_from(self.endian + ENTRY_FORMAT, data, pos)
+            pos += entry_size
+
+            planes = struct.unpack_from(f'{self.endian}{num_planes}I', data, pos)
+            pos += 4 * num_planes
+
+            metadata = data[pos:pos + metadata_size].decode('utf-8')
+            pos += metadata_size
+
+            # Entries are padded to 8 bytes.
+            pos = (pos + 7) // 8 * 8
+
+            frames.append({
+                'offset': offset,
+                'timestamp': timestamp,
+                'sequence': sequence,
+                'status': status,
+                'planes': planes,
+                'metadata': metadata,
+            })
+
+        return frames
+
+    def read(self, index):
+        frame = self.frames[index]
+        self.file.seek(frame['offset'])
+        return [self.file.read(size) for size in frame['planes']]
+
+
+def list_frames(capture, show_metadata):
+    print(f'{fourcc_to_str(capture.fourcc)} {capture.width}x{capture.height} '
+          f'stride {capture.stride} modifier {capture.modifier:#x}, '
+          f'{capture.frame_count} frames')
+
+    for index, frame in enumerate(capture.frames):
+        ts = frame['timestamp']
+        planes = '/'.join(str(size) for size in frame['planes'])
+        print(f'{index}: {ts // 1000000000}.{ts // 1000 % 1000000:06} '
+              f'seq: {frame["sequence"]:06} status: {frame["status"]} '
+              f'bytesused: {planes}')
+
+        if show_metadata:
+            for line in frame['metadata'].splitlines():
+                print(f'\t{line}')
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description='Read a cam capture container file')
+    parser.add_argument('-m', '--metadata', action='store_true',
+                        help='Print the metadata of the frames')
+    parser.add_argument('-x', '--extract', type=int, metavar='INDEX',
+                        help='Extract the frame at INDEX, with the planes concatenated')
+    parser.add_argument('-o', '--output', type=str,
+                        help='Output file for the extracted frame (defaults to stdout)')
+    parser.add_argument('input', type=str,
+                        help='Capture container file')
+    args = parser.parse_args(argv[1:])
+
+    with open(args.input, 'rb') as f:
+        try:
+            capture = Capture(f)
+        except (ValueError, struct.error) as e:
+            print(f'Failed to read {args.input}: {e}', file=sys.stderr)
+            return 1
+
+        if args.extract is None:
+            list_frames(capture, args.metadata)
+            return 0
+
+        if not 0 <= args.extract < len(capture.frames):
+            print(f'Invalid frame index {args.extract}', file=sys.stderr)
+            return 1
+
+        planes = capture.read(args.extract)
+
+    out = open(args.output, 'wb') if args.output else sys.stdout.buffer
+    try:
+        for plane in planes:
+            out.write(plane)
+    finally:
+        if args.output:
+            out.close()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))